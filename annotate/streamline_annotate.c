@@ -1,5 +1,5 @@
 /**
- * Copyright (C) 2014-2021 by Arm Limited. All rights reserved.
+ * Copyright (C) 2014-2022 by Arm Limited. All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
  * modification, are permitted provided that the following conditions
@@ -47,10 +47,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/prctl.h>
 #include <sys/socket.h>
 #include <sys/syscall.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <time.h>
 #include <unistd.h>
@@ -64,6 +66,8 @@
 #else
 #define STREAMLINE_ANNOTATE_PARENT "\0streamline-annotate-parent"
 #define STREAMLINE_ANNOTATE "\0streamline-annotate"
+/* Accepts a thread's ring instead of its data */
+#define STREAMLINE_ANNOTATE_SHARED "\0streamline-annotate-shared"
 #endif
 
 static const char gator_annotate_handshake[] = "ANNOTATE 5\n";
@@ -85,26 +89,94 @@ static const uint8_t HEADER_CAM_VIEW_NAME = 0x0d;
 static const uint8_t HEADER_CAM_JOB_START = 0x0e;
 static const uint8_t HEADER_CAM_JOB_SET_DEPS = 0x0f;
 static const uint8_t HEADER_CAM_JOB_STOP = 0x10;
+/* Handled by gatord, which expands interned strings before forwarding the data */
+static const uint8_t HEADER_INTERN_STRING = 0x80;
+static const uint8_t HEADER_INTERNED = 0x81;
+/* Handled by gatord, which expands the jobs into HEADER_CAM_JOB messages before forwarding the data */
+static const uint8_t HEADER_CAM_JOB_BATCH = 0x82;
+
+/*
+ * The messages on the parent connection. gatord writes a single zero byte before closing it, or the limits of the
+ * channel annotations (two uint32s, the rate and the sampling), to which the library replies with the numbers of
+ * channel annotations suppressed so far (two uint64s, by the rate and by the sampling).
+ */
+static const uint8_t PARENT_CHANNEL_LIMITS = 0x01;
+static const uint8_t PARENT_SUPPRESSED = 0x01;
+#define PARENT_CHANNEL_LIMITS_SIZE (1 + 2 * sizeof(uint32_t))
+#define PARENT_SUPPRESSED_SIZE (1 + 2 * sizeof(uint64_t))
 
 static const uint32_t SIZE_COLOR = 4;
 static const uint32_t MAXSIZE_PACK_INT = 5;
 static const uint32_t MAXSIZE_PACK_LONG = 10;
+/* The header and id of an interned message that precede its original fields */
+static const uint32_t MAXSIZE_INTERNED_PREFIX = 1 + MAXSIZE_PACK_INT;
+static const uint32_t MAXSIZE_INTERNED_STRING = THREAD_BUFFER_SIZE / 4;
+/* The jobs of a batch are split into messages of up to this size, which gatord must buffer to expand */
+static const uint32_t MAXSIZE_CAM_JOB_BATCH = THREAD_BUFFER_SIZE / 4;
 
 static const uint64_t NS_PER_S = 1000000000;
 
+/* How long a thread waits for gatord to make space in a shared ring before checking again */
+#define SHARED_RING_POLL_NS (NS_PER_S / 1000)
+/* The longest gator_annotate_flush waits for gatord to drain the shared rings */
+#define SHARED_RING_FLUSH_NS NS_PER_S
+/* The channels whose limits each thread tracks at once, as the channels that map to the same slot take it in turn */
+#define CHANNEL_LIMIT_SLOTS 32
+/* The timer is converted relative to the last anchor; beyond this the conversion may overflow so the clock is read */
+#define ARCH_TIMER_MAX_DELTA_NS NS_PER_S
+
+/*
+ * The buffer of annotations written by a thread.
+ *
+ * When using the shared memory transport, the ring is mapped into gatord which reads it directly, so this layout is
+ * part of the protocol and must match annotation_shared_ring_t in gatord. The positions are in separate cache lines
+ * as one is written by the thread and the other by the reader.
+ */
+struct gator_ring {
+    uint32_t write_pos;
+    char write_pad[64 - sizeof(uint32_t)];
+    uint32_t read_pos;
+    char read_pad[64 - sizeof(uint32_t)];
+    char buf[THREAD_BUFFER_SIZE];
+};
+
+/* The rate and sampling state of a channel of a thread */
+struct gator_channel_limit {
+    /* The start of the current second, within which count annotations have been kept */
+    uint64_t window_start;
+    uint32_t channel;
+    uint32_t count;
+    bool used;
+    /* Set when the open annotation was suppressed, so that its end is too */
+    bool suppressed;
+};
+
 struct gator_thread {
     struct gator_thread * next;
     const char * oob_data;
-    /* oob_data must be written before oob_length */
+    /* The copy of the data that oob_data points into when it is sent asynchronously, freed once sent */
+    char * oob_copy;
+    /* The position in the ring that the data follows; the ring after it is only sent once the data has been */
+    uint32_t oob_pos;
+    /* oob_data, oob_copy and oob_pos must be written before oob_length */
     size_t oob_length;
     /* Posted when data is sent */
     sem_t sem;
     int fd;
     int tid;
-    uint32_t write_pos;
-    uint32_t read_pos;
+    /* The memfd the ring is allocated in when it can be shared with gatord, otherwise -1 */
+    int ring_fd;
+    struct gator_ring * ring;
+    /* The interned strings up to this id have been sent on the current connection */
+    uint32_t interned_sent;
     bool exited;
-    char buf[THREAD_BUFFER_SIZE];
+    /* Set when gatord reads the ring directly, so the sender thread only maintains the connection */
+    bool shared;
+    /* Set on each new connection, as gatord keeps the interned strings per connection */
+    bool resend_interned;
+    /* The state of the generator of random numbers that the channel annotations are sampled with */
+    uint32_t sample_seed;
+    struct gator_channel_limit channel_limits[CHANNEL_LIMIT_SLOTS];
 };
 
 struct gator_counter {
@@ -144,11 +216,20 @@ struct gator_cam_name {
     uint32_t view_uid;
 };
 
+struct gator_interned {
+    struct gator_interned * next;
+    const char * str;
+    uint32_t str_size;
+    uint32_t id;
+};
+
 struct gator_state {
     struct gator_thread * threads;
     struct gator_counter * counters;
     struct gator_cam_track * cam_tracks;
     struct gator_cam_name * cam_names;
+    /* Newest first, so the ids are in descending order */
+    struct gator_interned * interned;
     /* Post to request asynchronous send of data */
     sem_t sender_sem;
     /* Post to request synchronous send of data */
@@ -161,9 +242,61 @@ struct gator_state {
     bool capturing;
     bool forked;
     bool resend_state;
+    /* Set when the threads' rings should be shared with gatord rather than sent over their sockets */
+    bool use_shared_memory;
+    /* Set when visual annotations are copied and sent by the sender thread rather than waited for */
+    bool visual_async;
+    /* Larger visual annotations are dropped, unless zero */
+    uint32_t visual_max_bytes;
+    /* Visual annotations that follow the last one sooner than this are dropped, unless zero */
+    uint64_t visual_min_interval;
+    /* The time of the last visual annotation that was not dropped */
+    uint64_t visual_last;
+    /* Set once a dropped visual annotation has been reported */
+    bool visual_drop_reported;
+    /* Channel annotations beyond this many per second, on each channel of each thread, are suppressed, unless zero */
+    uint32_t channel_max_rate;
+    /* Only one in this many channel annotations, chosen at random, is kept, unless zero or one */
+    uint32_t channel_sample;
+    /* The limits from the environment, which apply unless gatord sets its own */
+    uint32_t channel_max_rate_default;
+    uint32_t channel_sample_default;
+    /* The numbers of channel annotations suppressed by the rate and by the sampling */
+    uint64_t channel_rate_limited;
+    uint64_t channel_sampled_out;
+    /* The total last reported to gatord, and when */
+    uint64_t channel_suppressed_reported;
+    uint64_t channel_report_time;
+    /* Set once a suppressed channel annotation has been logged */
+    bool channel_suppress_logged;
+    /* Set once gatord has sent the limits, so is known to read the replies */
+    bool parent_reads;
+    /* The part of a message from gatord read so far */
+    char parent_buf[PARENT_CHANNEL_LIMITS_SIZE];
+    uint32_t parent_buf_length;
+};
+
+/*
+ * Converts the arch timer into CLOCK_MONOTONIC_RAW, which the kernel derives from the same counter, using a recent
+ * reading of both. The sender thread refreshes the anchor, so writes to it are guarded by a sequence count which is odd
+ * while it is being written.
+ */
+struct gator_arch_timer {
+    uint32_t seq;
+    uint64_t anchor_counter;
+    uint64_t anchor_ns;
+    /* Nanoseconds per tick, as a 32.32 fixed point value */
+    uint64_t mult;
+    uint64_t max_delta;
+    bool enabled;
 };
 
 static struct gator_state gator_state;
+static struct gator_arch_timer gator_arch_timer;
+/* Serializes adding interned strings, so each string gets exactly one id */
+static pthread_mutex_t gator_interned_mutex = PTHREAD_MUTEX_INITIALIZER;
+/* Stands in for the shared rings that a forked child does not inherit */
+static struct gator_ring gator_orphan_ring;
 /* Intentionally exported */
 uint8_t gator_dont_mangle_keys;
 
@@ -199,8 +332,14 @@ void gator_annotate_fork_child(void)
     struct gator_thread * thread;
     pthread_setspecific(gator_state.key, NULL);
     for (thread = gator_state.threads; thread != NULL; thread = thread->next) {
+        if (thread->ring_fd >= 0) {
+            close(thread->ring_fd);
+            thread->ring_fd = -1;
+            thread->ring = &gator_orphan_ring;
+            thread->shared = false;
+        }
         thread->exited = true;
-        thread->read_pos = thread->write_pos;
+        thread->ring->read_pos = thread->ring->write_pos;
     }
 
     gator_state.forked = true;
@@ -234,15 +373,109 @@ static uint64_t gator_time(const clockid_t clk_id)
     return NS_PER_S * ts.tv_sec + ts.tv_nsec;
 }
 
-uint64_t gator_get_time(void)
-{
 #ifndef CLOCK_MONOTONIC_RAW
-    /* Android doesn't have this defined but it was added in Linux 2.6.28 */
+/* Android doesn't have this defined but it was added in Linux 2.6.28 */
 #define CLOCK_MONOTONIC_RAW 4
 #endif
+
+static uint64_t gator_read_cntfrq(void)
+{
+#if defined(__aarch64__)
+    uint64_t frequency;
+    __asm__ volatile("mrs %0, CNTFRQ_EL0" : "=r"(frequency));
+    return frequency;
+#elif defined(__arm__)
+    uint32_t frequency;
+    __asm__ volatile("mrc p15, 0, %0, c14, c0, 0" : "=r"(frequency));
+    return frequency;
+#else
+    return 0;
+#endif
+}
+
+static uint64_t gator_read_cntvct(void)
+{
+#if defined(__aarch64__)
+    uint64_t count;
+    __asm__ volatile("isb; mrs %0, CNTVCT_EL0" : "=r"(count)::"memory");
+    return count;
+#elif defined(__arm__)
+    uint32_t low;
+    uint32_t high;
+    __asm__ volatile("isb; mrrc p15, 1, %0, %1, c14" : "=r"(low), "=r"(high)::"memory");
+    return ((uint64_t) high << 32) | low;
+#else
+    return 0;
+#endif
+}
+
+static void gator_arch_timer_anchor(void)
+{
+    const uint64_t before = gator_read_cntvct();
+    const uint64_t ns = gator_time(CLOCK_MONOTONIC_RAW);
+    const uint64_t after = gator_read_cntvct();
+
+    const uint32_t seq = gator_arch_timer.seq;
+    __atomic_store_n(&gator_arch_timer.seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&gator_arch_timer.anchor_counter, before + (after - before) / 2, __ATOMIC_RELAXED);
+    __atomic_store_n(&gator_arch_timer.anchor_ns, ns, __ATOMIC_RELAXED);
+    __atomic_store_n(&gator_arch_timer.seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+static void gator_arch_timer_setup(void)
+{
+    const uint64_t frequency = gator_read_cntfrq();
+    if (frequency == 0) {
+        LOG(LOG_ERROR, "The arch timer is not available, annotations will be timestamped using clock_gettime");
+        return;
+    }
+
+    gator_arch_timer.mult = (NS_PER_S << 32) / frequency;
+    gator_arch_timer.max_delta = (frequency * ARCH_TIMER_MAX_DELTA_NS) / NS_PER_S;
+    gator_arch_timer_anchor();
+    __atomic_store_n(&gator_arch_timer.enabled, true, __ATOMIC_RELEASE);
+}
+
+uint64_t gator_get_time(void)
+{
+    if (__atomic_load_n(&gator_arch_timer.enabled, __ATOMIC_ACQUIRE)) {
+        const uint32_t seq = __atomic_load_n(&gator_arch_timer.seq, __ATOMIC_ACQUIRE);
+        const uint64_t anchor_counter = __atomic_load_n(&gator_arch_timer.anchor_counter, __ATOMIC_RELAXED);
+        const uint64_t anchor_ns = __atomic_load_n(&gator_arch_timer.anchor_ns, __ATOMIC_RELAXED);
+        const uint64_t delta = gator_read_cntvct() - anchor_counter;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        /* Otherwise the anchor changed while it was being read, or is too old, so just read the clock */
+        if ((seq & 1) == 0 && __atomic_load_n(&gator_arch_timer.seq, __ATOMIC_RELAXED) == seq &&
+            delta < gator_arch_timer.max_delta) {
+            return anchor_ns + ((delta * gator_arch_timer.mult) >> 32);
+        }
+    }
+
     return gator_time(CLOCK_MONOTONIC_RAW);
 }
 
+#ifndef TCP_ANNOTATIONS
+static int gator_uds_connect(const char * const socket_name, const size_t name_len)
+{
+    const int fd = gator_socket_cloexec(PF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    struct sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+
+    memcpy(addr.sun_path, socket_name, name_len);
+    if (connect(fd, (const struct sockaddr *) &addr, offsetof(struct sockaddr_un, sun_path) + name_len - 1) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+#endif
+
 static int get_correct_socket_fd(bool for_parent)
 {
 #ifdef TCP_ANNOTATIONS
@@ -264,26 +497,11 @@ static int get_correct_socket_fd(bool for_parent)
         return -1;
     }
 #else
-    const int fd = gator_socket_cloexec(PF_UNIX, SOCK_STREAM, 0);
+    const int fd = (for_parent ? gator_uds_connect(STREAMLINE_ANNOTATE_PARENT, sizeof(STREAMLINE_ANNOTATE_PARENT))
+                               : gator_uds_connect(STREAMLINE_ANNOTATE, sizeof(STREAMLINE_ANNOTATE)));
     if (fd < 0) {
         return -1;
     }
-
-    struct sockaddr_un addr = {0};
-    addr.sun_family = AF_UNIX;
-
-    char * socket_name = STREAMLINE_ANNOTATE;
-    size_t name_len = sizeof(STREAMLINE_ANNOTATE);
-    if (for_parent) {
-        socket_name = STREAMLINE_ANNOTATE_PARENT;
-        name_len = sizeof(STREAMLINE_ANNOTATE_PARENT);
-    }
-
-    memcpy(addr.sun_path, socket_name, name_len);
-    if (connect(fd, (const struct sockaddr *) &addr, offsetof(struct sockaddr_un, sun_path) + name_len - 1) != 0) {
-        close(fd);
-        return -1;
-    }
 #endif
 
     return fd;
@@ -297,6 +515,68 @@ static bool gator_parent_connect(void)
     }
 
     gator_state.parent_fd = fd;
+    gator_state.parent_reads = false;
+    gator_state.parent_buf_length = 0;
+    gator_state.channel_suppressed_reported = 0;
+    /* The limits were set by the last gatord, so the application's own apply until this one sets its own */
+    __atomic_store_n(&gator_state.channel_max_rate, gator_state.channel_max_rate_default, __ATOMIC_RELAXED);
+    __atomic_store_n(&gator_state.channel_sample, gator_state.channel_sample_default, __ATOMIC_RELAXED);
+    return true;
+}
+
+static uint32_t gator_read_uint32(const char * const buf)
+{
+    const unsigned char * const bytes = (const unsigned char *) buf;
+    return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t) bytes[3] << 24);
+}
+
+static void gator_write_uint64(char * const buf, const uint64_t value)
+{
+    size_t i;
+    for (i = 0; i < sizeof(value); ++i) {
+        buf[i] = (value >> (8 * i)) & 0xff;
+    }
+}
+
+/* Zero leaves the limit the application set in its environment */
+static void gator_set_channel_limits(const uint32_t max_rate, const uint32_t sample)
+{
+    __atomic_store_n(&gator_state.channel_max_rate,
+                     max_rate != 0 ? max_rate : gator_state.channel_max_rate_default,
+                     __ATOMIC_RELAXED);
+    __atomic_store_n(&gator_state.channel_sample,
+                     sample != 0 ? sample : gator_state.channel_sample_default,
+                     __ATOMIC_RELAXED);
+}
+
+/*
+ * Read what gatord has sent on the parent connection, without waiting unless block is set. Returns false, having closed
+ * the connection, once gatord has closed it.
+ */
+static bool gator_parent_read(const bool block)
+{
+    char buf[64];
+    const ssize_t bytes = recv(gator_state.parent_fd, buf, sizeof(buf), block ? 0 : MSG_DONTWAIT);
+    if (bytes == 0 || (bytes < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        close(gator_state.parent_fd);
+        gator_state.parent_fd = -1;
+        return false;
+    }
+
+    ssize_t i;
+    for (i = 0; i < bytes; ++i) {
+        /* Skipping the zero byte that precedes the connection being closed */
+        if (gator_state.parent_buf_length == 0 && (uint8_t) buf[i] != PARENT_CHANNEL_LIMITS) {
+            continue;
+        }
+        gator_state.parent_buf[gator_state.parent_buf_length++] = buf[i];
+        if (gator_state.parent_buf_length == PARENT_CHANNEL_LIMITS_SIZE) {
+            gator_state.parent_buf_length = 0;
+            gator_state.parent_reads = true;
+            gator_set_channel_limits(gator_read_uint32(gator_state.parent_buf + 1),
+                                     gator_read_uint32(gator_state.parent_buf + 1 + sizeof(uint32_t)));
+        }
+    }
     return true;
 }
 
@@ -335,9 +615,12 @@ static uint32_t gator_buf_write_color(char * const buf, uint32_t * const write_p
     return 4;
 }
 
-static uint32_t gator_buf_write_int(char * const buf, uint32_t * const write_pos_ptr, int32_t x)
+static uint32_t gator_buf_write_long(char * const buf, uint32_t * const write_pos_ptr, int64_t x)
 {
     const uint32_t write_pos = *write_pos_ptr;
+    /* only wrap the write position if the packed value might cross the end of the buffer */
+    const uint32_t write_mask =
+        (write_pos + MAXSIZE_PACK_LONG <= THREAD_BUFFER_SIZE ? ~UINT32_C(0) : THREAD_BUFFER_MASK);
     int packed_bytes = 0;
     int more = true;
 
@@ -354,7 +637,7 @@ static uint32_t gator_buf_write_int(char * const buf, uint32_t * const write_pos
             b |= 0x80;
         }
 
-        buf[gator_buf_pos(write_pos + packed_bytes)] = b;
+        buf[(write_pos + packed_bytes) & write_mask] = b;
         packed_bytes++;
     }
 
@@ -362,31 +645,10 @@ static uint32_t gator_buf_write_int(char * const buf, uint32_t * const write_pos
     return packed_bytes;
 }
 
-static uint32_t gator_buf_write_long(char * const buf, uint32_t * const write_pos_ptr, int64_t x)
+static uint32_t gator_buf_write_int(char * const buf, uint32_t * const write_pos_ptr, int32_t x)
 {
-    const uint32_t write_pos = *write_pos_ptr;
-    int packed_bytes = 0;
-    int more = true;
-
-    while (more) {
-        /* low order 7 bits of x */
-        char b = x & 0x7f;
-
-        x >>= 7;
-
-        if ((x == 0 && (b & 0x40) == 0) || (x == -1 && (b & 0x40) != 0)) {
-            more = false;
-        }
-        else {
-            b |= 0x80;
-        }
-
-        buf[gator_buf_pos(write_pos + packed_bytes)] = b;
-        packed_bytes++;
-    }
-
-    *write_pos_ptr = gator_buf_pos(write_pos + packed_bytes);
-    return packed_bytes;
+    /* the encoding of a sign extended 32-bit value is identical to that of the 32-bit value */
+    return gator_buf_write_long(buf, write_pos_ptr, x);
 }
 
 static uint32_t gator_buf_write_time(char * const buf, uint32_t * const write_pos_ptr)
@@ -415,29 +677,142 @@ static uint32_t gator_buf_write_bytes(char * const buf,
     return count;
 }
 
-static int gator_connect(const int tid)
+#ifndef TCP_ANNOTATIONS
+static int gator_connect_shared(const int ring_fd, const char * const buf, const uint32_t length)
 {
-    const int fd = get_correct_socket_fd(/* for_parent= */ false);
+    const int fd = gator_uds_connect(STREAMLINE_ANNOTATE_SHARED, sizeof(STREAMLINE_ANNOTATE_SHARED));
     if (fd < 0) {
         return -1;
     }
 
+    /* Send the handshake and the ring together so that gatord reads the handshake before the ring */
+    struct iovec iov;
+    iov.iov_base = (void *) buf;
+    iov.iov_len = length;
+
+    union {
+        struct cmsghdr header;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } control;
+    memset(&control, 0, sizeof(control));
+
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    struct cmsghdr * const cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &ring_fd, sizeof(int));
+
+    const ssize_t bytes = sendmsg(fd, &msg, MSG_NOSIGNAL);
+    if (bytes != (ssize_t) length) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+#endif
+
+static int gator_connect(struct gator_thread * const thread)
+{
     /* Send tid as gatord cannot autodiscover it and the per process unique id */
     uint32_t write_pos = 0;
     char buf[sizeof(gator_annotate_handshake) + 2 * sizeof(uint32_t) + 1];
     gator_buf_write_bytes(buf, &write_pos, gator_annotate_handshake, sizeof(gator_annotate_handshake) - 1);
-    gator_buf_write_uint32(buf, &write_pos, tid);
+    gator_buf_write_uint32(buf, &write_pos, thread->tid);
     gator_buf_write_uint32(buf, &write_pos, getpid());
     gator_buf_write_byte(buf, &write_pos, gator_dont_mangle_keys);
+
+#ifndef TCP_ANNOTATIONS
+    if (thread->ring_fd >= 0) {
+        const int fd = gator_connect_shared(thread->ring_fd, buf, write_pos);
+        if (fd >= 0) {
+            thread->shared = true;
+            thread->resend_interned = true;
+            return fd;
+        }
+        /* Older versions of gatord only accept the data, which can be sent from the ring wherever it is */
+    }
+#endif
+
+    thread->shared = false;
+
+    const int fd = get_correct_socket_fd(/* for_parent= */ false);
+    if (fd < 0) {
+        return -1;
+    }
+
     const ssize_t bytes = send(fd, buf, write_pos, MSG_NOSIGNAL);
     if (bytes != (ssize_t) write_pos) {
         close(fd);
         return -1;
     }
 
+    thread->resend_interned = true;
     return fd;
 }
 
+static bool gator_ring_alloc(struct gator_thread * const thread)
+{
+    thread->ring_fd = -1;
+
+#if !defined(TCP_ANNOTATIONS) && defined(__NR_memfd_create)
+    if (gator_state.use_shared_memory) {
+        const int fd = syscall(__NR_memfd_create, "gator-annotate", 1 /* MFD_CLOEXEC */);
+        if (fd >= 0) {
+            void * const ring = (ftruncate(fd, sizeof(struct gator_ring)) == 0
+                                     ? mmap(NULL, sizeof(struct gator_ring), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+                                     : MAP_FAILED);
+            /* A forked child must not write to the parent's rings */
+            if (ring != MAP_FAILED && madvise(ring, sizeof(struct gator_ring), MADV_DONTFORK) == 0) {
+                thread->ring_fd = fd;
+                thread->ring = (struct gator_ring *) ring;
+                return true;
+            }
+            LOG(LOG_ERROR, "Unable to share annotations through memory, with error %s", strerror(errno));
+            /* Don't try again for every thread */
+            gator_state.use_shared_memory = false;
+            if (ring != MAP_FAILED) {
+                munmap(ring, sizeof(struct gator_ring));
+            }
+            close(fd);
+        }
+    }
+#endif
+
+    thread->ring = (struct gator_ring *) malloc(sizeof(*thread->ring));
+    if (thread->ring == NULL) {
+        LOG(LOG_ERROR, "malloc failed, with error %s", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+static void gator_ring_free(struct gator_thread * const thread)
+{
+    if (thread->ring_fd >= 0) {
+        munmap(thread->ring, sizeof(*thread->ring));
+        close(thread->ring_fd);
+    }
+    else if (thread->ring != &gator_orphan_ring) {
+        free(thread->ring);
+    }
+}
+
+/* The out of band data has all been sent, so the thread may send more */
+static void gator_oob_done(struct gator_thread * const thread)
+{
+    free(thread->oob_copy);
+    thread->oob_copy = NULL;
+    /* Release so that the thread only reuses oob_copy once it has been freed */
+    __atomic_store_n(&thread->oob_length, 0, __ATOMIC_RELEASE);
+}
+
 static void gator_start_capturing(void)
 {
     if (__sync_bool_compare_and_swap(&gator_state.capturing, false, true)) {
@@ -450,25 +825,56 @@ static void gator_stop_capturing(void)
     if (__sync_bool_compare_and_swap(&gator_state.capturing, true, false)) {
         struct gator_thread * thread;
         for (thread = gator_state.threads; thread != NULL; thread = thread->next) {
-            thread->read_pos = thread->write_pos;
-            thread->oob_length = 0;
+            thread->ring->read_pos = thread->ring->write_pos;
+            gator_oob_done(thread);
             sem_post(&thread->sem);
             if (thread->fd > 0) {
                 close(thread->fd);
                 thread->fd = -1;
             }
+            thread->shared = false;
         }
     }
 }
 
+static void gator_sleep(const uint64_t ns)
+{
+    struct timespec ts;
+    gator_set_ts(&ts, ns);
+    nanosleep(&ts, NULL);
+}
+
+/* gatord does not write to a shared connection, so it only becomes readable once gatord closes it */
+static bool gator_shared_connected(const int fd)
+{
+    char temp;
+    const ssize_t bytes = recv(fd, &temp, sizeof(temp), MSG_DONTWAIT);
+    return (bytes > 0) || ((bytes < 0) && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR));
+}
+
+static uint32_t gator_buf_used(const struct gator_thread * thread);
+
+/* Wait until gatord has read everything from a shared ring */
+static void gator_shared_drain(const struct gator_thread * const thread, const uint64_t deadline)
+{
+    while (gator_buf_used(thread) > 0 && gator_get_time() < deadline && gator_shared_connected(thread->fd)) {
+        gator_sleep(SHARED_RING_POLL_NS);
+    }
+}
+
 static bool gator_send(struct gator_thread * const thread, const uint32_t write_pos)
 {
     size_t write;
     ssize_t bytes;
 
-    if (write_pos > thread->read_pos) {
-        write = write_pos - thread->read_pos;
-        bytes = send(thread->fd, thread->buf + thread->read_pos, write, MSG_NOSIGNAL);
+    if (write_pos == thread->ring->read_pos) {
+        /* Nothing in the ring precedes the out of band data */
+        write = 0;
+        bytes = 0;
+    }
+    else if (write_pos > thread->ring->read_pos) {
+        write = write_pos - thread->ring->read_pos;
+        bytes = send(thread->fd, thread->ring->buf + thread->ring->read_pos, write, MSG_NOSIGNAL);
         if (bytes == 0) {
             //not an error reattempt.
             return true;
@@ -476,11 +882,11 @@ static bool gator_send(struct gator_thread * const thread, const uint32_t write_
         if (bytes < 0) {
             return false;
         }
-        thread->read_pos = gator_buf_pos(thread->read_pos + bytes);
+        thread->ring->read_pos = gator_buf_pos(thread->ring->read_pos + bytes);
     }
     else {
-        write = THREAD_BUFFER_SIZE - thread->read_pos;
-        bytes = send(thread->fd, thread->buf + thread->read_pos, write, MSG_NOSIGNAL);
+        write = THREAD_BUFFER_SIZE - thread->ring->read_pos;
+        bytes = send(thread->fd, thread->ring->buf + thread->ring->read_pos, write, MSG_NOSIGNAL);
         if (bytes == 0) {
             //not an error reattempt.
             return true;
@@ -488,12 +894,12 @@ static bool gator_send(struct gator_thread * const thread, const uint32_t write_
         if (bytes < 0) {
             return false;
         }
-        thread->read_pos = gator_buf_pos(thread->read_pos + bytes);
+        thread->ring->read_pos = gator_buf_pos(thread->ring->read_pos + bytes);
 
         if (write == (size_t) bytes) {
             /* Don't write more on a short write to be fair to other threads */
             write = write_pos;
-            bytes = send(thread->fd, thread->buf, write, MSG_NOSIGNAL);
+            bytes = send(thread->fd, thread->ring->buf, write, MSG_NOSIGNAL);
             if (bytes == 0) {
                 //not an error reattempt.
                 return true;
@@ -501,7 +907,7 @@ static bool gator_send(struct gator_thread * const thread, const uint32_t write_
             if (bytes < 0) {
                 return false;
             }
-            thread->read_pos = gator_buf_pos(thread->read_pos + bytes);
+            thread->ring->read_pos = gator_buf_pos(thread->ring->read_pos + bytes);
         }
     }
 
@@ -517,11 +923,42 @@ static bool gator_send(struct gator_thread * const thread, const uint32_t write_
             return false;
         }
         thread->oob_data += bytes;
-        thread->oob_length -= bytes;
+        if ((size_t) bytes == thread->oob_length) {
+            gator_oob_done(thread);
+        }
+        else {
+            thread->oob_length -= bytes;
+        }
     }
     return true;
 }
 
+/* Report the channel annotations suppressed so far to gatord, once they change but at most once a second */
+static void gator_report_suppressed(void)
+{
+    /* Older versions of gatord do not read the parent connection, so would never drain it */
+    if (!gator_state.parent_reads) {
+        return;
+    }
+
+    const uint64_t rate_limited = __atomic_load_n(&gator_state.channel_rate_limited, __ATOMIC_RELAXED);
+    const uint64_t sampled_out = __atomic_load_n(&gator_state.channel_sampled_out, __ATOMIC_RELAXED);
+    const uint64_t now = gator_get_time();
+    if (rate_limited + sampled_out == gator_state.channel_suppressed_reported ||
+        now < gator_state.channel_report_time + NS_PER_S) {
+        return;
+    }
+
+    char buf[PARENT_SUPPRESSED_SIZE];
+    buf[0] = PARENT_SUPPRESSED;
+    gator_write_uint64(buf + 1, rate_limited);
+    gator_write_uint64(buf + 1 + sizeof(uint64_t), sampled_out);
+    if (send(gator_state.parent_fd, buf, sizeof(buf), MSG_DONTWAIT | MSG_NOSIGNAL) == (ssize_t) sizeof(buf)) {
+        gator_state.channel_suppressed_reported = rate_limited + sampled_out;
+        gator_state.channel_report_time = now;
+    }
+}
+
 static void * gator_func(void * arg)
 {
     bool print = true;
@@ -537,6 +974,10 @@ static void * gator_func(void * arg)
     }
 
     for (;;) {
+        if (gator_arch_timer.enabled) {
+            gator_arch_timer_anchor();
+        }
+
         if (gator_state.parent_fd < 0) {
             if (gator_parent_connect()) {
                 /* Optimistically begin capturing data */
@@ -559,11 +1000,7 @@ static void * gator_func(void * arg)
         }
 
         if (!gator_state.capturing) {
-            char temp;
-            const ssize_t bytes = read(gator_state.parent_fd, &temp, sizeof(temp));
-            if (bytes <= 0) {
-                close(gator_state.parent_fd);
-                gator_state.parent_fd = -1;
+            if (!gator_parent_read(true)) {
                 continue;
             }
             gator_start_capturing();
@@ -571,6 +1008,11 @@ static void * gator_func(void * arg)
         }
 
         if (gator_state.capturing) {
+            if (!gator_parent_read(false)) {
+                continue;
+            }
+            gator_report_suppressed();
+
             /* Iterate every 100ms */
             const uint64_t freq = NS_PER_S / 10;
             const uint64_t now = gator_time(CLOCK_REALTIME);
@@ -594,17 +1036,31 @@ static void * gator_func(void * arg)
         while (sem_trywait(&gator_state.sync_sem) == 0) {
             ++sync_count;
         }
+        const uint64_t flush_deadline = gator_get_time() + SHARED_RING_FLUSH_NS;
 
         struct gator_thread ** prev = &gator_state.threads;
         struct gator_thread * thread = *prev;
         while (thread != NULL) {
             if (gator_state.capturing) {
-                if (thread->fd < 0 && (thread->fd = gator_connect(thread->tid)) < 0) {
+                if (thread->fd < 0 && (thread->fd = gator_connect(thread)) < 0) {
                     gator_stop_capturing();
                 }
+                else if (thread->shared) {
+                    /* gatord reads the ring itself, so only check that it is still there */
+                    if (!gator_shared_connected(thread->fd)) {
+                        gator_stop_capturing();
+                    }
+                    else if (sync_count > 0) {
+                        gator_shared_drain(thread, flush_deadline);
+                    }
+                }
                 else {
-                    const uint32_t write_pos = thread->write_pos;
-                    if (write_pos != thread->read_pos || thread->oob_length > 0) {
+                    uint32_t write_pos = __atomic_load_n(&thread->ring->write_pos, __ATOMIC_ACQUIRE);
+                    /* What was written after the start of the out of band data is sent after it */
+                    if (__atomic_load_n(&thread->oob_length, __ATOMIC_ACQUIRE) > 0) {
+                        write_pos = thread->oob_pos;
+                    }
+                    if (write_pos != thread->ring->read_pos || thread->oob_length > 0) {
                         if (!gator_send(thread, write_pos)) {
                             LOG(LOG_ERROR,
                                 "Failed to send bytes, "                                                    //
@@ -613,12 +1069,13 @@ static void * gator_func(void * arg)
                                 thread->exited ? "true" : "false",
                                 thread->fd,
                                 thread->oob_length,
-                                thread->read_pos,
+                                thread->ring->read_pos,
                                 thread->tid,
                                 write_pos);
                             gator_stop_capturing();
                         }
-                        else {
+                        else if (thread->ring_fd < 0) {
+                            /* Threads with a shared ring poll for space rather than waiting to be woken */
                             sem_post(&thread->sem);
                         }
                     }
@@ -636,6 +1093,8 @@ static void * gator_func(void * arg)
                     close(thread->fd);
                 }
                 sem_destroy(&thread->sem);
+                gator_ring_free(thread);
+                free(thread->oob_copy);
                 free(thread);
                 thread = next;
             }
@@ -648,6 +1107,23 @@ static void * gator_func(void * arg)
     return NULL;
 }
 
+/* Read an unsigned number from the environment, or zero if it is not set */
+static uint32_t gator_getenv_uint(const char * const name)
+{
+    const char * const value = getenv(name);
+    if (value == NULL) {
+        return 0;
+    }
+
+    char * end;
+    const unsigned long result = strtoul(value, &end, 10);
+    if (end == value || *end != '\0' || result > UINT32_MAX) {
+        LOG(LOG_ERROR, "Ignoring %s as '%s' is not a valid number", name, value);
+        return 0;
+    }
+    return result;
+}
+
 void gator_annotate_setup(void)
 {
     /* Support calling gator_annotate_setup more than once, but not at the same time on different cores */
@@ -656,6 +1132,23 @@ void gator_annotate_setup(void)
         /* Optimistically begin capturing data */
         gator_state.capturing = true;
 
+        const char * const shared_memory = getenv("STREAMLINE_ANNOTATE_SHARED_MEMORY");
+        gator_state.use_shared_memory = (shared_memory != NULL && strcmp(shared_memory, "1") == 0);
+
+        const char * const arch_timer = getenv("STREAMLINE_ANNOTATE_ARCH_TIMER");
+        if (arch_timer != NULL && strcmp(arch_timer, "1") == 0) {
+            gator_arch_timer_setup();
+        }
+
+        const char * const visual_async = getenv("STREAMLINE_ANNOTATE_VISUAL_ASYNC");
+        gator_state.visual_async = (visual_async != NULL && strcmp(visual_async, "1") == 0);
+        gator_state.visual_max_bytes = gator_getenv_uint("STREAMLINE_ANNOTATE_VISUAL_MAX_BYTES");
+        const uint32_t visual_max_rate = gator_getenv_uint("STREAMLINE_ANNOTATE_VISUAL_MAX_RATE");
+        gator_state.visual_min_interval = (visual_max_rate == 0 ? 0 : NS_PER_S / visual_max_rate);
+        gator_state.channel_max_rate_default = gator_getenv_uint("STREAMLINE_ANNOTATE_CHANNEL_MAX_RATE");
+        gator_state.channel_sample_default = gator_getenv_uint("STREAMLINE_ANNOTATE_CHANNEL_SAMPLE");
+        gator_set_channel_limits(0, 0);
+
         int err = sem_init(&gator_state.sender_sem, 0, 0);
         if (err != 0) {
             LOG(LOG_ERROR, "sem_init failed, with error %s", strerror(err));
@@ -733,18 +1226,30 @@ static struct gator_thread * gator_get_thread(void)
         return NULL;
     }
 
+    if (!gator_ring_alloc(thread)) {
+        goto fail_free_thread;
+    }
+
     thread->oob_data = NULL;
+    thread->oob_copy = NULL;
+    thread->oob_pos = 0;
     thread->oob_length = 0;
     thread->fd = -1;
     thread->tid = syscall(__NR_gettid);
-    thread->write_pos = 0;
-    thread->read_pos = 0;
+    thread->ring->write_pos = 0;
+    thread->ring->read_pos = 0;
+    thread->interned_sent = 0;
     thread->exited = false;
+    thread->shared = false;
+    thread->resend_interned = false;
+    /* Any odd seed will do, but each thread has its own so that they do not suppress in step */
+    thread->sample_seed = ((uint32_t) thread->tid * 2654435761u) | 1;
+    memset(thread->channel_limits, 0, sizeof(thread->channel_limits));
 
     err = sem_init(&thread->sem, 0, 0);
     if (err != 0) {
         LOG(LOG_ERROR, "sem_init failed, with error %s", strerror(err));
-        goto fail_free_thread;
+        goto fail_free_ring;
     }
 
     err = pthread_setspecific(gator_state.key, thread);
@@ -773,10 +1278,16 @@ success:
         }
     }
 
+    if (__sync_bool_compare_and_swap(&thread->resend_interned, true, false)) {
+        thread->interned_sent = 0;
+    }
+
     return thread;
 
 fail_sem_destroy:
     sem_destroy(&thread->sem);
+fail_free_ring:
+    gator_ring_free(thread);
 fail_free_thread:
     free(thread);
     return NULL;
@@ -784,12 +1295,14 @@ fail_free_thread:
 
 static uint32_t gator_buf_free(const struct gator_thread * const thread)
 {
-    return (thread->read_pos - thread->write_pos - 1) & THREAD_BUFFER_MASK;
+    /* Acquire so that the reader has finished with the space before it is reused */
+    return (__atomic_load_n(&thread->ring->read_pos, __ATOMIC_ACQUIRE) - thread->ring->write_pos - 1) &
+           THREAD_BUFFER_MASK;
 }
 
 static uint32_t gator_buf_used(const struct gator_thread * const thread)
 {
-    return (thread->write_pos - thread->read_pos) & THREAD_BUFFER_MASK;
+    return (thread->ring->write_pos - thread->ring->read_pos) & THREAD_BUFFER_MASK;
 }
 
 #define gator_buf_wait_bytes(thread, bytes)                                                                            \
@@ -804,84 +1317,313 @@ static uint32_t gator_buf_used(const struct gator_thread * const thread)
 static void __gator_buf_wait_bytes(struct gator_thread * const thread, const uint32_t bytes)
 {
     while (gator_buf_free(thread) < bytes) {
-        sem_post(&gator_state.sender_sem);
-        sem_wait(&thread->sem);
+        if (!thread->shared) {
+            sem_post(&gator_state.sender_sem);
+        }
+        if (thread->ring_fd >= 0) {
+            /* Whichever of gatord or the sender reads the ring, it does so without being asked */
+            gator_sleep(SHARED_RING_POLL_NS);
+        }
+        else {
+            sem_wait(&thread->sem);
+        }
     }
 }
 
+static void gator_buf_commit(struct gator_thread * const thread, const uint32_t write_pos)
+{
+    /* Release so that the reader sees the data before the position */
+    __atomic_store_n(&thread->ring->write_pos, write_pos, __ATOMIC_RELEASE);
+}
+
 static void gator_msg_begin(const char marker,
                             struct gator_thread * const thread,
                             uint32_t * const write_pos_ptr,
                             uint32_t * const size_pos_ptr,
                             uint32_t * const length_ptr)
 {
-    *write_pos_ptr = thread->write_pos;
-    gator_buf_write_byte(thread->buf, write_pos_ptr, marker);
+    *write_pos_ptr = thread->ring->write_pos;
+    gator_buf_write_byte(thread->ring->buf, write_pos_ptr, marker);
     *size_pos_ptr = *write_pos_ptr;
     *write_pos_ptr = gator_buf_pos(*write_pos_ptr + sizeof(uint32_t));
     *length_ptr = 0;
 }
 
+/* As gator_msg_begin, but for a message whose trailing string is omitted if it is interned */
+static void gator_msg_begin_str(const char marker,
+                                const uint32_t str_id,
+                                struct gator_thread * const thread,
+                                uint32_t * const write_pos_ptr,
+                                uint32_t * const size_pos_ptr,
+                                uint32_t * const length_ptr)
+{
+    if (str_id == 0) {
+        gator_msg_begin(marker, thread, write_pos_ptr, size_pos_ptr, length_ptr);
+        return;
+    }
+
+    gator_msg_begin(HEADER_INTERNED, thread, write_pos_ptr, size_pos_ptr, length_ptr);
+    *length_ptr += gator_buf_write_byte(thread->ring->buf, write_pos_ptr, marker);
+    *length_ptr += gator_buf_write_int(thread->ring->buf, write_pos_ptr, str_id);
+}
+
 static void gator_msg_end(struct gator_thread * const thread,
                           const uint32_t write_pos,
                           uint32_t size_pos,
                           const uint32_t length)
 {
-    gator_buf_write_uint32(thread->buf, &size_pos, length);
-    thread->write_pos = write_pos;
+    gator_buf_write_uint32(thread->ring->buf, &size_pos, length);
+    gator_buf_commit(thread, write_pos);
 
-    /* Wakeup the sender thread if 3/4 full */
-    if (gator_buf_used(thread) >= 3 * THREAD_BUFFER_SIZE / 4) {
+    /* Wakeup the sender thread if 3/4 full, unless gatord is reading the ring */
+    if (!thread->shared && gator_buf_used(thread) >= 3 * THREAD_BUFFER_SIZE / 4) {
         sem_post(&gator_state.sender_sem);
     }
 }
 
-void gator_annotate_str(const uint32_t channel, const char * const str)
+uint32_t gator_annotate_intern(const char * const str)
+{
+    if (str == NULL) {
+        return 0;
+    }
+
+    const size_t str_size = strlen(str);
+    if (str_size > MAXSIZE_INTERNED_STRING) {
+        LOG(LOG_ERROR, "string is too large to intern");
+        return 0;
+    }
+
+    uint32_t id = 0;
+    pthread_mutex_lock(&gator_interned_mutex);
+
+    struct gator_interned * interned;
+    for (interned = gator_state.interned; interned != NULL; interned = interned->next) {
+        if (interned->str_size == str_size && memcmp(interned->str, str, str_size) == 0) {
+            id = interned->id;
+            goto unlock;
+        }
+    }
+
+    interned = (struct gator_interned *) malloc(sizeof(*interned) + str_size);
+    if (interned == NULL) {
+        LOG(LOG_ERROR, "malloc failed, with error %s", strerror(errno));
+        goto unlock;
+    }
+
+    /* The string is stored after the struct, and is not nul terminated */
+    memcpy(interned + 1, str, str_size);
+    interned->str = (const char *) (interned + 1);
+    interned->str_size = str_size;
+    interned->next = gator_state.interned;
+    interned->id = (interned->next == NULL) ? 1 : interned->next->id + 1;
+    id = interned->id;
+
+    /* Release so that the annotating threads see the whole entry */
+    __atomic_store_n(&gator_state.interned, interned, __ATOMIC_RELEASE);
+
+unlock:
+    pthread_mutex_unlock(&gator_interned_mutex);
+    return id;
+}
+
+static void gator_annotate_write_interned(struct gator_thread * const thread, const struct gator_interned * interned)
 {
+    gator_buf_wait_bytes(thread, 1 + sizeof(uint32_t) + MAXSIZE_PACK_INT + interned->str_size);
 
+    uint32_t write_pos;
+    uint32_t size_pos;
+    uint32_t length;
+    gator_msg_begin(HEADER_INTERN_STRING, thread, &write_pos, &size_pos, &length);
+
+    length += gator_buf_write_int(thread->ring->buf, &write_pos, interned->id);
+    length += gator_buf_write_bytes(thread->ring->buf, &write_pos, interned->str, interned->str_size);
+
+    gator_msg_end(thread, write_pos, size_pos, length);
+}
+
+/* Send any interned strings that have not yet been sent on this thread's connection, and so may be used */
+static void gator_annotate_send_interned(struct gator_thread * const thread)
+{
+    const struct gator_interned * const newest = __atomic_load_n(&gator_state.interned, __ATOMIC_ACQUIRE);
+    if (newest == NULL || newest->id <= thread->interned_sent) {
+        return;
+    }
+
+    const struct gator_interned * interned;
+    for (interned = newest; interned != NULL && interned->id > thread->interned_sent; interned = interned->next) {
+        gator_annotate_write_interned(thread, interned);
+    }
+
+    thread->interned_sent = newest->id;
+}
+
+/* Suppress a channel annotation, logging the first one that is suppressed */
+static bool gator_channel_suppress(const char * const reason)
+{
+    if (__sync_bool_compare_and_swap(&gator_state.channel_suppress_logged, false, true)) {
+        LOG(LOG_WARN,
+            "Suppressing channel annotation as %s, further suppressed channel annotations are counted but not logged",
+            reason);
+    }
+    return false;
+}
+
+static uint32_t gator_sample_random(struct gator_thread * const thread)
+{
+    /* xorshift32 */
+    uint32_t x = thread->sample_seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    thread->sample_seed = x;
+    return x;
+}
+
+/*
+ * Apply the configured limits to a channel annotation, returning false if it is to be suppressed. This is checked
+ * before waiting for space in the ring, so a suppressed annotation never blocks. The end of an annotation is only
+ * suppressed along with its start, so the channel stays balanced, other than when another channel took the slot while
+ * the annotation was open.
+ */
+static bool gator_channel_accept(struct gator_thread * const thread, const uint32_t channel, const bool is_end)
+{
+    struct gator_channel_limit * const limit = &thread->channel_limits[channel % CHANNEL_LIMIT_SLOTS];
+    const bool matches = limit->used && limit->channel == channel;
+
+    if (is_end) {
+        if (matches && limit->suppressed) {
+            limit->suppressed = false;
+            return false;
+        }
+        return true;
+    }
+
+    const uint32_t max_rate = __atomic_load_n(&gator_state.channel_max_rate, __ATOMIC_RELAXED);
+    const uint32_t sample = __atomic_load_n(&gator_state.channel_sample, __ATOMIC_RELAXED);
+    if (max_rate == 0 && sample <= 1) {
+        if (matches) {
+            limit->suppressed = false;
+        }
+        return true;
+    }
+
+    if (!matches) {
+        limit->used = true;
+        limit->channel = channel;
+        limit->count = 0;
+        limit->window_start = 0;
+    }
+
+    if (sample > 1 && gator_sample_random(thread) % sample != 0) {
+        __atomic_add_fetch(&gator_state.channel_sampled_out, 1, __ATOMIC_RELAXED);
+        limit->suppressed = true;
+        return gator_channel_suppress("it was not sampled, as set by STREAMLINE_ANNOTATE_CHANNEL_SAMPLE or gatord");
+    }
+
+    if (max_rate != 0) {
+        const uint64_t now = gator_get_time();
+        if (limit->window_start == 0 || now >= limit->window_start + NS_PER_S) {
+            limit->window_start = now;
+            limit->count = 0;
+        }
+        if (limit->count >= max_rate) {
+            __atomic_add_fetch(&gator_state.channel_rate_limited, 1, __ATOMIC_RELAXED);
+            limit->suppressed = true;
+            return gator_channel_suppress(
+                "it exceeds the rate set by STREAMLINE_ANNOTATE_CHANNEL_MAX_RATE or gatord");
+        }
+        ++limit->count;
+    }
+
+    limit->suppressed = false;
+    return true;
+}
+
+/*
+ * Either the string, or the id of an interned string to send in its place. An id of zero, as returned when interning
+ * fails, is the same as a NULL string.
+ */
+static void gator_annotate_write_str(const uint32_t channel, const char * const str, const uint32_t str_id)
+{
     struct gator_thread * const thread = gator_get_thread();
-    if (thread == NULL) {
+    if (thread == NULL || !gator_channel_accept(thread, channel, str == NULL && str_id == 0)) {
         return;
     }
 
+    if (str_id != 0) {
+        gator_annotate_send_interned(thread);
+    }
+
     const int str_size = (str == NULL) ? 0 : strlen(str);
-    gator_buf_wait_bytes(thread, 1 + sizeof(uint32_t) + MAXSIZE_PACK_LONG + MAXSIZE_PACK_INT + str_size);
+    gator_buf_wait_bytes(thread,
+                         1 + sizeof(uint32_t) + MAXSIZE_INTERNED_PREFIX + MAXSIZE_PACK_LONG + MAXSIZE_PACK_INT +
+                             str_size);
 
     uint32_t write_pos;
     uint32_t size_pos;
     uint32_t length;
-    gator_msg_begin(HEADER_UTF8, thread, &write_pos, &size_pos, &length);
+    gator_msg_begin_str(HEADER_UTF8, str_id, thread, &write_pos, &size_pos, &length);
 
-    length += gator_buf_write_time(thread->buf, &write_pos);
-    length += gator_buf_write_int(thread->buf, &write_pos, channel);
-    length += gator_buf_write_bytes(thread->buf, &write_pos, str, str_size);
+    length += gator_buf_write_time(thread->ring->buf, &write_pos);
+    length += gator_buf_write_int(thread->ring->buf, &write_pos, channel);
+    length += gator_buf_write_bytes(thread->ring->buf, &write_pos, str, str_size);
 
     gator_msg_end(thread, write_pos, size_pos, length);
 }
 
-void gator_annotate_color(const uint32_t channel, const uint32_t color, const char * const str)
+void gator_annotate_str(const uint32_t channel, const char * const str)
+{
+    gator_annotate_write_str(channel, str, 0);
+}
+
+void gator_annotate_str_interned(const uint32_t channel, const uint32_t str_id)
+{
+    gator_annotate_write_str(channel, NULL, str_id);
+}
+
+/* As gator_annotate_write_str */
+static void gator_annotate_write_color(const uint32_t channel,
+                                       const uint32_t color,
+                                       const char * const str,
+                                       const uint32_t str_id)
 {
     struct gator_thread * const thread = gator_get_thread();
-    if (thread == NULL) {
+    if (thread == NULL || !gator_channel_accept(thread, channel, str == NULL && str_id == 0)) {
         return;
     }
 
+    if (str_id != 0) {
+        gator_annotate_send_interned(thread);
+    }
+
     const int str_size = (str == NULL) ? 0 : strlen(str);
-    gator_buf_wait_bytes(thread, 1 + sizeof(uint32_t) + MAXSIZE_PACK_LONG + MAXSIZE_PACK_INT + SIZE_COLOR + str_size);
+    gator_buf_wait_bytes(thread,
+                         1 + sizeof(uint32_t) + MAXSIZE_INTERNED_PREFIX + MAXSIZE_PACK_LONG + MAXSIZE_PACK_INT +
+                             SIZE_COLOR + str_size);
 
     uint32_t write_pos;
     uint32_t size_pos;
     uint32_t length;
-    gator_msg_begin(HEADER_UTF8_COLOR, thread, &write_pos, &size_pos, &length);
+    gator_msg_begin_str(HEADER_UTF8_COLOR, str_id, thread, &write_pos, &size_pos, &length);
 
-    length += gator_buf_write_time(thread->buf, &write_pos);
-    length += gator_buf_write_int(thread->buf, &write_pos, channel);
-    length += gator_buf_write_color(thread->buf, &write_pos, color);
-    length += gator_buf_write_bytes(thread->buf, &write_pos, str, str_size);
+    length += gator_buf_write_time(thread->ring->buf, &write_pos);
+    length += gator_buf_write_int(thread->ring->buf, &write_pos, channel);
+    length += gator_buf_write_color(thread->ring->buf, &write_pos, color);
+    length += gator_buf_write_bytes(thread->ring->buf, &write_pos, str, str_size);
 
     gator_msg_end(thread, write_pos, size_pos, length);
 }
 
+void gator_annotate_color(const uint32_t channel, const uint32_t color, const char * const str)
+{
+    gator_annotate_write_color(channel, color, str, 0);
+}
+
+void gator_annotate_color_interned(const uint32_t channel, const uint32_t color, const uint32_t str_id)
+{
+    gator_annotate_write_color(channel, color, NULL, str_id);
+}
+
 void gator_annotate_name_channel(const uint32_t channel, const uint32_t group, const char * const str)
 {
     struct gator_thread * const thread = gator_get_thread();
@@ -897,10 +1639,10 @@ void gator_annotate_name_channel(const uint32_t channel, const uint32_t group, c
     uint32_t length;
     gator_msg_begin(HEADER_CHANNEL_NAME, thread, &write_pos, &size_pos, &length);
 
-    length += gator_buf_write_time(thread->buf, &write_pos);
-    length += gator_buf_write_int(thread->buf, &write_pos, channel);
-    length += gator_buf_write_int(thread->buf, &write_pos, group);
-    length += gator_buf_write_bytes(thread->buf, &write_pos, str, str_size);
+    length += gator_buf_write_time(thread->ring->buf, &write_pos);
+    length += gator_buf_write_int(thread->ring->buf, &write_pos, channel);
+    length += gator_buf_write_int(thread->ring->buf, &write_pos, group);
+    length += gator_buf_write_bytes(thread->ring->buf, &write_pos, str, str_size);
 
     gator_msg_end(thread, write_pos, size_pos, length);
 }
@@ -920,13 +1662,43 @@ void gator_annotate_name_group(const uint32_t group, const char * const str)
     uint32_t length;
     gator_msg_begin(HEADER_GROUP_NAME, thread, &write_pos, &size_pos, &length);
 
-    length += gator_buf_write_time(thread->buf, &write_pos);
-    length += gator_buf_write_int(thread->buf, &write_pos, group);
-    length += gator_buf_write_bytes(thread->buf, &write_pos, str, str_size);
+    length += gator_buf_write_time(thread->ring->buf, &write_pos);
+    length += gator_buf_write_int(thread->ring->buf, &write_pos, group);
+    length += gator_buf_write_bytes(thread->ring->buf, &write_pos, str, str_size);
 
     gator_msg_end(thread, write_pos, size_pos, length);
 }
 
+/* Drop a visual annotation, reporting the first one that is dropped */
+static bool gator_visual_drop(const char * const reason)
+{
+    if (__sync_bool_compare_and_swap(&gator_state.visual_drop_reported, false, true)) {
+        LOG(LOG_WARN, "Dropping visual annotation as %s, further dropped visual annotations are not reported", reason);
+    }
+    return false;
+}
+
+/* Apply the configured limits to a visual annotation, returning false if it is to be dropped */
+static bool gator_visual_accept(const uint32_t data_length)
+{
+    if (gator_state.visual_max_bytes != 0 && data_length > gator_state.visual_max_bytes) {
+        return gator_visual_drop("it is larger than STREAMLINE_ANNOTATE_VISUAL_MAX_BYTES");
+    }
+
+    if (gator_state.visual_min_interval != 0) {
+        const uint64_t now = gator_get_time();
+        uint64_t last = __atomic_load_n(&gator_state.visual_last, __ATOMIC_RELAXED);
+        /* Of the threads that annotate at once, only the one that updates the time may send */
+        if ((last != 0 && now < last + gator_state.visual_min_interval) ||
+            !__atomic_compare_exchange_n(&gator_state.visual_last, &last, now, false, __ATOMIC_RELAXED,
+                                         __ATOMIC_RELAXED)) {
+            return gator_visual_drop("it exceeds STREAMLINE_ANNOTATE_VISUAL_MAX_RATE");
+        }
+    }
+
+    return true;
+}
+
 void gator_annotate_visual(const void * const data, const uint32_t data_length, const char * const str)
 {
     struct gator_thread * const thread = gator_get_thread();
@@ -934,27 +1706,71 @@ void gator_annotate_visual(const void * const data, const uint32_t data_length,
         return;
     }
 
+    if (!gator_visual_accept(data_length)) {
+        return;
+    }
+
     const int str_size = (str == NULL) ? 0 : strlen(str);
     /* Don't include data_length because it doesn't end up in the buffer */
     gator_buf_wait_bytes(thread, 1 + sizeof(uint32_t) + MAXSIZE_PACK_LONG + str_size + 1);
 
+    /* The data follows the message through the thread's socket, so is sent from a copy by the sender thread */
+    char * copy = NULL;
+    if (gator_state.visual_async && thread->ring_fd < 0 && data_length > 0) {
+        /* Only one visual annotation is sent at a time, so rather than wait for the last, drop this one */
+        if (__atomic_load_n(&thread->oob_length, __ATOMIC_ACQUIRE) > 0) {
+            gator_visual_drop("the last one from the thread is still being sent");
+            return;
+        }
+
+        copy = (char *) malloc(data_length);
+        if (copy == NULL) {
+            LOG(LOG_ERROR, "malloc failed, with error %s", strerror(errno));
+            return;
+        }
+        memcpy(copy, data, data_length);
+    }
+
     uint32_t write_pos;
     uint32_t size_pos;
     uint32_t length;
     gator_msg_begin(HEADER_VISUAL, thread, &write_pos, &size_pos, &length);
 
-    length += gator_buf_write_time(thread->buf, &write_pos);
-    length += gator_buf_write_bytes(thread->buf, &write_pos, str, str_size);
-    length += gator_buf_write_byte(thread->buf, &write_pos, '\0');
+    length += gator_buf_write_time(thread->ring->buf, &write_pos);
+    length += gator_buf_write_bytes(thread->ring->buf, &write_pos, str, str_size);
+    length += gator_buf_write_byte(thread->ring->buf, &write_pos, '\0');
     /* Calculate the length, but don't write the image */
     length += data_length;
     /* Write the length and commit the first part of the message */
-    gator_buf_write_uint32(thread->buf, &size_pos, length);
-    thread->write_pos = write_pos;
+    gator_buf_write_uint32(thread->ring->buf, &size_pos, length);
+    gator_buf_commit(thread, write_pos);
+
+    if (thread->ring_fd >= 0) {
+        /* Nothing but the ring may be shared with gatord, so pass the image through it in pieces */
+        const char * const bytes = (const char *) data;
+        uint32_t offset = 0;
+        while (offset < data_length && gator_state.capturing) {
+            const uint32_t count =
+                (data_length - offset < THREAD_BUFFER_SIZE / 2 ? data_length - offset : THREAD_BUFFER_SIZE / 2);
+            __gator_buf_wait_bytes(thread, count);
+            gator_buf_write_bytes(thread->ring->buf, &write_pos, bytes + offset, count);
+            gator_buf_commit(thread, write_pos);
+            offset += count;
+        }
+        return;
+    }
 
-    thread->oob_data = (const char *) data;
+    thread->oob_data = (copy != NULL ? copy : (const char *) data);
+    thread->oob_copy = copy;
+    thread->oob_pos = write_pos;
     __sync_synchronize();
     thread->oob_length = data_length;
+
+    if (copy != NULL) {
+        sem_post(&gator_state.sender_sem);
+        return;
+    }
+
     while (thread->oob_length > 0) {
         sem_post(&gator_state.sender_sem);
         sem_wait(&thread->sem);
@@ -975,8 +1791,8 @@ void gator_annotate_marker(const char * const str)
     uint32_t length;
     gator_msg_begin(HEADER_MARKER, thread, &write_pos, &size_pos, &length);
 
-    length += gator_buf_write_time(thread->buf, &write_pos);
-    length += gator_buf_write_bytes(thread->buf, &write_pos, str, str_size);
+    length += gator_buf_write_time(thread->ring->buf, &write_pos);
+    length += gator_buf_write_bytes(thread->ring->buf, &write_pos, str, str_size);
 
     gator_msg_end(thread, write_pos, size_pos, length);
 }
@@ -995,9 +1811,9 @@ void gator_annotate_marker_color(const uint32_t color, const char * const str)
     uint32_t length;
     gator_msg_begin(HEADER_MARKER_COLOR, thread, &write_pos, &size_pos, &length);
 
-    length += gator_buf_write_time(thread->buf, &write_pos);
-    length += gator_buf_write_color(thread->buf, &write_pos, color);
-    length += gator_buf_write_bytes(thread->buf, &write_pos, str, str_size);
+    length += gator_buf_write_time(thread->ring->buf, &write_pos);
+    length += gator_buf_write_color(thread->ring->buf, &write_pos, color);
+    length += gator_buf_write_bytes(thread->ring->buf, &write_pos, str, str_size);
 
     gator_msg_end(thread, write_pos, size_pos, length);
 }
@@ -1023,34 +1839,34 @@ static void gator_annotate_write_counter(struct gator_thread * const thread, con
     uint32_t length;
     gator_msg_begin(HEADER_COUNTER, thread, &write_pos, &size_pos, &length);
 
-    length += gator_buf_write_int(thread->buf, &write_pos, counter->id);
-    length += gator_buf_write_int(thread->buf, &write_pos, counter->per_cpu);
-    length += gator_buf_write_int(thread->buf, &write_pos, counter->counter_class);
-    length += gator_buf_write_int(thread->buf, &write_pos, counter->display);
-    length += gator_buf_write_int(thread->buf, &write_pos, counter->modifier);
-    length += gator_buf_write_int(thread->buf, &write_pos, counter->series_composition);
-    length += gator_buf_write_int(thread->buf, &write_pos, counter->rendering_type);
-    length += gator_buf_write_int(thread->buf, &write_pos, counter->average_selection);
-    length += gator_buf_write_int(thread->buf, &write_pos, counter->average_cores);
-    length += gator_buf_write_int(thread->buf, &write_pos, counter->percentage);
-    length += gator_buf_write_int(thread->buf, &write_pos, counter->activity_count);
-    length += gator_buf_write_int(thread->buf, &write_pos, counter->cores);
-    length += gator_buf_write_color(thread->buf, &write_pos, counter->color);
+    length += gator_buf_write_int(thread->ring->buf, &write_pos, counter->id);
+    length += gator_buf_write_int(thread->ring->buf, &write_pos, counter->per_cpu);
+    length += gator_buf_write_int(thread->ring->buf, &write_pos, counter->counter_class);
+    length += gator_buf_write_int(thread->ring->buf, &write_pos, counter->display);
+    length += gator_buf_write_int(thread->ring->buf, &write_pos, counter->modifier);
+    length += gator_buf_write_int(thread->ring->buf, &write_pos, counter->series_composition);
+    length += gator_buf_write_int(thread->ring->buf, &write_pos, counter->rendering_type);
+    length += gator_buf_write_int(thread->ring->buf, &write_pos, counter->average_selection);
+    length += gator_buf_write_int(thread->ring->buf, &write_pos, counter->average_cores);
+    length += gator_buf_write_int(thread->ring->buf, &write_pos, counter->percentage);
+    length += gator_buf_write_int(thread->ring->buf, &write_pos, counter->activity_count);
+    length += gator_buf_write_int(thread->ring->buf, &write_pos, counter->cores);
+    length += gator_buf_write_color(thread->ring->buf, &write_pos, counter->color);
     for (i = 0; i < counter->activity_count; ++i) {
-        length += gator_buf_write_bytes(thread->buf,
+        length += gator_buf_write_bytes(thread->ring->buf,
                                         &write_pos,
                                         counter->activities[i],
                                         (counter->activities[i] == NULL) ? 0 : strlen(counter->activities[i]));
-        length += gator_buf_write_byte(thread->buf, &write_pos, '\0');
-        length += gator_buf_write_color(thread->buf, &write_pos, counter->activity_colors[i]);
+        length += gator_buf_write_byte(thread->ring->buf, &write_pos, '\0');
+        length += gator_buf_write_color(thread->ring->buf, &write_pos, counter->activity_colors[i]);
     }
-    length += gator_buf_write_bytes(thread->buf, &write_pos, counter->title, title_size);
-    length += gator_buf_write_byte(thread->buf, &write_pos, '\0');
-    length += gator_buf_write_bytes(thread->buf, &write_pos, counter->name, name_size);
-    length += gator_buf_write_byte(thread->buf, &write_pos, '\0');
-    length += gator_buf_write_bytes(thread->buf, &write_pos, counter->units, units_size);
-    length += gator_buf_write_byte(thread->buf, &write_pos, '\0');
-    length += gator_buf_write_bytes(thread->buf, &write_pos, counter->description, description_size);
+    length += gator_buf_write_bytes(thread->ring->buf, &write_pos, counter->title, title_size);
+    length += gator_buf_write_byte(thread->ring->buf, &write_pos, '\0');
+    length += gator_buf_write_bytes(thread->ring->buf, &write_pos, counter->name, name_size);
+    length += gator_buf_write_byte(thread->ring->buf, &write_pos, '\0');
+    length += gator_buf_write_bytes(thread->ring->buf, &write_pos, counter->units, units_size);
+    length += gator_buf_write_byte(thread->ring->buf, &write_pos, '\0');
+    length += gator_buf_write_bytes(thread->ring->buf, &write_pos, counter->description, description_size);
 
     gator_msg_end(thread, write_pos, size_pos, length);
 }
@@ -1156,10 +1972,10 @@ void gator_annotate_counter_value(const uint32_t core, const uint32_t id, const
     uint32_t length;
     gator_msg_begin(HEADER_COUNTER_VALUE, thread, &write_pos, &size_pos, &length);
 
-    length += gator_buf_write_time(thread->buf, &write_pos);
-    length += gator_buf_write_int(thread->buf, &write_pos, core);
-    length += gator_buf_write_int(thread->buf, &write_pos, id);
-    length += gator_buf_write_long(thread->buf, &write_pos, value);
+    length += gator_buf_write_time(thread->ring->buf, &write_pos);
+    length += gator_buf_write_int(thread->ring->buf, &write_pos, core);
+    length += gator_buf_write_int(thread->ring->buf, &write_pos, id);
+    length += gator_buf_write_long(thread->ring->buf, &write_pos, value);
 
     gator_msg_end(thread, write_pos, size_pos, length);
 }
@@ -1178,11 +1994,11 @@ void gator_annotate_activity_switch(const uint32_t core, const uint32_t id, cons
     uint32_t length;
     gator_msg_begin(HEADER_ACTIVITY_SWITCH, thread, &write_pos, &size_pos, &length);
 
-    length += gator_buf_write_time(thread->buf, &write_pos);
-    length += gator_buf_write_int(thread->buf, &write_pos, core);
-    length += gator_buf_write_int(thread->buf, &write_pos, id);
-    length += gator_buf_write_int(thread->buf, &write_pos, activity);
-    length += gator_buf_write_int(thread->buf, &write_pos, tid);
+    length += gator_buf_write_time(thread->ring->buf, &write_pos);
+    length += gator_buf_write_int(thread->ring->buf, &write_pos, core);
+    length += gator_buf_write_int(thread->ring->buf, &write_pos, id);
+    length += gator_buf_write_int(thread->ring->buf, &write_pos, activity);
+    length += gator_buf_write_int(thread->ring->buf, &write_pos, tid);
 
     gator_msg_end(thread, write_pos, size_pos, length);
 }
@@ -1198,10 +2014,10 @@ static void gator_annotate_write_cam_track(struct gator_thread * const thread,
     uint32_t length;
     gator_msg_begin(HEADER_CAM_TRACK, thread, &write_pos, &size_pos, &length);
 
-    length += gator_buf_write_int(thread->buf, &write_pos, cam_track->view_uid);
-    length += gator_buf_write_int(thread->buf, &write_pos, cam_track->track_uid);
-    length += gator_buf_write_int(thread->buf, &write_pos, cam_track->parent_track);
-    length += gator_buf_write_bytes(thread->buf, &write_pos, cam_track->name, name_size);
+    length += gator_buf_write_int(thread->ring->buf, &write_pos, cam_track->view_uid);
+    length += gator_buf_write_int(thread->ring->buf, &write_pos, cam_track->track_uid);
+    length += gator_buf_write_int(thread->ring->buf, &write_pos, cam_track->parent_track);
+    length += gator_buf_write_bytes(thread->ring->buf, &write_pos, cam_track->name, name_size);
 
     gator_msg_end(thread, write_pos, size_pos, length);
 }
@@ -1235,6 +2051,55 @@ void gator_cam_track(const uint32_t view_uid,
     gator_annotate_write_cam_track(thread, cam_track);
 }
 
+/* As gator_annotate_write_str */
+static void gator_cam_write_job(const uint32_t view_uid,
+                                const uint32_t job_uid,
+                                const char * const name,
+                                const uint32_t name_id,
+                                const uint32_t track,
+                                const uint64_t start_time,
+                                const uint64_t duration,
+                                const uint32_t color,
+                                const uint32_t primary_dependency,
+                                const size_t dependency_count,
+                                const uint32_t * const dependencies)
+{
+    struct gator_thread * const thread = gator_get_thread();
+    if (thread == NULL) {
+        return;
+    }
+
+    if (name_id != 0) {
+        gator_annotate_send_interned(thread);
+    }
+
+    const int name_size = (name == NULL) ? 0 : strlen(name);
+    gator_buf_wait_bytes(thread,
+                         1 + sizeof(uint32_t) + MAXSIZE_INTERNED_PREFIX + 5 * MAXSIZE_PACK_INT +
+                             2 * MAXSIZE_PACK_LONG + SIZE_COLOR + dependency_count * MAXSIZE_PACK_INT + name_size);
+
+    uint32_t write_pos;
+    uint32_t size_pos;
+    uint32_t length;
+    gator_msg_begin_str(HEADER_CAM_JOB, name_id, thread, &write_pos, &size_pos, &length);
+
+    length += gator_buf_write_int(thread->ring->buf, &write_pos, view_uid);
+    length += gator_buf_write_int(thread->ring->buf, &write_pos, job_uid);
+    length += gator_buf_write_int(thread->ring->buf, &write_pos, track);
+    length += gator_buf_write_long(thread->ring->buf, &write_pos, start_time);
+    length += gator_buf_write_long(thread->ring->buf, &write_pos, duration);
+    length += gator_buf_write_color(thread->ring->buf, &write_pos, color);
+    length += gator_buf_write_int(thread->ring->buf, &write_pos, primary_dependency);
+    length += gator_buf_write_int(thread->ring->buf, &write_pos, dependency_count);
+    size_t i;
+    for (i = 0; i < dependency_count; ++i) {
+        length += gator_buf_write_int(thread->ring->buf, &write_pos, dependencies[i]);
+    }
+    length += gator_buf_write_bytes(thread->ring->buf, &write_pos, name, name_size);
+
+    gator_msg_end(thread, write_pos, size_pos, length);
+}
+
 void gator_cam_job(const uint32_t view_uid,
                    const uint32_t job_uid,
                    const char * const name,
@@ -1245,70 +2110,183 @@ void gator_cam_job(const uint32_t view_uid,
                    const uint32_t primary_dependency,
                    const size_t dependency_count,
                    const uint32_t * const dependencies)
+{
+    gator_cam_write_job(view_uid,
+                        job_uid,
+                        name,
+                        0,
+                        track,
+                        start_time,
+                        duration,
+                        color,
+                        primary_dependency,
+                        dependency_count,
+                        dependencies);
+}
+
+void gator_cam_job_interned(const uint32_t view_uid,
+                            const uint32_t job_uid,
+                            const uint32_t name_id,
+                            const uint32_t track,
+                            const uint64_t start_time,
+                            const uint64_t duration,
+                            const uint32_t color,
+                            const uint32_t primary_dependency,
+                            const size_t dependency_count,
+                            const uint32_t * const dependencies)
+{
+    gator_cam_write_job(view_uid,
+                        job_uid,
+                        NULL,
+                        name_id,
+                        track,
+                        start_time,
+                        duration,
+                        color,
+                        primary_dependency,
+                        dependency_count,
+                        dependencies);
+}
+
+/* The most space a job may take in a batch */
+static size_t gator_cam_job_record_size(const struct gator_cam_job_record * const job)
+{
+    return 5 * MAXSIZE_PACK_INT + 2 * MAXSIZE_PACK_LONG + SIZE_COLOR + job->dependency_count * MAXSIZE_PACK_INT;
+}
+
+/*
+ * Each message holds the view, the number of jobs, then for each job; the job uid, the name id, the track, the
+ * difference between its start time and that of the previous job (or the start time, for the first), the duration,
+ * the color, the primary dependency, the number of dependencies and the dependencies.
+ */
+void gator_cam_jobs(const uint32_t view_uid, const struct gator_cam_job_record * const jobs, const size_t job_count)
 {
     struct gator_thread * const thread = gator_get_thread();
     if (thread == NULL) {
         return;
     }
 
-    const int name_size = (name == NULL) ? 0 : strlen(name);
-    gator_buf_wait_bytes(thread,
-                         1 + sizeof(uint32_t) + 5 * MAXSIZE_PACK_INT + 2 * MAXSIZE_PACK_LONG + SIZE_COLOR +
-                             dependency_count * MAXSIZE_PACK_INT + name_size);
+    gator_annotate_send_interned(thread);
 
-    uint32_t write_pos;
-    uint32_t size_pos;
-    uint32_t length;
-    gator_msg_begin(HEADER_CAM_JOB, thread, &write_pos, &size_pos, &length);
-
-    length += gator_buf_write_int(thread->buf, &write_pos, view_uid);
-    length += gator_buf_write_int(thread->buf, &write_pos, job_uid);
-    length += gator_buf_write_int(thread->buf, &write_pos, track);
-    length += gator_buf_write_long(thread->buf, &write_pos, start_time);
-    length += gator_buf_write_long(thread->buf, &write_pos, duration);
-    length += gator_buf_write_color(thread->buf, &write_pos, color);
-    length += gator_buf_write_int(thread->buf, &write_pos, primary_dependency);
-    length += gator_buf_write_int(thread->buf, &write_pos, dependency_count);
-    size_t i;
-    for (i = 0; i < dependency_count; ++i) {
-        length += gator_buf_write_int(thread->buf, &write_pos, dependencies[i]);
-    }
-    length += gator_buf_write_bytes(thread->buf, &write_pos, name, name_size);
+    size_t first = 0;
+    while (first < job_count) {
+        /* Take as many jobs as fit in one message */
+        size_t size = 1 + sizeof(uint32_t) + 2 * MAXSIZE_PACK_INT;
+        size_t end = first;
+        while (end < job_count && size + gator_cam_job_record_size(&jobs[end]) <= MAXSIZE_CAM_JOB_BATCH) {
+            size += gator_cam_job_record_size(&jobs[end]);
+            ++end;
+        }
 
-    gator_msg_end(thread, write_pos, size_pos, length);
+        /* A job with too many dependencies to fit is sent on its own */
+        if (end == first) {
+            const struct gator_cam_job_record * const job = &jobs[first];
+            gator_cam_write_job(view_uid,
+                                job->job_uid,
+                                NULL,
+                                job->name_id,
+                                job->track,
+                                job->start_time,
+                                job->duration,
+                                job->color,
+                                job->primary_dependency,
+                                job->dependency_count,
+                                job->dependencies);
+            ++first;
+            continue;
+        }
+
+        __gator_buf_wait_bytes(thread, size);
+
+        uint32_t write_pos;
+        uint32_t size_pos;
+        uint32_t length;
+        gator_msg_begin(HEADER_CAM_JOB_BATCH, thread, &write_pos, &size_pos, &length);
+
+        length += gator_buf_write_int(thread->ring->buf, &write_pos, view_uid);
+        length += gator_buf_write_int(thread->ring->buf, &write_pos, end - first);
+        uint64_t previous_start_time = 0;
+        size_t i;
+        for (i = first; i < end; ++i) {
+            const struct gator_cam_job_record * const job = &jobs[i];
+            length += gator_buf_write_int(thread->ring->buf, &write_pos, job->job_uid);
+            length += gator_buf_write_int(thread->ring->buf, &write_pos, job->name_id);
+            length += gator_buf_write_int(thread->ring->buf, &write_pos, job->track);
+            length += gator_buf_write_long(thread->ring->buf, &write_pos, job->start_time - previous_start_time);
+            length += gator_buf_write_long(thread->ring->buf, &write_pos, job->duration);
+            length += gator_buf_write_color(thread->ring->buf, &write_pos, job->color);
+            length += gator_buf_write_int(thread->ring->buf, &write_pos, job->primary_dependency);
+            length += gator_buf_write_int(thread->ring->buf, &write_pos, job->dependency_count);
+            size_t j;
+            for (j = 0; j < job->dependency_count; ++j) {
+                length += gator_buf_write_int(thread->ring->buf, &write_pos, job->dependencies[j]);
+            }
+            previous_start_time = job->start_time;
+        }
+
+        gator_msg_end(thread, write_pos, size_pos, length);
+        first = end;
+    }
 }
 
-void gator_cam_job_start(const uint32_t view_uid,
-                         const uint32_t job_uid,
-                         const char * const name,
-                         const uint32_t track,
-                         const uint64_t time,
-                         const uint32_t color)
+/* As gator_annotate_write_str */
+static void gator_cam_write_job_start(const uint32_t view_uid,
+                                      const uint32_t job_uid,
+                                      const char * const name,
+                                      const uint32_t name_id,
+                                      const uint32_t track,
+                                      const uint64_t time,
+                                      const uint32_t color)
 {
     struct gator_thread * const thread = gator_get_thread();
     if (thread == NULL) {
         return;
     }
 
+    if (name_id != 0) {
+        gator_annotate_send_interned(thread);
+    }
+
     const int name_size = (name == NULL) ? 0 : strlen(name);
     gator_buf_wait_bytes(thread,
-                         1 + sizeof(uint32_t) + 3 * MAXSIZE_PACK_INT + MAXSIZE_PACK_LONG + SIZE_COLOR + name_size);
+                         1 + sizeof(uint32_t) + MAXSIZE_INTERNED_PREFIX + 3 * MAXSIZE_PACK_INT + MAXSIZE_PACK_LONG +
+                             SIZE_COLOR + name_size);
 
     uint32_t write_pos;
     uint32_t size_pos;
     uint32_t length;
-    gator_msg_begin(HEADER_CAM_JOB_START, thread, &write_pos, &size_pos, &length);
+    gator_msg_begin_str(HEADER_CAM_JOB_START, name_id, thread, &write_pos, &size_pos, &length);
 
-    length += gator_buf_write_int(thread->buf, &write_pos, view_uid);
-    length += gator_buf_write_int(thread->buf, &write_pos, job_uid);
-    length += gator_buf_write_int(thread->buf, &write_pos, track);
-    length += gator_buf_write_long(thread->buf, &write_pos, time);
-    length += gator_buf_write_color(thread->buf, &write_pos, color);
-    length += gator_buf_write_bytes(thread->buf, &write_pos, name, name_size);
+    length += gator_buf_write_int(thread->ring->buf, &write_pos, view_uid);
+    length += gator_buf_write_int(thread->ring->buf, &write_pos, job_uid);
+    length += gator_buf_write_int(thread->ring->buf, &write_pos, track);
+    length += gator_buf_write_long(thread->ring->buf, &write_pos, time);
+    length += gator_buf_write_color(thread->ring->buf, &write_pos, color);
+    length += gator_buf_write_bytes(thread->ring->buf, &write_pos, name, name_size);
 
     gator_msg_end(thread, write_pos, size_pos, length);
 }
 
+void gator_cam_job_start(const uint32_t view_uid,
+                         const uint32_t job_uid,
+                         const char * const name,
+                         const uint32_t track,
+                         const uint64_t time,
+                         const uint32_t color)
+{
+    gator_cam_write_job_start(view_uid, job_uid, name, 0, track, time, color);
+}
+
+void gator_cam_job_start_interned(const uint32_t view_uid,
+                                  const uint32_t job_uid,
+                                  const uint32_t name_id,
+                                  const uint32_t track,
+                                  const uint64_t time,
+                                  const uint32_t color)
+{
+    gator_cam_write_job_start(view_uid, job_uid, NULL, name_id, track, time, color);
+}
+
 void gator_cam_job_set_dependencies(const uint32_t view_uid,
                                     const uint32_t job_uid,
                                     const uint64_t time,
@@ -1330,14 +2308,14 @@ void gator_cam_job_set_dependencies(const uint32_t view_uid,
     uint32_t length;
     gator_msg_begin(HEADER_CAM_JOB_SET_DEPS, thread, &write_pos, &size_pos, &length);
 
-    length += gator_buf_write_int(thread->buf, &write_pos, view_uid);
-    length += gator_buf_write_int(thread->buf, &write_pos, job_uid);
-    length += gator_buf_write_long(thread->buf, &write_pos, time);
-    length += gator_buf_write_int(thread->buf, &write_pos, primary_dependency);
-    length += gator_buf_write_int(thread->buf, &write_pos, dependency_count);
+    length += gator_buf_write_int(thread->ring->buf, &write_pos, view_uid);
+    length += gator_buf_write_int(thread->ring->buf, &write_pos, job_uid);
+    length += gator_buf_write_long(thread->ring->buf, &write_pos, time);
+    length += gator_buf_write_int(thread->ring->buf, &write_pos, primary_dependency);
+    length += gator_buf_write_int(thread->ring->buf, &write_pos, dependency_count);
     size_t i;
     for (i = 0; i < dependency_count; ++i) {
-        length += gator_buf_write_int(thread->buf, &write_pos, dependencies[i]);
+        length += gator_buf_write_int(thread->ring->buf, &write_pos, dependencies[i]);
     }
 
     gator_msg_end(thread, write_pos, size_pos, length);
@@ -1357,9 +2335,9 @@ void gator_cam_job_stop(const uint32_t view_uid, const uint32_t job_uid, const u
     uint32_t length;
     gator_msg_begin(HEADER_CAM_JOB_STOP, thread, &write_pos, &size_pos, &length);
 
-    length += gator_buf_write_int(thread->buf, &write_pos, view_uid);
-    length += gator_buf_write_int(thread->buf, &write_pos, job_uid);
-    length += gator_buf_write_long(thread->buf, &write_pos, time);
+    length += gator_buf_write_int(thread->ring->buf, &write_pos, view_uid);
+    length += gator_buf_write_int(thread->ring->buf, &write_pos, job_uid);
+    length += gator_buf_write_long(thread->ring->buf, &write_pos, time);
 
     gator_msg_end(thread, write_pos, size_pos, length);
 }
@@ -1375,8 +2353,8 @@ static void gator_annotate_write_cam_name(struct gator_thread * const thread,
     uint32_t length;
     gator_msg_begin(HEADER_CAM_VIEW_NAME, thread, &write_pos, &size_pos, &length);
 
-    length += gator_buf_write_int(thread->buf, &write_pos, cam_name->view_uid);
-    length += gator_buf_write_bytes(thread->buf, &write_pos, cam_name->name, name_size);
+    length += gator_buf_write_int(thread->ring->buf, &write_pos, cam_name->view_uid);
+    length += gator_buf_write_bytes(thread->ring->buf, &write_pos, cam_name->name, name_size);
 
     gator_msg_end(thread, write_pos, size_pos, length);
 }
@@ -1,4 +1,4 @@
-/* Copyright (C) 2014-2021 by Arm Limited. All rights reserved.
+/* Copyright (C) 2014-2022 by Arm Limited. All rights reserved.
  *
  * Redistribution and use in source and binary forms, with or without
  * modification, are permitted provided that the following conditions
@@ -57,6 +57,9 @@
  *  CAM_VIEW_NAME                                Name the custom activity map view
  *  CAM_TRACK                                    Create a new custom activity map track
  *  CAM_JOB                                      Add a new job to a CAM track, use gator_get_time() to obtain the time in nanoseconds
+ *  CAM_JOB_INTERNED                             As CAM_JOB, with the id of an interned name
+ *  CAM_JOB_START_INTERNED                       As CAM_JOB_START, with the id of an interned name
+ *  CAM_JOBS                                     Add an array of jobs to a view at once, see gator_cam_job_record
  *
  *  For defining textual annotations:
  *
@@ -74,6 +77,17 @@
  *  ANNOTATE_END()                               Terminate an annotation
  *  ANNOTATE_CHANNEL_END(channel)                Terminate an annotation on a channel
  *
+ *  For strings that are annotated many times, intern them once and then annotate with their id, so that only the id
+ *  is sent each time. Interning requires a version of gatord that supports it. Interning a string that has already
+ *  been interned returns the same id; 0 is returned on failure, which annotates as if the string were NULL:
+ *
+ *  ANNOTATE_INTERN(str)                         Intern a string, returning its id
+ *  ANNOTATE_INTERNED(id)                        String annotation with an interned string
+ *  ANNOTATE_CHANNEL_INTERNED(channel, id)       String annotation on a channel with an interned string
+ *  ANNOTATE_COLOR_INTERNED(color, id)           String annotation with color with an interned string
+ *  ANNOTATE_CHANNEL_COLOR_INTERNED(channel, color, id)
+ *                                               String annotation on a channel with color with an interned string
+ *
  *  For sending image annotations:
  *
  *  ANNOTATE_VISUAL(data, length, str)           Image annotation with optional string
@@ -125,12 +139,33 @@ enum gator_annotate_series_composition { ANNOTATE_STACKED = 1, ANNOTATE_OVERLAY,
 
 enum gator_annotate_rendering_type { ANNOTATE_FILL = 1, ANNOTATE_LINE, ANNOTATE_BAR };
 
+/*
+ * One of the jobs added by gator_cam_jobs, with the same meaning as the arguments of gator_cam_job_interned. The
+ * name, if any, must be interned. The jobs are sent in a compact form that gator expands, so this requires a version
+ * of gator that supports it.
+ */
+struct gator_cam_job_record {
+    uint32_t job_uid;
+    /* The id returned by gator_annotate_intern, or 0 for no name */
+    uint32_t name_id;
+    uint32_t track;
+    uint64_t start_time;
+    uint64_t duration;
+    uint32_t color;
+    uint32_t primary_dependency;
+    size_t dependency_count;
+    const uint32_t * dependencies;
+};
+
 void gator_annotate_setup(void);
 uint64_t gator_get_time(void);
 void gator_annotate_fork_child(void);
 void gator_annotate_flush(void);
 void gator_annotate_str(uint32_t channel, const char * str);
 void gator_annotate_color(uint32_t channel, uint32_t color, const char * str);
+uint32_t gator_annotate_intern(const char * str);
+void gator_annotate_str_interned(uint32_t channel, uint32_t str_id);
+void gator_annotate_color_interned(uint32_t channel, uint32_t color, uint32_t str_id);
 void gator_annotate_name_channel(uint32_t channel, uint32_t group, const char * str);
 void gator_annotate_name_group(uint32_t group, const char * str);
 void gator_annotate_visual(const void * data, uint32_t length, const char * str);
@@ -168,12 +203,29 @@ void gator_cam_job(uint32_t view_uid,
                    uint32_t primary_dependency,
                    size_t dependency_count,
                    const uint32_t * dependencies);
+void gator_cam_job_interned(uint32_t view_uid,
+                            uint32_t job_uid,
+                            uint32_t name_id,
+                            uint32_t track,
+                            uint64_t start_time,
+                            uint64_t duration,
+                            uint32_t color,
+                            uint32_t primary_dependency,
+                            size_t dependency_count,
+                            const uint32_t * dependencies);
+void gator_cam_jobs(uint32_t view_uid, const struct gator_cam_job_record * jobs, size_t job_count);
 void gator_cam_job_start(uint32_t view_uid,
                          uint32_t job_uid,
                          const char * name,
                          uint32_t track,
                          uint64_t time,
                          uint32_t color);
+void gator_cam_job_start_interned(uint32_t view_uid,
+                                  uint32_t job_uid,
+                                  uint32_t name_id,
+                                  uint32_t track,
+                                  uint64_t time,
+                                  uint32_t color);
 void gator_cam_job_set_dependencies(uint32_t view_uid,
                                     uint32_t job_uid,
                                     uint64_t time,
@@ -193,6 +245,11 @@ void gator_cam_view_name(uint32_t view_uid, const char * name);
 #define ANNOTATE_CHANNEL_COLOR(channel, color, str) gator_annotate_color(channel, color, str)
 #define ANNOTATE_END() gator_annotate_str(0, NULL)
 #define ANNOTATE_CHANNEL_END(channel) gator_annotate_str(channel, NULL)
+#define ANNOTATE_INTERN(str) gator_annotate_intern(str)
+#define ANNOTATE_INTERNED(id) gator_annotate_str_interned(0, id)
+#define ANNOTATE_CHANNEL_INTERNED(channel, id) gator_annotate_str_interned(channel, id)
+#define ANNOTATE_COLOR_INTERNED(color, id) gator_annotate_color_interned(0, color, id)
+#define ANNOTATE_CHANNEL_COLOR_INTERNED(channel, color, id) gator_annotate_color_interned(channel, color, id)
 #define ANNOTATE_NAME_CHANNEL(channel, group, str) gator_annotate_name_channel(channel, group, str)
 #define ANNOTATE_NAME_GROUP(group, str) gator_annotate_name_group(group, str)
 
@@ -303,6 +360,11 @@ void gator_cam_view_name(uint32_t view_uid, const char * name);
     gator_cam_job(view_uid, job_uid, name, track, start_time, duration, color, -1, dependency_count, dependencies)
 #define CAM_JOB_START(view_uid, job_uid, name, track, time, color)                                                     \
     gator_cam_job_start(view_uid, job_uid, name, track, time, color)
+#define CAM_JOB_INTERNED(view_uid, job_uid, name_id, track, start_time, duration, color)                               \
+    gator_cam_job_interned(view_uid, job_uid, name_id, track, start_time, duration, color, -1, 0, 0)
+#define CAM_JOB_START_INTERNED(view_uid, job_uid, name_id, track, time, color)                                         \
+    gator_cam_job_start_interned(view_uid, job_uid, name_id, track, time, color)
+#define CAM_JOBS(view_uid, jobs, job_count) gator_cam_jobs(view_uid, jobs, job_count)
 #define CAM_JOB_SET_DEP(view_uid, job_uid, time, dependency)                                                           \
     {                                                                                                                  \
         uint32_t __dependency = dependency;                                                                            \
@@ -5,10 +5,17 @@
 #include "FtraceDriver.h"
 #include "Logging.h"
 #include "OlyUtility.h"
+#include "android/PropertyUtils.h"
 #include "lib/String.h"
 
+#include <cstring>
+#include <string>
+#include <vector>
+
 #include <unistd.h>
 
+extern char ** environ;
+
 class AtraceCounter : public DriverCounter {
 public:
     AtraceCounter(DriverCounter * next, const char * name, int flag);
@@ -88,18 +95,36 @@ void AtraceDriver::readEvents(mxml_node_t * const xml)
 void AtraceDriver::setAtrace(const int flags)
 {
     LOG_DEBUG("Setting atrace flags to %i", flags);
+    const lib::printf_str_t<16> flagsStr {"%i", flags};
+    if (!android_prop_utils::setProperty("debug.atrace.tags.enableflags", flagsStr.c_str())) {
+        LOG_WARNING("Unable to set the atrace flags");
+        return;
+    }
+
+    // the apps only read the property again once notified, which needs the framework so cannot be done directly;
+    // the environment is made before forking so that the child only has to exec
+    const std::string classPath = std::string("CLASSPATH=") + mNotifyPath;
+    std::vector<char *> envp;
+    for (char ** env = environ; *env != nullptr; ++env) {
+        if (strncmp(*env, "CLASSPATH=", 10) != 0) {
+            envp.push_back(*env);
+        }
+    }
+    envp.push_back(const_cast<char *>(classPath.c_str()));
+    envp.push_back(nullptr);
+    char appProcess[] = "/system/bin/app_process";
+    char binDir[] = "/system/bin";
+    char notify[] = "Notify";
+    char * const argv[] = {appProcess, binDir, notify, nullptr};
+
     pid_t pid = fork();
     if (pid < 0) {
         LOG_ERROR("fork failed");
         handleException();
     }
     else if (pid == 0) {
-        lib::printf_str_t<1 << 10> buf {"setprop debug.atrace.tags.enableflags %i; "
-                                        "CLASSPATH=%s app_process /system/bin Notify",
-                                        flags,
-                                        mNotifyPath};
-        execlp("sh", "sh", "-c", buf, nullptr);
-        exit(0);
+        execve(appProcess, argv, envp.data());
+        _exit(0);
     }
 }
 
@@ -4,7 +4,83 @@
 
 #include "BufferUtils.h"
 #include "CommitTimeChecker.h"
+#include "FixedFrameLayout.h"
 #include "IRawFrameBuilder.h"
+#include "Logging.h"
+#include "lib/Probe.h"
+
+#include <algorithm>
+#include <atomic>
+
+namespace {
+    // shared by the delta and rollup states, so that a decoder can key either by stream id alone
+    std::atomic_int nextStreamId {0};
+
+    /** A key, then a value; the key is 0 for a timestamp, 1 for a tid, 2 for a core, or else a counter's key */
+    using KeyValueLayout = buffer_utils::FixedFrameLayout<buffer_utils::PackedInt32, buffer_utils::PackedInt64>;
+    using KeyValue32Layout = buffer_utils::FixedFrameLayout<buffer_utils::PackedInt32, buffer_utils::PackedInt32>;
+
+    std::uint64_t getContextKey(int tid, int core)
+    {
+        return (std::uint64_t(std::uint32_t(tid)) << 32) | std::uint32_t(core);
+    }
+}
+
+BlockCounterDeltaState::BlockCounterDeltaState() : streamId(nextStreamId++)
+{
+    setContext(0, 0);
+}
+
+void BlockCounterDeltaState::setContext(int newTid, int newCore)
+{
+    tid = newTid;
+    core = newCore;
+    currentValues = &previousValues[getContextKey(tid, core)];
+}
+
+BlockCounterRollupState::BlockCounterRollupState() : streamId(nextStreamId++)
+{
+}
+
+void BlockCounterRollupState::startSample(std::uint64_t time)
+{
+    for (auto & level : levels) {
+        if (level.samples == 0) {
+            level.startTime = time;
+        }
+        level.samples += 1;
+        level.endTime = time;
+    }
+    setContext(0, 0);
+}
+
+void BlockCounterRollupState::setContext(int newTid, int newCore)
+{
+    tid = newTid;
+    core = newCore;
+    const auto contextKey = getContextKey(tid, core);
+    for (auto & level : levels) {
+        level.currentSummaries = &level.summaries[contextKey];
+    }
+}
+
+void BlockCounterRollupState::add(int key, std::int64_t value)
+{
+    for (auto & level : levels) {
+        if (level.currentSummaries == nullptr) {
+            // no sample has started
+            continue;
+        }
+        const auto [it, inserted] = level.currentSummaries->try_emplace(key, Summary {value, value, value, 1});
+        if (!inserted) {
+            Summary & summary = it->second;
+            summary.min = std::min(summary.min, value);
+            summary.max = std::max(summary.max, value);
+            summary.sum += value;
+            summary.count += 1;
+        }
+    }
+}
 
 BlockCounterFrameBuilder::~BlockCounterFrameBuilder()
 {
@@ -13,14 +89,27 @@ BlockCounterFrameBuilder::~BlockCounterFrameBuilder()
 
 bool BlockCounterFrameBuilder::eventHeader(uint64_t time)
 {
+    if (rollupState != nullptr) {
+        writeCompletedRollups();
+    }
+
     if (!ensureFrameStarted()) {
         return false;
     }
 
-    if (checkSpace(buffer_utils::MAXSIZE_PACK32 + buffer_utils::MAXSIZE_PACK64)) {
+    if (checkSpace(KeyValueLayout::MAX_SIZE)) {
         // key of zero indicates a timestamp
-        rawBuilder.packInt(0);
-        rawBuilder.packInt64(time);
+        if (deltaState != nullptr) {
+            KeyValueLayout::write(rawBuilder, 0, static_cast<int64_t>(time - deltaState->previousTime));
+            deltaState->previousTime = time;
+            deltaState->setContext(0, 0);
+        }
+        else {
+            KeyValueLayout::write(rawBuilder, 0, static_cast<int64_t>(time));
+        }
+        if (rollupState != nullptr) {
+            rollupState->startSample(time);
+        }
 
         return true;
     }
@@ -34,10 +123,16 @@ bool BlockCounterFrameBuilder::eventCore(int core)
         return false;
     }
 
-    if (checkSpace(2 * buffer_utils::MAXSIZE_PACK32)) {
+    if (checkSpace(KeyValue32Layout::MAX_SIZE)) {
         // key of 2 indicates a core
-        rawBuilder.packInt(2);
-        rawBuilder.packInt(core);
+        KeyValue32Layout::write(rawBuilder, 2, core);
+
+        if (deltaState != nullptr) {
+            deltaState->setContext(deltaState->tid, core);
+        }
+        if (rollupState != nullptr) {
+            rollupState->setContext(rollupState->tid, core);
+        }
 
         return true;
     }
@@ -51,10 +146,16 @@ bool BlockCounterFrameBuilder::eventTid(int tid)
         return false;
     }
 
-    if (checkSpace(2 * buffer_utils::MAXSIZE_PACK32)) {
+    if (checkSpace(KeyValue32Layout::MAX_SIZE)) {
         // key of 1 indicates a tid
-        rawBuilder.packInt(1);
-        rawBuilder.packInt(tid);
+        KeyValue32Layout::write(rawBuilder, 1, tid);
+
+        if (deltaState != nullptr) {
+            deltaState->setContext(tid, deltaState->core);
+        }
+        if (rollupState != nullptr) {
+            rollupState->setContext(tid, rollupState->core);
+        }
 
         return true;
     }
@@ -64,13 +165,32 @@ bool BlockCounterFrameBuilder::eventTid(int tid)
 
 bool BlockCounterFrameBuilder::event64(int key, int64_t value)
 {
+    // every value is summarised, including those omitted from the delta frames
+    if (rollupState != nullptr) {
+        rollupState->add(key, value);
+    }
+
+    BlockCounterDeltaState::ValueMap * const previousValues =
+        (deltaState != nullptr ? deltaState->currentValues : nullptr);
+    if (previousValues != nullptr) {
+        const auto it = previousValues->find(key);
+        if ((it != previousValues->end()) && (it->second == value)) {
+            // unchanged, so omitted
+            return true;
+        }
+    }
+
     if (!ensureFrameStarted()) {
         return false;
     }
 
-    if (checkSpace(buffer_utils::MAXSIZE_PACK64 + buffer_utils::MAXSIZE_PACK32)) {
-        rawBuilder.packInt(key);
-        rawBuilder.packInt64(value);
+    if (checkSpace(KeyValueLayout::MAX_SIZE)) {
+        KeyValueLayout::write(rawBuilder, key, value);
+
+        // only once sent, as the decoder will not have seen it otherwise
+        if (previousValues != nullptr) {
+            (*previousValues)[key] = value;
+        }
 
         return true;
     }
@@ -80,7 +200,8 @@ bool BlockCounterFrameBuilder::event64(int key, int64_t value)
 
 bool BlockCounterFrameBuilder::check(const uint64_t time)
 {
-    if ((flushIsNeeded != nullptr) && ((*flushIsNeeded)(time, rawBuilder.needsFlush()))) {
+    if ((flushIsNeeded != nullptr) && ((*flushIsNeeded)(time, rawBuilder.needsFlush(), rawBuilder.bytesSinceFlush()))) {
+        GATOR_PROBE2(block_counter_flush, time, rawBuilder.bytesSinceFlush());
         return flush();
     }
     return false;
@@ -108,8 +229,14 @@ bool BlockCounterFrameBuilder::ensureFrameStarted()
         return false;
     }
 
-    rawBuilder.beginFrame(FrameType::BLOCK_COUNTER);
-    rawBuilder.packInt(0); // core
+    if (deltaState != nullptr) {
+        rawBuilder.beginFrame(FrameType::BLOCK_COUNTER_DELTA);
+        rawBuilder.packInt(deltaState->getStreamId());
+    }
+    else {
+        rawBuilder.beginFrame(FrameType::BLOCK_COUNTER);
+        rawBuilder.packInt(0); // core
+    }
     isFrameStarted = true;
     return true;
 }
@@ -123,3 +250,56 @@ bool BlockCounterFrameBuilder::endFrame()
     }
     return shouldEndFrame;
 }
+
+void BlockCounterFrameBuilder::writeCompletedRollups()
+{
+    for (std::size_t i = 0; i < BlockCounterRollupState::FACTORS.size(); ++i) {
+        const unsigned factor = BlockCounterRollupState::FACTORS[i];
+        auto & level = rollupState->levels[i];
+        if (level.samples < factor) {
+            continue;
+        }
+
+        // the rollup frame must not be nested in the current frame
+        endFrame();
+
+        constexpr int summarySize = buffer_utils::MAXSIZE_PACK32 + 3 * buffer_utils::MAXSIZE_PACK64;
+        int size = IRawFrameBuilder::MAX_FRAME_HEADER_SIZE + 3 * buffer_utils::MAXSIZE_PACK32
+                 + 2 * buffer_utils::MAXSIZE_PACK64;
+        for (const auto & [contextKey, summaries] : level.summaries) {
+            size += 4 * buffer_utils::MAXSIZE_PACK32 + static_cast<int>(summaries.size()) * summarySize;
+        }
+
+        if (checkSpace(size)) {
+            rawBuilder.beginFrame(FrameType::BLOCK_COUNTER_ROLLUP);
+            rawBuilder.packInt(rollupState->getStreamId());
+            rawBuilder.packInt(factor);
+            rawBuilder.packInt64(level.startTime);
+            rawBuilder.packInt64(level.endTime);
+            rawBuilder.packInt(level.samples);
+            for (const auto & [contextKey, summaries] : level.summaries) {
+                if (summaries.empty()) {
+                    continue;
+                }
+                rawBuilder.packInt(1);
+                rawBuilder.packInt(static_cast<int32_t>(contextKey >> 32));
+                rawBuilder.packInt(2);
+                rawBuilder.packInt(static_cast<int32_t>(contextKey & 0xffffffffU));
+                for (const auto & [key, summary] : summaries) {
+                    rawBuilder.packInt(key);
+                    rawBuilder.packInt64(summary.min);
+                    rawBuilder.packInt64(summary.max);
+                    rawBuilder.packInt64(summary.sum / summary.count);
+                }
+            }
+            rawBuilder.endFrame();
+        }
+        else {
+            LOG_DEBUG("Dropped a block counter rollup of %u samples as the buffer is full", level.samples);
+        }
+
+        level.samples = 0;
+        level.summaries.clear();
+        level.currentSummaries = nullptr;
+    }
+}
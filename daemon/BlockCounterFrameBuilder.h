@@ -1,24 +1,122 @@
-/* Copyright (C) 2020-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2020-2022 by Arm Limited. All rights reserved. */
 
 #pragma once
 
 #include "CommitTimeChecker.h"
 #include "IBlockCounterFrameBuilder.h"
 
+#include <array>
+#include <cstdint>
 #include <memory>
+#include <unordered_map>
 #include <utility>
 
 class IRawFrameBuilder;
 
+/**
+ * The encoder state of a stream of FrameType::BLOCK_COUNTER_DELTA frames.
+ *
+ * In a delta frame the frame header holds the stream id rather than a core; each timestamp is the difference from the
+ * previous timestamp in the stream (or from zero for the first); and a value is omitted if it is the same as the
+ * previous value sent in the stream for that key, tid and core, where the tid and core are those most recently sent
+ * since the timestamp (or zero if none were). Decoders must therefore keep the same state per stream id, across frames.
+ *
+ * The state must be shared by all the builders that write to one buffer, and only be used by one of them at a time.
+ */
+class BlockCounterDeltaState {
+public:
+    BlockCounterDeltaState();
+
+    [[nodiscard]] int getStreamId() const { return streamId; }
+
+private:
+    friend class BlockCounterFrameBuilder;
+
+    using ValueMap = std::unordered_map<int, std::int64_t>;
+
+    const int streamId;
+    std::uint64_t previousTime = 0;
+    int tid = 0;
+    int core = 0;
+    /** The previous values by key, for each tid and core */
+    std::unordered_map<std::uint64_t, ValueMap> previousValues {};
+    /** The previous values of the current tid and core */
+    ValueMap * currentValues = nullptr;
+
+    void setContext(int newTid, int newCore);
+};
+
+/**
+ * The state of the FrameType::BLOCK_COUNTER_ROLLUP frames of a stream of block counter frames.
+ *
+ * Each level summarises consecutive runs of FACTORS[i] samples (that is, timestamps) in one rollup frame, so that a
+ * long capture can be shown at low zoom without reading every sample. A rollup frame holds the stream id, the factor,
+ * the times of the first and last samples and the number of samples, followed by the summaries. The summaries are
+ * made of the key of 1 and the tid, the key of 2 and the core, then for each key seen with that tid and core, the key,
+ * the minimum, the maximum and the (truncated) mean of its values. A run is written once the next sample starts, so
+ * the last, partial, run of a capture is not written.
+ *
+ * As for BlockCounterDeltaState, the state must be shared by all the builders that write to one buffer, and only be
+ * used by one of them at a time.
+ */
+class BlockCounterRollupState {
+public:
+    /** The number of samples each level summarises */
+    static constexpr std::array<unsigned, 2> FACTORS {10, 100};
+
+    BlockCounterRollupState();
+
+    [[nodiscard]] int getStreamId() const { return streamId; }
+
+private:
+    friend class BlockCounterFrameBuilder;
+
+    struct Summary {
+        std::int64_t min;
+        std::int64_t max;
+        std::int64_t sum;
+        std::uint32_t count;
+    };
+
+    using SummaryMap = std::unordered_map<int, Summary>;
+
+    struct Level {
+        unsigned samples = 0;
+        std::uint64_t startTime = 0;
+        std::uint64_t endTime = 0;
+        /** The summaries by key, for each tid and core */
+        std::unordered_map<std::uint64_t, SummaryMap> summaries {};
+        /** The summaries of the current tid and core */
+        SummaryMap * currentSummaries = nullptr;
+    };
+
+    const int streamId;
+    int tid = 0;
+    int core = 0;
+    std::array<Level, FACTORS.size()> levels {};
+
+    void startSample(std::uint64_t time);
+    void setContext(int newTid, int newCore);
+    void add(int key, std::int64_t value);
+};
+
 /**
  * Builds block counter frames
  *
- * Creates and splits frames as needed
+ * Creates and splits frames as needed. If given a delta state then it builds FrameType::BLOCK_COUNTER_DELTA frames
+ * rather than FrameType::BLOCK_COUNTER. If given a rollup state then it also builds FrameType::BLOCK_COUNTER_ROLLUP
+ * frames, between the others.
  */
 class BlockCounterFrameBuilder : public IBlockCounterFrameBuilder {
 public:
-    BlockCounterFrameBuilder(IRawFrameBuilder & rawBuilder, std::uint64_t commitRate)
-        : rawBuilder(rawBuilder), flushIsNeeded(std::make_shared<CommitTimeChecker>(commitRate))
+    BlockCounterFrameBuilder(IRawFrameBuilder & rawBuilder,
+                             std::uint64_t commitRate,
+                             std::shared_ptr<BlockCounterDeltaState> deltaState = {},
+                             std::shared_ptr<BlockCounterRollupState> rollupState = {})
+        : rawBuilder(rawBuilder),
+          flushIsNeeded(std::make_shared<CommitTimeChecker>(commitRate)),
+          deltaState(std::move(deltaState)),
+          rollupState(std::move(rollupState))
     {
     }
 
@@ -44,9 +142,12 @@ public:
 private:
     IRawFrameBuilder & rawBuilder;
     std::shared_ptr<CommitTimeChecker> flushIsNeeded;
+    std::shared_ptr<BlockCounterDeltaState> deltaState {};
+    std::shared_ptr<BlockCounterRollupState> rollupState {};
     bool isFrameStarted = false;
 
     bool ensureFrameStarted();
     bool endFrame();
+    void writeCompletedRollups();
     bool checkSpace(const int bytes);
 };
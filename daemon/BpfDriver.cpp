@@ -0,0 +1,357 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "BpfDriver.h"
+
+#include "Logging.h"
+#include "k/perf_event.h"
+#include "lib/AutoClosingFd.h"
+#include "lib/Syscall.h"
+#include "lib/Utils.h"
+#include "linux/Tracepoints.h"
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <linux/bpf.h>
+#include <unistd.h>
+
+namespace {
+    constexpr const char * COUNTER_PREFIX = "bpf_";
+    constexpr const char * POSSIBLE_CPUS_PATH = "/sys/devices/system/cpu/possible";
+
+    /** The value kept by the program for each cpu */
+    struct BpfValue {
+        // the number of times the tracepoint fired
+        std::uint64_t count;
+        // the sum of the field, if any
+        std::uint64_t sum;
+    };
+
+    /** Where some integer field is in the tracepoint's record; its value is always treated as unsigned */
+    struct FieldLocation {
+        std::int16_t offset;
+        std::uint8_t size;
+    };
+
+    std::uint64_t toAttrPointer(const void * pointer)
+    {
+        return static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(pointer));
+    }
+
+    bpf_insn makeInsn(std::uint8_t code, std::uint8_t dst, std::uint8_t src, std::int16_t off, std::int32_t imm)
+    {
+        bpf_insn result {};
+        result.code = code;
+        result.dst_reg = dst;
+        result.src_reg = src;
+        result.off = off;
+        result.imm = imm;
+        return result;
+    }
+
+    lib::AutoClosingFd createMap()
+    {
+        bpf_attr attr {};
+        attr.map_type = BPF_MAP_TYPE_PERCPU_ARRAY;
+        attr.key_size = sizeof(std::uint32_t);
+        attr.value_size = sizeof(BpfValue);
+        attr.max_entries = 1;
+        return lib::AutoClosingFd {lib::bpf(BPF_MAP_CREATE, &attr, sizeof(attr))};
+    }
+
+    /**
+     * Load the program that, each time the tracepoint fires, increments the count in the map's only entry and (if there
+     * is a field) adds the field's value to the sum. The map is per cpu, so no atomic operations are needed.
+     */
+    lib::AutoClosingFd loadProgram(int mapFd, const std::optional<FieldLocation> & field)
+    {
+        constexpr std::uint8_t R0 = BPF_REG_0;
+        constexpr std::uint8_t R1 = BPF_REG_1;
+        constexpr std::uint8_t R2 = BPF_REG_2;
+        constexpr std::uint8_t R3 = BPF_REG_3;
+        constexpr std::uint8_t R6 = BPF_REG_6;
+        constexpr std::uint8_t R10 = BPF_REG_10;
+
+        std::vector<bpf_insn> update {
+            makeInsn(BPF_LDX | BPF_MEM | BPF_DW, R1, R0, offsetof(BpfValue, count), 0),
+            makeInsn(BPF_ALU64 | BPF_ADD | BPF_K, R1, 0, 0, 1),
+            makeInsn(BPF_STX | BPF_MEM | BPF_DW, R0, R1, offsetof(BpfValue, count), 0),
+        };
+        if (field) {
+            static constexpr std::uint8_t sizes[] = {0, BPF_B, BPF_H, 0, BPF_W, 0, 0, 0, BPF_DW};
+            update.push_back(makeInsn(BPF_LDX | BPF_MEM | sizes[field->size], R2, R6, field->offset, 0));
+            update.push_back(makeInsn(BPF_LDX | BPF_MEM | BPF_DW, R3, R0, offsetof(BpfValue, sum), 0));
+            update.push_back(makeInsn(BPF_ALU64 | BPF_ADD | BPF_X, R3, R2, 0, 0));
+            update.push_back(makeInsn(BPF_STX | BPF_MEM | BPF_DW, R0, R3, offsetof(BpfValue, sum), 0));
+        }
+
+        std::vector<bpf_insn> program {
+            // keep the tracepoint's record, as r1 is clobbered by the call
+            makeInsn(BPF_ALU64 | BPF_MOV | BPF_X, R6, R1, 0, 0),
+            // the key (0) is on the stack
+            makeInsn(BPF_ST | BPF_MEM | BPF_W, R10, 0, -4, 0),
+            makeInsn(BPF_ALU64 | BPF_MOV | BPF_X, R2, R10, 0, 0),
+            makeInsn(BPF_ALU64 | BPF_ADD | BPF_K, R2, 0, 0, -4),
+            // the two halves of the 64 bit load of the map
+            makeInsn(BPF_LD | BPF_DW | BPF_IMM, R1, BPF_PSEUDO_MAP_FD, 0, mapFd),
+            makeInsn(0, 0, 0, 0, 0),
+            makeInsn(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_map_lookup_elem),
+            makeInsn(BPF_JMP | BPF_JEQ | BPF_K, R0, 0, static_cast<std::int16_t>(update.size()), 0),
+        };
+        program.insert(program.end(), update.begin(), update.end());
+        program.push_back(makeInsn(BPF_ALU64 | BPF_MOV | BPF_K, R0, 0, 0, 0));
+        program.push_back(makeInsn(BPF_JMP | BPF_EXIT, 0, 0, 0, 0));
+
+        static constexpr char license[] = "GPL";
+
+        bpf_attr attr {};
+        attr.prog_type = BPF_PROG_TYPE_TRACEPOINT;
+        attr.insn_cnt = program.size();
+        attr.insns = toAttrPointer(program.data());
+        attr.license = toAttrPointer(license);
+        return lib::AutoClosingFd {lib::bpf(BPF_PROG_LOAD, &attr, sizeof(attr))};
+    }
+
+    /** @return True if this process may load eBPF programs */
+    bool isBpfAvailable()
+    {
+        return static_cast<bool>(createMap());
+    }
+
+    /** @return The number of cpus the kernel may ever bring online, which is the number of values of a per-cpu map */
+    std::size_t getNumberOfPossibleCpus()
+    {
+        const auto cpus = lib::readCpuMaskFromFile(POSSIBLE_CPUS_PATH);
+        return (cpus.empty() ? 0 : static_cast<std::size_t>(*cpus.rbegin()) + 1);
+    }
+
+    /** Find a field in the tracepoint's format, that the program can read */
+    std::optional<FieldLocation> findField(const TraceFsConstants & traceFsConstants,
+                                           const char * tracepoint,
+                                           const std::string & field)
+    {
+        const auto found = findTracepointField(traceFsConstants, tracepoint, field);
+        if (!found) {
+            return {};
+        }
+
+        const int offset = found->offset;
+        const int size = found->size;
+        // the program may only read naturally aligned integers from the record, after the first word
+        if (((size != 1) && (size != 2) && (size != 4) && (size != 8)) || (offset < 8) || (offset > INT16_MAX)
+            || ((offset % size) != 0)) {
+            return {};
+        }
+
+        return FieldLocation {static_cast<std::int16_t>(offset), static_cast<std::uint8_t>(size)};
+    }
+}
+
+class BpfCounter : public DriverCounter {
+public:
+    BpfCounter(DriverCounter * next, const char * name, const char * tracepoint, const char * field);
+
+    // Intentionally unimplemented
+    BpfCounter(const BpfCounter &) = delete;
+    BpfCounter & operator=(const BpfCounter &) = delete;
+    BpfCounter(BpfCounter &&) = delete;
+    BpfCounter & operator=(BpfCounter &&) = delete;
+
+    [[nodiscard]] const char * getTracepoint() const { return mTracepoint.c_str(); }
+
+    /** Load the program and attach it to the tracepoint on every online cpu */
+    bool attach(const TraceFsConstants & traceFsConstants, std::size_t numberOfPossibleCpus);
+
+    /** Read the total of the per-cpu values */
+    void sample();
+
+    int64_t read() override;
+
+private:
+    const std::string mTracepoint;
+    const std::string mField;
+    lib::AutoClosingFd mMapFd {};
+    lib::AutoClosingFd mProgramFd {};
+    std::vector<lib::AutoClosingFd> mEventFds {};
+    std::vector<BpfValue> mValues {};
+    std::uint64_t mValue {0};
+    std::uint64_t mPrev {0};
+};
+
+BpfCounter::BpfCounter(DriverCounter * next, const char * name, const char * tracepoint, const char * field)
+    : DriverCounter(next, name), mTracepoint(tracepoint), mField(field != nullptr ? field : "")
+{
+}
+
+bool BpfCounter::attach(const TraceFsConstants & traceFsConstants, std::size_t numberOfPossibleCpus)
+{
+    mEventFds.clear();
+    mValues.assign(numberOfPossibleCpus, BpfValue {0, 0});
+    mValue = 0;
+    mPrev = 0;
+
+    const auto id = getTracepointId(traceFsConstants, mTracepoint.c_str());
+    if (id <= 0) {
+        LOG_WARNING("%s is disabled as the tracepoint %s was not found", getName(), mTracepoint.c_str());
+        return false;
+    }
+
+    std::optional<FieldLocation> field {};
+    if (!mField.empty()) {
+        field = findField(traceFsConstants, mTracepoint.c_str(), mField);
+        if (!field) {
+            LOG_WARNING("%s is disabled as %s has no readable integer field %s",
+                        getName(),
+                        mTracepoint.c_str(),
+                        mField.c_str());
+            return false;
+        }
+    }
+
+    mMapFd = createMap();
+    if (!mMapFd) {
+        LOG_WARNING("%s is disabled as the eBPF map could not be created (%d)", getName(), errno);
+        return false;
+    }
+
+    mProgramFd = loadProgram(*mMapFd, field);
+    if (!mProgramFd) {
+        LOG_WARNING("%s is disabled as the eBPF program could not be loaded (%d)", getName(), errno);
+        return false;
+    }
+
+    for (std::size_t cpu = 0; cpu < numberOfPossibleCpus; ++cpu) {
+        perf_event_attr attr {};
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_TRACEPOINT;
+        attr.config = id;
+        attr.sample_period = 1;
+        attr.disabled = 1;
+
+        // offline cpus fail to open, and are not counted
+        lib::AutoClosingFd fd {lib::perf_event_open(&attr, -1, static_cast<int>(cpu), -1, PERF_FLAG_FD_CLOEXEC)};
+        if (!fd) {
+            continue;
+        }
+
+        if ((lib::ioctl(*fd, PERF_EVENT_IOC_SET_BPF, *mProgramFd) != 0)
+            || (lib::ioctl(*fd, PERF_EVENT_IOC_ENABLE, 0) != 0)) {
+            LOG_WARNING("%s is disabled as the eBPF program could not be attached (%d)", getName(), errno);
+            mEventFds.clear();
+            return false;
+        }
+
+        mEventFds.push_back(std::move(fd));
+    }
+
+    if (mEventFds.empty()) {
+        LOG_WARNING("%s is disabled as the tracepoint %s could not be opened", getName(), mTracepoint.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+void BpfCounter::sample()
+{
+    if (mEventFds.empty()) {
+        return;
+    }
+
+    std::uint32_t key = 0;
+    bpf_attr attr {};
+    attr.map_fd = *mMapFd;
+    attr.key = toAttrPointer(&key);
+    attr.value = toAttrPointer(mValues.data());
+    if (lib::bpf(BPF_MAP_LOOKUP_ELEM, &attr, sizeof(attr)) != 0) {
+        LOG_DEBUG("Unable to read the eBPF map of %s (%d)", getName(), errno);
+        return;
+    }
+
+    std::uint64_t total = 0;
+    for (const auto & value : mValues) {
+        total += (mField.empty() ? value.count : value.sum);
+    }
+    mValue = total;
+}
+
+int64_t BpfCounter::read()
+{
+    const auto result = static_cast<int64_t>(mValue - mPrev);
+    mPrev = mValue;
+    return result;
+}
+
+BpfDriver::BpfDriver(const TraceFsConstants & traceFsConstants)
+    : PolledDriver("BPF"), mTraceFsConstants(traceFsConstants)
+{
+}
+
+void BpfDriver::readEvents(mxml_node_t * const xml)
+{
+    mxml_node_t * node = xml;
+    while (true) {
+        node = mxmlFindElement(node, xml, "event", nullptr, nullptr, MXML_DESCEND);
+        if (node == nullptr) {
+            break;
+        }
+        const char * counter = mxmlElementGetAttr(node, "counter");
+        if ((counter == nullptr) || (strncmp(counter, COUNTER_PREFIX, strlen(COUNTER_PREFIX)) != 0)) {
+            continue;
+        }
+
+        const char * tracepoint = mxmlElementGetAttr(node, "tracepoint");
+        if (tracepoint == nullptr) {
+            LOG_ERROR("The eBPF counter %s is missing the required tracepoint attribute", counter);
+            handleException();
+        }
+        const char * field = mxmlElementGetAttr(node, "field");
+        setCounters(new BpfCounter(getCounters(), counter, tracepoint, field));
+    }
+}
+
+int BpfDriver::writeCounters(mxml_node_t * root) const
+{
+    if ((getCounters() == nullptr) || !isBpfAvailable()) {
+        return 0;
+    }
+
+    int count = 0;
+    for (auto * counter = static_cast<BpfCounter *>(getCounters()); counter != nullptr;
+         counter = static_cast<BpfCounter *>(counter->getNext())) {
+        if (getTracepointId(mTraceFsConstants, counter->getTracepoint()) > 0) {
+            mxml_node_t * node = mxmlNewElement(root, "counter");
+            mxmlElementSetAttr(node, "name", counter->getName());
+            ++count;
+        }
+    }
+
+    return count;
+}
+
+void BpfDriver::start()
+{
+    const auto numberOfPossibleCpus = getNumberOfPossibleCpus();
+
+    for (auto * counter = static_cast<BpfCounter *>(getCounters()); counter != nullptr;
+         counter = static_cast<BpfCounter *>(counter->getNext())) {
+        if (counter->isEnabled()) {
+            counter->attach(mTraceFsConstants, numberOfPossibleCpus);
+        }
+    }
+}
+
+void BpfDriver::sample()
+{
+    for (auto * counter = static_cast<BpfCounter *>(getCounters()); counter != nullptr;
+         counter = static_cast<BpfCounter *>(counter->getNext())) {
+        if (counter->isEnabled()) {
+            counter->sample();
+        }
+    }
+}
@@ -0,0 +1,39 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#ifndef BPFDRIVER_H
+#define BPFDRIVER_H
+
+#include "PolledDriver.h"
+
+struct TraceFsConstants;
+
+/**
+ * Counts tracepoints in the kernel, using a small eBPF program attached to each, so that high frequency events (such
+ * as block I/O completions, page faults or futex contention) can be counted without a perf record for every event.
+ * Each poll reads the per-cpu totals from the program's map.
+ *
+ * The counters are defined in events-BPF.xml, and are only available when eBPF programs can be loaded (which requires
+ * CAP_BPF, or CAP_SYS_ADMIN on older kernels).
+ */
+class BpfDriver : public PolledDriver {
+public:
+    explicit BpfDriver(const TraceFsConstants & traceFsConstants);
+
+    // Intentionally unimplemented
+    BpfDriver(const BpfDriver &) = delete;
+    BpfDriver & operator=(const BpfDriver &) = delete;
+    BpfDriver(BpfDriver &&) = delete;
+    BpfDriver & operator=(BpfDriver &&) = delete;
+
+    void readEvents(mxml_node_t * xml) override;
+
+    int writeCounters(mxml_node_t * root) const override;
+
+    void start() override;
+    void sample() override;
+
+private:
+    const TraceFsConstants & mTraceFsConstants;
+};
+
+#endif // BPFDRIVER_H
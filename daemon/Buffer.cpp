@@ -4,10 +4,13 @@
 
 #include "BufferUtils.h"
 #include "Logging.h"
+#include "OneShotBudget.h"
+#include "PipelineStats.h"
 #include "Protocol.h"
 #include "Sender.h"
 #include "lib/Assert.h"
 
+#include <algorithm>
 #include <cstring>
 #include <limits>
 
@@ -18,37 +21,60 @@
 // if less than that is free we should send
 constexpr int FRACTION_TO_KEEP_FREE = 4;
 
-Buffer::Buffer(const int size, sem_t & readerSem, bool includeResponseType)
-    : mBuf(new char[size]),
+// How much a lazy buffer may commit before its pages are given back (the next time it is empty), which bounds how much
+// of it stays resident for a source that rarely fills it
+constexpr int LAZY_RELEASE_BYTES = 256 * 1024;
+
+Buffer::Buffer(const int size, sem_t & readerSem, bool includeResponseType, Backing backing)
+    : mMapping(lib::RingMapping::create(size > 0 ? size : 0, backing == Backing::PREFAULTED)),
+      mBuf(mMapping.data()),
+      mIsMirrored(mMapping.isMirrored()),
       mReaderSem(readerSem),
       mWriterSem(),
       mSize(size),
       mReadPos(0),
       mWritePos(0),
       mCommitPos(0),
+      mFlushPos(0),
       mIsDone(false),
-      mIncludeResponseType(includeResponseType)
+      mReaderNotified(false),
+      mWriterWaiting(false),
+      mIncludeResponseType(includeResponseType),
+      mBacking(backing),
+      mCommittedSinceRelease(0)
 {
+    if (!mMapping) {
+        LOG_ERROR("Unable to allocate a buffer of %d bytes", size);
+        handleException();
+    }
+
     if ((mSize & mask) != 0) {
-        delete[] mBuf;
         LOG_ERROR("Buffer size is not a power of 2");
         handleException();
     }
 
     runtime_assert(mSize > 8192, "Buffer::mSize is too small");
 
+    LOG_DEBUG("Created a %s%s buffer of %d bytes",
+              (backing == Backing::PREFAULTED ? "prefaulted " : ""),
+              (mIsMirrored ? "mirrored" : "plain"),
+              mSize);
+
     sem_init(&mWriterSem, 0, 0);
 }
 
 Buffer::~Buffer()
 {
-    delete[] mBuf;
     sem_destroy(&mWriterSem);
 }
 
 bool Buffer::write(ISender & sender)
 {
     bool isDone = mIsDone.load(std::memory_order_acquire);
+    // allow the next flush to notify again; the fence orders this against the read of mCommitPos so that any data
+    // committed after that read is guaranteed to be notified
+    mReaderNotified.store(false, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
     // acquire the data written to the buffer
     const int commitPos = mCommitPos.load(std::memory_order_acquire);
     // only we, the consumer, write this so relaxed load is fine
@@ -64,23 +90,32 @@ bool Buffer::write(ISender & sender)
     char * buffer1 = mBuf + readPos;
     int length2 = 0;
     char * buffer2 = mBuf;
-    // possible wrap around
+    // possible wrap around, which the mirror makes contiguous
     if (length1 < 0) {
-        length1 = mSize - readPos;
-        length2 = commitPos;
+        if (mIsMirrored) {
+            length1 += mSize;
+        }
+        else {
+            length1 = mSize - readPos;
+            length2 = commitPos;
+        }
     }
 
     LOG_DEBUG("Sending data length1: %i length2: %i", length1, length2);
 
-    constexpr std::size_t numberOfParts = 2;
-    const lib::Span<const char, int> parts[numberOfParts] = {{buffer1, length1}, {buffer2, length2}};
-    sender.writeDataParts({parts, numberOfParts}, ResponseType::RAW);
+    constexpr std::size_t maxNumberOfParts = 2;
+    const lib::Span<const char, int> parts[maxNumberOfParts] = {{buffer1, length1}, {buffer2, length2}};
+    sender.writeDataParts({parts, (length2 > 0 ? maxNumberOfParts : 1)}, ResponseType::RAW);
 
     // release the space only after we have finished reading the data
     mReadPos.store(commitPos, std::memory_order_release);
+    gPipelineStats.onBufferConsumed(length1 + length2);
 
-    // send a notification that space is available
-    sem_post(&mWriterSem);
+    // send a notification that space is available, but only if the writer is waiting for it
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (mWriterWaiting.exchange(false, std::memory_order_relaxed)) {
+        sem_post(&mWriterSem);
+    }
 
     return isDone;
 }
@@ -111,9 +146,19 @@ void Buffer::waitForSpace(int bytes)
         handleException();
     }
 
-    while (bytesAvailable() < bytes) {
+    while (true) {
+        // publish that we are waiting before checking the space, so that the reader cannot miss posting mWriterSem
+        mWriterWaiting.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (bytesAvailable() >= bytes) {
+            break;
+        }
+
         sem_wait(&mWriterSem);
     }
+
+    mWriterWaiting.store(false, std::memory_order_relaxed);
 }
 
 bool Buffer::supportsWriteOfSize(int bytes) const
@@ -124,6 +169,9 @@ bool Buffer::supportsWriteOfSize(int bytes) const
 int Buffer::contiguousSpaceAvailable() const
 {
     int remaining = bytesAvailable();
+    if (mIsMirrored) {
+        return remaining;
+    }
     int contiguous = mSize - mWritePos;
     if (remaining < contiguous) {
         return remaining;
@@ -131,11 +179,25 @@ int Buffer::contiguousSpaceAvailable() const
     return contiguous;
 }
 
+int Buffer::bytesSinceFlush() const
+{
+    int written = mWritePos - mFlushPos;
+    if (written < 0) {
+        written += mSize;
+    }
+    return written;
+}
+
 void Buffer::flush()
 {
+    // only we, the producer, write to mCommitPos so only relaxed load needed
+    mFlushPos = mCommitPos.load(std::memory_order_relaxed);
     if (mCommitPos.load(std::memory_order_relaxed) != mReadPos.load(std::memory_order_acquire)) {
-        // send a notification that data is ready
-        sem_post(&mReaderSem);
+        // send a notification that data is ready, unless one is already pending
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!mReaderNotified.exchange(true, std::memory_order_relaxed)) {
+            sem_post(&mReaderSem);
+        }
     }
 }
 
@@ -161,13 +223,8 @@ int Buffer::packInt64(int64_t x)
 
 void Buffer::writeBytes(const void * const data, std::size_t count)
 {
-    std::size_t i = 0;
-
-    for (; i < count; ++i) {
-        mBuf[(mWritePos + i) & mask] = static_cast<const char *>(data)[i];
-    }
-
-    mWritePos = (mWritePos + i) & mask;
+    copyIn(mWritePos, data, count);
+    mWritePos = (mWritePos + count) & mask;
 }
 
 void Buffer::writeString(std::string_view str)
@@ -183,6 +240,10 @@ void Buffer::writeString(std::string_view str)
 
 void Buffer::beginFrame(FrameType frameType)
 {
+    if ((mBacking == Backing::LAZY) && (mCommittedSinceRelease >= LAZY_RELEASE_BYTES)) {
+        releaseIfEmpty();
+    }
+
     if (mIncludeResponseType) {
         packInt(static_cast<int32_t>(ResponseType::APC_DATA));
     }
@@ -225,14 +286,24 @@ void Buffer::endFrame()
         abortFrame();
         return;
     }
+    const int frameLength = length + typeLength + static_cast<int>(sizeof(int32_t));
+    if (!gOneShotBudget.consume(frameLength)) {
+        // the one-shot capture is full
+        abortFrame();
+        return;
+    }
+    char lengthBytes[sizeof(int32_t)];
     for (size_t byte = 0; byte < sizeof(int32_t); byte++) {
-        mBuf[(commitPos + typeLength + byte) & mask] = (length >> byte * 8) & 0xFF;
+        lengthBytes[byte] = (length >> byte * 8) & 0xFF;
     }
+    copyIn(commitPos + typeLength, lengthBytes, sizeof(lengthBytes));
 
     LOG_DEBUG("Committing data mReadPos: %i mWritePos: %i mCommitPos: %i",
               mReadPos.load(std::memory_order_relaxed),
               mWritePos,
               commitPos);
+    gPipelineStats.onBufferCommitted(frameLength);
+    mCommittedSinceRelease += frameLength;
     // release the commited data for the consumer to acquire
     mCommitPos.store(mWritePos, std::memory_order_release);
 }
@@ -258,7 +329,34 @@ void Buffer::advanceWrite(int bytes)
 
 void Buffer::writeDirect(int index, const void * data, std::size_t count)
 {
-    for (std::size_t i = 0; i < count; ++i) {
-        mBuf[(index + i) & mask] = static_cast<const char *>(data)[i];
+    copyIn(index, data, count);
+}
+
+void Buffer::releaseIfEmpty()
+{
+    // between frames everything written is committed, so once the reader has caught up nothing else is in use; the
+    // reader only ever touches [mReadPos, mCommitPos) so it cannot be using the pages either
+    if (mReadPos.load(std::memory_order_acquire) != mWritePos) {
+        return;
     }
+
+    // keep the page being written to, and give back the rest
+    const auto writePos = static_cast<std::size_t>(mWritePos);
+    const auto size = static_cast<std::size_t>(mSize);
+    mMapping.release(writePos + 1, size - (writePos + 1));
+    mMapping.release(0, writePos);
+    mCommittedSinceRelease = 0;
+}
+
+void Buffer::copyIn(int index, const void * data, std::size_t count)
+{
+    runtime_assert(count <= static_cast<std::size_t>(mSize), "Buffer::copyIn is too large");
+
+    const int start = index & mask;
+    const auto * const bytes = static_cast<const char *>(data);
+    // the mirror follows the end of the buffer, so the copy never needs to be split
+    const std::size_t first = (mIsMirrored ? count : std::min<std::size_t>(count, mSize - start));
+
+    std::memcpy(mBuf + start, bytes, first);
+    std::memcpy(mBuf, bytes + first, count - first);
 }
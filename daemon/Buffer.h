@@ -9,6 +9,7 @@
 
 #include "IBufferControl.h"
 #include "IRawFrameBuilder.h"
+#include "lib/RingMapping.h"
 
 #include <atomic>
 #include <cstdint>
@@ -18,10 +19,21 @@
 
 class Buffer : public IBufferControl, public IRawFrameBuilderWithDirectAccess {
 public:
-    Buffer(int size, sem_t & readerSem, bool includeResponseType);
+    /** How the buffer's memory is backed, which should follow how busy the source writing to it is */
+    enum class Backing {
+        /** Faulted in as it is first written, and given back when the buffer is empty after a fair amount was sent */
+        LAZY,
+        /** Faulted in (with transparent huge pages where possible) up front, so the write path takes no page faults */
+        PREFAULTED,
+    };
+
+    Buffer(int size, sem_t & readerSem, bool includeResponseType, Backing backing = Backing::LAZY);
 #ifdef BUFFER_USE_SESSION_DATA
     // include SessionData.h first to get access to this constructor
-    Buffer(const int size, sem_t & readerSem) : Buffer(size, readerSem, !gSessionData.mLocalCapture) {}
+    Buffer(const int size, sem_t & readerSem, Backing backing = Backing::LAZY)
+        : Buffer(size, readerSem, !gSessionData.mLocalCapture, backing)
+    {
+    }
 #endif
 
     // Intentionally unimplemented
@@ -35,6 +47,7 @@ public:
     bool write(ISender & sender) override;
 
     [[nodiscard]] int bytesAvailable() const override;
+    [[nodiscard]] int bytesSinceFlush() const override;
     [[nodiscard]] bool isFull() const override { return bytesAvailable() <= 0; }
     [[nodiscard]] int contiguousSpaceAvailable() const;
     [[nodiscard]] int size() const { return mSize; }
@@ -69,15 +82,32 @@ public:
     [[nodiscard]] bool supportsWriteOfSize(int bytes) const override;
 
 private:
+    // where possible the buffer is followed by a mirror of itself, so that anything that wraps is still contiguous and
+    // is written or sent in one go; otherwise the wrap is split by hand
+    lib::RingMapping mMapping;
     char * const mBuf;
+    const bool mIsMirrored;
     sem_t & mReaderSem;
     sem_t mWriterSem;
     const int mSize;
     std::atomic_int mReadPos;
     int mWritePos;
     std::atomic_int mCommitPos;
+    // the commit position at the last flush, only used by the producer
+    int mFlushPos;
     std::atomic_bool mIsDone;
+    // set once mReaderSem is posted for the committed data, and cleared when the reader consumes it, so that the reader is
+    // only woken once per batch of committed frames rather than on every flush
+    std::atomic_bool mReaderNotified;
+    // set whilst the writer is blocked in waitForSpace, so that the reader only posts mWriterSem when it is required
+    std::atomic_bool mWriterWaiting;
     const bool mIncludeResponseType;
+    const Backing mBacking;
+    // the bytes committed since the lazy buffer's pages were last given back, only used by the producer
+    int mCommittedSinceRelease;
+
+    void releaseIfEmpty();
+    void copyIn(int index, const void * data, std::size_t count);
 };
 
 #endif // BUFFER_H
@@ -1,110 +1,186 @@
-/* Copyright (C) 2013-2020 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2013-2022 by Arm Limited. All rights reserved. */
 
 #include "BufferUtils.h"
 
+#include <algorithm>
+#include <type_traits>
+
 namespace buffer_utils {
+    namespace {
+        /** Count the number of bytes required to pack x; bytes needed = significant bits (including sign) / 7, rounded up */
+        constexpr int packedSize(int32_t x)
+        {
+            const int bits = 32 - __builtin_clrsb(x);
+            return (bits + 6) / 7;
+        }
+
+        constexpr int packedSize(int64_t x)
+        {
+            const int bits = 64 - __builtin_clrsbll(x);
+            return (bits + 6) / 7;
+        }
+
+        /** Can a value of up to maxSize bytes be written at writePos without wrapping */
+        constexpr bool canPackUnwrapped(int writePos, int writePosWrapMask, int maxSize)
+        {
+            return (writePosWrapMask == -1) || ((writePos >= 0) && ((writePos + maxSize) <= writePosWrapMask));
+        }
+
+        /**
+         * Pack x into contiguous memory. As the size is known up front, the loop does not need to test for the
+         * terminating byte each iteration.
+         */
+        template<typename T>
+        int packUnwrapped(char * const buf, T x)
+        {
+            const int packedBytes = packedSize(x);
+
+            for (int i = 0; i < packedBytes - 1; ++i) {
+                buf[i] = static_cast<char>((x & 0x7f) | 0x80);
+                x >>= 7;
+            }
+
+            buf[packedBytes - 1] = static_cast<char>(x & 0x7f);
+
+            return packedBytes;
+        }
+
+        /** Pack x into the ring buffer at writePos, wrapping as necessary */
+        template<typename T>
+        int packWrapped(char * const buf, int & writePos, T x, int writePosWrapMask)
+        {
+            int packedBytes = 0;
+            bool more = true;
+            while (more) {
+                // low order 7 bits of x
+                char b = x & 0x7f;
+                x >>= 7;
+
+                if ((x == 0 && (b & 0x40) == 0) || (x == -1 && (b & 0x40) != 0)) {
+                    more = false;
+                }
+                else {
+                    b |= 0x80;
+                }
+
+                buf[(writePos + packedBytes) & writePosWrapMask] = b;
+                packedBytes++;
+            }
+
+            writePos = (writePos + packedBytes) & writePosWrapMask;
+
+            return packedBytes;
+        }
+
+        template<typename T>
+        T unpack(const char * buf, int & readPos)
+        {
+            char b = buf[readPos++];
+
+            // fast path for single byte values (sign extend from bit 6)
+            if ((b & 0x80) == 0) {
+                return ((b & 0x40) != 0 ? T(b) - 0x80 : T(b));
+            }
+
+            uint8_t shift = 7;
+            T value = T(b & 0x7f);
+
+            while ((b & 0x80) != 0) {
+                b = buf[readPos++];
+                value |= static_cast<T>(static_cast<std::make_unsigned_t<T>>(b & 0x7f) << shift);
+                shift += 7;
+            }
+
+            if (shift < 8 * sizeof(value) && (b & 0x40) != 0) {
+                value |= static_cast<T>(~std::make_unsigned_t<T>(0) << shift);
+            }
+
+            return value;
+        }
+    }
+
     int sizeOfPackInt(int32_t x)
     {
-        char tmp[MAXSIZE_PACK32];
-        int writePos = 0;
-
-        return packInt(tmp, writePos, x);
+        return packedSize(x);
     }
 
     int sizeOfPackInt64(int64_t x)
     {
-        char tmp[MAXSIZE_PACK64];
-        int writePos = 0;
-
-        return packInt64(tmp, writePos, x);
+        return packedSize(x);
     }
 
     int packInt(char * const buf, int & writePos, int32_t x, int writePosWrapMask)
     {
-        int packedBytes = 0;
-        bool more = true;
-        while (more) {
-            // low order 7 bits of x
-            char b = x & 0x7f;
-            x >>= 7;
-
-            if ((x == 0 && (b & 0x40) == 0) || (x == -1 && (b & 0x40) != 0)) {
-                more = false;
-            }
-            else {
-                b |= 0x80;
-            }
-
-            buf[(writePos + packedBytes) & writePosWrapMask] = b;
-            packedBytes++;
+        if (canPackUnwrapped(writePos, writePosWrapMask, MAXSIZE_PACK32)) {
+            const int packedBytes = packUnwrapped(buf + writePos, x);
+            writePos = (writePos + packedBytes) & writePosWrapMask;
+            return packedBytes;
         }
 
-        writePos = (writePos + packedBytes) & writePosWrapMask;
-
-        return packedBytes;
+        return packWrapped(buf, writePos, x, writePosWrapMask);
     }
 
     int packInt64(char * const buf, int & writePos, int64_t x, int writePosWrapMask)
+    {
+        if (canPackUnwrapped(writePos, writePosWrapMask, MAXSIZE_PACK64)) {
+            const int packedBytes = packUnwrapped(buf + writePos, x);
+            writePos = (writePos + packedBytes) & writePosWrapMask;
+            return packedBytes;
+        }
+
+        return packWrapped(buf, writePos, x, writePosWrapMask);
+    }
+
+    int packInt64Array(char * const buf,
+                       int & writePos,
+                       const int64_t * const values,
+                       size_t count,
+                       int writePosWrapMask)
     {
         int packedBytes = 0;
-        bool more = true;
-        while (more) {
-            // low order 7 bits of x
-            char b = x & 0x7f;
-            x >>= 7;
-
-            if ((x == 0 && (b & 0x40) == 0) || (x == -1 && (b & 0x40) != 0)) {
-                more = false;
+        size_t n = 0;
+
+        // pack as many as possible without checking for wrapping on each value
+        while ((n < count) && (writePos >= 0)) {
+            const size_t remaining = (writePosWrapMask == -1 ? count - n
+                                                             : (writePosWrapMask - writePos) / MAXSIZE_PACK64);
+            if (remaining == 0) {
+                break;
             }
-            else {
-                b |= 0x80;
+
+            char * const start = buf + writePos;
+            char * ptr = start;
+            for (size_t const end = n + std::min(remaining, count - n); n < end; ++n) {
+                ptr += packUnwrapped(ptr, values[n]);
             }
 
-            buf[(writePos + packedBytes) & writePosWrapMask] = b;
-            packedBytes++;
+            const int written = static_cast<int>(ptr - start);
+            packedBytes += written;
+            writePos = (writePos + written) & writePosWrapMask;
         }
 
-        writePos = (writePos + packedBytes) & writePosWrapMask;
+        // the remainder (if any) straddles the end of the buffer
+        for (; n < count; ++n) {
+            packedBytes += packInt64(buf, writePos, values[n], writePosWrapMask);
+        }
 
         return packedBytes;
     }
 
     int32_t unpackInt(const char * buf, int & readPos)
     {
-        uint8_t shift = 0;
-        int32_t value = 0;
-        char b = -1;
-
-        while ((b & 0x80) != 0) {
-            b = buf[readPos++];
-            value |= int32_t(b & 0x7f) << shift;
-            shift += 7;
-        }
-
-        if (shift < 8 * sizeof(value) && (b & 0x40) != 0) {
-            value |= -(INT32_C(1) << shift);
-        }
-
-        return value;
+        return unpack<int32_t>(buf, readPos);
     }
 
     int64_t unpackInt64(const char * buf, int & readPos)
     {
-        uint8_t shift = 0;
-        int64_t value = 0;
-        char b = -1;
-
-        while ((b & 0x80) != 0) {
-            b = buf[readPos++];
-            value |= int64_t(b & 0x7f) << shift;
-            shift += 7;
-        }
+        return unpack<int64_t>(buf, readPos);
+    }
 
-        if (shift < 8 * sizeof(value) && (b & 0x40) != 0) {
-            value |= -(INT64_C(1) << shift);
+    void unpackInt64Array(const char * buf, int & readPos, int64_t * const values, size_t count)
+    {
+        for (size_t n = 0; n < count; ++n) {
+            values[n] = unpack<int64_t>(buf, readPos);
         }
-
-        return value;
     }
-
 }
@@ -1,4 +1,4 @@
-/* Copyright (C) 2013-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2013-2022 by Arm Limited. All rights reserved. */
 
 #ifndef BUFFER_UTILS_H
 #define BUFFER_UTILS_H
@@ -13,9 +13,18 @@ namespace buffer_utils {
     int packInt(char * buf, int & writePos, int32_t x, int writePosWrapMask = -1);
     int packInt64(char * buf, int & writePos, int64_t x, int writePosWrapMask = -1);
 
+    /**
+     * Pack a sequence of values, as per packInt64, returning the total number of bytes written.
+     * This is faster than calling packInt64 in a loop where the output does not wrap.
+     */
+    int packInt64Array(char * buf, int & writePos, const int64_t * values, size_t count, int writePosWrapMask = -1);
+
     int32_t unpackInt(const char * buf, int & readPos);
     int64_t unpackInt64(const char * buf, int & readPos);
 
+    /** Unpack a sequence of `count` values, as per unpackInt64 */
+    void unpackInt64Array(const char * buf, int & readPos, int64_t * values, size_t count);
+
     int sizeOfPackInt(int32_t x);
     int sizeOfPackInt64(int64_t x);
 
@@ -0,0 +1,266 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "CaptureFileWriter.h"
+
+#include "Logging.h"
+#include "lib/Syscall.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include <fcntl.h>
+#include <sys/prctl.h>
+#include <unistd.h>
+
+namespace {
+    constexpr int OPEN_FLAGS = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+    constexpr mode_t OPEN_MODE = 0666;
+
+    void * allocateBuffer()
+    {
+        void * const result = std::aligned_alloc(CaptureFileWriter::ALIGNMENT, CaptureFileWriter::BUFFER_SIZE);
+        if (result == nullptr) {
+            throw std::bad_alloc();
+        }
+        return result;
+    }
+}
+
+std::unique_ptr<CaptureFileWriter> CaptureFileWriter::create(const char * path)
+{
+    bool direct = true;
+    lib::AutoClosingFd fd {lib::open(path, OPEN_FLAGS | O_DIRECT, OPEN_MODE)};
+    if ((!fd) && (errno == EINVAL)) {
+        // the filesystem does not support O_DIRECT (e.g. tmpfs)
+        direct = false;
+        fd = lib::open(path, OPEN_FLAGS, OPEN_MODE);
+    }
+
+    if (!fd) {
+        return nullptr;
+    }
+
+    LOG_DEBUG("Writing capture data to %s%s", path, (direct ? " using O_DIRECT" : ""));
+
+    // NOLINTNEXTLINE(cppcoreguidelines-owning-memory) - the constructor is private so make_unique cannot be used
+    return std::unique_ptr<CaptureFileWriter> {new CaptureFileWriter(std::move(fd), direct)};
+}
+
+CaptureFileWriter::CaptureFileWriter(lib::AutoClosingFd && fd, bool direct)
+    : mFd(std::move(fd)), mDirect(direct), mOpened(std::chrono::steady_clock::now())
+{
+    // must not reallocate once pointers to the buffers are taken
+    mBuffers.reserve(BUFFER_COUNT);
+    for (std::size_t n = 0; n < BUFFER_COUNT; ++n) {
+        mBuffers.push_back(Buffer {{static_cast<char *>(allocateBuffer()), std::free}, 0});
+        mFree.push_back(&mBuffers.back());
+    }
+
+    mCurrent = mFree.back();
+    mFree.pop_back();
+
+    mThread = std::thread {[this]() { ioThreadEntryPoint(); }};
+}
+
+CaptureFileWriter::~CaptureFileWriter()
+{
+    close();
+}
+
+bool CaptureFileWriter::write(lib::Span<const char, int> data)
+{
+    const char * ptr = data.data();
+    auto remaining = static_cast<std::size_t>(data.size());
+
+    while (remaining > 0) {
+        if (mCurrent == nullptr) {
+            return false;
+        }
+
+        const std::size_t length = std::min(remaining, BUFFER_SIZE - mCurrent->length);
+        std::memcpy(mCurrent->data.get() + mCurrent->length, ptr, length);
+        mCurrent->length += length;
+        ptr += length;
+        remaining -= length;
+
+        if ((mCurrent->length == BUFFER_SIZE) && (!submitCurrent())) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool CaptureFileWriter::close()
+{
+    if (mClosed) {
+        std::lock_guard<std::mutex> lock {mMutex};
+        return !mFailed;
+    }
+
+    mClosed = true;
+
+    {
+        std::lock_guard<std::mutex> lock {mMutex};
+        if (mCurrent->length > 0) {
+            mFull.push_back(mCurrent);
+        }
+        else {
+            mFree.push_back(mCurrent);
+        }
+        mCurrent = nullptr;
+        mStopping = true;
+    }
+
+    mFullCondition.notify_one();
+    mThread.join();
+
+    // remove the padding of the final O_DIRECT write and release any space that was preallocated but not used
+    bool trimmed = (::ftruncate(*mFd, mOffset) == 0);
+    if (!trimmed) {
+        LOG_ERROR("Unable to truncate capture data file (%s)", strerror(errno));
+    }
+    if (mCanAllocate && (mAllocated > mOffset)) {
+        ::fallocate(*mFd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, mOffset, mAllocated - mOffset);
+    }
+
+    mFd.close();
+
+    std::lock_guard<std::mutex> lock {mMutex};
+    mStats.elapsed = std::chrono::steady_clock::now() - mOpened;
+    return trimmed && !mFailed;
+}
+
+CaptureFileWriter::Stats CaptureFileWriter::getStats() const
+{
+    std::lock_guard<std::mutex> lock {mMutex};
+    return mStats;
+}
+
+bool CaptureFileWriter::submitCurrent()
+{
+    std::unique_lock<std::mutex> lock {mMutex};
+
+    mFull.push_back(mCurrent);
+    mCurrent = nullptr;
+    mFullCondition.notify_one();
+
+    if (mFree.empty()) {
+        const auto start = std::chrono::steady_clock::now();
+        mFreeCondition.wait(lock, [this]() { return !mFree.empty(); });
+        mStats.stallTime += std::chrono::steady_clock::now() - start;
+        mStats.stallCount += 1;
+    }
+
+    mCurrent = mFree.back();
+    mFree.pop_back();
+
+    return !mFailed;
+}
+
+void CaptureFileWriter::ioThreadEntryPoint()
+{
+    prctl(PR_SET_NAME, reinterpret_cast<unsigned long>(&"gatord-iowrite"), 0, 0, 0);
+
+    std::unique_lock<std::mutex> lock {mMutex};
+
+    while (true) {
+        mFullCondition.wait(lock, [this]() { return mStopping || !mFull.empty(); });
+
+        if (mFull.empty()) {
+            return;
+        }
+
+        Buffer * const buffer = mFull.front();
+        mFull.pop_front();
+
+        // once a write has failed the remaining data is discarded
+        const bool failed = mFailed;
+        lock.unlock();
+
+        const auto start = std::chrono::steady_clock::now();
+        const bool written = (!failed) && writeBuffer(*buffer);
+        const auto writeTime = std::chrono::steady_clock::now() - start;
+        const std::size_t length = buffer->length;
+        buffer->length = 0;
+
+        lock.lock();
+        if (written) {
+            mStats.bytesWritten += length;
+            mStats.writeTime += writeTime;
+        }
+        else {
+            mFailed = true;
+        }
+        mFree.push_back(buffer);
+        mFreeCondition.notify_one();
+    }
+}
+
+bool CaptureFileWriter::writeBuffer(Buffer & buffer)
+{
+    const std::size_t length = buffer.length;
+    std::size_t done = 0;
+
+    while (true) {
+        // O_DIRECT requires whole blocks so the final, partially filled, buffer is padded; close trims the padding
+        std::size_t writeLength = length;
+        if (mDirect) {
+            writeLength = (length + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+            std::memset(buffer.data.get() + length, 0, writeLength - length);
+        }
+
+        preallocate(mOffset + writeLength);
+
+        while (done < writeLength) {
+            const ssize_t result = ::pwrite(*mFd, buffer.data.get() + done, writeLength - done, mOffset + done);
+            if (result >= 0) {
+                done += result;
+            }
+            else if (errno != EINTR) {
+                break;
+            }
+        }
+
+        if (done >= writeLength) {
+            break;
+        }
+
+        // some filesystems accept O_DIRECT when opening but then reject the writes, so fall back to buffered IO
+        if ((errno == EINVAL) && mDirect && (done == 0)) {
+            const int flags = lib::fcntl(*mFd, F_GETFL);
+            if ((flags != -1) && (lib::fcntl(*mFd, F_SETFL, flags & ~O_DIRECT) == 0)) {
+                LOG_DEBUG("O_DIRECT writes are not supported, falling back to buffered writes");
+                mDirect = false;
+                continue;
+            }
+        }
+
+        LOG_ERROR("Failed writing capture data (%s)", strerror(errno));
+        return false;
+    }
+
+    // start writeback straight away rather than letting the dirty pages build up and then stall in one go
+    if (!mDirect) {
+        ::sync_file_range(*mFd, mOffset, length, SYNC_FILE_RANGE_WRITE);
+    }
+
+    mOffset += length;
+    return true;
+}
+
+void CaptureFileWriter::preallocate(off_t end)
+{
+    while (mCanAllocate && (end > mAllocated)) {
+        // keep the size so that the file only ever contains what was written, even if gatord is killed
+        if (::fallocate(*mFd, FALLOC_FL_KEEP_SIZE, mAllocated, EXTENT_SIZE) != 0) {
+            LOG_DEBUG("Unable to preallocate space for the capture data (%s)", strerror(errno));
+            mCanAllocate = false;
+            return;
+        }
+        mAllocated += EXTENT_SIZE;
+    }
+}
@@ -0,0 +1,121 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#pragma once
+
+#include "lib/AutoClosingFd.h"
+#include "lib/Span.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <sys/types.h>
+
+/**
+ * Writes the local capture data file without blocking the sender on the page cache.
+ *
+ * Data is copied into one of a small ring of aligned buffers, and each full buffer is handed to a dedicated IO thread
+ * which writes it (using O_DIRECT where the filesystem supports it) into space that is preallocated in large extents.
+ * The caller only blocks when every buffer is waiting to be written, and the time spent doing so is recorded so that
+ * slow storage can be identified.
+ */
+class CaptureFileWriter {
+public:
+    /** The size of each buffer in the ring */
+    static constexpr std::size_t BUFFER_SIZE = 1024 * 1024;
+    /** The number of buffers in the ring */
+    static constexpr std::size_t BUFFER_COUNT = 8;
+    /** The alignment of the buffers, offsets and lengths as required for O_DIRECT */
+    static constexpr std::size_t ALIGNMENT = 4096;
+    /** The amount of space that is preallocated at a time */
+    static constexpr off_t EXTENT_SIZE = 64 * 1024 * 1024;
+
+    struct Stats {
+        /** The number of bytes written to the file */
+        std::uint64_t bytesWritten;
+        /** The time from the file being opened until it was closed */
+        std::chrono::nanoseconds elapsed;
+        /** The time the IO thread spent writing */
+        std::chrono::nanoseconds writeTime;
+        /** The time callers of write spent waiting for a free buffer */
+        std::chrono::nanoseconds stallTime;
+        /** The number of times a caller of write had to wait for a free buffer */
+        std::uint64_t stallCount;
+    };
+
+    /**
+     * Create (or truncate) the file and start the IO thread
+     *
+     * @return The writer, or nullptr if the file could not be created
+     */
+    static std::unique_ptr<CaptureFileWriter> create(const char * path);
+
+    // Intentionally unimplemented
+    CaptureFileWriter(const CaptureFileWriter &) = delete;
+    CaptureFileWriter & operator=(const CaptureFileWriter &) = delete;
+    CaptureFileWriter(CaptureFileWriter &&) = delete;
+    CaptureFileWriter & operator=(CaptureFileWriter &&) = delete;
+
+    ~CaptureFileWriter();
+
+    /**
+     * Queue some data to be written, blocking only if all the buffers are waiting to be written
+     *
+     * @return false if this or some previous write failed
+     */
+    bool write(lib::Span<const char, int> data);
+
+    /**
+     * Write any remaining data, stop the IO thread and trim the file to the amount written. No further calls to write
+     * may be made.
+     *
+     * @return false if any write failed
+     */
+    bool close();
+
+    /** @return The statistics for the file; complete only once close has been called */
+    [[nodiscard]] Stats getStats() const;
+
+private:
+    struct Buffer {
+        std::unique_ptr<char, void (*)(void *)> data;
+        std::size_t length;
+    };
+
+    lib::AutoClosingFd mFd;
+    bool mDirect;
+    std::vector<Buffer> mBuffers {};
+    Buffer * mCurrent {nullptr};
+    mutable std::mutex mMutex {};
+    std::condition_variable mFullCondition {};
+    std::condition_variable mFreeCondition {};
+    // buffers waiting for the IO thread, protected by mMutex
+    std::deque<Buffer *> mFull {};
+    // buffers available for writing, protected by mMutex
+    std::vector<Buffer *> mFree {};
+    // protected by mMutex
+    bool mStopping {false};
+    // protected by mMutex
+    bool mFailed {false};
+    // protected by mMutex
+    Stats mStats {};
+    // only accessed by the IO thread until it is joined
+    off_t mOffset {0};
+    off_t mAllocated {0};
+    bool mCanAllocate {true};
+    std::chrono::steady_clock::time_point mOpened;
+    std::thread mThread {};
+    bool mClosed {false};
+
+    CaptureFileWriter(lib::AutoClosingFd && fd, bool direct);
+
+    bool submitCurrent();
+    void ioThreadEntryPoint();
+    bool writeBuffer(Buffer & buffer);
+    void preallocate(off_t end);
+};
@@ -0,0 +1,109 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "CaptureIndexWriter.h"
+
+#include "BufferUtils.h"
+#include "Logging.h"
+#include "Time.h"
+#include "lib/FileDescriptor.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+
+namespace {
+    constexpr char INDEX_MAGIC[] = {'G', 'A', 'T', 'O', 'R', 'I', 'D', 'X'};
+    constexpr std::uint32_t INDEX_VERSION = 1;
+
+    std::string getIndexFileName(const std::string & dataFileName)
+    {
+        return dataFileName + ".idx";
+    }
+
+    std::string getStateFileName(const std::string & dataFileName)
+    {
+        return dataFileName + ".state";
+    }
+
+    lib::AutoClosingFd createFile(const std::string & name)
+    {
+        lib::AutoClosingFd fd {::open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)};
+        if (!fd) {
+            // NOLINTNEXTLINE(concurrency-mt-unsafe)
+            LOG_WARNING("Unable to create the capture index file %s (%s)", name.c_str(), strerror(errno));
+        }
+        return fd;
+    }
+}
+
+std::unique_ptr<CaptureIndexWriter> CaptureIndexWriter::create(const std::string & dataFileName,
+                                                               std::chrono::milliseconds interval,
+                                                               lib::Span<const char> initialState)
+{
+    auto indexFd = createFile(getIndexFileName(dataFileName));
+    if (!indexFd) {
+        return {};
+    }
+    auto stateFd = createFile(getStateFileName(dataFileName));
+    if (!stateFd) {
+        return {};
+    }
+
+    char header[sizeof(INDEX_MAGIC) + sizeof(INDEX_VERSION)];
+    std::memcpy(header, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    buffer_utils::writeLEInt(header + sizeof(INDEX_MAGIC), INDEX_VERSION);
+    if (!lib::writeAll(*indexFd, header, sizeof(header))) {
+        return {};
+    }
+
+    std::unique_ptr<CaptureIndexWriter> writer {
+        new CaptureIndexWriter(std::move(indexFd), std::move(stateFd), interval)};
+    if (!writer->addState(initialState)) {
+        return {};
+    }
+    return writer;
+}
+
+void CaptureIndexWriter::remove(const std::string & dataFileName)
+{
+    // they may not exist, if the index was not enabled or could not be written
+    ::remove(getIndexFileName(dataFileName).c_str());
+    ::remove(getStateFileName(dataFileName).c_str());
+}
+
+CaptureIndexWriter::CaptureIndexWriter(lib::AutoClosingFd && indexFd,
+                                       lib::AutoClosingFd && stateFd,
+                                       std::chrono::milliseconds interval)
+    : mIndexFd(std::move(indexFd)), mStateFd(std::move(stateFd)), mInterval(interval)
+{
+}
+
+bool CaptureIndexWriter::checkpoint(std::uint64_t dataOffset)
+{
+    const auto now = std::chrono::steady_clock::now();
+    if (mHasEntry && ((now - mLastEntry) < mInterval)) {
+        return true;
+    }
+    mHasEntry = true;
+    mLastEntry = now;
+
+    char entry[3 * sizeof(std::uint64_t)];
+    buffer_utils::writeLELong(entry, getTime());
+    buffer_utils::writeLELong(entry + sizeof(std::uint64_t), dataOffset);
+    buffer_utils::writeLELong(entry + 2 * sizeof(std::uint64_t), mStateLength);
+    return lib::writeAll(*mIndexFd, entry, sizeof(entry));
+}
+
+bool CaptureIndexWriter::addState(lib::Span<const char> frames)
+{
+    if (frames.size() == 0) {
+        return true;
+    }
+    if (!lib::writeAll(*mStateFd, frames.data(), frames.size())) {
+        return false;
+    }
+    mStateLength += frames.size();
+    return true;
+}
@@ -0,0 +1,71 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#pragma once
+
+#include "lib/AutoClosingFd.h"
+#include "lib/Span.h"
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+/**
+ * Writes the time index that sits alongside a local capture data file, so that a tool can load some window of a long
+ * capture without parsing the data from the start.
+ *
+ * The index is made of two files:
+ * - <data file>.idx, which starts with the 8 bytes "GATORIDX" and a 32 bit version (currently 1), followed by entries
+ *   of three 64 bit values: the CLOCK_MONOTONIC_RAW time (in ns) the entry was made, the offset in the (uncompressed)
+ *   data file, and the length of the state file, at that time.
+ * - <data file>.state, which holds a copy of the summary, name and attribute frames written to the data file, each
+ *   prefixed by its length, as they are needed to make sense of the rest of the data.
+ *
+ * Data is only written to the data file after the time it describes, so everything from some time onwards is at or
+ * after the offset of the last entry made before that time. To load a window, read the state file up to the entry's
+ * length, then the data file from the entry's offset.
+ */
+class CaptureIndexWriter {
+public:
+    /**
+     * Create (or truncate) the index files
+     *
+     * @param dataFileName The name of the data file, without any compression suffix
+     * @param interval The time between entries
+     * @param initialState The frames already at the start of the data file, for the state file
+     * @return The writer, or nullptr if the files could not be created
+     */
+    static std::unique_ptr<CaptureIndexWriter> create(const std::string & dataFileName,
+                                                      std::chrono::milliseconds interval,
+                                                      lib::Span<const char> initialState);
+
+    /** Remove the index files of some data file */
+    static void remove(const std::string & dataFileName);
+
+    /**
+     * Add an entry if the interval has passed since the last one
+     *
+     * @param dataOffset The amount of (uncompressed) data written so far
+     * @return false if the entry could not be written
+     */
+    bool checkpoint(std::uint64_t dataOffset);
+
+    /**
+     * Add some frames to the state file
+     *
+     * @return false if they could not be written
+     */
+    bool addState(lib::Span<const char> frames);
+
+private:
+    lib::AutoClosingFd mIndexFd;
+    lib::AutoClosingFd mStateFd;
+    std::chrono::milliseconds mInterval;
+    std::chrono::steady_clock::time_point mLastEntry {};
+    bool mHasEntry {false};
+    std::uint64_t mStateLength {0};
+
+    CaptureIndexWriter(lib::AutoClosingFd && indexFd,
+                       lib::AutoClosingFd && stateFd,
+                       std::chrono::milliseconds interval);
+};
@@ -6,15 +6,18 @@
 #include "Constant.h"
 #include "ICpuInfo.h"
 #include "Logging.h"
+#include "MemoryBudget.h"
 #include "OlyUtility.h"
 #include "PrimarySourceProvider.h"
 #include "SessionData.h"
 #include "lib/FsEntry.h"
 #include "lib/String.h"
+#include "lib/Utils.h"
 #include "xml/MxmlUtils.h"
 
 #include <algorithm>
 #include <cassert>
+#include <cinttypes>
 #include <cstdlib>
 #include <cstring>
 #include <set>
@@ -135,6 +138,20 @@ static mxml_node_t * getTree(bool includeTime,
         mxmlElementSetAttr(target, "local_capture", "yes");
     }
 
+    // where gatord's own threads ran, so that its effect on the measured cores can be judged
+    if (!gSessionData.mGatorCpus.empty()) {
+        mxmlElementSetAttr(target, "gator_cpus", lib::formatCpuMask(gSessionData.mGatorCpus).c_str());
+    }
+    if (gSessionData.mGatorNice) {
+        mxmlElementSetAttrf(target, "gator_nice", "%d", *gSessionData.mGatorNice);
+    }
+    if (gSessionData.mPollingCpu >= 0) {
+        mxmlElementSetAttrf(target, "polling_cpu", "%d", gSessionData.mPollingCpu);
+    }
+    if (gSessionData.mRealtimePolling) {
+        mxmlElementSetAttr(target, "realtime_polling", "yes");
+    }
+
     // add some OS information
 #if defined(GATOR_TARGET_OS)
     mxmlElementSetAttr(target, "os", GATOR_TARGET_OS);
@@ -143,6 +160,22 @@ static mxml_node_t * getTree(bool includeTime,
 #endif
 #endif
 
+    // the memory that each component's buffers were given, and the limit they were carved from
+    const auto allocations = gMemoryBudget.getAllocations();
+    if (!allocations.empty()) {
+        mxml_node_t * const memory = mxmlNewElement(captured, "memory");
+        const auto limit = gMemoryBudget.getLimit();
+        if (limit > 0) {
+            mxmlElementSetAttrf(memory, "limit", "%" PRIu64, limit);
+        }
+        for (const auto & [component, allocation] : allocations) {
+            mxml_node_t * const node = mxmlNewElement(memory, "allocation");
+            mxmlElementSetAttr(node, "component", component.c_str());
+            mxmlElementSetAttrf(node, "buffers", "%zu", allocation.count);
+            mxmlElementSetAttrf(node, "bytes", "%" PRIu64, allocation.bytes);
+        }
+    }
+
     // add mali gpu ids
     if (!maliGpuIds.empty()) {
         // make set of unique ids
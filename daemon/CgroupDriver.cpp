@@ -0,0 +1,415 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "CgroupDriver.h"
+
+#include "Logging.h"
+#include "linux/proc/ProcFieldParser.h"
+
+#include <array>
+#include <cctype>
+#include <deque>
+#include <optional>
+#include <string_view>
+#include <utility>
+
+#include <dirent.h>
+
+namespace {
+    class CgroupCounter : public DriverCounter {
+    public:
+        CgroupCounter(DriverCounter * next,
+                      const char * name,
+                      lib::AutoClosingFd & fd,
+                      std::string filePath,
+                      std::string title,
+                      const char * label,
+                      const char * description,
+                      const char * unit,
+                      double multiplier,
+                      bool delta,
+                      const uint64_t * value);
+
+        // Intentionally unimplemented
+        CgroupCounter(const CgroupCounter &) = delete;
+        CgroupCounter & operator=(const CgroupCounter &) = delete;
+        CgroupCounter(CgroupCounter &&) = delete;
+        CgroupCounter & operator=(CgroupCounter &&) = delete;
+
+        /** @return The fd of the file the value is read from, which is shared with the other counters of the file */
+        [[nodiscard]] lib::AutoClosingFd & getFd() const { return mFd; }
+        /** @return The path of the file relative to the root of the hierarchy */
+        [[nodiscard]] const std::string & getFilePath() const { return mFilePath; }
+        [[nodiscard]] const char * getTitle() const { return mTitle.c_str(); }
+        [[nodiscard]] const char * getLabel() const { return mLabel; }
+        [[nodiscard]] const char * getDescription() const { return mDescription; }
+        [[nodiscard]] const char * getUnit() const { return mUnit; }
+        [[nodiscard]] double getMultiplier() const { return mMultiplier; }
+        [[nodiscard]] bool isDelta() const { return mDelta; }
+
+        int64_t read() override;
+
+    private:
+        lib::AutoClosingFd & mFd;
+        const std::string mFilePath;
+        const std::string mTitle;
+        const char * const mLabel;
+        const char * const mDescription;
+        const char * const mUnit;
+        const uint64_t * const mValue;
+        const double mMultiplier;
+        uint64_t mPrev;
+        const bool mDelta;
+    };
+
+    CgroupCounter::CgroupCounter(DriverCounter * next,
+                                 const char * name,
+                                 lib::AutoClosingFd & fd,
+                                 std::string filePath,
+                                 std::string title,
+                                 const char * label,
+                                 const char * description,
+                                 const char * unit,
+                                 double multiplier,
+                                 bool delta,
+                                 const uint64_t * value)
+        : DriverCounter(next, name),
+          mFd(fd),
+          mFilePath(std::move(filePath)),
+          mTitle(std::move(title)),
+          mLabel(label),
+          mDescription(description),
+          mUnit(unit),
+          mValue(value),
+          mMultiplier(multiplier),
+          mPrev(0),
+          mDelta(delta)
+    {
+    }
+
+    int64_t CgroupCounter::read()
+    {
+        if (!mDelta) {
+            return *mValue;
+        }
+        // the values are reset if the cgroup is removed and another created with the same name
+        const int64_t result = (*mValue >= mPrev ? *mValue - mPrev : 0);
+        mPrev = *mValue;
+        return result;
+    }
+
+    /** @return The mount point of the cgroup v2 hierarchy, or nothing if it is not mounted */
+    std::optional<std::string> findMountPoint()
+    {
+        std::vector<char> buffer;
+        const auto mounts = lib::DirectoryFd::open("/proc/self").readFile("mounts", buffer);
+        if (!mounts) {
+            return {};
+        }
+
+        std::string_view remaining = *mounts;
+        while (!remaining.empty()) {
+            lnx::ProcFieldParser fields {lnx::ProcFieldParser::nextLine(remaining)};
+            fields.skip();
+            const std::string_view mountPoint = fields.nextField();
+            if (fields.nextField() == "cgroup2") {
+                return std::string {mountPoint};
+            }
+        }
+
+        return {};
+    }
+
+    /** Make a counter name from a cgroup path, replacing the characters that are not valid in one */
+    std::string makeName(const std::string & path, const char * suffix)
+    {
+        std::string name {"Linux_cgroup_"};
+        for (const char c : path) {
+            name += (std::isalnum(static_cast<unsigned char>(c)) != 0 ? c : '_');
+        }
+        name += '_';
+        name += suffix;
+        return name;
+    }
+
+    /**
+     * Parse the values of some keys of a "key value" per line file, such as cpu.stat or memory.stat
+     *
+     * @return False if not every key was found
+     */
+    template<std::size_t N>
+    bool parseKeyedValues(std::string_view contents,
+                          const std::array<std::pair<std::string_view, uint64_t *>, N> & keys)
+    {
+        std::size_t found = 0;
+        while ((found < N) && !contents.empty()) {
+            lnx::ProcFieldParser fields {lnx::ProcFieldParser::nextLine(contents)};
+            const std::string_view key = fields.nextField();
+            for (const auto & [name, value] : keys) {
+                if (name == key) {
+                    if (!fields.next(*value)) {
+                        return false;
+                    }
+                    found += 1;
+                    break;
+                }
+            }
+        }
+        return found == N;
+    }
+
+    /** Sum the read and written bytes of every device in io.stat */
+    void parseIoStat(std::string_view contents, uint64_t & read, uint64_t & written)
+    {
+        constexpr std::string_view RBYTES {"rbytes="};
+        constexpr std::string_view WBYTES {"wbytes="};
+
+        uint64_t readTotal = 0;
+        uint64_t writtenTotal = 0;
+
+        // each line is "major:minor rbytes=... wbytes=... rios=... wios=... dbytes=... dios=..."
+        while (!contents.empty()) {
+            lnx::ProcFieldParser fields {lnx::ProcFieldParser::nextLine(contents)};
+            fields.skip();
+            for (auto field = fields.nextField(); !field.empty(); field = fields.nextField()) {
+                uint64_t value = 0;
+                if (field.substr(0, RBYTES.size()) == RBYTES) {
+                    if (lnx::ProcFieldParser {field.substr(RBYTES.size())}.next(value)) {
+                        readTotal += value;
+                    }
+                }
+                else if (field.substr(0, WBYTES.size()) == WBYTES) {
+                    if (lnx::ProcFieldParser {field.substr(WBYTES.size())}.next(value)) {
+                        writtenTotal += value;
+                    }
+                }
+            }
+        }
+
+        read = readTotal;
+        written = writtenTotal;
+    }
+}
+
+void CgroupDriver::readEvents(mxml_node_t * const /*unused*/)
+{
+    const auto mountPoint = findMountPoint();
+    if (mountPoint) {
+        mRoot = lib::DirectoryFd::open(mountPoint->c_str());
+    }
+    if (!mRoot) {
+        LOG_SETUP("Linux counters\nCannot find a cgroup v2 hierarchy. Cgroup counters not available.");
+        return;
+    }
+
+    // breadth first, so that if there are too many cgroups it is the deepest that are left out
+    std::deque<std::pair<std::string, std::size_t>> pending {{std::string {}, 0}};
+    while (!pending.empty() && (mCgroups.size() < MAX_CGROUPS)) {
+        auto [path, depth] = std::move(pending.front());
+        pending.pop_front();
+
+        const lib::DirectoryFd dir = (path.empty() ? mRoot.openDirectory(".") : mRoot.openDirectory(path.c_str()));
+        if (!dir) {
+            continue;
+        }
+
+        if (depth > 0) {
+            // cpu.stat is always present, but only has the throttling stats (and memory.stat and io.stat are only
+            // present) if the parent enables the controller for its children
+            if (!dir.openFile("cpu.stat")) {
+                continue;
+            }
+            addCgroup(path,
+                      bool(dir.openFile("cpu.max")),
+                      bool(dir.openFile("memory.stat")),
+                      bool(dir.openFile("io.stat")));
+        }
+
+        if (depth < MAX_DEPTH) {
+            dir.forEachChild([&](const lib::DirectoryFd::Entry & entry) {
+                if (entry.type == DT_DIR) {
+                    pending.emplace_back(path.empty() ? std::string {entry.name} : path + '/' + entry.name,
+                                         depth + 1);
+                }
+            });
+        }
+    }
+
+    if (mCgroups.size() >= MAX_CGROUPS) {
+        LOG_DEBUG("Only the first %zu cgroups are counted", MAX_CGROUPS);
+    }
+}
+
+void CgroupDriver::addCgroup(std::string path, bool hasCpu, bool hasMemory, bool hasIo)
+{
+    auto & cgroup = *mCgroups.emplace_back(std::make_unique<Cgroup>());
+    cgroup.path = std::move(path);
+
+    const auto add = [&](lib::AutoClosingFd & fd,
+                         const char * fileName,
+                         const char * suffix,
+                         const char * title,
+                         const char * label,
+                         const char * description,
+                         const char * unit,
+                         double multiplier,
+                         bool delta,
+                         const uint64_t & value) {
+        setCounters(new CgroupCounter(getCounters(),
+                                      makeName(cgroup.path, suffix).c_str(),
+                                      fd,
+                                      cgroup.path + '/' + fileName,
+                                      cgroup.path + ": " + title,
+                                      label,
+                                      description,
+                                      unit,
+                                      multiplier,
+                                      delta,
+                                      &value));
+    };
+
+    add(cgroup.cpuFd,
+        "cpu.stat",
+        "cpu_usage",
+        "CPU",
+        "Usage",
+        "The CPU time used by the tasks in the cgroup (cpu.stat usage_usec)",
+        "s",
+        0.000001,
+        true,
+        cgroup.cpuUsage);
+
+    if (hasCpu) {
+        add(cgroup.cpuFd,
+            "cpu.stat",
+            "cpu_throttled",
+            "CPU",
+            "Throttled",
+            "The time for which the tasks in the cgroup were throttled by its CPU bandwidth limit (cpu.stat "
+            "throttled_usec)",
+            "s",
+            0.000001,
+            true,
+            cgroup.cpuThrottled);
+    }
+
+    if (hasMemory) {
+        add(cgroup.memoryFd,
+            "memory.stat",
+            "memory_anon",
+            "Memory",
+            "Anonymous",
+            "The anonymous memory used by the cgroup (memory.stat anon)",
+            "B",
+            1.0,
+            false,
+            cgroup.memoryAnon);
+        add(cgroup.memoryFd,
+            "memory.stat",
+            "memory_file",
+            "Memory",
+            "File",
+            "The page cache used by the cgroup (memory.stat file)",
+            "B",
+            1.0,
+            false,
+            cgroup.memoryFile);
+    }
+
+    if (hasIo) {
+        add(cgroup.ioFd,
+            "io.stat",
+            "io_read",
+            "IO",
+            "Read",
+            "The bytes read from block devices by the cgroup (io.stat rbytes)",
+            "B",
+            1.0,
+            true,
+            cgroup.ioRead);
+        add(cgroup.ioFd,
+            "io.stat",
+            "io_write",
+            "IO",
+            "Write",
+            "The bytes written to block devices by the cgroup (io.stat wbytes)",
+            "B",
+            1.0,
+            true,
+            cgroup.ioWrite);
+    }
+}
+
+void CgroupDriver::writeEvents(mxml_node_t * root) const
+{
+    root = mxmlNewElement(root, "category");
+    mxmlElementSetAttr(root, "name", "Cgroups");
+
+    for (auto * counter = static_cast<CgroupCounter *>(getCounters()); counter != nullptr;
+         counter = static_cast<CgroupCounter *>(counter->getNext())) {
+        mxml_node_t * node = mxmlNewElement(root, "event");
+        mxmlElementSetAttr(node, "counter", counter->getName());
+        mxmlElementSetAttr(node, "title", counter->getTitle());
+        mxmlElementSetAttr(node, "name", counter->getLabel());
+        mxmlElementSetAttr(node, "display", (counter->isDelta() ? "accumulate" : "maximum"));
+        mxmlElementSetAttr(node, "class", (counter->isDelta() ? "delta" : "absolute"));
+        mxmlElementSetAttr(node, "units", counter->getUnit());
+        if (counter->getMultiplier() != 1.0) {
+            mxmlElementSetAttrf(node, "multiplier", "%f", counter->getMultiplier());
+        }
+        if (!counter->isDelta()) {
+            mxmlElementSetAttr(node, "average_selection", "yes");
+        }
+        mxmlElementSetAttr(node, "series_composition", "overlay");
+        mxmlElementSetAttr(node, "rendering_type", "line");
+        mxmlElementSetAttr(node, "description", counter->getDescription());
+    }
+}
+
+void CgroupDriver::start()
+{
+    // only the files with enabled counters are opened
+    for (auto * counter = static_cast<CgroupCounter *>(getCounters()); counter != nullptr;
+         counter = static_cast<CgroupCounter *>(counter->getNext())) {
+        if (counter->isEnabled() && !counter->getFd()) {
+            counter->getFd() = mRoot.openFile(counter->getFilePath().c_str());
+        }
+    }
+
+    sample();
+
+    // Initialize previous values
+    for (DriverCounter * counter = getCounters(); counter != nullptr; counter = counter->getNext()) {
+        if (!counter->isEnabled()) {
+            continue;
+        }
+        counter->read();
+    }
+}
+
+void CgroupDriver::sample()
+{
+    for (auto & cgroup : mCgroups) {
+        // the cgroup may be removed during the capture, in which case its values stop changing
+        if (cgroup->cpuFd) {
+            const auto contents = lib::DirectoryFd::readContents(*cgroup->cpuFd, mBuf);
+            if (contents) {
+                parseKeyedValues<2>(*contents,
+                                    {{{"usage_usec", &cgroup->cpuUsage}, {"throttled_usec", &cgroup->cpuThrottled}}});
+            }
+        }
+
+        if (cgroup->memoryFd) {
+            const auto contents = lib::DirectoryFd::readContents(*cgroup->memoryFd, mBuf);
+            if (contents) {
+                parseKeyedValues<2>(*contents, {{{"anon", &cgroup->memoryAnon}, {"file", &cgroup->memoryFile}}});
+            }
+        }
+
+        if (cgroup->ioFd) {
+            const auto contents = lib::DirectoryFd::readContents(*cgroup->ioFd, mBuf);
+            if (contents) {
+                parseIoStat(*contents, cgroup->ioRead, cgroup->ioWrite);
+            }
+        }
+    }
+}
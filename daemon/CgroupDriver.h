@@ -0,0 +1,67 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#ifndef CGROUPDRIVER_H
+#define CGROUPDRIVER_H
+
+#include "PolledDriver.h"
+#include "lib/AutoClosingFd.h"
+#include "lib/DirectoryFd.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Reads the CPU, memory and IO usage of the cgroups in the cgroup v2 hierarchy, such as those of containers, systemd
+ * services, or (on Android) the uids and task profiles of apps.
+ *
+ * The cgroups are discovered breadth first from the root (which is not itself counted, as its usage is that of the
+ * whole system) down to MAX_DEPTH levels, up to MAX_CGROUPS of them, and their counters are declared in the counter
+ * XML by writeEvents. Each cgroup's cpu.stat, memory.stat and io.stat files are opened once, at the start of the
+ * capture and only if one of their counters is enabled, then all are reread from the start in one pass per poll.
+ */
+class CgroupDriver : public PolledDriver {
+public:
+    /** The deepest level below the root at which cgroups are counted */
+    static constexpr std::size_t MAX_DEPTH = 3;
+    /** The most cgroups counted, which bounds the counters declared and the files read per poll */
+    static constexpr std::size_t MAX_CGROUPS = 256;
+
+    CgroupDriver() : PolledDriver("Cgroup") {}
+
+    // Intentionally unimplemented
+    CgroupDriver(const CgroupDriver &) = delete;
+    CgroupDriver & operator=(const CgroupDriver &) = delete;
+    CgroupDriver(CgroupDriver &&) = delete;
+    CgroupDriver & operator=(CgroupDriver &&) = delete;
+
+    void readEvents(mxml_node_t * root) override;
+    void writeEvents(mxml_node_t * root) const override;
+    void start() override;
+    void sample() override;
+
+private:
+    struct Cgroup {
+        /** The path relative to the root of the hierarchy */
+        std::string path;
+        lib::AutoClosingFd cpuFd {};
+        lib::AutoClosingFd memoryFd {};
+        lib::AutoClosingFd ioFd {};
+        uint64_t cpuUsage {0};
+        uint64_t cpuThrottled {0};
+        uint64_t memoryAnon {0};
+        uint64_t memoryFile {0};
+        uint64_t ioRead {0};
+        uint64_t ioWrite {0};
+    };
+
+    lib::DirectoryFd mRoot {};
+    std::vector<std::unique_ptr<Cgroup>> mCgroups {};
+    std::vector<char> mBuf {};
+
+    void addCgroup(std::string path, bool hasCpu, bool hasMemory, bool hasIo);
+};
+
+#endif // CGROUPDRIVER_H
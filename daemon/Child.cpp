@@ -3,7 +3,9 @@
 #include "Child.h"
 
 #include "CapturedXML.h"
+#include "CommitTimeChecker.h"
 #include "ConfigurationXML.h"
+#include "ConfigurationXMLParser.h"
 #include "CounterXML.h"
 #include "Driver.h"
 #include "Drivers.h"
@@ -12,19 +14,24 @@
 #include "ICpuInfo.h"
 #include "LocalCapture.h"
 #include "Logging.h"
+#include "MemoryBudget.h"
 #include "Monitor.h"
 #include "OlySocket.h"
 #include "OlyUtility.h"
+#include "OneShotBudget.h"
+#include "PipelineStats.h"
 #include "PolledDriver.h"
 #include "PrimarySourceProvider.h"
 #include "Sender.h"
 #include "SessionData.h"
 #include "StreamlineSetup.h"
+#include "ThreadPlacement.h"
 #include "UserSpaceSource.h"
 #include "armnn/ArmNNSource.h"
 #include "capture/CaptureProcess.h"
 #include "lib/Assert.h"
-#include "lib/FsUtils.h"
+#include "lib/FileDescriptor.h"
+#include "lib/Probe.h"
 #include "lib/WaitForProcessPoller.h"
 #include "lib/Waiter.h"
 #include "logging/global_log.h"
@@ -32,9 +39,14 @@
 #include "xml/EventsXML.h"
 
 #include <algorithm>
+#include <chrono>
 #include <cstdlib>
 #include <cstring>
+#include <functional>
 #include <iostream>
+#include <optional>
+#include <set>
+#include <string>
 #include <thread>
 #include <utility>
 
@@ -79,6 +91,7 @@ std::unique_ptr<Child> Child::createLocal(agents::i_agent_spawner_t & spawner,
     return std::unique_ptr<Child>(new Child(spawner,
                                             drivers,
                                             nullptr,
+                                            {},
                                             config,
                                             event_listener,
                                             std::move(last_error_supplier),
@@ -88,6 +101,7 @@ std::unique_ptr<Child> Child::createLocal(agents::i_agent_spawner_t & spawner,
 std::unique_ptr<Child> Child::createLive(agents::i_agent_spawner_t & spawner,
                                          Drivers & drivers,
                                          OlySocket & sock,
+                                         lib::AutoClosingFd resumeChannel,
                                          capture::capture_process_event_listener_t & event_listener,
                                          logging::last_log_error_supplier_t last_error_supplier,
                                          logging::log_setup_supplier_t log_setup_supplier)
@@ -95,6 +109,7 @@ std::unique_ptr<Child> Child::createLive(agents::i_agent_spawner_t & spawner,
     return std::unique_ptr<Child>(new Child(spawner,
                                             drivers,
                                             &sock,
+                                            std::move(resumeChannel),
                                             {},
                                             event_listener,
                                             std::move(last_error_supplier),
@@ -121,6 +136,7 @@ void Child::signalHandler(int signum)
 Child::Child(agents::i_agent_spawner_t & spawner,
              Drivers & drivers,
              OlySocket * sock,
+             lib::AutoClosingFd resumeChannel,
              Child::Config config,
              capture::capture_process_event_listener_t & event_listener,
              logging::last_log_error_supplier_t last_error_supplier,
@@ -130,6 +146,7 @@ Child::Child(agents::i_agent_spawner_t & spawner,
       sender(),
       drivers(drivers),
       socket(sock),
+      resumeChannel(std::move(resumeChannel)),
       event_listener(event_listener),
       numExceptions(0),
       sessionEnded(),
@@ -247,7 +264,7 @@ void Child::run()
     // Start up and parse session xml
     if (socket != nullptr) {
         // Respond to Streamline requests
-        StreamlineSetup ss(*socket, drivers, capturedSpes, log_setup_supplier);
+        StreamlineSetup ss(*socket, drivers, capturedSpes, log_setup_supplier, !sender->getSessionToken().empty());
     }
     else {
         char * xmlString;
@@ -272,6 +289,16 @@ void Child::run()
                           primarySourceProvider.getDetectedUncorePmus());
     }
 
+    // every buffer of the capture is carved from here on
+    gMemoryBudget.reset(static_cast<std::uint64_t>(gSessionData.mMemoryLimit) * 1024 * 1024);
+
+    if (gSessionData.mSubscriberPort > 0) {
+        sender->listenForSubscribers(gSessionData.mSubscriberPort);
+    }
+
+    // keep the capture's threads off the measured cores; those started from here on inherit the placement
+    thread_placement::applyToProcess(getpid(), "gatord-child");
+
     // set up stop thread early, so that ping commands get replied to, even if the
     // setup phase below takes a long time.
     std::thread stopThread {[this]() { stopThreadEntryPoint(); }};
@@ -292,6 +319,11 @@ void Child::run()
         waitTillStart.disable();
     };
 
+    // one-shot captures end once all the sources together have sent the configured buffer size
+    gOneShotBudget.reset(
+        (gSessionData.mOneShot ? static_cast<std::uint64_t>(gSessionData.mTotalBufferSize) * 1024 * 1024 : 0),
+        [this]() { endSession(); });
+
     auto newPrimarySource = primarySourceProvider.createPrimarySource(
         senderSem,
         *sender,
@@ -314,27 +346,25 @@ void Child::run()
     // If initialized later, us gator with ftrace has time sync issues
     // Must be initialized before senderThread is started as senderThread checks externalSource
     if (!addSource(createExternalSource(senderSem, drivers), [this, &waitForAgents](auto & source) {
-            this->agent_workers_process.async_add_external_source(source, [&waitForAgents](bool success) {
-                waitForAgents.disable();
-                if (!success) {
-                    handleException();
-                }
-                else {
-                    LOG_DEBUG("Started ext_source agent");
-                }
-            });
+            this->agent_workers_process.async_add_external_source(
+                source,
+                gSessionData.mTriggerMarker,
+                ipc::annotation_channel_limits_t {std::uint32_t(gSessionData.mAnnotationChannelMaxRate),
+                                                  std::uint32_t(gSessionData.mAnnotationChannelSample)},
+                [&waitForAgents](bool success) {
+                    waitForAgents.disable();
+                    if (!success) {
+                        handleException();
+                    }
+                    else {
+                        LOG_DEBUG("Started ext_source agent");
+                    }
+                });
         })) {
         LOG_ERROR("Unable to prepare external source for capture");
         handleException();
     }
 
-    // wait for the ext agent to start
-    if (!sessionEnded) {
-        LOG_DEBUG("Waiting for agent to start");
-        waitForAgents.wait();
-        LOG_DEBUG("Waiting for agent complete");
-    }
-
     // initialize midgard hardware counters
     if (drivers.getMaliHwCntrs().countersEnabled()) {
         if (!addSource(mali_userspace::createMaliHwCntrSource(senderSem, drivers.getMaliHwCntrs()))) {
@@ -366,6 +396,13 @@ void Child::run()
         handleException();
     }
 
+    // wait for the ext agent to start, which it has been doing whilst the other sources were prepared
+    if (!sessionEnded) {
+        LOG_DEBUG("Waiting for agent to start");
+        waitForAgents.wait();
+        LOG_DEBUG("Waiting for agent complete");
+    }
+
     // do this last so that monotonic start is close to start of profiling
     auto monotonicStart = primarySource.sendSummary();
     if (!monotonicStart) {
@@ -412,11 +449,14 @@ void Child::run()
 
     LOG_DEBUG("Profiling ended.");
 
+    gPipelineStats.logSummary();
+
     // must happen before sources is cleared
     agent_workers_process.join();
 
     sources.clear();
     sender.reset();
+    gOneShotBudget.reset(0, {});
 }
 
 template<typename S>
@@ -434,7 +474,12 @@ bool Child::addSource(std::unique_ptr<S> source, Callback callback)
     std::lock_guard<std::mutex> lock {sessionEndedMutex};
     if (!sessionEnded) {
         callback(*source);
-        sources.push_back(std::move(source));
+        // keep the bulk sources last, so that each pass of the sender writes the others first
+        auto const bulk = source->isBulk();
+        auto it = std::find_if(sources.begin(), sources.end(), [bulk](auto const & other) {
+            return other->isBulk() && !bulk;
+        });
+        sources.insert(it, std::move(source));
     }
     return true;
 }
@@ -459,6 +504,7 @@ void Child::doEndSession()
     std::lock_guard<std::mutex> lock {sessionEndedMutex};
 
     sessionEnded = true;
+    gPipelineStats.onStopRequested();
 
     for (auto & source : sources) {
         source->interrupt();
@@ -518,16 +564,35 @@ void Child::durationThreadEntryPoint(const lib::Waiter & waitTillStart, const li
 namespace {
     class StreamlineCommandHandler : public IStreamlineCommandHandler {
     public:
-        StreamlineCommandHandler(Sender & sender) : sender(sender) {}
+        using ReconfigureCallback = std::function<bool(const std::set<CounterConfiguration> &)>;
+
+        StreamlineCommandHandler(Sender & sender, ReconfigureCallback reconfigure)
+            : sender(sender), reconfigure(std::move(reconfigure))
+        {
+        }
 
         State handleRequest(char *) override
         {
             LOG_DEBUG("INVESTIGATE: Received unknown command type COMMAND_REQUEST_XML");
             return State::PROCESS_COMMANDS;
         }
-        State handleDeliver(char *) override
+        State handleDeliver(char * xml) override
         {
-            LOG_DEBUG("INVESTIGATE: Received unknown command type COMMAND_DELIVER_XML");
+            // a configuration xml delivered while capturing changes the counters of the running capture
+            ConfigurationXMLParser parser {};
+            if ((xml == nullptr) || (parser.parseConfigurationContent(xml) != 0)) {
+                LOG_DEBUG("INVESTIGATE: Received unknown command type COMMAND_DELIVER_XML");
+                sender.writeData(nullptr, 0, ResponseType::NAK);
+                return State::PROCESS_COMMANDS;
+            }
+
+            const auto & parsed = parser.getCounterConfiguration();
+            const std::set<CounterConfiguration> counterConfigurations {parsed.begin(), parsed.end()};
+            const bool reconfigured = reconfigure(counterConfigurations);
+
+            LOG_DEBUG("Received configuration xml while capturing, %s",
+                      (reconfigured ? "the counters were changed" : "but the counters could not be changed"));
+            sender.writeData(nullptr, 0, (reconfigured ? ResponseType::ACK : ResponseType::NAK));
             return State::PROCESS_COMMANDS;
         }
         State handleApcStart() override
@@ -565,6 +630,7 @@ namespace {
 
     private:
         Sender & sender;
+        ReconfigureCallback reconfigure;
     };
 }
 
@@ -584,17 +650,40 @@ void Child::stopThreadEntryPoint()
         LOG_ERROR("Monitor::add(socket=%d) failed: %d, (%s)", socket->getFd(), errno, strerror(errno));
         handleException();
     }
+    if (resumeChannel && !monitor.add(*resumeChannel)) {
+        LOG_ERROR("Monitor::add(resumeChannel=%d) failed: %d, (%s)", *resumeChannel, errno, strerror(errno));
+        handleException();
+    }
 
-    StreamlineCommandHandler commandHandler {*sender};
+    StreamlineCommandHandler commandHandler {*sender, [this](const std::set<CounterConfiguration> & counters) {
+                                                 return drivers.getPrimarySourceProvider().reconfigureCounters(
+                                                     counters,
+                                                     senderSem,
+                                                     *sender,
+                                                     agent_workers_process);
+                                             }};
+
+    // set whilst the connection to the host is lost, and it may still resume the capture
+    std::optional<std::chrono::steady_clock::time_point> resumeDeadline {};
 
     while (true) {
+        int timeoutMs = -1;
+        if (resumeDeadline) {
+            const auto remaining = *resumeDeadline - std::chrono::steady_clock::now();
+            timeoutMs = std::max<int>(0, std::chrono::duration_cast<std::chrono::milliseconds>(remaining).count());
+        }
+
         struct epoll_event ee;
-        const int ready = monitor.wait(&ee, 1, -1);
+        const int ready = monitor.wait(&ee, 1, timeoutMs);
         if (ready < 0) {
             LOG_ERROR("Monitor::wait failed");
             handleException();
         }
         if (ready == 0) {
+            if (resumeDeadline && (std::chrono::steady_clock::now() >= *resumeDeadline)) {
+                LOG_ERROR("The host did not resume the capture within %d seconds", gSessionData.mResumeTimeoutSeconds);
+                break;
+            }
             continue;
         }
 
@@ -605,13 +694,50 @@ void Child::stopThreadEntryPoint()
             break;
         }
 
+        if (ee.data.fd == *resumeChannel) {
+            std::string token;
+            const int fd = lib::receiveFd(*resumeChannel, token);
+            if (fd < 0) {
+                // gator-main has gone, so there will be no more
+                monitor.remove(*resumeChannel);
+                continue;
+            }
+
+            // a further data connection gives its number after the token
+            const auto space = token.rfind(' ');
+            if (space != std::string::npos) {
+                sender->attachDataStream(fd, token.substr(0, space), token.substr(space + 1));
+                continue;
+            }
+
+            // the host may reconnect before the loss of the old connection is noticed, so stop reading from it
+            // whilst it is replaced (which keeps the same fd)
+            monitor.remove(socket->getFd());
+            if (sender->resume(fd, token)) {
+                resumeDeadline.reset();
+            }
+            if (!resumeDeadline && !monitor.add(socket->getFd())) {
+                LOG_ERROR("Monitor::add(socket=%d) failed: %d, (%s)", socket->getFd(), errno, strerror(errno));
+                handleException();
+            }
+            continue;
+        }
+
         assert(ee.data.fd == socket->getFd());
 
         // This thread will stall until the APC_STOP or PING command is received over the socket or the socket is disconnected
         const auto result = streamlineSetupCommandIteration(*socket, commandHandler, [](bool) -> void {});
-        if (result != IStreamlineCommandHandler::State::PROCESS_COMMANDS) {
-            break;
+        if (result == IStreamlineCommandHandler::State::PROCESS_COMMANDS) {
+            continue;
+        }
+        if ((result == IStreamlineCommandHandler::State::EXIT_ERROR) && sender->isResumable()) {
+            sender->suspend();
+            monitor.remove(socket->getFd());
+            resumeDeadline =
+                std::chrono::steady_clock::now() + std::chrono::seconds(gSessionData.mResumeTimeoutSeconds);
+            continue;
         }
+        break;
     }
 
     doEndSession();
@@ -622,10 +748,14 @@ void Child::stopThreadEntryPoint()
 bool Child::sendAllSources()
 {
     bool done = true;
+    GATOR_PROBE(send_all_sources_start);
+    sender->beginBatch();
     for (auto & source : sources) {
         // bitwise &, no short circuit
         done &= source->write(*sender);
     }
+    sender->endBatch();
+    GATOR_PROBE1(send_all_sources_end, done);
     return !done;
 }
 
@@ -634,10 +764,22 @@ void Child::senderThreadEntryPoint()
     prctl(PR_SET_NAME, reinterpret_cast<unsigned long>(&"gatord-sender"), 0, 0, 0);
     sem_wait(&haltPipeline);
 
+    const std::uint64_t gatherWindow = CommitTimeChecker::getGatherWindow(gSessionData.mLiveRate);
+
     do {
         if (sem_wait(&senderSem) != 0) {
             LOG_ERROR("wait failed: %d, (%s)", errno, strerror(errno));
         }
+
+        // in live mode, give the other sources a moment to commit the rest of the period's data, so that it is all
+        // sent in one batch
+        if (gatherWindow > 0) {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(gatherWindow));
+        }
+
+        // coalesce any other pending notifications, as the sources are all drained in one pass anyway
+        while (sem_trywait(&senderSem) == 0) {
+        }
     } while (sendAllSources());
 
     // write end-of-capture sequence
@@ -648,34 +790,6 @@ void Child::senderThreadEntryPoint()
     LOG_DEBUG("Exit sender thread");
 }
 
-void Child::watchPidsThreadEntryPoint(std::set<int> & pids, const lib::Waiter & waiter)
-{
-    // rename thread
-    prctl(PR_SET_NAME, reinterpret_cast<unsigned long>("gatord-pidwatcher"), 0, 0, 0);
-
-    while (!pids.empty()) {
-        if (!waiter.wait_for(std::chrono::seconds(1))) {
-            LOG_DEBUG("Exit watch pids thread by request");
-            return;
-        }
-
-        const auto & alivePids = lib::getNumericalDirectoryEntries<int>("/proc");
-        auto it = pids.begin();
-        while (it != pids.end()) {
-            if (alivePids.count(*it) == 0) {
-                LOG_DEBUG("pid %d exited", *it);
-                it = pids.erase(it);
-            }
-            else {
-                ++it;
-            }
-        }
-    }
-    LOG_DEBUG("Ending session because all watched processes have exited");
-    endSession();
-    LOG_DEBUG("Exit watch pids thread");
-}
-
 void Child::on_terminal_signal(int signo)
 {
     endSession(signo);
@@ -685,3 +799,9 @@ void Child::on_agent_thread_terminated()
 {
     endSession();
 }
+
+void Child::on_agent_launched(pid_t pid)
+{
+    // the agent was forked with gatord's initial placement, rather than that of the forking thread
+    thread_placement::applyToProcess(pid, "the agent");
+}
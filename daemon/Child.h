@@ -42,9 +42,13 @@ public:
                                               capture::capture_process_event_listener_t & event_listener,
                                               logging::last_log_error_supplier_t last_error_supplier,
                                               logging::log_setup_supplier_t log_setup_supplier);
+    /**
+     * @param resumeChannel Receives the new connections from the host to resume the capture, from gator-main
+     */
     static std::unique_ptr<Child> createLive(agents::i_agent_spawner_t & spawner,
                                              Drivers & drivers,
                                              OlySocket & sock,
+                                             lib::AutoClosingFd resumeChannel,
                                              capture::capture_process_event_listener_t & event_listener,
                                              logging::last_log_error_supplier_t last_error_supplier,
                                              logging::log_setup_supplier_t log_setup_supplier);
@@ -80,6 +84,7 @@ private:
     std::unique_ptr<Sender> sender;
     Drivers & drivers;
     OlySocket * socket;
+    lib::AutoClosingFd resumeChannel;
     capture::capture_process_event_listener_t & event_listener;
     int numExceptions;
     std::mutex sessionEndedMutex {};
@@ -95,6 +100,7 @@ private:
     Child(agents::i_agent_spawner_t & spawner,
           Drivers & drivers,
           OlySocket * sock,
+          lib::AutoClosingFd resumeChannel,
           Config config,
           capture::capture_process_event_listener_t & event_listener,
           logging::last_log_error_supplier_t last_error_supplier,
@@ -120,12 +126,12 @@ private:
      * @return true if there will be more to send again on at least one source, false otherwise (EOF)
      */
     bool sendAllSources();
-    void watchPidsThreadEntryPoint(std::set<int> &, const lib::Waiter & waiter);
     void doEndSession();
 
     // for agent_workers_process_t
     void on_terminal_signal(int signo);
     void on_agent_thread_terminated();
+    void on_agent_launched(pid_t pid);
 };
 
 #endif //__CHILD_H__
@@ -1,17 +1,50 @@
-/* Copyright (C) 2020 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2020-2022 by Arm Limited. All rights reserved. */
 
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
 
+/**
+ * Decides when a source commits the frames it built, so that the sender can send them.
+ *
+ * In live mode (a non-zero commit rate) the frames are committed:
+ *  - on time, at the next multiple of the commit rate since the start of the capture, so that under light load all the
+ *    sources (whose times are all relative to the start of the capture) commit together and the sender is woken
+ *    once per period to send them in one batch, rather than once for each source at its own phase;
+ *  - on size, as soon as SIZE_THRESHOLD bytes were written since the last commit, so that under heavy load the data
+ *    is sent in large writes as it is produced rather than building up until the end of the period.
+ *
+ * Otherwise, and in either case, they are committed when forced (such as when the buffer is nearly full).
+ */
 class CommitTimeChecker {
 public:
+    /** The number of bytes written at which a commit is made without waiting for the period to end */
+    static constexpr int SIZE_THRESHOLD = 128 * 1024;
+    /** The longest time the sender waits after being woken, for the other sources' commits of the same period */
+    static constexpr std::uint64_t MAX_GATHER_WINDOW_NS = 1000000;
+
+    /** @return The time the sender should wait after being woken, to gather the commits of one period together */
+    [[nodiscard]] static constexpr std::uint64_t getGatherWindow(std::uint64_t commitRate)
+    {
+        return std::min(MAX_GATHER_WINDOW_NS, commitRate / 16);
+    }
+
     CommitTimeChecker(std::uint64_t commitRate) : commitRate(commitRate), nextCommit(commitRate) {}
 
-    bool operator()(std::uint64_t time, bool force)
+    /**
+     * @param time The time relative to the start of the capture
+     * @param force True if the frames must be committed now
+     * @param pendingBytes The number of bytes written since the last commit
+     * @return True if the frames should be committed
+     */
+    bool operator()(std::uint64_t time, bool force, int pendingBytes)
     {
-        if (force || ((commitRate > 0) && time >= nextCommit)) {
-            nextCommit = time + commitRate;
+        const bool live = (commitRate > 0);
+        if (force || (live && ((time >= nextCommit) || (pendingBytes >= SIZE_THRESHOLD)))) {
+            if (live) {
+                nextCommit = ((time / commitRate) + 1) * commitRate;
+            }
             return true;
         }
         else {
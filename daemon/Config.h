@@ -10,6 +10,9 @@
 
 #define MAX_PERFORMANCE_COUNTERS 100
 
+// the number of PMU sized groups of events that may be selected for each cluster when multiplexing the PMU
+#define PMU_MULTIPLEX_GROUPS 4
+
 // feature control options
 #ifndef CONFIG_PREFER_SYSTEM_WIDE_MODE
 #define CONFIG_PREFER_SYSTEM_WIDE_MODE 1
@@ -60,6 +63,11 @@
 #endif
 #endif
 
+// compile in the USDT probes of lib/Probe.h
+#ifndef CONFIG_USDT_PROBES
+#define CONFIG_USDT_PROBES 0
+#endif
+
 #ifndef CONFIG_LOG_TRACE
 #if (!defined(NDEBUG) || (defined(GATOR_UNIT_TESTS) && GATOR_UNIT_TESTS))
 #define CONFIG_LOG_TRACE 1
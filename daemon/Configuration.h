@@ -1,10 +1,11 @@
-/* Copyright (C) 2018-2020 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2018-2022 by Arm Limited. All rights reserved. */
 
 #ifndef CONFIGURATION_H_
 #define CONFIGURATION_H_
 
 #include "EventCode.h"
 
+#include <cstdint>
 #include <set>
 #include <string>
 #include <vector>
@@ -17,11 +18,51 @@ enum class SpeOps {
     BRANCH //branch
 };
 
+/** An inclusive range of virtual addresses */
+struct SpeAddressRange {
+    uint64_t start;
+    uint64_t end;
+};
+
+/**
+ * Aggregation by gatord of the kept SPE records into a memory access heatmap for each window of time, which is sent
+ * instead of the records themselves
+ */
+struct SpeHeatmap {
+    uint32_t granularity = 0;   // if 0 disabled, else the size in bytes of the blocks the data addresses are counted in
+    uint32_t top_entries = 256; // the number of the most frequent entries sent for each window
+    uint32_t window_ms = 100;   // the length of each window
+    uint32_t raw_interval = 0;  // if 0 no records are sent, else one in every `raw_interval` records is also sent
+
+    [[nodiscard]] bool isEnabled() const { return granularity > 0; }
+};
+
+/**
+ * Filters applied by gatord to the decoded SPE records before they are sent, in addition to (and independently of)
+ * the filters programmed into the hardware. A record is kept only if it passes every enabled filter, and then only one
+ * in every `decimation` of the kept records is sent (or, with a heatmap, aggregated).
+ */
+struct SpeRecordFilter {
+    int min_latency = 0;                       // if 0 disabled, else the minimum total latency
+    uint64_t event_mask {};                    // if 0 disabled, else at least one of these events must be set
+    std::set<SpeOps> ops {};                   // if empty disabled, else the operation must be one of these
+    std::vector<SpeAddressRange> pc_ranges {}; // if empty disabled, else the pc must be in one of these
+    uint32_t decimation = 1;                   // keep one in every `decimation` records
+    SpeHeatmap heatmap {};
+
+    [[nodiscard]] bool isEnabled() const
+    {
+        return (min_latency > 0) || (event_mask != 0) || !ops.empty() || !pc_ranges.empty() || (decimation > 1)
+            || heatmap.isEnabled();
+    }
+};
+
 struct SpeConfiguration {
     std::string id {};
     uint64_t event_filter_mask {}; // if 0 filtering is disabled, else equals PMSEVFR_EL1 (ref doc).
     std::set<SpeOps> ops {};
     int min_latency = 0;
+    SpeRecordFilter record_filter {};
 };
 
 inline bool operator==(const SpeConfiguration & lhs, const SpeConfiguration & rhs)
@@ -0,0 +1,60 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "CpuBudgetGovernor.h"
+
+#include "Logging.h"
+#include "PipelineStats.h"
+#include "SessionData.h"
+
+CpuBudgetGovernor gCpuBudgetGovernor {};
+
+unsigned CpuBudgetGovernor::update()
+{
+    const int budgetPercent = gSessionData.mCpuBudgetPercent;
+    if (budgetPercent <= 0) {
+        return 0;
+    }
+
+    // whichever polling loop gets here first does the check, the others just use the last result
+    const std::unique_lock<std::mutex> lock {mMutex, std::try_to_lock};
+    if (!lock.owns_lock()) {
+        return mThrottleShift.load(std::memory_order_relaxed);
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    if (!mLastCheck) {
+        mLastCheck = now;
+        mLastCpuTime = gPipelineStats.getCpuTime();
+        return 0;
+    }
+
+    const auto elapsed = now - *mLastCheck;
+    if (elapsed < CHECK_INTERVAL) {
+        return mThrottleShift.load(std::memory_order_relaxed);
+    }
+
+    const auto cpuTime = gPipelineStats.getCpuTime();
+    const double usagePercent = (std::chrono::duration<double>(cpuTime - mLastCpuTime).count() * 100.0)
+                              / std::chrono::duration<double>(elapsed).count();
+    mLastCheck = now;
+    mLastCpuTime = cpuTime;
+
+    unsigned shift = mThrottleShift.load(std::memory_order_relaxed);
+    if ((usagePercent > budgetPercent) && (shift < MAX_THROTTLE_SHIFT)) {
+        shift += 1;
+        LOG_WARNING("gatord used %.1f%% of a CPU, which is over its budget of %d%%, so the counters are now polled "
+                    "%u times less often",
+                    usagePercent,
+                    budgetPercent,
+                    1U << shift);
+    }
+    else if ((usagePercent < (budgetPercent / 2.0)) && (shift > 0)) {
+        shift -= 1;
+        LOG_INFO("gatord used %.1f%% of a CPU, so the counters are now polled %u times less often than configured",
+                 usagePercent,
+                 1U << shift);
+    }
+    mThrottleShift.store(shift, std::memory_order_relaxed);
+
+    return shift;
+}
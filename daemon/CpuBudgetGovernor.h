@@ -0,0 +1,43 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#ifndef CPU_BUDGET_GOVERNOR_H
+#define CPU_BUDGET_GOVERNOR_H
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <optional>
+
+/**
+ * Keeps the CPU time used by gatord and its perf agent within the budget set in the session, by slowing down the
+ * counter polling loops.
+ *
+ * The usage is measured from the CPU times recorded by PipelineStats, at most once every CHECK_INTERVAL. While it is
+ * over the budget the polling periods are doubled, up to MAX_THROTTLE_SHIFT times, and once it falls below half the
+ * budget they are halved again. The perf sample rates are not changed, as the samples are weighted by the period that
+ * the events were configured with at the start of the capture.
+ */
+class CpuBudgetGovernor {
+public:
+    /** The most times that the polling periods are doubled */
+    static constexpr unsigned MAX_THROTTLE_SHIFT = 4;
+    /** The interval over which the usage is measured */
+    static constexpr std::chrono::seconds CHECK_INTERVAL {1};
+
+    /**
+     * Check the usage, if it is due to be checked. Called by each polling loop.
+     *
+     * @return The power of two that the polling periods should currently be multiplied by
+     */
+    unsigned update();
+
+private:
+    std::mutex mMutex {};
+    std::optional<std::chrono::steady_clock::time_point> mLastCheck {};
+    std::chrono::microseconds mLastCpuTime {0};
+    std::atomic<unsigned> mThrottleShift {0};
+};
+
+extern CpuBudgetGovernor gCpuBudgetGovernor;
+
+#endif // CPU_BUDGET_GOVERNOR_H
@@ -2,6 +2,7 @@
 
 #include "CpuUtils.h"
 
+#include "CpuUtils_Cache.h"
 #include "CpuUtils_Topology.h"
 #include "Logging.h"
 #include "OlyUtility.h"
@@ -224,7 +225,7 @@ namespace cpu_utils {
             std::mutex mutex;
             std::condition_variable cv;
             std::size_t identificationThreadCallbackCounter = 0;
-            std::map<unsigned, PerCoreIdentificationThread::properties_t> collected_properties {};
+            CpuPropertiesMap collected_properties {};
             std::vector<std::unique_ptr<PerCoreIdentificationThread>> perCoreThreads {};
 
             // wake all cores; this ensures the contents of /proc/cpuinfo reflect the full range of cores in the system.
@@ -233,7 +234,12 @@ namespace cpu_utils {
             // - once all cores are online and affined, *and* have read the data they are required to read, then they callback here to notify this method to continue
             // - the threads remain online until this function finishes (they are disposed of / terminated by destructor); this is so as
             //   to ensure that the cores remain online until cpuinfo is read
-            if (!ignoreOffline) {
+            // that is slow on devices with many cores (or that have to online them), so the result is cached for the
+            // remainder of the boot; with a valid cache cpuinfo need only be read for the hardware name
+            if (readCachedCpuProperties(cpuIds.size(), collected_properties)) {
+                LOG_DEBUG("Using the cached CPU properties");
+            }
+            else if (!ignoreOffline) {
                 for (unsigned cpu = 0; cpu < cpuIds.size(); ++cpu) {
                     perCoreThreads.emplace_back(new PerCoreIdentificationThread(
                         false,
@@ -260,6 +266,9 @@ namespace cpu_utils {
                               identificationThreadCallbackCounter,
                               cpuIds.size());
                 }
+                else {
+                    writeCachedCpuProperties(cpuIds.size(), collected_properties);
+                }
             }
             //
             // when we don't care about onlining the cores, just read them directly, one by one, any that are offline will be ignored anyway
@@ -0,0 +1,221 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "CpuUtils_Cache.h"
+
+#include "Logging.h"
+#include "lib/AutoClosingFd.h"
+#include "lib/Format.h"
+#include "lib/FsEntry.h"
+
+#include <cstdio>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+namespace cpu_utils {
+    namespace {
+        // bump the version whenever the format of the file changes
+        constexpr char CACHE_FILE_MAGIC[] = "gatord-cpu-properties 1";
+        constexpr char CACHE_FILE_NAME[] = "gatord-cpu-properties.cache";
+        constexpr char BOOT_ID_PATH[] = "/proc/sys/kernel/random/boot_id";
+
+        /** @return The directory to store the cache in, which is /tmp on Linux and /data/local/tmp on Android */
+        std::optional<std::string> getCacheDirectory()
+        {
+            if (access("/tmp", W_OK) == 0) {
+                return "/tmp";
+            }
+            if (access("/data/local/tmp", W_OK) == 0) {
+                return "/data/local/tmp";
+            }
+            return {};
+        }
+
+        /** @return The line that identifies the boot and kernel that the cache is valid for */
+        std::optional<std::string> getCacheKey(std::size_t numberOfCpus)
+        {
+            auto const bootId = lib::FsEntry::create(BOOT_ID_PATH).readFileContentsSingleLine();
+            if (bootId.empty()) {
+                return {};
+            }
+
+            struct utsname utsname;
+            if (uname(&utsname) != 0) {
+                return {};
+            }
+
+            return lib::Format() << bootId << " " << utsname.release << " " << utsname.version << " " << numberOfCpus;
+        }
+
+        std::optional<std::string> readCacheFile(const std::string & path)
+        {
+            // the daemon runs as root so only trust a regular file that only this user could have written
+            lib::AutoClosingFd fd {open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW)};
+            if (!fd) {
+                return {};
+            }
+
+            struct stat st;
+            if ((fstat(*fd, &st) != 0) || !S_ISREG(st.st_mode) || (st.st_uid != geteuid())
+                // NOLINTNEXTLINE(hicpp-signed-bitwise)
+                || ((st.st_mode & (S_IWGRP | S_IWOTH)) != 0)) {
+                LOG_DEBUG("Ignoring the CPU properties cache %s as it is not trusted", path.c_str());
+                return {};
+            }
+
+            std::string contents;
+            char buffer[4096];
+            ssize_t n;
+            while ((n = read(*fd, buffer, sizeof(buffer))) > 0) {
+                contents.append(buffer, n);
+            }
+            if (n < 0) {
+                return {};
+            }
+
+            return contents;
+        }
+
+        bool parseProperties(std::istringstream & line, unsigned & cpu, PerCoreIdentificationThread::properties_t & p)
+        {
+            std::string siblings;
+            line >> cpu >> p.core_id >> p.physical_package_id >> std::hex >> p.midr_el1 >> std::dec >> siblings;
+            if (!line || siblings.empty()) {
+                return false;
+            }
+
+            p.core_siblings.clear();
+            if (siblings == "-") {
+                return true;
+            }
+
+            std::istringstream siblingsStream {siblings};
+            std::string sibling;
+            while (std::getline(siblingsStream, sibling, ',')) {
+                try {
+                    p.core_siblings.insert(std::stoi(sibling));
+                }
+                catch (...) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    }
+
+    bool readCachedCpuProperties(std::size_t numberOfCpus, CpuPropertiesMap & properties)
+    {
+        auto const directory = getCacheDirectory();
+        auto const key = getCacheKey(numberOfCpus);
+        if (!directory || !key) {
+            return false;
+        }
+
+        auto const path = lib::FsEntry::create(lib::FsEntry::create(*directory), CACHE_FILE_NAME).path();
+        auto const contents = readCacheFile(path);
+        if (!contents) {
+            return false;
+        }
+
+        std::istringstream stream {*contents};
+        std::string line;
+        if (!std::getline(stream, line) || (line != CACHE_FILE_MAGIC) || !std::getline(stream, line)
+            || (line != *key)) {
+            LOG_DEBUG("The CPU properties cache %s is stale", path.c_str());
+            return false;
+        }
+
+        CpuPropertiesMap result {};
+        while (std::getline(stream, line)) {
+            std::istringstream lineStream {line};
+            unsigned cpu;
+            PerCoreIdentificationThread::properties_t p {};
+            if (!parseProperties(lineStream, cpu, p) || (cpu >= numberOfCpus)
+                || (p.midr_el1 == PerCoreIdentificationThread::INVALID_MIDR_EL1)) {
+                LOG_DEBUG("The CPU properties cache %s is invalid", path.c_str());
+                return false;
+            }
+            result[cpu] = std::move(p);
+        }
+
+        if (result.size() != numberOfCpus) {
+            LOG_DEBUG("The CPU properties cache %s is incomplete", path.c_str());
+            return false;
+        }
+
+        LOG_DEBUG("Read the properties of %zu CPUs from %s", numberOfCpus, path.c_str());
+        properties = std::move(result);
+        return true;
+    }
+
+    void writeCachedCpuProperties(std::size_t numberOfCpus, const CpuPropertiesMap & properties)
+    {
+        if (properties.size() != numberOfCpus) {
+            return;
+        }
+        for (const auto & entry : properties) {
+            if ((entry.first >= numberOfCpus)
+                || (entry.second.midr_el1 == PerCoreIdentificationThread::INVALID_MIDR_EL1)) {
+                return;
+            }
+        }
+
+        auto const directory = getCacheDirectory();
+        auto const key = getCacheKey(numberOfCpus);
+        if (!directory || !key) {
+            return;
+        }
+
+        std::ostringstream contents;
+        contents << CACHE_FILE_MAGIC << '\n' << *key << '\n';
+        for (const auto & [cpu, p] : properties) {
+            contents << cpu << ' ' << p.core_id << ' ' << p.physical_package_id << ' ' << std::hex << p.midr_el1
+                     << std::dec << ' ';
+            if (p.core_siblings.empty()) {
+                contents << '-';
+            }
+            bool first = true;
+            for (int sibling : p.core_siblings) {
+                contents << (first ? "" : ",") << sibling;
+                first = false;
+            }
+            contents << '\n';
+        }
+
+        // write to a new file and then rename it over the old one, so that a concurrent reader never sees part of it
+        auto const path = lib::FsEntry::create(lib::FsEntry::create(*directory), CACHE_FILE_NAME).path();
+        auto const tempPath = std::string(lib::Format() << path << "." << getpid());
+        {
+            lib::AutoClosingFd fd {open(tempPath.c_str(),
+                                        // NOLINTNEXTLINE(hicpp-signed-bitwise)
+                                        O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC | O_NOFOLLOW,
+                                        // NOLINTNEXTLINE(hicpp-signed-bitwise)
+                                        S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)};
+            if (!fd) {
+                LOG_DEBUG("Unable to create %s", tempPath.c_str());
+                return;
+            }
+
+            auto const data = contents.str();
+            if (write(*fd, data.data(), data.size()) != static_cast<ssize_t>(data.size())) {
+                LOG_DEBUG("Unable to write %s", tempPath.c_str());
+                unlink(tempPath.c_str());
+                return;
+            }
+        }
+
+        if (rename(tempPath.c_str(), path.c_str()) != 0) {
+            LOG_DEBUG("Unable to rename %s to %s", tempPath.c_str(), path.c_str());
+            unlink(tempPath.c_str());
+            return;
+        }
+
+        LOG_DEBUG("Wrote the properties of %zu CPUs to %s", numberOfCpus, path.c_str());
+    }
+}
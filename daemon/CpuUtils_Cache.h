@@ -0,0 +1,36 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#ifndef CPU_UTILS_CACHE_H
+#define CPU_UTILS_CACHE_H
+
+#include "linux/PerCoreIdentificationThread.h"
+
+#include <cstddef>
+#include <map>
+
+namespace cpu_utils {
+    using CpuPropertiesMap = std::map<unsigned, PerCoreIdentificationThread::properties_t>;
+
+    /**
+     * Read the per core properties that were identified by some earlier run of gatord.
+     *
+     * The cache is only valid for the same boot (by boot_id) of the same kernel, as the MIDR and topology of each core
+     * cannot change within those. This avoids having to online and affine a thread to every core on each start up.
+     *
+     * @param numberOfCpus The number of cpus expected
+     * @param properties Receives the cached properties
+     * @return True if the cache was valid and has the properties for all of the cpus
+     */
+    bool readCachedCpuProperties(std::size_t numberOfCpus, CpuPropertiesMap & properties);
+
+    /**
+     * Store the per core properties for use by some later run of gatord. Nothing is stored unless the MIDR was read
+     * for all of the cpus.
+     *
+     * @param numberOfCpus The number of cpus
+     * @param properties The identified properties
+     */
+    void writeCachedCpuProperties(std::size_t numberOfCpus, const CpuPropertiesMap & properties);
+}
+
+#endif // CPU_UTILS_CACHE_H
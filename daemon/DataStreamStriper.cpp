@@ -0,0 +1,119 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "DataStreamStriper.h"
+
+#include "BufferUtils.h"
+#include "Logging.h"
+
+#include <algorithm>
+
+#include <sys/prctl.h>
+#include <sys/uio.h>
+
+namespace {
+    // Fail if a connection makes no progress for this long
+    constexpr int SEND_TIMEOUT_MS = 8000;
+    // type and length
+    constexpr std::size_t RESPONSE_HEADER_SIZE = 1 + sizeof(std::uint32_t);
+}
+
+DataStreamStriper::~DataStreamStriper()
+{
+    {
+        std::lock_guard<std::mutex> lock {mMutex};
+        for (auto & stream : mStreams) {
+            stream->closing = true;
+            stream->condition.notify_one();
+        }
+    }
+
+    for (auto & stream : mStreams) {
+        stream->thread.join();
+        stream->socket.shutdownConnection();
+        stream->socket.closeSocket();
+    }
+}
+
+void DataStreamStriper::attach(int socketID)
+{
+    std::lock_guard<std::mutex> lock {mMutex};
+
+    auto & stream = *mStreams.emplace_back(std::make_unique<Stream>(socketID));
+    stream.thread = std::thread {[this, &stream]() { writerThreadEntryPoint(stream); }};
+    mSpaceCondition.notify_all();
+
+    LOG_DEBUG("Attached data stream %zu", mStreams.size());
+}
+
+bool DataStreamStriper::hasStreams() const
+{
+    std::lock_guard<std::mutex> lock {mMutex};
+    return !mStreams.empty();
+}
+
+void DataStreamStriper::write(std::uint64_t sequence,
+                              lib::Span<const lib::Span<const char, int>> dataParts,
+                              ResponseType type)
+{
+    std::size_t length = 0;
+    for (const auto & data : dataParts) {
+        length += data.size();
+    }
+    const std::size_t innerLength = length + (type != ResponseType::RAW ? RESPONSE_HEADER_SIZE : 0);
+
+    std::vector<char> response;
+    response.reserve(RESPONSE_HEADER_SIZE + sizeof(std::uint64_t) + innerLength);
+    response.resize(RESPONSE_HEADER_SIZE + sizeof(std::uint64_t));
+    response[0] = static_cast<char>(ResponseType::APC_DATA_SEQUENCED);
+    buffer_utils::writeLEInt(response.data() + 1, sizeof(std::uint64_t) + innerLength);
+    buffer_utils::writeLELong(response.data() + RESPONSE_HEADER_SIZE, sequence);
+    if (type != ResponseType::RAW) {
+        char header[RESPONSE_HEADER_SIZE];
+        header[0] = static_cast<char>(type);
+        buffer_utils::writeLEInt(header + 1, length);
+        response.insert(response.end(), header, header + sizeof(header));
+    }
+    for (const auto & data : dataParts) {
+        response.insert(response.end(), data.begin(), data.end());
+    }
+
+    std::unique_lock<std::mutex> lock {mMutex};
+
+    const auto leastQueued = [this]() {
+        return std::min_element(mStreams.begin(), mStreams.end(), [](const auto & a, const auto & b) {
+            return a->queuedBytes < b->queuedBytes;
+        });
+    };
+
+    // a response bigger than the limit is still queued once its connection is idle
+    mSpaceCondition.wait(lock, [&]() { return (*leastQueued())->queuedBytes < QUEUE_LIMIT; });
+
+    auto & stream = **leastQueued();
+    stream.queuedBytes += response.size();
+    stream.queue.push_back(std::move(response));
+    stream.condition.notify_one();
+}
+
+void DataStreamStriper::writerThreadEntryPoint(Stream & stream)
+{
+    prctl(PR_SET_NAME, reinterpret_cast<unsigned long>(&"gatord-stripe"), 0, 0, 0);
+
+    std::unique_lock<std::mutex> lock {mMutex};
+    while (true) {
+        stream.condition.wait(lock, [&stream]() { return stream.closing || !stream.queue.empty(); });
+        if (stream.queue.empty()) {
+            break;
+        }
+
+        std::vector<char> response = std::move(stream.queue.front());
+        stream.queue.pop_front();
+        lock.unlock();
+
+        struct iovec iov {response.data(), response.size()};
+        stream.socket.sendv(&iov, 1, SEND_TIMEOUT_MS);
+
+        lock.lock();
+        stream.queuedBytes -= response.size();
+        mSpaceCondition.notify_one();
+    }
+}
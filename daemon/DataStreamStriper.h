@@ -0,0 +1,81 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#pragma once
+
+#include "ISender.h"
+#include "OlySocket.h"
+#include "lib/Span.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Spreads the capture data over the further connections the host opened for it (see SessionData::mDataStreams), so
+ * that the data rate is not limited by the window of a single connection.
+ *
+ * Each write is sent whole, wrapped in a ResponseType::APC_DATA_SEQUENCED response, on whichever connection has the
+ * least queued for it. The host puts the writes back in order by their sequence numbers, then reads the responses in
+ * them as if they had been sent over the main connection. Each connection has its own writer thread, so that the
+ * connections are filled in parallel; the caller only blocks once every queue is full.
+ */
+class DataStreamStriper {
+public:
+    /** The most that is queued for each connection before the caller blocks */
+    static constexpr std::size_t QUEUE_LIMIT = 4 * 1024 * 1024;
+
+    DataStreamStriper() = default;
+
+    // Intentionally unimplemented
+    DataStreamStriper(const DataStreamStriper &) = delete;
+    DataStreamStriper & operator=(const DataStreamStriper &) = delete;
+    DataStreamStriper(DataStreamStriper &&) = delete;
+    DataStreamStriper & operator=(DataStreamStriper &&) = delete;
+
+    /** Send everything that is queued, then close the connections */
+    ~DataStreamStriper();
+
+    /**
+     * Start sending over another connection
+     *
+     * @param socketID The connection, which is taken over
+     */
+    void attach(int socketID);
+
+    /** @return True once there is a connection to send over */
+    [[nodiscard]] bool hasStreams() const;
+
+    /**
+     * Queue a response on the least loaded connection, blocking if they are all full. Only valid once hasStreams.
+     *
+     * @param sequence The write's sequence number
+     * @param dataParts The response, or responses if RAW
+     * @param type The type of the response
+     */
+    void write(std::uint64_t sequence, lib::Span<const lib::Span<const char, int>> dataParts, ResponseType type);
+
+private:
+    struct Stream {
+        explicit Stream(int socketID) : socket(socketID) {}
+
+        OlySocket socket;
+        std::condition_variable condition {};
+        // protected by DataStreamStriper::mMutex
+        std::deque<std::vector<char>> queue {};
+        std::size_t queuedBytes {0};
+        bool closing {false};
+        std::thread thread {};
+    };
+
+    mutable std::mutex mMutex {};
+    // signalled when some queue has space
+    std::condition_variable mSpaceCondition {};
+    // protected by mMutex
+    std::vector<std::unique_ptr<Stream>> mStreams {};
+
+    void writerThreadEntryPoint(Stream & stream);
+};
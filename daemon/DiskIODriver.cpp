@@ -1,14 +1,13 @@
-/* Copyright (C) 2013-2021 by Arm Limited. All rights reserved. */
-
-// Define to get format macros from inttypes.h
-#define __STDC_FORMAT_MACROS
+/* Copyright (C) 2013-2022 by Arm Limited. All rights reserved. */
 
 #include "DiskIODriver.h"
 
 #include "Logging.h"
 #include "SessionData.h"
+#include "linux/proc/ProcFieldParser.h"
 
-#include <cinttypes>
+#include <cstdint>
+#include <string_view>
 
 #include <unistd.h>
 
@@ -59,7 +58,7 @@ void DiskIODriver::doRead()
         return;
     }
 
-    if (!mBuf.read("/proc/diskstats")) {
+    if (!mBuf.reread("/proc/diskstats")) {
         LOG_ERROR("Unable to read /proc/diskstats");
         handleException();
     }
@@ -67,43 +66,27 @@ void DiskIODriver::doRead()
     mReadBytes = 0;
     mWriteBytes = 0;
 
-    char * lastName = nullptr;
-    int lastNameLen = -1;
-    char * line = mBuf.getBuf();
-    while (*line != '\0') {
-        char * end = strchr(line, '\n');
-        if (end != nullptr) {
-            *end = '\0';
-        }
-
-        int nameStart = -1;
-        int nameEnd = -1;
-        uint64_t readBytes = -1;
-        uint64_t writeBytes = -1;
-        // NOLINTNEXTLINE(cert-err34-c)
-        const int count = sscanf(line,
-                                 "%*d %*d %n%*s%n %*u %*u %" SCNu64 " %*u %*u %*u %" SCNu64,
-                                 &nameStart,
-                                 &nameEnd,
-                                 &readBytes,
-                                 &writeBytes);
-        if (count != 2) {
+    std::string_view lastName {};
+    std::string_view remaining {mBuf.getBuf(), mBuf.getLength()};
+    while (!remaining.empty()) {
+        lnx::ProcFieldParser fields {lnx::ProcFieldParser::nextLine(remaining)};
+
+        std::string_view name {};
+        uint64_t readBytes = 0;
+        uint64_t writeBytes = 0;
+        // major minor name reads reads_merged sectors_read ms_reading writes writes_merged sectors_written ...
+        if (!fields.skip(2) || (name = fields.nextField()).empty() || !fields.skip(2) || !fields.next(readBytes)
+            || !fields.skip(3) || !fields.next(writeBytes)) {
             LOG_ERROR("Unable to parse /proc/diskstats");
             handleException();
         }
 
         // Skip partitions which are identified if the name is a substring of the last non-partition
-        if ((lastName == nullptr) || (strncmp(lastName, line + nameStart, lastNameLen) != 0)) {
-            lastName = line + nameStart;
-            lastNameLen = nameEnd - nameStart;
+        if (lastName.empty() || (name.compare(0, lastName.size(), lastName) != 0)) {
+            lastName = name;
             mReadBytes += readBytes;
             mWriteBytes += writeBytes;
         }
-
-        if (end == nullptr) {
-            break;
-        }
-        line = end + 1;
     }
 }
 
@@ -119,8 +102,7 @@ void DiskIODriver::start()
     }
 }
 
-void DiskIODriver::read(IBlockCounterFrameBuilder & buffer)
+void DiskIODriver::sample()
 {
     doRead();
-    super::read(buffer);
 }
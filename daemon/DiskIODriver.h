@@ -1,4 +1,4 @@
-/* Copyright (C) 2013-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2013-2022 by Arm Limited. All rights reserved. */
 
 #ifndef DISKIODRIVER_H
 #define DISKIODRIVER_H
@@ -7,9 +7,6 @@
 #include "PolledDriver.h"
 
 class DiskIODriver : public PolledDriver {
-private:
-    using super = PolledDriver;
-
 public:
     DiskIODriver() : PolledDriver("DiskIO") {}
 
@@ -21,7 +18,7 @@ public:
 
     void readEvents(mxml_node_t * root) override;
     void start() override;
-    void read(IBlockCounterFrameBuilder & buffer) override;
+    void sample() override;
 
 private:
     void doRead();
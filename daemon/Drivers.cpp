@@ -55,10 +55,17 @@ Drivers::Drivers(bool systemWide,
         all.push_back(driver);
         allPolled.push_back(driver);
     }
-    for (auto const & polledDriver : mMaliHwCntrs.getPolledDrivers()) {
-        all.push_back(polledDriver.second.get());
-        allPolled.push_back(polledDriver.second.get());
+    // the GPU frequency tracepoint sees every change, so the polled GPU clock is only used without it
+    if (!mPrimarySourceProvider->supportsGpuFrequencyTracepoint()) {
+        for (auto const & polledDriver : mMaliHwCntrs.getPolledDrivers()) {
+            all.push_back(polledDriver.second.get());
+            allPolled.push_back(polledDriver.second.get());
+        }
     }
+    all.push_back(&mMaliHwCntrs.getMemoryDriver());
+    allPolled.push_back(&mMaliHwCntrs.getMemoryDriver());
+    all.push_back(&mInternalsDriver);
+    allPolled.push_back(&mInternalsDriver);
     all.push_back(&mMaliHwCntrs);
     all.push_back(&mMidgard);
     all.push_back(&mFtraceDriver);
@@ -69,9 +76,7 @@ Drivers::Drivers(bool systemWide,
     all.push_back(&mCcnDriver);
     all.push_back(&mArmnnDriver);
 
-    auto staticEventsXml = events_xml::getStaticTree(mPrimarySourceProvider->getCpuInfo().getClusters(),
-                                                     mPrimarySourceProvider->getDetectedUncorePmus());
-    for (Driver * driver : all) {
-        driver->readEvents(staticEventsXml.get());
-    }
+    events_xml::readStaticTree(mPrimarySourceProvider->getCpuInfo().getClusters(),
+                               mPrimarySourceProvider->getDetectedUncorePmus(),
+                               all);
 }
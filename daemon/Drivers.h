@@ -7,6 +7,7 @@
 #include "CCNDriver.h"
 #include "ExternalDriver.h"
 #include "FtraceDriver.h"
+#include "InternalsDriver.h"
 #include "MidgardDriver.h"
 #include "PrimarySourceProvider.h"
 #include "TtraceDriver.h"
@@ -69,6 +70,7 @@ private:
     FtraceDriver mFtraceDriver;
     AtraceDriver mAtraceDriver;
     TtraceDriver mTtraceDriver;
+    InternalsDriver mInternalsDriver {};
     std::vector<Driver *> all {};
     std::vector<PolledDriver *> allPolled {};
 };
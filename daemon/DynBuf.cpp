@@ -1,4 +1,4 @@
-/* Copyright (C) 2013-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2013-2022 by Arm Limited. All rights reserved. */
 
 #include "DynBuf.h"
 
@@ -74,6 +74,44 @@ fail:
     return result;
 }
 
+bool DynBuf::reread(const char * const path)
+{
+    if (!rereadFd) {
+        rereadFd = open(path, O_RDONLY | O_CLOEXEC);
+        if (!rereadFd) {
+            LOG_DEBUG("open '%s' failed", path);
+            return false;
+        }
+    }
+
+    length = 0;
+
+    for (;;) {
+        const size_t minCapacity = length + MIN_BUFFER_FREE + 1;
+        if (capacity < minCapacity) {
+            if (resize(minCapacity) != 0) {
+                LOG_DEBUG("DynBuf::resize failed");
+                return false;
+            }
+        }
+
+        const ssize_t bytes = ::pread(*rereadFd, buf + length, capacity - length - 1, length);
+        if (bytes < 0) {
+            LOG_DEBUG("pread failed");
+            // reopen it for the next call, in case it was replaced
+            rereadFd.close();
+            return false;
+        }
+        else if (bytes == 0) {
+            break;
+        }
+        length += bytes;
+    }
+
+    buf[length] = '\0';
+    return true;
+}
+
 int DynBuf::readlink(const char * const path)
 {
     ssize_t bytes = MIN_BUFFER_FREE;
@@ -1,8 +1,10 @@
-/* Copyright (C) 2013-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2013-2022 by Arm Limited. All rights reserved. */
 
 #ifndef DYNBUF_H
 #define DYNBUF_H
 
+#include "lib/AutoClosingFd.h"
+
 #include <cstdarg>
 #include <cstdlib>
 
@@ -28,6 +30,11 @@ public:
     }
 
     bool read(const char * path);
+    /**
+     * Like read, but the file is kept open between calls and reread from the start with pread, which saves the open
+     * and close for files that are polled, such as those in sysfs and procfs. The path must be the same for every call.
+     */
+    bool reread(const char * path);
     // On error instead of printing the error and returning false, this returns -errno
     int readlink(const char * path);
     __attribute__((format(printf, 2, 3))) bool printf(const char * format, ...);
@@ -45,6 +52,7 @@ private:
     size_t capacity;
     size_t length;
     char * buf;
+    lib::AutoClosingFd rereadFd {};
 };
 
 #endif // DYNBUF_H
@@ -11,6 +11,7 @@
 #include "CommitTimeChecker.h"
 #include "Drivers.h"
 #include "Logging.h"
+#include "MemoryBudget.h"
 #include "Monitor.h"
 #include "OlySocket.h"
 #include "PrimarySourceProvider.h"
@@ -19,9 +20,14 @@
 #include "lib/AutoClosingFd.h"
 #include "lib/FileDescriptor.h"
 #include "lib/Memory.h"
+#include "lib/Probe.h"
 #include "lib/Syscall.h"
 
+#include <algorithm>
 #include <atomic>
+#include <cinttypes>
+#include <map>
+#include <vector>
 
 #include <fcntl.h>
 #include <sys/prctl.h>
@@ -36,13 +42,38 @@ static const char FTRACE_V1[] = "FTRACE 1\n";
 static const char FTRACE_V2[] = "FTRACE 2\n";
 
 static constexpr int BUFFER_SIZE = 1 * 1024 * 1024;
+static constexpr int MAX_EVENTS = 64;
+// the number of deficit round robin rounds per wakeup before going back to the monitor
+static constexpr int MAX_TRANSFER_ROUNDS = 16;
+// the bytes each source may read per round
+static constexpr int USER_QUANTUM = 64 * 1024;
+// kernel-originated streams (ftrace) cannot be throttled at source, so get a larger share
+static constexpr int KERNEL_QUANTUM = 4 * USER_QUANTUM;
 
 class ExternalSourceImpl : public ExternalSource {
+private:
+    /** The scheduling state and backpressure metrics of one input, only accessed from the run thread */
+    struct SourceState {
+        /** True for kernel-originated streams, which are read first and get a larger quantum */
+        bool kernel {false};
+        /** The bytes that may still be read this round */
+        int deficit {0};
+        std::uint64_t bytes {0};
+        std::uint64_t reads {0};
+        /** The number of rounds in which the source used its whole budget with data still to read */
+        std::uint64_t deferrals {0};
+        /** The number of reads that had to wait for space in the buffer */
+        std::uint64_t bufferWaits {0};
+        bool closed {false};
+    };
+
 public:
     ExternalSourceImpl(sem_t & senderSem, Drivers & mDrivers, std::function<uint64_t()> getMonotonicTime)
         : mGetMonotonicTime(std::move(getMonotonicTime)),
           mCommitChecker(gSessionData.mLiveRate),
-          mBuffer(BUFFER_SIZE, senderSem),
+          mBuffer(static_cast<int>(gMemoryBudget.allocate("external sources", 1, BUFFER_SIZE)),
+                  senderSem,
+                  Buffer::Backing::PREFAULTED),
 
           mMidgardStartupUds(MALI_GRAPHICS_STARTUP, sizeof(MALI_GRAPHICS_STARTUP)),
           mUtgardStartupUds(MALI_UTGARD_STARTUP, sizeof(MALI_UTGARD_STARTUP)),
@@ -63,7 +94,7 @@ public:
         }
     }
 
-    void configureConnection(const int fd, const char * const handshake, size_t size)
+    void configureConnection(const int fd, const char * const handshake, size_t size, bool kernel)
     {
         if (!lib::setNonblock(fd)) {
             LOG_ERROR("Unable to set nonblock on fh");
@@ -75,6 +106,8 @@ public:
             handleException();
         }
 
+        mSources[fd] = SourceState {kernel};
+
         // Write the handshake to the circular buffer
         waitFor(IRawFrameBuilder::MAX_FRAME_HEADER_SIZE + buffer_utils::MAXSIZE_PACK32 + size - 1, []() {
             LOG_ERROR("Unable to configure connection, buffer too small");
@@ -98,14 +131,27 @@ public:
             return false;
         }
 
-        configureConnection(mMidgardUds, MALI_GRAPHICS_V1, sizeof(MALI_GRAPHICS_V1));
+        configureConnection(mMidgardUds, MALI_GRAPHICS_V1, sizeof(MALI_GRAPHICS_V1), false);
 
         return true;
     }
 
+    /**
+     * @return True if the ftrace buffer must be read, which is only when some ftrace counter is enabled (or some
+     * atrace or ttrace counter, as those are read from trace_marker). Tracepoints captured by perf are not included.
+     */
+    bool isFtraceRequired() const
+    {
+        return mDrivers.getFtraceDriver().isSupported()
+            && (mDrivers.getFtraceDriver().countersEnabled() || mDrivers.getAtraceDriver().countersEnabled()
+                || mDrivers.getTtraceDriver().countersEnabled());
+    }
+
     void connectFtrace()
     {
-        if (!mDrivers.getFtraceDriver().isSupported()) {
+        mFtraceRequired = isFtraceRequired();
+        if (!mFtraceRequired) {
+            LOG_DEBUG("Not reading ftrace as no counters require it");
             return;
         }
 
@@ -122,7 +168,7 @@ public:
         }
 
         for (int fd : ftraceFds.first) {
-            configureConnection(fd, handshake, size);
+            configureConnection(fd, handshake, size, true);
         }
     }
 
@@ -178,7 +224,7 @@ public:
 
         std::vector<counter_value_t> collected_values {};
 
-        if (mDrivers.getFtraceDriver().isSupported()) {
+        if (mFtraceRequired) {
             mDrivers.getAtraceDriver().start();
             mDrivers.getTtraceDriver().start();
             mDrivers.getFtraceDriver().start([&collected_values](int key, int core, std::int64_t value) {
@@ -230,8 +276,10 @@ public:
         }
 
         // start the capture
+        std::vector<int> readyFds {};
+        readyFds.reserve(MAX_EVENTS);
         while (mSessionIsActive) {
-            struct epoll_event events[16];
+            struct epoll_event events[MAX_EVENTS];
             // Clear any pending sem posts
             while (sem_trywait(&mBufferSem) == 0) {
             }
@@ -270,31 +318,32 @@ public:
                     }
                 }
                 else {
-                    /* This can result in some starvation if there are multiple
-                     * threads which are annotating heavily, but it is not
-                     * recommended that threads annotate that much as it can also
-                     * starve out the gator data.
-                     */
-                    while (mSessionIsActive) {
-                        if (!transfer(monotonicStart, fd, endSession)) {
-                            break;
-                        }
-                    }
+                    readyFds.push_back(fd);
                 }
             }
+
+            transferReady(monotonicStart, readyFds, endSession);
         }
 
-        if (mDrivers.getFtraceDriver().isSupported()) {
+        if (mFtraceRequired) {
             const auto ftraceFds = mDrivers.getFtraceDriver().stop();
             // Read any slop
             for (int fd : ftraceFds) {
-                transfer(monotonicStart, fd, endSession);
-                close(fd);
+                auto & source = mSources[fd];
+                transfer(monotonicStart, fd, source, BUFFER_SIZE, endSession);
+                if (!source.closed) {
+                    close(fd);
+                }
             }
             mDrivers.getTtraceDriver().stop();
             mDrivers.getAtraceDriver().stop();
         }
 
+        for (const auto & pair : mSources) {
+            logSourceStats(pair.first, pair.second);
+        }
+        mSources.clear();
+
         for (auto & pair : external_agent_connections) {
             LOG_DEBUG("Closing read end %d", pair.first);
             pair.second.close();
@@ -304,13 +353,84 @@ public:
         mBuffer.setDone();
     }
 
-    bool transfer(const std::uint64_t monotonicStart, const int fd, const std::function<void()> & endSession)
+    /**
+     * Read from the ready fds using deficit round robin, so that one busy connection (such as a heavily annotating
+     * thread) cannot starve out the others. Each round every fd earns its quantum and may read up to its accumulated
+     * budget; an fd with nothing left to read loses its budget and leaves the set. Kernel-originated streams are read
+     * first in each round, and whatever remains after a bounded number of rounds is left for the monitor to report
+     * again.
+     */
+    void transferReady(const std::uint64_t monotonicStart,
+                       std::vector<int> & readyFds,
+                       const std::function<void()> & endSession)
+    {
+        std::stable_partition(readyFds.begin(), readyFds.end(), [this](int fd) { return mSources[fd].kernel; });
+
+        for (int round = 0; (round < MAX_TRANSFER_ROUNDS) && !readyFds.empty() && mSessionIsActive; ++round) {
+            readyFds.erase(std::remove_if(readyFds.begin(),
+                                          readyFds.end(),
+                                          [&](int fd) {
+                                              auto & source = mSources[fd];
+                                              const bool more = transferQuantum(monotonicStart, fd, source, endSession);
+                                              if (source.closed) {
+                                                  logSourceStats(fd, source);
+                                                  mSources.erase(fd);
+                                              }
+                                              return !more;
+                                          }),
+                           readyFds.end());
+        }
+        readyFds.clear();
+    }
+
+    /**
+     * Read from one fd for one round
+     *
+     * @return True if the fd used its budget with data still to read
+     */
+    bool transferQuantum(const std::uint64_t monotonicStart,
+                         const int fd,
+                         SourceState & source,
+                         const std::function<void()> & endSession)
+    {
+        source.deficit += (source.kernel ? KERNEL_QUANTUM : USER_QUANTUM);
+
+        while (mSessionIsActive && (source.deficit > 0)) {
+            const std::uint64_t before = source.bytes;
+            const bool more = transfer(monotonicStart, fd, source, source.deficit, endSession);
+            source.deficit -= static_cast<int>(source.bytes - before);
+            if (!more) {
+                source.deficit = 0;
+                return false;
+            }
+        }
+
+        source.deferrals += 1;
+        return mSessionIsActive;
+    }
+
+    /**
+     * Read some of the data from one fd into an EXTERNAL frame
+     *
+     * @param budget The most bytes to read
+     * @return True if the read was not short, so there may be more to read
+     */
+    bool transfer(const std::uint64_t monotonicStart,
+                  const int fd,
+                  SourceState & source,
+                  const int budget,
+                  const std::function<void()> & endSession)
     {
         // Wait until there is enough room for a header and two ints
-        waitFor(IRawFrameBuilder::MAX_FRAME_HEADER_SIZE + 2 * buffer_utils::MAXSIZE_PACK32, endSession);
+        const int required = IRawFrameBuilder::MAX_FRAME_HEADER_SIZE + 2 * buffer_utils::MAXSIZE_PACK32;
+        if (mBuffer.bytesAvailable() <= required) {
+            source.bufferWaits += 1;
+        }
+        waitFor(required, endSession);
+        GATOR_PROBE1(external_transfer_start, fd);
         mBuffer.beginFrame(FrameType::EXTERNAL);
         mBuffer.packInt(fd);
-        const int contiguous = mBuffer.contiguousSpaceAvailable();
+        const int contiguous = std::min(mBuffer.contiguousSpaceAvailable(), budget);
         const int bytes = read(fd, mBuffer.getWritePos(), contiguous);
         if (bytes <= 0) {
             mBuffer.abortFrame();
@@ -327,9 +447,14 @@ public:
             // Always force-flush the buffer as this frame don't work like others
             checkFlush(monotonicStart, true);
             close(fd);
+            source.closed = true;
             return false;
         }
 
+        source.bytes += bytes;
+        source.reads += 1;
+        GATOR_PROBE2(external_transfer_end, fd, bytes);
+
         mBuffer.advanceWrite(bytes);
         mBuffer.endFrame();
         checkFlush(monotonicStart, isBufferOverFull(mBuffer.contiguousSpaceAvailable()));
@@ -392,21 +517,36 @@ private:
     OlyServerSocket mMidgardStartupUds;
     OlyServerSocket mUtgardStartupUds;
     std::map<int, lib::AutoClosingFd> external_agent_connections {};
+    std::map<int, SourceState> mSources {};
     lib::AutoClosingFd mInterruptRead {};
     lib::AutoClosingFd mInterruptWrite {};
     int mMidgardUds;
     Drivers & mDrivers;
+    // set when the ftrace buffer is read for this capture
+    bool mFtraceRequired {false};
     std::atomic_bool mSessionIsActive {true};
 
     void checkFlush(std::uint64_t monotonicStart, bool force)
     {
         const auto delta = mGetMonotonicTime() - monotonicStart;
 
-        if (mCommitChecker(delta, force)) {
+        if (mCommitChecker(delta, force, mBuffer.bytesSinceFlush())) {
             mBuffer.flush();
         }
     }
 
+    static void logSourceStats(int fd, const SourceState & source)
+    {
+        LOG_DEBUG("External source %d (%s): %" PRIu64 " bytes in %" PRIu64 " reads, deferred %" PRIu64
+                  " times, waited for the buffer %" PRIu64 " times",
+                  fd,
+                  (source.kernel ? "kernel" : "user"),
+                  source.bytes,
+                  source.reads,
+                  source.deferrals,
+                  source.bufferWaits);
+    }
+
     static bool isBufferOverFull(int sizeAvailable)
     {
         // if less than a quarter left
@@ -15,6 +15,8 @@ class ExternalSource : public Source {
 public:
     /** Create a pipe and return the write end. The read end will consume bytes from the external source agent and add them into an APC frame */
     virtual lib::AutoClosingFd add_agent_pipe() = 0;
+
+    [[nodiscard]] bool isBulk() const override { return true; }
 };
 
 /// Counters from external sources like graphics drivers and annotations
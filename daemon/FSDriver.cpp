@@ -1,13 +1,15 @@
-/* Copyright (C) 2014-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2014-2022 by Arm Limited. All rights reserved. */
 
 #include "FSDriver.h"
 
+#include "DynBuf.h"
 #include "Logging.h"
-#include "lib/Utils.h"
 
-#include <fcntl.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
 #include <regex.h>
-#include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -28,6 +30,7 @@ public:
 
 private:
     char * const mPath;
+    DynBuf mBuf {};
     regex_t mReg;
     bool mUseRegex;
 };
@@ -56,29 +59,17 @@ FSCounter::~FSCounter()
 
 int64_t FSCounter::read()
 {
+    // the file is kept open between samples, as these may be polled at a high rate
+    if (!mBuf.reread(mPath)) {
+        LOG_ERROR("Unable to read %s", mPath);
+        handleException();
+    }
+
+    const char * const data = mBuf.getBuf();
     int64_t value;
     if (mUseRegex) {
-        char buf[4096];
-        size_t pos = 0;
-        const int fd = open(mPath, O_RDONLY | O_CLOEXEC);
-        if (fd < 0) {
-            goto fail;
-        }
-        while (pos < sizeof(buf) - 1) {
-            const ssize_t bytes = ::read(fd, buf + pos, sizeof(buf) - pos - 1);
-            if (bytes < 0) {
-                goto fail;
-            }
-            else if (bytes == 0) {
-                break;
-            }
-            pos += bytes;
-        }
-        close(fd);
-        buf[pos] = '\0';
-
         regmatch_t match[2];
-        int result = regexec(&mReg, buf, 2, match, 0);
+        int result = regexec(&mReg, data, 2, match, 0);
         if (result != 0) {
             // No match
             return 0;
@@ -89,7 +80,7 @@ int64_t FSCounter::read()
         }
         else {
             errno = 0;
-            value = strtoll(buf + match[1].rm_so, nullptr, 0);
+            value = strtoll(data + match[1].rm_so, nullptr, 0);
             if (errno != 0) {
                 LOG_ERROR("Parsing %s failed: %s", mPath, strerror(errno));
                 handleException();
@@ -97,15 +88,15 @@ int64_t FSCounter::read()
         }
     }
     else {
-        if (lib::readInt64FromFile(mPath, value) != 0) {
-            goto fail;
+        char * endptr;
+        errno = 0;
+        value = strtoll(data, &endptr, 0);
+        if (errno != 0 || (data == endptr) || (*endptr != '\n' && *endptr != '\0')) {
+            LOG_ERROR("Invalid value in file %s: %s", mPath, data);
+            handleException();
         }
     }
     return value;
-
-fail:
-    LOG_ERROR("Unable to read %s", mPath);
-    handleException();
 }
 
 FSDriver::FSDriver() : PolledDriver("FS")
@@ -1,4 +1,4 @@
-/* Copyright (C) 2014-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2014-2022 by Arm Limited. All rights reserved. */
 
 #ifndef FSDRIVER_H
 #define FSDRIVER_H
@@ -17,6 +17,9 @@ public:
     void readEvents(mxml_node_t * xml) override;
 
     int writeCounters(mxml_node_t * root) const override;
+
+    // the files are user specified, so may be arbitrarily slow to read
+    [[nodiscard]] bool isSlowToRead() const override { return true; }
 };
 
 #endif // FSDRIVER_H
@@ -0,0 +1,70 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#pragma once
+
+#include "BufferUtils.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace buffer_utils {
+    /** A field that is packed as per packInt */
+    struct PackedInt32 {
+        using value_type = int32_t;
+
+        static constexpr int MAX_SIZE = MAXSIZE_PACK32;
+
+        static int pack(char * buf, int & writePos, value_type x) { return packInt(buf, writePos, x); }
+    };
+
+    /** A field that is packed as per packInt64 */
+    struct PackedInt64 {
+        using value_type = int64_t;
+
+        static constexpr int MAX_SIZE = MAXSIZE_PACK64;
+
+        static int pack(char * buf, int & writePos, value_type x) { return packInt64(buf, writePos, x); }
+    };
+
+    /**
+     * Describes a sequence of packed fields whose number and types are fixed, so that the most space they can take
+     * is known at compile time. The space can then be checked (or reserved) once for the whole sequence, and the
+     * fields packed straight into contiguous memory, without a bounds check or a virtual call for each field.
+     */
+    template<typename... Fields>
+    struct FixedFrameLayout {
+        static constexpr int MAX_SIZE = (Fields::MAX_SIZE + ... + 0);
+
+        /**
+         * Packs the values into contiguous memory
+         *
+         * @param buf The start of the memory, which must have at least MAX_SIZE bytes from writePos
+         * @param writePos The position to pack the first value at, which is advanced past the last
+         * @return The number of bytes packed
+         */
+        static int pack(char * buf, int & writePos, typename Fields::value_type... values)
+        {
+            const int start = writePos;
+            (Fields::pack(buf, writePos, values), ...);
+            return writePos - start;
+        }
+
+        /**
+         * Packs the values and writes them to a frame builder with one call to its writeBytes
+         *
+         * The builder must have at least MAX_SIZE bytes available
+         *
+         * @return The number of bytes written
+         */
+        template<typename Builder>
+        static int write(Builder & builder, typename Fields::value_type... values)
+        {
+            std::array<char, MAX_SIZE> bytes;
+            int length = 0;
+            pack(bytes.data(), length, values...);
+            builder.writeBytes(bytes.data(), std::size_t(length));
+            return length;
+        }
+    };
+}
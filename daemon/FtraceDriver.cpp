@@ -17,6 +17,8 @@
 #include <atomic>
 #include <chrono>
 #include <csignal>
+#include <set>
+#include <string>
 #include <thread>
 
 #include <dirent.h>
@@ -76,7 +78,8 @@ namespace {
         FtraceCounter(DriverCounter * next,
                       const TraceFsConstants & traceFsConstants,
                       const char * name,
-                      const char * enable);
+                      const char * enable,
+                      const char * filter = nullptr);
         ~FtraceCounter() override;
 
         // Intentionally unimplemented
@@ -95,7 +98,11 @@ namespace {
     private:
         const TraceFsConstants & traceFsConstants;
         char * const mEnable;
+        /** The filter from the events XML, which may be empty */
+        std::string mFilter;
         int mWasEnabled;
+        /** Set when the filter file was written, so that it is cleared again on stop */
+        bool mSetFilter {false};
     };
 
     class CpuFrequencyFtraceCounter : public FtraceCounter {
@@ -132,10 +139,12 @@ namespace {
     FtraceCounter::FtraceCounter(DriverCounter * next,
                                  const TraceFsConstants & traceFsConstants,
                                  const char * name,
-                                 const char * enable)
+                                 const char * enable,
+                                 const char * filter)
         : DriverCounter(next, name),
           traceFsConstants(traceFsConstants),
           mEnable(enable == nullptr ? nullptr : strdup(enable)),
+          mFilter(filter == nullptr ? "" : filter),
           mWasEnabled(0)
     {
     }
@@ -150,16 +159,33 @@ namespace {
     void FtraceCounter::prepare()
     {
         if (mEnable == nullptr) {
+            // Without an enable attribute the counter can only match the trace_marker writes (ftrace/print), which are
+            // always recorded and whose format is always sent, so the raw pages decode just as well as the text would.
+            // Any other event that was enabled outside of gator is turned off by the raw collection however.
             if (gSessionData.mFtraceRaw) {
-                LOG_ERROR("The ftrace counter %s is not compatible with the more efficient ftrace collection as it is "
-                          "missing the enable attribute. Please either add the enable attribute to the counter in "
-                          "events XML or disable the counter in counter configuration.",
+                LOG_DEBUG("The ftrace counter %s has no enable attribute so will only match trace_marker writes",
                           getName());
-                handleException();
             }
             return;
         }
 
+        // the kernel drops the records that do not match the filter, or that are of another process when only the
+        // --pid processes' are wanted, before they are written to the ring buffer
+        const auto filter = makeTracepointFilter(mFilter.c_str(),
+                                                 (gSessionData.mFilterPidTracepoints ? gSessionData.mPids
+                                                                                     : std::set<int> {}));
+        if (!filter.empty()) {
+            lib::printf_str_t<tracefs_path_buffer_size> buf {"%s/%s/filter", traceFsConstants.path__events, mEnable};
+            if (lib::writeCStringToFile(buf, filter.c_str()) != 0) {
+                LOG_ERROR("Unable to set the filter '%s' of the ftrace counter %s in %s",
+                          filter.c_str(),
+                          getName(),
+                          buf.c_str());
+                handleException();
+            }
+            mSetFilter = true;
+        }
+
         lib::printf_str_t<tracefs_path_buffer_size> buf {"%s/%s/enable", traceFsConstants.path__events, mEnable};
         if ((lib::readIntFromFile(buf, mWasEnabled) != 0) || (lib::writeIntToFile(buf, 1) != 0)) {
             LOG_ERROR("Unable to read or write to %s", buf.c_str());
@@ -175,6 +201,15 @@ namespace {
 
         lib::printf_str_t<tracefs_path_buffer_size> buf {"%s/%s/enable", traceFsConstants.path__events, mEnable};
         lib::writeIntToFile(buf, mWasEnabled);
+
+        // writing 0 clears the filter
+        if (mSetFilter) {
+            lib::printf_str_t<tracefs_path_buffer_size> filterBuf {"%s/%s/filter",
+                                                                   traceFsConstants.path__events,
+                                                                   mEnable};
+            lib::writeCStringToFile(filterBuf, "0");
+            mSetFilter = false;
+        }
     }
 
     bool FtraceCounter::readTracepointFormat(IPerfAttrsConsumer & attrsConsumer)
@@ -478,6 +513,7 @@ void FtraceDriver::readEvents(mxml_node_t * const xml)
 
         const char * regex = mxmlElementGetAttr(node, "regex");
         const char * tracepoint = mxmlElementGetAttr(node, "tracepoint");
+        const char * filter = mxmlElementGetAttr(node, "filter");
         const char * enable = mxmlElementGetAttr(node, "enable");
         if (enable == nullptr) {
             enable = tracepoint;
@@ -516,7 +552,7 @@ void FtraceDriver::readEvents(mxml_node_t * const xml)
             }
         }
         else {
-            setCounters(new FtraceCounter(getCounters(), traceFsConstants, counter, enable));
+            setCounters(new FtraceCounter(getCounters(), traceFsConstants, counter, enable, filter));
         }
     }
 }
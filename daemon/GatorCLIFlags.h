@@ -1,4 +1,4 @@
-/* Copyright (C) 2010-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2010-2022 by Arm Limited. All rights reserved. */
 
 #ifndef GATORCLIFLAGS_H_
 #define GATORCLIFLAGS_H_
@@ -12,6 +12,7 @@ enum {
     USE_CMDLINE_ARG_DURATION = 0x20,
     USE_CMDLINE_ARG_FTRACE_RAW = 0x40,
     USE_CMDLINE_ARG_EXCLUDE_KERNEL = 0x80,
+    USE_CMDLINE_ARG_CGROUP = 0x100,
 };
 
 #endif /* GATORCLIFLAGS_H_ */
@@ -8,6 +8,8 @@
 #include "lib/Utils.h"
 
 #include <algorithm>
+#include <cerrno>
+#include <cstdlib>
 #include <sstream>
 
 namespace {
@@ -20,7 +22,7 @@ namespace {
     constexpr int GATOR_MAX_VALUE_PORT = 65535;
 }
 
-static const char OPTSTRING_SHORT[] = "ac:d::e:f:hi:k:l:m:o:p:r:s:t:u:vw:x:A:C:DE:F:N:O:P:Q:R:S:TVX:Z:";
+static const char OPTSTRING_SHORT[] = "ac:d::e:f:hi:k:l:m:o:p:r:s:t:u:vw:x:y:A:C:DE:F:G:M:N:O:P:Q:R:S:TVX:Z:";
 
 static const struct option OPTSTRING_LONG[] = { // PLEASE KEEP THIS LIST IN ALPHANUMERIC ORDER TO ALLOW EASY SELECTION
                                                 // OF NEW ITEMS.
@@ -43,11 +45,14 @@ static const struct option OPTSTRING_LONG[] = { // PLEASE KEEP THIS LIST IN ALPH
     {"version", /****************/ required_argument, nullptr, 'v'}, //
     {"app-cwd", /****************/ required_argument, nullptr, 'w'}, //
     {"stop-on-exit", /***********/ required_argument, nullptr, 'x'}, //
+    {"replay", /*****************/ required_argument, nullptr, 'y'}, //
     APP,                                                             //
     {"counters", /***************/ required_argument, nullptr, 'C'}, //
     {"disable-kernel-annotations", no_argument, /***/ nullptr, 'D'}, //
     {"append-events-xml", /******/ required_argument, nullptr, 'E'}, //
     {"spe-sample-rate", /********/ required_argument, nullptr, 'F'}, //
+    {"cgroup", /*****************/ required_argument, nullptr, 'G'}, //
+    {"pmu-multiplex", /**********/ required_argument, nullptr, 'M'}, //
     /********************************************************* 'N' ***/
     {"disable-cpu-onlining", /***/ required_argument, nullptr, 'O'}, //
     {"pmus-xml", /***************/ required_argument, nullptr, 'P'}, //
@@ -74,6 +79,17 @@ static const char SPE_KEY_VALUE_DELIMITER = '=';
 static const char * SPE_MIN_LATENCY_KEY = "min_latency";
 static const char * SPE_EVENTS_KEY = "events";
 static const char * SPE_OPS_KEY = "ops";
+static const char * SPE_RECORD_MIN_LATENCY_KEY = "record_min_latency";
+static const char * SPE_RECORD_EVENTS_KEY = "record_events";
+static const char * SPE_RECORD_OPS_KEY = "record_ops";
+static const char * SPE_RECORD_PC_KEY = "record_pc";
+static const char * SPE_RECORD_DECIMATION_KEY = "record_decimation";
+static const char * SPE_HEATMAP_KEY = "heatmap";
+static const char * SPE_HEATMAP_TOP_KEY = "heatmap_top";
+static const char * SPE_HEATMAP_WINDOW_KEY = "heatmap_window";
+static const char * SPE_HEATMAP_RAW_KEY = "heatmap_raw";
+static constexpr int SPE_HEATMAP_MAX_TOP_ENTRIES = 4096;
+static const char SPE_RANGE_DELIMITER = '-';
 
 SampleRate getSampleRate(const std::string & value)
 {
@@ -205,6 +221,86 @@ static void split(const std::string & data, char delimiter, std::vector<std::str
     }
 }
 
+/**
+ * Parse a comma separated list of SPE event bit positions into a mask
+ */
+static bool parseSpeEvents(const std::string & value, uint64_t & mask)
+{
+    std::vector<std::string> spe_events;
+    split(value, SPES_KEY_VALUE_DELIMITER, spe_events);
+    for (const std::string & spe_event : spe_events) {
+        int event;
+        if (!stringToInt(&event, spe_event.c_str(), DECIMAL_BASE)) {
+            LOG_ERROR("Event filter cannot be a non integer , failed for %s ", spe_event.c_str());
+            return false;
+        }
+        if ((event < 0 || event > MAX_EVENT_BIT_POSITION)) {
+            LOG_ERROR("Event filter should be a bit position from 0 - 63 , failed for %d ", event);
+            return false;
+        }
+        mask |= (uint64_t(1) << event);
+    }
+    return true;
+}
+
+/**
+ * Parse a comma separated list of SPE operation types
+ */
+static bool parseSpeOps(const std::string & value, std::set<SpeOps> & ops)
+{
+    std::vector<std::string> spe_ops;
+    split(value, SPES_KEY_VALUE_DELIMITER, spe_ops);
+    if (!spe_ops.empty()) {
+        ops.clear();
+        //convert to enum
+        for (const auto & spe_ops_it : spe_ops) {
+            if (strcasecmp(spe_ops_it.c_str(), LOAD_OPS) == 0) {
+                ops.insert(SpeOps::LOAD);
+            }
+            else if (strcasecmp(spe_ops_it.c_str(), STORE_OPS) == 0) {
+                ops.insert(SpeOps::STORE);
+            }
+            else if (strcasecmp(spe_ops_it.c_str(), BRANCH_OPS) == 0) {
+                ops.insert(SpeOps::BRANCH);
+            }
+            else {
+                LOG_ERROR("Not a valid Ops %s", spe_ops_it.c_str());
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static bool parseSpeAddress(const std::string & value, uint64_t & address)
+{
+    char * end = nullptr;
+    errno = 0;
+    address = strtoull(value.c_str(), &end, 0);
+    return (!value.empty()) && (errno == 0) && (*end == '\0');
+}
+
+/**
+ * Parse a comma separated list of SPE address ranges, each of the form <start>-<end>
+ */
+static bool parseSpeAddressRanges(const std::string & value, std::vector<SpeAddressRange> & ranges)
+{
+    std::vector<std::string> spe_ranges;
+    split(value, SPES_KEY_VALUE_DELIMITER, spe_ranges);
+    for (const std::string & spe_range : spe_ranges) {
+        std::vector<std::string> bounds;
+        split(spe_range, SPE_RANGE_DELIMITER, bounds);
+        SpeAddressRange range {};
+        if ((bounds.size() != 2) || !parseSpeAddress(bounds[0], range.start) || !parseSpeAddress(bounds[1], range.end)
+            || (range.start > range.end)) {
+            LOG_ERROR("Address range must be <start>-<end> , failed for %s ", spe_range.c_str());
+            return false;
+        }
+        ranges.push_back(range);
+    }
+    return true;
+}
+
 void GatorCLIParser::parseAndUpdateSpe()
 {
     std::vector<std::string> spe_data;
@@ -232,49 +328,98 @@ void GatorCLIParser::parseAndUpdateSpe()
                         }
                     }
                     else if (spe[0] == SPE_EVENTS_KEY) {
-                        std::vector<std::string> spe_events;
-                        split(spe[1], SPES_KEY_VALUE_DELIMITER, spe_events);
-                        for (const std::string & spe_event : spe_events) {
-                            int event;
-                            if (!stringToInt(&event, spe_event.c_str(), DECIMAL_BASE)) {
-                                LOG_ERROR("Event filter cannot be a non integer , failed for %s ", spe_event.c_str());
-                                result.parsingFailed();
-                                return;
-                            }
-                            if ((event < 0 || event > MAX_EVENT_BIT_POSITION)) {
-                                LOG_ERROR("Event filter should be a bit position from 0 - 63 , failed for %d ", event);
-                                result.parsingFailed();
-                                return;
-                            }
-                            //FIXME
-                            //NOLINTNEXTLINE(hicpp-signed-bitwise)
-                            data.event_filter_mask = data.event_filter_mask | 1 << event;
+                        if (!parseSpeEvents(spe[1], data.event_filter_mask)) {
+                            result.parsingFailed();
+                            return;
                         }
                     }
                     else if (spe[0] == SPE_OPS_KEY) {
-                        std::vector<std::string> spe_ops;
-                        split(spe[1], SPES_KEY_VALUE_DELIMITER, spe_ops);
-                        if (!spe_ops.empty()) {
-                            data.ops.clear();
-                            //convert to enum
-                            for (const auto & spe_ops_it : spe_ops) {
-                                if (strcasecmp(spe_ops_it.c_str(), LOAD_OPS) == 0) {
-                                    data.ops.insert(SpeOps::LOAD);
-                                }
-                                else if (strcasecmp(spe_ops_it.c_str(), STORE_OPS) == 0) {
-                                    data.ops.insert(SpeOps::STORE);
-                                }
-                                else if (strcasecmp(spe_ops_it.c_str(), BRANCH_OPS) == 0) {
-                                    data.ops.insert(SpeOps::BRANCH);
-                                }
-                                else {
-                                    LOG_ERROR("Not a valid Ops %s", spe_ops_it.c_str());
-                                    result.parsingFailed();
-                                    return;
-                                }
-                            }
+                        if (!parseSpeOps(spe[1], data.ops)) {
+                            result.parsingFailed();
+                            return;
+                        }
+                    }
+                    else if (spe[0] == SPE_RECORD_MIN_LATENCY_KEY) {
+                        if (!stringToInt(&(data.record_filter.min_latency), spe[1].c_str(), DECIMAL_BASE)
+                            || (data.record_filter.min_latency < 0)) {
+                            LOG_ERROR("Invalid record minimum latency for %s (%s)", data.id.c_str(), spe[1].c_str());
+                            result.parsingFailed();
+                            return;
+                        }
+                    }
+                    else if (spe[0] == SPE_RECORD_EVENTS_KEY) {
+                        if (!parseSpeEvents(spe[1], data.record_filter.event_mask)) {
+                            result.parsingFailed();
+                            return;
+                        }
+                    }
+                    else if (spe[0] == SPE_RECORD_OPS_KEY) {
+                        if (!parseSpeOps(spe[1], data.record_filter.ops)) {
+                            result.parsingFailed();
+                            return;
                         }
                     }
+                    else if (spe[0] == SPE_RECORD_PC_KEY) {
+                        if (!parseSpeAddressRanges(spe[1], data.record_filter.pc_ranges)) {
+                            result.parsingFailed();
+                            return;
+                        }
+                    }
+                    else if (spe[0] == SPE_RECORD_DECIMATION_KEY) {
+                        int decimation;
+                        if (!stringToInt(&decimation, spe[1].c_str(), DECIMAL_BASE) || (decimation < 1)) {
+                            LOG_ERROR("Invalid record decimation for %s (%s)", data.id.c_str(), spe[1].c_str());
+                            result.parsingFailed();
+                            return;
+                        }
+                        data.record_filter.decimation = decimation;
+                    }
+                    else if (spe[0] == SPE_HEATMAP_KEY) {
+                        int granularity;
+                        if (spe[1] == "line") {
+                            granularity = 64;
+                        }
+                        else if (spe[1] == "page") {
+                            granularity = 4096;
+                        }
+                        else if (!stringToInt(&granularity, spe[1].c_str(), DECIMAL_BASE) || (granularity < 1)
+                                 || ((granularity & (granularity - 1)) != 0)) {
+                            LOG_ERROR("Invalid heatmap granularity for %s (%s), line, page or a power of two expected",
+                                      data.id.c_str(),
+                                      spe[1].c_str());
+                            result.parsingFailed();
+                            return;
+                        }
+                        data.record_filter.heatmap.granularity = granularity;
+                    }
+                    else if (spe[0] == SPE_HEATMAP_TOP_KEY) {
+                        int top;
+                        if (!stringToInt(&top, spe[1].c_str(), DECIMAL_BASE) || (top < 1)
+                            || (top > SPE_HEATMAP_MAX_TOP_ENTRIES)) {
+                            LOG_ERROR("Invalid heatmap top entries for %s (%s)", data.id.c_str(), spe[1].c_str());
+                            result.parsingFailed();
+                            return;
+                        }
+                        data.record_filter.heatmap.top_entries = top;
+                    }
+                    else if (spe[0] == SPE_HEATMAP_WINDOW_KEY) {
+                        int window;
+                        if (!stringToInt(&window, spe[1].c_str(), DECIMAL_BASE) || (window < 1)) {
+                            LOG_ERROR("Invalid heatmap window for %s (%s)", data.id.c_str(), spe[1].c_str());
+                            result.parsingFailed();
+                            return;
+                        }
+                        data.record_filter.heatmap.window_ms = window;
+                    }
+                    else if (spe[0] == SPE_HEATMAP_RAW_KEY) {
+                        int raw;
+                        if (!stringToInt(&raw, spe[1].c_str(), DECIMAL_BASE) || (raw < 0)) {
+                            LOG_ERROR("Invalid heatmap raw interval for %s (%s)", data.id.c_str(), spe[1].c_str());
+                            result.parsingFailed();
+                            return;
+                        }
+                        data.record_filter.heatmap.raw_interval = raw;
+                    }
                     else { // invalid key
                         LOG_ERROR("--spe arguments not in correct format %s ", spe_data_it.c_str());
                         result.parsingFailed();
@@ -444,6 +589,10 @@ void GatorCLIParser::parseCLIArguments(int argc,
                 }
                 result.mStopGator = optionInt == 1;
                 break;
+            case 'y': //replay a local capture
+                result.mReplayApcDir = optarg;
+                result.mode = ExecutionMode::REPLAY;
+                break;
             case 'C': //counter
             {
                 int startpos = -1;
@@ -572,6 +721,20 @@ void GatorCLIParser::parseCLIArguments(int argc,
                     "                                        Values below this threshold are ignored\n"
                     "                                        and the hardware minimum is used\n"
                     "                                        instead.\n"
+                    "  -M|--pmu-multiplex <ms>               Allow more CPU PMU events to be selected\n"
+                    "                                        than there are hardware counters, by\n"
+                    "                                        splitting them into groups that each fit\n"
+                    "                                        the PMU and rotating the groups every\n"
+                    "                                        <ms> milliseconds. Only applies to\n"
+                    "                                        system-wide captures (defaults to '0',\n"
+                    "                                        disabled).\n"
+                    "  -G|--cgroup <path>                    Restrict the CPU events of a system-wide\n"
+                    "                                        capture to the tasks in a perf_event\n"
+                    "                                        cgroup, such as those of a container.\n"
+                    "                                        <path> is either the absolute path to\n"
+                    "                                        the cgroup directory, or its path\n"
+                    "                                        relative to the cgroup mount point.\n"
+                    "                                        Implies '--system-wide yes'.\n"
                     "\n"
                     "* Arguments available only on Android targets:\n"
                     "\n"
@@ -601,6 +764,11 @@ void GatorCLIParser::parseCLIArguments(int argc,
                     "                                        in Streamline.\n"
                     "  -a|--allow-command                    Allow the user to issue a command from\n"
                     "                                        Streamline\n"
+                    "  -y|--replay <apc_dir>                 Instead of capturing, serve the local\n"
+                    "                                        capture in <apc_dir> to Streamline as\n"
+                    "                                        though it were being captured live, on\n"
+                    "                                        the port given by --port. Compressed\n"
+                    "                                        captures cannot be replayed.\n"
                     "\n"
                     "* Arguments available to local capture mode only:\n"
                     "\n"
@@ -622,6 +790,11 @@ void GatorCLIParser::parseCLIArguments(int argc,
                     "                                        enable. This option may be specified\n"
                     "                                        multiple times.\n"
                     "  -X|--spe <id>[:events=<indexes>][:ops=<types>][:min_latency=<lat>]\n"
+                    "              [:record_events=<indexes>][:record_ops=<types>]\n"
+                    "              [:record_min_latency=<lat>][:record_pc=<ranges>]\n"
+                    "              [:record_decimation=<n>][:heatmap=<size>]\n"
+                    "              [:heatmap_top=<k>][:heatmap_window=<ms>]\n"
+                    "              [:heatmap_raw=<n>]\n"
                     "                                        Enable Statistical Profiling Extension\n"
                     "                                        (SPE). Where:\n"
                     "                                        * <id> is the name of the SPE properties\n"
@@ -643,6 +816,29 @@ void GatorCLIParser::parseCLIArguments(int argc,
                     "                                          will only be recorded if its latency \n"
                     "                                          is greater than or equal to this \n"
                     "                                          value. The valid range is [0,4096).\n"
+                    "                                        * The record_ options filter the SPE\n"
+                    "                                          records in gatord before they are\n"
+                    "                                          sent, reducing the amount of data\n"
+                    "                                          transferred. A record is sent if it\n"
+                    "                                          has any of the events in\n"
+                    "                                          record_events, is any of the types in\n"
+                    "                                          record_ops, has at least\n"
+                    "                                          record_min_latency (which is not\n"
+                    "                                          limited to 4096), and its pc is in any\n"
+                    "                                          of the comma separated <start>-<end>\n"
+                    "                                          record_pc ranges. Only 1 in every <n>\n"
+                    "                                          of the matching records is sent.\n"
+                    "                                        * The heatmap options aggregate the\n"
+                    "                                          matching records in gatord instead of\n"
+                    "                                          sending them. Their data addresses\n"
+                    "                                          are counted by blocks of <size>\n"
+                    "                                          bytes (line, page or a power of two),\n"
+                    "                                          data source, latency and pc page, and\n"
+                    "                                          the <k> (default 256) most frequent\n"
+                    "                                          are sent every <ms> (default 100)\n"
+                    "                                          milliseconds, with the latencies of\n"
+                    "                                          each data source. 1 in every <n> of\n"
+                    "                                          the records is also sent.\n"
                     /*                                                                              ^ */
                     /*                                                                              | */
                     /* ------------------------------------ last character before new line here ----+ */
@@ -722,6 +918,25 @@ void GatorCLIParser::parseCLIArguments(int argc,
                 }
                 break;
             }
+            case 'M': {
+                result.mPmuMultiplexQuantumMs = 0;
+                if (!stringToInt(&result.mPmuMultiplexQuantumMs, optarg, 0)) {
+                    LOG_ERROR("Invalid value for --pmu-multiplex (%s): not an integer", optarg);
+                    result.parsingFailed();
+                    result.mPmuMultiplexQuantumMs = 0;
+                }
+                else if ((result.mPmuMultiplexQuantumMs < 0) || (result.mPmuMultiplexQuantumMs > 10000)) {
+                    LOG_ERROR("Invalid value for --pmu-multiplex (%s): must be between 0 and 10000", optarg);
+                    result.parsingFailed();
+                    result.mPmuMultiplexQuantumMs = 0;
+                }
+                break;
+            }
+            case 'G': {
+                result.mCgroup = optarg;
+                result.parameterSetFlag = result.parameterSetFlag | USE_CMDLINE_ARG_CGROUP;
+                break;
+            }
             case 'k': {
                 if (optionInt < 0) {
                     LOG_ERROR("Invalid value for --exclude-kernel (%s), 'yes' or 'no' expected.", optarg);
@@ -764,7 +979,20 @@ void GatorCLIParser::parseCLIArguments(int argc,
             USE_CMDLINE_ARG_STOP_GATOR; // must be set, otherwise session.xml will override during live mode (which leads to counter-intuitive behaviour)
     }
 
-    if (!systemWideSet) {
+    if (!result.mCgroup.empty()) {
+        if (haveProcess) {
+            LOG_ERROR("--cgroup cannot be combined with --app, --pid, --wait-process or --android-pkg.");
+            result.parsingFailed();
+            return;
+        }
+        if (systemWideSet && !result.mSystemWide) {
+            LOG_ERROR("--cgroup requires system-wide mode.");
+            result.parsingFailed();
+            return;
+        }
+        result.mSystemWide = true;
+    }
+    else if (!systemWideSet) {
 #if CONFIG_PREFER_SYSTEM_WIDE_MODE
         // default to system-wide mode unless a process option was specified
         result.mSystemWide = !haveProcess;
@@ -783,6 +1011,11 @@ void GatorCLIParser::parseCLIArguments(int argc,
     }
 
     if (result.mode == ExecutionMode::LOCAL_CAPTURE) {
+        if (result.mReplayApcDir != nullptr) {
+            LOG_ERROR("--replay is not applicable in local capture mode.");
+            result.parsingFailed();
+            return;
+        }
         if (result.mAllowCommands) {
             LOG_ERROR("--allow-command is not applicable in local capture mode.");
             result.parsingFailed();
@@ -805,6 +1038,13 @@ void GatorCLIParser::parseCLIArguments(int argc,
             LOG_WARNING("No counters (--counters) specified, default counters will be used");
         }
     }
+    else if (result.mode == ExecutionMode::REPLAY) {
+        if (result.mSessionXMLPath != nullptr) {
+            LOG_ERROR("--session-xml is not applicable when replaying a capture.");
+            result.parsingFailed();
+            return;
+        }
+    }
     else if (result.mode == ExecutionMode::DAEMON) {
         if (!result.mSystemWide && !result.mAllowCommands && !haveProcess) {
             LOG_ERROR("In daemon mode, without --system-wide=yes, a process to profile must be specified with "
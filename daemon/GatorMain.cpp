@@ -15,7 +15,9 @@
 #include "android/Spawn.h"
 #include "android/Utils.h"
 #include "capture/CaptureProcess.h"
+#include "capture/CaptureReplay.h"
 #include "capture/Environment.h"
+#include "lib/ArchTimestamp.h"
 #include "lib/FileDescriptor.h"
 #include "lib/Popen.h"
 #include "lib/Process.h"
@@ -108,6 +110,7 @@ void updateSessionData(const ParserResult & result)
     gSessionData.mExcludeKernelEvents = result.mExcludeKernelEvents;
     gSessionData.mWaitForProcessCommand = result.mWaitForCommand;
     gSessionData.mPids = result.mPids;
+    gSessionData.mCgroup = result.mCgroup;
 
     if (result.mTargetPath != nullptr) {
         if (gSessionData.mTargetPath != nullptr) {
@@ -121,6 +124,7 @@ void updateSessionData(const ParserResult & result)
     gSessionData.mStopOnExit = result.mStopGator;
     gSessionData.mPerfMmapSizeInPages = result.mPerfMmapSizeInPages;
     gSessionData.mSpeSampleRate = result.mSpeSampleRate;
+    gSessionData.mPmuMultiplexQuantumMs = result.mPmuMultiplexQuantumMs;
     gSessionData.mAndroidPackage = result.mAndroidPackage;
     gSessionData.mAndroidActivity = result.mAndroidActivity;
 
@@ -190,6 +194,12 @@ int start_capture_process(const ParserResult & result,
                      result.mDisableKernelAnnotations,
                      TraceFsConstants::detect()};
 
+    // the per-thread fallback can only profile the launched or attached processes (with the agents run as the
+    // android package's user, if one is set)
+    if (drivers.getPrimarySourceProvider().isRestrictedToProcesses()) {
+        gSessionData.mSystemWide = false;
+    }
+
     // Handle child exit codes
     signal(SIGCHLD, handler);
 
@@ -266,6 +276,11 @@ int gator_main(int argc, char ** argv)
     // and enable debug mode
     global_logging->set_debug_enabled(GatorCLIParser::hasDebugFlag(argc, argv));
 
+    // before any other thread reads the time
+    if (lib::enableArchTimestamps()) {
+        LOG_DEBUG("Reading timestamps from the arch timer");
+    }
+
     gSessionData.initialize();
     //setting default values of gSessionData
     setDefaults();
@@ -282,6 +297,7 @@ int gator_main(int argc, char ** argv)
     signal(SIGABRT, handler);
     signal(SIGHUP, handler);
     signal(SIGUSR1, handler);
+    signal(SIGUSR2, handler);
     gator::process::set_parent_death_signal(SIGKILL);
 
     prctl(PR_SET_NAME, reinterpret_cast<unsigned long>(&"gatord-main"), 0, 0, 0);
@@ -312,6 +328,11 @@ int gator_main(int argc, char ** argv)
 
     updateSessionData(result);
 
+    // nothing is captured, so the environment is left as it is
+    if (result.mode == ParserResult::ExecutionMode::REPLAY) {
+        return capture::replayCapture(result.mReplayApcDir, result.port, signalPipe[0]);
+    }
+
     // configure any environment settings we'll need to start sampling
     // e.g. perf security settings.
     auto environment = capture::prepareCaptureEnvironment();
@@ -1,4 +1,4 @@
-/* Copyright (C) 2013-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2013-2022 by Arm Limited. All rights reserved. */
 
 #ifndef HWMONDRIVER_H
 #define HWMONDRIVER_H
@@ -21,6 +21,10 @@ public:
     void writeEvents(mxml_node_t * root) const override;
 
     void start() override;
+
+    // power rails are sampled quickly, but libsensors may be reading from a slow bus
+    [[nodiscard]] std::chrono::nanoseconds getPollPeriod() const override { return getHighRatePollPeriod(); }
+    [[nodiscard]] bool isSlowToRead() const override { return true; }
 };
 
 #endif // HWMONDRIVER_H
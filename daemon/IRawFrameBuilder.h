@@ -60,6 +60,11 @@ public:
      */
     [[nodiscard]] virtual int bytesAvailable() const = 0;
 
+    /**
+     * Gets the number of bytes written to the backing buffer since it was last flushed
+     */
+    [[nodiscard]] virtual int bytesSinceFlush() const = 0;
+
     /**
      * Packs a 32 bit number
      *
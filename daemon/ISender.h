@@ -1,4 +1,4 @@
-/* Copyright (C) 2010-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2010-2022 by Arm Limited. All rights reserved. */
 
 #ifndef __ISENDER_H__
 #define __ISENDER_H__
@@ -15,6 +15,8 @@ enum class ResponseType : char {
     ACK = 4,
     NAK = 5,
     CURRENT_CONFIG = 6,
+    /// APC_DATA preceded by a 64 bit sequence number, for when the data is striped over several connections
+    APC_DATA_SEQUENCED = 7,
     ERROR = '\xFF'
 };
 
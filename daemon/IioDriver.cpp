@@ -0,0 +1,524 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "IioDriver.h"
+
+#include "Logging.h"
+#include "lib/DirectoryFd.h"
+#include "lib/String.h"
+#include "lib/Syscall.h"
+#include "lib/Utils.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <optional>
+#include <string_view>
+#include <utility>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+    constexpr const char IIO_DEVICES[] = "/sys/bus/iio/devices";
+    constexpr const char SCAN_ELEMENTS[] = "scan_elements";
+    /** Ignore gaps between timestamps longer than this, such as if the device stopped, when integrating energy */
+    constexpr double MAX_SAMPLE_GAP_NS = 1e9;
+    /** Values are reported in micro units, that is uW, uA and uV, and energy in uJ */
+    constexpr double MICRO_PER_MILLI = 1000;
+    /** mW * ns = 1e-12 J = 1e-6 uJ */
+    constexpr double MICROJOULES_PER_MILLIWATT_NS = 1e-6;
+
+    using path_str_t = lib::printf_str_t<256>;
+
+    class IioCounter : public DriverCounter {
+    public:
+        IioCounter(DriverCounter * next,
+                   const char * name,
+                   std::string title,
+                   std::string label,
+                   const char * unit,
+                   bool delta,
+                   const int64_t * value)
+            : DriverCounter(next, name),
+              mTitle(std::move(title)),
+              mLabel(std::move(label)),
+              mUnit(unit),
+              mValue(value),
+              mDelta(delta)
+        {
+        }
+
+        // Intentionally unimplemented
+        IioCounter(const IioCounter &) = delete;
+        IioCounter & operator=(const IioCounter &) = delete;
+        IioCounter(IioCounter &&) = delete;
+        IioCounter & operator=(IioCounter &&) = delete;
+
+        [[nodiscard]] const char * getTitle() const { return mTitle.c_str(); }
+        [[nodiscard]] const char * getLabel() const { return mLabel.c_str(); }
+        [[nodiscard]] const char * getUnit() const { return mUnit; }
+        [[nodiscard]] bool isDelta() const { return mDelta; }
+
+        int64_t read() override { return *mValue; }
+
+    private:
+        const std::string mTitle;
+        const std::string mLabel;
+        const char * const mUnit;
+        const int64_t * const mValue;
+        const bool mDelta;
+    };
+
+    /** @return The contents of a sysfs file, without the trailing newline */
+    std::optional<std::string> readAttribute(const lib::DirectoryFd & dir, const char * name)
+    {
+        std::vector<char> buffer;
+        const auto contents = dir.readFile(name, buffer);
+        if (!contents) {
+            return {};
+        }
+        std::string_view value = *contents;
+        while (!value.empty() && ((value.back() == '\n') || (value.back() == ' '))) {
+            value.remove_suffix(1);
+        }
+        return std::string {value};
+    }
+
+    /**
+     * Read <name>_<attribute>, or the shared attribute of the channel type (the name without its number) if the
+     * channel has no attribute of its own
+     */
+    double readChannelAttribute(const lib::DirectoryFd & dir,
+                                const std::string & name,
+                                const char * attribute,
+                                double defaultValue)
+    {
+        std::string shared = name;
+        while (!shared.empty() && (std::isdigit(static_cast<unsigned char>(shared.back())) != 0)) {
+            shared.pop_back();
+        }
+
+        for (const auto & prefix : {name, shared}) {
+            lib::printf_str_t<128> file {"%s_%s", prefix.c_str(), attribute};
+            const auto value = readAttribute(dir, file);
+            if (value && !value->empty()) {
+                char * end = nullptr;
+                const double result = std::strtod(value->c_str(), &end);
+                if (end != value->c_str()) {
+                    return result;
+                }
+            }
+        }
+
+        return defaultValue;
+    }
+
+    /** @return The type of an input channel, such as "power" for in_power0, or nullptr if it is not read */
+    const char * parseKind(std::string_view name)
+    {
+        constexpr std::string_view prefix {"in_"};
+        if (name.substr(0, prefix.size()) != prefix) {
+            return nullptr;
+        }
+        name.remove_prefix(prefix.size());
+        for (const char * kind : {"power", "current", "voltage", "timestamp"}) {
+            if (name.substr(0, std::strlen(kind)) == kind) {
+                return kind;
+            }
+        }
+        return nullptr;
+    }
+
+    /** Make a counter name from the device and channel, replacing the characters that are not valid in one */
+    std::string makeName(const std::string & id, const std::string & channel, const char * suffix)
+    {
+        std::string name {"iio_"};
+        for (const char c : id + '_' + channel + '_' + suffix) {
+            name += (std::isalnum(static_cast<unsigned char>(c)) != 0 ? c : '_');
+        }
+        return name;
+    }
+}
+
+void IioDriver::readEvents(mxml_node_t * const /*unused*/)
+{
+    const auto devices = lib::DirectoryFd::open(IIO_DEVICES);
+    if (!devices) {
+        return;
+    }
+
+    std::vector<std::string> ids;
+    devices.forEachChild([&](const lib::DirectoryFd::Entry & entry) {
+        if (std::strncmp(entry.name, "iio:device", std::strlen("iio:device")) == 0) {
+            ids.emplace_back(entry.name);
+        }
+    });
+    std::sort(ids.begin(), ids.end());
+
+    for (const auto & id : ids) {
+        readDevice(id.c_str());
+    }
+}
+
+void IioDriver::readDevice(const char * id)
+{
+    const path_str_t path {"%s/%s", IIO_DEVICES, id};
+    const auto dir = lib::DirectoryFd::open(path);
+    const auto scanElements = dir.openDirectory(SCAN_ELEMENTS);
+    // devices without scan_elements do not support buffered mode
+    if (!scanElements) {
+        return;
+    }
+
+    auto device = std::make_unique<Device>();
+    device->id = id;
+    device->name = readAttribute(dir, "name").value_or(id);
+
+    const auto frequency = readAttribute(dir, "sampling_frequency");
+    const double hz = (frequency ? std::strtod(frequency->c_str(), nullptr) : 0);
+    device->samplePeriodNs = (hz > 0 ? 1e9 / hz : 0);
+
+    std::vector<std::string> names;
+    scanElements.forEachChild([&](const lib::DirectoryFd::Entry & entry) {
+        const std::string_view name {entry.name};
+        constexpr std::string_view suffix {"_en"};
+        if ((name.size() > suffix.size()) && (name.substr(name.size() - suffix.size()) == suffix)) {
+            names.emplace_back(name.substr(0, name.size() - suffix.size()));
+        }
+    });
+
+    bool hasTimestamp = false;
+    for (const auto & name : names) {
+        const char * const kind = parseKind(name);
+        if (kind == nullptr) {
+            continue;
+        }
+
+        lib::printf_str_t<128> file {"%s_type", name.c_str()};
+        const auto type = readAttribute(scanElements, file);
+        file.printf("%s_index", name.c_str());
+        const auto index = readAttribute(scanElements, file);
+        if (!type || !index) {
+            continue;
+        }
+
+        // such as "le:s12/16>>4"; repeated elements ("le:s12/16X2>>4") are not supported
+        char endianness = 0;
+        char sign = 0;
+        unsigned bits = 0;
+        unsigned storageBits = 0;
+        unsigned shift = 0;
+        if ((std::sscanf(type->c_str(), "%ce:%c%u/%u>>%u", &endianness, &sign, &bits, &storageBits, &shift) != 5)
+            || ((storageBits != 8) && (storageBits != 16) && (storageBits != 32) && (storageBits != 64))
+            || (bits == 0) || (bits > storageBits)) {
+            LOG_DEBUG("Unsupported IIO channel type '%s' for %s/%s", type->c_str(), id, name.c_str());
+            continue;
+        }
+
+        Channel channel {};
+        channel.name = name;
+        channel.kind = (std::strcmp(kind, "power") == 0     ? Kind::POWER
+                        : std::strcmp(kind, "current") == 0 ? Kind::CURRENT
+                        : std::strcmp(kind, "voltage") == 0 ? Kind::VOLTAGE
+                                                            : Kind::TIMESTAMP);
+        channel.index = std::strtoul(index->c_str(), nullptr, 10);
+        channel.bits = bits;
+        channel.storageBytes = storageBits / 8;
+        channel.shift = shift;
+        channel.isSigned = (sign == 's');
+        channel.isBigEndian = (endianness == 'b');
+        channel.scale = readChannelAttribute(dir, name, "scale", 1.0);
+        channel.offset = readChannelAttribute(dir, name, "offset", 0.0);
+
+        hasTimestamp |= (channel.kind == Kind::TIMESTAMP);
+        device->channels.push_back(std::move(channel));
+    }
+
+    std::sort(device->channels.begin(), device->channels.end(), [](const auto & a, const auto & b) {
+        return a.index < b.index;
+    });
+
+    bool any = false;
+    for (auto & channel : device->channels) {
+        const char * unit = nullptr;
+        switch (channel.kind) {
+            case Kind::POWER:
+                unit = "W";
+                break;
+            case Kind::CURRENT:
+                unit = "A";
+                break;
+            case Kind::VOLTAGE:
+                unit = "V";
+                break;
+            case Kind::TIMESTAMP:
+                continue;
+        }
+
+        const std::string label = channel.name.substr(std::strlen("in_"));
+        channel.averageCounter = new IioCounter(getCounters(),
+                                                makeName(device->id, channel.name, "average").c_str(),
+                                                "IIO " + device->name,
+                                                label,
+                                                unit,
+                                                false,
+                                                &channel.average);
+        setCounters(channel.averageCounter);
+
+        if ((channel.kind == Kind::POWER) && (hasTimestamp || (device->samplePeriodNs > 0))) {
+            channel.energyCounter = new IioCounter(getCounters(),
+                                                   makeName(device->id, channel.name, "energy").c_str(),
+                                                   "IIO " + device->name + " energy",
+                                                   label,
+                                                   "J",
+                                                   true,
+                                                   &channel.energyDelta);
+            setCounters(channel.energyCounter);
+        }
+
+        any = true;
+    }
+
+    if (any) {
+        mDevices.push_back(std::move(device));
+    }
+}
+
+void IioDriver::writeEvents(mxml_node_t * root) const
+{
+    root = mxmlNewElement(root, "category");
+    mxmlElementSetAttr(root, "name", "IIO");
+
+    for (auto * counter = static_cast<IioCounter *>(getCounters()); counter != nullptr;
+         counter = static_cast<IioCounter *>(counter->getNext())) {
+        mxml_node_t * node = mxmlNewElement(root, "event");
+        mxmlElementSetAttr(node, "counter", counter->getName());
+        mxmlElementSetAttr(node, "title", counter->getTitle());
+        mxmlElementSetAttr(node, "name", counter->getLabel());
+        mxmlElementSetAttr(node, "display", (counter->isDelta() ? "accumulate" : "average"));
+        mxmlElementSetAttr(node, "class", (counter->isDelta() ? "delta" : "absolute"));
+        mxmlElementSetAttr(node, "units", counter->getUnit());
+        mxmlElementSetAttr(node, "multiplier", "0.000001");
+        if (!counter->isDelta()) {
+            mxmlElementSetAttr(node, "average_selection", "yes");
+        }
+        mxmlElementSetAttr(node, "series_composition", "overlay");
+        mxmlElementSetAttr(node, "rendering_type", "line");
+        lib::printf_str_t<256> description {"%s of IIO channel %s, %s (%s), as sampled in buffered mode",
+                                            (counter->isDelta() ? "Energy" : "Average"),
+                                            counter->getLabel(),
+                                            counter->getTitle(),
+                                            counter->getName()};
+        mxmlElementSetAttr(node, "description", description);
+    }
+}
+
+bool IioDriver::startDevice(Device & device)
+{
+    const path_str_t path {"%s/%s", IIO_DEVICES, device.id.c_str()};
+    path_str_t file {"%s/buffer/enable", path.c_str()};
+
+    // the channels can only be changed while the buffer is disabled
+    if (lib::writeCStringToFile(file, "0") != 0) {
+        return false;
+    }
+
+    bool energyEnabled = false;
+    for (auto & channel : device.channels) {
+        channel.enabled = ((channel.averageCounter != nullptr) && channel.averageCounter->isEnabled())
+                       || ((channel.energyCounter != nullptr) && channel.energyCounter->isEnabled());
+        energyEnabled |= ((channel.energyCounter != nullptr) && channel.energyCounter->isEnabled());
+    }
+
+    device.sampleSize = 0;
+    std::size_t alignment = 1;
+    for (auto & channel : device.channels) {
+        if (channel.kind == Kind::TIMESTAMP) {
+            channel.enabled = energyEnabled;
+        }
+
+        file.printf("%s/%s/%s_en", path.c_str(), SCAN_ELEMENTS, channel.name.c_str());
+        if (lib::writeCStringToFile(file, (channel.enabled ? "1" : "0")) != 0) {
+            return false;
+        }
+
+        // each element is aligned to its own size within the sample, as is the sample as a whole
+        if (channel.enabled) {
+            device.sampleSize = ((device.sampleSize + channel.storageBytes - 1) / channel.storageBytes)
+                              * channel.storageBytes;
+            channel.position = device.sampleSize;
+            device.sampleSize += channel.storageBytes;
+            alignment = std::max<std::size_t>(alignment, channel.storageBytes);
+        }
+    }
+    device.sampleSize = ((device.sampleSize + alignment - 1) / alignment) * alignment;
+
+    file.printf("%s/buffer/length", path.c_str());
+    if (lib::writeIntToFile(file, BUFFER_LENGTH) != 0) {
+        return false;
+    }
+
+    // use the device's own trigger, if it has one and none is configured
+    file.printf("%s/trigger/current_trigger", path.c_str());
+    const auto trigger = readAttribute(lib::DirectoryFd::open(path), "trigger/current_trigger");
+    if (trigger && trigger->empty()) {
+        const lib::printf_str_t<128> ownTrigger {"%s-dev%s",
+                                                 device.name.c_str(),
+                                                 device.id.c_str() + std::strlen("iio:device")};
+        if (lib::writeCStringToFile(file, ownTrigger) != 0) {
+            LOG_DEBUG("IIO device %s has no trigger named %s", device.id.c_str(), ownTrigger.c_str());
+        }
+    }
+
+    file.printf("%s/buffer/enable", path.c_str());
+    if (lib::writeCStringToFile(file, "1") != 0) {
+        return false;
+    }
+    device.startedBuffer = true;
+
+    file.printf("/dev/%s", device.id.c_str());
+    device.fd = lib::AutoClosingFd {lib::open(file, O_RDONLY | O_NONBLOCK | O_CLOEXEC)};
+    if (!device.fd) {
+        return false;
+    }
+
+    device.readBuffer.resize(device.sampleSize * BUFFER_LENGTH);
+    device.pending = 0;
+    device.haveLastSample = false;
+    return true;
+}
+
+void IioDriver::start()
+{
+    for (auto & device : mDevices) {
+        const bool enabled = std::any_of(device->channels.begin(), device->channels.end(), [](const auto & channel) {
+            return ((channel.averageCounter != nullptr) && channel.averageCounter->isEnabled())
+                || ((channel.energyCounter != nullptr) && channel.energyCounter->isEnabled());
+        });
+        if (enabled && !startDevice(*device)) {
+            LOG_WARNING("Unable to enable the buffer of IIO device %s (%s); its counters will be zero",
+                        device->id.c_str(),
+                        device->name.c_str());
+            device->fd.close();
+        }
+    }
+}
+
+int64_t IioDriver::decodeValue(const Channel & channel, const char * sample)
+{
+    uint64_t raw = 0;
+    for (unsigned n = 0; n < channel.storageBytes; ++n) {
+        const unsigned byte = static_cast<unsigned char>(sample[channel.position + n]);
+        const unsigned shift = (channel.isBigEndian ? (channel.storageBytes - 1 - n) : n) * 8;
+        raw |= uint64_t(byte) << shift;
+    }
+    raw >>= channel.shift;
+
+    if (channel.bits >= 64) {
+        return static_cast<int64_t>(raw);
+    }
+
+    const uint64_t mask = (uint64_t(1) << channel.bits) - 1;
+    raw &= mask;
+    if (channel.isSigned && ((raw >> (channel.bits - 1)) != 0)) {
+        raw |= ~mask;
+    }
+    return static_cast<int64_t>(raw);
+}
+
+void IioDriver::decodeSample(Device & device, const char * sample)
+{
+    // the timestamp is usually the last element, but is needed first
+    std::optional<int64_t> timestamp;
+    for (const auto & channel : device.channels) {
+        if (channel.enabled && (channel.kind == Kind::TIMESTAMP)) {
+            timestamp = decodeValue(channel, sample);
+        }
+    }
+
+    for (auto & channel : device.channels) {
+        if (!channel.enabled || (channel.kind == Kind::TIMESTAMP)) {
+            continue;
+        }
+
+        const double previous = channel.last;
+        channel.last = (double(decodeValue(channel, sample)) + channel.offset) * channel.scale;
+        channel.sum += channel.last;
+        channel.count += 1;
+
+        // integrate the power over the time since the previous sample, at the previous sample's value
+        if ((channel.energyCounter != nullptr) && device.haveLastSample) {
+            const double deltaNs =
+                (timestamp ? double(*timestamp - device.lastTimestamp) : device.samplePeriodNs);
+            if ((deltaNs > 0) && (deltaNs <= MAX_SAMPLE_GAP_NS)) {
+                channel.energy += previous * deltaNs * MICROJOULES_PER_MILLIWATT_NS;
+            }
+        }
+    }
+
+    device.lastTimestamp = timestamp.value_or(0);
+    device.haveLastSample = true;
+}
+
+void IioDriver::sample()
+{
+    for (auto & device : mDevices) {
+        if (!device->fd) {
+            continue;
+        }
+
+        // read until the kfifo is empty
+        for (;;) {
+            const ssize_t bytes = lib::read(*device->fd,
+                                            device->readBuffer.data() + device->pending,
+                                            device->readBuffer.size() - device->pending);
+            if (bytes <= 0) {
+                if ((bytes < 0) && (errno != EAGAIN) && (errno != EINTR)) {
+                    LOG_WARNING("Unable to read IIO device %s (%d)", device->id.c_str(), errno);
+                    device->fd.close();
+                }
+                break;
+            }
+
+            const std::size_t available = device->pending + bytes;
+            const std::size_t samples = available / device->sampleSize;
+            for (std::size_t n = 0; n < samples; ++n) {
+                decodeSample(*device, device->readBuffer.data() + (n * device->sampleSize));
+            }
+
+            // keep any partial sample for the next read
+            device->pending = available - (samples * device->sampleSize);
+            std::memmove(device->readBuffer.data(),
+                         device->readBuffer.data() + (samples * device->sampleSize),
+                         device->pending);
+        }
+
+        for (auto & channel : device->channels) {
+            // report the last value if there were no samples in the window
+            const double average = (channel.count > 0 ? channel.sum / double(channel.count) : channel.last);
+            channel.average = std::llround(average * MICRO_PER_MILLI);
+            channel.sum = 0;
+            channel.count = 0;
+
+            // keep the fraction of a uJ for the next window
+            channel.energyDelta = static_cast<int64_t>(channel.energy);
+            channel.energy -= double(channel.energyDelta);
+        }
+    }
+}
+
+void IioDriver::stop()
+{
+    for (auto & device : mDevices) {
+        device->fd.close();
+        if (device->startedBuffer) {
+            const path_str_t file {"%s/%s/buffer/enable", IIO_DEVICES, device->id.c_str()};
+            lib::writeCStringToFile(file, "0");
+            device->startedBuffer = false;
+        }
+    }
+}
@@ -0,0 +1,106 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#ifndef IIODRIVER_H
+#define IIODRIVER_H
+
+#include "PolledDriver.h"
+#include "lib/AutoClosingFd.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Reads the power, current and voltage channels of IIO devices (such as power monitor ADCs) in buffered mode.
+ *
+ * Rather than reading each value once per poll, the device's buffer is enabled so that the device streams every
+ * sample (at its configured sampling frequency and trigger) into its kfifo, and each poll reads all the samples since
+ * the previous one from /dev/iio:deviceN. For each channel the poll reports the average of those samples, and for each
+ * power channel the energy, integrated on the target from every sample using the device's timestamp channel (or the
+ * sampling frequency, if it has none), so that short phases of activity are not lost between polls.
+ *
+ * The device's sampling frequency and trigger are left as configured, except that if no trigger is set, the device's
+ * own trigger ("<name>-dev<N>") is used if it has one. Enabling the buffer needs write access to the device's sysfs
+ * files, so usually requires root.
+ */
+class IioDriver : public PolledDriver {
+public:
+    /** The number of samples the kfifo is resized to hold, which must cover the samples of one poll */
+    static constexpr unsigned BUFFER_LENGTH = 8192;
+
+    IioDriver() : PolledDriver("IIO") {}
+
+    // Intentionally unimplemented
+    IioDriver(const IioDriver &) = delete;
+    IioDriver & operator=(const IioDriver &) = delete;
+    IioDriver(IioDriver &&) = delete;
+    IioDriver & operator=(IioDriver &&) = delete;
+
+    void readEvents(mxml_node_t * root) override;
+    void writeEvents(mxml_node_t * root) const override;
+    void start() override;
+    void sample() override;
+    void stop() override;
+
+private:
+    enum class Kind { POWER, CURRENT, VOLTAGE, TIMESTAMP };
+
+    struct Channel {
+        /** The name of the channel, as the prefix of its sysfs files, such as in_power0 */
+        std::string name;
+        Kind kind;
+        /** The scan index, which orders the channels in each sample */
+        unsigned index;
+        /** The decoding of the value, as per scan_elements/<name>_type */
+        unsigned bits;
+        unsigned storageBytes;
+        unsigned shift;
+        bool isSigned;
+        bool isBigEndian;
+        /** The position in each sample, while enabled */
+        std::size_t position {0};
+        /** To convert the raw value to mW, mA or mV, as value = (raw + offset) * scale */
+        double scale;
+        double offset;
+        bool enabled {false};
+        DriverCounter * averageCounter {nullptr};
+        DriverCounter * energyCounter {nullptr};
+        /** The values of the current window */
+        double sum {0};
+        uint64_t count {0};
+        double last {0};
+        /** The energy in uJ integrated but not yet reported */
+        double energy {0};
+        /** The values reported for the window */
+        int64_t average {0};
+        int64_t energyDelta {0};
+    };
+
+    struct Device {
+        /** The directory name, such as iio:device0 */
+        std::string id;
+        /** The contents of the name file */
+        std::string name;
+        std::vector<Channel> channels {};
+        /** The sampling period, used to integrate energy if there is no timestamp channel, or 0 if unknown */
+        double samplePeriodNs {0};
+        lib::AutoClosingFd fd {};
+        std::size_t sampleSize {0};
+        std::vector<char> readBuffer {};
+        std::size_t pending {0};
+        int64_t lastTimestamp {0};
+        bool haveLastSample {false};
+        bool startedBuffer {false};
+    };
+
+    std::vector<std::unique_ptr<Device>> mDevices {};
+
+    void readDevice(const char * id);
+    bool startDevice(Device & device);
+    static int64_t decodeValue(const Channel & channel, const char * sample);
+    static void decodeSample(Device & device, const char * sample);
+};
+
+#endif // IIODRIVER_H
@@ -0,0 +1,85 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "InternalsDriver.h"
+
+#include "PipelineStats.h"
+
+#include <cstdint>
+#include <functional>
+
+namespace {
+    class InternalsCounter : public DriverCounter {
+    public:
+        /**
+         * @param isDelta True if the value read is a running total, of which the counter reports the increase
+         */
+        InternalsCounter(DriverCounter * next, const char * name, bool isDelta, std::function<int64_t()> reader)
+            : DriverCounter(next, name), mReader(std::move(reader)), mIsDelta(isDelta)
+        {
+        }
+
+        // Intentionally unimplemented
+        InternalsCounter(const InternalsCounter &) = delete;
+        InternalsCounter & operator=(const InternalsCounter &) = delete;
+        InternalsCounter(InternalsCounter &&) = delete;
+        InternalsCounter & operator=(InternalsCounter &&) = delete;
+
+        int64_t read() override
+        {
+            const int64_t value = mReader();
+            if (!mIsDelta) {
+                return value;
+            }
+            const int64_t result = value - mPrev;
+            mPrev = value;
+            return result;
+        }
+
+    private:
+        std::function<int64_t()> mReader;
+        int64_t mPrev {0};
+        bool mIsDelta;
+    };
+}
+
+void InternalsDriver::readEvents(mxml_node_t * const /*unused*/)
+{
+    setCounters(new InternalsCounter(getCounters(), "Gator_internals_perf_mmap_fill", false, []() -> int64_t {
+        return gPipelineStats.takePeakMmapFill();
+    }));
+    setCounters(new InternalsCounter(getCounters(), "Gator_internals_ipc_queue_depth", false, []() -> int64_t {
+        return gPipelineStats.getIpcQueueDepth();
+    }));
+    setCounters(new InternalsCounter(getCounters(), "Gator_internals_agent_data", true, []() -> int64_t {
+        return static_cast<int64_t>(gPipelineStats.getAgentBytes());
+    }));
+    setCounters(new InternalsCounter(getCounters(), "Gator_internals_lost_records", true, []() -> int64_t {
+        return static_cast<int64_t>(gPipelineStats.getLostRecords());
+    }));
+    setCounters(new InternalsCounter(getCounters(), "Gator_internals_buffer_used", false, []() -> int64_t {
+        return gPipelineStats.getBufferedBytes();
+    }));
+    setCounters(new InternalsCounter(getCounters(), "Gator_internals_sender_data", true, []() -> int64_t {
+        return static_cast<int64_t>(gPipelineStats.getSenderBytes());
+    }));
+    setCounters(new InternalsCounter(getCounters(), "Gator_internals_sender_latency", false, []() -> int64_t {
+        return std::chrono::duration_cast<std::chrono::microseconds>(gPipelineStats.takeSenderMaxWriteTime()).count();
+    }));
+    setCounters(new InternalsCounter(getCounters(), "Gator_internals_cpu_time", true, []() -> int64_t {
+        return gPipelineStats.getCpuTime().count();
+    }));
+    setCounters(new InternalsCounter(getCounters(), "Gator_internals_memory", false, []() -> int64_t {
+        return static_cast<int64_t>(gPipelineStats.getMaxRssKiB() * 1024);
+    }));
+}
+
+void InternalsDriver::start()
+{
+    // Initialize the previous values, and discard any peaks from before the capture started
+    for (DriverCounter * counter = getCounters(); counter != nullptr; counter = counter->getNext()) {
+        if (!counter->isEnabled()) {
+            continue;
+        }
+        counter->read();
+    }
+}
@@ -0,0 +1,26 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#ifndef INTERNALSDRIVER_H
+#define INTERNALSDRIVER_H
+
+#include "PolledDriver.h"
+
+/**
+ * Publishes gatord's own capture pipeline statistics (see PipelineStats) as the "Gator Internals" counters, so that
+ * the cause of any lost data can be seen, and the mmap size and buffer mode tuned accordingly.
+ */
+class InternalsDriver : public PolledDriver {
+public:
+    InternalsDriver() : PolledDriver("Internals") {}
+
+    // Intentionally unimplemented
+    InternalsDriver(const InternalsDriver &) = delete;
+    InternalsDriver & operator=(const InternalsDriver &) = delete;
+    InternalsDriver(InternalsDriver &&) = delete;
+    InternalsDriver & operator=(InternalsDriver &&) = delete;
+
+    void readEvents(mxml_node_t * root) override;
+    void start() override;
+};
+
+#endif // INTERNALSDRIVER_H
@@ -0,0 +1,95 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "Lz4FileWriter.h"
+
+#include "Logging.h"
+
+#include <algorithm>
+
+namespace {
+    LZ4F_cctx * createContext()
+    {
+        LZ4F_cctx * context = nullptr;
+        const auto result = LZ4F_createCompressionContext(&context, LZ4F_VERSION);
+        if (LZ4F_isError(result) != 0) {
+            LOG_ERROR("Failed to create LZ4 compression context: %s", LZ4F_getErrorName(result));
+            return nullptr;
+        }
+        return context;
+    }
+
+    LZ4F_preferences_t createPreferences()
+    {
+        LZ4F_preferences_t preferences = LZ4F_INIT_PREFERENCES;
+        // the APC frames are highly repetitive so linked blocks significantly improve the ratio
+        preferences.frameInfo.blockMode = LZ4F_blockLinked;
+        preferences.frameInfo.blockSizeID = LZ4F_max64KB;
+        preferences.frameInfo.contentChecksumFlag = LZ4F_contentChecksumEnabled;
+        return preferences;
+    }
+}
+
+Lz4FileWriter::Lz4FileWriter(CaptureFileWriter & file)
+    : mContext(createContext(), LZ4F_freeCompressionContext),
+      mPreferences(createPreferences()),
+      mOutput(std::max<std::size_t>(LZ4F_compressBound(CHUNK_SIZE, &mPreferences), LZ4F_HEADER_SIZE_MAX)),
+      mFile(file)
+{
+    if (mContext) {
+        checkAndWrite(LZ4F_compressBegin(mContext.get(), mOutput.data(), mOutput.size(), &mPreferences),
+                      "LZ4F_compressBegin");
+    }
+}
+
+bool Lz4FileWriter::write(lib::Span<const char, int> data)
+{
+    if ((!mContext) || mFinished) {
+        return false;
+    }
+
+    const char * ptr = data.data();
+    auto remaining = static_cast<std::size_t>(data.size());
+
+    while (remaining > 0) {
+        const std::size_t length = std::min(remaining, CHUNK_SIZE);
+
+        if (!checkAndWrite(
+                LZ4F_compressUpdate(mContext.get(), mOutput.data(), mOutput.size(), ptr, length, nullptr),
+                "LZ4F_compressUpdate")) {
+            return false;
+        }
+
+        mBytesIn += length;
+        ptr += length;
+        remaining -= length;
+    }
+
+    return true;
+}
+
+bool Lz4FileWriter::finish()
+{
+    if ((!mContext) || mFinished) {
+        return false;
+    }
+
+    mFinished = true;
+
+    return checkAndWrite(LZ4F_compressEnd(mContext.get(), mOutput.data(), mOutput.size(), nullptr),
+                         "LZ4F_compressEnd");
+}
+
+bool Lz4FileWriter::checkAndWrite(std::size_t result, const char * operation)
+{
+    if (LZ4F_isError(result) != 0) {
+        LOG_ERROR("%s failed: %s", operation, LZ4F_getErrorName(result));
+        return false;
+    }
+
+    if ((result > 0) && (!mFile.write({mOutput.data(), static_cast<int>(result)}))) {
+        return false;
+    }
+
+    mBytesOut += result;
+    return true;
+}
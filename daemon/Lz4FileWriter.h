@@ -0,0 +1,68 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#pragma once
+
+#include "CaptureFileWriter.h"
+#include "lib/Span.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <lz4frame.h>
+
+/**
+ * Streams data into a file as a single LZ4 frame, so that the result can be decompressed with the standard lz4 tool.
+ * Data is compressed in fixed size chunks as it is written, so the memory use is bounded regardless of the capture
+ * length.
+ */
+class Lz4FileWriter {
+public:
+    /** The amount of input that is compressed in one go */
+    static constexpr std::size_t CHUNK_SIZE = 64 * 1024;
+
+    /**
+     * Construct a writer, writing the frame header to the file
+     *
+     * @param file The file to write to; must remain open until after finish is called
+     */
+    explicit Lz4FileWriter(CaptureFileWriter & file);
+
+    // Intentionally unimplemented
+    Lz4FileWriter(const Lz4FileWriter &) = delete;
+    Lz4FileWriter & operator=(const Lz4FileWriter &) = delete;
+    Lz4FileWriter(Lz4FileWriter &&) = delete;
+    Lz4FileWriter & operator=(Lz4FileWriter &&) = delete;
+
+    ~Lz4FileWriter() = default;
+
+    /**
+     * Compress and write some data
+     *
+     * @return false if the data could not be compressed or written
+     */
+    bool write(lib::Span<const char, int> data);
+
+    /**
+     * Flush any buffered data and write the frame footer. No further calls to write may be made.
+     *
+     * @return false if the data could not be compressed or written
+     */
+    bool finish();
+
+    /** @return The number of bytes passed to write */
+    [[nodiscard]] std::uint64_t getBytesIn() const { return mBytesIn; }
+    /** @return The number of (compressed) bytes written to the file */
+    [[nodiscard]] std::uint64_t getBytesOut() const { return mBytesOut; }
+
+private:
+    std::unique_ptr<LZ4F_cctx, LZ4F_errorCode_t (*)(LZ4F_cctx *)> mContext;
+    LZ4F_preferences_t mPreferences;
+    std::vector<char> mOutput;
+    CaptureFileWriter & mFile;
+    std::uint64_t mBytesIn {0};
+    std::uint64_t mBytesOut {0};
+    bool mFinished {false};
+
+    bool checkAndWrite(std::size_t result, const char * operation);
+};
@@ -1,10 +1,18 @@
-/* Copyright (C) 2013-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2013-2022 by Arm Limited. All rights reserved. */
 
 #include "MemInfoDriver.h"
 
 #include "Logging.h"
 #include "SessionData.h"
+#include "lib/DirectoryFd.h"
+#include "lib/Syscall.h"
+#include "linux/proc/ProcFieldParser.h"
 
+#include <array>
+#include <optional>
+#include <string_view>
+
+#include <fcntl.h>
 #include <unistd.h>
 
 class MemInfoCounter : public DriverCounter {
@@ -47,50 +55,54 @@ void MemInfoDriver::readEvents(mxml_node_t * const /*unused*/)
     }
 }
 
-void MemInfoDriver::read(IBlockCounterFrameBuilder & buffer)
+void MemInfoDriver::sample()
 {
     if (!countersEnabled()) {
         return;
     }
 
-    if (!mBuf.read("/proc/meminfo")) {
+    if (!mFd) {
+        mFd = lib::AutoClosingFd {lib::open("/proc/meminfo", O_RDONLY | O_CLOEXEC)};
+    }
+
+    const std::optional<std::string_view> contents =
+        (mFd ? lib::DirectoryFd::readContents(*mFd, mBuf) : std::optional<std::string_view> {});
+    if (!contents) {
         LOG_ERROR("Failed to read /proc/meminfo");
         handleException();
     }
 
-    char * key = mBuf.getBuf();
-    char * colon;
     int64_t memTotal = 0;
-    while ((colon = strchr(key, ':')) != nullptr) {
-        char * end = strchr(colon + 1, '\n');
-        if (end != nullptr) {
-            *end = '\0';
-        }
-        *colon = '\0';
-
-        if (strcmp(key, "MemTotal") == 0) {
-            memTotal = strtoll(colon + 1, nullptr, 10) << 10;
-        }
-        else if (strcmp(key, "MemFree") == 0) {
-            mMemFree = strtoll(colon + 1, nullptr, 10) << 10;
-        }
-        else if (strcmp(key, "Buffers") == 0) {
-            mBuffers = strtoll(colon + 1, nullptr, 10) << 10;
-        }
-        else if (strcmp(key, "Cached") == 0) {
-            mCached = strtoll(colon + 1, nullptr, 10) << 10;
-        }
-        else if (strcmp(key, "Slab") == 0) {
-            mSlab = strtoll(colon + 1, nullptr, 10) << 10;
+    const std::array<std::pair<std::string_view, int64_t *>, 5> keys {{
+        {"MemTotal", &memTotal},
+        {"MemFree", &mMemFree},
+        {"Buffers", &mBuffers},
+        {"Cached", &mCached},
+        {"Slab", &mSlab},
+    }};
+
+    // only parse the values of the needed keys, and stop once they have all been found
+    std::size_t found = 0;
+    std::string_view remaining = *contents;
+    while ((found < keys.size()) && !remaining.empty()) {
+        const std::string_view line = lnx::ProcFieldParser::nextLine(remaining);
+        const auto colon = line.find(':');
+        if (colon == std::string_view::npos) {
+            continue;
         }
 
-        if (end == nullptr) {
-            break;
+        const std::string_view key = line.substr(0, colon);
+        for (const auto & [name, value] : keys) {
+            if (key == name) {
+                int64_t kib = 0;
+                if (lnx::ProcFieldParser {line.substr(colon + 1)}.next(kib)) {
+                    *value = kib << 10;
+                }
+                found += 1;
+                break;
+            }
         }
-        key = end + 1;
     }
 
     mMemUsed = memTotal - mMemFree;
-
-    super::read(buffer);
 }
@@ -1,15 +1,14 @@
-/* Copyright (C) 2013-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2013-2022 by Arm Limited. All rights reserved. */
 
 #ifndef MEMINFODRIVER_H
 #define MEMINFODRIVER_H
 
-#include "DynBuf.h"
 #include "PolledDriver.h"
+#include "lib/AutoClosingFd.h"
 
-class MemInfoDriver : public PolledDriver {
-private:
-    using super = PolledDriver;
+#include <vector>
 
+class MemInfoDriver : public PolledDriver {
 public:
     MemInfoDriver() : PolledDriver("MemInfo") {}
 
@@ -20,10 +19,12 @@ public:
     MemInfoDriver & operator=(MemInfoDriver &&) = delete;
 
     void readEvents(mxml_node_t * root) override;
-    void read(IBlockCounterFrameBuilder & buffer) override;
+    void sample() override;
 
 private:
-    DynBuf mBuf {};
+    /** Kept open between samples (and reread from the start) so sampling is cheap enough to do at a high rate */
+    lib::AutoClosingFd mFd {};
+    std::vector<char> mBuf {};
     int64_t mMemUsed {0};
     int64_t mMemFree {0};
     int64_t mBuffers {0};
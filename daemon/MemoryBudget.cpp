@@ -0,0 +1,83 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "MemoryBudget.h"
+
+#include "Logging.h"
+
+#include <algorithm>
+#include <cinttypes>
+
+MemoryBudget gMemoryBudget {};
+
+namespace {
+    constexpr std::uint64_t KILOBYTES = 1024;
+}
+
+void MemoryBudget::reset(std::uint64_t bytes)
+{
+    std::lock_guard<std::mutex> lock {mMutex};
+
+    mLimit = bytes;
+    mAllocated = 0;
+    mAllocations.clear();
+}
+
+std::size_t MemoryBudget::allocate(const char * component,
+                                   std::size_t count,
+                                   std::size_t requested,
+                                   std::size_t minimum)
+{
+    std::lock_guard<std::mutex> lock {mMutex};
+
+    // a buffer that asks for less than the minimum is left as it is
+    minimum = std::min(minimum, requested);
+
+    std::size_t size = requested;
+    if (mLimit > 0) {
+        const std::uint64_t remaining = (mLimit > mAllocated ? mLimit - mAllocated : 0);
+        while ((size > minimum) && (std::uint64_t(size) * count > remaining)) {
+            size = std::max(size / 2, minimum);
+        }
+
+        if (std::uint64_t(size) * count > remaining) {
+            LOG_ERROR("The memory limit of %" PRIu64 " MB is too small; the %zu buffers of the %s need %" PRIu64
+                      " KB, but only %" PRIu64 " KB is left",
+                      mLimit / (KILOBYTES * KILOBYTES),
+                      count,
+                      component,
+                      (std::uint64_t(size) * count) / KILOBYTES,
+                      remaining / KILOBYTES);
+            handleException();
+        }
+
+        if (size < requested) {
+            LOG_DEBUG("The %s buffers are shrunk from %zu to %zu bytes to fit the memory limit",
+                      component,
+                      requested,
+                      size);
+        }
+    }
+
+    const std::uint64_t bytes = std::uint64_t(size) * count;
+    mAllocated += bytes;
+
+    auto & allocation = mAllocations[component];
+    allocation.count += count;
+    allocation.bytes += bytes;
+
+    return size;
+}
+
+std::uint64_t MemoryBudget::getLimit() const
+{
+    std::lock_guard<std::mutex> lock {mMutex};
+
+    return mLimit;
+}
+
+std::map<std::string, MemoryBudget::Allocation> MemoryBudget::getAllocations() const
+{
+    std::lock_guard<std::mutex> lock {mMutex};
+
+    return mAllocations;
+}
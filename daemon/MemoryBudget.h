@@ -0,0 +1,74 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#ifndef MEMORY_BUDGET_H
+#define MEMORY_BUDGET_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+/**
+ * The memory that all of gatord's capture buffers may use, shared by all the components that hold capture data.
+ *
+ * Each component carves its buffers from the single global instance as it is set up: the source Buffers, the perf
+ * ring buffers of every core, the perf agent's IPC queue, the flight recorder and the queue of the extra hosts. A
+ * buffer that does not fit is halved (keeping it a power of two, as the Buffers and the perf ring buffers must be)
+ * until it does, and if it does not fit at its smallest size the capture is not started, rather than gatord being
+ * killed once it runs out of memory part of the way through. What each component was given is reported in the
+ * captured XML.
+ *
+ * Without a limit nothing is shrunk, but the allocations are still recorded.
+ */
+class MemoryBudget {
+public:
+    /** The smallest that a buffer is shrunk to, unless it asks for less */
+    static constexpr std::size_t MIN_BUFFER_SIZE = 64 * 1024;
+
+    /** The memory given to each of the components */
+    struct Allocation {
+        /** The number of buffers */
+        std::size_t count {0};
+        /** The bytes of them all */
+        std::uint64_t bytes {0};
+    };
+
+    /**
+     * Set up the budget for a capture, forgetting the allocations of the previous one
+     *
+     * @param bytes The memory that the buffers may use, or 0 for no limit
+     */
+    void reset(std::uint64_t bytes);
+
+    /**
+     * Carve some equally sized buffers from the budget, ending the capture (through handleException) if they do not
+     * fit at the minimum size
+     *
+     * @param component The name of what the buffers are for, as reported in the captured XML
+     * @param count The number of buffers
+     * @param requested The size that each buffer would be without a limit
+     * @param minimum The smallest that each buffer may be
+     * @return The size that each buffer is to be
+     */
+    std::size_t allocate(const char * component,
+                         std::size_t count,
+                         std::size_t requested,
+                         std::size_t minimum = MIN_BUFFER_SIZE);
+
+    /** @return The limit, or 0 if there is none */
+    [[nodiscard]] std::uint64_t getLimit() const;
+
+    /** @return What each component was given, by name */
+    [[nodiscard]] std::map<std::string, Allocation> getAllocations() const;
+
+private:
+    mutable std::mutex mMutex {};
+    std::uint64_t mLimit {0};
+    std::uint64_t mAllocated {0};
+    std::map<std::string, Allocation> mAllocations {};
+};
+
+extern MemoryBudget gMemoryBudget;
+
+#endif // MEMORY_BUDGET_H
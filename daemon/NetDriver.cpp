@@ -1,20 +1,30 @@
-/* Copyright (C) 2013-2021 by Arm Limited. All rights reserved. */
-
-// Define to get format macros from inttypes.h
-#define __STDC_FORMAT_MACROS
+/* Copyright (C) 2013-2022 by Arm Limited. All rights reserved. */
 
 #include "NetDriver.h"
 
 #include "Logging.h"
 #include "SessionData.h"
+#include "async/netlink/nl_link_stats.h"
+#include "linux/proc/ProcFieldParser.h"
 
-#include <cinttypes>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
 
+#include <fnmatch.h>
 #include <unistd.h>
 
+namespace {
+    constexpr char INTERFACE_COUNTER_PREFIX[] = "Linux_net_if_";
+}
+
 class NetCounter : public DriverCounter {
 public:
-    NetCounter(DriverCounter * next, const char * name, uint64_t * value);
+    /**
+     * @param pattern The fnmatch pattern of the names of the interfaces that are counted, or empty for all of them
+     * @param transmit True to count the transmitted bytes, rather than the received bytes
+     */
+    NetCounter(DriverCounter * next, const char * name, std::string pattern, bool transmit);
 
     // Intentionally unimplemented
     NetCounter(const NetCounter &) = delete;
@@ -22,82 +32,195 @@ public:
     NetCounter(NetCounter &&) = delete;
     NetCounter & operator=(NetCounter &&) = delete;
 
+    /** Total the bytes of the matching interfaces */
+    void update(const NetDriver::InterfaceStats * interfaces, std::size_t count);
+
     int64_t read() override;
 
 private:
-    uint64_t * const mValue;
+    const std::string mPattern;
+    const bool mTransmit;
+    uint64_t mValue;
     uint64_t mPrev;
 };
 
-NetCounter::NetCounter(DriverCounter * next, const char * const name, uint64_t * const value)
-    : DriverCounter(next, name), mValue(value), mPrev(0)
+NetCounter::NetCounter(DriverCounter * next, const char * const name, std::string pattern, bool transmit)
+    : DriverCounter(next, name), mPattern(std::move(pattern)), mTransmit(transmit), mValue(0), mPrev(0)
 {
 }
 
+void NetCounter::update(const NetDriver::InterfaceStats * const interfaces, std::size_t count)
+{
+    mValue = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+        const auto & interface = interfaces[i];
+        if (mPattern.empty() || (fnmatch(mPattern.c_str(), interface.name.c_str(), 0) == 0)) {
+            mValue += (mTransmit ? interface.transmitBytes : interface.receiveBytes);
+        }
+    }
+}
+
 int64_t NetCounter::read()
 {
-    int64_t result = *mValue - mPrev;
-    mPrev = *mValue;
+    // the total goes down when an interface goes away, which is not negative traffic
+    int64_t result = (mValue >= mPrev ? mValue - mPrev : 0);
+    mPrev = mValue;
     return result;
 }
 
-void NetDriver::readEvents(mxml_node_t * const /*unused*/)
+NetDriver::NetDriver() : PolledDriver("Net") {}
+
+NetDriver::~NetDriver() = default;
+
+void NetDriver::readEvents(mxml_node_t * const xml)
 {
-    if (access("/proc/net/dev", R_OK) == 0) {
-        setCounters(new NetCounter(getCounters(), "Linux_net_rx", &mReceiveBytes));
-        setCounters(new NetCounter(getCounters(), "Linux_net_tx", &mTransmitBytes));
-    }
-    else {
+    if (access("/proc/net/dev", R_OK) != 0) {
         LOG_SETUP("Linux counters\nCannot access /proc/net/dev. Network transmit and receive counters not available.");
+        return;
+    }
+
+    setCounters(new NetCounter(getCounters(), "Linux_net_rx", {}, false));
+    setCounters(new NetCounter(getCounters(), "Linux_net_tx", {}, true));
+
+    mxml_node_t * node = xml;
+    while (true) {
+        node = mxmlFindElement(node, xml, "event", nullptr, nullptr, MXML_DESCEND);
+        if (node == nullptr) {
+            break;
+        }
+        const char * counter = mxmlElementGetAttr(node, "counter");
+        if ((counter == nullptr)
+            || (strncmp(counter, INTERFACE_COUNTER_PREFIX, sizeof(INTERFACE_COUNTER_PREFIX) - 1) != 0)) {
+            continue;
+        }
+
+        const char * interface = mxmlElementGetAttr(node, "interface");
+        const char * stat = mxmlElementGetAttr(node, "stat");
+        if ((interface == nullptr) || (*interface == '\0')) {
+            LOG_ERROR("The network counter %s is missing the required interface attribute", counter);
+            handleException();
+        }
+        if ((stat == nullptr) || ((strcmp(stat, "rx") != 0) && (strcmp(stat, "tx") != 0))) {
+            LOG_ERROR("The network counter %s must have a stat attribute of 'rx' or 'tx'", counter);
+            handleException();
+        }
+        setCounters(new NetCounter(getCounters(), counter, interface, strcmp(stat, "tx") == 0));
     }
 }
 
-bool NetDriver::doRead()
+NetDriver::InterfaceStats & NetDriver::addInterface()
 {
-    if (!countersEnabled()) {
-        return true;
+    if (mInterfaceCount == mInterfaces.size()) {
+        mInterfaces.push_back({{}, 0, 0, 0});
     }
+    return mInterfaces[mInterfaceCount++];
+}
 
-    if (!mBuf.read("/proc/net/dev")) {
+bool NetDriver::readNetlink()
+{
+    bool unknownInterface = false;
+    const bool ok = mLinkStats->dump_stats([&](const auto & stats) {
+        auto & interface = addInterface();
+        const auto it = mInterfaceNames.find(stats.ifindex);
+        if (it != mInterfaceNames.end()) {
+            interface.name.assign(it->second);
+        }
+        else {
+            interface.name.clear();
+            unknownInterface = true;
+        }
+        interface.ifindex = stats.ifindex;
+        interface.receiveBytes = stats.rx_bytes;
+        interface.transmitBytes = stats.tx_bytes;
+    });
+    if (!ok) {
         return false;
     }
 
-    // Skip the header
-    char * key;
-    if (((key = strchr(mBuf.getBuf(), '\n')) == nullptr) || ((key = strchr(key + 1, '\n')) == nullptr)) {
+    // the stats only give the index of each interface, so the names are read again whenever one appears
+    if (unknownInterface) {
+        mInterfaceNames.clear();
+        if (!mLinkStats->dump_names([this](int ifindex, std::string_view name) {
+                mInterfaceNames.emplace(ifindex, std::string(name));
+            })) {
+            return false;
+        }
+        for (std::size_t i = 0; i < mInterfaceCount; ++i) {
+            auto & interface = mInterfaces[i];
+            const auto it = mInterfaceNames.find(interface.ifindex);
+            if (interface.name.empty() && (it != mInterfaceNames.end())) {
+                interface.name.assign(it->second);
+            }
+        }
+    }
+
+    return true;
+}
+
+bool NetDriver::readProcNetDev()
+{
+    if (!mBuf.reread("/proc/net/dev")) {
         return false;
     }
-    key = key + 1;
 
-    mReceiveBytes = 0;
-    mTransmitBytes = 0;
+    std::string_view remaining {mBuf.getBuf(), mBuf.getLength()};
 
-    char * colon;
-    while ((colon = strchr(key, ':')) != nullptr) {
-        char * end = strchr(colon + 1, '\n');
-        if (end != nullptr) {
-            *end = '\0';
+    // Skip the header
+    for (int line = 0; line < 2; ++line) {
+        if (remaining.find('\n') == std::string_view::npos) {
+            return false;
+        }
+        lnx::ProcFieldParser::nextLine(remaining);
+    }
+
+    while (!remaining.empty()) {
+        const std::string_view line = lnx::ProcFieldParser::nextLine(remaining);
+        const auto colon = line.find(':');
+        if (colon == std::string_view::npos) {
+            break;
         }
-        *colon = '\0';
 
         uint64_t receiveBytes;
         uint64_t transmitBytes;
 
-        // NOLINTNEXTLINE(cert-err34-c)
-        const int count = sscanf(colon + 1, //
-                                 " %" SCNu64 " %*u %*u %*u %*u %*u %*u %*u %" SCNu64,
-                                 &receiveBytes,
-                                 &transmitBytes);
-        if (count != 2) {
+        // bytes packets errs drop fifo frame compressed multicast, then the same for transmit
+        lnx::ProcFieldParser fields {line.substr(colon + 1)};
+        if (!fields.next(receiveBytes) || !fields.skip(7) || !fields.next(transmitBytes)) {
             return false;
         }
-        mReceiveBytes += receiveBytes;
-        mTransmitBytes += transmitBytes;
 
-        if (end == nullptr) {
-            break;
+        // the name is right aligned
+        const auto start = line.find_first_not_of(' ');
+        auto & interface = addInterface();
+        interface.name.assign(line.substr(start, colon - start));
+        interface.ifindex = 0;
+        interface.receiveBytes = receiveBytes;
+        interface.transmitBytes = transmitBytes;
+    }
+
+    return true;
+}
+
+bool NetDriver::doRead()
+{
+    if (!countersEnabled()) {
+        return true;
+    }
+
+    mInterfaceCount = 0;
+    if (mLinkStats && !readNetlink()) {
+        LOG_DEBUG("Reading the network stats with rtnetlink failed, so /proc/net/dev is read instead");
+        mLinkStats.reset();
+        mInterfaceCount = 0;
+    }
+    if (!mLinkStats && !readProcNetDev()) {
+        return false;
+    }
+
+    for (DriverCounter * counter = getCounters(); counter != nullptr; counter = counter->getNext()) {
+        if (counter->isEnabled()) {
+            static_cast<NetCounter *>(counter)->update(mInterfaces.data(), mInterfaceCount);
         }
-        key = end + 1;
     }
 
     return true;
@@ -105,6 +228,14 @@ bool NetDriver::doRead()
 
 void NetDriver::start()
 {
+    if (countersEnabled()) {
+        mLinkStats = std::make_unique<async::netlink::nl_link_stats_client_t>(mContext);
+        if (!mLinkStats->is_open()) {
+            mLinkStats.reset();
+        }
+        LOG_DEBUG("Network stats are read from %s", (mLinkStats ? "rtnetlink" : "/proc/net/dev"));
+    }
+
     if (!doRead()) {
         LOG_ERROR("Unable to read network stats");
         handleException();
@@ -118,11 +249,16 @@ void NetDriver::start()
     }
 }
 
-void NetDriver::read(IBlockCounterFrameBuilder & buffer)
+void NetDriver::stop()
+{
+    mLinkStats.reset();
+    mInterfaceNames.clear();
+}
+
+void NetDriver::sample()
 {
     if (!doRead()) {
         LOG_ERROR("Unable to read network stats");
         handleException();
     }
-    super::read(buffer);
 }
@@ -1,4 +1,4 @@
-/* Copyright (C) 2013-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2013-2022 by Arm Limited. All rights reserved. */
 
 #ifndef NETDRIVER_H
 #define NETDRIVER_H
@@ -6,12 +6,28 @@
 #include "DynBuf.h"
 #include "PolledDriver.h"
 
-class NetDriver : public PolledDriver {
-private:
-    using super = PolledDriver;
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/asio/io_context.hpp>
 
+namespace async::netlink {
+    class nl_link_stats_client_t;
+}
+
+/**
+ * Counts the bytes received and transmitted by all the network interfaces (Linux_net_rx and Linux_net_tx), or by those
+ * whose names match the pattern of a Linux_net_if_ counter in the events xml.
+ *
+ * The stats are read with a single rtnetlink dump where the kernel supports it, otherwise by parsing /proc/net/dev.
+ */
+class NetDriver : public PolledDriver {
 public:
-    NetDriver() : PolledDriver("Net") {}
+    NetDriver();
+    ~NetDriver() override;
 
     // Intentionally unimplemented
     NetDriver(const NetDriver &) = delete;
@@ -21,14 +37,31 @@ public:
 
     void readEvents(mxml_node_t * root) override;
     void start() override;
-    void read(IBlockCounterFrameBuilder & buffer) override;
+    void stop() override;
+    void sample() override;
+
+    /** The stats of one interface, as of the last read */
+    struct InterfaceStats {
+        std::string name;
+        /** The index of the interface, or zero when read from /proc/net/dev */
+        int ifindex;
+        uint64_t receiveBytes;
+        uint64_t transmitBytes;
+    };
 
 private:
     bool doRead();
+    bool readNetlink();
+    bool readProcNetDev();
+    InterfaceStats & addInterface();
 
     DynBuf mBuf {};
-    uint64_t mReceiveBytes {0};
-    uint64_t mTransmitBytes {0};
+    boost::asio::io_context mContext {};
+    std::unique_ptr<async::netlink::nl_link_stats_client_t> mLinkStats {};
+    std::map<int, std::string> mInterfaceNames {};
+    /** Reused for each read, only the first mInterfaceCount of which are current */
+    std::vector<InterfaceStats> mInterfaces {};
+    std::size_t mInterfaceCount {0};
 };
 
 #endif // NETDRIVER_H
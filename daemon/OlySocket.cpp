@@ -1,4 +1,4 @@
-/* Copyright (C) 2010-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2010-2022 by Arm Limited. All rights reserved. */
 
 #include "OlySocket.h"
 
@@ -14,6 +14,8 @@
 #include <fcntl.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
 #include <sys/un.h>
 #include <unistd.h>
 #endif
@@ -32,6 +34,14 @@
 #define SHUTDOWN_RX_TX SHUT_RDWR
 #endif
 
+namespace {
+    /** @return True for the receive errors that mean the host has gone, rather than that something is wrong */
+    bool isDisconnectError(int error)
+    {
+        return (error == ECONNRESET) || (error == ETIMEDOUT);
+    }
+}
+
 int socket_cloexec(int domain, int type, int protocol)
 {
     int sock;
@@ -316,6 +326,79 @@ void OlySocket::send(const char * buffer, int size)
     }
 }
 
+#ifndef WIN32
+void OlySocket::sendv(struct iovec * iov, int iovcnt, int timeoutMs)
+{
+    if (!trySendv(iov, iovcnt, timeoutMs)) {
+        handleException();
+    }
+}
+
+bool OlySocket::trySendv(struct iovec * iov, int iovcnt, int timeoutMs)
+{
+    struct msghdr msg {};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = iovcnt;
+
+    while (msg.msg_iovlen > 0) {
+        const ssize_t n = ::sendmsg(mSocketID, &msg, MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+                LOG_ERROR("Socket send error (%d): %s", errno, strerror(errno));
+                return false;
+            }
+
+            // wait for space in the socket buffer
+            struct pollfd pfd {mSocketID, POLLOUT, 0};
+            const int result = lib::poll(&pfd, 1, timeoutMs);
+            if ((result < 0) && (errno != EINTR)) {
+                LOG_ERROR("Socket poll error (%d): %s", errno, strerror(errno));
+                return false;
+            }
+            if (result == 0) {
+                LOG_ERROR("Socket send timed out");
+                return false;
+            }
+            continue;
+        }
+
+        // skip past whatever was sent
+        auto sent = static_cast<size_t>(n);
+        while ((msg.msg_iovlen > 0) && (sent >= msg.msg_iov->iov_len)) {
+            sent -= msg.msg_iov->iov_len;
+            ++msg.msg_iov;
+            --msg.msg_iovlen;
+        }
+        if (msg.msg_iovlen > 0) {
+            msg.msg_iov->iov_base = static_cast<char *>(msg.msg_iov->iov_base) + sent;
+            msg.msg_iov->iov_len -= sent;
+        }
+    }
+
+    return true;
+}
+
+void OlySocket::replaceConnection(int socketID)
+{
+    if (dup3(socketID, mSocketID, O_CLOEXEC) < 0) {
+        LOG_ERROR("Unable to replace the socket connection (%d): %s", errno, strerror(errno));
+        handleException();
+    }
+    CLOSE_SOCKET(socketID);
+}
+
+void OlySocket::setCork(bool corked)
+{
+    const int value = (corked ? 1 : 0);
+    // expected to fail for non-TCP sockets, so ignore the result
+    setsockopt(mSocketID, IPPROTO_TCP, TCP_CORK, &value, sizeof(value));
+}
+#endif
+
 // Returns the number of bytes received
 int OlySocket::receive(char * buffer, int size)
 {
@@ -324,6 +407,10 @@ int OlySocket::receive(char * buffer, int size)
     }
 
     int bytes = recv(mSocketID, buffer, size, 0);
+    if ((bytes < 0) && isDisconnectError(errno)) {
+        LOG_DEBUG("Socket disconnected (%d)", errno);
+        return -1;
+    }
     if (bytes < 0) {
         LOG_ERROR("Socket receive error (%d): %s", errno, strerror(errno));
         handleException();
@@ -341,6 +428,10 @@ int OlySocket::receiveNBytes(char * buffer, int size)
     int bytes = 0;
     while (size > 0 && buffer != nullptr) {
         bytes = recv(mSocketID, buffer, size, 0);
+        if ((bytes < 0) && isDisconnectError(errno)) {
+            LOG_DEBUG("Socket disconnected (%d)", errno);
+            return -1;
+        }
         if (bytes < 0) {
             LOG_ERROR("Socket receive error (%d): %s", errno, strerror(errno));
             handleException();
@@ -368,6 +459,10 @@ int OlySocket::receiveString(char * buffer, int size)
     while (!found && bytes_received < size) {
         // Receive a single character
         int bytes = recv(mSocketID, &buffer[bytes_received], 1, 0);
+        if ((bytes < 0) && isDisconnectError(errno)) {
+            LOG_DEBUG("Socket disconnected (%d)", errno);
+            return -1;
+        }
         if (bytes < 0) {
             LOG_ERROR("Socket receive error (%d): %s", errno, strerror(errno));
             handleException();
@@ -1,4 +1,4 @@
-/* Copyright (C) 2010-2020 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2010-2022 by Arm Limited. All rights reserved. */
 
 #ifndef __OLY_SOCKET_H__
 #define __OLY_SOCKET_H__
@@ -9,6 +9,7 @@
 using socklen_t = int;
 #else
 #include <sys/socket.h>
+#include <sys/uio.h>
 #endif
 
 #include "Config.h"
@@ -25,6 +26,25 @@ public:
     void closeSocket();
     void shutdownConnection();
     void send(const char * buffer, int size);
+#ifndef WIN32
+    /**
+     * Send all the data described by `iov`, which is modified to track the progress of the send.
+     * The send fails (fatally) if no progress can be made for `timeoutMs` milliseconds.
+     */
+    void sendv(struct iovec * iov, int iovcnt, int timeoutMs);
+    /**
+     * As sendv, but returns false rather than failing when the data cannot be sent, such as when the host has
+     * disconnected
+     */
+    [[nodiscard]] bool trySendv(struct iovec * iov, int iovcnt, int timeoutMs);
+    /**
+     * Replace the connection with another, keeping the same file descriptor number so that anything that refers to
+     * this socket uses the new connection. Takes ownership of socketID.
+     */
+    void replaceConnection(int socketID);
+    /** Enable or disable TCP_CORK; has no effect on non-TCP sockets */
+    void setCork(bool corked);
+#endif
     int receive(char * buffer, int size);
     int receiveNBytes(char * buffer, int size);
     int receiveString(char * buffer, int size);
@@ -1,4 +1,4 @@
-/* Copyright (C) 2010-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2010-2022 by Arm Limited. All rights reserved. */
 
 #include "OlyUtility.h"
 
@@ -12,6 +12,9 @@
 #if defined(WIN32)
 #include <windows.h>
 #elif defined(__linux__)
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #elif defined(DARWIN)
 #include <mach-o/dyld.h>
@@ -211,14 +214,71 @@ int appendToDisk(const char * path, const char * data)
     return 0;
 }
 
+#if defined(__linux__)
 /**
- * Copies the srcFile into dstFile in 1kB chunks.
+ * Copies the srcFile into dstFile within the kernel using sendfile, which avoids copying the (possibly very large)
+ * images through user space.
+ * -1 is returned if it cannot be copied this way, and nothing was written; 0 on any other error; otherwise 1.
+ */
+static int sendFile(const char * srcFile, const char * dstFile)
+{
+    const int srcFd = open(srcFile, O_RDONLY | O_CLOEXEC);
+    if (srcFd < 0) {
+        return 0;
+    }
+
+    // only regular files have a size that can be trusted (procfs and sysfs files report zero)
+    struct stat srcStat;
+    if ((fstat(srcFd, &srcStat) != 0) || !S_ISREG(srcStat.st_mode) || (srcStat.st_size == 0)) {
+        close(srcFd);
+        return -1;
+    }
+
+    // NOLINTNEXTLINE(hicpp-signed-bitwise)
+    const int dstFd = open(dstFile, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (dstFd < 0) {
+        close(srcFd);
+        return 0;
+    }
+
+    int result = 1;
+    off_t offset = 0;
+    while (offset < srcStat.st_size) {
+        const ssize_t bytes = sendfile(dstFd, srcFd, &offset, srcStat.st_size - offset);
+        if (bytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            result = (((errno == EINVAL) || (errno == ENOSYS)) && (offset == 0) ? -1 : 0);
+            break;
+        }
+        if (bytes == 0) {
+            // the file was truncated while copying
+            break;
+        }
+    }
+
+    close(srcFd);
+    close(dstFd);
+    return result;
+}
+#endif
+
+/**
+ * Copies the srcFile into dstFile (in 64kB chunks, where it cannot be copied within the kernel).
  * The dstFile will be overwritten if it exists.
  * 0 is returned on an error; otherwise 1.
  */
-#define TRANSFER_SIZE 1024
+#define TRANSFER_SIZE (64 * 1024)
 int copyFile(const char * srcFile, const char * dstFile)
 {
+#if defined(__linux__)
+    const int result = sendFile(srcFile, dstFile);
+    if (result >= 0) {
+        return result;
+    }
+#endif
+
     char buffer[TRANSFER_SIZE];
     FILE * f_src = fopen(srcFile, "rbe");
     if (f_src == nullptr) {
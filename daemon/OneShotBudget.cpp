@@ -0,0 +1,41 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "OneShotBudget.h"
+
+#include "Logging.h"
+
+#include <cinttypes>
+#include <utility>
+
+OneShotBudget gOneShotBudget {};
+
+void OneShotBudget::reset(std::uint64_t bytes, std::function<void()> onExhausted)
+{
+    // only called whilst no source is running
+    mOnExhausted = std::move(onExhausted);
+    mRemaining.store(bytes, std::memory_order_relaxed);
+    mExhausted.store(false, std::memory_order_relaxed);
+    mLimited.store(bytes > 0, std::memory_order_release);
+}
+
+bool OneShotBudget::consume(std::uint64_t bytes)
+{
+    if (!mLimited.load(std::memory_order_acquire)) {
+        return true;
+    }
+
+    std::uint64_t remaining = mRemaining.load(std::memory_order_relaxed);
+    while (bytes <= remaining) {
+        if (mRemaining.compare_exchange_weak(remaining, remaining - bytes, std::memory_order_relaxed)) {
+            return true;
+        }
+    }
+
+    if (!mExhausted.exchange(true, std::memory_order_acq_rel)) {
+        LOG_DEBUG("One shot (%" PRIu64 " bytes left)", remaining);
+        if (mOnExhausted) {
+            mOnExhausted();
+        }
+    }
+    return false;
+}
@@ -0,0 +1,46 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#ifndef ONE_SHOT_BUDGET_H
+#define ONE_SHOT_BUDGET_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+
+/**
+ * The number of bytes a one-shot capture may send, shared by all the sources.
+ *
+ * Every frame committed to a source Buffer, and every frame received from the perf agent, consumes its size from the
+ * single global instance, so that the capture uses the whole configured buffer size whichever sources produce the
+ * data, and ends at a deterministic total size. The first frame that does not fit is dropped, as are all those after
+ * it, and the capture is ended.
+ */
+class OneShotBudget {
+public:
+    /**
+     * Set up the budget for a capture
+     *
+     * @param bytes The number of bytes the capture may send, or 0 for no limit
+     * @param onExhausted Called (once, from whichever thread) when the first frame does not fit
+     */
+    void reset(std::uint64_t bytes, std::function<void()> onExhausted);
+
+    /**
+     * Consume the bytes of a frame from the budget
+     *
+     * @return False if the frame does not fit, and so must be dropped
+     */
+    bool consume(std::uint64_t bytes);
+
+    [[nodiscard]] bool isExhausted() const { return mExhausted.load(std::memory_order_acquire); }
+
+private:
+    std::atomic_bool mLimited {false};
+    std::atomic_uint64_t mRemaining {0};
+    std::atomic_bool mExhausted {false};
+    std::function<void()> mOnExhausted {};
+};
+
+extern OneShotBudget gOneShotBudget;
+
+#endif // ONE_SHOT_BUDGET_H
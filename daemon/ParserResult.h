@@ -1,4 +1,4 @@
-/* Copyright (C) 2014-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2014-2022 by Arm Limited. All rights reserved. */
 
 #ifndef PARSERRESULT_H_
 #define PARSERRESULT_H_
@@ -22,6 +22,7 @@ public:
         LOCAL_CAPTURE,
         PRINT,
         DAEMON,
+        REPLAY,
         EXIT,
     };
 
@@ -34,6 +35,7 @@ public:
     std::vector<SpeConfiguration> mSpeConfigs {};
     std::vector<std::string> mCaptureCommand {};
     std::set<int> mPids {};
+    std::string mCgroup {};
     std::map<std::string, EventCode> events {};
     std::set<Printable> printables {};
 
@@ -51,6 +53,7 @@ public:
     const char * pmuPath {nullptr};
     const char * mAndroidPackage {nullptr};
     const char * mAndroidActivity {nullptr};
+    const char * mReplayApcDir {nullptr};
 
     int mBacktraceDepth {0};
     int mSampleRate {0};
@@ -58,6 +61,7 @@ public:
     int mAndroidApiLevel {0};
     int mPerfMmapSizeInPages {-1};
     int mSpeSampleRate {-1};
+    int mPmuMultiplexQuantumMs {0};
     int port {DEFAULT_PORT};
 
     bool mFtraceRaw {false};
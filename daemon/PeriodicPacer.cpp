@@ -0,0 +1,126 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "PeriodicPacer.h"
+
+#include "Logging.h"
+#include "SessionData.h"
+#include "ThreadPlacement.h"
+#include "Time.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <ctime>
+
+#include <sched.h>
+#include <sys/prctl.h>
+
+namespace {
+    std::uint64_t getMonotonicNs()
+    {
+        timespec now {};
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return (std::uint64_t(now.tv_sec) * NS_PER_S) + now.tv_nsec;
+    }
+
+    /** In the low-wakeup mode, every loop is paced to at least the session's period, so they all wake together */
+    std::chrono::nanoseconds coarsen(std::chrono::nanoseconds period)
+    {
+        return std::max(period, std::chrono::nanoseconds(gSessionData.mLowWakeupSeconds * NS_PER_S));
+    }
+
+    std::size_t getHistogramBucket(std::chrono::nanoseconds lateness)
+    {
+        const auto & limits = PeriodicPacer::HISTOGRAM_LIMITS;
+        return std::upper_bound(limits.begin(), limits.end(), lateness) - limits.begin();
+    }
+}
+
+void PeriodicPacer::configureThread(const char * name)
+{
+    prctl(PR_SET_NAME, reinterpret_cast<unsigned long>(name), 0, 0, 0);
+
+    // the default 50us slack would be most of the permitted jitter at 1 kHz (it does not apply to SCHED_FIFO), but in
+    // the low-wakeup mode the loops should rather be batched with the other wakeups
+    const std::uint64_t timerSlackNs = thread_placement::getTimerSlackNs();
+    prctl(PR_SET_TIMERSLACK, (timerSlackNs != 0 ? static_cast<unsigned long>(timerSlackNs) : 1UL), 0, 0, 0);
+
+    if (gSessionData.mPollingCpu >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(gSessionData.mPollingCpu, &cpus);
+        if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0) {
+            LOG_WARNING("Unable to pin %s to cpu %d (%d)", name, gSessionData.mPollingCpu, errno);
+        }
+    }
+
+    if (gSessionData.mRealtimePolling) {
+        // the lowest priority is enough to preempt the workload, which will be SCHED_OTHER
+        sched_param param {};
+        param.sched_priority = sched_get_priority_min(SCHED_FIFO);
+        if (sched_setscheduler(0, SCHED_FIFO, &param) != 0) {
+            LOG_WARNING("Unable to make %s SCHED_FIFO (%d)", name, errno);
+        }
+    }
+}
+
+PeriodicPacer::PeriodicPacer(std::chrono::nanoseconds period, bool aligned)
+    : mStats {coarsen(period), 0, 0, std::chrono::nanoseconds::zero(), {}},
+      mDeadlineNs(getMonotonicNs()),
+      mAligned(aligned)
+{
+    if (aligned) {
+        const std::uint64_t periodNs = mStats.period.count();
+        mDeadlineNs += periodNs - (mDeadlineNs % periodNs);
+    }
+}
+
+void PeriodicPacer::setPeriod(std::chrono::nanoseconds period)
+{
+    mStats.period = coarsen(period);
+
+    if (!mAligned) {
+        return;
+    }
+
+    // the next deadline becomes the first multiple of the new period after the current one (or, before the first
+    // wait, the first multiple at or after it)
+    const std::uint64_t periodNs = mStats.period.count();
+    if (mFirst) {
+        mDeadlineNs += (periodNs - (mDeadlineNs % periodNs)) % periodNs;
+    }
+    else {
+        mDeadlineNs -= mDeadlineNs % periodNs;
+    }
+}
+
+std::uint64_t PeriodicPacer::wait()
+{
+    const std::uint64_t periodNs = mStats.period.count();
+
+    if (!mFirst) {
+        mDeadlineNs += periodNs;
+    }
+    mFirst = false;
+
+    std::uint64_t skipped = 0;
+    const std::uint64_t nowNs = getMonotonicNs();
+    if (nowNs > mDeadlineNs) {
+        // overran; run now, from the most recent deadline
+        skipped = (nowNs - mDeadlineNs) / periodNs;
+        mDeadlineNs += skipped * periodNs;
+    }
+    else {
+        const timespec deadline {static_cast<time_t>(mDeadlineNs / NS_PER_S),
+                                 static_cast<long>(mDeadlineNs % NS_PER_S)};
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) == EINTR) {
+        }
+    }
+
+    const auto lateness = std::chrono::nanoseconds(getMonotonicNs() - mDeadlineNs);
+    mStats.periods += 1;
+    mStats.missed += skipped;
+    mStats.maxLateness = std::max(mStats.maxLateness, lateness);
+    mStats.histogram[getHistogramBucket(lateness)] += 1;
+
+    return skipped;
+}
@@ -0,0 +1,85 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#ifndef PERIODIC_PACER_H
+#define PERIODIC_PACER_H
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Paces a polling loop to a fixed period.
+ *
+ * Each wait sleeps until an absolute CLOCK_MONOTONIC deadline (so time spent in the loop body does not accumulate as
+ * drift), and records how late the thread was woken relative to the deadline so that the achieved sample spacing can
+ * be reported at the end of the capture.
+ *
+ * Aligned pacers share a single tick, as their deadlines are the multiples of their period since the clock's epoch.
+ * So the loops of every polled source with the same period (or with periods that are multiples of each other) read
+ * their counters at the same instants, and the kernel expires their timers together, rather than each source waking
+ * at its own offset from whenever it happened to start.
+ *
+ * In the session's low-wakeup mode, every period is lengthened to at least the low-wakeup period.
+ */
+class PeriodicPacer {
+public:
+    /** The number of lateness histogram buckets */
+    static constexpr std::size_t HISTOGRAM_BUCKETS = 8;
+    /** The exclusive upper bound of each histogram bucket but the last, which holds everything else */
+    static constexpr std::array<std::chrono::microseconds, HISTOGRAM_BUCKETS - 1> HISTOGRAM_LIMITS {
+        std::chrono::microseconds(10),
+        std::chrono::microseconds(20),
+        std::chrono::microseconds(50),
+        std::chrono::microseconds(100),
+        std::chrono::microseconds(200),
+        std::chrono::microseconds(500),
+        std::chrono::microseconds(1000),
+    };
+
+    struct Stats {
+        std::chrono::nanoseconds period;
+        /** The number of deadlines that were waited for */
+        std::uint64_t periods;
+        /** The number of deadlines that were skipped because the loop body overran them */
+        std::uint64_t missed;
+        /** The longest time between a deadline and the thread waking */
+        std::chrono::nanoseconds maxLateness;
+        /** The number of wakeups by lateness */
+        std::array<std::uint64_t, HISTOGRAM_BUCKETS> histogram;
+    };
+
+    /**
+     * Prepare the calling thread to run a paced loop: name it, remove its timer slack (or in the low-wakeup mode, make
+     * it large), and if configured in the session make it SCHED_FIFO and pin it to the chosen cpu.
+     */
+    static void configureThread(const char * name);
+
+    /**
+     * @param period The loop period
+     * @param aligned True to put the deadlines on multiples of the period (the shared tick), false to start from now
+     */
+    explicit PeriodicPacer(std::chrono::nanoseconds period, bool aligned = false);
+
+    /**
+     * Sleep until the next deadline. If the deadline has already passed then any further deadlines that have also
+     * passed are skipped and it returns immediately.
+     *
+     * @return The number of deadlines skipped
+     */
+    std::uint64_t wait();
+
+    /** Change the period, from the next deadline on; an aligned pacer stays aligned to the new period */
+    void setPeriod(std::chrono::nanoseconds period);
+
+    [[nodiscard]] const Stats & getStats() const { return mStats; }
+
+private:
+    Stats mStats;
+    /** The current deadline, in CLOCK_MONOTONIC nanoseconds */
+    std::uint64_t mDeadlineNs;
+    bool mAligned;
+    bool mFirst {true};
+};
+
+#endif // PERIODIC_PACER_H
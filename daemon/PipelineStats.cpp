@@ -0,0 +1,203 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "PipelineStats.h"
+
+#include "Logging.h"
+#include "lib/Resource.h"
+
+#include <cinttypes>
+#include <cstdio>
+
+PipelineStats gPipelineStats {};
+
+namespace {
+    template<typename T>
+    void updateMax(std::atomic<T> & max, T value)
+    {
+        T current = max.load(std::memory_order_relaxed);
+        while ((value > current) && !max.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    double toMilliseconds(std::chrono::nanoseconds value)
+    {
+        return std::chrono::duration<double, std::milli>(value).count();
+    }
+
+    std::int64_t steadyNowNs()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+}
+
+void PipelineStats::onAgentStats(std::uint32_t peakMmapFill,
+                                 std::uint32_t ipcQueueDepth,
+                                 std::uint64_t cpuTimeUs,
+                                 std::uint64_t maxRssKiB,
+                                 std::uint64_t wakeups,
+                                 std::uint64_t lostRecords,
+                                 std::uint64_t lostSamples,
+                                 std::uint64_t truncatedAuxRecords,
+                                 std::uint64_t oneShotDroppedBytes)
+{
+    updateMax(mIntervalMmapFill, peakMmapFill);
+    updateMax(mPeakMmapFill, peakMmapFill);
+    mIpcQueueDepth.store(ipcQueueDepth, std::memory_order_relaxed);
+    updateMax(mPeakIpcQueueDepth, ipcQueueDepth);
+    mAgentCpuTimeUs.store(cpuTimeUs, std::memory_order_relaxed);
+    mAgentMaxRssKiB.store(maxRssKiB, std::memory_order_relaxed);
+    mAgentWakeups.store(wakeups, std::memory_order_relaxed);
+    mLostRecords.store(lostRecords, std::memory_order_relaxed);
+    mLostSamples.store(lostSamples, std::memory_order_relaxed);
+    mTruncatedAuxRecords.store(truncatedAuxRecords, std::memory_order_relaxed);
+    mOneShotDroppedBytes.store(oneShotDroppedBytes, std::memory_order_relaxed);
+}
+
+void PipelineStats::onAgentData(std::size_t bytes)
+{
+    mAgentBytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void PipelineStats::onBufferCommitted(int bytes)
+{
+    const auto buffered = mBufferedBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    updateMax(mPeakBufferedBytes, buffered);
+}
+
+void PipelineStats::onBufferConsumed(int bytes)
+{
+    mBufferedBytes.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+void PipelineStats::onSenderWrite(std::size_t bytes, std::chrono::nanoseconds latency)
+{
+    const auto latencyNs = static_cast<std::uint64_t>(latency.count());
+
+    mSenderBytes.fetch_add(bytes, std::memory_order_relaxed);
+    mSenderWrites.fetch_add(1, std::memory_order_relaxed);
+    mSenderWriteNs.fetch_add(latencyNs, std::memory_order_relaxed);
+    updateMax(mSenderMaxWriteNs, latencyNs);
+    updateMax(mIntervalSenderMaxWriteNs, latencyNs);
+}
+
+void PipelineStats::onPollingLoopEnd(std::string name, const PeriodicPacer::Stats & stats)
+{
+    const std::lock_guard<std::mutex> lock {mPollingLoopsMutex};
+    mPollingLoops.emplace_back(std::move(name), stats);
+}
+
+std::chrono::microseconds PipelineStats::getCpuTime() const
+{
+    return std::chrono::microseconds {lib::getSelfResourceUsage().cpuTimeUs
+                                      + mAgentCpuTimeUs.load(std::memory_order_relaxed)};
+}
+
+std::uint64_t PipelineStats::getMaxRssKiB() const
+{
+    return lib::getSelfResourceUsage().maxRssKiB + mAgentMaxRssKiB.load(std::memory_order_relaxed);
+}
+
+void PipelineStats::onStopRequested()
+{
+    std::int64_t expected = 0;
+    mStopRequestedNs.compare_exchange_strong(expected, steadyNowNs(), std::memory_order_relaxed);
+}
+
+PipelineStats::Summary PipelineStats::getSummary() const
+{
+    const auto shellUsage = lib::getSelfResourceUsage();
+    const auto stopRequestedNs = mStopRequestedNs.load(std::memory_order_relaxed);
+
+    return {
+        mAgentBytes.load(std::memory_order_relaxed),
+        mPeakMmapFill.load(std::memory_order_relaxed),
+        mPeakIpcQueueDepth.load(std::memory_order_relaxed),
+        static_cast<std::uint64_t>(mPeakBufferedBytes.load(std::memory_order_relaxed)),
+        mSenderBytes.load(std::memory_order_relaxed),
+        mSenderWrites.load(std::memory_order_relaxed),
+        std::chrono::nanoseconds {mSenderWriteNs.load(std::memory_order_relaxed)},
+        std::chrono::nanoseconds {mSenderMaxWriteNs.load(std::memory_order_relaxed)},
+        std::chrono::microseconds {shellUsage.cpuTimeUs},
+        std::chrono::microseconds {mAgentCpuTimeUs.load(std::memory_order_relaxed)},
+        shellUsage.maxRssKiB,
+        mAgentMaxRssKiB.load(std::memory_order_relaxed),
+        shellUsage.wakeups,
+        mAgentWakeups.load(std::memory_order_relaxed),
+        mLostRecords.load(std::memory_order_relaxed),
+        mLostSamples.load(std::memory_order_relaxed),
+        mTruncatedAuxRecords.load(std::memory_order_relaxed),
+        mOneShotDroppedBytes.load(std::memory_order_relaxed),
+        std::chrono::nanoseconds {stopRequestedNs != 0 ? steadyNowNs() - stopRequestedNs : 0},
+    };
+}
+
+void PipelineStats::logSummary() const
+{
+    const auto summary = getSummary();
+
+    LOG_INFO("Capture pipeline summary:\n"
+             "  perf agent: peak ring buffer fill %.1f%%, peak IPC queue depth %" PRIu32 "\n"
+             "  agents: %" PRIu64 " bytes received\n"
+             "  buffers: peak %" PRIu64 " bytes waiting to be sent\n"
+             "  sender: %" PRIu64 " bytes in %" PRIu64 " writes, mean write %.3f ms, max write %.3f ms\n"
+             "  resources: gatord %.3f s CPU, %" PRIu64 " KiB peak RSS, %" PRIu64 " wakeups; perf agent %.3f s CPU, %"
+             PRIu64 " KiB peak RSS, %" PRIu64 " wakeups",
+             (summary.peakMmapFill * 100.0) / MMAP_FILL_SCALE,
+             summary.peakIpcQueueDepth,
+             summary.agentBytes,
+             summary.peakBufferedBytes,
+             summary.senderBytes,
+             summary.senderWrites,
+             (summary.senderWrites > 0 ? toMilliseconds(summary.senderWriteTime) / summary.senderWrites : 0.0),
+             toMilliseconds(summary.senderMaxWriteTime),
+             std::chrono::duration<double>(summary.shellCpuTime).count(),
+             summary.shellMaxRssKiB,
+             summary.shellWakeups,
+             std::chrono::duration<double>(summary.agentCpuTime).count(),
+             summary.agentMaxRssKiB,
+             summary.agentWakeups);
+
+    if ((summary.lostRecords != 0) || (summary.lostSamples != 0) || (summary.truncatedAuxRecords != 0)) {
+        LOG_WARNING("The kernel lost %" PRIu64 " perf records (the ring buffers were full) and %" PRIu64
+                    " samples, and truncated %" PRIu64
+                    " aux records; consider increasing --mmap-pages or reducing the sample rate",
+                    summary.lostRecords,
+                    summary.lostSamples,
+                    summary.truncatedAuxRecords);
+    }
+    if (summary.stopLatency.count() != 0) {
+        LOG_INFO("  stop: the capture ended %.3f ms after it was asked to stop", toMilliseconds(summary.stopLatency));
+    }
+    if (summary.oneShotDroppedBytes != 0) {
+        LOG_INFO("  perf agent: %" PRIu64 " bytes discarded after the one-shot limit was reached or the capture ended",
+                 summary.oneShotDroppedBytes);
+    }
+
+    const std::lock_guard<std::mutex> lock {mPollingLoopsMutex};
+    for (const auto & [name, stats] : mPollingLoops) {
+        std::string histogram;
+        for (std::size_t i = 0; i < stats.histogram.size(); ++i) {
+            char bucket[48];
+            if (i < PeriodicPacer::HISTOGRAM_LIMITS.size()) {
+                snprintf(bucket,
+                         sizeof(bucket),
+                         " <%" PRIi64 "us:%" PRIu64,
+                         static_cast<std::int64_t>(PeriodicPacer::HISTOGRAM_LIMITS[i].count()),
+                         stats.histogram[i]);
+            }
+            else {
+                snprintf(bucket, sizeof(bucket), " more:%" PRIu64, stats.histogram[i]);
+            }
+            histogram += bucket;
+        }
+
+        LOG_INFO("  %s: period %.3f ms, %" PRIu64 " periods, %" PRIu64 " missed, max lateness %.3f ms, lateness%s",
+                 name.c_str(),
+                 toMilliseconds(stats.period),
+                 stats.periods,
+                 stats.missed,
+                 toMilliseconds(stats.maxLateness),
+                 histogram.c_str());
+    }
+}
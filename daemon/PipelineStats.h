@@ -0,0 +1,133 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#ifndef PIPELINE_STATS_H
+#define PIPELINE_STATS_H
+
+#include "PeriodicPacer.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Self-profiling statistics for each stage of the capture pipeline, from the perf ring buffers in the perf agent,
+ * through the IPC channel and the source Buffers, to the Sender.
+ *
+ * Each stage records into the single global instance. The values are sampled by InternalsDriver, which publishes them
+ * as the "Gator Internals" counters, and are logged as a summary at the end of the capture.
+ */
+class PipelineStats {
+public:
+    struct Summary {
+        std::uint64_t agentBytes;
+        std::uint32_t peakMmapFill;
+        std::uint32_t peakIpcQueueDepth;
+        std::uint64_t peakBufferedBytes;
+        std::uint64_t senderBytes;
+        std::uint64_t senderWrites;
+        std::chrono::nanoseconds senderWriteTime;
+        std::chrono::nanoseconds senderMaxWriteTime;
+        std::chrono::microseconds shellCpuTime;
+        std::chrono::microseconds agentCpuTime;
+        std::uint64_t shellMaxRssKiB;
+        std::uint64_t agentMaxRssKiB;
+        std::uint64_t shellWakeups;
+        std::uint64_t agentWakeups;
+        std::uint64_t lostRecords;
+        std::uint64_t lostSamples;
+        std::uint64_t truncatedAuxRecords;
+        std::uint64_t oneShotDroppedBytes;
+        /** The time from the stop request until now, or 0 if the capture was not stopped */
+        std::chrono::nanoseconds stopLatency;
+    };
+
+    /** The scale of the mmap fill values, i.e. they are in parts per thousand */
+    static constexpr std::uint32_t MMAP_FILL_SCALE = 1000;
+
+    /** Record the state reported by the perf agent (the losses are running totals) */
+    void onAgentStats(std::uint32_t peakMmapFill,
+                      std::uint32_t ipcQueueDepth,
+                      std::uint64_t cpuTimeUs,
+                      std::uint64_t maxRssKiB,
+                      std::uint64_t wakeups,
+                      std::uint64_t lostRecords,
+                      std::uint64_t lostSamples,
+                      std::uint64_t truncatedAuxRecords,
+                      std::uint64_t oneShotDroppedBytes);
+    /** Record some data received from an agent */
+    void onAgentData(std::size_t bytes);
+    /** Record some data committed to a Buffer */
+    void onBufferCommitted(int bytes);
+    /** Record some data sent from a Buffer */
+    void onBufferConsumed(int bytes);
+    /** Record a call to Sender::writeDataParts */
+    void onSenderWrite(std::size_t bytes, std::chrono::nanoseconds latency);
+    /** Record the achieved timing of a paced polling loop once it has finished */
+    void onPollingLoopEnd(std::string name, const PeriodicPacer::Stats & stats);
+    /** Record that the capture was asked to stop (only the first request is kept) */
+    void onStopRequested();
+
+    /** @return The peak mmap fill since the last call */
+    std::uint32_t takePeakMmapFill() { return mIntervalMmapFill.exchange(0, std::memory_order_relaxed); }
+    /** @return The most recently reported IPC queue depth */
+    [[nodiscard]] std::uint32_t getIpcQueueDepth() const { return mIpcQueueDepth.load(std::memory_order_relaxed); }
+    /** @return The total data received from the agents */
+    [[nodiscard]] std::uint64_t getAgentBytes() const { return mAgentBytes.load(std::memory_order_relaxed); }
+    /** @return The amount of data currently held in the Buffers */
+    [[nodiscard]] std::int64_t getBufferedBytes() const { return mBufferedBytes.load(std::memory_order_relaxed); }
+    /** @return The total number of perf records and samples that the kernel reported as lost */
+    [[nodiscard]] std::uint64_t getLostRecords() const
+    {
+        return mLostRecords.load(std::memory_order_relaxed) + mLostSamples.load(std::memory_order_relaxed);
+    }
+    /** @return The total data written by the Sender */
+    [[nodiscard]] std::uint64_t getSenderBytes() const { return mSenderBytes.load(std::memory_order_relaxed); }
+    /** @return The total CPU time used by gatord and its perf agent */
+    [[nodiscard]] std::chrono::microseconds getCpuTime() const;
+    /** @return The sum of the peak resident set sizes of gatord and its perf agent, in KiB */
+    [[nodiscard]] std::uint64_t getMaxRssKiB() const;
+    /** @return The longest Sender write since the last call */
+    std::chrono::nanoseconds takeSenderMaxWriteTime()
+    {
+        return std::chrono::nanoseconds {mIntervalSenderMaxWriteNs.exchange(0, std::memory_order_relaxed)};
+    }
+
+    /** @return The totals and peaks for the whole capture */
+    [[nodiscard]] Summary getSummary() const;
+
+    /** Log the summary */
+    void logSummary() const;
+
+private:
+    std::atomic<std::uint32_t> mIntervalMmapFill {0};
+    std::atomic<std::uint32_t> mPeakMmapFill {0};
+    std::atomic<std::uint32_t> mIpcQueueDepth {0};
+    std::atomic<std::uint32_t> mPeakIpcQueueDepth {0};
+    std::atomic<std::uint64_t> mAgentCpuTimeUs {0};
+    std::atomic<std::uint64_t> mAgentMaxRssKiB {0};
+    std::atomic<std::uint64_t> mAgentWakeups {0};
+    std::atomic<std::uint64_t> mLostRecords {0};
+    std::atomic<std::uint64_t> mLostSamples {0};
+    std::atomic<std::uint64_t> mTruncatedAuxRecords {0};
+    std::atomic<std::uint64_t> mOneShotDroppedBytes {0};
+    std::atomic<std::uint64_t> mAgentBytes {0};
+    std::atomic<std::int64_t> mBufferedBytes {0};
+    std::atomic<std::int64_t> mPeakBufferedBytes {0};
+    std::atomic<std::uint64_t> mSenderBytes {0};
+    std::atomic<std::uint64_t> mSenderWrites {0};
+    std::atomic<std::uint64_t> mSenderWriteNs {0};
+    std::atomic<std::uint64_t> mSenderMaxWriteNs {0};
+    std::atomic<std::uint64_t> mIntervalSenderMaxWriteNs {0};
+    /** The steady clock time of the stop request, in ns, or 0 if there was none */
+    std::atomic<std::int64_t> mStopRequestedNs {0};
+    mutable std::mutex mPollingLoopsMutex {};
+    std::vector<std::pair<std::string, PeriodicPacer::Stats>> mPollingLoops {};
+};
+
+extern PipelineStats gPipelineStats;
+
+#endif // PIPELINE_STATS_H
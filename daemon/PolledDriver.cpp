@@ -1,8 +1,16 @@
-/* Copyright (C) 2013-2020 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2013-2022 by Arm Limited. All rights reserved. */
 
 #include "PolledDriver.h"
 
 #include "IBlockCounterFrameBuilder.h"
+#include "SessionData.h"
+#include "Time.h"
+
+#include <algorithm>
+
+namespace {
+    constexpr int MAX_HIGH_POLL_RATE = 1000;
+}
 
 void PolledDriver::read(IBlockCounterFrameBuilder & buffer)
 {
@@ -13,3 +21,11 @@ void PolledDriver::read(IBlockCounterFrameBuilder & buffer)
         buffer.event64(counter->getKey(), counter->read());
     }
 }
+
+std::chrono::nanoseconds PolledDriver::getHighRatePollPeriod()
+{
+    if (gSessionData.mSampleRate <= 0) {
+        return DEFAULT_POLL_PERIOD;
+    }
+    return std::chrono::nanoseconds(NS_PER_S / std::min(gSessionData.mSampleRate, MAX_HIGH_POLL_RATE));
+}
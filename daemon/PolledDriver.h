@@ -1,14 +1,19 @@
-/* Copyright (C) 2013-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2013-2022 by Arm Limited. All rights reserved. */
 
 #ifndef NATIVE_GATOR_DAEMON_POLLEDDRIVER_H_
 #define NATIVE_GATOR_DAEMON_POLLEDDRIVER_H_
 
 #include "SimpleDriver.h"
 
+#include <chrono>
+
 class IBlockCounterFrameBuilder;
 
 class PolledDriver : public SimpleDriver {
 public:
+    /** The polling period used unless a driver specifies otherwise */
+    static constexpr std::chrono::nanoseconds DEFAULT_POLL_PERIOD = std::chrono::milliseconds(100);
+
     // Intentionally unimplemented
     PolledDriver(const PolledDriver &) = delete;
     PolledDriver & operator=(const PolledDriver &) = delete;
@@ -16,10 +21,37 @@ public:
     PolledDriver & operator=(PolledDriver &&) = delete;
 
     virtual void start() {}
+
+    /** Called once polling has ended, to release anything that start acquired (such as device state it changed) */
+    virtual void stop() {}
+
+    /**
+     * Read the current values from the driver's sources, ready for the next call to read.
+     *
+     * For each poll, this is called on every driver in the group, one after the other, before read is called on any of
+     * them. So the values of a poll are read as close together as possible, and the writing of the frame does not delay
+     * the reading of the later drivers. Drivers that read their values in read need not implement it.
+     */
+    virtual void sample() {}
     virtual void read(IBlockCounterFrameBuilder & buffer);
 
+    /** @return How often read should be called; drivers with the same period are read together */
+    [[nodiscard]] virtual std::chrono::nanoseconds getPollPeriod() const { return DEFAULT_POLL_PERIOD; }
+
+    /**
+     * @return True if read may take long enough (for example because it waits on a slow bus or a library call) that it
+     * would disturb the timing of other drivers, so should be called from a separate thread
+     */
+    [[nodiscard]] virtual bool isSlowToRead() const { return false; }
+
 protected:
     PolledDriver(const char * name) : SimpleDriver(name) {}
+
+    /**
+     * @return The polling period for drivers whose values change quickly, which follows the session sample rate but is
+     * limited to at most 1 kHz
+     */
+    static std::chrono::nanoseconds getHighRatePollPeriod();
 };
 
 #endif /* NATIVE_GATOR_DAEMON_POLLEDDRIVER_H_ */
@@ -0,0 +1,208 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "PressureDriver.h"
+
+#include "Logging.h"
+#include "SessionData.h"
+#include "lib/DirectoryFd.h"
+#include "lib/String.h"
+#include "lib/Syscall.h"
+#include "linux/proc/ProcFieldParser.h"
+
+#include <cstring>
+#include <optional>
+#include <string_view>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+namespace {
+    /**
+     * A stall event is when tasks are stalled for at least 300ms within 2s. Without CAP_SYS_RESOURCE, the kernel only
+     * accepts windows that are a multiple of 2s.
+     */
+    constexpr char TRIGGER[] = "some 300000 2000000";
+
+    using path_str_t = lib::printf_str_t<32>;
+
+    class PressureCounter : public DriverCounter {
+    public:
+        PressureCounter(DriverCounter * next, const char * name, uint64_t * value);
+
+        // Intentionally unimplemented
+        PressureCounter(const PressureCounter &) = delete;
+        PressureCounter & operator=(const PressureCounter &) = delete;
+        PressureCounter(PressureCounter &&) = delete;
+        PressureCounter & operator=(PressureCounter &&) = delete;
+
+        int64_t read() override;
+
+    private:
+        uint64_t * const mValue;
+        uint64_t mPrev;
+    };
+
+    PressureCounter::PressureCounter(DriverCounter * next, const char * const name, uint64_t * const value)
+        : DriverCounter(next, name), mValue(value), mPrev(0)
+    {
+    }
+
+    int64_t PressureCounter::read()
+    {
+        int64_t result = *mValue - mPrev;
+        mPrev = *mValue;
+        return result;
+    }
+
+    /** Parse the total of a "some avg10=... avg60=... avg300=... total=..." line */
+    bool parseTotal(std::string_view line, uint64_t & total)
+    {
+        constexpr std::string_view TOTAL {"total="};
+
+        lnx::ProcFieldParser fields {line};
+        fields.nextField();
+
+        for (auto field = fields.nextField(); !field.empty(); field = fields.nextField()) {
+            if (field.substr(0, TOTAL.size()) == TOTAL) {
+                return lnx::ProcFieldParser {field.substr(TOTAL.size())}.next(total);
+            }
+        }
+
+        return false;
+    }
+}
+
+void PressureDriver::readEvents(mxml_node_t * const /*unused*/)
+{
+    bool any = false;
+
+    for (auto & resource : mResources) {
+        path_str_t path {"/proc/pressure/%s", resource.name};
+        if (lib::access(path, R_OK) != 0) {
+            continue;
+        }
+
+        lib::printf_str_t<64> name {"Linux_pressure_%s_some", resource.name};
+        resource.someCounter = new PressureCounter(getCounters(), name.c_str(), &resource.someTotal);
+        setCounters(resource.someCounter);
+
+        if (resource.hasFull) {
+            name.printf("Linux_pressure_%s_full", resource.name);
+            resource.fullCounter = new PressureCounter(getCounters(), name.c_str(), &resource.fullTotal);
+            setCounters(resource.fullCounter);
+        }
+
+        // a trigger can only be created by writing to the file
+        if (lib::access(path, W_OK) == 0) {
+            name.printf("Linux_pressure_%s_events", resource.name);
+            resource.eventsCounter = new PressureCounter(getCounters(), name.c_str(), &resource.events);
+            setCounters(resource.eventsCounter);
+        }
+
+        any = true;
+    }
+
+    if (!any) {
+        LOG_SETUP("Linux counters\nCannot access /proc/pressure. Pressure stall counters not available.");
+    }
+}
+
+bool PressureDriver::doRead()
+{
+    std::array<pollfd, std::tuple_size_v<decltype(mResources)>> triggers {};
+    std::size_t numTriggers = 0;
+
+    for (auto & resource : mResources) {
+        if (resource.triggerFd) {
+            triggers[numTriggers++] = pollfd {*resource.triggerFd, POLLPRI, 0};
+        }
+
+        if (!resource.fd) {
+            continue;
+        }
+
+        const std::optional<std::string_view> contents = lib::DirectoryFd::readContents(*resource.fd, mBuf);
+        if (!contents) {
+            return false;
+        }
+
+        std::string_view remaining = *contents;
+        while (!remaining.empty()) {
+            const std::string_view line = lnx::ProcFieldParser::nextLine(remaining);
+            if (line.substr(0, 4) == "some") {
+                parseTotal(line, resource.someTotal);
+            }
+            else if (line.substr(0, 4) == "full") {
+                parseTotal(line, resource.fullTotal);
+            }
+        }
+    }
+
+    // the kernel clears the event when it is polled, so each fired trigger is counted once
+    if ((numTriggers > 0) && (lib::poll(triggers.data(), numTriggers, 0) > 0)) {
+        std::size_t index = 0;
+        for (auto & resource : mResources) {
+            if (!resource.triggerFd) {
+                continue;
+            }
+            const auto revents = triggers[index++].revents;
+            if ((revents & POLLPRI) != 0) {
+                resource.events += 1;
+            }
+            if ((revents & (POLLERR | POLLNVAL)) != 0) {
+                LOG_DEBUG("The %s pressure trigger failed", resource.name);
+                resource.triggerFd.close();
+            }
+        }
+    }
+
+    return true;
+}
+
+void PressureDriver::start()
+{
+    for (auto & resource : mResources) {
+        const bool stallsEnabled = ((resource.someCounter != nullptr) && resource.someCounter->isEnabled())
+                                || ((resource.fullCounter != nullptr) && resource.fullCounter->isEnabled());
+        const bool eventsEnabled = (resource.eventsCounter != nullptr) && resource.eventsCounter->isEnabled();
+
+        path_str_t path {"/proc/pressure/%s", resource.name};
+
+        if (stallsEnabled) {
+            resource.fd = lib::AutoClosingFd {lib::open(path, O_RDONLY | O_CLOEXEC)};
+        }
+
+        if (eventsEnabled) {
+            resource.triggerFd = lib::AutoClosingFd {lib::open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC)};
+            // the trigger lasts until the fd is closed
+            if (resource.triggerFd
+                && (lib::write(*resource.triggerFd, TRIGGER, std::strlen(TRIGGER) + 1) < 0)) {
+                LOG_SETUP("Linux counters\nCannot create a %s pressure trigger. Pressure stall event counters not "
+                          "available.",
+                          resource.name);
+                resource.triggerFd.close();
+            }
+        }
+    }
+
+    if (!doRead()) {
+        LOG_ERROR("Unable to read pressure stall information");
+        handleException();
+    }
+    // Initialize previous values
+    for (DriverCounter * counter = getCounters(); counter != nullptr; counter = counter->getNext()) {
+        if (!counter->isEnabled()) {
+            continue;
+        }
+        counter->read();
+    }
+}
+
+void PressureDriver::sample()
+{
+    if (!doRead()) {
+        LOG_ERROR("Unable to read pressure stall information");
+        handleException();
+    }
+}
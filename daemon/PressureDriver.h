@@ -0,0 +1,64 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#ifndef PRESSUREDRIVER_H
+#define PRESSUREDRIVER_H
+
+#include "PolledDriver.h"
+#include "lib/AutoClosingFd.h"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Reads the pressure stall information (PSI) in /proc/pressure. For each resource this counts the time for which some
+ * (and, for memory and io, all) non-idle tasks were stalled waiting for it, and the number of stall events, where a
+ * stall event is when the 'some' stall time exceeds a threshold within a window of time.
+ *
+ * The stall events are detected by the kernel using PSI triggers, so that they are not missed between polls, and
+ * each poll only checks whether the trigger has fired since the previous one rather than reading anything.
+ */
+class PressureDriver : public PolledDriver {
+public:
+    PressureDriver() : PolledDriver("Pressure") {}
+
+    // Intentionally unimplemented
+    PressureDriver(const PressureDriver &) = delete;
+    PressureDriver & operator=(const PressureDriver &) = delete;
+    PressureDriver(PressureDriver &&) = delete;
+    PressureDriver & operator=(PressureDriver &&) = delete;
+
+    void readEvents(mxml_node_t * root) override;
+    void start() override;
+    void sample() override;
+
+    // the events are timestamped by the poll that sees them, so poll quickly
+    [[nodiscard]] std::chrono::nanoseconds getPollPeriod() const override { return getHighRatePollPeriod(); }
+
+private:
+    struct Resource {
+        const char * name;
+        bool hasFull;
+        DriverCounter * someCounter;
+        DriverCounter * fullCounter;
+        DriverCounter * eventsCounter;
+        /** The PSI file, kept open between polls and reread from the start */
+        lib::AutoClosingFd fd;
+        /** A second open of the PSI file, with the trigger attached */
+        lib::AutoClosingFd triggerFd;
+        uint64_t someTotal;
+        uint64_t fullTotal;
+        uint64_t events;
+    };
+
+    bool doRead();
+
+    std::array<Resource, 3> mResources {{
+        {"cpu", false, nullptr, nullptr, nullptr, {}, {}, 0, 0, 0},
+        {"memory", true, nullptr, nullptr, nullptr, {}, {}, 0, 0, 0},
+        {"io", true, nullptr, nullptr, nullptr, {}, {}, 0, 0, 0},
+    }};
+    std::vector<char> mBuf {};
+};
+
+#endif // PRESSUREDRIVER_H
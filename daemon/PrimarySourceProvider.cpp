@@ -2,6 +2,8 @@
 
 #include "PrimarySourceProvider.h"
 
+#include "BpfDriver.h"
+#include "CgroupDriver.h"
 #include "Child.h"
 #include "Config.h"
 #include "CpuUtils.h"
@@ -9,10 +11,13 @@
 #include "FSDriver.h"
 #include "HwmonDriver.h"
 #include "ICpuInfo.h"
+#include "IioDriver.h"
 #include "ISender.h"
 #include "Logging.h"
 #include "MemInfoDriver.h"
 #include "NetDriver.h"
+#include "PressureDriver.h"
+#include "ResctrlDriver.h"
 #include "SessionData.h"
 #include "lib/FsEntry.h"
 #include "lib/Utils.h"
@@ -151,6 +156,11 @@ namespace {
             return driver.getConfig().use_ftrace_for_cpu_frequency;
         }
 
+        [[nodiscard]] bool supportsGpuFrequencyTracepoint() const override
+        {
+            return driver.hasGpuFrequencyTracepoint();
+        }
+
         [[nodiscard]] bool supportsMultiEbs() const override { return true; }
 
         [[nodiscard]] const char * getPrepareFailedMessage() const override
@@ -194,15 +204,28 @@ namespace {
                                         agent_workers_process);
         }
 
+        bool reconfigureCounters(const std::set<CounterConfiguration> & counterConfigurations,
+                                 sem_t & senderSem,
+                                 ISender & sender,
+                                 agents::agent_workers_process_t<Child> & agent_workers_process) override
+        {
+            return driver.reconfigure_source(counterConfigurations, senderSem, sender, agent_workers_process);
+        }
+
     private:
-        static std::vector<PolledDriver *> createPolledDrivers()
+        static std::vector<PolledDriver *> createPolledDrivers(const TraceFsConstants & traceFsConstants)
         {
             return std::vector<PolledDriver *> {{new HwmonDriver(),
+                                                 new IioDriver(),
                                                  new FSDriver(),
                                                  new DiskIODriver(),
                                                  new MemInfoDriver(),
+                                                 new PressureDriver(),
+                                                 new CgroupDriver(),
+                                                 new ResctrlDriver(),
                                                  new NetDriver(),
-                                                 new gator::android::ThermalDriver}};
+                                                 new gator::android::ThermalDriver,
+                                                 new BpfDriver(traceFsConstants)}};
         }
 
         PerfPrimarySource(PerfDriverConfiguration && configuration,
@@ -212,7 +235,7 @@ namespace {
                           std::vector<UncorePmu> uncorePmus,
                           const TraceFsConstants & traceFsConstants,
                           bool disableKernelAnnotations)
-            : PrimarySourceProvider(createPolledDrivers()),
+            : PrimarySourceProvider(createPolledDrivers(traceFsConstants)),
               cpuInfo(std::move(cpuInfo)),
               driver(std::move(configuration),
                      std::move(pmuXml),
@@ -289,6 +312,8 @@ namespace {
 
         [[nodiscard]] bool useFtraceDriverForCpuFrequency() const override { return true; }
 
+        [[nodiscard]] bool supportsGpuFrequencyTracepoint() const override { return false; }
+
         [[nodiscard]] bool supportsMultiEbs() const override { return false; }
 
         [[nodiscard]] const char * getPrepareFailedMessage() const override
@@ -327,8 +352,14 @@ namespace {
     private:
         static std::vector<PolledDriver *> createPolledDrivers()
         {
-            return std::vector<PolledDriver *> {
-                {new HwmonDriver(), new FSDriver(), new DiskIODriver(), new MemInfoDriver(), new NetDriver()}};
+            return std::vector<PolledDriver *> {{new HwmonDriver(),
+                                                 new FSDriver(),
+                                                 new DiskIODriver(),
+                                                 new MemInfoDriver(),
+                                                 new PressureDriver(),
+                                                 new CgroupDriver(),
+                                                 new ResctrlDriver(),
+                                                 new NetDriver()}};
         }
 
         NonRootPrimarySource(PmuXML && pmuXml, CpuInfo && cpuInfo)
@@ -361,6 +392,15 @@ const std::vector<PolledDriver *> & PrimarySourceProvider::getAdditionalPolledDr
     return polledDrivers;
 }
 
+bool PrimarySourceProvider::reconfigureCounters(const std::set<CounterConfiguration> & /*counterConfigurations*/,
+                                                sem_t & /*senderSem*/,
+                                                ISender & /*sender*/,
+                                                agents::agent_workers_process_t<Child> & /*agent_workers_process*/)
+{
+    LOG_DEBUG("The counters of this capture can not be changed while capturing");
+    return false;
+}
+
 std::unique_ptr<PrimarySourceProvider> PrimarySourceProvider::detect(bool systemWide,
                                                                      const TraceFsConstants & traceFsConstants,
                                                                      PmuXML && pmuXml,
@@ -403,6 +443,30 @@ std::unique_ptr<PrimarySourceProvider> PrimarySourceProvider::detect(bool system
         LOG_SETUP("Profiling Source\nUsing perf API for primary data source");
         return result;
     }
+
+    // a non-root user may still be allowed to profile their own processes (such as a debuggable app, when the agents
+    // are launched with run-as), which gives sampled call stacks rather than just the /proc counters
+    if (systemWide && !isRoot) {
+        LOG_DEBUG("Trying perf API as non-root for the launched or attached processes only...");
+
+        result = PerfPrimarySource::tryCreate(false,
+                                              traceFsConstants,
+                                              pmuXml,
+                                              maliFamilyName,
+                                              ids,
+                                              modelNameToUse,
+                                              disableCpuOnlining,
+                                              disableKernelAnnotations);
+        if (result != nullptr) {
+            result->restrictedToProcesses = true;
+            LOG_DEBUG("...Success");
+            LOG_SETUP("Profiling Source\nUsing perf API for primary data source, restricted to the launched or "
+                      "attached processes as system-wide capture is not allowed");
+            LOG_WARNING("System-wide capture is not allowed, so only the launched or attached processes are profiled; "
+                        "specify the process to profile in the capture options");
+            return result;
+        }
+    }
     LOG_ERROR("...Perf API is not available.");
 
 #endif /* CONFIG_SUPPORT_PERF */
@@ -3,6 +3,7 @@
 #ifndef INCLUDE_PRIMARYSOURCEPROVIDER_H
 #define INCLUDE_PRIMARYSOURCEPROVIDER_H
 
+#include "Configuration.h"
 #include "ISender.h"
 #include "agents/agent_workers_process.h"
 #include "lib/Span.h"
@@ -64,6 +65,9 @@ public:
     /** Return true if the FtraceDriver is responsible for capturing the cpu_frequency tracepoint */
     [[nodiscard]] virtual bool useFtraceDriverForCpuFrequency() const = 0;
 
+    /** Return true if the primary source captures the GPU frequency tracepoint, in place of the polled GPU clock */
+    [[nodiscard]] virtual bool supportsGpuFrequencyTracepoint() const = 0;
+
     /** Return true if the source supports setting more than one EBS counter */
     [[nodiscard]] virtual bool supportsMultiEbs() const = 0;
 
@@ -91,16 +95,33 @@ public:
         bool enableOnCommandExec,
         agents::agent_workers_process_t<Child> & agent_workers_process) = 0;
 
+    /**
+     * Change the counters of the running capture to those of the configuration, where the source supports it
+     *
+     * @return True if the counters were changed
+     */
+    [[nodiscard]] virtual bool reconfigureCounters(const std::set<CounterConfiguration> & counterConfigurations,
+                                                   sem_t & senderSem,
+                                                   ISender & sender,
+                                                   agents::agent_workers_process_t<Child> & agent_workers_process);
+
     [[nodiscard]] virtual const ICpuInfo & getCpuInfo() const = 0;
     [[nodiscard]] virtual ICpuInfo & getCpuInfo() = 0;
 
     [[nodiscard]] virtual lib::Span<const UncorePmu> getDetectedUncorePmus() const = 0;
 
+    /**
+     * Return true if system-wide capture was requested but is not allowed (such as by perf_event_paranoid for a
+     * non-root user), so the source only captures the processes that are launched or attached to, per thread
+     */
+    [[nodiscard]] bool isRestrictedToProcesses() const { return restrictedToProcesses; }
+
 protected:
     explicit PrimarySourceProvider(std::vector<PolledDriver *> polledDrivers);
 
 private:
     std::vector<PolledDriver *> polledDrivers;
+    bool restrictedToProcesses {false};
 };
 
 #endif /* INCLUDE_PRIMARYSOURCEPROVIDER_H */
@@ -1,4 +1,4 @@
-/* Copyright (C) 2013-2020 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2013-2022 by Arm Limited. All rights reserved. */
 
 #ifndef PROTOCOL_H
 #define PROTOCOL_H
@@ -20,6 +20,24 @@ enum class FrameType : char {
     PERF_SYNC = 15,
     // METADATA = 16,
     // ARMNN = 17, not released
+    BLOCK_COUNTER_DELTA = 18,
+    // the call stacks referred to by the PERF_DATA samples of a capture with call stack deduplication enabled
+    PERF_CALL_STACKS = 19,
+    // the aggregated perf samples of a capture with sample aggregation enabled
+    PERF_SAMPLE_AGGREGATES = 20,
+    // the latency histograms of the probed functions of a capture with function probes
+    PERF_FUNCTION_LATENCIES = 21,
+    // the coarse summaries of a stream of block counter frames of a capture with counter rollups enabled
+    BLOCK_COUNTER_ROLLUP = 22,
+    // the memory access heatmaps of the SPE records of a capture with SPE heatmaps enabled
+    PERF_SPE_HEATMAP = 23,
+    // the Mali GPU job intervals and per-uid GPU time, from the kbase tracepoints, of a capture that has them
+    PERF_GPU_ACTIVITY = 24,
+    // the lock wait time histograms, from the futex or lock tracepoints, of a capture with lock contention enabled
+    PERF_LOCK_CONTENTION = 25,
+    // the runtime and estimated energy of each thread, from the sched_switch and cpu_frequency tracepoints and the
+    // kernel's energy model, of a capture with thread energy enabled
+    PERF_THREAD_ENERGY = 26,
 };
 
 // PERF_ATTR messages
@@ -36,6 +54,7 @@ enum class CodeType : int {
     COUNTERS = 10,
     HEADER_PAGE = 11,
     HEADER_EVENT = 12,
+    JIT_SYMBOLS = 13,
 };
 
 // Summary Frame Messages
@@ -3,8 +3,8 @@
 
 /* Define the product release version / protocol version */
 
-// Protocol version Streamline v8.1
-#define PROTOCOL_VERSION 810
+// Protocol version Streamline v8.2.1 (adds FrameType::PERF_THREAD_ENERGY)
+#define PROTOCOL_VERSION 821
 // Differentiates development versions from release code
 #define PROTOCOL_VERSION_DEV_MULTIPLIER 100000
 
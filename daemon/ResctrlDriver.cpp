@@ -0,0 +1,302 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "ResctrlDriver.h"
+
+#include "Logging.h"
+#include "linux/proc/ProcFieldParser.h"
+
+#include <cctype>
+#include <optional>
+#include <string_view>
+#include <utility>
+
+#include <dirent.h>
+
+namespace {
+    constexpr char OCCUPANCY_FILE[] = "llc_occupancy";
+    constexpr char BANDWIDTH_FILE[] = "mbm_total_bytes";
+
+    class ResctrlCounter : public DriverCounter {
+    public:
+        ResctrlCounter(DriverCounter * next, const char * name, std::string label, bool delta, const uint64_t * value);
+
+        // Intentionally unimplemented
+        ResctrlCounter(const ResctrlCounter &) = delete;
+        ResctrlCounter & operator=(const ResctrlCounter &) = delete;
+        ResctrlCounter(ResctrlCounter &&) = delete;
+        ResctrlCounter & operator=(ResctrlCounter &&) = delete;
+
+        /** @return The name of the group */
+        [[nodiscard]] const char * getLabel() const { return mLabel.c_str(); }
+        /** @return True for the bandwidth counter, false for the occupancy counter */
+        [[nodiscard]] bool isDelta() const { return mDelta; }
+
+        int64_t read() override;
+
+    private:
+        const std::string mLabel;
+        const uint64_t * const mValue;
+        uint64_t mPrev;
+        const bool mDelta;
+    };
+
+    ResctrlCounter::ResctrlCounter(DriverCounter * next,
+                                   const char * name,
+                                   std::string label,
+                                   bool delta,
+                                   const uint64_t * value)
+        : DriverCounter(next, name), mLabel(std::move(label)), mValue(value), mPrev(0), mDelta(delta)
+    {
+    }
+
+    int64_t ResctrlCounter::read()
+    {
+        if (!mDelta) {
+            return *mValue;
+        }
+        // the monitors are reset if the group is removed and another created with the same name
+        const int64_t result = (*mValue >= mPrev ? *mValue - mPrev : 0);
+        mPrev = *mValue;
+        return result;
+    }
+
+    /** @return The mount point of the resctrl filesystem, or nothing if it is not mounted */
+    std::optional<std::string> findMountPoint()
+    {
+        std::vector<char> buffer;
+        const auto mounts = lib::DirectoryFd::open("/proc/self").readFile("mounts", buffer);
+        if (!mounts) {
+            return {};
+        }
+
+        std::string_view remaining = *mounts;
+        while (!remaining.empty()) {
+            lnx::ProcFieldParser fields {lnx::ProcFieldParser::nextLine(remaining)};
+            fields.skip();
+            const std::string_view mountPoint = fields.nextField();
+            if (fields.nextField() == "resctrl") {
+                return std::string {mountPoint};
+            }
+        }
+
+        return {};
+    }
+
+    /** @return The name of a group as shown in Streamline, where a monitor group is shown as control/monitor */
+    std::string makeLabel(const std::string & path)
+    {
+        constexpr std::string_view MON_GROUPS {"mon_groups/"};
+
+        if (path.empty()) {
+            return "default";
+        }
+
+        std::string label = path;
+        const auto pos = label.find(MON_GROUPS);
+        if (pos != std::string::npos) {
+            label.erase(pos, MON_GROUPS.size());
+        }
+        return label;
+    }
+
+    /** Make a counter name from a group label, replacing the characters that are not valid in one */
+    std::string makeName(const std::string & label, const char * suffix)
+    {
+        std::string name {"Linux_resctrl_"};
+        for (const char c : label) {
+            name += (std::isalnum(static_cast<unsigned char>(c)) != 0 ? c : '_');
+        }
+        name += '_';
+        name += suffix;
+        return name;
+    }
+
+    /** @return The path of a child of a group, relative to the root of the filesystem */
+    std::string childPath(const std::string & path, const char * child)
+    {
+        return (path.empty() ? std::string {child} : path + '/' + child);
+    }
+}
+
+void ResctrlDriver::readEvents(mxml_node_t * const /*unused*/)
+{
+    const auto mountPoint = findMountPoint();
+    if (mountPoint) {
+        mRoot = lib::DirectoryFd::open(mountPoint->c_str());
+    }
+    if (!mRoot || !mRoot.openDirectory("info/L3_MON")) {
+        LOG_SETUP("Linux counters\nCannot find a resctrl filesystem with monitoring support. Resctrl cache "
+                  "occupancy and memory bandwidth counters not available.");
+        return;
+    }
+
+    // the default group's tasks are those of no control group, so it is counted like the others
+    std::vector<std::string> controlGroups {std::string {}};
+    mRoot.forEachChild([&](const lib::DirectoryFd::Entry & entry) {
+        const std::string_view name {entry.name};
+        if ((entry.type == DT_DIR) && (name != "info") && (name != "mon_data") && (name != "mon_groups")) {
+            controlGroups.emplace_back(name);
+        }
+    });
+
+    for (const auto & controlGroup : controlGroups) {
+        if (mGroups.size() >= MAX_GROUPS) {
+            break;
+        }
+        addGroup(controlGroup);
+
+        const std::string monGroupsPath = childPath(controlGroup, "mon_groups");
+        const lib::DirectoryFd monGroups = mRoot.openDirectory(monGroupsPath.c_str());
+        if (!monGroups) {
+            continue;
+        }
+
+        std::vector<std::string> monitorGroups;
+        monGroups.forEachChild([&](const lib::DirectoryFd::Entry & entry) {
+            if (entry.type == DT_DIR) {
+                monitorGroups.emplace_back(monGroupsPath + '/' + entry.name);
+            }
+        });
+        for (auto & monitorGroup : monitorGroups) {
+            if (mGroups.size() >= MAX_GROUPS) {
+                break;
+            }
+            addGroup(std::move(monitorGroup));
+        }
+    }
+
+    if (mGroups.size() >= MAX_GROUPS) {
+        LOG_DEBUG("Only the first %zu resctrl groups are counted", MAX_GROUPS);
+    }
+}
+
+void ResctrlDriver::addGroup(std::string path)
+{
+    const std::string monDataPath = childPath(path, "mon_data");
+    const lib::DirectoryFd monData = mRoot.openDirectory(monDataPath.c_str());
+    if (!monData) {
+        return;
+    }
+
+    auto group = std::make_unique<Group>();
+    group->path = std::move(path);
+
+    // a domain is a cache (or, with MPAM, a memory system component) that is monitored, such as each L3
+    monData.forEachChild([&](const lib::DirectoryFd::Entry & entry) {
+        const std::string_view name {entry.name};
+        if ((entry.type != DT_DIR) || (name.substr(0, 4) != "mon_")) {
+            return;
+        }
+        const std::string domainPath = monDataPath + '/' + entry.name;
+        for (auto [monitors, fileName] : {std::pair {&group->occupancy, OCCUPANCY_FILE},
+                                          std::pair {&group->bandwidth, BANDWIDTH_FILE}}) {
+            std::string filePath = domainPath + '/' + fileName;
+            if (mRoot.openFile(filePath.c_str())) {
+                monitors->filePaths.emplace_back(std::move(filePath));
+            }
+        }
+    });
+
+    if (group->occupancy.filePaths.empty() && group->bandwidth.filePaths.empty()) {
+        return;
+    }
+
+    const std::string label = makeLabel(group->path);
+    if (!group->occupancy.filePaths.empty()) {
+        group->occupancy.counter = new ResctrlCounter(getCounters(),
+                                                      makeName(label, "llc_occupancy").c_str(),
+                                                      label,
+                                                      false,
+                                                      &group->occupancy.total);
+        setCounters(group->occupancy.counter);
+    }
+    if (!group->bandwidth.filePaths.empty()) {
+        group->bandwidth.counter = new ResctrlCounter(getCounters(),
+                                                      makeName(label, "mbm_total").c_str(),
+                                                      label,
+                                                      true,
+                                                      &group->bandwidth.total);
+        setCounters(group->bandwidth.counter);
+    }
+
+    mGroups.emplace_back(std::move(group));
+}
+
+void ResctrlDriver::writeEvents(mxml_node_t * root) const
+{
+    root = mxmlNewElement(root, "category");
+    mxmlElementSetAttr(root, "name", "Resctrl");
+
+    for (auto * counter = static_cast<ResctrlCounter *>(getCounters()); counter != nullptr;
+         counter = static_cast<ResctrlCounter *>(counter->getNext())) {
+        mxml_node_t * node = mxmlNewElement(root, "event");
+        mxmlElementSetAttr(node, "counter", counter->getName());
+        mxmlElementSetAttr(node, "title", (counter->isDelta() ? "Memory bandwidth" : "LLC occupancy"));
+        mxmlElementSetAttr(node, "name", counter->getLabel());
+        mxmlElementSetAttr(node, "display", (counter->isDelta() ? "accumulate" : "maximum"));
+        mxmlElementSetAttr(node, "class", (counter->isDelta() ? "delta" : "absolute"));
+        mxmlElementSetAttr(node, "units", "B");
+        if (!counter->isDelta()) {
+            mxmlElementSetAttr(node, "average_selection", "yes");
+        }
+        mxmlElementSetAttr(node, "series_composition", "overlay");
+        mxmlElementSetAttr(node, "rendering_type", "line");
+        mxmlElementSetAttr(node,
+                           "description",
+                           (counter->isDelta()
+                                ? "The bytes transferred to and from memory by the tasks in the resctrl group, in "
+                                  "every domain (mbm_total_bytes)"
+                                : "The last level cache used by the tasks in the resctrl group, in every domain "
+                                  "(llc_occupancy)"));
+    }
+}
+
+void ResctrlDriver::start()
+{
+    // only the files with enabled counters are opened
+    for (auto & group : mGroups) {
+        for (auto * monitors : {&group->occupancy, &group->bandwidth}) {
+            if ((monitors->counter == nullptr) || !monitors->counter->isEnabled() || !monitors->monitors.empty()) {
+                continue;
+            }
+            for (const auto & filePath : monitors->filePaths) {
+                monitors->monitors.push_back(Monitor {mRoot.openFile(filePath.c_str())});
+            }
+        }
+    }
+
+    sample();
+
+    // Initialize previous values
+    for (DriverCounter * counter = getCounters(); counter != nullptr; counter = counter->getNext()) {
+        if (!counter->isEnabled()) {
+            continue;
+        }
+        counter->read();
+    }
+}
+
+void ResctrlDriver::readMonitors(Monitors & monitors)
+{
+    uint64_t total = 0;
+    for (auto & monitor : monitors.monitors) {
+        // the group may be removed during the capture, in which case its values stop changing, and a monitor reads
+        // "Unavailable" until its first count, in which case the last value is kept
+        if (monitor.fd) {
+            const auto contents = lib::DirectoryFd::readContents(*monitor.fd, mBuf);
+            if (contents) {
+                lnx::ProcFieldParser {*contents}.next(monitor.value);
+            }
+        }
+        total += monitor.value;
+    }
+    monitors.total = total;
+}
+
+void ResctrlDriver::sample()
+{
+    for (auto & group : mGroups) {
+        readMonitors(group->occupancy);
+        readMonitors(group->bandwidth);
+    }
+}
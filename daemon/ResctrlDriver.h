@@ -0,0 +1,75 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#ifndef RESCTRLDRIVER_H
+#define RESCTRLDRIVER_H
+
+#include "PolledDriver.h"
+#include "lib/AutoClosingFd.h"
+#include "lib/DirectoryFd.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * Reads the cache occupancy and memory bandwidth monitors of the resctrl filesystem, which are those of the MPAM
+ * partitions on Arm server parts (and of the RDT RMIDs on x86), so that a noisy neighbour can be seen by which group
+ * of tasks is filling the last level cache or using the memory bandwidth.
+ *
+ * The default group, the control groups and their monitor groups are discovered by readEvents, up to MAX_GROUPS of
+ * them, and their counters are declared in the counter XML by writeEvents. Each counter is the sum of the group's
+ * monitors in every domain (mon_data/mon_L3_*). The monitor files are opened once, at the start of the capture and
+ * only if the group's counter is enabled, then all are reread from the start in one pass per poll.
+ */
+class ResctrlDriver : public PolledDriver {
+public:
+    /** The most groups counted, which bounds the counters declared and the files read per poll */
+    static constexpr std::size_t MAX_GROUPS = 256;
+
+    ResctrlDriver() : PolledDriver("Resctrl") {}
+
+    // Intentionally unimplemented
+    ResctrlDriver(const ResctrlDriver &) = delete;
+    ResctrlDriver & operator=(const ResctrlDriver &) = delete;
+    ResctrlDriver(ResctrlDriver &&) = delete;
+    ResctrlDriver & operator=(ResctrlDriver &&) = delete;
+
+    void readEvents(mxml_node_t * root) override;
+    void writeEvents(mxml_node_t * root) const override;
+    void start() override;
+    void sample() override;
+
+private:
+    /** One monitor of one domain */
+    struct Monitor {
+        lib::AutoClosingFd fd {};
+        uint64_t value {0};
+    };
+
+    /** One kind of monitor of a group, in every domain */
+    struct Monitors {
+        /** The path of each domain's monitor file, relative to the root of the filesystem */
+        std::vector<std::string> filePaths {};
+        std::vector<Monitor> monitors {};
+        DriverCounter * counter {nullptr};
+        uint64_t total {0};
+    };
+
+    struct Group {
+        /** The path relative to the root of the filesystem, which is empty for the default group */
+        std::string path;
+        Monitors occupancy {};
+        Monitors bandwidth {};
+    };
+
+    lib::DirectoryFd mRoot {};
+    std::vector<std::unique_ptr<Group>> mGroups {};
+    std::vector<char> mBuf {};
+
+    void addGroup(std::string path);
+    void readMonitors(Monitors & monitors);
+};
+
+#endif // RESCTRLDRIVER_H
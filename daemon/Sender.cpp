@@ -4,20 +4,146 @@
 
 #include "BufferUtils.h"
 #include "Logging.h"
+#include "MemoryBudget.h"
 #include "OlySocket.h"
+#include "OlyUtility.h"
+#include "PipelineStats.h"
+#include "Protocol.h"
 #include "SessionData.h"
-#include "lib/File.h"
+#include "lib/FileDescriptor.h"
+#include "lib/Probe.h"
 #include "lib/String.h"
 
 #include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
 #include <climits>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
 
+#include <fcntl.h>
 #include <unistd.h>
 
+namespace {
+    constexpr std::uint64_t SEGMENT_SIZE_UNIT = 1024ULL * 1024ULL;
+    constexpr std::uint64_t SPOOL_SIZE_UNIT = 1024ULL * 1024ULL;
+    // Fail if the socket makes no progress for this long
+    constexpr int SEND_TIMEOUT_MS = 8000;
+
+    constexpr std::string_view MAGIC = "STREAMLINE";
+
+    /**
+     * Parse the host's magic sequence, which may be followed by a session token (separated by a space) that allows it
+     * to resume the capture should the connection be lost
+     *
+     * @return False if the line is not the magic sequence
+     */
+    bool parseMagic(std::string_view line, std::string & token)
+    {
+        if (line.substr(0, MAGIC.size()) != MAGIC) {
+            return false;
+        }
+        if (line.size() == MAGIC.size()) {
+            token.clear();
+            return true;
+        }
+        if ((line[MAGIC.size()] != ' ') || (line.size() == MAGIC.size() + 1)) {
+            return false;
+        }
+        token = line.substr(MAGIC.size() + 1);
+        return true;
+    }
+
+    /** Random access to the bytes of some data that is split into parts */
+    class DataPartsReader {
+    public:
+        explicit DataPartsReader(lib::Span<const lib::Span<const char, int>> dataParts) : mDataParts(dataParts)
+        {
+            for (const auto & data : dataParts) {
+                mSize += data.size();
+            }
+        }
+
+        [[nodiscard]] int size() const { return mSize; }
+
+        [[nodiscard]] char at(int offset) const
+        {
+            for (const auto & data : mDataParts) {
+                if (offset < data.size()) {
+                    return data.data()[offset];
+                }
+                offset -= data.size();
+            }
+            return 0;
+        }
+
+        [[nodiscard]] uint32_t readLEInt(int offset) const
+        {
+            char buf[sizeof(uint32_t)];
+            for (std::size_t n = 0; n < sizeof(buf); ++n) {
+                buf[n] = at(offset + static_cast<int>(n));
+            }
+            return buffer_utils::readLEInt(buf);
+        }
+
+        void copyTo(std::vector<char> & out, int offset, int length) const
+        {
+            for (const auto & data : mDataParts) {
+                if ((length > 0) && (offset < data.size())) {
+                    const int count = std::min(length, data.size() - offset);
+                    out.insert(out.end(), data.data() + offset, data.data() + offset + count);
+                    length -= count;
+                    offset = 0;
+                }
+                else {
+                    offset -= data.size();
+                }
+            }
+        }
+
+    private:
+        lib::Span<const lib::Span<const char, int>> mDataParts;
+        int mSize {0};
+    };
+
+    /** @return True for the frames that are needed to make sense of the rest of the data in a segment */
+    bool isSegmentHeaderFrame(char frameType)
+    {
+        switch (static_cast<FrameType>(frameType)) {
+            case FrameType::SUMMARY:
+            case FrameType::NAME:
+            case FrameType::PERF_ATTRS:
+                return true;
+            default:
+                return false;
+        }
+    }
+}
+
 Sender::Sender(OlySocket * socket)
-    : mDataSocket(socket), mDataFile(nullptr, fclose), mDataFileName(nullptr), mSendMutex()
+    : mDataSocket(socket),
+      mDataFile(),
+      mDataFileName(),
+      mDataFileCompressor(),
+      mDataFileIndex(),
+      mApcDir(),
+      mDataFileSegment(0),
+      mDataFileSegmentBytes(0),
+      mDataFileSegmentStart(),
+      mSegmentHeaderFrames(),
+      mSubscribers(),
+      mSessionToken(),
+      mSuspended(false),
+      mSpoolFd(),
+      mSpoolBytes(0),
+      mStriper(),
+      mNextSequence(0),
+      mAttachedDataStreams(),
+      mSendMutex(),
+      mSendIov(),
+      mSpoolIov()
 {
     // Set up the socket connection
     if (socket != nullptr) {
@@ -26,7 +152,7 @@ Sender::Sender(OlySocket * socket)
 
         // Receive magic sequence - can wait forever
         // Streamline will send data prior to the magic sequence for legacy support, which should be ignored for v4+
-        while (strcmp("STREAMLINE", streamline) != 0) {
+        while (!parseMagic(streamline, mSessionToken)) {
             if (mDataSocket->receiveString(streamline, sizeof(streamline)) == -1) {
                 LOG_ERROR("Socket disconnected");
                 handleException();
@@ -51,6 +177,14 @@ Sender::Sender(OlySocket * socket)
 
 Sender::~Sender()
 {
+    closeDataFile();
+    mSubscribers.reset();
+
+    if (mSuspended && (mSpoolBytes > 0)) {
+        LOG_WARNING("The host did not resume the capture, so %" PRIu64 " bytes of capture data were not sent",
+                    mSpoolBytes);
+    }
+
     // Just close it as the client socket is on the stack
     if (mDataSocket != nullptr) {
         mDataSocket->closeSocket();
@@ -64,13 +198,364 @@ void Sender::createDataFile(const char * apcDir)
         return;
     }
 
-    mDataFileName.reset(new char[strlen(apcDir) + 12]);
-    sprintf(mDataFileName.get(), "%s/0000000000", apcDir);
-    mDataFile.reset(lib::fopen_cloexec(mDataFileName.get(), "wb"));
+    mApcDir = apcDir;
+    mDataFileSegment = 0;
+    mSegmentHeaderFrames.clear();
+
+    openDataFile();
+}
+
+void Sender::listenForSubscribers(int port)
+{
+    const auto requestedLimit = static_cast<std::size_t>(gSessionData.mSubscriberQueueSize) * 1024 * 1024;
+    const auto queueLimit = gMemoryBudget.allocate("subscriber queue", 1, requestedLimit);
+    const auto dropPolicy = (gSessionData.mSubscriberDisconnect ? SubscriberFanout::DropPolicy::DISCONNECT
+                                                                : SubscriberFanout::DropPolicy::DROP);
+
+    mSubscribers = std::make_unique<SubscriberFanout>(port, queueLimit, dropPolicy);
+}
+
+bool Sender::isResumable() const
+{
+    return (mDataSocket != nullptr) && !mSessionToken.empty() && (gSessionData.mResumeTimeoutSeconds > 0)
+        && (gSessionData.mDataStreams == 0);
+}
+
+void Sender::suspend()
+{
+    lockSend();
+    suspendLocked();
+    unlockSend();
+}
+
+void Sender::suspendLocked()
+{
+    if (mSuspended) {
+        return;
+    }
+
+    if (!mSpoolFd) {
+        const char * tmpDir = getenv("TMPDIR"); // NOLINT(concurrency-mt-unsafe)
+        std::string path =
+            lib::dyn_printf_str_t {"%s/gatord-spool-XXXXXX", (tmpDir != nullptr ? tmpDir : "/tmp")}.c_str();
+        mSpoolFd = mkostemp(path.data(), O_CLOEXEC);
+        if (!mSpoolFd) {
+            // NOLINTNEXTLINE(concurrency-mt-unsafe)
+            LOG_ERROR("Unable to create the spool for the capture data %s (%s)", path.c_str(), strerror(errno));
+            handleException();
+        }
+        // only needed for as long as it is open
+        unlink(path.c_str());
+    }
+
+    LOG_WARNING("Lost the connection to the host, spooling the capture data for up to %d seconds until it resumes",
+                gSessionData.mResumeTimeoutSeconds);
+
+    mSuspended = true;
+    mDataSocket->shutdownConnection();
+}
+
+bool Sender::resume(int socketID, const std::string & token)
+{
+    if (!isResumable() || (token != mSessionToken)) {
+        LOG_WARNING("Rejected a connection to resume the capture, as the session token does not match");
+        close(socketID);
+        return false;
+    }
+
+    lockSend();
+
+    mDataSocket->replaceConnection(socketID);
+    mSuspended = true;
+
+    const std::uint64_t spooled = mSpoolBytes;
+    const bool resumed = sendSpool();
+    if (resumed) {
+        LOG_INFO("The host resumed the capture, %" PRIu64 " bytes of spooled capture data were sent", spooled);
+        mSuspended = false;
+        mSpoolBytes = 0;
+        if (mSpoolFd && (ftruncate(mSpoolFd.get(), 0) != 0)) {
+            LOG_DEBUG("Unable to truncate the spool (%d)", errno);
+        }
+    }
+    else {
+        // keep the spool for the next attempt
+        mDataSocket->shutdownConnection();
+    }
+
+    unlockSend();
+
+    return resumed;
+}
+
+bool Sender::sendSpool()
+{
+    std::vector<char> buffer(1024 * 1024);
+    std::uint64_t offset = 0;
+    while (offset < mSpoolBytes) {
+        const auto count = std::min<std::uint64_t>(buffer.size(), mSpoolBytes - offset);
+        const ssize_t bytes = pread(mSpoolFd.get(), buffer.data(), count, static_cast<off_t>(offset));
+        if (bytes <= 0) {
+            LOG_ERROR("Unable to read the spool of capture data (%d)", errno);
+            handleException();
+        }
+
+        struct iovec iov {buffer.data(), static_cast<size_t>(bytes)};
+        if (!mDataSocket->trySendv(&iov, 1, SEND_TIMEOUT_MS)) {
+            return false;
+        }
+        offset += bytes;
+    }
+    return true;
+}
+
+void Sender::writeToSpool(lib::Span<const struct iovec> iov)
+{
+    std::uint64_t length = 0;
+    for (const auto & data : iov) {
+        length += data.iov_len;
+    }
+
+    if (mSpoolBytes + length > static_cast<std::uint64_t>(gSessionData.mSpoolSize) * SPOOL_SIZE_UNIT) {
+        LOG_ERROR("The host did not resume the capture before %d MB of capture data were spooled",
+                  gSessionData.mSpoolSize);
+        handleException();
+    }
+
+    for (const auto & data : iov) {
+        if (!lib::writeAll(mSpoolFd.get(), data.iov_base, data.iov_len)) {
+            // NOLINTNEXTLINE(concurrency-mt-unsafe)
+            LOG_ERROR("Unable to write the spool of capture data (%s)", strerror(errno));
+            handleException();
+        }
+    }
+    mSpoolBytes += length;
+}
+
+bool Sender::attachDataStream(int socketID, const std::string & token, const std::string & index)
+{
+    int number = 0;
+    if (mSessionToken.empty() || (token != mSessionToken) || !stringToInt(&number, index.c_str(), 10) || (number < 1)
+        || (number > gSessionData.mDataStreams)) {
+        LOG_WARNING("Rejected a further data connection, as its session token or number is not valid");
+        close(socketID);
+        return false;
+    }
+
+    lockSend();
+
+    // the host only knows whether the data stream was attached by what arrives on it
+    const auto position = static_cast<std::size_t>(number - 1);
+    mAttachedDataStreams.resize(gSessionData.mDataStreams, false);
+    const bool attached = !mAttachedDataStreams[position];
+    if (attached) {
+        mAttachedDataStreams[position] = true;
+        if (!mStriper) {
+            mStriper = std::make_unique<DataStreamStriper>();
+        }
+        mStriper->attach(socketID);
+    }
+
+    unlockSend();
+
+    if (!attached) {
+        LOG_WARNING("Rejected a further data connection, as connection %d is already attached", number);
+        close(socketID);
+    }
+    return attached;
+}
+
+void Sender::lockSend()
+{
+    if (pthread_mutex_lock(&mSendMutex) != 0) {
+        LOG_ERROR("pthread_mutex_lock failed");
+        handleException();
+    }
+}
+
+void Sender::unlockSend()
+{
+    if (pthread_mutex_unlock(&mSendMutex) != 0) {
+        LOG_ERROR("pthread_mutex_unlock failed");
+        handleException();
+    }
+}
+
+std::string Sender::getDataFileName(unsigned segment) const
+{
+    const bool compress = gSessionData.mCompressLocalCapture;
+
+    return lib::dyn_printf_str_t {(compress ? "%s/%010u.lz4" : "%s/%010u"), mApcDir.c_str(), segment}.c_str();
+}
+
+std::string Sender::getIndexedFileName(unsigned segment) const
+{
+    // the index refers to the uncompressed data, so is named for it
+    return lib::dyn_printf_str_t {"%s/%010u", mApcDir.c_str(), segment}.c_str();
+}
+
+void Sender::openDataFile()
+{
+    mDataFileName = getDataFileName(mDataFileSegment);
+    mDataFile = CaptureFileWriter::create(mDataFileName.c_str());
     if (!mDataFile) {
-        LOG_ERROR("Failed to open binary file: %s", mDataFileName.get());
+        LOG_ERROR("Failed to open binary file: %s", mDataFileName.c_str());
         handleException();
     }
+
+    if (gSessionData.mCompressLocalCapture) {
+        mDataFileCompressor = std::make_unique<Lz4FileWriter>(*mDataFile);
+    }
+
+    if (gSessionData.mIndexIntervalMs > 0) {
+        mDataFileIndex = CaptureIndexWriter::create(getIndexedFileName(mDataFileSegment),
+                                                    std::chrono::milliseconds(gSessionData.mIndexIntervalMs),
+                                                    mSegmentHeaderFrames);
+    }
+
+    mDataFileSegmentBytes = 0;
+    mDataFileSegmentStart = std::chrono::steady_clock::now();
+}
+
+void Sender::closeDataFile()
+{
+    mDataFileIndex.reset();
+
+    // Complete the compressed data, which must happen before the file is closed
+    if (mDataFileCompressor) {
+        if (!mDataFileCompressor->finish()) {
+            LOG_ERROR("Failed writing binary file %s", mDataFileName.c_str());
+        }
+        LOG_INFO("Compressed %" PRIu64 " bytes of capture data to %" PRIu64 " bytes",
+                 mDataFileCompressor->getBytesIn(),
+                 mDataFileCompressor->getBytesOut());
+        mDataFileCompressor.reset();
+    }
+
+    if (mDataFile) {
+        if (!mDataFile->close()) {
+            LOG_ERROR("Failed writing binary file %s", mDataFileName.c_str());
+        }
+        const auto stats = mDataFile->getStats();
+        const auto elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(stats.elapsed).count();
+        const auto writeMs = std::chrono::duration_cast<std::chrono::milliseconds>(stats.writeTime).count();
+        const auto stallMs = std::chrono::duration_cast<std::chrono::milliseconds>(stats.stallTime).count();
+        const double megabytes = static_cast<double>(stats.bytesWritten) / (1024.0 * 1024.0);
+        LOG_INFO("Wrote %.1f MB of capture data at %.1f MB/s (%.1f MB/s whilst writing), "
+                 "the sender stalled %" PRIu64 " times for a total of %lld ms",
+                 megabytes,
+                 (elapsedMs > 0 ? (megabytes * 1000.0) / static_cast<double>(elapsedMs) : 0.0),
+                 (writeMs > 0 ? (megabytes * 1000.0) / static_cast<double>(writeMs) : 0.0),
+                 stats.stallCount,
+                 static_cast<long long>(stallMs));
+        mDataFile.reset();
+    }
+}
+
+bool Sender::isSegmented() const
+{
+    return (gSessionData.mSegmentSize > 0) || (gSessionData.mSegmentSeconds > 0);
+}
+
+bool Sender::isSegmentFull() const
+{
+    if ((gSessionData.mSegmentSize > 0)
+        && (mDataFileSegmentBytes >= static_cast<std::uint64_t>(gSessionData.mSegmentSize) * SEGMENT_SIZE_UNIT)) {
+        return true;
+    }
+
+    return (gSessionData.mSegmentSeconds > 0)
+        && ((std::chrono::steady_clock::now() - mDataFileSegmentStart)
+            >= std::chrono::seconds(gSessionData.mSegmentSeconds));
+}
+
+void Sender::startNextSegment()
+{
+    closeDataFile();
+
+    mDataFileSegment += 1;
+    openDataFile();
+
+    LOG_DEBUG("Started capture data segment %s", mDataFileName.c_str());
+
+    // drop the oldest segment once there are more than the number to keep
+    if ((gSessionData.mSegmentCount > 0) && (mDataFileSegment >= static_cast<unsigned>(gSessionData.mSegmentCount))) {
+        const auto oldName = getDataFileName(mDataFileSegment - gSessionData.mSegmentCount);
+        if (remove(oldName.c_str()) != 0) {
+            // NOLINTNEXTLINE(concurrency-mt-unsafe)
+            LOG_WARNING("Unable to remove the capture data segment %s (%s)", oldName.c_str(), strerror(errno));
+        }
+        CaptureIndexWriter::remove(getIndexedFileName(mDataFileSegment - gSessionData.mSegmentCount));
+    }
+
+    // make the segment loadable on its own
+    if (!mSegmentHeaderFrames.empty()) {
+        writeToDataFile({mSegmentHeaderFrames.data(), static_cast<int>(mSegmentHeaderFrames.size())});
+    }
+}
+
+void Sender::dropDataFileIndex()
+{
+    // the index is only an aid to loading the data, so the capture continues without it
+    LOG_WARNING("Failed writing the index of binary file %s, so it is removed", mDataFileName.c_str());
+    mDataFileIndex.reset();
+    CaptureIndexWriter::remove(getIndexedFileName(mDataFileSegment));
+}
+
+void Sender::writeToDataFile(lib::Span<const char, int> data)
+{
+    const bool written = (mDataFileCompressor ? mDataFileCompressor->write(data) : mDataFile->write(data));
+    if (!written) {
+        LOG_ERROR("Failed writing binary file %s", mDataFileName.c_str());
+        handleException();
+    }
+    mDataFileSegmentBytes += data.size();
+}
+
+bool Sender::retainSegmentHeaderFrames(lib::Span<const lib::Span<const char, int>> dataParts, ResponseType type)
+{
+    const DataPartsReader reader {dataParts};
+    const std::size_t retainedSize = mSegmentHeaderFrames.size();
+
+    // a single frame, without its length
+    if (type != ResponseType::RAW) {
+        if ((reader.size() > 0) && isSegmentHeaderFrame(reader.at(0))) {
+            char header[4];
+            buffer_utils::writeLEInt(header, reader.size());
+            mSegmentHeaderFrames.insert(mSegmentHeaderFrames.end(), header, header + sizeof(header));
+            reader.copyTo(mSegmentHeaderFrames, 0, reader.size());
+        }
+        return mSegmentHeaderFrames.size() != retainedSize;
+    }
+
+    // whole frames, each prefixed by its length
+    int offset = 0;
+    while ((offset + 4) < reader.size()) {
+        const int length = static_cast<int>(reader.readLEInt(offset));
+        if ((length <= 0) || (length > (reader.size() - offset - 4))) {
+            break;
+        }
+        if (isSegmentHeaderFrame(reader.at(offset + 4))) {
+            reader.copyTo(mSegmentHeaderFrames, offset, length + 4);
+        }
+        offset += length + 4;
+    }
+
+    return mSegmentHeaderFrames.size() != retainedSize;
+}
+
+void Sender::beginBatch()
+{
+    if (mDataSocket != nullptr) {
+        mDataSocket->setCork(true);
+    }
+}
+
+void Sender::endBatch()
+{
+    if (mDataSocket != nullptr) {
+        mDataSocket->setCork(false);
+    }
 }
 
 void Sender::writeDataParts(lib::Span<const lib::Span<const char, int>> dataParts,
@@ -105,66 +590,100 @@ void Sender::writeDataParts(lib::Span<const lib::Span<const char, int>> dataPart
         handleException();
     }
 
-    // Send data over the socket connection
-    if (mDataSocket != nullptr) {
-        // Start alarm
-        const int alarmDuration = 8;
-        alarm(alarmDuration);
+    const auto writeStart = std::chrono::steady_clock::now();
+    GATOR_PROBE2(sender_write_start, length, static_cast<int>(type));
+
+    const bool isCaptureData = (type == ResponseType::APC_DATA || type == ResponseType::RAW);
+    // once the host has asked for further data connections, it orders the capture data by sequence number
+    const bool isSequenced = isCaptureData && (gSessionData.mDataStreams > 0);
 
-        // Send data over the socket, sending the type and size first
+    // Send data over the socket connection
+    if ((mDataSocket != nullptr) && isSequenced && mStriper) {
+        mStriper->write(mNextSequence++, dataParts, type);
+    }
+    else if (mDataSocket != nullptr) {
+        // Send the type and size first, gathered with the data into a single send
         LOG_DEBUG("Sending data with length %d", length);
+        char sequenceHeader[5 + sizeof(std::uint64_t)];
+        char header[5];
+        mSendIov.clear();
+        if (isSequenced) {
+            const int innerLength = length + (type != ResponseType::RAW ? sizeof(header) : 0);
+            sequenceHeader[0] = static_cast<char>(ResponseType::APC_DATA_SEQUENCED);
+            buffer_utils::writeLEInt(sequenceHeader + 1, sizeof(std::uint64_t) + innerLength);
+            buffer_utils::writeLELong(sequenceHeader + 5, mNextSequence++);
+            mSendIov.push_back({sequenceHeader, sizeof(sequenceHeader)});
+        }
         if (type != ResponseType::RAW) {
-            char header[5];
             header[0] = static_cast<char>(type);
             buffer_utils::writeLEInt(header + 1, length);
-            mDataSocket->send(header, sizeof(header));
+            mSendIov.push_back({header, sizeof(header)});
         }
 
-        // 100Kbits/sec * alarmDuration sec / 8 bits/byte
-        const int chunkSize = 100 * 1000 * alarmDuration / 8;
         for (const auto & data : dataParts) {
-            int pos = 0;
-            while (true) {
-                mDataSocket->send(data.data() + pos, std::min(data.size() - pos, chunkSize));
-                pos += chunkSize;
-                if (pos >= data.size()) {
-                    break;
-                }
+            if (data.size() > 0) {
+                // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast) - iovec is not const, but is only read from
+                mSendIov.push_back({const_cast<char *>(data.data()), static_cast<size_t>(data.size())});
+            }
+        }
 
-                // Reset the alarm
-                alarm(alarmDuration);
-                LOG_DEBUG("Resetting the alarm");
+        if (mSuspended) {
+            writeToSpool(mSendIov);
+        }
+        else if (isResumable()) {
+            mSpoolIov = mSendIov;
+            if (!mDataSocket->trySendv(mSendIov.data(), static_cast<int>(mSendIov.size()), SEND_TIMEOUT_MS)) {
+                // the host will discard whatever part was sent, so spool the whole response
+                suspendLocked();
+                writeToSpool(mSpoolIov);
             }
         }
+        else {
+            mDataSocket->sendv(mSendIov.data(), static_cast<int>(mSendIov.size()), SEND_TIMEOUT_MS);
+        }
+    }
 
-        // Stop alarm
-        alarm(0);
+    // the data is always some whole number of frames, so the segments can be split and subscribers can join here
+    if (isCaptureData && (mSubscribers || (mDataFile && (isSegmented() || mDataFileIndex)))) {
+        if (mDataFile && isSegmentFull()) {
+            startNextSegment();
+        }
+        if (mSubscribers) {
+            mSubscribers->admitSubscribers(mSegmentHeaderFrames);
+        }
+        if (mDataFileIndex && !mDataFileIndex->checkpoint(mDataFileSegmentBytes)) {
+            dropDataFileIndex();
+        }
+        const std::size_t retainedSize = mSegmentHeaderFrames.size();
+        const bool hasHeaderFrames = retainSegmentHeaderFrames(dataParts, type);
+        if (mDataFileIndex && hasHeaderFrames
+            && !mDataFileIndex->addState({mSegmentHeaderFrames.data() + retainedSize,
+                                          mSegmentHeaderFrames.size() - retainedSize})) {
+            dropDataFileIndex();
+        }
+        if (mSubscribers) {
+            mSubscribers->publish(dataParts, type, hasHeaderFrames);
+        }
     }
 
     // Write data to disk as long as it is not meta data
-    if (mDataFile && (type == ResponseType::APC_DATA || type == ResponseType::RAW)) {
+    if (mDataFile && isCaptureData) {
         LOG_DEBUG("Writing data with length %d", length);
-        // Send data to the data file
-        auto writeData = [this](lib::Span<const char, int> data) {
-            if (fwrite(data.data(), 1, data.size(), mDataFile.get()) != static_cast<size_t>(data.size())) {
-                LOG_ERROR("Failed writing binary file %s", mDataFileName.get());
-                handleException();
-            }
-        };
 
+        // Send data to the data file
         if (type != ResponseType::RAW) {
             char header[4];
             buffer_utils::writeLEInt(header, length);
-            writeData(header);
+            writeToDataFile(header);
         }
 
         for (const auto & data : dataParts) {
-            writeData(data);
+            writeToDataFile(data);
         }
     }
 
-    if (pthread_mutex_unlock(&mSendMutex) != 0) {
-        LOG_ERROR("pthread_mutex_unlock failed");
-        handleException();
-    }
+    gPipelineStats.onSenderWrite(length, std::chrono::steady_clock::now() - writeStart);
+    GATOR_PROBE1(sender_write_end, length);
+
+    unlockSend();
 }
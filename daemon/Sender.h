@@ -1,14 +1,24 @@
-/* Copyright (C) 2010-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2010-2022 by Arm Limited. All rights reserved. */
 
 #ifndef __SENDER_H__
 #define __SENDER_H__
 
+#include "CaptureFileWriter.h"
+#include "CaptureIndexWriter.h"
+#include "DataStreamStriper.h"
 #include "ISender.h"
+#include "Lz4FileWriter.h"
+#include "SubscriberFanout.h"
+#include "lib/AutoClosingFd.h"
 
-#include <cstdio>
+#include <chrono>
+#include <cstdint>
 #include <memory>
+#include <string>
+#include <vector>
 
 #include <pthread.h>
+#include <sys/uio.h>
 
 class OlySocket;
 
@@ -26,13 +36,119 @@ public:
     void writeDataParts(lib::Span<const lib::Span<const char, int>> dataParts,
                         ResponseType type,
                         bool ignoreLockErrors = false) override;
+    /**
+     * Start writing the capture data to a file in apcDir. When SessionData::mSegmentSize or mSegmentSeconds are set,
+     * the data is split into numbered segments, each of which starts with a copy of the frames that describe the
+     * capture, and only the last mSegmentCount segments (if set) are kept. When SessionData::mIndexIntervalMs is set,
+     * each data file has a time index alongside it (see CaptureIndexWriter).
+     */
     void createDataFile(const char * apcDir);
 
+    /**
+     * Start delivering the capture data to any extra hosts that connect to the port, as configured by
+     * SessionData::mSubscriberQueueSize and mSubscriberDisconnect. See SubscriberFanout.
+     */
+    void listenForSubscribers(int port);
+
+    /** @return The session token the host gave in the magic sequence, or empty if it gave none */
+    [[nodiscard]] const std::string & getSessionToken() const { return mSessionToken; }
+
+    /**
+     * @return True if the host may reconnect and resume the capture after losing the connection, which requires it
+     * to have given a session token and the session to set SessionData::mResumeTimeoutSeconds (but not
+     * SessionData::mDataStreams, as a lost data connection cannot be resumed)
+     */
+    [[nodiscard]] bool isResumable() const;
+
+    /**
+     * Stop sending to the host, as the connection has been lost, and spool the data to a local file instead until
+     * resume is called (or the spool, of SessionData::mSpoolSize MBs, is full). Only valid if resumable.
+     */
+    void suspend();
+
+    /**
+     * Continue the capture over a new connection from the host, which has already completed the magic sequence, by
+     * sending the data spooled since the connection was lost. The host discards any partial response from the old
+     * connection, as the spool starts with whichever response was being sent when the connection was lost.
+     *
+     * @param socketID The new connection, which is taken over by the socket passed to the constructor
+     * @param token The session token the host gave for the new connection
+     * @return False if the token does not match or the spooled data could not be sent
+     */
+    bool resume(int socketID, const std::string & token);
+
+    /**
+     * Start striping the capture data over a further connection from the host, which has already completed the magic
+     * sequence. See DataStreamStriper.
+     *
+     * @param socketID The connection, which is taken over
+     * @param token The session token the host gave for the connection
+     * @param index The number of the connection, from 1 to SessionData::mDataStreams
+     * @return False if the token or index is not valid
+     */
+    bool attachDataStream(int socketID, const std::string & token, const std::string & index);
+
+    /**
+     * Hold back partially filled packets whilst a batch of responses is written, so that many small responses are
+     * coalesced into fewer, larger segments. Must be paired with a call to endBatch.
+     */
+    void beginBatch();
+    /** Release anything held back since beginBatch */
+    void endBatch();
+
 private:
     OlySocket * mDataSocket;
-    std::unique_ptr<FILE, int (*)(FILE *)> mDataFile;
-    std::unique_ptr<char[]> mDataFileName;
+    std::unique_ptr<CaptureFileWriter> mDataFile;
+    std::string mDataFileName;
+    // set when the data file is compressed
+    std::unique_ptr<Lz4FileWriter> mDataFileCompressor;
+    // set when the data file is indexed
+    std::unique_ptr<CaptureIndexWriter> mDataFileIndex;
+    std::string mApcDir;
+    // the number of the data file segment being written, and how much has been written to it since when
+    unsigned mDataFileSegment;
+    std::uint64_t mDataFileSegmentBytes;
+    std::chrono::steady_clock::time_point mDataFileSegmentStart;
+    // the summary, name and attribute frames seen so far, repeated at the start of each new segment and sent to each
+    // new subscriber
+    std::vector<char> mSegmentHeaderFrames;
+    // set when there may be subscribers
+    std::unique_ptr<SubscriberFanout> mSubscribers;
+    // given again by the host to resume the capture or to attach further data connections
+    std::string mSessionToken;
+    // set while the connection to the host is lost, protected by mSendMutex
+    bool mSuspended;
+    // the data written whilst suspended, and the amount in it, protected by mSendMutex
+    lib::AutoClosingFd mSpoolFd;
+    std::uint64_t mSpoolBytes;
+    // set once the host has attached a further data connection
+    std::unique_ptr<DataStreamStriper> mStriper;
+    // the number of the next write of capture data, when it is sequenced; protected by mSendMutex
+    std::uint64_t mNextSequence;
+    // the indexes of the further data connections that are attached; protected by mSendMutex
+    std::vector<bool> mAttachedDataStreams;
     pthread_mutex_t mSendMutex;
+    // reused for each response, protected by mSendMutex
+    std::vector<struct iovec> mSendIov;
+    // a copy of mSendIov, which is consumed by the send, for spooling a failed send
+    std::vector<struct iovec> mSpoolIov;
+
+    [[nodiscard]] std::string getDataFileName(unsigned segment) const;
+    [[nodiscard]] std::string getIndexedFileName(unsigned segment) const;
+    void openDataFile();
+    void closeDataFile();
+    [[nodiscard]] bool isSegmented() const;
+    [[nodiscard]] bool isSegmentFull() const;
+    void startNextSegment();
+    void dropDataFileIndex();
+    void writeToDataFile(lib::Span<const char, int> data);
+    void lockSend();
+    void unlockSend();
+    void suspendLocked();
+    void writeToSpool(lib::Span<const struct iovec> iov);
+    [[nodiscard]] bool sendSpool();
+    /** @return True if the data contained any of the frames that are retained */
+    bool retainSegmentHeaderFrames(lib::Span<const lib::Span<const char, int>> dataParts, ResponseType type);
 };
 
 #endif //__SENDER_H__
@@ -12,9 +12,11 @@
 #include "OlyUtility.h"
 #include "PrimarySourceProvider.h"
 #include "SessionXML.h"
+#include "Time.h"
 #include "lib/File.h"
 #include "lib/Format.h"
 #include "lib/Time.h"
+#include "linux/perf/PerfUtils.h"
 #include "mali_userspace/MaliInstanceLocator.h"
 
 #include <algorithm>
@@ -28,6 +30,32 @@ const size_t MALI_GRAPHICS_SIZE = sizeof(MALI_GRAPHICS);
 
 SessionData gSessionData;
 
+namespace {
+    /**
+     * Convert a session xml sample rate to Hz. Uses prime numbers just below the desired value to reduce the chance of
+     * events firing at the same time.
+     */
+    bool parseSampleRate(const char * value, int & sampleRate)
+    {
+        if (strcmp(value, "high") == 0) {
+            sampleRate = 10007; // 10000
+        }
+        else if (strcmp(value, "normal") == 0) {
+            sampleRate = 1009; // 1000
+        }
+        else if (strcmp(value, "low") == 0) {
+            sampleRate = 101; // 100
+        }
+        else if (strcmp(value, "none") == 0) {
+            sampleRate = 0;
+        }
+        else {
+            return false;
+        }
+        return true;
+    }
+}
+
 void SessionData::initialize()
 {
     mSharedData = shared_memory::make_unique<SharedData>();
@@ -38,7 +66,52 @@ void SessionData::initialize()
     mFtraceRaw = false;
     mSystemWide = false;
     mExcludeKernelEvents = false;
+    mCompressLocalCapture = false;
+    mRealtimePolling = false;
+    mPollingCpu = -1;
+    mGatorCpus.clear();
+    mGatorNice.reset();
+    mDeltaBlockCounters = false;
+    mCounterRollups = false;
+    mFlightRecorderSeconds = 0;
+    mFlightRecorderSize = DEFAULT_FLIGHT_RECORDER_SIZE;
+    mTriggerMarker.clear();
+    mDedupCallStacks = false;
+    mLazyProcessMaps = false;
+    mAggregateSamplesMs = 0;
+    mFilterPidSamples = false;
+    mFilterPidTracepoints = false;
+    mInheritStatCounters = false;
+    mSuppressMetricInputs = false;
+    mExcludeGuestEvents = false;
+    mExcludeHostEvents = false;
+    mLockContention = false;
+    mThreadEnergy = false;
+    mEtmTrace = false;
+    mEtmFilters.clear();
+    mEtmStrobeWindowUs = 0;
+    mEtmStrobePeriodUs = 0;
+    mSegmentSize = 0;
+    mSegmentSeconds = 0;
+    mSegmentCount = 0;
+    mIndexIntervalMs = 0;
+    mCpuBudgetPercent = 0;
+    mMemoryLimit = 0;
+    mSubscriberPort = 0;
+    mSubscriberQueueSize = DEFAULT_SUBSCRIBER_QUEUE_SIZE;
+    mSubscriberDisconnect = false;
+    mResumeTimeoutSeconds = 0;
+    mSpoolSize = DEFAULT_SPOOL_SIZE;
+    mDataStreams = 0;
+    mLowWakeupSeconds = 0;
+    mStopDrainTimeoutMs = DEFAULT_STOP_DRAIN_TIMEOUT_MS;
+    mCpuLocalDrain = false;
+    mArmNNAggregateMs = 0;
+    mArmNNExemplarInterval = DEFAULT_ARMNN_EXEMPLAR_INTERVAL;
+    mAnnotationChannelMaxRate = 0;
+    mAnnotationChannelSample = 0;
     mImages.clear();
+    mFunctionProbes.clear();
     mConfigurationXMLPath = nullptr;
     mSessionXMLPath = nullptr;
     mEventsXMLPath = nullptr;
@@ -48,9 +121,13 @@ void SessionData::initialize()
     mCaptureWorkingDir = nullptr;
     mCaptureUser = nullptr;
     mSampleRate = 0;
+    mClusterSampleRates.clear();
     mLiveRate = 0;
     mDuration = 0;
     mBacktraceDepth = 0;
+    mUserStackSize = 0;
+    mMaxCallStackDepth = 0;
+    mCallStackSamplePeriod = 1;
     mTotalBufferSize = 0;
     long l = sysconf(_SC_PAGE_SIZE);
     if (l < 0) {
@@ -67,26 +144,20 @@ void SessionData::parseSessionXML(char * xmlString)
     SessionXML session(xmlString);
     session.parse();
 
-    // Set session data values - use prime numbers just below the desired value to reduce the chance of events firing at the same time
+    // Set session data values
     if ((gSessionData.parameterSetFlag & USE_CMDLINE_ARG_SAMPLE_RATE) == 0) {
-        if (strcmp(session.parameters.sample_rate, "high") == 0) {
-            mSampleRate = 10007; // 10000
-        }
-        else if (strcmp(session.parameters.sample_rate, "normal") == 0) {
-            mSampleRate = 1009; // 1000
-        }
-        else if (strcmp(session.parameters.sample_rate, "low") == 0) {
-            mSampleRate = 101; // 100
-        }
-        else if (strcmp(session.parameters.sample_rate, "none") == 0) {
-            mSampleRate = 0;
-        }
-        else {
-
+        if (!parseSampleRate(session.parameters.sample_rate, mSampleRate)) {
             LOG_ERROR("Invalid sample rate (%s) in session xml.", session.parameters.sample_rate);
             handleException();
         }
     }
+    mClusterSampleRates.clear();
+    for (const auto & [cluster, sampleRate] : session.parameters.cluster_sample_rates) {
+        if (!parseSampleRate(sampleRate.c_str(), mClusterSampleRates[cluster])) {
+            LOG_ERROR("Invalid sample rate (%s) for cluster %s in session xml.", sampleRate.c_str(), cluster.c_str());
+            handleException();
+        }
+    }
     if ((gSessionData.parameterSetFlag & USE_CMDLINE_ARG_CALL_STACK_UNWINDING) == 0) {
         mBacktraceDepth = session.parameters.call_stack_unwinding ? 128 : 0;
     }
@@ -119,6 +190,9 @@ void SessionData::parseSessionXML(char * xmlString)
         else {
             // Convert milli- to nanoseconds
             mLiveRate = session.parameters.live_rate * 1000000ULL;
+            if (mLowWakeupSeconds > 0) {
+                mLiveRate = std::max<uint64_t>(mLiveRate, mLowWakeupSeconds * NS_PER_S);
+            }
         }
     }
     if ((!mSystemWide) && (mWaitForProcessCommand == nullptr) && mCaptureCommand.empty() && mPids.empty()) {
@@ -138,4 +212,31 @@ void SessionData::parseSessionXML(char * xmlString)
                   "or disable system-wide mode.");
         handleException();
     }
+
+    if (!mCgroup.empty()) {
+        if (!mSystemWide) {
+            LOG_ERROR("Capturing a cgroup requires system-wide mode.");
+            handleException();
+        }
+
+        auto path = perf_utils::findPerfEventCgroupPath(mCgroup);
+        if (!path) {
+            LOG_ERROR("Unable to find the cgroup '%s'.", mCgroup.c_str());
+            handleException();
+        }
+        mCgroup = *path;
+    }
+
+    if ((!mLocalCapture) && ((mSegmentSize > 0) || (mSegmentSeconds > 0))) {
+        LOG_WARNING("Segmented capture data is only supported for local captures, the data will not be segmented.");
+    }
+
+    if ((!mTriggerMarker.empty()) && (mFlightRecorderSeconds == 0)) {
+        LOG_WARNING("The trigger marker only has an effect when the flight recorder is enabled.");
+    }
+
+    if ((!mSystemWide) && (mPmuMultiplexQuantumMs > 0)) {
+        LOG_WARNING("PMU event multiplexing is only supported in system-wide mode. Any events that do not fit the "
+                    "PMU may not be counted.");
+    }
 }
@@ -17,6 +17,7 @@
 #include <list>
 #include <map>
 #include <memory>
+#include <optional>
 #include <set>
 #include <string>
 #include <vector>
@@ -41,9 +42,27 @@ public:
     char mMaliMidgardCounters[1 << 13];
 };
 
+/** A function whose latency is measured by a pair of uprobes on its entry and return */
+struct FunctionProbe {
+    // the executable or shared library that contains the function
+    std::string path;
+    // the name of the function's symbol
+    std::string function;
+};
+
 class SessionData {
 public:
     static const size_t MAX_STRING_LEN = 80;
+    static const int DEFAULT_FLIGHT_RECORDER_SIZE = 64;
+    static const int DEFAULT_SUBSCRIBER_QUEUE_SIZE = 16;
+    static const int DEFAULT_SPOOL_SIZE = 256;
+    static const int DEFAULT_STOP_DRAIN_TIMEOUT_MS = 10000;
+    static const int DEFAULT_ARMNN_EXEMPLAR_INTERVAL = 10;
+    static const int MAX_DATA_STREAMS = 16;
+    // the largest sample_stack_user that perf accepts, being below USHRT_MAX and a multiple of 8
+    static const int MAX_USER_STACK_SIZE = 65528;
+    // the kernel's default limit on the frames in a call stack (perf_event_max_stack)
+    static const int MAX_CALL_STACK_DEPTH = 127;
 
     SessionData() = default;
     // Intentionally unimplemented
@@ -58,8 +77,11 @@ public:
     shared_memory::unique_ptr<SharedData> mSharedData {};
 
     std::list<std::string> mImages {};
+    std::vector<FunctionProbe> mFunctionProbes {};
     std::vector<std::string> mCaptureCommand {};
     std::set<int> mPids {};
+    // the perf_event cgroup to which the CPU events of a system-wide capture are restricted, or empty for all tasks
+    std::string mCgroup {};
     std::set<Constant> mConstants {};
 
     const char * mConfigurationXMLPath {nullptr};
@@ -77,14 +99,27 @@ public:
     uint64_t parameterSetFlag {0};
     int mAndroidApiLevel {0};
     int mBacktraceDepth {0};
+    // copy this many bytes of the user stack with each perf sample that has a call stack, so that the perf agent can
+    // unwind code that is built without frame pointers from its unwind tables, or 0 to only follow the frame pointers
+    int mUserStackSize {0};
+    // the most frames in each sampled call stack, which bounds the sample size and the kernel's unwinding cost, or 0
+    // for the kernel's limit
+    int mMaxCallStackDepth {0};
+    // collect the call stack with only one in this many of the periodic samples (the others just record the pc), or
+    // 1 for every sample
+    int mCallStackSamplePeriod {1};
     // number of MB to use for the entire collection buffer
     int mTotalBufferSize {0};
     int mSampleRate {0};
+    // overrides mSampleRate for the PC sampling of specific clusters, by cluster id or core name
+    std::map<std::string, int> mClusterSampleRates {};
     int mDuration {0};
     int mPageSize {0};
     int mAnnotateStart {0};
     int mPerfMmapSizeInPages {0};
     int mSpeSampleRate {-1};
+    // split the CPU PMU events into groups that fit the PMU and rotate them every N milliseconds, or 0 to not
+    int mPmuMultiplexQuantumMs {0};
     bool mStopOnExit {false};
     bool mWaitingOnCommand {false};
     bool mLocalCapture {false};
@@ -95,6 +130,112 @@ public:
     bool mFtraceRaw {false};
     bool mSystemWide {false};
     bool mExcludeKernelEvents {false};
+    // compress the local capture data file (as 0000000000.lz4)
+    bool mCompressLocalCapture {false};
+    // run the counter polling threads as SCHED_FIFO
+    bool mRealtimePolling {false};
+    // the cpu to pin the counter polling threads to, or -1 for any
+    int mPollingCpu {-1};
+    // the cpus to pin all of gatord's threads (and its agents' threads) to, which does not include the profiled
+    // command, or empty for any
+    std::set<int> mGatorCpus {};
+    // the nice value of gatord's threads, or empty to keep the default high priority
+    std::optional<int> mGatorNice {};
+    // write the polled counters as FrameType::BLOCK_COUNTER_DELTA frames (only requested by hosts that support them)
+    bool mDeltaBlockCounters {false};
+    // also write FrameType::BLOCK_COUNTER_ROLLUP frames summarising the polled counters at coarser resolutions
+    bool mCounterRollups {false};
+    // keep only the most recent N seconds of perf data in the perf agent, sending it when triggered, or 0 to send it all
+    int mFlightRecorderSeconds {0};
+    // the maximum size of the perf data held by the flight recorder, in MBs
+    int mFlightRecorderSize {DEFAULT_FLIGHT_RECORDER_SIZE};
+    // trigger the flight recorder whenever a marker annotation with exactly this text is received, or empty for none
+    std::string mTriggerMarker {};
+    // replace repeated perf sample call stacks with references to FrameType::PERF_CALL_STACKS entries (only requested
+    // by hosts that support them)
+    bool mDedupCallStacks {false};
+    // in system-wide mode, send the /proc/[pid]/maps of only those processes that appear in the perf samples, once
+    // they are first seen, rather than of every process at the start of the capture
+    bool mLazyProcessMaps {false};
+    // fold the perf samples into FrameType::PERF_SAMPLE_AGGREGATES windows of N milliseconds, rather than sending each
+    // sample, or 0 to send them all (only requested by hosts that support them)
+    int mAggregateSamplesMs {0};
+    // in system-wide mode with --pid, drop the perf samples of every other process in the agent rather than sending
+    // them all to the host
+    bool mFilterPidSamples {false};
+    // in system-wide mode with --pid, have the kernel keep only the records of the chosen tracepoint counters that are
+    // from the processes (though not their children), rather than writing every process's records
+    bool mFilterPidTracepoints {false};
+    // in application mode, count the perf events that have no sample period per process (summed over its threads by
+    // the kernel, which writes each thread's counts on exit) and read them periodically, rather than sampling them
+    bool mInheritStatCounters {false};
+    // don't capture the selected cpu PMU events that are inputs to a selected derived metric of the same cluster (which
+    // the perf agent evaluates from its own counting groups), so that only the metric values are sent
+    bool mSuppressMetricInputs {false};
+    // with KVM, count the cpu PMU events only while running the guests or only while running the host, rather than
+    // both (the guests' samples are those of their vcpu threads, marked PERF_RECORD_MISC_GUEST_KERNEL / _USER)
+    bool mExcludeGuestEvents {false};
+    bool mExcludeHostEvents {false};
+    // pair the futex syscalls (or the kernel's lock contention tracepoints) of each thread in the perf agent, sending a
+    // histogram of the wait times of each lock and call site rather than every syscall
+    bool mLockContention {false};
+    // attribute the energy of each cpu, from the kernel's energy model and the cpu's frequency, to the threads that
+    // ran on it in the perf agent, sending the runtime and energy of each thread rather than only the scheduler trace
+    bool mThreadEnergy {false};
+    // trace the instructions executed by each cpu with its CoreSight ETM / ETE, through the aux buffer of the cs_etm
+    // PMU, optionally only within the address range filters (as for PERF_EVENT_IOC_SET_FILTER, e.g.
+    // "filter 0x1000/0x400@/usr/bin/app") and only for the first N microseconds of every M (strobing)
+    bool mEtmTrace {false};
+    std::string mEtmFilters {};
+    int mEtmStrobeWindowUs {0};
+    int mEtmStrobePeriodUs {0};
+    // split the local capture data file into segments of at most N MBs and / or N seconds, or 0 for no limit
+    int mSegmentSize {0};
+    int mSegmentSeconds {0};
+    // keep only the most recent N segments of the local capture data file, or 0 to keep them all
+    int mSegmentCount {0};
+    // write a time index alongside the local capture data file, with an entry every N milliseconds, or 0 for none
+    int mIndexIntervalMs {0};
+    // slow down the counter polling while gatord uses more than N percent of a CPU, or 0 for no limit
+    int mCpuBudgetPercent {0};
+    // carve all of gatord's capture buffers from a budget of N MBs, shrinking them to fit, or 0 for no limit
+    int mMemoryLimit {0};
+    // also deliver the capture data to any extra hosts that connect to this TCP port, or 0 for none
+    int mSubscriberPort {0};
+    // the most capture data queued for each of those hosts, in MBs
+    int mSubscriberQueueSize {DEFAULT_SUBSCRIBER_QUEUE_SIZE};
+    // disconnect a host whose queue is full, rather than dropping the data that does not fit
+    bool mSubscriberDisconnect {false};
+    // when the connection to the host is lost, wait up to N seconds for it to reconnect and resume the capture (if it
+    // gave a session token), or 0 to end the capture
+    int mResumeTimeoutSeconds {0};
+    // the most capture data held on the target whilst waiting for the host to resume the capture, in MBs
+    int mSpoolSize {DEFAULT_SPOOL_SIZE};
+    // the number of further connections the host opens to stripe the capture data over, or 0 to send it all over the
+    // main connection (only requested by hosts that support ResponseType::APC_DATA_SEQUENCED)
+    int mDataStreams {0};
+    // to measure power, batch gatord's own activity into one wakeup every N seconds (or 0 for the usual timers): the
+    // counter polling, live commits, perf ring buffer polling and sync are all paced to the period, gatord's threads
+    // are given a large timer slack and kept on the smallest core, and the perf buffers only wake gatord when nearly
+    // full
+    int mLowWakeupSeconds {0};
+    // the longest time, in ms from the stop request, that the perf agent spends draining the ring buffers at the end
+    // of the capture (after which any data that remains is discarded so that the capture ends promptly), or 0 for no
+    // limit
+    int mStopDrainTimeoutMs {DEFAULT_STOP_DRAIN_TIMEOUT_MS};
+    // drain each cpu's perf ring buffer on a thread of the perf agent that is pinned to that cpu (so the records are
+    // read from its own cache, and the cost of draining each cpu is seen on it), rather than on the agent's threads
+    bool mCpuLocalDrain {false};
+    // have the Arm NN processes sample their counters once every N ms, so that they send one set of values (summed
+    // over the window, for the delta counters) per window rather than one per ms, and not send their timeline, or 0
+    // to send everything; every Mth window is instead captured in full, with the timeline, as an exemplar (or never
+    // for 0)
+    int mArmNNAggregateMs {0};
+    int mArmNNExemplarInterval {DEFAULT_ARMNN_EXEMPLAR_INTERVAL};
+    // have the annotate library suppress the channel annotations beyond N per second on each channel of each thread,
+    // and keep only one in M of them chosen at random (0 leaves the limits set by the application's environment)
+    int mAnnotationChannelMaxRate {0};
+    int mAnnotationChannelSample {0};
 
     // PMU Counters
     Counter mCounters[MAX_PERFORMANCE_COUNTERS];
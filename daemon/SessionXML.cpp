@@ -5,15 +5,20 @@
 #include "Logging.h"
 #include "OlyUtility.h"
 #include "SessionData.h"
+#include "lib/Utils.h"
 
 #include <climits>
 #include <cstddef>
 #include <cstdlib>
 #include <cstring>
 
+#include <sched.h>
+
 namespace {
     constexpr const char * TAG_SESSION = "session";
     constexpr const char * TAG_IMAGE = "image";
+    constexpr const char * TAG_CLUSTER = "cluster";
+    constexpr const char * TAG_FUNCTION_PROBE = "function_probe";
 
     constexpr const char * ATTR_VERSION = "version";
     constexpr const char * ATTR_CALL_STACK_UNWINDING = "call_stack_unwinding";
@@ -22,12 +27,61 @@ namespace {
     constexpr const char * ATTR_DURATION = "duration";
     constexpr const char * USE_EFFICIENT_FTRACE = "use_efficient_ftrace";
     constexpr const char * ATTR_PATH = "path";
+    constexpr const char * ATTR_NAME = "name";
+    constexpr const char * ATTR_FUNCTION = "function";
     constexpr const char * ATTR_LIVE_RATE = "live_rate";
     constexpr const char * ATTR_CAPTURE_WORKING_DIR = "capture_working_dir";
     constexpr const char * ATTR_CAPTURE_COMMAND = "capture_command";
     constexpr const char * ATTR_STOP_GATOR = "stop_gator";
     constexpr const char * ATTR_CAPTURE_USER = "capture_user";
     constexpr const char * ATTR_EXCLUDE_KERNEL_EVENTS = "exclude_kernel_events";
+    constexpr const char * ATTR_COMPRESS_LOCAL_CAPTURE = "compress_local_capture";
+    constexpr const char * ATTR_REALTIME_POLLING = "realtime_polling";
+    constexpr const char * ATTR_POLLING_CPU = "polling_cpu";
+    constexpr const char * ATTR_GATOR_CPUS = "gator_cpus";
+    constexpr const char * ATTR_GATOR_NICE = "gator_nice";
+    constexpr const char * ATTR_DELTA_BLOCK_COUNTERS = "delta_block_counters";
+    constexpr const char * ATTR_COUNTER_ROLLUPS = "counter_rollups";
+    constexpr const char * ATTR_FLIGHT_RECORDER = "flight_recorder";
+    constexpr const char * ATTR_FLIGHT_RECORDER_SIZE = "flight_recorder_size";
+    constexpr const char * ATTR_TRIGGER_MARKER = "trigger_marker";
+    constexpr const char * ATTR_DEDUP_CALL_STACKS = "dedup_call_stacks";
+    constexpr const char * ATTR_CGROUP = "cgroup";
+    constexpr const char * ATTR_LAZY_PROCESS_MAPS = "lazy_process_maps";
+    constexpr const char * ATTR_AGGREGATE_SAMPLES = "aggregate_samples";
+    constexpr const char * ATTR_FILTER_PID_SAMPLES = "filter_pid_samples";
+    constexpr const char * ATTR_FILTER_PID_TRACEPOINTS = "filter_pid_tracepoints";
+    constexpr const char * ATTR_INHERIT_STAT_COUNTERS = "inherit_stat_counters";
+    constexpr const char * ATTR_SUPPRESS_METRIC_INPUTS = "suppress_metric_inputs";
+    constexpr const char * ATTR_ETM = "etm";
+    constexpr const char * ATTR_ETM_FILTERS = "etm_filters";
+    constexpr const char * ATTR_ETM_STROBE_WINDOW = "etm_strobe_window";
+    constexpr const char * ATTR_ETM_STROBE_PERIOD = "etm_strobe_period";
+    constexpr const char * ATTR_SEGMENT_SIZE = "segment_size";
+    constexpr const char * ATTR_SEGMENT_DURATION = "segment_duration";
+    constexpr const char * ATTR_SEGMENT_COUNT = "segment_count";
+    constexpr const char * ATTR_INDEX_INTERVAL = "index_interval";
+    constexpr const char * ATTR_CPU_BUDGET = "cpu_budget";
+    constexpr const char * ATTR_MEMORY_LIMIT = "memory_limit";
+    constexpr const char * ATTR_SUBSCRIBER_PORT = "subscriber_port";
+    constexpr const char * ATTR_SUBSCRIBER_QUEUE_SIZE = "subscriber_queue_size";
+    constexpr const char * ATTR_SUBSCRIBER_DROP_POLICY = "subscriber_drop_policy";
+    constexpr const char * ATTR_RESUME_TIMEOUT = "resume_timeout";
+    constexpr const char * ATTR_SPOOL_SIZE = "spool_size";
+    constexpr const char * ATTR_DATA_STREAMS = "data_streams";
+    constexpr const char * ATTR_USER_STACK_SIZE = "user_stack_size";
+    constexpr const char * ATTR_CALL_STACK_DEPTH = "call_stack_depth";
+    constexpr const char * ATTR_CALL_STACK_SAMPLE_PERIOD = "call_stack_sample_period";
+    constexpr const char * ATTR_GUEST_EVENTS = "guest_events";
+    constexpr const char * ATTR_LOCK_CONTENTION = "lock_contention";
+    constexpr const char * ATTR_THREAD_ENERGY = "thread_energy";
+    constexpr const char * ATTR_LOW_WAKEUP_PERIOD = "low_wakeup_period";
+    constexpr const char * ATTR_STOP_DRAIN_TIMEOUT = "stop_drain_timeout";
+    constexpr const char * ATTR_CPU_LOCAL_DRAIN = "cpu_local_drain";
+    constexpr const char * ATTR_ARMNN_AGGREGATE = "armnn_aggregate";
+    constexpr const char * ATTR_ARMNN_EXEMPLAR_INTERVAL = "armnn_exemplar_interval";
+    constexpr const char * ATTR_ANNOTATION_CHANNEL_MAX_RATE = "annotation_channel_max_rate";
+    constexpr const char * ATTR_ANNOTATION_CHANNEL_SAMPLE = "annotation_channel_sample";
 }
 
 SessionXML::SessionXML(const char * str) : mSessionXML(str)
@@ -133,6 +187,258 @@ void SessionXML::sessionTag(mxml_node_t * tree, mxml_node_t * node)
     if ((gSessionData.parameterSetFlag & USE_CMDLINE_ARG_EXCLUDE_KERNEL) == 0) {
         gSessionData.mExcludeKernelEvents = stringToBool(mxmlElementGetAttr(node, ATTR_EXCLUDE_KERNEL_EVENTS), false);
     }
+    gSessionData.mCompressLocalCapture = stringToBool(mxmlElementGetAttr(node, ATTR_COMPRESS_LOCAL_CAPTURE), false);
+    gSessionData.mRealtimePolling = stringToBool(mxmlElementGetAttr(node, ATTR_REALTIME_POLLING), false);
+    if (mxmlElementGetAttr(node, ATTR_POLLING_CPU) != nullptr) {
+        if (!stringToInt(&gSessionData.mPollingCpu, mxmlElementGetAttr(node, ATTR_POLLING_CPU), 10)) {
+            LOG_ERROR("Invalid session.xml polling_cpu must be an integer");
+            handleException();
+        }
+    }
+    const char * gatorCpus = mxmlElementGetAttr(node, ATTR_GATOR_CPUS);
+    if (gatorCpus != nullptr) {
+        gSessionData.mGatorCpus = lib::parseCpuMask(gatorCpus);
+        if (gSessionData.mGatorCpus.empty() || (*gSessionData.mGatorCpus.rbegin() >= CPU_SETSIZE)) {
+            LOG_ERROR("Invalid session.xml gator_cpus must be a list of cpus, such as 0-1,4");
+            handleException();
+        }
+    }
+    if (mxmlElementGetAttr(node, ATTR_GATOR_NICE) != nullptr) {
+        int nice = 0;
+        if (!stringToInt(&nice, mxmlElementGetAttr(node, ATTR_GATOR_NICE), 10) || (nice < -20) || (nice > 19)) {
+            LOG_ERROR("Invalid session.xml gator_nice must be an integer from -20 to 19");
+            handleException();
+        }
+        gSessionData.mGatorNice = nice;
+    }
+    gSessionData.mDeltaBlockCounters = stringToBool(mxmlElementGetAttr(node, ATTR_DELTA_BLOCK_COUNTERS), false);
+    gSessionData.mCounterRollups = stringToBool(mxmlElementGetAttr(node, ATTR_COUNTER_ROLLUPS), false);
+    if (mxmlElementGetAttr(node, ATTR_FLIGHT_RECORDER) != nullptr) {
+        if (!stringToInt(&gSessionData.mFlightRecorderSeconds, mxmlElementGetAttr(node, ATTR_FLIGHT_RECORDER), 10)
+            || (gSessionData.mFlightRecorderSeconds < 0)) {
+            LOG_ERROR("Invalid session.xml flight_recorder must be a non-negative integer");
+            handleException();
+        }
+    }
+    if (mxmlElementGetAttr(node, ATTR_FLIGHT_RECORDER_SIZE) != nullptr) {
+        if (!stringToInt(&gSessionData.mFlightRecorderSize, mxmlElementGetAttr(node, ATTR_FLIGHT_RECORDER_SIZE), 10)
+            || (gSessionData.mFlightRecorderSize <= 0)) {
+            LOG_ERROR("Invalid session.xml flight_recorder_size must be a positive integer");
+            handleException();
+        }
+    }
+    const char * triggerMarker = mxmlElementGetAttr(node, ATTR_TRIGGER_MARKER);
+    gSessionData.mTriggerMarker = (triggerMarker != nullptr ? triggerMarker : "");
+    gSessionData.mDedupCallStacks = stringToBool(mxmlElementGetAttr(node, ATTR_DEDUP_CALL_STACKS), false);
+    gSessionData.mLazyProcessMaps = stringToBool(mxmlElementGetAttr(node, ATTR_LAZY_PROCESS_MAPS), false);
+    if (mxmlElementGetAttr(node, ATTR_AGGREGATE_SAMPLES) != nullptr) {
+        if (!stringToInt(&gSessionData.mAggregateSamplesMs, mxmlElementGetAttr(node, ATTR_AGGREGATE_SAMPLES), 10)
+            || (gSessionData.mAggregateSamplesMs < 0)) {
+            LOG_ERROR("Invalid session.xml aggregate_samples must be a non-negative integer");
+            handleException();
+        }
+    }
+    gSessionData.mFilterPidSamples = stringToBool(mxmlElementGetAttr(node, ATTR_FILTER_PID_SAMPLES), false);
+    gSessionData.mFilterPidTracepoints =
+        stringToBool(mxmlElementGetAttr(node, ATTR_FILTER_PID_TRACEPOINTS), false);
+    gSessionData.mInheritStatCounters = stringToBool(mxmlElementGetAttr(node, ATTR_INHERIT_STAT_COUNTERS), false);
+    gSessionData.mSuppressMetricInputs = stringToBool(mxmlElementGetAttr(node, ATTR_SUPPRESS_METRIC_INPUTS), false);
+    const char * guestEvents = mxmlElementGetAttr(node, ATTR_GUEST_EVENTS);
+    if ((guestEvents != nullptr) && (strcmp(guestEvents, "include") != 0) && (strcmp(guestEvents, "exclude") != 0)
+        && (strcmp(guestEvents, "only") != 0)) {
+        LOG_ERROR("Invalid session.xml guest_events must be include, exclude or only");
+        handleException();
+    }
+    gSessionData.mExcludeGuestEvents = ((guestEvents != nullptr) && (strcmp(guestEvents, "exclude") == 0));
+    gSessionData.mExcludeHostEvents = ((guestEvents != nullptr) && (strcmp(guestEvents, "only") == 0));
+    gSessionData.mLockContention = stringToBool(mxmlElementGetAttr(node, ATTR_LOCK_CONTENTION), false);
+    gSessionData.mThreadEnergy = stringToBool(mxmlElementGetAttr(node, ATTR_THREAD_ENERGY), false);
+    gSessionData.mEtmTrace = stringToBool(mxmlElementGetAttr(node, ATTR_ETM), false);
+    {
+        const char * etmFilters = mxmlElementGetAttr(node, ATTR_ETM_FILTERS);
+        gSessionData.mEtmFilters = (etmFilters != nullptr ? etmFilters : "");
+    }
+    if (mxmlElementGetAttr(node, ATTR_ETM_STROBE_WINDOW) != nullptr) {
+        if (!stringToInt(&gSessionData.mEtmStrobeWindowUs, mxmlElementGetAttr(node, ATTR_ETM_STROBE_WINDOW), 10)
+            || (gSessionData.mEtmStrobeWindowUs < 0)) {
+            LOG_ERROR("Invalid session.xml etm_strobe_window must be a non-negative integer");
+            handleException();
+        }
+    }
+    if (mxmlElementGetAttr(node, ATTR_ETM_STROBE_PERIOD) != nullptr) {
+        if (!stringToInt(&gSessionData.mEtmStrobePeriodUs, mxmlElementGetAttr(node, ATTR_ETM_STROBE_PERIOD), 10)
+            || (gSessionData.mEtmStrobePeriodUs < 0)) {
+            LOG_ERROR("Invalid session.xml etm_strobe_period must be a non-negative integer");
+            handleException();
+        }
+    }
+    if ((gSessionData.mEtmStrobeWindowUs > 0) && (gSessionData.mEtmStrobeWindowUs >= gSessionData.mEtmStrobePeriodUs)) {
+        LOG_ERROR("Invalid session.xml etm_strobe_window must be less than etm_strobe_period");
+        handleException();
+    }
+    if (mxmlElementGetAttr(node, ATTR_SEGMENT_SIZE) != nullptr) {
+        if (!stringToInt(&gSessionData.mSegmentSize, mxmlElementGetAttr(node, ATTR_SEGMENT_SIZE), 10)
+            || (gSessionData.mSegmentSize < 0)) {
+            LOG_ERROR("Invalid session.xml segment_size must be a non-negative integer");
+            handleException();
+        }
+    }
+    if (mxmlElementGetAttr(node, ATTR_SEGMENT_DURATION) != nullptr) {
+        if (!stringToInt(&gSessionData.mSegmentSeconds, mxmlElementGetAttr(node, ATTR_SEGMENT_DURATION), 10)
+            || (gSessionData.mSegmentSeconds < 0)) {
+            LOG_ERROR("Invalid session.xml segment_duration must be a non-negative integer");
+            handleException();
+        }
+    }
+    if (mxmlElementGetAttr(node, ATTR_SEGMENT_COUNT) != nullptr) {
+        if (!stringToInt(&gSessionData.mSegmentCount, mxmlElementGetAttr(node, ATTR_SEGMENT_COUNT), 10)
+            || (gSessionData.mSegmentCount < 0)) {
+            LOG_ERROR("Invalid session.xml segment_count must be a non-negative integer");
+            handleException();
+        }
+    }
+    if (mxmlElementGetAttr(node, ATTR_INDEX_INTERVAL) != nullptr) {
+        if (!stringToInt(&gSessionData.mIndexIntervalMs, mxmlElementGetAttr(node, ATTR_INDEX_INTERVAL), 10)
+            || (gSessionData.mIndexIntervalMs < 0)) {
+            LOG_ERROR("Invalid session.xml index_interval must be a non-negative integer");
+            handleException();
+        }
+    }
+    if (mxmlElementGetAttr(node, ATTR_CPU_BUDGET) != nullptr) {
+        if (!stringToInt(&gSessionData.mCpuBudgetPercent, mxmlElementGetAttr(node, ATTR_CPU_BUDGET), 10)
+            || (gSessionData.mCpuBudgetPercent < 0) || (gSessionData.mCpuBudgetPercent > 100)) {
+            LOG_ERROR("Invalid session.xml cpu_budget must be an integer between 0 and 100");
+            handleException();
+        }
+    }
+    if (mxmlElementGetAttr(node, ATTR_MEMORY_LIMIT) != nullptr) {
+        if (!stringToInt(&gSessionData.mMemoryLimit, mxmlElementGetAttr(node, ATTR_MEMORY_LIMIT), 10)
+            || (gSessionData.mMemoryLimit < 0)) {
+            LOG_ERROR("Invalid session.xml memory_limit must be a non-negative integer");
+            handleException();
+        }
+    }
+    if (mxmlElementGetAttr(node, ATTR_SUBSCRIBER_PORT) != nullptr) {
+        if (!stringToInt(&gSessionData.mSubscriberPort, mxmlElementGetAttr(node, ATTR_SUBSCRIBER_PORT), 10)
+            || (gSessionData.mSubscriberPort < 0) || (gSessionData.mSubscriberPort > 65535)) {
+            LOG_ERROR("Invalid session.xml subscriber_port must be an integer between 0 and 65535");
+            handleException();
+        }
+    }
+    if (mxmlElementGetAttr(node, ATTR_SUBSCRIBER_QUEUE_SIZE) != nullptr) {
+        if (!stringToInt(&gSessionData.mSubscriberQueueSize, mxmlElementGetAttr(node, ATTR_SUBSCRIBER_QUEUE_SIZE), 10)
+            || (gSessionData.mSubscriberQueueSize <= 0)) {
+            LOG_ERROR("Invalid session.xml subscriber_queue_size must be a positive integer");
+            handleException();
+        }
+    }
+    const char * dropPolicy = mxmlElementGetAttr(node, ATTR_SUBSCRIBER_DROP_POLICY);
+    if ((dropPolicy != nullptr) && (strcmp(dropPolicy, "drop") != 0) && (strcmp(dropPolicy, "disconnect") != 0)) {
+        LOG_ERROR("Invalid session.xml subscriber_drop_policy must be drop or disconnect");
+        handleException();
+    }
+    gSessionData.mSubscriberDisconnect = ((dropPolicy != nullptr) && (strcmp(dropPolicy, "disconnect") == 0));
+    if (mxmlElementGetAttr(node, ATTR_RESUME_TIMEOUT) != nullptr) {
+        if (!stringToInt(&gSessionData.mResumeTimeoutSeconds, mxmlElementGetAttr(node, ATTR_RESUME_TIMEOUT), 10)
+            || (gSessionData.mResumeTimeoutSeconds < 0)) {
+            LOG_ERROR("Invalid session.xml resume_timeout must be a non-negative integer");
+            handleException();
+        }
+    }
+    if (mxmlElementGetAttr(node, ATTR_SPOOL_SIZE) != nullptr) {
+        if (!stringToInt(&gSessionData.mSpoolSize, mxmlElementGetAttr(node, ATTR_SPOOL_SIZE), 10)
+            || (gSessionData.mSpoolSize <= 0)) {
+            LOG_ERROR("Invalid session.xml spool_size must be a positive integer");
+            handleException();
+        }
+    }
+    if (mxmlElementGetAttr(node, ATTR_DATA_STREAMS) != nullptr) {
+        if (!stringToInt(&gSessionData.mDataStreams, mxmlElementGetAttr(node, ATTR_DATA_STREAMS), 10)
+            || (gSessionData.mDataStreams < 0) || (gSessionData.mDataStreams > SessionData::MAX_DATA_STREAMS)) {
+            LOG_ERROR("Invalid session.xml data_streams must be an integer between 0 and %d",
+                      SessionData::MAX_DATA_STREAMS);
+            handleException();
+        }
+    }
+    if (mxmlElementGetAttr(node, ATTR_USER_STACK_SIZE) != nullptr) {
+        if (!stringToInt(&gSessionData.mUserStackSize, mxmlElementGetAttr(node, ATTR_USER_STACK_SIZE), 10)
+            || (gSessionData.mUserStackSize < 0) || (gSessionData.mUserStackSize > SessionData::MAX_USER_STACK_SIZE)) {
+            LOG_ERROR("Invalid session.xml user_stack_size must be an integer between 0 and %d",
+                      SessionData::MAX_USER_STACK_SIZE);
+            handleException();
+        }
+    }
+    if (mxmlElementGetAttr(node, ATTR_CALL_STACK_DEPTH) != nullptr) {
+        if (!stringToInt(&gSessionData.mMaxCallStackDepth, mxmlElementGetAttr(node, ATTR_CALL_STACK_DEPTH), 10)
+            || (gSessionData.mMaxCallStackDepth < 0)
+            || (gSessionData.mMaxCallStackDepth > SessionData::MAX_CALL_STACK_DEPTH)) {
+            LOG_ERROR("Invalid session.xml call_stack_depth must be an integer between 0 and %d",
+                      SessionData::MAX_CALL_STACK_DEPTH);
+            handleException();
+        }
+    }
+    if (mxmlElementGetAttr(node, ATTR_CALL_STACK_SAMPLE_PERIOD) != nullptr) {
+        if (!stringToInt(&gSessionData.mCallStackSamplePeriod,
+                         mxmlElementGetAttr(node, ATTR_CALL_STACK_SAMPLE_PERIOD),
+                         10)
+            || (gSessionData.mCallStackSamplePeriod < 1)) {
+            LOG_ERROR("Invalid session.xml call_stack_sample_period must be a positive integer");
+            handleException();
+        }
+    }
+    if (mxmlElementGetAttr(node, ATTR_LOW_WAKEUP_PERIOD) != nullptr) {
+        if (!stringToInt(&gSessionData.mLowWakeupSeconds, mxmlElementGetAttr(node, ATTR_LOW_WAKEUP_PERIOD), 10)
+            || (gSessionData.mLowWakeupSeconds < 0)) {
+            LOG_ERROR("Invalid session.xml low_wakeup_period must be a non-negative integer");
+            handleException();
+        }
+    }
+    if (mxmlElementGetAttr(node, ATTR_STOP_DRAIN_TIMEOUT) != nullptr) {
+        if (!stringToInt(&gSessionData.mStopDrainTimeoutMs, mxmlElementGetAttr(node, ATTR_STOP_DRAIN_TIMEOUT), 10)
+            || (gSessionData.mStopDrainTimeoutMs < 0)) {
+            LOG_ERROR("Invalid session.xml stop_drain_timeout must be a non-negative integer");
+            handleException();
+        }
+    }
+    gSessionData.mCpuLocalDrain = stringToBool(mxmlElementGetAttr(node, ATTR_CPU_LOCAL_DRAIN), false);
+    if (mxmlElementGetAttr(node, ATTR_ARMNN_AGGREGATE) != nullptr) {
+        if (!stringToInt(&gSessionData.mArmNNAggregateMs, mxmlElementGetAttr(node, ATTR_ARMNN_AGGREGATE), 10)
+            || (gSessionData.mArmNNAggregateMs < 0)) {
+            LOG_ERROR("Invalid session.xml armnn_aggregate must be a non-negative integer");
+            handleException();
+        }
+    }
+    if (mxmlElementGetAttr(node, ATTR_ARMNN_EXEMPLAR_INTERVAL) != nullptr) {
+        if (!stringToInt(&gSessionData.mArmNNExemplarInterval,
+                         mxmlElementGetAttr(node, ATTR_ARMNN_EXEMPLAR_INTERVAL),
+                         10)
+            || (gSessionData.mArmNNExemplarInterval < 0)) {
+            LOG_ERROR("Invalid session.xml armnn_exemplar_interval must be a non-negative integer");
+            handleException();
+        }
+    }
+    if (mxmlElementGetAttr(node, ATTR_ANNOTATION_CHANNEL_MAX_RATE) != nullptr) {
+        if (!stringToInt(&gSessionData.mAnnotationChannelMaxRate,
+                         mxmlElementGetAttr(node, ATTR_ANNOTATION_CHANNEL_MAX_RATE),
+                         10)
+            || (gSessionData.mAnnotationChannelMaxRate < 0)) {
+            LOG_ERROR("Invalid session.xml annotation_channel_max_rate must be a non-negative integer");
+            handleException();
+        }
+    }
+    if (mxmlElementGetAttr(node, ATTR_ANNOTATION_CHANNEL_SAMPLE) != nullptr) {
+        if (!stringToInt(&gSessionData.mAnnotationChannelSample,
+                         mxmlElementGetAttr(node, ATTR_ANNOTATION_CHANNEL_SAMPLE),
+                         10)
+            || (gSessionData.mAnnotationChannelSample < 0)) {
+            LOG_ERROR("Invalid session.xml annotation_channel_sample must be a non-negative integer");
+            handleException();
+        }
+    }
+    if ((gSessionData.parameterSetFlag & USE_CMDLINE_ARG_CGROUP) == 0) {
+        const char * cgroup = mxmlElementGetAttr(node, ATTR_CGROUP);
+        gSessionData.mCgroup = (cgroup != nullptr ? cgroup : "");
+    }
 
     // parse subtags
     node = mxmlGetFirstChild(node);
@@ -144,6 +450,12 @@ void SessionXML::sessionTag(mxml_node_t * tree, mxml_node_t * node)
         if (strcmp(TAG_IMAGE, mxmlGetElement(node)) == 0) {
             sessionImage(node);
         }
+        else if (strcmp(TAG_CLUSTER, mxmlGetElement(node)) == 0) {
+            sessionCluster(node);
+        }
+        else if (strcmp(TAG_FUNCTION_PROBE, mxmlGetElement(node)) == 0) {
+            sessionFunctionProbe(node);
+        }
         node = mxmlWalkNext(node, tree, MXML_NO_DESCEND);
     }
 }
@@ -152,3 +464,25 @@ void SessionXML::sessionImage(mxml_node_t * node)
 {
     gSessionData.mImages.emplace_back(mxmlElementGetAttr(node, ATTR_PATH));
 }
+
+void SessionXML::sessionFunctionProbe(mxml_node_t * node)
+{
+    const char * path = mxmlElementGetAttr(node, ATTR_PATH);
+    const char * function = mxmlElementGetAttr(node, ATTR_FUNCTION);
+    if ((path == nullptr) || (function == nullptr) || (*path == '\0') || (*function == '\0')) {
+        LOG_ERROR("Invalid session.xml function_probe must have a path and a function");
+        handleException();
+    }
+    gSessionData.mFunctionProbes.push_back({path, function});
+}
+
+void SessionXML::sessionCluster(mxml_node_t * node)
+{
+    const char * name = mxmlElementGetAttr(node, ATTR_NAME);
+    const char * sampleRate = mxmlElementGetAttr(node, ATTR_SAMPLE_RATE);
+    if ((name == nullptr) || (sampleRate == nullptr)) {
+        LOG_ERROR("Invalid session.xml cluster must have a name and a sample_rate");
+        handleException();
+    }
+    parameters.cluster_sample_rates[name] = sampleRate;
+}
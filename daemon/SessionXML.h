@@ -1,10 +1,13 @@
-/* Copyright (C) 2010-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2010-2022 by Arm Limited. All rights reserved. */
 
 #ifndef SESSION_XML_H
 #define SESSION_XML_H
 
 #include "mxml/mxml.h"
 
+#include <map>
+#include <string>
+
 struct ImageLinkList;
 
 struct ConfigParameters {
@@ -15,6 +18,8 @@ struct ConfigParameters {
     // whether stack unwinding is performed
     bool call_stack_unwinding;
     int live_rate;
+    // the sample rates ("high", "normal", "low" or "none") of specific clusters, by cluster id or core name
+    std::map<std::string, std::string> cluster_sample_rates {};
 
     ConfigParameters() : buffer_mode(), sample_rate(), call_stack_unwinding(false), live_rate(0)
     {
@@ -42,6 +47,10 @@ private:
 
     static void sessionImage(mxml_node_t * node);
 
+    static void sessionFunctionProbe(mxml_node_t * node);
+
+    void sessionCluster(mxml_node_t * node);
+
     void sessionTag(mxml_node_t * tree, mxml_node_t * node);
 };
 
@@ -1,9 +1,21 @@
-/* Copyright (C) 2013-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2013-2022 by Arm Limited. All rights reserved. */
 
 #include "SimpleDriver.h"
 
 #include "Counter.h"
 
+#include <algorithm>
+#include <cctype>
+#include <string>
+
+namespace {
+    std::string toLower(std::string value)
+    {
+        std::transform(value.begin(), value.end(), value.begin(), [](unsigned char c) { return std::tolower(c); });
+        return value;
+    }
+}
+
 SimpleDriver::~SimpleDriver()
 {
     DriverCounter * counters = mCounters;
@@ -59,27 +71,56 @@ int SimpleDriver::writeCounters(mxml_node_t * root) const
     return count;
 }
 
-DriverCounter * SimpleDriver::findCounter(Counter & counter) const
+void SimpleDriver::indexCounters() const
 {
-    DriverCounter * dcounter = nullptr;
+    static constexpr char slotSuffix[] = "_cnt";
+
+    mCountersByName.clear();
+    mCountersBySlotPrefix.clear();
+
+    std::size_t position = 0;
     for (DriverCounter * driverCounter = mCounters; driverCounter != nullptr;
          driverCounter = driverCounter->getNext()) {
-        if (strcasecmp(driverCounter->getName(), counter.getType()) == 0) {
-            dcounter = driverCounter;
-            counter.setType(driverCounter->getName());
-            break;
-        }
+        const std::string name = toLower(driverCounter->getName());
+
+        // keep the first of any duplicates, as the list was searched in order
+        mCountersByName.emplace(name, IndexedCounter {position, driverCounter});
+
         //to get the slot name when only part of the counter name is given
         //for eg: ARMv8_Cortex_A53 --> should be read as ARMv8_Cortex_A53_cnt0
-        std::string driverCounterName = driverCounter->getName();
-        std::string counterType = counter.getType();
-        counterType = counterType + "_cnt";
-        driverCounterName = driverCounterName.substr(0, counterType.length());
-        if (strcasecmp(driverCounterName.c_str(), counterType.c_str()) == 0) {
-            dcounter = driverCounter;
-            counter.setType(driverCounter->getName());
-            break;
+        for (auto pos = name.find(slotSuffix); pos != std::string::npos; pos = name.find(slotSuffix, pos + 1)) {
+            mCountersBySlotPrefix.emplace(name.substr(0, pos), IndexedCounter {position, driverCounter});
         }
+
+        ++position;
+    }
+
+    mCountersIndexed = true;
+}
+
+DriverCounter * SimpleDriver::findCounter(Counter & counter) const
+{
+    if (!mCountersIndexed) {
+        indexCounters();
+    }
+
+    const std::string type = toLower(counter.getType());
+    const auto byName = mCountersByName.find(type);
+    const auto bySlotPrefix = mCountersBySlotPrefix.find(type);
+
+    const IndexedCounter * match = nullptr;
+    if (byName != mCountersByName.end()) {
+        match = &byName->second;
+    }
+    if ((bySlotPrefix != mCountersBySlotPrefix.end())
+        && ((match == nullptr) || (bySlotPrefix->second.position < match->position))) {
+        match = &bySlotPrefix->second;
     }
-    return dcounter;
+
+    if (match == nullptr) {
+        return nullptr;
+    }
+
+    counter.setType(match->counter->getName());
+    return match->counter;
 }
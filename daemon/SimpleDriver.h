@@ -1,4 +1,4 @@
-/* Copyright (C) 2013-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2013-2022 by Arm Limited. All rights reserved. */
 
 #ifndef NATIVE_GATOR_DAEMON_SIMPLEDRIVER_H_
 #define NATIVE_GATOR_DAEMON_SIMPLEDRIVER_H_
@@ -6,6 +6,10 @@
 #include "Driver.h"
 #include "DriverCounter.h"
 
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+
 class SimpleDriver : public Driver {
 public:
     ~SimpleDriver() override;
@@ -27,12 +31,32 @@ protected:
 
     DriverCounter * getCounters() const { return mCounters; }
 
-    void setCounters(DriverCounter * const counter) { mCounters = counter; }
+    void setCounters(DriverCounter * const counter)
+    {
+        mCounters = counter;
+        mCountersIndexed = false;
+    }
 
     DriverCounter * findCounter(Counter & counter) const;
 
 private:
+    /** A counter, and its position in the list (as the first in the list is used when more than one matches) */
+    struct IndexedCounter {
+        std::size_t position;
+        DriverCounter * counter;
+    };
+
     DriverCounter * mCounters;
+    /**
+     * The counters by their lower case names, so that claiming and setting up a counter does not walk the list.
+     * Built on the first lookup after the list changes, which is once the events have been read.
+     */
+    mutable std::unordered_map<std::string, IndexedCounter> mCountersByName {};
+    /** The counters by the lower case of each part of their name that precedes "_cnt", for the slot counters */
+    mutable std::unordered_map<std::string, IndexedCounter> mCountersBySlotPrefix {};
+    mutable bool mCountersIndexed {false};
+
+    void indexCounters() const;
 };
 
 #endif /* NATIVE_GATOR_DAEMON_SIMPLEDRIVER_H_ */
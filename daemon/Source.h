@@ -1,4 +1,4 @@
-/* Copyright (C) 2010-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2010-2022 by Arm Limited. All rights reserved. */
 
 #pragma once
 
@@ -19,6 +19,12 @@ public:
      * @return true if done, nothing more to write
      */
     virtual bool write(ISender & sender) = 0;
+
+    /**
+     * @return true if the source may write large bursts of data (such as the perf samples), in which case it is
+     * written after the other sources so that their small frames (which the live view waits on) are not held up
+     */
+    [[nodiscard]] virtual bool isBulk() const { return false; }
 };
 
 class PrimarySource : public Source {
@@ -29,4 +35,6 @@ public:
      * @return monotonic start or empty on failure
      */
     virtual std::optional<std::uint64_t> sendSummary() = 0;
+
+    [[nodiscard]] bool isBulk() const override { return true; }
 };
@@ -1,4 +1,4 @@
-/* Copyright (C) 2011-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2011-2022 by Arm Limited. All rights reserved. */
 
 #include "StreamlineSetup.h"
 
@@ -19,6 +19,8 @@
 #include "xml/CurrentConfigXML.h"
 #include "xml/EventsXML.h"
 
+#include <string>
+
 static const char TAG_SESSION[] = "session";
 static const char TAG_REQUEST[] = "request";
 static const char TAG_CONFIGURATIONS[] = "configurations";
@@ -33,8 +35,13 @@ static const char VALUE_DEFAULTS[] = "defaults";
 StreamlineSetup::StreamlineSetup(OlySocket & s,
                                  Drivers & drivers,
                                  lib::Span<const CapturedSpe> capturedSpes,
-                                 logging::log_setup_supplier_t log_setup_supplier)
-    : mSocket(s), mDrivers(drivers), mCapturedSpes(capturedSpes), log_setup_supplier(std::move(log_setup_supplier))
+                                 logging::log_setup_supplier_t log_setup_supplier,
+                                 bool hasSessionToken)
+    : mSocket(s),
+      mDrivers(drivers),
+      mCapturedSpes(capturedSpes),
+      log_setup_supplier(std::move(log_setup_supplier)),
+      mHasSessionToken(hasSessionToken)
 {
     const auto result =
         streamlineSetupCommandLoop(s, *this, [](bool recvd) -> void { gSessionData.mWaitingOnCommand = !recvd; });
@@ -99,9 +106,12 @@ IStreamlineCommandHandler::State StreamlineSetup::handleRequest(char * xml)
         LOG_DEBUG("Sent events xml response");
     }
     else if ((attr != nullptr) && strcmp(attr, VALUE_CONFIGURATION) == 0) {
-        const auto & xml =
-            configuration_xml::getConfigurationXML(mDrivers.getPrimarySourceProvider().getCpuInfo().getClusters());
-        sendString(xml.raw.get(), ResponseType::XML);
+        if (!mConfigurationXML) {
+            mConfigurationXML =
+                configuration_xml::getConfigurationXML(mDrivers.getPrimarySourceProvider().getCpuInfo().getClusters())
+                    .raw.get();
+        }
+        sendString(*mConfigurationXML, ResponseType::XML);
         LOG_DEBUG("Sent configuration xml response");
     }
     else if ((attr != nullptr) && strcmp(attr, VALUE_COUNTERS) == 0) {
@@ -113,11 +123,14 @@ IStreamlineCommandHandler::State StreamlineSetup::handleRequest(char * xml)
         LOG_DEBUG("Sent counters xml response");
     }
     else if ((attr != nullptr) && strcmp(attr, VALUE_CAPTURED) == 0) {
-        const auto xml = captured_xml::getXML(false,
-                                              mCapturedSpes,
-                                              mDrivers.getPrimarySourceProvider(),
-                                              mDrivers.getMaliHwCntrs().getDeviceGpuIds());
-        sendString(xml.get(), ResponseType::XML);
+        if (!mCapturedXML) {
+            mCapturedXML = captured_xml::getXML(false,
+                                                mCapturedSpes,
+                                                mDrivers.getPrimarySourceProvider(),
+                                                mDrivers.getMaliHwCntrs().getDeviceGpuIds())
+                               .get();
+        }
+        sendString(*mCapturedXML, ResponseType::XML);
         LOG_DEBUG("Sent captured xml response");
     }
     else if ((attr != nullptr) && strcmp(attr, VALUE_DEFAULTS) == 0) {
@@ -140,11 +153,23 @@ IStreamlineCommandHandler::State StreamlineSetup::handleDeliver(char * xml)
     mxml_node_t * tree;
 
     // Determine xml type
+    mCapturedXML.reset();
     tree = mxmlLoadString(nullptr, xml, MXML_NO_CALLBACK);
     if (mxmlFindElement(tree, tree, TAG_SESSION, nullptr, nullptr, MXML_DESCEND_FIRST) != nullptr) {
         // Session XML
         gSessionData.parseSessionXML(xml);
-        sendData(nullptr, 0, ResponseType::ACK);
+        if (gSessionData.mDataStreams > 0) {
+            if (!mHasSessionToken) {
+                LOG_WARNING("The capture data is sent over the main connection only, as the host gave no session token "
+                            "with which to attach further connections");
+                gSessionData.mDataStreams = 0;
+            }
+            // the host asked for further data connections, so tell it how many to open
+            sendString(std::to_string(gSessionData.mDataStreams), ResponseType::ACK);
+        }
+        else {
+            sendData(nullptr, 0, ResponseType::ACK);
+        }
         LOG_DEBUG("Received session xml");
     }
     else if (mxmlFindElement(tree, tree, TAG_CONFIGURATIONS, nullptr, nullptr, MXML_DESCEND_FIRST) != nullptr) {
@@ -190,17 +215,18 @@ void StreamlineSetup::sendData(const char * data, uint32_t length, ResponseType
 void StreamlineSetup::sendDefaults()
 {
     // Send the config built into the binary
-    auto xml =
-        configuration_xml::getDefaultConfigurationXml(mDrivers.getPrimarySourceProvider().getCpuInfo().getClusters());
-    size_t size = strlen(xml.get());
+    if (!mDefaultsXML) {
+        auto const & clusters = mDrivers.getPrimarySourceProvider().getCpuInfo().getClusters();
+        mDefaultsXML = configuration_xml::getDefaultConfigurationXml(clusters).get();
+    }
 
     // Artificial size restriction
-    if (size > 1024 * 1024) {
+    if (mDefaultsXML->size() > 1024 * 1024) {
         LOG_ERROR("Corrupt default configuration file");
         handleException();
     }
 
-    sendData(xml.get(), size, ResponseType::XML);
+    sendString(*mDefaultsXML, ResponseType::XML);
 }
 
 void StreamlineSetup::writeConfiguration(char * xml)
@@ -234,4 +260,6 @@ void StreamlineSetup::writeConfiguration(char * xml)
     }
 
     checkError(configuration_xml::setCounters(counterConfigs, !result.isDefault, mDrivers));
+
+    mConfigurationXML = result.raw.get();
 }
@@ -1,4 +1,4 @@
-/* Copyright (C) 2010-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2010-2022 by Arm Limited. All rights reserved. */
 
 #ifndef __STREAMLINE_SETUP_H__
 #define __STREAMLINE_SETUP_H__
@@ -10,6 +10,7 @@
 
 #include <cstdint>
 #include <cstring>
+#include <optional>
 #include <string>
 
 class OlySocket;
@@ -19,10 +20,15 @@ struct CapturedSpe;
 
 class StreamlineSetup : private IStreamlineCommandHandler {
 public:
+    /**
+     * @param hasSessionToken True if the host gave a session token in the magic sequence, without which it cannot
+     * attach further data connections
+     */
     StreamlineSetup(OlySocket & socket,
                     Drivers & drivers,
                     lib::Span<const CapturedSpe> capturedSpes,
-                    logging::log_setup_supplier_t log_setup_supplier);
+                    logging::log_setup_supplier_t log_setup_supplier,
+                    bool hasSessionToken);
 
     // Intentionally unimplemented
     StreamlineSetup(const StreamlineSetup &) = delete;
@@ -35,6 +41,14 @@ private:
     Drivers & mDrivers;
     lib::Span<const CapturedSpe> mCapturedSpes;
     logging::log_setup_supplier_t log_setup_supplier;
+    bool mHasSessionToken;
+    /**
+     * The responses that only change when some xml is delivered, which Streamline asks for again each time the counter
+     * configuration dialog is opened, so are kept rather than regenerated
+     */
+    std::optional<std::string> mConfigurationXML {};
+    std::optional<std::string> mDefaultsXML {};
+    std::optional<std::string> mCapturedXML {};
 
     State handleRequest(char * xml) override;
     State handleDeliver(char * xml) override;
@@ -47,7 +61,7 @@ private:
 
     void sendData(const char * data, uint32_t length, ResponseType type);
     void sendString(const char * string, ResponseType type) { sendData(string, strlen(string), type); }
-    void sendString(std::string & string, ResponseType type) { sendData(string.c_str(), string.size(), type); }
+    void sendString(const std::string & string, ResponseType type) { sendData(string.c_str(), string.size(), type); }
     void sendDefaults();
     void writeConfiguration(char * xml);
 };
@@ -0,0 +1,257 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "SubscriberFanout.h"
+
+#include "BufferUtils.h"
+#include "Logging.h"
+#include "lib/FileDescriptor.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstring>
+#include <iterator>
+
+#include <poll.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+namespace {
+    // a subscriber that makes no progress for this long is disconnected
+    constexpr int SEND_TIMEOUT_SECONDS = 8;
+}
+
+SubscriberFanout::SubscriberFanout(int port, std::size_t queueLimit, DropPolicy dropPolicy)
+    : mQueueLimit(queueLimit), mDropPolicy(dropPolicy), mServerSocket(port)
+{
+    int pipefd[2];
+    if (lib::pipe_cloexec(pipefd) != 0) {
+        LOG_ERROR("Unable to set up the subscriber pipe");
+        handleException();
+    }
+    mStopPipe[0] = pipefd[0];
+    mStopPipe[1] = pipefd[1];
+
+    mAcceptThread = std::thread {[this]() { acceptThreadEntryPoint(); }};
+
+    LOG_DEBUG("Listening for subscribers on port %d", port);
+}
+
+SubscriberFanout::~SubscriberFanout()
+{
+    const char stop = 0;
+    if (::write(mStopPipe[1].get(), &stop, sizeof(stop)) != sizeof(stop)) {
+        LOG_DEBUG("Unable to stop the subscriber accept thread (%d)", errno);
+    }
+    mAcceptThread.join();
+
+    {
+        std::lock_guard<std::mutex> lock {mMutex};
+        for (auto & subscriber : mSubscribers) {
+            subscriber->closing = true;
+            subscriber->condition.notify_one();
+        }
+    }
+
+    for (auto & subscriber : mSubscribers) {
+        subscriber->thread.join();
+        closeSubscriber(*subscriber);
+    }
+}
+
+void SubscriberFanout::acceptThreadEntryPoint()
+{
+    prctl(PR_SET_NAME, reinterpret_cast<unsigned long>(&"gatord-subacc"), 0, 0, 0);
+
+    while (true) {
+        struct pollfd fds[2] = {{mServerSocket.getFd(), POLLIN, 0}, {mStopPipe[0].get(), POLLIN, 0}};
+        if (::poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_WARNING("No longer accepting subscribers (%d)", errno);
+            return;
+        }
+
+        if (fds[1].revents != 0) {
+            return;
+        }
+
+        if ((fds[0].revents & POLLIN) != 0) {
+            lib::AutoClosingFd fd {accept_cloexec(mServerSocket.getFd(), nullptr, nullptr)};
+            if (!fd) {
+                LOG_DEBUG("Unable to accept a subscriber (%d)", errno);
+                continue;
+            }
+
+            // a subscriber that stops reading must not hold up the end of the capture for ever
+            struct timeval timeout {SEND_TIMEOUT_SECONDS, 0};
+            if (setsockopt(fd.get(), SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) != 0) {
+                LOG_DEBUG("Unable to set the send timeout of a subscriber (%d)", errno);
+            }
+
+            std::lock_guard<std::mutex> lock {mMutex};
+            mPending.push_back(std::move(fd));
+        }
+    }
+}
+
+void SubscriberFanout::admitSubscribers(lib::Span<const char> headerFrames)
+{
+    reapFinished();
+
+    std::vector<lib::AutoClosingFd> pending;
+    {
+        std::lock_guard<std::mutex> lock {mMutex};
+        if (mPending.empty()) {
+            return;
+        }
+        std::swap(pending, mPending);
+    }
+
+    const Message header = std::make_shared<const std::vector<char>>(headerFrames.begin(), headerFrames.end());
+
+    for (auto & fd : pending) {
+        auto & subscriber = *mSubscribers.emplace_back(std::make_unique<Subscriber>(std::move(fd)));
+        if (!header->empty()) {
+            enqueue(subscriber, header, true);
+        }
+        subscriber.thread = std::thread {[this, &subscriber]() { writerThreadEntryPoint(subscriber); }};
+
+        LOG_DEBUG("Admitted subscriber %d, %zu are connected", subscriber.fd.get(), mSubscribers.size());
+    }
+}
+
+void SubscriberFanout::publish(lib::Span<const lib::Span<const char, int>> dataParts,
+                               ResponseType type,
+                               bool hasHeaderFrames)
+{
+    if (mSubscribers.empty()) {
+        return;
+    }
+
+    // copied once, however many subscribers there are
+    auto data = std::make_shared<std::vector<char>>();
+    if (type != ResponseType::RAW) {
+        int length = 0;
+        for (const auto & part : dataParts) {
+            length += part.size();
+        }
+        char header[4];
+        buffer_utils::writeLEInt(header, length);
+        data->insert(data->end(), header, header + sizeof(header));
+    }
+    for (const auto & part : dataParts) {
+        data->insert(data->end(), part.begin(), part.end());
+    }
+
+    const Message message {std::move(data)};
+    for (auto & subscriber : mSubscribers) {
+        enqueue(*subscriber, message, hasHeaderFrames);
+    }
+}
+
+void SubscriberFanout::enqueue(Subscriber & subscriber, const Message & message, bool hasHeaderFrames)
+{
+    std::lock_guard<std::mutex> lock {mMutex};
+
+    if (subscriber.closing) {
+        return;
+    }
+
+    if (!hasHeaderFrames && (subscriber.queuedBytes + message->size() > mQueueLimit)) {
+        if (mDropPolicy == DropPolicy::DISCONNECT) {
+            LOG_WARNING("Disconnecting subscriber %d as it is not keeping up with the capture", subscriber.fd.get());
+            subscriber.closing = true;
+            subscriber.queue.clear();
+            subscriber.queuedBytes = 0;
+            subscriber.condition.notify_one();
+        }
+        else {
+            subscriber.droppedBytes += message->size();
+        }
+        return;
+    }
+
+    subscriber.queue.push_back(message);
+    subscriber.queuedBytes += message->size();
+    subscriber.condition.notify_one();
+}
+
+void SubscriberFanout::writerThreadEntryPoint(Subscriber & subscriber)
+{
+    prctl(PR_SET_NAME, reinterpret_cast<unsigned long>(&"gatord-subwrite"), 0, 0, 0);
+
+    std::unique_lock<std::mutex> lock {mMutex};
+    while (true) {
+        subscriber.condition.wait(lock, [&subscriber]() { return subscriber.closing || !subscriber.queue.empty(); });
+        if (subscriber.queue.empty()) {
+            break;
+        }
+
+        const Message message = subscriber.queue.front();
+        subscriber.queue.pop_front();
+        subscriber.queuedBytes -= message->size();
+        lock.unlock();
+
+        std::size_t sent = 0;
+        int error = 0;
+        while (sent < message->size()) {
+            const ssize_t result =
+                ::send(subscriber.fd.get(), message->data() + sent, message->size() - sent, MSG_NOSIGNAL);
+            if (result < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                error = errno;
+                break;
+            }
+            sent += result;
+        }
+
+        lock.lock();
+        if (sent < message->size()) {
+            LOG_DEBUG("Subscriber %d disconnected (%d)", subscriber.fd.get(), error);
+            subscriber.closing = true;
+            subscriber.queue.clear();
+            subscriber.queuedBytes = 0;
+            break;
+        }
+    }
+
+    subscriber.finished = true;
+}
+
+void SubscriberFanout::reapFinished()
+{
+    std::vector<std::unique_ptr<Subscriber>> finished;
+    {
+        std::lock_guard<std::mutex> lock {mMutex};
+        const auto it = std::stable_partition(mSubscribers.begin(), mSubscribers.end(), [](const auto & subscriber) {
+            return !subscriber->finished;
+        });
+        std::move(it, mSubscribers.end(), std::back_inserter(finished));
+        mSubscribers.erase(it, mSubscribers.end());
+    }
+
+    // the threads have already left their loops, so the joins do not wait
+    for (auto & subscriber : finished) {
+        subscriber->thread.join();
+        closeSubscriber(*subscriber);
+    }
+}
+
+void SubscriberFanout::closeSubscriber(Subscriber & subscriber)
+{
+    if (subscriber.droppedBytes > 0) {
+        LOG_WARNING("Subscriber %d missed %" PRIu64 " bytes of capture data as it was not keeping up",
+                    subscriber.fd.get(),
+                    subscriber.droppedBytes);
+    }
+    LOG_DEBUG("Subscriber %d closed", subscriber.fd.get());
+
+    ::shutdown(subscriber.fd.get(), SHUT_RDWR);
+    subscriber.fd.close();
+}
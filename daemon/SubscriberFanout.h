@@ -0,0 +1,108 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#pragma once
+
+#include "ISender.h"
+#include "OlySocket.h"
+#include "lib/AutoClosingFd.h"
+#include "lib/Span.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Delivers the capture data to any number of extra hosts (such as a headless recorder or a CI job) that connect to the
+ * subscriber port, alongside the host that started the capture, so that several consumers can observe one capture
+ * rather than running several gatord instances that contend for the counters.
+ *
+ * Each subscriber receives the data in the format of the local capture data file. One that joins part way through
+ * first receives the summary, name and attribute frames sent so far, so that the rest of the stream can be decoded.
+ *
+ * Each subscriber has its own bounded queue and writer thread, so that a slow one never stalls the sender or the
+ * others. When a queue is full, the subscriber either misses the data that does not fit (the frames that describe the
+ * capture are always queued) or is disconnected, depending on the drop policy.
+ */
+class SubscriberFanout {
+public:
+    enum class DropPolicy {
+        /** Drop the data that does not fit in the queue */
+        DROP,
+        /** Disconnect the subscriber */
+        DISCONNECT,
+    };
+
+    /**
+     * Listen for subscribers and start accepting them
+     *
+     * @param port The TCP port to listen on
+     * @param queueLimit The maximum number of bytes queued for each subscriber
+     * @param dropPolicy What to do with a subscriber whose queue is full
+     */
+    SubscriberFanout(int port, std::size_t queueLimit, DropPolicy dropPolicy);
+
+    // Intentionally unimplemented
+    SubscriberFanout(const SubscriberFanout &) = delete;
+    SubscriberFanout & operator=(const SubscriberFanout &) = delete;
+    SubscriberFanout(SubscriberFanout &&) = delete;
+    SubscriberFanout & operator=(SubscriberFanout &&) = delete;
+
+    /** Stop accepting subscribers, and disconnect each once everything queued for it has been sent */
+    ~SubscriberFanout();
+
+    /**
+     * Start delivering to the subscribers that have connected since the last call. Must be called by the same thread
+     * as publish, between messages.
+     *
+     * @param headerFrames The frames that describe the capture, sent so far, each prefixed by its length
+     */
+    void admitSubscribers(lib::Span<const char> headerFrames);
+
+    /**
+     * Queue a message for every subscriber
+     *
+     * @param dataParts The message
+     * @param type The type of the message; anything but RAW is a single frame, which is prefixed by its length
+     * @param hasHeaderFrames True if the message contains frames that describe the capture, which are never dropped
+     */
+    void publish(lib::Span<const lib::Span<const char, int>> dataParts, ResponseType type, bool hasHeaderFrames);
+
+private:
+    using Message = std::shared_ptr<const std::vector<char>>;
+
+    struct Subscriber {
+        explicit Subscriber(lib::AutoClosingFd && fd) : fd(std::move(fd)) {}
+
+        lib::AutoClosingFd fd;
+        std::condition_variable condition {};
+        // protected by SubscriberFanout::mMutex
+        std::deque<Message> queue {};
+        std::size_t queuedBytes {0};
+        std::uint64_t droppedBytes {0};
+        bool closing {false};
+        bool finished {false};
+        std::thread thread {};
+    };
+
+    const std::size_t mQueueLimit;
+    const DropPolicy mDropPolicy;
+    OlyServerSocket mServerSocket;
+    // written to wake and stop the accept thread
+    lib::AutoClosingFd mStopPipe[2];
+    std::mutex mMutex {};
+    // accepted, but not yet admitted; protected by mMutex
+    std::vector<lib::AutoClosingFd> mPending {};
+    // only accessed by the thread that calls admitSubscribers / publish, and the destructor
+    std::vector<std::unique_ptr<Subscriber>> mSubscribers {};
+    std::thread mAcceptThread {};
+
+    void acceptThreadEntryPoint();
+    void writerThreadEntryPoint(Subscriber & subscriber);
+    void enqueue(Subscriber & subscriber, const Message & message, bool hasHeaderFrames);
+    void reapFinished();
+    static void closeSubscriber(Subscriber & subscriber);
+};
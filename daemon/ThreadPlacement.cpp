@@ -0,0 +1,157 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "ThreadPlacement.h"
+
+#include "Logging.h"
+#include "OlyUtility.h"
+#include "SessionData.h"
+#include "Time.h"
+#include "lib/Format.h"
+#include "lib/FsEntry.h"
+#include "lib/Utils.h"
+
+#include <cerrno>
+#include <optional>
+#include <set>
+#include <string>
+
+#include <sched.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+namespace thread_placement {
+    namespace {
+        /** In the low-wakeup mode, timers may be deferred by up to this fraction of the period */
+        constexpr std::uint64_t LOW_WAKEUP_SLACK_DIVISOR = 10;
+
+        /** @return The online cpu with the lowest cpu_capacity (the lowest numbered of them), or nothing if unknown */
+        std::optional<int> findSmallestCpu()
+        {
+            std::optional<int> smallest;
+            long long smallestCapacity = 0;
+
+            auto children = lib::FsEntry::create("/sys/devices/system/cpu").children();
+            for (auto child = children.next(); child; child = children.next()) {
+                const auto & name = child->name();
+                int cpu = 0;
+                if ((name.rfind("cpu", 0) != 0) || !stringToInt(&cpu, name.c_str() + 3, 10)) {
+                    continue;
+                }
+
+                // cpu0 usually has no online file, as it cannot be offlined
+                const auto online = lib::FsEntry::create(*child, "online");
+                if (online.exists() && (online.readFileContentsSingleLine() == "0")) {
+                    continue;
+                }
+
+                long long capacity = 0;
+                const auto capacityText = lib::FsEntry::create(*child, "cpu_capacity").readFileContentsSingleLine();
+                if (!stringToLongLong(&capacity, capacityText.c_str(), 10)) {
+                    continue;
+                }
+
+                if (!smallest || (capacity < smallestCapacity)
+                    || ((capacity == smallestCapacity) && (cpu < *smallest))) {
+                    smallest = cpu;
+                    smallestCapacity = capacity;
+                }
+            }
+
+            return smallest;
+        }
+
+        /** @return The cpus to pin gatord's threads to, or empty to leave them */
+        std::set<int> getCpus()
+        {
+            if (!gSessionData.mGatorCpus.empty() || (gSessionData.mLowWakeupSeconds <= 0)) {
+                return gSessionData.mGatorCpus;
+            }
+
+            const auto smallest = findSmallestCpu();
+            if (!smallest) {
+                return {};
+            }
+            return {*smallest};
+        }
+    }
+
+    bool isEnabled()
+    {
+        return !gSessionData.mGatorCpus.empty() || gSessionData.mGatorNice.has_value()
+            || (gSessionData.mLowWakeupSeconds > 0);
+    }
+
+    std::uint64_t getTimerSlackNs()
+    {
+        if (gSessionData.mLowWakeupSeconds <= 0) {
+            return 0;
+        }
+        return (gSessionData.mLowWakeupSeconds * NS_PER_S) / LOW_WAKEUP_SLACK_DIVISOR;
+    }
+
+    void applyToProcess(pid_t pid, const char * name)
+    {
+        if (!isEnabled()) {
+            return;
+        }
+
+        const std::set<int> cpuSet = getCpus();
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        for (int cpu : cpuSet) {
+            CPU_SET(cpu, &cpus);
+        }
+
+        const std::string cpuList = lib::formatCpuMask(cpuSet);
+        const std::uint64_t timerSlackNs = getTimerSlackNs();
+        const std::string timerSlack = std::to_string(timerSlackNs);
+
+        int affinityError = 0;
+        int niceError = 0;
+        bool timerSlackFailed = false;
+        std::size_t placed = 0;
+
+        // which at least covers the threads this one goes on to start
+        if ((timerSlackNs != 0) && (pid == getpid())) {
+            prctl(PR_SET_TIMERSLACK, static_cast<unsigned long>(timerSlackNs), 0, 0, 0);
+        }
+
+        const auto tasks = lib::FsEntry::create(lib::Format() << "/proc/" << pid << "/task");
+        auto children = tasks.children();
+        for (auto child = children.next(); child; child = children.next()) {
+            int tid = 0;
+            if (!stringToInt(&tid, child->name().c_str(), 10)) {
+                continue;
+            }
+
+            // a thread may exit while the others are placed, so only report the first failure of each kind
+            if (!cpuSet.empty() && (sched_setaffinity(tid, sizeof(cpus), &cpus) != 0) && (affinityError == 0)) {
+                affinityError = errno;
+            }
+            if (gSessionData.mGatorNice && (setpriority(PRIO_PROCESS, tid, *gSessionData.mGatorNice) != 0)
+                && (niceError == 0)) {
+                niceError = errno;
+            }
+            // setting the slack of any thread but the calling one needs CAP_SYS_NICE
+            if ((timerSlackNs != 0)
+                && !lib::FsEntry::create(*child, "timerslack_ns").writeFileContents(timerSlack.c_str())) {
+                timerSlackFailed = true;
+            }
+
+            placed += 1;
+        }
+
+        if (affinityError != 0) {
+            LOG_WARNING("Unable to pin %s to cpus %s (%d)", name, cpuList.c_str(), affinityError);
+        }
+        if (niceError != 0) {
+            LOG_WARNING("Unable to set the nice value of %s to %d (%d)", name, *gSessionData.mGatorNice, niceError);
+        }
+        if (timerSlackFailed) {
+            LOG_WARNING("Unable to set the timer slack of %s to %s ns", name, timerSlack.c_str());
+        }
+
+        LOG_DEBUG("Placed %zu threads of %s (%d)", placed, name, pid);
+    }
+}
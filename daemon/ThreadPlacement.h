@@ -0,0 +1,39 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#ifndef THREAD_PLACEMENT_H
+#define THREAD_PLACEMENT_H
+
+#include <cstdint>
+
+#include <sys/types.h>
+
+/**
+ * Keeps gatord off the cores being measured, by pinning its threads to the session's gator_cpus and giving them the
+ * session's gator_nice value. In the low-wakeup mode the threads are also given a large timer slack (so the kernel
+ * can batch their timers with other wakeups) and, unless gator_cpus is set, pinned to the smallest core.
+ *
+ * New threads inherit the placement of the thread that creates them, so each process only needs to be placed once,
+ * before it starts the bulk of its threads. The exceptions are the per-core identification threads (which pin
+ * themselves to the core they identify), the counter polling threads (which are moved to polling_cpu, and made
+ * SCHED_FIFO by realtime_polling), the perf agent's drain threads of cpu_local_drain (which pin themselves to the cpu
+ * whose ring buffer they drain) and the forked processes (which start with the placement gatord started with, so
+ * that the profiled command is not restricted to gatord's cpus). The perf data of every core is still drained, as the
+ * ring buffers may be read from any cpu.
+ */
+namespace thread_placement {
+    /** @return True if the session changes the placement of gatord's threads */
+    bool isEnabled();
+
+    /** @return The timer slack of gatord's threads in the low-wakeup mode, or 0 for the default */
+    std::uint64_t getTimerSlackNs();
+
+    /**
+     * Apply the session's placement to every thread of some process
+     *
+     * @param pid The process, which is either this process or one of its agents
+     * @param name Describes the process in any warning
+     */
+    void applyToProcess(pid_t pid, const char * name);
+}
+
+#endif // THREAD_PLACEMENT_H
@@ -3,6 +3,7 @@
 #pragma once
 
 #include "Logging.h"
+#include "lib/ArchTimestamp.h"
 
 #include <cstdint>
 #include <ctime>
@@ -18,9 +19,16 @@ enum class monotonic_delta_t : std::uint64_t;
 std::uint64_t getTime();
 #else
 
-/** The getTime function reads the current value of CLOCK_MONOTONIC_RAW as a u64 in nanoseconds */
+/**
+ * The getTime function reads the current value of CLOCK_MONOTONIC_RAW as a u64 in nanoseconds, from the arch timer
+ * if lib::enableArchTimestamps succeeded
+ */
 inline std::uint64_t getTime()
 {
+    if (lib::archTimestampsEnabled()) {
+        return lib::getArchTimestampNS();
+    }
+
     struct timespec ts;
     if (clock_gettime(CLOCK_MONOTONIC_RAW, &ts) != 0) {
         LOG_ERROR("Failed to get uptime");
@@ -1,4 +1,4 @@
-/* Copyright (C) 2010-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2010-2022 by Arm Limited. All rights reserved. */
 
 #define __STDC_FORMAT_MACROS
 #define BUFFER_USE_SESSION_DATA
@@ -9,79 +9,183 @@
 #include "Buffer.h"
 #include "BufferUtils.h"
 #include "Child.h"
+#include "CpuBudgetGovernor.h"
 #include "Drivers.h"
 #include "Logging.h"
+#include "MemoryBudget.h"
+#include "PeriodicPacer.h"
+#include "PipelineStats.h"
 #include "PolledDriver.h"
 #include "PrimarySourceProvider.h"
 #include "SessionData.h"
 #include "Source.h"
+#include "Time.h"
 #include "lib/Memory.h"
 #include "lib/Span.h"
+#include "lib/String.h"
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <cinttypes>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <thread>
 #include <utility>
+#include <vector>
 
-#include <sys/prctl.h>
 #include <unistd.h>
 
-class UserSpaceSource : public Source {
-public:
-    UserSpaceSource(sem_t & senderSem, lib::Span<PolledDriver * const> drivers)
-        : mBuffer(gSessionData.mTotalBufferSize * 1024 * 1024, senderSem), mDrivers(drivers)
-    {
-    }
+namespace {
+    /** A set of drivers with the same polling period and cost, which are read together by one thread */
+    class PolledDriverGroup {
+    public:
+        PolledDriverGroup(std::chrono::nanoseconds period, bool slow, sem_t & senderSem)
+            : mBuffer(static_cast<int>(gMemoryBudget.allocate("polled counters",
+                                                              1,
+                                                              std::size_t(gSessionData.mTotalBufferSize) * 1024 * 1024)),
+                      senderSem),
+              mDeltaState(gSessionData.mDeltaBlockCounters ? std::make_shared<BlockCounterDeltaState>() : nullptr),
+              mRollupState(gSessionData.mCounterRollups ? std::make_shared<BlockCounterRollupState>() : nullptr),
+              mPeriod(period),
+              mSlow(slow)
+        {
+        }
 
-    void run(std::uint64_t monotonicStart, std::function<void()> endSession) override
-    {
-        prctl(PR_SET_NAME, reinterpret_cast<unsigned long>(&"gatord-counters"), 0, 0, 0);
+        [[nodiscard]] bool matches(const PolledDriver & driver) const
+        {
+            return (driver.getPollPeriod() == mPeriod) && (driver.isSlowToRead() == mSlow);
+        }
 
-        std::vector<PolledDriver *> allUserspaceDrivers;
+        void addDriver(PolledDriver & driver) { mDrivers.push_back(&driver); }
 
-        for (PolledDriver * usDriver : mDrivers) {
-            if (usDriver->countersEnabled()) {
-                usDriver->start();
-                allUserspaceDrivers.emplace_back(usDriver);
+        void start()
+        {
+            for (PolledDriver * driver : mDrivers) {
+                driver->start();
             }
         }
 
-        uint64_t nextTime = 0;
-        while (mSessionIsActive) {
-            const uint64_t currTime = getTime() - monotonicStart;
-            // Sample ten times a second ignoring gSessionData.mSampleRate
-            nextTime += NS_PER_S / 10; //gSessionData.mSampleRate;
-            if (nextTime < currTime) {
-                LOG_DEBUG("Too slow, currTime: %" PRIi64 " nextTime: %" PRIi64, currTime, nextTime);
-                nextTime = currTime;
-            }
+        void run(std::uint64_t monotonicStart, const std::atomic_bool & sessionIsActive)
+        {
+            const char * const name = (mSlow ? "gatord-ctr-slow" : "gatord-counters");
+            PeriodicPacer::configureThread(name);
+
+            // aligned, so that the groups (and the other polled sources) with related periods read together
+            PeriodicPacer pacer {mPeriod, true};
+            unsigned throttleShift = 0;
+            while (sessionIsActive) {
+                pacer.wait();
+
+                const unsigned newThrottleShift = gCpuBudgetGovernor.update();
+                if (newThrottleShift != throttleShift) {
+                    throttleShift = newThrottleShift;
+                    pacer.setPeriod(mPeriod * (1U << throttleShift));
+                }
+
+                const uint64_t currTime = getTime() - monotonicStart;
+                for (PolledDriver * driver : mDrivers) {
+                    driver->sample();
+                }
 
-            BlockCounterFrameBuilder builder {mBuffer, gSessionData.mLiveRate};
-            if (builder.eventHeader(currTime)) {
-                for (PolledDriver * usDriver : allUserspaceDrivers) {
-                    usDriver->read(builder);
+                BlockCounterFrameBuilder builder {mBuffer, gSessionData.mLiveRate, mDeltaState, mRollupState};
+                if (builder.eventHeader(currTime)) {
+                    for (PolledDriver * driver : mDrivers) {
+                        driver->read(builder);
+                    }
+                    // Only check after writing all counters so that time and corresponding counters appear in the
+                    // same frame
+                    builder.check(currTime);
                 }
-                // Only check after writing all counters so that time and corresponding counters appear in the same frame
-                builder.check(currTime);
             }
 
-            if (gSessionData.mOneShot && mSessionIsActive && (mBuffer.bytesAvailable() <= 0)) {
-                LOG_DEBUG("One shot (counters)");
-                endSession();
+            for (PolledDriver * driver : mDrivers) {
+                driver->stop();
+            }
+
+            lib::printf_str_t<64> description {"Counter polling (%s)", name};
+            gPipelineStats.onPollingLoopEnd(description.c_str(), pacer.getStats());
+
+            mBuffer.setDone();
+        }
+
+        bool write(ISender & sender) { return mBuffer.write(sender); }
+
+    private:
+        Buffer mBuffer;
+        /** Shared by the builder of each poll, as they all write to mBuffer */
+        std::shared_ptr<BlockCounterDeltaState> mDeltaState;
+        std::shared_ptr<BlockCounterRollupState> mRollupState;
+        std::vector<PolledDriver *> mDrivers {};
+        std::chrono::nanoseconds mPeriod;
+        bool mSlow;
+    };
+}
+
+/**
+ * Polls the enabled PolledDrivers, each at its own period.
+ *
+ * Drivers are grouped by period and whether they are slow to read, and each group is read by its own thread into its
+ * own Buffer, so that a slow driver cannot delay the reading of the others. The groups' loops share the aligned
+ * PeriodicPacer tick, so the drivers of every group with the same period are read at the same instant.
+ */
+class UserSpaceSource : public Source {
+public:
+    UserSpaceSource(sem_t & senderSem, lib::Span<PolledDriver * const> drivers)
+    {
+        // the groups must exist before run is called as write may be called at any time
+        for (PolledDriver * driver : drivers) {
+            if (!driver->countersEnabled()) {
+                continue;
+            }
+
+            auto it = std::find_if(mGroups.begin(), mGroups.end(), [driver](const auto & group) {
+                return group->matches(*driver);
+            });
+            if (it == mGroups.end()) {
+                mGroups.push_back(
+                    std::make_unique<PolledDriverGroup>(driver->getPollPeriod(), driver->isSlowToRead(), senderSem));
+                it = std::prev(mGroups.end());
             }
+            (*it)->addDriver(*driver);
+        }
+    }
 
-            usleep((nextTime - currTime) / NS_PER_US);
+    // one-shot captures are ended by gOneShotBudget, rather than when this source's buffer is full
+    void run(std::uint64_t monotonicStart, std::function<void()> /*endSession*/) override
+    {
+        for (auto & group : mGroups) {
+            group->start();
+        }
+
+        std::vector<std::thread> threads;
+        for (std::size_t i = 1; i < mGroups.size(); ++i) {
+            threads.emplace_back([this, i, monotonicStart]() { mGroups[i]->run(monotonicStart, mSessionIsActive); });
+        }
+
+        if (!mGroups.empty()) {
+            mGroups.front()->run(monotonicStart, mSessionIsActive);
         }
 
-        mBuffer.setDone();
+        for (auto & thread : threads) {
+            thread.join();
+        }
     }
 
     void interrupt() override { mSessionIsActive = false; }
 
-    bool write(ISender & sender) override { return mBuffer.write(sender); }
+    bool write(ISender & sender) override
+    {
+        bool done = true;
+        for (auto & group : mGroups) {
+            done = group->write(sender) && done;
+        }
+        return done;
+    }
 
 private:
-    Buffer mBuffer;
-    lib::Span<PolledDriver * const> mDrivers;
+    std::vector<std::unique_ptr<PolledDriverGroup>> mGroups {};
     std::atomic_bool mSessionIsActive {true};
 };
 
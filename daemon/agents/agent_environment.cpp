@@ -5,15 +5,19 @@
 #include "agents/ext_source/ext_source_agent.h"
 #include "ipc/raw_ipc_channel_sink.h"
 #include "ipc/raw_ipc_channel_source.h"
+#include "ipc/shared_frame_ring.h"
 #include "lib/AutoClosingFd.h"
 #include "lib/String.h"
 #include "logging/agent_log.h"
 
+#include <algorithm>
+#include <cerrno>
 #include <csignal>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <exception>
+#include <thread>
 
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/signal_set.hpp>
@@ -24,7 +28,31 @@
 
 namespace agents {
     namespace {
-        constexpr std::size_t n_threads = 2;
+        constexpr std::size_t min_n_threads = 2;
+        constexpr std::size_t max_n_threads = 32;
+        constexpr std::size_t cpus_per_thread = 8;
+
+        /**
+         * Determine the number of additional io_context worker threads. By default this scales with the number of cpus (as
+         * large systems have many perf ringbuffers to drain), but may be overridden with the GATORD_AGENT_THREADS
+         * environment variable.
+         */
+        std::size_t get_n_threads()
+        {
+            //NOLINTNEXTLINE(concurrency-mt-unsafe)
+            auto const * env_threads = getenv("GATORD_AGENT_THREADS");
+            if (env_threads != nullptr) {
+                char * end = nullptr;
+                auto const n = std::strtoul(env_threads, &end, 10);
+                if ((end != env_threads) && (*end == '\0') && (n > 0)) {
+                    return std::min<std::size_t>(n, max_n_threads);
+                }
+                LOG_DEBUG("Ignoring invalid GATORD_AGENT_THREADS value '%s'", env_threads);
+            }
+
+            auto const n_cpus = std::thread::hardware_concurrency();
+            return std::clamp<std::size_t>(n_cpus / cpus_per_thread, min_n_threads, max_n_threads);
+        }
 
         lib::AutoClosingFd dup_and_close(int fd)
         {
@@ -43,6 +71,23 @@ namespace agents {
             return dup_fd;
         }
 
+        bool reply_to_ring_offer(int fd, bool attached)
+        {
+            char const reply = (attached ? ipc::shared_frame_ring_t::preamble_attached
+                                         : ipc::shared_frame_ring_t::preamble_declined);
+
+            ssize_t n_written;
+            while (((n_written = ::write(fd, &reply, sizeof(reply))) < 0) && (errno == EINTR)) {
+            }
+
+            if (n_written != sizeof(reply)) {
+                // NOLINTNEXTLINE(concurrency-mt-unsafe)
+                LOG_ERROR("Could not reply to the shell (%d: %s)", errno, strerror(errno));
+                return false;
+            }
+            return true;
+        }
+
         void do_wait_signal(boost::asio::signal_set & signals,
                             std::shared_ptr<agent_environment_base_t> env,
                             async::proc::process_monitor_t & process_monitor)
@@ -94,6 +139,13 @@ namespace agents {
             auto ipc_in = dup_and_close(STDIN_FILENO);
             auto ipc_out = dup_and_close(STDOUT_FILENO);
 
+            // the shell offers the shared ring before anything else, and expects the reply before any message
+            auto ring = ipc::shared_frame_ring_t::receive_offer(ipc_in.get());
+            if (!reply_to_ring_offer(ipc_out.get(), ring != nullptr)) {
+                return EXIT_FAILURE;
+            }
+            LOG_DEBUG("%s the shared IPC ring", (ring ? "Attached to" : "Not using"));
+
             // setup asio context
             boost::asio::io_context io_context {};
 
@@ -108,7 +160,7 @@ namespace agents {
             signals.add(SIGINT);
 
             // create our IPC channels
-            auto ipc_sink = ipc::raw_ipc_channel_sink_t::create(io_context, std::move(ipc_out));
+            auto ipc_sink = ipc::raw_ipc_channel_sink_t::create(io_context, std::move(ipc_out), std::move(ring));
             auto ipc_source = ipc::raw_ipc_channel_source_t::create(io_context, std::move(ipc_in));
 
             // create our agent
@@ -130,8 +182,11 @@ namespace agents {
             env->start();
 
             // provide extra threads by way of pool
+            auto const n_threads = get_n_threads();
             boost::asio::thread_pool threads {n_threads};
 
+            LOG_DEBUG("Using %zu worker threads", n_threads);
+
             // start the io context on the thread pool (as the caller expects this function to return immediately)
             for (std::size_t i = 0; i < n_threads; ++i) {
                 boost::asio::post(threads, [thread_no = i, &io_context]() {
@@ -276,10 +276,13 @@ namespace agents {
             auto binder = message_binder_factory_type::create_message_binder(*this, *agent);
 
             auto self = this->shared_from_this();
+            // the predicate completes on the strand, so the receive need only dispatch to it rather than post another
+            // handler for each message
             return repeatedly(
                 [self]() { return start_on(self->strand) | then([self]() { return !self->is_shutdown; }); },
                 [self, binder]() mutable {
-                    return start_on(self->strand) | binder->async_receive_next_message(self->source);
+                    return start_on<on_executor_mode_t::dispatch>(self->strand)
+                         | binder->async_receive_next_message(self->source);
                 });
         }
 
@@ -2,6 +2,8 @@
 
 #pragma once
 
+#include "ipc/messages.h"
+
 #include <functional>
 
 #include <unistd.h>
@@ -30,5 +32,9 @@ namespace agents {
         virtual ~i_agent_worker_t() noexcept = default;
         virtual void on_sigchild() = 0;
         virtual void shutdown() = 0;
+        /** Called when the user asks for the data held by any flight recorder to be saved into the capture */
+        virtual void on_flight_recorder_trigger() = 0;
+        /** Called when the user changes the counters of the running capture */
+        virtual void on_capture_reconfiguration(ipc::msg_capture_reconfiguration_t const & msg) = 0;
     };
 }
@@ -15,12 +15,16 @@
 #include "lib/Syscall.h"
 
 #include <cerrno>
+#include <chrono>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <functional>
 #include <map>
 #include <memory>
+#include <string>
 #include <tuple>
+#include <utility>
 
 #include <boost/asio/dispatch.hpp>
 #include <boost/asio/io_context.hpp>
@@ -50,6 +54,7 @@ namespace agents {
             signal_set.add(SIGTERM);
             signal_set.add(SIGABRT);
             signal_set.add(SIGCHLD);
+            signal_set.add(SIGUSR2);
         }
 
         /** Start the worker. Agents must be spawned separately once the worker has started */
@@ -88,16 +93,24 @@ namespace agents {
          * Add the 'external source' agent worker
          *
          * @param external_souce A reference to the ExternalSource class which receives data from the agent process
+         * @param trigger_marker The text of the marker annotations that trigger the flight recorder, or empty for none
+         * @param channel_limits The limits of the channel annotations to set in each annotating process
          * @param token Some completion token, called asynchronously once the agent is ready
          * @return depends on completion token type
          */
         template<typename ExternalSource, typename CompletionToken>
-        auto async_add_external_source(ExternalSource & external_souce, CompletionToken && token)
+        auto async_add_external_source(ExternalSource & external_souce,
+                                       std::string trigger_marker,
+                                       ipc::annotation_channel_limits_t channel_limits,
+                                       CompletionToken && token)
         {
             return worker_manager.template async_add_agent<ext_source_agent_worker_t<ExternalSource>>(
                 process_monitor,
                 std::forward<CompletionToken>(token),
-                std::ref(external_souce));
+                std::ref(external_souce),
+                std::move(trigger_marker),
+                std::function<void()> {[this]() { worker_manager.trigger_flight_recorder(); }},
+                channel_limits);
         }
 
         template<typename EventHandler, typename ConfigMsg, typename CompletionToken>
@@ -110,6 +123,12 @@ namespace agents {
                 std::forward<ConfigMsg>(msg));
         }
 
+        /** Tell all the agents to change the counters of the running capture */
+        void reconfigure_capture(ipc::msg_capture_reconfiguration_t msg)
+        {
+            worker_manager.reconfigure_capture(std::move(msg));
+        }
+
     private:
         boost::asio::io_context io_context {};
         async::proc::process_monitor_t process_monitor {io_context};
@@ -192,11 +211,43 @@ namespace agents {
                 LOG_DEBUG("Received signal %d", signo);
                 parent.on_terminal_signal(signo);
             }
+            else if (signo == SIGUSR2) {
+                LOG_DEBUG("Received flight recorder trigger signal");
+                trigger_flight_recorder();
+            }
             else {
                 LOG_DEBUG("Unexpected signal # %d", signo);
             }
         }
 
+        /** Tell all the agents to send the contents of their flight recorders (as SIGUSR2 does) */
+        void trigger_flight_recorder()
+        {
+            using namespace async::continuations;
+
+            spawn("Flight recorder trigger",
+                  start_on(strand) //
+                      | then([this]() {
+                            for (auto & agent : agent_workers) {
+                                agent.second->on_flight_recorder_trigger();
+                            }
+                        }));
+        }
+
+        /** Tell all the agents to change the counters of the running capture */
+        void reconfigure_capture(ipc::msg_capture_reconfiguration_t msg)
+        {
+            using namespace async::continuations;
+
+            spawn("Capture reconfiguration",
+                  start_on(strand) //
+                      | then([this, msg = std::move(msg)]() {
+                            for (auto & agent : agent_workers) {
+                                agent.second->on_capture_reconfiguration(msg);
+                            }
+                        }));
+        }
+
         /** Terminate the worker. This function will return once all the agents are terminated and any worker threads have exited. */
         void async_shutdown()
         {
@@ -244,12 +295,14 @@ namespace agents {
                                }
 
                                // start the process, returning the wrapper instance
+                               auto const spawn_start = std::chrono::steady_clock::now();
                                return async_spawn_agent_worker<WorkerType>(io_context,
                                                                            spawner,
                                                                            make_state_observer(),
                                                                            use_continuation,
                                                                            std::forward<decltype(args)>(args)...) //
-                                    | then([this, &process_monitor](auto worker) -> polymorphic_continuation_t<bool> {
+                                    | then([this, &process_monitor, spawn_start](
+                                               auto worker) -> polymorphic_continuation_t<bool> {
                                           // spawn failed, just let the handler know directly
                                           if (!worker.second) {
                                               return start_with(false);
@@ -263,7 +316,21 @@ namespace agents {
                                           observe_agent_pid(process_monitor, worker.first, worker.second);
 
                                           // now wait for it to be ready
-                                          return worker.second->async_wait_launched(use_continuation);
+                                          return worker.second->async_wait_launched(use_continuation)
+                                               | then([this, pid = worker.first, spawn_start](bool ready) {
+                                                     if (ready) {
+                                                         auto const elapsed = std::chrono::steady_clock::now()
+                                                                            - spawn_start;
+                                                         auto const ms = std::chrono::duration_cast<
+                                                             std::chrono::milliseconds>(elapsed);
+                                                         LOG_INFO("%s (pid %d) was ready %lld ms after it was spawned",
+                                                                  WorkerType::get_agent_process_id(),
+                                                                  pid,
+                                                                  static_cast<long long>(ms.count()));
+                                                         parent.on_agent_launched(pid);
+                                                     }
+                                                     return ready;
+                                                 });
                                       });
                            });
                 },
@@ -8,10 +8,14 @@
 #include "async/continuations/stored_continuation.h"
 #include "async/continuations/use_continuation.h"
 #include "lib/Assert.h"
+#include "lib/AutoClosingFd.h"
 #include "lib/FsEntry.h"
 
+#include <algorithm>
 #include <chrono>
+#include <cstdlib>
 #include <deque>
+#include <optional>
 #include <set>
 #include <stdexcept>
 #include <utility>
@@ -24,6 +28,9 @@
 #include <boost/asio/steady_timer.hpp>
 #include <boost/system/error_code.hpp>
 
+#include <fcntl.h>
+#include <unistd.h>
+
 namespace agents {
     /**
      * Monitors CPU online state by polling one or more files in sysfs (specifically the /sys/devices/system/cpu<n>/online)
@@ -71,10 +78,16 @@ namespace agents {
         /** Constructor, using the provided context */
         explicit polling_cpu_monitor_t(boost::asio::io_context & context,
                                        std::vector<std::pair<lib::FsEntry, int>> monitor_paths = find_all_cpu_paths())
-            : timer(context), strand(context), monitor_paths(std::move(monitor_paths))
+            : timer(context),
+              strand(context),
+              monitor_paths(std::move(monitor_paths)),
+              monitor_fds(this->monitor_paths.size())
         {
         }
 
+        /** Never poll more often than this, as in the low-wakeup mode; must be called before start */
+        void set_min_poll_interval(std::chrono::microseconds interval) { min_poll_interval = interval; }
+
         /** Start observing for changes */
         void start()
         {
@@ -99,7 +112,9 @@ namespace agents {
                         return start_on(st->strand)                             //
                              | then([st]() { return st->on_strand_do_poll(); }) //
                              | then([st](bool any_offline) {
-                                   st->timer.expires_from_now(any_offline ? short_poll_interval : long_poll_interval);
+                                   st->timer.expires_from_now(std::max<std::chrono::microseconds>(
+                                       (any_offline ? short_poll_interval : long_poll_interval),
+                                       st->min_poll_interval));
                                })                                     //
                              | st->timer.async_wait(use_continuation) //
                              | post_on(st->strand)                    //
@@ -166,6 +181,9 @@ namespace agents {
         boost::asio::steady_timer timer;
         boost::asio::io_context::strand strand;
         std::vector<std::pair<lib::FsEntry, int>> monitor_paths;
+        /** Kept open between polls (and reread from the start), as the files are polled thousands of times a second */
+        std::vector<lib::AutoClosingFd> monitor_fds;
+        std::chrono::microseconds min_poll_interval {0};
         completion_handler_t pending_handler {};
         std::set<unsigned> online_cpu_nos {};
         std::deque<event_t> pending_events {};
@@ -228,15 +246,13 @@ namespace agents {
 
             bool any_offline = false;
 
-            for (auto const & entry : monitor_paths) {
-                const std::string contents = entry.first.readFileContentsSingleLine();
-                if (!contents.empty()) {
-                    const unsigned online_value = strtoul(contents.c_str(), nullptr, 0);
-                    const bool is_online = (online_value != 0);
-                    any_offline |= !is_online;
+            for (std::size_t index = 0; index < monitor_paths.size(); ++index) {
+                auto const is_online = read_online(index);
+                if (is_online) {
+                    any_offline |= !*is_online;
 
                     // process it
-                    process_one(entry.second, is_online);
+                    process_one(monitor_paths[index].second, *is_online);
                 }
             }
 
@@ -246,6 +262,29 @@ namespace agents {
             return any_offline;
         }
 
+        /** @return The value of one of the 'online' files, or empty if it could not be read */
+        [[nodiscard]] std::optional<bool> read_online(std::size_t index)
+        {
+            auto & fd = monitor_fds[index];
+            if (!fd) {
+                fd = ::open(monitor_paths[index].first.path().c_str(), O_RDONLY | O_CLOEXEC);
+                if (!fd) {
+                    return {};
+                }
+            }
+
+            char buffer[16];
+            auto const n = ::pread(*fd, buffer, sizeof(buffer) - 1, 0);
+            if (n <= 0) {
+                // reopen it next time, in case the cpu was removed and added again
+                fd.close();
+                return {};
+            }
+            buffer[n] = '\0';
+
+            return (strtoul(buffer, nullptr, 0) != 0);
+        }
+
         /** Process one polled value */
         void process_one(int cpu, bool online)
         {
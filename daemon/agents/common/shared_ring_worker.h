@@ -0,0 +1,432 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#pragma once
+
+#include "Logging.h"
+#include "agents/common/socket_reference.h"
+#include "async/continuations/async_initiate.h"
+#include "async/continuations/stored_continuation.h"
+#include "lib/AutoClosingFd.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <boost/asio/bind_executor.hpp>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/error.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/io_context_strand.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/socket_base.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/system/error_code.hpp>
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+namespace agents {
+    /**
+     * The header of a ring buffer that an annotating thread shares with gatord. The buffer itself follows the header
+     * and fills the rest of the mapping.
+     *
+     * This must match struct gator_ring in streamline_annotate.c.
+     */
+    struct annotation_shared_ring_t {
+        /** Written by the annotating thread once the data before it is complete */
+        alignas(64) std::atomic<std::uint32_t> write_pos;
+        /** Written by gatord once the data before it has been copied out */
+        alignas(64) std::atomic<std::uint32_t> read_pos;
+    };
+
+    static_assert(std::atomic<std::uint32_t>::is_always_lock_free);
+    static_assert(offsetof(annotation_shared_ring_t, read_pos) == 64);
+    static_assert(sizeof(annotation_shared_ring_t) == 128);
+
+    /**
+     * Socket worker for annotation connections that pass their ring buffer to gatord, rather than sending the data
+     * through the socket.
+     *
+     * The connection begins with the same handshake bytes as any other, along with the memfd holding the ring. The
+     * handshake is forwarded first, after which the ring is polled and whatever has been written to it is forwarded in
+     * one message. Nothing else is read from the socket, it is only watched for being closed, at which point the ring is
+     * drained one last time.
+     *
+     * @tparam IpcSinkType The IPC sink wrapper which handles sending async IPC messages containing the received data
+     */
+    template<typename IpcSinkType>
+    class shared_ring_read_worker_t : public std::enable_shared_from_this<shared_ring_read_worker_t<IpcSinkType>> {
+    public:
+        static constexpr std::size_t max_handshake_size {4096};
+        /** How soon the ring is checked again after it was found to have data */
+        static constexpr std::chrono::microseconds min_poll_period {500};
+        /** How often the ring is checked once it has been empty for a while */
+        static constexpr std::chrono::microseconds max_poll_period {10000};
+
+        using ipc_sink_type = IpcSinkType;
+
+        /** Factory method */
+        static std::shared_ptr<shared_ring_read_worker_t> create(boost::asio::io_context & context,
+                                                                 ipc_sink_type && ipc_sink,
+                                                                 std::shared_ptr<socket_reference_base_t> socket_ref)
+        {
+            return std::make_shared<shared_ring_read_worker_t>(
+                shared_ring_read_worker_t {context, std::move(ipc_sink), std::move(socket_ref)});
+        }
+
+        /** @return True if the socket is still open */
+        [[nodiscard]] bool is_open() const { return socket_ref->is_open(); }
+
+        /** Start receiving the handshake and ring from the socket */
+        void start()
+        {
+            // tell of the new connection
+            ipc_sink.async_send_new_connection([st = this->shared_from_this()](auto const & ec, auto /*msg*/) {
+                if (ec) {
+                    // log it and close the connection
+                    LOG_ERROR_IF_NOT_EOF_OR_CANCELLED(
+                        ec,
+                        "(%p) Error occured while notifying IPC of new external connection %d, dropping due to %s",
+                        st.get(),
+                        st->socket_ref->native_handle(),
+                        ec.message().c_str());
+                    return st->async_close([st]() { LOG_DEBUG("(%p) Was closed", st.get()); });
+                }
+                // wait for the handshake
+                boost::asio::post(st->strand, [st]() { st->do_receive_handshake(); });
+            });
+        }
+
+        /** Send some data to the socket */
+        template<typename CompletionToken>
+        auto async_send_bytes(std::vector<char> && bytes, CompletionToken && token)
+        {
+            using namespace async::continuations;
+
+            LOG_TRACE("(%p) Received request to send %zu bytes", this, bytes.size());
+
+            return async_initiate_explicit<void(boost::system::error_code)>(
+                [st = this->shared_from_this(), bytes = std::move(bytes)](auto && sc) mutable {
+                    return st->do_async_send_bytes(std::move(bytes), std::forward<decltype(sc)>(sc));
+                },
+                std::forward<CompletionToken>(token));
+        }
+
+        /** Close the connection */
+        template<typename CompletionToken>
+        auto async_close(CompletionToken && token)
+        {
+            using namespace async::continuations;
+
+            return async_initiate_explicit<void()>(
+                [st = this->shared_from_this()](auto && sc) mutable {
+                    boost::asio::post(st->strand, [st, sc = std::forward<decltype(sc)>(sc)]() mutable {
+                        st->do_async_close(std::move(sc));
+                    });
+                },
+                std::forward<CompletionToken>(token));
+        }
+
+    private:
+        boost::asio::io_context & context;
+        boost::asio::io_context::strand strand;
+        boost::asio::steady_timer timer;
+        ipc_sink_type ipc_sink;
+        std::shared_ptr<socket_reference_base_t> socket_ref;
+        std::vector<char> receive_message_buffer {};
+        std::shared_ptr<annotation_shared_ring_t> ring {};
+        std::size_t ring_size {0};
+        std::chrono::microseconds poll_period {min_poll_period};
+        bool watching_for_close {false};
+        bool peer_closed {false};
+
+        shared_ring_read_worker_t(boost::asio::io_context & context,
+                                  ipc_sink_type && ipc_sink,
+                                  std::shared_ptr<socket_reference_base_t> socket_ref)
+            : context(context),
+              strand(context),
+              timer(context),
+              ipc_sink(std::move(ipc_sink)),
+              socket_ref(std::move(socket_ref))
+        {
+        }
+
+        /** Perform the async close operation */
+        template<typename R, typename E>
+        void do_async_close(async::continuations::raw_stored_continuation_t<R, E> && sc)
+        {
+            timer.cancel();
+
+            // tell the IPC mechanism, but only once
+            if (is_open()) {
+                return ipc_sink.async_send_close_connection(
+                    [st = this->shared_from_this(), sc = std::move(sc)](auto const & /*ec*/, auto /*msg*/) mutable {
+                        boost::asio::post(st->strand, [st, sc = std::move(sc)]() mutable {
+                            // close the socket
+                            st->socket_ref->close();
+                            // notify the handler
+                            return resume_continuation(st->context, std::move(sc));
+                        });
+                    });
+            }
+
+            // otherwise just call the handler directly
+            return resume_continuation(context, std::move(sc));
+        }
+
+        /** Perform the async send operation */
+        template<typename R, typename E>
+        void do_async_send_bytes(std::vector<char> && bytes,
+                                 async::continuations::raw_stored_continuation_t<R, E, boost::system::error_code> && sc)
+        {
+            socket_ref->with_socket([st = this->shared_from_this(),
+                                     bytes_ptr = std::make_unique<std::vector<char>>(std::move(bytes)),
+                                     sc = std::move(sc)](auto & socket) mutable {
+                // make the buffer before the call to move(bytes_ptr) otherwise the move will happen before the deref
+                auto buffer = boost::asio::buffer(*bytes_ptr);
+
+                boost::asio::async_write(
+                    socket,
+                    buffer,
+                    [st, bytes_ptr = std::move(bytes_ptr), sc = std::move(sc)](auto const & ec, auto /*n*/) mutable {
+                        // the library never reads the socket, so just report the error, the ring worker will close it
+                        return resume_continuation(st->context, std::move(sc), ec);
+                    });
+            });
+        }
+
+        /** Close the connection from the strand, logging why */
+        void on_strand_close_on_error(boost::system::error_code const & ec, char const * what)
+        {
+            LOG_ERROR_IF_NOT_EOF_OR_CANCELLED(ec,
+                                              "(%p) Error occured %s for external connection %d, dropping due to %s",
+                                              this,
+                                              what,
+                                              socket_ref->native_handle(),
+                                              ec.message().c_str());
+
+            async_close([st = this->shared_from_this()]() { LOG_DEBUG("(%p) Was closed", st.get()); });
+        }
+
+        /** Wait for the handshake and the ring */
+        void do_receive_handshake()
+        {
+            socket_ref->with_socket([st = this->shared_from_this()](auto & socket) {
+                socket.async_wait(boost::asio::socket_base::wait_read,
+                                  boost::asio::bind_executor(st->strand, [st](auto const & ec) {
+                                      if (ec) {
+                                          return st->on_strand_close_on_error(ec, "waiting for the handshake");
+                                      }
+                                      st->on_strand_receive_handshake();
+                                  }));
+            });
+        }
+
+        /** Read whatever part of the handshake has arrived */
+        void on_strand_receive_handshake()
+        {
+            receive_message_buffer.resize(max_handshake_size);
+
+            iovec iov {receive_message_buffer.data(), receive_message_buffer.size()};
+            std::array<char, CMSG_SPACE(sizeof(int))> control {};
+
+            msghdr msg {};
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control.data();
+            msg.msg_controllen = control.size();
+
+            auto const n_read = ::recvmsg(socket_ref->native_handle(), &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+            if (n_read < 0) {
+                if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)) {
+                    return do_receive_handshake();
+                }
+                return on_strand_close_on_error(boost::system::error_code {errno, boost::system::system_category()},
+                                                "reading the handshake");
+            }
+            if (n_read == 0) {
+                return on_strand_close_on_error(boost::asio::error::make_error_code(boost::asio::error::eof),
+                                                "reading the handshake");
+            }
+
+            for (auto * cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+                if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_RIGHTS)
+                    && (cmsg->cmsg_len == CMSG_LEN(sizeof(int)))) {
+                    int fd;
+                    std::memcpy(&fd, CMSG_DATA(cmsg), sizeof(fd));
+                    if (!map_ring(lib::AutoClosingFd {fd})) {
+                        return on_strand_close_on_error(
+                            boost::asio::error::make_error_code(boost::asio::error::invalid_argument),
+                            "mapping the ring");
+                    }
+                }
+            }
+
+            receive_message_buffer.resize(n_read);
+
+            do_forward_inward_bytes();
+        }
+
+        /** Map the ring from its memfd */
+        bool map_ring(lib::AutoClosingFd fd)
+        {
+            struct stat st {};
+            if ((ring != nullptr) || (::fstat(fd.get(), &st) != 0)) {
+                return false;
+            }
+
+            // the buffer must be a power of two so the positions can wrap
+            auto const mapping_size = std::size_t(st.st_size);
+            auto const buffer_size = mapping_size - std::min(mapping_size, sizeof(annotation_shared_ring_t));
+            if ((buffer_size == 0) || ((buffer_size & (buffer_size - 1)) != 0)) {
+                LOG_DEBUG("(%p) Shared ring has an invalid size %zu", this, mapping_size);
+                return false;
+            }
+
+            void * const mapping = ::mmap(nullptr, mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd.get(), 0);
+            if (mapping == MAP_FAILED) {
+                LOG_DEBUG("(%p) Unable to map shared ring (%d)", this, errno);
+                return false;
+            }
+
+            ring = std::shared_ptr<annotation_shared_ring_t>(
+                static_cast<annotation_shared_ring_t *>(mapping),
+                [mapping_size](annotation_shared_ring_t * p) { ::munmap(p, mapping_size); });
+            ring_size = buffer_size;
+
+            LOG_DEBUG("(%p) Mapped shared ring of %zu bytes", this, ring_size);
+
+            return true;
+        }
+
+        /** Copy whatever has been written to the ring into the receive buffer, making the space available again */
+        void copy_from_ring()
+        {
+            auto const mask = std::uint32_t(ring_size - 1);
+            auto const write_pos = ring->write_pos.load(std::memory_order_acquire) & mask;
+            auto const read_pos = ring->read_pos.load(std::memory_order_relaxed) & mask;
+            auto const used = std::size_t((write_pos - read_pos) & mask);
+
+            auto const * const buffer = reinterpret_cast<char const *>(ring.get() + 1);
+            auto const first = std::min<std::size_t>(used, ring_size - read_pos);
+
+            receive_message_buffer.resize(used);
+            std::copy_n(buffer + read_pos, first, receive_message_buffer.begin());
+            std::copy_n(buffer, used - first, receive_message_buffer.begin() + first);
+
+            ring->read_pos.store(std::uint32_t((read_pos + used) & mask), std::memory_order_release);
+        }
+
+        /** Watch for the library closing the connection */
+        void do_watch_for_close()
+        {
+            socket_ref->with_socket([st = this->shared_from_this()](auto & socket) {
+                socket.async_wait(boost::asio::socket_base::wait_read,
+                                  boost::asio::bind_executor(st->strand, [st](auto const & ec) {
+                                      if (ec) {
+                                          st->peer_closed = true;
+                                          return;
+                                      }
+
+                                      std::array<char, 64> discard {};
+                                      auto const n_read = ::recv(st->socket_ref->native_handle(),
+                                                                 discard.data(),
+                                                                 discard.size(),
+                                                                 MSG_DONTWAIT);
+                                      if ((n_read == 0)
+                                          || ((n_read < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK)
+                                              && (errno != EINTR))) {
+                                          st->peer_closed = true;
+                                          return;
+                                      }
+                                      if (n_read > 0) {
+                                          LOG_DEBUG("(%p) Ignoring %zd unexpected bytes", st.get(), n_read);
+                                      }
+                                      st->do_watch_for_close();
+                                  }));
+            });
+        }
+
+        /** Forward whatever is in the ring, or wait for the next poll if there is nothing */
+        void on_strand_poll_ring()
+        {
+            if (!is_open()) {
+                return;
+            }
+
+            // read the flag before the ring so that nothing written before the connection closed is missed
+            bool const closed = peer_closed;
+
+            copy_from_ring();
+
+            if (!receive_message_buffer.empty()) {
+                // the thread is busy, so check again soon
+                poll_period = min_poll_period;
+                return do_forward_inward_bytes();
+            }
+
+            if (closed) {
+                LOG_DEBUG("(%p) Shared ring connection closed", this);
+                return async_close([st = this->shared_from_this()]() { LOG_DEBUG("(%p) Was closed", st.get()); });
+            }
+
+            // back off while the thread is idle
+            poll_period = std::min(poll_period * 2, max_poll_period);
+
+            timer.expires_after(poll_period);
+            timer.async_wait(boost::asio::bind_executor(strand, [st = this->shared_from_this()](auto const & ec) {
+                if (ec) {
+                    return;
+                }
+                st->on_strand_poll_ring();
+            }));
+        }
+
+        /** Forward the receive buffer to the shell process via IPC */
+        void do_forward_inward_bytes()
+        {
+            if (receive_message_buffer.empty()) {
+                return on_strand_continue();
+            }
+
+            return ipc_sink.async_send_received_bytes(
+                std::move(receive_message_buffer),
+                [st = this->shared_from_this()](auto const & ec, auto msg) mutable {
+                    boost::asio::post(st->strand, [st, ec, msg = std::move(msg)]() mutable {
+                        // reuse the buffer
+                        st->receive_message_buffer = ipc_sink_type::reclaim_buffer(std::move(msg));
+                        // handle send error?
+                        if (ec) {
+                            return st->on_strand_close_on_error(ec, "forwarding bytes");
+                        }
+                        st->on_strand_continue();
+                    });
+                });
+        }
+
+        /** Read more of the handshake, or poll the ring once it has been received */
+        void on_strand_continue()
+        {
+            if (!ring) {
+                return do_receive_handshake();
+            }
+
+            if (!std::exchange(watching_for_close, true)) {
+                do_watch_for_close();
+            }
+
+            on_strand_poll_ring();
+        }
+    };
+}
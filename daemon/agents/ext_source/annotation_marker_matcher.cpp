@@ -0,0 +1,140 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "agents/ext_source/annotation_marker_matcher.h"
+
+#include "BufferUtils.h"
+#include "Logging.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+
+namespace agents {
+    namespace {
+        /** The handshake of the version of the protocol that the markers are decoded for */
+        constexpr std::string_view handshake_magic {"ANNOTATE 5\n"};
+        /** The magic is followed by the tid, the pid and the 'don't mangle keys' flag */
+        constexpr std::size_t handshake_size = handshake_magic.size() + 2 * sizeof(std::uint32_t) + 1;
+        /** Each message is a one byte header and a four byte length */
+        constexpr std::size_t message_header_size = 1 + sizeof(std::uint32_t);
+        /** The largest packed 64-bit timestamp */
+        constexpr std::size_t max_packed_time_size = 10;
+        constexpr std::size_t color_size = sizeof(std::uint32_t);
+
+        void append(std::vector<char> & output, char const * begin, std::size_t size)
+        {
+            output.insert(output.end(), begin, begin + size);
+        }
+    }
+
+    bool annotation_marker_matcher_t::match(lib::Span<char const> bytes)
+    {
+        bool matched = false;
+
+        std::size_t position = 0;
+        while ((position < bytes.size()) && (state != state_t::ignored)) {
+            auto const available = bytes.size() - position;
+            char const * const data = bytes.data() + position;
+
+            switch (state) {
+                case state_t::handshake: {
+                    auto const n = std::min(handshake_size - pending.size(), available);
+                    append(pending, data, n);
+                    position += n;
+
+                    auto const compared = std::min(pending.size(), handshake_magic.size());
+                    if (std::memcmp(pending.data(), handshake_magic.data(), compared) != 0) {
+                        LOG_DEBUG("Annotation connection has an unexpected handshake, not matching its markers");
+                        pending.clear();
+                        state = state_t::ignored;
+                    }
+                    else if (pending.size() == handshake_size) {
+                        pending.clear();
+                        state = state_t::message_header;
+                    }
+                    break;
+                }
+
+                case state_t::message_header: {
+                    auto const n = std::min(message_header_size - pending.size(), available);
+                    append(pending, data, n);
+                    position += n;
+
+                    if (pending.size() < message_header_size) {
+                        break;
+                    }
+
+                    auto const header = static_cast<std::uint8_t>(pending[0]);
+                    remaining = buffer_utils::readLEInt(pending.data() + 1);
+                    pending.clear();
+
+                    auto const could_match =
+                        ((header == header_marker) || (header == header_marker_color))
+                        && (remaining <= (max_packed_time_size + color_size + marker.size()));
+
+                    if (could_match) {
+                        pending.push_back(char(header));
+                        if (remaining == 0) {
+                            matched |= is_matching_marker();
+                            pending.clear();
+                        }
+                        else {
+                            state = state_t::marker_message;
+                        }
+                    }
+                    else if (remaining > 0) {
+                        state = state_t::skipped_message;
+                    }
+                    break;
+                }
+
+                case state_t::marker_message:
+                case state_t::skipped_message: {
+                    auto const n = std::min<std::size_t>(remaining, available);
+                    if (state == state_t::marker_message) {
+                        append(pending, data, n);
+                    }
+                    position += n;
+                    remaining -= n;
+
+                    if (remaining == 0) {
+                        if (state == state_t::marker_message) {
+                            matched |= is_matching_marker();
+                            pending.clear();
+                        }
+                        state = state_t::message_header;
+                    }
+                    break;
+                }
+
+                case state_t::ignored: {
+                    break;
+                }
+            }
+        }
+
+        return matched;
+    }
+
+    bool annotation_marker_matcher_t::is_matching_marker() const
+    {
+        auto const header = static_cast<std::uint8_t>(pending[0]);
+
+        // skip the packed timestamp
+        std::size_t position = 1;
+        while ((position < pending.size()) && ((static_cast<std::uint8_t>(pending[position]) & 0x80) != 0)) {
+            position += 1;
+        }
+        position += 1;
+
+        if (header == header_marker_color) {
+            position += color_size;
+        }
+
+        if (position > pending.size()) {
+            return false;
+        }
+
+        return std::string_view(pending.data() + position, pending.size() - position) == marker;
+    }
+}
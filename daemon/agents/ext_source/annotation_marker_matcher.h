@@ -0,0 +1,55 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#pragma once
+
+#include "lib/Span.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace agents {
+    /**
+     * Watches the (expanded) data from one annotation connection for marker annotations (ANNOTATE_MARKER and
+     * ANNOTATE_MARKER_COLOR) whose text is exactly some configured string.
+     *
+     * Only the marker messages that are small enough to match are buffered; everything else is skipped over as it
+     * arrives. Connections that do not start with the expected handshake are ignored in their entirety.
+     */
+    class annotation_marker_matcher_t {
+    public:
+        static constexpr std::uint8_t header_marker = 0x06;
+        static constexpr std::uint8_t header_marker_color = 0x07;
+
+        explicit annotation_marker_matcher_t(std::string marker) : marker(std::move(marker)) {}
+
+        /**
+         * Scan the next part of the connection's data
+         *
+         * @param bytes The data, as forwarded to the external source
+         * @return True if the data completed at least one matching marker annotation
+         */
+        [[nodiscard]] bool match(lib::Span<char const> bytes);
+
+    private:
+        enum class state_t {
+            handshake,
+            message_header,
+            marker_message,
+            skipped_message,
+            ignored,
+        };
+
+        std::string marker;
+        /** The partial handshake, message header or marker message received so far */
+        std::vector<char> pending {};
+        state_t state {state_t::handshake};
+        /** The number of bytes left of the current message */
+        std::uint32_t remaining {0};
+
+        /** @return True if the complete marker message (in pending) matches */
+        [[nodiscard]] bool is_matching_marker() const;
+    };
+}
@@ -0,0 +1,63 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "agents/ext_source/annotation_parent_messages.h"
+
+#include "Logging.h"
+
+#include <algorithm>
+
+namespace agents {
+    namespace {
+        void write_uint32(char * buffer, std::uint32_t value)
+        {
+            for (std::size_t i = 0; i < sizeof(value); ++i) {
+                buffer[i] = char((value >> (8 * i)) & 0xff);
+            }
+        }
+
+        [[nodiscard]] std::uint64_t read_uint64(char const * buffer)
+        {
+            std::uint64_t value = 0;
+            for (std::size_t i = 0; i < sizeof(value); ++i) {
+                value |= std::uint64_t(static_cast<unsigned char>(buffer[i])) << (8 * i);
+            }
+            return value;
+        }
+    }
+
+    std::array<char, parent_channel_limits_size> encode_channel_limits(ipc::annotation_channel_limits_t const & limits)
+    {
+        std::array<char, parent_channel_limits_size> result {};
+        result[0] = char(parent_header_channel_limits);
+        write_uint32(result.data() + 1, limits.max_rate);
+        write_uint32(result.data() + 1 + sizeof(std::uint32_t), limits.sample);
+        return result;
+    }
+
+    bool annotation_suppression_reader_t::read(lib::Span<char const> bytes)
+    {
+        bool completed = false;
+
+        std::size_t position = 0;
+        while ((position < bytes.size()) && !ignored) {
+            if (pending.empty() && (static_cast<std::uint8_t>(bytes[position]) != parent_header_suppressed)) {
+                LOG_DEBUG("Annotation parent connection sent an unexpected message, ignoring it");
+                ignored = true;
+                break;
+            }
+
+            auto const n = std::min(parent_suppressed_size - pending.size(), bytes.size() - position);
+            pending.insert(pending.end(), bytes.data() + position, bytes.data() + position + n);
+            position += n;
+
+            if (pending.size() == parent_suppressed_size) {
+                rate_limited = read_uint64(pending.data() + 1);
+                sampled_out = read_uint64(pending.data() + 1 + sizeof(std::uint64_t));
+                pending.clear();
+                completed = true;
+            }
+        }
+
+        return completed;
+    }
+}
@@ -0,0 +1,49 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#pragma once
+
+#include "ipc/messages.h"
+#include "lib/Span.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace agents {
+    /** The message that sets the limits of the channel annotations, a header byte then the limits */
+    constexpr std::uint8_t parent_header_channel_limits = 0x01;
+    constexpr std::size_t parent_channel_limits_size = 1 + 2 * sizeof(std::uint32_t);
+
+    /** The reply with the numbers of channel annotations suppressed so far, a header byte then the counts */
+    constexpr std::uint8_t parent_header_suppressed = 0x01;
+    constexpr std::size_t parent_suppressed_size = 1 + 2 * sizeof(std::uint64_t);
+
+    /** @return The message sent on an annotation parent connection to set the limits of the channel annotations */
+    [[nodiscard]] std::array<char, parent_channel_limits_size> encode_channel_limits(
+        ipc::annotation_channel_limits_t const & limits);
+
+    /**
+     * Reads the replies that the annotate library sends on its parent connection, keeping the latest numbers of channel
+     * annotations that the process has suppressed. A connection that sends anything else is ignored from then on.
+     */
+    class annotation_suppression_reader_t {
+    public:
+        /**
+         * Read the next part of the connection's data
+         *
+         * @return True if the data completed at least one reply
+         */
+        [[nodiscard]] bool read(lib::Span<char const> bytes);
+
+        [[nodiscard]] std::uint64_t get_rate_limited() const { return rate_limited; }
+        [[nodiscard]] std::uint64_t get_sampled_out() const { return sampled_out; }
+
+    private:
+        /** The partial reply received so far */
+        std::vector<char> pending {};
+        std::uint64_t rate_limited {0};
+        std::uint64_t sampled_out {0};
+        bool ignored {false};
+    };
+}
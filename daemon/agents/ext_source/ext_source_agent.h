@@ -3,9 +3,11 @@
 
 #include "Logging.h"
 #include "agents/agent_environment.h"
+#include "agents/common/shared_ring_worker.h"
 #include "agents/common/socket_listener.h"
 #include "agents/common/socket_reference.h"
 #include "agents/common/socket_worker.h"
+#include "agents/ext_source/annotation_parent_messages.h"
 #include "agents/ext_source/ipc_sink_wrapper.h"
 #include "async/completion_handler.h"
 #include "async/continuations/continuation.h"
@@ -14,7 +16,9 @@
 #include "ipc/raw_ipc_channel_source.h"
 #include "lib/Utils.h"
 
+#include <array>
 #include <atomic>
+#include <cinttypes>
 #include <map>
 #include <memory>
 #include <stdexcept>
@@ -22,10 +26,12 @@
 #include <variant>
 #include <vector>
 
+#include <boost/asio/bind_executor.hpp>
 #include <boost/asio/dispatch.hpp>
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/ip/address_v6.hpp>
 #include <boost/asio/local/stream_protocol.hpp>
+#include <boost/asio/write.hpp>
 #include <boost/system/error_code.hpp>
 
 namespace agents {
@@ -34,12 +40,16 @@ namespace agents {
      */
     class ext_source_agent_t : public std::enable_shared_from_this<ext_source_agent_t> {
     public:
-        using accepted_message_types = std::tuple<ipc::msg_annotation_send_bytes_t, ipc::msg_annotation_close_conn_t>;
+        using accepted_message_types = std::tuple<ipc::msg_annotation_send_bytes_t,
+                                                  ipc::msg_annotation_close_conn_t,
+                                                  ipc::msg_annotation_channel_limits_t>;
 
         using socket_read_worker_type = socket_read_worker_t<ipc_annotations_sink_adapter_t>;
+        using shared_ring_read_worker_type = shared_ring_read_worker_t<ipc_annotations_sink_adapter_t>;
 
         static constexpr std::string_view annotation_uds_parent_socket_name {"\0streamline-annotate-parent", 27};
         static constexpr std::string_view annotation_uds_data_socket_name {"\0streamline-annotate", 20};
+        static constexpr std::string_view annotation_uds_shared_socket_name {"\0streamline-annotate-shared", 27};
         static constexpr std::uint16_t annotation_parent_tcp_port = 8082;
         static constexpr std::uint16_t annotation_data_tcp_port = 8083;
 
@@ -60,10 +70,12 @@ namespace agents {
         }
 
         /** Add a UDS annotation socket listener */
-        void add_uds_annotation_listeners(std::string_view parent_name, std::string_view data_name)
+        void add_uds_annotation_listeners(std::string_view parent_name,
+                                          std::string_view data_name,
+                                          std::string_view shared_name)
         {
             // strand is used for synchronizing access to internal structures
-            return boost::asio::post(strand, [st = shared_from_this(), parent_name, data_name]() {
+            return boost::asio::post(strand, [st = shared_from_this(), parent_name, data_name, shared_name]() {
                 if (!st->is_shutdown) {
                     st->on_strand_add_agent(
                         "Annotations UDS parent listener",
@@ -76,6 +88,13 @@ namespace agents {
                         make_uds_socket_lister([st](auto socket) { st->spawn_worker(std::move(socket)); },
                                                st->io_context,
                                                boost::asio::local::stream_protocol::endpoint {data_name}));
+
+                    // only unix domain sockets can pass the ring's file descriptor
+                    st->on_strand_add_agent(
+                        "Annotations UDS shared ring listener",
+                        make_uds_socket_lister([st](auto socket) { st->spawn_shared_ring_worker(std::move(socket)); },
+                                               st->io_context,
+                                               boost::asio::local::stream_protocol::endpoint {shared_name}));
                 }
             });
         }
@@ -105,7 +124,9 @@ namespace agents {
         /** Add the default listener set */
         void add_all_defaults()
         {
-            add_uds_annotation_listeners(annotation_uds_parent_socket_name, annotation_uds_data_socket_name);
+            add_uds_annotation_listeners(annotation_uds_parent_socket_name,
+                                         annotation_uds_data_socket_name,
+                                         annotation_uds_shared_socket_name);
             add_tcp_annotation_listeners(
                 boost::asio::ip::tcp::endpoint {
                     boost::asio::ip::address_v6::loopback(),
@@ -149,15 +170,47 @@ namespace agents {
             return co_close_worker_by_id(msg.header);
         }
 
+        async::continuations::polymorphic_continuation_t<> co_receive_message(
+            ipc::msg_annotation_channel_limits_t msg)
+        {
+            using namespace async::continuations;
+
+            return start_on(strand) | then([self = shared_from_this(), limits = msg.header]() {
+                       LOG_DEBUG("Limiting annotation channels to %u per second, sampling 1 in %u",
+                                 limits.max_rate,
+                                 limits.sample);
+
+                       self->channel_limits = limits;
+
+                       // the processes that are already connected are updated too
+                       for (auto const & parent : self->parent_connections) {
+                           self->send_channel_limits(parent);
+                       }
+                   });
+        }
+
     private:
+        /** An annotations 'parent' connection, which has one per process */
+        struct parent_connection_t {
+            explicit parent_connection_t(std::shared_ptr<socket_reference_base_t> socket) : socket(std::move(socket))
+            {
+            }
+
+            std::shared_ptr<socket_reference_base_t> socket;
+            annotation_suppression_reader_t suppressions {};
+            std::array<char, 256> read_buffer {};
+        };
+
         static constexpr std::array<char, 1> close_parent_bytes {{0}};
 
         boost::asio::io_context & io_context;
         boost::asio::io_context::strand strand;
         std::shared_ptr<ipc::raw_ipc_channel_sink_t> ipc_sink;
         std::vector<std::shared_ptr<socket_listener_base_t>> socket_listeners {};
-        std::vector<std::shared_ptr<socket_reference_base_t>> parent_connections {};
+        std::vector<std::shared_ptr<parent_connection_t>> parent_connections {};
+        ipc::annotation_channel_limits_t channel_limits {0, 0};
         std::map<ipc::annotation_uid_t, std::shared_ptr<socket_read_worker_type>> socket_workers {};
+        std::map<ipc::annotation_uid_t, std::shared_ptr<shared_ring_read_worker_type>> shared_ring_workers {};
         ipc::annotation_uid_t uid_counter {0};
         bool is_shutdown {false};
 
@@ -176,28 +229,40 @@ namespace agents {
                                  message.header);
 
                        auto worker_it = self->socket_workers.find(message.header);
-                       if (worker_it == self->socket_workers.end()) {
-                           LOG_DEBUG("Received bytes for non-existent client %d", message.header);
-                           return {};
+                       if (worker_it != self->socket_workers.end()) {
+                           return self->co_send_bytes_to_worker(worker_it->second, std::move(message));
                        }
 
-                       auto worker = worker_it->second;
-                       if (!worker) {
-                           LOG_DEBUG("Received bytes for non-existent client %d", message.header);
-                           return {};
+                       auto shared_worker_it = self->shared_ring_workers.find(message.header);
+                       if (shared_worker_it != self->shared_ring_workers.end()) {
+                           return self->co_send_bytes_to_worker(shared_worker_it->second, std::move(message));
                        }
 
-                       return worker->async_send_bytes(std::move(message.suffix), use_continuation)
-                            | then(
-                                  [id = message.header, self](const auto & ec) mutable -> polymorphic_continuation_t<> {
-                                      if (ec) {
-                                          LOG_DEBUG("Failed to send bytes to worker %d due to %s",
-                                                    id,
-                                                    ec.message().c_str());
-                                          return self->co_close_worker_by_id(id);
-                                      }
-                                      return {};
-                                  });
+                       LOG_DEBUG("Received bytes for non-existent client %d", message.header);
+                       return {};
+                   });
+        }
+
+        /** Transmit the bytes to some worker */
+        template<typename Worker>
+        async::continuations::polymorphic_continuation_t<> co_send_bytes_to_worker(std::shared_ptr<Worker> worker,
+                                                                                   ipc::msg_annotation_send_bytes_t message)
+        {
+            using namespace async::continuations;
+
+            if (!worker) {
+                LOG_DEBUG("Received bytes for non-existent client %d", message.header);
+                return {};
+            }
+
+            return worker->async_send_bytes(std::move(message.suffix), use_continuation)
+                 | then([id = message.header, self = shared_from_this()](const auto & ec) mutable
+                        -> polymorphic_continuation_t<> {
+                       if (ec) {
+                           LOG_DEBUG("Failed to send bytes to worker %d due to %s", id, ec.message().c_str());
+                           return self->co_close_worker_by_id(id);
+                       }
+                       return {};
                    });
         }
 
@@ -237,10 +302,24 @@ namespace agents {
                                return worker->async_close(use_continuation);
                            })
                  | then([self]() mutable { self->socket_workers.clear(); })
+                 | iterate(shared_ring_workers,
+                           [self](auto it) mutable {
+                               auto worker = it->second;
+
+                               LOG_TRACE("Closing shared ring worker %d (%p)", it->first, worker.get());
+
+                               // remove from the map
+                               self->shared_ring_workers.erase(it);
+
+                               static_assert(!std::is_const_v<decltype(worker)>);
+                               return worker->async_close(use_continuation);
+                           })
+                 | then([self]() mutable { self->shared_ring_workers.clear(); })
                  // then close the parent connections
                  | iterate(parent_connections,
                            [self](auto it) mutable {
-                               auto parent = *it;
+                               auto parent = (*it)->socket;
+                               log_suppressions(**it);
                                // close the parent connections after writing a single 0-byte to each
                                parent->with_socket([parent](auto & socket) mutable {
                                    boost::asio::async_write(
@@ -265,10 +344,71 @@ namespace agents {
 
                 // store the parent connection; we don't use it for data transmission, but the annotation protocol expects the port to be maintained
                 // until gatord exits
-                st->parent_connections.emplace_back(make_socket_ref(std::move(socket)));
+                auto parent = std::make_shared<parent_connection_t>(make_socket_ref(std::move(socket)));
+                st->parent_connections.emplace_back(parent);
+
+                // the limits are always sent, as they also tell the library that its replies are read
+                st->send_channel_limits(parent);
+                st->read_parent(std::move(parent));
             });
         }
 
+        /** Send the limits of the channel annotations on a parent connection */
+        void send_channel_limits(std::shared_ptr<parent_connection_t> const & parent)
+        {
+            // the buffer must be owned until it is fully sent
+            auto buffer_ptr =
+                std::make_shared<std::array<char, parent_channel_limits_size>>(encode_channel_limits(channel_limits));
+
+            parent->socket->with_socket([buffer_ptr](auto & socket) {
+                boost::asio::async_write(socket,
+                                         boost::asio::buffer(*buffer_ptr),
+                                         [buffer_ptr](auto const & ec, auto /*n*/) {
+                                             if (ec) {
+                                                 LOG_DEBUG("Failed to send the annotation channel limits due to %s",
+                                                           ec.message().c_str());
+                                             }
+                                         });
+            });
+        }
+
+        /** Read the replies on a parent connection, until it is closed */
+        void read_parent(std::shared_ptr<parent_connection_t> parent)
+        {
+            parent->socket->with_socket([st = shared_from_this(), parent](auto & socket) {
+                socket.async_read_some(
+                    boost::asio::buffer(parent->read_buffer),
+                    boost::asio::bind_executor(st->strand, [st, parent](auto const & ec, std::size_t n) {
+                        if (ec) {
+                            // closed by the process, or at shutdown
+                            return;
+                        }
+
+                        if (parent->suppressions.read({parent->read_buffer.data(), n})) {
+                            LOG_DEBUG("Annotating process has suppressed %" PRIu64 " channel annotations by rate and %"
+                                      PRIu64 " by sampling",
+                                      parent->suppressions.get_rate_limited(),
+                                      parent->suppressions.get_sampled_out());
+                        }
+
+                        st->read_parent(parent);
+                    }));
+            });
+        }
+
+        /** Log the channel annotations that the process of a parent connection suppressed, if any */
+        static void log_suppressions(parent_connection_t const & parent)
+        {
+            auto const rate_limited = parent.suppressions.get_rate_limited();
+            auto const sampled_out = parent.suppressions.get_sampled_out();
+            if ((rate_limited != 0) || (sampled_out != 0)) {
+                LOG_INFO("An annotating process suppressed %" PRIu64 " channel annotations that exceeded the rate "
+                         "limit and %" PRIu64 " that were not sampled",
+                         rate_limited,
+                         sampled_out);
+            }
+        }
+
         /**
          * Called whenever a new connection is accepted to create a new worker from the new connection socket.
          */
@@ -297,6 +437,34 @@ namespace agents {
             });
         }
 
+        /**
+         * Called whenever a new connection is accepted on the shared ring socket to create a new worker from the new
+         * connection socket.
+         */
+        void spawn_shared_ring_worker(boost::asio::local::stream_protocol::socket socket)
+        {
+            // strand is used for synchronizing access to internal structures
+            return boost::asio::post(strand, [st = shared_from_this(), socket = std::move(socket)]() mutable {
+                if (st->is_shutdown) {
+                    LOG_DEBUG("Dropping new inbound connection due to shutdown");
+                    return;
+                }
+
+                // create it
+                auto id = ++st->uid_counter;
+                auto shared_ring_read_worker =
+                    shared_ring_read_worker_type::create(st->io_context,
+                                                         ipc_annotations_sink_adapter_t(st->ipc_sink, id),
+                                                         make_socket_ref(std::move(socket)));
+
+                // store it
+                st->shared_ring_workers[id] = shared_ring_read_worker;
+
+                // start it
+                shared_ring_read_worker->start();
+            });
+        }
+
         /** Add one new listener to the list of socket listeners */
         template<typename ProtocolType, typename WorkerSpawnerFn>
         void on_strand_add_agent(std::string_view name,
@@ -333,24 +501,35 @@ namespace agents {
             auto self = this->shared_from_this();
 
             return start_on(strand) | then([self, id]() -> async::continuations::polymorphic_continuation_t<> {
-                       auto worker_it = self->socket_workers.find(id);
-                       if (worker_it == self->socket_workers.end()) {
-                           LOG_DEBUG("Received close request for non-existent client %d", id);
-                           return {};
+                       if (self->socket_workers.count(id) > 0) {
+                           return co_close_worker_in(self->socket_workers, id);
                        }
+                       return co_close_worker_in(self->shared_ring_workers, id);
+                   });
+        }
 
-                       auto worker = worker_it->second;
-                       if (!worker) {
-                           LOG_DEBUG("Received close request for non-existent client %d", id);
-                           return {};
-                       }
+        /** Remove a worker from one of the worker maps and close it */
+        template<typename Workers>
+        static async::continuations::polymorphic_continuation_t<> co_close_worker_in(Workers & workers,
+                                                                                     ipc::annotation_uid_t id)
+        {
+            auto worker_it = workers.find(id);
+            if (worker_it == workers.end()) {
+                LOG_DEBUG("Received close request for non-existent client %d", id);
+                return {};
+            }
+
+            auto worker = worker_it->second;
+            if (!worker) {
+                LOG_DEBUG("Received close request for non-existent client %d", id);
+                return {};
+            }
 
-                       // remove from the map
-                       self->socket_workers.erase(worker_it);
+            // remove from the map
+            workers.erase(worker_it);
 
-                       // close it
-                       return worker->async_close(async::continuations::use_continuation);
-                   });
+            // close it
+            return worker->async_close(async::continuations::use_continuation);
         }
     };
 }
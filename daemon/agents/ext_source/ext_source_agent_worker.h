@@ -1,7 +1,9 @@
 /* Copyright (C) 2021-2022 by Arm Limited. All rights reserved. */
 #pragma once
 
+#include "PipelineStats.h"
 #include "agents/agent_worker_base.h"
+#include "agents/ext_source/annotation_marker_matcher.h"
 #include "agents/spawn_agent.h"
 #include "async/continuations/continuation.h"
 #include "async/continuations/operations.h"
@@ -9,8 +11,11 @@
 #include "ipc/messages.h"
 
 #include <cerrno>
+#include <functional>
+#include <map>
 #include <memory>
 #include <stdexcept>
+#include <string>
 #include <variant>
 
 #include <boost/asio/bind_executor.hpp>
@@ -29,6 +34,10 @@ namespace agents {
      * with the agent process via the IPC mechanism.
      * The class will respond to msg_annoatation_read data and forward the received annotation messages
      * into the ExternalSource class for insertion into the APC data.
+     * When some trigger marker is configured, the forwarded data is also watched for marker annotations with that
+     * text, each of which calls the trigger callback (which triggers the flight recorder).
+     * Once the agent is ready it is sent the limits of the channel annotations, which it passes on to each annotating
+     * process.
      */
     template<typename ExternalSource>
     class ext_source_agent_worker_t : public agent_worker_base_t,
@@ -37,6 +46,10 @@ namespace agents {
         boost::asio::io_context::strand strand;
         ExternalSource & external_source;
         std::map<ipc::annotation_uid_t, boost::asio::posix::stream_descriptor> external_source_pipes {};
+        std::string trigger_marker;
+        std::function<void()> on_trigger_marker;
+        ipc::annotation_channel_limits_t channel_limits;
+        std::map<ipc::annotation_uid_t, annotation_marker_matcher_t> marker_matchers {};
 
         /** @return A continuation that requests the remote target to shutdown */
         auto cont_shutdown()
@@ -86,6 +99,7 @@ namespace agents {
 
                        // and remove from the map
                        st->external_source_pipes.erase(it);
+                       st->marker_matchers.erase(uid);
 
                        // close the external source pipe
                        return st->sink().async_send_message(ipc::msg_annotation_close_conn_t {uid}, use_continuation)
@@ -129,6 +143,36 @@ namespace agents {
             LOG_DEBUG("Unexpected message ipc::msg_apc_frame_data_t; ignoring");
         }
 
+        /** Handle one of the IPC variant values */
+        static void cont_on_recv_message(ipc::msg_perf_data_raw_t const & /*message*/)
+        {
+            LOG_DEBUG("Unexpected message ipc::msg_perf_data_raw_t; ignoring");
+        }
+
+        /** Handle one of the IPC variant values */
+        static void cont_on_recv_message(ipc::msg_perf_agent_stats_t const & /*message*/)
+        {
+            LOG_DEBUG("Unexpected message ipc::msg_perf_agent_stats_t; ignoring");
+        }
+
+        /** Handle one of the IPC variant values */
+        static void cont_on_recv_message(ipc::msg_flight_recorder_trigger_t const & /*message*/)
+        {
+            LOG_DEBUG("Unexpected message ipc::msg_flight_recorder_trigger_t; ignoring");
+        }
+
+        /** Handle one of the IPC variant values */
+        static void cont_on_recv_message(ipc::msg_capture_reconfiguration_t const & /*message*/)
+        {
+            LOG_DEBUG("Unexpected message ipc::msg_capture_reconfiguration_t; ignoring");
+        }
+
+        /** Handle one of the IPC variant values */
+        static void cont_on_recv_message(ipc::msg_annotation_channel_limits_t const & /*message*/)
+        {
+            LOG_DEBUG("Unexpected message ipc::msg_annotation_channel_limits_t; ignoring");
+        }
+
         /** Handle one of the IPC variant values */
         static void cont_on_recv_message(ipc::msg_start_t const & /*message*/)
         {
@@ -159,15 +203,26 @@ namespace agents {
             LOG_DEBUG("Unexpected message ipc::msg_capture_started_t; ignoring");
         }
 
-        /** Handle the 'ready' IPC message variant. The agent is ready. */
-        void cont_on_recv_message(ipc::msg_ready_t const & /*message*/)
+        /** Handle the 'ready' IPC message variant. The agent is ready, so is sent the channel limits. */
+        async::continuations::polymorphic_continuation_t<> cont_on_recv_message(ipc::msg_ready_t const & /*message*/)
         {
+            using namespace async::continuations;
+
             LOG_DEBUG("Received ready message.");
 
             // transition state
-            if (transition_state(state_t::ready)) {
-                LOG_DEBUG("ext_source agent is now ready");
+            if (!transition_state(state_t::ready)) {
+                return {};
             }
+
+            LOG_DEBUG("ext_source agent is now ready");
+
+            return sink().async_send_message(ipc::msg_annotation_channel_limits_t {channel_limits}, use_continuation)
+                 | then([st = this->shared_from_this()](auto const & ec, auto const & /*msg*/) {
+                       if (ec) {
+                           LOG_DEBUG("Failed to send the annotation channel limits due to %s", ec.message().c_str());
+                       }
+                   });
         }
 
         /** Handle the 'shutdown' IPC message variant. The agent is shutdown. */
@@ -202,6 +257,10 @@ namespace agents {
                 LOG_ERROR("Failed to create external data pipe, does the UID already exist?");
                 return;
             }
+
+            if (!trigger_marker.empty()) {
+                marker_matchers.insert_or_assign(message.header, annotation_marker_matcher_t {trigger_marker});
+            }
         }
 
         /** Handle the 'recv' IPC message variant. The agent received data from a connection. */
@@ -214,6 +273,8 @@ namespace agents {
                       message.header,
                       message.suffix.size());
 
+            gPipelineStats.onAgentData(message.suffix.size());
+
             auto uid = message.header;
             auto it = external_source_pipes.find(uid);
             if (it == external_source_pipes.end()) {
@@ -221,6 +282,12 @@ namespace agents {
                 return {};
             }
 
+            auto matcher = marker_matchers.find(uid);
+            if ((matcher != marker_matchers.end()) && matcher->second.match(message.suffix)) {
+                LOG_DEBUG("Received the trigger marker on connection %d", uid);
+                on_trigger_marker();
+            }
+
             // the buffer must be owned until it is fully sent
             auto buffer_ptr = std::make_shared<std::vector<char>>(std::move(message.suffix));
 
@@ -265,6 +332,7 @@ namespace agents {
 
             // and remove from the map
             external_source_pipes.erase(it);
+            marker_matchers.erase(message.header);
         }
 
         /**
@@ -277,10 +345,8 @@ namespace agents {
             auto st = this->shared_from_this();
 
             return repeatedly(
-                [st]() {
+                []() {
                     // don't stop until the agent terminates and closes the connection from its end
-                    LOG_DEBUG("Receive loop would have terminated? %d",
-                              (st->get_state() >= state_t::terminated_pending_message_loop));
                     return true;
                 },
                 [st]() {
@@ -300,10 +366,16 @@ namespace agents {
         ext_source_agent_worker_t(boost::asio::io_context & io_context,
                                   agent_process_t && agent_process,
                                   state_change_observer_t && state_change_observer,
-                                  ExternalSource & external_source)
+                                  ExternalSource & external_source,
+                                  std::string trigger_marker,
+                                  std::function<void()> on_trigger_marker,
+                                  ipc::annotation_channel_limits_t channel_limits)
             : agent_worker_base_t(std::move(agent_process), std::move(state_change_observer)),
               strand(io_context),
-              external_source(external_source)
+              external_source(external_source),
+              trigger_marker(std::move(trigger_marker)),
+              on_trigger_marker(std::move(on_trigger_marker)),
+              channel_limits(channel_limits)
         {
         }
 
@@ -349,6 +421,12 @@ namespace agents {
             spawn("Shutdown request", cont_shutdown());
         }
 
+        /** The external source agent does not have a flight recorder */
+        void on_flight_recorder_trigger() override {}
+
+        /** The external source agent does not have any counters to change */
+        void on_capture_reconfiguration(ipc::msg_capture_reconfiguration_t const & /*msg*/) override {}
+
     protected:
         [[nodiscard]] boost::asio::io_context::strand & work_strand() override { return strand; }
     };
@@ -0,0 +1,322 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "agents/ext_source/interned_string_expander.h"
+
+#include "BufferUtils.h"
+#include "Logging.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <string_view>
+
+namespace agents {
+    namespace {
+        /** The handshake of the version of the protocol that may contain interned strings */
+        constexpr std::string_view handshake_magic {"ANNOTATE 5\n"};
+        /** The magic is followed by the tid, the pid and the 'don't mangle keys' flag */
+        constexpr std::size_t handshake_size = handshake_magic.size() + 2 * sizeof(std::uint32_t) + 1;
+        /** Each message is a one byte header and a four byte length */
+        constexpr std::size_t message_header_size = 1 + sizeof(std::uint32_t);
+        /** Colors are four bytes */
+        constexpr std::size_t color_size = 4;
+
+        /** Decode a packed int, as buffer_utils::unpackInt, but without reading beyond the end of the data */
+        bool read_packed_int(lib::Span<char const> data, std::size_t & position, std::uint32_t & value)
+        {
+            std::uint32_t result = 0;
+            for (unsigned shift = 0; (shift < 35) && (position < data.size()); shift += 7) {
+                auto const b = static_cast<std::uint8_t>(data[position++]);
+                result |= std::uint32_t(b & 0x7f) << shift;
+                if ((b & 0x80) == 0) {
+                    value = result;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /** Decode a packed long, as buffer_utils::unpackInt64, but without reading beyond the end of the data */
+        bool read_packed_long(lib::Span<char const> data, std::size_t & position, std::int64_t & value)
+        {
+            std::uint64_t result = 0;
+            for (unsigned shift = 0; (shift < 70) && (position < data.size()); shift += 7) {
+                auto const b = static_cast<std::uint8_t>(data[position++]);
+                result |= std::uint64_t(b & 0x7f) << shift;
+                if ((b & 0x80) == 0) {
+                    // sign extend
+                    if (((shift + 7) < 64) && ((b & 0x40) != 0)) {
+                        result |= ~std::uint64_t(0) << (shift + 7);
+                    }
+                    value = static_cast<std::int64_t>(result);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void append(std::vector<char> & output, char const * begin, std::size_t size)
+        {
+            output.insert(output.end(), begin, begin + size);
+        }
+    }
+
+    std::vector<char> interned_string_expander_t::expand(std::vector<char> && bytes)
+    {
+        // nothing to do for a connection that doesn't use the protocol, or in the middle of a large message
+        if ((state == state_t::passthrough) || ((state == state_t::forwarded_message) && (remaining >= bytes.size()))) {
+            if (state == state_t::forwarded_message) {
+                remaining -= bytes.size();
+                if (remaining == 0) {
+                    state = state_t::message_header;
+                }
+            }
+            return std::move(bytes);
+        }
+
+        std::vector<char> output {};
+        output.reserve(bytes.size());
+
+        std::size_t position = 0;
+        while (position < bytes.size()) {
+            auto const available = bytes.size() - position;
+            char const * const data = bytes.data() + position;
+
+            switch (state) {
+                case state_t::handshake: {
+                    auto const n = std::min(handshake_size - pending.size(), available);
+                    append(pending, data, n);
+                    position += n;
+
+                    auto const compared = std::min(pending.size(), handshake_magic.size());
+                    if (std::memcmp(pending.data(), handshake_magic.data(), compared) != 0) {
+                        LOG_DEBUG("Annotation connection has an unexpected handshake, forwarding it unchanged");
+                        append(output, pending.data(), pending.size());
+                        pending.clear();
+                        state = state_t::passthrough;
+                    }
+                    else if (pending.size() == handshake_size) {
+                        append(output, pending.data(), pending.size());
+                        pending.clear();
+                        state = state_t::message_header;
+                    }
+                    break;
+                }
+
+                case state_t::message_header: {
+                    auto const n = std::min(message_header_size - pending.size(), available);
+                    append(pending, data, n);
+                    position += n;
+
+                    if (pending.size() < message_header_size) {
+                        break;
+                    }
+
+                    auto const header = static_cast<std::uint8_t>(pending[0]);
+                    remaining = buffer_utils::readLEInt(pending.data() + 1);
+
+                    if ((header != header_intern_string) && (header != header_interned)
+                        && (header != header_cam_job_batch)) {
+                        append(output, pending.data(), pending.size());
+                        pending.clear();
+                        state = (remaining > 0 ? state_t::forwarded_message : state_t::message_header);
+                    }
+                    else if (remaining > max_interned_message_size) {
+                        LOG_DEBUG("Interned annotation of %u bytes is too large, forwarding the rest unchanged",
+                                  remaining);
+                        append(output, pending.data(), pending.size());
+                        pending.clear();
+                        state = state_t::passthrough;
+                    }
+                    else if (remaining == 0) {
+                        on_interned_message(output);
+                    }
+                    else {
+                        state = state_t::interned_message;
+                    }
+                    break;
+                }
+
+                case state_t::forwarded_message: {
+                    auto const n = std::min<std::size_t>(remaining, available);
+                    append(output, data, n);
+                    position += n;
+                    remaining -= n;
+
+                    if (remaining == 0) {
+                        state = state_t::message_header;
+                    }
+                    break;
+                }
+
+                case state_t::interned_message: {
+                    auto const n = std::min<std::size_t>(remaining, available);
+                    append(pending, data, n);
+                    position += n;
+                    remaining -= n;
+
+                    if (remaining == 0) {
+                        on_interned_message(output);
+                    }
+                    break;
+                }
+
+                case state_t::passthrough: {
+                    append(output, data, available);
+                    position += available;
+                    break;
+                }
+            }
+        }
+
+        return output;
+    }
+
+    void interned_string_expander_t::on_interned_message(std::vector<char> & output)
+    {
+        auto const header = static_cast<std::uint8_t>(pending[0]);
+        lib::Span<char const> const payload {pending.data() + message_header_size,
+                                             pending.size() - message_header_size};
+
+        std::size_t position = 0;
+        std::uint32_t id = 0;
+
+        if (header == header_cam_job_batch) {
+            on_cam_job_batch(payload, output);
+        }
+        else if (header == header_intern_string) {
+            if (read_packed_int(payload, position, id)) {
+                strings[id].assign(payload.data() + position, payload.size() - position);
+            }
+            else {
+                LOG_DEBUG("Ignoring malformed interned string definition");
+            }
+        }
+        else if ((payload.size() > 0) && read_packed_int(payload, position = 1, id)) {
+            auto const it = strings.find(id);
+            if (it == strings.end()) {
+                LOG_DEBUG("Expanding undefined interned string %u as an empty string", id);
+            }
+
+            auto const original_header = payload[0];
+            auto const fields = payload.subspan(position);
+            auto const string_size = (it != strings.end() ? it->second.size() : 0);
+
+            std::array<char, message_header_size> expanded_header {};
+            expanded_header[0] = original_header;
+            buffer_utils::writeLEInt(expanded_header.data() + 1, fields.size() + string_size);
+
+            append(output, expanded_header.data(), expanded_header.size());
+            append(output, fields.data(), fields.size());
+            if (it != strings.end()) {
+                append(output, it->second.data(), it->second.size());
+            }
+        }
+        else {
+            LOG_DEBUG("Ignoring malformed interned annotation");
+        }
+
+        pending.clear();
+        state = state_t::message_header;
+    }
+
+    void interned_string_expander_t::on_cam_job_batch(lib::Span<char const> payload, std::vector<char> & output)
+    {
+        std::size_t position = 0;
+
+        // the packed ints that are forwarded as they are, are copied rather than re-encoded
+        auto const read_raw = [&](lib::Span<char const> & raw, std::uint32_t & value) {
+            auto const start = position;
+            if (!read_packed_int(payload, position, value)) {
+                return false;
+            }
+            raw = payload.subspan(start, position - start);
+            return true;
+        };
+
+        lib::Span<char const> view_uid {};
+        std::uint32_t ignored = 0;
+        std::uint32_t count = 0;
+        if (!read_raw(view_uid, ignored) || !read_packed_int(payload, position, count)) {
+            LOG_DEBUG("Ignoring malformed CAM job batch");
+            return;
+        }
+
+        std::vector<char> fields {};
+        std::uint64_t start_time = 0;
+
+        for (std::uint32_t n = 0; n < count; ++n) {
+            lib::Span<char const> job_uid {};
+            lib::Span<char const> track {};
+            lib::Span<char const> primary_dependency {};
+            lib::Span<char const> dependency_count_raw {};
+            std::uint32_t name_id = 0;
+            std::uint32_t dependency_count = 0;
+            std::int64_t start_time_delta = 0;
+            std::int64_t duration = 0;
+
+            auto const read_job_start = [&]() {
+                return read_raw(job_uid, ignored) && read_packed_int(payload, position, name_id)
+                    && read_raw(track, ignored) && read_packed_long(payload, position, start_time_delta);
+            };
+            if (!read_job_start()) {
+                LOG_DEBUG("Ignoring the rest of a malformed CAM job batch");
+                return;
+            }
+
+            auto const duration_position = position;
+            if (!read_packed_long(payload, position, duration) || ((payload.size() - position) < color_size)) {
+                LOG_DEBUG("Ignoring the rest of a malformed CAM job batch");
+                return;
+            }
+            position += color_size;
+            auto const duration_and_color = payload.subspan(duration_position, position - duration_position);
+
+            auto const dependencies_position = position;
+            if (!read_raw(primary_dependency, ignored) || !read_raw(dependency_count_raw, dependency_count)) {
+                LOG_DEBUG("Ignoring the rest of a malformed CAM job batch");
+                return;
+            }
+            for (std::uint32_t d = 0; d < dependency_count; ++d) {
+                if (!read_packed_int(payload, position, ignored)) {
+                    LOG_DEBUG("Ignoring the rest of a malformed CAM job batch");
+                    return;
+                }
+            }
+            auto const dependencies = payload.subspan(dependencies_position, position - dependencies_position);
+
+            start_time += static_cast<std::uint64_t>(start_time_delta);
+
+            // the fields of the equivalent CAM job message
+            std::array<char, buffer_utils::MAXSIZE_PACK64> packed_start_time {};
+            int packed_start_time_size = 0;
+            buffer_utils::packInt64(packed_start_time.data(),
+                                    packed_start_time_size,
+                                    static_cast<std::int64_t>(start_time));
+
+            fields.clear();
+            append(fields, view_uid.data(), view_uid.size());
+            append(fields, job_uid.data(), job_uid.size());
+            append(fields, track.data(), track.size());
+            append(fields, packed_start_time.data(), packed_start_time_size);
+            append(fields, duration_and_color.data(), duration_and_color.size());
+            append(fields, dependencies.data(), dependencies.size());
+
+            auto const it = (name_id != 0 ? strings.find(name_id) : strings.end());
+            if ((name_id != 0) && (it == strings.end())) {
+                LOG_DEBUG("Expanding undefined interned string %u as an empty string", name_id);
+            }
+            auto const string_size = (it != strings.end() ? it->second.size() : 0);
+
+            std::array<char, message_header_size> expanded_header {};
+            expanded_header[0] = static_cast<char>(header_cam_job);
+            buffer_utils::writeLEInt(expanded_header.data() + 1, fields.size() + string_size);
+
+            append(output, expanded_header.data(), expanded_header.size());
+            append(output, fields.data(), fields.size());
+            if (it != strings.end()) {
+                append(output, it->second.data(), it->second.size());
+            }
+        }
+    }
+}
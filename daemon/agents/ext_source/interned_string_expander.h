@@ -0,0 +1,73 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#pragma once
+
+#include "lib/Span.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace agents {
+    /**
+     * Expands the interned strings in the data from one annotation connection, so that what is forwarded to Streamline
+     * is the same as if the strings had been sent in full.
+     *
+     * The annotate library sends each string once in an intern message, and then may send any message that ends with a
+     * string as an interned message holding the original header, the string's id and the fields before the string.
+     * Both are consumed here, as are the batches of CAM jobs, which are expanded into one CAM job message per job
+     * (with any interned name expanded as for the interned messages). Everything else is forwarded unchanged.
+     * Connections that do not start with the expected handshake are forwarded unchanged in their entirety.
+     */
+    class interned_string_expander_t {
+    public:
+        /** Defines a string: packed int id, then the string */
+        static constexpr std::uint8_t header_intern_string = 0x80;
+        /** A message whose trailing string is interned: the original header, packed int id, then the other fields */
+        static constexpr std::uint8_t header_interned = 0x81;
+        /**
+         * A batch of CAM jobs: packed int view uid and number of jobs, then for each job; the packed int job uid,
+         * name id (or zero) and track, the packed long difference from the previous job's start time (or from zero),
+         * the packed long duration, the color, and the packed int primary dependency, number of dependencies and
+         * dependencies
+         */
+        static constexpr std::uint8_t header_cam_job_batch = 0x82;
+        /** The header of the CAM job messages that a batch is expanded into */
+        static constexpr std::uint8_t header_cam_job = 0x0c;
+
+        /** Interned messages larger than this cannot have come from the library */
+        static constexpr std::uint32_t max_interned_message_size = 1 << 16;
+
+        /**
+         * Rewrite the next part of the connection's data
+         *
+         * @param bytes The data, as received from the connection
+         * @return The data to forward, which may be the same buffer
+         */
+        [[nodiscard]] std::vector<char> expand(std::vector<char> && bytes);
+
+    private:
+        enum class state_t {
+            handshake,
+            message_header,
+            forwarded_message,
+            interned_message,
+            passthrough,
+        };
+
+        std::unordered_map<std::uint32_t, std::string> strings {};
+        /** The partial handshake, message header or interned message received so far */
+        std::vector<char> pending {};
+        state_t state {state_t::handshake};
+        /** The number of bytes left of the current message */
+        std::uint32_t remaining {0};
+
+        /** Handle a complete intern, interned or CAM job batch message (in pending) */
+        void on_interned_message(std::vector<char> & output);
+
+        /** Expand the payload of a CAM job batch message */
+        void on_cam_job_batch(lib::Span<char const> payload, std::vector<char> & output);
+    };
+}
@@ -1,8 +1,9 @@
-/* Copyright (C) 2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2021-2022 by Arm Limited. All rights reserved. */
 
 #pragma once
 
 #include "Logging.h"
+#include "agents/ext_source/interned_string_expander.h"
 #include "ipc/messages.h"
 #include "ipc/raw_ipc_channel_sink.h"
 
@@ -33,11 +34,11 @@ namespace agents {
             sink->async_send_message(ipc::msg_annotation_new_conn_t {id}, std::forward<CompletionToken>(token));
         }
 
-        /** Send the 'received bytes' IPC message */
+        /** Send the 'received bytes' IPC message, with any interned strings expanded */
         template<typename CompletionToken>
         void async_send_received_bytes(std::vector<char> && bytes, CompletionToken && token)
         {
-            sink->async_send_message(ipc::msg_annotation_recv_bytes_t {id, std::move(bytes)},
+            sink->async_send_message(ipc::msg_annotation_recv_bytes_t {id, expander.expand(std::move(bytes))},
                                      std::forward<CompletionToken>(token));
         }
 
@@ -55,5 +56,6 @@ namespace agents {
     private:
         std::shared_ptr<ipc::raw_ipc_channel_sink_t> sink;
         ipc::annotation_uid_t id;
+        interned_string_expander_t expander {};
     };
 }
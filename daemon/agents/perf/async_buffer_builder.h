@@ -3,6 +3,7 @@
 #pragma once
 
 #include "BufferUtils.h"
+#include "FixedFrameLayout.h"
 #include "IRawFrameBuilder.h"
 #include "Logging.h"
 #include "lib/Assert.h"
@@ -13,6 +14,7 @@
 #include <cinttypes>
 #include <iterator>
 #include <limits>
+#include <utility>
 
 #include <boost/system/error_code.hpp>
 
@@ -153,6 +155,22 @@ namespace agents::perf {
         */
         std::size_t packMonotonicDelta(monotonic_delta_t x) { return packInt64(std::uint64_t(x)); }
 
+        /**
+        * Packs a fixed sequence of fields, as described by some buffer_utils::FixedFrameLayout, checking for
+        * (and if needed making) space for the whole sequence once rather than for each field
+        *
+        * Must be required bytes available
+        */
+        template<typename Layout, typename... Values>
+        std::size_t packFixed(Values &&... values)
+        {
+            ensure_space_at(write_index, Layout::MAX_SIZE);
+            int length = 0;
+            Layout::pack(buffer.data() + write_index, length, std::forward<Values>(values)...);
+            write_index += length;
+            return length;
+        }
+
         /** Write a 32-bit unsigned int in little endian form */
         void writeLeUint32(std::uint32_t n)
         {
@@ -2,14 +2,28 @@
 
 #pragma once
 
+#include "Configuration.h"
+#include "agents/perf/block_io_latency.h"
+#include "agents/perf/call_stack_deduplicator.h"
+#include "agents/perf/cpu_drain_threads.h"
 #include "agents/perf/events/perf_ringbuffer_mmap.hpp"
 #include "agents/perf/events/types.hpp"
+#include "agents/perf/flight_recorder.h"
+#include "agents/perf/function_latency.h"
+#include "agents/perf/gpu_timeline.h"
+#include "agents/perf/lock_contention.h"
 #include "agents/perf/record_types.h"
+#include "agents/perf/sample_aggregator.h"
+#include "agents/perf/sample_pid_filter.h"
+#include "agents/perf/sample_pid_tracker.h"
+#include "agents/perf/thread_energy.h"
+#include "agents/perf/user_stack_unwinder.h"
 #include "async/continuations/async_initiate.h"
 #include "async/continuations/continuation.h"
 #include "async/continuations/operations.h"
 #include "async/continuations/stored_continuation.h"
 #include "async/continuations/use_continuation.h"
+#include "ipc/frame_buffer_pool.h"
 #include "ipc/raw_ipc_channel_sink.h"
 #include "lib/Assert.h"
 #include "lib/EnumUtils.h"
@@ -19,9 +33,11 @@
 #include <chrono>
 #include <cstddef>
 #include <deque>
+#include <map>
 #include <memory>
 #include <set>
 #include <utility>
+#include <vector>
 
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/io_context_strand.hpp>
@@ -50,16 +66,59 @@ namespace agents::perf {
 
         static constexpr auto live_poll_interval = std::chrono::milliseconds(100);
         static constexpr auto local_poll_interval = std::chrono::seconds(1);
+        /** The poll interval is never reduced below this value */
+        static constexpr auto min_poll_interval = std::chrono::milliseconds(10);
+        /** The poll interval may be increased up to this many times the default when the buffers are idle */
+        static constexpr std::size_t max_poll_interval_factor = 4;
+        /** The poll interval is halved when any data buffer is found to be at least this full (out of fill_scale) */
+        static constexpr std::size_t high_fill_threshold = perf_buffer_consumer_t::fill_scale / 4;
+        /** The poll interval is doubled when every data buffer is found to be at most this full (out of fill_scale) */
+        static constexpr std::size_t low_fill_threshold = perf_buffer_consumer_t::fill_scale / 100;
 
         async_perf_ringbuffer_monitor_t(boost::asio::io_context & context,
                                         std::shared_ptr<ipc::raw_ipc_channel_sink_t> const & ipc_sink,
+                                        std::shared_ptr<ipc::frame_buffer_pool_t> const & frame_buffer_pool,
                                         std::shared_ptr<perf_activator_t> const & perf_activator,
                                         bool live_mode,
-                                        std::size_t one_shot_mode_limit)
+                                        std::chrono::milliseconds low_wakeup_period,
+                                        std::chrono::milliseconds drain_timeout,
+                                        std::size_t one_shot_mode_limit,
+                                        std::map<core_no_t, SpeRecordFilter> spe_record_filters,
+                                        std::shared_ptr<flight_recorder_t> flight_recorder,
+                                        std::shared_ptr<call_stack_dedup_state_t> call_stack_dedup_state,
+                                        std::shared_ptr<sample_pid_tracker_t> sample_pid_tracker,
+                                        std::shared_ptr<sample_aggregation_state_t> sample_aggregation_state,
+                                        std::shared_ptr<function_latency_state_t> function_latency_state,
+                                        std::shared_ptr<gpu_timeline_state_t> gpu_timeline_state,
+                                        std::shared_ptr<block_io_state_t> block_io_state,
+                                        std::shared_ptr<lock_contention_state_t> lock_contention_state,
+                                        std::shared_ptr<thread_energy_state_t> thread_energy_state,
+                                        std::shared_ptr<sample_pid_filter_t> sample_pid_filter,
+                                        std::shared_ptr<user_stack_unwind_state_t> user_stack_unwind_state,
+                                        std::shared_ptr<cpu_drain_threads_t> cpu_drain_threads)
             : timer(context),
               strand(context),
               perf_activator(perf_activator),
-              perf_buffer_consumer(std::make_shared<perf_buffer_consumer_t>(context, ipc_sink, one_shot_mode_limit)),
+              perf_buffer_consumer(std::make_shared<perf_buffer_consumer_t>(context,
+                                                                            ipc_sink,
+                                                                            frame_buffer_pool,
+                                                                            one_shot_mode_limit,
+                                                                            std::move(spe_record_filters),
+                                                                            std::move(flight_recorder),
+                                                                            std::move(call_stack_dedup_state),
+                                                                            std::move(sample_pid_tracker),
+                                                                            std::move(sample_aggregation_state),
+                                                                            std::move(function_latency_state),
+                                                                            std::move(gpu_timeline_state),
+                                                                            std::move(block_io_state),
+                                                                            std::move(lock_contention_state),
+                                                                            std::move(thread_energy_state),
+                                                                            std::move(sample_pid_filter),
+                                                                            std::move(user_stack_unwind_state),
+                                                                            std::move(cpu_drain_threads))),
+              poll_interval(low_wakeup_period.count() != 0 ? low_wakeup_period : default_poll_interval(live_mode)),
+              low_wakeup_period(low_wakeup_period),
+              drain_timeout(drain_timeout),
               live_mode(live_mode)
         {
         }
@@ -72,6 +131,7 @@ namespace agents::perf {
               strand(context),
               perf_activator(perf_activator),
               perf_buffer_consumer(std::move(perf_buffer_consumer)),
+              poll_interval(default_poll_interval(live_mode)),
               live_mode(live_mode)
         {
         }
@@ -94,6 +154,9 @@ namespace agents::perf {
             spawn("stop perf event monitor",
                   start_on(strand) //
                       | then([st = this->shared_from_this()]() -> polymorphic_continuation_t<> {
+                            if (!st->terminate_requested) {
+                                st->terminate_time = std::chrono::steady_clock::now();
+                            }
                             st->terminate_requested = true;
                             st->timer.cancel();
 
@@ -127,6 +190,36 @@ namespace agents::perf {
             return perf_buffer_consumer->async_wait_one_shot_full(std::forward<CompletionToken>(token));
         }
 
+        /**
+         * Poll all the ringbuffers and then send the data held by the flight recorder
+         */
+        template<typename CompletionToken>
+        auto async_flush_flight_recorder(CompletionToken && token)
+        {
+            using namespace async::continuations;
+
+            return async_initiate<continuation_of_t<boost::system::error_code>>(
+                [st = this->shared_from_this()]() {
+                    return st->perf_buffer_consumer->async_poll_all(use_continuation) //
+                         | then([st](boost::system::error_code const & ec) {
+                               if (ec) {
+                                   LOG_DEBUG("Poll before flight recorder flush failed with %s", ec.message().c_str());
+                               }
+                               return st->perf_buffer_consumer->async_flush_flight_recorder(use_continuation);
+                           });
+                },
+                std::forward<CompletionToken>(token));
+        }
+
+        /**
+         * Record the ids of newly opened events, so that the call stacks in their samples can be deduplicated (or the
+         * samples aggregated, and their pids tracked)
+         */
+        void add_event_ids(std::vector<std::pair<perf_event_id_t, gator_key_t>> const & mappings)
+        {
+            perf_buffer_consumer->add_event_ids(mappings);
+        }
+
         /**
          * Add a new ring buffer to the set of monitored ringbuffers
          */
@@ -298,6 +391,14 @@ namespace agents::perf {
         std::set<std::shared_ptr<stream_descriptor_t>> primary_streams {};
         std::set<std::shared_ptr<stream_descriptor_t>> supplimentary_streams {};
         async::continuations::stored_continuation_t<> termination_handler {};
+        std::chrono::milliseconds poll_interval;
+        /** In the low-wakeup mode the fixed poll interval (the watermark wakes the agent if a buffer fills), or 0 */
+        std::chrono::milliseconds low_wakeup_period {0};
+        /** The longest time spent draining the ring buffers once they are removed (since the terminate request, when
+         * terminating), or 0 for no limit */
+        std::chrono::milliseconds drain_timeout {0};
+        /** When terminate was first requested */
+        std::chrono::steady_clock::time_point terminate_time {};
         bool live_mode;
         bool busy_polling {false};
         bool poll_all {false};
@@ -305,7 +406,7 @@ namespace agents::perf {
         bool terminate_requested {false};
         bool any_added {false};
 
-        /** Asynchronously remove one item from the remove list */
+        /** Asynchronously remove all the items from the remove list, in parallel */
         async::continuations::polymorphic_continuation_t<boost::system::error_code> async_remove()
         {
             using namespace async::continuations;
@@ -318,29 +419,33 @@ namespace agents::perf {
                       removed_cpus.size());
 
             if (!removed_cpus.empty()) {
-                auto const cpu_no = removed_cpus.front();
-                removed_cpus.pop_front();
+                std::set<int> unique_cpu_nos {removed_cpus.begin(), removed_cpus.end()};
+                std::vector<int> cpu_nos {unique_cpu_nos.begin(), unique_cpu_nos.end()};
+                removed_cpus.clear();
 
-                LOG_TRACE("Requesting to remove ringbuffer for cpu %d", cpu_no);
+                LOG_TRACE("Requesting to remove ringbuffers for %zu cpus", cpu_nos.size());
 
                 return start_on(strand.context()) //
-                     | perf_buffer_consumer->async_remove_ringbuffer(cpu_no,
-                                                                     use_continuation) //
-                     | post_on(strand)                                                 //
-                     | then([cpu_no, st = this->shared_from_this()](auto ec) {
-                           LOG_TRACE("Removed cpu #%d, got ec=%s", cpu_no, ec.message().c_str());
-
-                           // remove the counter
-                           st->cpu_fd_counter.erase(cpu_no);
-
-                           // notify the handler
-                           auto handler = std::move(st->cpu_shutdown_monitors[cpu_no]);
-                           if (handler) {
-                               LOG_TRACE("notifying that mmap %d is removed", cpu_no);
-                               resume_continuation(st->strand.context(), std::move(handler));
+                     | perf_buffer_consumer->async_remove_ringbuffers(cpu_nos,
+                                                                      get_drain_deadline(),
+                                                                      use_continuation) //
+                     | post_on(strand)                                                  //
+                     | then([cpu_nos, st = this->shared_from_this()](auto ec) {
+                           LOG_TRACE("Removed %zu cpus, got ec=%s", cpu_nos.size(), ec.message().c_str());
+
+                           for (auto cpu_no : cpu_nos) {
+                               // remove the counter
+                               st->cpu_fd_counter.erase(cpu_no);
+
+                               // notify the handler
+                               auto handler = std::move(st->cpu_shutdown_monitors[cpu_no]);
+                               if (handler) {
+                                   LOG_TRACE("notifying that mmap %d is removed", cpu_no);
+                                   resume_continuation(st->strand.context(), std::move(handler));
+                               }
                            }
 
-                           // remove the next one; any previous error is logged and swallowed
+                           // remove any more that were queued meanwhile; any previous error is logged and swallowed
                            return st->async_remove();
                        });
             }
@@ -350,6 +455,9 @@ namespace agents::perf {
                 && removed_cpus.empty()) {
                 // yup
                 terminate_complete = true;
+                LOG_INFO("Perf ring buffers drained %.3f ms after the capture was stopped",
+                         std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - terminate_time)
+                             .count());
                 // notify the handler
                 if (termination_handler) {
                     LOG_TRACE("notifying terminated");
@@ -365,6 +473,15 @@ namespace agents::perf {
             return start_with(boost::system::error_code {});
         }
 
+        /** @return The time after which the ring buffers removed now are no longer drained */
+        [[nodiscard]] std::chrono::steady_clock::time_point get_drain_deadline() const
+        {
+            if (drain_timeout.count() == 0) {
+                return std::chrono::steady_clock::time_point::max();
+            }
+            return (terminate_requested ? terminate_time : std::chrono::steady_clock::now()) + drain_timeout;
+        }
+
         /** Asynchronously poll either all cpus OR each item in the pending list */
         async::continuations::polymorphic_continuation_t<boost::system::error_code> async_poll(bool poll_all)
         {
@@ -397,10 +514,13 @@ namespace agents::perf {
                            std::map<int, std::set<std::shared_ptr<stream_descriptor_t>>> cpu_aux_streams {
                                std::move(*st->cpu_aux_streams_read)};
 
-                           // re-enable any AUX items that might have got disabled due to mmap full
+                           // re-enable any AUX items that might have got disabled due to mmap full (unless all
+                           // the events were disabled to terminate)
                            for (auto & entry : cpu_aux_streams) {
                                for (auto & fd : entry.second) {
-                                   st->perf_activator->re_enable(fd->native_handle());
+                                   if (!st->terminate_requested) {
+                                       st->perf_activator->re_enable(fd->native_handle());
+                                   }
                                }
                            }
 
@@ -410,35 +530,40 @@ namespace agents::perf {
             }
 
             if (!pending_cpus_read->empty()) {
-                // poll one item from the pending list
-                auto cpu_no = pending_cpus_read->front();
-                pending_cpus_read->pop_front();
+                // poll all the items from the pending list; they are drained in parallel
+                std::set<int> unique_cpu_nos {pending_cpus_read->begin(), pending_cpus_read->end()};
+                std::vector<int> cpu_nos {unique_cpu_nos.begin(), unique_cpu_nos.end()};
+                pending_cpus_read->clear();
 
-                LOG_TRACE("Requesting to poll ringbuffer for cpu %d", cpu_no);
+                LOG_TRACE("Requesting to poll ringbuffers for %zu cpus", cpu_nos.size());
 
-                return start_on(strand.context())                                 //
-                     | perf_buffer_consumer->async_poll(cpu_no, use_continuation) //
-                     | then([cpu_no](auto ec) {
-                           LOG_TRACE("Polled cpu #%d, got ec=%s", cpu_no, ec.message().c_str());
+                return start_on(strand.context())                                       //
+                     | perf_buffer_consumer->async_poll_cpus(cpu_nos, use_continuation) //
+                     | then([](auto ec) {
+                           LOG_TRACE("Polled cpus, got ec=%s", ec.message().c_str());
                            return ec;
                        })              //
                      | map_error()     //
                      | post_on(strand) //
-                     | then([st = this->shared_from_this(), cpu_no]() {
+                     | then([st = this->shared_from_this(), cpu_nos]() {
                            // re-enable any AUX items that might have got disabled due to mmap full
-                           auto it = st->cpu_aux_streams_read->find(cpu_no);
-                           if (it != st->cpu_aux_streams_read->end()) {
-                               // re-enable
-                               for (auto & fd : it->second) {
-                                   st->perf_activator->re_enable(fd->native_handle());
+                           for (auto cpu_no : cpu_nos) {
+                               auto it = st->cpu_aux_streams_read->find(cpu_no);
+                               if (it != st->cpu_aux_streams_read->end()) {
+                                   // re-enable, unless terminating
+                                   for (auto & fd : it->second) {
+                                       if (!st->terminate_requested) {
+                                           st->perf_activator->re_enable(fd->native_handle());
+                                       }
+                                   }
+
+                                   // remove it
+                                   st->cpu_aux_streams_read->erase(it);
                                }
-
-                               // remove it
-                               st->cpu_aux_streams_read->erase(it);
                            }
 
-                           // try again for the next item
-                           return st->async_poll(false);
+                           // now remove any queued for remove
+                           return st->async_remove();
                        });
             }
 
@@ -642,6 +767,45 @@ namespace agents::perf {
                   });
         }
 
+        /** The poll interval used at the start of the capture */
+        static constexpr std::chrono::milliseconds default_poll_interval(bool live_mode)
+        {
+            return (live_mode ? std::chrono::milliseconds(live_poll_interval)
+                              : std::chrono::milliseconds(local_poll_interval));
+        }
+
+        /**
+         * Adjust the poll interval according to how full the data buffers were found to be since the last timer tick.
+         * The interval is shortened when the buffers are filling quickly (so as to avoid overflow and lost records), and
+         * lengthened when they are mostly idle (so as to avoid needless wakeups), except that in the low-wakeup mode it
+         * stays at the period. The fill level is also reported to the shell for the capture pipeline statistics.
+         */
+        void update_poll_interval()
+        {
+            auto const peak_fill = perf_buffer_consumer->take_peak_data_fill();
+            auto const default_interval = default_poll_interval(live_mode);
+            auto const max_interval = default_interval * max_poll_interval_factor;
+            auto const prev_interval = poll_interval;
+            auto const adaptive = (low_wakeup_period.count() == 0);
+
+            if (adaptive && (peak_fill >= high_fill_threshold)) {
+                poll_interval = std::max<std::chrono::milliseconds>(poll_interval / 2, min_poll_interval);
+            }
+            else if (adaptive && (peak_fill <= low_fill_threshold)) {
+                poll_interval = std::min<std::chrono::milliseconds>(poll_interval * 2, max_interval);
+            }
+
+            if (poll_interval != prev_interval) {
+                LOG_DEBUG("Perf buffer poll interval changed from %lldms to %lldms (peak fill %zu/%zu)",
+                          static_cast<long long>(prev_interval.count()),
+                          static_cast<long long>(poll_interval.count()),
+                          peak_fill,
+                          perf_buffer_consumer_t::fill_scale);
+            }
+
+            perf_buffer_consumer->send_stats(peak_fill);
+        }
+
         /** Start the timer */
         void do_start_timer()
         {
@@ -658,7 +822,7 @@ namespace agents::perf {
                                  });
                       }, //
                       [st]() {
-                          st->timer.expires_from_now(st->live_mode ? live_poll_interval : local_poll_interval);
+                          st->timer.expires_from_now(st->poll_interval);
 
                           return st->timer.async_wait(use_continuation) //
                                | post_on(st->strand)                    //
@@ -675,6 +839,7 @@ namespace agents::perf {
 
                                      // if no error, then timeout occured so trigger a poll_all
                                      if (!ec) {
+                                         st->update_poll_interval();
                                          st->poll_all = true;
                                      }
 
@@ -0,0 +1,350 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "agents/perf/block_io_latency.h"
+
+#include "agents/perf/perf_data_records.h"
+#include "k/perf_event.h"
+#include "lib/EnumUtils.h"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+namespace agents::perf {
+    namespace {
+        constexpr std::size_t word_size = sizeof(std::uint64_t);
+
+        constexpr gator_key_t no_key {0};
+
+        [[nodiscard]] std::uint64_t read_word(char const * data, std::size_t index)
+        {
+            std::uint64_t result;
+            std::memcpy(&result, data + (index * word_size), word_size);
+            return result;
+        }
+
+        void append_bytes(std::vector<char> & output, void const * data, std::size_t size)
+        {
+            auto const * bytes = static_cast<char const *>(data);
+            output.insert(output.end(), bytes, bytes + size);
+        }
+
+        /** @return The histogram bucket of a latency */
+        [[nodiscard]] std::size_t latency_bucket(std::uint64_t latency)
+        {
+            std::size_t bucket = 0;
+            for (auto limit = block_io_config_t::first_latency_limit_ns;
+                 (latency >= limit) && (bucket < (block_io_config_t::number_of_latency_buckets - 1));
+                 limit *= 4) {
+                bucket += 1;
+            }
+            return bucket;
+        }
+    }
+
+    bool block_io_config_t::is_enabled() const
+    {
+        auto const any_latency_key =
+            std::any_of(latency_keys.begin(), latency_keys.end(), [](gator_key_t key) { return key != no_key; });
+
+        return (issue_key != no_key) && (complete_key != no_key)
+            && (any_latency_key || (average_latency_key != no_key) || (queue_depth_key != no_key));
+    }
+
+    block_io_state_t::block_io_state_t(event_configuration_t const & configuration,
+                                       block_io_config_t config,
+                                       std::chrono::nanoseconds window)
+        : config(std::move(config)),
+          window_ns(std::max<std::uint64_t>(1, window.count())),
+          latency_counts(block_io_config_t::number_of_latency_buckets, 0)
+    {
+        for_each_event_definition(configuration, [this](event_definition_t const & event) {
+            auto const sample_fields = (event.attr.sample_type & required_tracepoint_sample_fields);
+            if ((event.attr.type != PERF_TYPE_TRACEPOINT) || (sample_fields != required_tracepoint_sample_fields)
+                || (event.key == no_key)) {
+                return;
+            }
+
+            if (event.key == this->config.issue_key) {
+                key_formats.emplace(
+                    event.key,
+                    event_format_t {event_kind_t::issue, event.attr.sample_type, event.attr.read_format});
+            }
+            else if (event.key == this->config.complete_key) {
+                key_formats.emplace(
+                    event.key,
+                    event_format_t {event_kind_t::complete, event.attr.sample_type, event.attr.read_format});
+            }
+        });
+    }
+
+    void block_io_state_t::set_monotonic_start(std::uint64_t monotonic_start)
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        this->monotonic_start = monotonic_start;
+    }
+
+    void block_io_state_t::add_ids(std::vector<std::pair<perf_event_id_t, gator_key_t>> const & mappings)
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        bool added = false;
+        for (auto const & [id, key] : mappings) {
+            auto it = key_formats.find(key);
+            if (it != key_formats.end()) {
+                id_formats[static_cast<std::uint64_t>(id)] = it->second;
+                added = true;
+            }
+        }
+
+        if (added) {
+            version.fetch_add(1, std::memory_order_acq_rel);
+        }
+    }
+
+    void block_io_state_t::copy_formats(std::unordered_map<std::uint64_t, event_format_t> & formats) const
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        formats = id_formats;
+    }
+
+    block_io_state_t::stats_t block_io_state_t::get_stats() const
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        return stats;
+    }
+
+    void block_io_state_t::open_window(std::uint64_t time, std::vector<window_t> & windows)
+    {
+        if (window_open && (time >= window_start) && ((time - window_start) >= window_ns)) {
+            auto const end = window_start + window_ns;
+            close_window(end, windows);
+
+            // the host holds each counter at its last value, so follow the window with an empty one if the devices
+            // were idle after it
+            if ((time - end) >= window_ns) {
+                window_start = end;
+                close_window(end + window_ns, windows);
+            }
+        }
+
+        if (!window_open) {
+            window_open = true;
+            window_start = time;
+            last_time = time;
+        }
+
+        last_time = std::max(last_time, time);
+    }
+
+    void block_io_state_t::on_issue(std::uint64_t time,
+                                    std::uint32_t dev,
+                                    std::uint64_t sector,
+                                    std::vector<window_t> & windows)
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        open_window(time, windows);
+
+        request_id_t const id {dev, sector};
+
+        // the completion was read first
+        auto it = completed.find(id);
+        if (it != completed.end()) {
+            if (it->second >= time) {
+                add_latency(it->second - time);
+            }
+            completed.erase(it);
+            return;
+        }
+
+        // a requeued request is issued again, so its latency is from the last issue
+        auto [issue, inserted] = issued.emplace(id, time);
+        if (!inserted) {
+            issue->second = std::max(issue->second, time);
+        }
+        else if (issued.size() > max_unpaired) {
+            issued.erase(issue);
+            stats.unpaired += 1;
+        }
+    }
+
+    void block_io_state_t::on_complete(std::uint64_t time,
+                                       std::uint32_t dev,
+                                       std::uint64_t sector,
+                                       std::vector<window_t> & windows)
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        open_window(time, windows);
+
+        request_id_t const id {dev, sector};
+
+        auto it = issued.find(id);
+        if ((it != issued.end()) && (it->second <= time)) {
+            add_latency(time - it->second);
+            issued.erase(it);
+            return;
+        }
+
+        // the issue is yet to be read (from another cpu's mmap) or was lost
+        if ((completed.size() < max_unpaired) && completed.emplace(id, time).second) {
+            return;
+        }
+
+        stats.unpaired += 1;
+    }
+
+    void block_io_state_t::add_latency(std::uint64_t latency)
+    {
+        latency_counts[latency_bucket(latency)] += 1;
+        latency_sum += latency;
+        stats.requests += 1;
+    }
+
+    void block_io_state_t::flush(std::vector<window_t> & windows)
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        windows.clear();
+
+        if (window_open) {
+            close_window(last_time, windows);
+        }
+    }
+
+    void block_io_state_t::drop_unpaired(pending_map_t & pending, std::uint64_t oldest)
+    {
+        for (auto it = pending.begin(); it != pending.end();) {
+            if (it->second < oldest) {
+                it = pending.erase(it);
+                stats.unpaired += 1;
+            }
+            else {
+                ++it;
+            }
+        }
+    }
+
+    void block_io_state_t::close_window(std::uint64_t end, std::vector<window_t> & windows)
+    {
+        // drop the samples that are too old to still be paired
+        auto const oldest = (last_time > max_unpaired_age_ns ? last_time - max_unpaired_age_ns : 0);
+        drop_unpaired(issued, oldest);
+        drop_unpaired(completed, oldest);
+
+        window_open = false;
+
+        auto const requests = std::accumulate(latency_counts.begin(), latency_counts.end(), std::uint64_t(0));
+        auto const duration = std::max<std::uint64_t>(1, end - window_start);
+
+        auto & window = windows.emplace_back();
+        window.timestamp = monotonic_delta_t(end > monotonic_start ? end - monotonic_start : 0);
+        window.counters.reserve(block_io_config_t::number_of_latency_buckets + 2);
+
+        auto const add_counter = [&window](gator_key_t key, std::uint64_t value) {
+            if (key != no_key) {
+                window.counters.push_back(
+                    apc::perf_counter_t {counter_core, lib::toEnumValue(key), static_cast<std::int64_t>(value)});
+            }
+        };
+
+        for (std::size_t bucket = 0; bucket < config.latency_keys.size(); ++bucket) {
+            add_counter(config.latency_keys[bucket], latency_counts[bucket]);
+        }
+        add_counter(config.average_latency_key, (requests != 0 ? latency_sum / requests : 0));
+        add_counter(config.queue_depth_key, (latency_sum * queue_depth_scale) / duration);
+
+        std::fill(latency_counts.begin(), latency_counts.end(), 0);
+        latency_sum = 0;
+
+        stats.windows += 1;
+    }
+
+    block_io_state_t::event_format_t const * block_io_filter_t::find_format(std::uint64_t id)
+    {
+        auto it = formats.find(id);
+        if (it != formats.end()) {
+            return &it->second;
+        }
+
+        // refresh the local copy only when some new id was added since it was taken
+        auto const version = state->get_version();
+        if (version == formats_version) {
+            return nullptr;
+        }
+
+        formats_version = version;
+        state->copy_formats(formats);
+
+        it = formats.find(id);
+        return (it != formats.end() ? &it->second : nullptr);
+    }
+
+    void block_io_filter_t::filter(lib::Span<char const> first_span,
+                                   lib::Span<char const> second_span,
+                                   std::vector<char> & records,
+                                   std::vector<block_io_state_t::window_t> & windows)
+    {
+        records.clear();
+        records.reserve(first_span.size() + second_span.size());
+        windows.clear();
+
+        for_each_perf_data_record(first_span, second_span, split_record, records, [&](lib::Span<char const> record) {
+            filter_record(record, records, windows);
+        });
+    }
+
+    void block_io_filter_t::filter_record(lib::Span<char const> record,
+                                          std::vector<char> & records,
+                                          std::vector<block_io_state_t::window_t> & windows)
+    {
+        perf_event_header header;
+        std::memcpy(&header, record.data(), sizeof(header));
+
+        std::size_t const words = record.size() / word_size;
+
+        if ((header.type != PERF_RECORD_SAMPLE) || (header.size != record.size()) || (words <= 1)) {
+            return append_bytes(records, record.data(), record.size());
+        }
+
+        auto const * format = find_format(read_word(record.data(), 1));
+        if (format == nullptr) {
+            return append_bytes(records, record.data(), record.size());
+        }
+
+        std::uint64_t time = 0;
+        lib::Span<char const> raw_data {};
+        if (!find_tracepoint_sample_time_and_raw_data(record,
+                                                      format->sample_type,
+                                                      format->read_format,
+                                                      time,
+                                                      raw_data)) {
+            return append_bytes(records, record.data(), record.size());
+        }
+
+        auto const & config = state->get_config();
+        auto const is_issue = (format->kind == block_io_state_t::event_kind_t::issue);
+
+        auto const dev = read_tracepoint_field(raw_data, (is_issue ? config.issue_dev : config.complete_dev));
+        auto const sector = read_tracepoint_field(raw_data, (is_issue ? config.issue_sector : config.complete_sector));
+        if (!dev || !sector) {
+            return append_bytes(records, record.data(), record.size());
+        }
+
+        if (is_issue) {
+            state->on_issue(time, std::uint32_t(*dev), *sector, windows);
+        }
+        else {
+            state->on_complete(time, std::uint32_t(*dev), *sector, windows);
+        }
+    }
+
+    void block_io_filter_t::flush(std::vector<block_io_state_t::window_t> & windows)
+    {
+        state->flush(windows);
+    }
+}
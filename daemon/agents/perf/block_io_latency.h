@@ -0,0 +1,246 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#pragma once
+
+#include "Time.h"
+#include "agents/perf/events/event_configuration.hpp"
+#include "agents/perf/events/types.hpp"
+#include "agents/perf/tracepoint_sample.h"
+#include "apc/perf_counter.h"
+#include "lib/Span.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace agents::perf {
+    /** The block tracepoints that the perf agent pairs into block I/O latencies, and the counters derived from them */
+    struct block_io_config_t {
+        /** The number of latency histogram buckets; the last one is of every latency beyond the others */
+        static constexpr std::size_t number_of_latency_buckets = 8;
+        /** The upper limit of the first bucket, which is a quarter of the limit of the next, and so on */
+        static constexpr std::uint64_t first_latency_limit_ns = 64'000;
+
+        /** The key of the block_rq_issue event, or zero if it is not enabled */
+        gator_key_t issue_key {0};
+        tracepoint_field_t issue_dev {0, 0};
+        tracepoint_field_t issue_sector {0, 0};
+
+        /** The key of the block_rq_complete event, or zero if it is not enabled */
+        gator_key_t complete_key {0};
+        tracepoint_field_t complete_dev {0, 0};
+        tracepoint_field_t complete_sector {0, 0};
+
+        /** The key of the counter of each latency bucket, or zero where it is not enabled */
+        std::vector<gator_key_t> latency_keys {};
+        /** The key of the mean latency counter, or zero if it is not enabled */
+        gator_key_t average_latency_key {0};
+        /** The key of the mean queue depth counter, or zero if it is not enabled */
+        gator_key_t queue_depth_key {0};
+
+        /** @return True if both tracepoints are converted into at least one counter */
+        [[nodiscard]] bool is_enabled() const;
+    };
+
+    /**
+     * Pairs the samples of the block_rq_issue and block_rq_complete tracepoints into the latency of each block I/O
+     * request, so that the latency distribution and the queue depth of the block devices can be shown as counters
+     * without the host decoding every block request.
+     *
+     * A request is identified by its device and first sector, which are the same in both of its samples. The samples
+     * of any cpu may be of any device, and the cpus' mmaps are not read in time order, so the state is shared by all
+     * the cpus (and is serialized by a mutex), and a completion that is read before its issue waits to be paired with
+     * it.
+     *
+     * Each window of sample time is converted into a set of counter values, all of which are attributed to one core
+     * (as the block devices are not per cpu):
+     *
+     *  - the number of requests completed in the window whose latency is within each histogram bucket
+     *  - the mean latency of those requests, in nanoseconds
+     *  - the mean number of requests in flight over the window, which (by Little's law) is the sum of those
+     *    latencies divided by the length of the window, in hundredths
+     */
+    class block_io_state_t {
+    public:
+        /** The most requests that may be waiting to be paired, beyond which their samples are dropped as unpaired */
+        static constexpr std::size_t max_unpaired = 65536;
+        /** Unpaired samples older than this (relative to the end of the window) are dropped as the window closes */
+        static constexpr std::uint64_t max_unpaired_age_ns = 10'000'000'000ULL;
+        /** The core that the counter values are attributed to */
+        static constexpr int counter_core = 0;
+        /** The mean queue depth is sent in units of this, to keep two decimal places */
+        static constexpr std::uint64_t queue_depth_scale = 100;
+
+        /** The tracepoint an event is of */
+        enum class event_kind_t {
+            issue,
+            complete,
+        };
+
+        /** Where a tracepoint event's fields are in its samples */
+        struct event_format_t {
+            event_kind_t kind;
+            std::uint64_t sample_type;
+            std::uint64_t read_format;
+        };
+
+        /** The counter values of a closed window */
+        struct window_t {
+            /** The end of the window, relative to the start of the capture */
+            monotonic_delta_t timestamp;
+            std::vector<apc::perf_counter_t> counters;
+        };
+
+        struct stats_t {
+            std::uint64_t requests;
+            std::uint64_t unpaired;
+            std::uint64_t windows;
+        };
+
+        /**
+         * @param configuration The capture's events; only those tracepoint events whose samples start with their id
+         * (PERF_SAMPLE_IDENTIFIER), and that have the time and raw data (PERF_SAMPLE_TIME and PERF_SAMPLE_RAW), are
+         * converted
+         * @param config The tracepoints to convert
+         * @param window The length of each window, in sample time
+         */
+        block_io_state_t(event_configuration_t const & configuration,
+                         block_io_config_t config,
+                         std::chrono::nanoseconds window);
+
+        /** @return The tracepoints that are converted */
+        [[nodiscard]] block_io_config_t const & get_config() const { return config; }
+
+        /**
+         * Set the time that the capture started, which the window times are relative to; the sample times are in
+         * CLOCK_MONOTONIC_RAW, as is this
+         */
+        void set_monotonic_start(std::uint64_t monotonic_start);
+
+        /** Record the ids of newly opened events */
+        void add_ids(std::vector<std::pair<perf_event_id_t, gator_key_t>> const & mappings);
+
+        /** @return A value that changes whenever ids are added */
+        [[nodiscard]] std::uint64_t get_version() const { return version.load(std::memory_order_acquire); }
+
+        /** Copy the format of each tracepoint event's id into `formats` */
+        void copy_formats(std::unordered_map<std::uint64_t, event_format_t> & formats) const;
+
+        /**
+         * Record one block_rq_issue sample
+         *
+         * @param time The time of the sample
+         * @param windows Receives the window, if it closed
+         */
+        void on_issue(std::uint64_t time, std::uint32_t dev, std::uint64_t sector, std::vector<window_t> & windows);
+
+        /**
+         * Pair one block_rq_complete sample with its issue
+         *
+         * @param time The time of the sample
+         * @param windows Receives the window, if it closed
+         */
+        void on_complete(std::uint64_t time, std::uint32_t dev, std::uint64_t sector, std::vector<window_t> & windows);
+
+        /** Close the current window, if it has anything in it */
+        void flush(std::vector<window_t> & windows);
+
+        [[nodiscard]] stats_t get_stats() const;
+
+    private:
+        struct request_id_t {
+            std::uint32_t dev;
+            std::uint64_t sector;
+
+            [[nodiscard]] bool operator==(request_id_t const & that) const
+            {
+                return (dev == that.dev) && (sector == that.sector);
+            }
+        };
+
+        struct request_id_hash_t {
+            [[nodiscard]] std::size_t operator()(request_id_t const & id) const
+            {
+                return std::hash<std::uint64_t> {}(id.sector ^ (std::uint64_t(id.dev) << 40));
+            }
+        };
+
+        using pending_map_t = std::unordered_map<request_id_t, std::uint64_t, request_id_hash_t>;
+
+        block_io_config_t config;
+        std::uint64_t window_ns;
+        std::map<gator_key_t, event_format_t> key_formats {};
+        mutable std::mutex mutex {};
+        std::unordered_map<std::uint64_t, event_format_t> id_formats {};
+        std::atomic_uint64_t version {0};
+        std::uint64_t monotonic_start = 0;
+        /** The time of each issued request that has not completed yet */
+        pending_map_t issued {};
+        /** The time of each completed request whose issue has not been read yet */
+        pending_map_t completed {};
+        std::vector<std::uint64_t> latency_counts;
+        std::uint64_t latency_sum = 0;
+        /** The time of the first sample of the window, which it is closed relative to */
+        std::uint64_t window_start = 0;
+        std::uint64_t last_time = 0;
+        bool window_open = false;
+        stats_t stats {0, 0, 0};
+
+        /** Start a window if there is not one open, having closed the current one if the sample is after it */
+        void open_window(std::uint64_t time, std::vector<window_t> & windows);
+
+        /** Add the latency of one request to the window */
+        void add_latency(std::uint64_t latency);
+
+        /** Append the current window to `windows`; it ends at `end` */
+        void close_window(std::uint64_t end, std::vector<window_t> & windows);
+
+        /** Drop the unpaired samples that are older than `oldest` */
+        void drop_unpaired(pending_map_t & pending, std::uint64_t oldest);
+    };
+
+    /**
+     * Removes the samples of the block tracepoints from the perf data records of one cpu, passing them to the shared
+     * block_io_state_t. All the other records are forwarded unchanged. One filter is used per cpu.
+     */
+    class block_io_filter_t {
+    public:
+        explicit block_io_filter_t(std::shared_ptr<block_io_state_t> state) : state(std::move(state)) {}
+
+        /**
+         * Filter a chunk of whole perf data records
+         *
+         * @param first_span The first part of the records
+         * @param second_span The remainder of the records, which follows on from the first (when the mmap wrapped)
+         * @param records Receives the records that are not block tracepoint samples
+         * @param windows Receives each window that closed
+         */
+        void filter(lib::Span<char const> first_span,
+                    lib::Span<char const> second_span,
+                    std::vector<char> & records,
+                    std::vector<block_io_state_t::window_t> & windows);
+
+        /** Close the current (shared) window, if it has anything in it */
+        void flush(std::vector<block_io_state_t::window_t> & windows);
+
+    private:
+        std::shared_ptr<block_io_state_t> state;
+        std::uint64_t formats_version = 0;
+        std::unordered_map<std::uint64_t, block_io_state_t::event_format_t> formats {};
+        /** Reused for a record that is split across the two spans */
+        std::vector<char> split_record {};
+
+        [[nodiscard]] block_io_state_t::event_format_t const * find_format(std::uint64_t id);
+
+        void filter_record(lib::Span<char const> record,
+                           std::vector<char> & records,
+                           std::vector<block_io_state_t::window_t> & windows);
+    };
+}
@@ -0,0 +1,226 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "agents/perf/call_stack_deduplicator.h"
+
+#include "agents/perf/perf_data_records.h"
+#include "k/perf_event.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace agents::perf {
+    namespace {
+        constexpr std::size_t word_size = sizeof(std::uint64_t);
+
+        /** The sample fields that precede the read values, each of which is one word */
+        constexpr std::uint64_t fixed_sample_fields[] = {
+            PERF_SAMPLE_IDENTIFIER,
+            PERF_SAMPLE_IP,
+            PERF_SAMPLE_TID,
+            PERF_SAMPLE_TIME,
+            PERF_SAMPLE_ADDR,
+            PERF_SAMPLE_ID,
+            PERF_SAMPLE_STREAM_ID,
+            PERF_SAMPLE_CPU,
+            PERF_SAMPLE_PERIOD,
+        };
+
+        [[nodiscard]] std::uint64_t read_word(char const * data, std::size_t index)
+        {
+            std::uint64_t result;
+            std::memcpy(&result, data + (index * word_size), word_size);
+            return result;
+        }
+
+        void append_bytes(std::vector<char> & output, void const * data, std::size_t size)
+        {
+            auto const * bytes = static_cast<char const *>(data);
+            output.insert(output.end(), bytes, bytes + size);
+        }
+    }
+
+    call_stack_dedup_state_t::call_stack_dedup_state_t(event_configuration_t const & configuration)
+    {
+        for_each_event_definition(configuration, [this](event_definition_t const & event) {
+            auto const sample_type = event.attr.sample_type;
+
+            // the id must be at a fixed position so that the format can be found
+            if (((sample_type & PERF_SAMPLE_CALLCHAIN) == 0) || ((sample_type & PERF_SAMPLE_IDENTIFIER) == 0)) {
+                return;
+            }
+
+            std::size_t fixed_words = 1; // the header
+            for (auto field : fixed_sample_fields) {
+                if ((sample_type & field) != 0) {
+                    fixed_words += 1;
+                }
+            }
+
+            key_formats.emplace(event.key,
+                                sample_format_t {fixed_words,
+                                                 event.attr.read_format,
+                                                 ((sample_type & PERF_SAMPLE_READ) != 0)});
+        });
+    }
+
+    void call_stack_dedup_state_t::add_ids(std::vector<std::pair<perf_event_id_t, gator_key_t>> const & mappings)
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        bool added = false;
+        for (auto const & [id, key] : mappings) {
+            auto it = key_formats.find(key);
+            if (it != key_formats.end()) {
+                id_formats[static_cast<std::uint64_t>(id)] = it->second;
+                added = true;
+            }
+        }
+
+        if (added) {
+            version.fetch_add(1, std::memory_order_acq_rel);
+        }
+    }
+
+    void call_stack_dedup_state_t::copy_formats(std::unordered_map<std::uint64_t, sample_format_t> & formats) const
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        formats = id_formats;
+    }
+
+    std::size_t call_stack_deduplicator_t::stack_hash_t::operator()(std::vector<std::uint64_t> const & ips) const
+    {
+        // FNV-1a over the words, which is sufficient as the table compares the whole stack on a match
+        std::uint64_t hash = 0xcbf29ce484222325ULL;
+        for (auto ip : ips) {
+            hash = (hash ^ ip) * 0x100000001b3ULL;
+        }
+        return std::size_t(hash ^ (hash >> 32));
+    }
+
+    call_stack_dedup_state_t::sample_format_t const * call_stack_deduplicator_t::find_format(std::uint64_t id)
+    {
+        auto it = formats.find(id);
+        if (it != formats.end()) {
+            return &it->second;
+        }
+
+        // refresh the local copy only when some new id was added since it was taken
+        auto const version = state->get_version();
+        if (version == formats_version) {
+            return nullptr;
+        }
+
+        formats_version = version;
+        state->copy_formats(formats);
+
+        it = formats.find(id);
+        return (it != formats.end() ? &it->second : nullptr);
+    }
+
+    void call_stack_deduplicator_t::deduplicate(lib::Span<char const> first_span,
+                                                lib::Span<char const> second_span,
+                                                std::vector<char> & records,
+                                                std::vector<std::uint64_t> & new_stacks)
+    {
+        records.clear();
+        records.reserve(first_span.size() + second_span.size());
+        new_stacks.clear();
+
+        for_each_perf_data_record(first_span, second_span, split_record, records, [&](lib::Span<char const> record) {
+            deduplicate_record(record, records, new_stacks);
+        });
+    }
+
+    void call_stack_deduplicator_t::deduplicate_record(lib::Span<char const> record,
+                                                       std::vector<char> & records,
+                                                       std::vector<std::uint64_t> & new_stacks)
+    {
+        perf_event_header header;
+        std::memcpy(&header, record.data(), sizeof(header));
+
+        std::size_t const words = record.size() / word_size;
+
+        if ((header.type != PERF_RECORD_SAMPLE) || (header.size != record.size()) || (words < 2)) {
+            return append_bytes(records, record.data(), record.size());
+        }
+
+        auto const * format = find_format(read_word(record.data(), 1));
+        if (format == nullptr) {
+            return append_bytes(records, record.data(), record.size());
+        }
+
+        // find the callchain
+        std::size_t callchain_index = format->fixed_words;
+        if (format->has_read) {
+            if (callchain_index >= words) {
+                return append_bytes(records, record.data(), record.size());
+            }
+
+            std::size_t const times = (((format->read_format & PERF_FORMAT_TOTAL_TIME_ENABLED) != 0) ? 1 : 0)
+                                    + (((format->read_format & PERF_FORMAT_TOTAL_TIME_RUNNING) != 0) ? 1 : 0);
+            std::size_t const value_words = (((format->read_format & PERF_FORMAT_ID) != 0) ? 2 : 1);
+
+            if ((format->read_format & PERF_FORMAT_GROUP) != 0) {
+                auto const nr_values = read_word(record.data(), callchain_index);
+                if (nr_values > words) {
+                    return append_bytes(records, record.data(), record.size());
+                }
+                callchain_index += 1 + times + (nr_values * value_words);
+            }
+            else {
+                callchain_index += times + value_words;
+            }
+        }
+
+        if (callchain_index >= words) {
+            return append_bytes(records, record.data(), record.size());
+        }
+
+        auto const nr = read_word(record.data(), callchain_index);
+        if ((nr == 0) || (nr >= (words - callchain_index))) {
+            return append_bytes(records, record.data(), record.size());
+        }
+
+        auto const ips_index = callchain_index + 1;
+        auto const end_index = ips_index + nr;
+
+        current_stack.resize(nr);
+        std::memcpy(current_stack.data(), record.data() + (ips_index * word_size), nr * word_size);
+
+        stats.samples += 1;
+
+        std::uint64_t stack_id;
+        auto it = stacks.find(current_stack);
+        if (it != stacks.end()) {
+            stack_id = it->second;
+            stats.deduplicated_samples += 1;
+        }
+        else {
+            if (stacks.size() >= max_stacks) {
+                stacks.clear();
+            }
+
+            stack_id = state->next_stack_id();
+            stacks.emplace(current_stack, stack_id);
+            stats.stacks += 1;
+
+            new_stacks.push_back(stack_id);
+            new_stacks.push_back(nr);
+            new_stacks.insert(new_stacks.end(), current_stack.begin(), current_stack.end());
+        }
+
+        // the header, with the new size
+        header.size -= (nr * word_size);
+        append_bytes(records, &header, sizeof(header));
+        // up to the callchain
+        append_bytes(records, record.data() + sizeof(header), (callchain_index * word_size) - sizeof(header));
+        // the reference in place of the callchain
+        std::uint64_t const reference = (stack_id | stack_id_flag);
+        append_bytes(records, &reference, sizeof(reference));
+        // everything after the callchain
+        append_bytes(records, record.data() + (end_index * word_size), record.size() - (end_index * word_size));
+
+        stats.saved_bytes += (nr * word_size);
+    }
+}
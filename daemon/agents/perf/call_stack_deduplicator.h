@@ -0,0 +1,130 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#pragma once
+
+#include "agents/perf/events/event_configuration.hpp"
+#include "agents/perf/events/types.hpp"
+#include "lib/Span.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace agents::perf {
+    /**
+     * The state shared by the call stack deduplicators of all the cpus in a capture; the location of the callchain
+     * within the samples of each event id, and the source of unique stack ids.
+     *
+     * The ids are added from the capture's strand as the events are opened, whereas the deduplicators run on each cpu's
+     * strand, so access to them is serialized by a mutex.
+     */
+    class call_stack_dedup_state_t {
+    public:
+        /** Where the callchain is found in a sample */
+        struct sample_format_t {
+            /** The offset, in words from the start of the record, of the read values (or of the callchain if none) */
+            std::size_t fixed_words;
+            std::uint64_t read_format;
+            bool has_read;
+        };
+
+        /**
+         * @param configuration The capture's events; only those whose samples have a callchain and start with their
+         * id (PERF_SAMPLE_IDENTIFIER) are deduplicated
+         */
+        explicit call_stack_dedup_state_t(event_configuration_t const & configuration);
+
+        /** Record the ids of newly opened events */
+        void add_ids(std::vector<std::pair<perf_event_id_t, gator_key_t>> const & mappings);
+
+        /** @return A value that changes whenever ids are added */
+        [[nodiscard]] std::uint64_t get_version() const { return version.load(std::memory_order_acquire); }
+
+        /** Copy the format of each id having a callchain into `formats` */
+        void copy_formats(std::unordered_map<std::uint64_t, sample_format_t> & formats) const;
+
+        /** @return A new stack id, unique within the capture */
+        [[nodiscard]] std::uint64_t next_stack_id() { return ++last_stack_id; }
+
+    private:
+        std::map<gator_key_t, sample_format_t> key_formats {};
+        mutable std::mutex mutex {};
+        std::unordered_map<std::uint64_t, sample_format_t> id_formats {};
+        std::atomic_uint64_t version {0};
+        std::atomic_uint64_t last_stack_id {0};
+    };
+
+    /**
+     * Replaces the callchain of each perf sample record with a reference to a call stack that has been sent to the
+     * host in a FrameType::PERF_CALL_STACKS frame, sending each distinct call stack once rather than with every sample.
+     *
+     * In a rewritten sample, the callchain's `nr` and `ips[nr]` words are replaced by a single word that is the stack
+     * id with `stack_id_flag` set (which a real `nr` never has), and the header's size is reduced accordingly. Records
+     * that are not samples, or whose event is unknown, are forwarded unchanged.
+     *
+     * One deduplicator is used per cpu, so the stacks are always defined in the same ordered stream of data as the
+     * samples that refer to them. The ids are unique within the capture so that the deduplicator can be reset, or
+     * replaced when the cpu's mmap is, without an id being reused.
+     */
+    class call_stack_deduplicator_t {
+    public:
+        static constexpr std::uint64_t stack_id_flag = std::uint64_t(1) << 63;
+
+        /** Once this many stacks are held the table is cleared, bounding the memory used per cpu */
+        static constexpr std::size_t max_stacks = 4096;
+
+        struct stats_t {
+            std::uint64_t samples;
+            std::uint64_t deduplicated_samples;
+            std::uint64_t stacks;
+            std::uint64_t saved_bytes;
+        };
+
+        explicit call_stack_deduplicator_t(std::shared_ptr<call_stack_dedup_state_t> state) : state(std::move(state))
+        {
+        }
+
+        /**
+         * Deduplicate the call stacks in a chunk of whole perf data records
+         *
+         * @param first_span The first part of the records
+         * @param second_span The remainder of the records, which follows on from the first (when the mmap wrapped)
+         * @param records Receives the (possibly rewritten) records
+         * @param new_stacks Receives the stacks that must be sent before the records; for each, the id, `nr` and then
+         * `ips[nr]` words
+         */
+        void deduplicate(lib::Span<char const> first_span,
+                         lib::Span<char const> second_span,
+                         std::vector<char> & records,
+                         std::vector<std::uint64_t> & new_stacks);
+
+        [[nodiscard]] stats_t const & get_stats() const { return stats; }
+
+    private:
+        struct stack_hash_t {
+            std::size_t operator()(std::vector<std::uint64_t> const & ips) const;
+        };
+
+        std::shared_ptr<call_stack_dedup_state_t> state;
+        std::uint64_t formats_version = 0;
+        std::unordered_map<std::uint64_t, call_stack_dedup_state_t::sample_format_t> formats {};
+        std::unordered_map<std::vector<std::uint64_t>, std::uint64_t, stack_hash_t> stacks {};
+        /** Reused for the lookup of each sample's stack */
+        std::vector<std::uint64_t> current_stack {};
+        /** Reused for a record that is split across the two spans */
+        std::vector<char> split_record {};
+        stats_t stats {0, 0, 0, 0};
+
+        [[nodiscard]] call_stack_dedup_state_t::sample_format_t const * find_format(std::uint64_t id);
+
+        void deduplicate_record(lib::Span<char const> record,
+                                std::vector<char> & records,
+                                std::vector<std::uint64_t> & new_stacks);
+    };
+}
@@ -10,7 +10,9 @@
 #include "linux/perf/PerfEventGroup.h"
 #include "linux/perf/PerfEventGroupIdentifier.h"
 
+#include <map>
 #include <memory>
+#include <set>
 #include <stdexcept>
 
 namespace agents::perf {
@@ -26,6 +28,20 @@ namespace agents::perf {
             msg.set_one_shot(session_data.mOneShot);
             msg.set_exclude_kernel_events(session_data.mExcludeKernelEvents);
             msg.set_stop_on_exit(session_data.mStopOnExit);
+            msg.set_flight_recorder_seconds(session_data.mFlightRecorderSeconds);
+            msg.set_flight_recorder_size(session_data.mFlightRecorderSize);
+            msg.set_dedup_call_stacks(session_data.mDedupCallStacks);
+            msg.set_pmu_multiplex_quantum_ms(session_data.mPmuMultiplexQuantumMs);
+            msg.set_cgroup(session_data.mCgroup);
+            msg.set_lazy_process_maps(session_data.mLazyProcessMaps);
+            msg.set_aggregate_samples_ms(session_data.mAggregateSamplesMs);
+            msg.set_filter_pid_samples(session_data.mFilterPidSamples);
+            msg.set_etm_filters(session_data.mEtmFilters);
+            msg.set_etm_strobe_window_us(session_data.mEtmStrobeWindowUs);
+            msg.set_etm_strobe_period_us(session_data.mEtmStrobePeriodUs);
+            msg.set_low_wakeup_seconds(session_data.mLowWakeupSeconds);
+            msg.set_stop_drain_timeout_ms(session_data.mStopDrainTimeoutMs);
+            msg.set_cpu_local_drain(session_data.mCpuLocalDrain);
         }
 
         void add_perf_config(ipc::proto::shell::perf::capture_configuration_t::perf_config_t & msg,
@@ -204,13 +220,18 @@ namespace agents::perf {
             msg.set_sample_stack_user(attr.sample_stack_user);
             msg.set_clockid(attr.clockid);
             msg.set_aux_watermark(attr.aux_watermark);
+            msg.set_sample_max_stack(attr.sample_max_stack);
         }
 
         void add_perf_event(ipc::proto::shell::perf::capture_configuration_t::perf_event_definition_t & msg,
                             int key,
-                            perf_event_attr const & attr)
+                            perf_event_attr const & attr,
+                            int multiplex_group = 0,
+                            std::string const & filter = {})
         {
             msg.set_key(key);
+            msg.set_multiplex_group(multiplex_group);
+            msg.set_filter(filter);
             auto * msg_attr = msg.mutable_attr();
             add_perf_event_attr(*msg_attr, attr);
         }
@@ -260,7 +281,7 @@ namespace agents::perf {
             auto * msg_events = list.mutable_events();
             for (auto const & event : state.events) {
                 auto * msg_entry = msg_events->Add();
-                add_perf_event(*msg_entry, event.key, event.attr);
+                add_perf_event(*msg_entry, event.key, event.attr, identifier.getMultiplexGroup(), event.filter);
             }
         }
 
@@ -282,6 +303,7 @@ namespace agents::perf {
             msg.set_page_size(ringbuffer_config.page_size);
             msg.set_data_size(ringbuffer_config.data_buffer_size);
             msg.set_aux_size(ringbuffer_config.aux_buffer_size);
+            msg.set_ipc_queue_size(ringbuffer_config.ipc_queue_size);
         }
 
         void add_perf_pmu_type_to_name(google::protobuf::Map<::google::protobuf::uint32, std::string> & msg,
@@ -292,6 +314,32 @@ namespace agents::perf {
             }
         }
 
+        void add_spe_record_filters(
+            google::protobuf::Map<std::string, ipc::proto::shell::perf::capture_configuration_t::spe_record_filter_t> &
+                msg,
+            std::map<std::string, SpeRecordFilter> const & spe_record_filters)
+        {
+            for (auto const & entry : spe_record_filters) {
+                auto const & filter = entry.second;
+                auto & filter_msg = msg[entry.first];
+                filter_msg.set_min_latency(filter.min_latency);
+                filter_msg.set_event_mask(filter.event_mask);
+                filter_msg.set_load(filter.ops.count(SpeOps::LOAD) > 0);
+                filter_msg.set_store(filter.ops.count(SpeOps::STORE) > 0);
+                filter_msg.set_branch(filter.ops.count(SpeOps::BRANCH) > 0);
+                for (auto const & range : filter.pc_ranges) {
+                    auto * range_msg = filter_msg.add_pc_ranges();
+                    range_msg->set_start(range.start);
+                    range_msg->set_end(range.end);
+                }
+                filter_msg.set_decimation(filter.decimation);
+                filter_msg.set_heatmap_granularity(filter.heatmap.granularity);
+                filter_msg.set_heatmap_top_entries(filter.heatmap.top_entries);
+                filter_msg.set_heatmap_window_ms(filter.heatmap.window_ms);
+                filter_msg.set_heatmap_raw_interval(filter.heatmap.raw_interval);
+            }
+        }
+
         /// ------------------------------ deserializing
 
         void extract_session_data(ipc::proto::shell::perf::capture_configuration_t::session_data_t const & msg,
@@ -303,6 +351,20 @@ namespace agents::perf {
             session_data.one_shot = msg.one_shot();
             session_data.exclude_kernel_events = msg.exclude_kernel_events();
             session_data.stop_on_exit = msg.stop_on_exit();
+            session_data.flight_recorder_seconds = msg.flight_recorder_seconds();
+            session_data.flight_recorder_size = msg.flight_recorder_size();
+            session_data.dedup_call_stacks = msg.dedup_call_stacks();
+            session_data.pmu_multiplex_quantum_ms = msg.pmu_multiplex_quantum_ms();
+            session_data.cgroup = msg.cgroup();
+            session_data.lazy_process_maps = msg.lazy_process_maps();
+            session_data.aggregate_samples_ms = msg.aggregate_samples_ms();
+            session_data.filter_pid_samples = msg.filter_pid_samples();
+            session_data.etm_filters = msg.etm_filters();
+            session_data.etm_strobe_window_us = msg.etm_strobe_window_us();
+            session_data.etm_strobe_period_us = msg.etm_strobe_period_us();
+            session_data.low_wakeup_seconds = msg.low_wakeup_seconds();
+            session_data.stop_drain_timeout_ms = msg.stop_drain_timeout_ms();
+            session_data.cpu_local_drain = msg.cpu_local_drain();
         }
 
         void extract_perf_config(ipc::proto::shell::perf::capture_configuration_t::perf_config_t const & msg,
@@ -437,6 +499,7 @@ namespace agents::perf {
             result.sample_stack_user = msg.sample_stack_user();
             result.clockid = msg.clockid();
             result.aux_watermark = msg.aux_watermark();
+            result.sample_max_stack = msg.sample_max_stack();
             set_one_of(result.freq, result.sample_freq, result.sample_period, msg.sample_period_or_freq());
             set_one_of(result.watermark,
                        result.wakeup_watermark,
@@ -453,6 +516,26 @@ namespace agents::perf {
                 events.emplace_back(event_definition_t {
                     extract_perf_event_attr(entry.attr()),
                     gator_key_t(entry.key()),
+                    entry.multiplex_group(),
+                    entry.filter(),
+                });
+            }
+        }
+
+        void extract_live_event_definition_list(
+            ipc::proto::shell::perf::capture_reconfiguration_t::added_event_list_t const & msg,
+            std::vector<live_event_definition_t> & events)
+        {
+            for (auto const & entry : msg.events()) {
+                auto const & event = entry.event();
+                events.emplace_back(live_event_definition_t {
+                    event_definition_t {
+                        extract_perf_event_attr(event.attr()),
+                        gator_key_t(event.key()),
+                        event.multiplex_group(),
+                        event.filter(),
+                    },
+                    gator_key_t(entry.leader_key()),
                 });
             }
         }
@@ -470,6 +553,7 @@ namespace agents::perf {
             event_configuration.header_event = event_definition_t {
                 extract_perf_event_attr(hm.attr()),
                 gator_key_t(hm.key()),
+                0,
             };
 
             extract_event_definition_list(msg.global_events(), event_configuration.global_events);
@@ -501,6 +585,7 @@ namespace agents::perf {
             ringbuffer_config.page_size = msg.page_size();
             ringbuffer_config.data_buffer_size = msg.data_size();
             ringbuffer_config.aux_buffer_size = msg.aux_size();
+            ringbuffer_config.ipc_queue_size = msg.ipc_queue_size();
         }
 
         std::vector<std::string> extract_args(google::protobuf::RepeatedPtrField<std::string> && args)
@@ -545,6 +630,103 @@ namespace agents::perf {
             }
         }
 
+        void extract_function_probes(
+            google::protobuf::RepeatedPtrField<
+                ipc::proto::shell::perf::capture_configuration_t::function_probe_t> const & msg,
+            std::vector<function_latency_state_t::probe_t> & function_probes)
+        {
+            for (auto const & probe : msg) {
+                function_probes.push_back({gator_key_t(probe.entry_key()), gator_key_t(probe.return_key())});
+            }
+        }
+
+        void extract_cpu_metrics(
+            google::protobuf::RepeatedPtrField<ipc::proto::shell::perf::capture_configuration_t::cpu_metric_t> & msg,
+            std::size_t number_of_clusters,
+            std::vector<perf_capture_configuration_t::cpu_metric_t> & cpu_metrics)
+        {
+            for (auto & metric : msg) {
+                runtime_assert(metric.cluster_index() < number_of_clusters, "Invalid cluster index received");
+                cpu_metrics.push_back({metric.cluster_index(),
+                                       metric.pmu_type(),
+                                       metric.key(),
+                                       std::move(*metric.mutable_expression()),
+                                       metric.multiplier()});
+            }
+        }
+
+        [[nodiscard]] tracepoint_field_t extract_tracepoint_field(
+            ipc::proto::shell::perf::capture_configuration_t::tracepoint_field_t const & msg)
+        {
+            return {msg.offset(), msg.size()};
+        }
+
+        void extract_gpu_timeline(ipc::proto::shell::perf::capture_configuration_t::gpu_timeline_t const & msg,
+                                  gpu_timeline_config_t & gpu_timeline)
+        {
+            for (auto key : msg.job_slot_keys()) {
+                gpu_timeline.job_slot_keys.push_back(gator_key_t(key));
+            }
+            runtime_assert(gpu_timeline.job_slot_keys.size() <= gpu_timeline_config_t::number_of_job_slots,
+                           "Invalid number of job slots received");
+            gpu_timeline.job_slot_event_id = extract_tracepoint_field(msg.job_slot_event_id());
+            gpu_timeline.job_slot_tgid = extract_tracepoint_field(msg.job_slot_tgid());
+            gpu_timeline.job_slot_pid = extract_tracepoint_field(msg.job_slot_pid());
+            gpu_timeline.work_period_key = gator_key_t(msg.work_period_key());
+            gpu_timeline.work_period_gpu_id = extract_tracepoint_field(msg.work_period_gpu_id());
+            gpu_timeline.work_period_uid = extract_tracepoint_field(msg.work_period_uid());
+            gpu_timeline.work_period_start_time = extract_tracepoint_field(msg.work_period_start_time());
+            gpu_timeline.work_period_end_time = extract_tracepoint_field(msg.work_period_end_time());
+            gpu_timeline.work_period_active_duration = extract_tracepoint_field(msg.work_period_active_duration());
+        }
+
+        void extract_block_io(ipc::proto::shell::perf::capture_configuration_t::block_io_t const & msg,
+                              block_io_config_t & block_io)
+        {
+            block_io.issue_key = gator_key_t(msg.issue_key());
+            block_io.issue_dev = extract_tracepoint_field(msg.issue_dev());
+            block_io.issue_sector = extract_tracepoint_field(msg.issue_sector());
+            block_io.complete_key = gator_key_t(msg.complete_key());
+            block_io.complete_dev = extract_tracepoint_field(msg.complete_dev());
+            block_io.complete_sector = extract_tracepoint_field(msg.complete_sector());
+            for (auto key : msg.latency_keys()) {
+                block_io.latency_keys.push_back(gator_key_t(key));
+            }
+            runtime_assert(block_io.latency_keys.size() <= block_io_config_t::number_of_latency_buckets,
+                           "Invalid number of block I/O latency buckets received");
+            block_io.average_latency_key = gator_key_t(msg.average_latency_key());
+            block_io.queue_depth_key = gator_key_t(msg.queue_depth_key());
+        }
+
+        void extract_lock_contention(ipc::proto::shell::perf::capture_configuration_t::lock_contention_t const & msg,
+                                     lock_contention_config_t & lock_contention)
+        {
+            lock_contention.begin_key = gator_key_t(msg.begin_key());
+            lock_contention.begin_address = extract_tracepoint_field(msg.begin_address());
+            lock_contention.begin_op = extract_tracepoint_field(msg.begin_op());
+            lock_contention.end_key = gator_key_t(msg.end_key());
+        }
+
+        void extract_thread_energy(ipc::proto::shell::perf::capture_configuration_t::thread_energy_t const & msg,
+                                   thread_energy_config_t & thread_energy)
+        {
+            thread_energy.sched_switch_key = gator_key_t(msg.sched_switch_key());
+            thread_energy.switch_prev_tid = extract_tracepoint_field(msg.switch_prev_tid());
+            thread_energy.switch_next_tid = extract_tracepoint_field(msg.switch_next_tid());
+            thread_energy.cpu_frequency_key = gator_key_t(msg.cpu_frequency_key());
+            thread_energy.frequency_state = extract_tracepoint_field(msg.frequency_state());
+            thread_energy.frequency_cpu_id = extract_tracepoint_field(msg.frequency_cpu_id());
+            for (auto const & msg_domain : msg.domains()) {
+                auto & domain = thread_energy.domains.emplace_back();
+                for (auto cpu : msg_domain.cpus()) {
+                    domain.cpus.push_back(int(cpu));
+                }
+                for (auto const & state : msg_domain.states()) {
+                    domain.states.push_back({state.frequency_khz(), state.power()});
+                }
+            }
+        }
+
         void extract_perf_pmu_type_to_name(google::protobuf::Map<::google::protobuf::uint32, std::string> & msg,
                                            std::map<std::uint32_t, std::string> & perf_pmu_type_to_name)
         {
@@ -552,6 +734,80 @@ namespace agents::perf {
                 perf_pmu_type_to_name.emplace(entry.first, std::move(entry.second));
             }
         }
+        void extract_spe_record_filters(
+            google::protobuf::Map<std::string,
+                                  ipc::proto::shell::perf::capture_configuration_t::spe_record_filter_t> const & msg,
+            std::vector<perf_capture_configuration_t::gator_cpu_t> const & clusters,
+            std::vector<std::int32_t> const & per_core_cluster_index,
+            std::map<core_no_t, SpeRecordFilter> & per_core_spe_record_filter)
+        {
+            for (std::size_t core = 0; core < per_core_cluster_index.size(); ++core) {
+                auto const cluster_index = per_core_cluster_index[core];
+                if ((cluster_index < 0) || (std::size_t(cluster_index) >= clusters.size())) {
+                    continue;
+                }
+
+                auto const * spe_name = clusters[cluster_index].getSpeName();
+                auto const it = (spe_name != nullptr ? msg.find(spe_name) : msg.end());
+                if (it == msg.end()) {
+                    continue;
+                }
+
+                auto const & filter_msg = it->second;
+                SpeRecordFilter filter {};
+                filter.min_latency = filter_msg.min_latency();
+                filter.event_mask = filter_msg.event_mask();
+                if (filter_msg.load()) {
+                    filter.ops.insert(SpeOps::LOAD);
+                }
+                if (filter_msg.store()) {
+                    filter.ops.insert(SpeOps::STORE);
+                }
+                if (filter_msg.branch()) {
+                    filter.ops.insert(SpeOps::BRANCH);
+                }
+                for (auto const & range_msg : filter_msg.pc_ranges()) {
+                    filter.pc_ranges.push_back({range_msg.start(), range_msg.end()});
+                }
+                filter.decimation = filter_msg.decimation();
+                filter.heatmap.granularity = filter_msg.heatmap_granularity();
+                filter.heatmap.top_entries = filter_msg.heatmap_top_entries();
+                filter.heatmap.window_ms = filter_msg.heatmap_window_ms();
+                filter.heatmap.raw_interval = filter_msg.heatmap_raw_interval();
+                per_core_spe_record_filter.emplace(core_no_t(core), std::move(filter));
+            }
+        }
+
+        void extract_simulated_perf(perf_capture_configuration_t & configuration)
+        {
+            configuration.simulated_perf = simulated_perf_config_t::from_environment();
+            if (!configuration.simulated_perf) {
+                return;
+            }
+
+            // each simulated core is a copy of one of the real ones
+            auto const num_real_cores = configuration.per_core_cpuids.size();
+            auto const num_cores = configuration.simulated_perf->num_cpu_cores;
+            if (num_real_cores == 0) {
+                configuration.simulated_perf.reset();
+                return;
+            }
+
+            configuration.per_core_cpuids.resize(num_cores);
+            configuration.per_core_cluster_index.resize(num_cores);
+            for (std::size_t core = num_real_cores; core < num_cores; ++core) {
+                auto const real_core = core % num_real_cores;
+                configuration.per_core_cpuids[core] = configuration.per_core_cpuids[real_core];
+                configuration.per_core_cluster_index[core] = configuration.per_core_cluster_index[real_core];
+            }
+            configuration.num_cpu_cores = num_cores;
+
+            // there is no aux data to simulate, and the metrics read the real cores
+            configuration.per_core_spe_type.clear();
+            configuration.per_core_spe_record_filter.clear();
+            configuration.event_configuration.spe_events.clear();
+            configuration.cpu_metrics.clear();
+        }
     }
 
     /* create the message */
@@ -566,6 +822,7 @@ namespace agents::perf {
         perf_groups_configurer_state_t const & perf_groups,
         agents::perf::buffer_config_t const & ringbuffer_config,
         std::map<std::uint32_t, std::string> const & perf_pmu_type_to_name,
+        std::map<std::string, SpeRecordFilter> const & spe_record_filters,
         bool enable_on_exec,
         bool stop_pids)
     {
@@ -580,6 +837,7 @@ namespace agents::perf {
         add_event_configuration(*result.suffix.mutable_event_configuration(), perf_groups, cpu_info, uncore_pmus);
         add_ringbuffer_config(*result.suffix.mutable_ringbuffer_config(), ringbuffer_config);
         add_perf_pmu_type_to_name(*result.suffix.mutable_perf_pmu_type_to_name(), perf_pmu_type_to_name);
+        add_spe_record_filters(*result.suffix.mutable_spe_record_filters(), spe_record_filters);
 
         result.suffix.set_num_cpu_cores(cpu_info.getNumberOfCores());
         result.suffix.set_enable_on_exec(enable_on_exec);
@@ -622,6 +880,113 @@ namespace agents::perf {
         }
     }
 
+    void add_function_probes(ipc::msg_capture_configuration_t & msg,
+                             lib::Span<function_latency_state_t::probe_t const> probes)
+    {
+        for (auto const & probe : probes) {
+            auto * msg_probe = msg.suffix.add_function_probes();
+            msg_probe->set_entry_key(static_cast<std::int32_t>(probe.entry_key));
+            msg_probe->set_return_key(static_cast<std::int32_t>(probe.return_key));
+        }
+    }
+
+    void add_cpu_metrics(ipc::msg_capture_configuration_t & msg,
+                         lib::Span<perf_capture_configuration_t::cpu_metric_t const> metrics)
+    {
+        for (auto const & metric : metrics) {
+            auto * msg_metric = msg.suffix.add_cpu_metrics();
+            msg_metric->set_cluster_index(metric.cluster_index);
+            msg_metric->set_pmu_type(metric.pmu_type);
+            msg_metric->set_key(metric.key);
+            msg_metric->set_expression(metric.expression);
+            msg_metric->set_multiplier(metric.multiplier);
+        }
+    }
+
+    void add_gpu_timeline(ipc::msg_capture_configuration_t & msg, gpu_timeline_config_t const & gpu_timeline)
+    {
+        auto const set_field = [](auto * msg_field, tracepoint_field_t const & field) {
+            msg_field->set_offset(field.offset);
+            msg_field->set_size(field.size);
+        };
+
+        auto * msg_gpu_timeline = msg.suffix.mutable_gpu_timeline();
+        for (auto key : gpu_timeline.job_slot_keys) {
+            msg_gpu_timeline->add_job_slot_keys(static_cast<std::int32_t>(key));
+        }
+        set_field(msg_gpu_timeline->mutable_job_slot_event_id(), gpu_timeline.job_slot_event_id);
+        set_field(msg_gpu_timeline->mutable_job_slot_tgid(), gpu_timeline.job_slot_tgid);
+        set_field(msg_gpu_timeline->mutable_job_slot_pid(), gpu_timeline.job_slot_pid);
+        msg_gpu_timeline->set_work_period_key(static_cast<std::int32_t>(gpu_timeline.work_period_key));
+        set_field(msg_gpu_timeline->mutable_work_period_gpu_id(), gpu_timeline.work_period_gpu_id);
+        set_field(msg_gpu_timeline->mutable_work_period_uid(), gpu_timeline.work_period_uid);
+        set_field(msg_gpu_timeline->mutable_work_period_start_time(), gpu_timeline.work_period_start_time);
+        set_field(msg_gpu_timeline->mutable_work_period_end_time(), gpu_timeline.work_period_end_time);
+        set_field(msg_gpu_timeline->mutable_work_period_active_duration(), gpu_timeline.work_period_active_duration);
+    }
+
+    void add_block_io(ipc::msg_capture_configuration_t & msg, block_io_config_t const & block_io)
+    {
+        auto const set_field = [](auto * msg_field, tracepoint_field_t const & field) {
+            msg_field->set_offset(field.offset);
+            msg_field->set_size(field.size);
+        };
+
+        auto * msg_block_io = msg.suffix.mutable_block_io();
+        msg_block_io->set_issue_key(static_cast<std::int32_t>(block_io.issue_key));
+        set_field(msg_block_io->mutable_issue_dev(), block_io.issue_dev);
+        set_field(msg_block_io->mutable_issue_sector(), block_io.issue_sector);
+        msg_block_io->set_complete_key(static_cast<std::int32_t>(block_io.complete_key));
+        set_field(msg_block_io->mutable_complete_dev(), block_io.complete_dev);
+        set_field(msg_block_io->mutable_complete_sector(), block_io.complete_sector);
+        for (auto key : block_io.latency_keys) {
+            msg_block_io->add_latency_keys(static_cast<std::int32_t>(key));
+        }
+        msg_block_io->set_average_latency_key(static_cast<std::int32_t>(block_io.average_latency_key));
+        msg_block_io->set_queue_depth_key(static_cast<std::int32_t>(block_io.queue_depth_key));
+    }
+
+    void add_lock_contention(ipc::msg_capture_configuration_t & msg, lock_contention_config_t const & lock_contention)
+    {
+        auto const set_field = [](auto * msg_field, tracepoint_field_t const & field) {
+            msg_field->set_offset(field.offset);
+            msg_field->set_size(field.size);
+        };
+
+        auto * msg_lock_contention = msg.suffix.mutable_lock_contention();
+        msg_lock_contention->set_begin_key(static_cast<std::int32_t>(lock_contention.begin_key));
+        set_field(msg_lock_contention->mutable_begin_address(), lock_contention.begin_address);
+        set_field(msg_lock_contention->mutable_begin_op(), lock_contention.begin_op);
+        msg_lock_contention->set_end_key(static_cast<std::int32_t>(lock_contention.end_key));
+    }
+
+    void add_thread_energy(ipc::msg_capture_configuration_t & msg, thread_energy_config_t const & thread_energy)
+    {
+        auto const set_field = [](auto * msg_field, tracepoint_field_t const & field) {
+            msg_field->set_offset(field.offset);
+            msg_field->set_size(field.size);
+        };
+
+        auto * msg_thread_energy = msg.suffix.mutable_thread_energy();
+        msg_thread_energy->set_sched_switch_key(static_cast<std::int32_t>(thread_energy.sched_switch_key));
+        set_field(msg_thread_energy->mutable_switch_prev_tid(), thread_energy.switch_prev_tid);
+        set_field(msg_thread_energy->mutable_switch_next_tid(), thread_energy.switch_next_tid);
+        msg_thread_energy->set_cpu_frequency_key(static_cast<std::int32_t>(thread_energy.cpu_frequency_key));
+        set_field(msg_thread_energy->mutable_frequency_state(), thread_energy.frequency_state);
+        set_field(msg_thread_energy->mutable_frequency_cpu_id(), thread_energy.frequency_cpu_id);
+        for (auto const & domain : thread_energy.domains) {
+            auto * msg_domain = msg_thread_energy->add_domains();
+            for (auto cpu : domain.cpus) {
+                msg_domain->add_cpus(static_cast<std::uint32_t>(cpu));
+            }
+            for (auto const & state : domain.states) {
+                auto * msg_state = msg_domain->add_states();
+                msg_state->set_frequency_khz(state.frequency_khz);
+                msg_state->set_power(state.power);
+            }
+        }
+    }
+
     std::shared_ptr<perf_capture_configuration_t> parse_capture_configuration_msg(ipc::msg_capture_configuration_t msg)
     {
         auto result = std::make_shared<perf_capture_configuration_t>();
@@ -651,7 +1016,90 @@ namespace agents::perf {
         extract_command(*msg.suffix.mutable_command(), result->command);
         extract_wait_process(*msg.suffix.mutable_wait_process(), result->wait_process);
         extract_pids(msg.suffix.pids(), result->pids);
+        extract_function_probes(msg.suffix.function_probes(), result->function_probes);
+        extract_cpu_metrics(*msg.suffix.mutable_cpu_metrics(), result->clusters.size(), result->cpu_metrics);
+        extract_gpu_timeline(msg.suffix.gpu_timeline(), result->gpu_timeline);
+        extract_block_io(msg.suffix.block_io(), result->block_io);
+        extract_lock_contention(msg.suffix.lock_contention(), result->lock_contention);
+        extract_thread_energy(msg.suffix.thread_energy(), result->thread_energy);
         extract_perf_pmu_type_to_name(*msg.suffix.mutable_perf_pmu_type_to_name(), result->perf_pmu_type_to_name);
+        extract_spe_record_filters(msg.suffix.spe_record_filters(),
+                                   result->clusters,
+                                   result->per_core_cluster_index,
+                                   result->per_core_spe_record_filter);
+        extract_simulated_perf(*result);
+
+        return result;
+    }
+
+    ipc::msg_capture_reconfiguration_t create_capture_reconfiguration_msg(
+        perf_groups_configurer_state_t const & perf_groups,
+        std::map<PerfEventGroupIdentifier, std::size_t> const & previous_group_sizes,
+        std::set<int> const & removed_keys,
+        ICpuInfo const & cpu_info)
+    {
+        ipc::msg_capture_reconfiguration_t result {};
+
+        for (auto const & [identifier, state] : perf_groups.perfEventGroupMap) {
+            // only the cpu events can be changed
+            ipc::proto::shell::perf::capture_reconfiguration_t::added_event_list_t * list;
+            bool requires_leader;
+            switch (identifier.getType()) {
+                case PerfEventGroupIdentifier::Type::GLOBAL: {
+                    list = result.suffix.mutable_global_events();
+                    requires_leader = false;
+                    break;
+                }
+                case PerfEventGroupIdentifier::Type::PER_CLUSTER_CPU: {
+                    auto index = find_pmu_index(cpu_info.getClusters(), identifier.getCluster());
+                    list = &(*result.suffix.mutable_cluster_specific_events())[index];
+                    requires_leader = true;
+                    break;
+                }
+                default: {
+                    continue;
+                }
+            }
+
+            auto it = previous_group_sizes.find(identifier);
+            auto const first_added = (it != previous_group_sizes.end() ? it->second : 0);
+
+            for (auto n = first_added; n < state.events.size(); ++n) {
+                auto const & event = state.events[n];
+                auto * msg_entry = list->add_events();
+                add_perf_event(*msg_entry->mutable_event(),
+                               event.key,
+                               event.attr,
+                               identifier.getMultiplexGroup(),
+                               event.filter);
+                msg_entry->set_leader_key((requires_leader && (n > 0)) ? state.events.front().key : 0);
+            }
+        }
+
+        for (auto key : removed_keys) {
+            result.suffix.add_removed_keys(key);
+        }
+
+        return result;
+    }
+
+    perf_capture_reconfiguration_t parse_capture_reconfiguration_msg(
+        ipc::msg_capture_reconfiguration_t const & msg,
+        perf_capture_configuration_t const & configuration)
+    {
+        perf_capture_reconfiguration_t result {};
+
+        extract_live_event_definition_list(msg.suffix.global_events(), result.global_events);
+
+        for (auto const & entry : msg.suffix.cluster_specific_events()) {
+            runtime_assert(entry.first < configuration.clusters.size(), "Invalid cluster id received");
+            auto id = cpu_cluster_id_t(entry.first);
+            extract_live_event_definition_list(entry.second, result.cluster_specific_events[id]);
+        }
+
+        for (auto key : msg.suffix.removed_keys()) {
+            result.removed_keys.insert(gator_key_t(key));
+        }
 
         return result;
     }
@@ -2,10 +2,17 @@
 
 #pragma once
 
+#include "Configuration.h"
 #include "ICpuInfo.h"
 #include "SessionData.h"
+#include "agents/perf/block_io_latency.h"
 #include "agents/perf/events/event_configuration.hpp"
+#include "agents/perf/events/simulated_perf_events.hpp"
 #include "agents/perf/events/types.hpp"
+#include "agents/perf/function_latency.h"
+#include "agents/perf/gpu_timeline.h"
+#include "agents/perf/lock_contention.h"
+#include "agents/perf/thread_energy.h"
 #include "agents/perf/record_types.h"
 #include "ipc/messages.h"
 #include "k/perf_event.h"
@@ -31,6 +38,20 @@ namespace agents::perf {
             bool one_shot;
             bool exclude_kernel_events;
             bool stop_on_exit;
+            std::uint32_t flight_recorder_seconds;
+            std::uint32_t flight_recorder_size;
+            bool dedup_call_stacks;
+            std::uint32_t pmu_multiplex_quantum_ms;
+            std::string cgroup;
+            bool lazy_process_maps;
+            std::uint32_t aggregate_samples_ms;
+            bool filter_pid_samples;
+            std::string etm_filters;
+            std::uint32_t etm_strobe_window_us;
+            std::uint32_t etm_strobe_period_us;
+            std::uint32_t low_wakeup_seconds;
+            std::uint32_t stop_drain_timeout_ms;
+            bool cpu_local_drain;
         };
 
         struct command_t {
@@ -46,6 +67,15 @@ namespace agents::perf {
             bool use_cpuinfo;
         };
 
+        /** A derived metric of the cpu PMU events of some cluster, which the agent evaluates */
+        struct cpu_metric_t {
+            std::uint32_t cluster_index;
+            std::uint32_t pmu_type;
+            std::int32_t key;
+            std::string expression;
+            double multiplier;
+        };
+
         session_data_t session_data {};
         perf_config_t perf_config {};
         std::vector<gator_cpu_t> clusters {};
@@ -53,6 +83,7 @@ namespace agents::perf {
         std::vector<std::int32_t> per_core_cluster_index {};
         std::vector<std::int32_t> per_core_cpuids {};
         std::map<core_no_t, std::uint32_t> per_core_spe_type {};
+        std::map<core_no_t, SpeRecordFilter> per_core_spe_record_filter {};
         std::vector<uncore_pmu_t> uncore_pmus {};
         std::map<std::uint32_t, std::string> cpuid_to_core_name {};
         std::map<std::uint32_t, std::string> perf_pmu_type_to_name {};
@@ -64,6 +95,21 @@ namespace agents::perf {
         std::uint32_t num_cpu_cores {};
         bool enable_on_exec {};
         bool stop_pids {};
+        std::vector<function_latency_state_t::probe_t> function_probes {};
+        std::vector<cpu_metric_t> cpu_metrics {};
+        gpu_timeline_config_t gpu_timeline {};
+        block_io_config_t block_io {};
+        lock_contention_config_t lock_contention {};
+        thread_energy_config_t thread_energy {};
+        /** Set when the perf events are simulated, in which case the cores are as many as it says */
+        std::optional<simulated_perf_config_t> simulated_perf {};
+    };
+
+    /** Validated and extracted fields from a received reconfiguration message */
+    struct perf_capture_reconfiguration_t {
+        std::vector<live_event_definition_t> global_events {};
+        std::map<cpu_cluster_id_t, std::vector<live_event_definition_t>> cluster_specific_events {};
+        std::set<gator_key_t> removed_keys {};
     };
 
     /**
@@ -80,6 +126,7 @@ namespace agents::perf {
         perf_groups_configurer_state_t const & perf_groups,
         agents::perf::buffer_config_t const & ringbuffer_config,
         std::map<std::uint32_t, std::string> const & perf_pmu_type_to_name,
+        std::map<std::string, SpeRecordFilter> const & spe_record_filters,
         bool enable_on_exec,
         bool stop_pids);
 
@@ -96,7 +143,47 @@ namespace agents::perf {
     /** Add the pids for --pids */
     void add_pids(ipc::msg_capture_configuration_t & msg, std::set<int> const & pids);
 
+    /** Add the entry and return event keys of the probed functions */
+    void add_function_probes(ipc::msg_capture_configuration_t & msg,
+                             lib::Span<function_latency_state_t::probe_t const> probes);
+
+    /** Add the derived metrics of the cpu PMU events */
+    void add_cpu_metrics(ipc::msg_capture_configuration_t & msg,
+                         lib::Span<perf_capture_configuration_t::cpu_metric_t const> metrics);
+
+    /** Add the Mali GPU tracepoints to convert into GPU activity */
+    void add_gpu_timeline(ipc::msg_capture_configuration_t & msg, gpu_timeline_config_t const & gpu_timeline);
+
+    /** Add the block tracepoints to pair into block I/O latencies */
+    void add_block_io(ipc::msg_capture_configuration_t & msg, block_io_config_t const & block_io);
+
+    /** Add the futex or lock tracepoints to pair into lock wait times */
+    void add_lock_contention(ipc::msg_capture_configuration_t & msg, lock_contention_config_t const & lock_contention);
+
+    /** Add the tracepoints and energy model to combine into the energy used by each thread */
+    void add_thread_energy(ipc::msg_capture_configuration_t & msg, thread_energy_config_t const & thread_energy);
+
     /** Extract and validate the fields from the received msg. (Passed by value to allow moving out strings, rather than copying) */
     [[nodiscard]] std::shared_ptr<perf_capture_configuration_t> parse_capture_configuration_msg(
         ipc::msg_capture_configuration_t msg);
+
+    /**
+     * Create the message that changes the perf events of a running capture
+     *
+     * @param perf_groups The groups, once the added events were added to them
+     * @param previous_group_sizes The number of events that each group had before the events were added to it, such
+     *  that only the events after them are sent
+     * @param removed_keys The keys of the removed events
+     * @param cpu_info The cpu info that the groups' clusters are from
+     */
+    [[nodiscard]] ipc::msg_capture_reconfiguration_t create_capture_reconfiguration_msg(
+        perf_groups_configurer_state_t const & perf_groups,
+        std::map<PerfEventGroupIdentifier, std::size_t> const & previous_group_sizes,
+        std::set<int> const & removed_keys,
+        ICpuInfo const & cpu_info);
+
+    /** Extract and validate the fields from the received reconfiguration msg, for the capture's configuration */
+    [[nodiscard]] perf_capture_reconfiguration_t parse_capture_reconfiguration_msg(
+        ipc::msg_capture_reconfiguration_t const & msg,
+        perf_capture_configuration_t const & configuration);
 };
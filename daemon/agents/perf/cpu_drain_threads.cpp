@@ -0,0 +1,88 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "agents/perf/cpu_drain_threads.h"
+
+#include "Logging.h"
+#include "lib/String.h"
+
+#include <cerrno>
+#include <cinttypes>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+
+#include <sched.h>
+#include <sys/prctl.h>
+
+namespace agents::perf {
+    namespace {
+        constexpr std::size_t comm_len = 16;
+        constexpr std::uint64_t ns_per_us = 1000;
+        constexpr std::uint64_t us_per_s = 1000000;
+
+        /** @return The CPU time used by the calling thread, in microseconds */
+        [[nodiscard]] std::uint64_t thread_cpu_time_us()
+        {
+            timespec time {};
+            if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time) != 0) {
+                return 0;
+            }
+            return (std::uint64_t(time.tv_sec) * us_per_s) + (std::uint64_t(time.tv_nsec) / ns_per_us);
+        }
+    }
+
+    cpu_drain_threads_t::~cpu_drain_threads_t() noexcept
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        for (auto & [cpu, state] : threads) {
+            // any handler still queued is dropped, as nothing waits for it any more
+            state->work.reset();
+            state->context.stop();
+
+            // the last reference to whatever owns this may be released by a handler on one of the threads, which
+            // cannot join itself, but keeps its state until it returns from run
+            if (state->thread.get_id() == std::this_thread::get_id()) {
+                state->thread.detach();
+            }
+            else if (state->thread.joinable()) {
+                state->thread.join();
+            }
+        }
+    }
+
+    boost::asio::io_context & cpu_drain_threads_t::context_for(int cpu)
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        auto & state = threads[cpu];
+        if (!state) {
+            state = std::make_shared<drain_thread_t>();
+            state->thread = std::thread {[state = state, cpu]() { run(state, cpu); }};
+        }
+
+        return state->context;
+    }
+
+    void cpu_drain_threads_t::run(std::shared_ptr<drain_thread_t> const & state, int cpu)
+    {
+        lib::printf_str_t<comm_len> comm_str {"gatord-drain-%d", cpu};
+        prctl(PR_SET_NAME, reinterpret_cast<unsigned long>(comm_str.c_str()), 0, 0, 0);
+
+        // the placement of gatord's threads is overridden, as the thread must run where its ring buffer is written
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(cpu, &cpus);
+        if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0) {
+            // NOLINTNEXTLINE(concurrency-mt-unsafe)
+            LOG_DEBUG("Unable to pin the drain thread of cpu %d (%s); it runs unpinned", cpu, strerror(errno));
+        }
+
+        LOG_DEBUG("Launched the drain thread of cpu %d", cpu);
+
+        state->context.run();
+
+        LOG_DEBUG("The drain thread of cpu %d used %" PRIu64 " us of CPU time", cpu, thread_cpu_time_us());
+    }
+}
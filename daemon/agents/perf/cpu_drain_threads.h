@@ -0,0 +1,51 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+
+namespace agents::perf {
+    /**
+     * The threads that drain the perf ring buffers on the cpus they belong to, for the cpu_local_drain mode.
+     *
+     * Each cpu's ring buffer is drained (and its records encoded into apc frames) on a thread that is pinned to that
+     * cpu, so that the records are read from the cpu's own cache rather than across the interconnect, and only the
+     * finished frames are handed over to the IPC sink. Each thread is named gatord-drain-<cpu>, so that the cost of
+     * draining each cpu is seen against that cpu in the capture.
+     *
+     * The threads are started the first time the context of their cpu is asked for, and each runs its own io_context,
+     * on which the cpu's strand is made.
+     */
+    class cpu_drain_threads_t {
+    public:
+        cpu_drain_threads_t() = default;
+        cpu_drain_threads_t(cpu_drain_threads_t const &) = delete;
+        cpu_drain_threads_t & operator=(cpu_drain_threads_t const &) = delete;
+        cpu_drain_threads_t(cpu_drain_threads_t &&) = delete;
+        cpu_drain_threads_t & operator=(cpu_drain_threads_t &&) = delete;
+
+        ~cpu_drain_threads_t() noexcept;
+
+        /** @return The io_context that runs on the thread pinned to the cpu, starting the thread if need be */
+        [[nodiscard]] boost::asio::io_context & context_for(int cpu);
+
+    private:
+        struct drain_thread_t {
+            boost::asio::io_context context {1};
+            boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work {context.get_executor()};
+            std::thread thread {};
+        };
+
+        /** The body of the thread of some cpu, which owns a reference to its state so it outlives the object */
+        static void run(std::shared_ptr<drain_thread_t> const & state, int cpu);
+
+        std::mutex mutex {};
+        std::map<int, std::shared_ptr<drain_thread_t>> threads {};
+    };
+}
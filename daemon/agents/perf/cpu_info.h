@@ -28,6 +28,11 @@ namespace agents::perf {
 
         void updateIds(bool /*ignoreOffline*/) override
         {
+            // the simulated cores are fixed copies of the real ones
+            if (configuration->simulated_perf) {
+                return;
+            }
+
             cpu_utils::readCpuInfo(true, false, configuration->per_core_cpuids);
             ICpuInfo::updateClusterIds(configuration->per_core_cpuids,
                                        configuration->clusters,
@@ -0,0 +1,189 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "agents/perf/cpu_metrics.h"
+
+#include "Logging.h"
+#include "k/perf_event.h"
+#include "lib/EnumUtils.h"
+#include "lib/Syscall.h"
+
+#include <cerrno>
+#include <cinttypes>
+#include <cmath>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+
+namespace agents::perf {
+    namespace {
+        /** The words of a group read before the counts; the number of events, and the times enabled and running */
+        constexpr std::size_t read_header_words = 3;
+        constexpr std::uint64_t read_format =
+            PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        constexpr double ns_per_s = 1e9;
+    }
+
+    cpu_metrics_t::cpu_metrics_t(perf_capture_configuration_t const & configuration)
+        : exclude_kernel(configuration.session_data.exclude_kernel_events || configuration.perf_config.exclude_kernel),
+          has_fd_cloexec(configuration.perf_config.has_fd_cloexec)
+    {
+        for (auto const & metric : configuration.cpu_metrics) {
+            std::string error;
+            auto expression = metric_expression_t::parse(metric.expression, error);
+            if (!expression) {
+                LOG_ERROR("Invalid metric expression '%s' for key %d (%s)",
+                          metric.expression.c_str(),
+                          metric.key,
+                          error.c_str());
+                continue;
+            }
+
+            metrics.push_back(metric_t {cpu_cluster_id_t(metric.cluster_index),
+                                        metric.pmu_type,
+                                        gator_key_t(metric.key),
+                                        std::move(*expression),
+                                        (metric.multiplier != 0 ? metric.multiplier : 1)});
+        }
+
+        if (!metrics.empty() && !configuration.session_data.cgroup.empty()) {
+            //NOLINTNEXTLINE(hicpp-signed-bitwise) - O_RDONLY | O_DIRECTORY | O_CLOEXEC
+            cgroup_fd = lib::AutoClosingFd {
+                lib::open(configuration.session_data.cgroup.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)};
+            if (!cgroup_fd) {
+                LOG_ERROR("Unable to open the cgroup '%s' for the cpu metrics (%s)",
+                          configuration.session_data.cgroup.c_str(),
+                          std::strerror(errno));
+                metrics.clear();
+            }
+        }
+    }
+
+    void cpu_metrics_t::core_online(core_no_t core_no, cpu_cluster_id_t cluster_id)
+    {
+        auto & core_groups = groups[core_no];
+        core_groups.clear();
+
+        for (std::size_t index = 0; index < metrics.size(); ++index) {
+            if (metrics[index].cluster_id != cluster_id) {
+                continue;
+            }
+
+            auto group = open_group(core_no, index);
+            if (group) {
+                core_groups.push_back(std::move(*group));
+            }
+        }
+
+        if (core_groups.empty()) {
+            groups.erase(core_no);
+        }
+    }
+
+    std::optional<cpu_metrics_t::group_t> cpu_metrics_t::open_group(core_no_t core_no, std::size_t metric_index) const
+    {
+        auto const & metric = metrics[metric_index];
+        auto const events = metric.expression.get_events();
+        auto const is_cgroup = bool(cgroup_fd);
+        auto const flags = (has_fd_cloexec ? PERF_FLAG_FD_CLOEXEC : 0UL) | (is_cgroup ? PERF_FLAG_PID_CGROUP : 0UL);
+
+        group_t group {metric_index, {}, {}, false};
+
+        for (auto const event : events) {
+            perf_event_attr attr {};
+            attr.size = sizeof(attr);
+            attr.type = metric.pmu_type;
+            attr.config = event;
+            attr.read_format = read_format;
+            attr.exclude_kernel = exclude_kernel;
+
+            auto const group_fd = (group.fds.empty() ? -1 : group.fds.front().get());
+            lib::AutoClosingFd fd {lib::perf_event_open(&attr,
+                                                        (is_cgroup ? cgroup_fd.get() : -1),
+                                                        lib::toEnumValue(core_no),
+                                                        group_fd,
+                                                        flags)};
+
+            // the kernel events may not be counted without privileges
+            if (!fd && !exclude_kernel && ((errno == EACCES) || (errno == EPERM))) {
+                attr.exclude_kernel = 1;
+                fd = lib::AutoClosingFd {lib::perf_event_open(&attr,
+                                                              (is_cgroup ? cgroup_fd.get() : -1),
+                                                              lib::toEnumValue(core_no),
+                                                              group_fd,
+                                                              flags)};
+            }
+
+            if (!fd) {
+                LOG_DEBUG("Unable to open event 0x%" PRIx64 " of the metric for key %d on cpu %d (%s)",
+                          event,
+                          lib::toEnumValue(metric.key),
+                          lib::toEnumValue(core_no),
+                          std::strerror(errno));
+                return {};
+            }
+
+            if (!has_fd_cloexec) {
+                //NOLINTNEXTLINE(hicpp-signed-bitwise) - FD_CLOEXEC
+                lib::fcntl(*fd, F_SETFD, lib::fcntl(*fd, F_GETFD) | FD_CLOEXEC);
+            }
+
+            group.fds.push_back(std::move(fd));
+        }
+
+        group.last_read.resize(read_header_words + events.size());
+        return group;
+    }
+
+    std::vector<apc::perf_counter_t> cpu_metrics_t::read()
+    {
+        std::vector<apc::perf_counter_t> result {};
+
+        for (auto & [core_no, core_groups] : groups) {
+            for (auto & group : core_groups) {
+                auto const & metric = metrics[group.metric_index];
+                auto const nr = group.fds.size();
+
+                read_buffer.resize(read_header_words + nr);
+                auto const size = read_buffer.size() * sizeof(std::uint64_t);
+                if ((lib::read(*group.fds.front(), read_buffer.data(), size) != static_cast<ssize_t>(size))
+                    || (read_buffer[0] != nr)) {
+                    continue;
+                }
+
+                auto const had_last_read = group.has_last_read;
+                std::swap(read_buffer, group.last_read);
+                group.has_last_read = true;
+                if (!had_last_read) {
+                    continue;
+                }
+
+                // read_buffer now holds the previous read
+                auto const & current = group.last_read;
+                auto const enabled = current[1] - read_buffer[1];
+                auto const running = current[2] - read_buffer[2];
+                if ((enabled == 0) || (running == 0)) {
+                    continue;
+                }
+
+                auto const scale = static_cast<double>(enabled) / static_cast<double>(running);
+                counts.resize(nr);
+                for (std::size_t n = 0; n < nr; ++n) {
+                    auto const index = read_header_words + n;
+                    counts[n] = static_cast<double>(current[index] - read_buffer[index]) * scale;
+                }
+
+                auto const value = metric.expression.evaluate(counts, static_cast<double>(enabled) / ns_per_s);
+                if (!value) {
+                    continue;
+                }
+
+                result.push_back(apc::perf_counter_t {lib::toEnumValue(core_no),
+                                                      lib::toEnumValue(metric.key),
+                                                      std::llround(*value / metric.multiplier)});
+            }
+        }
+
+        return result;
+    }
+}
@@ -0,0 +1,81 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#pragma once
+
+#include "agents/perf/capture_configuration.h"
+#include "agents/perf/events/types.hpp"
+#include "agents/perf/metric_expression.h"
+#include "apc/perf_counter.h"
+#include "lib/AutoClosingFd.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <vector>
+
+namespace agents::perf {
+    /**
+     * Evaluates the derived metrics of the cpu PMU events (such as the instructions per cycle or the L2 refill
+     * bandwidth) on each core, so that only the metric's value is sent to the host rather than the raw counts it is
+     * computed from.
+     *
+     * Each metric's events are opened as one counting group per core (so that they count over exactly the same time,
+     * and without sampling or a ring buffer), which is read with PERF_FORMAT_GROUP. Each read gives the increase in
+     * the counts since the last, scaled up by the time enabled over the time running where the kernel multiplexed the
+     * group with the captured events, from which the metric is evaluated and sent as a counter value (divided by the
+     * counter's multiplier, which the host multiplies it by again).
+     */
+    class cpu_metrics_t {
+    public:
+        explicit cpu_metrics_t(perf_capture_configuration_t const & configuration);
+
+        /** @return True if there are no metrics to evaluate */
+        [[nodiscard]] bool empty() const { return metrics.empty(); }
+
+        /** Open the groups of the metrics of the core's cluster, when the core comes online */
+        void core_online(core_no_t core_no, cpu_cluster_id_t cluster_id);
+
+        /** Close the core's groups, when the core goes offline */
+        void core_offline(core_no_t core_no) { groups.erase(core_no); }
+
+        /**
+         * Read every group and evaluate its metric
+         *
+         * @return The value of each metric on each core over the interval since the last read. A group's first read,
+         * or one over an interval in which it did not run, gives no value.
+         */
+        [[nodiscard]] std::vector<apc::perf_counter_t> read();
+
+    private:
+        struct metric_t {
+            cpu_cluster_id_t cluster_id;
+            std::uint32_t pmu_type;
+            gator_key_t key;
+            metric_expression_t expression;
+            double multiplier;
+        };
+
+        struct group_t {
+            std::size_t metric_index;
+            /** The leader first */
+            std::vector<lib::AutoClosingFd> fds;
+            /** The last read; the number of events, the times enabled and running, then the count of each event */
+            std::vector<std::uint64_t> last_read;
+            bool has_last_read;
+        };
+
+        std::vector<metric_t> metrics {};
+        std::map<core_no_t, std::vector<group_t>> groups {};
+        /** The cgroup that the events are restricted to, if any */
+        lib::AutoClosingFd cgroup_fd {};
+        bool exclude_kernel;
+        bool has_fd_cloexec;
+        /** Reused for each read */
+        std::vector<std::uint64_t> read_buffer {};
+        std::vector<double> counts {};
+
+        /** @return The group, or nothing if some event could not be opened on the core */
+        [[nodiscard]] std::optional<group_t> open_group(core_no_t core_no, std::size_t metric_index) const;
+    };
+}
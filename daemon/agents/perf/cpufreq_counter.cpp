@@ -25,7 +25,7 @@ namespace agents::perf {
         auto cluster_id = cluster_ids[cpu_no];
         auto const & cpu_freq_keys = cluster_keys_for_cpu_frequency_counter;
 
-        if ((cluster_id < 0) && (std::size_t(cluster_id) >= cpu_freq_keys.size())) {
+        if ((cluster_id < 0) || (std::size_t(cluster_id) >= cpu_freq_keys.size())) {
             return {};
         }
 
@@ -0,0 +1,865 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "agents/perf/dwarf_unwind_table.h"
+
+#include "lib/AutoClosingFd.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace agents::perf {
+    namespace {
+        /** The pointer encodings, as described by the LSB's specification of .eh_frame */
+        enum : std::uint8_t {
+            DW_EH_PE_absptr = 0x00,
+            DW_EH_PE_uleb128 = 0x01,
+            DW_EH_PE_udata2 = 0x02,
+            DW_EH_PE_udata4 = 0x03,
+            DW_EH_PE_udata8 = 0x04,
+            DW_EH_PE_sleb128 = 0x09,
+            DW_EH_PE_sdata2 = 0x0a,
+            DW_EH_PE_sdata4 = 0x0b,
+            DW_EH_PE_sdata8 = 0x0c,
+            DW_EH_PE_format_mask = 0x0f,
+            DW_EH_PE_pcrel = 0x10,
+            DW_EH_PE_application_mask = 0x70,
+            DW_EH_PE_indirect = 0x80,
+            DW_EH_PE_omit = 0xff,
+        };
+
+        /** The call frame instructions, from DWARF 5 section 6.4.2 (and the GNU and AArch64 extensions) */
+        enum : std::uint8_t {
+            DW_CFA_advance_loc = 0x40,
+            DW_CFA_offset = 0x80,
+            DW_CFA_restore = 0xc0,
+            DW_CFA_primary_mask = 0xc0,
+            DW_CFA_operand_mask = 0x3f,
+            DW_CFA_nop = 0x00,
+            DW_CFA_set_loc = 0x01,
+            DW_CFA_advance_loc1 = 0x02,
+            DW_CFA_advance_loc2 = 0x03,
+            DW_CFA_advance_loc4 = 0x04,
+            DW_CFA_offset_extended = 0x05,
+            DW_CFA_restore_extended = 0x06,
+            DW_CFA_undefined = 0x07,
+            DW_CFA_same_value = 0x08,
+            DW_CFA_register = 0x09,
+            DW_CFA_remember_state = 0x0a,
+            DW_CFA_restore_state = 0x0b,
+            DW_CFA_def_cfa = 0x0c,
+            DW_CFA_def_cfa_register = 0x0d,
+            DW_CFA_def_cfa_offset = 0x0e,
+            DW_CFA_def_cfa_expression = 0x0f,
+            DW_CFA_expression = 0x10,
+            DW_CFA_offset_extended_sf = 0x11,
+            DW_CFA_def_cfa_sf = 0x12,
+            DW_CFA_def_cfa_offset_sf = 0x13,
+            DW_CFA_val_offset = 0x14,
+            DW_CFA_val_offset_sf = 0x15,
+            DW_CFA_val_expression = 0x16,
+            DW_CFA_AARCH64_negate_ra_state = 0x2d,
+            DW_CFA_GNU_args_size = 0x2e,
+            DW_CFA_GNU_negative_offset_extended = 0x2f,
+        };
+
+        /** Bounds remembered states, so that malformed instructions cannot use unbounded memory */
+        constexpr std::size_t max_remembered_states = 16;
+
+        /** Reads the fields of a CIE or FDE, failing (then reading zeros) at the end of the data rather than past it */
+        class cfi_reader_t {
+        public:
+            /**
+             * @param data The data to read, as loaded at `address`
+             * @param end The end of the data that may be read
+             * @param position The offset to start reading from
+             */
+            cfi_reader_t(char const * data, std::size_t end, std::size_t position, std::uint64_t address)
+                : data(data), end(end), position(std::min(position, end)), address(address)
+            {
+            }
+
+            [[nodiscard]] bool ok() const { return !failed; }
+            [[nodiscard]] bool at_end() const { return position >= end; }
+            [[nodiscard]] std::size_t get_position() const { return position; }
+            void set_position(std::size_t new_position) { position = std::min(new_position, end); }
+
+            template<typename T>
+            [[nodiscard]] T read()
+            {
+                T result {};
+                if ((end - position) < sizeof(T)) {
+                    failed = true;
+                    position = end;
+                    return result;
+                }
+                std::memcpy(&result, data + position, sizeof(T));
+                position += sizeof(T);
+                return result;
+            }
+
+            void skip(std::uint64_t count)
+            {
+                if ((end - position) < count) {
+                    failed = true;
+                    position = end;
+                    return;
+                }
+                position += count;
+            }
+
+            [[nodiscard]] std::uint64_t read_uleb128()
+            {
+                std::uint64_t result = 0;
+                unsigned shift = 0;
+                std::uint8_t byte;
+                do {
+                    byte = read<std::uint8_t>();
+                    if (shift < 64) {
+                        result |= (std::uint64_t(byte & 0x7f) << shift);
+                    }
+                    shift += 7;
+                } while (((byte & 0x80) != 0) && ok());
+                return result;
+            }
+
+            [[nodiscard]] std::int64_t read_sleb128()
+            {
+                std::uint64_t result = 0;
+                unsigned shift = 0;
+                std::uint8_t byte;
+                do {
+                    byte = read<std::uint8_t>();
+                    if (shift < 64) {
+                        result |= (std::uint64_t(byte & 0x7f) << shift);
+                    }
+                    shift += 7;
+                } while (((byte & 0x80) != 0) && ok());
+                if ((shift < 64) && ((byte & 0x40) != 0)) {
+                    result |= (~std::uint64_t(0) << shift);
+                }
+                return static_cast<std::int64_t>(result);
+            }
+
+            /** @return The nul terminated string at the current position, or nullptr */
+            [[nodiscard]] char const * read_string()
+            {
+                auto const * const start = data + position;
+                auto const * const nul = static_cast<char const *>(std::memchr(start, 0, end - position));
+                if (nul == nullptr) {
+                    failed = true;
+                    position = end;
+                    return nullptr;
+                }
+                position += (nul - start) + 1;
+                return start;
+            }
+
+            /**
+             * Read a pointer in some DW_EH_PE encoding
+             *
+             * @return The pointer, or empty if it is omitted or its encoding is not supported (in which case it is
+             * still skipped if its size is known)
+             */
+            [[nodiscard]] std::optional<std::uint64_t> read_encoded(std::uint8_t encoding)
+            {
+                if (encoding == DW_EH_PE_omit) {
+                    return {};
+                }
+
+                auto const field_address = address + position;
+
+                std::uint64_t value;
+                switch (encoding & DW_EH_PE_format_mask) {
+                    case DW_EH_PE_absptr:
+                    case DW_EH_PE_udata8:
+                    case DW_EH_PE_sdata8:
+                        value = read<std::uint64_t>();
+                        break;
+                    case DW_EH_PE_uleb128:
+                        value = read_uleb128();
+                        break;
+                    case DW_EH_PE_udata2:
+                        value = read<std::uint16_t>();
+                        break;
+                    case DW_EH_PE_udata4:
+                        value = read<std::uint32_t>();
+                        break;
+                    case DW_EH_PE_sleb128:
+                        value = read_sleb128();
+                        break;
+                    case DW_EH_PE_sdata2:
+                        value = static_cast<std::int64_t>(read<std::int16_t>());
+                        break;
+                    case DW_EH_PE_sdata4:
+                        value = static_cast<std::int64_t>(read<std::int32_t>());
+                        break;
+                    default:
+                        failed = true;
+                        position = end;
+                        return {};
+                }
+
+                if (!ok() || ((encoding & DW_EH_PE_indirect) != 0)) {
+                    return {};
+                }
+
+                switch (encoding & DW_EH_PE_application_mask) {
+                    case 0:
+                        return value;
+                    case DW_EH_PE_pcrel:
+                        return value + field_address;
+                    default:
+                        // text, data and function relative pointers are not used for code addresses in practice
+                        return {};
+                }
+            }
+
+        private:
+            char const * data;
+            std::size_t end;
+            std::size_t position;
+            std::uint64_t address;
+            bool failed = false;
+        };
+
+        /** The parts of a CIE or FDE that precede its contents */
+        struct entry_header_t {
+            /** The offset just after the CIE id or CIE pointer */
+            std::size_t contents;
+            /** The offset of the next entry */
+            std::size_t end;
+            /** The CIE id, or the section offset of the FDE's CIE */
+            std::uint64_t cie_offset;
+            bool is_cie;
+        };
+
+        struct cie_t {
+            std::uint64_t code_alignment;
+            std::int64_t data_alignment;
+            std::uint64_t return_address_register;
+            std::size_t instructions;
+            std::size_t end;
+            std::uint8_t fde_encoding;
+            bool has_augmentation_data;
+            bool is_signal_frame;
+        };
+
+        void set_rule(unwind_row_t & row, std::uint64_t reg, unwind_row_t::rule_t rule, std::int64_t value = 0)
+        {
+            // the rules of the other registers (such as the floating point ones) are not needed to unwind
+            if (reg < unwind_row_t::num_registers) {
+                row.rules[reg] = {rule, value};
+            }
+        }
+
+        void restore_rule(unwind_row_t & row, unwind_row_t const & initial, std::uint64_t reg)
+        {
+            if (reg < unwind_row_t::num_registers) {
+                row.rules[reg] = initial.rules[reg];
+            }
+        }
+
+        std::string to_hex(char const * data, std::size_t size)
+        {
+            constexpr char digits[] = "0123456789abcdef";
+            std::string result;
+            result.reserve(size * 2);
+            for (std::size_t i = 0; i < size; ++i) {
+                auto const byte = static_cast<unsigned char>(data[i]);
+                result += digits[byte >> 4];
+                result += digits[byte & 0xf];
+            }
+            return result;
+        }
+
+        [[nodiscard]] std::optional<entry_header_t> read_entry_header(char const * data,
+                                                                      std::size_t size,
+                                                                      std::size_t offset,
+                                                                      bool is_eh_frame)
+        {
+            cfi_reader_t reader {data, size, offset, 0};
+
+            bool is_64bit = false;
+            std::uint64_t length = reader.read<std::uint32_t>();
+            if (length == 0xffffffffULL) {
+                is_64bit = true;
+                length = reader.read<std::uint64_t>();
+            }
+
+            // a zero length terminates .eh_frame
+            auto const id_position = reader.get_position();
+            if (!reader.ok() || (length == 0) || (length > (size - id_position))) {
+                return {};
+            }
+
+            std::uint64_t const id = (is_64bit ? reader.read<std::uint64_t>() : reader.read<std::uint32_t>());
+            if (!reader.ok()) {
+                return {};
+            }
+
+            entry_header_t header {reader.get_position(), id_position + length, id, false};
+            if (is_eh_frame) {
+                // the CIE pointer is relative to its own position
+                header.is_cie = (id == 0);
+                header.cie_offset = id_position - id;
+            }
+            else {
+                header.is_cie = (id == (is_64bit ? ~std::uint64_t(0) : 0xffffffffULL));
+            }
+            return header;
+        }
+
+        [[nodiscard]] std::optional<cie_t> read_cie(char const * data,
+                                                    std::size_t size,
+                                                    std::uint64_t address,
+                                                    std::size_t offset,
+                                                    bool is_eh_frame)
+        {
+            if (offset >= size) {
+                return {};
+            }
+
+            auto const header = read_entry_header(data, size, offset, is_eh_frame);
+            if (!header || !header->is_cie) {
+                return {};
+            }
+
+            cfi_reader_t reader {data, header->end, header->contents, address};
+
+            auto const version = reader.read<std::uint8_t>();
+            if ((version != 1) && (version != 3) && (version != 4)) {
+                return {};
+            }
+
+            auto const * const augmentation = reader.read_string();
+            if (augmentation == nullptr) {
+                return {};
+            }
+
+            if (version >= 4) {
+                auto const address_size = reader.read<std::uint8_t>();
+                auto const segment_size = reader.read<std::uint8_t>();
+                if ((address_size != sizeof(std::uint64_t)) || (segment_size != 0)) {
+                    return {};
+                }
+            }
+
+            cie_t cie {};
+            cie.code_alignment = reader.read_uleb128();
+            cie.data_alignment = reader.read_sleb128();
+            cie.return_address_register = (version == 1 ? reader.read<std::uint8_t>() : reader.read_uleb128());
+            cie.fde_encoding = DW_EH_PE_absptr;
+
+            if (augmentation[0] == 'z') {
+                cie.has_augmentation_data = true;
+
+                auto const augmentation_size = reader.read_uleb128();
+                auto const augmentation_end = reader.get_position() + augmentation_size;
+
+                for (char const * c = augmentation + 1; (*c != 0) && reader.ok(); ++c) {
+                    if (*c == 'R') {
+                        cie.fde_encoding = reader.read<std::uint8_t>();
+                    }
+                    else if (*c == 'L') {
+                        (void) reader.read<std::uint8_t>();
+                    }
+                    else if (*c == 'P') {
+                        (void) reader.read_encoded(reader.read<std::uint8_t>());
+                    }
+                    else if (*c == 'S') {
+                        cie.is_signal_frame = true;
+                    }
+                    else if ((*c != 'B') && (*c != 'G')) {
+                        // the remaining augmentations are unknown, but their data is skipped below
+                        break;
+                    }
+                }
+
+                reader.set_position(augmentation_end);
+            }
+            else if (augmentation[0] != 0) {
+                // older GCC augmentations (such as "eh") change the layout of the CIE
+                return {};
+            }
+
+            if (!reader.ok()) {
+                return {};
+            }
+
+            cie.instructions = reader.get_position();
+            cie.end = header->end;
+            return cie;
+        }
+
+        /**
+         * Run some call frame instructions, up to the first that advances the location past `target`
+         *
+         * @return False if the instructions could not be interpreted
+         */
+        [[nodiscard]] bool execute(cfi_reader_t & reader,
+                                   cie_t const & cie,
+                                   unwind_row_t & row,
+                                   unwind_row_t const & initial,
+                                   std::uint64_t location,
+                                   std::uint64_t target)
+        {
+            using rule_t = unwind_row_t::rule_t;
+
+            std::vector<unwind_row_t> remembered {};
+
+            auto const advance = [&](std::uint64_t delta) {
+                location += delta * cie.code_alignment;
+                return (location <= target);
+            };
+
+            while (!reader.at_end()) {
+                auto const op = reader.read<std::uint8_t>();
+                auto const operand = std::uint64_t(op & DW_CFA_operand_mask);
+
+                switch (op & DW_CFA_primary_mask) {
+                    case DW_CFA_advance_loc:
+                        if (!advance(operand)) {
+                            return true;
+                        }
+                        continue;
+                    case DW_CFA_offset:
+                        set_rule(row,
+                                 operand,
+                                 rule_t::offset,
+                                 static_cast<std::int64_t>(reader.read_uleb128()) * cie.data_alignment);
+                        continue;
+                    case DW_CFA_restore:
+                        restore_rule(row, initial, operand);
+                        continue;
+                    default:
+                        break;
+                }
+
+                switch (op) {
+                    case DW_CFA_nop:
+                    case DW_CFA_AARCH64_negate_ra_state:
+                        // the return address is always stripped of any pointer authentication code
+                        break;
+                    case DW_CFA_set_loc: {
+                        auto const new_location = reader.read_encoded(cie.fde_encoding);
+                        if (!new_location) {
+                            return false;
+                        }
+                        location = *new_location;
+                        if (location > target) {
+                            return true;
+                        }
+                        break;
+                    }
+                    case DW_CFA_advance_loc1:
+                        if (!advance(reader.read<std::uint8_t>())) {
+                            return true;
+                        }
+                        break;
+                    case DW_CFA_advance_loc2:
+                        if (!advance(reader.read<std::uint16_t>())) {
+                            return true;
+                        }
+                        break;
+                    case DW_CFA_advance_loc4:
+                        if (!advance(reader.read<std::uint32_t>())) {
+                            return true;
+                        }
+                        break;
+                    case DW_CFA_offset_extended: {
+                        auto const reg = reader.read_uleb128();
+                        auto const offset = static_cast<std::int64_t>(reader.read_uleb128()) * cie.data_alignment;
+                        set_rule(row, reg, rule_t::offset, offset);
+                        break;
+                    }
+                    case DW_CFA_restore_extended:
+                        restore_rule(row, initial, reader.read_uleb128());
+                        break;
+                    case DW_CFA_undefined:
+                        set_rule(row, reader.read_uleb128(), rule_t::undefined);
+                        break;
+                    case DW_CFA_same_value:
+                        set_rule(row, reader.read_uleb128(), rule_t::same_value);
+                        break;
+                    case DW_CFA_register: {
+                        auto const reg = reader.read_uleb128();
+                        auto const from = reader.read_uleb128();
+                        set_rule(row, reg, rule_t::reg, static_cast<std::int64_t>(from));
+                        break;
+                    }
+                    case DW_CFA_remember_state:
+                        if (remembered.size() >= max_remembered_states) {
+                            return false;
+                        }
+                        remembered.push_back(row);
+                        break;
+                    case DW_CFA_restore_state:
+                        if (remembered.empty()) {
+                            return false;
+                        }
+                        row = remembered.back();
+                        remembered.pop_back();
+                        break;
+                    case DW_CFA_def_cfa:
+                        row.cfa_register = reader.read_uleb128();
+                        row.cfa_offset = static_cast<std::int64_t>(reader.read_uleb128());
+                        row.cfa_valid = true;
+                        break;
+                    case DW_CFA_def_cfa_sf:
+                        row.cfa_register = reader.read_uleb128();
+                        row.cfa_offset = reader.read_sleb128() * cie.data_alignment;
+                        row.cfa_valid = true;
+                        break;
+                    case DW_CFA_def_cfa_register:
+                        row.cfa_register = reader.read_uleb128();
+                        row.cfa_valid = true;
+                        break;
+                    case DW_CFA_def_cfa_offset:
+                        row.cfa_offset = static_cast<std::int64_t>(reader.read_uleb128());
+                        break;
+                    case DW_CFA_def_cfa_offset_sf:
+                        row.cfa_offset = reader.read_sleb128() * cie.data_alignment;
+                        break;
+                    case DW_CFA_def_cfa_expression:
+                        reader.skip(reader.read_uleb128());
+                        row.cfa_valid = false;
+                        break;
+                    case DW_CFA_expression:
+                    case DW_CFA_val_expression: {
+                        auto const reg = reader.read_uleb128();
+                        reader.skip(reader.read_uleb128());
+                        set_rule(row, reg, rule_t::undefined);
+                        break;
+                    }
+                    case DW_CFA_offset_extended_sf: {
+                        auto const reg = reader.read_uleb128();
+                        auto const offset = reader.read_sleb128() * cie.data_alignment;
+                        set_rule(row, reg, rule_t::offset, offset);
+                        break;
+                    }
+                    case DW_CFA_val_offset: {
+                        auto const reg = reader.read_uleb128();
+                        auto const offset = static_cast<std::int64_t>(reader.read_uleb128()) * cie.data_alignment;
+                        set_rule(row, reg, rule_t::val_offset, offset);
+                        break;
+                    }
+                    case DW_CFA_val_offset_sf: {
+                        auto const reg = reader.read_uleb128();
+                        auto const offset = reader.read_sleb128() * cie.data_alignment;
+                        set_rule(row, reg, rule_t::val_offset, offset);
+                        break;
+                    }
+                    case DW_CFA_GNU_args_size:
+                        (void) reader.read_uleb128();
+                        break;
+                    case DW_CFA_GNU_negative_offset_extended: {
+                        auto const reg = reader.read_uleb128();
+                        auto const offset = -static_cast<std::int64_t>(reader.read_uleb128()) * cie.data_alignment;
+                        set_rule(row, reg, rule_t::offset, offset);
+                        break;
+                    }
+                    default:
+                        return false;
+                }
+
+                if (!reader.ok()) {
+                    return false;
+                }
+            }
+
+            return reader.ok();
+        }
+    }
+
+    std::unique_ptr<dwarf_unwind_table_t> dwarf_unwind_table_t::open(std::string const & path)
+    {
+        lib::AutoClosingFd fd {::open(path.c_str(), O_RDONLY | O_CLOEXEC)};
+        if (!fd) {
+            return {};
+        }
+
+        struct stat st;
+        if ((fstat(*fd, &st) != 0) || !S_ISREG(st.st_mode) || (st.st_size <= 0)) {
+            return {};
+        }
+
+        void * const address = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, *fd, 0);
+        if (address == MAP_FAILED) {
+            return {};
+        }
+
+        std::unique_ptr<dwarf_unwind_table_t> table {
+            new dwarf_unwind_table_t(static_cast<char const *>(address), st.st_size)};
+        if (!table->read_headers()) {
+            return {};
+        }
+        return table;
+    }
+
+    dwarf_unwind_table_t::dwarf_unwind_table_t(char const * data, std::size_t size) : data(data), size(size)
+    {
+    }
+
+    dwarf_unwind_table_t::~dwarf_unwind_table_t()
+    {
+        munmap(const_cast<char *>(data), size);
+    }
+
+    bool dwarf_unwind_table_t::read_headers()
+    {
+        auto const in_file = [this](std::uint64_t offset, std::uint64_t length) {
+            return (offset <= size) && (length <= (size - offset));
+        };
+
+        // the unwound processes run on this machine, so have the same byte order
+        const unsigned char native_data = ((__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) ? ELFDATA2LSB : ELFDATA2MSB);
+
+        Elf64_Ehdr ehdr;
+        if (!in_file(0, sizeof(ehdr))) {
+            return false;
+        }
+        std::memcpy(&ehdr, data, sizeof(ehdr));
+        if ((std::memcmp(ehdr.e_ident, ELFMAG, SELFMAG) != 0) || (ehdr.e_ident[EI_CLASS] != ELFCLASS64)
+            || (ehdr.e_ident[EI_DATA] != native_data) || (ehdr.e_phentsize != sizeof(Elf64_Phdr))
+            || !in_file(ehdr.e_phoff, std::uint64_t(ehdr.e_phnum) * sizeof(Elf64_Phdr))) {
+            return false;
+        }
+
+        auto const read_build_id = [&](std::uint64_t offset, std::uint64_t length) {
+            if (!build_id.empty() || !in_file(offset, length)) {
+                return;
+            }
+
+            constexpr auto align = [](std::uint64_t value) { return (value + 3) & ~std::uint64_t(3); };
+
+            std::uint64_t position = 0;
+            while ((length - position) >= sizeof(Elf64_Nhdr)) {
+                Elf64_Nhdr nhdr;
+                std::memcpy(&nhdr, data + offset + position, sizeof(nhdr));
+                auto const name = position + sizeof(nhdr);
+                auto const desc = name + align(nhdr.n_namesz);
+                if ((desc > length) || (align(nhdr.n_descsz) > (length - desc))) {
+                    return;
+                }
+                if ((nhdr.n_type == NT_GNU_BUILD_ID) && (nhdr.n_namesz == sizeof(ELF_NOTE_GNU))
+                    && (std::memcmp(data + offset + name, ELF_NOTE_GNU, sizeof(ELF_NOTE_GNU)) == 0)) {
+                    build_id = to_hex(data + offset + desc, nhdr.n_descsz);
+                    return;
+                }
+                position = desc + align(nhdr.n_descsz);
+            }
+        };
+
+        std::optional<Elf64_Phdr> eh_frame_hdr {};
+        for (std::size_t i = 0; i < ehdr.e_phnum; ++i) {
+            Elf64_Phdr phdr;
+            std::memcpy(&phdr, data + ehdr.e_phoff + (i * sizeof(phdr)), sizeof(phdr));
+            if (phdr.p_type == PT_LOAD) {
+                segments.push_back({phdr.p_offset, phdr.p_vaddr, phdr.p_filesz});
+            }
+            else if (phdr.p_type == PT_NOTE) {
+                read_build_id(phdr.p_offset, phdr.p_filesz);
+            }
+            else if (phdr.p_type == PT_GNU_EH_FRAME) {
+                eh_frame_hdr = phdr;
+            }
+        }
+
+        // the section headers are optional, but give the extent of .eh_frame and are the only way to find .debug_frame
+        if ((ehdr.e_shoff != 0) && (ehdr.e_shentsize == sizeof(Elf64_Shdr)) && (ehdr.e_shstrndx < ehdr.e_shnum)
+            && in_file(ehdr.e_shoff, std::uint64_t(ehdr.e_shnum) * sizeof(Elf64_Shdr))) {
+            auto const read_shdr = [&](std::size_t index) {
+                Elf64_Shdr shdr;
+                std::memcpy(&shdr, data + ehdr.e_shoff + (index * sizeof(shdr)), sizeof(shdr));
+                return shdr;
+            };
+
+            auto const strtab = read_shdr(ehdr.e_shstrndx);
+            auto const name_is = [&](Elf64_Shdr const & shdr, char const * name) {
+                auto const length = std::strlen(name) + 1;
+                return in_file(strtab.sh_offset, strtab.sh_size) && (shdr.sh_name < strtab.sh_size)
+                    && (length <= (strtab.sh_size - shdr.sh_name))
+                    && (std::memcmp(data + strtab.sh_offset + shdr.sh_name, name, length) == 0);
+            };
+
+            for (std::size_t i = 0; i < ehdr.e_shnum; ++i) {
+                auto const shdr = read_shdr(i);
+                if (shdr.sh_type == SHT_NOTE) {
+                    read_build_id(shdr.sh_offset, shdr.sh_size);
+                }
+                if ((shdr.sh_type != SHT_PROGBITS) || !in_file(shdr.sh_offset, shdr.sh_size)) {
+                    continue;
+                }
+                if (name_is(shdr, ".eh_frame")) {
+                    eh_frame.data = data + shdr.sh_offset;
+                    eh_frame.size = shdr.sh_size;
+                    eh_frame.address = shdr.sh_addr;
+                    eh_frame.is_eh_frame = true;
+                }
+                else if (name_is(shdr, ".debug_frame")) {
+                    debug_frame.data = data + shdr.sh_offset;
+                    debug_frame.size = shdr.sh_size;
+                }
+            }
+        }
+
+        // otherwise find .eh_frame from its header, which is always loaded; it extends to its zero terminator
+        if ((eh_frame.data == nullptr) && eh_frame_hdr && in_file(eh_frame_hdr->p_offset, eh_frame_hdr->p_filesz)) {
+            cfi_reader_t reader {data + eh_frame_hdr->p_offset, eh_frame_hdr->p_filesz, 0, eh_frame_hdr->p_vaddr};
+            auto const version = reader.read<std::uint8_t>();
+            auto const pointer_encoding = reader.read<std::uint8_t>();
+            reader.skip(2);
+            auto const address = (version == 1 ? reader.read_encoded(pointer_encoding) : std::nullopt);
+            if (address) {
+                for (auto const & segment : segments) {
+                    if ((*address >= segment.address) && ((*address - segment.address) < segment.size)) {
+                        auto const offset = segment.offset + (*address - segment.address);
+                        if (in_file(offset, 0)) {
+                            eh_frame.data = data + offset;
+                            eh_frame.size = std::min<std::uint64_t>(segment.size - (*address - segment.address),
+                                                                    size - offset);
+                            eh_frame.address = *address;
+                            eh_frame.is_eh_frame = true;
+                        }
+                        break;
+                    }
+                }
+            }
+        }
+
+        return true;
+    }
+
+    void dwarf_unwind_table_t::index()
+    {
+        index(eh_frame);
+        index(debug_frame);
+    }
+
+    void dwarf_unwind_table_t::index(section_t & section)
+    {
+        if (section.data == nullptr) {
+            return;
+        }
+
+        std::unordered_map<std::size_t, std::optional<cie_t>> cies {};
+
+        std::size_t offset = 0;
+        while (offset < section.size) {
+            auto const header = read_entry_header(section.data, section.size, offset, section.is_eh_frame);
+            if (!header) {
+                break;
+            }
+
+            if (!header->is_cie) {
+                auto it = cies.find(header->cie_offset);
+                if (it == cies.end()) {
+                    it = cies.emplace(header->cie_offset,
+                                      read_cie(section.data,
+                                               section.size,
+                                               section.address,
+                                               header->cie_offset,
+                                               section.is_eh_frame))
+                             .first;
+                }
+
+                if (it->second) {
+                    cfi_reader_t reader {section.data, header->end, header->contents, section.address};
+                    auto const pc_begin = reader.read_encoded(it->second->fde_encoding);
+                    auto const pc_range = reader.read_encoded(it->second->fde_encoding & DW_EH_PE_format_mask);
+                    if (pc_begin && pc_range && (*pc_range != 0)) {
+                        section.fdes.push_back({*pc_begin, *pc_begin + *pc_range, offset});
+                    }
+                }
+            }
+
+            offset = header->end;
+        }
+
+        std::sort(section.fdes.begin(), section.fdes.end(), [](auto const & a, auto const & b) {
+            return a.pc_begin < b.pc_begin;
+        });
+        section.fdes.shrink_to_fit();
+    }
+
+    std::optional<std::uint64_t> dwarf_unwind_table_t::file_offset_to_address(std::uint64_t offset) const
+    {
+        for (auto const & segment : segments) {
+            if ((offset >= segment.offset) && ((offset - segment.offset) < segment.size)) {
+                return segment.address + (offset - segment.offset);
+            }
+        }
+        return {};
+    }
+
+    std::optional<unwind_row_t> dwarf_unwind_table_t::find_row(std::uint64_t address) const
+    {
+        auto row = find_row(eh_frame, address);
+        if (!row) {
+            row = find_row(debug_frame, address);
+        }
+        return row;
+    }
+
+    std::optional<unwind_row_t> dwarf_unwind_table_t::find_row(section_t const & section, std::uint64_t address)
+    {
+        auto it = std::upper_bound(section.fdes.begin(),
+                                   section.fdes.end(),
+                                   address,
+                                   [](std::uint64_t a, fde_entry_t const & fde) { return a < fde.pc_begin; });
+        if (it == section.fdes.begin()) {
+            return {};
+        }
+        --it;
+        if (address >= it->pc_end) {
+            return {};
+        }
+
+        auto const header = read_entry_header(section.data, section.size, it->offset, section.is_eh_frame);
+        if (!header) {
+            return {};
+        }
+        auto const cie =
+            read_cie(section.data, section.size, section.address, header->cie_offset, section.is_eh_frame);
+        if (!cie) {
+            return {};
+        }
+
+        cfi_reader_t fde_reader {section.data, header->end, header->contents, section.address};
+        (void) fde_reader.read_encoded(cie->fde_encoding);
+        (void) fde_reader.read_encoded(cie->fde_encoding & DW_EH_PE_format_mask);
+        if (cie->has_augmentation_data) {
+            fde_reader.skip(fde_reader.read_uleb128());
+        }
+        if (!fde_reader.ok()) {
+            return {};
+        }
+
+        // every register that the CIE and FDE do not mention keeps its value, as GCC and LLVM assume
+        unwind_row_t row {};
+        for (auto & rule : row.rules) {
+            rule = {unwind_row_t::rule_t::same_value, 0};
+        }
+        row.return_address_register = cie->return_address_register;
+        row.is_signal_frame = cie->is_signal_frame;
+
+        cfi_reader_t cie_reader {section.data, cie->end, cie->instructions, section.address};
+        if (!execute(cie_reader, *cie, row, row, 0, std::numeric_limits<std::uint64_t>::max())) {
+            return {};
+        }
+
+        unwind_row_t const initial = row;
+        if (!execute(fde_reader, *cie, row, initial, it->pc_begin, address) || !row.cfa_valid) {
+            return {};
+        }
+
+        return row;
+    }
+}
@@ -0,0 +1,134 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace agents::perf {
+    /** The rules for recovering the caller's registers at some address, as described by an FDE's call frame info */
+    struct unwind_row_t {
+        /** The number of registers tracked; x0-x30 and sp, numbered as in the AArch64 DWARF register mapping */
+        static constexpr std::size_t num_registers = 32;
+
+        enum class rule_t : std::uint8_t {
+            /** The caller's value is the same as the current value */
+            same_value,
+            /** The caller's value cannot be recovered */
+            undefined,
+            /** The caller's value is saved at CFA + value */
+            offset,
+            /** The caller's value is CFA + value */
+            val_offset,
+            /** The caller's value is in register `value` */
+            reg,
+        };
+
+        struct register_rule_t {
+            rule_t rule;
+            std::int64_t value;
+        };
+
+        std::array<register_rule_t, num_registers> rules;
+        std::uint64_t cfa_register;
+        std::int64_t cfa_offset;
+        std::uint64_t return_address_register;
+        /** False if the CFA is not defined, or is defined by an expression (which is not supported) */
+        bool cfa_valid;
+        /** True if the frame is a signal handler's, so its caller's address is not a return address */
+        bool is_signal_frame;
+    };
+
+    /**
+     * The unwind tables (.eh_frame and .debug_frame) of one 64-bit ELF file, which is mapped read only for as long as
+     * the table exists, indexed by the address range of each FDE so that the rules for some address can be found
+     * without scanning.
+     *
+     * The call frame instructions are interpreted when a row is looked up, so only the index is held per FDE.
+     * Instructions that use DWARF expressions are not supported, making the rules they affect undefined.
+     */
+    class dwarf_unwind_table_t {
+    public:
+        /**
+         * Map a file and read its build id, without indexing its unwind tables
+         *
+         * @return The table (to be indexed with `index`), or nullptr if the file is not a 64-bit ELF file of this
+         * machine's byte order
+         */
+        [[nodiscard]] static std::unique_ptr<dwarf_unwind_table_t> open(std::string const & path);
+
+        ~dwarf_unwind_table_t();
+
+        // Intentionally undefined
+        dwarf_unwind_table_t(dwarf_unwind_table_t const &) = delete;
+        dwarf_unwind_table_t & operator=(dwarf_unwind_table_t const &) = delete;
+        dwarf_unwind_table_t(dwarf_unwind_table_t &&) = delete;
+        dwarf_unwind_table_t & operator=(dwarf_unwind_table_t &&) = delete;
+
+        /** @return The hex encoded NT_GNU_BUILD_ID note, or empty if the file has none */
+        [[nodiscard]] std::string const & get_build_id() const { return build_id; }
+
+        /** Find the FDEs of the file's unwind tables; it must be called once before `find_row` */
+        void index();
+
+        /** @return True if the file has any FDEs */
+        [[nodiscard]] bool has_fdes() const { return !eh_frame.fdes.empty() || !debug_frame.fdes.empty(); }
+
+        /** @return The virtual address (as used by the unwind tables) that is loaded from some file offset */
+        [[nodiscard]] std::optional<std::uint64_t> file_offset_to_address(std::uint64_t offset) const;
+
+        /**
+         * Find the rules for recovering the caller's registers at some address
+         *
+         * @param address The virtual address within the file
+         * @return The rules, or empty if no FDE covers the address or its instructions could not be interpreted
+         */
+        [[nodiscard]] std::optional<unwind_row_t> find_row(std::uint64_t address) const;
+
+    private:
+        struct loadable_segment_t {
+            std::uint64_t offset;
+            std::uint64_t address;
+            std::uint64_t size;
+        };
+
+        struct fde_entry_t {
+            std::uint64_t pc_begin;
+            std::uint64_t pc_end;
+            /** The offset of the FDE's length field within its section */
+            std::size_t offset;
+        };
+
+        struct section_t {
+            char const * data = nullptr;
+            std::size_t size = 0;
+            /** The virtual address of the section, for pc relative pointers */
+            std::uint64_t address = 0;
+            /** True for .eh_frame (rather than .debug_frame), which differs in the encoding of the CIE pointers */
+            bool is_eh_frame = false;
+            /** Sorted by pc_begin */
+            std::vector<fde_entry_t> fdes {};
+        };
+
+        char const * data;
+        std::size_t size;
+        std::string build_id {};
+        std::vector<loadable_segment_t> segments {};
+        section_t eh_frame {};
+        section_t debug_frame {};
+
+        dwarf_unwind_table_t(char const * data, std::size_t size);
+
+        /** Find the segments, build id and unwind table sections */
+        [[nodiscard]] bool read_headers();
+
+        [[nodiscard]] static std::optional<unwind_row_t> find_row(section_t const & section, std::uint64_t address);
+
+        static void index(section_t & section);
+    };
+}
@@ -12,9 +12,12 @@
 #include "lib/EnumUtils.h"
 #include "linux/perf/PerfUtils.h"
 
+#include <algorithm>
 #include <cstdint>
+#include <deque>
 #include <map>
 #include <memory>
+#include <optional>
 #include <set>
 #include <stdexcept>
 #include <utility>
@@ -154,6 +157,26 @@ namespace agents::perf {
             return !(core_no_to_spe_type.empty() || configuration.spe_events.empty());
         }
 
+        /** @return true if any event is an inherited counter, whose value must be read periodically */
+        [[nodiscard]] bool has_inherited_counters() const
+        {
+            bool result = false;
+            for_each_event_definition(configuration, [&result](event_definition_t const & event) {
+                result = result || is_inherited_counter(event);
+            });
+            return result;
+        }
+
+        /** @return true if any event is a CoreSight ETM's */
+        [[nodiscard]] bool has_etm() const
+        {
+            bool result = false;
+            for_each_event_definition(configuration, [this, &result](event_definition_t const & event) {
+                result = result || perf_activator->is_etm_type(event.attr.type);
+            });
+            return result;
+        }
+
         /** @return true if the cpu requires an aux buffer */
         [[nodiscard]] bool requires_aux(core_no_t no) const
         {
@@ -382,6 +405,248 @@ namespace agents::perf {
             core_offline_it(it);
         }
 
+        /**
+         * Rotate the multiplexed CPU PMU event groups on every online core, so that each is counted in turn
+         *
+         * @param activity_tracker A callable of `void(core_no_t, gator_key_t, bool)` that receives the key of each
+         * group leader whose group was disabled (false) or onlined (true)
+         */
+        template<typename ActivityTracker>
+        void rotate_multiplex_groups(ActivityTracker && activity_tracker)
+        {
+            if (!capture_started) {
+                return;
+            }
+
+            for (auto it = core_properties.begin(); it != core_properties.end();) {
+                auto const no = it->first;
+                bool failed = false;
+
+                for (auto & entry : it->second.binding_sets) {
+                    auto result = entry.second.rotate_multiplex_groups(*perf_activator,
+                                                                       [&](gator_key_t key, bool active) {
+                                                                           activity_tracker(no, key, active);
+                                                                       });
+
+                    if ((result == aggregate_state_t::offline) || (result == aggregate_state_t::failed)) {
+                        LOG_DEBUG("Rotating multiplexed groups on core %d for pid %d %s, removing core",
+                                  lib::toEnumValue(no),
+                                  entry.first,
+                                  (result == aggregate_state_t::offline ? "found it offline" : "failed with error"));
+                        failed = true;
+                        break;
+                    }
+                }
+
+                if (failed) {
+                    core_offline_it(it++);
+                }
+                else {
+                    ++it;
+                }
+            }
+        }
+
+        /**
+         * Read the value of each online inherited counter, which includes the counts of the threads that have exited
+         *
+         * @param count_tracker A callable of `void(core_no_t, gator_key_t, perf_event_id_t, std::uint64_t)` that
+         * receives the core, key, id and value of each counter
+         */
+        template<typename CountTracker>
+        void read_inherited_counters(CountTracker && count_tracker)
+        {
+            if (!capture_started) {
+                return;
+            }
+
+            for (auto & core : core_properties) {
+                auto const no = core.first;
+                for (auto & entry : core.second.binding_sets) {
+                    entry.second.for_each_online_inherited_counter([&](auto & binding) {
+                        auto const count = perf_activator->read_count(binding.get_fd());
+                        if (count) {
+                            count_tracker(no, binding.get_key(), binding.get_id(), *count);
+                        }
+                    });
+                }
+            }
+        }
+
+        /**
+         * Enable or disable each online CoreSight ETM event, so that the trace is strobed
+         *
+         * @param enable True to enable them, false to disable them
+         */
+        void set_etm_enabled(bool enable)
+        {
+            if (!capture_started) {
+                return;
+            }
+
+            for (auto & core : core_properties) {
+                for (auto & entry : core.second.binding_sets) {
+                    entry.second.for_each_online_aux_event([&](auto & binding) {
+                        if (perf_activator->is_etm_type(binding.get_type())) {
+                            if (enable) {
+                                perf_activator->re_enable(binding.get_fd());
+                            }
+                            else {
+                                perf_activator->stop(binding.get_fd());
+                            }
+                        }
+                    });
+                }
+            }
+        }
+
+        /**
+         * Disable every online event, on all cores, in one pass at the end of the capture, so that none of the ring
+         * buffers are still being filled while they are drained (which would otherwise make the final drain of a busy
+         * cpu take as long as it keeps producing data). The events are left open; they are closed when the capture's
+         * state is destroyed.
+         */
+        void stop_all()
+        {
+            if (!capture_started) {
+                return;
+            }
+
+            std::size_t count = 0;
+            for (auto & core : core_properties) {
+                for (auto & entry : core.second.binding_sets) {
+                    entry.second.for_each_online_event([&](auto & binding) {
+                        perf_activator->stop(binding.get_fd());
+                        ++count;
+                    });
+                }
+            }
+
+            LOG_DEBUG("Disabled %zu events", count);
+        }
+
+        /**
+         * Change the events of a running capture, first removing and then adding the events of `reconfiguration` on
+         * every online core (for each tracked thread, in app mode). The cores and threads that come online later are
+         * created with the changed events. The added events are not enabled until `reconfigure_start` is called, which
+         * must be once their id->key mappings are sent.
+         *
+         * @param reconfiguration The events to remove and add
+         * @return The id->key mappings of the added events
+         */
+        [[nodiscard]] id_to_key_mappings_t reconfigure_prepare(perf_capture_reconfiguration_t const & reconfiguration)
+        {
+            LOG_DEBUG("Reconfigure removing %zu events, adding %zu global events and the events of %zu clusters",
+                      reconfiguration.removed_keys.size(),
+                      reconfiguration.global_events.size(),
+                      reconfiguration.cluster_specific_events.size());
+
+            // the removed events of the configuration are skipped by the binding sets created from now on, as are any
+            // that were added before
+            removed_configuration_keys.insert(reconfiguration.removed_keys.begin(),
+                                              reconfiguration.removed_keys.end());
+            for (auto & entry : live_events) {
+                entry.removed = entry.removed || (reconfiguration.removed_keys.count(entry.definition.event.key) > 0);
+            }
+
+            // the added events are kept for as long as the bindings refer to them
+            auto const first_added = live_events.size();
+            for (auto const & definition : reconfiguration.global_events) {
+                live_events.push_back(live_event_entry_t {definition, std::nullopt});
+            }
+            for (auto const & [cluster_id, definitions] : reconfiguration.cluster_specific_events) {
+                for (auto const & definition : definitions) {
+                    live_events.push_back(live_event_entry_t {definition, cluster_id});
+                }
+            }
+
+            id_to_key_mappings_t id_to_key_mappings {};
+
+            for (auto & core : core_properties) {
+                auto & properties = core.second;
+                if ((properties.mmap == nullptr) || (properties.header_event_fd == nullptr)) {
+                    continue;
+                }
+
+                auto spe_it = core_no_to_spe_type.find(properties.no);
+                const auto spe_type = (spe_it != core_no_to_spe_type.end() ? spe_it->second : 0);
+
+                // the monitor already observes each thread's exit through the fds of its other events
+                auto mmap_tracker = make_mmap_tracker(perf_activator,
+                                                      properties.mmap,
+                                                      properties.header_event_fd,
+                                                      properties.no,
+                                                      properties.cluster_id,
+                                                      [](pid_t, std::shared_ptr<stream_descriptor_t>, bool) {});
+
+                for (auto & entry : properties.binding_sets) {
+                    auto const pid = entry.first;
+                    auto & binding_set = entry.second;
+
+                    binding_set.remove_live_events(*perf_activator, reconfiguration.removed_keys);
+
+                    for (auto n = first_added; n < live_events.size(); ++n) {
+                        auto const & added = live_events[n];
+                        if (added.cluster_id && (*added.cluster_id != properties.cluster_id)) {
+                            continue;
+                        }
+
+                        auto result = binding_set.add_live_event(
+                            added.definition,
+                            [&id_to_key_mappings](gator_key_t key, perf_event_id_t id) {
+                                id_to_key_mappings.emplace_back(id, key);
+                            },
+                            [pid, &mmap_tracker](std::shared_ptr<stream_descriptor_t> fd, bool requires_aux) {
+                                return mmap_tracker(pid, std::move(fd), requires_aux);
+                            },
+                            *perf_activator,
+                            spe_type);
+
+                        if (result != aggregate_state_t::usable) {
+                            LOG_DEBUG("Reconfigure could not add event %d on core %d for pid %d",
+                                      lib::toEnumValue(added.definition.event.key),
+                                      lib::toEnumValue(properties.no),
+                                      pid);
+                        }
+                    }
+                }
+            }
+
+            return id_to_key_mappings;
+        }
+
+        /** Enable the events that `reconfigure_prepare` added */
+        void reconfigure_start()
+        {
+            if (!capture_started) {
+                return;
+            }
+
+            for (auto it = core_properties.begin(); it != core_properties.end();) {
+                bool failed = false;
+
+                for (auto & entry : it->second.binding_sets) {
+                    auto result = entry.second.start_live_events(*perf_activator);
+
+                    if ((result == aggregate_state_t::offline) || (result == aggregate_state_t::failed)) {
+                        LOG_DEBUG("Reconfigure start on core %d for pid %d %s, removing core",
+                                  lib::toEnumValue(it->first),
+                                  entry.first,
+                                  (result == aggregate_state_t::offline ? "found it offline" : "failed with error"));
+                        failed = true;
+                        break;
+                    }
+                }
+
+                if (failed) {
+                    core_offline_it(it++);
+                }
+                else {
+                    ++it;
+                }
+            }
+        }
+
         /**
          * Add a new PID (a thread) to the set of threads that are currently being captured.
          *
@@ -609,6 +874,15 @@ namespace agents::perf {
             constexpr core_properties_t(core_no_t no, cpu_cluster_id_t cluster_id) : no(no), cluster_id(cluster_id) {}
         };
 
+        /** An event that was added while the capture was running */
+        struct live_event_entry_t {
+            live_event_definition_t definition;
+            /** The cluster whose cores count the event, or empty for every core */
+            std::optional<cpu_cluster_id_t> cluster_id;
+            /** Set once the event was removed again */
+            bool removed {false};
+        };
+
         std::shared_ptr<perf_activator_t> perf_activator;
         event_configuration_t const & configuration;
         std::vector<perf_capture_configuration_t::uncore_pmu_t> const & uncore_pmus;
@@ -620,6 +894,10 @@ namespace agents::perf {
         bool capture_started {false};
         std::set<pid_t> tracked_pids {};
         std::set<uncore_pmu_id_t> all_active_uncore_pmu_ids {};
+        /** The events that were added while the capture was running, which the bindings refer to so are never erased */
+        std::deque<live_event_entry_t> live_events {};
+        /** The keys of the events of the configuration that were removed while the capture was running */
+        std::set<gator_key_t> removed_configuration_keys {};
 
         /**
          * Create the binding sets for some core.
@@ -732,7 +1010,8 @@ namespace agents::perf {
             auto has_no_events = configuration.global_events.empty()
                               && ((cluster_events == nullptr) || cluster_events->empty())
                               && ((core_events == nullptr) || core_events->empty())
-                              && ((spe_type == 0) || configuration.spe_events.empty()) && (uncore_event_count == 0);
+                              && ((spe_type == 0) || configuration.spe_events.empty()) && (uncore_event_count == 0)
+                              && !has_live_events_for(properties.cluster_id);
 
             if (has_no_events) {
                 LOG_DEBUG("No events configured for cpu=%d, pid=%d", lib::toEnumValue(properties.no), pid);
@@ -788,6 +1067,23 @@ namespace agents::perf {
                 all_active_uncore_pmu_ids.insert(id);
             }
 
+            // then apply the changes made while the capture was running
+            if (!removed_configuration_keys.empty()) {
+                binding_set.remove_live_events(*perf_activator, removed_configuration_keys);
+            }
+
+            for (auto const & entry : live_events) {
+                if (entry.removed || (entry.cluster_id && (*entry.cluster_id != properties.cluster_id))) {
+                    continue;
+                }
+                if (!binding_set.add_live_definition(entry.definition)) {
+                    LOG_DEBUG("Could not add the live event %d for cpu=%d, pid=%d",
+                              lib::toEnumValue(entry.definition.event.key),
+                              lib::toEnumValue(properties.no),
+                              pid);
+                }
+            }
+
             // now all the bindings are created, now create the events
             auto result = binding_set.create_events(
                 enable_on_exec && !capture_started,
@@ -827,6 +1123,14 @@ namespace agents::perf {
             }
         }
 
+        /** @return True if any event that was added while the capture was running is counted by the cluster */
+        [[nodiscard]] bool has_live_events_for(cpu_cluster_id_t cluster_id) const
+        {
+            return std::any_of(live_events.begin(), live_events.end(), [cluster_id](auto const & entry) {
+                return (!entry.removed) && ((!entry.cluster_id) || (*entry.cluster_id == cluster_id));
+            });
+        }
+
         /** Find all uncore pmus associated with some core that need to be brought online */
         [[nodiscard]] std::pair<std::set<uncore_pmu_id_t>, std::size_t> find_all_uncore_ids_for(core_no_t no, pid_t pid)
         {
@@ -10,12 +10,15 @@
 #include "lib/EnumUtils.h"
 #include "lib/Span.h"
 
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
 #include <functional>
 #include <map>
 #include <optional>
+#include <set>
 #include <stdexcept>
+#include <utility>
 #include <vector>
 
 #include <boost/asio/posix/stream_descriptor.hpp>
@@ -77,6 +80,9 @@ namespace agents::perf {
         /** @return the perf id associated with the event */
         [[nodiscard]] perf_event_id_t get_id() const { return perf_id; }
 
+        /** @return the attribute type of the event */
+        [[nodiscard]] std::uint32_t get_type() const { return event.attr.type; }
+
         /** @return the file descriptor associated with the event */
         [[nodiscard]] int get_fd() { return (fd ? fd->native_handle() : -1); }
 
@@ -86,6 +92,21 @@ namespace agents::perf {
         /** @return true if the event is in the offline state, or false otherwise */
         [[nodiscard]] bool is_offline() const { return state == event_binding_state_t::offline; }
 
+        /** @return true if the event is online */
+        [[nodiscard]] bool is_online() const { return state == event_binding_state_t::online; }
+
+        /** @return true if the event is online and is an inherited counter, whose value must be read */
+        [[nodiscard]] bool is_online_inherited_counter() const
+        {
+            return (state == event_binding_state_t::online) && is_inherited_counter(event);
+        }
+
+        /** @return true if the event is online and writes to the aux buffer */
+        [[nodiscard]] bool is_online_aux_event() const
+        {
+            return (state == event_binding_state_t::online) && is_aux_event(event);
+        }
+
         /** Set the event id as read from the legacy read id method */
         void set_id(perf_event_id_t id) { perf_id = id; }
 
@@ -157,6 +178,25 @@ namespace agents::perf {
             }
         }
 
+        /** Disable the event if it is online, transitioning back to 'ready' */
+        template<typename PerfActivator>
+        [[nodiscard]] event_binding_state_t pause(PerfActivator && activator)
+        {
+            if (state != event_binding_state_t::online) {
+                return state;
+            }
+
+            auto result = activator.stop(fd->native_handle());
+
+            if ((!result) && (fd->native_handle() == -1)) {
+                LOG_DEBUG("Raced against fd->close(), ignoring failure to pause");
+                return state;
+            }
+
+            state = (result ? event_binding_state_t::ready : event_binding_state_t::failed);
+            return state;
+        }
+
         /** Clean up all data and move back to 'offline' or 'failed' state */
         template<typename PerfActivator>
         void stop(PerfActivator && activator, bool failed)
@@ -173,10 +213,10 @@ namespace agents::perf {
         }
 
     private:
-        /** Does the attr require an aux buffer ? */
-        static constexpr bool requires_aux(std::uint64_t spe_type, std::uint64_t attr_type)
+        /** Does the attr require an aux buffer ? (the SPE's always do, any other PMU's do if configured to) */
+        static constexpr bool requires_aux(std::uint64_t spe_type, perf_event_attr const & attr)
         {
-            return ((attr_type >= PERF_TYPE_MAX) && (attr_type == spe_type));
+            return ((attr.type >= PERF_TYPE_MAX) && ((attr.type == spe_type) || (attr.aux_watermark != 0)));
         }
 
         /** The attribute structure */
@@ -207,7 +247,7 @@ namespace agents::perf {
             switch (result.status) {
                 case perf_activator_t::event_creation_status_t::success: {
                     // add it to the mmap
-                    if (!mmap_tracker(result.fd, requires_aux(spe_type, event.attr.type))) {
+                    if (!mmap_tracker(result.fd, requires_aux(spe_type, event.attr))) {
                         return event_binding_state_t::failed;
                     }
                     // success
@@ -243,6 +283,7 @@ namespace agents::perf {
         using event_binding_type = event_binding_t<StreamDescriptor>;
 
         event_binding_group_t(event_definition_t const & leader, lib::Span<event_definition_t const> children)
+            : multiplex_group(leader.multiplex_group)
         {
             runtime_assert(children.empty() || ((leader.attr.read_format & PERF_FORMAT_GROUP) == PERF_FORMAT_GROUP),
                            "Must be a stand alone attribute, or PERF_FORMAT_GROUP is required");
@@ -255,6 +296,12 @@ namespace agents::perf {
             }
         }
 
+        /** @return the key associated with the group leader */
+        [[nodiscard]] gator_key_t get_leader_key() const { return bindings.front().get_key(); }
+
+        /** @return the multiplex group index of the group, or 0 if it is not rotated onto the PMU */
+        [[nodiscard]] std::uint32_t get_multiplex_group() const { return multiplex_group; }
+
         /** Insert another child event into the group */
         [[nodiscard]] bool add_event(event_definition_t const & event)
         {
@@ -414,6 +461,31 @@ namespace agents::perf {
             }
         }
 
+        /** Disable the events if they are online, transitioning back to 'ready' */
+        template<typename PerfActivator>
+        [[nodiscard]] aggregate_state_t pause(PerfActivator && activator)
+        {
+            auto result = bindings.front().pause(activator);
+            switch (result) {
+                case event_binding_state_t::offline:
+                    return aggregate_state_t::offline;
+
+                case event_binding_state_t::ready:
+                    return aggregate_state_t::usable;
+
+                case event_binding_state_t::failed:
+                case event_binding_state_t::not_supported:
+                    return aggregate_state_t::failed;
+
+                case event_binding_state_t::terminated:
+                    return aggregate_state_t::terminated;
+
+                case event_binding_state_t::online:
+                default:
+                    throw std::runtime_error("unexpected event_binding_state_t");
+            }
+        }
+
         /** Clean up all data and move back to 'offline' or 'failed' state */
         template<typename PerfActivator>
         void stop(PerfActivator && activator, bool failed)
@@ -423,8 +495,129 @@ namespace agents::perf {
             }
         }
 
+        /**
+         * Create another child event in a group whose leader was already created, as for the events added to a running
+         * capture. A group that is counting is disabled while the event is added, so that its id->key mapping can be
+         * sent before any sample that reads it; it is then restarted by the set's `start_live_events`.
+         *
+         * @return usable if the event was created (or is not supported, which is ignored as for `create_events`),
+         * otherwise the reason it was not
+         */
+        template<typename IdToKeyMappingTracker, typename MmapTracker, typename PerfActivator>
+        [[nodiscard]] aggregate_state_t add_live_event(event_definition_t const & event,
+                                                       IdToKeyMappingTracker && id_to_key_mapping_tracker,
+                                                       MmapTracker && mmap_tracker,
+                                                       PerfActivator && activator,
+                                                       core_no_t core_no,
+                                                       pid_t pid,
+                                                       std::uint32_t spe_type)
+        {
+            if (bindings.front().is_offline()) {
+                return aggregate_state_t::offline;
+            }
+
+            if (bindings.front().is_online()) {
+                auto result = pause(activator);
+                if (result != aggregate_state_t::usable) {
+                    return result;
+                }
+                pending_start = true;
+            }
+
+            auto const group_fd = bindings.front().get_fd();
+            auto & child = bindings.emplace_back(event);
+            auto child_state = child.create_event(false, group_fd, mmap_tracker, activator, core_no, pid, spe_type);
+
+            switch (child_state) {
+                case event_binding_state_t::ready:
+                case event_binding_state_t::online:
+                    id_to_key_mapping_tracker(child.get_key(), child.get_id());
+                    return aggregate_state_t::usable;
+
+                case event_binding_state_t::not_supported:
+                    return aggregate_state_t::usable;
+
+                case event_binding_state_t::offline:
+                    return aggregate_state_t::offline;
+
+                case event_binding_state_t::terminated:
+                    return aggregate_state_t::terminated;
+
+                case event_binding_state_t::failed:
+                    return aggregate_state_t::failed;
+
+                default:
+                    throw std::runtime_error("unexpected event_binding_state_t");
+            }
+        }
+
+        /**
+         * Stop and remove the child events whose key is one of `keys` (a removed leader is removed along with its
+         * group by the binding set)
+         */
+        template<typename PerfActivator>
+        void remove_events(PerfActivator && activator, std::set<gator_key_t> const & keys)
+        {
+            std::vector<event_binding_type> kept {};
+            kept.reserve(bindings.size());
+
+            for (std::size_t n = 0; n < bindings.size(); ++n) {
+                auto & binding = bindings[n];
+                if ((n == 0) || (keys.count(binding.get_key()) == 0)) {
+                    kept.emplace_back(std::move(binding));
+                }
+                else {
+                    binding.stop(activator, false);
+                }
+            }
+
+            bindings = std::move(kept);
+        }
+
+        /** Mark the group as needing to be started by the set's next `start_live_events`, as for a new group */
+        void set_pending_start() { pending_start = true; }
+
+        /** @return True if the group was marked as needing to be started, clearing the mark */
+        [[nodiscard]] bool take_pending_start() { return std::exchange(pending_start, false); }
+
+        /** Call `consumer` with each online inherited counter in the group */
+        template<typename Consumer>
+        void for_each_online_inherited_counter(Consumer && consumer)
+        {
+            for (auto & binding : bindings) {
+                if (binding.is_online_inherited_counter()) {
+                    consumer(binding);
+                }
+            }
+        }
+
+        /** Call `consumer` with each online aux event in the group */
+        template<typename Consumer>
+        void for_each_online_aux_event(Consumer && consumer)
+        {
+            for (auto & binding : bindings) {
+                if (binding.is_online_aux_event()) {
+                    consumer(binding);
+                }
+            }
+        }
+
+        /** Call `consumer` with each online event in the group */
+        template<typename Consumer>
+        void for_each_online_event(Consumer && consumer)
+        {
+            for (auto & binding : bindings) {
+                if (binding.is_online()) {
+                    consumer(binding);
+                }
+            }
+        }
+
     private:
         std::vector<event_binding_type> bindings {};
+        std::uint32_t multiplex_group;
+        /** Set once events were added to the group while it was running, until it is restarted */
+        bool pending_start {false};
 
         /**
          * Destroy any events previously created and return an error
@@ -495,7 +688,8 @@ namespace agents::perf {
         /**
          * Give some event definitions, where the first is a group leader and the rest are
          * a mix of stand alone events and members of that group, create the appropriate
-         * events and groups and add them to the set
+         * events and groups and add them to the set. Any further group leaders (as for the
+         * multiplexed CPU PMU events) start a new group, which the members that follow join.
          *
          * @retval true if the events were successfully added
          * @retval false if the events wer not added (e.g. because the bindings were not offline, or the span is empty)
@@ -508,14 +702,20 @@ namespace agents::perf {
 
             runtime_assert(is_group_leader(events.front()), "First item must be group leader");
 
-            auto & group = groups.emplace_back(events.front(), lib::Span<event_definition_t const>());
+            // by index, as adding the stand alone events may reallocate the groups
+            auto group_index = groups.size();
+            groups.emplace_back(events.front(), lib::Span<event_definition_t const>());
 
             for (auto const & event : events.subspan(1)) {
-                if (is_stand_alone(event)) {
+                if (is_multiplex_group_leader(event)) {
+                    group_index = groups.size();
+                    groups.emplace_back(event, lib::Span<event_definition_t const>());
+                }
+                else if (is_stand_alone(event)) {
                     groups.emplace_back(event, lib::Span<event_definition_t const>());
                 }
                 else {
-                    auto result = group.add_event(event);
+                    auto result = groups.at(group_index).add_event(event);
                     runtime_assert(result, "expected event to be inserted into new group");
                 }
             }
@@ -523,6 +723,133 @@ namespace agents::perf {
             return true;
         }
 
+        /**
+         * Add an event that was added to a running capture to a set whose events are not yet created, either joining
+         * the group led by `leader_key`, or as a new stand alone event or group leader.
+         *
+         * @retval true if the event was successfully added
+         * @retval false if the event was not added (e.g. because the bindings were not offline, or the group it joins
+         * is not in the set)
+         */
+        [[nodiscard]] bool add_live_definition(live_event_definition_t const & definition)
+        {
+            if (state != aggregate_state_t::offline) {
+                return false;
+            }
+
+            if (definition.leader_key == gator_key_t {0}) {
+                groups.emplace_back(definition.event, lib::Span<event_definition_t const>());
+                return true;
+            }
+
+            auto * group = find_group_for(definition);
+            return (group != nullptr) && group->add_event(definition.event);
+        }
+
+        /**
+         * Add an event that was added to a running capture to a set whose events were already created, creating it
+         * either as a member of the group led by `leader_key`, or as a new stand alone event or group leader. As with
+         * `create_events` the event is not enabled; it is enabled by `start_live_events`. A failure to create the event
+         * does not change the state of the set, so that its other events keep counting.
+         *
+         * @return usable if the event was created, or otherwise the reason it was not
+         */
+        template<typename IdToKeyMappingTracker, typename MmapTracker, typename PerfActivator>
+        [[nodiscard]] aggregate_state_t add_live_event(live_event_definition_t const & definition,
+                                                       IdToKeyMappingTracker && id_to_key_mapping_tracker,
+                                                       MmapTracker && mmap_tracker,
+                                                       PerfActivator && activator,
+                                                       std::uint32_t spe_type)
+        {
+            if (state != aggregate_state_t::usable) {
+                return state;
+            }
+
+            // the ids of the legacy kernels are read from the whole group, which cannot be done for one more member
+            if (activator.is_legacy_kernel_requires_id_from_read()) {
+                return aggregate_state_t::failed;
+            }
+
+            if (definition.leader_key != gator_key_t {0}) {
+                auto * group = find_group_for(definition);
+                if (group == nullptr) {
+                    return aggregate_state_t::failed;
+                }
+                return group->add_live_event(definition.event,
+                                             id_to_key_mapping_tracker,
+                                             mmap_tracker,
+                                             activator,
+                                             core_no,
+                                             pid,
+                                             spe_type);
+            }
+
+            auto & group = groups.emplace_back(definition.event, lib::Span<event_definition_t const>());
+            auto result =
+                group.create_events(false, id_to_key_mapping_tracker, mmap_tracker, activator, core_no, pid, spe_type);
+            if (result != aggregate_state_t::usable) {
+                groups.pop_back();
+                return result;
+            }
+
+            group.set_pending_start();
+            return result;
+        }
+
+        /**
+         * Remove the events whose key is one of `keys`, which removes the whole group of any removed group leader.
+         * The set may be offline, or its events may have been created.
+         */
+        template<typename PerfActivator>
+        void remove_live_events(PerfActivator && activator, std::set<gator_key_t> const & keys)
+        {
+            auto it = std::remove_if(groups.begin(), groups.end(), [&](auto & group) {
+                if (keys.count(group.get_leader_key()) > 0) {
+                    group.stop(activator, false);
+                    return true;
+                }
+                group.remove_events(activator, keys);
+                return false;
+            });
+
+            groups.erase(it, groups.end());
+        }
+
+        /**
+         * Enable the groups that `add_live_event` created or added to, once their id->key mappings were sent. Does
+         * nothing until the set was started, as `start` enables them.
+         */
+        template<typename PerfActivator>
+        [[nodiscard]] aggregate_state_t start_live_events(PerfActivator && activator)
+        {
+            if ((state != aggregate_state_t::usable) || !started) {
+                return state;
+            }
+
+            // the added groups may be the first that are multiplexed
+            if (active_multiplex_group == 0) {
+                active_multiplex_group = next_multiplex_group(0);
+            }
+
+            for (auto & group : groups) {
+                if (!group.take_pending_start()) {
+                    continue;
+                }
+
+                if ((group.get_multiplex_group() != 0) && (group.get_multiplex_group() != active_multiplex_group)) {
+                    // left ready until it is rotated onto the PMU
+                    continue;
+                }
+
+                auto result = group.start(activator);
+                if (result != aggregate_state_t::usable) {
+                    return (state = destroy_groups(activator, groups.size(), result));
+                }
+            }
+
+            return state;
+        }
+
         /** @return the current state */
         [[nodiscard]] aggregate_state_t get_state() const noexcept { return state; }
 
@@ -562,13 +889,22 @@ namespace agents::perf {
             return (state = (any_usable ? aggregate_state_t::usable : aggregate_state_t::terminated));
         }
 
-        /**  Attempt to online all the event bindings. */
+        /**  Attempt to online all the event bindings (of the multiplexed groups, only the first is onlined). */
         template<typename PerfActivator>
         [[nodiscard]] aggregate_state_t start(PerfActivator && activator)
         {
             bool any_usable = false;
 
+            active_multiplex_group = next_multiplex_group(0);
+            started = true;
+
             for (auto & group : groups) {
+                if ((group.get_multiplex_group() != 0) && (group.get_multiplex_group() != active_multiplex_group)) {
+                    // left ready until it is rotated onto the PMU
+                    any_usable = true;
+                    continue;
+                }
+
                 auto result = group.start(activator);
                 switch (result) {
                     case aggregate_state_t::usable:
@@ -587,6 +923,77 @@ namespace agents::perf {
             return (state = (any_usable ? aggregate_state_t::usable : aggregate_state_t::terminated));
         }
 
+        /**
+         * Disable the active multiplexed group and online the next, so that each of them is counted in turn.
+         * Does nothing unless there is more than one multiplexed group and the set was started.
+         *
+         * @param activity_tracker A callable of `void(gator_key_t, bool)` that receives the key of each group leader
+         * whose group was disabled (false) or onlined (true)
+         * @return the current state
+         */
+        template<typename PerfActivator, typename ActivityTracker>
+        [[nodiscard]] aggregate_state_t rotate_multiplex_groups(PerfActivator && activator,
+                                                                ActivityTracker && activity_tracker)
+        {
+            auto const next = next_multiplex_group(active_multiplex_group);
+
+            if ((state != aggregate_state_t::usable) || (active_multiplex_group == 0)
+                || (next == active_multiplex_group)) {
+                return state;
+            }
+
+            for (auto & group : groups) {
+                if (group.get_multiplex_group() == active_multiplex_group) {
+                    auto result = group.pause(activator);
+                    if (result != aggregate_state_t::usable) {
+                        return (state = destroy_groups(activator, groups.size(), result));
+                    }
+                    activity_tracker(group.get_leader_key(), false);
+                }
+            }
+
+            active_multiplex_group = next;
+
+            for (auto & group : groups) {
+                if (group.get_multiplex_group() == active_multiplex_group) {
+                    auto result = group.start(activator);
+                    if (result != aggregate_state_t::usable) {
+                        return (state = destroy_groups(activator, groups.size(), result));
+                    }
+                    activity_tracker(group.get_leader_key(), true);
+                }
+            }
+
+            return state;
+        }
+
+        /** Call `consumer` with each online inherited counter in the set */
+        template<typename Consumer>
+        void for_each_online_inherited_counter(Consumer && consumer)
+        {
+            for (auto & group : groups) {
+                group.for_each_online_inherited_counter(consumer);
+            }
+        }
+
+        /** Call `consumer` with each online aux event in the set */
+        template<typename Consumer>
+        void for_each_online_aux_event(Consumer && consumer)
+        {
+            for (auto & group : groups) {
+                group.for_each_online_aux_event(consumer);
+            }
+        }
+
+        /** Call `consumer` with each online event in the set */
+        template<typename Consumer>
+        void for_each_online_event(Consumer && consumer)
+        {
+            for (auto & group : groups) {
+                group.for_each_online_event(consumer);
+            }
+        }
+
         /** Clean up all data and move back to 'offline' state. */
         template<typename PerfActivator>
         void offline(PerfActivator && activator)
@@ -595,6 +1002,8 @@ namespace agents::perf {
                 group.stop(activator, false);
             }
             state = aggregate_state_t::offline;
+            active_multiplex_group = 0;
+            started = false;
         }
 
     private:
@@ -608,10 +1017,53 @@ namespace agents::perf {
             return event.attr.pinned;
         }
 
+        [[nodiscard]] static constexpr bool is_multiplex_group_leader(event_definition_t const & event)
+        {
+            return event.attr.pinned && (event.multiplex_group != 0);
+        }
+
         std::vector<event_binding_group_type> groups {};
         core_no_t core_no;
         pid_t pid;
         aggregate_state_t state {aggregate_state_t::offline};
+        /** The multiplexed groups that are currently onlined, or 0 if there are none */
+        std::uint32_t active_multiplex_group {0};
+        /** Set once the set was started */
+        bool started {false};
+
+        /** @return The group that an added event joins, or nullptr if it is not in the set */
+        [[nodiscard]] event_binding_group_type * find_group_for(live_event_definition_t const & definition)
+        {
+            for (auto & group : groups) {
+                if ((group.get_leader_key() == definition.leader_key)
+                    && (group.get_multiplex_group() == definition.event.multiplex_group)) {
+                    return &group;
+                }
+            }
+            return nullptr;
+        }
+
+        /** @return The next multiplex group index after `after`, wrapping around (or 0 if there are none) */
+        [[nodiscard]] std::uint32_t next_multiplex_group(std::uint32_t after) const
+        {
+            std::uint32_t first = 0;
+            std::uint32_t next = 0;
+
+            for (auto const & group : groups) {
+                auto const index = group.get_multiplex_group();
+                if (index == 0) {
+                    continue;
+                }
+                if ((first == 0) || (index < first)) {
+                    first = index;
+                }
+                if ((index > after) && ((next == 0) || (index < next))) {
+                    next = index;
+                }
+            }
+
+            return (next != 0 ? next : first);
+        }
 
         /**
          * Destroy any groups previously created and return an error
@@ -7,6 +7,7 @@
 
 #include <cstdint>
 #include <map>
+#include <string>
 #include <vector>
 
 namespace agents::perf {
@@ -17,6 +18,20 @@ namespace agents::perf {
     struct event_definition_t {
         perf_event_attr attr;
         gator_key_t key;
+        /** The (one based) index of the group of CPU PMU events that are rotated onto the PMU, or 0 if not rotated */
+        std::uint32_t multiplex_group;
+        /** The tracepoint's filter expression, set before the event is enabled, or empty for none */
+        std::string filter {};
+    };
+
+    /**
+     * Defines an event added to a capture that is already running, which either joins the group led by some event
+     * that is already counting, or is a stand alone event or the leader of a new group
+     */
+    struct live_event_definition_t {
+        event_definition_t event;
+        /** The key of the leader of the group that the event joins, or 0 if it does not join a group */
+        gator_key_t leader_key;
     };
 
     /**
@@ -36,4 +51,49 @@ namespace agents::perf {
         /** The map of CPU specific events, defining the events that may be activated for a specific CPU */
         std::map<core_no_t, std::vector<event_definition_t>> cpu_specific_events {};
     };
+
+    /** @return True for an event that writes to the aux buffer (such as the SPE's or the ETM's) */
+    [[nodiscard]] inline bool is_aux_event(event_definition_t const & event)
+    {
+        return event.attr.aux_watermark != 0;
+    }
+
+    /**
+     * @return True for an event that only counts (rather than being sampled) and is inherited by the monitored threads,
+     * so that the kernel sums the counts of the threads that exit into it (and, with inherit_stat, writes each one's
+     * PERF_RECORD_READ), and its value must be read
+     */
+    [[nodiscard]] inline bool is_inherited_counter(event_definition_t const & event)
+    {
+        return (event.attr.sample_period == 0) && (event.attr.freq == 0) && (event.attr.inherit != 0)
+            && ((event.attr.read_format & PERF_FORMAT_GROUP) == 0) && !is_aux_event(event);
+    }
+
+    /** Call `fn` with each event definition in the configuration, including the header event */
+    template<typename Fn>
+    void for_each_event_definition(event_configuration_t const & configuration, Fn && fn)
+    {
+        fn(configuration.header_event);
+        for (auto const & event : configuration.global_events) {
+            fn(event);
+        }
+        for (auto const & event : configuration.spe_events) {
+            fn(event);
+        }
+        for (auto const & events : configuration.cluster_specific_events) {
+            for (auto const & event : events.second) {
+                fn(event);
+            }
+        }
+        for (auto const & events : configuration.uncore_specific_events) {
+            for (auto const & event : events.second) {
+                fn(event);
+            }
+        }
+        for (auto const & events : configuration.cpu_specific_events) {
+            for (auto const & event : events.second) {
+                fn(event);
+            }
+        }
+    }
 }
@@ -25,6 +25,7 @@
 #include <boost/system/errc.hpp>
 #include <boost/system/error_code.hpp>
 
+#include <fcntl.h>
 #include <unistd.h>
 
 namespace agents::perf {
@@ -34,9 +35,11 @@ namespace agents::perf {
                                                   pid_t pid,
                                                   int core,
                                                   int group_fd,
-                                                  bool supports_cloexec)
+                                                  bool supports_cloexec,
+                                                  bool is_cgroup)
         {
-            auto const flags = PERF_FLAG_FD_OUTPUT | (supports_cloexec ? PERF_FLAG_FD_CLOEXEC : 0UL);
+            auto const flags = PERF_FLAG_FD_OUTPUT | (supports_cloexec ? PERF_FLAG_FD_CLOEXEC : 0UL)
+                             | (is_cgroup ? PERF_FLAG_PID_CGROUP : 0UL);
 
             int result = lib::perf_event_open(&attr, pid, core, group_fd, flags);
             if (result < 0) {
@@ -59,16 +62,26 @@ namespace agents::perf {
                                                                      int core,
                                                                      int group_fd,
                                                                      bool supports_cloexec,
-                                                                     lib::Span<std::array<bool, 3> const> patterns)
+                                                                     bool is_cgroup,
+                                                                     lib::Span<std::array<bool, 3> const> patterns,
+                                                                     std::size_t & pattern_index)
         {
-            for (auto const pattern : patterns) {
+            // try the pattern that last succeeded first, then the others in order
+            for (std::size_t n = 0; n <= patterns.size(); ++n) {
+                auto const index = (n == 0 ? pattern_index : n - 1);
+                if ((index >= patterns.size()) || ((n > 0) && (index == pattern_index))) {
+                    continue;
+                }
+
+                auto const & pattern = patterns[index];
+
                 // set
                 attr.exclude_kernel = pattern[0];
                 attr.exclude_hv = pattern[1];
                 attr.exclude_idle = pattern[2];
 
                 // try to open the event as is
-                auto fd = perf_event_open(attr, pid, core, group_fd, supports_cloexec);
+                auto fd = perf_event_open(attr, pid, core, group_fd, supports_cloexec, is_cgroup);
 
                 // take a copy of errno so that logging calls etc don't overwrite it
                 auto peo_errno = boost::system::errc::make_error_code(boost::system::errc::errc_t(errno));
@@ -80,6 +93,7 @@ namespace agents::perf {
                               bool(attr.exclude_hv),
                               bool(attr.exclude_idle));
 
+                    pattern_index = index;
                     return {std::move(fd)};
                 }
 
@@ -126,6 +140,7 @@ namespace agents::perf {
                                          off_t offset,
                                          int fd)
         {
+            // the pages are allocated by the kernel (on the node of the event's cpu), so MAP_HUGETLB is not applicable
             mmap_ptr_t result {lib::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset), length};
 
             if (!result) {
@@ -177,21 +192,96 @@ namespace agents::perf {
             return result;
         }
 
+        /** @return True if some mmap failed because it would exceed the locked memory limit (perf_event_mlock_kb) */
+        [[nodiscard]] bool is_mlock_limit_error(int error)
+        {
+            return (error == ENOMEM) || ((error == EPERM) && (getuid() != 0));
+        }
+
         /**
-         * Calculate the mmap region from @a config.
+         * Map some perf buffer, halving its size for as long as the mapping would exceed the locked memory limit and
+         * the buffer is larger than one page.
          *
-         * @param config Buffer config.
-         * @return Size in bytes.
+         * @param header_size The size of the part of the mapping that precedes the buffer
+         * @param buffer_size The size of the buffer, which is updated to the size that was last tried
+         * @param before_each Called with the buffer size before each attempt
          */
-        [[nodiscard]] constexpr std::size_t get_data_mmap_length(buffer_config_t const & config)
+        template<typename BeforeEach>
+        mmap_ptr_t try_mmap_shrinking(core_no_t core_no,
+                                      const buffer_config_t & config,
+                                      std::size_t header_size,
+                                      std::size_t & buffer_size,
+                                      off_t offset,
+                                      int fd,
+                                      BeforeEach && before_each)
         {
-            return config.page_size + config.data_buffer_size;
+            while (buffer_size > config.page_size) {
+                before_each(buffer_size);
+
+                auto const length = header_size + buffer_size;
+                mmap_ptr_t result {lib::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset), length};
+                if (result) {
+                    LOG_DEBUG("mmap passed for fd %i (mmapLength=%zu, offset=%zu)",
+                              fd,
+                              length,
+                              static_cast<std::size_t>(offset));
+                    return result;
+                }
+
+                if (!is_mlock_limit_error(errno)) {
+                    break;
+                }
+
+                LOG_DEBUG("mmap for fd %i exceeds the locked memory limit (mmapLength=%zu), retrying at half size",
+                          fd,
+                          length);
+                buffer_size /= 2;
+            }
+
+            // the last attempt reports the error
+            before_each(buffer_size);
+            return try_mmap_with_logging(core_no, config, header_size + buffer_size, offset, fd);
         }
     }
 
+    void perf_activator_t::open_cgroup()
+    {
+        auto const & cgroup = capture_configuration->session_data.cgroup;
+
+        if (cgroup.empty()) {
+            return;
+        }
+
+        //NOLINTNEXTLINE(hicpp-signed-bitwise) - O_RDONLY | O_DIRECTORY | O_CLOEXEC
+        cgroup_fd = lib::AutoClosingFd {lib::open(cgroup.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)};
+        if (!cgroup_fd) {
+            LOG_ERROR("Unable to open the cgroup '%s' (%s)", cgroup.c_str(), std::strerror(errno));
+        }
+
+        for (auto const & [id, events] : capture_configuration->event_configuration.uncore_specific_events) {
+            for (auto const & event : events) {
+                uncore_types.insert(event.attr.type);
+            }
+        }
+    }
+
+    bool perf_activator_t::is_cgroup_event(event_definition_t const & event, pid_t pid) const
+    {
+        // cgroup events are per cpu, and uncore pmus cannot tell which task caused an event
+        return (!capture_configuration->session_data.cgroup.empty()) && (pid == -1)
+            && (uncore_types.count(event.attr.type) == 0);
+    }
+
+    bool perf_activator_t::is_etm_type(std::uint32_t type) const
+    {
+        auto const & type_to_name = capture_configuration->perf_pmu_type_to_name;
+        auto const it = type_to_name.find(type);
+        return (it != type_to_name.end()) && (it->second == "cs_etm");
+    }
+
     bool perf_activator_t::is_legacy_kernel_requires_id_from_read() const
     {
-        return !capture_configuration->perf_config.has_ioctl_read_id;
+        return (!simulated_events) && (!capture_configuration->perf_config.has_ioctl_read_id);
     }
 
     std::pair<perf_activator_t::read_ids_status_t, std::vector<perf_event_id_t>>
@@ -250,6 +340,23 @@ namespace agents::perf {
         return {read_ids_status_t::failed_offline, {}};
     }
 
+    std::optional<std::uint64_t> perf_activator_t::read_count(int fd) const
+    {
+        if (simulated_events) {
+            return simulated_events->read_count(fd);
+        }
+
+        // the value, then any of the times and the id
+        std::uint64_t buffer[4] {};
+
+        auto const bytes = lib::read(fd, reinterpret_cast<char *>(buffer), sizeof(buffer));
+        if (bytes < static_cast<ssize_t>(sizeof(std::uint64_t))) {
+            return {};
+        }
+
+        return buffer[0];
+    }
+
     //NOLINTNEXTLINE(readability-function-cognitive-complexity)
     perf_activator_t::event_creation_result_t perf_activator_t::create_event(event_definition_t const & event,
                                                                              enable_state_t enable_state,
@@ -295,8 +402,32 @@ namespace agents::perf {
                   perf_event_printer.perf_attr_to_string(attr, core_no, "    ", "\n").c_str());
         LOG_DEBUG("perf_event_open: cpu: %d, pid: %d, leader = %d", lib::toEnumValue(core_no), pid, group_fd);
 
+        if (simulated_events) {
+            auto created = simulated_events->create_event(attr, core_no, group_fd);
+            if (!created.fd) {
+                return event_creation_result_t {
+                    boost::system::errc::make_error_code(boost::system::errc::errc_t(errno)),
+                    "Unable to create a simulated perf event"};
+            }
+            return event_creation_result_t {
+                created.perf_id,
+                std::make_shared<boost::asio::posix::stream_descriptor>(context, created.fd.release())};
+        }
+
+        // restrict the event to the cgroup, by passing its fd as the pid
+        auto const is_cgroup = is_cgroup_event(event, pid);
+        if (is_cgroup) {
+            if (!cgroup_fd) {
+                return event_creation_result_t {
+                    boost::system::errc::make_error_code(boost::system::errc::errc_t::bad_file_descriptor),
+                    "Unable to open the cgroup " + capture_configuration->session_data.cgroup};
+            }
+            pid = *cgroup_fd;
+        }
+
         lib::AutoClosingFd fd {};
         boost::system::error_code peo_errno {};
+        auto & pattern_index = exclude_pattern_indexes[{attr.type, bool(attr.exclude_kernel)}];
 
         // if the attr excludes kernel events, then try by excluding various combinations of exclude_bits starting from most restrictive
         if (attr.exclude_kernel) {
@@ -305,7 +436,9 @@ namespace agents::perf {
                                               int(core_no),
                                               group_fd,
                                               capture_configuration->perf_config.has_fd_cloexec,
-                                              exclude_pattern_exclude_kernel);
+                                              is_cgroup,
+                                              exclude_pattern_exclude_kernel,
+                                              pattern_index);
 
             lib::get_error_or_value(std::move(result), fd, peo_errno);
         }
@@ -315,7 +448,9 @@ namespace agents::perf {
                                               int(core_no),
                                               group_fd,
                                               capture_configuration->perf_config.has_fd_cloexec,
-                                              exclude_pattern_include_kernel);
+                                              is_cgroup,
+                                              exclude_pattern_include_kernel,
+                                              pattern_index);
 
             lib::get_error_or_value(std::move(result), fd, peo_errno);
         }
@@ -369,6 +504,29 @@ namespace agents::perf {
             return event_creation_result_t {peo_errno, error_message.str()};
         }
 
+        // restrict the ETM's trace to the address ranges of the filters, before the event is enabled
+        auto const & etm_filters = capture_configuration->session_data.etm_filters;
+        if (is_etm_type(attr.type) && !etm_filters.empty()) {
+            //NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast) - PERF_EVENT_IOC_SET_FILTER
+            if (lib::ioctl(*fd, PERF_EVENT_IOC_SET_FILTER, reinterpret_cast<unsigned long>(etm_filters.c_str())) != 0) {
+                peo_errno = boost::system::errc::make_error_code(boost::system::errc::errc_t(errno));
+                return event_creation_result_t {peo_errno,
+                                                "Unable to set the ETM filters '" + etm_filters + "' ("
+                                                    + peo_errno.message() + ")"};
+            }
+        }
+
+        // keep only the tracepoint's records that match its filter, before the event is enabled
+        if ((attr.type == PERF_TYPE_TRACEPOINT) && !event.filter.empty()) {
+            //NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast) - PERF_EVENT_IOC_SET_FILTER
+            if (lib::ioctl(*fd, PERF_EVENT_IOC_SET_FILTER, reinterpret_cast<unsigned long>(event.filter.c_str())) != 0) {
+                peo_errno = boost::system::errc::make_error_code(boost::system::errc::errc_t(errno));
+                return event_creation_result_t {peo_errno,
+                                                "Unable to set the tracepoint filter '" + event.filter + "' ("
+                                                    + peo_errno.message() + ")"};
+            }
+        }
+
         // read the id
         perf_event_id_t perf_id = perf_event_id_t::invalid;
 
@@ -392,11 +550,14 @@ namespace agents::perf {
                                         std::make_shared<boost::asio::posix::stream_descriptor>(context, fd.release())};
     }
 
-    //NOLINTNEXTLINE(readability-convert-member-functions-to-static)
     bool perf_activator_t::set_output(int fd, int output_fd)
     {
         runtime_assert((output_fd > 0), "invalid output_fd");
 
+        if (simulated_events) {
+            return simulated_events->set_output(fd, output_fd);
+        }
+
         //NOLINTNEXTLINE(hicpp-signed-bitwise) - PERF_EVENT_IOC_SET_OUTPUT
         if (lib::ioctl(fd, PERF_EVENT_IOC_SET_OUTPUT, output_fd) != 0) {
             // take a new copy of the errno if it failed, before calling log
@@ -411,13 +572,25 @@ namespace agents::perf {
         return true;
     }
 
-    //NOLINTNEXTLINE(readability-convert-member-functions-to-static)
     perf_ringbuffer_mmap_t perf_activator_t::mmap_data(core_no_t core_no, int fd)
     {
         auto const & ringbuffer_config = capture_configuration->ringbuffer_config;
-        auto const data_length = get_data_mmap_length(ringbuffer_config);
 
-        auto data_mapping = try_mmap_with_logging(core_no, ringbuffer_config, data_length, 0, fd);
+        if (simulated_events) {
+            auto data_mapping = simulated_events->mmap_data(fd, ringbuffer_config.page_size, data_buffer_size);
+            if (!data_mapping) {
+                return {};
+            }
+            return {ringbuffer_config.page_size, std::move(data_mapping)};
+        }
+
+        auto data_mapping = try_mmap_shrinking(core_no,
+                                               ringbuffer_config,
+                                               ringbuffer_config.page_size,
+                                               data_buffer_size,
+                                               0,
+                                               fd,
+                                               [](std::size_t /*size*/) {});
         if (!data_mapping) {
             return {};
         }
@@ -427,22 +600,31 @@ namespace agents::perf {
 
     void perf_activator_t::mmap_aux(perf_ringbuffer_mmap_t & mmap, core_no_t core_no, int fd)
     {
+        // there is no simulated aux data
+        if (simulated_events) {
+            return;
+        }
+
         auto const & ringbuffer_config = capture_configuration->ringbuffer_config;
-        auto const data_length = get_data_mmap_length(ringbuffer_config);
-        auto const aux_length = ringbuffer_config.aux_buffer_size;
+        // the data buffer may have been mapped smaller than configured
+        auto const data_length = ringbuffer_config.page_size + mmap.data_span().size();
 
         if (data_length > std::numeric_limits<off_t>::max()) {
             LOG_DEBUG("Offset for perf aux buffer is out of range: %zu", data_length);
             return;
         }
 
-        // Update the header
+        // Update the header (before each attempt, as the kernel takes the size of the aux mapping from it)
         auto * pemp = mmap.header();
         pemp->aux_offset = data_length;
-        pemp->aux_size = aux_length;
 
-        auto aux_mapping =
-            try_mmap_with_logging(core_no, ringbuffer_config, aux_length, static_cast<off_t>(data_length), fd);
+        auto aux_mapping = try_mmap_shrinking(core_no,
+                                              ringbuffer_config,
+                                              0,
+                                              aux_buffer_size,
+                                              static_cast<off_t>(data_length),
+                                              fd,
+                                              [pemp](std::size_t size) { pemp->aux_size = size; });
         if (!aux_mapping) {
             return;
         }
@@ -450,26 +632,32 @@ namespace agents::perf {
         mmap.set_aux_mapping(std::move(aux_mapping));
     }
 
-    //NOLINTNEXTLINE(readability-convert-member-functions-to-static)
     bool perf_activator_t::start(int fd)
     {
         LOG_DEBUG("enabling fd %d", fd);
+        if (simulated_events) {
+            return simulated_events->set_enabled(fd, true, true);
+        }
         //NOLINTNEXTLINE(hicpp-signed-bitwise) - PERF_EVENT_IOC_ENABLE
         return (lib::ioctl(fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP) == 0);
     }
 
-    //NOLINTNEXTLINE(readability-convert-member-functions-to-static)
     bool perf_activator_t::stop(int fd)
     {
         LOG_DEBUG("disabling fd %d", fd);
+        if (simulated_events) {
+            return simulated_events->set_enabled(fd, false, true);
+        }
         //NOLINTNEXTLINE(hicpp-signed-bitwise) - PERF_EVENT_IOC_DISABLE
         return (lib::ioctl(fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP) == 0);
     }
 
-    //NOLINTNEXTLINE(readability-convert-member-functions-to-static)
     bool perf_activator_t::re_enable(int fd)
     {
         LOG_DEBUG("enabling fd %d", fd);
+        if (simulated_events) {
+            return simulated_events->set_enabled(fd, true, false);
+        }
         //NOLINTNEXTLINE(hicpp-signed-bitwise) - PERF_EVENT_IOC_ENABLE
         return (lib::ioctl(fd, PERF_EVENT_IOC_ENABLE, 0) == 0);
     }
@@ -6,12 +6,17 @@
 #include "agents/perf/events/event_configuration.hpp"
 #include "agents/perf/events/perf_event_utils.hpp"
 #include "agents/perf/events/perf_ringbuffer_mmap.hpp"
+#include "agents/perf/events/simulated_perf_events.hpp"
 #include "agents/perf/events/types.hpp"
+#include "lib/AutoClosingFd.h"
 #include "lib/Syscall.h"
 
 #include <cstddef>
 #include <cstdint>
+#include <map>
+#include <memory>
 #include <optional>
+#include <set>
 #include <system_error>
 #include <utility>
 #include <vector>
@@ -26,6 +31,13 @@
 namespace agents::perf {
     /**
      * Interface for object used to create and manipulate raw perf events
+     *
+     * Counter values are never read back through the event fds; they are delivered as PERF_SAMPLE_READ samples into
+     * the mmap ring buffers. User space PMU access (`cap_user_rdpmc` in the mmap page) is deliberately not used, as it
+     * only gives valid values to the thread being counted, whereas the events are always for some other pid or cpu.
+     *
+     * When the configuration asks for simulated perf events, they are created by simulated_perf_events_t rather than
+     * perf_event_open, so that the rest of the capture runs as it would on a machine with that many cores.
      */
     class perf_activator_t {
     public:
@@ -98,8 +110,14 @@ namespace agents::perf {
               context(context),
               perf_event_printer(capture_configuration->cpuid_to_core_name,
                                  capture_configuration->per_core_cpuids,
-                                 capture_configuration->perf_pmu_type_to_name)
+                                 capture_configuration->perf_pmu_type_to_name),
+              data_buffer_size(capture_configuration->ringbuffer_config.data_buffer_size),
+              aux_buffer_size(capture_configuration->ringbuffer_config.aux_buffer_size)
         {
+            if (capture_configuration->simulated_perf) {
+                simulated_events = std::make_unique<simulated_perf_events_t>(*capture_configuration->simulated_perf);
+            }
+            open_cgroup();
         }
 
         /** @return True if the kernel is old and requires using 'read' to determine the ID of events in a group */
@@ -116,6 +134,14 @@ namespace agents::perf {
         [[nodiscard]] static std::pair<read_ids_status_t, std::vector<perf_event_id_t>>
         read_legacy_ids(std::uint64_t read_format, int group_fd, std::size_t nr_ids);
 
+        /**
+         * Read the value of a single event (one that is not read with PERF_FORMAT_GROUP)
+         *
+         * @param fd The event file descriptor
+         * @return The value, or nothing if it could not be read
+         */
+        [[nodiscard]] std::optional<std::uint64_t> read_count(int fd) const;
+
         /**
          * Create the new event, but do not start it. The event is created in a disabled state, and its fd and perf id are returned.
          *
@@ -203,9 +229,37 @@ namespace agents::perf {
          */
         bool re_enable(int fd);
 
+        /** @return True if the attr type is the CoreSight ETM's */
+        [[nodiscard]] bool is_etm_type(std::uint32_t type) const;
+
     private:
         std::shared_ptr<perf_capture_configuration_t> capture_configuration;
         boost::asio::io_context & context;
         perf_event_printer_t perf_event_printer;
+        /** The cgroup directory that the cpu events are restricted to, if any */
+        lib::AutoClosingFd cgroup_fd {};
+        /** The attr types of the uncore events, which always count for the whole system */
+        std::set<std::uint32_t> uncore_types {};
+        /**
+         * For each attr type and exclude_kernel setting, the index of the exclude_* bits pattern that last opened an
+         * event of that type. It is tried first for the next one, as the events are opened for each thread and core,
+         * and the earlier patterns are often refused by the PMU.
+         */
+        std::map<std::pair<std::uint32_t, bool>, std::size_t> exclude_pattern_indexes {};
+        /**
+         * The sizes of the data and aux buffers to map. These start out as configured, but are halved where the
+         * mapping would exceed the locked memory limit. That limit is shared by all the buffers, so the smaller size is
+         * kept for the remaining cores.
+         */
+        std::size_t data_buffer_size;
+        std::size_t aux_buffer_size;
+        /** Creates the events instead of the kernel, when they are simulated */
+        std::unique_ptr<simulated_perf_events_t> simulated_events {};
+
+        /** Open the configured cgroup (if any), so that the cpu events can be restricted to it */
+        void open_cgroup();
+
+        /** @return True if the event should be restricted to the cgroup */
+        [[nodiscard]] bool is_cgroup_event(event_definition_t const & event, pid_t pid) const;
     };
 }
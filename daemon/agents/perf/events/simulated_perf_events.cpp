@@ -0,0 +1,550 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "agents/perf/events/simulated_perf_events.hpp"
+
+#include "Logging.h"
+#include "lib/EnumUtils.h"
+#include "lib/Syscall.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace agents::perf {
+    namespace {
+        constexpr std::uint32_t default_samples_per_second = 1000;
+        constexpr unsigned long max_cpu_cores = 4096;
+        constexpr unsigned long max_samples_per_second = 1000000;
+        /** How often the producer writes into the rings */
+        constexpr auto producer_tick = std::chrono::milliseconds(1);
+        constexpr double ns_per_s = 1e9;
+        /** The period reported for frequency based events, as if counting a 1GHz clock */
+        constexpr std::uint64_t clock_hz = 1000000000;
+        /** Where the simulated samples' ips are, which is somewhere in the agent's own text */
+        constexpr std::uint64_t simulated_ip_base = 0x400000;
+        constexpr std::uint64_t simulated_ip_range = 0x10000;
+
+        std::uint64_t clock_now(perf_event_attr const & attr)
+        {
+            timespec ts {};
+            clock_gettime((attr.use_clockid ? clockid_t(attr.clockid) : CLOCK_MONOTONIC), &ts);
+            return (std::uint64_t(ts.tv_sec) * clock_hz) + std::uint64_t(ts.tv_nsec);
+        }
+
+        /** Append two u32 fields, which share a word */
+        void push_u32_pair(std::vector<std::uint64_t> & record, std::uint32_t first, std::uint32_t second)
+        {
+            std::uint32_t const pair[2] {first, second};
+            std::uint64_t word;
+            std::memcpy(&word, pair, sizeof(word));
+            record.push_back(word);
+        }
+
+        void set_header(std::vector<std::uint64_t> & record, std::uint32_t type, std::uint16_t misc)
+        {
+            perf_event_header const header {type, misc, std::uint16_t(record.size() * sizeof(std::uint64_t))};
+            std::memcpy(record.data(), &header, sizeof(header));
+        }
+
+        void signal(lib::AutoClosingFd const & fd)
+        {
+            eventfd_t const value = 1;
+            if (lib::write(*fd, &value, sizeof(value)) < 0) {
+                LOG_DEBUG("Unable to signal a simulated perf event (%d)", errno);
+            }
+        }
+
+        void clear_signal(lib::AutoClosingFd const & fd)
+        {
+            eventfd_t value;
+            // nonblocking, so fails if it was not signalled anyway
+            (void) lib::read(*fd, &value, sizeof(value));
+        }
+    }
+
+    std::optional<simulated_perf_config_t> simulated_perf_config_t::from_environment()
+    {
+        //NOLINTNEXTLINE(concurrency-mt-unsafe)
+        auto const * env = getenv("GATORD_SIMULATED_PERF");
+        if ((env == nullptr) || (*env == '\0')) {
+            return {};
+        }
+
+        char * end = nullptr;
+        auto const num_cpu_cores = std::strtoul(env, &end, 10);
+        auto samples_per_second = static_cast<unsigned long>(default_samples_per_second);
+        bool valid = (end != env);
+        if (valid && (*end == ',')) {
+            auto const * rate = end + 1;
+            samples_per_second = std::strtoul(rate, &end, 10);
+            valid = (end != rate);
+        }
+
+        if ((!valid) || (*end != '\0') || (num_cpu_cores == 0) || (num_cpu_cores > max_cpu_cores)
+            || (samples_per_second == 0) || (samples_per_second > max_samples_per_second)) {
+            LOG_ERROR("Ignoring invalid GATORD_SIMULATED_PERF value '%s'", env);
+            return {};
+        }
+
+        LOG_WARNING("Simulating the perf events of %lu cores, with %lu samples per second each",
+                    num_cpu_cores,
+                    samples_per_second);
+
+        return simulated_perf_config_t {std::uint32_t(num_cpu_cores), std::uint32_t(samples_per_second)};
+    }
+
+    simulated_perf_events_t::simulated_perf_events_t(simulated_perf_config_t config)
+        : config(config), sample_pid(getpid()), producer([this]() { run(); })
+    {
+    }
+
+    simulated_perf_events_t::~simulated_perf_events_t()
+    {
+        {
+            std::lock_guard<std::mutex> lock {mutex};
+            stopping = true;
+        }
+        stop_condition.notify_all();
+        producer.join();
+    }
+
+    simulated_perf_events_t::created_event_t simulated_perf_events_t::create_event(perf_event_attr const & attr,
+                                                                                   core_no_t core_no,
+                                                                                   int group_fd)
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        //NOLINTNEXTLINE(hicpp-signed-bitwise) - EFD_NONBLOCK | EFD_CLOEXEC
+        lib::AutoClosingFd fd {::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)};
+        if (!fd) {
+            return {};
+        }
+
+        lib::AutoClosingFd own_fd {lib::fcntl(*fd, F_DUPFD_CLOEXEC, 0)};
+        if (!own_fd) {
+            return {};
+        }
+
+        // the number was free, so any event that had it is closed
+        forget(*fd);
+
+        if (group_fd >= 0) {
+            auto it = events.find(group_fd);
+            if (it == events.end()) {
+                errno = EBADF;
+                return {};
+            }
+            it->second.member_fds.push_back(*fd);
+        }
+
+        auto const perf_id = perf_event_id_t(next_perf_id++);
+        // the child is exec'd as soon as the capture starts, so enable_on_exec is treated as enabled
+        auto const enabled = ((group_fd >= 0) || (!attr.disabled) || attr.enable_on_exec);
+
+        events.emplace(*fd,
+                       event_t {std::move(own_fd), attr, perf_id, core_no, group_fd, clock_now(attr), enabled});
+
+        return {std::move(fd), perf_id};
+    }
+
+    bool simulated_perf_events_t::set_output(int fd, int output_fd)
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        auto event = events.find(fd);
+        auto output = events.find(output_fd);
+        if ((event == events.end()) || (output == events.end()) || (!output->second.ring)) {
+            errno = EINVAL;
+            return false;
+        }
+
+        event->second.ring = output->second.ring;
+        event->second.ring->fds.push_back(fd);
+        return true;
+    }
+
+    mmap_ptr_t simulated_perf_events_t::mmap_data(int fd, std::size_t page_size, std::size_t data_size)
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        auto event = events.find(fd);
+        if ((event == events.end()) || event->second.ring) {
+            errno = EINVAL;
+            return {};
+        }
+
+        auto const length = page_size + data_size;
+
+        // map the ring twice, so that each side can unmap it when it is finished
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg)
+        lib::AutoClosingFd memfd {int(::syscall(__NR_memfd_create, "gatord-simulated-perf", 1 /* MFD_CLOEXEC */))};
+        if ((!memfd) || (::ftruncate(*memfd, off_t(length)) != 0)) {
+            LOG_ERROR("Unable to create a simulated perf ring (%s)", std::strerror(errno));
+            return {};
+        }
+
+        mmap_ptr_t producer_mapping {lib::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, *memfd, 0),
+                                     length};
+        mmap_ptr_t consumer_mapping {lib::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, *memfd, 0),
+                                     length};
+        if ((!producer_mapping) || (!consumer_mapping)) {
+            LOG_ERROR("Unable to map a simulated perf ring (%s)", std::strerror(errno));
+            return {};
+        }
+
+        auto * header = producer_mapping.get_as<perf_event_mmap_page>();
+        header->data_offset = page_size;
+        header->data_size = data_size;
+
+        auto const & attr = event->second.attr;
+        auto const watermark = (attr.watermark ? std::max<std::uint64_t>(attr.wakeup_watermark, 1) : 1);
+
+        auto ring = std::make_shared<ring_t>(ring_t {std::move(producer_mapping), page_size, data_size, watermark});
+        ring->fds.push_back(fd);
+        event->second.ring = ring;
+        rings[fd] = std::move(ring);
+
+        return consumer_mapping;
+    }
+
+    bool simulated_perf_events_t::set_enabled(int fd, bool enabled, bool group)
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        auto it = events.find(fd);
+        if (it == events.end()) {
+            errno = EBADF;
+            return false;
+        }
+
+        it->second.enabled = enabled;
+        if (group) {
+            for (auto member_fd : it->second.member_fds) {
+                events.at(member_fd).enabled = enabled;
+            }
+        }
+        return true;
+    }
+
+    std::optional<std::uint64_t> simulated_perf_events_t::read_count(int fd) const
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        auto it = events.find(fd);
+        if (it == events.end()) {
+            return {};
+        }
+        return it->second.count;
+    }
+
+    void simulated_perf_events_t::run()
+    {
+        prctl(PR_SET_NAME, reinterpret_cast<unsigned long>(&"gatord-simperf"), 0, 0, 0);
+
+        auto last = std::chrono::steady_clock::now();
+
+        std::unique_lock<std::mutex> lock {mutex};
+        while (!stopping) {
+            stop_condition.wait_for(lock, producer_tick);
+            if (stopping) {
+                break;
+            }
+
+            auto const now = std::chrono::steady_clock::now();
+            auto const elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(now - last);
+            last = now;
+
+            produce(elapsed.count());
+        }
+    }
+
+    void simulated_perf_events_t::produce(std::uint64_t elapsed_ns)
+    {
+        for (auto & entry : rings) {
+            auto & ring = *entry.second;
+
+            samplers.clear();
+            for (auto fd : ring.fds) {
+                auto & event = events.at(fd);
+                if ((event.attr.sample_period != 0) && is_enabled(event)) {
+                    samplers.push_back(&event);
+                }
+            }
+
+            auto * header = ring.mapping.get_as<perf_event_mmap_page>();
+
+            if (samplers.empty()) {
+                ring.credit = 0;
+            }
+            else {
+                ring.credit += (double(config.samples_per_second) * double(elapsed_ns)) / ns_per_s;
+                auto const count = std::uint64_t(ring.credit);
+                ring.credit -= double(count);
+
+                // spread the samples over the tick
+                auto const now = clock_now(samplers.front()->attr);
+                auto const start_head = ring.head;
+
+                for (std::uint64_t n = 0; n < count; ++n) {
+                    auto & event = *samplers[ring.next_event++ % samplers.size()];
+                    auto const time = now - (((count - 1 - n) * elapsed_ns) / count);
+
+                    if (ring.lost != 0) {
+                        encode_lost(event, ring.lost, time, record_buffer);
+                        if (!write_record(ring, record_buffer)) {
+                            ring.lost += 1;
+                            continue;
+                        }
+                        ring.lost = 0;
+                    }
+
+                    encode_sample(event, time, record_buffer);
+                    if (!write_record(ring, record_buffer)) {
+                        ring.lost += 1;
+                    }
+                }
+
+                ring.unsignalled += (ring.head - start_head);
+                __atomic_store_n(&header->data_head, ring.head, __ATOMIC_RELEASE);
+            }
+
+            // wake the consumer for each watermark's worth, as perf does
+            if (ring.unsignalled >= ring.watermark) {
+                ring.unsignalled = 0;
+                ring.is_signalled = true;
+                for (auto fd : ring.fds) {
+                    signal(events.at(fd).fd);
+                }
+            }
+            else if (ring.is_signalled && (__atomic_load_n(&header->data_tail, __ATOMIC_ACQUIRE) == ring.head)) {
+                ring.is_signalled = false;
+                for (auto fd : ring.fds) {
+                    clear_signal(events.at(fd).fd);
+                }
+            }
+        }
+    }
+
+    bool simulated_perf_events_t::is_enabled(event_t const & event) const
+    {
+        if (!event.enabled) {
+            return false;
+        }
+        return (event.leader_fd < 0) || events.at(event.leader_fd).enabled;
+    }
+
+    void simulated_perf_events_t::encode_sample(event_t & event,
+                                                std::uint64_t time,
+                                                std::vector<std::uint64_t> & record)
+    {
+        auto const & attr = event.attr;
+        auto const sample_type = attr.sample_type;
+        auto const id = lib::toEnumValue(event.perf_id);
+        auto const cpu = std::uint32_t(lib::toEnumValue(event.core_no));
+        auto const period =
+            (attr.freq ? (clock_hz / std::max<std::uint64_t>(attr.sample_freq, 1)) : attr.sample_period);
+        auto const ip = simulated_ip_base + ((event.samples * sizeof(std::uint32_t)) % simulated_ip_range);
+
+        event.samples += 1;
+        event.count += period;
+
+        // the group's counters count along with the leader
+        auto & leader = (event.leader_fd < 0 ? event : events.at(event.leader_fd));
+        for (auto member_fd : leader.member_fds) {
+            auto & member = events.at(member_fd);
+            if ((&member != &event) && member.enabled) {
+                member.count += period;
+            }
+        }
+
+        // the header, which is filled in once the size is known
+        record.assign(1, 0);
+
+        if ((sample_type & PERF_SAMPLE_IDENTIFIER) != 0) {
+            record.push_back(id);
+        }
+        if ((sample_type & PERF_SAMPLE_IP) != 0) {
+            record.push_back(ip);
+        }
+        if ((sample_type & PERF_SAMPLE_TID) != 0) {
+            push_u32_pair(record, std::uint32_t(sample_pid), std::uint32_t(sample_pid));
+        }
+        if ((sample_type & PERF_SAMPLE_TIME) != 0) {
+            record.push_back(time);
+        }
+        if ((sample_type & PERF_SAMPLE_ADDR) != 0) {
+            record.push_back(0);
+        }
+        if ((sample_type & PERF_SAMPLE_ID) != 0) {
+            record.push_back(id);
+        }
+        if ((sample_type & PERF_SAMPLE_STREAM_ID) != 0) {
+            record.push_back(id);
+        }
+        if ((sample_type & PERF_SAMPLE_CPU) != 0) {
+            push_u32_pair(record, cpu, 0);
+        }
+        if ((sample_type & PERF_SAMPLE_PERIOD) != 0) {
+            record.push_back(period);
+        }
+        if ((sample_type & PERF_SAMPLE_READ) != 0) {
+            auto const read_format = attr.read_format;
+            auto const push_times = [&](event_t const & timed) {
+                if ((read_format & PERF_FORMAT_TOTAL_TIME_ENABLED) != 0) {
+                    record.push_back(time - timed.start_time);
+                }
+                if ((read_format & PERF_FORMAT_TOTAL_TIME_RUNNING) != 0) {
+                    record.push_back(time - timed.start_time);
+                }
+            };
+            auto const push_value = [&](event_t const & counter) {
+                record.push_back(counter.count);
+                if ((read_format & PERF_FORMAT_ID) != 0) {
+                    record.push_back(lib::toEnumValue(counter.perf_id));
+                }
+            };
+
+            if ((read_format & PERF_FORMAT_GROUP) != 0) {
+                record.push_back(1 + leader.member_fds.size());
+                push_times(leader);
+                push_value(leader);
+                for (auto member_fd : leader.member_fds) {
+                    push_value(events.at(member_fd));
+                }
+            }
+            else {
+                record.push_back(event.count);
+                push_times(event);
+                if ((read_format & PERF_FORMAT_ID) != 0) {
+                    record.push_back(id);
+                }
+            }
+        }
+        if ((sample_type & PERF_SAMPLE_CALLCHAIN) != 0) {
+            record.push_back(2);
+            record.push_back(std::uint64_t(PERF_CONTEXT_USER));
+            record.push_back(ip);
+        }
+        if ((sample_type & PERF_SAMPLE_RAW) != 0) {
+            // the size, then that many bytes of data; together they fill a word
+            push_u32_pair(record, sizeof(std::uint32_t), 0);
+        }
+        // an empty branch stack, no user or interrupt registers (PERF_SAMPLE_REGS_ABI_NONE) and an empty user stack,
+        // then zero for each of the rest
+        for (auto const flag : {PERF_SAMPLE_BRANCH_STACK,
+                                PERF_SAMPLE_REGS_USER,
+                                PERF_SAMPLE_STACK_USER,
+                                PERF_SAMPLE_WEIGHT,
+                                PERF_SAMPLE_DATA_SRC,
+                                PERF_SAMPLE_TRANSACTION,
+                                PERF_SAMPLE_REGS_INTR,
+                                PERF_SAMPLE_PHYS_ADDR}) {
+            if ((sample_type & flag) != 0) {
+                record.push_back(0);
+            }
+        }
+
+        set_header(record, PERF_RECORD_SAMPLE, PERF_RECORD_MISC_USER);
+    }
+
+    void simulated_perf_events_t::encode_lost(event_t const & event,
+                                              std::uint64_t lost,
+                                              std::uint64_t time,
+                                              std::vector<std::uint64_t> & record)
+    {
+        auto const & attr = event.attr;
+        auto const sample_type = attr.sample_type;
+        auto const id = lib::toEnumValue(event.perf_id);
+
+        record.assign(1, 0);
+        record.push_back(id);
+        record.push_back(lost);
+
+        if (attr.sample_id_all) {
+            if ((sample_type & PERF_SAMPLE_TID) != 0) {
+                push_u32_pair(record, 0, 0);
+            }
+            if ((sample_type & PERF_SAMPLE_TIME) != 0) {
+                record.push_back(time);
+            }
+            if ((sample_type & PERF_SAMPLE_ID) != 0) {
+                record.push_back(id);
+            }
+            if ((sample_type & PERF_SAMPLE_STREAM_ID) != 0) {
+                record.push_back(id);
+            }
+            if ((sample_type & PERF_SAMPLE_CPU) != 0) {
+                push_u32_pair(record, std::uint32_t(lib::toEnumValue(event.core_no)), 0);
+            }
+            if ((sample_type & PERF_SAMPLE_IDENTIFIER) != 0) {
+                record.push_back(id);
+            }
+        }
+
+        set_header(record, PERF_RECORD_LOST, 0);
+    }
+
+    bool simulated_perf_events_t::write_record(ring_t & ring, std::vector<std::uint64_t> const & record)
+    {
+        auto const * header = ring.mapping.get_as<perf_event_mmap_page>();
+        auto const tail = __atomic_load_n(&header->data_tail, __ATOMIC_ACQUIRE);
+        auto const size = record.size() * sizeof(std::uint64_t);
+
+        if (size > (ring.data_size - (ring.head - tail))) {
+            return false;
+        }
+
+        auto * const data = ring.mapping.data() + ring.page_size;
+        auto const offset = ring.head & (ring.data_size - 1);
+        auto const first_part = std::min<std::size_t>(size, ring.data_size - offset);
+        auto const * const bytes = reinterpret_cast<char const *>(record.data());
+
+        std::memcpy(data + offset, bytes, first_part);
+        std::memcpy(data, bytes + first_part, size - first_part);
+
+        ring.head += size;
+        return true;
+    }
+
+    void simulated_perf_events_t::forget(int fd)
+    {
+        auto it = events.find(fd);
+        if (it == events.end()) {
+            return;
+        }
+
+        auto & event = it->second;
+
+        // detach it from its group, and orphan its members (which were closed along with it)
+        if (event.leader_fd >= 0) {
+            auto leader = events.find(event.leader_fd);
+            if (leader != events.end()) {
+                auto & members = leader->second.member_fds;
+                members.erase(std::remove(members.begin(), members.end(), fd), members.end());
+            }
+        }
+        for (auto member_fd : event.member_fds) {
+            auto & member = events.at(member_fd);
+            member.leader_fd = -1;
+            member.enabled = false;
+        }
+
+        if (event.ring) {
+            auto & fds = event.ring->fds;
+            fds.erase(std::remove(fds.begin(), fds.end(), fd), fds.end());
+        }
+
+        rings.erase(fd);
+        events.erase(it);
+    }
+}
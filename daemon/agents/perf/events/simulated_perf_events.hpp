@@ -0,0 +1,173 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#pragma once
+
+#include "agents/perf/events/perf_ringbuffer_mmap.hpp"
+#include "agents/perf/events/types.hpp"
+#include "k/perf_event.h"
+#include "lib/AutoClosingFd.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include <sys/types.h>
+
+namespace agents::perf {
+    /** Configures the simulated perf events, from the GATORD_SIMULATED_PERF environment variable */
+    struct simulated_perf_config_t {
+        /** The number of cores to simulate, which may be more than the machine has */
+        std::uint32_t num_cpu_cores;
+        /** The number of samples each simulated core produces per second */
+        std::uint32_t samples_per_second;
+
+        /**
+         * Read the configuration, which is given as `<cores>[,<samples per second>]`
+         *
+         * @return The configuration, or nothing if the perf events are not simulated
+         */
+        [[nodiscard]] static std::optional<simulated_perf_config_t> from_environment();
+    };
+
+    /**
+     * Stands in for the kernel behind perf_activator_t, so that the whole capture pipeline (the agent, the shell and
+     * the sender) can be benchmarked at the scale of a machine with many more cores than the one it runs on.
+     *
+     * Each event is an eventfd rather than a perf fd, and each ring is shared memory with the kernel's layout. A
+     * producer thread writes PERF_RECORD_SAMPLE records (encoded for each event's sample_type and read_format) into
+     * the rings of the enabled sampling events at the configured rate for each core, and makes the events' fds
+     * readable each time another wakeup_watermark's worth has been written, as perf does. Samples that do not fit in a
+     * full ring are dropped, and counted in a PERF_RECORD_LOST once there is room again.
+     *
+     * There is no aux data, so the SPE and ETM are not simulated. The state of an event is kept until its fd number is
+     * reused, as closing the fd is not seen here.
+     */
+    class simulated_perf_events_t {
+    public:
+        struct created_event_t {
+            lib::AutoClosingFd fd;
+            perf_event_id_t perf_id;
+        };
+
+        explicit simulated_perf_events_t(simulated_perf_config_t config);
+        ~simulated_perf_events_t();
+
+        simulated_perf_events_t(simulated_perf_events_t const &) = delete;
+        simulated_perf_events_t & operator=(simulated_perf_events_t const &) = delete;
+        simulated_perf_events_t(simulated_perf_events_t &&) = delete;
+        simulated_perf_events_t & operator=(simulated_perf_events_t &&) = delete;
+
+        /**
+         * Create a simulated event
+         *
+         * @param attr The event's attributes; it starts enabled unless it is a disabled group leader
+         * @param core_no The core it samples
+         * @param group_fd The group leader fd, or -1
+         * @return The event's fd and id, or an invalid fd (and errno set) on failure
+         */
+        [[nodiscard]] created_event_t create_event(perf_event_attr const & attr, core_no_t core_no, int group_fd);
+
+        /** Redirect the records of one event into the ring of another */
+        [[nodiscard]] bool set_output(int fd, int output_fd);
+
+        /**
+         * Map the ring for an event
+         *
+         * @param fd The event's fd
+         * @param page_size The size of the header page
+         * @param data_size The size of the data area, which is a power of two
+         * @return The mapping of the header page followed by the data area, or an invalid one on failure
+         */
+        [[nodiscard]] mmap_ptr_t mmap_data(int fd, std::size_t page_size, std::size_t data_size);
+
+        /**
+         * Enable or disable an event
+         *
+         * @param fd The event's fd
+         * @param enabled True to enable it, false to disable it
+         * @param group True to apply to the members of its group as well (PERF_IOC_FLAG_GROUP)
+         * @return False if the fd is not a simulated event
+         */
+        [[nodiscard]] bool set_enabled(int fd, bool enabled, bool group);
+
+        /** @return The count of an event, being the sum of the periods of its samples */
+        [[nodiscard]] std::optional<std::uint64_t> read_count(int fd) const;
+
+    private:
+        struct ring_t {
+            /** The producer's own mapping of the ring, as the consumer unmaps its mapping whenever it is finished */
+            mmap_ptr_t mapping;
+            std::size_t page_size;
+            std::size_t data_size;
+            /** The number of bytes to write between each wakeup */
+            std::uint64_t watermark;
+            /** The fds of the events that write into the ring */
+            std::vector<int> fds {};
+            std::uint64_t head {0};
+            std::uint64_t unsignalled {0};
+            std::uint64_t lost {0};
+            double credit {0};
+            std::size_t next_event {0};
+            bool is_signalled {false};
+        };
+
+        struct event_t {
+            /** A dup of the event's eventfd, so that it is never written to once the original is closed */
+            lib::AutoClosingFd fd;
+            perf_event_attr attr;
+            perf_event_id_t perf_id;
+            core_no_t core_no;
+            int leader_fd;
+            std::uint64_t start_time;
+            bool enabled;
+            std::vector<int> member_fds {};
+            std::shared_ptr<ring_t> ring {};
+            std::uint64_t count {0};
+            std::uint64_t samples {0};
+        };
+
+        simulated_perf_config_t config;
+        mutable std::mutex mutex {};
+        std::condition_variable stop_condition {};
+        std::map<int, event_t> events {};
+        std::map<int, std::shared_ptr<ring_t>> rings {};
+        /** The pid of the samples, which is the agent's own so that it has real maps */
+        pid_t sample_pid;
+        std::uint64_t next_perf_id {1};
+        bool stopping {false};
+        /** Scratch space for the producer */
+        std::vector<event_t *> samplers {};
+        std::vector<std::uint64_t> record_buffer {};
+        std::thread producer;
+
+        /** The producer thread's loop */
+        void run();
+
+        /** Write the samples for one tick of the producer into each ring */
+        void produce(std::uint64_t elapsed_ns);
+
+        /** @return True if the event and its group leader are enabled */
+        [[nodiscard]] bool is_enabled(event_t const & event) const;
+
+        /** Encode a sample from the event into `record` */
+        void encode_sample(event_t & event, std::uint64_t time, std::vector<std::uint64_t> & record);
+
+        /** Encode a PERF_RECORD_LOST for the event into `record` */
+        static void encode_lost(event_t const & event,
+                                std::uint64_t lost,
+                                std::uint64_t time,
+                                std::vector<std::uint64_t> & record);
+
+        /** Copy a record into the ring, returning false if it is full */
+        static bool write_record(ring_t & ring, std::vector<std::uint64_t> const & record);
+
+        /** Forget the event of an fd that was closed, as its number is being reused */
+        void forget(int fd);
+    };
+}
@@ -0,0 +1,55 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "agents/perf/flight_recorder.h"
+
+#include "Logging.h"
+
+#include <cinttypes>
+#include <utility>
+
+namespace agents::perf {
+    void flight_recorder_t::record(message_t message, std::size_t size)
+    {
+        auto const now = clock_type::now();
+
+        std::lock_guard<std::mutex> lock {mutex};
+
+        entries.push_back({now, size, std::move(message)});
+        total_size += size;
+
+        discard_oldest(now);
+    }
+
+    std::deque<flight_recorder_t::message_t> flight_recorder_t::take()
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        discard_oldest(clock_type::now());
+
+        LOG_DEBUG("Flight recorder holds %zu messages (%zu bytes), %" PRIu64 " bytes were discarded",
+                  entries.size(),
+                  total_size,
+                  discarded_size);
+
+        std::deque<message_t> result {};
+        for (auto & entry : entries) {
+            result.push_back(std::move(entry.message));
+        }
+
+        entries.clear();
+        total_size = 0;
+        discarded_size = 0;
+
+        return result;
+    }
+
+    void flight_recorder_t::discard_oldest(clock_type::time_point now)
+    {
+        // always keep the newest, even if it alone exceeds the capacity
+        while ((entries.size() > 1) && ((total_size > capacity) || ((now - entries.front().time) > window))) {
+            total_size -= entries.front().size;
+            discarded_size += entries.front().size;
+            entries.pop_front();
+        }
+    }
+}
@@ -0,0 +1,67 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#pragma once
+
+#include "ipc/messages.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <variant>
+
+namespace agents::perf {
+    /**
+     * Holds the most recent perf data and aux frames of a capture in memory instead of sending them to the shell, so that
+     * a capture can run for as long as needed and only the data leading up to some event of interest is saved.
+     *
+     * The oldest messages are discarded once they are older than the window (measured from when they were read from the
+     * mmap), or once the total size exceeds the capacity. Messages are recorded from each cpu's strand in parallel, so
+     * access is serialized by a mutex.
+     */
+    class flight_recorder_t {
+    public:
+        using message_t = std::variant<ipc::msg_perf_data_raw_t, ipc::msg_apc_frame_data_t>;
+
+        /**
+         * @param window The age beyond which messages are discarded
+         * @param capacity The total size of the messages beyond which the oldest are discarded
+         */
+        flight_recorder_t(std::chrono::seconds window, std::size_t capacity) : window(window), capacity(capacity) {}
+
+        /**
+         * Add a message to the recorder
+         *
+         * @param message The message
+         * @param size The size of the data in the message
+         */
+        void record(message_t message, std::size_t size);
+
+        /**
+         * Remove the contents of the recorder
+         *
+         * @return The recorded messages, oldest first
+         */
+        [[nodiscard]] std::deque<message_t> take();
+
+    private:
+        using clock_type = std::chrono::steady_clock;
+
+        struct entry_t {
+            clock_type::time_point time;
+            std::size_t size;
+            message_t message;
+        };
+
+        std::mutex mutex {};
+        std::deque<entry_t> entries {};
+        std::chrono::seconds window;
+        std::size_t capacity;
+        std::size_t total_size {0};
+        std::uint64_t discarded_size {0};
+
+        /** Discard the messages that are too old or do not fit */
+        void discard_oldest(clock_type::time_point now);
+    };
+}
@@ -0,0 +1,340 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "agents/perf/function_latency.h"
+
+#include "agents/perf/perf_data_records.h"
+#include "k/perf_event.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace agents::perf {
+    namespace {
+        constexpr std::size_t word_size = sizeof(std::uint64_t);
+
+        /** The fields that every paired sample has */
+        constexpr std::uint64_t required_sample_fields = PERF_SAMPLE_IDENTIFIER | PERF_SAMPLE_TID | PERF_SAMPLE_TIME;
+
+        [[nodiscard]] std::uint64_t read_word(char const * data, std::size_t index)
+        {
+            std::uint64_t result;
+            std::memcpy(&result, data + (index * word_size), word_size);
+            return result;
+        }
+
+        void append_bytes(std::vector<char> & output, void const * data, std::size_t size)
+        {
+            auto const * bytes = static_cast<char const *>(data);
+            output.insert(output.end(), bytes, bytes + size);
+        }
+
+        [[nodiscard]] std::size_t bucket_index(std::uint64_t latency)
+        {
+            std::size_t index = 0;
+            while ((latency != 0) && (index < (function_latency_state_t::number_of_buckets - 1))) {
+                latency >>= 1;
+                index += 1;
+            }
+            return index;
+        }
+    }
+
+    function_latency_state_t::function_latency_state_t(event_configuration_t const & configuration,
+                                                       std::vector<probe_t> probes,
+                                                       std::chrono::nanoseconds window)
+        : probes(std::move(probes)),
+          window_ns(std::max<std::uint64_t>(1, window.count())),
+          histograms(this->probes.size())
+    {
+        std::map<gator_key_t, std::pair<std::size_t, bool>> probe_keys {};
+        for (std::size_t index = 0; index < this->probes.size(); ++index) {
+            probe_keys[this->probes[index].entry_key] = {index, false};
+            probe_keys[this->probes[index].return_key] = {index, true};
+        }
+
+        for_each_event_definition(configuration, [this, &probe_keys](event_definition_t const & event) {
+            auto const it = probe_keys.find(event.key);
+            if (it == probe_keys.end()) {
+                return;
+            }
+
+            auto const sample_type = event.attr.sample_type;
+            if ((sample_type & required_sample_fields) != required_sample_fields) {
+                return;
+            }
+
+            // the id is always the first word after the header
+            std::size_t index = 2;
+            if ((sample_type & PERF_SAMPLE_IP) != 0) {
+                index += 1;
+            }
+
+            key_formats.emplace(event.key, event_format_t {it->second.first, it->second.second, index, index + 1});
+        });
+    }
+
+    void function_latency_state_t::add_ids(std::vector<std::pair<perf_event_id_t, gator_key_t>> const & mappings)
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        bool added = false;
+        for (auto const & [id, key] : mappings) {
+            auto it = key_formats.find(key);
+            if (it != key_formats.end()) {
+                id_formats[static_cast<std::uint64_t>(id)] = it->second;
+                added = true;
+            }
+        }
+
+        if (added) {
+            version.fetch_add(1, std::memory_order_acq_rel);
+        }
+    }
+
+    void function_latency_state_t::copy_formats(std::unordered_map<std::uint64_t, event_format_t> & formats) const
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        formats = id_formats;
+    }
+
+    function_latency_state_t::stats_t function_latency_state_t::get_stats() const
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        return stats;
+    }
+
+    void function_latency_state_t::on_sample(event_format_t const & format,
+                                             std::uint32_t tid,
+                                             std::uint64_t time,
+                                             std::vector<std::vector<std::uint64_t>> & windows)
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        if (window_open && (time >= window_start) && ((time - window_start) >= window_ns)) {
+            close_window(windows);
+        }
+
+        if (!window_open) {
+            window_open = true;
+            window_start = time;
+            first_call_time = std::numeric_limits<std::uint64_t>::max();
+            last_call_time = 0;
+        }
+
+        auto & times = unpaired[(std::uint64_t(format.probe) << 32) | tid];
+
+        if (!format.is_return) {
+            // pair with the earliest return after it
+            auto best = times.returns.end();
+            for (auto it = times.returns.begin(); it != times.returns.end(); ++it) {
+                if ((*it >= time) && ((best == times.returns.end()) || (*it < *best))) {
+                    best = it;
+                }
+            }
+
+            if (best == times.returns.end()) {
+                return add_unpaired(format.probe, times.entries, time);
+            }
+
+            add_call(format.probe, time, *best);
+            times.returns.erase(best);
+        }
+        else {
+            // pair with the latest entry before it
+            auto best = times.entries.end();
+            for (auto it = times.entries.begin(); it != times.entries.end(); ++it) {
+                if ((*it <= time) && ((best == times.entries.end()) || (*it > *best))) {
+                    best = it;
+                }
+            }
+
+            if (best == times.entries.end()) {
+                return add_unpaired(format.probe, times.returns, time);
+            }
+
+            add_call(format.probe, *best, time);
+            times.entries.erase(best);
+        }
+    }
+
+    void function_latency_state_t::add_call(std::size_t probe, std::uint64_t entry_time, std::uint64_t return_time)
+    {
+        auto & histogram = histograms[probe];
+        auto const latency = return_time - entry_time;
+
+        histogram.min = (histogram.count == 0 ? latency : std::min(histogram.min, latency));
+        histogram.max = std::max(histogram.max, latency);
+        histogram.count += 1;
+        histogram.sum += latency;
+        histogram.buckets[bucket_index(latency)] += 1;
+
+        first_call_time = std::min(first_call_time, entry_time);
+        last_call_time = std::max(last_call_time, return_time);
+
+        stats.calls += 1;
+    }
+
+    void function_latency_state_t::add_unpaired(std::size_t probe,
+                                                std::vector<std::uint64_t> & times,
+                                                std::uint64_t time)
+    {
+        if (times.size() >= max_unpaired_per_thread) {
+            times.erase(times.begin());
+            histograms[probe].unpaired += 1;
+            stats.unpaired += 1;
+        }
+
+        times.push_back(time);
+    }
+
+    void function_latency_state_t::flush(std::vector<std::vector<std::uint64_t>> & windows)
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        windows.clear();
+
+        if (window_open) {
+            close_window(windows);
+        }
+    }
+
+    void function_latency_state_t::close_window(std::vector<std::vector<std::uint64_t>> & windows)
+    {
+        // drop the samples that are too old to still be paired
+        auto const newest = std::max(window_start, last_call_time);
+        auto const oldest = (newest > max_unpaired_age_ns ? newest - max_unpaired_age_ns : 0);
+        for (auto it = unpaired.begin(); it != unpaired.end();) {
+            auto & histogram = histograms[it->first >> 32];
+
+            for (auto * times : {&it->second.entries, &it->second.returns}) {
+                auto const old_end = std::remove_if(times->begin(), times->end(), [oldest](std::uint64_t time) {
+                    return time < oldest;
+                });
+                auto const dropped = std::uint64_t(times->end() - old_end);
+                histogram.unpaired += dropped;
+                stats.unpaired += dropped;
+                times->erase(old_end, times->end());
+            }
+
+            if (it->second.entries.empty() && it->second.returns.empty()) {
+                it = unpaired.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+
+        std::size_t number_of_probes = 0;
+        for (auto const & histogram : histograms) {
+            if ((histogram.count != 0) || (histogram.unpaired != 0)) {
+                number_of_probes += 1;
+            }
+        }
+
+        window_open = false;
+
+        if (number_of_probes == 0) {
+            return;
+        }
+
+        auto & window = windows.emplace_back();
+        window.reserve(3 + (number_of_probes * (7 + number_of_buckets)));
+
+        // a window with only unpaired samples has no calls to take the times from
+        window.push_back(first_call_time <= last_call_time ? first_call_time : window_start);
+        window.push_back(first_call_time <= last_call_time ? last_call_time : window_start);
+        window.push_back(number_of_probes);
+
+        for (std::size_t index = 0; index < histograms.size(); ++index) {
+            auto & histogram = histograms[index];
+            if ((histogram.count == 0) && (histogram.unpaired == 0)) {
+                continue;
+            }
+
+            std::size_t number_of_used_buckets = number_of_buckets;
+            while ((number_of_used_buckets > 0) && (histogram.buckets[number_of_used_buckets - 1] == 0)) {
+                number_of_used_buckets -= 1;
+            }
+
+            window.push_back(static_cast<std::uint64_t>(probes[index].entry_key));
+            window.push_back(histogram.count);
+            window.push_back(histogram.sum);
+            window.push_back(histogram.min);
+            window.push_back(histogram.max);
+            window.push_back(histogram.unpaired);
+            window.push_back(number_of_used_buckets);
+            window.insert(window.end(), histogram.buckets.begin(), histogram.buckets.begin() + number_of_used_buckets);
+
+            histogram = histogram_t {};
+        }
+
+        stats.windows += 1;
+    }
+
+    function_latency_state_t::event_format_t const * function_latency_filter_t::find_format(std::uint64_t id)
+    {
+        auto it = formats.find(id);
+        if (it != formats.end()) {
+            return &it->second;
+        }
+
+        // refresh the local copy only when some new id was added since it was taken
+        auto const version = state->get_version();
+        if (version == formats_version) {
+            return nullptr;
+        }
+
+        formats_version = version;
+        state->copy_formats(formats);
+
+        it = formats.find(id);
+        return (it != formats.end() ? &it->second : nullptr);
+    }
+
+    void function_latency_filter_t::filter(lib::Span<char const> first_span,
+                                           lib::Span<char const> second_span,
+                                           std::vector<char> & records,
+                                           std::vector<std::vector<std::uint64_t>> & windows)
+    {
+        records.clear();
+        records.reserve(first_span.size() + second_span.size());
+        windows.clear();
+
+        for_each_perf_data_record(first_span, second_span, split_record, records, [&](lib::Span<char const> record) {
+            filter_record(record, records, windows);
+        });
+    }
+
+    void function_latency_filter_t::filter_record(lib::Span<char const> record,
+                                                  std::vector<char> & records,
+                                                  std::vector<std::vector<std::uint64_t>> & windows)
+    {
+        perf_event_header header;
+        std::memcpy(&header, record.data(), sizeof(header));
+
+        std::size_t const words = record.size() / word_size;
+
+        if ((header.type != PERF_RECORD_SAMPLE) || (header.size != record.size()) || (words <= 1)) {
+            return append_bytes(records, record.data(), record.size());
+        }
+
+        auto const * format = find_format(read_word(record.data(), 1));
+        if ((format == nullptr) || (format->time_index >= words)) {
+            return append_bytes(records, record.data(), record.size());
+        }
+
+        // the pid is the lower half of the word, and the tid the upper; only the tid matters here
+        auto const tid = std::uint32_t(read_word(record.data(), format->tid_index) >> 32);
+        auto const time = read_word(record.data(), format->time_index);
+
+        state->on_sample(*format, tid, time, windows);
+    }
+
+    void function_latency_filter_t::flush(std::vector<std::vector<std::uint64_t>> & windows)
+    {
+        state->flush(windows);
+    }
+}
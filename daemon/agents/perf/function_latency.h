@@ -0,0 +1,189 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#pragma once
+
+#include "agents/perf/events/event_configuration.hpp"
+#include "agents/perf/events/types.hpp"
+#include "lib/Span.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace agents::perf {
+    /**
+     * Measures the latency of the probed functions, by pairing the samples of each function's entry and return
+     * uprobe events for each thread, and collecting the latencies into a histogram for each window of sample time.
+     *
+     * As a thread may return on a different cpu to the one it entered the function on, and as the cpus' mmaps are not
+     * read in time order, the pairing is shared by all the cpus (and is serialized by a mutex). An entry is paired with
+     * the earliest unpaired return after it, and a return with the latest unpaired entry before it, so that the samples
+     * may arrive in any order and recursive calls still pair correctly.
+     *
+     * Each window is a sequence of words, all of which are packed into a FrameType::PERF_FUNCTION_LATENCIES frame:
+     *
+     *  - the time of the earliest entry and of the latest return of the window's calls
+     *  - the number of probes, then for each probe; the key of its entry event, the number of calls, the sum, minimum
+     *    and maximum of their latencies in nanoseconds, the number of samples that could not be paired, the number of
+     *    buckets, and the count in each bucket. Bucket 0 counts the calls that took 0ns, and bucket n counts those that
+     *    took at least 2^(n-1)ns but less than 2^n ns. The buckets after the last non-zero bucket are omitted.
+     *
+     * A probe is only included in the window if it has some calls or unpaired samples.
+     */
+    class function_latency_state_t {
+    public:
+        static constexpr std::size_t number_of_buckets = 64;
+        /** The most unpaired entries, or returns, kept for each probe and thread */
+        static constexpr std::size_t max_unpaired_per_thread = 64;
+        /** Unpaired samples older than this (relative to the end of the window) are dropped as the window closes */
+        static constexpr std::uint64_t max_unpaired_age_ns = 10'000'000'000ULL;
+
+        /** The keys of the entry and return events of a probed function */
+        struct probe_t {
+            gator_key_t entry_key;
+            gator_key_t return_key;
+        };
+
+        /** Where a probe event's fields are in its samples, and which probe it is */
+        struct event_format_t {
+            std::size_t probe;
+            bool is_return;
+            /** The offset, in words from the start of the record, of the pid/tid */
+            std::size_t tid_index;
+            /** The offset, in words from the start of the record, of the time */
+            std::size_t time_index;
+        };
+
+        struct stats_t {
+            std::uint64_t calls;
+            std::uint64_t unpaired;
+            std::uint64_t windows;
+        };
+
+        /**
+         * @param configuration The capture's events; only those probe events whose samples start with their id
+         * (PERF_SAMPLE_IDENTIFIER), and that have the pid/tid and time (PERF_SAMPLE_TID and PERF_SAMPLE_TIME), are
+         * paired
+         * @param probes The probed functions
+         * @param window The length of each window, in sample time
+         */
+        function_latency_state_t(event_configuration_t const & configuration,
+                                 std::vector<probe_t> probes,
+                                 std::chrono::nanoseconds window);
+
+        /** Record the ids of newly opened events */
+        void add_ids(std::vector<std::pair<perf_event_id_t, gator_key_t>> const & mappings);
+
+        /** @return A value that changes whenever ids are added */
+        [[nodiscard]] std::uint64_t get_version() const { return version.load(std::memory_order_acquire); }
+
+        /** Copy the format of each probe event's id into `formats` */
+        void copy_formats(std::unordered_map<std::uint64_t, event_format_t> & formats) const;
+
+        /**
+         * Pair one sample of some probe event
+         *
+         * @param format The format of the sample's event
+         * @param tid The thread that hit the probe
+         * @param time The time of the sample
+         * @param windows Receives the words of the window, if it closed
+         */
+        void on_sample(event_format_t const & format,
+                       std::uint32_t tid,
+                       std::uint64_t time,
+                       std::vector<std::vector<std::uint64_t>> & windows);
+
+        /** Close the current window, if it has any calls or unpaired samples */
+        void flush(std::vector<std::vector<std::uint64_t>> & windows);
+
+        [[nodiscard]] stats_t get_stats() const;
+
+    private:
+        struct histogram_t {
+            std::uint64_t count = 0;
+            std::uint64_t sum = 0;
+            std::uint64_t min = 0;
+            std::uint64_t max = 0;
+            std::uint64_t unpaired = 0;
+            std::array<std::uint64_t, number_of_buckets> buckets {};
+        };
+
+        /** The unpaired sample times of one probe and thread, each in the order they were received */
+        struct unpaired_t {
+            std::vector<std::uint64_t> entries {};
+            std::vector<std::uint64_t> returns {};
+        };
+
+        std::vector<probe_t> probes;
+        std::uint64_t window_ns;
+        std::map<gator_key_t, event_format_t> key_formats {};
+        mutable std::mutex mutex {};
+        std::unordered_map<std::uint64_t, event_format_t> id_formats {};
+        std::atomic_uint64_t version {0};
+        std::vector<histogram_t> histograms;
+        /** By probe index (in the upper word) and tid */
+        std::unordered_map<std::uint64_t, unpaired_t> unpaired {};
+        /** The time of the first sample of the window, which it is closed relative to */
+        std::uint64_t window_start = 0;
+        std::uint64_t first_call_time = 0;
+        std::uint64_t last_call_time = 0;
+        bool window_open = false;
+        stats_t stats {0, 0, 0};
+
+        void add_call(std::size_t probe, std::uint64_t entry_time, std::uint64_t return_time);
+
+        /** Add an unpaired sample time, dropping the oldest if there are too many */
+        void add_unpaired(std::size_t probe, std::vector<std::uint64_t> & times, std::uint64_t time);
+
+        /** Append the current window to `windows` and start a new one */
+        void close_window(std::vector<std::vector<std::uint64_t>> & windows);
+    };
+
+    /**
+     * Removes the samples of the probe events from the perf data records of one cpu, passing them to the shared
+     * function_latency_state_t. All the other records are forwarded unchanged. One filter is used per cpu.
+     */
+    class function_latency_filter_t {
+    public:
+        explicit function_latency_filter_t(std::shared_ptr<function_latency_state_t> state) : state(std::move(state))
+        {
+        }
+
+        /**
+         * Filter a chunk of whole perf data records
+         *
+         * @param first_span The first part of the records
+         * @param second_span The remainder of the records, which follows on from the first (when the mmap wrapped)
+         * @param records Receives the records that are not probe samples
+         * @param windows Receives the words of each window that closed
+         */
+        void filter(lib::Span<char const> first_span,
+                    lib::Span<char const> second_span,
+                    std::vector<char> & records,
+                    std::vector<std::vector<std::uint64_t>> & windows);
+
+        /** Close the current (shared) window, if it has anything in it */
+        void flush(std::vector<std::vector<std::uint64_t>> & windows);
+
+    private:
+        std::shared_ptr<function_latency_state_t> state;
+        std::uint64_t formats_version = 0;
+        std::unordered_map<std::uint64_t, function_latency_state_t::event_format_t> formats {};
+        /** Reused for a record that is split across the two spans */
+        std::vector<char> split_record {};
+
+        [[nodiscard]] function_latency_state_t::event_format_t const * find_format(std::uint64_t id);
+
+        void filter_record(lib::Span<char const> record,
+                           std::vector<char> & records,
+                           std::vector<std::vector<std::uint64_t>> & windows);
+    };
+}
@@ -0,0 +1,396 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "agents/perf/gpu_timeline.h"
+
+#include "agents/perf/perf_data_records.h"
+#include "k/perf_event.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace agents::perf {
+    namespace {
+        constexpr std::size_t word_size = sizeof(std::uint64_t);
+
+        /** The kinds of mali_job_slots_event, which are the top byte of its event_id (see GATOR_MAKE_EVENT in kbase) */
+        constexpr std::uint32_t job_slot_start = 1;
+        constexpr std::uint32_t job_slot_stop = 2;
+        constexpr std::uint32_t job_slot_soft_stopped = 3;
+
+        constexpr gator_key_t no_key {0};
+
+        [[nodiscard]] std::uint64_t read_word(char const * data, std::size_t index)
+        {
+            std::uint64_t result;
+            std::memcpy(&result, data + (index * word_size), word_size);
+            return result;
+        }
+
+        void append_bytes(std::vector<char> & output, void const * data, std::size_t size)
+        {
+            auto const * bytes = static_cast<char const *>(data);
+            output.insert(output.end(), bytes, bytes + size);
+        }
+    }
+
+    bool gpu_timeline_config_t::is_enabled() const
+    {
+        return (work_period_key != no_key)
+            || std::any_of(job_slot_keys.begin(), job_slot_keys.end(), [](gator_key_t key) { return key != no_key; });
+    }
+
+    gpu_timeline_state_t::gpu_timeline_state_t(event_configuration_t const & configuration,
+                                               gpu_timeline_config_t config,
+                                               std::chrono::nanoseconds window)
+        : config(std::move(config)),
+          window_ns(std::max<std::uint64_t>(1, window.count())),
+          slots(gpu_timeline_config_t::number_of_job_slots)
+    {
+        for_each_event_definition(configuration, [this](event_definition_t const & event) {
+            auto const sample_fields = (event.attr.sample_type & required_tracepoint_sample_fields);
+            if ((event.attr.type != PERF_TYPE_TRACEPOINT) || (sample_fields != required_tracepoint_sample_fields)) {
+                return;
+            }
+
+            auto const & job_slot_keys = this->config.job_slot_keys;
+            if ((event.key != no_key)
+                && (std::find(job_slot_keys.begin(), job_slot_keys.end(), event.key) != job_slot_keys.end())) {
+                key_formats.emplace(
+                    event.key,
+                    event_format_t {event_kind_t::job_slots, event.attr.sample_type, event.attr.read_format});
+            }
+            else if ((event.key != no_key) && (event.key == this->config.work_period_key)) {
+                key_formats.emplace(
+                    event.key,
+                    event_format_t {event_kind_t::work_period, event.attr.sample_type, event.attr.read_format});
+            }
+        });
+    }
+
+    void gpu_timeline_state_t::add_ids(std::vector<std::pair<perf_event_id_t, gator_key_t>> const & mappings)
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        bool added = false;
+        for (auto const & [id, key] : mappings) {
+            auto it = key_formats.find(key);
+            if (it != key_formats.end()) {
+                id_formats[static_cast<std::uint64_t>(id)] = it->second;
+                added = true;
+            }
+        }
+
+        if (added) {
+            version.fetch_add(1, std::memory_order_acq_rel);
+        }
+    }
+
+    void gpu_timeline_state_t::copy_formats(std::unordered_map<std::uint64_t, event_format_t> & formats) const
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        formats = id_formats;
+    }
+
+    gpu_timeline_state_t::stats_t gpu_timeline_state_t::get_stats() const
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        return stats;
+    }
+
+    void gpu_timeline_state_t::open_window(std::uint64_t time,
+                                           bool full,
+                                           std::vector<std::vector<std::uint64_t>> & windows)
+    {
+        if (window_open && (full || ((time >= window_start) && ((time - window_start) >= window_ns)))) {
+            close_window(windows);
+        }
+
+        if (!window_open) {
+            window_open = true;
+            window_start = time;
+            first_time = std::numeric_limits<std::uint64_t>::max();
+            last_time = 0;
+        }
+
+        first_time = std::min(first_time, time);
+        last_time = std::max(last_time, time);
+    }
+
+    void gpu_timeline_state_t::on_job_slot_event(std::uint64_t time,
+                                                 std::uint32_t event_id,
+                                                 std::uint32_t tgid,
+                                                 std::uint32_t pid,
+                                                 std::vector<std::vector<std::uint64_t>> & windows)
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        // the sample may pair with every unpaired start of its slot
+        open_window(time, (intervals.size() + max_unpaired_per_slot) > max_intervals_per_window, windows);
+
+        auto const kind = (event_id >> 24);
+        auto const slot_no = std::size_t((event_id >> 16) & 0xff);
+
+        if ((slot_no >= slots.size()) || (slot_no >= config.job_slot_keys.size())
+            || (config.job_slot_keys[slot_no] == no_key)) {
+            return;
+        }
+
+        auto & slot = slots[slot_no];
+
+        switch (kind) {
+            case job_slot_start: {
+                if (slot.starts.size() >= max_unpaired_per_slot) {
+                    slot.starts.erase(slot.starts.begin());
+                    unpaired += 1;
+                    stats.unpaired += 1;
+                }
+                auto const position = std::upper_bound(slot.starts.begin(),
+                                                       slot.starts.end(),
+                                                       time,
+                                                       [](std::uint64_t t, job_t const & job) { return t < job.time; });
+                slot.starts.insert(position, job_t {time, tgid, pid});
+                break;
+            }
+            case job_slot_stop:
+            case job_slot_soft_stopped: {
+                if (slot.stops.size() >= max_unpaired_per_slot) {
+                    slot.stops.erase(slot.stops.begin());
+                    unpaired += 1;
+                    stats.unpaired += 1;
+                }
+                slot.stops.insert(std::upper_bound(slot.stops.begin(), slot.stops.end(), time), time);
+                break;
+            }
+            default:
+                return;
+        }
+
+        pair(slot_no);
+    }
+
+    void gpu_timeline_state_t::pair(std::size_t slot_no)
+    {
+        auto & slot = slots[slot_no];
+
+        std::size_t starts = 0;
+        std::size_t stops = 0;
+        while ((starts < slot.starts.size()) && (stops < slot.stops.size())) {
+            auto const & start = slot.starts[starts];
+            auto const stop = slot.stops[stops];
+
+            // a stop before the earliest start is of a job whose start was lost
+            if (stop < start.time) {
+                stops += 1;
+                unpaired += 1;
+                stats.unpaired += 1;
+                continue;
+            }
+
+            intervals.push_back(
+                {config.job_slot_keys[slot_no], std::max(start.time, slot.last_stop), stop, start.tgid, start.pid});
+            stats.intervals += 1;
+
+            slot.last_stop = stop;
+            starts += 1;
+            stops += 1;
+        }
+
+        slot.starts.erase(slot.starts.begin(), slot.starts.begin() + starts);
+        slot.stops.erase(slot.stops.begin(), slot.stops.begin() + stops);
+    }
+
+    void gpu_timeline_state_t::on_work_period(std::uint64_t time,
+                                              std::uint32_t gpu_id,
+                                              std::uint32_t uid,
+                                              std::uint64_t start_time,
+                                              std::uint64_t end_time,
+                                              std::uint64_t active_duration,
+                                              std::vector<std::vector<std::uint64_t>> & windows)
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        open_window(time, work_periods.size() >= max_work_periods_per_window, windows);
+
+        auto const id = (std::uint64_t(gpu_id) << 32) | uid;
+        auto it = work_periods.find(id);
+        if (it == work_periods.end()) {
+            it = work_periods.emplace(id, work_period_total_t {0, 0, start_time, end_time}).first;
+        }
+
+        auto & total = it->second;
+        total.periods += 1;
+        total.active += active_duration;
+        total.start = std::min(total.start, start_time);
+        total.end = std::max(total.end, end_time);
+
+        stats.work_periods += 1;
+    }
+
+    void gpu_timeline_state_t::flush(std::vector<std::vector<std::uint64_t>> & windows)
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        windows.clear();
+
+        if (window_open) {
+            close_window(windows);
+        }
+    }
+
+    void gpu_timeline_state_t::close_window(std::vector<std::vector<std::uint64_t>> & windows)
+    {
+        // drop the samples that are too old to still be paired
+        auto const oldest = (last_time > max_unpaired_age_ns ? last_time - max_unpaired_age_ns : 0);
+        for (auto & slot : slots) {
+            auto const old_starts = std::find_if(slot.starts.begin(), slot.starts.end(), [oldest](job_t const & job) {
+                return job.time >= oldest;
+            });
+            auto const old_stops = std::lower_bound(slot.stops.begin(), slot.stops.end(), oldest);
+            auto const dropped = std::uint64_t((old_starts - slot.starts.begin()) + (old_stops - slot.stops.begin()));
+            unpaired += dropped;
+            stats.unpaired += dropped;
+            slot.starts.erase(slot.starts.begin(), old_starts);
+            slot.stops.erase(slot.stops.begin(), old_stops);
+        }
+
+        window_open = false;
+
+        if (intervals.empty() && work_periods.empty() && (unpaired == 0)) {
+            return;
+        }
+
+        auto & window = windows.emplace_back();
+        window.reserve(5 + (intervals.size() * 5) + (work_periods.size() * 6));
+
+        window.push_back(first_time);
+        window.push_back(last_time);
+
+        window.push_back(intervals.size());
+        for (auto const & interval : intervals) {
+            window.push_back(static_cast<std::uint64_t>(interval.key));
+            window.push_back(interval.start);
+            window.push_back(interval.end);
+            window.push_back(interval.tgid);
+            window.push_back(interval.pid);
+        }
+
+        window.push_back(unpaired);
+
+        window.push_back(work_periods.size());
+        for (auto const & [id, total] : work_periods) {
+            window.push_back(id >> 32);
+            window.push_back(id & 0xffffffffULL);
+            window.push_back(total.periods);
+            window.push_back(total.active);
+            window.push_back(total.start);
+            window.push_back(total.end);
+        }
+
+        intervals.clear();
+        work_periods.clear();
+        unpaired = 0;
+
+        stats.windows += 1;
+    }
+
+    gpu_timeline_state_t::event_format_t const * gpu_timeline_filter_t::find_format(std::uint64_t id)
+    {
+        auto it = formats.find(id);
+        if (it != formats.end()) {
+            return &it->second;
+        }
+
+        // refresh the local copy only when some new id was added since it was taken
+        auto const version = state->get_version();
+        if (version == formats_version) {
+            return nullptr;
+        }
+
+        formats_version = version;
+        state->copy_formats(formats);
+
+        it = formats.find(id);
+        return (it != formats.end() ? &it->second : nullptr);
+    }
+
+    void gpu_timeline_filter_t::filter(lib::Span<char const> first_span,
+                                       lib::Span<char const> second_span,
+                                       std::vector<char> & records,
+                                       std::vector<std::vector<std::uint64_t>> & windows)
+    {
+        records.clear();
+        records.reserve(first_span.size() + second_span.size());
+        windows.clear();
+
+        for_each_perf_data_record(first_span, second_span, split_record, records, [&](lib::Span<char const> record) {
+            filter_record(record, records, windows);
+        });
+    }
+
+    void gpu_timeline_filter_t::filter_record(lib::Span<char const> record,
+                                              std::vector<char> & records,
+                                              std::vector<std::vector<std::uint64_t>> & windows)
+    {
+        perf_event_header header;
+        std::memcpy(&header, record.data(), sizeof(header));
+
+        std::size_t const words = record.size() / word_size;
+
+        if ((header.type != PERF_RECORD_SAMPLE) || (header.size != record.size()) || (words <= 1)) {
+            return append_bytes(records, record.data(), record.size());
+        }
+
+        auto const * format = find_format(read_word(record.data(), 1));
+        if (format == nullptr) {
+            return append_bytes(records, record.data(), record.size());
+        }
+
+        std::uint64_t time = 0;
+        lib::Span<char const> raw_data {};
+        if (!find_tracepoint_sample_time_and_raw_data(record,
+                                                      format->sample_type,
+                                                      format->read_format,
+                                                      time,
+                                                      raw_data)) {
+            return append_bytes(records, record.data(), record.size());
+        }
+
+        auto const & config = state->get_config();
+
+        if (format->kind == gpu_timeline_state_t::event_kind_t::job_slots) {
+            auto const event_id = read_tracepoint_field(raw_data, config.job_slot_event_id);
+            if (!event_id) {
+                return append_bytes(records, record.data(), record.size());
+            }
+
+            state->on_job_slot_event(time,
+                                     std::uint32_t(*event_id),
+                                     std::uint32_t(read_tracepoint_field(raw_data, config.job_slot_tgid).value_or(0)),
+                                     std::uint32_t(read_tracepoint_field(raw_data, config.job_slot_pid).value_or(0)),
+                                     windows);
+        }
+        else {
+            auto const uid = read_tracepoint_field(raw_data, config.work_period_uid);
+            auto const active_duration = read_tracepoint_field(raw_data, config.work_period_active_duration);
+            if (!uid || !active_duration) {
+                return append_bytes(records, record.data(), record.size());
+            }
+
+            state->on_work_period(time,
+                                  std::uint32_t(read_tracepoint_field(raw_data, config.work_period_gpu_id).value_or(0)),
+                                  std::uint32_t(*uid),
+                                  read_tracepoint_field(raw_data, config.work_period_start_time).value_or(0),
+                                  read_tracepoint_field(raw_data, config.work_period_end_time).value_or(0),
+                                  *active_duration,
+                                  windows);
+        }
+    }
+
+    void gpu_timeline_filter_t::flush(std::vector<std::vector<std::uint64_t>> & windows)
+    {
+        state->flush(windows);
+    }
+}
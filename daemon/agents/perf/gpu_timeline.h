@@ -0,0 +1,256 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#pragma once
+
+#include "agents/perf/events/event_configuration.hpp"
+#include "agents/perf/events/types.hpp"
+#include "agents/perf/tracepoint_sample.h"
+#include "lib/Span.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace agents::perf {
+    /** The Mali GPU tracepoints that the perf agent converts into GPU activity, and where their fields are */
+    struct gpu_timeline_config_t {
+        /** The number of job slots that have activity counters (fragment, vertex-tiling-compute and compute) */
+        static constexpr std::size_t number_of_job_slots = 3;
+
+        /**
+         * The keys of the activity counters of each job slot, or zero where it is not enabled. The mali_job_slots_event
+         * tracepoint is opened only once for all of them, with the key of one of them.
+         */
+        std::vector<gator_key_t> job_slot_keys {};
+        tracepoint_field_t job_slot_event_id {0, 0};
+        tracepoint_field_t job_slot_tgid {0, 0};
+        tracepoint_field_t job_slot_pid {0, 0};
+
+        /** The key of the gpu_work_period tracepoint's counter, or zero if it is not enabled */
+        gator_key_t work_period_key {0};
+        tracepoint_field_t work_period_gpu_id {0, 0};
+        tracepoint_field_t work_period_uid {0, 0};
+        tracepoint_field_t work_period_start_time {0, 0};
+        tracepoint_field_t work_period_end_time {0, 0};
+        tracepoint_field_t work_period_active_duration {0, 0};
+
+        /** @return True if either of the tracepoints is converted */
+        [[nodiscard]] bool is_enabled() const;
+    };
+
+    /**
+     * Converts the samples of the Mali GPU tracepoints that stock kbase drivers emit into the GPU activity timeline and
+     * per-uid GPU time, so that neither an instrumented DDK (with its own data path) nor the host's decoding of every
+     * raw job slot sample is needed.
+     *
+     * - Each mali_job_slots_event sample is a job starting, stopping or being soft-stopped on a job slot. A slot's
+     *   starts and stops are paired in time order into the intervals that each job ran for; a job that was queued
+     *   behind another starts running when that one stops.
+     * - Each gpu_work_period sample is a period of some uid's GPU work. They are summed for each GPU and uid.
+     *
+     * The samples of any cpu may be of any slot, and the cpus' mmaps are not read in time order, so the state is shared
+     * by all the cpus (and is serialized by a mutex).
+     *
+     * Each window of sample time is a sequence of words, all of which are packed into a FrameType::PERF_GPU_ACTIVITY
+     * frame:
+     *
+     *  - the time of the first and last sample of the window
+     *  - the number of job intervals, then for each; the key of its slot's activity counter, its start and end time,
+     *    and the tgid and pid it ran for
+     *  - the number of job slot samples that could not be paired, or that were too old to be
+     *  - the number of work period totals, then for each; the GPU id and uid, the number of periods, the sum of their
+     *    active durations in nanoseconds, and the earliest start and the latest end of the periods (which are as the
+     *    tracepoint gives them)
+     */
+    class gpu_timeline_state_t {
+    public:
+        /** The most queued starts, or early stops, kept for each slot */
+        static constexpr std::size_t max_unpaired_per_slot = 64;
+        /** The most job intervals in each window, which is closed early once full so that it fits in one frame */
+        static constexpr std::size_t max_intervals_per_window = 16384;
+        /** The most work period totals in each window, which is likewise closed early once full */
+        static constexpr std::size_t max_work_periods_per_window = 1024;
+        /** Unpaired samples older than this (relative to the end of the window) are dropped as the window closes */
+        static constexpr std::uint64_t max_unpaired_age_ns = 10'000'000'000ULL;
+
+        /** The tracepoint an event is of */
+        enum class event_kind_t {
+            job_slots,
+            work_period,
+        };
+
+        /** Where a tracepoint event's fields are in its samples */
+        struct event_format_t {
+            event_kind_t kind;
+            std::uint64_t sample_type;
+            std::uint64_t read_format;
+        };
+
+        struct stats_t {
+            std::uint64_t intervals;
+            std::uint64_t unpaired;
+            std::uint64_t work_periods;
+            std::uint64_t windows;
+        };
+
+        /**
+         * @param configuration The capture's events; only those tracepoint events whose samples start with their id
+         * (PERF_SAMPLE_IDENTIFIER), and that have the time and raw data (PERF_SAMPLE_TIME and PERF_SAMPLE_RAW), are
+         * converted
+         * @param config The tracepoints to convert
+         * @param window The length of each window, in sample time
+         */
+        gpu_timeline_state_t(event_configuration_t const & configuration,
+                             gpu_timeline_config_t config,
+                             std::chrono::nanoseconds window);
+
+        /** @return The tracepoints that are converted */
+        [[nodiscard]] gpu_timeline_config_t const & get_config() const { return config; }
+
+        /** Record the ids of newly opened events */
+        void add_ids(std::vector<std::pair<perf_event_id_t, gator_key_t>> const & mappings);
+
+        /** @return A value that changes whenever ids are added */
+        [[nodiscard]] std::uint64_t get_version() const { return version.load(std::memory_order_acquire); }
+
+        /** Copy the format of each tracepoint event's id into `formats` */
+        void copy_formats(std::unordered_map<std::uint64_t, event_format_t> & formats) const;
+
+        /**
+         * Convert one mali_job_slots_event sample
+         *
+         * @param time The time of the sample
+         * @param event_id The event field, being the kind of event and the slot
+         * @param windows Receives the words of the window, if it closed
+         */
+        void on_job_slot_event(std::uint64_t time,
+                               std::uint32_t event_id,
+                               std::uint32_t tgid,
+                               std::uint32_t pid,
+                               std::vector<std::vector<std::uint64_t>> & windows);
+
+        /**
+         * Add one gpu_work_period sample to its uid's total
+         *
+         * @param time The time of the sample
+         * @param windows Receives the words of the window, if it closed
+         */
+        void on_work_period(std::uint64_t time,
+                            std::uint32_t gpu_id,
+                            std::uint32_t uid,
+                            std::uint64_t start_time,
+                            std::uint64_t end_time,
+                            std::uint64_t active_duration,
+                            std::vector<std::vector<std::uint64_t>> & windows);
+
+        /** Close the current window, if it has anything in it */
+        void flush(std::vector<std::vector<std::uint64_t>> & windows);
+
+        [[nodiscard]] stats_t get_stats() const;
+
+    private:
+        struct job_t {
+            std::uint64_t time;
+            std::uint32_t tgid;
+            std::uint32_t pid;
+        };
+
+        struct interval_t {
+            gator_key_t key;
+            std::uint64_t start;
+            std::uint64_t end;
+            std::uint32_t tgid;
+            std::uint32_t pid;
+        };
+
+        /** The unpaired samples of a slot, each in time order */
+        struct slot_t {
+            std::vector<job_t> starts {};
+            std::vector<std::uint64_t> stops {};
+            /** When the last job on the slot stopped, which a queued job cannot have started running before */
+            std::uint64_t last_stop = 0;
+        };
+
+        struct work_period_total_t {
+            std::uint64_t periods = 0;
+            std::uint64_t active = 0;
+            std::uint64_t start = 0;
+            std::uint64_t end = 0;
+        };
+
+        gpu_timeline_config_t config;
+        std::uint64_t window_ns;
+        std::map<gator_key_t, event_format_t> key_formats {};
+        mutable std::mutex mutex {};
+        std::unordered_map<std::uint64_t, event_format_t> id_formats {};
+        std::atomic_uint64_t version {0};
+        std::vector<slot_t> slots;
+        std::vector<interval_t> intervals {};
+        /** By GPU id (in the upper word) and uid */
+        std::map<std::uint64_t, work_period_total_t> work_periods {};
+        std::uint64_t unpaired = 0;
+        /** The time of the first sample of the window, which it is closed relative to */
+        std::uint64_t window_start = 0;
+        std::uint64_t first_time = 0;
+        std::uint64_t last_time = 0;
+        bool window_open = false;
+        stats_t stats {0, 0, 0, 0};
+
+        /** Start a window if there is not one open, having closed the current one if full or the sample is after it */
+        void open_window(std::uint64_t time, bool full, std::vector<std::vector<std::uint64_t>> & windows);
+
+        /** Pair the earliest start and stop of the slot, for as long as they are in order */
+        void pair(std::size_t slot_no);
+
+        /** Append the current window to `windows` and start a new one */
+        void close_window(std::vector<std::vector<std::uint64_t>> & windows);
+    };
+
+    static_assert(gpu_timeline_state_t::max_unpaired_per_slot <= gpu_timeline_state_t::max_intervals_per_window,
+                  "A window must have room for the intervals paired by any one sample");
+
+    /**
+     * Removes the samples of the Mali GPU tracepoints from the perf data records of one cpu, passing them to the shared
+     * gpu_timeline_state_t. All the other records are forwarded unchanged. One filter is used per cpu.
+     */
+    class gpu_timeline_filter_t {
+    public:
+        explicit gpu_timeline_filter_t(std::shared_ptr<gpu_timeline_state_t> state) : state(std::move(state)) {}
+
+        /**
+         * Filter a chunk of whole perf data records
+         *
+         * @param first_span The first part of the records
+         * @param second_span The remainder of the records, which follows on from the first (when the mmap wrapped)
+         * @param records Receives the records that are not GPU tracepoint samples
+         * @param windows Receives the words of each window that closed
+         */
+        void filter(lib::Span<char const> first_span,
+                    lib::Span<char const> second_span,
+                    std::vector<char> & records,
+                    std::vector<std::vector<std::uint64_t>> & windows);
+
+        /** Close the current (shared) window, if it has anything in it */
+        void flush(std::vector<std::vector<std::uint64_t>> & windows);
+
+    private:
+        std::shared_ptr<gpu_timeline_state_t> state;
+        std::uint64_t formats_version = 0;
+        std::unordered_map<std::uint64_t, gpu_timeline_state_t::event_format_t> formats {};
+        /** Reused for a record that is split across the two spans */
+        std::vector<char> split_record {};
+
+        [[nodiscard]] gpu_timeline_state_t::event_format_t const * find_format(std::uint64_t id);
+
+        void filter_record(lib::Span<char const> record,
+                           std::vector<char> & records,
+                           std::vector<std::vector<std::uint64_t>> & windows);
+    };
+}
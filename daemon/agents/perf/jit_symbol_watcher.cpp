@@ -0,0 +1,448 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "agents/perf/jit_symbol_watcher.h"
+
+#include "Logging.h"
+#include "lib/FsEntry.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <optional>
+
+#include <fcntl.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace agents::perf {
+    namespace {
+        constexpr std::string_view perf_map_prefix = "perf-";
+        constexpr std::string_view perf_map_suffix = ".map";
+        constexpr std::string_view jitdump_prefix = "jit-";
+        constexpr std::string_view jitdump_suffix = ".dump";
+
+        constexpr std::uint32_t jitdump_magic = 0x4A695444;
+        constexpr std::size_t jitdump_header_size = 40;
+        constexpr std::size_t jitdump_header_size_offset = 8;
+        constexpr std::size_t jitdump_record_header_size = 16;
+        constexpr std::uint32_t jit_code_load = 0;
+        constexpr std::uint32_t jit_code_close = 3;
+        /** The offsets within a JIT_CODE_LOAD record (including its header) */
+        constexpr std::size_t code_load_code_addr_offset = 32;
+        constexpr std::size_t code_load_code_size_offset = 40;
+        constexpr std::size_t code_load_name_offset = 56;
+
+        constexpr std::uint32_t directory_events = IN_CREATE | IN_MOVED_TO | IN_MODIFY | IN_CLOSE_WRITE;
+        constexpr std::uint32_t file_events = IN_MODIFY | IN_CLOSE_WRITE;
+
+        template<typename T>
+        T read_value(char const * data, std::size_t offset)
+        {
+            T result;
+            std::memcpy(&result, data + offset, sizeof(T));
+            return result;
+        }
+
+        /** @return The pid in a name like `<prefix><pid><suffix>`, if it is one */
+        std::optional<pid_t> parse_pid(std::string_view name, std::string_view prefix, std::string_view suffix)
+        {
+            if ((name.size() <= prefix.size() + suffix.size()) || (name.substr(0, prefix.size()) != prefix)
+                || (name.substr(name.size() - suffix.size()) != suffix)) {
+                return {};
+            }
+
+            auto const digits = name.substr(prefix.size(), name.size() - prefix.size() - suffix.size());
+            pid_t pid = 0;
+            for (char c : digits) {
+                if ((c < '0') || (c > '9') || (pid > 100000000)) {
+                    return {};
+                }
+                pid = (pid * 10) + (c - '0');
+            }
+            return pid;
+        }
+
+        /** Consume one hex number (optionally with a 0x prefix) and any spaces that precede it */
+        bool parse_hex(std::string_view & text, std::uint64_t & value)
+        {
+            auto const start = text.find_first_not_of(" \t");
+            if (start == std::string_view::npos) {
+                return false;
+            }
+            text.remove_prefix(start);
+            if ((text.size() > 2) && (text[0] == '0') && ((text[1] == 'x') || (text[1] == 'X'))) {
+                text.remove_prefix(2);
+            }
+
+            std::size_t length = 0;
+            value = 0;
+            for (; (length < text.size()) && (length <= 16); ++length) {
+                char const c = text[length];
+                std::uint64_t digit;
+                if ((c >= '0') && (c <= '9')) {
+                    digit = c - '0';
+                }
+                else if ((c >= 'a') && (c <= 'f')) {
+                    digit = c - 'a' + 10;
+                }
+                else if ((c >= 'A') && (c <= 'F')) {
+                    digit = c - 'A' + 10;
+                }
+                else {
+                    break;
+                }
+                value = (value << 4) | digit;
+            }
+
+            // the number must be followed by a space, and fit in 64 bits
+            if ((length == 0) || (length > 16) || (length == text.size()) || (text[length] != ' ')) {
+                return false;
+            }
+            text.remove_prefix(length);
+            return true;
+        }
+    }
+
+    jit_symbol_watcher_t::jit_symbol_watcher_t(std::string directory)
+        : directory(std::move(directory)), inotify_fd(inotify_init1(IN_NONBLOCK | IN_CLOEXEC))
+    {
+        if (inotify_fd) {
+            directory_wd = inotify_add_watch(*inotify_fd, this->directory.c_str(), directory_events);
+        }
+        if (directory_wd < 0) {
+            // the followed files are then checked for changes at each poll
+            LOG_DEBUG("Could not watch %s for JIT symbol files (%d)", this->directory.c_str(), errno);
+            inotify_fd.close();
+        }
+
+        // the files of processes that were already running
+        auto const dir_entry = lib::FsEntry::create(this->directory);
+        auto iterator = dir_entry.children();
+        for (auto child = iterator.next(); child; child = iterator.next()) {
+            auto const name = child->name();
+            if (auto pid = parse_pid(name, perf_map_prefix, perf_map_suffix)) {
+                add_file(child->path(), *pid, file_format_t::perf_map, false);
+            }
+            else if (auto pid = parse_pid(name, jitdump_prefix, jitdump_suffix)) {
+                add_file(child->path(), *pid, file_format_t::jitdump, false);
+            }
+        }
+    }
+
+    void jit_symbol_watcher_t::add_process_maps(std::string_view maps)
+    {
+        while (!maps.empty()) {
+            auto const end = std::min(maps.find('\n'), maps.size());
+            auto const line = maps.substr(0, end);
+            maps.remove_prefix(std::min(end + 1, maps.size()));
+
+            auto const path_start = line.find('/');
+            auto const name_start = line.rfind('/');
+            if (path_start == std::string_view::npos) {
+                continue;
+            }
+
+            // the pid in the name is that of the process that wrote the file, which may be the parent of this one
+            auto const pid = parse_pid(line.substr(name_start + 1), jitdump_prefix, jitdump_suffix);
+            if (!pid) {
+                continue;
+            }
+
+            auto const file_directory = line.substr(path_start, name_start - path_start);
+            add_file(std::string(line.substr(path_start)), *pid, file_format_t::jitdump, file_directory != directory);
+        }
+    }
+
+    void jit_symbol_watcher_t::add_file(std::string const & path, pid_t pid, file_format_t format, bool watch)
+    {
+        if (files.count(path) > 0) {
+            return;
+        }
+        if (files.size() >= max_files) {
+            LOG_DEBUG("Not following JIT symbol file %s, as too many are followed", path.c_str());
+            return;
+        }
+
+        lib::AutoClosingFd fd {::open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW | O_NONBLOCK)};
+        struct stat st {};
+        if ((!fd) || (fstat(*fd, &st) != 0) || !S_ISREG(st.st_mode)) {
+            return;
+        }
+
+        if (watch && inotify_fd) {
+            auto const wd = inotify_add_watch(*inotify_fd, path.c_str(), file_events);
+            if (wd >= 0) {
+                watched_paths[wd] = path;
+            }
+        }
+
+        LOG_DEBUG("Following JIT symbol file %s for pid %d", path.c_str(), pid);
+        files.emplace(path, file_t {pid, format, std::move(fd), 0, true, false});
+    }
+
+    void jit_symbol_watcher_t::read_events()
+    {
+        if (!inotify_fd) {
+            for (auto & entry : files) {
+                entry.second.changed = true;
+            }
+            return;
+        }
+
+        alignas(struct inotify_event) char events[4096];
+        for (;;) {
+            auto const length = ::read(*inotify_fd, events, sizeof(events));
+            if (length <= 0) {
+                return;
+            }
+
+            for (char const * ptr = events; ptr < events + length;) {
+                auto const * event = reinterpret_cast<struct inotify_event const *>(ptr);
+                ptr += sizeof(struct inotify_event) + event->len;
+
+                if ((event->mask & IN_Q_OVERFLOW) != 0) {
+                    for (auto & entry : files) {
+                        entry.second.changed = true;
+                    }
+                }
+                else if ((event->wd == directory_wd) && (event->len > 0)) {
+                    std::string_view const name {event->name};
+                    auto const path = directory + "/" + std::string(name);
+                    auto it = files.find(path);
+
+                    // a new file of the same name (as for a reused pid) is read from its start
+                    if ((it != files.end()) && ((event->mask & (IN_CREATE | IN_MOVED_TO)) != 0)) {
+                        files.erase(it);
+                        it = files.end();
+                    }
+
+                    if (it != files.end()) {
+                        it->second.changed = true;
+                    }
+                    else if (auto pid = parse_pid(name, perf_map_prefix, perf_map_suffix)) {
+                        add_file(path, *pid, file_format_t::perf_map, false);
+                    }
+                    else if (auto pid = parse_pid(name, jitdump_prefix, jitdump_suffix)) {
+                        add_file(path, *pid, file_format_t::jitdump, false);
+                    }
+                }
+                else if (auto it = watched_paths.find(event->wd); it != watched_paths.end()) {
+                    auto file = files.find(it->second);
+                    if (file != files.end()) {
+                        file->second.changed = true;
+                    }
+                    if ((event->mask & IN_IGNORED) != 0) {
+                        watched_paths.erase(it);
+                    }
+                }
+            }
+        }
+    }
+
+    std::vector<jit_symbol_watcher_t::process_symbols_t> jit_symbol_watcher_t::poll(
+        std::function<bool(pid_t)> const & filter)
+    {
+        read_events();
+
+        std::map<pid_t, std::string> symbols_by_pid {};
+        for (auto & entry : files) {
+            auto & file = entry.second;
+            if (file.finished || !file.changed || !filter(file.pid)) {
+                continue;
+            }
+
+            file.changed = false;
+            auto & symbols = symbols_by_pid[file.pid];
+            if (file.format == file_format_t::perf_map) {
+                read_perf_map(file, symbols);
+            }
+            else {
+                read_jitdump(file, symbols);
+            }
+        }
+
+        std::vector<process_symbols_t> result {};
+        for (auto & entry : symbols_by_pid) {
+            if (!entry.second.empty()) {
+                result.push_back({entry.first, std::move(entry.second)});
+            }
+        }
+        return result;
+    }
+
+    void jit_symbol_watcher_t::read_perf_map(file_t & file, std::string & symbols)
+    {
+        struct stat st {};
+        if (fstat(*file.fd, &st) != 0) {
+            return;
+        }
+
+        auto const size = static_cast<std::uint64_t>(st.st_size);
+        if (size < file.offset) {
+            // rewritten
+            file.offset = 0;
+        }
+
+        auto const to_read = std::min<std::uint64_t>(size - file.offset, max_read_per_poll);
+        if (to_read == 0) {
+            return;
+        }
+
+        buffer.resize(to_read);
+        auto const length = ::pread(*file.fd, buffer.data(), buffer.size(), static_cast<off_t>(file.offset));
+        if (length <= 0) {
+            return;
+        }
+
+        std::string_view const data {buffer.data(), static_cast<std::size_t>(length)};
+        std::size_t consumed = 0;
+        for (auto end = data.find('\n'); end != std::string_view::npos; end = data.find('\n', consumed)) {
+            auto line = data.substr(consumed, end - consumed);
+            consumed = end + 1;
+
+            std::uint64_t start;
+            std::uint64_t code_size;
+            if (!parse_hex(line, start) || !parse_hex(line, code_size)) {
+                continue;
+            }
+
+            auto const name_start = line.find_first_not_of(' ');
+            if (name_start == std::string_view::npos) {
+                continue;
+            }
+            line.remove_prefix(name_start);
+            if ((!line.empty()) && (line.back() == '\r')) {
+                line.remove_suffix(1);
+            }
+            if (line.size() <= max_symbol_length) {
+                add_symbol(file.pid, start, code_size, line, symbols);
+            }
+        }
+
+        // an incomplete line is read again once it is complete, unless it is too long to be kept
+        if (data.size() - consumed > max_symbol_length) {
+            consumed = data.size();
+        }
+        file.offset += consumed;
+
+        if (to_read == max_read_per_poll) {
+            // there may be more
+            file.changed = true;
+        }
+    }
+
+    void jit_symbol_watcher_t::read_jitdump(file_t & file, std::string & symbols)
+    {
+        struct stat st {};
+        if (fstat(*file.fd, &st) != 0) {
+            return;
+        }
+
+        auto const size = static_cast<std::uint64_t>(st.st_size);
+        if (size < file.offset) {
+            file.offset = 0;
+        }
+
+        if (file.offset == 0) {
+            if (size < jitdump_header_size) {
+                return;
+            }
+
+            buffer.resize(jitdump_header_size);
+            if (::pread(*file.fd, buffer.data(), buffer.size(), 0) != static_cast<ssize_t>(jitdump_header_size)) {
+                return;
+            }
+
+            // the file is written in the byte order of the process, which is the same as gatord's
+            auto const header_size = read_value<std::uint32_t>(buffer.data(), jitdump_header_size_offset);
+            if ((read_value<std::uint32_t>(buffer.data(), 0) != jitdump_magic)
+                || (header_size < jitdump_header_size)) {
+                file.finished = true;
+                return;
+            }
+            file.offset = header_size;
+        }
+
+        std::size_t read_bytes = 0;
+        while ((file.offset + jitdump_record_header_size <= size) && (read_bytes < max_read_per_poll)) {
+            // read the header, and for a JIT_CODE_LOAD its fields and name, but not the code that follows them
+            auto const to_read =
+                std::min<std::uint64_t>(size - file.offset, code_load_name_offset + max_symbol_length + 1);
+            buffer.resize(to_read);
+            auto const length = ::pread(*file.fd, buffer.data(), buffer.size(), static_cast<off_t>(file.offset));
+            if (length < static_cast<ssize_t>(jitdump_record_header_size)) {
+                return;
+            }
+            read_bytes += length;
+
+            auto const id = read_value<std::uint32_t>(buffer.data(), 0);
+            auto const total_size = read_value<std::uint32_t>(buffer.data(), 4);
+            if (total_size < jitdump_record_header_size) {
+                file.finished = true;
+                return;
+            }
+            if (file.offset + total_size > size) {
+                // not yet completely written
+                return;
+            }
+
+            if ((id == jit_code_load) && (total_size > code_load_name_offset)
+                && (static_cast<std::size_t>(length) > code_load_name_offset)) {
+                auto const available = std::min<std::size_t>(length, total_size) - code_load_name_offset;
+                char const * name = buffer.data() + code_load_name_offset;
+                auto const * name_end = static_cast<char const *>(std::memchr(name, 0, available));
+                if ((name_end != nullptr) && (std::memchr(name, '\n', name_end - name) == nullptr)) {
+                    add_symbol(file.pid,
+                               read_value<std::uint64_t>(buffer.data(), code_load_code_addr_offset),
+                               read_value<std::uint64_t>(buffer.data(), code_load_code_size_offset),
+                               std::string_view(name, name_end - name),
+                               symbols);
+                }
+            }
+            else if (id == jit_code_close) {
+                file.finished = true;
+                return;
+            }
+
+            file.offset += total_size;
+        }
+
+        if (read_bytes >= max_read_per_poll) {
+            // there may be more
+            file.changed = true;
+        }
+    }
+
+    void jit_symbol_watcher_t::add_symbol(pid_t pid,
+                                          std::uint64_t start,
+                                          std::uint64_t size,
+                                          std::string_view name,
+                                          std::string & symbols)
+    {
+        if (name.empty()) {
+            return;
+        }
+
+        std::uint64_t hash = std::hash<std::string_view> {}(name);
+        for (std::uint64_t value : {std::uint64_t(pid), start, size}) {
+            hash ^= value + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+        }
+
+        if (sent_symbols.size() >= max_sent_symbols) {
+            sent_symbols.clear();
+        }
+        if (!sent_symbols.insert(hash).second) {
+            return;
+        }
+
+        char prefix[40];
+        auto const prefix_length = std::snprintf(prefix, sizeof(prefix), "%" PRIx64 " %" PRIx64 " ", start, size);
+        symbols.append(prefix, prefix_length);
+        symbols.append(name);
+        symbols.push_back('\n');
+    }
+}
@@ -0,0 +1,117 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#pragma once
+
+#include "lib/AutoClosingFd.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <sys/types.h>
+
+namespace agents::perf {
+    /**
+     * Follows the symbol files that JIT compilers and interpreters write for perf, so that their generated code can be
+     * symbolized; the `perf-<pid>.map` text files (as written by ART, V8 and LuaJIT) and the binary `jit-<pid>.dump`
+     * jitdump files (as written by the JVMTI agent and V8).
+     *
+     * The files are found in the watched directory (normally /tmp), which is watched with inotify, and (for jitdump
+     * files, which are written wherever the runtime chooses but are always mapped by the process that writes them)
+     * in the maps of each process as they are sent. Only the part of each file that was appended since it was last
+     * read is read, and only once inotify shows it to have changed. The symbols are converted to the perf map format
+     * (`<start> <size> <name>`, with the start and size in hex) and those already sent are not sent again.
+     *
+     * The memory used is bounded; no more than max_files files are followed, no more than max_read_per_poll bytes
+     * are read from a file at a time (the rest are read at the next poll), and once max_sent_symbols symbols are
+     * remembered the record of what was sent is reset, so that a symbol may be sent more than once.
+     *
+     * The watcher is not thread safe, and is used from the capture's strand.
+     */
+    class jit_symbol_watcher_t {
+    public:
+        /** At most this many files are followed */
+        static constexpr std::size_t max_files = 1024;
+        /** At most this much is read from each file per poll */
+        static constexpr std::size_t max_read_per_poll = 1024 * 1024;
+        /** The number of symbols that are remembered as sent before that record is reset */
+        static constexpr std::size_t max_sent_symbols = 256 * 1024;
+        /** Longer lines of a perf map file, or names in a jitdump file, are skipped */
+        static constexpr std::size_t max_symbol_length = 4096;
+
+        /** The symbols found for some process, in the perf map format */
+        struct process_symbols_t {
+            pid_t pid;
+            std::string symbols;
+        };
+
+        /** @param directory The directory in which the runtimes write `perf-<pid>.map` files */
+        explicit jit_symbol_watcher_t(std::string directory = "/tmp");
+
+        /** Follow any jitdump file that is mapped in the contents of some process's maps file */
+        void add_process_maps(std::string_view maps);
+
+        /**
+         * Read the symbols that were added to the files since the last poll
+         *
+         * @param filter Decides whether the symbols of some process are wanted; the files of other processes are not
+         * read until they are
+         * @return The new symbols of each process that has any
+         */
+        [[nodiscard]] std::vector<process_symbols_t> poll(std::function<bool(pid_t)> const & filter);
+
+    private:
+        enum class file_format_t {
+            perf_map,
+            jitdump,
+        };
+
+        struct file_t {
+            pid_t pid;
+            file_format_t format;
+            lib::AutoClosingFd fd;
+            /** How much of the file was read */
+            std::uint64_t offset;
+            /** True once inotify shows the file to have changed since it was last read */
+            bool changed;
+            /** True once the file is found not to be one that can be read, or the jitdump file is closed */
+            bool finished;
+        };
+
+        std::string directory;
+        lib::AutoClosingFd inotify_fd;
+        int directory_wd = -1;
+        /** By path */
+        std::map<std::string, file_t> files {};
+        /** The paths of the files that are watched directly, by watch descriptor */
+        std::unordered_map<int, std::string> watched_paths {};
+        /** The hashes of the symbols that were sent */
+        std::unordered_set<std::uint64_t> sent_symbols {};
+        /** Reused when reading from the files */
+        std::vector<char> buffer {};
+
+        /** Start following some file, if it is not already followed */
+        void add_file(std::string const & path, pid_t pid, file_format_t format, bool watch);
+
+        /** Mark the files that inotify shows to have changed */
+        void read_events();
+
+        void read_perf_map(file_t & file, std::string & symbols);
+
+        void read_jitdump(file_t & file, std::string & symbols);
+
+        /** Append the symbol to `symbols` unless it was already sent */
+        void add_symbol(pid_t pid,
+                        std::uint64_t start,
+                        std::uint64_t size,
+                        std::string_view name,
+                        std::string & symbols);
+    };
+}
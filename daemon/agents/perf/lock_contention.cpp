@@ -0,0 +1,486 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "agents/perf/lock_contention.h"
+
+#include "agents/perf/perf_data_records.h"
+#include "k/perf_event.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace agents::perf {
+    namespace {
+        constexpr std::size_t word_size = sizeof(std::uint64_t);
+
+        constexpr gator_key_t no_key {0};
+
+        /** The fields that every paired sample has */
+        constexpr std::uint64_t required_sample_fields = required_tracepoint_sample_fields | PERF_SAMPLE_TID;
+
+        // the futex operations, as in linux/futex.h
+        constexpr std::uint64_t futex_wait = 0;
+        constexpr std::uint64_t futex_lock_pi = 6;
+        constexpr std::uint64_t futex_wait_bitset = 9;
+        constexpr std::uint64_t futex_wait_requeue_pi = 11;
+        constexpr std::uint64_t futex_lock_pi2 = 13;
+        /** Removes FUTEX_PRIVATE_FLAG and FUTEX_CLOCK_REALTIME from the operation */
+        constexpr std::uint64_t futex_cmd_mask = 0x7f;
+
+        [[nodiscard]] std::uint64_t read_word(char const * data, std::size_t index)
+        {
+            std::uint64_t result;
+            std::memcpy(&result, data + (index * word_size), word_size);
+            return result;
+        }
+
+        void append_bytes(std::vector<char> & output, void const * data, std::size_t size)
+        {
+            auto const * bytes = static_cast<char const *>(data);
+            output.insert(output.end(), bytes, bytes + size);
+        }
+
+        [[nodiscard]] std::size_t bucket_index(std::uint64_t latency)
+        {
+            std::size_t index = 0;
+            while ((latency != 0) && (index < (lock_contention_state_t::number_of_buckets - 1))) {
+                latency >>= 1;
+                index += 1;
+            }
+            return index;
+        }
+
+        [[nodiscard]] bool is_futex_wait(std::uint64_t op)
+        {
+            switch (op & futex_cmd_mask) {
+                case futex_wait:
+                case futex_lock_pi:
+                case futex_wait_bitset:
+                case futex_wait_requeue_pi:
+                case futex_lock_pi2:
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        /** Take the innermost frames of a call chain; those of user space if it has any, otherwise the kernel's */
+        void read_callsite(lib::Span<char const> record,
+                           tracepoint_callchain_t const & callchain,
+                           lock_contention_state_t::callsite_t & callsite)
+        {
+            std::size_t first = callchain.index;
+            std::size_t const end = callchain.index + callchain.length;
+            for (std::size_t index = first; index < end; ++index) {
+                if (read_word(record.data(), index) == PERF_CONTEXT_USER) {
+                    first = index + 1;
+                    break;
+                }
+            }
+
+            for (std::size_t index = first;
+                 (index < end) && (callsite.number_of_frames < lock_contention_state_t::max_callsite_frames);
+                 ++index) {
+                auto const frame = read_word(record.data(), index);
+                if (frame < PERF_CONTEXT_MAX) {
+                    callsite.frames[callsite.number_of_frames++] = frame;
+                }
+            }
+        }
+
+        template<typename Histogram>
+        void append_histogram(std::vector<std::uint64_t> & window, Histogram const & histogram)
+        {
+            std::size_t number_of_used_buckets = histogram.buckets.size();
+            while ((number_of_used_buckets > 0) && (histogram.buckets[number_of_used_buckets - 1] == 0)) {
+                number_of_used_buckets -= 1;
+            }
+
+            window.push_back(histogram.count);
+            window.push_back(histogram.sum);
+            window.push_back(histogram.max);
+            window.push_back(number_of_used_buckets);
+            window.insert(window.end(), histogram.buckets.begin(), histogram.buckets.begin() + number_of_used_buckets);
+        }
+    }
+
+    bool lock_contention_config_t::is_enabled() const
+    {
+        return (begin_key != no_key) && (end_key != no_key) && (begin_address.size != 0);
+    }
+
+    std::size_t lock_contention_state_t::callsite_hash_t::operator()(callsite_t const & callsite) const
+    {
+        std::uint64_t hash = callsite.pid;
+        for (std::size_t index = 0; index < callsite.number_of_frames; ++index) {
+            hash = (hash * 31) ^ callsite.frames[index];
+        }
+        return std::hash<std::uint64_t> {}(hash);
+    }
+
+    lock_contention_state_t::lock_contention_state_t(event_configuration_t const & configuration,
+                                                     lock_contention_config_t config,
+                                                     std::chrono::nanoseconds window)
+        : config(std::move(config)), window_ns(std::max<std::uint64_t>(1, window.count()))
+    {
+        for_each_event_definition(configuration, [this](event_definition_t const & event) {
+            auto const sample_type = event.attr.sample_type;
+            auto const sample_fields = (sample_type & required_sample_fields);
+            if ((event.attr.type != PERF_TYPE_TRACEPOINT) || (sample_fields != required_sample_fields)
+                || (event.key == no_key)) {
+                return;
+            }
+
+            // the id is always the first word after the header
+            std::size_t const tid_index = ((sample_type & PERF_SAMPLE_IP) != 0 ? 3 : 2);
+
+            if (event.key == this->config.begin_key) {
+                key_formats.emplace(event.key, event_format_t {false, sample_type, event.attr.read_format, tid_index});
+            }
+            else if (event.key == this->config.end_key) {
+                key_formats.emplace(event.key, event_format_t {true, sample_type, event.attr.read_format, tid_index});
+            }
+        });
+    }
+
+    void lock_contention_state_t::add_ids(std::vector<std::pair<perf_event_id_t, gator_key_t>> const & mappings)
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        bool added = false;
+        for (auto const & [id, key] : mappings) {
+            auto it = key_formats.find(key);
+            if (it != key_formats.end()) {
+                id_formats[static_cast<std::uint64_t>(id)] = it->second;
+                added = true;
+            }
+        }
+
+        if (added) {
+            version.fetch_add(1, std::memory_order_acq_rel);
+        }
+    }
+
+    void lock_contention_state_t::copy_formats(std::unordered_map<std::uint64_t, event_format_t> & formats) const
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        formats = id_formats;
+    }
+
+    lock_contention_state_t::stats_t lock_contention_state_t::get_stats() const
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        return stats;
+    }
+
+    void lock_contention_state_t::open_window(std::uint64_t time, std::vector<std::vector<std::uint64_t>> & windows)
+    {
+        if (window_open && (time >= window_start) && ((time - window_start) >= window_ns)) {
+            close_window(windows);
+        }
+
+        if (!window_open) {
+            window_open = true;
+            window_start = time;
+            first_wait_time = std::numeric_limits<std::uint64_t>::max();
+            last_wait_time = 0;
+        }
+    }
+
+    void lock_contention_state_t::on_begin(std::uint32_t tid,
+                                           std::uint64_t time,
+                                           bool is_wait,
+                                           std::uint64_t address,
+                                           callsite_t const & callsite,
+                                           std::vector<std::vector<std::uint64_t>> & windows)
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        open_window(time, windows);
+
+        auto & samples = unpaired[tid];
+        begin_t const begin {time, is_wait, address, callsite};
+
+        // pair with the earliest end after it
+        auto best = samples.ends.end();
+        for (auto it = samples.ends.begin(); it != samples.ends.end(); ++it) {
+            if ((*it >= time) && ((best == samples.ends.end()) || (*it < *best))) {
+                best = it;
+            }
+        }
+
+        if (best == samples.ends.end()) {
+            if (samples.begins.size() >= max_unpaired_per_thread) {
+                samples.begins.erase(samples.begins.begin());
+                add_unpaired();
+            }
+            samples.begins.push_back(begin);
+            return;
+        }
+
+        add_wait(begin, *best);
+        samples.ends.erase(best);
+    }
+
+    void lock_contention_state_t::on_end(std::uint32_t tid,
+                                         std::uint64_t time,
+                                         std::vector<std::vector<std::uint64_t>> & windows)
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        open_window(time, windows);
+
+        auto & samples = unpaired[tid];
+
+        // pair with the latest start before it
+        auto best = samples.begins.end();
+        for (auto it = samples.begins.begin(); it != samples.begins.end(); ++it) {
+            if ((it->time <= time) && ((best == samples.begins.end()) || (it->time > best->time))) {
+                best = it;
+            }
+        }
+
+        if (best == samples.begins.end()) {
+            if (samples.ends.size() >= max_unpaired_per_thread) {
+                samples.ends.erase(samples.ends.begin());
+                add_unpaired();
+            }
+            samples.ends.push_back(time);
+            return;
+        }
+
+        add_wait(*best, time);
+        samples.begins.erase(best);
+    }
+
+    void lock_contention_state_t::add_wait(begin_t const & begin, std::uint64_t end_time)
+    {
+        // the syscalls that do not wait are only paired so that their ends are not left unpaired
+        if (!begin.is_wait) {
+            return;
+        }
+
+        auto const wait = end_time - begin.time;
+
+        auto const add_to = [wait](histogram_t & histogram) {
+            histogram.count += 1;
+            histogram.sum += wait;
+            histogram.max = std::max(histogram.max, wait);
+            histogram.buckets[bucket_index(wait)] += 1;
+        };
+
+        auto lock_it = locks.find({begin.callsite.pid, begin.address});
+        if ((lock_it == locks.end()) && (locks.size() < max_entries)) {
+            lock_it = locks.emplace(lock_id_t {begin.callsite.pid, begin.address}, histogram_t {}).first;
+        }
+
+        auto callsite_it = callsites.find(begin.callsite);
+        if ((callsite_it == callsites.end()) && (callsites.size() < max_entries)) {
+            callsite_it = callsites.emplace(begin.callsite, histogram_t {}).first;
+        }
+
+        // keep the two sets of histograms consistent, so that a wait is in both or neither
+        if ((lock_it == locks.end()) || (callsite_it == callsites.end())) {
+            window_dropped += 1;
+            stats.dropped += 1;
+            return;
+        }
+
+        add_to(lock_it->second);
+        add_to(callsite_it->second);
+
+        first_wait_time = std::min(first_wait_time, begin.time);
+        last_wait_time = std::max(last_wait_time, end_time);
+
+        stats.waits += 1;
+    }
+
+    void lock_contention_state_t::add_unpaired()
+    {
+        window_unpaired += 1;
+        stats.unpaired += 1;
+    }
+
+    void lock_contention_state_t::flush(std::vector<std::vector<std::uint64_t>> & windows)
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        windows.clear();
+
+        if (window_open) {
+            close_window(windows);
+        }
+    }
+
+    void lock_contention_state_t::close_window(std::vector<std::vector<std::uint64_t>> & windows)
+    {
+        // drop the samples that are too old to still be paired
+        auto const newest = std::max(window_start, last_wait_time);
+        auto const oldest = (newest > max_unpaired_age_ns ? newest - max_unpaired_age_ns : 0);
+        for (auto it = unpaired.begin(); it != unpaired.end();) {
+            auto & begins = it->second.begins;
+            auto const old_begins = std::remove_if(begins.begin(), begins.end(), [oldest](begin_t const & begin) {
+                return begin.time < oldest;
+            });
+            auto & ends = it->second.ends;
+            auto const old_ends =
+                std::remove_if(ends.begin(), ends.end(), [oldest](std::uint64_t time) { return time < oldest; });
+
+            auto const dropped = std::uint64_t(begins.end() - old_begins) + std::uint64_t(ends.end() - old_ends);
+            window_unpaired += dropped;
+            stats.unpaired += dropped;
+            begins.erase(old_begins, begins.end());
+            ends.erase(old_ends, ends.end());
+
+            if (begins.empty() && ends.empty()) {
+                it = unpaired.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+
+        window_open = false;
+
+        if (locks.empty() && (window_dropped == 0) && (window_unpaired == 0)) {
+            return;
+        }
+
+        auto & window = windows.emplace_back();
+        window.reserve(6 + (locks.size() * (6 + number_of_buckets))
+                       + (callsites.size() * (6 + max_callsite_frames + number_of_buckets)));
+
+        // a window with only unpaired or dropped samples has no waits to take the times from
+        window.push_back(first_wait_time <= last_wait_time ? first_wait_time : window_start);
+        window.push_back(first_wait_time <= last_wait_time ? last_wait_time : window_start);
+        window.push_back(window_dropped);
+        window.push_back(window_unpaired);
+
+        window.push_back(locks.size());
+        for (auto const & [id, histogram] : locks) {
+            window.push_back(id.pid);
+            window.push_back(id.address);
+            append_histogram(window, histogram);
+        }
+
+        window.push_back(callsites.size());
+        for (auto const & [callsite, histogram] : callsites) {
+            window.push_back(callsite.pid);
+            window.push_back(callsite.number_of_frames);
+            window.insert(window.end(),
+                          callsite.frames.begin(),
+                          callsite.frames.begin() + callsite.number_of_frames);
+            append_histogram(window, histogram);
+        }
+
+        locks.clear();
+        callsites.clear();
+        window_dropped = 0;
+        window_unpaired = 0;
+
+        stats.windows += 1;
+    }
+
+    lock_contention_state_t::event_format_t const * lock_contention_filter_t::find_format(std::uint64_t id)
+    {
+        auto it = formats.find(id);
+        if (it != formats.end()) {
+            return &it->second;
+        }
+
+        // refresh the local copy only when some new id was added since it was taken
+        auto const version = state->get_version();
+        if (version == formats_version) {
+            return nullptr;
+        }
+
+        formats_version = version;
+        state->copy_formats(formats);
+
+        it = formats.find(id);
+        return (it != formats.end() ? &it->second : nullptr);
+    }
+
+    void lock_contention_filter_t::filter(lib::Span<char const> first_span,
+                                          lib::Span<char const> second_span,
+                                          std::vector<char> & records,
+                                          std::vector<std::vector<std::uint64_t>> & windows)
+    {
+        records.clear();
+        records.reserve(first_span.size() + second_span.size());
+        windows.clear();
+
+        for_each_perf_data_record(first_span, second_span, split_record, records, [&](lib::Span<char const> record) {
+            filter_record(record, records, windows);
+        });
+    }
+
+    void lock_contention_filter_t::filter_record(lib::Span<char const> record,
+                                                 std::vector<char> & records,
+                                                 std::vector<std::vector<std::uint64_t>> & windows)
+    {
+        perf_event_header header;
+        std::memcpy(&header, record.data(), sizeof(header));
+
+        std::size_t const words = record.size() / word_size;
+
+        if ((header.type != PERF_RECORD_SAMPLE) || (header.size != record.size()) || (words <= 1)) {
+            return append_bytes(records, record.data(), record.size());
+        }
+
+        auto const * format = find_format(read_word(record.data(), 1));
+        if ((format == nullptr) || (format->tid_index >= words)) {
+            return append_bytes(records, record.data(), record.size());
+        }
+
+        std::uint64_t time = 0;
+        lib::Span<char const> raw_data {};
+        tracepoint_callchain_t callchain {0, 0};
+        if (!find_tracepoint_sample_time_and_raw_data(record,
+                                                      format->sample_type,
+                                                      format->read_format,
+                                                      time,
+                                                      raw_data,
+                                                      callchain)) {
+            return append_bytes(records, record.data(), record.size());
+        }
+
+        // the pid is the lower half of the word, and the tid the upper
+        auto const pid_tid = read_word(record.data(), format->tid_index);
+        auto const tid = std::uint32_t(pid_tid >> 32);
+
+        if (format->is_end) {
+            return state->on_end(tid, time, windows);
+        }
+
+        auto const & config = state->get_config();
+
+        auto const address = read_tracepoint_field(raw_data, config.begin_address);
+        if (!address) {
+            return append_bytes(records, record.data(), record.size());
+        }
+
+        // without an operation every sample is a wait
+        bool is_wait = true;
+        if (config.begin_op.size != 0) {
+            auto const op = read_tracepoint_field(raw_data, config.begin_op);
+            if (!op) {
+                return append_bytes(records, record.data(), record.size());
+            }
+            is_wait = is_futex_wait(*op);
+        }
+
+        lock_contention_state_t::callsite_t callsite {};
+        callsite.pid = std::uint32_t(pid_tid);
+        read_callsite(record, callchain, callsite);
+
+        state->on_begin(tid, time, is_wait, *address, callsite, windows);
+    }
+
+    void lock_contention_filter_t::flush(std::vector<std::vector<std::uint64_t>> & windows)
+    {
+        state->flush(windows);
+    }
+}
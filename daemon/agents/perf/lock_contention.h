@@ -0,0 +1,272 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#pragma once
+
+#include "agents/perf/events/event_configuration.hpp"
+#include "agents/perf/events/types.hpp"
+#include "agents/perf/tracepoint_sample.h"
+#include "lib/Span.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace agents::perf {
+    /**
+     * The tracepoints that the perf agent pairs into lock wait times; either syscalls:sys_enter_futex and
+     * syscalls:sys_exit_futex (for the user space locks), or lock:contention_begin and lock:contention_end (for the
+     * kernel's locks)
+     */
+    struct lock_contention_config_t {
+        /** The key of the event of the start of each wait, or zero if it is not enabled */
+        gator_key_t begin_key {0};
+        /** The address of the lock that is waited on (uaddr or lock_addr) */
+        tracepoint_field_t begin_address {0, 0};
+        /** The futex operation, which is absent for lock:contention_begin, whose every sample is a wait */
+        tracepoint_field_t begin_op {0, 0};
+
+        /** The key of the event of the end of each wait, or zero if it is not enabled */
+        gator_key_t end_key {0};
+
+        /** @return True if both tracepoints are converted */
+        [[nodiscard]] bool is_enabled() const;
+    };
+
+    /**
+     * Pairs the start and end samples of the lock tracepoints for each thread into the time that it waited for each
+     * lock, so that the contended locks can be found without the host decoding every futex syscall.
+     *
+     * As a thread may finish waiting on a different cpu to the one it started on, and as the cpus' mmaps are not read
+     * in time order, the pairing is shared by all the cpus (and is serialized by a mutex). A thread is in at most one
+     * syscall at a time, so a start is paired with the earliest unpaired end after it, and an end with the latest
+     * unpaired start before it. For the futex syscalls, only the operations that wait (FUTEX_WAIT, FUTEX_WAIT_BITSET,
+     * FUTEX_LOCK_PI, FUTEX_LOCK_PI2 and FUTEX_WAIT_REQUEUE_PI) are counted; the others are paired and then dropped.
+     *
+     * The wait times of each window of sample time are collected into a histogram for each lock, by process and
+     * address, and for each call site, by process and the innermost frames of the start sample's call chain (the user
+     * frames, if it has any). Each window is a sequence of words, all of which are packed into a
+     * FrameType::PERF_LOCK_CONTENTION frame:
+     *
+     *  - the time of the earliest start and of the latest end of the window's waits
+     *  - the number of waits that were not counted as there were too many locks or call sites in the window, and the
+     *    number of samples that could not be paired
+     *  - the number of locks, then for each lock; its pid, address, and histogram
+     *  - the number of call sites, then for each call site; its pid, the number of frames, each frame, and histogram
+     *
+     * Each histogram is the number of waits, the sum and maximum of their times in nanoseconds, the number of buckets,
+     * and the count in each bucket. Bucket 0 counts the waits that took 0ns, and bucket n counts those that took at
+     * least 2^(n-1)ns but less than 2^n ns. The buckets after the last non-zero bucket are omitted.
+     */
+    class lock_contention_state_t {
+    public:
+        static constexpr std::size_t number_of_buckets = 64;
+        /** The most locks, and the most call sites, in each window; the waits of any others are counted as dropped */
+        static constexpr std::size_t max_entries = 512;
+        /** The most frames of each call site */
+        static constexpr std::size_t max_callsite_frames = 4;
+        /** The most unpaired starts, or ends, kept for each thread */
+        static constexpr std::size_t max_unpaired_per_thread = 16;
+        /** Unpaired samples older than this (relative to the end of the window) are dropped as the window closes */
+        static constexpr std::uint64_t max_unpaired_age_ns = 10'000'000'000ULL;
+
+        /** The innermost frames of a call chain */
+        struct callsite_t {
+            std::uint32_t pid = 0;
+            std::uint32_t number_of_frames = 0;
+            std::array<std::uint64_t, max_callsite_frames> frames {};
+
+            [[nodiscard]] bool operator==(callsite_t const & that) const
+            {
+                return (pid == that.pid) && (number_of_frames == that.number_of_frames) && (frames == that.frames);
+            }
+        };
+
+        /** Where a lock tracepoint event's fields are in its samples, and which tracepoint it is */
+        struct event_format_t {
+            bool is_end;
+            std::uint64_t sample_type;
+            std::uint64_t read_format;
+            /** The offset, in words from the start of the record, of the pid/tid */
+            std::size_t tid_index;
+        };
+
+        struct stats_t {
+            std::uint64_t waits;
+            std::uint64_t unpaired;
+            std::uint64_t dropped;
+            std::uint64_t windows;
+        };
+
+        /**
+         * @param configuration The capture's events; only those lock tracepoint events whose samples start with their
+         * id (PERF_SAMPLE_IDENTIFIER), and that have the pid/tid, time and raw data (PERF_SAMPLE_TID, PERF_SAMPLE_TIME
+         * and PERF_SAMPLE_RAW), are paired
+         * @param config The tracepoints to pair
+         * @param window The length of each window, in sample time
+         */
+        lock_contention_state_t(event_configuration_t const & configuration,
+                                lock_contention_config_t config,
+                                std::chrono::nanoseconds window);
+
+        /** @return The tracepoints that are paired */
+        [[nodiscard]] lock_contention_config_t const & get_config() const { return config; }
+
+        /** Record the ids of newly opened events */
+        void add_ids(std::vector<std::pair<perf_event_id_t, gator_key_t>> const & mappings);
+
+        /** @return A value that changes whenever ids are added */
+        [[nodiscard]] std::uint64_t get_version() const { return version.load(std::memory_order_acquire); }
+
+        /** Copy the format of each lock tracepoint event's id into `formats` */
+        void copy_formats(std::unordered_map<std::uint64_t, event_format_t> & formats) const;
+
+        /**
+         * Record the start of one syscall or wait
+         *
+         * @param tid The waiting thread
+         * @param time The time of the sample
+         * @param is_wait False if the futex operation does not wait, in which case it is only paired
+         * @param address The lock's address
+         * @param callsite Where the lock was waited on
+         * @param windows Receives the words of the window, if it closed
+         */
+        void on_begin(std::uint32_t tid,
+                      std::uint64_t time,
+                      bool is_wait,
+                      std::uint64_t address,
+                      callsite_t const & callsite,
+                      std::vector<std::vector<std::uint64_t>> & windows);
+
+        /**
+         * Pair the end of one syscall or wait with its start
+         *
+         * @param tid The waiting thread
+         * @param time The time of the sample
+         * @param windows Receives the words of the window, if it closed
+         */
+        void on_end(std::uint32_t tid, std::uint64_t time, std::vector<std::vector<std::uint64_t>> & windows);
+
+        /** Close the current window, if it has any waits or unpaired samples */
+        void flush(std::vector<std::vector<std::uint64_t>> & windows);
+
+        [[nodiscard]] stats_t get_stats() const;
+
+    private:
+        struct histogram_t {
+            std::uint64_t count = 0;
+            std::uint64_t sum = 0;
+            std::uint64_t max = 0;
+            std::array<std::uint64_t, number_of_buckets> buckets {};
+        };
+
+        struct begin_t {
+            std::uint64_t time;
+            bool is_wait;
+            std::uint64_t address;
+            callsite_t callsite;
+        };
+
+        /** The unpaired samples of one thread, each in the order they were received */
+        struct unpaired_t {
+            std::vector<begin_t> begins {};
+            std::vector<std::uint64_t> ends {};
+        };
+
+        struct lock_id_t {
+            std::uint32_t pid;
+            std::uint64_t address;
+
+            [[nodiscard]] bool operator==(lock_id_t const & that) const
+            {
+                return (pid == that.pid) && (address == that.address);
+            }
+        };
+
+        struct lock_id_hash_t {
+            [[nodiscard]] std::size_t operator()(lock_id_t const & id) const
+            {
+                return std::hash<std::uint64_t> {}(id.address ^ (std::uint64_t(id.pid) << 48));
+            }
+        };
+
+        struct callsite_hash_t {
+            [[nodiscard]] std::size_t operator()(callsite_t const & callsite) const;
+        };
+
+        lock_contention_config_t config;
+        std::uint64_t window_ns;
+        std::map<gator_key_t, event_format_t> key_formats {};
+        mutable std::mutex mutex {};
+        std::unordered_map<std::uint64_t, event_format_t> id_formats {};
+        std::atomic_uint64_t version {0};
+        std::unordered_map<lock_id_t, histogram_t, lock_id_hash_t> locks {};
+        std::unordered_map<callsite_t, histogram_t, callsite_hash_t> callsites {};
+        /** By tid */
+        std::unordered_map<std::uint32_t, unpaired_t> unpaired {};
+        /** The time of the first sample of the window, which it is closed relative to */
+        std::uint64_t window_start = 0;
+        std::uint64_t first_wait_time = 0;
+        std::uint64_t last_wait_time = 0;
+        std::uint64_t window_dropped = 0;
+        std::uint64_t window_unpaired = 0;
+        bool window_open = false;
+        stats_t stats {0, 0, 0, 0};
+
+        /** Start a window if there is not one open, having closed the current one if the sample is after it */
+        void open_window(std::uint64_t time, std::vector<std::vector<std::uint64_t>> & windows);
+
+        void add_wait(begin_t const & begin, std::uint64_t end_time);
+
+        /** Count one sample that could not be paired */
+        void add_unpaired();
+
+        /** Append the current window to `windows` */
+        void close_window(std::vector<std::vector<std::uint64_t>> & windows);
+    };
+
+    /**
+     * Removes the samples of the lock tracepoints from the perf data records of one cpu, passing them to the shared
+     * lock_contention_state_t. All the other records are forwarded unchanged. One filter is used per cpu.
+     */
+    class lock_contention_filter_t {
+    public:
+        explicit lock_contention_filter_t(std::shared_ptr<lock_contention_state_t> state) : state(std::move(state)) {}
+
+        /**
+         * Filter a chunk of whole perf data records
+         *
+         * @param first_span The first part of the records
+         * @param second_span The remainder of the records, which follows on from the first (when the mmap wrapped)
+         * @param records Receives the records that are not lock tracepoint samples
+         * @param windows Receives the words of each window that closed
+         */
+        void filter(lib::Span<char const> first_span,
+                    lib::Span<char const> second_span,
+                    std::vector<char> & records,
+                    std::vector<std::vector<std::uint64_t>> & windows);
+
+        /** Close the current (shared) window, if it has anything in it */
+        void flush(std::vector<std::vector<std::uint64_t>> & windows);
+
+    private:
+        std::shared_ptr<lock_contention_state_t> state;
+        std::uint64_t formats_version = 0;
+        std::unordered_map<std::uint64_t, lock_contention_state_t::event_format_t> formats {};
+        /** Reused for a record that is split across the two spans */
+        std::vector<char> split_record {};
+
+        [[nodiscard]] lock_contention_state_t::event_format_t const * find_format(std::uint64_t id);
+
+        void filter_record(lib::Span<char const> record,
+                           std::vector<char> & records,
+                           std::vector<std::vector<std::uint64_t>> & windows);
+    };
+}
@@ -0,0 +1,277 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "agents/perf/metric_expression.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+
+namespace agents::perf {
+    /** A recursive descent parser, which appends the operations of each term as it is parsed */
+    class metric_expression_t::parser_t {
+    public:
+        parser_t(std::string_view text, metric_expression_t & expression) : text(text), expression(expression) {}
+
+        [[nodiscard]] bool parse(std::string & error)
+        {
+            if (!parse_sum()) {
+                error = message;
+                return false;
+            }
+
+            skip_space();
+            if (position < text.size()) {
+                error = "unexpected '" + std::string(1, text[position]) + "'";
+                return false;
+            }
+
+            return true;
+        }
+
+    private:
+        std::string_view text;
+        metric_expression_t & expression;
+        std::size_t position {0};
+        std::size_t depth {0};
+        std::size_t max_depth {0};
+        std::string message {};
+
+        void skip_space()
+        {
+            while ((position < text.size()) && (std::isspace(static_cast<unsigned char>(text[position])) != 0)) {
+                ++position;
+            }
+        }
+
+        [[nodiscard]] bool accept(char c)
+        {
+            skip_space();
+            if ((position < text.size()) && (text[position] == c)) {
+                ++position;
+                return true;
+            }
+            return false;
+        }
+
+        [[nodiscard]] bool fail(std::string reason)
+        {
+            message = std::move(reason);
+            return false;
+        }
+
+        /** Append an operation, which pushes `pushes` values once it has popped `pops` */
+        [[nodiscard]] bool append(op_t op, std::size_t pops, std::size_t pushes)
+        {
+            depth = depth - pops + pushes;
+            max_depth = std::max(max_depth, depth);
+            if (max_depth > max_stack_depth) {
+                return fail("the expression is too deeply nested");
+            }
+            expression.ops.push_back(op);
+            return true;
+        }
+
+        [[nodiscard]] bool parse_sum()
+        {
+            if (!parse_product()) {
+                return false;
+            }
+
+            while (true) {
+                if (accept('+')) {
+                    if (!parse_product() || !append({op_code_t::add, 0, 0}, 2, 1)) {
+                        return false;
+                    }
+                }
+                else if (accept('-')) {
+                    if (!parse_product() || !append({op_code_t::subtract, 0, 0}, 2, 1)) {
+                        return false;
+                    }
+                }
+                else {
+                    return true;
+                }
+            }
+        }
+
+        [[nodiscard]] bool parse_product()
+        {
+            if (!parse_unary()) {
+                return false;
+            }
+
+            while (true) {
+                if (accept('*')) {
+                    if (!parse_unary() || !append({op_code_t::multiply, 0, 0}, 2, 1)) {
+                        return false;
+                    }
+                }
+                else if (accept('/')) {
+                    if (!parse_unary() || !append({op_code_t::divide, 0, 0}, 2, 1)) {
+                        return false;
+                    }
+                }
+                else {
+                    return true;
+                }
+            }
+        }
+
+        [[nodiscard]] bool parse_unary()
+        {
+            if (accept('-')) {
+                return parse_unary() && append({op_code_t::negate, 0, 0}, 1, 1);
+            }
+            return parse_primary();
+        }
+
+        [[nodiscard]] bool parse_primary()
+        {
+            skip_space();
+            if (position >= text.size()) {
+                return fail("unexpected end of the expression");
+            }
+
+            if (accept('(')) {
+                if (!parse_sum()) {
+                    return false;
+                }
+                if (!accept(')')) {
+                    return fail("missing ')'");
+                }
+                return true;
+            }
+
+            if (accept('$')) {
+                return parse_event();
+            }
+
+            constexpr std::string_view interval_name = "interval";
+            if (text.substr(position, interval_name.size()) == interval_name) {
+                position += interval_name.size();
+                return append({op_code_t::interval, 0, 0}, 0, 1);
+            }
+
+            if ((std::isdigit(static_cast<unsigned char>(text[position])) != 0) || (text[position] == '.')) {
+                return parse_constant();
+            }
+
+            return fail("unexpected '" + std::string(1, text[position]) + "'");
+        }
+
+        [[nodiscard]] bool parse_event()
+        {
+            // strtoull needs a terminated string, and an event number is short
+            auto const is_event_char = [](char c) {
+                return (std::isxdigit(static_cast<unsigned char>(c)) != 0) || (c == 'x') || (c == 'X');
+            };
+
+            std::array<char, 24> buffer {};
+            std::size_t length = 0;
+            while ((position + length < text.size()) && (length + 1 < buffer.size())
+                   && is_event_char(text[position + length])) {
+                buffer[length] = text[position + length];
+                ++length;
+            }
+
+            char * end = nullptr;
+            auto const event = std::strtoull(buffer.data(), &end, 16);
+            if ((length == 0) || (end != buffer.data() + length)) {
+                return fail("expected an event number after '$'");
+            }
+            position += length;
+
+            auto const it = std::find(expression.events.begin(), expression.events.end(), event);
+            auto const index = static_cast<std::size_t>(it - expression.events.begin());
+            if (it == expression.events.end()) {
+                expression.events.push_back(event);
+            }
+
+            return append({op_code_t::event, index, 0}, 0, 1);
+        }
+
+        [[nodiscard]] bool parse_constant()
+        {
+            std::array<char, 32> buffer {};
+            std::size_t length = 0;
+            while ((position + length < text.size()) && (length + 1 < buffer.size())
+                   && ((std::isdigit(static_cast<unsigned char>(text[position + length])) != 0)
+                       || (text[position + length] == '.'))) {
+                buffer[length] = text[position + length];
+                ++length;
+            }
+
+            char * end = nullptr;
+            auto const value = std::strtod(buffer.data(), &end);
+            if (end != buffer.data() + length) {
+                return fail("invalid number '" + std::string(buffer.data()) + "'");
+            }
+            position += length;
+
+            return append({op_code_t::constant, 0, value}, 0, 1);
+        }
+    };
+
+    std::optional<metric_expression_t> metric_expression_t::parse(std::string_view text, std::string & error)
+    {
+        metric_expression_t result {};
+        parser_t parser {text, result};
+        if (!parser.parse(error)) {
+            return {};
+        }
+        return result;
+    }
+
+    std::optional<double> metric_expression_t::evaluate(lib::Span<double const> counts, double interval_seconds) const
+    {
+        std::array<double, max_stack_depth> stack {};
+        std::size_t size = 0;
+
+        for (auto const & op : ops) {
+            switch (op.code) {
+                case op_code_t::constant:
+                    stack[size++] = op.value;
+                    break;
+                case op_code_t::event:
+                    if (op.event_index >= counts.size()) {
+                        return {};
+                    }
+                    stack[size++] = counts[op.event_index];
+                    break;
+                case op_code_t::interval:
+                    stack[size++] = interval_seconds;
+                    break;
+                case op_code_t::negate:
+                    stack[size - 1] = -stack[size - 1];
+                    break;
+                case op_code_t::add:
+                    --size;
+                    stack[size - 1] += stack[size];
+                    break;
+                case op_code_t::subtract:
+                    --size;
+                    stack[size - 1] -= stack[size];
+                    break;
+                case op_code_t::multiply:
+                    --size;
+                    stack[size - 1] *= stack[size];
+                    break;
+                case op_code_t::divide:
+                    --size;
+                    if (stack[size] == 0) {
+                        return {};
+                    }
+                    stack[size - 1] /= stack[size];
+                    break;
+            }
+        }
+
+        if ((size != 1) || !std::isfinite(stack[0])) {
+            return {};
+        }
+
+        return stack[0];
+    }
+}
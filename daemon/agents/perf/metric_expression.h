@@ -0,0 +1,81 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#pragma once
+
+#include "lib/Span.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace agents::perf {
+    /**
+     * A derived metric of some of a cpu PMU's events, such as the instructions per cycle, as given by the `expression`
+     * attribute of a metric counter in the events XML.
+     *
+     * An expression is made of:
+     *
+     *  - `$` followed by an event number in hex (such as `$0x08`), which is the count of that event over the interval
+     *  - `interval`, which is the length of the interval in seconds (so that a count can be made a rate)
+     *  - decimal numbers, such as `64` or `0.5`
+     *  - the binary operators `+`, `-`, `*` and `/`, the unary `-`, and parentheses, with the usual precedence
+     *
+     * For example `$0x08 / $0x11` (the instructions executed per cycle) or `$0x17 * 64 / interval` (the bytes
+     * refilled into the L2 cache per second). The expression is compiled to a short sequence of operations on a stack,
+     * so that it can be evaluated for each core and interval without allocating.
+     */
+    class metric_expression_t {
+    public:
+        /** The deepest the evaluation stack may get, which bounds the complexity of an expression */
+        static constexpr std::size_t max_stack_depth = 16;
+
+        /**
+         * Parse an expression
+         *
+         * @param text The expression
+         * @param error Receives the reason the expression is invalid
+         * @return The expression, or nothing if it is invalid
+         */
+        [[nodiscard]] static std::optional<metric_expression_t> parse(std::string_view text, std::string & error);
+
+        /** @return The distinct events of the expression, in the order they first appear */
+        [[nodiscard]] lib::Span<std::uint64_t const> get_events() const { return events; }
+
+        /**
+         * Evaluate the expression
+         *
+         * @param counts The count of each event (in the order of get_events) over the interval
+         * @param interval_seconds The length of the interval
+         * @return The value, or nothing if it is not a finite number (such as when it divides by a zero count)
+         */
+        [[nodiscard]] std::optional<double> evaluate(lib::Span<double const> counts, double interval_seconds) const;
+
+    private:
+        enum class op_code_t : std::uint8_t {
+            constant,
+            event,
+            interval,
+            negate,
+            add,
+            subtract,
+            multiply,
+            divide,
+        };
+
+        struct op_t {
+            op_code_t code;
+            /** The index of the event, for op_code_t::event */
+            std::size_t event_index;
+            /** The value, for op_code_t::constant */
+            double value;
+        };
+
+        class parser_t;
+
+        std::vector<op_t> ops {};
+        std::vector<std::uint64_t> events {};
+    };
+}
@@ -13,6 +13,7 @@
 #include "lib/exception.h"
 
 #include <memory>
+#include <utility>
 
 #include <boost/asio/io_context.hpp>
 
@@ -21,7 +22,10 @@ namespace agents::perf {
     template<typename CaptureType>
     class perf_agent_t : public std::enable_shared_from_this<perf_agent_t<CaptureType>> {
     public:
-        using accepted_message_types = std::tuple<ipc::msg_capture_configuration_t, ipc::msg_start_t>;
+        using accepted_message_types = std::tuple<ipc::msg_capture_configuration_t,
+                                                  ipc::msg_start_t,
+                                                  ipc::msg_flight_recorder_trigger_t,
+                                                  ipc::msg_capture_reconfiguration_t>;
 
         using capture_factory =
             std::function<std::shared_ptr<CaptureType>(boost::asio::io_context &,
@@ -61,6 +65,27 @@ namespace agents::perf {
             return capture->async_on_received_start_message(msg.header, async::continuations::use_continuation);
         }
 
+        async::continuations::polymorphic_continuation_t<> co_receive_message(
+            ipc::msg_flight_recorder_trigger_t /*msg*/)
+        {
+            if (!capture) {
+                LOG_DEBUG("Ignoring flight recorder trigger received before the capture configuration");
+                return {};
+            }
+
+            return capture->async_on_received_flight_recorder_trigger(async::continuations::use_continuation);
+        }
+
+        async::continuations::polymorphic_continuation_t<> co_receive_message(ipc::msg_capture_reconfiguration_t msg)
+        {
+            if (!capture) {
+                LOG_DEBUG("Ignoring capture reconfiguration received before the capture configuration");
+                return {};
+            }
+
+            return capture->async_on_received_reconfiguration(std::move(msg), async::continuations::use_continuation);
+        }
+
         async::continuations::polymorphic_continuation_t<> co_receive_message(ipc::msg_capture_configuration_t msg)
         {
             using namespace async::continuations;
@@ -1,7 +1,9 @@
 /* Copyright (C) 2022 by Arm Limited. All rights reserved. */
 #pragma once
 
+#include "PipelineStats.h"
 #include "agents/agent_worker_base.h"
+#include "agents/perf/perf_frame_packer.hpp"
 #include "async/continuations/async_initiate.h"
 #include "async/continuations/operations.h"
 #include "async/continuations/stored_continuation.h"
@@ -145,6 +147,7 @@ namespace agents::perf {
         boost::asio::io_context::strand strand;
         EventObserver & observer;
         ipc::msg_capture_configuration_t capture_config;
+        std::vector<char> perf_data_frame_buffer {};
 
         auto co_shutdown()
         {
@@ -214,7 +217,25 @@ namespace agents::perf {
 
         auto co_receive_message(ipc::msg_apc_frame_data_t && msg)
         {
-            observer.on_apc_frame_received(std::move(msg.suffix));
+            gPipelineStats.onAgentData(msg.suffix.size());
+            observer.on_apc_frame_received(msg.suffix);
+            // the observer does not retain the frame, so the buffer is returned for the next message
+            this->source().release_frame_buffer(std::move(msg.suffix));
+        }
+
+        /**
+         * Handle the raw perf data message - the agent sends the perf records directly from the mmap, so encode them here.
+         */
+        auto co_receive_message(ipc::msg_perf_data_raw_t const & msg)
+        {
+            gPipelineStats.onAgentData(msg.suffix.size());
+
+            // the observer does not retain the frame, so the buffer is reused for the next message
+            perf_data_frame_buffer =
+                encode_one_perf_data_apc_frame(msg.header, msg.suffix, {}, std::move(perf_data_frame_buffer));
+            if (!perf_data_frame_buffer.empty()) {
+                observer.on_apc_frame_received(perf_data_frame_buffer);
+            }
         }
 
         auto co_receive_message(ipc::msg_exec_target_app_t const & /*msg*/) { observer.exec_target_app(); }
@@ -223,6 +244,19 @@ namespace agents::perf {
 
         auto co_receive_message(ipc::msg_capture_started_t const & /*msg*/) { observer.on_capture_started(); }
 
+        static auto co_receive_message(ipc::msg_perf_agent_stats_t const & msg)
+        {
+            gPipelineStats.onAgentStats(msg.header.peak_mmap_fill,
+                                        msg.header.ipc_queue_depth,
+                                        msg.header.cpu_time_us,
+                                        msg.header.max_rss_kib,
+                                        msg.header.wakeups,
+                                        msg.header.lost_records,
+                                        msg.header.lost_samples,
+                                        msg.header.truncated_aux_records,
+                                        msg.header.one_shot_dropped_bytes);
+        }
+
     public:
         [[nodiscard]] bool start()
         {
@@ -247,9 +281,11 @@ namespace agents::perf {
                           return async_receive_one_of<msg_ready_t,
                                                       msg_capture_ready_t,
                                                       msg_apc_frame_data_t,
+                                                      msg_perf_data_raw_t,
                                                       msg_shutdown_t,
                                                       msg_capture_failed_t,
                                                       msg_capture_started_t,
+                                                      msg_perf_agent_stats_t,
                                                       msg_exec_target_app_t>(self->source_shared(),
                                                                              use_continuation)
                                | map_error()           //
@@ -280,6 +316,56 @@ namespace agents::perf {
             spawn("Perf worker shutdown", co_shutdown());
         }
 
+        void on_flight_recorder_trigger() override
+        {
+            using namespace async::continuations;
+
+            LOG_DEBUG("perf worker: got flight recorder trigger");
+
+            auto self = this->shared_from_this();
+
+            spawn("flight recorder trigger for perf shell",
+                  start_on(strand) //
+                      | then([self]() -> polymorphic_continuation_t<> {
+                            if (self->get_state() != state_t::ready) {
+                                return {};
+                            }
+
+                            return self->sink().async_send_message(ipc::msg_flight_recorder_trigger_t {},
+                                                                   use_continuation)
+                                 | then([](auto const & ec, auto const & /*msg*/) {
+                                       if (ec) {
+                                           LOG_ERROR("Error triggering the flight recorder: %s", ec.message().c_str());
+                                       }
+                                   });
+                        }));
+        }
+
+        void on_capture_reconfiguration(ipc::msg_capture_reconfiguration_t const & msg) override
+        {
+            using namespace async::continuations;
+
+            LOG_DEBUG("perf worker: got capture reconfiguration");
+
+            auto self = this->shared_from_this();
+
+            spawn("capture reconfiguration for perf shell",
+                  start_on(strand) //
+                      | then([self, msg]() -> polymorphic_continuation_t<> {
+                            if (self->get_state() != state_t::ready) {
+                                LOG_DEBUG("Ignoring capture reconfiguration as the perf agent is not ready");
+                                return {};
+                            }
+
+                            return self->sink().async_send_message(msg, use_continuation)
+                                 | then([](auto const & ec, auto const & /*msg*/) {
+                                       if (ec) {
+                                           LOG_ERROR("Error reconfiguring the capture: %s", ec.message().c_str());
+                                       }
+                                   });
+                        }));
+        }
+
         void on_sigchild() override
         {
             using namespace async::continuations;
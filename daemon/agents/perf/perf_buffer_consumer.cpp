@@ -6,13 +6,24 @@
 #include "ISender.h"
 #include "agents/perf/async_buffer_builder.h"
 #include "agents/perf/perf_frame_packer.hpp"
+#include "apc/perf_apc_frame_utils.h"
 #include "async/continuations/continuation.h"
 #include "async/continuations/stored_continuation.h"
 #include "ipc/messages.h"
 #include "k/perf_event.h"
 #include "lib/Assert.h"
+#include "lib/Probe.h"
 #include "lib/error_code_or.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
 #include <boost/system/error_code.hpp>
 
 namespace agents::perf {
@@ -30,12 +41,29 @@ namespace agents::perf {
         {
             __atomic_store_n(&(header->*Field), value, __ATOMIC_RELEASE);
         }
+
+        /** Read the word at `offset` bytes into a chunk of records that is split into two (word aligned) spans */
+        [[nodiscard]] std::uint64_t read_chunk_word(lib::Span<char const> first_span,
+                                                    lib::Span<char const> second_span,
+                                                    std::size_t offset)
+        {
+            std::uint64_t result;
+            if (offset < first_span.size()) {
+                std::memcpy(&result, first_span.data() + offset, sizeof(result));
+            }
+            else {
+                std::memcpy(&result, second_span.data() + (offset - first_span.size()), sizeof(result));
+            }
+            return result;
+        }
     }
 
+    template<typename MessageType>
     async::continuations::polymorphic_continuation_t<std::uint64_t, std::uint64_t, boost::system::error_code>
     perf_buffer_consumer_t::do_send_msg(std::shared_ptr<perf_buffer_consumer_t> const & st,
                                         int cpu,
-                                        std::vector<char> buffer,
+                                        MessageType message,
+                                        std::size_t size,
                                         std::uint64_t head,
                                         std::uint64_t tail)
     {
@@ -45,24 +73,51 @@ namespace agents::perf {
                   cpu,
                   head,
                   tail,
-                  buffer.size());
+                  size);
+
+        // in flight recorder mode the data is kept until it is triggered, rather than being sent
+        if (st->flight_recorder) {
+            if constexpr (std::is_same_v<MessageType, ipc::msg_apc_frame_data_t>
+                          || std::is_same_v<MessageType, ipc::msg_perf_data_raw_t>) {
+                st->flight_recorder->record(std::move(message), size);
+            }
+            else {
+                // the spans point into the mmap, so must be copied out
+                auto const & [first, second] = message.suffix;
+                std::vector<char> data {};
+                data.reserve(size);
+                data.insert(data.end(), first.begin(), first.end());
+                data.insert(data.end(), second.begin(), second.end());
+                st->flight_recorder->record(ipc::msg_perf_data_raw_t {message.header, std::move(data)}, size);
+            }
+
+            return start_with(head, tail, boost::system::error_code {});
+        }
 
         // update the running total (for one-shot mode)
-        st->cumulative_bytes_sent_apc_frames.fetch_add(buffer.size(), std::memory_order_acq_rel);
+        st->cumulative_bytes_sent_apc_frames.fetch_add(size, std::memory_order_acq_rel);
 
-        // send one-shot notification?
+        // send one-shot notification? (the observer is only accessed from the strand)
         if (st->is_one_shot_full()) {
-            stored_continuation_t<> sc {std::move(st->one_shot_mode_observer)};
-            if (sc) {
-                resume_continuation(st->strand.context(), std::move(sc));
-            }
+            boost::asio::post(st->strand, [st]() {
+                stored_continuation_t<> sc {std::move(st->one_shot_mode_observer)};
+                if (sc) {
+                    resume_continuation(st->strand.context(), std::move(sc));
+                }
+            });
         }
 
         // send the message
-        return st->ipc_sink->async_send_message(ipc::msg_apc_frame_data_t {std::move(buffer)}, use_continuation) //
-             | then([head, tail](auto ec, auto /*msg*/) {
+        return st->ipc_sink->async_send_message(std::move(message), use_continuation) //
+             | then([st, head, tail](auto ec, auto msg) {
                    LOG_TRACE("... sent, ec=%s , head=%" PRIu64 " , tail=%" PRIu64, ec.message().c_str(), head, tail);
 
+                   // recycle the buffer
+                   if constexpr (std::is_same_v<MessageType, ipc::msg_apc_frame_data_t>
+                                 || std::is_same_v<MessageType, ipc::msg_perf_data_raw_t>) {
+                       st->frame_buffer_pool->release(std::move(msg.suffix));
+                   }
+
                    return std::make_tuple(head, tail, ec);
                })
              | unpack_tuple();
@@ -71,12 +126,13 @@ namespace agents::perf {
     template<__u64 perf_event_mmap_page::*HeadField, __u64 perf_event_mmap_page::*TailField, typename Op>
     async::continuations::polymorphic_continuation_t<boost::system::error_code, bool>
     perf_buffer_consumer_t::do_send_common(std::shared_ptr<perf_buffer_consumer_t> const & st,
-                                           std::shared_ptr<perf_ringbuffer_mmap_t> const & mmap,
+                                           std::shared_ptr<cpu_ringbuffer_t> const & ringbuffer,
                                            int cpu,
                                            Op && op)
     {
         using namespace async::continuations;
 
+        auto const & mmap = ringbuffer->mmap;
         auto * header = mmap->header();
 
         std::uint64_t const head = atomic_load_field<HeadField>(header);
@@ -92,6 +148,7 @@ namespace agents::perf {
         // is the one-shot mode limit met, if so just skip the data
         if (st->is_one_shot_full()) {
             LOG_TRACE("... skipping (one-shot), cpu=%d , head=%" PRIu64 " , tail=%" PRIu64, cpu, head, tail);
+            st->one_shot_dropped_bytes.fetch_add(head - tail, std::memory_order_relaxed);
             atomic_store_field<TailField>(mmap->header(), head);
 
             return start_with(boost::system::error_code {}, false);
@@ -102,11 +159,11 @@ namespace agents::perf {
              | loop([](std::uint64_t head,
                        std::uint64_t tail,
                        boost::system::error_code ec) { return start_with((head > tail) && !ec, head, tail, ec); },
-                    [op = std::forward<Op>(op), st, mmap](std::uint64_t head,
-                                                          std::uint64_t tail,
-                                                          boost::system::error_code ec) {
-                        return op(head, tail, ec)            //
-                             | post_on(st->strand.context()) //
+                    [op = std::forward<Op>(op), ringbuffer, mmap](std::uint64_t head,
+                                                                  std::uint64_t tail,
+                                                                  boost::system::error_code ec) {
+                        return op(head, tail, ec)          //
+                             | post_on(ringbuffer->strand) //
                              | then([mmap](std::uint64_t h, std::uint64_t t, boost::system::error_code c) {
                                    atomic_store_field<TailField>(mmap->header(), std::min(h, t));
                                    return start_with(h, t, c);
@@ -119,9 +176,75 @@ namespace agents::perf {
                });
     }
 
+    void perf_buffer_consumer_t::update_peak_data_fill(perf_ringbuffer_mmap_t & mmap)
+    {
+        auto * header = mmap.header();
+
+        std::uint64_t const head = atomic_load_field<&perf_event_mmap_page::data_head>(header);
+        std::uint64_t const tail = header->data_tail;
+        std::size_t const size = mmap.data_span().size();
+
+        if ((head <= tail) || (size == 0)) {
+            return;
+        }
+
+        std::size_t const fill = std::min<std::uint64_t>(((head - tail) * fill_scale) / size, fill_scale);
+
+        auto current = peak_data_fill.load(std::memory_order_relaxed);
+        while ((current < fill) && !peak_data_fill.compare_exchange_weak(current, fill, std::memory_order_acq_rel)) {
+        }
+    }
+
+    void perf_buffer_consumer_t::count_losses(cpu_ringbuffer_t & ringbuffer,
+                                              lib::Span<char const> first_span,
+                                              lib::Span<char const> second_span)
+    {
+        constexpr std::size_t word_size = sizeof(std::uint64_t);
+
+        loss_stats_t found {0, 0, 0};
+        auto const size = first_span.size() + second_span.size();
+
+        for (std::size_t offset = 0; offset < size;) {
+            perf_event_header header;
+            auto const header_word = read_chunk_word(first_span, second_span, offset);
+            std::memcpy(&header, &header_word, sizeof(header));
+
+            auto const record_size = std::max<std::size_t>(word_size, (header.size + word_size - 1) & ~(word_size - 1));
+
+            // PERF_RECORD_LOST is {header, id, lost}, PERF_RECORD_LOST_SAMPLES is {header, lost} and
+            // PERF_RECORD_AUX is {header, aux_offset, aux_size, flags}
+            if ((header.type == PERF_RECORD_LOST) && (record_size >= 3 * word_size)) {
+                found.lost_records += read_chunk_word(first_span, second_span, offset + (2 * word_size));
+            }
+            else if ((header.type == PERF_RECORD_LOST_SAMPLES) && (record_size >= 2 * word_size)) {
+                found.lost_samples += read_chunk_word(first_span, second_span, offset + word_size);
+            }
+            else if ((header.type == PERF_RECORD_AUX) && (record_size >= 4 * word_size)
+                     && ((read_chunk_word(first_span, second_span, offset + (3 * word_size))
+                          & PERF_AUX_FLAG_TRUNCATED)
+                         != 0)) {
+                found.truncated_aux_records += 1;
+            }
+
+            offset += record_size;
+        }
+
+        if ((found.lost_records == 0) && (found.lost_samples == 0) && (found.truncated_aux_records == 0)) {
+            return;
+        }
+
+        ringbuffer.loss_stats.lost_records += found.lost_records;
+        ringbuffer.loss_stats.lost_samples += found.lost_samples;
+        ringbuffer.loss_stats.truncated_aux_records += found.truncated_aux_records;
+
+        total_lost_records.fetch_add(found.lost_records, std::memory_order_relaxed);
+        total_lost_samples.fetch_add(found.lost_samples, std::memory_order_relaxed);
+        total_truncated_aux_records.fetch_add(found.truncated_aux_records, std::memory_order_relaxed);
+    }
+
     async::continuations::polymorphic_continuation_t<boost::system::error_code, bool>
     perf_buffer_consumer_t::do_send_aux_section(std::shared_ptr<perf_buffer_consumer_t> const & st,
-                                                std::shared_ptr<perf_ringbuffer_mmap_t> const & mmap,
+                                                std::shared_ptr<cpu_ringbuffer_t> const & ringbuffer,
                                                 int cpu,
                                                 boost::system::error_code ec_from_data,
                                                 bool modified_from_data)
@@ -134,7 +257,7 @@ namespace agents::perf {
             return start_with(ec_from_data, modified_from_data);
         }
 
-        if (!mmap->has_aux()) {
+        if (!ringbuffer->mmap->has_aux()) {
             return start_with(boost::system::error_code {}, modified_from_data);
         }
 
@@ -142,11 +265,11 @@ namespace agents::perf {
 
         return do_send_common<&perf_event_mmap_page::aux_head, &perf_event_mmap_page::aux_tail>(
             st,
-            mmap,
+            ringbuffer,
             cpu,
-            [st, mmap, cpu](std::uint64_t const header_head,
-                            std::uint64_t const header_tail,
-                            boost::system::error_code ec)
+            [st, ringbuffer, mmap = ringbuffer->mmap, cpu](std::uint64_t const header_head,
+                                        std::uint64_t const header_tail,
+                                        boost::system::error_code ec)
                 -> polymorphic_continuation_t<std::uint64_t, std::uint64_t, boost::system::error_code> {
                 //
                 LOG_TRACE("Sending aux chunk for cpu=%d , head=%" PRIu64 " , tail=%" PRIu64,
@@ -164,19 +287,780 @@ namespace agents::perf {
                 auto [first_span, second_span] =
                     extract_one_perf_aux_apc_frame_data_span_pair(aux_buffer, header_head, header_tail);
 
+                if (ringbuffer->spe_record_filter) {
+                    return do_send_filtered_aux_chunk(st,
+                                                      *ringbuffer,
+                                                      cpu,
+                                                      first_span,
+                                                      second_span,
+                                                      header_head,
+                                                      header_tail,
+                                                      ec);
+                }
+
                 // encode the message
-                auto [new_tail, buffer] = encode_one_perf_aux_apc_frame(cpu, first_span, second_span, header_tail);
+                auto const payload_size = first_span.size() + second_span.size();
+                GATOR_PROBE2(perf_aux_chunk, cpu, payload_size);
+                auto [new_tail, buffer] = encode_one_perf_aux_apc_frame(
+                    cpu,
+                    first_span,
+                    second_span,
+                    header_tail,
+                    st->frame_buffer_pool->acquire(max_perf_aux_apc_frame_size(payload_size)));
 
                 runtime_assert(!buffer.empty(), "Expected some apc frame data");
 
                 // send it
-                return do_send_msg(st, cpu, std::move(buffer), header_head, new_tail);
+                auto const size = buffer.size();
+                return do_send_msg(st, cpu, ipc::msg_apc_frame_data_t {std::move(buffer)}, size, header_head, new_tail);
             });
     }
 
+    async::continuations::polymorphic_continuation_t<std::uint64_t, std::uint64_t, boost::system::error_code>
+    perf_buffer_consumer_t::do_send_filtered_aux_chunk(std::shared_ptr<perf_buffer_consumer_t> const & st,
+                                                       cpu_ringbuffer_t & ringbuffer,
+                                                       int cpu,
+                                                       lib::Span<char const> first_span,
+                                                       lib::Span<char const> second_span,
+                                                       std::uint64_t header_head,
+                                                       std::uint64_t header_tail,
+                                                       boost::system::error_code ec)
+    {
+        using namespace async::continuations;
+
+        auto & filter = *ringbuffer.spe_record_filter;
+        auto & output = ringbuffer.spe_record_filter_output;
+
+        auto const output_offset = filter.get_output_offset();
+        auto const chunk_end = header_tail + first_span.size() + second_span.size();
+
+        output.clear();
+        auto const new_tail =
+            header_tail + filter.filter_records(first_span, second_span, output, ringbuffer.spe_heatmap_windows);
+
+        // stop at a trailing partial record, unless there is more data after this chunk
+        auto const head = ((new_tail < chunk_end) && (chunk_end == header_head) ? new_tail : header_head);
+
+        auto frames = std::make_shared<std::deque<std::vector<char>>>();
+        encode_spe_heatmaps(st, ringbuffer, cpu, *frames);
+
+        if (output.empty()) {
+            if (frames->empty()) {
+                return start_with(head, new_tail, ec);
+            }
+            return do_send_apc_frames(st, cpu, std::move(frames), head, new_tail);
+        }
+
+        auto buffer = encode_one_perf_aux_apc_frame(cpu,
+                                                    output,
+                                                    {},
+                                                    output_offset,
+                                                    st->frame_buffer_pool->acquire(
+                                                        max_perf_aux_apc_frame_size(output.size())))
+                          .second;
+
+        auto const size = buffer.size();
+        return do_send_msg(st, cpu, ipc::msg_apc_frame_data_t {std::move(buffer)}, size, head, new_tail)
+             | then([st, cpu, frames = std::move(frames)](std::uint64_t head,
+                                                          std::uint64_t tail,
+                                                          boost::system::error_code ec) mutable
+                    -> polymorphic_continuation_t<std::uint64_t, std::uint64_t, boost::system::error_code> {
+                   if (ec) {
+                       return start_with(head, tail, ec);
+                   }
+
+                   return do_send_apc_frames(st, cpu, std::move(frames), head, tail);
+               });
+    }
+
+    async::continuations::polymorphic_continuation_t<std::uint64_t, std::uint64_t, boost::system::error_code>
+    perf_buffer_consumer_t::do_send_deduplicated_data_chunk(
+        std::shared_ptr<perf_buffer_consumer_t> const & st,
+        cpu_ringbuffer_t & ringbuffer,
+        int cpu,
+        std::pair<lib::Span<char const>, lib::Span<char const>> spans,
+        std::uint64_t header_head,
+        std::uint64_t new_tail)
+    {
+        using namespace async::continuations;
+
+        auto records = st->frame_buffer_pool->acquire(spans.first.size() + spans.second.size());
+        auto & new_stacks = ringbuffer.new_call_stacks;
+
+        ringbuffer.call_stack_deduplicator->deduplicate(spans.first, spans.second, records, new_stacks);
+
+        auto const records_size = records.size();
+        ipc::msg_perf_data_raw_t records_message {cpu, std::move(records)};
+
+        if (new_stacks.empty()) {
+            return do_send_msg(st, cpu, std::move(records_message), records_size, header_head, new_tail);
+        }
+
+        // the stacks must be sent first, as the records refer to them
+        auto stacks_frame = encode_one_perf_call_stacks_apc_frame(
+            cpu,
+            new_stacks,
+            st->frame_buffer_pool->acquire(new_stacks.size() * buffer_utils::MAXSIZE_PACK64));
+        auto const stacks_size = stacks_frame.size();
+
+        return do_send_msg(st,
+                           cpu,
+                           ipc::msg_apc_frame_data_t {std::move(stacks_frame)},
+                           stacks_size,
+                           header_head,
+                           new_tail)
+             | then([st, cpu, records_message = std::move(records_message), records_size](
+                        std::uint64_t head,
+                        std::uint64_t tail,
+                        boost::system::error_code ec) mutable
+                    -> polymorphic_continuation_t<std::uint64_t, std::uint64_t, boost::system::error_code> {
+                   if (ec) {
+                       return start_with(head, tail, ec);
+                   }
+
+                   return do_send_msg(st, cpu, std::move(records_message), records_size, head, tail);
+               });
+    }
+
+    async::continuations::polymorphic_continuation_t<std::uint64_t, std::uint64_t, boost::system::error_code>
+    perf_buffer_consumer_t::do_send_aggregated_data_chunk(
+        std::shared_ptr<perf_buffer_consumer_t> const & st,
+        cpu_ringbuffer_t & ringbuffer,
+        int cpu,
+        std::pair<lib::Span<char const>, lib::Span<char const>> spans,
+        std::uint64_t header_head,
+        std::uint64_t new_tail)
+    {
+        using namespace async::continuations;
+
+        auto records = st->frame_buffer_pool->acquire(spans.first.size() + spans.second.size());
+
+        ringbuffer.sample_aggregator->aggregate(spans.first,
+                                                spans.second,
+                                                records,
+                                                ringbuffer.sample_aggregates_windows);
+
+        auto frames = std::make_shared<std::deque<std::vector<char>>>();
+        encode_sample_aggregates(st, ringbuffer, cpu, *frames);
+
+        if (records.empty()) {
+            st->frame_buffer_pool->release(std::move(records));
+            return do_send_apc_frames(st, cpu, std::move(frames), header_head, new_tail);
+        }
+
+        // the records go first, as they include the comm and mmap records of the aggregated samples' processes
+        auto const records_size = records.size();
+        return do_send_msg(st,
+                           cpu,
+                           ipc::msg_perf_data_raw_t {cpu, std::move(records)},
+                           records_size,
+                           header_head,
+                           new_tail)
+             | then([st, cpu, frames = std::move(frames)](std::uint64_t head,
+                                                          std::uint64_t tail,
+                                                          boost::system::error_code ec) mutable
+                    -> polymorphic_continuation_t<std::uint64_t, std::uint64_t, boost::system::error_code> {
+                   if (ec) {
+                       return start_with(head, tail, ec);
+                   }
+
+                   return do_send_apc_frames(st, cpu, std::move(frames), head, tail);
+               });
+    }
+
+    async::continuations::polymorphic_continuation_t<std::uint64_t, std::uint64_t, boost::system::error_code>
+    perf_buffer_consumer_t::do_send_function_latency_filtered_data_chunk(
+        std::shared_ptr<perf_buffer_consumer_t> const & st,
+        cpu_ringbuffer_t & ringbuffer,
+        int cpu,
+        std::pair<lib::Span<char const>, lib::Span<char const>> spans,
+        std::uint64_t header_head,
+        std::uint64_t new_tail)
+    {
+        using namespace async::continuations;
+
+        auto records = st->frame_buffer_pool->acquire(spans.first.size() + spans.second.size());
+
+        ringbuffer.function_latency_filter->filter(spans.first,
+                                                   spans.second,
+                                                   records,
+                                                   ringbuffer.function_latencies_windows);
+
+        auto frames = std::make_shared<std::deque<std::vector<char>>>();
+        encode_function_latencies(st, ringbuffer, cpu, *frames);
+
+        auto send_frames = [st, cpu, frames](std::uint64_t head, std::uint64_t tail, boost::system::error_code ec)
+            -> polymorphic_continuation_t<std::uint64_t, std::uint64_t, boost::system::error_code> {
+            if (ec) {
+                return start_with(head, tail, ec);
+            }
+
+            return do_send_apc_frames(st, cpu, frames, head, tail);
+        };
+
+        if (records.empty()) {
+            st->frame_buffer_pool->release(std::move(records));
+            return send_frames(header_head, new_tail, {});
+        }
+
+        // the remaining records are copied again as they are aggregated or deduplicated, so are only needed until then
+        if (ringbuffer.sample_aggregator || ringbuffer.call_stack_deduplicator) {
+            std::pair<lib::Span<char const>, lib::Span<char const>> const remaining {records, {}};
+
+            auto send_records =
+                (ringbuffer.sample_aggregator
+                     ? do_send_aggregated_data_chunk(st, ringbuffer, cpu, remaining, header_head, new_tail)
+                     : do_send_deduplicated_data_chunk(st, ringbuffer, cpu, remaining, header_head, new_tail));
+
+            st->frame_buffer_pool->release(std::move(records));
+
+            return std::move(send_records) | then(std::move(send_frames));
+        }
+
+        auto const records_size = records.size();
+        return do_send_msg(st,
+                           cpu,
+                           ipc::msg_perf_data_raw_t {cpu, std::move(records)},
+                           records_size,
+                           header_head,
+                           new_tail)
+             | then(std::move(send_frames));
+    }
+
+    async::continuations::polymorphic_continuation_t<std::uint64_t, std::uint64_t, boost::system::error_code>
+    perf_buffer_consumer_t::do_send_gpu_timeline_filtered_data_chunk(
+        std::shared_ptr<perf_buffer_consumer_t> const & st,
+        cpu_ringbuffer_t & ringbuffer,
+        int cpu,
+        std::pair<lib::Span<char const>, lib::Span<char const>> spans,
+        std::uint64_t header_head,
+        std::uint64_t new_tail)
+    {
+        using namespace async::continuations;
+
+        auto records = st->frame_buffer_pool->acquire(spans.first.size() + spans.second.size());
+
+        ringbuffer.gpu_timeline_filter->filter(spans.first, spans.second, records, ringbuffer.gpu_activity_windows);
+
+        auto frames = std::make_shared<std::deque<std::vector<char>>>();
+        encode_gpu_activity(st, ringbuffer, cpu, *frames);
+
+        auto send_frames = [st, cpu, frames](std::uint64_t head, std::uint64_t tail, boost::system::error_code ec)
+            -> polymorphic_continuation_t<std::uint64_t, std::uint64_t, boost::system::error_code> {
+            if (ec) {
+                return start_with(head, tail, ec);
+            }
+
+            return do_send_apc_frames(st, cpu, frames, head, tail);
+        };
+
+        if (records.empty()) {
+            st->frame_buffer_pool->release(std::move(records));
+            return send_frames(header_head, new_tail, {});
+        }
+
+        // the remaining records are copied again as they are paired, aggregated or deduplicated, so are only needed
+        // until then
+        if (ringbuffer.function_latency_filter || ringbuffer.sample_aggregator || ringbuffer.call_stack_deduplicator) {
+            std::pair<lib::Span<char const>, lib::Span<char const>> const remaining {records, {}};
+
+            auto send_records = [&]() {
+                if (ringbuffer.function_latency_filter) {
+                    return do_send_function_latency_filtered_data_chunk(st,
+                                                                        ringbuffer,
+                                                                        cpu,
+                                                                        remaining,
+                                                                        header_head,
+                                                                        new_tail);
+                }
+                if (ringbuffer.sample_aggregator) {
+                    return do_send_aggregated_data_chunk(st, ringbuffer, cpu, remaining, header_head, new_tail);
+                }
+                return do_send_deduplicated_data_chunk(st, ringbuffer, cpu, remaining, header_head, new_tail);
+            }();
+
+            st->frame_buffer_pool->release(std::move(records));
+
+            return std::move(send_records) | then(std::move(send_frames));
+        }
+
+        auto const records_size = records.size();
+        return do_send_msg(st,
+                           cpu,
+                           ipc::msg_perf_data_raw_t {cpu, std::move(records)},
+                           records_size,
+                           header_head,
+                           new_tail)
+             | then(std::move(send_frames));
+    }
+
+    async::continuations::polymorphic_continuation_t<std::uint64_t, std::uint64_t, boost::system::error_code>
+    perf_buffer_consumer_t::do_send_block_io_filtered_data_chunk(
+        std::shared_ptr<perf_buffer_consumer_t> const & st,
+        cpu_ringbuffer_t & ringbuffer,
+        int cpu,
+        std::pair<lib::Span<char const>, lib::Span<char const>> spans,
+        std::uint64_t header_head,
+        std::uint64_t new_tail)
+    {
+        using namespace async::continuations;
+
+        auto records = st->frame_buffer_pool->acquire(spans.first.size() + spans.second.size());
+
+        ringbuffer.block_io_filter->filter(spans.first, spans.second, records, ringbuffer.block_io_windows);
+
+        auto frames = std::make_shared<std::deque<std::vector<char>>>();
+        encode_block_io_counters(st, ringbuffer, *frames);
+
+        auto send_frames = [st, cpu, frames](std::uint64_t head, std::uint64_t tail, boost::system::error_code ec)
+            -> polymorphic_continuation_t<std::uint64_t, std::uint64_t, boost::system::error_code> {
+            if (ec) {
+                return start_with(head, tail, ec);
+            }
+
+            return do_send_apc_frames(st, cpu, frames, head, tail);
+        };
+
+        if (records.empty()) {
+            st->frame_buffer_pool->release(std::move(records));
+            return send_frames(header_head, new_tail, {});
+        }
+
+        // the remaining records are copied again as they are unwound, filtered, converted, paired, aggregated or
+        // deduplicated, so are only needed until then
+        if (ringbuffer.lock_contention_filter || ringbuffer.thread_energy_filter
+            || has_processing_stage(st, ringbuffer)) {
+            std::pair<lib::Span<char const>, lib::Span<char const>> const remaining {records, {}};
+
+            auto send_records = [&]() {
+                if (ringbuffer.lock_contention_filter) {
+                    return do_send_lock_contention_filtered_data_chunk(st,
+                                                                       ringbuffer,
+                                                                       cpu,
+                                                                       remaining,
+                                                                       header_head,
+                                                                       new_tail);
+                }
+                if (ringbuffer.thread_energy_filter) {
+                    return do_send_thread_energy_filtered_data_chunk(st,
+                                                                     ringbuffer,
+                                                                     cpu,
+                                                                     remaining,
+                                                                     header_head,
+                                                                     new_tail);
+                }
+                return do_send_processed_data_chunk(st, ringbuffer, cpu, remaining, header_head, new_tail);
+            }();
+
+            st->frame_buffer_pool->release(std::move(records));
+
+            return std::move(send_records) | then(std::move(send_frames));
+        }
+
+        if (st->sample_pid_tracker) {
+            st->sample_pid_tracker->scan(records, {});
+        }
+
+        auto const records_size = records.size();
+        return do_send_msg(st,
+                           cpu,
+                           ipc::msg_perf_data_raw_t {cpu, std::move(records)},
+                           records_size,
+                           header_head,
+                           new_tail)
+             | then(std::move(send_frames));
+    }
+
+    async::continuations::polymorphic_continuation_t<std::uint64_t, std::uint64_t, boost::system::error_code>
+    perf_buffer_consumer_t::do_send_lock_contention_filtered_data_chunk(
+        std::shared_ptr<perf_buffer_consumer_t> const & st,
+        cpu_ringbuffer_t & ringbuffer,
+        int cpu,
+        std::pair<lib::Span<char const>, lib::Span<char const>> spans,
+        std::uint64_t header_head,
+        std::uint64_t new_tail)
+    {
+        using namespace async::continuations;
+
+        auto records = st->frame_buffer_pool->acquire(spans.first.size() + spans.second.size());
+
+        ringbuffer.lock_contention_filter->filter(spans.first,
+                                                  spans.second,
+                                                  records,
+                                                  ringbuffer.lock_contention_windows);
+
+        auto frames = std::make_shared<std::deque<std::vector<char>>>();
+        encode_lock_contention(st, ringbuffer, cpu, *frames);
+
+        auto send_frames = [st, cpu, frames](std::uint64_t head, std::uint64_t tail, boost::system::error_code ec)
+            -> polymorphic_continuation_t<std::uint64_t, std::uint64_t, boost::system::error_code> {
+            if (ec) {
+                return start_with(head, tail, ec);
+            }
+
+            return do_send_apc_frames(st, cpu, frames, head, tail);
+        };
+
+        if (records.empty()) {
+            st->frame_buffer_pool->release(std::move(records));
+            return send_frames(header_head, new_tail, {});
+        }
+
+        // the remaining records are copied again as they are unwound, filtered, converted, paired, aggregated or
+        // deduplicated, so are only needed until then
+        if (ringbuffer.thread_energy_filter || has_processing_stage(st, ringbuffer)) {
+            std::pair<lib::Span<char const>, lib::Span<char const>> const remaining {records, {}};
+
+            auto send_records = [&]() {
+                if (ringbuffer.thread_energy_filter) {
+                    return do_send_thread_energy_filtered_data_chunk(st,
+                                                                     ringbuffer,
+                                                                     cpu,
+                                                                     remaining,
+                                                                     header_head,
+                                                                     new_tail);
+                }
+                return do_send_processed_data_chunk(st, ringbuffer, cpu, remaining, header_head, new_tail);
+            }();
+
+            st->frame_buffer_pool->release(std::move(records));
+
+            return std::move(send_records) | then(std::move(send_frames));
+        }
+
+        if (st->sample_pid_tracker) {
+            st->sample_pid_tracker->scan(records, {});
+        }
+
+        auto const records_size = records.size();
+        return do_send_msg(st,
+                           cpu,
+                           ipc::msg_perf_data_raw_t {cpu, std::move(records)},
+                           records_size,
+                           header_head,
+                           new_tail)
+             | then(std::move(send_frames));
+    }
+
+    async::continuations::polymorphic_continuation_t<std::uint64_t, std::uint64_t, boost::system::error_code>
+    perf_buffer_consumer_t::do_send_thread_energy_filtered_data_chunk(
+        std::shared_ptr<perf_buffer_consumer_t> const & st,
+        cpu_ringbuffer_t & ringbuffer,
+        int cpu,
+        std::pair<lib::Span<char const>, lib::Span<char const>> spans,
+        std::uint64_t header_head,
+        std::uint64_t new_tail)
+    {
+        using namespace async::continuations;
+
+        auto records = st->frame_buffer_pool->acquire(spans.first.size() + spans.second.size());
+
+        ringbuffer.thread_energy_filter->filter(spans.first, spans.second, records, ringbuffer.thread_energy_windows);
+
+        auto frames = std::make_shared<std::deque<std::vector<char>>>();
+        encode_thread_energy(st, ringbuffer, cpu, *frames);
+
+        auto send_frames = [st, cpu, frames](std::uint64_t head, std::uint64_t tail, boost::system::error_code ec)
+            -> polymorphic_continuation_t<std::uint64_t, std::uint64_t, boost::system::error_code> {
+            if (ec) {
+                return start_with(head, tail, ec);
+            }
+
+            return do_send_apc_frames(st, cpu, frames, head, tail);
+        };
+
+        if (records.empty()) {
+            st->frame_buffer_pool->release(std::move(records));
+            return send_frames(header_head, new_tail, {});
+        }
+
+        // the remaining records are copied again as they are unwound, filtered, converted, paired, aggregated or
+        // deduplicated, so are only needed until then
+        if (has_processing_stage(st, ringbuffer)) {
+            std::pair<lib::Span<char const>, lib::Span<char const>> const remaining {records, {}};
+
+            auto send_records = do_send_processed_data_chunk(st, ringbuffer, cpu, remaining, header_head, new_tail);
+
+            st->frame_buffer_pool->release(std::move(records));
+
+            return std::move(send_records) | then(std::move(send_frames));
+        }
+
+        if (st->sample_pid_tracker) {
+            st->sample_pid_tracker->scan(records, {});
+        }
+
+        auto const records_size = records.size();
+        return do_send_msg(st,
+                           cpu,
+                           ipc::msg_perf_data_raw_t {cpu, std::move(records)},
+                           records_size,
+                           header_head,
+                           new_tail)
+             | then(std::move(send_frames));
+    }
+
+    async::continuations::polymorphic_continuation_t<std::uint64_t, std::uint64_t, boost::system::error_code>
+    perf_buffer_consumer_t::do_send_unwound_data_chunk(std::shared_ptr<perf_buffer_consumer_t> const & st,
+                                                       cpu_ringbuffer_t & ringbuffer,
+                                                       int cpu,
+                                                       std::pair<lib::Span<char const>, lib::Span<char const>> spans,
+                                                       std::uint64_t header_head,
+                                                       std::uint64_t new_tail)
+    {
+        using namespace async::continuations;
+
+        auto records = st->frame_buffer_pool->acquire(spans.first.size() + spans.second.size());
+
+        ringbuffer.user_stack_unwinder->unwind(spans.first, spans.second, records);
+
+        // the remaining records are copied again as they are filtered, converted, paired, aggregated or deduplicated,
+        // so are only needed until then
+        if (st->sample_pid_filter || ringbuffer.gpu_timeline_filter || ringbuffer.function_latency_filter
+            || ringbuffer.sample_aggregator || ringbuffer.call_stack_deduplicator) {
+            std::pair<lib::Span<char const>, lib::Span<char const>> const remaining {records, {}};
+
+            auto send_records = [&]() {
+                if (st->sample_pid_filter) {
+                    return do_send_pid_filtered_data_chunk(st, ringbuffer, cpu, remaining, header_head, new_tail);
+                }
+                if (st->sample_pid_tracker) {
+                    st->sample_pid_tracker->scan(records, {});
+                }
+                if (ringbuffer.gpu_timeline_filter) {
+                    return do_send_gpu_timeline_filtered_data_chunk(st,
+                                                                    ringbuffer,
+                                                                    cpu,
+                                                                    remaining,
+                                                                    header_head,
+                                                                    new_tail);
+                }
+                if (ringbuffer.function_latency_filter) {
+                    return do_send_function_latency_filtered_data_chunk(st,
+                                                                        ringbuffer,
+                                                                        cpu,
+                                                                        remaining,
+                                                                        header_head,
+                                                                        new_tail);
+                }
+                if (ringbuffer.sample_aggregator) {
+                    return do_send_aggregated_data_chunk(st, ringbuffer, cpu, remaining, header_head, new_tail);
+                }
+                return do_send_deduplicated_data_chunk(st, ringbuffer, cpu, remaining, header_head, new_tail);
+            }();
+
+            st->frame_buffer_pool->release(std::move(records));
+
+            return send_records;
+        }
+
+        if (st->sample_pid_tracker) {
+            st->sample_pid_tracker->scan(records, {});
+        }
+
+        auto const records_size = records.size();
+        return do_send_msg(st,
+                           cpu,
+                           ipc::msg_perf_data_raw_t {cpu, std::move(records)},
+                           records_size,
+                           header_head,
+                           new_tail);
+    }
+
+    async::continuations::polymorphic_continuation_t<std::uint64_t, std::uint64_t, boost::system::error_code>
+    perf_buffer_consumer_t::do_send_pid_filtered_data_chunk(
+        std::shared_ptr<perf_buffer_consumer_t> const & st,
+        cpu_ringbuffer_t & ringbuffer,
+        int cpu,
+        std::pair<lib::Span<char const>, lib::Span<char const>> spans,
+        std::uint64_t header_head,
+        std::uint64_t new_tail)
+    {
+        using namespace async::continuations;
+
+        auto records = st->frame_buffer_pool->acquire(spans.first.size() + spans.second.size());
+
+        st->sample_pid_filter->filter(spans.first, spans.second, records);
+
+        // only the processes whose samples were kept need their maps
+        if (st->sample_pid_tracker) {
+            st->sample_pid_tracker->scan(records, {});
+        }
+
+        if (records.empty()) {
+            st->frame_buffer_pool->release(std::move(records));
+            return start_with(header_head, new_tail, boost::system::error_code {});
+        }
+
+        // the remaining records are copied again as they are converted, paired, aggregated or deduplicated, so are only
+        // needed until then
+        if (ringbuffer.gpu_timeline_filter || ringbuffer.function_latency_filter || ringbuffer.sample_aggregator
+            || ringbuffer.call_stack_deduplicator) {
+            std::pair<lib::Span<char const>, lib::Span<char const>> const remaining {records, {}};
+
+            auto send_records = [&]() {
+                if (ringbuffer.gpu_timeline_filter) {
+                    return do_send_gpu_timeline_filtered_data_chunk(st,
+                                                                    ringbuffer,
+                                                                    cpu,
+                                                                    remaining,
+                                                                    header_head,
+                                                                    new_tail);
+                }
+                if (ringbuffer.function_latency_filter) {
+                    return do_send_function_latency_filtered_data_chunk(st,
+                                                                        ringbuffer,
+                                                                        cpu,
+                                                                        remaining,
+                                                                        header_head,
+                                                                        new_tail);
+                }
+                if (ringbuffer.sample_aggregator) {
+                    return do_send_aggregated_data_chunk(st, ringbuffer, cpu, remaining, header_head, new_tail);
+                }
+                return do_send_deduplicated_data_chunk(st, ringbuffer, cpu, remaining, header_head, new_tail);
+            }();
+
+            st->frame_buffer_pool->release(std::move(records));
+
+            return send_records;
+        }
+
+        auto const records_size = records.size();
+        return do_send_msg(st,
+                           cpu,
+                           ipc::msg_perf_data_raw_t {cpu, std::move(records)},
+                           records_size,
+                           header_head,
+                           new_tail);
+    }
+
+    void perf_buffer_consumer_t::encode_sample_aggregates(std::shared_ptr<perf_buffer_consumer_t> const & st,
+                                                          cpu_ringbuffer_t & ringbuffer,
+                                                          int cpu,
+                                                          std::deque<std::vector<char>> & frames)
+    {
+        for (auto const & window : ringbuffer.sample_aggregates_windows) {
+            frames.emplace_back(encode_one_perf_sample_aggregates_apc_frame(
+                cpu,
+                window,
+                st->frame_buffer_pool->acquire(window.size() * buffer_utils::MAXSIZE_PACK64)));
+        }
+        ringbuffer.sample_aggregates_windows.clear();
+    }
+
+    void perf_buffer_consumer_t::encode_function_latencies(std::shared_ptr<perf_buffer_consumer_t> const & st,
+                                                           cpu_ringbuffer_t & ringbuffer,
+                                                           int cpu,
+                                                           std::deque<std::vector<char>> & frames)
+    {
+        for (auto const & window : ringbuffer.function_latencies_windows) {
+            frames.emplace_back(encode_one_perf_function_latencies_apc_frame(
+                cpu,
+                window,
+                st->frame_buffer_pool->acquire(window.size() * buffer_utils::MAXSIZE_PACK64)));
+        }
+        ringbuffer.function_latencies_windows.clear();
+    }
+
+    void perf_buffer_consumer_t::encode_gpu_activity(std::shared_ptr<perf_buffer_consumer_t> const & st,
+                                                     cpu_ringbuffer_t & ringbuffer,
+                                                     int cpu,
+                                                     std::deque<std::vector<char>> & frames)
+    {
+        for (auto const & window : ringbuffer.gpu_activity_windows) {
+            frames.emplace_back(encode_one_perf_gpu_activity_apc_frame(
+                cpu,
+                window,
+                st->frame_buffer_pool->acquire(window.size() * buffer_utils::MAXSIZE_PACK64)));
+        }
+        ringbuffer.gpu_activity_windows.clear();
+    }
+
+    void perf_buffer_consumer_t::encode_block_io_counters(std::shared_ptr<perf_buffer_consumer_t> const & st,
+                                                          cpu_ringbuffer_t & ringbuffer,
+                                                          std::deque<std::vector<char>> & frames)
+    {
+        for (auto const & window : ringbuffer.block_io_windows) {
+            if (!window.counters.empty()) {
+                // each counter is its core, key and value
+                auto const capacity = (1 + (window.counters.size() * 3)) * buffer_utils::MAXSIZE_PACK64;
+                frames.emplace_back(apc::make_perf_counters_frame(window.timestamp,
+                                                                  window.counters,
+                                                                  st->frame_buffer_pool->acquire(capacity)));
+            }
+        }
+        ringbuffer.block_io_windows.clear();
+    }
+
+    void perf_buffer_consumer_t::encode_lock_contention(std::shared_ptr<perf_buffer_consumer_t> const & st,
+                                                        cpu_ringbuffer_t & ringbuffer,
+                                                        int cpu,
+                                                        std::deque<std::vector<char>> & frames)
+    {
+        for (auto const & window : ringbuffer.lock_contention_windows) {
+            frames.emplace_back(encode_one_perf_lock_contention_apc_frame(
+                cpu,
+                window,
+                st->frame_buffer_pool->acquire(window.size() * buffer_utils::MAXSIZE_PACK64)));
+        }
+        ringbuffer.lock_contention_windows.clear();
+    }
+
+    void perf_buffer_consumer_t::encode_thread_energy(std::shared_ptr<perf_buffer_consumer_t> const & st,
+                                                      cpu_ringbuffer_t & ringbuffer,
+                                                      int cpu,
+                                                      std::deque<std::vector<char>> & frames)
+    {
+        for (auto const & window : ringbuffer.thread_energy_windows) {
+            frames.emplace_back(encode_one_perf_thread_energy_apc_frame(
+                cpu,
+                window,
+                st->frame_buffer_pool->acquire(window.size() * buffer_utils::MAXSIZE_PACK64)));
+        }
+        ringbuffer.thread_energy_windows.clear();
+    }
+
+    void perf_buffer_consumer_t::encode_spe_heatmaps(std::shared_ptr<perf_buffer_consumer_t> const & st,
+                                                     cpu_ringbuffer_t & ringbuffer,
+                                                     int cpu,
+                                                     std::deque<std::vector<char>> & frames)
+    {
+        for (auto const & window : ringbuffer.spe_heatmap_windows) {
+            frames.emplace_back(encode_one_perf_spe_heatmap_apc_frame(
+                cpu,
+                window,
+                st->frame_buffer_pool->acquire(window.size() * buffer_utils::MAXSIZE_PACK64)));
+        }
+        ringbuffer.spe_heatmap_windows.clear();
+    }
+
+    async::continuations::polymorphic_continuation_t<std::uint64_t, std::uint64_t, boost::system::error_code>
+    perf_buffer_consumer_t::do_send_apc_frames(std::shared_ptr<perf_buffer_consumer_t> const & st,
+                                               int cpu,
+                                               std::shared_ptr<std::deque<std::vector<char>>> frames,
+                                               std::uint64_t head,
+                                               std::uint64_t tail)
+    {
+        using namespace async::continuations;
+
+        return start_with(head, tail, boost::system::error_code {}) //
+             | loop(
+                   [frames](std::uint64_t head, std::uint64_t tail, boost::system::error_code const & ec) {
+                       return start_with(!ec && !frames->empty(), head, tail, ec);
+                   },
+                   [st, cpu, frames](std::uint64_t head, std::uint64_t tail, boost::system::error_code const & /*ec*/) {
+                       auto frame = std::move(frames->front());
+                       frames->pop_front();
+
+                       auto const size = frame.size();
+                       return do_send_msg(st, cpu, ipc::msg_apc_frame_data_t {std::move(frame)}, size, head, tail);
+                   });
+    }
+
     async::continuations::polymorphic_continuation_t<boost::system::error_code, bool>
     perf_buffer_consumer_t::do_send_data_section(std::shared_ptr<perf_buffer_consumer_t> const & st,
-                                                 std::shared_ptr<perf_ringbuffer_mmap_t> const & mmap,
+                                                 std::shared_ptr<cpu_ringbuffer_t> const & ringbuffer,
                                                  int cpu)
     {
 
@@ -184,13 +1068,16 @@ namespace agents::perf {
 
         LOG_TRACE("Sending data for %d", cpu);
 
+        // track how full the buffer got, so that the poll interval can adapt to the data rate
+        st->update_peak_data_fill(*ringbuffer->mmap);
+
         return do_send_common<&perf_event_mmap_page::data_head, &perf_event_mmap_page::data_tail>(
             st,
-            mmap,
+            ringbuffer,
             cpu,
-            [st, mmap, cpu](std::uint64_t const header_head,
-                            std::uint64_t const header_tail,
-                            boost::system::error_code ec)
+            [st, ringbuffer, mmap = ringbuffer->mmap, cpu](std::uint64_t const header_head,
+                                        std::uint64_t const header_tail,
+                                        boost::system::error_code ec)
                 -> polymorphic_continuation_t<std::uint64_t, std::uint64_t, boost::system::error_code> {
                 LOG_TRACE("Sending data chunk for cpu=%d , head=%" PRIu64 " , tail=%" PRIu64,
                           cpu,
@@ -201,37 +1088,156 @@ namespace agents::perf {
                     return start_with(header_head, header_head, ec);
                 }
 
-                // encode the data into an apc frame
-                auto [new_tail, buffer] =
-                    extract_one_perf_data_apc_frame(cpu, mmap->data_span(), header_head, header_tail);
+                // find the records to send; they are sent directly from the mmap and encoded by the shell
+                auto [new_tail, spans] =
+                    extract_one_perf_data_raw_span_pair(mmap->data_span(), header_head, header_tail);
 
-                runtime_assert(!buffer.empty(), "Expected some apc frame data");
+                auto const size = spans.first.size() + spans.second.size();
 
-                // send it
-                return do_send_msg(st, cpu, std::move(buffer), header_head, new_tail);
+                runtime_assert(size > 0, "Expected some perf data");
+                GATOR_PROBE2(perf_data_chunk, cpu, size);
+
+                st->count_losses(*ringbuffer, spans.first, spans.second);
+
+                // the block tracepoints' samples are converted before the pid filter, as a request may complete in
+                // the context of any process
+                if (ringbuffer->block_io_filter) {
+                    return do_send_block_io_filtered_data_chunk(st, *ringbuffer, cpu, spans, header_head, new_tail);
+                }
+
+                // as are the futex and lock tracepoints' samples, whose call chains are only needed for the call sites
+                if (ringbuffer->lock_contention_filter) {
+                    return do_send_lock_contention_filtered_data_chunk(st,
+                                                                       *ringbuffer,
+                                                                       cpu,
+                                                                       spans,
+                                                                       header_head,
+                                                                       new_tail);
+                }
+
+                // and the scheduler tracepoints' samples, as the energy of every thread is attributed
+                if (ringbuffer->thread_energy_filter) {
+                    return do_send_thread_energy_filtered_data_chunk(st,
+                                                                     *ringbuffer,
+                                                                     cpu,
+                                                                     spans,
+                                                                     header_head,
+                                                                     new_tail);
+                }
+
+                return do_send_processed_data_chunk(st, *ringbuffer, cpu, spans, header_head, new_tail);
             });
     }
 
+    bool perf_buffer_consumer_t::has_processing_stage(std::shared_ptr<perf_buffer_consumer_t> const & st,
+                                                      cpu_ringbuffer_t const & ringbuffer)
+    {
+        return ringbuffer.user_stack_unwinder || st->sample_pid_filter || ringbuffer.gpu_timeline_filter
+            || ringbuffer.function_latency_filter || ringbuffer.sample_aggregator || ringbuffer.call_stack_deduplicator;
+    }
+
+    async::continuations::polymorphic_continuation_t<std::uint64_t, std::uint64_t, boost::system::error_code>
+    perf_buffer_consumer_t::do_send_processed_data_chunk(std::shared_ptr<perf_buffer_consumer_t> const & st,
+                                                         cpu_ringbuffer_t & ringbuffer,
+                                                         int cpu,
+                                                         std::pair<lib::Span<char const>, lib::Span<char const>> spans,
+                                                         std::uint64_t header_head,
+                                                         std::uint64_t new_tail)
+    {
+        if (ringbuffer.user_stack_unwinder) {
+            return do_send_unwound_data_chunk(st, ringbuffer, cpu, spans, header_head, new_tail);
+        }
+
+        if (st->sample_pid_filter) {
+            return do_send_pid_filtered_data_chunk(st, ringbuffer, cpu, spans, header_head, new_tail);
+        }
+
+        if (st->sample_pid_tracker) {
+            st->sample_pid_tracker->scan(spans.first, spans.second);
+        }
+
+        if (ringbuffer.gpu_timeline_filter) {
+            return do_send_gpu_timeline_filtered_data_chunk(st, ringbuffer, cpu, spans, header_head, new_tail);
+        }
+
+        if (ringbuffer.function_latency_filter) {
+            return do_send_function_latency_filtered_data_chunk(st, ringbuffer, cpu, spans, header_head, new_tail);
+        }
+
+        if (ringbuffer.sample_aggregator) {
+            return do_send_aggregated_data_chunk(st, ringbuffer, cpu, spans, header_head, new_tail);
+        }
+
+        if (ringbuffer.call_stack_deduplicator) {
+            return do_send_deduplicated_data_chunk(st, ringbuffer, cpu, spans, header_head, new_tail);
+        }
+
+        // send it
+        return do_send_msg(st,
+                           cpu,
+                           ipc::msg_perf_data_raw_from_spans_t {cpu, spans},
+                           spans.first.size() + spans.second.size(),
+                           header_head,
+                           new_tail);
+    }
+
+    async::continuations::polymorphic_continuation_t<boost::system::error_code>
+    perf_buffer_consumer_t::do_flush_flight_recorder(std::shared_ptr<perf_buffer_consumer_t> const & st)
+    {
+        using namespace async::continuations;
+
+        if (!st->flight_recorder) {
+            return start_with(boost::system::error_code {});
+        }
+
+        auto messages = std::make_shared<std::deque<flight_recorder_t::message_t>>(st->flight_recorder->take());
+
+        LOG_DEBUG("Sending %zu messages from the flight recorder", messages->size());
+
+        return start_with(boost::system::error_code {}) //
+             | loop(
+                   [messages](boost::system::error_code const & ec) {
+                       return start_with(!ec && !messages->empty(), ec);
+                   },
+                   [st, messages](boost::system::error_code const & /*ec*/) {
+                       auto message = std::move(messages->front());
+                       messages->pop_front();
+
+                       return std::visit(
+                           [&st](auto && msg) -> polymorphic_continuation_t<boost::system::error_code> {
+                               return st->ipc_sink->async_send_message(std::move(msg), use_continuation)
+                                    | then([](auto const & ec, auto const & /*msg*/) { return ec; });
+                           },
+                           std::move(message));
+                   });
+    }
+
     [[nodiscard]] async::continuations::polymorphic_continuation_t<boost::system::error_code>
     perf_buffer_consumer_t::do_poll(std::shared_ptr<perf_buffer_consumer_t> const & st,
-                                    std::shared_ptr<perf_ringbuffer_mmap_t> const & mmap,
+                                    std::shared_ptr<cpu_ringbuffer_t> const & ringbuffer,
                                     int cpu)
     {
         using namespace async::continuations;
 
-        // SDDAP-11384, read data before aux
+        GATOR_PROBE1(perf_poll_start, cpu);
+
+        // SDDAP-11384, read data before aux (both are drained on the cpu's strand, so the order is preserved per cpu)
 
-        return do_send_data_section(st, mmap, cpu) //
-             | then([st, mmap, cpu](boost::system::error_code const & ec, bool modified) {
-                   return do_send_aux_section(st, mmap, cpu, ec, modified);
+        return do_send_data_section(st, ringbuffer, cpu) //
+             | then([st, ringbuffer, cpu](boost::system::error_code const & ec, bool modified) {
+                   return do_send_aux_section(st, ringbuffer, cpu, ec, modified);
+               }) //
+             | then([cpu](boost::system::error_code const & ec, bool modified) {
+                   GATOR_PROBE2(perf_poll_end, cpu, modified);
+                   return start_with(ec, modified);
                })                  //
              | post_on(st->strand) //
-             | then([st, mmap, cpu](boost::system::error_code const & ec,
+             | then([st, ringbuffer, cpu](boost::system::error_code const & ec,
                                     bool modified) mutable -> polymorphic_continuation_t<boost::system::error_code> {
                    // not removed / error path
-                   if ((ec) || (st->removed_cpus.count(cpu) <= 0)) {
+                   if ((ec) || (!ringbuffer->removed)) {
                        // mark it as no longer busy
-                       st->busy_cpus.erase(cpu);
+                       ringbuffer->busy = false;
                        return start_with(ec);
                    }
 
@@ -240,26 +1246,208 @@ namespace agents::perf {
                    // when removed, do it again repeatedly to flush any remainig data since the remove request (which may overlap the sending)
                    return start_with(boost::system::error_code {}, modified)
                         | loop(
-                              [](boost::system::error_code const & ec, bool modified) {
+                              [ringbuffer, cpu](boost::system::error_code const & ec, bool modified) {
                                   LOG_TRACE("Remove send loop will iterate (modified=%u, ec=%s)",
                                             modified,
                                             ec.message().c_str());
+                                  // bound the time spent draining a cpu that is still producing data
+                                  auto const expired = (std::chrono::steady_clock::now() >= ringbuffer->drain_deadline);
+                                  if (modified && !ec && expired) {
+                                      LOG_WARNING("Stopped draining the perf ring buffer for cpu %d as the drain "
+                                                  "deadline passed; any data that remains is discarded",
+                                                  cpu);
+                                  }
                                   // only continue to iterate if no error and last iteration indicates modified ringbuffer data
-                                  return start_with(modified && !ec, ec, modified);
+                                  return start_with(modified && !ec && !expired, ec, modified);
                               },
-                              [st, mmap, cpu](boost::system::error_code const & /*ec*/, bool /*modified*/) {
-                                  return do_send_data_section(st, mmap, cpu) //
-                                       | then([st, mmap, cpu](boost::system::error_code e, bool m) {
-                                             return do_send_aux_section(st, mmap, cpu, e, m);
+                              [st, ringbuffer, cpu](boost::system::error_code const & /*ec*/, bool /*modified*/) {
+                                  return start_on(ringbuffer->strand) //
+                                       | then([st, ringbuffer, cpu]() {
+                                             return do_send_data_section(st, ringbuffer, cpu);
+                                         })
+                                       | then([st, ringbuffer, cpu](boost::system::error_code e, bool m) {
+                                             return do_send_aux_section(st, ringbuffer, cpu, e, m);
                                          });
                               })
+                        | post_on(ringbuffer->strand) //
+                        | then([st, ringbuffer, cpu](boost::system::error_code const & ec, bool modified)
+                                   -> polymorphic_continuation_t<boost::system::error_code, bool> {
+                              // send the last, incomplete, windows of aggregates, of function latencies, of GPU
+                              // activity, of block I/O, of lock wait times, of thread energies and of the SPE heatmap
+                              auto const has_spe_heatmap = ringbuffer->spe_record_filter
+                                                        && (ringbuffer->spe_record_filter->get_heatmap() != nullptr);
+                              if (ec
+                                  || (!ringbuffer->sample_aggregator && !ringbuffer->function_latency_filter
+                                      && !ringbuffer->gpu_timeline_filter && !ringbuffer->block_io_filter
+                                      && !ringbuffer->lock_contention_filter && !ringbuffer->thread_energy_filter
+                                      && !has_spe_heatmap)) {
+                                  return start_with(ec, modified);
+                              }
+
+                              auto frames = std::make_shared<std::deque<std::vector<char>>>();
+                              if (ringbuffer->sample_aggregator) {
+                                  ringbuffer->sample_aggregator->flush(ringbuffer->sample_aggregates_windows);
+                                  encode_sample_aggregates(st, *ringbuffer, cpu, *frames);
+                              }
+                              if (ringbuffer->function_latency_filter) {
+                                  ringbuffer->function_latency_filter->flush(ringbuffer->function_latencies_windows);
+                                  encode_function_latencies(st, *ringbuffer, cpu, *frames);
+                              }
+                              if (ringbuffer->gpu_timeline_filter) {
+                                  ringbuffer->gpu_timeline_filter->flush(ringbuffer->gpu_activity_windows);
+                                  encode_gpu_activity(st, *ringbuffer, cpu, *frames);
+                              }
+                              if (ringbuffer->block_io_filter) {
+                                  ringbuffer->block_io_filter->flush(ringbuffer->block_io_windows);
+                                  encode_block_io_counters(st, *ringbuffer, *frames);
+                              }
+                              if (ringbuffer->lock_contention_filter) {
+                                  ringbuffer->lock_contention_filter->flush(ringbuffer->lock_contention_windows);
+                                  encode_lock_contention(st, *ringbuffer, cpu, *frames);
+                              }
+                              if (ringbuffer->thread_energy_filter) {
+                                  ringbuffer->thread_energy_filter->flush(ringbuffer->thread_energy_windows);
+                                  encode_thread_energy(st, *ringbuffer, cpu, *frames);
+                              }
+                              if (has_spe_heatmap) {
+                                  ringbuffer->spe_record_filter->flush(ringbuffer->spe_heatmap_windows);
+                                  encode_spe_heatmaps(st, *ringbuffer, cpu, *frames);
+                              }
+
+                              return do_send_apc_frames(st, cpu, std::move(frames), 0, 0)
+                                   | then([modified](std::uint64_t /*head*/,
+                                                     std::uint64_t /*tail*/,
+                                                     boost::system::error_code const & e) {
+                                         return std::make_tuple(e, modified);
+                                     })
+                                   | unpack_tuple();
+                          })
                         | post_on(st->strand) //
-                        | then([st, cpu](boost::system::error_code const & ec, bool /*modified*/) {
+                        | then([st, ringbuffer, cpu](boost::system::error_code const & ec, bool /*modified*/) {
                               LOG_TRACE("Remove mmap completed for %d (poll ec =%s)", cpu, ec.message().c_str());
+                              if (ringbuffer->call_stack_deduplicator) {
+                                  auto const & stats = ringbuffer->call_stack_deduplicator->get_stats();
+                                  LOG_INFO("Call stacks for cpu %d: %" PRIu64 " samples, %" PRIu64
+                                           " with a previously sent stack, %" PRIu64 " stacks sent, %" PRIu64
+                                           " bytes saved",
+                                           cpu,
+                                           stats.samples,
+                                           stats.deduplicated_samples,
+                                           stats.stacks,
+                                           stats.saved_bytes);
+                              }
+                              if (ringbuffer->user_stack_unwinder) {
+                                  auto const & stats = ringbuffer->user_stack_unwinder->get_stats();
+                                  LOG_INFO("User stacks for cpu %d: %" PRIu64 " samples, %" PRIu64
+                                           " with more frames than the frame pointers gave, %" PRIu64
+                                           " bytes removed",
+                                           cpu,
+                                           stats.samples,
+                                           stats.unwound_samples,
+                                           stats.removed_bytes);
+                              }
+                              if (ringbuffer->sample_aggregator) {
+                                  auto const & stats = ringbuffer->sample_aggregator->get_stats();
+                                  LOG_INFO("Aggregated samples for cpu %d: %" PRIu64 " samples into %" PRIu64
+                                           " entries, %" PRIu64 " windows sent with %" PRIu64 " exemplars",
+                                           cpu,
+                                           stats.samples,
+                                           stats.entries,
+                                           stats.windows,
+                                           stats.exemplars);
+                              }
+                              auto const & losses = ringbuffer->loss_stats;
+                              if ((losses.lost_records != 0) || (losses.lost_samples != 0)
+                                  || (losses.truncated_aux_records != 0)) {
+                                  LOG_WARNING("Data lost for cpu %d: %" PRIu64 " records (the buffer was full), "
+                                              "%" PRIu64 " samples, %" PRIu64 " truncated aux records",
+                                              cpu,
+                                              losses.lost_records,
+                                              losses.lost_samples,
+                                              losses.truncated_aux_records);
+                              }
+                              if (ringbuffer->spe_record_filter) {
+                                  auto const & stats = ringbuffer->spe_record_filter->get_stats();
+                                  LOG_INFO("SPE records for cpu %d: %" PRIu64 " forwarded (%" PRIu64
+                                           " bytes), %" PRIu64 " dropped (%" PRIu64 " bytes)",
+                                           cpu,
+                                           stats.forwarded_records,
+                                           stats.forwarded_bytes,
+                                           stats.dropped_records,
+                                           stats.dropped_bytes);
+                                  auto const * heatmap = ringbuffer->spe_record_filter->get_heatmap();
+                                  if (heatmap != nullptr) {
+                                      auto const & heatmap_stats = heatmap->get_stats();
+                                      LOG_INFO("SPE heatmap for cpu %d: %" PRIu64 " records, %" PRIu64
+                                               " windows, %" PRIu64 " entries",
+                                               cpu,
+                                               heatmap_stats.records,
+                                               heatmap_stats.windows,
+                                               heatmap_stats.entries);
+                                  }
+                              }
                               // mark it as no longer busy
-                              st->busy_cpus.erase(cpu);
+                              ringbuffer->busy = false;
                               // remove it
                               st->per_cpu_mmaps.erase(cpu);
+                              // the function latencies are shared by all the cpus
+                              if (st->per_cpu_mmaps.empty() && st->function_latency_state) {
+                                  auto const stats = st->function_latency_state->get_stats();
+                                  LOG_INFO("Function latencies: %" PRIu64 " calls, %" PRIu64
+                                           " unpaired samples, %" PRIu64 " windows sent",
+                                           stats.calls,
+                                           stats.unpaired,
+                                           stats.windows);
+                              }
+                              // as is the GPU activity
+                              if (st->per_cpu_mmaps.empty() && st->gpu_timeline_state) {
+                                  auto const stats = st->gpu_timeline_state->get_stats();
+                                  LOG_INFO("GPU activity: %" PRIu64 " job intervals, %" PRIu64
+                                           " unpaired job slot samples, %" PRIu64 " work periods, %" PRIu64
+                                           " windows sent",
+                                           stats.intervals,
+                                           stats.unpaired,
+                                           stats.work_periods,
+                                           stats.windows);
+                              }
+                              // as is the block I/O
+                              if (st->per_cpu_mmaps.empty() && st->block_io_state) {
+                                  auto const stats = st->block_io_state->get_stats();
+                                  LOG_INFO("Block I/O: %" PRIu64 " requests, %" PRIu64 " unpaired samples, %" PRIu64
+                                           " windows sent",
+                                           stats.requests,
+                                           stats.unpaired,
+                                           stats.windows);
+                              }
+                              // as are the lock wait times
+                              if (st->per_cpu_mmaps.empty() && st->lock_contention_state) {
+                                  auto const stats = st->lock_contention_state->get_stats();
+                                  LOG_INFO("Lock contention: %" PRIu64 " waits, %" PRIu64 " unpaired samples, %" PRIu64
+                                           " waits dropped, %" PRIu64 " windows sent",
+                                           stats.waits,
+                                           stats.unpaired,
+                                           stats.dropped,
+                                           stats.windows);
+                              }
+                              // as are the thread energies
+                              if (st->per_cpu_mmaps.empty() && st->thread_energy_state) {
+                                  auto const stats = st->thread_energy_state->get_stats();
+                                  LOG_INFO("Thread energy: %" PRIu64 " switches, %" PRIu64
+                                           " frequency changes, %" PRIu64 " windows sent",
+                                           stats.switches,
+                                           stats.frequency_changes,
+                                           stats.windows);
+                              }
+                              // as is the pid filter
+                              if (st->per_cpu_mmaps.empty() && st->sample_pid_filter) {
+                                  auto const stats = st->sample_pid_filter->get_stats();
+                                  LOG_INFO("Samples filtered by pid: %" PRIu64 " kept, %" PRIu64 " dropped (%" PRIu64
+                                           " bytes), %" PRIu64 " child processes followed",
+                                           stats.kept_samples,
+                                           stats.dropped_samples,
+                                           stats.dropped_bytes,
+                                           stats.followed_children);
+                              }
                               return ec;
                           });
                });
@@ -2,21 +2,41 @@
 
 #pragma once
 
+#include "Configuration.h"
 #include "Logging.h"
+#include "agents/perf/block_io_latency.h"
+#include "agents/perf/call_stack_deduplicator.h"
+#include "agents/perf/cpu_drain_threads.h"
 #include "agents/perf/events/perf_ringbuffer_mmap.hpp"
+#include "agents/perf/events/types.hpp"
+#include "agents/perf/flight_recorder.h"
+#include "agents/perf/function_latency.h"
+#include "agents/perf/gpu_timeline.h"
+#include "agents/perf/lock_contention.h"
 #include "agents/perf/record_types.h"
+#include "agents/perf/sample_aggregator.h"
+#include "agents/perf/sample_pid_filter.h"
+#include "agents/perf/sample_pid_tracker.h"
+#include "agents/perf/spe_record_filter.h"
+#include "agents/perf/thread_energy.h"
+#include "agents/perf/user_stack_unwinder.h"
 #include "async/continuations/async_initiate.h"
 #include "async/continuations/continuation.h"
 #include "async/continuations/continuation_of.h"
 #include "async/continuations/operations.h"
 #include "async/continuations/stored_continuation.h"
 #include "async/continuations/use_continuation.h"
+#include "ipc/frame_buffer_pool.h"
+#include "ipc/messages.h"
 #include "ipc/raw_ipc_channel_sink.h"
+#include "lib/Resource.h"
 
 #include <atomic>
 #include <deque>
+#include <map>
 #include <memory>
-#include <set>
+#include <optional>
+#include <vector>
 
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/io_context_strand.hpp>
@@ -28,13 +48,71 @@ namespace agents::perf {
      * This class consumes the contents of the perf mmap ringbuffers, outputing perf data apc frames and perf aux apc frames.
      * It is not responsible for monitoring of the perf file descriptors / periodic timer (these are handled elsewhere), but it provides
      * an interface where some other caller can trigger the data in the ringbuffer(s) to be consumed.
+     *
+     * The bookkeeping (which mmaps exist, which are busy) is serialized on a single strand, but each cpu's mmap is drained on its own
+     * strand so that the cpus are drained independently of (and in parallel with) each other.
+     * Given cpu_drain_threads, each cpu's strand runs on a thread pinned to that cpu, not on the agent's thread pool.
      */
     class perf_buffer_consumer_t : public std::enable_shared_from_this<perf_buffer_consumer_t> {
     public:
+        /** The scale of the value returned by take_peak_data_fill */
+        static constexpr std::size_t fill_scale = 1000;
+
+        /**
+         * @param spe_record_filters The filter to apply to the SPE records in each cpu's aux data, for those cpus that
+         * have one
+         * @param flight_recorder If set, the data is kept in the flight recorder rather than being sent to the shell
+         * @param call_stack_dedup_state If set, the call stacks in the perf samples are deduplicated
+         * @param sample_pid_tracker If set, records the pids that appear in the perf samples
+         * @param sample_aggregation_state If set, the perf samples are aggregated rather than sent individually
+         * @param function_latency_state If set, the samples of the function probes are paired into latency histograms
+         * rather than sent individually
+         * @param gpu_timeline_state If set, the samples of the Mali GPU tracepoints are converted into GPU activity
+         * rather than sent individually
+         * @param block_io_state If set, the samples of the block tracepoints are paired into block I/O counters rather
+         * than sent individually
+         * @param lock_contention_state If set, the samples of the futex or lock tracepoints are paired into lock wait
+         * times rather than sent individually
+         * @param thread_energy_state If set, the samples of the scheduler and cpu frequency tracepoints are combined
+         * into the energy used by each thread; the cpu frequency samples are not sent individually
+         * @param sample_pid_filter If set, the samples of the processes that are not being profiled are dropped
+         * @param user_stack_unwind_state If set, the copies of the user stack in the perf samples are unwound
+         * @param cpu_drain_threads If set, each cpu's mmap is drained on a thread pinned to the cpu
+         */
         perf_buffer_consumer_t(boost::asio::io_context & context,
                                std::shared_ptr<ipc::raw_ipc_channel_sink_t> ipc_sink,
-                               std::size_t one_shot_mode_limit)
-            : one_shot_mode_limit(one_shot_mode_limit), ipc_sink(std::move(ipc_sink)), strand(context)
+                               std::shared_ptr<ipc::frame_buffer_pool_t> frame_buffer_pool,
+                               std::size_t one_shot_mode_limit,
+                               std::map<core_no_t, SpeRecordFilter> spe_record_filters = {},
+                               std::shared_ptr<flight_recorder_t> flight_recorder = {},
+                               std::shared_ptr<call_stack_dedup_state_t> call_stack_dedup_state = {},
+                               std::shared_ptr<sample_pid_tracker_t> sample_pid_tracker = {},
+                               std::shared_ptr<sample_aggregation_state_t> sample_aggregation_state = {},
+                               std::shared_ptr<function_latency_state_t> function_latency_state = {},
+                               std::shared_ptr<gpu_timeline_state_t> gpu_timeline_state = {},
+                               std::shared_ptr<block_io_state_t> block_io_state = {},
+                               std::shared_ptr<lock_contention_state_t> lock_contention_state = {},
+                               std::shared_ptr<thread_energy_state_t> thread_energy_state = {},
+                               std::shared_ptr<sample_pid_filter_t> sample_pid_filter = {},
+                               std::shared_ptr<user_stack_unwind_state_t> user_stack_unwind_state = {},
+                               std::shared_ptr<cpu_drain_threads_t> cpu_drain_threads = {})
+            : one_shot_mode_limit(one_shot_mode_limit),
+              spe_record_filters(std::move(spe_record_filters)),
+              flight_recorder(std::move(flight_recorder)),
+              call_stack_dedup_state(std::move(call_stack_dedup_state)),
+              sample_pid_tracker(std::move(sample_pid_tracker)),
+              sample_aggregation_state(std::move(sample_aggregation_state)),
+              function_latency_state(std::move(function_latency_state)),
+              gpu_timeline_state(std::move(gpu_timeline_state)),
+              block_io_state(std::move(block_io_state)),
+              lock_contention_state(std::move(lock_contention_state)),
+              thread_energy_state(std::move(thread_energy_state)),
+              sample_pid_filter(std::move(sample_pid_filter)),
+              user_stack_unwind_state(std::move(user_stack_unwind_state)),
+              cpu_drain_threads(std::move(cpu_drain_threads)),
+              ipc_sink(std::move(ipc_sink)),
+              frame_buffer_pool(std::move(frame_buffer_pool)),
+              strand(context)
         {
         }
 
@@ -63,8 +141,11 @@ namespace agents::perf {
                                }
 
                                // insert it into the map
-                               auto [it, inserted] = st->per_cpu_mmaps.try_emplace(cpu, std::move(mmap));
-                               (void) it;
+                               auto & drain_context = (st->cpu_drain_threads ? st->cpu_drain_threads->context_for(cpu)
+                                                                             : st->strand.context());
+                               auto [it, inserted] = st->per_cpu_mmaps.try_emplace(
+                                   cpu,
+                                   std::make_shared<cpu_ringbuffer_t>(drain_context, std::move(mmap)));
 
                                if (!inserted) {
                                    LOG_DEBUG("... failed, as already has mmap");
@@ -72,6 +153,43 @@ namespace agents::perf {
                                        boost::system::errc::device_or_resource_busy);
                                }
 
+                               auto filter_it = st->spe_record_filters.find(core_no_t(cpu));
+                               if ((filter_it != st->spe_record_filters.end()) && it->second->mmap->has_aux()) {
+                                   it->second->spe_record_filter.emplace(filter_it->second);
+                               }
+
+                               if (st->user_stack_unwind_state) {
+                                   it->second->user_stack_unwinder.emplace(st->user_stack_unwind_state);
+                               }
+
+                               if (st->call_stack_dedup_state) {
+                                   it->second->call_stack_deduplicator.emplace(st->call_stack_dedup_state);
+                               }
+
+                               if (st->sample_aggregation_state) {
+                                   it->second->sample_aggregator.emplace(st->sample_aggregation_state);
+                               }
+
+                               if (st->function_latency_state) {
+                                   it->second->function_latency_filter.emplace(st->function_latency_state);
+                               }
+
+                               if (st->gpu_timeline_state) {
+                                   it->second->gpu_timeline_filter.emplace(st->gpu_timeline_state);
+                               }
+
+                               if (st->block_io_state) {
+                                   it->second->block_io_filter.emplace(st->block_io_state);
+                               }
+
+                               if (st->lock_contention_state) {
+                                   it->second->lock_contention_filter.emplace(st->lock_contention_state);
+                               }
+
+                               if (st->thread_energy_state) {
+                                   it->second->thread_energy_filter.emplace(cpu, st->thread_energy_state);
+                               }
+
                                // success
                                return boost::system::error_code {};
                            });
@@ -99,26 +217,73 @@ namespace agents::perf {
                          | then([cpu, st]() mutable -> polymorphic_continuation_t<boost::system::error_code> {
                                LOG_TRACE("Poll started for %d", cpu);
 
-                               auto mmap_it = st->per_cpu_mmaps.find(cpu);
+                               auto ringbuffer_it = st->per_cpu_mmaps.find(cpu);
                                // ignore cpus that don't exist; its probably just poll_all
-                               if (mmap_it == st->per_cpu_mmaps.end()) {
+                               if (ringbuffer_it == st->per_cpu_mmaps.end()) {
                                    LOG_TRACE("No such mmap found for %d", cpu);
                                    return start_with(boost::system::error_code {});
                                }
 
                                // if it is already being polled, also ignore the request
-                               if (!st->busy_cpus.insert(cpu).second) {
+                               if (ringbuffer_it->second->busy) {
                                    LOG_TRACE("Already polling %d", cpu);
                                    return start_with(boost::system::error_code {});
                                }
 
-                               // ok, poll it
-                               return do_poll(st, mmap_it->second, cpu);
+                               ringbuffer_it->second->busy = true;
+
+                               // ok, poll it on its own strand
+                               return start_on(ringbuffer_it->second->strand) //
+                                    | then([st, ringbuffer = ringbuffer_it->second, cpu]() {
+                                          return do_poll(st, ringbuffer, cpu);
+                                      });
                            });
                 },
                 token);
         }
 
+        /**
+         * Cause the mmaps associated with each of `cpus` to be polled.
+         *
+         * The cpus are polled in parallel with each other, and the operation completes once all of them have been polled. The
+         * result is the first error reported by any of the polls.
+         *
+         * @param cpus The cpus for which the associated mmap should be polled
+         */
+        template<typename CompletionToken>
+        auto async_poll_cpus(std::vector<int> cpus, CompletionToken && token)
+        {
+            using namespace async::continuations;
+
+            LOG_TRACE("Poll requested for %zu cpus", cpus.size());
+
+            return async_initiate_explicit<void(boost::system::error_code)>(
+                [st = shared_from_this(), cpus = std::move(cpus)](auto && sc) mutable {
+                    if (cpus.empty()) {
+                        return resume_continuation(st->strand.context(), std::move(sc), boost::system::error_code {});
+                    }
+
+                    auto join = std::make_shared<poll_join_t>(cpus.size(), sc.move());
+
+                    for (auto cpu : cpus) {
+                        submit(st->async_poll(cpu, use_continuation) //
+                                   | post_on(st->strand)            //
+                                   | then([st, join](boost::system::error_code const & ec) {
+                                         if (ec && !join->ec) {
+                                             join->ec = ec;
+                                         }
+
+                                         if (--(join->remaining) == 0) {
+                                             LOG_TRACE("Poll cpus completed (ec=%s)", join->ec.message().c_str());
+                                             resume_continuation(st->strand.context(), std::move(join->sc), join->ec);
+                                         }
+                                     }),
+                               sc.get_exceptionally());
+                    }
+                },
+                std::forward<CompletionToken>(token));
+        }
+
         /**
          * Cause the mmap for all currently tracked cpus to be polled.
          */
@@ -133,49 +298,52 @@ namespace agents::perf {
                 [st = shared_from_this()]() mutable {
                     return start_on(st->strand) //
                          | then([st]() mutable {
-                               return start_with<std::size_t, std::size_t, boost::system::error_code>(
-                                          0,
-                                          st->per_cpu_mmaps.size(),
-                                          {}) //
-                                    | loop(
-                                          [](std::size_t n, std::size_t count, boost::system::error_code ec) { //
-                                              return start_with((n < count) && !ec, n, count, ec);
-                                          },
-                                          [st](std::size_t n, std::size_t count, boost::system::error_code /*ec*/) {
-                                              return st->async_poll(n, use_continuation) //
-                                                   | then([n, count](auto ec) { return start_with(n + 1, count, ec); });
-                                          })
-                                    | then([](std::size_t /*n*/, std::size_t /*count*/, boost::system::error_code ec) {
-                                          LOG_TRACE("Poll all completed (ec=%s)", ec.message().c_str());
-                                          return ec;
-                                      });
+                               std::vector<int> cpus {};
+                               cpus.reserve(st->per_cpu_mmaps.size());
+                               for (auto const & entry : st->per_cpu_mmaps) {
+                                   cpus.push_back(entry.first);
+                               }
+
+                               return st->async_poll_cpus(std::move(cpus), use_continuation);
                            });
                 },
                 token);
         }
 
         /**
-         * Remove the mmap associated with some cpu.
+         * Remove the mmaps associated with each of `cpus`.
          *
-         * The mmap will be polled one more time before removal, and any currently active poll operations will complete successfully in parallel.
+         * The mmaps are drained in parallel with each other, repeatedly until no more data is found (or until the
+         * deadline passes, after which any remaining data is discarded), and any currently active poll operations will
+         * complete successfully in parallel. The operation completes once all of them are removed.
          *
-         * @param cpu The cpu for which the associated mmap should be removed
+         * @param cpus The cpus for which the associated mmap should be removed
+         * @param drain_deadline The time after which the removed mmaps are no longer drained again
          */
         template<typename CompletionToken>
-        auto async_remove_ringbuffer(int cpu, CompletionToken && token)
+        auto async_remove_ringbuffers(std::vector<int> cpus,
+                                      std::chrono::steady_clock::time_point drain_deadline,
+                                      CompletionToken && token)
         {
             using namespace async::continuations;
 
-            LOG_TRACE("Remove mmap requested for %d", cpu);
+            LOG_TRACE("Remove mmap requested for %zu cpus", cpus.size());
 
             return async_initiate<continuation_of_t<boost::system::error_code>>(
-                [st = shared_from_this(), cpu]() mutable {
+                [st = shared_from_this(), cpus = std::move(cpus), drain_deadline]() mutable {
                     return start_on(st->strand) //
-                         | then([st, cpu]() {
-                               LOG_TRACE("Remove mmap marked for %d", cpu);
-                               st->removed_cpus.insert(cpu);
-                           }) //
-                         | st->async_poll(cpu, use_continuation);
+                         | then([st, cpus = std::move(cpus), drain_deadline]() mutable {
+                               for (auto cpu : cpus) {
+                                   auto ringbuffer_it = st->per_cpu_mmaps.find(cpu);
+                                   if (ringbuffer_it != st->per_cpu_mmaps.end()) {
+                                       LOG_TRACE("Remove mmap marked for %d", cpu);
+                                       ringbuffer_it->second->removed = true;
+                                       ringbuffer_it->second->drain_deadline = drain_deadline;
+                                   }
+                               }
+
+                               return st->async_poll_cpus(std::move(cpus), use_continuation);
+                           });
                 },
                 token);
         }
@@ -213,6 +381,65 @@ namespace agents::perf {
                 token);
         }
 
+        /**
+         * Send the data held by the flight recorder to the shell, oldest first. Does nothing if there is no flight recorder.
+         *
+         * The data that is currently in the mmaps is not included, so they should be polled first.
+         */
+        template<typename CompletionToken>
+        auto async_flush_flight_recorder(CompletionToken && token)
+        {
+            using namespace async::continuations;
+
+            LOG_TRACE("Flush flight recorder requested");
+
+            return async_initiate<continuation_of_t<boost::system::error_code>>(
+                [st = shared_from_this()]() mutable {
+                    return start_on(st->strand) //
+                         | then([st]() { return do_flush_flight_recorder(st); });
+                },
+                token);
+        }
+
+        /**
+         * Record the ids of newly opened events, so that the call stacks in their samples can be deduplicated (or the
+         * samples aggregated, paired or filtered, and their pids tracked). Must be called before the events are
+         * enabled, otherwise their first samples are sent unchanged.
+         */
+        void add_event_ids(std::vector<std::pair<perf_event_id_t, gator_key_t>> const & mappings)
+        {
+            if (call_stack_dedup_state) {
+                call_stack_dedup_state->add_ids(mappings);
+            }
+            if (sample_pid_tracker) {
+                sample_pid_tracker->add_ids(mappings);
+            }
+            if (sample_aggregation_state) {
+                sample_aggregation_state->add_ids(mappings);
+            }
+            if (function_latency_state) {
+                function_latency_state->add_ids(mappings);
+            }
+            if (gpu_timeline_state) {
+                gpu_timeline_state->add_ids(mappings);
+            }
+            if (block_io_state) {
+                block_io_state->add_ids(mappings);
+            }
+            if (lock_contention_state) {
+                lock_contention_state->add_ids(mappings);
+            }
+            if (thread_energy_state) {
+                thread_energy_state->add_ids(mappings);
+            }
+            if (sample_pid_filter) {
+                sample_pid_filter->add_ids(mappings);
+            }
+            if (user_stack_unwind_state) {
+                user_stack_unwind_state->add_ids(mappings);
+            }
+        }
+
         /** Is the output data full wrt one-shot mode */
         [[nodiscard]] bool is_one_shot_full() const
         {
@@ -220,6 +447,35 @@ namespace agents::perf {
                     && (cumulative_bytes_sent_apc_frames.load(std::memory_order_acquire) >= one_shot_mode_limit));
         }
 
+        /**
+         * Read and reset the peak fill level of any of the data ringbuffers, as observed at the start of each poll since
+         * the last call.
+         *
+         * @return The peak fill level, in the range [0, fill_scale]
+         */
+        [[nodiscard]] std::size_t take_peak_data_fill() { return peak_data_fill.exchange(0, std::memory_order_acq_rel); }
+
+        /**
+         * Report the state of the agent side of the capture pipeline to the shell
+         *
+         * @param peak_fill The peak fill level, as returned by take_peak_data_fill
+         */
+        void send_stats(std::size_t peak_fill)
+        {
+            auto const usage = lib::getSelfResourceUsage();
+            ipc_sink->async_send_message(
+                ipc::msg_perf_agent_stats_t {{static_cast<std::uint32_t>(peak_fill),
+                                              static_cast<std::uint32_t>(ipc_sink->queue_depth()),
+                                              usage.cpuTimeUs,
+                                              usage.maxRssKiB,
+                                              usage.wakeups,
+                                              total_lost_records.load(std::memory_order_relaxed),
+                                              total_lost_samples.load(std::memory_order_relaxed),
+                                              total_truncated_aux_records.load(std::memory_order_relaxed),
+                                              one_shot_dropped_bytes.load(std::memory_order_relaxed)}},
+                [](auto const & /*ec*/, auto const & /*msg*/) {});
+        }
+
         /** Manually trigger the one-shot-mode callback */
         void trigger_one_shot_mode()
         {
@@ -239,20 +495,100 @@ namespace agents::perf {
         }
 
     private:
+        /** The per-cpu state; the mmap and the strand on which it is drained */
+        /** The data that the kernel reported as lost for some cpu */
+        struct loss_stats_t {
+            /** The number of records lost as the data buffer was full (the sum of the PERF_RECORD_LOST counts) */
+            std::uint64_t lost_records;
+            /** The number of samples that could not be generated (the sum of the PERF_RECORD_LOST_SAMPLES counts) */
+            std::uint64_t lost_samples;
+            /** The number of PERF_RECORD_AUX records with PERF_AUX_FLAG_TRUNCATED set */
+            std::uint64_t truncated_aux_records;
+        };
+
+        struct cpu_ringbuffer_t {
+            cpu_ringbuffer_t(boost::asio::io_context & context, std::shared_ptr<perf_ringbuffer_mmap_t> mmap)
+                : mmap(std::move(mmap)), strand(context)
+            {
+            }
+
+            std::shared_ptr<perf_ringbuffer_mmap_t> mmap;
+            boost::asio::io_context::strand strand;
+            /** Set when the aux data is SPE records that are filtered before they are sent */
+            std::optional<spe_record_filter_t> spe_record_filter {};
+            /** The records that passed the filter, reused for each chunk */
+            std::vector<char> spe_record_filter_output {};
+            /** The heatmap windows closed by a chunk, reused for each chunk */
+            std::vector<std::vector<std::uint64_t>> spe_heatmap_windows {};
+            /** Set when the copies of the user stack in the samples are unwound */
+            std::optional<user_stack_unwinder_t> user_stack_unwinder {};
+            /** Set when the call stacks in the samples are deduplicated */
+            std::optional<call_stack_deduplicator_t> call_stack_deduplicator {};
+            /** The stacks first seen in a chunk, reused for each chunk */
+            std::vector<std::uint64_t> new_call_stacks {};
+            /** Set when the samples are aggregated */
+            std::optional<sample_aggregator_t> sample_aggregator {};
+            /** The windows closed by a chunk, reused for each chunk */
+            std::vector<std::vector<std::uint64_t>> sample_aggregates_windows {};
+            /** Set when the function probes' samples are paired */
+            std::optional<function_latency_filter_t> function_latency_filter {};
+            /** The windows closed by a chunk, reused for each chunk */
+            std::vector<std::vector<std::uint64_t>> function_latencies_windows {};
+            /** Set when the Mali GPU tracepoints' samples are converted */
+            std::optional<gpu_timeline_filter_t> gpu_timeline_filter {};
+            /** The windows closed by a chunk, reused for each chunk */
+            std::vector<std::vector<std::uint64_t>> gpu_activity_windows {};
+            /** Set when the block tracepoints' samples are paired */
+            std::optional<block_io_filter_t> block_io_filter {};
+            /** The windows closed by a chunk, reused for each chunk */
+            std::vector<block_io_state_t::window_t> block_io_windows {};
+            /** Set when the futex or lock tracepoints' samples are paired */
+            std::optional<lock_contention_filter_t> lock_contention_filter {};
+            /** The windows closed by a chunk, reused for each chunk */
+            std::vector<std::vector<std::uint64_t>> lock_contention_windows {};
+            /** Set when the scheduler and cpu frequency tracepoints' samples are combined into thread energies */
+            std::optional<thread_energy_filter_t> thread_energy_filter {};
+            /** The windows closed by a chunk, reused for each chunk */
+            std::vector<std::vector<std::uint64_t>> thread_energy_windows {};
+            /** The losses found in the data so far (only accessed from the ringbuffer's strand) */
+            loss_stats_t loss_stats {0, 0, 0};
+            /** Set while the mmap is being polled (only accessed from the consumer's strand) */
+            bool busy = false;
+            /** Set once the mmap is to be removed after its final poll (only accessed from the consumer's strand) */
+            bool removed = false;
+            /** Once removed, the time after which the mmap is not drained again, even if more data was found */
+            std::chrono::steady_clock::time_point drain_deadline {};
+        };
+
+        /** Tracks the completion of a set of parallel poll operations, only accessed from the strand */
+        struct poll_join_t {
+            poll_join_t(std::size_t remaining, async::continuations::stored_continuation_t<boost::system::error_code> sc)
+                : remaining(remaining), sc(std::move(sc))
+            {
+            }
+
+            std::size_t remaining;
+            boost::system::error_code ec {};
+            async::continuations::stored_continuation_t<boost::system::error_code> sc;
+        };
+
         /**
-         * Send one apc_frame IPC message, returns the head, new-tail and error code as required at the end of each send loop iteration
+         * Send one apc_frame (or raw perf data) IPC message, returns the head, new-tail and error code as required at the end of each send loop iteration
          *
          * @param st The this pointer for the perf_buffer_consumer_t that made the request
          * @param cpu The cpu associated with the request
-         * @param buffer The apc_frame data buffer
+         * @param message The message to send
+         * @param size The size of the message payload (for one-shot mode accounting)
          * @param head The aux_head or data_head value
          * @param tail The new value for aux_tail or data_tail after the send completes
          * @return A continuation producing the head, new-tail and error code values
          */
+        template<typename MessageType>
         static async::continuations::polymorphic_continuation_t<std::uint64_t, std::uint64_t, boost::system::error_code>
         do_send_msg(std::shared_ptr<perf_buffer_consumer_t> const & st,
                     int cpu,
-                    std::vector<char> buffer,
+                    MessageType message,
+                    std::size_t size,
                     std::uint64_t head,
                     std::uint64_t tail);
 
@@ -262,7 +598,7 @@ namespace agents::perf {
          * @tparam HeadField A pointer-to-member-variable for the aux_head or data_head field in the mmap header
          * @tparam TailField A pointer-to-member-variable for the aux_tail or data_tail field in the mmap header
          * @tparam Op The loop body operation, that encodes and sends some chunk of the mmap. Must return a continuation over `(head, new-tail, error-code)`
-         * @param mmap The mmap object
+         * @param ringbuffer The mmap object and the strand it is drained on
          * @param cpu The cpu associated with this mmap
          * @param op The operation
          * @return a continuation that produces an error code
@@ -270,46 +606,311 @@ namespace agents::perf {
         template<__u64 perf_event_mmap_page::*HeadField, __u64 perf_event_mmap_page::*TailField, typename Op>
         static async::continuations::polymorphic_continuation_t<boost::system::error_code, bool> do_send_common(
             std::shared_ptr<perf_buffer_consumer_t> const & st,
-            std::shared_ptr<perf_ringbuffer_mmap_t> const & mmap,
+            std::shared_ptr<cpu_ringbuffer_t> const & ringbuffer,
             int cpu,
             Op && op);
 
+        /**
+         * Update peak_data_fill from the current fill level of the data section of some mmap
+         */
+        void update_peak_data_fill(perf_ringbuffer_mmap_t & mmap);
+
+        /**
+         * Add any loss records in a chunk of whole perf data records to the ringbuffer's loss_stats, and the totals
+         *
+         * @param ringbuffer The ringbuffer that the records were read from
+         * @param first_span The first part of the records
+         * @param second_span The remainder of the records, which follows on from the first (when the mmap wrapped)
+         */
+        void count_losses(cpu_ringbuffer_t & ringbuffer,
+                          lib::Span<char const> first_span,
+                          lib::Span<char const> second_span);
+
         /**
          * Read and send the aux section
          */
         static async::continuations::polymorphic_continuation_t<boost::system::error_code, bool> do_send_aux_section(
             std::shared_ptr<perf_buffer_consumer_t> const & st,
-            std::shared_ptr<perf_ringbuffer_mmap_t> const & mmap,
+            std::shared_ptr<cpu_ringbuffer_t> const & ringbuffer,
             int cpu,
             boost::system::error_code ec_from_data,
             bool modified_from_data);
 
         /**
-         * Read and send the data section
+         * Filter the SPE records in one chunk of the aux section and send those that are kept, followed by any heatmap
+         * windows that the chunk closed. The records are sent as a contiguous stream, so the offset in each frame is
+         * that of the first kept record within the kept records.
+         *
+         * @return A continuation producing the head, new-tail and error code values. If the chunk ends with a partial
+         * record that has not been completely written yet, the head is set to the new tail so that the send loop stops
+         * and the partial record is tried again on the next poll.
+         */
+        static async::continuations::polymorphic_continuation_t<std::uint64_t, std::uint64_t, boost::system::error_code>
+        do_send_filtered_aux_chunk(std::shared_ptr<perf_buffer_consumer_t> const & st,
+                                   cpu_ringbuffer_t & ringbuffer,
+                                   int cpu,
+                                   lib::Span<char const> first_span,
+                                   lib::Span<char const> second_span,
+                                   std::uint64_t header_head,
+                                   std::uint64_t header_tail,
+                                   boost::system::error_code ec);
+
+        /**
+         * Deduplicate the call stacks in one chunk of the data section, then send the stacks that were first seen in
+         * the chunk followed by the rewritten records
+         *
+         * @return A continuation producing the head, new-tail and error code values
+         */
+        static async::continuations::polymorphic_continuation_t<std::uint64_t, std::uint64_t, boost::system::error_code>
+        do_send_deduplicated_data_chunk(std::shared_ptr<perf_buffer_consumer_t> const & st,
+                                        cpu_ringbuffer_t & ringbuffer,
+                                        int cpu,
+                                        std::pair<lib::Span<char const>, lib::Span<char const>> spans,
+                                        std::uint64_t header_head,
+                                        std::uint64_t new_tail);
+
+        /**
+         * Unwind the copies of the user stack in one chunk of the data section, then send the rewritten records (which
+         * may be filtered, paired, aggregated or deduplicated as usual)
+         *
+         * @return A continuation producing the head, new-tail and error code values
+         */
+        static async::continuations::polymorphic_continuation_t<std::uint64_t, std::uint64_t, boost::system::error_code>
+        do_send_unwound_data_chunk(std::shared_ptr<perf_buffer_consumer_t> const & st,
+                                   cpu_ringbuffer_t & ringbuffer,
+                                   int cpu,
+                                   std::pair<lib::Span<char const>, lib::Span<char const>> spans,
+                                   std::uint64_t header_head,
+                                   std::uint64_t new_tail);
+
+        /**
+         * Drop the samples of the processes that are not being profiled from one chunk of the data section, then send
+         * the remaining records (which may be paired, aggregated or deduplicated as usual)
+         *
+         * @return A continuation producing the head, new-tail and error code values
+         */
+        static async::continuations::polymorphic_continuation_t<std::uint64_t, std::uint64_t, boost::system::error_code>
+        do_send_pid_filtered_data_chunk(std::shared_ptr<perf_buffer_consumer_t> const & st,
+                                        cpu_ringbuffer_t & ringbuffer,
+                                        int cpu,
+                                        std::pair<lib::Span<char const>, lib::Span<char const>> spans,
+                                        std::uint64_t header_head,
+                                        std::uint64_t new_tail);
+
+        /**
+         * Aggregate the samples in one chunk of the data section, then send the records that were not aggregated
+         * followed by any windows of aggregates that closed
+         *
+         * @return A continuation producing the head, new-tail and error code values
+         */
+        static async::continuations::polymorphic_continuation_t<std::uint64_t, std::uint64_t, boost::system::error_code>
+        do_send_aggregated_data_chunk(std::shared_ptr<perf_buffer_consumer_t> const & st,
+                                      cpu_ringbuffer_t & ringbuffer,
+                                      int cpu,
+                                      std::pair<lib::Span<char const>, lib::Span<char const>> spans,
+                                      std::uint64_t header_head,
+                                      std::uint64_t new_tail);
+
+        /**
+         * Remove the function probes' samples from one chunk of the data section, then send the remaining records
+         * (which may be deduplicated or aggregated as usual) followed by any windows of latencies that closed
+         *
+         * @return A continuation producing the head, new-tail and error code values
+         */
+        static async::continuations::polymorphic_continuation_t<std::uint64_t, std::uint64_t, boost::system::error_code>
+        do_send_function_latency_filtered_data_chunk(std::shared_ptr<perf_buffer_consumer_t> const & st,
+                                                     cpu_ringbuffer_t & ringbuffer,
+                                                     int cpu,
+                                                     std::pair<lib::Span<char const>, lib::Span<char const>> spans,
+                                                     std::uint64_t header_head,
+                                                     std::uint64_t new_tail);
+
+        /**
+         * Remove the Mali GPU tracepoints' samples from one chunk of the data section, then send the remaining records
+         * (which may be paired, deduplicated or aggregated as usual) followed by any closed windows of GPU activity
+         *
+         * @return A continuation producing the head, new-tail and error code values
+         */
+        static async::continuations::polymorphic_continuation_t<std::uint64_t, std::uint64_t, boost::system::error_code>
+        do_send_gpu_timeline_filtered_data_chunk(std::shared_ptr<perf_buffer_consumer_t> const & st,
+                                                 cpu_ringbuffer_t & ringbuffer,
+                                                 int cpu,
+                                                 std::pair<lib::Span<char const>, lib::Span<char const>> spans,
+                                                 std::uint64_t header_head,
+                                                 std::uint64_t new_tail);
+
+        /**
+         * Remove the block tracepoints' samples from one chunk of the data section, then send the remaining records
+         * (which are processed as usual) followed by the counters of any closed windows of block I/O
+         *
+         * @return A continuation producing the head, new-tail and error code values
+         */
+        static async::continuations::polymorphic_continuation_t<std::uint64_t, std::uint64_t, boost::system::error_code>
+        do_send_block_io_filtered_data_chunk(std::shared_ptr<perf_buffer_consumer_t> const & st,
+                                             cpu_ringbuffer_t & ringbuffer,
+                                             int cpu,
+                                             std::pair<lib::Span<char const>, lib::Span<char const>> spans,
+                                             std::uint64_t header_head,
+                                             std::uint64_t new_tail);
+
+        /**
+         * Remove the futex or lock tracepoints' samples from one chunk of the data section, then send the remaining
+         * records (which are processed as usual) followed by any closed windows of lock wait times
+         *
+         * @return A continuation producing the head, new-tail and error code values
+         */
+        static async::continuations::polymorphic_continuation_t<std::uint64_t, std::uint64_t, boost::system::error_code>
+        do_send_lock_contention_filtered_data_chunk(std::shared_ptr<perf_buffer_consumer_t> const & st,
+                                                    cpu_ringbuffer_t & ringbuffer,
+                                                    int cpu,
+                                                    std::pair<lib::Span<char const>, lib::Span<char const>> spans,
+                                                    std::uint64_t header_head,
+                                                    std::uint64_t new_tail);
+
+        /**
+         * Pass the scheduler and cpu frequency tracepoints' samples in one chunk of the data section to the thread
+         * energy state, removing the cpu frequency samples, then send the remaining records (which are processed as
+         * usual) followed by any closed windows of thread energies
+         *
+         * @return A continuation producing the head, new-tail and error code values
+         */
+        static async::continuations::polymorphic_continuation_t<std::uint64_t, std::uint64_t, boost::system::error_code>
+        do_send_thread_energy_filtered_data_chunk(std::shared_ptr<perf_buffer_consumer_t> const & st,
+                                                  cpu_ringbuffer_t & ringbuffer,
+                                                  int cpu,
+                                                  std::pair<lib::Span<char const>, lib::Span<char const>> spans,
+                                                  std::uint64_t header_head,
+                                                  std::uint64_t new_tail);
+
+        /**
+         * Send one chunk of the data section through whichever of the unwinder, pid filter, converters, pairing,
+         * aggregation and deduplication are enabled, or else send it as it is
+         *
+         * @return A continuation producing the head, new-tail and error code values
+         */
+        static async::continuations::polymorphic_continuation_t<std::uint64_t, std::uint64_t, boost::system::error_code>
+        do_send_processed_data_chunk(std::shared_ptr<perf_buffer_consumer_t> const & st,
+                                     cpu_ringbuffer_t & ringbuffer,
+                                     int cpu,
+                                     std::pair<lib::Span<char const>, lib::Span<char const>> spans,
+                                     std::uint64_t header_head,
+                                     std::uint64_t new_tail);
+
+        /** @return True if do_send_processed_data_chunk copies the records rather than sending them as they are */
+        [[nodiscard]] static bool has_processing_stage(std::shared_ptr<perf_buffer_consumer_t> const & st,
+                                                       cpu_ringbuffer_t const & ringbuffer);
+
+        /**
+         * Encode each of the ringbuffer's closed windows of aggregates into an apc_frame, appending them to `frames`,
+         * so that the windows can be reused while the frames are sent
+         */
+        static void encode_sample_aggregates(std::shared_ptr<perf_buffer_consumer_t> const & st,
+                                             cpu_ringbuffer_t & ringbuffer,
+                                             int cpu,
+                                             std::deque<std::vector<char>> & frames);
+
+        /** As encode_sample_aggregates, but for the ringbuffer's closed windows of function latencies */
+        static void encode_function_latencies(std::shared_ptr<perf_buffer_consumer_t> const & st,
+                                              cpu_ringbuffer_t & ringbuffer,
+                                              int cpu,
+                                              std::deque<std::vector<char>> & frames);
+
+        /** As encode_sample_aggregates, but for the ringbuffer's closed windows of GPU activity */
+        static void encode_gpu_activity(std::shared_ptr<perf_buffer_consumer_t> const & st,
+                                        cpu_ringbuffer_t & ringbuffer,
+                                        int cpu,
+                                        std::deque<std::vector<char>> & frames);
+
+        /** As encode_sample_aggregates, but for the counters of the ringbuffer's closed windows of block I/O */
+        static void encode_block_io_counters(std::shared_ptr<perf_buffer_consumer_t> const & st,
+                                             cpu_ringbuffer_t & ringbuffer,
+                                             std::deque<std::vector<char>> & frames);
+
+        /** As encode_sample_aggregates, but for the ringbuffer's closed windows of lock wait times */
+        static void encode_lock_contention(std::shared_ptr<perf_buffer_consumer_t> const & st,
+                                           cpu_ringbuffer_t & ringbuffer,
+                                           int cpu,
+                                           std::deque<std::vector<char>> & frames);
+
+        /** As encode_sample_aggregates, but for the ringbuffer's closed windows of thread energies */
+        static void encode_thread_energy(std::shared_ptr<perf_buffer_consumer_t> const & st,
+                                         cpu_ringbuffer_t & ringbuffer,
+                                         int cpu,
+                                         std::deque<std::vector<char>> & frames);
+
+        /** As encode_sample_aggregates, but for the ringbuffer's closed windows of the SPE heatmap */
+        static void encode_spe_heatmaps(std::shared_ptr<perf_buffer_consumer_t> const & st,
+                                        cpu_ringbuffer_t & ringbuffer,
+                                        int cpu,
+                                        std::deque<std::vector<char>> & frames);
+
+        /**
+         * Send each of the encoded apc_frames, one after the other
+         *
+         * @return A continuation producing the head, new-tail (as passed in) and error code values
+         */
+        static async::continuations::polymorphic_continuation_t<std::uint64_t, std::uint64_t, boost::system::error_code>
+        do_send_apc_frames(std::shared_ptr<perf_buffer_consumer_t> const & st,
+                           int cpu,
+                           std::shared_ptr<std::deque<std::vector<char>>> frames,
+                           std::uint64_t head,
+                           std::uint64_t tail);
+
+        /**
+         * Read and send the data section.
+         *
+         * The records are sent as-is directly from the mmap (the shell encodes them into the apc_frame), so that the agent does not have
+         * to copy or encode the data (unless the call stacks are unwound or deduplicated or the samples filtered,
+         * aggregated or paired, in which case the rewritten records are sent from a copy). The data_tail is only
+         * advanced once the send completes.
          */
         static async::continuations::polymorphic_continuation_t<boost::system::error_code, bool> do_send_data_section(
             std::shared_ptr<perf_buffer_consumer_t> const & st,
-            std::shared_ptr<perf_ringbuffer_mmap_t> const & mmap,
+            std::shared_ptr<cpu_ringbuffer_t> const & ringbuffer,
             int cpu);
 
+        /**
+         * Send each of the messages taken from the flight recorder, one after the other
+         */
+        [[nodiscard]] static async::continuations::polymorphic_continuation_t<boost::system::error_code>
+        do_flush_flight_recorder(std::shared_ptr<perf_buffer_consumer_t> const & st);
+
         /**
          * Construct the poll operation for one cpu
          *
          * @param st The shared this
-         * @param mmap The mmap being read from
+         * @param ringbuffer The mmap being read from and the strand it is drained on
          * @param cpu The cpu to poll
          */
         [[nodiscard]] static async::continuations::polymorphic_continuation_t<boost::system::error_code> do_poll(
             std::shared_ptr<perf_buffer_consumer_t> const & st,
-            std::shared_ptr<perf_ringbuffer_mmap_t> const & mmap,
+            std::shared_ptr<cpu_ringbuffer_t> const & ringbuffer,
             int cpu);
 
         std::atomic_size_t cumulative_bytes_sent_apc_frames {0};
+        std::atomic_size_t peak_data_fill {0};
+        std::atomic_uint64_t total_lost_records {0};
+        std::atomic_uint64_t total_lost_samples {0};
+        std::atomic_uint64_t total_truncated_aux_records {0};
+        std::atomic_uint64_t one_shot_dropped_bytes {0};
         std::size_t one_shot_mode_limit {0};
-        std::set<int> busy_cpus {};
-        std::set<int> removed_cpus {};
-        std::map<int, std::shared_ptr<perf_ringbuffer_mmap_t>> per_cpu_mmaps {};
+        std::map<core_no_t, SpeRecordFilter> spe_record_filters;
+        std::shared_ptr<flight_recorder_t> flight_recorder;
+        std::shared_ptr<call_stack_dedup_state_t> call_stack_dedup_state;
+        std::shared_ptr<sample_pid_tracker_t> sample_pid_tracker;
+        std::shared_ptr<sample_aggregation_state_t> sample_aggregation_state;
+        std::shared_ptr<function_latency_state_t> function_latency_state;
+        std::shared_ptr<gpu_timeline_state_t> gpu_timeline_state;
+        std::shared_ptr<block_io_state_t> block_io_state;
+        std::shared_ptr<lock_contention_state_t> lock_contention_state;
+        std::shared_ptr<thread_energy_state_t> thread_energy_state;
+        std::shared_ptr<sample_pid_filter_t> sample_pid_filter;
+        std::shared_ptr<user_stack_unwind_state_t> user_stack_unwind_state;
+        // must outlive the strands of the cpus, so is declared before them
+        std::shared_ptr<cpu_drain_threads_t> cpu_drain_threads;
+        std::map<int, std::shared_ptr<cpu_ringbuffer_t>> per_cpu_mmaps {};
         std::shared_ptr<ipc::raw_ipc_channel_sink_t> ipc_sink;
+        std::shared_ptr<ipc::frame_buffer_pool_t> frame_buffer_pool;
         async::continuations::stored_continuation_t<> one_shot_mode_observer {};
         boost::asio::io_context::strand strand;
     };
@@ -7,15 +7,27 @@
 #include "Time.h"
 #include "agents/common/nl_cpu_monitor.h"
 #include "agents/common/polling_cpu_monitor.h"
+#include "agents/perf/block_io_latency.h"
+#include "agents/perf/call_stack_deduplicator.h"
 #include "agents/perf/capture_configuration.h"
+#include "agents/perf/cpu_drain_threads.h"
 #include "agents/perf/cpu_info.h"
 #include "agents/perf/cpufreq_counter.h"
 #include "agents/perf/events/event_binding_manager.hpp"
 #include "agents/perf/events/perf_activator.hpp"
+#include "agents/perf/flight_recorder.h"
+#include "agents/perf/function_latency.h"
+#include "agents/perf/gpu_timeline.h"
+#include "agents/perf/lock_contention.h"
 #include "agents/perf/perf_capture_cpu_monitor.h"
 #include "agents/perf/perf_capture_helper.h"
 #include "agents/perf/perf_driver_summary.h"
+#include "agents/perf/sample_aggregator.h"
+#include "agents/perf/sample_pid_filter.h"
+#include "agents/perf/sample_pid_tracker.h"
 #include "agents/perf/sync_generator.h"
+#include "agents/perf/thread_energy.h"
+#include "agents/perf/user_stack_unwinder.h"
 #include "apc/misc_apc_frame_ipc_sender.h"
 #include "apc/summary_apc_frame_utils.h"
 #include "async/continuations/async_initiate.h"
@@ -23,14 +35,21 @@
 #include "async/continuations/operations.h"
 #include "async/continuations/stored_continuation.h"
 #include "async/continuations/use_continuation.h"
+#include "ipc/frame_buffer_pool.h"
 #include "ipc/messages.h"
 #include "ipc/raw_ipc_channel_sink.h"
 #include "lib/Assert.h"
+#include "lib/Format.h"
+#include "lib/FsEntry.h"
 #include "lib/Utils.h"
 
+#include <chrono>
+#include <exception>
 #include <memory>
 #include <optional>
 #include <set>
+#include <string>
+#include <utility>
 
 #include <boost/asio/error.hpp>
 #include <boost/asio/io_context.hpp>
@@ -79,8 +98,12 @@ namespace agents::perf {
                        std::shared_ptr<perf_capture_configuration_t> conf)
             : strand(context),
               ipc_sink(std::move(sink)),
+              frame_buffer_pool(std::make_shared<ipc::frame_buffer_pool_t>()),
               configuration(std::move(conf)),
               perf_activator(std::make_shared<perf_activator_t>(configuration, context)),
+              sample_pid_tracker(make_sample_pid_tracker(*configuration)),
+              sample_pid_filter(make_sample_pid_filter(*configuration)),
+              block_io_state(make_block_io_state(*configuration)),
               perf_capture_helper(std::make_shared<perf_capture_helper_t>(
                   configuration,
                   context,
@@ -89,9 +112,29 @@ namespace agents::perf {
                   std::make_shared<async_perf_ringbuffer_monitor_t>(
                       context,
                       ipc_sink,
+                      frame_buffer_pool,
                       perf_activator,
                       configuration->session_data.live_rate,
-                      (configuration->session_data.one_shot ? configuration->session_data.total_buffer_size : 0)),
+                      std::chrono::seconds(configuration->session_data.low_wakeup_seconds),
+                      std::chrono::milliseconds(configuration->session_data.stop_drain_timeout_ms),
+                      // the shell ends the capture once the budget shared by all the sources is used, so this is
+                      // only a backstop at the whole budget (in bytes, as is the limit)
+                      (configuration->session_data.one_shot
+                           ? static_cast<std::size_t>(configuration->session_data.total_buffer_size) * 1024 * 1024
+                           : 0),
+                      configuration->per_core_spe_record_filter,
+                      make_flight_recorder(configuration->session_data),
+                      make_call_stack_dedup_state(*configuration),
+                      sample_pid_tracker,
+                      make_sample_aggregation_state(*configuration),
+                      make_function_latency_state(*configuration),
+                      make_gpu_timeline_state(*configuration),
+                      block_io_state,
+                      make_lock_contention_state(*configuration),
+                      make_thread_energy_state(*configuration),
+                      sample_pid_filter,
+                      make_user_stack_unwind_state(*configuration),
+                      make_cpu_drain_threads(configuration->session_data)),
                   perf_capture_events_helper_t(configuration,
                                                event_binding_manager_t(perf_activator,
                                                                        configuration->event_configuration,
@@ -101,11 +144,17 @@ namespace agents::perf {
                                                                        configuration->enable_on_exec),
                                                std::move(configuration->pids)),
                   std::make_shared<cpu_info_t>(configuration),
-                  ipc_sink)),
-              perf_capture_cpu_monitor(std::make_shared<perf_capture_cpu_monitor_t>(context,
-                                                                                    configuration->num_cpu_cores,
-                                                                                    perf_capture_helper))
+                  ipc_sink,
+                  frame_buffer_pool,
+                  sample_pid_tracker)),
+              perf_capture_cpu_monitor(std::make_shared<perf_capture_cpu_monitor_t>(
+                  context,
+                  configuration->num_cpu_cores,
+                  perf_capture_helper,
+                  std::chrono::seconds(configuration->session_data.low_wakeup_seconds)))
         {
+            // the shell carved the queue from its memory budget, along with the ring buffers
+            ipc_sink->set_max_queued_frame_bytes(configuration->ringbuffer_config.ipc_queue_size);
         }
 
         /**
@@ -119,6 +168,8 @@ namespace agents::perf {
 
             return async_initiate(
                 [st = shared_from_this()]() {
+                    log_numa_topology(*st->configuration);
+
                     // spawn a thread to poll for process to start or fork (but not exec the app we are launching)
                     // do not block on the continuation here, as it blocks the message loop
                     spawn("async_prepare",
@@ -151,33 +202,89 @@ namespace agents::perf {
 
             return async_initiate(
                 [st = shared_from_this(), monotonic_start]() {
-                    return start_on(st->strand)
+                    return start_on(st->strand) //
+                         | then([st]() { st->begin_startup_timing(); })
                          // send the summary frame
                          | st->perf_capture_helper->async_send_summary_frame(monotonic_start, use_continuation)
                          // start generating sync events and set misc ready parts for the helper
                          | then([st, monotonic_start]() {
+                               st->end_startup_step("summary");
+                               if (st->block_io_state) {
+                                   st->block_io_state->set_monotonic_start(monotonic_start);
+                               }
                                st->perf_capture_helper->enable_counters();
                                st->perf_capture_helper->observe_one_shot_event();
                                st->start_sync_thread(monotonic_start);
                            })
                          // Start any pid monitoring
                          | st->perf_capture_helper->async_start_pids(use_continuation)
+                         | then([st]() { st->end_startup_step("process tracking"); })
                          // bring online the core monitoring (after setting start_counters, as this enables the buffer monitor and tells the event binding set to activate in a started state)
                          | st->perf_capture_cpu_monitor->async_start_monitoring(monotonic_start, use_continuation)
                          // send any manually read initial counter values
                          | st->perf_capture_helper->async_read_initial_counter_values(monotonic_start, use_continuation)
                          // Spawn a separate async 'threads' to send various system-wide bits of data whilst the rest of the capture process continues
-                         | then([st]() {
+                         | then([st, monotonic_start]() {
+                               st->end_startup_step("cpu monitoring");
+
+                               // rotate any oversubscribed PMU events
+                               if (st->configuration->session_data.pmu_multiplex_quantum_ms > 0) {
+                                   spawn_terminator("pmu multiplexer",
+                                                    st,
+                                                    st->perf_capture_helper->async_rotate_multiplex_groups(
+                                                        monotonic_start,
+                                                        use_continuation));
+                               }
+
+                               // read the counters that are summed over the threads by the kernel, rather than sampled
+                               if (st->perf_capture_helper->has_inherited_counters()) {
+                                   spawn_terminator("inherited counters reader",
+                                                    st,
+                                                    st->perf_capture_helper->async_read_inherited_counters(
+                                                        monotonic_start,
+                                                        use_continuation));
+                               }
+
+                               // evaluate the derived metrics of the cpu PMU events
+                               if (st->perf_capture_helper->has_cpu_metrics()) {
+                                   spawn_terminator("cpu metrics reader",
+                                                    st,
+                                                    st->perf_capture_helper->async_read_cpu_metrics(
+                                                        monotonic_start,
+                                                        use_continuation));
+                               }
+
+                               // periodically disable the ETM trace
+                               if (st->perf_capture_helper->is_strobing_etm()) {
+                                   spawn_terminator("etm strober",
+                                                    st,
+                                                    st->perf_capture_helper->async_strobe_etm(use_continuation));
+                               }
+
                                // the process initial properties
                                spawn_terminator(
                                    "process properies reader",
                                    st,
                                    st->perf_capture_helper->async_read_process_properties(use_continuation));
 
-                               // and the contents of each process 'maps' file
-                               spawn_terminator("process maps reader",
+                               // and the contents of each process 'maps' file, or just of those that are sampled
+                               if (st->perf_capture_helper->is_sending_sampled_process_maps()) {
+                                   spawn_terminator(
+                                       "sampled process maps sender",
+                                       st,
+                                       st->perf_capture_helper->async_send_sampled_process_maps(use_continuation));
+                               }
+                               else {
+                                   spawn_terminator(
+                                       "process maps reader",
+                                       st,
+                                       st->perf_capture_helper->async_read_process_maps(use_continuation));
+                               }
+
+                               // and the symbols of any JIT compiled code
+                               spawn_terminator("jit symbols sender",
                                                 st,
-                                                st->perf_capture_helper->async_read_process_maps(use_continuation));
+                                                st->perf_capture_helper->async_send_jit_symbols(use_continuation));
 
                                // and the contents of kallsyms file
                                spawn_terminator("kallsyms reader",
@@ -194,6 +301,10 @@ namespace agents::perf {
                                                  return {};
                                              }
 
+                                             // the cores are activated concurrently with the process / maps readers
+                                             st->end_startup_step("core activation");
+                                             st->log_startup_timings();
+
                                              // tell shell gator that the capture has started and then  exec the forked process
                                              return st->perf_capture_helper->async_notify_start_capture(
                                                         use_continuation)
@@ -204,6 +315,75 @@ namespace agents::perf {
                 std::forward<CompletionToken>(token));
         }
 
+        /**
+         * Called once the 'msg_flight_recorder_trigger_t' message is received
+         */
+        template<typename CompletionToken>
+        auto async_on_received_flight_recorder_trigger(CompletionToken && token)
+        {
+            using namespace async::continuations;
+
+            return async_initiate(
+                [st = shared_from_this()]() {
+                    if (st->configuration->session_data.flight_recorder_seconds == 0) {
+                        LOG_DEBUG("Ignoring flight recorder trigger as the flight recorder is not enabled");
+                        return start_with();
+                    }
+
+                    LOG_INFO("Sending the last %u seconds of perf data",
+                             st->configuration->session_data.flight_recorder_seconds);
+
+                    // do not block the message loop while the data is sent
+                    spawn("flight recorder flush",
+                          st->perf_capture_helper->async_flush_flight_recorder(use_continuation) //
+                              | map_error(),
+                          [](bool failed, boost::system::error_code const & ec) {
+                              if (failed) {
+                                  LOG_ERROR("Failed to send the flight recorder data (%s)", ec.message().c_str());
+                              }
+                          });
+
+                    return start_with();
+                },
+                std::forward<CompletionToken>(token));
+        }
+
+        /**
+         * Called once the 'msg_capture_reconfiguration_t' message is received
+         */
+        template<typename CompletionToken>
+        auto async_on_received_reconfiguration(ipc::msg_capture_reconfiguration_t msg, CompletionToken && token)
+        {
+            using namespace async::continuations;
+
+            return async_initiate(
+                [st = shared_from_this(), msg = std::move(msg)]() {
+                    perf_capture_reconfiguration_t reconfiguration {};
+                    try {
+                        reconfiguration = parse_capture_reconfiguration_msg(msg, *st->configuration);
+                    }
+                    catch (std::exception const & ex) {
+                        LOG_ERROR("Invalid capture reconfiguration received (%s)", ex.what());
+                        return start_with();
+                    }
+
+                    LOG_DEBUG("Reconfiguring the capture");
+
+                    // do not block the message loop while the events are changed
+                    spawn("capture reconfiguration",
+                          st->perf_capture_helper->async_reconfigure(std::move(reconfiguration), use_continuation) //
+                              | map_error(),
+                          [](bool failed, boost::system::error_code const & ec) {
+                              if (failed) {
+                                  LOG_ERROR("Failed to reconfigure the capture (%s)", ec.message().c_str());
+                              }
+                          });
+
+                    return start_with();
+                },
+                std::forward<CompletionToken>(token));
+        }
+
         /** Called to shutdown the capture */
         template<typename CompletionToken>
         auto async_shutdown(CompletionToken && token)
@@ -233,6 +413,296 @@ namespace agents::perf {
     private:
         using cpu_no_t = int;
 
+        static constexpr std::size_t megabytes = 1024UL * 1024UL;
+        /** The length of each function latency window, when the samples are not aggregated */
+        static constexpr std::uint64_t default_function_latency_window_ms = 1000;
+        /** The length of each window of GPU activity, when the samples are not aggregated */
+        static constexpr std::uint64_t default_gpu_timeline_window_ms = 1000;
+        /** The length of each window of block I/O counters, when the samples are not aggregated */
+        static constexpr std::uint64_t default_block_io_window_ms = 100;
+        /** The length of each window of lock wait times, when the samples are not aggregated */
+        static constexpr std::uint64_t default_lock_contention_window_ms = 1000;
+        /** The length of each window of thread energies, when the samples are not aggregated */
+        static constexpr std::uint64_t default_thread_energy_window_ms = 1000;
+
+        /** @return The threads to drain each cpu's ring buffer on, or nullptr to drain them on the agent's threads */
+        static std::shared_ptr<cpu_drain_threads_t> make_cpu_drain_threads(
+            perf_capture_configuration_t::session_data_t const & session_data)
+        {
+            if (!session_data.cpu_local_drain) {
+                return {};
+            }
+
+            return std::make_shared<cpu_drain_threads_t>();
+        }
+
+        /** @return The flight recorder to hold the perf data in, or nullptr if the data is sent as it is read */
+        static std::shared_ptr<flight_recorder_t> make_flight_recorder(
+            perf_capture_configuration_t::session_data_t const & session_data)
+        {
+            if (session_data.flight_recorder_seconds == 0) {
+                return {};
+            }
+
+            return std::make_shared<flight_recorder_t>(std::chrono::seconds(session_data.flight_recorder_seconds),
+                                                       std::size_t(session_data.flight_recorder_size) * megabytes);
+        }
+
+        /** @return The state for deduplicating the call stacks, or nullptr if they are sent as they are */
+        static std::shared_ptr<call_stack_dedup_state_t> make_call_stack_dedup_state(
+            perf_capture_configuration_t const & configuration)
+        {
+            if (!configuration.session_data.dedup_call_stacks) {
+                return {};
+            }
+
+            // the sample's id must be at a fixed position to find its callchain
+            if (!configuration.perf_config.has_sample_identifier) {
+                LOG_DEBUG("Call stacks are not deduplicated as PERF_SAMPLE_IDENTIFIER is not supported");
+                return {};
+            }
+
+            // the flight recorder may discard the stacks that later samples refer to
+            if (configuration.session_data.flight_recorder_seconds != 0) {
+                LOG_DEBUG("Call stacks are not deduplicated as the flight recorder is enabled");
+                return {};
+            }
+
+            // the aggregated samples hold each distinct stack once per window anyway
+            if (configuration.session_data.aggregate_samples_ms != 0) {
+                LOG_DEBUG("Call stacks are not deduplicated as the samples are aggregated");
+                return {};
+            }
+
+            return std::make_shared<call_stack_dedup_state_t>(configuration.event_configuration);
+        }
+
+        /** @return The state for unwinding the copies of the user stack, or nullptr if no event copies it */
+        static std::shared_ptr<user_stack_unwind_state_t> make_user_stack_unwind_state(
+            perf_capture_configuration_t const & configuration)
+        {
+            auto state = std::make_shared<user_stack_unwind_state_t>(configuration.event_configuration);
+            if (state->empty()) {
+                return {};
+            }
+            return state;
+        }
+
+        /** @return The state for aggregating the samples, or nullptr if each sample is sent */
+        static std::shared_ptr<sample_aggregation_state_t> make_sample_aggregation_state(
+            perf_capture_configuration_t const & configuration)
+        {
+            if (configuration.session_data.aggregate_samples_ms == 0) {
+                return {};
+            }
+
+            // the sample's id must be at a fixed position to find the fields it is aggregated by
+            if (!configuration.perf_config.has_sample_identifier) {
+                LOG_DEBUG("Samples are not aggregated as PERF_SAMPLE_IDENTIFIER is not supported");
+                return {};
+            }
+
+            return std::make_shared<sample_aggregation_state_t>(
+                configuration.event_configuration,
+                std::chrono::milliseconds(configuration.session_data.aggregate_samples_ms));
+        }
+
+        /** @return The state for measuring the latency of the probed functions, or nullptr if there are none */
+        static std::shared_ptr<function_latency_state_t> make_function_latency_state(
+            perf_capture_configuration_t const & configuration)
+        {
+            if (configuration.function_probes.empty()) {
+                return {};
+            }
+
+            // the probe's id must be at a fixed position to pair its entry and return samples
+            if (!configuration.perf_config.has_sample_identifier) {
+                LOG_WARNING("Function latencies are not measured as PERF_SAMPLE_IDENTIFIER is not supported");
+                return {};
+            }
+
+            auto const window_ms = (configuration.session_data.aggregate_samples_ms != 0
+                                        ? configuration.session_data.aggregate_samples_ms
+                                        : default_function_latency_window_ms);
+
+            return std::make_shared<function_latency_state_t>(configuration.event_configuration,
+                                                              configuration.function_probes,
+                                                              std::chrono::milliseconds(window_ms));
+        }
+
+        /** @return The state for converting the Mali GPU tracepoints into GPU activity, or nullptr if there are none */
+        static std::shared_ptr<gpu_timeline_state_t> make_gpu_timeline_state(
+            perf_capture_configuration_t const & configuration)
+        {
+            if (!configuration.gpu_timeline.is_enabled()) {
+                return {};
+            }
+
+            // the tracepoint's id must be at a fixed position to find its samples, which are otherwise sent as they are
+            if (!configuration.perf_config.has_sample_identifier) {
+                LOG_WARNING("The GPU activity is not converted as PERF_SAMPLE_IDENTIFIER is not supported");
+                return {};
+            }
+
+            auto const window_ms = (configuration.session_data.aggregate_samples_ms != 0
+                                        ? configuration.session_data.aggregate_samples_ms
+                                        : default_gpu_timeline_window_ms);
+
+            return std::make_shared<gpu_timeline_state_t>(configuration.event_configuration,
+                                                          configuration.gpu_timeline,
+                                                          std::chrono::milliseconds(window_ms));
+        }
+
+        /** @return The state for pairing the block tracepoints into block I/O counters, or nullptr if there are none */
+        static std::shared_ptr<block_io_state_t> make_block_io_state(perf_capture_configuration_t const & configuration)
+        {
+            if (!configuration.block_io.is_enabled()) {
+                return {};
+            }
+
+            // the tracepoint's id must be at a fixed position to find its samples, and the sample times must be in the
+            // same clock as the capture for the counters to be placed
+            auto const & perf_config = configuration.perf_config;
+            if (!perf_config.has_sample_identifier || !perf_config.has_attr_clockid_support) {
+                LOG_WARNING("The block I/O counters are not available as PERF_SAMPLE_IDENTIFIER or the perf clock id "
+                            "is not supported");
+                return {};
+            }
+
+            auto const window_ms = (configuration.session_data.aggregate_samples_ms != 0
+                                        ? configuration.session_data.aggregate_samples_ms
+                                        : default_block_io_window_ms);
+
+            return std::make_shared<block_io_state_t>(configuration.event_configuration,
+                                                      configuration.block_io,
+                                                      std::chrono::milliseconds(window_ms));
+        }
+
+        /** @return The state for pairing the futex or lock tracepoints into lock wait times, or nullptr if none are */
+        static std::shared_ptr<lock_contention_state_t> make_lock_contention_state(
+            perf_capture_configuration_t const & configuration)
+        {
+            if (!configuration.lock_contention.is_enabled()) {
+                return {};
+            }
+
+            // the tracepoint's id must be at a fixed position to pair its samples, which are otherwise sent as they are
+            if (!configuration.perf_config.has_sample_identifier) {
+                LOG_WARNING("Lock contention is not measured as PERF_SAMPLE_IDENTIFIER is not supported");
+                return {};
+            }
+
+            auto const window_ms = (configuration.session_data.aggregate_samples_ms != 0
+                                        ? configuration.session_data.aggregate_samples_ms
+                                        : default_lock_contention_window_ms);
+
+            return std::make_shared<lock_contention_state_t>(configuration.event_configuration,
+                                                             configuration.lock_contention,
+                                                             std::chrono::milliseconds(window_ms));
+        }
+
+        /** @return The state for combining the scheduler and frequency tracepoints into thread energies, or nullptr */
+        static std::shared_ptr<thread_energy_state_t> make_thread_energy_state(
+            perf_capture_configuration_t const & configuration)
+        {
+            if (!configuration.thread_energy.is_enabled()) {
+                return {};
+            }
+
+            // the tracepoint's id must be at a fixed position to find its samples, which are otherwise sent as they are
+            if (!configuration.perf_config.has_sample_identifier) {
+                LOG_WARNING("Thread energy is not measured as PERF_SAMPLE_IDENTIFIER is not supported");
+                return {};
+            }
+
+            auto const window_ms = (configuration.session_data.aggregate_samples_ms != 0
+                                        ? configuration.session_data.aggregate_samples_ms
+                                        : default_thread_energy_window_ms);
+
+            return std::make_shared<thread_energy_state_t>(configuration.event_configuration,
+                                                           configuration.thread_energy,
+                                                           std::chrono::milliseconds(window_ms));
+        }
+
+        /** @return The tracker of the sampled pids, or nullptr if the maps of all processes are sent at the start */
+        static std::shared_ptr<sample_pid_tracker_t> make_sample_pid_tracker(
+            perf_capture_configuration_t const & configuration)
+        {
+            // app captures only send the maps of the (few) monitored processes anyway
+            if ((!configuration.session_data.lazy_process_maps) || (!configuration.perf_config.is_system_wide)) {
+                return {};
+            }
+
+            // the sample's id must be at a fixed position to find its pid
+            if (!configuration.perf_config.has_sample_identifier) {
+                LOG_DEBUG("All process maps are sent as PERF_SAMPLE_IDENTIFIER is not supported");
+                return {};
+            }
+
+            return std::make_shared<sample_pid_tracker_t>(configuration.event_configuration);
+        }
+
+        /** @return The filter of the samples of the processes not being profiled, or nullptr if all are sent */
+        static std::shared_ptr<sample_pid_filter_t> make_sample_pid_filter(
+            perf_capture_configuration_t const & configuration)
+        {
+            if (!configuration.session_data.filter_pid_samples) {
+                return {};
+            }
+
+            // only the other processes' samples of a system-wide capture of some --pid processes need to be dropped
+            if ((!configuration.perf_config.is_system_wide) || configuration.pids.empty()) {
+                LOG_DEBUG("Samples are not filtered by pid as this is not a system-wide capture with --pid");
+                return {};
+            }
+
+            // the sample's id must be at a fixed position to find its pid
+            if (!configuration.perf_config.has_sample_identifier) {
+                LOG_WARNING("Samples are not filtered by pid as PERF_SAMPLE_IDENTIFIER is not supported");
+                return {};
+            }
+
+            return std::make_shared<sample_pid_filter_t>(configuration.event_configuration, configuration.pids);
+        }
+
+        /**
+         * Log the cores and the size of the perf ring buffers on each NUMA node (the kernel allocates each core's ring
+         * buffer on that core's node), so that any imbalance between the nodes can be seen.
+         */
+        static void log_numa_topology(perf_capture_configuration_t const & configuration)
+        {
+            auto const nodes = lib::readCpuMaskFromFile("/sys/devices/system/node/online");
+            if (nodes.size() < 2) {
+                return;
+            }
+
+            auto const & ringbuffer_config = configuration.ringbuffer_config;
+
+            for (int node : nodes) {
+                std::string const cpulist_path = lib::Format() << "/sys/devices/system/node/node" << node << "/cpulist";
+
+                std::size_t num_cores = 0;
+                std::size_t buffer_size = 0;
+                for (int cpu : lib::readCpuMaskFromFile(cpulist_path.c_str())) {
+                    if ((cpu < 0) || (std::uint32_t(cpu) >= configuration.num_cpu_cores)) {
+                        continue;
+                    }
+
+                    num_cores += 1;
+                    buffer_size += ringbuffer_config.page_size + ringbuffer_config.data_buffer_size;
+                    if (configuration.per_core_spe_type.count(core_no_t(cpu)) > 0) {
+                        buffer_size += ringbuffer_config.aux_buffer_size;
+                    }
+                }
+
+                LOG_INFO("NUMA node %d has %zu cores (%s) with %zu KiB of perf ring buffers",
+                         node,
+                         num_cores,
+                         lib::FsEntry::create(cpulist_path).readFileContentsSingleLine().c_str(),
+                         buffer_size / 1024);
+            }
+        }
+
         template<typename StateChain, typename... Args>
         static void spawn_terminator(char const * name,
                                      std::shared_ptr<perf_capture_t> const & shared_this,
@@ -245,20 +715,58 @@ namespace agents::perf {
             });
         }
 
+        using startup_clock_t = std::chrono::steady_clock;
+
         boost::asio::io_context::strand strand;
         std::shared_ptr<ipc::raw_ipc_channel_sink_t> ipc_sink;
+        std::shared_ptr<ipc::frame_buffer_pool_t> frame_buffer_pool;
         std::shared_ptr<perf_capture_configuration_t> configuration;
         std::shared_ptr<cpu_info_t> cpu_info {};
         std::shared_ptr<perf_activator_t> perf_activator {};
+        std::shared_ptr<sample_pid_tracker_t> sample_pid_tracker {};
+        std::shared_ptr<sample_pid_filter_t> sample_pid_filter {};
+        std::shared_ptr<block_io_state_t> block_io_state {};
         std::shared_ptr<perf_capture_helper_t> perf_capture_helper {};
         std::unique_ptr<sync_generator> sync_thread {};
         std::shared_ptr<perf_capture_cpu_monitor_t> perf_capture_cpu_monitor {};
+        startup_clock_t::time_point startup_begin {};
+        startup_clock_t::time_point startup_step_begin {};
+        std::string startup_timings {};
 
         /** @return True if the capture is terminated, false if not */
         [[nodiscard]] bool is_terminated() const { return perf_capture_cpu_monitor->is_terminated(); }
 
+        /** Start timing the steps of the capture start up */
+        void begin_startup_timing()
+        {
+            startup_begin = startup_step_begin = startup_clock_t::now();
+            startup_timings.clear();
+        }
+
+        /** Record how long the named start up step took */
+        void end_startup_step(char const * name)
+        {
+            auto const now = startup_clock_t::now();
+            auto const step_ms = std::chrono::duration_cast<std::chrono::milliseconds>(now - startup_step_begin);
+
+            if (!startup_timings.empty()) {
+                startup_timings += ", ";
+            }
+            startup_timings += std::string(name) + " " + std::to_string(step_ms.count()) + "ms";
+            startup_step_begin = now;
+        }
+
+        /** Log the total start up time, broken down by step */
+        void log_startup_timings() const
+        {
+            auto const total_ms =
+                std::chrono::duration_cast<std::chrono::milliseconds>(startup_step_begin - startup_begin);
+
+            LOG_INFO("Capture start up took %lldms (%s)", static_cast<long long>(total_ms.count()), startup_timings.c_str());
+        }
+
         /**
-         * Launch the SPE sync thread
+         * Launch the SPE (and ETM) sync thread
          *
          * @param monotonic_start The capture start timestamp (in CLOCK_MONOTONIC_RAW)
          */
@@ -268,8 +776,11 @@ namespace agents::perf {
                 runtime_assert(sync_thread == nullptr, "start_sync_thread called twice");
 
                 sync_thread = sync_generator::create(configuration->perf_config.has_attr_clockid_support,
-                                                     perf_capture_helper->has_spe(),
-                                                     ipc_sink);
+                                                     perf_capture_helper->has_spe() || perf_capture_helper->has_etm(),
+                                                     ipc_sink,
+                                                     frame_buffer_pool,
+                                                     std::chrono::seconds(
+                                                         configuration->session_data.low_wakeup_seconds));
 
                 if (sync_thread != nullptr) {
                     sync_thread->start(monotonic_start);
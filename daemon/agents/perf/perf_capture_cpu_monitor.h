@@ -13,7 +13,10 @@
 #include "async/continuations/stored_continuation.h"
 #include "async/continuations/use_continuation.h"
 
+#include <chrono>
+#include <map>
 #include <memory>
+#include <optional>
 #include <set>
 
 #include <boost/asio/io_context.hpp>
@@ -40,8 +43,12 @@ namespace agents::perf {
         std::shared_ptr<nl_kobject_uevent_cpu_monitor_t> nl_kobject_uevent_cpu_monitor {};
         std::shared_ptr<polling_cpu_monitor_t> polling_cpu_monitor {};
         std::set<int> cores_having_received_initial_event {};
+        /** The cores that have a state change in progress, along with any change to make once that completes */
+        std::map<int, std::optional<bool>> cores_changing_state {};
         all_cores_ready_handler_t all_cores_ready_handler {};
         std::size_t num_cpu_cores;
+        /** If the cpus must be polled (rather than notified by netlink), poll them at most this often */
+        std::chrono::microseconds min_polling_interval {0};
         bool terminated {false};
         bool notified_all_cores_ready_handler {false};
 
@@ -188,15 +195,9 @@ namespace agents::perf {
                       [st, coalescing_cpu_monitor, monotonic_start]() mutable {
                           return coalescing_cpu_monitor->async_receive_one(use_continuation) //
                                | map_error()                                                 //
+                               | post_on(st->strand)                                         //
                                | then([st, monotonic_start](auto event) mutable {
-                                     return st->async_update_cpu_state(monotonic_start,
-                                                                       event.cpu_no,
-                                                                       event.online,
-                                                                       use_continuation) //
-                                          | post_on(st->strand)                          //
-                                          | then([st, cpu_no = event.cpu_no]() {
-                                                st->check_cores_having_received_initial_event(cpu_no);
-                                            });
+                                     st->on_strand_update_cpu_state(monotonic_start, event.cpu_no, event.online);
                                  });
                       }),
                   [st](bool) {
@@ -205,6 +206,79 @@ namespace agents::perf {
                   });
         }
 
+        /**
+         * Start handling a state change event from the coalescing monitor.
+         *
+         * Each core is onlined / offlined independently of the others so that, particularly at start up, the cores
+         * are activated concurrently rather than one after another. The changes for any one core are still made in
+         * order; any change that is received whilst a previous one is in progress is deferred until it completes.
+         *
+         * @param monotonic_start The capture start timestamp (in CLOCK_MONOTONIC_RAW)
+         * @param cpu_no The core for which to enable events
+         * @param online True if the core was online, false if it was offline
+         */
+        void on_strand_update_cpu_state(std::uint64_t monotonic_start, int cpu_no, bool online)
+        {
+            if ((cpu_no < 0) || terminated) {
+                return;
+            }
+
+            auto [it, inserted] = cores_changing_state.try_emplace(cpu_no);
+
+            if (!inserted) {
+                // the events alternate between online and offline, so a deferred change is cancelled by the next one
+                if (it->second) {
+                    it->second.reset();
+                }
+                else {
+                    it->second = online;
+                }
+                return;
+            }
+
+            spawn_update_cpu_state(monotonic_start, cpu_no, online);
+        }
+
+        /**
+         * Spawn the task that onlines / offlines a single core, and then makes any deferred change for that core
+         *
+         * @param monotonic_start The capture start timestamp (in CLOCK_MONOTONIC_RAW)
+         * @param cpu_no The core for which to enable events
+         * @param online True if the core was online, false if it was offline
+         */
+        void spawn_update_cpu_state(std::uint64_t monotonic_start, int cpu_no, bool online)
+        {
+            using namespace async::continuations;
+
+            auto st = this->shared_from_this();
+
+            spawn("cpu state change",
+                  async_update_cpu_state(monotonic_start, cpu_no, online, use_continuation) //
+                      | post_on(strand)                                                     //
+                      | then([st, monotonic_start, cpu_no]() {
+                            st->check_cores_having_received_initial_event(cpu_no);
+
+                            auto it = st->cores_changing_state.find(cpu_no);
+                            if (it == st->cores_changing_state.end()) {
+                                return;
+                            }
+
+                            auto deferred = it->second;
+                            if ((!deferred) || st->terminated) {
+                                st->cores_changing_state.erase(it);
+                                return;
+                            }
+
+                            it->second.reset();
+                            st->spawn_update_cpu_state(monotonic_start, cpu_no, *deferred);
+                        }),
+                  [st](bool failed) {
+                      if (failed) {
+                          st->terminate();
+                      }
+                  });
+        }
+
         /**
          * Check / notify the handler when all cores have received on event
          *
@@ -263,6 +337,7 @@ namespace agents::perf {
             // create it on demand if necessary
             if (monitor == nullptr) {
                 polling_cpu_monitor = monitor = std::make_shared<polling_cpu_monitor_t>(strand.context());
+                monitor->set_min_poll_interval(min_polling_interval);
             }
 
             start_monitoring_cpus(monotonic_start, this->shared_from_this(), std::move(monitor));
@@ -271,13 +346,15 @@ namespace agents::perf {
     public:
         basic_perf_capture_cpu_monitor_t(boost::asio::io_context & context,
                                          std::size_t num_cpu_cores,
-                                         std::shared_ptr<perf_capture_helper_t> perf_capture_helper)
+                                         std::shared_ptr<perf_capture_helper_t> perf_capture_helper,
+                                         std::chrono::microseconds min_polling_interval)
             : strand(context),
               perf_capture_helper(std::move(perf_capture_helper)),
               coalescing_cpu_monitor(std::make_shared<coalescing_cpu_monitor_t>(context)),
               nl_kobject_uevent_cpu_monitor(std::make_shared<nl_kobject_uevent_cpu_monitor_t>(context)),
               polling_cpu_monitor(),
-              num_cpu_cores(num_cpu_cores)
+              num_cpu_cores(num_cpu_cores),
+              min_polling_interval(min_polling_interval)
         {
         }
 
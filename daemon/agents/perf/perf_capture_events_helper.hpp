@@ -5,9 +5,13 @@
 #include "agents/perf/events/event_binding_manager.hpp"
 #include "agents/perf/events/perf_activator.hpp"
 #include "agents/perf/events/types.hpp"
+#include "apc/perf_counter.h"
+#include "lib/EnumUtils.h"
 #include "lib/error_code_or.hpp"
 #include "linux/proc/ProcessChildren.h"
 
+#include <cstdint>
+#include <map>
 #include <memory>
 #include <optional>
 #include <set>
@@ -441,11 +445,86 @@ namespace agents::perf {
          */
         void core_offline(core_no_t core_no) { event_binding_manager.core_offline(core_no); }
 
+        /**
+         * Rotate the multiplexed CPU PMU event groups onto the PMU
+         *
+         * @return The activity counter value for each rotated group; 1 for those now counting, 0 for the rest
+         */
+        [[nodiscard]] std::vector<apc::perf_counter_t> rotate_multiplex_groups()
+        {
+            std::vector<apc::perf_counter_t> result {};
+
+            event_binding_manager.rotate_multiplex_groups([&result](core_no_t no, gator_key_t key, bool active) {
+                result.push_back(apc::perf_counter_t {lib::toEnumValue(no), lib::toEnumValue(key), (active ? 1 : 0)});
+            });
+
+            return result;
+        }
+
+        /**
+         * Remove and add the perf events of the running capture, on the online cores
+         *
+         * @param reconfiguration The events to remove and add
+         * @return The id->key mappings of the added events, which must be sent before `reconfigure_start` is called
+         */
+        [[nodiscard]] id_to_key_mappings_t reconfigure_prepare(perf_capture_reconfiguration_t const & reconfiguration)
+        {
+            return event_binding_manager.reconfigure_prepare(reconfiguration);
+        }
+
+        /** Enable the events that were added by `reconfigure_prepare` */
+        void reconfigure_start() { event_binding_manager.reconfigure_start(); }
+
+        /** @return True if there are inherited counters, whose values must be read periodically */
+        [[nodiscard]] bool has_inherited_counters() const { return event_binding_manager.has_inherited_counters(); }
+
+        /**
+         * Read the inherited counters, which the kernel sums over the monitored threads (including those that exited)
+         *
+         * @return The increase in each counter on each core since it was last read
+         */
+        [[nodiscard]] std::vector<apc::perf_counter_t> read_inherited_counters()
+        {
+            std::map<std::pair<core_no_t, gator_key_t>, std::int64_t> deltas {};
+            std::map<perf_event_id_t, std::uint64_t> counts {};
+
+            event_binding_manager.read_inherited_counters(
+                [&](core_no_t no, gator_key_t key, perf_event_id_t id, std::uint64_t count) {
+                    // the events of a newly tracked process or online core count from zero
+                    auto const it = last_inherited_counts.find(id);
+                    auto const last = (it != last_inherited_counts.end() ? it->second : 0);
+                    deltas[{no, key}] += static_cast<std::int64_t>(count >= last ? count - last : count);
+                    counts[id] = count;
+                });
+
+            // drops the events that were closed
+            last_inherited_counts = std::move(counts);
+
+            std::vector<apc::perf_counter_t> result {};
+            for (auto const & entry : deltas) {
+                result.push_back(apc::perf_counter_t {lib::toEnumValue(entry.first.first),
+                                                      lib::toEnumValue(entry.first.second),
+                                                      entry.second});
+            }
+            return result;
+        }
+
+        /** @return True if there are CoreSight ETM events */
+        [[nodiscard]] bool has_etm() const { return event_binding_manager.has_etm(); }
+
+        /** Enable or disable the CoreSight ETM events, so that the trace is strobed */
+        void set_etm_enabled(bool enable) { event_binding_manager.set_etm_enabled(enable); }
+
+        /** Disable all the events, so that the ring buffers can be drained at the end of the capture */
+        void stop_all_events() { event_binding_manager.stop_all(); }
+
     private:
         event_binding_manager_t event_binding_manager;
         std::set<pid_t> monitored_pids;
         std::set<pid_t> monitored_gatord_tids {};
         std::map<pid_t, lnx::sig_continuer_t> all_stopped_tids {};
+        /** The value of each inherited counter when it was last read, by id */
+        std::map<perf_event_id_t, std::uint64_t> last_inherited_counts {};
         bool const is_system_wide;
         bool const stop_on_exit;
         bool const profile_gator;
@@ -5,13 +5,16 @@
 #include "Time.h"
 #include "agents/agent_environment.h"
 #include "agents/perf/async_perf_ringbuffer_monitor.hpp"
+#include "agents/perf/cpu_metrics.h"
 #include "agents/perf/cpufreq_counter.h"
 #include "agents/perf/events/event_binding_manager.hpp"
 #include "agents/perf/events/event_bindings.hpp"
 #include "agents/perf/events/perf_activator.hpp"
 #include "agents/perf/events/types.hpp"
+#include "agents/perf/jit_symbol_watcher.h"
 #include "agents/perf/perf_buffer_consumer.h"
 #include "agents/perf/perf_capture_events_helper.hpp"
+#include "agents/perf/sample_pid_tracker.h"
 #include "apc/misc_apc_frame_ipc_sender.h"
 #include "async/continuations/async_initiate.h"
 #include "async/continuations/continuation.h"
@@ -23,14 +26,20 @@
 #include "async/proc/async_read_proc_sys_dependencies.h"
 #include "async/proc/async_wait_for_process.h"
 #include "async/proc/process_monitor.hpp"
+#include "ipc/frame_buffer_pool.h"
 #include "ipc/messages.h"
 #include "ipc/raw_ipc_channel_sink.h"
+#include "lib/Format.h"
 #include "lib/FsEntry.h"
 #include "lib/error_code_or.hpp"
 #include "lib/forked_process.h"
 #include "linux/proc/ProcessChildren.h"
 
+#include <algorithm>
+#include <chrono>
 #include <memory>
+#include <string_view>
+#include <vector>
 
 #include <boost/asio.hpp>
 #include <boost/asio/buffer.hpp>
@@ -38,6 +47,7 @@
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/posix/stream_descriptor.hpp>
 #include <boost/asio/read_until.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <boost/system/error_code.hpp>
 
 namespace agents::perf {
@@ -67,25 +77,60 @@ namespace agents::perf {
                               std::shared_ptr<async_perf_ringbuffer_monitor_t> aprm,
                               perf_capture_events_helper_t && pceh,
                               std::shared_ptr<ICpuInfo> cpu_info,
-                              std::shared_ptr<ipc::raw_ipc_channel_sink_t> ipc_sink)
+                              std::shared_ptr<ipc::raw_ipc_channel_sink_t> ipc_sink,
+                              std::shared_ptr<ipc::frame_buffer_pool_t> frame_buffer_pool,
+                              std::shared_ptr<sample_pid_tracker_t> sample_pid_tracker = {})
             : configuration(std::move(conf)),
               strand(context),
+              multiplex_timer(context),
+              inherited_counters_timer(context),
+              cpu_metrics_timer(context),
+              etm_strobe_timer(context),
+              sampled_process_maps_timer(context),
+              jit_symbols_timer(context),
               process_monitor(process_monitor),
               terminator(std::move(terminator)),
               cpu_info(std::move(cpu_info)),
               ipc_sink(std::move(ipc_sink)),
-              misc_apc_frame_ipc_sender(std::make_shared<apc::misc_apc_frame_ipc_sender_t>(this->ipc_sink)),
+              misc_apc_frame_ipc_sender(std::make_shared<apc::misc_apc_frame_ipc_sender_t>(this->ipc_sink,
+                                                                                         std::move(frame_buffer_pool))),
               async_perf_ringbuffer_monitor(std::move(aprm)),
-              perf_capture_events_helper(std::move(pceh))
+              perf_capture_events_helper(std::move(pceh)),
+              sample_pid_tracker(std::move(sample_pid_tracker)),
+              jit_symbol_watcher(std::make_shared<jit_symbol_watcher_t>()),
+              cpu_metrics(*configuration)
         {
+            // jitdump files are found from the maps of the processes that write them
+            misc_apc_frame_ipc_sender->set_maps_observer(
+                [w = jit_symbol_watcher](std::string_view maps) { w->add_process_maps(maps); });
         }
 
+        /** @return True if the process maps are sent only for the processes that appear in the samples */
+        [[nodiscard]] bool is_sending_sampled_process_maps() const { return sample_pid_tracker != nullptr; }
+
         /** @return True if the captured events are enable-on-exec, rather than started manually */
         [[nodiscard]] bool is_enable_on_exec() const { return perf_capture_events_helper.is_enable_on_exec(); }
 
+        /** @return True if some counters are inherited counters, whose values must be read periodically */
+        [[nodiscard]] bool has_inherited_counters() const
+        {
+            return perf_capture_events_helper.has_inherited_counters();
+        }
+
+        /** @return True if there are derived metrics of the cpu PMU events, which must be evaluated periodically */
+        [[nodiscard]] bool has_cpu_metrics() const { return !cpu_metrics.empty(); }
+
         /** @return True if configured counter groups include the SPE group */
         [[nodiscard]] bool has_spe() const { return perf_capture_events_helper.has_spe(); }
 
+        [[nodiscard]] bool has_etm() const { return perf_capture_events_helper.has_etm(); }
+
+        /** @return True if the CoreSight ETM trace is captured, and must be periodically disabled to strobe it */
+        [[nodiscard]] bool is_strobing_etm() const
+        {
+            return (configuration->session_data.etm_strobe_window_us > 0) && has_etm();
+        }
+
         /** @return True if terminate was requested */
         [[nodiscard]] bool is_terminate_requested() const
         {
@@ -115,6 +160,13 @@ namespace agents::perf {
                   });
         }
 
+        /** Send the data held by the flight recorder (if there is one) */
+        template<typename CompletionToken>
+        auto async_flush_flight_recorder(CompletionToken && token)
+        {
+            return async_perf_ringbuffer_monitor->async_flush_flight_recorder(std::forward<CompletionToken>(token));
+        }
+
         /** Mark capture as started */
         template<typename CompletionToken>
         auto async_notify_start_capture(CompletionToken && token)
@@ -167,6 +219,9 @@ namespace agents::perf {
                                    return {};
                                }
 
+                               // the events are not enabled yet, so their first samples can be deduplicated
+                               st->async_perf_ringbuffer_monitor->add_event_ids(result->id_to_key_mappings);
+
                                // and send all the mappings (asynchronously)
                                spawn("process key->id mapping task",
                                      st->misc_apc_frame_ipc_sender->async_send_keys_frame(result->id_to_key_mappings,
@@ -338,6 +393,109 @@ namespace agents::perf {
                 std::forward<CompletionToken>(token));
         }
 
+        /**
+         * Periodically write the `maps` file contents into the capture for each process that first appeared in the
+         * samples since the last time, until the capture terminates
+         *
+         * @param token The completion token for the async operation
+         */
+        template<typename CompletionToken>
+        [[nodiscard]] auto async_send_sampled_process_maps(CompletionToken && token)
+        {
+            using namespace async::continuations;
+
+            return async_initiate(
+                [st = this->shared_from_this()]() {
+                    return repeatedly(
+                        [st]() {
+                            return start_on(st->strand) //
+                                 | then([st]() { return !st->is_terminate_requested(); });
+                        },
+                        [st]() {
+                            return start_on(st->strand) //
+                                 | then([st]() {
+                                       st->sampled_process_maps_timer.expires_from_now(sampled_process_maps_interval);
+                                   })
+                                 | st->sampled_process_maps_timer.async_wait(use_continuation) //
+                                 | post_on(st->strand)                                         //
+                                 | then([st](boost::system::error_code const & ec) -> polymorphic_continuation_t<> {
+                                       // cancelled by terminate
+                                       if ((ec == boost::asio::error::operation_aborted)
+                                           || st->is_terminate_requested()) {
+                                           return {};
+                                       }
+
+                                       if (ec) {
+                                           return start_with(ec) | map_error();
+                                       }
+
+                                       auto pids = std::make_shared<std::vector<pid_t>>(
+                                           st->sample_pid_tracker->take_new_pids());
+
+                                       return iterate(std::size_t {0}, pids->size(), [st, pids](auto index) {
+                                           return st->async_send_process_maps((*pids)[index], use_continuation);
+                                       });
+                                   });
+                        });
+                },
+                std::forward<CompletionToken>(token));
+        }
+
+        /**
+         * Periodically write the symbols that JIT compilers have added to the perf map and jitdump files of the
+         * monitored processes into the capture, until the capture terminates
+         *
+         * @param token The completion token for the async operation
+         */
+        template<typename CompletionToken>
+        [[nodiscard]] auto async_send_jit_symbols(CompletionToken && token)
+        {
+            using namespace async::continuations;
+
+            return async_initiate(
+                [st = this->shared_from_this()]() {
+                    return repeatedly(
+                        [st]() {
+                            return start_on(st->strand) //
+                                 | then([st]() { return !st->is_terminate_requested(); });
+                        },
+                        [st]() {
+                            return start_on(st->strand) //
+                                 | then([st]() { st->jit_symbols_timer.expires_from_now(jit_symbols_interval); })
+                                 | st->jit_symbols_timer.async_wait(use_continuation) //
+                                 | post_on(st->strand)                                //
+                                 | then([st](boost::system::error_code const & ec) -> polymorphic_continuation_t<> {
+                                       // cancelled by terminate
+                                       if ((ec == boost::asio::error::operation_aborted)
+                                           || st->is_terminate_requested()) {
+                                           return {};
+                                       }
+
+                                       if (ec) {
+                                           return start_with(ec) | map_error();
+                                       }
+
+                                       auto new_symbols = st->jit_symbol_watcher->poll(
+                                           [sw = st->configuration->perf_config.is_system_wide,
+                                            pids = st->perf_capture_events_helper.get_monitored_pids()](pid_t pid) {
+                                               return sw || (pids.count(pid) > 0);
+                                           });
+                                       auto symbols = std::make_shared<decltype(new_symbols)>(std::move(new_symbols));
+
+                                       return iterate(std::size_t {0}, symbols->size(), [st, symbols](auto index) {
+                                           auto const & entry = (*symbols)[index];
+                                           return st->misc_apc_frame_ipc_sender->async_send_jit_symbols_frame(
+                                                      entry.pid,
+                                                      entry.symbols,
+                                                      use_continuation)
+                                                | map_error();
+                                       });
+                                   });
+                        });
+                },
+                std::forward<CompletionToken>(token));
+        }
+
         /**
          * Read the kallsyms file and write into the capture
          *
@@ -547,6 +705,9 @@ namespace agents::perf {
 
                                auto result = lib::get_value(std::move(error_or_result));
 
+                               // the events are not enabled yet, so their first samples can be deduplicated
+                               st->async_perf_ringbuffer_monitor->add_event_ids(result.mappings);
+
                                // send all the mappings (asynchronously)
                                spawn("core key->id mapping task",
                                      st->misc_apc_frame_ipc_sender->async_send_keys_frame(result.mappings,
@@ -571,7 +732,14 @@ namespace agents::perf {
                                           // ensure that the pids are resumed after we return
                                           std::map<pid_t, lnx::sig_continuer_t> pp {std::move(paused_pids)};
                                           // start the core
-                                          return st->perf_capture_events_helper.core_online_start(core_no_t(cpu_no));
+                                          auto result =
+                                              st->perf_capture_events_helper.core_online_start(core_no_t(cpu_no));
+                                          // and count its metrics
+                                          if (!result.first && result.second && !st->cpu_metrics.empty()) {
+                                              st->cpu_metrics.core_online(core_no_t(cpu_no),
+                                                                          st->get_cluster_id(cpu_no));
+                                          }
+                                          return result;
                                       })
                                     | unpack_tuple() //
                                     | map_error();
@@ -593,8 +761,11 @@ namespace agents::perf {
 
             return async_initiate(
                 [st = this->shared_from_this(), cpu_no]() {
-                    return start_on(st->strand)                                                                     //
-                         | then([st, cpu_no]() { st->perf_capture_events_helper.core_offline(core_no_t(cpu_no)); }) //
+                    return start_on(st->strand) //
+                         | then([st, cpu_no]() {
+                               st->perf_capture_events_helper.core_offline(core_no_t(cpu_no));
+                               st->cpu_metrics.core_offline(core_no_t(cpu_no));
+                           })
                          | st->async_perf_ringbuffer_monitor->await_mmap_removed(cpu_no, use_continuation);
                 },
                 std::forward<CompletionToken>(token));
@@ -805,6 +976,264 @@ namespace agents::perf {
                 std::forward<CompletionToken>(token));
         }
 
+        /**
+         * Periodically rotate the multiplexed CPU PMU event groups, sending a counter frame that records which groups
+         * are counting each time they are rotated, until the capture terminates.
+         *
+         * @param monotonic_start The capture start timestamp (in CLOCK_MONOTONIC_RAW)
+         * @param token The completion token for the async operation
+         */
+        template<typename CompletionToken>
+        [[nodiscard]] auto async_rotate_multiplex_groups(std::uint64_t monotonic_start, CompletionToken && token)
+        {
+            using namespace async::continuations;
+
+            return async_initiate(
+                [st = this->shared_from_this(), monotonic_start]() {
+                    auto const quantum =
+                        std::chrono::milliseconds(st->configuration->session_data.pmu_multiplex_quantum_ms);
+
+                    return repeatedly(
+                        [st]() {
+                            return start_on(st->strand) //
+                                 | then([st]() { return !st->is_terminate_requested(); });
+                        },
+                        [st, monotonic_start, quantum]() {
+                            return start_on(st->strand) //
+                                 | then([st, quantum]() { st->multiplex_timer.expires_from_now(quantum); })
+                                 | st->multiplex_timer.async_wait(use_continuation) //
+                                 | post_on(st->strand)                              //
+                                 | then([st, monotonic_start](
+                                            boost::system::error_code const & ec) -> polymorphic_continuation_t<> {
+                                       // cancelled by terminate
+                                       if ((ec == boost::asio::error::operation_aborted)
+                                           || st->is_terminate_requested()) {
+                                           return {};
+                                       }
+
+                                       if (ec) {
+                                           return start_with(ec) | map_error();
+                                       }
+
+                                       auto counters = st->perf_capture_events_helper.rotate_multiplex_groups();
+                                       if (counters.empty()) {
+                                           return {};
+                                       }
+
+                                       return st->misc_apc_frame_ipc_sender->async_send_perf_counters_frame(
+                                                  monotonic_delta_now(monotonic_start),
+                                                  counters,
+                                                  use_continuation) //
+                                            | map_error();
+                                   });
+                        });
+                },
+                std::forward<CompletionToken>(token));
+        }
+
+        /**
+         * Change the perf events of the running capture, removing and then adding the events on each online core. The
+         * id->key mappings of the added events are sent before they are enabled, so that none of their samples are
+         * lost.
+         *
+         * @param reconfiguration The events to remove and add
+         * @param token The completion token for the async operation
+         */
+        template<typename CompletionToken>
+        [[nodiscard]] auto async_reconfigure(perf_capture_reconfiguration_t reconfiguration, CompletionToken && token)
+        {
+            using namespace async::continuations;
+
+            return async_initiate(
+                [st = this->shared_from_this(), reconfiguration = std::move(reconfiguration)]() mutable {
+                    return start_on(st->strand) //
+                         | then([st, reconfiguration = std::move(reconfiguration)]() -> polymorphic_continuation_t<> {
+                               if (st->is_terminate_requested()) {
+                                   return {};
+                               }
+
+                               auto mappings = st->perf_capture_events_helper.reconfigure_prepare(reconfiguration);
+
+                               st->async_perf_ringbuffer_monitor->add_event_ids(mappings);
+
+                               auto start = [st]() {
+                                   return start_on(st->strand) //
+                                        | then([st]() { st->perf_capture_events_helper.reconfigure_start(); });
+                               };
+
+                               if (mappings.empty()) {
+                                   return start();
+                               }
+
+                               return st->misc_apc_frame_ipc_sender->async_send_keys_frame(mappings, use_continuation)
+                                    | map_error() //
+                                    | then(std::move(start));
+                           });
+                },
+                std::forward<CompletionToken>(token));
+        }
+
+        /**
+         * Periodically read the inherited counters, sending a counter frame with the increase in each since the last
+         * read, until the capture terminates. The kernel sums the counts of every thread of the monitored processes
+         * into these, so there is one read per counter, core and process rather than a sample per counter overflow.
+         *
+         * @param monotonic_start The capture start timestamp (in CLOCK_MONOTONIC_RAW)
+         * @param token The completion token for the async operation
+         */
+        template<typename CompletionToken>
+        [[nodiscard]] auto async_read_inherited_counters(std::uint64_t monotonic_start, CompletionToken && token)
+        {
+            using namespace async::continuations;
+
+            return async_initiate(
+                [st = this->shared_from_this(), monotonic_start]() {
+                    auto const interval = st->get_counter_read_interval();
+
+                    return repeatedly(
+                        [st]() {
+                            return start_on(st->strand) //
+                                 | then([st]() { return !st->is_terminate_requested(); });
+                        },
+                        [st, monotonic_start, interval]() {
+                            return start_on(st->strand) //
+                                 | then([st, interval]() { st->inherited_counters_timer.expires_from_now(interval); })
+                                 | st->inherited_counters_timer.async_wait(use_continuation) //
+                                 | post_on(st->strand)                                       //
+                                 | then([st, monotonic_start](
+                                            boost::system::error_code const & ec) -> polymorphic_continuation_t<> {
+                                       // cancelled by terminate
+                                       if ((ec == boost::asio::error::operation_aborted)
+                                           || st->is_terminate_requested()) {
+                                           return {};
+                                       }
+
+                                       if (ec) {
+                                           return start_with(ec) | map_error();
+                                       }
+
+                                       auto counters = st->perf_capture_events_helper.read_inherited_counters();
+                                       if (counters.empty()) {
+                                           return {};
+                                       }
+
+                                       return st->misc_apc_frame_ipc_sender->async_send_perf_counters_frame(
+                                                  monotonic_delta_now(monotonic_start),
+                                                  counters,
+                                                  use_continuation) //
+                                            | map_error();
+                                   });
+                        });
+                },
+                std::forward<CompletionToken>(token));
+        }
+
+        /**
+         * Periodically read the groups of the derived metrics of the cpu PMU events, sending a counter frame with the
+         * value of each metric on each core over the interval since the last read, until the capture terminates. The
+         * metrics are read at the same interval as the inherited counters.
+         *
+         * @param monotonic_start The capture start timestamp (in CLOCK_MONOTONIC_RAW)
+         * @param token The completion token for the async operation
+         */
+        template<typename CompletionToken>
+        [[nodiscard]] auto async_read_cpu_metrics(std::uint64_t monotonic_start, CompletionToken && token)
+        {
+            using namespace async::continuations;
+
+            return async_initiate(
+                [st = this->shared_from_this(), monotonic_start]() {
+                    auto const interval = st->get_counter_read_interval();
+
+                    return repeatedly(
+                        [st]() {
+                            return start_on(st->strand) //
+                                 | then([st]() { return !st->is_terminate_requested(); });
+                        },
+                        [st, monotonic_start, interval]() {
+                            return start_on(st->strand) //
+                                 | then([st, interval]() { st->cpu_metrics_timer.expires_from_now(interval); })
+                                 | st->cpu_metrics_timer.async_wait(use_continuation) //
+                                 | post_on(st->strand)                                //
+                                 | then([st, monotonic_start](
+                                            boost::system::error_code const & ec) -> polymorphic_continuation_t<> {
+                                       // cancelled by terminate
+                                       if ((ec == boost::asio::error::operation_aborted)
+                                           || st->is_terminate_requested()) {
+                                           return {};
+                                       }
+
+                                       if (ec) {
+                                           return start_with(ec) | map_error();
+                                       }
+
+                                       auto counters = st->cpu_metrics.read();
+                                       if (counters.empty()) {
+                                           return {};
+                                       }
+
+                                       return st->misc_apc_frame_ipc_sender->async_send_perf_counters_frame(
+                                                  monotonic_delta_now(monotonic_start),
+                                                  counters,
+                                                  use_continuation) //
+                                            | map_error();
+                                   });
+                        });
+                },
+                std::forward<CompletionToken>(token));
+        }
+
+        /**
+         * Strobe the CoreSight ETM trace until the capture terminates; the ETM events are enabled for the strobe
+         * window, then disabled for the rest of the strobe period, so that the trace covers regular samples of the
+         * execution rather than filling the aux buffers with the first part of it
+         *
+         * @param token The completion token for the async operation
+         */
+        template<typename CompletionToken>
+        [[nodiscard]] auto async_strobe_etm(CompletionToken && token)
+        {
+            using namespace async::continuations;
+
+            return async_initiate(
+                [st = this->shared_from_this()]() {
+                    auto const window = std::chrono::microseconds(st->configuration->session_data.etm_strobe_window_us);
+                    auto const period = std::chrono::microseconds(st->configuration->session_data.etm_strobe_period_us);
+                    // the events are enabled as the capture starts
+                    auto enabled = std::make_shared<bool>(true);
+
+                    return repeatedly(
+                        [st]() {
+                            return start_on(st->strand) //
+                                 | then([st]() { return !st->is_terminate_requested(); });
+                        },
+                        [st, window, period, enabled]() {
+                            return start_on(st->strand) //
+                                 | then([st, window, period, enabled]() {
+                                       st->etm_strobe_timer.expires_from_now(*enabled ? window : period - window);
+                                   })
+                                 | st->etm_strobe_timer.async_wait(use_continuation) //
+                                 | post_on(st->strand)                               //
+                                 | then([st, enabled](boost::system::error_code const & ec) {
+                                       // cancelled by terminate
+                                       if ((ec == boost::asio::error::operation_aborted)
+                                           || st->is_terminate_requested()) {
+                                           return boost::system::error_code {};
+                                       }
+
+                                       if (!ec) {
+                                           *enabled = !*enabled;
+                                           st->perf_capture_events_helper.set_etm_enabled(*enabled);
+                                       }
+
+                                       return ec;
+                                   })
+                                 | map_error();
+                        });
+                },
+                std::forward<CompletionToken>(token));
+        }
+
         /** Cancel any outstanding asynchronous operations that need special handling. */
         void terminate()
         {
@@ -816,7 +1245,15 @@ namespace agents::perf {
                     w->cancel();
                 }
 
+                st->multiplex_timer.cancel();
+                st->inherited_counters_timer.cancel();
+                st->cpu_metrics_timer.cancel();
+                st->etm_strobe_timer.cancel();
+                st->sampled_process_maps_timer.cancel();
+                st->jit_symbols_timer.cancel();
+
                 st->perf_capture_events_helper.clear_stopped_tids();
+                st->perf_capture_events_helper.stop_all_events();
 
                 auto fc = st->forked_command;
                 if (fc) {
@@ -832,6 +1269,12 @@ namespace agents::perf {
     private:
         std::shared_ptr<perf_capture_configuration_t> configuration;
         boost::asio::io_context::strand strand;
+        boost::asio::steady_timer multiplex_timer;
+        boost::asio::steady_timer inherited_counters_timer;
+        boost::asio::steady_timer cpu_metrics_timer;
+        boost::asio::steady_timer etm_strobe_timer;
+        boost::asio::steady_timer sampled_process_maps_timer;
+        boost::asio::steady_timer jit_symbols_timer;
         process_monitor_t & process_monitor;
         agent_environment_base_t::terminator terminator;
         std::shared_ptr<ICpuInfo> cpu_info;
@@ -841,8 +1284,55 @@ namespace agents::perf {
         std::shared_ptr<async_perf_ringbuffer_monitor_t> async_perf_ringbuffer_monitor;
         std::shared_ptr<async::proc::async_process_t> forked_command;
         perf_capture_events_helper_t perf_capture_events_helper;
+        std::shared_ptr<sample_pid_tracker_t> sample_pid_tracker;
+        std::shared_ptr<jit_symbol_watcher_t> jit_symbol_watcher;
+        cpu_metrics_t cpu_metrics;
         bool terminate_requested {false};
 
+        /** How often the maps of the newly sampled processes are sent */
+        static constexpr auto sampled_process_maps_interval = std::chrono::milliseconds(100);
+
+        /** The inherited counters are read at the sample rate, limited to between these intervals */
+        static constexpr auto min_inherited_counters_interval = std::chrono::milliseconds(10);
+        static constexpr auto max_inherited_counters_interval = std::chrono::milliseconds(100);
+
+        /** How often the perf map and jitdump files are checked for new symbols */
+        static constexpr auto jit_symbols_interval = std::chrono::milliseconds(250);
+
+        /** Write the `maps` file contents of one process into the capture, unless it has exited */
+        template<typename CompletionToken>
+        [[nodiscard]] auto async_send_process_maps(pid_t pid, CompletionToken && token)
+        {
+            using namespace async::continuations;
+
+            return async_initiate(
+                [st = this->shared_from_this(), pid]() -> polymorphic_continuation_t<> {
+                    auto const maps_file = lib::FsEntry::create(lib::Format() << "/proc/" << pid << "/maps");
+
+                    // missing or inaccessible file is not an error
+                    if ((!maps_file.exists()) || (!maps_file.canAccess(true, false, false))) {
+                        return {};
+                    }
+
+                    return st->misc_apc_frame_ipc_sender->async_send_maps_frame(pid,
+                                                                                pid,
+                                                                                lib::readFileContents(maps_file),
+                                                                                use_continuation)
+                         | map_error();
+                },
+                std::forward<CompletionToken>(token));
+        }
+
+        /** @return The interval the inherited counters and the cpu metrics are read at */
+        [[nodiscard]] std::chrono::milliseconds get_counter_read_interval() const
+        {
+            auto const sample_rate = configuration->session_data.sample_rate;
+            return (sample_rate > 0 ? std::clamp(std::chrono::milliseconds(1000 / sample_rate),
+                                                 min_inherited_counters_interval,
+                                                 max_inherited_counters_interval)
+                                    : max_inherited_counters_interval);
+        }
+
         [[nodiscard]] cpu_cluster_id_t get_cluster_id(int cpu_no)
         {
             runtime_assert((cpu_no >= 0) && (std::size_t(cpu_no) < cpu_info->getNumberOfCores()), "Unexpected cpu no");
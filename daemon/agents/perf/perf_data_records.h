@@ -0,0 +1,83 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#pragma once
+
+#include "k/perf_event.h"
+#include "lib/Span.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace agents::perf {
+    /**
+     * Call `consumer` with each whole record of a chunk of the perf data mmap, as given by
+     * extract_one_perf_data_raw_span_pair, so that it only ever sees each record as contiguous memory.
+     *
+     * The chunk is split into two spans where it wraps around the end of the mmap (which cannot be mirrored, as it is
+     * mapped by the kernel). Every record that does not straddle that point is passed straight from the mmap; only the
+     * one that does is copied, once, into `split_record`.
+     *
+     * Anything at the end of the chunk that is not a whole record (which should not happen) is appended to `remainder`
+     * as is.
+     *
+     * @param first_span The first part of the chunk
+     * @param second_span The rest of the chunk, which follows on from the first (when the mmap wrapped)
+     * @param split_record Receives the record that straddles the wrap, reused for each chunk
+     * @param remainder Receives the trailing bytes that are not a whole record
+     * @param consumer Called with the span of each record in order
+     */
+    template<typename Consumer>
+    void for_each_perf_data_record(lib::Span<char const> first_span,
+                                   lib::Span<char const> second_span,
+                                   std::vector<char> & split_record,
+                                   std::vector<char> & remainder,
+                                   Consumer && consumer)
+    {
+        constexpr std::size_t word_size = sizeof(std::uint64_t);
+
+        std::size_t const total_size = first_span.size() + second_span.size();
+        std::size_t offset = 0;
+
+        while ((total_size - offset) >= sizeof(perf_event_header)) {
+            // the header is never split, as the records (and so the wrap point) are word aligned
+            auto const * header_data = (offset < first_span.size() ? first_span.data() + offset
+                                                                   : second_span.data() + (offset - first_span.size()));
+
+            perf_event_header header;
+            std::memcpy(&header, header_data, sizeof(header));
+
+            std::size_t const record_size =
+                std::max<std::size_t>(word_size, (header.size + word_size - 1) & ~(word_size - 1));
+            if (record_size > (total_size - offset)) {
+                break;
+            }
+
+            if ((offset >= first_span.size()) || ((offset + record_size) <= first_span.size())) {
+                consumer(lib::Span<char const> {header_data, record_size});
+            }
+            else {
+                auto const first_part = first_span.size() - offset;
+                split_record.assign(header_data, header_data + first_part);
+                split_record.insert(split_record.end(),
+                                    second_span.data(),
+                                    second_span.data() + (record_size - first_part));
+                consumer(lib::Span<char const> {split_record.data(), split_record.size()});
+            }
+
+            offset += record_size;
+        }
+
+        // forward anything that is not a whole record as is
+        if (offset < first_span.size()) {
+            remainder.insert(remainder.end(), first_span.data() + offset, first_span.data() + first_span.size());
+            offset = first_span.size();
+        }
+        if (offset < total_size) {
+            auto const * rest = second_span.data() + (offset - first_span.size());
+            remainder.insert(remainder.end(), rest, rest + (total_size - offset));
+        }
+    }
+}
@@ -8,10 +8,70 @@
 #include "linux/SysfsSummaryInformation.h"
 
 #include <ctime>
+#include <string>
 
+#include <sys/timex.h>
 #include <sys/utsname.h>
 
 namespace agents::perf {
+    namespace {
+        constexpr int clock_pairing_attempts = 8;
+
+        [[nodiscard]] std::uint64_t to_ns(struct timespec const & ts)
+        {
+            return (std::uint64_t(ts.tv_sec) * NS_PER_S) + ts.tv_nsec;
+        }
+
+        /**
+         * Add the information needed to align the capture with those made on other machines: a CLOCK_REALTIME value
+         * paired as closely as possible with a CLOCK_MONOTONIC_RAW value, and how well synchronized the realtime
+         * clock is (e.g. by NTP or PTP).
+         */
+        void add_clock_alignment_attributes(std::map<std::string, std::string> & additional_attributes)
+        {
+            std::optional<std::uint64_t> best_window {};
+            std::uint64_t best_realtime = 0;
+            std::uint64_t best_monotonic_raw = 0;
+
+            // take the realtime read that is most tightly bracketed by the monotonic raw reads
+            for (int n = 0; n < clock_pairing_attempts; ++n) {
+                struct timespec before;
+                struct timespec realtime;
+                struct timespec after;
+
+                if ((clock_gettime(CLOCK_MONOTONIC_RAW, &before) != 0)
+                    || (clock_gettime(CLOCK_REALTIME, &realtime) != 0)
+                    || (clock_gettime(CLOCK_MONOTONIC_RAW, &after) != 0)) {
+                    LOG_DEBUG("clock_gettime failed");
+                    return;
+                }
+
+                auto const window = to_ns(after) - to_ns(before);
+                if ((!best_window) || (window < *best_window)) {
+                    best_window = window;
+                    best_realtime = to_ns(realtime);
+                    best_monotonic_raw = to_ns(before) + (window / 2);
+                }
+            }
+
+            additional_attributes["clock.realtime"] = std::to_string(best_realtime);
+            additional_attributes["clock.monotonic_raw"] = std::to_string(best_monotonic_raw);
+            additional_attributes["clock.pairing_error_ns"] = std::to_string(*best_window / 2);
+
+            // modes == 0 only reads the state, so does not need any privileges
+            struct timex tx {};
+            auto const state = adjtimex(&tx);
+            if (state == -1) {
+                LOG_DEBUG("adjtimex failed");
+                return;
+            }
+
+            auto const is_synchronized = (state != TIME_ERROR) && ((tx.status & STA_UNSYNC) == 0);
+            additional_attributes["clock.is_synchronized"] = (is_synchronized ? "1" : "0");
+            additional_attributes["clock.estimated_error_us"] = std::to_string(tx.esterror);
+            additional_attributes["clock.maximum_error_us"] = std::to_string(tx.maxerror);
+        }
+    }
 
     std::optional<perf_driver_summary_state_t> create_perf_driver_summary_state(PerfConfig const & perf_config,
                                                                                 std::uint64_t monotonic_start)
@@ -58,6 +118,7 @@ namespace agents::perf {
         additional_attributes["perf.has_attr_context_switch"] = (perf_config.has_attr_context_switch ? "1" : "0");
 
         lnx::addDefaultSysfsSummaryInformation(additional_attributes);
+        add_clock_alignment_attributes(additional_attributes);
 
         return perf_driver_summary_state_t {
             std::move(additional_attributes),
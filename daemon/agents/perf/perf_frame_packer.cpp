@@ -5,6 +5,7 @@
 #include "ISender.h"
 #include "agents/perf/async_buffer_builder.h"
 #include "k/perf_event.h"
+#include "lib/Assert.h"
 
 namespace agents::perf {
 
@@ -28,14 +29,16 @@ namespace agents::perf {
             std::min<std::size_t>(ISender::MAX_RESPONSE_LENGTH - max_aux_header_size,
                                   1024UL * 1024UL); // limit frame size
 
-        [[nodiscard]] bool append_data_record(apc_buffer_builder_t<std::vector<char>> & builder,
-                                              lib::Span<sample_word_type const> data)
+        // the largest chunk of raw data words such that the encoded form is guaranteed to fit within max_data_payload_size
+        constexpr std::size_t max_data_raw_payload_size =
+            (max_data_payload_size / buffer_utils::MAXSIZE_PACK64) * sample_word_size;
+
+        void append_data_record(apc_buffer_builder_t<std::vector<char>> & builder,
+                                lib::Span<sample_word_type const> data)
         {
             for (auto w : data) {
                 builder.packInt64(w);
             }
-
-            return builder.getWriteIndex() <= max_data_payload_size;
         }
 
         template<typename T>
@@ -52,30 +55,18 @@ namespace agents::perf {
 
     }
 
-    std::pair<std::uint64_t, std::vector<char>> extract_one_perf_data_apc_frame(
-        int cpu,
-        lib::Span<char const> data_mmap,
-        std::uint64_t const header_head, // NOLINT(bugprone-easily-swappable-parameters)
-        std::uint64_t const header_tail)
+    std::pair<std::uint64_t, std::pair<lib::Span<char const>, lib::Span<char const>>>
+    extract_one_perf_data_raw_span_pair(lib::Span<char const> data_mmap,
+                                        std::uint64_t const header_head, // NOLINT(bugprone-easily-swappable-parameters)
+                                        std::uint64_t const header_tail)
     {
         auto const buffer_mask = data_mmap.size() - 1; // assumes the size is a power of two (which it should be)
 
-        // don't output an empty frame
+        // ignore invalid / empty input
         if (header_tail >= header_head) {
             return {header_tail, {}};
         }
 
-        std::vector<char> buffer {};
-        buffer.reserve(max_data_payload_size);
-        apc_buffer_builder_t builder {buffer};
-
-        // add the frame header
-        builder.beginFrame(FrameType::PERF_DATA);
-        builder.packInt(cpu);
-        // skip the length field for now
-        auto const length_index = builder.getWriteIndex();
-        builder.advanceWrite(4);
-
         // accumulate one or more records to fit into some message
         auto current_tail = header_tail;
         while (current_tail < header_head) {
@@ -84,45 +75,15 @@ namespace agents::perf {
             auto const record_size =
                 std::max<std::size_t>(8U, (record_header->size + sample_word_size - 1) & ~(sample_word_size - 1));
             auto const record_end = current_tail + record_size;
-            std::size_t const base_masked = (current_tail & buffer_mask);
-            std::size_t const end_masked = (record_end & buffer_mask);
 
             // incomplete or currently written record; is it possible? lets just be defensive
             if (record_end > header_head) {
                 break;
             }
 
-            auto const have_wrapped = end_masked < base_masked;
-
-            std::size_t const first_size = (have_wrapped ? (data_mmap.size() - base_masked) : record_size);
-            std::size_t const second_size = (have_wrapped ? end_masked : 0);
-
-            // encode the chunk
-            auto const current_offset = builder.getWriteIndex();
-
-            LOG_TRACE("appending record %p (%zu -> %" PRIu64 ") (%zu / %zu / %u / %zu / %zu / %zu)",
-                      record_header,
-                      record_size,
-                      record_end,
-                      base_masked,
-                      end_masked,
-                      have_wrapped,
-                      first_size,
-                      second_size,
-                      current_offset);
-
-            if ((!append_data_record(builder,
-                                     {
-                                         ring_buffer_ptr<sample_word_type>(data_mmap.data(), base_masked),
-                                         first_size / sample_word_size,
-                                     }))
-                || (!append_data_record(builder,
-                                        {
-                                            ring_buffer_ptr<sample_word_type>(data_mmap.data(), 0),
-                                            second_size / sample_word_size,
-                                        }))) {
-                LOG_TRACE("... aborted");
-                builder.trimTo(current_offset);
+            // would the encoded form of the chunk (potentially) exceed the frame size limit
+            if ((record_end - header_tail) > max_data_raw_payload_size) {
+                LOG_TRACE("... chunk full");
                 break;
             }
 
@@ -132,20 +93,258 @@ namespace agents::perf {
             current_tail = record_end;
         }
 
-        // don't output an empty frame
+        // don't output an empty chunk
         if (current_tail == header_tail) {
             return {header_tail, {}};
         }
 
+        std::size_t const total_size = (current_tail - header_tail);
+        std::size_t const base_masked = (header_tail & buffer_mask);
+
+        auto const have_wrapped = (base_masked + total_size) > data_mmap.size();
+
+        std::size_t const first_size = (have_wrapped ? (data_mmap.size() - base_masked) : total_size);
+        std::size_t const second_size = (total_size - first_size);
+
+        return {current_tail,
+                {
+                    {data_mmap.data() + base_masked, first_size},
+                    {data_mmap.data(), second_size},
+                }};
+    }
+
+    std::vector<char> encode_one_perf_data_apc_frame(int cpu,
+                                                    lib::Span<char const> first_span,
+                                                    lib::Span<char const> second_span,
+                                                    std::vector<char> buffer)
+    {
+        buffer.clear();
+
+        // don't output an empty frame
+        if (first_span.empty() && second_span.empty()) {
+            return buffer;
+        }
+
+        runtime_assert((first_span.size() % sample_word_size) == 0, "Unexpected data chunk alignment");
+        runtime_assert((second_span.size() % sample_word_size) == 0, "Unexpected data chunk alignment");
+
+        buffer.reserve(max_data_header_size
+                       + (((first_span.size() + second_span.size()) / sample_word_size)
+                          * buffer_utils::MAXSIZE_PACK64));
+        apc_buffer_builder_t builder {buffer};
+
+        // add the frame header
+        builder.beginFrame(FrameType::PERF_DATA);
+        builder.packInt(cpu);
+        // skip the length field for now
+        auto const length_index = builder.getWriteIndex();
+        builder.advanceWrite(4);
+
+        // encode the chunk
+        append_data_record(builder,
+                           {
+                               reinterpret_cast<sample_word_type const *>(first_span.data()),
+                               first_span.size() / sample_word_size,
+                           });
+        append_data_record(builder,
+                           {
+                               reinterpret_cast<sample_word_type const *>(second_span.data()),
+                               second_span.size() / sample_word_size,
+                           });
+
         // now fill in the length field
         auto const bytes_written = builder.getWriteIndex() - (length_index + 4);
         LOG_TRACE("setting length = %zu", bytes_written);
+        runtime_assert(bytes_written <= max_data_payload_size, "Encoded data chunk is too large");
         builder.writeLeUint32At(length_index, bytes_written);
 
         // commit the frame
         builder.endFrame();
 
-        return {current_tail, std::move(buffer)};
+        return buffer;
+    }
+
+    std::vector<char> encode_one_perf_call_stacks_apc_frame(int cpu,
+                                                           lib::Span<std::uint64_t const> new_stacks,
+                                                           std::vector<char> buffer)
+    {
+        buffer.clear();
+
+        if (new_stacks.empty()) {
+            return buffer;
+        }
+
+        // the stacks are never larger than the records they came from, so the frame is within the same limit
+        buffer.reserve(max_data_header_size + (new_stacks.size() * buffer_utils::MAXSIZE_PACK64));
+        apc_buffer_builder_t builder {buffer};
+
+        builder.beginFrame(FrameType::PERF_CALL_STACKS);
+        builder.packInt(cpu);
+        append_data_record(builder, new_stacks);
+        builder.endFrame();
+
+        return buffer;
+    }
+
+    std::vector<char> encode_one_perf_sample_aggregates_apc_frame(int cpu,
+                                                                 lib::Span<std::uint64_t const> window,
+                                                                 std::vector<char> buffer)
+    {
+        buffer.clear();
+
+        if (window.empty()) {
+            return buffer;
+        }
+
+        // the aggregator limits the size of each window so that it fits
+        runtime_assert((window.size() * buffer_utils::MAXSIZE_PACK64) <= max_data_payload_size,
+                       "Sample aggregates window is too large");
+
+        buffer.reserve(max_data_header_size + (window.size() * buffer_utils::MAXSIZE_PACK64));
+        apc_buffer_builder_t builder {buffer};
+
+        builder.beginFrame(FrameType::PERF_SAMPLE_AGGREGATES);
+        builder.packInt(cpu);
+        append_data_record(builder, window);
+        builder.endFrame();
+
+        return buffer;
+    }
+
+    std::vector<char> encode_one_perf_function_latencies_apc_frame(int cpu,
+                                                                   lib::Span<std::uint64_t const> window,
+                                                                   std::vector<char> buffer)
+    {
+        buffer.clear();
+
+        if (window.empty()) {
+            return buffer;
+        }
+
+        // each window holds at most one histogram per probe, which is far smaller than the limit
+        runtime_assert((window.size() * buffer_utils::MAXSIZE_PACK64) <= max_data_payload_size,
+                       "Function latencies window is too large");
+
+        buffer.reserve(max_data_header_size + (window.size() * buffer_utils::MAXSIZE_PACK64));
+        apc_buffer_builder_t builder {buffer};
+
+        builder.beginFrame(FrameType::PERF_FUNCTION_LATENCIES);
+        builder.packInt(cpu);
+        append_data_record(builder, window);
+        builder.endFrame();
+
+        return buffer;
+    }
+
+    std::vector<char> encode_one_perf_spe_heatmap_apc_frame(int cpu,
+                                                            lib::Span<std::uint64_t const> window,
+                                                            std::vector<char> buffer)
+    {
+        buffer.clear();
+
+        if (window.empty()) {
+            return buffer;
+        }
+
+        // each window holds at most the configured number of entries, which is limited so that it fits
+        runtime_assert((window.size() * buffer_utils::MAXSIZE_PACK64) <= max_data_payload_size,
+                       "SPE heatmap window is too large");
+
+        buffer.reserve(max_data_header_size + (window.size() * buffer_utils::MAXSIZE_PACK64));
+        apc_buffer_builder_t builder {buffer};
+
+        builder.beginFrame(FrameType::PERF_SPE_HEATMAP);
+        builder.packInt(cpu);
+        append_data_record(builder, window);
+        builder.endFrame();
+
+        return buffer;
+    }
+
+    std::vector<char> encode_one_perf_gpu_activity_apc_frame(int cpu,
+                                                             lib::Span<std::uint64_t const> window,
+                                                             std::vector<char> buffer)
+    {
+        buffer.clear();
+
+        if (window.empty()) {
+            return buffer;
+        }
+
+        // each window is closed early once full, which is limited so that it fits
+        runtime_assert((window.size() * buffer_utils::MAXSIZE_PACK64) <= max_data_payload_size,
+                       "GPU activity window is too large");
+
+        buffer.reserve(max_data_header_size + (window.size() * buffer_utils::MAXSIZE_PACK64));
+        apc_buffer_builder_t builder {buffer};
+
+        builder.beginFrame(FrameType::PERF_GPU_ACTIVITY);
+        builder.packInt(cpu);
+        append_data_record(builder, window);
+        builder.endFrame();
+
+        return buffer;
+    }
+
+    std::vector<char> encode_one_perf_lock_contention_apc_frame(int cpu,
+                                                               lib::Span<std::uint64_t const> window,
+                                                               std::vector<char> buffer)
+    {
+        buffer.clear();
+
+        if (window.empty()) {
+            return buffer;
+        }
+
+        // each window holds at most the limited number of locks and call sites, which is far smaller than the limit
+        runtime_assert((window.size() * buffer_utils::MAXSIZE_PACK64) <= max_data_payload_size,
+                       "Lock contention window is too large");
+
+        buffer.reserve(max_data_header_size + (window.size() * buffer_utils::MAXSIZE_PACK64));
+        apc_buffer_builder_t builder {buffer};
+
+        builder.beginFrame(FrameType::PERF_LOCK_CONTENTION);
+        builder.packInt(cpu);
+        append_data_record(builder, window);
+        builder.endFrame();
+
+        return buffer;
+    }
+
+    std::vector<char> encode_one_perf_thread_energy_apc_frame(int cpu,
+                                                             lib::Span<std::uint64_t const> window,
+                                                             std::vector<char> buffer)
+    {
+        buffer.clear();
+
+        if (window.empty()) {
+            return buffer;
+        }
+
+        // each window holds at most the limited number of threads, which fits within the limit
+        runtime_assert((window.size() * buffer_utils::MAXSIZE_PACK64) <= max_data_payload_size,
+                       "Thread energy window is too large");
+
+        buffer.reserve(max_data_header_size + (window.size() * buffer_utils::MAXSIZE_PACK64));
+        apc_buffer_builder_t builder {buffer};
+
+        builder.beginFrame(FrameType::PERF_THREAD_ENERGY);
+        builder.packInt(cpu);
+        append_data_record(builder, window);
+        builder.endFrame();
+
+        return buffer;
+    }
+
+    std::pair<std::uint64_t, std::vector<char>> extract_one_perf_data_apc_frame(
+        int cpu,
+        lib::Span<char const> data_mmap,
+        std::uint64_t const header_head, // NOLINT(bugprone-easily-swappable-parameters)
+        std::uint64_t const header_tail)
+    {
+        auto [new_tail, spans] = extract_one_perf_data_raw_span_pair(data_mmap, header_head, header_tail);
+
+        return {new_tail, encode_one_perf_data_apc_frame(cpu, spans.first, spans.second)};
     }
 
     std::pair<lib::Span<char const>, lib::Span<char const>> extract_one_perf_aux_apc_frame_data_span_pair(
@@ -195,13 +394,14 @@ namespace agents::perf {
     std::pair<std::uint64_t, std::vector<char>> encode_one_perf_aux_apc_frame(int cpu,
                                                                               lib::Span<char const> first_span,
                                                                               lib::Span<char const> second_span,
-                                                                              std::uint64_t const header_tail)
+                                                                              std::uint64_t const header_tail,
+                                                                              std::vector<char> buffer)
     {
         auto const combined_size = first_span.size() + second_span.size();
 
         // create the message data
-        std::vector<char> buffer {};
-        buffer.reserve(combined_size);
+        buffer.clear();
+        buffer.reserve(max_perf_aux_apc_frame_size(combined_size));
 
         apc_buffer_builder_t builder {buffer};
 
@@ -215,4 +415,6 @@ namespace agents::perf {
 
         return {header_tail + combined_size, std::move(buffer)};
     }
+
+    std::size_t max_perf_aux_apc_frame_size(std::size_t payload_size) { return max_aux_header_size + payload_size; }
 }
@@ -11,6 +11,120 @@
 
 namespace agents::perf {
 
+    /**
+     * Given the current state of the perf data section of some mmap, extract a pair of spans (pair to account for ringbuffer wrapping) representing
+     * the chunk of raw perf records to send as part of some apc_frame message. The chunk will only ever contain complete records, and is sized such that
+     * once encoded (by `encode_one_perf_data_apc_frame`) it is no larger than the max sized apc_frame payload.
+     *
+     * @param data_mmap The data area within the mmap
+     * @param header_head The data_head value
+     * @param header_tail The data_tail value
+     * @return A pair, being the new value for data_tail, and the first and second parts of the data chunk.
+     */
+    [[nodiscard]] std::pair<std::uint64_t, std::pair<lib::Span<char const>, lib::Span<char const>>>
+    extract_one_perf_data_raw_span_pair(lib::Span<char const> data_mmap,
+                                        std::uint64_t header_head,
+                                        std::uint64_t header_tail);
+
+    /**
+     * Given the pair of data spans that were previously extracted by `extract_one_perf_data_raw_span_pair`,
+     * encode them into an apc_frame message
+     *
+     * @param cpu The cpu associated with the mmap
+     * @param first_span The first span returned by extract_one_perf_data_raw_span_pair
+     * @param second_span The second span returned by extract_one_perf_data_raw_span_pair
+     * @param buffer Some (possibly recycled) buffer to encode the message into; any existing contents are discarded
+     * @return The encoded apc_frame message, or an empty vector if there was no data
+     */
+    [[nodiscard]] std::vector<char> encode_one_perf_data_apc_frame(int cpu,
+                                                                  lib::Span<char const> first_span,
+                                                                  lib::Span<char const> second_span,
+                                                                  std::vector<char> buffer = {});
+
+    /**
+     * Encode the new call stacks produced by a `call_stack_deduplicator_t` into an apc_frame message
+     *
+     * @param cpu The cpu associated with the mmap
+     * @param new_stacks The stack words; for each stack, the id, `nr` and then `ips[nr]`
+     * @param buffer Some (possibly recycled) buffer to encode the message into; any existing contents are discarded
+     * @return The encoded apc_frame message, or an empty vector if there were no stacks
+     */
+    [[nodiscard]] std::vector<char> encode_one_perf_call_stacks_apc_frame(int cpu,
+                                                                         lib::Span<std::uint64_t const> new_stacks,
+                                                                         std::vector<char> buffer = {});
+
+    /**
+     * Encode one window of aggregated samples produced by a `sample_aggregator_t` into an apc_frame message
+     *
+     * @param cpu The cpu associated with the mmap
+     * @param window The window's words
+     * @param buffer Some (possibly recycled) buffer to encode the message into; any existing contents are discarded
+     * @return The encoded apc_frame message, or an empty vector if the window was empty
+     */
+    [[nodiscard]] std::vector<char> encode_one_perf_sample_aggregates_apc_frame(int cpu,
+                                                                               lib::Span<std::uint64_t const> window,
+                                                                               std::vector<char> buffer = {});
+
+    /**
+     * Encode one window of function latencies produced by a `function_latency_state_t` into an apc_frame message
+     *
+     * @param cpu The cpu associated with the mmap that the window was closed by
+     * @param window The window's words
+     * @param buffer Some (possibly recycled) buffer to encode the message into; any existing contents are discarded
+     * @return The encoded apc_frame message, or an empty vector if the window was empty
+     */
+    [[nodiscard]] std::vector<char> encode_one_perf_function_latencies_apc_frame(int cpu,
+                                                                                 lib::Span<std::uint64_t const> window,
+                                                                                 std::vector<char> buffer = {});
+
+    /**
+     * Encode one window of an SPE heatmap produced by a `spe_heatmap_t` into an apc_frame message
+     *
+     * @param cpu The cpu whose aux data the window was aggregated from
+     * @param window The window's words
+     * @param buffer Some (possibly recycled) buffer to encode the message into; any existing contents are discarded
+     * @return The encoded apc_frame message, or an empty vector if the window was empty
+     */
+    [[nodiscard]] std::vector<char> encode_one_perf_spe_heatmap_apc_frame(int cpu,
+                                                                          lib::Span<std::uint64_t const> window,
+                                                                          std::vector<char> buffer = {});
+
+    /**
+     * Encode one window of GPU activity produced by a `gpu_timeline_state_t` into an apc_frame message
+     *
+     * @param cpu The cpu associated with the mmap that the window was closed by
+     * @param window The window's words
+     * @param buffer Some (possibly recycled) buffer to encode the message into; any existing contents are discarded
+     * @return The encoded apc_frame message, or an empty vector if the window was empty
+     */
+    [[nodiscard]] std::vector<char> encode_one_perf_gpu_activity_apc_frame(int cpu,
+                                                                           lib::Span<std::uint64_t const> window,
+                                                                           std::vector<char> buffer = {});
+
+    /**
+     * Encode one window of lock wait times produced by a `lock_contention_state_t` into an apc_frame message
+     *
+     * @param cpu The cpu associated with the mmap that the window was closed by
+     * @param window The window's words
+     * @param buffer Some (possibly recycled) buffer to encode the message into; any existing contents are discarded
+     * @return The encoded apc_frame message, or an empty vector if the window was empty
+     */
+    [[nodiscard]] std::vector<char> encode_one_perf_lock_contention_apc_frame(int cpu,
+                                                                             lib::Span<std::uint64_t const> window,
+                                                                             std::vector<char> buffer = {});
+
+    /**
+     * Encode one window of thread runtimes and energies produced by a `thread_energy_state_t` into an apc_frame message
+     *
+     * @param cpu The cpu associated with the mmap that the window was closed by
+     * @param window The window's words
+     * @param buffer Some (possibly recycled) buffer to encode the message into; any existing contents are discarded
+     * @return The encoded apc_frame message, or an empty vector if the window was empty
+     */
+    [[nodiscard]] std::vector<char> encode_one_perf_thread_energy_apc_frame(int cpu,
+                                                                           lib::Span<std::uint64_t const> window,
+                                                                           std::vector<char> buffer = {});
+
     /**
      * Given the current state of the perf data section of some mmap, extract some apc data frame from it
      *
@@ -49,11 +163,18 @@ namespace agents::perf {
      * @param first_span The first span returned by extract_one_perf_aux_apc_frame_data_span_pair
      * @param second_span The second span returned by extract_one_perf_aux_apc_frame_data_span_pair
      * @param header_tail The value of header_tail that was passed to extract_one_perf_aux_apc_frame_data_span_pair
+     * @param buffer Some (possibly recycled) buffer to encode the message into; any existing contents are discarded
      * @return A pair, being the new value for aux_tail, and the encoded apc_frame message
      */
     [[nodiscard]] std::pair<std::uint64_t, std::vector<char>> encode_one_perf_aux_apc_frame(
         int cpu,
         lib::Span<char const> first_span,
         lib::Span<char const> second_span,
-        std::uint64_t header_tail);
+        std::uint64_t header_tail,
+        std::vector<char> buffer = {});
+
+    /**
+     * @return The maximum size of the buffer required for some aux apc_frame message containing `payload_size` bytes of aux data
+     */
+    [[nodiscard]] std::size_t max_perf_aux_apc_frame_size(std::size_t payload_size);
 }
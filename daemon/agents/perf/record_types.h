@@ -14,6 +14,8 @@ namespace agents::perf {
         size_t data_buffer_size;
         /// must be power of 2 multiple of pageSize (or 0)
         size_t aux_buffer_size;
+        /// the most frame data in the agent's IPC send queue (or 0 for no limit)
+        size_t ipc_queue_size;
     };
 
     using data_word_t = std::uint64_t;
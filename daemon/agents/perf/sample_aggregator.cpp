@@ -0,0 +1,293 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "agents/perf/sample_aggregator.h"
+
+#include "agents/perf/perf_data_records.h"
+#include "k/perf_event.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace agents::perf {
+    namespace {
+        constexpr std::size_t word_size = sizeof(std::uint64_t);
+
+        /** The fields that every aggregated sample starts with, in this order (after the header) */
+        constexpr std::uint64_t required_sample_fields =
+            PERF_SAMPLE_IDENTIFIER | PERF_SAMPLE_IP | PERF_SAMPLE_TID | PERF_SAMPLE_TIME;
+        /** Counter values and tracepoint data must reach the host as they are */
+        constexpr std::uint64_t excluded_sample_fields = PERF_SAMPLE_READ | PERF_SAMPLE_RAW;
+
+        constexpr std::size_t ip_index = 2;
+        constexpr std::size_t tid_index = 3;
+        constexpr std::size_t time_index = 4;
+
+        /** The sample fields that follow the time and precede the period, each of which is one word */
+        constexpr std::uint64_t pre_period_sample_fields[] = {
+            PERF_SAMPLE_ADDR,
+            PERF_SAMPLE_ID,
+            PERF_SAMPLE_STREAM_ID,
+            PERF_SAMPLE_CPU,
+        };
+
+        [[nodiscard]] std::uint64_t read_word(char const * data, std::size_t index)
+        {
+            std::uint64_t result;
+            std::memcpy(&result, data + (index * word_size), word_size);
+            return result;
+        }
+
+        void append_bytes(std::vector<char> & output, void const * data, std::size_t size)
+        {
+            auto const * bytes = static_cast<char const *>(data);
+            output.insert(output.end(), bytes, bytes + size);
+        }
+    }
+
+    sample_aggregation_state_t::sample_aggregation_state_t(event_configuration_t const & configuration,
+                                                           std::chrono::nanoseconds window)
+        : window_ns(std::max<std::uint64_t>(1, window.count()))
+    {
+        for_each_event_definition(configuration, [this](event_definition_t const & event) {
+            auto const sample_type = event.attr.sample_type;
+
+            if (((sample_type & required_sample_fields) != required_sample_fields)
+                || ((sample_type & excluded_sample_fields) != 0)) {
+                return;
+            }
+
+            std::size_t index = time_index + 1;
+            for (auto field : pre_period_sample_fields) {
+                if ((sample_type & field) != 0) {
+                    index += 1;
+                }
+            }
+
+            std::size_t period_index = 0;
+            if ((sample_type & PERF_SAMPLE_PERIOD) != 0) {
+                period_index = index;
+                index += 1;
+            }
+
+            key_formats.emplace(event.key,
+                                sample_format_t {period_index,
+                                                 ((sample_type & PERF_SAMPLE_CALLCHAIN) != 0 ? index : 0)});
+        });
+    }
+
+    void sample_aggregation_state_t::add_ids(std::vector<std::pair<perf_event_id_t, gator_key_t>> const & mappings)
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        bool added = false;
+        for (auto const & [id, key] : mappings) {
+            auto it = key_formats.find(key);
+            if (it != key_formats.end()) {
+                id_formats[static_cast<std::uint64_t>(id)] = it->second;
+                added = true;
+            }
+        }
+
+        if (added) {
+            version.fetch_add(1, std::memory_order_acq_rel);
+        }
+    }
+
+    void sample_aggregation_state_t::copy_formats(std::unordered_map<std::uint64_t, sample_format_t> & formats) const
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        formats = id_formats;
+    }
+
+    std::size_t sample_aggregator_t::key_hash_t::operator()(std::vector<std::uint64_t> const & key) const
+    {
+        // FNV-1a over the words, which is sufficient as the table compares the whole key on a match
+        std::uint64_t hash = 0xcbf29ce484222325ULL;
+        for (auto word : key) {
+            hash = (hash ^ word) * 0x100000001b3ULL;
+        }
+        return std::size_t(hash ^ (hash >> 32));
+    }
+
+    sample_aggregation_state_t::sample_format_t const * sample_aggregator_t::find_format(std::uint64_t id)
+    {
+        auto it = formats.find(id);
+        if (it != formats.end()) {
+            return &it->second;
+        }
+
+        // refresh the local copy only when some new id was added since it was taken
+        auto const version = state->get_version();
+        if (version == formats_version) {
+            return nullptr;
+        }
+
+        formats_version = version;
+        state->copy_formats(formats);
+
+        it = formats.find(id);
+        return (it != formats.end() ? &it->second : nullptr);
+    }
+
+    void sample_aggregator_t::aggregate(lib::Span<char const> first_span,
+                                        lib::Span<char const> second_span,
+                                        std::vector<char> & records,
+                                        std::vector<std::vector<std::uint64_t>> & windows)
+    {
+        records.clear();
+        records.reserve(first_span.size() + second_span.size());
+        windows.clear();
+
+        for_each_perf_data_record(first_span, second_span, split_record, records, [&](lib::Span<char const> record) {
+            aggregate_record(record, records, windows);
+        });
+    }
+
+    void sample_aggregator_t::aggregate_record(lib::Span<char const> record,
+                                               std::vector<char> & records,
+                                               std::vector<std::vector<std::uint64_t>> & windows)
+    {
+        perf_event_header header;
+        std::memcpy(&header, record.data(), sizeof(header));
+
+        std::size_t const words = record.size() / word_size;
+
+        if ((header.type != PERF_RECORD_SAMPLE) || (header.size != record.size()) || (words <= time_index)) {
+            return append_bytes(records, record.data(), record.size());
+        }
+
+        auto const id = read_word(record.data(), 1);
+        auto const * format = find_format(id);
+        if ((format == nullptr) || (format->period_index >= words) || (format->callchain_index >= words)) {
+            return append_bytes(records, record.data(), record.size());
+        }
+
+        std::uint64_t nr = 0;
+        if (format->callchain_index != 0) {
+            nr = read_word(record.data(), format->callchain_index);
+            if (nr >= (words - format->callchain_index)) {
+                return append_bytes(records, record.data(), record.size());
+            }
+        }
+
+        auto const time = read_word(record.data(), time_index);
+        auto const period = (format->period_index != 0 ? read_word(record.data(), format->period_index) : 0);
+
+        current_key.resize(3 + nr);
+        current_key[0] = id;
+        current_key[1] = read_word(record.data(), tid_index);
+        current_key[2] = read_word(record.data(), ip_index);
+        if (nr != 0) {
+            std::memcpy(current_key.data() + 3,
+                        record.data() + ((format->callchain_index + 1) * word_size),
+                        nr * word_size);
+        }
+
+        if ((!entries.empty()) && (time >= window_start) && ((time - window_start) >= state->get_window_ns())) {
+            close_window(windows);
+        }
+
+        auto it = entries.find(current_key);
+        if (it == entries.end()) {
+            auto const words_needed = entry_header_words + current_key.size();
+            if ((!entries.empty()) && ((entry_words + words_needed) > max_entry_words)) {
+                close_window(windows);
+            }
+
+            if (entries.empty()) {
+                window_start = time;
+                window_end = time;
+            }
+
+            it = entries.emplace(current_key, entry_t {0, 0}).first;
+            entry_words += words_needed;
+            stats.entries += 1;
+        }
+
+        it->second.count += 1;
+        it->second.period += period;
+
+        window_end = std::max(window_end, time);
+        stats.samples += 1;
+
+        if (words <= max_exemplar_words) {
+            sample_exemplar(record);
+        }
+    }
+
+    void sample_aggregator_t::sample_exemplar(lib::Span<char const> record)
+    {
+        exemplar_candidates += 1;
+
+        std::vector<std::uint64_t> * exemplar;
+        if (exemplars.size() < max_exemplars) {
+            exemplar = &exemplars.emplace_back();
+        }
+        else {
+            // replace a random exemplar, so that each candidate is equally likely to be kept (algorithm R)
+            auto const index = next_random() % exemplar_candidates;
+            if (index >= max_exemplars) {
+                return;
+            }
+            exemplar = &exemplars[index];
+        }
+
+        exemplar->resize(record.size() / word_size);
+        std::memcpy(exemplar->data(), record.data(), exemplar->size() * word_size);
+    }
+
+    std::uint64_t sample_aggregator_t::next_random()
+    {
+        // xorshift64; the quality is not important, it just must not favour any part of the window
+        random_state ^= random_state << 13;
+        random_state ^= random_state >> 7;
+        random_state ^= random_state << 17;
+        return random_state;
+    }
+
+    void sample_aggregator_t::flush(std::vector<std::vector<std::uint64_t>> & windows)
+    {
+        windows.clear();
+
+        if (!entries.empty()) {
+            close_window(windows);
+        }
+    }
+
+    void sample_aggregator_t::close_window(std::vector<std::vector<std::uint64_t>> & windows)
+    {
+        std::size_t exemplar_words = 0;
+        for (auto const & exemplar : exemplars) {
+            exemplar_words += 1 + exemplar.size();
+        }
+
+        auto & window = windows.emplace_back();
+        window.reserve(window_header_words + entry_words + exemplar_words);
+
+        window.push_back(window_start);
+        window.push_back(window_end);
+
+        window.push_back(entries.size());
+        for (auto const & [key, entry] : entries) {
+            window.push_back(entry.count);
+            window.push_back(entry.period);
+            window.push_back(key.size());
+            window.insert(window.end(), key.begin(), key.end());
+        }
+
+        window.push_back(exemplars.size());
+        for (auto const & exemplar : exemplars) {
+            window.push_back(exemplar.size());
+            window.insert(window.end(), exemplar.begin(), exemplar.end());
+        }
+
+        stats.windows += 1;
+        stats.exemplars += exemplars.size();
+
+        entries.clear();
+        exemplars.clear();
+        entry_words = 0;
+        exemplar_candidates = 0;
+    }
+}
@@ -0,0 +1,166 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#pragma once
+
+#include "agents/perf/events/event_configuration.hpp"
+#include "agents/perf/events/types.hpp"
+#include "lib/Span.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace agents::perf {
+    /**
+     * The state shared by the sample aggregators of all the cpus in a capture; the layout of the samples of each event
+     * id, and the length of the aggregation window.
+     *
+     * The ids are added from the capture's strand as the events are opened, whereas the aggregators run on each cpu's
+     * strand, so access to them is serialized by a mutex.
+     */
+    class sample_aggregation_state_t {
+    public:
+        /** Where the fields that are aggregated by are found in a sample, beyond the fixed id, ip, pid/tid and time */
+        struct sample_format_t {
+            /** The offset, in words from the start of the record, of the period, or 0 if there is none */
+            std::size_t period_index;
+            /** The offset, in words from the start of the record, of the callchain's `nr`, or 0 if there is none */
+            std::size_t callchain_index;
+        };
+
+        /**
+         * @param configuration The capture's events; only those whose samples start with their id, ip, pid/tid and
+         * time (PERF_SAMPLE_IDENTIFIER, PERF_SAMPLE_IP, PERF_SAMPLE_TID and PERF_SAMPLE_TIME), and that carry no
+         * counter values or raw data (PERF_SAMPLE_READ or PERF_SAMPLE_RAW) are aggregated
+         * @param window The length of each aggregation window, in sample time
+         */
+        sample_aggregation_state_t(event_configuration_t const & configuration, std::chrono::nanoseconds window);
+
+        /** Record the ids of newly opened events */
+        void add_ids(std::vector<std::pair<perf_event_id_t, gator_key_t>> const & mappings);
+
+        /** @return A value that changes whenever ids are added */
+        [[nodiscard]] std::uint64_t get_version() const { return version.load(std::memory_order_acquire); }
+
+        /** Copy the format of each aggregated id into `formats` */
+        void copy_formats(std::unordered_map<std::uint64_t, sample_format_t> & formats) const;
+
+        [[nodiscard]] std::uint64_t get_window_ns() const { return window_ns; }
+
+    private:
+        std::uint64_t window_ns;
+        std::map<gator_key_t, sample_format_t> key_formats {};
+        mutable std::mutex mutex {};
+        std::unordered_map<std::uint64_t, sample_format_t> id_formats {};
+        std::atomic_uint64_t version {0};
+    };
+
+    /**
+     * Folds the perf sample records into a count per distinct (event id, pid/tid, ip, callchain) for each window of
+     * sample time, which are sent to the host in FrameType::PERF_SAMPLE_AGGREGATES frames rather than sending each
+     * sample. A small reservoir of the window's samples is kept as they were, so that some individual samples can still
+     * be inspected. Records that are not samples, or whose event is not aggregated, are forwarded unchanged.
+     *
+     * Each window is a sequence of words, all of which are packed into the frame:
+     *
+     *  - the time of the window's first and last sample
+     *  - the number of entries, then for each entry; the number of samples, the sum of their periods (or 0 if the
+     *    event has none), the number of key words, and the key words (the id, pid/tid, ip and then callchain `ips[nr]`)
+     *  - the number of exemplars, then for each exemplar; the number of words, and the words of the original record
+     *
+     * A window closes once some sample is at least the window length after its first sample, when the frame would
+     * otherwise become too large, or when flushed (as the cpu's mmap is removed). One aggregator is used per cpu.
+     */
+    class sample_aggregator_t {
+    public:
+        /** The size limit of a window, which keeps the packed frame within 1MiB */
+        static constexpr std::size_t max_window_words = 100 * 1024;
+        /** The number of samples kept as they were in each window */
+        static constexpr std::size_t max_exemplars = 16;
+        /** Samples larger than this are not kept as exemplars */
+        static constexpr std::size_t max_exemplar_words = 512;
+
+        struct stats_t {
+            std::uint64_t samples;
+            std::uint64_t windows;
+            std::uint64_t entries;
+            std::uint64_t exemplars;
+        };
+
+        explicit sample_aggregator_t(std::shared_ptr<sample_aggregation_state_t> state) : state(std::move(state)) {}
+
+        /**
+         * Aggregate the samples in a chunk of whole perf data records
+         *
+         * @param first_span The first part of the records
+         * @param second_span The remainder of the records, which follows on from the first (when the mmap wrapped)
+         * @param records Receives the records that are not aggregated
+         * @param windows Receives the words of each window that closed
+         */
+        void aggregate(lib::Span<char const> first_span,
+                       lib::Span<char const> second_span,
+                       std::vector<char> & records,
+                       std::vector<std::vector<std::uint64_t>> & windows);
+
+        /** Close the current window, if it has any samples */
+        void flush(std::vector<std::vector<std::uint64_t>> & windows);
+
+        [[nodiscard]] stats_t const & get_stats() const { return stats; }
+
+    private:
+        /** The start and end times, and the number of entries and of exemplars */
+        static constexpr std::size_t window_header_words = 4;
+        /** The count, period and size of the key */
+        static constexpr std::size_t entry_header_words = 3;
+        /** The words left for the entries once the largest possible reservoir is accounted for */
+        static constexpr std::size_t max_entry_words =
+            max_window_words - window_header_words - (max_exemplars * (max_exemplar_words + 1));
+
+        struct entry_t {
+            std::uint64_t count;
+            std::uint64_t period;
+        };
+
+        struct key_hash_t {
+            std::size_t operator()(std::vector<std::uint64_t> const & key) const;
+        };
+
+        std::shared_ptr<sample_aggregation_state_t> state;
+        std::uint64_t formats_version = 0;
+        std::unordered_map<std::uint64_t, sample_aggregation_state_t::sample_format_t> formats {};
+        std::unordered_map<std::vector<std::uint64_t>, entry_t, key_hash_t> entries {};
+        std::vector<std::vector<std::uint64_t>> exemplars {};
+        std::uint64_t window_start = 0;
+        std::uint64_t window_end = 0;
+        std::size_t entry_words = 0;
+        /** The number of samples in the window that could have been an exemplar */
+        std::uint64_t exemplar_candidates = 0;
+        std::uint64_t random_state = 0x9e3779b97f4a7c15ULL;
+        /** Reused for the lookup of each sample's key */
+        std::vector<std::uint64_t> current_key {};
+        /** Reused for a record that is split across the two spans */
+        std::vector<char> split_record {};
+        stats_t stats {0, 0, 0, 0};
+
+        [[nodiscard]] sample_aggregation_state_t::sample_format_t const * find_format(std::uint64_t id);
+
+        void aggregate_record(lib::Span<char const> record,
+                              std::vector<char> & records,
+                              std::vector<std::vector<std::uint64_t>> & windows);
+
+        /** Append the current window to `windows` and start a new one */
+        void close_window(std::vector<std::vector<std::uint64_t>> & windows);
+
+        /** Keep the record in the reservoir with a probability of max_exemplars / exemplar_candidates */
+        void sample_exemplar(lib::Span<char const> record);
+
+        [[nodiscard]] std::uint64_t next_random();
+    };
+}
@@ -0,0 +1,128 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "agents/perf/sample_pid_filter.h"
+
+#include "agents/perf/perf_data_records.h"
+#include "k/perf_event.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace agents::perf {
+    namespace {
+        constexpr std::size_t word_size = sizeof(std::uint64_t);
+
+        /** The fields that a filtered sample must start with (after the header), optionally with the ip between them */
+        constexpr std::uint64_t required_sample_fields = PERF_SAMPLE_IDENTIFIER | PERF_SAMPLE_TID;
+        /** Counter values and tracepoint data must reach the host, whichever process they are from */
+        constexpr std::uint64_t excluded_sample_fields = PERF_SAMPLE_READ | PERF_SAMPLE_RAW;
+
+        /** The fixed fields of PERF_RECORD_FORK, which follow the header */
+        struct fork_fields_t {
+            std::uint32_t pid;
+            std::uint32_t ppid;
+            std::uint32_t tid;
+            std::uint32_t ptid;
+        };
+
+        void append_bytes(std::vector<char> & output, void const * data, std::size_t size)
+        {
+            auto const * bytes = static_cast<char const *>(data);
+            output.insert(output.end(), bytes, bytes + size);
+        }
+    }
+
+    sample_pid_filter_t::sample_pid_filter_t(event_configuration_t const & configuration, std::set<pid_t> pids)
+        : pids(std::move(pids))
+    {
+        for_each_event_definition(configuration, [this](event_definition_t const & event) {
+            auto const sample_type = event.attr.sample_type;
+
+            if (((sample_type & required_sample_fields) != required_sample_fields)
+                || ((sample_type & excluded_sample_fields) != 0)) {
+                return;
+            }
+
+            // the header, the identifier and (if present) the ip precede the pid/tid
+            key_pid_offsets.emplace(event.key, ((sample_type & PERF_SAMPLE_IP) != 0 ? 3 : 2));
+        });
+    }
+
+    void sample_pid_filter_t::add_ids(std::vector<std::pair<perf_event_id_t, gator_key_t>> const & mappings)
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        for (auto const & [id, key] : mappings) {
+            auto it = key_pid_offsets.find(key);
+            if (it != key_pid_offsets.end()) {
+                id_pid_offsets[static_cast<std::uint64_t>(id)] = it->second;
+            }
+        }
+    }
+
+    void sample_pid_filter_t::filter(lib::Span<char const> first_span,
+                                     lib::Span<char const> second_span,
+                                     std::vector<char> & records)
+    {
+        records.clear();
+        records.reserve(first_span.size() + second_span.size());
+
+        std::lock_guard<std::mutex> lock {mutex};
+
+        for_each_perf_data_record(first_span, second_span, split_record, records, [&](lib::Span<char const> record) {
+            if (keep_record(record)) {
+                append_bytes(records, record.data(), record.size());
+            }
+        });
+    }
+
+    sample_pid_filter_t::stats_t sample_pid_filter_t::get_stats() const
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        return stats;
+    }
+
+    bool sample_pid_filter_t::keep_record(lib::Span<char const> record)
+    {
+        perf_event_header header;
+        std::memcpy(&header, record.data(), sizeof(header));
+
+        // follow the new processes of the profiled ones; a new thread has its parent's pid, so is already kept
+        if ((header.type == PERF_RECORD_FORK) && (record.size() >= (sizeof(header) + sizeof(fork_fields_t)))) {
+            fork_fields_t fields;
+            std::memcpy(&fields, record.data() + sizeof(header), sizeof(fields));
+
+            if ((fields.pid != fields.ppid) && (pids.count(pid_t(fields.ppid)) > 0)
+                && pids.insert(pid_t(fields.pid)).second) {
+                stats.followed_children += 1;
+            }
+            return true;
+        }
+
+        if ((header.type != PERF_RECORD_SAMPLE) || (record.size() < (3 * word_size))) {
+            return true;
+        }
+
+        std::uint64_t id;
+        std::memcpy(&id, record.data() + word_size, sizeof(id));
+
+        auto it = id_pid_offsets.find(id);
+        if ((it == id_pid_offsets.end()) || (((it->second + 1) * word_size) > record.size())) {
+            return true;
+        }
+
+        // the pid is the first u32 of the pid/tid word
+        std::uint32_t pid;
+        std::memcpy(&pid, record.data() + (it->second * word_size), sizeof(pid));
+
+        if (pids.count(pid_t(pid)) > 0) {
+            stats.kept_samples += 1;
+            return true;
+        }
+
+        stats.dropped_samples += 1;
+        stats.dropped_bytes += record.size();
+        return false;
+    }
+}
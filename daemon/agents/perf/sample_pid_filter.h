@@ -0,0 +1,79 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#pragma once
+
+#include "agents/perf/events/event_configuration.hpp"
+#include "agents/perf/events/types.hpp"
+#include "lib/Span.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <sys/types.h>
+
+namespace agents::perf {
+    /**
+     * Drops the perf samples of the processes that are not being profiled when a system-wide capture is made with
+     * --pid, so that the samples of every other process on the system are not sent to the host only to be filtered
+     * out there. The children of the profiled processes are followed through their PERF_RECORD_FORK records, although
+     * any samples of a child that are drained (from some other cpu's mmap) before its fork record is seen are dropped.
+     *
+     * Only the samples of events that start with their id (PERF_SAMPLE_IDENTIFIER) and have the pid/tid
+     * (PERF_SAMPLE_TID) are filtered. The samples of tracepoints (such as sched_switch, which the thread views are
+     * built from) and those that carry counter values (PERF_SAMPLE_READ) are always kept, as are the records that are
+     * not samples.
+     *
+     * The filter is shared by all the cpus, as the forks on one cpu change what is kept on the others. The ids are
+     * added from the capture's strand as the events are opened, whereas the data is filtered from each cpu's strand,
+     * so access is serialized by a mutex.
+     */
+    class sample_pid_filter_t {
+    public:
+        struct stats_t {
+            std::uint64_t kept_samples;
+            std::uint64_t dropped_samples;
+            std::uint64_t dropped_bytes;
+            /** The number of processes that were added as children of some profiled process */
+            std::uint64_t followed_children;
+        };
+
+        /**
+         * @param configuration The capture's events
+         * @param pids The processes whose samples are kept
+         */
+        sample_pid_filter_t(event_configuration_t const & configuration, std::set<pid_t> pids);
+
+        /** Record the ids of newly opened events */
+        void add_ids(std::vector<std::pair<perf_event_id_t, gator_key_t>> const & mappings);
+
+        /**
+         * Filter a chunk of whole perf data records
+         *
+         * @param first_span The first part of the records
+         * @param second_span The remainder of the records, which follows on from the first (when the mmap wrapped)
+         * @param records Receives the records that are kept
+         */
+        void filter(lib::Span<char const> first_span, lib::Span<char const> second_span, std::vector<char> & records);
+
+        [[nodiscard]] stats_t get_stats() const;
+
+    private:
+        /** The offset, in words from the start of the record, of the pid/tid word, for each key that is filtered */
+        std::map<gator_key_t, std::size_t> key_pid_offsets {};
+        mutable std::mutex mutex {};
+        std::unordered_map<std::uint64_t, std::size_t> id_pid_offsets {};
+        std::set<pid_t> pids;
+        /** Reused for a record that is split across the two spans */
+        std::vector<char> split_record {};
+        stats_t stats {0, 0, 0, 0};
+
+        /** @return True if the record is to be kept */
+        [[nodiscard]] bool keep_record(lib::Span<char const> record);
+    };
+}
@@ -0,0 +1,114 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "agents/perf/sample_pid_tracker.h"
+
+#include "k/perf_event.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace agents::perf {
+    namespace {
+        constexpr std::size_t word_size = sizeof(std::uint64_t);
+
+        /** Reads the words of a chunk of records that is split into two spans */
+        class split_chunk_reader_t {
+        public:
+            split_chunk_reader_t(lib::Span<char const> first_span, lib::Span<char const> second_span)
+                : first_span(first_span), second_span(second_span)
+            {
+            }
+
+            [[nodiscard]] std::size_t size() const { return first_span.size() + second_span.size(); }
+
+            /** @return The word at `offset` bytes from the start of the chunk (which must be word aligned) */
+            [[nodiscard]] std::uint64_t read_word(std::size_t offset) const
+            {
+                std::uint64_t result;
+                if (offset < first_span.size()) {
+                    std::memcpy(&result, first_span.data() + offset, word_size);
+                }
+                else {
+                    std::memcpy(&result, second_span.data() + (offset - first_span.size()), word_size);
+                }
+                return result;
+            }
+
+        private:
+            lib::Span<char const> first_span;
+            lib::Span<char const> second_span;
+        };
+    }
+
+    sample_pid_tracker_t::sample_pid_tracker_t(event_configuration_t const & configuration)
+    {
+        for_each_event_definition(configuration, [this](event_definition_t const & event) {
+            auto const sample_type = event.attr.sample_type;
+
+            // only the samples that have some pc to symbolize, and whose id is at a fixed position
+            if (((sample_type & PERF_SAMPLE_IP) == 0) || ((sample_type & PERF_SAMPLE_TID) == 0)
+                || ((sample_type & PERF_SAMPLE_IDENTIFIER) == 0)) {
+                return;
+            }
+
+            // the header, the identifier and the ip precede the pid/tid
+            key_pid_offsets.emplace(event.key, 3);
+        });
+    }
+
+    void sample_pid_tracker_t::add_ids(std::vector<std::pair<perf_event_id_t, gator_key_t>> const & mappings)
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        for (auto const & [id, key] : mappings) {
+            auto it = key_pid_offsets.find(key);
+            if (it != key_pid_offsets.end()) {
+                id_pid_offsets[static_cast<std::uint64_t>(id)] = it->second;
+            }
+        }
+    }
+
+    void sample_pid_tracker_t::scan(lib::Span<char const> first_span, lib::Span<char const> second_span)
+    {
+        split_chunk_reader_t const reader {first_span, second_span};
+
+        std::lock_guard<std::mutex> lock {mutex};
+
+        // consecutive samples are usually from the same process, so skip the lookup for those
+        pid_t last_pid = -1;
+
+        for (std::size_t offset = 0; offset < reader.size();) {
+            perf_event_header header;
+            auto const header_word = reader.read_word(offset);
+            std::memcpy(&header, &header_word, sizeof(header));
+
+            auto const record_size = std::max<std::size_t>(word_size, (header.size + word_size - 1) & ~(word_size - 1));
+
+            if ((header.type == PERF_RECORD_SAMPLE) && (record_size >= (4 * word_size))) {
+                auto it = id_pid_offsets.find(reader.read_word(offset + word_size));
+                if ((it != id_pid_offsets.end()) && ((it->second + 1) * word_size <= record_size)) {
+                    // the pid is the first u32 of the pid/tid word
+                    auto const pid_tid = reader.read_word(offset + (it->second * word_size));
+                    std::uint32_t pid;
+                    std::memcpy(&pid, &pid_tid, sizeof(pid));
+
+                    if ((pid_t(pid) != last_pid) && (pid != 0)) {
+                        last_pid = pid_t(pid);
+                        if (seen_pids.insert(last_pid).second) {
+                            new_pids.push_back(last_pid);
+                        }
+                    }
+                }
+            }
+
+            offset += record_size;
+        }
+    }
+
+    std::vector<pid_t> sample_pid_tracker_t::take_new_pids()
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        return std::exchange(new_pids, {});
+    }
+}
@@ -0,0 +1,55 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#pragma once
+
+#include "agents/perf/events/event_configuration.hpp"
+#include "agents/perf/events/types.hpp"
+#include "lib/Span.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <sys/types.h>
+
+namespace agents::perf {
+    /**
+     * Finds the processes that appear in the perf samples, so that the contents of their `maps` file need only be sent
+     * for those processes that have some sample to be symbolized, rather than for every process on the system.
+     *
+     * Only the samples of events that record both the IP and the TID, and that start with their id
+     * (PERF_SAMPLE_IDENTIFIER) are considered. The ids are added from the capture's strand as the events are opened,
+     * whereas the data is scanned from the buffer consumer, so access is serialized by a mutex.
+     */
+    class sample_pid_tracker_t {
+    public:
+        explicit sample_pid_tracker_t(event_configuration_t const & configuration);
+
+        /** Record the ids of newly opened events */
+        void add_ids(std::vector<std::pair<perf_event_id_t, gator_key_t>> const & mappings);
+
+        /**
+         * Find the pids of the samples in a chunk of whole perf data records
+         *
+         * @param first_span The first part of the records
+         * @param second_span The remainder of the records, which follows on from the first (when the mmap wrapped)
+         */
+        void scan(lib::Span<char const> first_span, lib::Span<char const> second_span);
+
+        /** @return The pids that were first seen since the last call */
+        [[nodiscard]] std::vector<pid_t> take_new_pids();
+
+    private:
+        /** The offset, in words from the start of the record, of the pid/tid word, for each key that has one */
+        std::map<gator_key_t, std::size_t> key_pid_offsets {};
+        std::mutex mutex {};
+        std::unordered_map<std::uint64_t, std::size_t> id_pid_offsets {};
+        std::set<pid_t> seen_pids {};
+        std::vector<pid_t> new_pids {};
+    };
+}
@@ -4,6 +4,7 @@
 #include "ExitStatus.h"
 #include "ISender.h"
 #include "Logging.h"
+#include "OneShotBudget.h"
 #include "Time.h"
 #include "agents/perf/perf_agent_worker.h"
 #include "lib/Assert.h"
@@ -127,6 +128,11 @@ namespace agents::perf {
         auto const length = frame.size();
         runtime_assert(length <= ISender::MAX_RESPONSE_LENGTH, "too large apc_frame msg received");
 
+        if (!gOneShotBudget.consume(length)) {
+            // the one-shot capture is full
+            return;
+        }
+
         sender.writeData(frame.data(), static_cast<int>(length), ResponseType::APC_DATA);
     }
 
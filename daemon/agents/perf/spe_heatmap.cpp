@@ -0,0 +1,153 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "agents/perf/spe_heatmap.h"
+
+#include <algorithm>
+#include <functional>
+#include <utility>
+
+namespace agents::perf {
+    namespace {
+        /** The timestamps, block size, record counts, number of buckets and number of data sources */
+        constexpr std::size_t window_header_words = 8;
+        /** The words of each entry */
+        constexpr std::size_t entry_words = 7;
+
+        [[nodiscard]] std::size_t bucket_index(std::uint32_t latency)
+        {
+            std::size_t index = 0;
+            while ((latency != 0) && (index < (spe_heatmap_t::number_of_buckets - 1))) {
+                latency >>= 1;
+                index += 1;
+            }
+            return index;
+        }
+
+        [[nodiscard]] std::size_t combine(std::size_t hash, std::uint64_t value)
+        {
+            return hash ^ (std::hash<std::uint64_t> {}(value) + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2));
+        }
+    }
+
+    std::size_t spe_heatmap_t::key_hash_t::operator()(key_t const & key) const
+    {
+        std::size_t hash = std::hash<std::uint64_t> {}(key.address);
+        hash = combine(hash, key.context);
+        hash = combine(hash, key.pc);
+        hash = combine(hash, key.data_source);
+        return combine(hash, key.bucket);
+    }
+
+    void spe_heatmap_t::add(record_t const & record)
+    {
+        if (records == 0) {
+            window_opened = std::chrono::steady_clock::now();
+            first_timestamp = record.timestamp;
+        }
+
+        records += 1;
+        stats.records += 1;
+        last_timestamp = std::max(last_timestamp, record.timestamp);
+
+        // only the loads and stores have a data address
+        if (!record.has_data_address) {
+            return;
+        }
+
+        counted_records += 1;
+
+        // the data source encoding is implementation defined, so limit how many histograms it can create
+        auto data_source = record.data_source;
+        if ((latencies.size() >= max_data_sources) && (latencies.count(data_source) == 0)) {
+            data_source = none;
+        }
+
+        auto const bucket = bucket_index(record.total_latency);
+        latencies[data_source][bucket] += 1;
+
+        key_t const key {record.context,
+                         record.data_address & ~std::uint64_t(config.granularity - 1),
+                         record.pc & ~(pc_page_size - 1),
+                         data_source,
+                         bucket};
+
+        auto it = entries.find(key);
+        if (it == entries.end()) {
+            if (entries.size() >= max_entries) {
+                uncounted_records += 1;
+                return;
+            }
+            it = entries.emplace(key, entry_t {0, 0}).first;
+            stats.entries += 1;
+        }
+
+        it->second.count += 1;
+        it->second.latency += record.total_latency;
+    }
+
+    void spe_heatmap_t::close_if_due(std::chrono::steady_clock::time_point now,
+                                     std::vector<std::vector<std::uint64_t>> & windows)
+    {
+        if ((records > 0) && ((now - window_opened) >= std::chrono::milliseconds(config.window_ms))) {
+            close_window(windows);
+        }
+    }
+
+    void spe_heatmap_t::flush(std::vector<std::vector<std::uint64_t>> & windows)
+    {
+        if (records > 0) {
+            close_window(windows);
+        }
+    }
+
+    void spe_heatmap_t::close_window(std::vector<std::vector<std::uint64_t>> & windows)
+    {
+        // pick the most frequent entries
+        std::vector<std::pair<key_t, entry_t>> top {entries.begin(), entries.end()};
+        auto const top_size = std::min<std::size_t>(top.size(), config.top_entries);
+        std::partial_sort(top.begin(),
+                          top.begin() + top_size,
+                          top.end(),
+                          [](auto const & a, auto const & b) { return a.second.count > b.second.count; });
+        top.resize(top_size);
+
+        auto & window = windows.emplace_back();
+        window.reserve(window_header_words + (latencies.size() * (1 + number_of_buckets)) + 1
+                       + (top.size() * entry_words));
+
+        window.push_back(first_timestamp);
+        window.push_back(last_timestamp);
+        window.push_back(config.granularity);
+        window.push_back(records);
+        window.push_back(counted_records);
+        window.push_back(uncounted_records);
+
+        window.push_back(number_of_buckets);
+        window.push_back(latencies.size());
+        for (auto const & [data_source, buckets] : latencies) {
+            window.push_back(data_source);
+            window.insert(window.end(), buckets.begin(), buckets.end());
+        }
+
+        window.push_back(top.size());
+        for (auto const & [key, entry] : top) {
+            window.push_back(key.context);
+            window.push_back(key.address);
+            window.push_back(key.pc);
+            window.push_back(key.data_source);
+            window.push_back(key.bucket);
+            window.push_back(entry.count);
+            window.push_back(entry.latency);
+        }
+
+        stats.windows += 1;
+
+        entries.clear();
+        latencies.clear();
+        first_timestamp = 0;
+        last_timestamp = 0;
+        records = 0;
+        counted_records = 0;
+        uncounted_records = 0;
+    }
+}
@@ -0,0 +1,123 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#pragma once
+
+#include "Configuration.h"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+namespace agents::perf {
+    /**
+     * Folds the SPE records of one cpu into a memory access heatmap for each window of time; a count per distinct
+     * (context id, block of data address, data source, latency bucket, page of pc), of which only the most frequent
+     * are sent, and a latency histogram per data source, which covers every aggregated record.
+     *
+     * Each window is a sequence of words, all of which are packed into a FrameType::PERF_SPE_HEATMAP frame:
+     *
+     *  - the SPE timestamps of the window's first and last records (which are converted to capture time using the
+     *    PERF_SYNC frames, as for the SPE records themselves)
+     *  - the size of the data address blocks in bytes
+     *  - the number of records, the number of those that had a data address (and so were counted), and the number
+     *    of those that were not counted by entry as the table of entries was full
+     *  - the number of latency buckets, then the number of data sources, then for each data source; the data source
+     *    and the count in each bucket. Bucket 0 counts the records with a total latency of 0 cycles, and bucket n
+     *    counts those with at least 2^(n-1) but less than 2^n cycles (the last bucket also counts any longer ones).
+     *  - the number of entries, then for each entry (most frequent first); the context id, the start of the data
+     *    address block, the start of the pc page, the data source, the latency bucket, the number of records, and the
+     *    sum of their total latencies
+     *
+     * The context id and data source are all ones for the records that have none. A window closes once it has been
+     * open for the configured length of time (as checked after each chunk of aux data), or when flushed.
+     */
+    class spe_heatmap_t {
+    public:
+        static constexpr std::size_t number_of_buckets = 17;
+        /** The most entries counted per window, which bounds the memory used */
+        static constexpr std::size_t max_entries = 64 * 1024;
+        /** The most data sources with a latency histogram; the records of any others are counted as having none */
+        static constexpr std::size_t max_data_sources = 256;
+        /** The size of the pc pages */
+        static constexpr std::uint64_t pc_page_size = 4096;
+        /** Marks a missing context id or data source */
+        static constexpr std::uint64_t none = ~std::uint64_t(0);
+
+        /** The fields of a record that are aggregated by */
+        struct record_t {
+            std::uint64_t timestamp;
+            std::uint64_t context;
+            std::uint64_t data_address;
+            std::uint64_t pc;
+            std::uint64_t data_source;
+            std::uint32_t total_latency;
+            bool has_data_address;
+        };
+
+        struct stats_t {
+            std::uint64_t records;
+            std::uint64_t windows;
+            std::uint64_t entries;
+        };
+
+        explicit spe_heatmap_t(SpeHeatmap config) : config(config) {}
+
+        /** Count one record in the current window */
+        void add(record_t const & record);
+
+        /**
+         * Close the current window if it has been open for long enough
+         *
+         * @param now The current time
+         * @param windows Receives the words of the window, if it closed
+         */
+        void close_if_due(std::chrono::steady_clock::time_point now, std::vector<std::vector<std::uint64_t>> & windows);
+
+        /** Close the current window, if it has any records */
+        void flush(std::vector<std::vector<std::uint64_t>> & windows);
+
+        [[nodiscard]] stats_t const & get_stats() const { return stats; }
+
+    private:
+        struct key_t {
+            std::uint64_t context;
+            std::uint64_t address;
+            std::uint64_t pc;
+            std::uint64_t data_source;
+            std::uint64_t bucket;
+
+            [[nodiscard]] bool operator==(key_t const & that) const
+            {
+                return (context == that.context) && (address == that.address) && (pc == that.pc)
+                    && (data_source == that.data_source) && (bucket == that.bucket);
+            }
+        };
+
+        struct key_hash_t {
+            std::size_t operator()(key_t const & key) const;
+        };
+
+        struct entry_t {
+            std::uint64_t count;
+            std::uint64_t latency;
+        };
+
+        SpeHeatmap config;
+        std::unordered_map<key_t, entry_t, key_hash_t> entries {};
+        /** By data source */
+        std::map<std::uint64_t, std::array<std::uint64_t, number_of_buckets>> latencies {};
+        std::chrono::steady_clock::time_point window_opened {};
+        std::uint64_t first_timestamp = 0;
+        std::uint64_t last_timestamp = 0;
+        std::uint64_t records = 0;
+        std::uint64_t counted_records = 0;
+        std::uint64_t uncounted_records = 0;
+        stats_t stats {0, 0, 0};
+
+        void close_window(std::vector<std::vector<std::uint64_t>> & windows);
+    };
+}
@@ -0,0 +1,258 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "agents/perf/spe_record_filter.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace agents::perf {
+    namespace {
+        // The packet header encodings, from the Arm ARM (Statistical Profiling Extension, "Packet formats")
+        constexpr std::uint8_t header_pad = 0x00;
+        constexpr std::uint8_t header_end = 0x01;
+        constexpr std::uint8_t header_timestamp = 0x71;
+        constexpr std::uint8_t header_extended_mask = 0xfc;
+        constexpr std::uint8_t header_extended = 0x20;
+        constexpr std::uint8_t header_events_mask = 0xcf;
+        constexpr std::uint8_t header_events = 0x42;
+        constexpr std::uint8_t header_op_type_mask = 0xfc;
+        constexpr std::uint8_t header_op_type = 0x48;
+        constexpr std::uint8_t header_indexed_mask = 0xf8;
+        constexpr std::uint8_t header_address = 0xb0;
+        constexpr std::uint8_t header_counter = 0x98;
+        constexpr std::uint8_t header_data_source_mask = 0xcf;
+        constexpr std::uint8_t header_data_source = 0x43;
+        constexpr std::uint8_t header_context_mask = 0xfc;
+        constexpr std::uint8_t header_context = 0x64;
+
+        constexpr unsigned address_index_pc = 0;
+        constexpr unsigned address_index_data_virtual = 2;
+        constexpr unsigned counter_index_total_latency = 0;
+        constexpr std::uint8_t op_class_load_store = 1;
+        constexpr std::uint8_t op_class_branch = 2;
+        constexpr std::uint8_t op_subclass_store = 0x1;
+
+        /** The virtual address occupies the bottom 56 bits of the payload, and is sign extended from bit 55 */
+        constexpr std::uint64_t address_mask = (std::uint64_t(1) << 56) - 1;
+        constexpr std::uint64_t address_sign_bit = (std::uint64_t(1) << 55);
+
+        /** Access to two spans as though they were one */
+        class split_span_t {
+        public:
+            split_span_t(lib::Span<char const> first, lib::Span<char const> second) : first(first), second(second) {}
+
+            [[nodiscard]] std::size_t size() const { return first.size() + second.size(); }
+
+            [[nodiscard]] std::uint8_t operator[](std::size_t index) const
+            {
+                return static_cast<std::uint8_t>(index < first.size() ? first[index] : second[index - first.size()]);
+            }
+
+            /** Read a little endian value of up to 8 bytes */
+            [[nodiscard]] std::uint64_t read(std::size_t index, std::size_t size) const
+            {
+                std::uint64_t result = 0;
+                for (std::size_t n = 0; n < size; ++n) {
+                    result |= std::uint64_t((*this)[index + n]) << (n * 8);
+                }
+                return result;
+            }
+
+            void copy(std::size_t begin, std::size_t end, std::vector<char> & output) const
+            {
+                if (begin < first.size()) {
+                    auto const first_end = std::min(end, first.size());
+                    output.insert(output.end(), first.data() + begin, first.data() + first_end);
+                    begin = first_end;
+                }
+                if (begin < end) {
+                    output.insert(output.end(),
+                                  second.data() + (begin - first.size()),
+                                  second.data() + (end - first.size()));
+                }
+            }
+
+        private:
+            lib::Span<char const> first;
+            lib::Span<char const> second;
+        };
+
+        /** The size is encoded in bits 5:4 of the (last) header byte as a power of two bytes */
+        constexpr std::size_t get_payload_size(std::uint8_t header)
+        {
+            return std::size_t(1) << ((header >> 4) & 0x3);
+        }
+    }
+
+    std::size_t spe_record_filter_t::filter_records(lib::Span<char const> first_span,
+                                                    lib::Span<char const> second_span,
+                                                    std::vector<char> & output,
+                                                    std::vector<std::vector<std::uint64_t>> & heatmap_windows)
+    {
+        split_span_t const data {first_span, second_span};
+        std::size_t const total = data.size();
+
+        std::size_t record_start = 0;
+        std::size_t position = 0;
+        record_t record {};
+
+        auto const end_record = [&]() {
+            auto const size = position - record_start;
+            if (passes(record) && (!heatmap || aggregate(record))) {
+                data.copy(record_start, position, output);
+                stats.forwarded_records += 1;
+                stats.forwarded_bytes += size;
+            }
+            else {
+                stats.dropped_records += 1;
+                stats.dropped_bytes += size;
+            }
+            record_start = position;
+            record = {};
+        };
+
+        while (position < total) {
+            std::uint8_t header = data[position];
+            std::size_t header_size = 1;
+
+            if (header == header_pad) {
+                position += 1;
+                continue;
+            }
+
+            if (header == header_end) {
+                position += 1;
+                end_record();
+                continue;
+            }
+
+            unsigned index = 0;
+            if ((header & header_extended_mask) == header_extended) {
+                if (position + 1 >= total) {
+                    break;
+                }
+                index = (header & 0x3) << 3;
+                header = data[position + 1];
+                header_size = 2;
+            }
+
+            auto const payload_size = get_payload_size(header);
+            if (position + header_size + payload_size > total) {
+                break;
+            }
+
+            auto const payload = data.read(position + header_size, payload_size);
+            index |= (header & 0x7);
+
+            if ((header & header_events_mask) == header_events) {
+                record.events = payload;
+            }
+            else if ((header & header_op_type_mask) == header_op_type) {
+                record.op_class = (header & 0x3);
+                record.op_subclass = static_cast<std::uint8_t>(payload);
+                record.has_op = true;
+            }
+            else if (((header & header_indexed_mask) == header_address) && (index == address_index_pc)) {
+                record.pc = payload & address_mask;
+                if ((record.pc & address_sign_bit) != 0) {
+                    record.pc |= ~address_mask;
+                }
+                record.has_pc = true;
+            }
+            else if (((header & header_indexed_mask) == header_address) && (index == address_index_data_virtual)) {
+                record.data_address = payload & address_mask;
+                if ((record.data_address & address_sign_bit) != 0) {
+                    record.data_address |= ~address_mask;
+                }
+                record.has_data_address = true;
+            }
+            else if ((header & header_data_source_mask) == header_data_source) {
+                record.data_source = payload;
+            }
+            else if ((header & header_context_mask) == header_context) {
+                record.context = payload;
+            }
+            else if (((header & header_indexed_mask) == header_counter) && (index == counter_index_total_latency)) {
+                record.total_latency = static_cast<std::uint32_t>(payload);
+            }
+
+            position += header_size + payload_size;
+
+            if ((header_size == 1) && (header == header_timestamp)) {
+                record.timestamp = payload;
+                end_record();
+            }
+            else if ((position - record_start) > max_record_size) {
+                // not a valid record, so discard what there is of it
+                stats.dropped_bytes += (position - record_start);
+                record_start = position;
+                record = {};
+            }
+        }
+
+        if (heatmap) {
+            heatmap->close_if_due(std::chrono::steady_clock::now(), heatmap_windows);
+        }
+
+        return record_start;
+    }
+
+    void spe_record_filter_t::flush(std::vector<std::vector<std::uint64_t>> & heatmap_windows)
+    {
+        if (heatmap) {
+            heatmap->flush(heatmap_windows);
+        }
+    }
+
+    bool spe_record_filter_t::aggregate(record_t const & record)
+    {
+        heatmap->add({record.timestamp,
+                      record.context,
+                      record.data_address,
+                      record.pc,
+                      record.data_source,
+                      record.total_latency,
+                      record.has_data_address});
+
+        auto const raw_interval = filter.heatmap.raw_interval;
+        return (raw_interval > 0) && ((aggregated_records++ % raw_interval) == 0);
+    }
+
+    bool spe_record_filter_t::passes(record_t const & record)
+    {
+        if ((filter.min_latency > 0) && (record.total_latency < std::uint32_t(filter.min_latency))) {
+            return false;
+        }
+
+        if ((filter.event_mask != 0) && ((record.events & filter.event_mask) == 0)) {
+            return false;
+        }
+
+        if (!filter.ops.empty()) {
+            bool const is_load_store = record.has_op && (record.op_class == op_class_load_store);
+            bool const is_store = is_load_store && ((record.op_subclass & op_subclass_store) != 0);
+            bool const is_branch = record.has_op && (record.op_class == op_class_branch);
+
+            if (!((is_load_store && !is_store && (filter.ops.count(SpeOps::LOAD) > 0))
+                  || (is_store && (filter.ops.count(SpeOps::STORE) > 0))
+                  || (is_branch && (filter.ops.count(SpeOps::BRANCH) > 0)))) {
+                return false;
+            }
+        }
+
+        if (!filter.pc_ranges.empty()) {
+            if (!record.has_pc) {
+                return false;
+            }
+            auto const in_range = [pc = record.pc](SpeAddressRange const & range) {
+                return (pc >= range.start) && (pc <= range.end);
+            };
+            if (std::none_of(filter.pc_ranges.begin(), filter.pc_ranges.end(), in_range)) {
+                return false;
+            }
+        }
+
+        // of those that match, keep the first and then every decimation'th one
+        return ((passed_records++ % std::max<std::uint32_t>(filter.decimation, 1)) == 0);
+    }
+}
@@ -0,0 +1,101 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#pragma once
+
+#include "Configuration.h"
+#include "agents/perf/spe_heatmap.h"
+#include "lib/Span.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace agents::perf {
+    /**
+     * Decodes the SPE records in the aux data of one cpu and removes those rejected by a SpeRecordFilter, so that only
+     * the remainder is sent to the host.
+     *
+     * A record is every byte from the end of the previous record up to and including its END or TIMESTAMP packet, so
+     * any padding is kept with the record that follows it and the kept records are forwarded byte for byte.
+     *
+     * When the filter has a heatmap, the kept records are aggregated into it instead, and only one in every
+     * `raw_interval` of them (if any) is also forwarded.
+     */
+    class spe_record_filter_t {
+    public:
+        /** Records longer than this cannot be valid, so are discarded rather than waiting for them to end */
+        static constexpr std::size_t max_record_size = 4096;
+
+        struct stats_t {
+            std::uint64_t forwarded_records;
+            std::uint64_t dropped_records;
+            std::uint64_t forwarded_bytes;
+            std::uint64_t dropped_bytes;
+        };
+
+        explicit spe_record_filter_t(SpeRecordFilter filter) : filter(std::move(filter))
+        {
+            if (this->filter.heatmap.isEnabled()) {
+                heatmap.emplace(this->filter.heatmap);
+            }
+        }
+
+        /**
+         * Filter the whole records at the start of some aux data
+         *
+         * @param first_span The first part of the aux data
+         * @param second_span The remainder of the aux data, which follows on from the first (when the aux buffer wrapped)
+         * @param output Receives the bytes of the records that were kept
+         * @param heatmap_windows Receives the words of each heatmap window that closed
+         * @return The number of bytes consumed; any partial record at the end is not consumed, unless it is longer than
+         * max_record_size
+         */
+        std::size_t filter_records(lib::Span<char const> first_span,
+                                   lib::Span<char const> second_span,
+                                   std::vector<char> & output,
+                                   std::vector<std::vector<std::uint64_t>> & heatmap_windows);
+
+        /** Close the current heatmap window, if there is a heatmap and the window has any records */
+        void flush(std::vector<std::vector<std::uint64_t>> & heatmap_windows);
+
+        /** @return The heatmap, or nullptr if the records are not aggregated */
+        [[nodiscard]] spe_heatmap_t const * get_heatmap() const { return (heatmap ? &*heatmap : nullptr); }
+
+        /** @return The offset in the forwarded stream of the next byte to be forwarded */
+        [[nodiscard]] std::uint64_t get_output_offset() const { return stats.forwarded_bytes; }
+
+        [[nodiscard]] stats_t const & get_stats() const { return stats; }
+
+    private:
+        /** The fields of a record that are filtered on */
+        struct record_t {
+            std::uint64_t events = 0;
+            std::uint64_t pc = 0;
+            std::uint64_t data_address = 0;
+            std::uint64_t timestamp = 0;
+            std::uint64_t context = spe_heatmap_t::none;
+            std::uint64_t data_source = spe_heatmap_t::none;
+            std::uint32_t total_latency = 0;
+            std::uint8_t op_class = 0;
+            std::uint8_t op_subclass = 0;
+            bool has_pc = false;
+            bool has_data_address = false;
+            bool has_op = false;
+        };
+
+        SpeRecordFilter filter;
+        std::optional<spe_heatmap_t> heatmap {};
+        stats_t stats {0, 0, 0, 0};
+        std::uint64_t passed_records = 0;
+        /** The number of records aggregated into the heatmap, of which every raw_interval'th is forwarded */
+        std::uint64_t aggregated_records = 0;
+
+        /** Apply the filter (and the decimation) to a record */
+        [[nodiscard]] bool passes(record_t const & record);
+
+        /** Aggregate a record that passed the filter into the heatmap */
+        [[nodiscard]] bool aggregate(record_t const & record);
+    };
+}
@@ -3,14 +3,16 @@
 #pragma once
 
 #include "BufferUtils.h"
-#include "IRawFrameBuilder.h"
+#include "FixedFrameLayout.h"
 #include "ISender.h"
 #include "Protocol.h"
 #include "agents/perf/async_buffer_builder.h"
+#include "ipc/frame_buffer_pool.h"
 #include "ipc/messages.h"
 #include "ipc/raw_ipc_channel_sink.h"
 #include "linux/perf/PerfSyncThread.h"
 
+#include <chrono>
 #include <cstdint>
 
 namespace agents::perf {
@@ -30,16 +32,24 @@ namespace agents::perf {
          * @param supports_clock_id True if the kernel perf API supports configuring clock_id
          * @param has_spe_configuration True if the user selected at least one SPE configuration
          * @param sink IPC channel to write the resulting APC frame into
+         * @param frame_buffer_pool The pool from which to allocate the frame buffers
+         * @param min_period The least time between sync points (as in the low-wakeup mode), or 0 for the default
          * @return sync_generator instance, or nullptr if supports_clock_id and !has_spe_configuration
          */
         static std::unique_ptr<basic_sync_generator_t> create(bool supports_clock_id,
                                                               bool has_spe_configuration,
-                                                              std::shared_ptr<ipc::raw_ipc_channel_sink_t> sink)
+                                                              std::shared_ptr<ipc::raw_ipc_channel_sink_t> sink,
+                                                              std::shared_ptr<ipc::frame_buffer_pool_t> frame_buffer_pool,
+                                                              std::chrono::nanoseconds min_period = {})
         {
             if (has_spe_configuration || !supports_clock_id) {
                 const bool enable_sync_thread_mode = (!supports_clock_id);
                 const bool read_timer = has_spe_configuration;
-                return std::make_unique<basic_sync_generator_t>(enable_sync_thread_mode, read_timer, std::move(sink));
+                return std::make_unique<basic_sync_generator_t>(enable_sync_thread_mode,
+                                                                read_timer,
+                                                                std::move(sink),
+                                                                std::move(frame_buffer_pool),
+                                                                min_period);
             }
 
             return nullptr;
@@ -51,13 +61,17 @@ namespace agents::perf {
          * @param enable_sync_thread_mode True to enable 'gatord-sync' thread mode
          * @param read_timer True to read the arch timer, false otherwise
          * @param sink IPC channel to write the resulting APC frame into
+         * @param frame_buffer_pool The pool from which to allocate the frame buffers
+         * @param min_period The least time between sync points, or 0 for the default
          */
         basic_sync_generator_t(bool enable_sync_thread_mode,
                                bool read_timer,
-                               std::shared_ptr<ipc::raw_ipc_channel_sink_t> sink)
-            : sink {std::move(sink)}, thread {enable_sync_thread_mode, read_timer, [this](auto... args) {
-                                                  write(args...);
-                                              }}
+                               std::shared_ptr<ipc::raw_ipc_channel_sink_t> sink,
+                               std::shared_ptr<ipc::frame_buffer_pool_t> frame_buffer_pool,
+                               std::chrono::nanoseconds min_period = {})
+            : sink {std::move(sink)},
+              frame_buffer_pool {std::move(frame_buffer_pool)},
+              thread {enable_sync_thread_mode, read_timer, min_period, [this](auto... args) { write(args...); }}
         {
         }
 
@@ -74,39 +88,38 @@ namespace agents::perf {
         void terminate() { thread.terminate(); }
 
     private:
-        static constexpr std::size_t max_sync_buffer_size = IRawFrameBuilder::MAX_FRAME_HEADER_SIZE // Header
-                                                          + buffer_utils::MAXSIZE_PACK32            // Length
-                                                          + buffer_utils::MAXSIZE_PACK32            // CPU (ignored)
-                                                          + buffer_utils::MAXSIZE_PACK32            // pid
-                                                          + buffer_utils::MAXSIZE_PACK32            // tid
-                                                          + buffer_utils::MAXSIZE_PACK64            // freq
-                                                          + buffer_utils::MAXSIZE_PACK64            // monotonic_raw
-                                                          + buffer_utils::MAXSIZE_PACK64;           // vcnt
+        /** The frame type, the cpu (which is ignored), the pid, the tid, the freq, the monotonic_raw and the vcnt */
+        using sync_frame_layout_t = buffer_utils::FixedFrameLayout<buffer_utils::PackedInt32,
+                                                                   buffer_utils::PackedInt32,
+                                                                   buffer_utils::PackedInt32,
+                                                                   buffer_utils::PackedInt32,
+                                                                   buffer_utils::PackedInt64,
+                                                                   buffer_utils::PackedInt64,
+                                                                   buffer_utils::PackedInt64>;
+
+        static constexpr std::size_t max_sync_buffer_size = sync_frame_layout_t::MAX_SIZE;
 
         std::shared_ptr<ipc::raw_ipc_channel_sink_t> sink;
-        std::vector<char> buffer;
+        std::shared_ptr<ipc::frame_buffer_pool_t> frame_buffer_pool;
         SyncThread thread;
 
         void write(pid_t pid, pid_t tid, std::uint64_t freq, std::uint64_t monotonic_raw, std::uint64_t vcnt)
         {
+            auto buffer = frame_buffer_pool->acquire(max_sync_buffer_size);
             buffer.resize(max_sync_buffer_size);
             auto builder = apc_buffer_builder_t(buffer);
 
-            // Begin frame, the size field and other header data will be added
-            // by the receiver
-            builder.beginFrame(FrameType::PERF_SYNC);
-            builder.packInt(0); // just pass CPU == 0, Since Streamline 7.4 it is ignored anyway
-
-            // Write header
-            builder.packInt(pid);
-            builder.packInt(tid);
-            builder.packInt64(static_cast<std::int64_t>(freq));
+            // The size field and other header data will be added by the receiver
+            builder.template packFixed<sync_frame_layout_t>(
+                static_cast<std::int32_t>(FrameType::PERF_SYNC),
+                0, // just pass CPU == 0, Since Streamline 7.4 it is ignored anyway
+                pid,
+                tid,
+                static_cast<std::int64_t>(freq),
+                static_cast<std::int64_t>(monotonic_raw),
+                static_cast<std::int64_t>(vcnt));
 
-            // Write record
-            builder.packInt64(static_cast<std::int64_t>(monotonic_raw));
-            builder.packInt64(static_cast<std::int64_t>(vcnt));
-
-            builder.endFrame();
+            builder.trimTo(builder.getWriteIndex());
 
             LOG_DEBUG("Committing perf sync data (freq: %" PRIu64 ", monotonic: %" PRIu64 ", vcnt: %" PRIu64
                       ") written: %zu bytes",
@@ -117,7 +130,9 @@ namespace agents::perf {
 
             // Send frame
             sink->async_send_message(ipc::msg_apc_frame_data_t {std::move(buffer)},
-                                     [](auto const & ec, auto const & /*msg*/) {
+                                     [frame_buffer_pool = frame_buffer_pool](auto const & ec, auto msg) {
+                                         frame_buffer_pool->release(std::move(msg.suffix));
+
                                          // EOF means terminated
                                          if (ec && ec != boost::asio::error::eof) {
                                              LOG_DEBUG("Failed to send IPC message due to %s", ec.message().c_str());
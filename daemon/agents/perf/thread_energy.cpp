@@ -0,0 +1,383 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "agents/perf/thread_energy.h"
+
+#include "agents/perf/perf_data_records.h"
+#include "k/perf_event.h"
+#include "lib/String.h"
+#include "lib/Utils.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace agents::perf {
+    namespace {
+        constexpr std::size_t word_size = sizeof(std::uint64_t);
+
+        constexpr gator_key_t no_key {0};
+
+        /** The energy is power multiplied by microseconds */
+        constexpr std::uint64_t ns_per_energy_unit = 1000;
+
+        [[nodiscard]] std::uint64_t read_word(char const * data, std::size_t index)
+        {
+            std::uint64_t result;
+            std::memcpy(&result, data + (index * word_size), word_size);
+            return result;
+        }
+
+        void append_bytes(std::vector<char> & output, void const * data, std::size_t size)
+        {
+            auto const * bytes = static_cast<char const *>(data);
+            output.insert(output.end(), bytes, bytes + size);
+        }
+
+        /** @return The current frequency of a cpu, in kHz, or zero if it is not known */
+        [[nodiscard]] std::uint64_t read_current_frequency(int cpu)
+        {
+            static constexpr std::size_t buffer_size = 128;
+
+            lib::printf_str_t<buffer_size> buffer {"/sys/devices/system/cpu/cpu%i/cpufreq/scaling_cur_freq", cpu};
+            std::int64_t frequency = 0;
+            if ((lib::readInt64FromFile(buffer, frequency) != 0) || (frequency <= 0)) {
+                return 0;
+            }
+            return std::uint64_t(frequency);
+        }
+    }
+
+    bool thread_energy_config_t::is_enabled() const
+    {
+        return (sched_switch_key != no_key) && (cpu_frequency_key != no_key) && (switch_prev_tid.size != 0)
+            && (switch_next_tid.size != 0) && (frequency_state.size != 0) && (frequency_cpu_id.size != 0)
+            && std::any_of(domains.begin(), domains.end(), [](domain_t const & domain) {
+                   return !domain.states.empty();
+               });
+    }
+
+    thread_energy_state_t::thread_energy_state_t(event_configuration_t const & configuration,
+                                                 thread_energy_config_t config,
+                                                 std::chrono::nanoseconds window)
+        : config(std::move(config)), window_ns(std::max<std::uint64_t>(1, window.count()))
+    {
+        for (auto & domain : this->config.domains) {
+            std::sort(domain.states.begin(), domain.states.end(), [](auto const & a, auto const & b) {
+                return a.frequency_khz < b.frequency_khz;
+            });
+        }
+
+        for_each_event_definition(configuration, [this](event_definition_t const & event) {
+            auto const sample_fields = (event.attr.sample_type & required_tracepoint_sample_fields);
+            if ((event.attr.type != PERF_TYPE_TRACEPOINT) || (sample_fields != required_tracepoint_sample_fields)
+                || (event.key == no_key)) {
+                return;
+            }
+
+            if (event.key == this->config.sched_switch_key) {
+                key_formats.emplace(
+                    event.key,
+                    event_format_t {event_kind_t::sched_switch, event.attr.sample_type, event.attr.read_format});
+            }
+            else if (event.key == this->config.cpu_frequency_key) {
+                key_formats.emplace(
+                    event.key,
+                    event_format_t {event_kind_t::cpu_frequency, event.attr.sample_type, event.attr.read_format});
+            }
+        });
+    }
+
+    void thread_energy_state_t::add_ids(std::vector<std::pair<perf_event_id_t, gator_key_t>> const & mappings)
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        bool added = false;
+        for (auto const & [id, key] : mappings) {
+            auto it = key_formats.find(key);
+            if (it != key_formats.end()) {
+                id_formats[static_cast<std::uint64_t>(id)] = it->second;
+                added = true;
+            }
+        }
+
+        if (added) {
+            version.fetch_add(1, std::memory_order_acq_rel);
+        }
+    }
+
+    void thread_energy_state_t::copy_formats(std::unordered_map<std::uint64_t, event_format_t> & formats) const
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        formats = id_formats;
+    }
+
+    thread_energy_state_t::stats_t thread_energy_state_t::get_stats() const
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        return stats;
+    }
+
+    thread_energy_state_t::cpu_state_t & thread_energy_state_t::get_cpu(int cpu)
+    {
+        auto const index = std::size_t(std::max(cpu, 0));
+        if (index < cpus.size()) {
+            return cpus[index];
+        }
+
+        auto const first_new = cpus.size();
+        cpus.resize(index + 1);
+
+        for (auto new_index = first_new; new_index < cpus.size(); ++new_index) {
+            auto & state = cpus[new_index];
+            auto const new_cpu = int(new_index);
+
+            for (std::size_t domain = 0; domain < config.domains.size(); ++domain) {
+                auto const & cpus_of_domain = config.domains[domain].cpus;
+                if (std::find(cpus_of_domain.begin(), cpus_of_domain.end(), new_cpu) != cpus_of_domain.end()) {
+                    state.domain = int(domain);
+                    break;
+                }
+            }
+
+            // until its first change, a cpu runs at its current frequency, or is assumed to run at its fastest
+            auto const frequency = read_current_frequency(new_cpu);
+            state.power = find_power(state.domain, (frequency != 0 ? frequency : ~std::uint64_t(0)));
+        }
+
+        return cpus[index];
+    }
+
+    std::uint64_t thread_energy_state_t::find_power(int domain, std::uint64_t frequency_khz) const
+    {
+        if ((domain < 0) || (std::size_t(domain) >= config.domains.size())) {
+            return 0;
+        }
+
+        auto const & states = config.domains[domain].states;
+        if (states.empty()) {
+            return 0;
+        }
+
+        auto it = std::find_if(states.begin(), states.end(), [frequency_khz](auto const & state) {
+            return state.frequency_khz >= frequency_khz;
+        });
+        return (it != states.end() ? it->power : states.back().power);
+    }
+
+    void thread_energy_state_t::add_runtime(cpu_state_t & state, std::uint64_t time)
+    {
+        if (time <= state.since) {
+            return;
+        }
+
+        auto const runtime = time - state.since;
+        state.since = time;
+
+        if ((!state.has_switched) || (state.tid == 0)) {
+            return;
+        }
+
+        // the threads beyond the limit are summed into the entry of the idle tasks, which is otherwise unused
+        auto it = threads.find(state.tid);
+        if (it == threads.end()) {
+            it = threads.emplace((threads.size() < max_threads ? state.tid : 0), usage_t {}).first;
+        }
+
+        it->second.runtime += runtime;
+        it->second.energy += (state.power * runtime) / ns_per_energy_unit;
+    }
+
+    void thread_energy_state_t::open_window(std::uint64_t time, std::vector<std::vector<std::uint64_t>> & windows)
+    {
+        if (window_open && (time >= window_start) && ((time - window_start) >= window_ns)) {
+            auto const end = window_start + window_ns;
+            close_window(end, windows);
+
+            // the windows follow on from each other, so that the time of a thread that runs across their ends is
+            // split between them, skipping any in which nothing was sampled
+            window_open = true;
+            window_start = end + (((time - end) / window_ns) * window_ns);
+            last_time = time;
+        }
+
+        if (!window_open) {
+            window_open = true;
+            window_start = time;
+            last_time = time;
+        }
+
+        last_time = std::max(last_time, time);
+    }
+
+    void thread_energy_state_t::on_switch(int cpu,
+                                          std::uint64_t time,
+                                          std::uint32_t prev_tid,
+                                          std::uint32_t next_tid,
+                                          std::vector<std::vector<std::uint64_t>> & windows)
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        open_window(time, windows);
+
+        auto & state = get_cpu(cpu);
+
+        // the sample says which thread ran, which is only unknown before the cpu's first switch
+        if (state.has_switched) {
+            state.tid = prev_tid;
+            add_runtime(state, time);
+        }
+
+        state.tid = next_tid;
+        state.since = std::max(state.since, time);
+        state.has_switched = true;
+
+        stats.switches += 1;
+    }
+
+    void thread_energy_state_t::on_frequency(int cpu,
+                                             std::uint64_t time,
+                                             std::uint64_t frequency_khz,
+                                             std::vector<std::vector<std::uint64_t>> & windows)
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        open_window(time, windows);
+
+        auto & state = get_cpu(cpu);
+
+        add_runtime(state, time);
+        state.power = find_power(state.domain, frequency_khz);
+
+        stats.frequency_changes += 1;
+    }
+
+    void thread_energy_state_t::flush(std::vector<std::vector<std::uint64_t>> & windows)
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        windows.clear();
+
+        if (window_open) {
+            close_window(last_time, windows);
+        }
+    }
+
+    void thread_energy_state_t::close_window(std::uint64_t end, std::vector<std::vector<std::uint64_t>> & windows)
+    {
+        // account for the threads that are still running up to the end of the window
+        for (auto & state : cpus) {
+            add_runtime(state, end);
+        }
+
+        window_open = false;
+
+        if (threads.empty()) {
+            return;
+        }
+
+        auto & window = windows.emplace_back();
+        window.reserve(3 + (threads.size() * 3));
+        window.push_back(window_start);
+        window.push_back(end);
+        window.push_back(threads.size());
+
+        for (auto const & [tid, usage] : threads) {
+            window.push_back(tid);
+            window.push_back(usage.runtime);
+            window.push_back(usage.energy);
+        }
+
+        threads.clear();
+
+        stats.windows += 1;
+    }
+
+    thread_energy_state_t::event_format_t const * thread_energy_filter_t::find_format(std::uint64_t id)
+    {
+        auto it = formats.find(id);
+        if (it != formats.end()) {
+            return &it->second;
+        }
+
+        // refresh the local copy only when some new id was added since it was taken
+        auto const version = state->get_version();
+        if (version == formats_version) {
+            return nullptr;
+        }
+
+        formats_version = version;
+        state->copy_formats(formats);
+
+        it = formats.find(id);
+        return (it != formats.end() ? &it->second : nullptr);
+    }
+
+    void thread_energy_filter_t::filter(lib::Span<char const> first_span,
+                                        lib::Span<char const> second_span,
+                                        std::vector<char> & records,
+                                        std::vector<std::vector<std::uint64_t>> & windows)
+    {
+        records.clear();
+        records.reserve(first_span.size() + second_span.size());
+        windows.clear();
+
+        for_each_perf_data_record(first_span, second_span, split_record, records, [&](lib::Span<char const> record) {
+            filter_record(record, records, windows);
+        });
+    }
+
+    void thread_energy_filter_t::filter_record(lib::Span<char const> record,
+                                               std::vector<char> & records,
+                                               std::vector<std::vector<std::uint64_t>> & windows)
+    {
+        perf_event_header header;
+        std::memcpy(&header, record.data(), sizeof(header));
+
+        std::size_t const words = record.size() / word_size;
+
+        if ((header.type != PERF_RECORD_SAMPLE) || (header.size != record.size()) || (words <= 1)) {
+            return append_bytes(records, record.data(), record.size());
+        }
+
+        auto const * format = find_format(read_word(record.data(), 1));
+        if (format == nullptr) {
+            return append_bytes(records, record.data(), record.size());
+        }
+
+        std::uint64_t time = 0;
+        lib::Span<char const> raw_data {};
+        if (!find_tracepoint_sample_time_and_raw_data(record,
+                                                      format->sample_type,
+                                                      format->read_format,
+                                                      time,
+                                                      raw_data)) {
+            return append_bytes(records, record.data(), record.size());
+        }
+
+        auto const & config = state->get_config();
+
+        if (format->kind == thread_energy_state_t::event_kind_t::sched_switch) {
+            // the switches are still needed by the host, so are only observed
+            auto const prev_tid = read_tracepoint_field(raw_data, config.switch_prev_tid);
+            auto const next_tid = read_tracepoint_field(raw_data, config.switch_next_tid);
+            if (prev_tid && next_tid) {
+                state->on_switch(cpu, time, std::uint32_t(*prev_tid), std::uint32_t(*next_tid), windows);
+            }
+            return append_bytes(records, record.data(), record.size());
+        }
+
+        auto const frequency = read_tracepoint_field(raw_data, config.frequency_state);
+        auto const cpu_id = read_tracepoint_field(raw_data, config.frequency_cpu_id);
+        if (!frequency || !cpu_id) {
+            return append_bytes(records, record.data(), record.size());
+        }
+
+        state->on_frequency(int(*cpu_id), time, *frequency, windows);
+    }
+
+    void thread_energy_filter_t::flush(std::vector<std::vector<std::uint64_t>> & windows)
+    {
+        state->flush(windows);
+    }
+}
@@ -0,0 +1,250 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#pragma once
+
+#include "agents/perf/events/event_configuration.hpp"
+#include "agents/perf/events/types.hpp"
+#include "agents/perf/tracepoint_sample.h"
+#include "lib/Span.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace agents::perf {
+    /**
+     * The kernel's energy model of the cpus, and the tracepoints that the perf agent combines with it into the energy
+     * used by each thread
+     */
+    struct thread_energy_config_t {
+        /** One performance state of a performance domain */
+        struct perf_state_t {
+            std::uint64_t frequency_khz;
+            /** The power at this frequency, in the energy model's unit (milliwatts, or microwatts on later kernels) */
+            std::uint64_t power;
+        };
+
+        /** The cpus that share a frequency, and their performance states, in order of frequency */
+        struct domain_t {
+            std::vector<int> cpus;
+            std::vector<perf_state_t> states;
+        };
+
+        /** The key of the sched_switch events (the cpus' group leaders), or zero if they are not enabled */
+        gator_key_t sched_switch_key {0};
+        tracepoint_field_t switch_prev_tid {0, 0};
+        tracepoint_field_t switch_next_tid {0, 0};
+
+        /** The key of the cpu_frequency event, or zero if it is not enabled */
+        gator_key_t cpu_frequency_key {0};
+        tracepoint_field_t frequency_state {0, 0};
+        tracepoint_field_t frequency_cpu_id {0, 0};
+
+        std::vector<domain_t> domains {};
+
+        /** @return True if both tracepoints are converted, and there is an energy model to convert them with */
+        [[nodiscard]] bool is_enabled() const;
+    };
+
+    /**
+     * Estimates the energy used by each thread from the kernel's energy model, by accumulating the time that each
+     * thread runs on each cpu (from the sched_switch samples) multiplied by the power of the frequency that the cpu
+     * ran at (from the cpu_frequency samples), so that the energy of each thread can be shown without the host
+     * post-processing the whole scheduler trace.
+     *
+     * The sched_switch samples are of the cpu they were read from, which are in time order, but a cpu_frequency sample
+     * may be of any cpu and so be read from another cpu's mmap, so the state is shared by all the cpus (and is
+     * serialized by a mutex), and a frequency change is applied from the time it is read if that is later than its
+     * own time. Until the first change of each cpu, its frequency is read from its cpufreq scaling_cur_freq.
+     *
+     * Each window of sample time is a sequence of words, all of which are packed into a
+     * FrameType::PERF_THREAD_ENERGY frame:
+     *
+     *  - the times of the start and end of the window
+     *  - the number of threads, then for each thread; its tid, the time it ran in nanoseconds, and its energy in the
+     *    energy model's unit of power multiplied by microseconds (so nanojoules for a model in milliwatts)
+     *
+     * A thread is only included in the window if it ran in it. The idle tasks are never included, so the threads
+     * beyond max_threads are summed into one entry whose tid is 0. The time that a thread runs across the end of a
+     * window is split at the window's end.
+     */
+    class thread_energy_state_t {
+    public:
+        /** The most threads in each window */
+        static constexpr std::size_t max_threads = 16384;
+
+        /** The tracepoint an event is of */
+        enum class event_kind_t {
+            sched_switch,
+            cpu_frequency,
+        };
+
+        /** Where a tracepoint event's fields are in its samples */
+        struct event_format_t {
+            event_kind_t kind;
+            std::uint64_t sample_type;
+            std::uint64_t read_format;
+        };
+
+        struct stats_t {
+            std::uint64_t switches;
+            std::uint64_t frequency_changes;
+            std::uint64_t windows;
+        };
+
+        /**
+         * @param configuration The capture's events; only those tracepoint events whose samples start with their id
+         * (PERF_SAMPLE_IDENTIFIER), and that have the time and raw data (PERF_SAMPLE_TIME and PERF_SAMPLE_RAW), are
+         * converted
+         * @param config The energy model and the tracepoints to convert
+         * @param window The length of each window, in sample time
+         */
+        thread_energy_state_t(event_configuration_t const & configuration,
+                              thread_energy_config_t config,
+                              std::chrono::nanoseconds window);
+
+        /** @return The tracepoints that are converted */
+        [[nodiscard]] thread_energy_config_t const & get_config() const { return config; }
+
+        /** Record the ids of newly opened events */
+        void add_ids(std::vector<std::pair<perf_event_id_t, gator_key_t>> const & mappings);
+
+        /** @return A value that changes whenever ids are added */
+        [[nodiscard]] std::uint64_t get_version() const { return version.load(std::memory_order_acquire); }
+
+        /** Copy the format of each tracepoint event's id into `formats` */
+        void copy_formats(std::unordered_map<std::uint64_t, event_format_t> & formats) const;
+
+        /**
+         * Record one sched_switch sample
+         *
+         * @param cpu The cpu that switched
+         * @param time The time of the sample
+         * @param prev_tid The thread that stopped running
+         * @param next_tid The thread that started running
+         * @param windows Receives the words of the window, if it closed
+         */
+        void on_switch(int cpu,
+                       std::uint64_t time,
+                       std::uint32_t prev_tid,
+                       std::uint32_t next_tid,
+                       std::vector<std::vector<std::uint64_t>> & windows);
+
+        /**
+         * Record one cpu_frequency sample
+         *
+         * @param cpu The cpu whose frequency changed
+         * @param time The time of the sample
+         * @param frequency_khz The new frequency
+         * @param windows Receives the words of the window, if it closed
+         */
+        void on_frequency(int cpu,
+                          std::uint64_t time,
+                          std::uint64_t frequency_khz,
+                          std::vector<std::vector<std::uint64_t>> & windows);
+
+        /** Close the current window, if any thread ran in it */
+        void flush(std::vector<std::vector<std::uint64_t>> & windows);
+
+        [[nodiscard]] stats_t get_stats() const;
+
+    private:
+        struct cpu_state_t {
+            /** The thread that is running, or zero if it is idle or not known yet */
+            std::uint32_t tid = 0;
+            /** The time from which the running thread has not been accounted for */
+            std::uint64_t since = 0;
+            /** The power of the cpu's current frequency */
+            std::uint64_t power = 0;
+            /** The cpu's domain, or -1 if the energy model does not have it */
+            int domain = -1;
+            /** Until the cpu's first switch, the running thread is not known */
+            bool has_switched = false;
+        };
+
+        struct usage_t {
+            std::uint64_t runtime = 0;
+            std::uint64_t energy = 0;
+        };
+
+        thread_energy_config_t config;
+        std::uint64_t window_ns;
+        std::map<gator_key_t, event_format_t> key_formats {};
+        mutable std::mutex mutex {};
+        std::unordered_map<std::uint64_t, event_format_t> id_formats {};
+        std::atomic_uint64_t version {0};
+        std::vector<cpu_state_t> cpus {};
+        /** By tid */
+        std::unordered_map<std::uint32_t, usage_t> threads {};
+        /** The time of the first sample of the window, which it is closed relative to */
+        std::uint64_t window_start = 0;
+        std::uint64_t last_time = 0;
+        bool window_open = false;
+        stats_t stats {0, 0, 0};
+
+        /** Start a window if there is not one open, having closed the current one if the sample is after it */
+        void open_window(std::uint64_t time, std::vector<std::vector<std::uint64_t>> & windows);
+
+        /** @return The state of a cpu, which is added if it is new */
+        [[nodiscard]] cpu_state_t & get_cpu(int cpu);
+
+        /** @return The power of a domain at some frequency, being that of its slowest state that is at least as fast */
+        [[nodiscard]] std::uint64_t find_power(int domain, std::uint64_t frequency_khz) const;
+
+        /** Account for the time that the cpu's thread has run up until `time` */
+        void add_runtime(cpu_state_t & state, std::uint64_t time);
+
+        /** Append the current window to `windows`; it ends at `end` */
+        void close_window(std::uint64_t end, std::vector<std::vector<std::uint64_t>> & windows);
+    };
+
+    /**
+     * Passes the sched_switch and cpu_frequency samples in the perf data records of one cpu to the shared
+     * thread_energy_state_t. The cpu_frequency samples (which are of an event only for this) are removed, and all the
+     * other records, including the sched_switch samples, are forwarded unchanged. One filter is used per cpu.
+     */
+    class thread_energy_filter_t {
+    public:
+        thread_energy_filter_t(int cpu, std::shared_ptr<thread_energy_state_t> state)
+            : cpu(cpu), state(std::move(state))
+        {
+        }
+
+        /**
+         * Filter a chunk of whole perf data records
+         *
+         * @param first_span The first part of the records
+         * @param second_span The remainder of the records, which follows on from the first (when the mmap wrapped)
+         * @param records Receives the records that are not cpu_frequency samples
+         * @param windows Receives the words of each window that closed
+         */
+        void filter(lib::Span<char const> first_span,
+                    lib::Span<char const> second_span,
+                    std::vector<char> & records,
+                    std::vector<std::vector<std::uint64_t>> & windows);
+
+        /** Close the current (shared) window, if it has anything in it */
+        void flush(std::vector<std::vector<std::uint64_t>> & windows);
+
+    private:
+        int cpu;
+        std::shared_ptr<thread_energy_state_t> state;
+        std::uint64_t formats_version = 0;
+        std::unordered_map<std::uint64_t, thread_energy_state_t::event_format_t> formats {};
+        /** Reused for a record that is split across the two spans */
+        std::vector<char> split_record {};
+
+        [[nodiscard]] thread_energy_state_t::event_format_t const * find_format(std::uint64_t id);
+
+        void filter_record(lib::Span<char const> record,
+                           std::vector<char> & records,
+                           std::vector<std::vector<std::uint64_t>> & windows);
+    };
+}
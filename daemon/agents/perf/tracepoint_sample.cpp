@@ -0,0 +1,132 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "agents/perf/tracepoint_sample.h"
+
+#include <cstddef>
+#include <cstring>
+
+namespace agents::perf {
+    namespace {
+        constexpr std::size_t word_size = sizeof(std::uint64_t);
+
+        /** The fields that come before the time, each of which is a single word */
+        constexpr std::uint64_t fields_before_time = PERF_SAMPLE_IDENTIFIER | PERF_SAMPLE_IP | PERF_SAMPLE_TID;
+        /** The fields that come after the time and before the read values, each of which is a single word */
+        constexpr std::uint64_t fields_after_time =
+            PERF_SAMPLE_ADDR | PERF_SAMPLE_ID | PERF_SAMPLE_STREAM_ID | PERF_SAMPLE_CPU | PERF_SAMPLE_PERIOD;
+
+        [[nodiscard]] std::uint64_t read_word(char const * data, std::size_t index)
+        {
+            std::uint64_t result;
+            std::memcpy(&result, data + (index * word_size), word_size);
+            return result;
+        }
+
+        /** @return The number of words of the read values of a sample */
+        [[nodiscard]] std::size_t read_values_size(std::uint64_t read_format, std::uint64_t nr)
+        {
+            std::size_t const times = ((read_format & PERF_FORMAT_TOTAL_TIME_ENABLED) != 0 ? 1 : 0)
+                                    + ((read_format & PERF_FORMAT_TOTAL_TIME_RUNNING) != 0 ? 1 : 0);
+            std::size_t const value = 1 + ((read_format & PERF_FORMAT_ID) != 0 ? 1 : 0);
+
+            if ((read_format & PERF_FORMAT_GROUP) != 0) {
+                return 1 + times + (nr * value);
+            }
+            return times + value;
+        }
+
+        template<typename T>
+        [[nodiscard]] std::uint64_t read_unsigned(char const * data)
+        {
+            T value;
+            std::memcpy(&value, data, sizeof(value));
+            return value;
+        }
+    }
+
+    bool find_tracepoint_sample_time_and_raw_data(lib::Span<char const> record,
+                                                  std::uint64_t sample_type,
+                                                  std::uint64_t read_format,
+                                                  std::uint64_t & time,
+                                                  lib::Span<char const> & raw_data)
+    {
+        tracepoint_callchain_t callchain {0, 0};
+        return find_tracepoint_sample_time_and_raw_data(record, sample_type, read_format, time, raw_data, callchain);
+    }
+
+    bool find_tracepoint_sample_time_and_raw_data(lib::Span<char const> record,
+                                                  std::uint64_t sample_type,
+                                                  std::uint64_t read_format,
+                                                  std::uint64_t & time,
+                                                  lib::Span<char const> & raw_data,
+                                                  tracepoint_callchain_t & callchain)
+    {
+        callchain = {0, 0};
+
+        std::size_t const words = record.size() / word_size;
+
+        // skip the header
+        std::size_t index = 1 + __builtin_popcountll(sample_type & fields_before_time);
+        if (index >= words) {
+            return false;
+        }
+        time = read_word(record.data(), index);
+        index += 1 + __builtin_popcountll(sample_type & fields_after_time);
+
+        if ((sample_type & PERF_SAMPLE_READ) != 0) {
+            if (index >= words) {
+                return false;
+            }
+            index += read_values_size(read_format, read_word(record.data(), index));
+        }
+
+        if ((sample_type & PERF_SAMPLE_CALLCHAIN) != 0) {
+            if (index >= words) {
+                return false;
+            }
+            auto const length = read_word(record.data(), index);
+            if (length >= (words - index)) {
+                return false;
+            }
+            callchain = {index + 1, std::size_t(length)};
+            index += 1 + length;
+        }
+
+        // the raw data is a u32 size followed by the data, so is not word aligned
+        if (index >= words) {
+            return false;
+        }
+        std::uint32_t size;
+        std::memcpy(&size, record.data() + (index * word_size), sizeof(size));
+        auto const offset = (index * word_size) + sizeof(size);
+        if (size > (record.size() - offset)) {
+            return false;
+        }
+
+        raw_data = {record.data() + offset, size};
+        return true;
+    }
+
+    std::optional<std::uint64_t> read_tracepoint_field(lib::Span<char const> raw_data, tracepoint_field_t const & field)
+    {
+        if ((field.size == 0) || (field.size > sizeof(std::uint64_t)) || (field.offset > raw_data.size())
+            || (field.size > (raw_data.size() - field.offset))) {
+            return {};
+        }
+
+        char const * const data = raw_data.data() + field.offset;
+
+        switch (field.size) {
+            case 1:
+                return read_unsigned<std::uint8_t>(data);
+            case 2:
+                return read_unsigned<std::uint16_t>(data);
+            case 4:
+                return read_unsigned<std::uint32_t>(data);
+            case 8:
+                return read_unsigned<std::uint64_t>(data);
+            default:
+                return {};
+        }
+    }
+}
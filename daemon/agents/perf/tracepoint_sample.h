@@ -0,0 +1,58 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#pragma once
+
+#include "k/perf_event.h"
+#include "lib/Span.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+namespace agents::perf {
+    /** Where an integer field is in the raw data of a tracepoint's samples (as read from its format) */
+    struct tracepoint_field_t {
+        std::uint32_t offset;
+        /** The size of the field in bytes, which is zero if the tracepoint does not have it */
+        std::uint32_t size;
+    };
+
+    /** Where the call chain of a sample is, in words from the start of its record */
+    struct tracepoint_callchain_t {
+        std::size_t index;
+        /** The number of entries, including the context markers, which is zero if the sample has none */
+        std::size_t length;
+    };
+
+    /** The fields that every sample converted by the agent has, so that its event and time can be found */
+    constexpr std::uint64_t required_tracepoint_sample_fields =
+        PERF_SAMPLE_IDENTIFIER | PERF_SAMPLE_TIME | PERF_SAMPLE_RAW;
+
+    /**
+     * Find the time and the raw data of a tracepoint sample, whose layout is as given in perf_event.h
+     *
+     * @param record The whole sample record, including its header
+     * @param sample_type The sample_type of the sample's event, which must have required_tracepoint_sample_fields
+     * @param read_format The read_format of the sample's event
+     * @param time Receives the time of the sample
+     * @param raw_data Receives the raw data of the sample
+     * @return False if the record is too short for its fields
+     */
+    [[nodiscard]] bool find_tracepoint_sample_time_and_raw_data(lib::Span<char const> record,
+                                                                std::uint64_t sample_type,
+                                                                std::uint64_t read_format,
+                                                                std::uint64_t & time,
+                                                                lib::Span<char const> & raw_data);
+
+    /** As above, but also find the sample's call chain (PERF_SAMPLE_CALLCHAIN), if it has one */
+    [[nodiscard]] bool find_tracepoint_sample_time_and_raw_data(lib::Span<char const> record,
+                                                                std::uint64_t sample_type,
+                                                                std::uint64_t read_format,
+                                                                std::uint64_t & time,
+                                                                lib::Span<char const> & raw_data,
+                                                                tracepoint_callchain_t & callchain);
+
+    /** @return The unsigned value of a field of the raw data, or nothing if it is not in the data */
+    [[nodiscard]] std::optional<std::uint64_t> read_tracepoint_field(lib::Span<char const> raw_data,
+                                                                     tracepoint_field_t const & field);
+}
@@ -0,0 +1,609 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "agents/perf/user_stack_unwinder.h"
+
+#include "agents/perf/perf_data_records.h"
+#include "k/perf_event.h"
+#include "lib/Format.h"
+#include "lib/FsEntry.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <sstream>
+
+namespace agents::perf {
+    namespace {
+        constexpr std::size_t word_size = sizeof(std::uint64_t);
+
+        /** The sample fields that precede the read values, each of which is one word */
+        constexpr std::uint64_t fixed_sample_fields[] = {
+            PERF_SAMPLE_IDENTIFIER,
+            PERF_SAMPLE_IP,
+            PERF_SAMPLE_TID,
+            PERF_SAMPLE_TIME,
+            PERF_SAMPLE_ADDR,
+            PERF_SAMPLE_ID,
+            PERF_SAMPLE_STREAM_ID,
+            PERF_SAMPLE_CPU,
+            PERF_SAMPLE_PERIOD,
+        };
+
+        constexpr std::uint64_t required_sample_fields = PERF_SAMPLE_IDENTIFIER | PERF_SAMPLE_TID
+                                                       | PERF_SAMPLE_CALLCHAIN | PERF_SAMPLE_REGS_USER
+                                                       | PERF_SAMPLE_STACK_USER;
+
+        /** The registers are found by their index in the sample, so all of x0-x30, sp and pc must be present */
+        constexpr std::uint64_t required_sample_regs_user = 0x1ffffffffULL;
+
+        constexpr std::size_t sp_register = 31;
+        constexpr std::size_t pc_register = 32;
+
+        [[nodiscard]] std::uint64_t read_word(char const * data, std::size_t index)
+        {
+            std::uint64_t result;
+            std::memcpy(&result, data + (index * word_size), word_size);
+            return result;
+        }
+
+        void append_bytes(std::vector<char> & output, void const * data, std::size_t size)
+        {
+            auto const * bytes = static_cast<char const *>(data);
+            output.insert(output.end(), bytes, bytes + size);
+        }
+
+        void append_word(std::vector<char> & output, std::uint64_t word) { append_bytes(output, &word, word_size); }
+
+        /** @return The return address, without any pointer authentication code */
+        [[nodiscard]] std::uint64_t strip_pointer_authentication(std::uint64_t address)
+        {
+#if defined(__aarch64__)
+            // XPACLRI removes the code from x30 (and is a NOP on cores without pointer authentication)
+            register std::uint64_t x30 asm("x30") = address;
+            asm("hint #7" : "+r"(x30));
+            return x30;
+#else
+            // user space addresses have at most 48 bits
+            return address & ((std::uint64_t(1) << 48) - 1);
+#endif
+        }
+
+        [[nodiscard]] std::vector<user_stack_unwind_state_t::mapping_t> read_process_maps(pid_t pid)
+        {
+            std::vector<user_stack_unwind_state_t::mapping_t> mappings {};
+
+            auto const contents = lib::FsEntry::create(lib::Format() << "/proc/" << pid << "/maps").readFileContents();
+
+            std::istringstream stream {contents};
+            std::string line;
+            while (std::getline(stream, line)) {
+                user_stack_unwind_state_t::mapping_t mapping {};
+                char perms[5] = {0};
+                int path_offset = 0;
+                if ((std::sscanf(line.c_str(),
+                                 "%" SCNx64 "-%" SCNx64 " %4s %" SCNx64 " %*s %" SCNu64 " %n",
+                                 &mapping.start,
+                                 &mapping.end,
+                                 perms,
+                                 &mapping.offset,
+                                 &mapping.inode,
+                                 &path_offset)
+                     < 5)
+                    || (path_offset <= 0)) {
+                    continue;
+                }
+
+                // only the executable mappings of files on disk have unwind tables to read
+                if ((perms[2] != 'x') || (line[path_offset] != '/')) {
+                    continue;
+                }
+
+                mapping.path = line.substr(path_offset);
+                mappings.push_back(std::move(mapping));
+            }
+
+            std::sort(mappings.begin(), mappings.end(), [](auto const & a, auto const & b) {
+                return a.start < b.start;
+            });
+            return mappings;
+        }
+    }
+
+    user_stack_unwind_state_t::user_stack_unwind_state_t(event_configuration_t const & configuration)
+    {
+        for_each_event_definition(configuration, [this](event_definition_t const & event) {
+            auto const sample_type = event.attr.sample_type;
+
+            // the id must be at a fixed position so that the format can be found
+            if (((sample_type & required_sample_fields) != required_sample_fields)
+                || (event.attr.sample_regs_user != required_sample_regs_user)
+                || ((sample_type & PERF_SAMPLE_BRANCH_STACK) != 0)) {
+                return;
+            }
+
+            std::size_t fixed_words = 1; // the header
+            std::size_t pid_index = 0;
+            for (auto field : fixed_sample_fields) {
+                if (field == PERF_SAMPLE_TID) {
+                    pid_index = fixed_words;
+                }
+                if ((sample_type & field) != 0) {
+                    fixed_words += 1;
+                }
+            }
+
+            key_formats.emplace(event.key,
+                                sample_format_t {fixed_words,
+                                                 pid_index,
+                                                 event.attr.read_format,
+                                                 ((sample_type & PERF_SAMPLE_READ) != 0),
+                                                 ((sample_type & PERF_SAMPLE_RAW) != 0)});
+        });
+    }
+
+    void user_stack_unwind_state_t::add_ids(std::vector<std::pair<perf_event_id_t, gator_key_t>> const & mappings)
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        bool added = false;
+        for (auto const & [id, key] : mappings) {
+            auto it = key_formats.find(key);
+            if (it != key_formats.end()) {
+                id_formats[static_cast<std::uint64_t>(id)] = it->second;
+                added = true;
+            }
+        }
+
+        if (added) {
+            version.fetch_add(1, std::memory_order_acq_rel);
+        }
+    }
+
+    void user_stack_unwind_state_t::copy_formats(std::unordered_map<std::uint64_t, sample_format_t> & formats) const
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        formats = id_formats;
+    }
+
+    std::shared_ptr<user_stack_unwind_state_t::process_maps_t const> user_stack_unwind_state_t::get_process_maps(
+        pid_t pid,
+        bool reread)
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        auto const now = std::chrono::steady_clock::now();
+
+        auto it = processes.find(pid);
+        if ((it != processes.end()) && ((!reread) || ((now - it->second->read_time) < min_reread_interval))) {
+            return it->second;
+        }
+
+        if ((it == processes.end()) && (processes.size() >= max_processes)) {
+            for (auto const & [other_pid, maps] : processes) {
+                maps->stale.store(true, std::memory_order_relaxed);
+            }
+            processes.clear();
+        }
+
+        auto maps = std::make_shared<process_maps_t>();
+        maps->mappings = read_process_maps(pid);
+        maps->read_time = now;
+
+        if (it != processes.end()) {
+            it->second->stale.store(true, std::memory_order_relaxed);
+            it->second = maps;
+        }
+        else {
+            processes.emplace(pid, maps);
+        }
+        return maps;
+    }
+
+    void user_stack_unwind_state_t::forget_process(pid_t pid)
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        auto it = processes.find(pid);
+        if (it != processes.end()) {
+            it->second->stale.store(true, std::memory_order_relaxed);
+            processes.erase(it);
+        }
+    }
+
+    std::shared_ptr<dwarf_unwind_table_t const> user_stack_unwind_state_t::get_table(mapping_t const & mapping)
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        auto const key = std::make_pair(mapping.inode, mapping.path);
+        auto it = file_tables.find(key);
+        if (it != file_tables.end()) {
+            return it->second;
+        }
+
+        std::shared_ptr<dwarf_unwind_table_t const> result {};
+
+        auto table = dwarf_unwind_table_t::open(mapping.path);
+        if (table) {
+            auto const build_id = table->get_build_id();
+            auto build_id_it = (build_id.empty() ? build_id_tables.end() : build_id_tables.find(build_id));
+            if (build_id_it != build_id_tables.end()) {
+                result = build_id_it->second;
+            }
+            else {
+                table->index();
+                if (table->has_fdes()) {
+                    result = std::move(table);
+                }
+                if (!build_id.empty()) {
+                    build_id_tables.emplace(build_id, result);
+                }
+            }
+        }
+
+        // the result is kept even when there is no table, so that the file is not read again
+        file_tables.emplace(key, result);
+        return result;
+    }
+
+    user_stack_unwind_state_t::sample_format_t const * user_stack_unwinder_t::find_format(std::uint64_t id)
+    {
+        auto it = formats.find(id);
+        if (it != formats.end()) {
+            return &it->second;
+        }
+
+        // refresh the local copy only when some new id was added since it was taken
+        auto const version = state->get_version();
+        if (version == formats_version) {
+            return nullptr;
+        }
+
+        formats_version = version;
+        state->copy_formats(formats);
+
+        it = formats.find(id);
+        return (it != formats.end() ? &it->second : nullptr);
+    }
+
+    void user_stack_unwinder_t::unwind(lib::Span<char const> first_span,
+                                       lib::Span<char const> second_span,
+                                       std::vector<char> & records)
+    {
+        records.clear();
+        records.reserve(first_span.size() + second_span.size());
+
+        for_each_perf_data_record(first_span, second_span, split_record, records, [&](lib::Span<char const> record) {
+            unwind_record(record, records);
+        });
+    }
+
+    void user_stack_unwinder_t::check_process_record(lib::Span<char const> record)
+    {
+        perf_event_header header;
+        std::memcpy(&header, record.data(), sizeof(header));
+
+        // each of these starts with the pid then tid
+        std::uint32_t ids[2];
+        if (record.size() < (sizeof(header) + sizeof(ids))) {
+            return;
+        }
+        std::memcpy(ids, record.data() + sizeof(header), sizeof(ids));
+
+        bool const changed = (header.type == PERF_RECORD_MMAP) || (header.type == PERF_RECORD_MMAP2)
+                          || ((header.type == PERF_RECORD_COMM) && ((header.misc & PERF_RECORD_MISC_COMM_EXEC) != 0))
+                          || ((header.type == PERF_RECORD_EXIT) && (ids[0] == ids[1]));
+        if (changed) {
+            auto const pid = static_cast<pid_t>(ids[0]);
+            processes.erase(pid);
+            state->forget_process(pid);
+        }
+    }
+
+    void user_stack_unwinder_t::unwind_record(lib::Span<char const> record, std::vector<char> & records)
+    {
+        perf_event_header header;
+        std::memcpy(&header, record.data(), sizeof(header));
+
+        std::size_t const words = record.size() / word_size;
+
+        if (header.type != PERF_RECORD_SAMPLE) {
+            check_process_record(record);
+            return append_bytes(records, record.data(), record.size());
+        }
+
+        if ((header.size != record.size()) || (words < 2)) {
+            return append_bytes(records, record.data(), record.size());
+        }
+
+        auto const * format = find_format(read_word(record.data(), 1));
+        if ((format == nullptr) || (format->pid_index >= words)) {
+            return append_bytes(records, record.data(), record.size());
+        }
+
+        // find the callchain
+        std::size_t callchain_index = format->fixed_words;
+        if (format->has_read) {
+            if (callchain_index >= words) {
+                return append_bytes(records, record.data(), record.size());
+            }
+
+            std::size_t const times = (((format->read_format & PERF_FORMAT_TOTAL_TIME_ENABLED) != 0) ? 1 : 0)
+                                    + (((format->read_format & PERF_FORMAT_TOTAL_TIME_RUNNING) != 0) ? 1 : 0);
+            std::size_t const value_words = (((format->read_format & PERF_FORMAT_ID) != 0) ? 2 : 1);
+
+            if ((format->read_format & PERF_FORMAT_GROUP) != 0) {
+                auto const nr_values = read_word(record.data(), callchain_index);
+                if (nr_values > words) {
+                    return append_bytes(records, record.data(), record.size());
+                }
+                callchain_index += 1 + times + (nr_values * value_words);
+            }
+            else {
+                callchain_index += times + value_words;
+            }
+        }
+
+        if (callchain_index >= words) {
+            return append_bytes(records, record.data(), record.size());
+        }
+
+        auto const nr = read_word(record.data(), callchain_index);
+        if (nr >= (words - callchain_index)) {
+            return append_bytes(records, record.data(), record.size());
+        }
+
+        auto const ips_index = callchain_index + 1;
+        std::size_t index = ips_index + nr;
+
+        // the raw data is a 32 bit size then the data, padded so that they end on a word boundary
+        if (format->has_raw) {
+            if (index >= words) {
+                return append_bytes(records, record.data(), record.size());
+            }
+            std::uint32_t raw_size;
+            std::memcpy(&raw_size, record.data() + (index * word_size), sizeof(raw_size));
+            index += (sizeof(raw_size) + raw_size + word_size - 1) / word_size;
+        }
+
+        // the user registers are the abi, then the registers unless the abi is none
+        if (index >= words) {
+            return append_bytes(records, record.data(), record.size());
+        }
+        auto const abi = read_word(record.data(), index);
+        auto const registers_index = index + 1;
+        index = registers_index + (abi != PERF_SAMPLE_REGS_ABI_NONE ? num_sample_registers : 0);
+
+        // the user stack is the size, then the data and the dynamic size unless the size is zero
+        if (index >= words) {
+            return append_bytes(records, record.data(), record.size());
+        }
+        auto const stack_size_index = index;
+        auto const stack_size = read_word(record.data(), stack_size_index);
+        auto const stack_index = stack_size_index + 1;
+        if ((stack_size == 0) || ((stack_size % word_size) != 0)
+            || ((stack_size / word_size) >= (words - stack_index))) {
+            return append_bytes(records, record.data(), record.size());
+        }
+        auto const dyn_size_index = stack_index + (stack_size / word_size);
+        auto const dyn_size = read_word(record.data(), dyn_size_index);
+        auto const end_index = dyn_size_index + 1;
+
+        stats.samples += 1;
+
+        frames.clear();
+        if ((abi == PERF_SAMPLE_REGS_ABI_64) && (dyn_size != 0) && (dyn_size <= stack_size)) {
+            std::uint32_t pid;
+            std::memcpy(&pid, record.data() + (format->pid_index * word_size), sizeof(pid));
+
+            std::uint64_t sample_registers[num_sample_registers];
+            std::memcpy(sample_registers, record.data() + (registers_index * word_size), sizeof(sample_registers));
+
+            unwind_stack(static_cast<pid_t>(pid),
+                         sample_registers,
+                         {record.data() + (stack_index * word_size), static_cast<std::size_t>(dyn_size)});
+        }
+
+        // the kernel's callchain has the kernel frames (if any) before the user ones
+        std::size_t user_context = nr;
+        for (std::size_t i = 0; i < nr; ++i) {
+            if (read_word(record.data(), ips_index + i) == PERF_CONTEXT_USER) {
+                user_context = i;
+                break;
+            }
+        }
+        std::size_t const user_frames = (user_context < nr ? nr - user_context - 1 : 0);
+        std::size_t const new_nr = user_context + 1 + frames.size();
+
+        // the stack's data and dynamic size are removed, leaving its zero size
+        std::size_t const removed_words = (stack_size / word_size) + 1;
+        bool const replace = (frames.size() > user_frames)
+                          && ((words - nr - removed_words + new_nr) * word_size
+                              <= std::numeric_limits<decltype(header.size)>::max());
+
+        header.size = static_cast<decltype(header.size)>((words - removed_words - nr + (replace ? new_nr : nr))
+                                                         * word_size);
+        append_bytes(records, &header, sizeof(header));
+        // up to the callchain
+        append_bytes(records, record.data() + sizeof(header), (callchain_index * word_size) - sizeof(header));
+        // the callchain
+        if (replace) {
+            append_word(records, new_nr);
+            append_bytes(records, record.data() + (ips_index * word_size), user_context * word_size);
+            append_word(records, PERF_CONTEXT_USER);
+            append_bytes(records, frames.data(), frames.size() * word_size);
+            stats.unwound_samples += 1;
+        }
+        else {
+            append_bytes(records, record.data() + (callchain_index * word_size), (nr + 1) * word_size);
+        }
+        // from after the callchain up to the stack's size, which becomes zero
+        append_bytes(records,
+                     record.data() + ((ips_index + nr) * word_size),
+                     (stack_size_index - (ips_index + nr)) * word_size);
+        append_word(records, 0);
+        // everything after the stack
+        append_bytes(records, record.data() + (end_index * word_size), record.size() - (end_index * word_size));
+
+        stats.removed_bytes += removed_words * word_size;
+    }
+
+    user_stack_unwinder_t::process_t & user_stack_unwinder_t::get_process(pid_t pid, bool reread)
+    {
+        if ((processes.size() >= user_stack_unwind_state_t::max_processes) && (processes.count(pid) == 0)) {
+            processes.clear();
+        }
+
+        auto & process = processes[pid];
+        if ((!process.maps) || process.maps->stale.load(std::memory_order_relaxed) || reread) {
+            auto maps = state->get_process_maps(pid, reread);
+            if (maps != process.maps) {
+                process.maps = std::move(maps);
+                process.tables.assign(process.maps->mappings.size(), {});
+                process.resolved.assign(process.maps->mappings.size(), false);
+            }
+        }
+        return process;
+    }
+
+    std::pair<dwarf_unwind_table_t const *, std::uint64_t> user_stack_unwinder_t::find_table(process_t & process,
+                                                                                            std::uint64_t address)
+    {
+        auto const & mappings = process.maps->mappings;
+
+        auto it = std::upper_bound(mappings.begin(), mappings.end(), address, [](std::uint64_t a, auto const & m) {
+            return a < m.start;
+        });
+        if (it == mappings.begin()) {
+            return {nullptr, 0};
+        }
+        --it;
+        if (address >= it->end) {
+            return {nullptr, 0};
+        }
+
+        auto const index = std::size_t(it - mappings.begin());
+        if (!process.resolved[index]) {
+            process.tables[index] = state->get_table(*it);
+            process.resolved[index] = true;
+        }
+
+        auto const * table = process.tables[index].get();
+        if (table == nullptr) {
+            return {nullptr, 0};
+        }
+
+        auto const file_address = table->file_offset_to_address(address - it->start + it->offset);
+        if (!file_address) {
+            return {nullptr, 0};
+        }
+        return {table, *file_address};
+    }
+
+    void user_stack_unwinder_t::unwind_stack(pid_t pid,
+                                             std::uint64_t const * sample_registers,
+                                             lib::Span<char const> stack)
+    {
+        using rule_t = unwind_row_t::rule_t;
+
+        registers_t registers;
+        std::copy_n(sample_registers, registers.size(), registers.begin());
+        // the registers whose values are known
+        std::uint64_t known = ~std::uint64_t(0);
+
+        auto const stack_base = registers[sp_register];
+        auto const read_stack = [&](std::uint64_t address, std::uint64_t & value) {
+            if ((address < stack_base) || (stack.size() < word_size)
+                || ((address - stack_base) > (stack.size() - word_size))) {
+                return false;
+            }
+            std::memcpy(&value, stack.data() + (address - stack_base), word_size);
+            return true;
+        };
+
+        std::uint64_t pc = sample_registers[pc_register];
+        // the caller's addresses are return addresses, so are looked up one before, which is in the call instruction
+        bool is_return_address = false;
+        bool reread = false;
+        auto * process = &get_process(pid, false);
+
+        frames.push_back(pc);
+
+        while (frames.size() < max_frames) {
+            auto const lookup_address = (is_return_address ? pc - 1 : pc);
+
+            auto [table, file_address] = find_table(*process, lookup_address);
+            if ((table == nullptr) && !reread) {
+                // the process may have mapped something since its maps were read
+                reread = true;
+                process = &get_process(pid, true);
+                std::tie(table, file_address) = find_table(*process, lookup_address);
+            }
+            if (table == nullptr) {
+                break;
+            }
+
+            auto const row = table->find_row(file_address);
+            if ((!row) || (row->cfa_register >= registers.size()) || ((known & (1ULL << row->cfa_register)) == 0)) {
+                break;
+            }
+
+            auto const cfa = registers[row->cfa_register] + row->cfa_offset;
+
+            registers_t caller_registers = registers;
+            std::uint64_t caller_known = known;
+            for (std::size_t r = 0; r < registers.size(); ++r) {
+                auto const & rule = row->rules[r];
+                switch (rule.rule) {
+                    case rule_t::same_value:
+                        break;
+                    case rule_t::undefined:
+                        caller_known &= ~(1ULL << r);
+                        break;
+                    case rule_t::offset:
+                        if (!read_stack(cfa + rule.value, caller_registers[r])) {
+                            caller_known &= ~(1ULL << r);
+                        }
+                        break;
+                    case rule_t::val_offset:
+                        caller_registers[r] = cfa + rule.value;
+                        break;
+                    case rule_t::reg:
+                        if ((std::uint64_t(rule.value) < registers.size())
+                            && ((known & (1ULL << rule.value)) != 0)) {
+                            caller_registers[r] = registers[rule.value];
+                        }
+                        else {
+                            caller_known &= ~(1ULL << r);
+                        }
+                        break;
+                }
+            }
+            caller_registers[sp_register] = cfa;
+            caller_known |= (1ULL << sp_register);
+
+            // an undefined return address marks the outermost frame
+            auto const ra_register = row->return_address_register;
+            if ((ra_register >= registers.size()) || ((caller_known & (1ULL << ra_register)) == 0)) {
+                break;
+            }
+
+            auto const caller_pc = strip_pointer_authentication(caller_registers[ra_register]);
+
+            // the stack grows down, so each caller's frame must be above its callee's
+            if ((caller_pc == 0) || (cfa < registers[sp_register])
+                || ((cfa == registers[sp_register]) && (caller_pc == pc))) {
+                break;
+            }
+
+            registers = caller_registers;
+            known = caller_known;
+            pc = caller_pc;
+            is_return_address = !row->is_signal_frame;
+
+            frames.push_back(pc);
+        }
+    }
+}
@@ -0,0 +1,192 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#pragma once
+
+#include "agents/perf/dwarf_unwind_table.h"
+#include "agents/perf/events/event_configuration.hpp"
+#include "agents/perf/events/types.hpp"
+#include "lib/Span.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <sys/types.h>
+
+namespace agents::perf {
+    /**
+     * The state shared by the user stack unwinders of all the cpus in a capture; the location of the fields within the
+     * samples of each event id that copies the user stack, the maps of the sampled processes, and the unwind tables of
+     * the files that they map. The tables are found by build id so that a file that is mapped from several paths (or
+     * is replaced by an identical copy) is only read once.
+     *
+     * The ids are added from the capture's strand as the events are opened, whereas the unwinders run on each cpu's
+     * strand, so access is serialized by a mutex. Each unwinder keeps its own references to the maps and tables that
+     * it has used, so that the mutex is not taken for every sample.
+     */
+    class user_stack_unwind_state_t {
+    public:
+        /** Where the fields are found in a sample */
+        struct sample_format_t {
+            /** The offset, in words from the start of the record, of the read values (or of the callchain if none) */
+            std::size_t fixed_words;
+            /** The offset, in words from the start of the record, of the pid/tid word */
+            std::size_t pid_index;
+            std::uint64_t read_format;
+            bool has_read;
+            bool has_raw;
+        };
+
+        /** An executable mapping of some file */
+        struct mapping_t {
+            std::uint64_t start;
+            std::uint64_t end;
+            std::uint64_t offset;
+            std::uint64_t inode;
+            std::string path;
+        };
+
+        struct process_maps_t {
+            /** Sorted by start */
+            std::vector<mapping_t> mappings;
+            std::chrono::steady_clock::time_point read_time;
+            /** Set once the maps are known to have changed, so that the unwinders that hold them read them again */
+            mutable std::atomic_bool stale {false};
+        };
+
+        /** The maps of a process are read again no more often than this when an address is not in any of them */
+        static constexpr auto min_reread_interval = std::chrono::milliseconds(100);
+
+        /** Once the maps of this many processes are held they are all dropped, bounding the memory used */
+        static constexpr std::size_t max_processes = 4096;
+
+        /**
+         * @param configuration The capture's events; only those whose samples have the callchain, user registers and
+         * user stack, and start with their id (PERF_SAMPLE_IDENTIFIER), are unwound
+         */
+        explicit user_stack_unwind_state_t(event_configuration_t const & configuration);
+
+        /** @return True if no event copies the user stack */
+        [[nodiscard]] bool empty() const { return key_formats.empty(); }
+
+        /** Record the ids of newly opened events */
+        void add_ids(std::vector<std::pair<perf_event_id_t, gator_key_t>> const & mappings);
+
+        /** @return A value that changes whenever ids are added */
+        [[nodiscard]] std::uint64_t get_version() const { return version.load(std::memory_order_acquire); }
+
+        /** Copy the format of each id having a user stack into `formats` */
+        void copy_formats(std::unordered_map<std::uint64_t, sample_format_t> & formats) const;
+
+        /**
+         * @param reread Read the maps again (unless they were read within min_reread_interval), as some address was
+         * not in the current ones
+         * @return The executable file mappings of the process, which are empty if it has exited
+         */
+        [[nodiscard]] std::shared_ptr<process_maps_t const> get_process_maps(pid_t pid, bool reread);
+
+        /** Drop the maps of a process, as it has mapped some file, exec'd or exited */
+        void forget_process(pid_t pid);
+
+        /** @return The unwind table of the mapped file, or nullptr if it cannot be read or has no unwind tables */
+        [[nodiscard]] std::shared_ptr<dwarf_unwind_table_t const> get_table(mapping_t const & mapping);
+
+    private:
+        std::map<gator_key_t, sample_format_t> key_formats {};
+        mutable std::mutex mutex {};
+        std::unordered_map<std::uint64_t, sample_format_t> id_formats {};
+        std::atomic_uint64_t version {0};
+        std::unordered_map<pid_t, std::shared_ptr<process_maps_t const>> processes {};
+        /** By inode and path, as found in the maps */
+        std::map<std::pair<std::uint64_t, std::string>, std::shared_ptr<dwarf_unwind_table_t const>> file_tables {};
+        std::unordered_map<std::string, std::shared_ptr<dwarf_unwind_table_t const>> build_id_tables {};
+    };
+
+    /**
+     * Unwinds the copy of the user stack (PERF_SAMPLE_STACK_USER) in each perf sample record, using the .eh_frame or
+     * .debug_frame of the mapped files, so that the call stacks of code that is built without frame pointers are
+     * complete. Only the resulting addresses are sent to the host, rather than the copy of the stack.
+     *
+     * In a rewritten sample, the part of the callchain that follows PERF_CONTEXT_USER is replaced by the unwound
+     * addresses (if there are more of those than the kernel found by following the frame pointers), and the user
+     * stack's `size` is set to zero, which removes its `data[size]` and `dyn_size` words. The result is a valid sample
+     * of the same sample_type, so the later stages in the agent and the host need no changes. Records that are not
+     * samples, or whose event is unknown, are forwarded unchanged.
+     *
+     * Only the samples of 64-bit processes (PERF_SAMPLE_REGS_ABI_64, with the AArch64 register set) are unwound; the
+     * user stack is removed from the others.
+     */
+    class user_stack_unwinder_t {
+    public:
+        /** The unwinding stops after this many frames */
+        static constexpr std::size_t max_frames = 128;
+
+        struct stats_t {
+            std::uint64_t samples;
+            /** The samples whose callchain was replaced by the unwound one */
+            std::uint64_t unwound_samples;
+            std::uint64_t removed_bytes;
+        };
+
+        explicit user_stack_unwinder_t(std::shared_ptr<user_stack_unwind_state_t> state) : state(std::move(state)) {}
+
+        /**
+         * Unwind the user stacks in a chunk of whole perf data records
+         *
+         * @param first_span The first part of the records
+         * @param second_span The remainder of the records, which follows on from the first (when the mmap wrapped)
+         * @param records Receives the (possibly rewritten) records
+         */
+        void unwind(lib::Span<char const> first_span, lib::Span<char const> second_span, std::vector<char> & records);
+
+        [[nodiscard]] stats_t const & get_stats() const { return stats; }
+
+    private:
+        /** The number of registers in a sample's PERF_SAMPLE_REGS_USER, x0-x30, sp and pc */
+        static constexpr std::size_t num_sample_registers = 33;
+
+        using registers_t = std::array<std::uint64_t, unwind_row_t::num_registers>;
+
+        /** An unwinder's references to some process's maps, and the tables of its mappings as they are used */
+        struct process_t {
+            std::shared_ptr<user_stack_unwind_state_t::process_maps_t const> maps {};
+            std::vector<std::shared_ptr<dwarf_unwind_table_t const>> tables {};
+            std::vector<bool> resolved {};
+        };
+
+        std::shared_ptr<user_stack_unwind_state_t> state;
+        std::uint64_t formats_version = 0;
+        std::unordered_map<std::uint64_t, user_stack_unwind_state_t::sample_format_t> formats {};
+        std::unordered_map<pid_t, process_t> processes {};
+        /** Reused for the frames of each sample */
+        std::vector<std::uint64_t> frames {};
+        /** Reused for a record that is split across the two spans */
+        std::vector<char> split_record {};
+        stats_t stats {0, 0, 0};
+
+        [[nodiscard]] user_stack_unwind_state_t::sample_format_t const * find_format(std::uint64_t id);
+
+        void unwind_record(lib::Span<char const> record, std::vector<char> & records);
+
+        /** Forget the maps of the process that some non-sample record shows to have changed */
+        void check_process_record(lib::Span<char const> record);
+
+        [[nodiscard]] process_t & get_process(pid_t pid, bool reread);
+
+        /** @return The table and file address for some address in a process, or nullptr if it cannot be found */
+        [[nodiscard]] std::pair<dwarf_unwind_table_t const *, std::uint64_t> find_table(process_t & process,
+                                                                                       std::uint64_t address);
+
+        /** Unwind into `frames` from the sampled registers, reading the saved registers from the copy of the stack */
+        void unwind_stack(pid_t pid, std::uint64_t const * sample_registers, lib::Span<char const> stack);
+    };
+}
@@ -2,6 +2,7 @@
 #include "agents/spawn_agent.h"
 
 #include "android/Spawn.h"
+#include "ipc/shared_frame_ring.h"
 #include "lib/Assert.h"
 #include "lib/AutoClosingFd.h"
 #include "lib/FsEntry.h"
@@ -9,9 +10,21 @@
 #include "lib/error_code_or.hpp"
 #include "lib/forked_process.h"
 
+#include <chrono>
+
 #include <boost/system/errc.hpp>
 
 namespace agents {
+    namespace {
+        /** The agent's stdin is a socket so that the shell can send it the shared ring */
+        lib::error_code_or_t<lib::stdio_fds_t> create_agent_stdio_fds()
+        {
+            return lib::stdio_fds_t::create_from(lib::pipe_pair_t::create_socket_pair(0),
+                                                 lib::pipe_pair_t::create(0),
+                                                 lib::pipe_pair_t::create(0));
+        }
+    }
+
     /** Simple agent spawner */
     lib::error_code_or_t<lib::forked_process_t> simple_agent_spawner_t::spawn_agent_process(char const * agent_name)
     {
@@ -25,7 +38,7 @@ namespace agents {
             return boost::system::errc::make_error_code(boost::system::errc::no_such_file_or_directory);
         }
 
-        auto stdio_fds = lib::stdio_fds_t::create_pipes();
+        auto stdio_fds = create_agent_stdio_fds();
         if (auto const * error = lib::get_error(stdio_fds)) {
             return *error;
         }
@@ -36,12 +49,9 @@ namespace agents {
             arguments.emplace_back("--trace");
         }
 
-        return lib::forked_process_t::fork_process(true,
-                                                   gatord_exe->path(),
-                                                   arguments,
-                                                   {},
-                                                   {},
-                                                   lib::get_value(std::move(stdio_fds)));
+        return lib::forked_process_t::spawn_process(gatord_exe->path(),
+                                                    arguments,
+                                                    lib::get_value(std::move(stdio_fds)));
     }
 
     android_pkg_agent_spawner_t::~android_pkg_agent_spawner_t() noexcept
@@ -70,7 +80,7 @@ namespace agents {
             }
         }
 
-        auto stdio_fds = lib::stdio_fds_t::create_pipes();
+        auto stdio_fds = create_agent_stdio_fds();
         if (auto const * error = lib::get_error(stdio_fds)) {
             return *error;
         }
@@ -85,12 +95,7 @@ namespace agents {
             agent_name,
         }};
 
-        return lib::forked_process_t::fork_process(true,
-                                                   "run-as",
-                                                   arguments,
-                                                   {},
-                                                   {},
-                                                   lib::get_value(std::move(stdio_fds)));
+        return lib::forked_process_t::spawn_process("run-as", arguments, lib::get_value(std::move(stdio_fds)));
     }
 
     /** Spawn the agent */
@@ -99,13 +104,30 @@ namespace agents {
                                                            char const * agent_name,
                                                            logging::agent_log_reader_t::consumer_fn_t log_consumer)
     {
+        auto const spawn_start = std::chrono::steady_clock::now();
         auto result = spawner.spawn_agent_process(agent_name);
         if (auto const * error = lib::get_error(result)) {
+            LOG_ERROR("Could not spawn %s (%s)", agent_name, error->message().c_str());
             return *error;
         }
 
         auto process = lib::get_value(std::move(result));
-        auto ipc_source = ipc::raw_ipc_channel_source_t::create(io_context, std::move(process.get_stdout_read()));
+        LOG_DEBUG("Spawned %s (pid %d) in %lld us",
+                  agent_name,
+                  process.get_pid(),
+                  static_cast<long long>(std::chrono::duration_cast<std::chrono::microseconds>(
+                                             std::chrono::steady_clock::now() - spawn_start)
+                                             .count()));
+
+        // offer the agent the shared ring for its frame data (only the pipe is used if there is no ring)
+        auto ring = ipc::shared_frame_ring_t::create();
+        if (!ipc::shared_frame_ring_t::send_offer(process.get_stdin_write().get(), ring.get())) {
+            return boost::system::errc::make_error_code(boost::system::errc::broken_pipe);
+        }
+
+        auto ipc_source = ipc::raw_ipc_channel_source_t::create_for_agent(io_context,
+                                                                          std::move(process.get_stdout_read()),
+                                                                          std::move(ring));
         auto ipc_sink = ipc::raw_ipc_channel_sink_t::create(io_context, std::move(process.get_stdin_write()));
         auto log_reader = logging::agent_log_reader_t::create(io_context,
                                                               std::move(process.get_stderr_read()),
@@ -40,7 +40,7 @@ namespace agents {
     };
 
     /**
-     * Default, simple implementation of i_agent_spawner_t that just forks/exec the current process binary
+     * Default, simple implementation of i_agent_spawner_t that just spawns the current process binary
      */
     class simple_agent_spawner_t final : public i_agent_spawner_t {
     public:
@@ -1,4 +1,4 @@
-/* Copyright (C) 2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2021-2022 by Arm Limited. All rights reserved. */
 
 #include "android/PropertyUtils.h"
 
@@ -9,10 +9,43 @@
 #include <array>
 #include <cerrno>
 
+#include <dlfcn.h>
+
 namespace android_prop_utils {
     constexpr std::string_view GET_PROP = "getprop";
     constexpr std::string_view SET_PROP = "setprop";
 
+    namespace {
+        using FnPtr_system_property_set = int (*)(const char *, const char *);
+
+        /**
+         * Sets the property through bionic, which saves starting a setprop process
+         *
+         * @return True if set, false if it was not (or bionic is not available, so it must be set with setprop)
+         */
+        bool setPropertyDirectly(std::string_view prop, std::string_view value)
+        {
+#if defined(ANDROID) || defined(__ANDROID__)
+            static const auto fn_system_property_set =
+                reinterpret_cast<FnPtr_system_property_set>(dlsym(RTLD_DEFAULT, "__system_property_set"));
+            if (fn_system_property_set == nullptr) {
+                return false;
+            }
+            const std::string propStr {prop};
+            const std::string valueStr {value};
+            if (fn_system_property_set(propStr.c_str(), valueStr.c_str()) != 0) {
+                LOG_DEBUG("__system_property_set(%s, %s) failed", propStr.c_str(), valueStr.c_str());
+                return false;
+            }
+            return true;
+#else
+            (void) prop;
+            (void) value;
+            return false;
+#endif
+        }
+    }
+
     std::optional<std::string> readProperty(std::string_view prop, bool singleLine)
     {
         std::string result;
@@ -42,6 +75,10 @@ namespace android_prop_utils {
 
     bool setProperty(std::string_view prop, std::string_view value)
     {
+        if (setPropertyDirectly(prop, value)) {
+            return true;
+        }
+
         const lib::PopenResult setPropResult = lib::popen(SET_PROP.data(), prop.data(), value.data());
         //setprop not found, probably not Android.
         if (setPropResult.pid == -ENOENT) {
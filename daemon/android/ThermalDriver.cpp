@@ -7,7 +7,11 @@
 #include "SessionData.h"
 #include "mxml/mxml.h"
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
 #include <cstdint>
 #include <cstdio>
 #include <string_view>
@@ -24,11 +28,15 @@ namespace gator::android {
     using FnPtr_AThermal_acquireManager = AThermalManager * (*) ();
     using FnPtr_AThermal_getCurrentThermalStatus = AThermalStatus (*)(AThermalManager *);
     using FnPtr_AThermal_releaseManager = void (*)(AThermalManager *);
+    using AThermal_StatusCallback = void (*)(void *, AThermalStatus);
+    using FnPtr_AThermal_registerThermalStatusListener = int (*)(AThermalManager *, AThermal_StatusCallback, void *);
+    using FnPtr_AThermal_unregisterThermalStatusListener = int (*)(AThermalManager *, AThermal_StatusCallback, void *);
+    using FnPtr_AThermal_getThermalHeadroom = float (*)(AThermalManager *, int);
 
     /**
      * AThermalWrapper struct is used to house the Thermal library function pointers.
      * This library must be accessed dynamically, as it does not exist on some target devices.
-     * Requires Android 11+
+     * Requires Android 11+, and Android 12+ for the headroom
      */
     struct AThermalWrapper {
     public:
@@ -40,6 +48,12 @@ namespace gator::android {
                 dlsym(lib_ptr, "AThermal_getCurrentThermalStatus"));
             fn_releaseManager =
                 reinterpret_cast<FnPtr_AThermal_releaseManager>(dlsym(lib_ptr, "AThermal_releaseManager"));
+            fn_registerThermalStatusListener = reinterpret_cast<FnPtr_AThermal_registerThermalStatusListener>(
+                dlsym(lib_ptr, "AThermal_registerThermalStatusListener"));
+            fn_unregisterThermalStatusListener = reinterpret_cast<FnPtr_AThermal_unregisterThermalStatusListener>(
+                dlsym(lib_ptr, "AThermal_unregisterThermalStatusListener"));
+            fn_getThermalHeadroom =
+                reinterpret_cast<FnPtr_AThermal_getThermalHeadroom>(dlsym(lib_ptr, "AThermal_getThermalHeadroom"));
         }
 
         [[nodiscard]] FnPtr_AThermal_acquireManager acquireManager() const { return fn_acquireManager; };
@@ -48,11 +62,75 @@ namespace gator::android {
             return fn_getCurrentThermalStatus;
         };
         [[nodiscard]] FnPtr_AThermal_releaseManager releaseManager() const { return fn_releaseManager; };
+        [[nodiscard]] FnPtr_AThermal_registerThermalStatusListener registerThermalStatusListener() const
+        {
+            return fn_registerThermalStatusListener;
+        };
+        [[nodiscard]] FnPtr_AThermal_unregisterThermalStatusListener unregisterThermalStatusListener() const
+        {
+            return fn_unregisterThermalStatusListener;
+        };
+        /** May be null, as it was added after the rest */
+        [[nodiscard]] FnPtr_AThermal_getThermalHeadroom getThermalHeadroom() const { return fn_getThermalHeadroom; };
 
     private:
         FnPtr_AThermal_acquireManager fn_acquireManager;
         FnPtr_AThermal_getCurrentThermalStatus fn_getCurrentThermalStatus;
         FnPtr_AThermal_releaseManager fn_releaseManager;
+        FnPtr_AThermal_registerThermalStatusListener fn_registerThermalStatusListener;
+        FnPtr_AThermal_unregisterThermalStatusListener fn_unregisterThermalStatusListener;
+        FnPtr_AThermal_getThermalHeadroom fn_getThermalHeadroom;
+    };
+
+    /**
+     * The thermal manager of a capture, and the values read from it.
+     *
+     * The status is updated by the listener as it changes, so that reading it is only a load, and the most severe
+     * status since the last sample is kept so that a brief change between polls is not missed. The headroom has to be
+     * asked for, which the thermal service allows at most once a second.
+     */
+    struct ThermalState {
+        // the status is an int, incremented by one so that negative values (including the error value) map to zero
+        static int toCounterValue(AThermalStatus status) { return std::max<int>(0, status + 1); }
+
+        static void onStatusChanged(void * data, AThermalStatus status)
+        {
+            auto & state = *static_cast<ThermalState *>(data);
+            const int value = toCounterValue(status);
+            state.status.store(value, std::memory_order_relaxed);
+
+            int peak = state.peakStatus.load(std::memory_order_relaxed);
+            while ((value > peak) && !state.peakStatus.compare_exchange_weak(peak, value, std::memory_order_relaxed)) {
+            }
+        }
+
+        explicit ThermalState(void * lib_ptr) : atw(lib_ptr) {}
+
+        // Intentionally undefined
+        ThermalState(const ThermalState &) = delete;
+        ThermalState & operator=(const ThermalState &) = delete;
+        ThermalState(ThermalState &&) = delete;
+        ThermalState & operator=(ThermalState &&) = delete;
+
+        ~ThermalState()
+        {
+            if (manager != nullptr) {
+                if (isListening) {
+                    atw.unregisterThermalStatusListener()(manager, &onStatusChanged, this);
+                }
+                atw.releaseManager()(manager);
+            }
+        }
+
+        AThermalWrapper atw;
+        AThermalManager * manager = nullptr;
+        bool isListening = false;
+        std::atomic_int status {0};
+        std::atomic_int peakStatus {0};
+        // written by sample, and read by the counters in the same thread
+        int sampledStatus = 0;
+        float headroom = 0;
+        std::chrono::steady_clock::time_point nextHeadroomRead {};
     };
 
     /**
@@ -60,8 +138,8 @@ namespace gator::android {
      */
     class ThermalCounter : public DriverCounter {
     public:
-        ThermalCounter(DriverCounter * next, const char * name, void * lib_ptr)
-            : DriverCounter(next, name), atw(lib_ptr)
+        ThermalCounter(DriverCounter * next, const char * name, const ThermalState & state)
+            : DriverCounter(next, name), state(state)
         {
         }
 
@@ -71,12 +149,22 @@ namespace gator::android {
         ThermalCounter(ThermalCounter &&) = delete;
         ThermalCounter & operator=(ThermalCounter &&) = delete;
 
-        void setCounterValues(mxml_node_t * node);
+        virtual void setCounterValues(mxml_node_t * node);
         int64_t read() override;
 
-    private:
-        AThermalWrapper atw;
-        void findThermalLibrary();
+    protected:
+        const ThermalState & state;
+    };
+
+    /**
+     * ThermalHeadroomCounter class defines a counter for displaying how close the device is to severe throttling
+     */
+    class ThermalHeadroomCounter : public ThermalCounter {
+    public:
+        using ThermalCounter::ThermalCounter;
+
+        void setCounterValues(mxml_node_t * node) override;
+        int64_t read() override;
     };
 
     /**
@@ -117,15 +205,36 @@ namespace gator::android {
     }
 
     /**
-     * Gets the current value of thermal status and returns.
+     * Gets the value of thermal status from the last sample and returns.
      */
     int64_t ThermalCounter::read()
     {
-        auto * mgr = atw.acquireManager()();
-        auto status = atw.getCurrentThermalStatus()(mgr);
+        return state.sampledStatus;
+    }
 
-        // convert to an int, incrementing by one so that negative values (including the error value are mapped to zero)
-        return std::max<int>(0, status + 1);
+    void ThermalHeadroomCounter::setCounterValues(mxml_node_t * node)
+    {
+        mxmlElementSetAttr(node, "counter", getName());
+        mxmlElementSetAttr(node, "title", "Android Thermal Throttling");
+        mxmlElementSetAttr(node, "name", "Thermal Headroom");
+        mxmlElementSetAttr(node, "display", "average");
+        mxmlElementSetAttr(node, "class", "absolute");
+        mxmlElementSetAttr(node, "units", "");
+        mxmlElementSetAttr(node, "multiplier", "0.01");
+        mxmlElementSetAttr(node, "average_selection", "yes");
+        mxmlElementSetAttr(node, "rendering_type", "line");
+        mxmlElementSetAttr(node, "proc", "no");
+        mxmlElementSetAttr(node, "per_core", "no");
+        mxmlElementSetAttr(node, "description",
+                           "Thermal headroom, where 1.0 is the point at which the device is severely throttled");
+    }
+
+    /**
+     * Gets the value of thermal headroom from the last sample (scaled by 100) and returns.
+     */
+    int64_t ThermalHeadroomCounter::read()
+    {
+        return std::lround(state.headroom * 100);
     }
 
     /**
@@ -158,14 +267,79 @@ namespace gator::android {
 #endif
     }
 
-    ThermalDriver::ThermalDriver() : PolledDriver("Thermal") { findThermalLibrary(); }
+    ThermalDriver::ThermalDriver() : PolledDriver("Thermal")
+    {
+        findThermalLibrary();
+        if (lib_ptr != nullptr) {
+            state = std::make_unique<ThermalState>(lib_ptr);
+        }
+    }
+
+    ThermalDriver::~ThermalDriver() = default;
+
     /**
      *  Performs counter discovery. Checks for conditions and creates one or more counters if those conditions are met.
      */
     void ThermalDriver::readEvents(mxml_node_t * /*unused*/)
     {
-        if (lib_ptr != nullptr) {
-            setCounters(new ThermalCounter(getCounters(), "Android_ThermalState", lib_ptr));
+        if (state != nullptr) {
+            setCounters(new ThermalCounter(getCounters(), "Android_ThermalState", *state));
+            if (state->atw.getThermalHeadroom() != nullptr) {
+                setCounters(new ThermalHeadroomCounter(getCounters(), "Android_ThermalHeadroom", *state));
+            }
+        }
+    }
+
+    void ThermalDriver::start()
+    {
+        if ((state == nullptr) || (state->manager != nullptr) || !countersEnabled()) {
+            return;
+        }
+
+        // one manager for the whole capture, as each acquisition goes through binder to the thermal service
+        state->manager = state->atw.acquireManager()();
+        if (state->manager == nullptr) {
+            LOG_WARNING("Unable to acquire the Android thermal manager");
+            return;
+        }
+
+        const int status = ThermalState::toCounterValue(state->atw.getCurrentThermalStatus()(state->manager));
+        state->status.store(status, std::memory_order_relaxed);
+        state->peakStatus.store(status, std::memory_order_relaxed);
+
+        state->isListening =
+            (state->atw.registerThermalStatusListener() != nullptr)
+            && (state->atw.unregisterThermalStatusListener() != nullptr)
+            && (state->atw.registerThermalStatusListener()(state->manager, &ThermalState::onStatusChanged, state.get())
+                == 0);
+        if (!state->isListening) {
+            LOG_DEBUG("Unable to listen for thermal status changes, so the status is read on each poll");
+        }
+    }
+
+    void ThermalDriver::sample()
+    {
+        if ((state == nullptr) || (state->manager == nullptr)) {
+            return;
+        }
+
+        if (state->isListening) {
+            // report the most severe status since the last sample, then start again from the current one
+            state->sampledStatus =
+                state->peakStatus.exchange(state->status.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+        else {
+            state->sampledStatus = ThermalState::toCounterValue(state->atw.getCurrentThermalStatus()(state->manager));
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+        if ((state->atw.getThermalHeadroom() != nullptr) && (now >= state->nextHeadroomRead)) {
+            state->nextHeadroomRead = now + std::chrono::seconds(1);
+            const float headroom = state->atw.getThermalHeadroom()(state->manager, 0);
+            // NaN if it is not known, so keep the previous value
+            if (!std::isnan(headroom)) {
+                state->headroom = headroom;
+            }
         }
     }
 
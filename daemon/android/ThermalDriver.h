@@ -2,10 +2,13 @@
 
 #include "PolledDriver.h"
 
+#include <memory>
+
 namespace gator::android {
 
     // forward declaration
     typedef struct _mxml_node_s mxml_node_t;
+    struct ThermalState;
 
     /**
      * ThermalDriver class is used to send Thermal data back to streamline.
@@ -13,6 +16,7 @@ namespace gator::android {
     class ThermalDriver : public PolledDriver {
     public:
         ThermalDriver();
+        ~ThermalDriver() override;
 
         // Intentionally unimplemented
         ThermalDriver(const ThermalDriver &) = delete;
@@ -23,8 +27,16 @@ namespace gator::android {
         void readEvents(mxml_node_t * xml) override;
         void writeEvents(mxml_node_t * root) const override;
 
+        /** Acquires the thermal manager for the capture, and listens for changes of the thermal status */
+        void start() override;
+        void sample() override;
+
+        // reading the headroom calls into the thermal HAL
+        [[nodiscard]] bool isSlowToRead() const override { return true; }
+
     private:
         void * lib_ptr; /**< Used to hold a pointer to the Thermal Library*/
+        std::unique_ptr<ThermalState> state; /**< Shared with the counters and the status listener */
 
         /**
          * Checks if the thermal library exists
@@ -0,0 +1,196 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+/*
+ * gator-apc-decode: decodes the counters, perf samples and thread names of a local capture to CSV or column files,
+ * without going through Streamline.
+ *
+ *   gator-apc-decode [--format=csv|columns] [--threads=N] [--output=DIR] [--no-sort] CAPTURE.apc|DATAFILE...
+ */
+
+#include "apc/capture_decoder.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <getopt.h>
+#include <sys/stat.h>
+
+namespace {
+    /** The data files of a capture are numbered, as in Sender::getDataFileName */
+    constexpr std::size_t data_file_name_length = 10;
+
+    void print_usage(char const * name)
+    {
+        std::fprintf(stderr,
+                     "Usage: %s [OPTIONS] CAPTURE.apc|DATAFILE...\n"
+                     "Decodes the counters, perf samples and thread names of local captures.\n"
+                     "\n"
+                     "  -f, --format=csv|columns  the output format (default csv); columns writes each column as a\n"
+                     "                            packed array of little endian values, such as counters.time.i64\n"
+                     "  -j, --threads=N           the number of decoding threads (default one per processor)\n"
+                     "  -o, --output=DIR          the directory to write to (default the current directory)\n"
+                     "  -n, --no-sort             leave the rows grouped by stream rather than sorted by time\n"
+                     "  -h, --help                show this help\n"
+                     "\n"
+                     "A compressed capture (--compress-local-capture) must be decompressed with lz4 -d first.\n",
+                     name);
+    }
+
+    bool is_data_file_name(char const * name)
+    {
+        return (std::strlen(name) == data_file_name_length)
+            && std::all_of(name, name + data_file_name_length, [](char c) { return std::isdigit(c) != 0; });
+    }
+
+    /** @return The data files of the capture in order, or the path itself if it is a file */
+    std::vector<std::string> find_data_files(std::string const & path, bool & has_compressed)
+    {
+        struct stat st {};
+        if ((stat(path.c_str(), &st) != 0) || !S_ISDIR(st.st_mode)) {
+            return {path};
+        }
+
+        std::vector<std::string> names;
+        std::unique_ptr<DIR, int (*)(DIR *)> dir {opendir(path.c_str()), closedir};
+        if (dir) {
+            // NOLINTNEXTLINE(concurrency-mt-unsafe)
+            for (struct dirent * entry = readdir(dir.get()); entry != nullptr; entry = readdir(dir.get())) {
+                if (is_data_file_name(entry->d_name)) {
+                    names.emplace_back(entry->d_name);
+                }
+                else if ((std::strlen(entry->d_name) == data_file_name_length + 4)
+                         && (std::strcmp(entry->d_name + data_file_name_length, ".lz4") == 0)) {
+                    has_compressed = true;
+                }
+            }
+        }
+
+        // the oldest segments may have been removed, so start with whichever is first
+        std::sort(names.begin(), names.end());
+        for (auto & name : names) {
+            name = path + "/" + name;
+        }
+        return names;
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    static struct option const long_options[] = {
+        {"format", required_argument, nullptr, 'f'},
+        {"threads", required_argument, nullptr, 'j'},
+        {"output", required_argument, nullptr, 'o'},
+        {"no-sort", no_argument, nullptr, 'n'},
+        {"help", no_argument, nullptr, 'h'},
+        {nullptr, 0, nullptr, 0},
+    };
+
+    bool columns = false;
+    unsigned threads = 0;
+    std::string output = ".";
+    bool sort = true;
+
+    int c;
+    // NOLINTNEXTLINE(concurrency-mt-unsafe)
+    while ((c = getopt_long(argc, argv, "f:j:o:nh", long_options, nullptr)) != -1) {
+        switch (c) {
+            case 'f':
+                if (std::strcmp(optarg, "columns") == 0) {
+                    columns = true;
+                }
+                else if (std::strcmp(optarg, "csv") != 0) {
+                    std::fprintf(stderr, "Unknown format '%s'\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'j':
+                threads = static_cast<unsigned>(std::strtoul(optarg, nullptr, 10));
+                break;
+            case 'o':
+                output = optarg;
+                break;
+            case 'n':
+                sort = false;
+                break;
+            case 'h':
+                print_usage(argv[0]);
+                return EXIT_SUCCESS;
+            default:
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (optind >= argc) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    auto const start = std::chrono::steady_clock::now();
+
+    apc::capture_decoder_t decoder {threads};
+    std::map<std::int32_t, std::string> counter_names;
+    std::uint64_t bytes = 0;
+    std::string error;
+    for (int i = optind; i < argc; ++i) {
+        std::string const path = argv[i];
+        bool has_compressed = false;
+        auto const files = find_data_files(path, has_compressed);
+        if (files.empty()) {
+            std::fprintf(stderr,
+                         (has_compressed ? "%s is compressed; decompress its data files with lz4 -d first\n"
+                                         : "%s has no data files\n"),
+                         path.c_str());
+            return EXIT_FAILURE;
+        }
+
+        for (auto const & file : files) {
+            struct stat st {};
+            if (stat(file.c_str(), &st) == 0) {
+                bytes += static_cast<std::uint64_t>(st.st_size);
+            }
+            if (!decoder.decode_file(file.c_str(), error)) {
+                std::fprintf(stderr, "%s: %s\n", file.c_str(), error.c_str());
+                return EXIT_FAILURE;
+            }
+        }
+
+        auto names = apc::read_counter_names((path + "/captured.xml").c_str());
+        counter_names.insert(names.begin(), names.end());
+    }
+
+    if (sort) {
+        decoder.sort();
+    }
+
+    if (!(columns ? apc::write_columns(decoder, output, error) : apc::write_csv(decoder, output, error))
+        || (!counter_names.empty() && !apc::write_keys_csv(counter_names, output, error))) {
+        std::fprintf(stderr, "%s\n", error.c_str());
+        return EXIT_FAILURE;
+    }
+
+    auto const elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::fprintf(stderr,
+                 "Decoded %.1f MB in %.2f s: %zu counter values, %zu samples, %zu threads",
+                 static_cast<double>(bytes) / (1024.0 * 1024.0),
+                 elapsed,
+                 decoder.get_counters().size(),
+                 decoder.get_samples().size(),
+                 decoder.get_threads().size());
+    if (decoder.get_malformed_frames() > 0) {
+        std::fprintf(stderr, " (%" PRIu64 " frames could not be decoded)", decoder.get_malformed_frames());
+    }
+    std::fprintf(stderr, "\n");
+
+    return EXIT_SUCCESS;
+}
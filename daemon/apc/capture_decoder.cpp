@@ -0,0 +1,877 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "apc/capture_decoder.h"
+
+#include "Protocol.h"
+#include "k/perf_event.h"
+#include "lib/AutoClosingFd.h"
+#include "mxml/mxml.h"
+#include "xml/MxmlUtils.h"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <charconv>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace apc {
+    namespace {
+        constexpr std::size_t frame_length_size = sizeof(std::uint32_t);
+        constexpr std::uint32_t perf_record_sample = 9;
+        // not defined by older kernel headers
+        constexpr std::uint64_t perf_format_lost = 1U << 4;
+
+        /** The keys of a block counter frame that are not counters */
+        constexpr std::int32_t block_counter_time_key = 0;
+        constexpr std::int32_t block_counter_tid_key = 1;
+        constexpr std::int32_t block_counter_core_key = 2;
+
+        template<typename T>
+        bool unpack(lib::Span<char const> frame, std::size_t & position, T & value)
+        {
+            using unsigned_t = std::make_unsigned_t<T>;
+
+            unsigned_t result = 0;
+            unsigned shift = 0;
+            std::uint8_t byte = 0;
+            do {
+                if ((position >= frame.size()) || (shift >= (8 * sizeof(T) + 7))) {
+                    return false;
+                }
+                byte = static_cast<std::uint8_t>(frame[position++]);
+                if (shift < (8 * sizeof(T))) {
+                    result |= static_cast<unsigned_t>(byte & 0x7fU) << shift;
+                }
+                shift += 7;
+            } while ((byte & 0x80U) != 0);
+
+            // sign extend from the last bit 6
+            if ((shift < (8 * sizeof(T))) && ((byte & 0x40U) != 0)) {
+                result |= ~unsigned_t(0) << shift;
+            }
+
+            value = static_cast<T>(result);
+            return true;
+        }
+
+        bool is_set(std::uint64_t bits, std::uint64_t flag)
+        {
+            return (bits & flag) != 0;
+        }
+
+        /** Buffers the output of a file, formatting the numbers without going through stdio */
+        class output_file_t {
+        public:
+            static constexpr std::size_t buffer_size = 1024 * 1024;
+
+            output_file_t(std::string const & directory, char const * name)
+                : path(directory + "/" + name), file(std::fopen(path.c_str(), "wb"))
+            {
+                buffer.reserve(buffer_size);
+            }
+
+            output_file_t(output_file_t const &) = delete;
+            output_file_t & operator=(output_file_t const &) = delete;
+            output_file_t(output_file_t &&) = delete;
+            output_file_t & operator=(output_file_t &&) = delete;
+
+            ~output_file_t()
+            {
+                if (file != nullptr) {
+                    std::fclose(file);
+                }
+            }
+
+            [[nodiscard]] bool is_open() const { return file != nullptr; }
+
+            void write(std::string_view text)
+            {
+                if (buffer.size() + text.size() > buffer_size) {
+                    flush();
+                }
+                buffer.insert(buffer.end(), text.begin(), text.end());
+            }
+
+            template<typename T>
+            void write_number(T value)
+            {
+                std::array<char, 24> digits;
+                auto const result = std::to_chars(digits.data(), digits.data() + digits.size(), value);
+                write({digits.data(), static_cast<std::size_t>(result.ptr - digits.data())});
+            }
+
+            /** Write a CSV field, quoted if it needs to be */
+            void write_field(std::string_view text)
+            {
+                if (text.find_first_of(",\"\n") == std::string_view::npos) {
+                    write(text);
+                    return;
+                }
+                write("\"");
+                for (char c : text) {
+                    write((c == '"') ? std::string_view {"\"\""} : std::string_view {&c, 1});
+                }
+                write("\"");
+            }
+
+            /** Write a column, as a packed array of its values */
+            template<typename Row, typename Field>
+            void write_column(std::vector<Row> const & rows, Field Row::*field)
+            {
+                for (auto const & row : rows) {
+                    auto const value = row.*field;
+                    write({reinterpret_cast<char const *>(&value), sizeof(value)});
+                }
+            }
+
+            bool close(std::string & error)
+            {
+                flush();
+                bool const closed = (std::fclose(file) == 0) && !failed;
+                file = nullptr;
+                if (!closed) {
+                    error = "Unable to write " + path;
+                }
+                return closed;
+            }
+
+        private:
+            std::string path;
+            std::FILE * file;
+            std::vector<char> buffer {};
+            bool failed {false};
+
+            void flush()
+            {
+                if ((!buffer.empty()) && (std::fwrite(buffer.data(), 1, buffer.size(), file) != buffer.size())) {
+                    failed = true;
+                }
+                buffer.clear();
+            }
+        };
+
+        bool open_output(output_file_t const & output, std::string const & name, std::string & error)
+        {
+            if (!output.is_open()) {
+                // NOLINTNEXTLINE(concurrency-mt-unsafe)
+                error = "Unable to create " + name + " (" + std::strerror(errno) + ")";
+                return false;
+            }
+            return true;
+        }
+
+        bool write_threads_csv(capture_decoder_t const & decoder, std::string const & directory, std::string & error)
+        {
+            output_file_t output {directory, "threads.csv"};
+            if (!open_output(output, "threads.csv", error)) {
+                return false;
+            }
+
+            output.write("pid,tid,image,comm\n");
+            for (auto const & row : decoder.get_threads()) {
+                output.write_number(row.pid);
+                output.write(",");
+                output.write_number(row.tid);
+                output.write(",");
+                output.write_field(row.image);
+                output.write(",");
+                output.write_field(row.comm);
+                output.write("\n");
+            }
+            return output.close(error);
+        }
+
+        template<typename Row, typename Field>
+        bool write_column_file(std::vector<Row> const & rows,
+                               Field Row::*field,
+                               std::string const & directory,
+                               std::string const & name,
+                               std::string & error)
+        {
+            output_file_t output {directory, name.c_str()};
+            if (!open_output(output, name, error)) {
+                return false;
+            }
+            output.write_column(rows, field);
+            return output.close(error);
+        }
+    }
+
+    std::optional<mapped_file_t> mapped_file_t::open(char const * path, std::string & error)
+    {
+        lib::AutoClosingFd fd {::open(path, O_RDONLY | O_CLOEXEC)};
+        struct stat st {};
+        if ((!fd) || (::fstat(*fd, &st) != 0)) {
+            // NOLINTNEXTLINE(concurrency-mt-unsafe)
+            error = std::string("Unable to open ") + path + " (" + std::strerror(errno) + ")";
+            return {};
+        }
+
+        auto const length = static_cast<std::size_t>(st.st_size);
+        if (length == 0) {
+            return mapped_file_t {nullptr, 0};
+        }
+
+        void * const address = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, *fd, 0);
+        if (address == MAP_FAILED) {
+            // NOLINTNEXTLINE(concurrency-mt-unsafe)
+            error = std::string("Unable to map ") + path + " (" + std::strerror(errno) + ")";
+            return {};
+        }
+
+        // the frames are read in order
+        ::madvise(address, length, MADV_SEQUENTIAL);
+
+        return mapped_file_t {static_cast<char const *>(address), length};
+    }
+
+    mapped_file_t::mapped_file_t(mapped_file_t && that) noexcept
+        : address(std::exchange(that.address, nullptr)), length(std::exchange(that.length, 0))
+    {
+    }
+
+    mapped_file_t & mapped_file_t::operator=(mapped_file_t && that) noexcept
+    {
+        std::swap(address, that.address);
+        std::swap(length, that.length);
+        return *this;
+    }
+
+    mapped_file_t::~mapped_file_t()
+    {
+        if (address != nullptr) {
+            // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
+            ::munmap(const_cast<char *>(address), length);
+        }
+    }
+
+    bool frame_reader_t::read_int(std::int32_t & value)
+    {
+        return unpack(frame, position, value);
+    }
+
+    bool frame_reader_t::read_int64(std::int64_t & value)
+    {
+        return unpack(frame, position, value);
+    }
+
+    bool frame_reader_t::read_le_uint32(std::uint32_t & value)
+    {
+        if (remaining() < sizeof(value)) {
+            return false;
+        }
+        value = 0;
+        for (std::size_t byte = 0; byte < sizeof(value); ++byte) {
+            value |= std::uint32_t(static_cast<std::uint8_t>(frame[position++])) << (8 * byte);
+        }
+        return true;
+    }
+
+    bool frame_reader_t::read_bytes(std::size_t count, lib::Span<char const> & bytes)
+    {
+        if (remaining() < count) {
+            return false;
+        }
+        bytes = {frame.data() + position, count};
+        position += count;
+        return true;
+    }
+
+    bool frame_reader_t::read_string(std::string_view & value)
+    {
+        std::int32_t length = 0;
+        lib::Span<char const> bytes;
+        if ((!read_int(length)) || (length < 0) || (!read_bytes(length, bytes))) {
+            return false;
+        }
+        value = {bytes.data(), bytes.size()};
+        return true;
+    }
+
+    bool frame_reader_t::read_c_string(std::string_view & value)
+    {
+        auto const * const start = frame.data() + position;
+        auto const * const end = static_cast<char const *>(std::memchr(start, 0, remaining()));
+        if (end == nullptr) {
+            return false;
+        }
+        value = {start, static_cast<std::size_t>(end - start)};
+        position += value.size() + 1;
+        return true;
+    }
+
+    capture_decoder_t::capture_decoder_t(unsigned threads)
+        : worker_count(threads > 0 ? threads : std::max(1U, std::thread::hardware_concurrency()))
+    {
+    }
+
+    bool capture_decoder_t::decode_file(char const * path, std::string & error)
+    {
+        auto file = mapped_file_t::open(path, error);
+        if (!file) {
+            return false;
+        }
+        return decode(file->data(), error);
+    }
+
+    bool capture_decoder_t::decode(lib::Span<char const> data, std::string & error)
+    {
+        // split the data into its frames, and decode those that must be read in order
+        std::vector<frame_t> frames;
+        std::size_t offset = 0;
+        while (offset < data.size()) {
+            frame_reader_t length_reader {{data.data() + offset, data.size() - offset}};
+            std::uint32_t length = 0;
+            lib::Span<char const> frame;
+            if ((!length_reader.read_le_uint32(length)) || (!length_reader.read_bytes(length, frame))) {
+                // the end of a capture that did not finish writing is expected to be cut short
+                malformed_frames += 1;
+                break;
+            }
+            offset += frame_length_size + length;
+
+            frame_reader_t reader {frame};
+            std::int32_t type = 0;
+            if (!reader.read_int(type)) {
+                malformed_frames += 1;
+                continue;
+            }
+            frame_counts[type] += 1;
+
+            switch (static_cast<FrameType>(type)) {
+                case FrameType::SUMMARY: {
+                    if (!decode_summary_frame(reader)) {
+                        malformed_frames += 1;
+                    }
+                    break;
+                }
+                case FrameType::PERF_ATTRS: {
+                    if (!decode_perf_attrs_frame(reader)) {
+                        malformed_frames += 1;
+                    }
+                    break;
+                }
+                case FrameType::BLOCK_COUNTER_DELTA: {
+                    std::int32_t stream = 0;
+                    if (!reader.read_int(stream)) {
+                        malformed_frames += 1;
+                        break;
+                    }
+                    delta_stream_times.try_emplace(stream, 0);
+                    frames.push_back({frame, type, stream});
+                    break;
+                }
+                case FrameType::BLOCK_COUNTER:
+                case FrameType::PERF_DATA: {
+                    // each frame stands alone, so they can be spread over all the workers
+                    frames.push_back({frame, type, static_cast<std::int64_t>(frames.size())});
+                    break;
+                }
+                default: {
+                    // not exported
+                    break;
+                }
+            }
+        }
+
+        // decode the streams in parallel
+        std::vector<worker_result_t> results(worker_count);
+        auto const decode_frames = [this, &frames, &results](unsigned worker) {
+            worker_result_t & result = results[worker];
+            for (auto const & frame : frames) {
+                if ((static_cast<std::uint64_t>(frame.stream) % worker_count) != worker) {
+                    continue;
+                }
+
+                frame_reader_t reader {frame.data};
+                std::int32_t type = 0;
+                reader.read_int(type);
+
+                bool decoded = false;
+                if (type == static_cast<int>(FrameType::PERF_DATA)) {
+                    decoded = decode_perf_data_frame(reader, result);
+                }
+                else if (type == static_cast<int>(FrameType::BLOCK_COUNTER_DELTA)) {
+                    // the stream is only ever updated by this worker
+                    decoded = decode_block_counter_frame(reader, &delta_stream_times.find(frame.stream)->second, result);
+                }
+                else {
+                    decoded = decode_block_counter_frame(reader, nullptr, result);
+                }
+
+                if (!decoded) {
+                    result.malformed_frames += 1;
+                }
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for (unsigned worker = 1; worker < worker_count; ++worker) {
+            workers.emplace_back(decode_frames, worker);
+        }
+        decode_frames(0);
+        for (auto & worker : workers) {
+            worker.join();
+        }
+
+        for (auto & result : results) {
+            counters.insert(counters.end(), result.counters.begin(), result.counters.end());
+            samples.insert(samples.end(), result.samples.begin(), result.samples.end());
+            malformed_frames += result.malformed_frames;
+        }
+
+        if (frames.empty() && frame_counts.empty() && !data.empty()) {
+            error = "No frames could be read; is the data file compressed?";
+            return false;
+        }
+        return true;
+    }
+
+    void capture_decoder_t::sort()
+    {
+        auto const by_time = [](auto const & a, auto const & b) { return a.time < b.time; };
+        std::stable_sort(counters.begin(), counters.end(), by_time);
+        std::stable_sort(samples.begin(), samples.end(), by_time);
+    }
+
+    bool capture_decoder_t::decode_summary_frame(frame_reader_t & reader)
+    {
+        std::int32_t message_type = 0;
+        if (!reader.read_int(message_type)) {
+            return false;
+        }
+        if (message_type != static_cast<int>(MessageType::SUMMARY)) {
+            // core names and such
+            return true;
+        }
+
+        std::string_view canary;
+        std::int64_t realtime = 0;
+        std::int64_t boottime = 0;
+        std::int64_t monotonic_raw = 0;
+        if ((!reader.read_string(canary)) || (!reader.read_int64(realtime)) || (!reader.read_int64(boottime))
+            || (!reader.read_int64(monotonic_raw))) {
+            return false;
+        }
+
+        monotonic_start = monotonic_raw;
+        return true;
+    }
+
+    bool capture_decoder_t::decode_perf_attrs_frame(frame_reader_t & reader)
+    {
+        std::int32_t legacy_core = 0;
+        std::int32_t code = 0;
+        if ((!reader.read_int(legacy_core)) || (!reader.read_int(code))) {
+            return false;
+        }
+
+        switch (static_cast<CodeType>(code)) {
+            case CodeType::PEA: {
+                // the attr is written whole, starting with its type and size
+                frame_reader_t size_reader {reader};
+                lib::Span<char const> type;
+                std::uint32_t size = 0;
+                lib::Span<char const> bytes;
+                std::int32_t key = 0;
+                if ((!size_reader.read_bytes(offsetof(perf_event_attr, size), type))
+                    || (!size_reader.read_le_uint32(size)) || (!reader.read_bytes(size, bytes))
+                    || (!reader.read_int(key))) {
+                    return false;
+                }
+                perf_event_attr attr {};
+                std::memcpy(&attr, bytes.data(), std::min<std::size_t>(size, sizeof(attr)));
+
+                events_by_key[key] = {key, attr.sample_type, attr.read_format};
+
+                // the id is at the same position in every sample, so it can be found before the event is known
+                if (sample_id_position == 0) {
+                    sample_id_position = 1;
+                    if (!is_set(attr.sample_type, PERF_SAMPLE_IDENTIFIER)) {
+                        for (auto const flag : {PERF_SAMPLE_IP, PERF_SAMPLE_TID, PERF_SAMPLE_TIME, PERF_SAMPLE_ADDR}) {
+                            sample_id_position += (is_set(attr.sample_type, flag) ? 1 : 0);
+                        }
+                    }
+                }
+                return true;
+            }
+            case CodeType::KEYS: {
+                std::int32_t count = 0;
+                if (!reader.read_int(count)) {
+                    return false;
+                }
+                for (std::int32_t i = 0; i < count; ++i) {
+                    std::int64_t id = 0;
+                    std::int32_t key = 0;
+                    if ((!reader.read_int64(id)) || (!reader.read_int(key))) {
+                        return false;
+                    }
+                    keys_by_id[static_cast<std::uint64_t>(id)] = key;
+                }
+                return true;
+            }
+            case CodeType::COMM: {
+                thread_row_t row {};
+                std::string_view image;
+                std::string_view comm;
+                if ((!reader.read_int(row.pid)) || (!reader.read_int(row.tid)) || (!reader.read_c_string(image))
+                    || (!reader.read_c_string(comm))) {
+                    return false;
+                }
+                row.image = image;
+                row.comm = comm;
+                threads.push_back(std::move(row));
+                return true;
+            }
+            case CodeType::COUNTERS: {
+                std::int64_t time = 0;
+                if (!reader.read_int64(time)) {
+                    return false;
+                }
+                while (true) {
+                    std::int32_t core = 0;
+                    if (!reader.read_int(core)) {
+                        return false;
+                    }
+                    if (core == -1) {
+                        return true;
+                    }
+                    counter_row_t row {time, core, 0, 0, 0};
+                    if ((!reader.read_int(row.key)) || (!reader.read_int64(row.value))) {
+                        return false;
+                    }
+                    counters.push_back(row);
+                }
+            }
+            default: {
+                // not exported
+                return true;
+            }
+        }
+    }
+
+    bool capture_decoder_t::decode_block_counter_frame(frame_reader_t & reader,
+                                                       std::int64_t * delta_stream_time,
+                                                       worker_result_t & result) const
+    {
+        // the core, or the stream of a delta frame
+        std::int32_t core_or_stream = 0;
+        if (!reader.read_int(core_or_stream)) {
+            return false;
+        }
+
+        std::int64_t time = (delta_stream_time != nullptr ? *delta_stream_time : 0);
+        counter_row_t row {time, (delta_stream_time != nullptr ? 0 : core_or_stream), 0, 0, 0};
+        while (!reader.at_end()) {
+            std::int32_t key = 0;
+            std::int64_t value = 0;
+            if ((!reader.read_int(key)) || (!reader.read_int64(value))) {
+                return false;
+            }
+
+            switch (key) {
+                case block_counter_time_key: {
+                    // the delta frames give the time since the previous sample of the stream
+                    row.time = (delta_stream_time != nullptr ? row.time + value : value);
+                    row.core = 0;
+                    row.tid = 0;
+                    break;
+                }
+                case block_counter_tid_key: {
+                    row.tid = static_cast<std::int32_t>(value);
+                    break;
+                }
+                case block_counter_core_key: {
+                    row.core = static_cast<std::int32_t>(value);
+                    break;
+                }
+                default: {
+                    // (the unchanged values of a delta frame are omitted, so that stream's series are sparse)
+                    row.key = key;
+                    row.value = value;
+                    result.counters.push_back(row);
+                    break;
+                }
+            }
+        }
+
+        if (delta_stream_time != nullptr) {
+            *delta_stream_time = row.time;
+        }
+        return true;
+    }
+
+    bool capture_decoder_t::decode_perf_data_frame(frame_reader_t & reader, worker_result_t & result) const
+    {
+        std::int32_t cpu = 0;
+        std::uint32_t length = 0;
+        lib::Span<char const> packed;
+        if ((!reader.read_int(cpu)) || (!reader.read_le_uint32(length)) || (!reader.read_bytes(length, packed))) {
+            return false;
+        }
+
+        // the records are packed as a sequence of 64 bit words
+        std::vector<std::uint64_t> words;
+        frame_reader_t words_reader {packed};
+        while (!words_reader.at_end()) {
+            std::int64_t word = 0;
+            if (!words_reader.read_int64(word)) {
+                return false;
+            }
+            words.push_back(static_cast<std::uint64_t>(word));
+        }
+
+        std::size_t index = 0;
+        while (index < words.size()) {
+            // struct perf_event_header { u32 type; u16 misc; u16 size; }
+            auto const header = words[index];
+            auto const type = static_cast<std::uint32_t>(header);
+            auto const size_in_words = static_cast<std::size_t>(header >> 48) / sizeof(std::uint64_t);
+            if ((size_in_words == 0) || (size_in_words > (words.size() - index))) {
+                return false;
+            }
+
+            if (type == perf_record_sample) {
+                decode_perf_sample(cpu, {words.data() + index, size_in_words}, result);
+            }
+            index += size_in_words;
+        }
+        return true;
+    }
+
+    void capture_decoder_t::decode_perf_sample(std::int32_t cpu,
+                                               lib::Span<std::uint64_t const> words,
+                                               worker_result_t & result) const
+    {
+        if ((sample_id_position == 0) || (sample_id_position >= words.size())) {
+            return;
+        }
+
+        auto const id = words[sample_id_position];
+        perf_event_t const * const event = find_event(id);
+        if (event == nullptr) {
+            return;
+        }
+
+        sample_row_t sample {0, cpu, 0, 0, event->key, 0, 0};
+        std::size_t index = 1;
+        // read the next word into `value`, if the field is present
+        auto const read_field = [&words, &index, event](std::uint64_t flag, auto & value) {
+            if (!is_set(event->sample_type, flag)) {
+                return true;
+            }
+            if (index >= words.size()) {
+                return false;
+            }
+            value = static_cast<std::remove_reference_t<decltype(value)>>(words[index++]);
+            return true;
+        };
+
+        std::uint64_t ignored = 0;
+        std::uint64_t tid = 0;
+        std::uint64_t time = 0;
+        std::uint64_t cpu_word = 0;
+        if ((!read_field(PERF_SAMPLE_IDENTIFIER, ignored)) || (!read_field(PERF_SAMPLE_IP, sample.ip))
+            || (!read_field(PERF_SAMPLE_TID, tid)) || (!read_field(PERF_SAMPLE_TIME, time))
+            || (!read_field(PERF_SAMPLE_ADDR, ignored)) || (!read_field(PERF_SAMPLE_ID, ignored))
+            || (!read_field(PERF_SAMPLE_STREAM_ID, ignored)) || (!read_field(PERF_SAMPLE_CPU, cpu_word))
+            || (!read_field(PERF_SAMPLE_PERIOD, sample.period))) {
+            return;
+        }
+
+        // struct { u32 pid; u32 tid; } and struct { u32 cpu; u32 res; }
+        sample.pid = static_cast<std::int32_t>(tid & 0xffffffffU);
+        sample.tid = static_cast<std::int32_t>(tid >> 32);
+        if (is_set(event->sample_type, PERF_SAMPLE_CPU)) {
+            sample.cpu = static_cast<std::int32_t>(cpu_word & 0xffffffffU);
+        }
+        sample.time = static_cast<std::int64_t>(time) - monotonic_start;
+        result.samples.push_back(sample);
+
+        if (!is_set(event->sample_type, PERF_SAMPLE_READ)) {
+            return;
+        }
+
+        // the counter values read with the sample
+        auto const read_format = event->read_format;
+        auto const has_id = is_set(read_format, PERF_FORMAT_ID);
+        auto const value_words = 1 + (has_id ? 1 : 0) + (is_set(read_format, perf_format_lost) ? 1 : 0);
+        auto const time_words = (is_set(read_format, PERF_FORMAT_TOTAL_TIME_ENABLED) ? 1 : 0)
+                              + (is_set(read_format, PERF_FORMAT_TOTAL_TIME_RUNNING) ? 1 : 0);
+        auto const add_value = [&](std::uint64_t value, std::size_t id_index) {
+            std::int32_t key = event->key;
+            if (has_id) {
+                auto const it = keys_by_id.find(words[id_index]);
+                if (it == keys_by_id.end()) {
+                    return;
+                }
+                key = it->second;
+            }
+            result.counters.push_back({sample.time, sample.cpu, sample.tid, key, static_cast<std::int64_t>(value)});
+        };
+
+        if (is_set(read_format, PERF_FORMAT_GROUP)) {
+            // the number of values, the times, then each value and its id
+            if (index >= words.size()) {
+                return;
+            }
+            auto const count = words[index];
+            index += 1 + time_words;
+            for (std::uint64_t i = 0; (i < count) && ((index + value_words) <= words.size()); ++i) {
+                add_value(words[index], index + 1);
+                index += value_words;
+            }
+        }
+        else if ((index + value_words + time_words) <= words.size()) {
+            // the value, the times, then the id
+            add_value(words[index], index + 1 + time_words);
+        }
+    }
+
+    capture_decoder_t::perf_event_t const * capture_decoder_t::find_event(std::uint64_t id) const
+    {
+        auto const key = keys_by_id.find(id);
+        if (key == keys_by_id.end()) {
+            return nullptr;
+        }
+        auto const event = events_by_key.find(key->second);
+        return (event != events_by_key.end() ? &event->second : nullptr);
+    }
+
+    bool write_csv(capture_decoder_t const & decoder, std::string const & directory, std::string & error)
+    {
+        {
+            output_file_t output {directory, "counters.csv"};
+            if (!open_output(output, "counters.csv", error)) {
+                return false;
+            }
+            output.write("time,core,tid,key,value\n");
+            for (auto const & row : decoder.get_counters()) {
+                output.write_number(row.time);
+                output.write(",");
+                output.write_number(row.core);
+                output.write(",");
+                output.write_number(row.tid);
+                output.write(",");
+                output.write_number(row.key);
+                output.write(",");
+                output.write_number(row.value);
+                output.write("\n");
+            }
+            if (!output.close(error)) {
+                return false;
+            }
+        }
+
+        {
+            output_file_t output {directory, "samples.csv"};
+            if (!open_output(output, "samples.csv", error)) {
+                return false;
+            }
+            output.write("time,cpu,pid,tid,key,ip,period\n");
+            for (auto const & row : decoder.get_samples()) {
+                output.write_number(row.time);
+                output.write(",");
+                output.write_number(row.cpu);
+                output.write(",");
+                output.write_number(row.pid);
+                output.write(",");
+                output.write_number(row.tid);
+                output.write(",");
+                output.write_number(row.key);
+                output.write(",");
+                output.write_number(row.ip);
+                output.write(",");
+                output.write_number(row.period);
+                output.write("\n");
+            }
+            if (!output.close(error)) {
+                return false;
+            }
+        }
+
+        return write_threads_csv(decoder, directory, error);
+    }
+
+    bool write_columns(capture_decoder_t const & decoder, std::string const & directory, std::string & error)
+    {
+        auto const & counters = decoder.get_counters();
+        auto const & samples = decoder.get_samples();
+
+        return write_column_file(counters, &counter_row_t::time, directory, "counters.time.i64", error)
+            && write_column_file(counters, &counter_row_t::core, directory, "counters.core.i32", error)
+            && write_column_file(counters, &counter_row_t::tid, directory, "counters.tid.i32", error)
+            && write_column_file(counters, &counter_row_t::key, directory, "counters.key.i32", error)
+            && write_column_file(counters, &counter_row_t::value, directory, "counters.value.i64", error)
+            && write_column_file(samples, &sample_row_t::time, directory, "samples.time.i64", error)
+            && write_column_file(samples, &sample_row_t::cpu, directory, "samples.cpu.i32", error)
+            && write_column_file(samples, &sample_row_t::pid, directory, "samples.pid.i32", error)
+            && write_column_file(samples, &sample_row_t::tid, directory, "samples.tid.i32", error)
+            && write_column_file(samples, &sample_row_t::key, directory, "samples.key.i32", error)
+            && write_column_file(samples, &sample_row_t::ip, directory, "samples.ip.u64", error)
+            && write_column_file(samples, &sample_row_t::period, directory, "samples.period.u64", error)
+            && write_threads_csv(decoder, directory, error);
+    }
+
+    std::map<std::int32_t, std::string> read_counter_names(char const * captured_xml_path)
+    {
+        std::map<std::int32_t, std::string> names;
+
+        std::unique_ptr<std::FILE, int (*)(std::FILE *)> file {std::fopen(captured_xml_path, "r"), std::fclose};
+        if (!file) {
+            return names;
+        }
+
+        auto const document = makeMxmlUniquePtr(mxmlLoadFile(nullptr, file.get(), MXML_NO_CALLBACK));
+        if (!document) {
+            return names;
+        }
+
+        for (mxml_node_t * node =
+                 mxmlFindElement(document.get(), document.get(), "counter", nullptr, nullptr, MXML_DESCEND);
+             node != nullptr;
+             node = mxmlFindElement(node, document.get(), "counter", nullptr, nullptr, MXML_DESCEND)) {
+            char const * const key = mxmlElementGetAttr(node, "key");
+            // a constant is named by its counter, the others by their type
+            char const * name = mxmlElementGetAttr(node, "counter");
+            if (name == nullptr) {
+                name = mxmlElementGetAttr(node, "type");
+            }
+            if ((key != nullptr) && (name != nullptr)) {
+                names[static_cast<std::int32_t>(std::strtol(key, nullptr, 0))] = name;
+            }
+        }
+
+        return names;
+    }
+
+    bool write_keys_csv(std::map<std::int32_t, std::string> const & names,
+                        std::string const & directory,
+                        std::string & error)
+    {
+        output_file_t output {directory, "keys.csv"};
+        if (!open_output(output, "keys.csv", error)) {
+            return false;
+        }
+
+        output.write("key,counter\n");
+        for (auto const & [key, name] : names) {
+            output.write_number(key);
+            output.write(",");
+            output.write_field(name);
+            output.write("\n");
+        }
+        return output.close(error);
+    }
+}
@@ -0,0 +1,198 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#pragma once
+
+#include "lib/Span.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace apc {
+
+    /** A read-only memory map of a whole file */
+    class mapped_file_t {
+    public:
+        /** @return The map, or nothing if the file could not be opened or mapped (with `error` set) */
+        static std::optional<mapped_file_t> open(char const * path, std::string & error);
+
+        mapped_file_t(mapped_file_t const &) = delete;
+        mapped_file_t & operator=(mapped_file_t const &) = delete;
+        mapped_file_t(mapped_file_t && that) noexcept;
+        mapped_file_t & operator=(mapped_file_t && that) noexcept;
+        ~mapped_file_t();
+
+        [[nodiscard]] lib::Span<char const> data() const { return {address, length}; }
+
+    private:
+        char const * address;
+        std::size_t length;
+
+        mapped_file_t(char const * address, std::size_t length) : address(address), length(length) {}
+    };
+
+    /** Reads the fields of one frame, as packed by buffer_utils and the apc frame builders, checked against its end */
+    class frame_reader_t {
+    public:
+        explicit frame_reader_t(lib::Span<char const> frame) : frame(frame) {}
+
+        [[nodiscard]] bool at_end() const { return position >= frame.size(); }
+        [[nodiscard]] std::size_t remaining() const { return frame.size() - position; }
+
+        bool read_int(std::int32_t & value);
+        bool read_int64(std::int64_t & value);
+        bool read_le_uint32(std::uint32_t & value);
+        bool read_bytes(std::size_t count, lib::Span<char const> & bytes);
+        /** A length-prefixed string, as written by IRawFrameBuilder::writeString */
+        bool read_string(std::string_view & value);
+        /** A nul terminated string, as written by the perf agent's frame builders */
+        bool read_c_string(std::string_view & value);
+
+    private:
+        lib::Span<char const> frame;
+        std::size_t position {0};
+    };
+
+    /** One counter value, from a block counter frame, a perf counters frame, or the read values of a perf sample */
+    struct counter_row_t {
+        /** The time since the start of the capture, in ns */
+        std::int64_t time;
+        std::int32_t core;
+        std::int32_t tid;
+        std::int32_t key;
+        std::int64_t value;
+    };
+
+    /** One perf sample */
+    struct sample_row_t {
+        /** The time since the start of the capture, in ns */
+        std::int64_t time;
+        std::int32_t cpu;
+        std::int32_t pid;
+        std::int32_t tid;
+        std::int32_t key;
+        std::uint64_t ip;
+        std::uint64_t period;
+    };
+
+    /** The name of a thread, from a perf comm frame */
+    struct thread_row_t {
+        std::int32_t pid;
+        std::int32_t tid;
+        std::string image;
+        std::string comm;
+    };
+
+    /**
+     * Decodes the data files of a local capture (the uncompressed <capture>.apc/0000000000 and any further segments)
+     * into tables of counter values, perf samples and thread names.
+     *
+     * Each file is memory mapped and split into its frames in one quick pass over their lengths. The perf attribute
+     * frames (which describe the perf events, and hold the few frames that must be read in order) are then decoded in
+     * order, after which the remaining frames are spread over the worker threads by the stream they belong to (the cpu
+     * of a perf data frame, the core of a block counter frame, or the stream of a block counter delta frame), so that
+     * each stream is decoded in order on one thread while the independent streams are decoded in parallel. Finally
+     * the rows are sorted by time.
+     */
+    class capture_decoder_t {
+    public:
+        /** @param threads The number of worker threads, or 0 for one per processor */
+        explicit capture_decoder_t(unsigned threads);
+
+        /** Decode one data file, adding to the rows of those already decoded */
+        bool decode_file(char const * path, std::string & error);
+
+        /** Decode the contents of one data file */
+        bool decode(lib::Span<char const> data, std::string & error);
+
+        /** Sort the rows of all the files decoded by time, which is otherwise grouped by stream */
+        void sort();
+
+        [[nodiscard]] std::vector<counter_row_t> const & get_counters() const { return counters; }
+        [[nodiscard]] std::vector<sample_row_t> const & get_samples() const { return samples; }
+        [[nodiscard]] std::vector<thread_row_t> const & get_threads() const { return threads; }
+        /** @return The number of frames decoded of each frame type */
+        [[nodiscard]] std::map<int, std::uint64_t> const & get_frame_counts() const { return frame_counts; }
+        /** @return The number of frames that were truncated or could not otherwise be decoded */
+        [[nodiscard]] std::uint64_t get_malformed_frames() const { return malformed_frames; }
+
+    private:
+        struct perf_event_t {
+            std::int32_t key;
+            std::uint64_t sample_type;
+            std::uint64_t read_format;
+        };
+
+        struct frame_t {
+            lib::Span<char const> data;
+            int type;
+            /** The stream the frame must be decoded in order with */
+            std::int64_t stream;
+        };
+
+        struct worker_result_t {
+            std::vector<counter_row_t> counters {};
+            std::vector<sample_row_t> samples {};
+            std::uint64_t malformed_frames {0};
+        };
+
+        unsigned worker_count;
+        std::vector<counter_row_t> counters {};
+        std::vector<sample_row_t> samples {};
+        std::vector<thread_row_t> threads {};
+        std::map<int, std::uint64_t> frame_counts {};
+        std::uint64_t malformed_frames {0};
+        /** The CLOCK_MONOTONIC_RAW time the capture started, which the perf sample times are relative to */
+        std::int64_t monotonic_start {0};
+        /** The perf events by id */
+        std::map<std::uint64_t, std::int32_t> keys_by_id {};
+        /** The perf events by key */
+        std::map<std::int32_t, perf_event_t> events_by_key {};
+        /** The position of the id in the samples that do not start with it, or 0 if unknown */
+        std::size_t sample_id_position {0};
+        /**
+         * The time of the last sample of each block counter delta stream, which the next is relative to. The streams
+         * are added before the workers start, so that each worker only updates those of its own streams.
+         */
+        std::map<std::int64_t, std::int64_t> delta_stream_times {};
+
+        bool decode_summary_frame(frame_reader_t & reader);
+        bool decode_perf_attrs_frame(frame_reader_t & reader);
+        bool decode_block_counter_frame(frame_reader_t & reader,
+                                        std::int64_t * delta_stream_time,
+                                        worker_result_t & result) const;
+        bool decode_perf_data_frame(frame_reader_t & reader, worker_result_t & result) const;
+        void decode_perf_sample(std::int32_t cpu,
+                                lib::Span<std::uint64_t const> words,
+                                worker_result_t & result) const;
+        [[nodiscard]] perf_event_t const * find_event(std::uint64_t id) const;
+    };
+
+    /** Write the rows as CSV files, counters.csv, samples.csv and threads.csv */
+    bool write_csv(capture_decoder_t const & decoder, std::string const & directory, std::string & error);
+
+    /**
+     * Write the rows as one file per column, each a packed array of little endian values named
+     * <table>.<column>.<type>, such as counters.time.i64, that can be loaded directly as an array (such as with
+     * numpy.fromfile). The threads are written as threads.csv, as for write_csv.
+     */
+    bool write_columns(capture_decoder_t const & decoder, std::string const & directory, std::string & error);
+
+    /**
+     * Read the names of the counters from a captured.xml
+     *
+     * @return The counter names (the type, or for a constant the counter) by key
+     */
+    std::map<std::int32_t, std::string> read_counter_names(char const * captured_xml_path);
+
+    /**
+     * Write the names of the counters as keys.csv
+     */
+    bool write_keys_csv(std::map<std::int32_t, std::string> const & names,
+                        std::string const & directory,
+                        std::string & error);
+}
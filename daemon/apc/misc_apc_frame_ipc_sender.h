@@ -10,12 +10,16 @@
 #include "apc/summary_apc_frame_utils.h"
 #include "async/continuations/async_initiate.h"
 #include "async/continuations/stored_continuation.h"
+#include "ipc/frame_buffer_pool.h"
 #include "ipc/messages.h"
 #include "ipc/raw_ipc_channel_sink.h"
 #include "k/perf_event.h"
+#include "lib/SentContentTracker.h"
 
 #include <cstdint>
+#include <functional>
 #include <memory>
+#include <string_view>
 #include <utility>
 #include <vector>
 
@@ -27,8 +31,11 @@ namespace apc {
 
     class misc_apc_frame_ipc_sender_t {
     public:
-        explicit misc_apc_frame_ipc_sender_t(std::shared_ptr<ipc::raw_ipc_channel_sink_t> ipc_sink)
-            : ipc_sink(std::move(ipc_sink)) {};
+        misc_apc_frame_ipc_sender_t(std::shared_ptr<ipc::raw_ipc_channel_sink_t> ipc_sink,
+                                    std::shared_ptr<ipc::frame_buffer_pool_t> frame_buffer_pool)
+            : ipc_sink(std::move(ipc_sink)),
+              frame_buffer_pool(std::move(frame_buffer_pool)),
+              sent_maps(std::make_shared<lib::SentContentTracker<std::pair<int, int>>>()) {};
 
         template<typename CompletionToken>
         auto async_send_perf_events_attributes_frame(perf_event_attr const & pea, int key, CompletionToken && token)
@@ -36,10 +43,15 @@ namespace apc {
             using namespace async::continuations;
 
             return async_initiate_explicit<void(boost::system::error_code)>(
-                [ipc_sink = ipc_sink, bytes = apc::make_perf_events_attributes_frame(pea, key)](auto && sc) mutable {
+                [ipc_sink = ipc_sink,
+                 frame_buffer_pool = frame_buffer_pool,
+                 bytes = apc::make_perf_events_attributes_frame(pea, key, acquire_buffer())](auto && sc) mutable {
                     submit(ipc_sink->async_send_message(ipc::msg_apc_frame_data_t {std::move(bytes)},
                                                         use_continuation) //
-                               | then([](auto const & ec, auto const &) { return ec; }),
+                               | then([frame_buffer_pool](auto const & ec, auto msg) {
+                                     frame_buffer_pool->release(std::move(msg.suffix));
+                                     return ec;
+                                 }),
                            std::forward<decltype(sc)>(sc));
                 },
                 std::forward<CompletionToken>(token));
@@ -53,10 +65,15 @@ namespace apc {
             using namespace async::continuations;
 
             return async_initiate_explicit<void(boost::system::error_code)>(
-                [ipc_sink = ipc_sink, bytes = apc::make_keys_frame(mappings)](auto && sc) mutable {
+                [ipc_sink = ipc_sink,
+                 frame_buffer_pool = frame_buffer_pool,
+                 bytes = apc::make_keys_frame(mappings, acquire_buffer())](auto && sc) mutable {
                     submit(ipc_sink->async_send_message(ipc::msg_apc_frame_data_t {std::move(bytes)},
                                                         use_continuation) //
-                               | then([](auto const & ec, auto const &) { return ec; }),
+                               | then([frame_buffer_pool](auto const & ec, auto msg) {
+                                     frame_buffer_pool->release(std::move(msg.suffix));
+                                     return ec;
+                                 }),
                            std::forward<decltype(sc)>(sc));
                 },
                 std::forward<CompletionToken>(token));
@@ -68,25 +85,69 @@ namespace apc {
             using namespace async::continuations;
 
             return async_initiate_explicit<void(boost::system::error_code)>(
-                [ipc_sink = ipc_sink, bytes = apc::make_format_frame(format)](auto && sc) mutable {
+                [ipc_sink = ipc_sink,
+                 frame_buffer_pool = frame_buffer_pool,
+                 bytes = apc::make_format_frame(format, acquire_buffer())](auto && sc) mutable {
                     submit(ipc_sink->async_send_message(ipc::msg_apc_frame_data_t {std::move(bytes)},
                                                         use_continuation) //
-                               | then([](auto const & ec, auto const &) { return ec; }),
+                               | then([frame_buffer_pool](auto const & ec, auto msg) {
+                                     frame_buffer_pool->release(std::move(msg.suffix));
+                                     return ec;
+                                 }),
                            std::forward<decltype(sc)>(sc));
                 },
                 std::forward<CompletionToken>(token));
         }
 
+        /** Set a function that is called with the contents of each maps frame as it is sent */
+        void set_maps_observer(std::function<void(std::string_view)> observer) { maps_observer = std::move(observer); }
+
         template<typename CompletionToken>
         auto async_send_maps_frame(int pid, int tid, std::string_view maps, CompletionToken && token)
         {
             using namespace async::continuations;
 
+            // the same maps are read again for a process each time it is polled or newly sampled
+            const bool repeated = !sent_maps->markSent({pid, tid}, maps);
+            if (maps_observer && !repeated) {
+                maps_observer(maps);
+            }
+
+            return async_initiate_explicit<void(boost::system::error_code)>(
+                [ipc_sink = ipc_sink,
+                 frame_buffer_pool = frame_buffer_pool,
+                 bytes = (repeated ? std::vector<char> {} : apc::make_maps_frame(pid, tid, maps, acquire_buffer())),
+                 repeated](auto && sc) mutable {
+                    if (repeated) {
+                        return submit(start_with(boost::system::error_code {}), std::forward<decltype(sc)>(sc));
+                    }
+
+                    submit(ipc_sink->async_send_message(ipc::msg_apc_frame_data_t {std::move(bytes)},
+                                                        use_continuation) //
+                               | then([frame_buffer_pool](auto const & ec, auto msg) {
+                                     frame_buffer_pool->release(std::move(msg.suffix));
+                                     return ec;
+                                 }),
+                           std::forward<decltype(sc)>(sc));
+                },
+                std::forward<CompletionToken>(token));
+        }
+
+        template<typename CompletionToken>
+        auto async_send_jit_symbols_frame(int pid, std::string_view symbols, CompletionToken && token)
+        {
+            using namespace async::continuations;
+
             return async_initiate_explicit<void(boost::system::error_code)>(
-                [ipc_sink = ipc_sink, bytes = apc::make_maps_frame(pid, tid, maps)](auto && sc) mutable {
+                [ipc_sink = ipc_sink,
+                 frame_buffer_pool = frame_buffer_pool,
+                 bytes = apc::make_jit_symbols_frame(pid, symbols, acquire_buffer())](auto && sc) mutable {
                     submit(ipc_sink->async_send_message(ipc::msg_apc_frame_data_t {std::move(bytes)},
                                                         use_continuation) //
-                               | then([](auto const & ec, auto const &) { return ec; }),
+                               | then([frame_buffer_pool](auto const & ec, auto msg) {
+                                     frame_buffer_pool->release(std::move(msg.suffix));
+                                     return ec;
+                                 }),
                            std::forward<decltype(sc)>(sc));
                 },
                 std::forward<CompletionToken>(token));
@@ -102,10 +163,15 @@ namespace apc {
             using namespace async::continuations;
 
             return async_initiate_explicit<void(boost::system::error_code)>(
-                [ipc_sink = ipc_sink, bytes = apc::make_comm_frame(pid, tid, image, comm)](auto && sc) mutable {
+                [ipc_sink = ipc_sink,
+                 frame_buffer_pool = frame_buffer_pool,
+                 bytes = apc::make_comm_frame(pid, tid, image, comm, acquire_buffer())](auto && sc) mutable {
                     submit(ipc_sink->async_send_message(ipc::msg_apc_frame_data_t {std::move(bytes)},
                                                         use_continuation) //
-                               | then([](auto const & ec, auto const &) { return ec; }),
+                               | then([frame_buffer_pool](auto const & ec, auto msg) {
+                                     frame_buffer_pool->release(std::move(msg.suffix));
+                                     return ec;
+                                 }),
                            std::forward<decltype(sc)>(sc));
                 },
                 std::forward<CompletionToken>(token));
@@ -118,11 +184,15 @@ namespace apc {
 
             return async_initiate_explicit<void(boost::system::error_code)>(
                 [ipc_sink = ipc_sink,
-                 bytes = (online ? apc::make_cpu_online_frame(timestamp, cpu) //
-                                 : apc::make_cpu_offline_frame(timestamp, cpu))](auto && sc) mutable {
+                 frame_buffer_pool = frame_buffer_pool,
+                 bytes = (online ? apc::make_cpu_online_frame(timestamp, cpu, acquire_buffer()) //
+                                 : apc::make_cpu_offline_frame(timestamp, cpu, acquire_buffer()))](auto && sc) mutable {
                     submit(ipc_sink->async_send_message(ipc::msg_apc_frame_data_t {std::move(bytes)},
                                                         use_continuation) //
-                               | then([](auto const & ec, auto const &) { return ec; }),
+                               | then([frame_buffer_pool](auto const & ec, auto msg) {
+                                     frame_buffer_pool->release(std::move(msg.suffix));
+                                     return ec;
+                                 }),
                            std::forward<decltype(sc)>(sc));
                 },
                 std::forward<CompletionToken>(token));
@@ -133,10 +203,15 @@ namespace apc {
             using namespace async::continuations;
 
             return async_initiate_explicit<void(boost::system::error_code)>(
-                [ipc_sink = ipc_sink, bytes = apc::make_kallsyms_frame(kallsyms)](auto && sc) mutable {
+                [ipc_sink = ipc_sink,
+                 frame_buffer_pool = frame_buffer_pool,
+                 bytes = apc::make_kallsyms_frame(kallsyms, acquire_buffer())](auto && sc) mutable {
                     submit(ipc_sink->async_send_message(ipc::msg_apc_frame_data_t {std::move(bytes)},
                                                         use_continuation) //
-                               | then([](auto const & ec, auto const &) { return ec; }),
+                               | then([frame_buffer_pool](auto const & ec, auto msg) {
+                                     frame_buffer_pool->release(std::move(msg.suffix));
+                                     return ec;
+                                 }),
                            std::forward<decltype(sc)>(sc));
                 },
                 std::forward<CompletionToken>(token));
@@ -150,10 +225,15 @@ namespace apc {
             using namespace async::continuations;
 
             return async_initiate_explicit<void(boost::system::error_code)>(
-                [ipc_sink = ipc_sink, bytes = apc::make_perf_counters_frame(timestamp, counters)](auto && sc) mutable {
+                [ipc_sink = ipc_sink,
+                 frame_buffer_pool = frame_buffer_pool,
+                 bytes = apc::make_perf_counters_frame(timestamp, counters, acquire_buffer())](auto && sc) mutable {
                     submit(ipc_sink->async_send_message(ipc::msg_apc_frame_data_t {std::move(bytes)},
                                                         use_continuation) //
-                               | then([](auto const & ec, auto const &) { return ec; }),
+                               | then([frame_buffer_pool](auto const & ec, auto msg) {
+                                     frame_buffer_pool->release(std::move(msg.suffix));
+                                     return ec;
+                                 }),
                            std::forward<decltype(sc)>(sc));
                 },
                 std::forward<CompletionToken>(token));
@@ -165,10 +245,15 @@ namespace apc {
             using namespace async::continuations;
 
             return async_initiate_explicit<void(boost::system::error_code)>(
-                [ipc_sink = ipc_sink, bytes = apc::make_header_page_frame(header_page)](auto && sc) mutable {
+                [ipc_sink = ipc_sink,
+                 frame_buffer_pool = frame_buffer_pool,
+                 bytes = apc::make_header_page_frame(header_page, acquire_buffer())](auto && sc) mutable {
                     submit(ipc_sink->async_send_message(ipc::msg_apc_frame_data_t {std::move(bytes)},
                                                         use_continuation) //
-                               | then([](auto const & ec, auto const &) { return ec; }),
+                               | then([frame_buffer_pool](auto const & ec, auto msg) {
+                                     frame_buffer_pool->release(std::move(msg.suffix));
+                                     return ec;
+                                 }),
                            std::forward<decltype(sc)>(sc));
                 },
                 std::forward<CompletionToken>(token));
@@ -180,10 +265,15 @@ namespace apc {
             using namespace async::continuations;
 
             return async_initiate_explicit<void(boost::system::error_code)>(
-                [ipc_sink = ipc_sink, bytes = apc::make_header_event_frame(header_event)](auto && sc) mutable {
+                [ipc_sink = ipc_sink,
+                 frame_buffer_pool = frame_buffer_pool,
+                 bytes = apc::make_header_event_frame(header_event, acquire_buffer())](auto && sc) mutable {
                     submit(ipc_sink->async_send_message(ipc::msg_apc_frame_data_t {std::move(bytes)},
                                                         use_continuation) //
-                               | then([](auto const & ec, auto const &) { return ec; }),
+                               | then([frame_buffer_pool](auto const & ec, auto msg) {
+                                     frame_buffer_pool->release(std::move(msg.suffix));
+                                     return ec;
+                                 }),
                            std::forward<decltype(sc)>(sc));
                 },
                 std::forward<CompletionToken>(token));
@@ -196,10 +286,15 @@ namespace apc {
             using namespace async::continuations;
 
             return async_initiate_explicit<void(boost::system::error_code)>(
-                [ipc_sink = ipc_sink, bytes = apc::make_summary_message(state)](auto && sc) mutable {
+                [ipc_sink = ipc_sink,
+                 frame_buffer_pool = frame_buffer_pool,
+                 bytes = apc::make_summary_message(state)](auto && sc) mutable {
                     submit(ipc_sink->async_send_message(ipc::msg_apc_frame_data_t {std::move(bytes)},
                                                         use_continuation) //
-                               | then([](auto const & ec, auto const &) { return ec; }),
+                               | then([frame_buffer_pool](auto const & ec, auto msg) {
+                                     frame_buffer_pool->release(std::move(msg.suffix));
+                                     return ec;
+                                 }),
                            std::forward<decltype(sc)>(sc));
                 },
                 std::forward<CompletionToken>(token));
@@ -211,10 +306,15 @@ namespace apc {
             using namespace async::continuations;
 
             return async_initiate_explicit<void(boost::system::error_code)>(
-                [ipc_sink = ipc_sink, bytes = apc::make_core_name_message(core, cpuid, name)](auto && sc) mutable {
+                [ipc_sink = ipc_sink,
+                 frame_buffer_pool = frame_buffer_pool,
+                 bytes = apc::make_core_name_message(core, cpuid, name)](auto && sc) mutable {
                     submit(ipc_sink->async_send_message(ipc::msg_apc_frame_data_t {std::move(bytes)},
                                                         use_continuation) //
-                               | then([](auto const & ec, auto const &) { return ec; }),
+                               | then([frame_buffer_pool](auto const & ec, auto msg) {
+                                     frame_buffer_pool->release(std::move(msg.suffix));
+                                     return ec;
+                                 }),
                            std::forward<decltype(sc)>(sc));
                 },
                 std::forward<CompletionToken>(token));
@@ -222,6 +322,12 @@ namespace apc {
 
     private:
         std::shared_ptr<ipc::raw_ipc_channel_sink_t> ipc_sink;
+        std::shared_ptr<ipc::frame_buffer_pool_t> frame_buffer_pool;
+        std::shared_ptr<lib::SentContentTracker<std::pair<int, int>>> sent_maps;
+        std::function<void(std::string_view)> maps_observer {};
+
+        /** Borrow a buffer from the pool to encode some frame into */
+        [[nodiscard]] std::vector<char> acquire_buffer() const { return frame_buffer_pool->acquire(0); }
     };
 
 }
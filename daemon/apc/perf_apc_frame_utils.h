@@ -3,6 +3,7 @@
 #pragma once
 
 #include "Buffer.h"
+#include "FixedFrameLayout.h"
 #include "Protocol.h"
 #include "Time.h"
 #include "agents/perf/async_buffer_builder.h"
@@ -18,13 +19,25 @@
 namespace apc {
 
     namespace detail {
+        using buffer_utils::PackedInt32;
+        using buffer_utils::PackedInt64;
+
+        /** The frame type, the legacy core number and the code type */
+        using perf_attr_frame_header_layout_t = buffer_utils::FixedFrameLayout<PackedInt32, PackedInt32, PackedInt32>;
+        /** The header, then the timestamp and the cpu */
+        using cpu_frame_layout_t =
+            buffer_utils::FixedFrameLayout<PackedInt32, PackedInt32, PackedInt32, PackedInt64, PackedInt32>;
+        /** The perf event id and the key */
+        using key_mapping_layout_t = buffer_utils::FixedFrameLayout<PackedInt64, PackedInt32>;
+        /** The core, the key and the value */
+        using perf_counter_layout_t = buffer_utils::FixedFrameLayout<PackedInt32, PackedInt32, PackedInt64>;
 
         inline void make_perf_attr_frame_header(CodeType type,
                                                 agents::perf::apc_buffer_builder_t<std::vector<char>> & buffer)
         {
-            buffer.packInt(static_cast<int32_t>(FrameType::PERF_ATTRS));
-            buffer.packInt(0); // legacy, used to be core number
-            buffer.packInt(static_cast<int32_t>(type));
+            buffer.packFixed<perf_attr_frame_header_layout_t>(static_cast<int32_t>(FrameType::PERF_ATTRS),
+                                                              0, // legacy, used to be core number
+                                                              static_cast<int32_t>(type));
         }
 
         inline void write_string_view(std::string_view sv,
@@ -37,22 +50,30 @@ namespace apc {
             }
         }
 
-        [[nodiscard]] inline std::vector<char> make_cpu_frame(CodeType type, monotonic_delta_t timestamp, int32_t cpu)
+        [[nodiscard]] inline std::vector<char> make_cpu_frame(CodeType type,
+                                                              monotonic_delta_t timestamp,
+                                                              int32_t cpu,
+                                                              std::vector<char> frame = {})
         {
-            std::vector<char> frame {};
+            frame.clear();
+            frame.reserve(cpu_frame_layout_t::MAX_SIZE);
             agents::perf::apc_buffer_builder_t<std::vector<char>> buffer(frame);
-            detail::make_perf_attr_frame_header(type, buffer);
-            buffer.packMonotonicDelta(timestamp);
-            buffer.packInt(cpu);
+            buffer.packFixed<cpu_frame_layout_t>(static_cast<int32_t>(FrameType::PERF_ATTRS),
+                                                 0, // legacy, used to be core number
+                                                 static_cast<int32_t>(type),
+                                                 static_cast<int64_t>(timestamp),
+                                                 cpu);
             buffer.endFrame();
             return frame;
         }
 
     }
 
-    [[nodiscard]] inline std::vector<char> make_perf_events_attributes_frame(perf_event_attr const & pea, int key)
+    [[nodiscard]] inline std::vector<char> make_perf_events_attributes_frame(perf_event_attr const & pea,
+                                                                             int key,
+                                                                             std::vector<char> frame = {})
     {
-        std::vector<char> frame {};
+        frame.clear();
         agents::perf::apc_buffer_builder_t<std::vector<char>> buffer(frame);
         detail::make_perf_attr_frame_header(CodeType::PEA, buffer);
         buffer.writeBytes(reinterpret_cast<const char *>(&pea), pea.size);
@@ -62,27 +83,31 @@ namespace apc {
     }
 
     [[nodiscard]] inline std::vector<char> make_keys_frame(
-        lib::Span<std::pair<agents::perf::perf_event_id_t, agents::perf::gator_key_t> const> mappings)
+        lib::Span<std::pair<agents::perf::perf_event_id_t, agents::perf::gator_key_t> const> mappings,
+        std::vector<char> frame = {})
     {
 
-        std::vector<char> frame {};
+        auto const count = static_cast<int>(mappings.size());
+        runtime_assert((count >= 0) && (mappings.size() == std::size_t(count)), "too many mappings !");
+
+        frame.clear();
+        frame.reserve(detail::perf_attr_frame_header_layout_t::MAX_SIZE + buffer_utils::MAXSIZE_PACK32
+                      + (mappings.size() * detail::key_mapping_layout_t::MAX_SIZE));
         agents::perf::apc_buffer_builder_t<std::vector<char>> buffer(frame);
         detail::make_perf_attr_frame_header(CodeType::KEYS, buffer);
 
-        auto const count = static_cast<int>(mappings.size());
-        runtime_assert((count >= 0) && (mappings.size() == std::size_t(count)), "too many mappings !");
         buffer.packInt(count);
         for (auto const & mapping : mappings) {
-            buffer.packInt64(static_cast<int64_t>(mapping.first));
-            buffer.packInt(static_cast<int32_t>(mapping.second));
+            buffer.packFixed<detail::key_mapping_layout_t>(static_cast<int64_t>(mapping.first),
+                                                           static_cast<int32_t>(mapping.second));
         }
         buffer.endFrame();
         return frame;
     }
 
-    [[nodiscard]] inline std::vector<char> make_format_frame(std::string_view format)
+    [[nodiscard]] inline std::vector<char> make_format_frame(std::string_view format, std::vector<char> frame = {})
     {
-        std::vector<char> frame {};
+        frame.clear();
         agents::perf::apc_buffer_builder_t<std::vector<char>> buffer(frame);
         detail::make_perf_attr_frame_header(CodeType::FORMAT, buffer);
         detail::write_string_view(format, buffer);
@@ -90,9 +115,12 @@ namespace apc {
         return frame;
     }
 
-    [[nodiscard]] inline std::vector<char> make_maps_frame(int pid, int tid, std::string_view maps)
+    [[nodiscard]] inline std::vector<char> make_maps_frame(int pid,
+                                                           int tid,
+                                                           std::string_view maps,
+                                                           std::vector<char> frame = {})
     {
-        std::vector<char> frame {};
+        frame.clear();
         agents::perf::apc_buffer_builder_t<std::vector<char>> buffer(frame);
         detail::make_perf_attr_frame_header(CodeType::MAPS, buffer);
         buffer.packInt(pid);
@@ -102,12 +130,26 @@ namespace apc {
         return frame;
     }
 
+    [[nodiscard]] inline std::vector<char> make_jit_symbols_frame(int pid,
+                                                                  std::string_view symbols,
+                                                                  std::vector<char> frame = {})
+    {
+        frame.clear();
+        agents::perf::apc_buffer_builder_t<std::vector<char>> buffer(frame);
+        detail::make_perf_attr_frame_header(CodeType::JIT_SYMBOLS, buffer);
+        buffer.packInt(pid);
+        detail::write_string_view(symbols, buffer);
+        buffer.endFrame();
+        return frame;
+    }
+
     [[nodiscard]] inline std::vector<char> make_comm_frame(int pid,
                                                            int tid,
                                                            std::string_view image,
-                                                           std::string_view comm)
+                                                           std::string_view comm,
+                                                           std::vector<char> frame = {})
     {
-        std::vector<char> frame {};
+        frame.clear();
         agents::perf::apc_buffer_builder_t<std::vector<char>> buffer(frame);
         detail::make_perf_attr_frame_header(CodeType::COMM, buffer);
 
@@ -120,19 +162,23 @@ namespace apc {
         return frame;
     }
 
-    [[nodiscard]] inline std::vector<char> make_cpu_online_frame(monotonic_delta_t timestamp, int32_t cpu)
+    [[nodiscard]] inline std::vector<char> make_cpu_online_frame(monotonic_delta_t timestamp,
+                                                                 int32_t cpu,
+                                                                 std::vector<char> frame = {})
     {
-        return detail::make_cpu_frame(CodeType::ONLINE_CPU, timestamp, cpu);
+        return detail::make_cpu_frame(CodeType::ONLINE_CPU, timestamp, cpu, std::move(frame));
     }
 
-    [[nodiscard]] inline std::vector<char> make_cpu_offline_frame(monotonic_delta_t timestamp, int32_t cpu)
+    [[nodiscard]] inline std::vector<char> make_cpu_offline_frame(monotonic_delta_t timestamp,
+                                                                  int32_t cpu,
+                                                                  std::vector<char> frame = {})
     {
-        return detail::make_cpu_frame(CodeType::OFFLINE_CPU, timestamp, cpu);
+        return detail::make_cpu_frame(CodeType::OFFLINE_CPU, timestamp, cpu, std::move(frame));
     }
 
-    [[nodiscard]] inline std::vector<char> make_kallsyms_frame(std::string_view kallsyms)
+    [[nodiscard]] inline std::vector<char> make_kallsyms_frame(std::string_view kallsyms, std::vector<char> frame = {})
     {
-        std::vector<char> frame {};
+        frame.clear();
         agents::perf::apc_buffer_builder_t<std::vector<char>> buffer(frame);
         detail::make_perf_attr_frame_header(CodeType::KALLSYMS, buffer);
         detail::write_string_view(kallsyms, buffer);
@@ -141,26 +187,28 @@ namespace apc {
     }
 
     [[nodiscard]] inline std::vector<char> make_perf_counters_frame(monotonic_delta_t timestamp,
-                                                                    lib::Span<perf_counter_t const> counters)
+                                                                    lib::Span<perf_counter_t const> counters,
+                                                                    std::vector<char> frame = {})
     {
-        std::vector<char> frame {};
+        frame.clear();
+        frame.reserve(detail::perf_attr_frame_header_layout_t::MAX_SIZE + buffer_utils::MAXSIZE_PACK64
+                      + (counters.size() * detail::perf_counter_layout_t::MAX_SIZE) + buffer_utils::MAXSIZE_PACK32);
         agents::perf::apc_buffer_builder_t<std::vector<char>> buffer(frame);
         detail::make_perf_attr_frame_header(CodeType::COUNTERS, buffer);
 
         buffer.packMonotonicDelta(timestamp);
         for (perf_counter_t pc : counters) {
-            buffer.packInt(pc.core);
-            buffer.packInt(pc.key);
-            buffer.packInt64(pc.value);
+            buffer.packFixed<detail::perf_counter_layout_t>(pc.core, pc.key, pc.value);
         }
         buffer.packInt(-1);
         buffer.endFrame();
         return frame;
     }
 
-    [[nodiscard]] inline std::vector<char> make_header_page_frame(std::string_view header_page)
+    [[nodiscard]] inline std::vector<char> make_header_page_frame(std::string_view header_page,
+                                                                  std::vector<char> frame = {})
     {
-        std::vector<char> frame {};
+        frame.clear();
         agents::perf::apc_buffer_builder_t<std::vector<char>> buffer(frame);
         detail::make_perf_attr_frame_header(CodeType::HEADER_PAGE, buffer);
         detail::write_string_view(header_page, buffer);
@@ -168,9 +216,10 @@ namespace apc {
         return frame;
     }
 
-    [[nodiscard]] inline std::vector<char> make_header_event_frame(std::string_view header_event)
+    [[nodiscard]] inline std::vector<char> make_header_event_frame(std::string_view header_event,
+                                                                   std::vector<char> frame = {})
     {
-        std::vector<char> frame {};
+        frame.clear();
         agents::perf::apc_buffer_builder_t<std::vector<char>> buffer(frame);
         detail::make_perf_attr_frame_header(CodeType::HEADER_EVENT, buffer);
         detail::write_string_view(header_event, buffer);
@@ -1,4 +1,4 @@
-/* Copyright (C) 2020-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2020-2022 by Arm Limited. All rights reserved. */
 
 #include "armnn/ArmNNDriver.h"
 
@@ -12,10 +12,10 @@ namespace armnn {
         : ::Driver {"ArmNN Driver"},
           mSessionCount {0},
           mGlobalState {&getEventKey},
-          mAcceptingSocket {SocketIO::udsServerListen("\0gatord_namespace", false)},
-          mDriverSourceIpc {
-              mSessionManager}, // This constructor doesn't access mSessionManager so it's okay to not be initialised at this point
-          mSessionManager {std::unique_ptr<IAcceptor> {new SocketAcceptor {mAcceptingSocket, createSession}}}
+          // This constructor doesn't access mSessionManager so it's okay to not be initialised at this point
+          // (the cast is only to stop the compiler warning that it is)
+          mDriverSourceIpc {static_cast<ICaptureStartStopHandler &>(mSessionManager)},
+          mSessionManager {SocketIO::udsServerListen("\0gatord_namespace", false).release(), createSession}
     {
 #if defined(__SANITIZE_THREAD__) || defined(__SANITIZE_ADDRESS__)
         // mSessionManager starts threads that cause undefined behaviour and leaks when we fork
@@ -33,7 +33,12 @@ namespace armnn {
     }
 
     // Clears and disables all counters/SPE
-    void Driver::resetCounters() { mGlobalState.disableAllCounters(); }
+    void Driver::resetCounters()
+    {
+        mGlobalState.disableAllCounters();
+        // the session XML has been read by now
+        mGlobalState.setAggregation(gSessionData.mArmNNAggregateMs, gSessionData.mArmNNExemplarInterval);
+    }
 
     // Enables and prepares the counter for capture
     void Driver::setupCounter(Counter & counter)
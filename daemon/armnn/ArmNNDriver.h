@@ -1,14 +1,14 @@
-/* Copyright (C) 2019-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2019-2022 by Arm Limited. All rights reserved. */
 #pragma once
 
 #include "Driver.h"
+#include "armnn/CounterDirectoryCache.h"
 #include "armnn/DriverSourceIpc.h"
 #include "armnn/GlobalState.h"
 #include "armnn/Session.h"
+#include "armnn/SessionServer.h"
 #include "armnn/SessionStateTracker.h"
-#include "armnn/SocketAcceptor.h"
 #include "armnn/SocketIO.h"
-#include "armnn/ThreadManagementServer.h"
 
 #include <memory>
 
@@ -46,15 +46,22 @@ namespace armnn {
     private:
         std::uint32_t mSessionCount;
         GlobalState mGlobalState;
-        SocketIO mAcceptingSocket;
+        // shared by all the sessions
+        CounterDirectoryCache mCounterDirectoryCache {};
         DriverSourceIpc mDriverSourceIpc;
 
-        SessionSupplier createSession = [&](std::unique_ptr<SocketIO> connection) {
+        SessionSupplier createSession = [&](boost::asio::io_context & context,
+                                            boost::asio::local::stream_protocol::socket && connection) {
             const std::uint32_t uniqueSessionID = mSessionCount++;
 
-            return Session::create(std::move(connection), mGlobalState, mDriverSourceIpc, uniqueSessionID);
+            return Session::create(context,
+                                   std::move(connection),
+                                   mGlobalState,
+                                   mCounterDirectoryCache,
+                                   mDriverSourceIpc,
+                                   uniqueSessionID);
         };
-        ThreadManagementServer mSessionManager;
+        SessionServer mSessionManager;
     };
 
 }
@@ -5,6 +5,7 @@
 #include "armnn/ArmNNSource.h"
 
 #include "Buffer.h"
+#include "MemoryBudget.h"
 #include "Source.h"
 #include "armnn/FrameBuilderFactory.h"
 #include "armnn/ICaptureController.h"
@@ -17,7 +18,10 @@ namespace armnn {
     class Source : public ::Source {
     public:
         Source(ICaptureController & captureController, sem_t & readerSem)
-            : captureController(captureController), buffer(gSessionData.mTotalBufferSize * 1024 * 1024, readerSem)
+            : captureController(captureController),
+              buffer(static_cast<int>(
+                         gMemoryBudget.allocate("ArmNN", 1, std::size_t(gSessionData.mTotalBufferSize) * 1024 * 1024)),
+                     readerSem)
         {
         }
 
@@ -0,0 +1,61 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "armnn/CounterDirectoryCache.h"
+
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <string_view>
+#include <utility>
+
+namespace armnn {
+    namespace {
+        std::size_t hashPacket(lib::Span<const std::uint8_t> packet)
+        {
+            return std::hash<std::string_view> {}(
+                std::string_view {reinterpret_cast<const char *>(packet.data()), packet.size()});
+        }
+    }
+
+    std::vector<CounterDirectoryCache::Entry>::const_iterator CounterDirectoryCache::findEntry(
+        std::size_t hash,
+        ByteOrder byteOrder,
+        lib::Span<const std::uint8_t> packet) const
+    {
+        return std::find_if(entries.begin(), entries.end(), [&](const Entry & entry) {
+            return (entry.hash == hash) && (entry.byteOrder == byteOrder)
+                && std::equal(entry.packet.begin(), entry.packet.end(), packet.begin(), packet.end());
+        });
+    }
+
+    std::shared_ptr<const CounterDirectory> CounterDirectoryCache::find(ByteOrder byteOrder,
+                                                                        lib::Span<const std::uint8_t> packet) const
+    {
+        const std::size_t hash = hashPacket(packet);
+
+        std::shared_lock<std::shared_mutex> lock {mutex};
+
+        const auto it = findEntry(hash, byteOrder, packet);
+        return (it != entries.end() ? it->directory : nullptr);
+    }
+
+    void CounterDirectoryCache::insert(ByteOrder byteOrder,
+                                       lib::Span<const std::uint8_t> packet,
+                                       std::shared_ptr<const CounterDirectory> directory)
+    {
+        const std::size_t hash = hashPacket(packet);
+
+        std::unique_lock<std::shared_mutex> lock {mutex};
+
+        // two sessions may have decoded the same packet at once
+        if (findEntry(hash, byteOrder, packet) != entries.end()) {
+            return;
+        }
+
+        if (entries.size() >= MAX_DIRECTORIES) {
+            entries.erase(entries.begin());
+        }
+
+        entries.push_back(Entry {hash, byteOrder, {packet.begin(), packet.end()}, std::move(directory)});
+    }
+}
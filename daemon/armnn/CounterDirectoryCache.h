@@ -0,0 +1,70 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#pragma once
+
+#include "armnn/ByteOrder.h"
+#include "armnn/ICounterDirectoryConsumer.h"
+#include "armnn/IGlobalState.h"
+#include "lib/Span.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <shared_mutex>
+#include <vector>
+
+namespace armnn {
+    /** The decoded and validated contents of a counter directory packet */
+    struct CounterDirectory {
+        /** Where an event is: its category's position in categories, and its UID within the category */
+        struct EventLocation {
+            std::size_t index;
+            std::uint16_t uid;
+        };
+
+        std::map<std::uint16_t, ICounterDirectoryConsumer::DeviceRecord> devices {};
+        std::map<std::uint16_t, ICounterDirectoryConsumer::CounterSetRecord> counterSets {};
+        std::vector<ICounterDirectoryConsumer::CategoryRecord> categories {};
+        /** Every event, by its global id */
+        std::map<EventId, EventLocation> eventsById {};
+    };
+
+    /**
+     * Holds the counter directories that have been decoded, by their packets' contents, so that a directory is only
+     * decoded (and its events only added to the global state) the first time that any session receives it. Arm NN
+     * processes with the same backends send identical directories, and there may be many short lived processes.
+     *
+     * All methods are multithread safe, and lookups from different sessions do not block each other.
+     */
+    class CounterDirectoryCache {
+    public:
+        /** The most directories held, beyond which the oldest is dropped */
+        static constexpr std::size_t MAX_DIRECTORIES = 64;
+
+        /** @return The directory decoded from an identical packet, or null if there is none */
+        [[nodiscard]] std::shared_ptr<const CounterDirectory> find(ByteOrder byteOrder,
+                                                                   lib::Span<const std::uint8_t> packet) const;
+
+        /** Hold a directory that was decoded from a packet */
+        void insert(ByteOrder byteOrder,
+                    lib::Span<const std::uint8_t> packet,
+                    std::shared_ptr<const CounterDirectory> directory);
+
+    private:
+        struct Entry {
+            std::size_t hash;
+            ByteOrder byteOrder;
+            std::vector<std::uint8_t> packet;
+            std::shared_ptr<const CounterDirectory> directory;
+        };
+
+        mutable std::shared_mutex mutex {};
+        /** In the order they were inserted */
+        std::vector<Entry> entries {};
+
+        [[nodiscard]] std::vector<Entry>::const_iterator findEntry(std::size_t hash,
+                                                                   ByteOrder byteOrder,
+                                                                   lib::Span<const std::uint8_t> packet) const;
+    };
+}
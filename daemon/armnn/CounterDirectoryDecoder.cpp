@@ -1,10 +1,14 @@
-/* Copyright (C) 2019-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2019-2022 by Arm Limited. All rights reserved. */
 
 #include "armnn/CounterDirectoryDecoder.h"
 
 #include "Logging.h"
 
 #include <cstring>
+#include <optional>
+#include <set>
+#include <string>
+#include <utility>
 #include <vector>
 
 namespace armnn {
@@ -270,16 +274,120 @@ namespace armnn {
                 }
             }
 
+            return true;
+        }
+        /** Make the global id of an event, which is the same in every session that has it */
+        EventId makeEventId(const CounterDirectory & directory,
+                            const ICounterDirectoryConsumer::CategoryRecord & category,
+                            const ICounterDirectoryConsumer::EventRecord & record)
+        {
+            EventId id {};
+            id.category = category.name;
+            id.name = record.name;
+            if (record.device_uid > 0) {
+                id.device = std::optional<std::string>(directory.devices.at(record.device_uid).name);
+            }
+            if (record.counter_set_uid > 0) {
+                id.counterSet = std::optional<std::string>(directory.counterSets.at(record.counter_set_uid).name);
+            }
+            return id;
+        }
+
+        /**
+         * Validate the data - make sure that devices / countersets references are correct, and that the UIDs and
+         * global ids are unique - and map the events by global id
+         */
+        bool indexEvents(CounterDirectory & directory)
+        {
+            std::set<std::uint16_t> seenUids;
+
+            for (std::size_t i = 0; i < directory.categories.size(); ++i) {
+                const auto & cat = directory.categories.at(i);
+                for (const auto & epair : cat.events_by_uid) {
+                    const auto & event = epair.second;
+                    if ((event.device_uid != 0) && (directory.devices.count(event.device_uid) == 0)) {
+                        LOG_ERROR(
+                            "Invalid counter directory, event '%s'.'%s' (0x%04x) references invalid device 0x%04x",
+                            cat.name.c_str(),
+                            event.name.c_str(),
+                            event.uid,
+                            event.device_uid);
+                        return false;
+                    }
+                    if ((event.counter_set_uid != 0) && (directory.counterSets.count(event.counter_set_uid) == 0)) {
+                        LOG_ERROR("Invalid counter directory, event '%s'.'%s' (0x%04x) references invalid counter "
+                                  "set 0x%04x",
+                                  cat.name.c_str(),
+                                  event.name.c_str(),
+                                  event.uid,
+                                  event.counter_set_uid);
+                        return false;
+                    }
+
+                    // track/validate UIDs (they should be unique)
+                    for (std::uint32_t uid = event.uid; uid <= event.max_uid; ++uid) {
+                        if (!seenUids.insert(uid).second) {
+                            LOG_ERROR("Invalid counter directory, event '%s'.'%s' (0x%04x) overlaps another event "
+                                      "with the same UID",
+                                      cat.name.c_str(),
+                                      event.name.c_str(),
+                                      event.uid);
+                            return false;
+                        }
+                    }
+
+                    // map to globalId
+                    EventId globalId = makeEventId(directory, cat, event);
+                    const CounterDirectory::EventLocation location {i, event.uid};
+                    if (!directory.eventsById.emplace(std::move(globalId), location).second) {
+                        LOG_ERROR("Invalid counter directory, event '%s'.'%s' (0x%04x) overlaps another event with "
+                                  "the same global id",
+                                  cat.name.c_str(),
+                                  event.name.c_str(),
+                                  event.uid);
+                        return false;
+                    }
+                }
+            }
+
             return true;
         }
     }
 
     bool CounterDirectoryDecoder::decode(Bytes bytes) const
+    {
+        // the processes that use the same backends send identical directories, which are only decoded once
+        std::shared_ptr<const CounterDirectory> directory = cache.find(byteOrder, bytes);
+        if (directory) {
+            if (!consumer.onCounterDirectory(std::move(directory), true)) {
+                LOG_ERROR("Packet consumer returned error ");
+                return false;
+            }
+            return true;
+        }
+
+        directory = decodeDirectory(bytes);
+        if (!directory) {
+            return false;
+        }
+
+        // pass to consumer
+        if (!consumer.onCounterDirectory(directory, false)) {
+            LOG_ERROR("Packet consumer returned error ");
+            return false;
+        }
+
+        // only once it has been consumed, so that its events are known to whichever session finds it
+        cache.insert(byteOrder, bytes, std::move(directory));
+        return true;
+    }
+
+    std::shared_ptr<const CounterDirectory> CounterDirectoryDecoder::decodeDirectory(Bytes bytes) const
     {
         // body_header section must exist
         if (bytes.size() < BODY_HEADER_SIZE) {
             LOG_ERROR("Failed to decode packet, too short (%zu)", bytes.size());
-            return false;
+            return {};
         }
 
         // read body header
@@ -305,21 +413,21 @@ namespace armnn {
             LOG_ERROR("Failed to decode packet, device_records_pointer_table_offset/count out of bounds (0x%x:0x%x)",
                       device_records_pointer_table_offset,
                       device_records_count);
-            return false;
+            return {};
         }
 
         if (bytes.size() < counter_set_pointer_table_offset + counter_set_count * OFFSET_SIZE) {
             LOG_ERROR("Failed to decode packet, counter_set_pointer_table_offset/count out of bounds (0x%x:0x%x)",
                       counter_set_pointer_table_offset,
                       counter_set_count);
-            return false;
+            return {};
         }
 
         if (bytes.size() < categories_pointer_table_offset + categories_count * OFFSET_SIZE) {
             LOG_ERROR("Failed to decode packet, categories_pointer_table_offset/count out of bounds (0x%x:0x%x)",
                       categories_pointer_table_offset,
                       categories_count);
-            return false;
+            return {};
         }
 
         // read the device_record_offsets
@@ -330,7 +438,7 @@ namespace armnn {
 
             if (!decodeDeviceRecord(byteOrder, deviceRecords, offset, device_record_map)) {
                 LOG_ERROR("Failed to decode packet, failed to decode device record[%u]@%x", i, offset);
-                return false;
+                return {};
             }
         }
 
@@ -342,7 +450,7 @@ namespace armnn {
 
             if (!decodeCounterSetRecord(byteOrder, counterSets, offset, counter_set_map)) {
                 LOG_ERROR("Failed to decode packet, failed to decode counter set record[%u]@%x", i, offset);
-                return false;
+                return {};
             }
         }
 
@@ -354,17 +462,19 @@ namespace armnn {
 
             if (!decodeCategoryRecord(byteOrder, categories, offset, categories_list[i])) {
                 LOG_ERROR("Failed to decode packet, failed to decode category record[%u]@%x", i, offset);
-                return false;
+                return {};
             }
         }
 
-        // pass to consumer
-        if (!consumer.onCounterDirectory(std::move(device_record_map),
-                                         std::move(counter_set_map),
-                                         std::move(categories_list))) {
-            LOG_ERROR("Packet consumer returned error ");
-            return false;
+        auto directory = std::make_shared<CounterDirectory>();
+        directory->devices = std::move(device_record_map);
+        directory->counterSets = std::move(counter_set_map);
+        directory->categories = std::move(categories_list);
+
+        if (!indexEvents(*directory)) {
+            return {};
         }
-        return true;
+
+        return directory;
     }
 }
@@ -1,8 +1,9 @@
-/* Copyright (C) 2019-2020 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2019-2022 by Arm Limited. All rights reserved. */
 #ifndef INCLUDE_ARMNN_COUNTER_DIRECTORY_PACKET_DECODER_H
 #define INCLUDE_ARMNN_COUNTER_DIRECTORY_PACKET_DECODER_H
 
 #include "armnn/ByteOrder.h"
+#include "armnn/CounterDirectoryCache.h"
 #include "armnn/ICounterDirectoryConsumer.h"
 #include "lib/Span.h"
 
@@ -10,14 +11,16 @@
 
 namespace armnn {
     /**
-     * Decoder class that decodes the counter directory packet
+     * Decoder class that decodes the counter directory packet, unless an identical packet was decoded before
      */
     class CounterDirectoryDecoder {
     public:
         using Bytes = lib::Span<const std::uint8_t>;
 
-        CounterDirectoryDecoder(ByteOrder byteOrder, ICounterDirectoryConsumer & consumer)
-            : byteOrder(byteOrder), consumer(consumer) {};
+        CounterDirectoryDecoder(ByteOrder byteOrder,
+                                ICounterDirectoryConsumer & consumer,
+                                CounterDirectoryCache & cache)
+            : byteOrder(byteOrder), consumer(consumer), cache(cache) {};
 
         /**
          * Decode a packet
@@ -30,6 +33,9 @@ namespace armnn {
     private:
         ByteOrder byteOrder;
         ICounterDirectoryConsumer & consumer;
+        CounterDirectoryCache & cache;
+
+        std::shared_ptr<const CounterDirectory> decodeDirectory(Bytes bytes) const;
     };
 }
 
@@ -1,4 +1,4 @@
-/* Copyright (C) 2020-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2020-2022 by Arm Limited. All rights reserved. */
 #include "armnn/DecoderUtility.h"
 
 #include "Logging.h"
@@ -237,7 +237,7 @@ namespace armnn {
     bool addCounterIndexValues(int startPosition,
                                const ByteOrder byteOrder,
                                const Bytes & bytes,
-                               std::map<std::uint16_t, std::uint32_t> & counterIndexValues)
+                               std::vector<CounterIndexAndValue> & counterIndexValues)
     {
         std::uint32_t size = sizeof(std::uint16_t) + sizeof(std::uint32_t);
 
@@ -248,17 +248,19 @@ namespace armnn {
             LOG_ERROR("Malformed bytes received for counter ids");
             return false;
         }
+        counterIndexValues.clear();
         for (; (position + size) <= bytes.size(); position += size) {
             const std::uint16_t index = byte_order::get_16(byteOrder, bytes, position);
             const std::uint32_t value = byte_order::get_32(byteOrder, bytes, position + sizeof(std::uint16_t));
-            counterIndexValues.insert({index, value});
+            counterIndexValues.push_back({index, value});
         }
         return true;
     }
 
     bool decodeAndConsumePeriodicCounterCapturePkt(const Bytes & bytes,
                                                    const ByteOrder byteOrder,
-                                                   IPacketConsumer & consumer)
+                                                   IPacketConsumer & consumer,
+                                                   std::vector<CounterIndexAndValue> & counterIndexValues)
     {
         std::size_t timestampSize = sizeof(std::uint64_t);
 
@@ -268,12 +270,11 @@ namespace armnn {
         }
 
         const std::uint64_t timeStamp = byte_order::get_64(byteOrder, bytes, 0);
-        std::map<std::uint16_t, std::uint32_t> counterIndexValueMap;
 
-        if (!addCounterIndexValues(2, byteOrder, bytes, counterIndexValueMap)) {
+        if (!addCounterIndexValues(2, byteOrder, bytes, counterIndexValues)) {
             return false;
         }
-        if (!consumer.onPeriodicCounterCapture(timeStamp, counterIndexValueMap)) {
+        if (!consumer.onPeriodicCounterCapture(timeStamp, counterIndexValues)) {
             return false;
         }
         return true;
@@ -282,7 +283,8 @@ namespace armnn {
     bool decodeAndConsumePerJobCounterCapturePkt(bool isPreJob,
                                                  const Bytes & bytes,
                                                  const ByteOrder byteOrder,
-                                                 IPacketConsumer & consumer)
+                                                 IPacketConsumer & consumer,
+                                                 std::vector<CounterIndexAndValue> & counterIndexValues)
     {
         std::size_t timestampAndObjectRefSize = 2 * sizeof(std::uint64_t);
 
@@ -293,11 +295,10 @@ namespace armnn {
         }
         const std::uint64_t timeStamp = byte_order::get_64(byteOrder, bytes, 0);
         const std::uint64_t objectRef = byte_order::get_64(byteOrder, bytes, 2 * UINT32_SIZE);
-        std::map<std::uint16_t, std::uint32_t> counterIndexValueMap;
-        if (!addCounterIndexValues(4, byteOrder, bytes, counterIndexValueMap)) {
+        if (!addCounterIndexValues(4, byteOrder, bytes, counterIndexValues)) {
             return false;
         }
-        if (!consumer.onPerJobCounterCapture(isPreJob, timeStamp, objectRef, counterIndexValueMap)) {
+        if (!consumer.onPerJobCounterCapture(isPreJob, timeStamp, objectRef, counterIndexValues)) {
             return false;
         }
         return true;
@@ -1,4 +1,4 @@
-/* Copyright (C) 2019-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2019-2022 by Arm Limited. All rights reserved. */
 #ifndef ARMNN_DECODERUTILITY_H_
 #define ARMNN_DECODERUTILITY_H_
 
@@ -7,6 +7,7 @@
 #include "armnn/PacketUtilityModels.h"
 
 #include <optional>
+#include <vector>
 
 namespace armnn {
 
@@ -23,14 +24,22 @@ namespace armnn {
 
     bool decodeAndConsumePerJobCounterSelectionPkt(Bytes bytes, ByteOrder byteOrder, IPacketConsumer & consumer);
 
+    /**
+     * @param counterIndexValues Storage for the decoded values, which is reused between packets to avoid allocating
+     */
     bool decodeAndConsumePeriodicCounterCapturePkt(const Bytes & bytes,
                                                    ByteOrder byteOrder,
-                                                   IPacketConsumer & consumer);
+                                                   IPacketConsumer & consumer,
+                                                   std::vector<CounterIndexAndValue> & counterIndexValues);
 
+    /**
+     * @param counterIndexValues Storage for the decoded values, which is reused between packets to avoid allocating
+     */
     bool decodeAndConsumePerJobCounterCapturePkt(bool isPreJob,
                                                  const Bytes & bytes,
                                                  ByteOrder byteOrder,
-                                                 IPacketConsumer & consumer);
+                                                 IPacketConsumer & consumer,
+                                                 std::vector<CounterIndexAndValue> & counterIndexValues);
 
 }
 #endif // end of ARMNN_DECODERUTILITY_H_
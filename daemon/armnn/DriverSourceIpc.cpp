@@ -1,4 +1,4 @@
-/* Copyright (C) 2020-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2020-2022 by Arm Limited. All rights reserved. */
 
 #include "armnn/DriverSourceIpc.h"
 
@@ -168,13 +168,13 @@ namespace armnn {
         return lib::Span<uint8_t>(static_cast<uint8_t *>(ptr), sizeof(T));
     }
 
-    struct CounterMsg {
+    struct CountersHeader {
         std::uint64_t timestamp;
-        int counterKey;
-        unsigned int core;
-        std::uint32_t counterValue;
+        std::size_t count;
     } __attribute__((packed));
 
+    static_assert(std::is_trivially_copyable<ApcCounterValue>::value, "must be a trivially copyable type");
+
     bool ParentToChildCounterConsumer::interruptReader()
     {
         uint8_t msgtype[1] {INTERRUPT_MSG};
@@ -192,7 +192,7 @@ namespace armnn {
                 case INTERRUPT_MSG:
                     return false;
                 case COUNTERS_MSG:
-                    return readCounterStruct(destination);
+                    return readCounterValues(destination);
                 case PACKET_MSG:
                     return readPacket(destination, isOneShot, getBufferBytesAvailable);
             }
@@ -203,36 +203,39 @@ namespace armnn {
         return false;
     }
 
-    bool ParentToChildCounterConsumer::readCounterStruct(ICounterConsumer & destination)
+    bool ParentToChildCounterConsumer::readCounterValues(ICounterConsumer & destination)
     {
-        CounterMsg msg {};
-        bool readResult = mToChild.readAll(asBytes(msg));
-        if (readResult) {
-            destination.consumeCounterValue(msg.timestamp,
-                                            ApcCounterKeyAndCoreNumber {msg.counterKey, msg.core},
-                                            msg.counterValue);
-            return true;
+        CountersHeader header {};
+        if (mToChild.readAll(asBytes(header))) {
+            mCounterValues.resize(header.count);
+            const lib::Span<uint8_t> values {reinterpret_cast<uint8_t *>(mCounterValues.data()),
+                                             mCounterValues.size() * sizeof(ApcCounterValue)};
+            if (mToChild.readAll(values)) {
+                destination.consumeCounterValues(header.timestamp, mCounterValues);
+                return true;
+            }
         }
         LOG_ERROR("Failed to read counters from gator-main");
 
-        return readResult;
+        return false;
     }
 
-    bool ParentToChildCounterConsumer::consumeCounterValue(std::uint64_t timestamp,
-                                                           ApcCounterKeyAndCoreNumber keyAndCore,
-                                                           std::uint32_t counterValue)
+    bool ParentToChildCounterConsumer::consumeCounterValues(std::uint64_t timestamp,
+                                                            lib::Span<const ApcCounterValue> counterValues)
     {
-        CounterMsg msg {};
-        msg.timestamp = timestamp;
-        msg.counterKey = keyAndCore.key;
-        msg.core = keyAndCore.core;
-        msg.counterValue = counterValue;
-
-        uint8_t msgtype[1] = {COUNTERS_MSG};
-        if (!mToChild.writeAll(msgtype)) {
-            return false;
-        }
-        return mToChild.writeAll(asBytes(msg));
+        CountersHeader header {timestamp, counterValues.size()};
+        const auto headerBytes = asBytes(header);
+        const auto * const valueBytes = reinterpret_cast<const uint8_t *>(counterValues.data());
+
+        // write the whole message at once, rather than a write for each part of it
+        mCountersMessage.clear();
+        mCountersMessage.push_back(COUNTERS_MSG);
+        mCountersMessage.insert(mCountersMessage.end(), headerBytes.begin(), headerBytes.end());
+        mCountersMessage.insert(mCountersMessage.end(),
+                                valueBytes,
+                                valueBytes + counterValues.size() * sizeof(ApcCounterValue));
+
+        return mToChild.writeAll(mCountersMessage);
     }
 
     struct TimelineHeader {
@@ -312,13 +315,11 @@ namespace armnn {
         mCountersChannel.reset();
     }
 
-    bool DriverSourceIpc::consumeCounterValue(std::uint64_t timestamp,
-                                              ApcCounterKeyAndCoreNumber keyAndCore,
-                                              std::uint32_t counterValue)
+    bool DriverSourceIpc::consumeCounterValues(std::uint64_t timestamp, lib::Span<const ApcCounterValue> counterValues)
     {
         std::lock_guard<std::mutex> guard(mParentMutex);
         if (mCountersChannel) {
-            return mCountersChannel->consumeCounterValue(timestamp, keyAndCore, counterValue);
+            return mCountersChannel->consumeCounterValues(timestamp, counterValues);
         }
         return true;
     }
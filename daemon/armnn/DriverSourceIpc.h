@@ -1,4 +1,4 @@
-/* Copyright (C) 2020-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2020-2022 by Arm Limited. All rights reserved. */
 
 #pragma once
 
@@ -13,6 +13,7 @@
 #include <optional>
 #include <string>
 #include <thread>
+#include <vector>
 
 namespace armnn {
 
@@ -74,9 +75,7 @@ namespace armnn {
                          bool isOneShot,
                          const std::function<unsigned int()> & getBufferBytesAvailable);
         bool interruptReader();
-        bool consumeCounterValue(std::uint64_t timestamp,
-                                 ApcCounterKeyAndCoreNumber keyAndCore,
-                                 std::uint32_t counterValue);
+        bool consumeCounterValues(std::uint64_t timestamp, lib::Span<const ApcCounterValue> counterValues);
         bool consumePacket(std::uint32_t sessionId, lib::Span<const std::uint8_t> data);
 
         /**
@@ -88,7 +87,10 @@ namespace armnn {
     private:
         Pipe mToChild {};
         bool mOneShotModeEnabledAndEnded;
-        bool readCounterStruct(ICounterConsumer & destination);
+        /** Reused between messages so that neither side allocates for each capture packet */
+        std::vector<std::uint8_t> mCountersMessage {};
+        std::vector<ApcCounterValue> mCounterValues {};
+        bool readCounterValues(ICounterConsumer & destination);
         bool readPacket(ICounterConsumer & destination,
                         bool isOneShot,
                         const std::function<unsigned int()> & getBufferBytesAvailable);
@@ -136,9 +138,7 @@ namespace armnn {
          * Used to transmit counter data from gator-main to gator-child (and
          * thereby to Streamline)
          */
-        bool consumeCounterValue(std::uint64_t timestamp,
-                                 ApcCounterKeyAndCoreNumber keyAndCore,
-                                 std::uint32_t counterValue) override;
+        bool consumeCounterValues(std::uint64_t timestamp, lib::Span<const ApcCounterValue> counterValues) override;
 
         /**
          * @return whether the data was successfully consumed
@@ -1,10 +1,11 @@
-/* Copyright (C) 2020-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2020-2022 by Arm Limited. All rights reserved. */
 
 #include "armnn/GlobalState.h"
 
 #include "Logging.h"
 #include "lib/EnumUtils.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cctype>
 #include <set>
@@ -12,6 +13,7 @@
 
 namespace armnn {
     static constexpr std::uint32_t DEFAULT_SAMPLE_PERIOD_MICROS = 1000;
+    static constexpr std::uint32_t MAX_AGGREGATE_PERIOD_MS = 3600000;
     static void replaceWhitespace(std::string & s)
     {
         for (char & c : s) {
@@ -109,6 +111,10 @@ namespace armnn {
     /** @return The requested sample period in microseconds */
     std::uint32_t GlobalState::getSamplePeriod() const { return DEFAULT_SAMPLE_PERIOD_MICROS; }
 
+    std::uint32_t GlobalState::getAggregatePeriod() const { return aggregation->periodMicros; }
+
+    std::uint32_t GlobalState::getExemplarInterval() const { return aggregation->exemplarInterval; }
+
     static Event::Class toEventClass(ICounterDirectoryConsumer::Class clazz,
                                      ICounterDirectoryConsumer::Interpolation interpolation)
     {
@@ -414,6 +420,16 @@ namespace armnn {
 
     void GlobalState::disableAllCounters() { enabledIdKeyAndEventNumbers->clear(); }
 
+    void GlobalState::setAggregation(std::uint32_t aggregatePeriodMs, std::uint32_t exemplarInterval)
+    {
+        // a window can't be shorter than the usual sample period
+        const std::uint32_t periodMicros =
+            (aggregatePeriodMs != 0
+                 ? std::max(std::min(aggregatePeriodMs, MAX_AGGREGATE_PERIOD_MS) * 1000, DEFAULT_SAMPLE_PERIOD_MICROS)
+                 : 0);
+        *aggregation = Aggregation {periodMicros, exemplarInterval};
+    }
+
     std::vector<std::string> GlobalState::getAllCounterNames() const
     {
         std::vector<std::string> allCounterNames;
@@ -1,4 +1,4 @@
-/* Copyright (C) 2019-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2019-2022 by Arm Limited. All rights reserved. */
 #pragma once
 
 #include "Events.h"
@@ -33,6 +33,9 @@ namespace armnn {
         CaptureMode getCaptureMode() const override;
         /** @return The requested sample period in microseconds */
         std::uint32_t getSamplePeriod() const override;
+        /** @return The sample period of the aggregated windows in microseconds, or zero if not aggregated */
+        std::uint32_t getAggregatePeriod() const override;
+        std::uint32_t getExemplarInterval() const override;
 
         void addEvents(std::vector<std::tuple<EventId, EventProperties>> /*unused*/) override;
 
@@ -50,6 +53,12 @@ namespace armnn {
 
         void disableAllCounters();
 
+        /**
+         * @param aggregatePeriodMs The length of each aggregated window, or zero for none
+         * @param exemplarInterval Every Nth window is an exemplar, or none for zero
+         */
+        void setAggregation(std::uint32_t aggregatePeriodMs, std::uint32_t exemplarInterval);
+
         std::vector<std::string> getAllCounterNames() const;
 
     private:
@@ -71,6 +80,11 @@ namespace armnn {
             std::map<int, std::string> eventsByNumber;
         };
 
+        struct Aggregation {
+            std::uint32_t periodMicros;
+            std::uint32_t exemplarInterval;
+        };
+
         struct CounterNameKeyAndEventNumber {
             const std::string & counterName;
             int key;
@@ -107,6 +121,9 @@ namespace armnn {
         // StaticVector and IdKeyAndEventNumber don't dynamically allocate so we can safely use them in shared memory
         shared_memory::unique_ptr<lib::StaticVector<CounterNameKeyAndEventNumber, 1000>> enabledIdKeyAndEventNumbers =
             shared_memory::make_unique<lib::StaticVector<CounterNameKeyAndEventNumber, 1000>>();
+        // set by the child, along with the enabled counters, for the sessions in gator-main
+        shared_memory::unique_ptr<Aggregation> aggregation =
+            shared_memory::make_unique<Aggregation>(Aggregation {0, 0});
     };
 
 }
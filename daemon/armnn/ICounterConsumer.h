@@ -1,4 +1,4 @@
-/* Copyright (C) 2020 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2020-2022 by Arm Limited. All rights reserved. */
 
 #pragma once
 
@@ -18,16 +18,22 @@ namespace armnn {
         }
     };
 
+    /** A counter value, with the APC counter key and core it is for */
+    struct ApcCounterValue {
+        ApcCounterKeyAndCoreNumber keyAndCore;
+        std::uint32_t counterValue;
+    };
+
     class ICounterConsumer {
     public:
         virtual ~ICounterConsumer() = default;
 
         /**
-         * @return whether the value was successfully consumed
+         * Consumes all the values of one capture packet, which share the same timestamp
+         *
+         * @return whether the values were successfully consumed
          */
-        virtual bool consumeCounterValue(std::uint64_t timestamp,
-                                         ApcCounterKeyAndCoreNumber keyAndCore,
-                                         std::uint32_t counterValue) = 0;
+        virtual bool consumeCounterValues(std::uint64_t timestamp, lib::Span<const ApcCounterValue> counterValues) = 0;
 
         /**
          * @return whether the data was successfully consumed
@@ -1,13 +1,16 @@
-/* Copyright (C) 2019-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2019-2022 by Arm Limited. All rights reserved. */
 #ifndef INCLUDE_ARMNN_I_COUNTER_DIRECTORY_CONSUMER_H
 #define INCLUDE_ARMNN_I_COUNTER_DIRECTORY_CONSUMER_H
 
 #include <cstdint>
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 
 namespace armnn {
+    struct CounterDirectory;
+
     /**
      * Interface for consumer that is called with decoded contents of counter directory packet
      */
@@ -95,14 +98,12 @@ namespace armnn {
         /**
          * Called with the contents parsed from the counter directory packet
          *
-         * @param devices The map of devices by UID
-         * @param counterSets The map of counter sets by UID
-         * @param categories The list of categories
+         * @param directory The devices, counter sets and categories, which are shared with any other session that
+         * sent an identical packet
+         * @param known True if the directory was consumed before (by any session), so its events are already known
          * @return False if there was some error in the counter directory data
          */
-        virtual bool onCounterDirectory(std::map<std::uint16_t, DeviceRecord> devices,
-                                        std::map<std::uint16_t, CounterSetRecord> counterSets,
-                                        std::vector<CategoryRecord> categories) = 0;
+        virtual bool onCounterDirectory(std::shared_ptr<const CounterDirectory> directory, bool known) = 0;
     };
 }
 
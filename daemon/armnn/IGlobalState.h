@@ -1,4 +1,4 @@
-/* Copyright (C) 2019-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2019-2022 by Arm Limited. All rights reserved. */
 
 #pragma once
 
@@ -83,6 +83,13 @@ namespace armnn {
         virtual CaptureMode getCaptureMode() const = 0;
         /** @return The requested sample period */
         virtual std::uint32_t getSamplePeriod() const = 0;
+        /**
+         * @return The sample period of the aggregated windows, in which the timeline is not sent, or zero if the
+         * capture is not aggregated
+         */
+        virtual std::uint32_t getAggregatePeriod() const = 0;
+        /** @return The number of aggregated windows from one exemplar window (which is not aggregated) to the next */
+        virtual std::uint32_t getExemplarInterval() const = 0;
 
         /**
          * Notify the global state of a set of events available from an armnn Session
@@ -1,18 +1,25 @@
-/* Copyright (C) 2019-2020 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2019-2022 by Arm Limited. All rights reserved. */
 
 #ifndef ARMNN_IPERIODICCOUNTERCAPTURECONSUMER_H_
 #define ARMNN_IPERIODICCOUNTERCAPTURECONSUMER_H_
 
+#include "lib/Span.h"
+
 #include <cstdint>
-#include <map>
 
 namespace armnn {
+    /** A counter value from a capture packet, where index is the counter UID */
+    struct CounterIndexAndValue {
+        std::uint16_t index;
+        std::uint32_t value;
+    };
+
     class IPeriodicCounterCaptureConsumer {
 
     public:
         virtual ~IPeriodicCounterCaptureConsumer() = default;
         virtual bool onPeriodicCounterCapture(std::uint64_t timeStamp,
-                                              std::map<std::uint16_t, std::uint32_t> counterIndexValues) = 0;
+                                              lib::Span<const CounterIndexAndValue> counterIndexValues) = 0;
     };
 }
 
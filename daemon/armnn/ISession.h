@@ -1,6 +1,8 @@
-/* Copyright (C) 2019-2020 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2019-2022 by Arm Limited. All rights reserved. */
 #pragma once
 
+#include <functional>
+
 namespace armnn {
     class ISession {
     public:
@@ -10,14 +12,18 @@ namespace armnn {
         virtual ~ISession() = default;
 
         /**
-         * Closes the ISession object (interupting the sender and reciever threads)
+         * Closes the ISession object (interupting any pending reads and writes)
          **/
         virtual void close() = 0;
 
         /**
-         * Run the recieve thread. This function should be called in a thread outside of the ISession object
+         * Start reading from the socket. The reads (and writes) happen asynchronously on the io_context that the
+         * ISession was created with.
+         *
+         * @param onReady Called once the connection has been initialised, after which the capture may be enabled
+         * @param onClosed Called once the connection is closed, whether or not it was initialised
          **/
-        virtual void runReadLoop() = 0;
+        virtual void start(std::function<void()> onReady, std::function<void()> onClosed) = 0;
 
         /**
          * Write a packet to the sender queue requesting to start the capture
@@ -29,4 +35,4 @@ namespace armnn {
          **/
         virtual bool disableCapture() = 0;
     };
-}
\ No newline at end of file
+}
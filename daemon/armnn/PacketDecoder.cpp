@@ -1,4 +1,4 @@
-/* Copyright (C) 2019-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2019-2022 by Arm Limited. All rights reserved. */
 #include "armnn/PacketDecoder.h"
 
 #include "armnn/CounterDirectoryDecoder.h"
@@ -9,8 +9,10 @@
 #include <string>
 
 namespace armnn {
-    PacketDecoder::PacketDecoder(ByteOrder byteOrder_, IPacketConsumer & consumer_)
-        : byteOrder(byteOrder_), consumer(consumer_)
+    PacketDecoder::PacketDecoder(ByteOrder byteOrder_,
+                                 IPacketConsumer & consumer_,
+                                 CounterDirectoryCache & counterDirectoryCache_)
+        : byteOrder(byteOrder_), consumer(consumer_), counterDirectoryCache(counterDirectoryCache_)
     {
     }
 
@@ -21,7 +23,7 @@ namespace armnn {
             case lib::toEnumValue(PacketType::CounterDirectoryPkt): //
             {
                 //1.x.x
-                const CounterDirectoryDecoder cdd(byteOrder, consumer);
+                const CounterDirectoryDecoder cdd(byteOrder, consumer, counterDirectoryCache);
                 if (!cdd.decode(payload)) {
                     LOG_ERROR("Decode and consume of counter directory packet failed");
                     return DecodingStatus::Failed;
@@ -49,7 +51,7 @@ namespace armnn {
             case lib::toEnumValue(PacketType::PeriodicCounterCapturePkt): //
             {
                 //1.x.x
-                if (!armnn::decodeAndConsumePeriodicCounterCapturePkt(payload, byteOrder, consumer)) {
+                if (!armnn::decodeAndConsumePeriodicCounterCapturePkt(payload, byteOrder, consumer, counterIndexValues)) {
                     LOG_ERROR("Decode and consume of periodic counter capture failed");
                     return DecodingStatus::Failed;
                 }
@@ -58,7 +60,7 @@ namespace armnn {
             case lib::toEnumValue(PacketType::PrePerJobCounterCapturePkt): //
             {
                 //1.x.x
-                if (!armnn::decodeAndConsumePerJobCounterCapturePkt(true, payload, byteOrder, consumer)) {
+                if (!armnn::decodeAndConsumePerJobCounterCapturePkt(true, payload, byteOrder, consumer, counterIndexValues)) {
                     LOG_ERROR("Decode and consume of pre per job counter capture failed");
                     return DecodingStatus::Failed;
                 }
@@ -67,7 +69,7 @@ namespace armnn {
             case lib::toEnumValue(PacketType::PostPerJobCounterCapturePkt): //
             {
                 //1.x.x
-                if (!armnn::decodeAndConsumePerJobCounterCapturePkt(false, payload, byteOrder, consumer)) {
+                if (!armnn::decodeAndConsumePerJobCounterCapturePkt(false, payload, byteOrder, consumer, counterIndexValues)) {
                     LOG_ERROR("Decode and consume of post per job counter capture failed");
                     return DecodingStatus::Failed;
                 }
@@ -1,16 +1,18 @@
-/* Copyright (C) 2019-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2019-2022 by Arm Limited. All rights reserved. */
 
 #ifndef ARMNN_PACKETDECODER_H_
 #define ARMNN_PACKETDECODER_H_
 
 #include "Logging.h"
 #include "armnn/ByteOrder.h"
+#include "armnn/CounterDirectoryCache.h"
 #include "armnn/IPacketConsumer.h"
 #include "armnn/IPacketDecoder.h"
 #include "armnn/PacketUtility.h"
 #include "armnn/PacketUtilityModels.h"
 
 #include <optional>
+#include <vector>
 
 namespace armnn {
 
@@ -18,7 +20,9 @@ namespace armnn {
     class PacketDecoder : public IPacketDecoder {
 
     public:
-        PacketDecoder(ByteOrder byteOrder_, IPacketConsumer & consumer_);
+        PacketDecoder(ByteOrder byteOrder_,
+                      IPacketConsumer & consumer_,
+                      CounterDirectoryCache & counterDirectoryCache_);
         /**
          * type - defined on packet family and id
          * payload - the body of the packet
@@ -34,6 +38,9 @@ namespace armnn {
     private:
         ByteOrder byteOrder;
         IPacketConsumer & consumer;
+        CounterDirectoryCache & counterDirectoryCache;
+        /** The decoded values of the most recent capture packet, kept so its storage is reused */
+        std::vector<CounterIndexAndValue> counterIndexValues {};
     };
 }
 
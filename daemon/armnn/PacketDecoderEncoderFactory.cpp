@@ -1,4 +1,4 @@
-/* Copyright (C) 2020-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2020-2022 by Arm Limited. All rights reserved. */
 
 #ifndef ARMNN_PACKETDECODERENCODERFACTORY_CPP_
 #define ARMNN_PACKETDECODERENCODERFACTORY_CPP_
@@ -62,11 +62,12 @@ namespace armnn {
      */
     std::unique_ptr<IPacketDecoder> createDecoder(const std::vector<PacketVersionTable> & pktVersionTable,
                                                   ByteOrder order,
-                                                  IPacketConsumer & consumer)
+                                                  IPacketConsumer & consumer,
+                                                  CounterDirectoryCache & counterDirectoryCache)
     {
         if (!pktVersionTable.empty()) {
             if (PacketDecoder::isValidPacketVersions(pktVersionTable)) {
-                std::unique_ptr<IPacketDecoder> decoder(new PacketDecoder(order, consumer));
+                std::unique_ptr<IPacketDecoder> decoder(new PacketDecoder(order, consumer, counterDirectoryCache));
                 return decoder;
             }
             LOG_ERROR("Cannot create decoder, as invalid versions in packet version table");
@@ -1,9 +1,10 @@
-/* Copyright (C) 2019-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2019-2022 by Arm Limited. All rights reserved. */
 
 #ifndef ARMNN_PACKETDECODERENCODERFACTORY_H_
 #define ARMNN_PACKETDECODERENCODERFACTORY_H_
 
 #include "Logging.h"
+#include "armnn/CounterDirectoryCache.h"
 #include "armnn/DecoderUtility.h"
 #include "armnn/IEncoder.h"
 #include "armnn/IPacketConsumer.h"
@@ -32,7 +33,8 @@ namespace armnn {
      */
     std::unique_ptr<IPacketDecoder> createDecoder(const std::vector<PacketVersionTable> & pktVersionTable,
                                                   ByteOrder order,
-                                                  IPacketConsumer & consumer);
+                                                  IPacketConsumer & consumer,
+                                                  CounterDirectoryCache & counterDirectoryCache);
     /**
      * Create encoder based on PacketVersionTable
      */
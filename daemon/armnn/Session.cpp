@@ -1,5 +1,5 @@
 /**
- * Copyright (C) 2020-2021 by Arm Limited. All rights reserved.
+ * Copyright (C) 2020-2022 by Arm Limited. All rights reserved.
  *
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU General Public License version 2 as
@@ -10,177 +10,338 @@
 
 #include "Logging.h"
 #include "armnn/PacketDecoderEncoderFactory.h"
-#include "armnn/SenderThread.h"
 #include "armnn/SessionPacketSender.h"
-#include "armnn/SocketIO.h"
 
+#include <chrono>
 #include <cinttypes>
 #include <cstring>
 
+#include <boost/asio/bind_executor.hpp>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/read.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/system/error_code.hpp>
+
 static constexpr uint32_t MAGIC = 0x45495434;
 static constexpr std::size_t HEADER_SIZE = 8;
 static constexpr std::size_t MAGIC_SIZE = 4;
 
 namespace armnn {
-    std::unique_ptr<Session> Session::create(std::unique_ptr<SocketIO> connection,
+    class Session::Sender : public ISender {
+    public:
+        explicit Sender(std::weak_ptr<Session> session) : mSession {std::move(session)} {}
+
+        bool send(std::vector<std::uint8_t> && data) override
+        {
+            auto session = mSession.lock();
+            return session && session->queueSend(std::move(data));
+        }
+
+    private:
+        // weak as the session indirectly owns this object
+        std::weak_ptr<Session> mSession;
+    };
+
+    std::shared_ptr<Session> Session::create(boost::asio::io_context & context,
+                                             socket_type && socket,
                                              IGlobalState & globalState,
+                                             CounterDirectoryCache & counterDirectoryCache,
                                              ICounterConsumer & counterConsumer,
                                              const std::uint32_t sessionID)
     {
         LOG_DEBUG("Creating new ArmNN session");
 
-        HeaderPacket headerPacket {};
-        if (!Session::initialiseConnection(*connection, headerPacket)) {
-            return nullptr;
-        }
+        return std::shared_ptr<Session> {
+            new Session {context, std::move(socket), globalState, counterDirectoryCache, counterConsumer, sessionID}};
+    }
 
-        // Decode the metadata packet and create the decoder
-        const auto packetBodyAfterMagic = lib::makeConstSpan(headerPacket.packet).subspan(HEADER_SIZE + MAGIC_SIZE);
-        std::optional<StreamMetadataContent> streamMetadata =
-            getStreamMetadata(packetBodyAfterMagic, headerPacket.byteOrder);
-        if (!streamMetadata) {
-            LOG_ERROR("Unable to decode the session metadata. Dropping Session.");
-            return nullptr;
-        }
+    Session::Session(boost::asio::io_context & context,
+                     socket_type && socket,
+                     IGlobalState & globalState,
+                     CounterDirectoryCache & counterDirectoryCache,
+                     ICounterConsumer & counterConsumer,
+                     std::uint32_t sessionID)
+        : mStrand {context},
+          mSocket {std::move(socket)},
+          mAggregateTimer {context},
+          mGlobalState {globalState},
+          mCounterDirectoryCache {counterDirectoryCache},
+          mCounterConsumer {counterConsumer},
+          mSessionID {sessionID}
+    {
+    }
 
-        std::unique_ptr<IEncoder> encoder =
-            armnn::createEncoder(streamMetadata->pktVersionTables, headerPacket.byteOrder);
-        if (!encoder) {
-            return nullptr;
-        }
+    void Session::start(std::function<void()> onReady, std::function<void()> onClosed)
+    {
+        boost::asio::post(mStrand,
+                          [st = shared_from_this(), onReady = std::move(onReady), onClosed = std::move(onClosed)]() mutable {
+                              if (st->mClosed.load()) {
+                                  // closed before it was started
+                                  return onClosed();
+                              }
+                              st->mOnReady = std::move(onReady);
+                              st->mOnClosed = std::move(onClosed);
+                              st->readMetadataHeader();
+                          });
+    }
 
-        std::vector<std::uint8_t> ack = encoder->encodeConnectionAcknowledge();
-        if (!connection->writeExact(ack)) {
-            return nullptr;
-        }
+    void Session::close()
+    {
+        boost::asio::post(mStrand, [st = shared_from_this()]() { st->doClose(); });
+    }
 
-        // Create the SessionPacketSender (all the sending part of the Session)
-        std::unique_ptr<ISender> sender {new SenderThread {*connection}};
-        std::unique_ptr<ISessionPacketSender> sps {new SessionPacketSender {std::move(sender), std::move(encoder)}};
+    bool Session::enableCapture()
+    {
+        const bool enabled = mSessionStateTracker->doEnableCapture();
 
-        // Create the SST and decoder.
-        std::unique_ptr<SessionStateTracker> sst {new SessionStateTracker {globalState,
-                                                                           counterConsumer,
-                                                                           std::move(sps),
-                                                                           sessionID,
-                                                                           std::move(headerPacket.packet)}};
-
-        std::unique_ptr<IPacketDecoder> decoder =
-            armnn::createDecoder(streamMetadata->pktVersionTables, headerPacket.byteOrder, *sst);
-        if (!decoder) {
-            return nullptr;
+        const std::chrono::microseconds aggregatePeriod {mGlobalState.getAggregatePeriod()};
+        if (aggregatePeriod.count() != 0) {
+            boost::asio::post(mStrand, [st = shared_from_this(), aggregatePeriod]() {
+                if (st->mClosed.load()) {
+                    return;
+                }
+                st->mAggregateTimer.expires_after(aggregatePeriod);
+                st->waitForAggregateWindowEnd();
+            });
         }
 
-        return std::make_unique<Session>(std::move(connection),
-                                         headerPacket.byteOrder,
-                                         std::move(decoder),
-                                         std::move(sst));
+        return enabled;
     }
 
-    bool Session::initialiseConnection(SocketIO & connection, HeaderPacket & headerPacket)
+    bool Session::disableCapture()
     {
-        // Read meta data and do first time set up.
-        if (connection.isOpen()) {
-            std::vector<std::uint8_t> packet(HEADER_SIZE + MAGIC_SIZE);
+        boost::asio::post(mStrand, [st = shared_from_this()]() { st->mAggregateTimer.cancel(); });
 
-            if (!connection.readExact(packet)) {
-                // Can't read the header.
-                LOG_ERROR("Unable to read the ArmNN metadata packet header");
-                return false;
-            }
+        return mSessionStateTracker->doDisableCapture();
+    }
 
-            // Get the byte order
-            if (byte_order::get_32<std::uint8_t>(ByteOrder::BIG, packet, HEADER_SIZE) == MAGIC) {
-                headerPacket.byteOrder = ByteOrder::BIG;
-            }
-            else if (byte_order::get_32<std::uint8_t>(ByteOrder::LITTLE, packet, HEADER_SIZE) == MAGIC) {
-                headerPacket.byteOrder = ByteOrder::LITTLE;
-            }
-            else {
-                // invalid magic
-                LOG_ERROR("Invalid ArmNN metadata packet magic");
-                return false;
+    void Session::waitForAggregateWindowEnd()
+    {
+        mAggregateTimer.async_wait(boost::asio::bind_executor(mStrand, [st = shared_from_this()](auto const & ec) {
+            if (ec || st->mClosed.load()) {
+                return;
             }
 
-            const std::uint32_t streamMetadataIdentifier =
-                byte_order::get_32<std::uint8_t>(headerPacket.byteOrder, packet, 0);
-            if (streamMetadataIdentifier != 0) {
-                LOG_ERROR("Invalid ArmNN stream_metadata_identifier (%" PRIu32 ")", streamMetadataIdentifier);
-                return false;
+            if (!st->mSessionStateTracker->onAggregateWindowEnd()) {
+                LOG_ERROR("Unable to switch the Arm NN capture between aggregated and exemplar windows");
+                return st->doClose();
             }
 
-            const std::uint32_t length = byte_order::get_32<std::uint8_t>(headerPacket.byteOrder, packet, 4);
-            if (length < MAGIC_SIZE) {
-                LOG_ERROR("Invalid ArmNN metadata packet length (%" PRIu32 ")", length);
-                return false;
-            }
+            // relative to the end of the window, so that the windows don't drift
+            st->mAggregateTimer.expires_at(st->mAggregateTimer.expiry()
+                                           + std::chrono::microseconds {st->mGlobalState.getAggregatePeriod()});
+            st->waitForAggregateWindowEnd();
+        }));
+    }
 
-            std::uint32_t remainingLength = length - MAGIC_SIZE;
-            std::vector<std::uint8_t> restOfPacketBody(remainingLength);
-            if (!connection.readExact(restOfPacketBody)) {
-                // Can't read the payload
-                LOG_ERROR("Unable to read the ArmNN metadata packet payload");
-                return false;
-            }
+    void Session::doClose()
+    {
+        if (mClosed.exchange(true)) {
+            return;
+        }
 
-            // Construct the body of the packet
-            packet.insert(packet.end(), restOfPacketBody.begin(), restOfPacketBody.end());
-            headerPacket.packet = std::move(packet);
+        boost::system::error_code ignored {};
+        mSocket.shutdown(socket_type::shutdown_both, ignored);
+        mSocket.close(ignored);
+        mAggregateTimer.cancel();
+        mSendQueue.clear();
 
-            return true;
+        if (mOnClosed) {
+            std::exchange(mOnClosed, {})();
         }
-
-        return false;
     }
 
-    Session::Session(std::unique_ptr<SocketIO> connection,
-                     ByteOrder byteOrder,
-                     std::unique_ptr<IPacketDecoder> decoder,
-                     std::unique_ptr<SessionStateTracker> sst)
-        : mEndianness {byteOrder},
-          mConnection {std::move(connection)},
-          mSessionStateTracker {std::move(sst)},
-          mDecoder {std::move(decoder)}
+    bool Session::queueSend(std::vector<std::uint8_t> && data)
     {
-    }
+        if (mClosed.load()) {
+            return false;
+        }
 
-    Session::~Session() { close(); }
+        boost::asio::post(mStrand, [st = shared_from_this(), data = std::move(data)]() mutable {
+            if (st->mClosed.load()) {
+                return;
+            }
+            st->mSendQueue.push_back(std::move(data));
+            if (!std::exchange(st->mSending, true)) {
+                st->doSend();
+            }
+        });
 
-    void Session::close()
+        return true;
+    }
+
+    void Session::doSend()
     {
-        if (mConnection->isOpen()) {
-            mConnection->interrupt();
+        if (mClosed.load() || mSendQueue.empty()) {
+            mSending = false;
+            return;
         }
+
+        boost::asio::async_write(mSocket,
+                                 boost::asio::buffer(mSendQueue.front()),
+                                 boost::asio::bind_executor(mStrand, [st = shared_from_this()](auto const & ec, auto) {
+                                     if (ec) {
+                                         LOG_ERROR("Unable to send packet");
+                                         st->mSending = false;
+                                         return st->doClose();
+                                     }
+
+                                     st->mSendQueue.pop_front();
+                                     st->doSend();
+                                 }));
     }
 
-    void Session::runReadLoop()
+    void Session::readMetadataHeader()
     {
-        // Main reading loop, decode packets
-        while (true) {
-            if (!receiveNextPacket()) {
-                LOG_DEBUG("Session: disconnected due to invalid packet or connection shutdown");
-                break;
-            }
-        }
+        mReadBuffer.resize(HEADER_SIZE + MAGIC_SIZE);
+
+        boost::asio::async_read(
+            mSocket,
+            boost::asio::buffer(mReadBuffer),
+            boost::asio::bind_executor(mStrand, [st = shared_from_this()](auto const & ec, auto) {
+                if (ec) {
+                    // Can't read the header.
+                    LOG_ERROR("Unable to read the ArmNN metadata packet header");
+                    return st->doClose();
+                }
+
+                // Get the byte order
+                if (byte_order::get_32<std::uint8_t>(ByteOrder::BIG, st->mReadBuffer, HEADER_SIZE) == MAGIC) {
+                    st->mEndianness = ByteOrder::BIG;
+                }
+                else if (byte_order::get_32<std::uint8_t>(ByteOrder::LITTLE, st->mReadBuffer, HEADER_SIZE) == MAGIC) {
+                    st->mEndianness = ByteOrder::LITTLE;
+                }
+                else {
+                    // invalid magic
+                    LOG_ERROR("Invalid ArmNN metadata packet magic");
+                    return st->doClose();
+                }
+
+                const std::uint32_t streamMetadataIdentifier =
+                    byte_order::get_32<std::uint8_t>(st->mEndianness, st->mReadBuffer, 0);
+                if (streamMetadataIdentifier != 0) {
+                    LOG_ERROR("Invalid ArmNN stream_metadata_identifier (%" PRIu32 ")", streamMetadataIdentifier);
+                    return st->doClose();
+                }
+
+                const std::uint32_t length = byte_order::get_32<std::uint8_t>(st->mEndianness, st->mReadBuffer, 4);
+                if (length < MAGIC_SIZE) {
+                    LOG_ERROR("Invalid ArmNN metadata packet length (%" PRIu32 ")", length);
+                    return st->doClose();
+                }
+
+                st->readMetadataBody(length - MAGIC_SIZE);
+            }));
+    }
+
+    void Session::readMetadataBody(std::uint32_t length)
+    {
+        mReadBuffer.resize(HEADER_SIZE + MAGIC_SIZE + length);
+
+        boost::asio::async_read(
+            mSocket,
+            boost::asio::buffer(mReadBuffer.data() + HEADER_SIZE + MAGIC_SIZE, length),
+            boost::asio::bind_executor(mStrand, [st = shared_from_this()](auto const & ec, auto) {
+                if (ec) {
+                    // Can't read the payload
+                    LOG_ERROR("Unable to read the ArmNN metadata packet payload");
+                    return st->doClose();
+                }
+
+                if (!st->initialiseSession()) {
+                    return st->doClose();
+                }
+
+                if (st->mOnReady) {
+                    std::exchange(st->mOnReady, {})();
+                }
+
+                st->readPacketHeader();
+            }));
     }
 
-    bool Session::receiveNextPacket()
+    bool Session::initialiseSession()
     {
-        std::vector<std::uint8_t> packet(HEADER_SIZE);
-        if (!mConnection->readExact(packet)) {
+        // Decode the metadata packet and create the decoder
+        const auto packetBodyAfterMagic = lib::makeConstSpan(mReadBuffer).subspan(HEADER_SIZE + MAGIC_SIZE);
+        std::optional<StreamMetadataContent> streamMetadata = getStreamMetadata(packetBodyAfterMagic, mEndianness);
+        if (!streamMetadata) {
+            LOG_ERROR("Unable to decode the session metadata. Dropping Session.");
             return false;
         }
-        const std::uint32_t type = byte_order::get_32<std::uint8_t>(mEndianness, packet, 0);
-        const std::uint32_t length = byte_order::get_32<std::uint8_t>(mEndianness, packet, 4);
-        packet.resize(HEADER_SIZE + length);
-        const auto data = lib::makeSpan(packet).subspan(HEADER_SIZE);
-        if (!mConnection->readExact(data)) {
+
+        std::unique_ptr<IEncoder> encoder = armnn::createEncoder(streamMetadata->pktVersionTables, mEndianness);
+        if (!encoder) {
             return false;
         }
 
+        // Queued first, so it is sent before anything requested by the SessionStateTracker
+        if (!queueSend(encoder->encodeConnectionAcknowledge())) {
+            return false;
+        }
+
+        // Create the SessionPacketSender (all the sending part of the Session)
+        std::unique_ptr<ISender> sender {new Sender {weak_from_this()}};
+        std::unique_ptr<ISessionPacketSender> sps {new SessionPacketSender {std::move(sender), std::move(encoder)}};
+
+        // Create the SST and decoder.
+        mSessionStateTracker.reset(new SessionStateTracker {mGlobalState,
+                                                            mCounterConsumer,
+                                                            std::move(sps),
+                                                            mSessionID,
+                                                            std::exchange(mReadBuffer, {})});
+
+        mDecoder = armnn::createDecoder(streamMetadata->pktVersionTables,
+                                        mEndianness,
+                                        *mSessionStateTracker,
+                                        mCounterDirectoryCache);
+        return !!mDecoder;
+    }
+
+    void Session::readPacketHeader()
+    {
+        mReadBuffer.resize(HEADER_SIZE);
+
+        boost::asio::async_read(mSocket,
+                                boost::asio::buffer(mReadBuffer),
+                                boost::asio::bind_executor(mStrand, [st = shared_from_this()](auto const & ec, auto) {
+                                    if (ec) {
+                                        LOG_DEBUG("Session: disconnected due to connection shutdown");
+                                        return st->doClose();
+                                    }
+
+                                    st->readPacketBody();
+                                }));
+    }
+
+    void Session::readPacketBody()
+    {
+        const std::uint32_t length = byte_order::get_32<std::uint8_t>(mEndianness, mReadBuffer, 4);
+        mReadBuffer.resize(HEADER_SIZE + length);
+
+        boost::asio::async_read(mSocket,
+                                boost::asio::buffer(mReadBuffer.data() + HEADER_SIZE, length),
+                                boost::asio::bind_executor(mStrand, [st = shared_from_this()](auto const & ec, auto) {
+                                    if (ec || !st->onPacket()) {
+                                        LOG_DEBUG("Session: disconnected due to invalid packet or connection "
+                                                  "shutdown");
+                                        return st->doClose();
+                                    }
+
+                                    st->readPacketHeader();
+                                }));
+    }
+
+    bool Session::onPacket()
+    {
+        const std::uint32_t type = byte_order::get_32<std::uint8_t>(mEndianness, mReadBuffer, 0);
+        const auto data = lib::makeSpan(mReadBuffer).subspan(HEADER_SIZE);
+
         auto status = mDecoder->decodePacket(type, data);
         if (status == DecodingStatus::NeedsForwarding) {
-            return mSessionStateTracker->forwardPacket(packet);
+            return mSessionStateTracker->forwardPacket(mReadBuffer);
         }
 
         return status == DecodingStatus::Ok;
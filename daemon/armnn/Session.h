@@ -1,5 +1,5 @@
 /**
- * Copyright (C) 2020-2021 by Arm Limited. All rights reserved.
+ * Copyright (C) 2020-2022 by Arm Limited. All rights reserved.
  *
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU General Public License version 2 as
@@ -9,55 +9,48 @@
 #pragma once
 
 #include "armnn/ByteOrder.h"
+#include "armnn/CounterDirectoryCache.h"
+#include "armnn/ICounterConsumer.h"
 #include "armnn/IGlobalState.h"
 #include "armnn/IPacketDecoder.h"
 #include "armnn/ISender.h"
 #include "armnn/ISession.h"
-#include "armnn/ISessionPacketSender.h"
 #include "armnn/SessionStateTracker.h"
-#include "armnn/SocketIO.h"
 
+#include <atomic>
+#include <cstdint>
+#include <deque>
 #include <functional>
-#include <mutex>
-#include <queue>
-#include <thread>
+#include <memory>
 #include <utility>
+#include <vector>
 
-namespace armnn {
-    // Struct to store the metadata for the connection
-    struct HeaderPacket {
-        ByteOrder byteOrder;
-        std::vector<std::uint8_t> packet;
-    };
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/io_context_strand.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+#include <boost/asio/steady_timer.hpp>
 
-    class Session : public ISession {
+namespace armnn {
+    /**
+     * A connection from an Arm NN process. All reads and writes are asynchronous, and are serialized on the session's
+     * strand, so that any number of sessions can share the threads that run the io_context.
+     *
+     * When the capture is aggregated, a timer on the strand ends each window, so that the SessionStateTracker can move
+     * between the aggregated and the exemplar windows.
+     */
+    class Session : public ISession, public std::enable_shared_from_this<Session> {
     public:
-        /** Creates a unique pointer to a Session object **/
-        static std::unique_ptr<Session> create(std::unique_ptr<SocketIO> connection,
+        using socket_type = boost::asio::local::stream_protocol::socket;
+
+        /** Creates a shared pointer to a Session object, which must then be started **/
+        static std::shared_ptr<Session> create(boost::asio::io_context & context,
+                                               socket_type && socket,
                                                IGlobalState & globalState,
+                                               CounterDirectoryCache & counterDirectoryCache,
                                                ICounterConsumer & counterConsumer,
                                                const std::uint32_t sessionID);
 
-        /**
-         * Initialises the connection.
-         * @param connection connection to be initialised
-         * @param headerPacket out parameter for a HeaderPacket
-         * @return true if connection has been initialised, false if not
-         **/
-        static bool initialiseConnection(SocketIO & connection, HeaderPacket & headerPacket);
-
-        /**
-         * @param connection will need to be initialised prior
-         * @param decoder will outlive sst
-         * @param sst will outlive socket
-         */
-        Session(std::unique_ptr<SocketIO> connection,
-                ByteOrder byteOrder,
-                std::unique_ptr<IPacketDecoder> decoder,
-                std::unique_ptr<SessionStateTracker> sst);
-
-        Session() = delete;
-        ~Session() override;
+        ~Session() override = default;
 
         // No copying
         Session(const Session &) = delete;
@@ -67,28 +60,61 @@ namespace armnn {
         Session(Session && that) = delete;
         Session & operator=(Session && that) = delete;
 
-        /** Run the read loop.
-         *  Will loop until an invalid packet is recieved
+        /**
+         * Read and decode the metadata packet, then read packets until an invalid packet is recieved
          **/
-        void runReadLoop() override;
+        void start(std::function<void()> onReady, std::function<void()> onClosed) override;
 
         /** Closes the connection **/
         void close() override;
 
         /** Enable the capture **/
-        bool enableCapture() override { return mSessionStateTracker->doEnableCapture(); }
+        bool enableCapture() override;
 
         /** Disable the capture **/
-        bool disableCapture() override { return mSessionStateTracker->doDisableCapture(); }
+        bool disableCapture() override;
 
     private:
-        static const std::size_t TIMEOUT = 3000;
-        const ByteOrder mEndianness;
+        /** The ISender given to the SessionStateTracker, which queues the packets on the session */
+        class Sender;
+
+        boost::asio::io_context::strand mStrand;
+        socket_type mSocket;
+        boost::asio::steady_timer mAggregateTimer;
+        IGlobalState & mGlobalState;
+        CounterDirectoryCache & mCounterDirectoryCache;
+        ICounterConsumer & mCounterConsumer;
+        const std::uint32_t mSessionID;
+        ByteOrder mEndianness {ByteOrder::LITTLE};
         // the order of these is important because they hold references to each other
-        std::unique_ptr<SocketIO> mConnection;
-        std::unique_ptr<SessionStateTracker> mSessionStateTracker;
-        std::unique_ptr<IPacketDecoder> mDecoder;
-
-        bool receiveNextPacket();
+        std::unique_ptr<SessionStateTracker> mSessionStateTracker {};
+        std::unique_ptr<IPacketDecoder> mDecoder {};
+        std::vector<std::uint8_t> mReadBuffer {};
+        std::deque<std::vector<std::uint8_t>> mSendQueue {};
+        std::function<void()> mOnReady {};
+        std::function<void()> mOnClosed {};
+        std::atomic<bool> mClosed {false};
+        bool mSending {false};
+
+        Session(boost::asio::io_context & context,
+                socket_type && socket,
+                IGlobalState & globalState,
+                CounterDirectoryCache & counterDirectoryCache,
+                ICounterConsumer & counterConsumer,
+                std::uint32_t sessionID);
+
+        bool queueSend(std::vector<std::uint8_t> && data);
+        void doSend();
+        void doClose();
+
+        void readMetadataHeader();
+        void readMetadataBody(std::uint32_t length);
+        bool initialiseSession();
+
+        void readPacketHeader();
+        void readPacketBody();
+        bool onPacket();
+
+        void waitForAggregateWindowEnd();
     };
 }
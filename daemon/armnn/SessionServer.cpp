@@ -0,0 +1,141 @@
+/* Copyright (C) 2019-2022 by Arm Limited. All rights reserved. */
+#include "armnn/SessionServer.h"
+
+#include "Logging.h"
+
+#include <cassert>
+
+#include <boost/asio/bind_executor.hpp>
+#include <boost/asio/error.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/system/error_code.hpp>
+
+#include <sys/prctl.h>
+
+namespace armnn {
+    SessionServer::SessionServer(lib::AutoClosingFd && acceptingSocket, SessionSupplier supplier)
+        : mAcceptor {mContext, boost::asio::local::stream_protocol {}, acceptingSocket.release()},
+          mSupplier {std::move(supplier)}
+    {
+        doAccept();
+
+        for (std::size_t i = 0; i < NUMBER_OF_THREADS; ++i) {
+            mThreads.emplace_back([this]() {
+                prctl(PR_SET_NAME, reinterpret_cast<unsigned long>(&"gatord-armnn"), 0, 0, 0);
+                mContext.run();
+            });
+        }
+    }
+
+    void SessionServer::stop()
+    {
+        if (mIsRunning) {
+            // Stop accepting, the pending accept is cancelled
+            boost::asio::post(mAcceptorStrand, [this]() {
+                boost::system::error_code ignored {};
+                mAcceptor.close(ignored);
+            });
+
+            // Ensure that stopCapture has been called
+            assert(!mEnabled);
+
+            // Shut down the sessions; the threads exit once they have all closed
+            {
+                std::lock_guard<std::mutex> lock {mMutex};
+                mStopping = true;
+                for (auto & s : mSessions) {
+                    s.second.session->close();
+                }
+            }
+
+            for (auto & t : mThreads) {
+                t.join();
+            }
+
+            mThreads.clear();
+            mIsRunning = false;
+        }
+    }
+
+    void SessionServer::startCapture()
+    {
+        std::lock_guard<std::mutex> lock {mMutex};
+        for (auto & s : mSessions) {
+            if (s.second.ready) {
+                s.second.session->enableCapture();
+            }
+        }
+        mEnabled = true;
+    }
+
+    void SessionServer::stopCapture()
+    {
+        std::lock_guard<std::mutex> lock {mMutex};
+        for (auto & s : mSessions) {
+            if (s.second.ready) {
+                s.second.session->disableCapture();
+            }
+        }
+        mEnabled = false;
+    }
+
+    void SessionServer::doAccept()
+    {
+        mAcceptor.async_accept(
+            boost::asio::bind_executor(mAcceptorStrand,
+                                       [this](auto const & ec, boost::asio::local::stream_protocol::socket socket) {
+                                           if (ec) {
+                                               if (ec != boost::asio::error::operation_aborted) {
+                                                   LOG_ERROR("Failed to accept socket due to %s",
+                                                             ec.message().c_str());
+                                               }
+                                               return;
+                                           }
+
+                                           onAccepted(std::move(socket));
+                                           doAccept();
+                                       }));
+    }
+
+    void SessionServer::onAccepted(boost::asio::local::stream_protocol::socket && socket)
+    {
+        auto session = mSupplier(mContext, std::move(socket));
+        if (!session) {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock {mMutex};
+            if (mStopping) {
+                return;
+            }
+            mSessions.emplace(session.get(), SessionData {session, false});
+        }
+
+        ISession & sessionRef = *session;
+        session->start([this, &sessionRef]() { onReady(sessionRef); }, [this, &sessionRef]() { onClosed(sessionRef); });
+    }
+
+    void SessionServer::onReady(ISession & session)
+    {
+        std::lock_guard<std::mutex> lock {mMutex};
+        auto it = mSessions.find(&session);
+        if (it == mSessions.end()) {
+            return;
+        }
+
+        it->second.ready = true;
+        if (mEnabled) {
+            session.enableCapture();
+        }
+        else {
+            session.disableCapture();
+        }
+    }
+
+    void SessionServer::onClosed(ISession & session)
+    {
+        std::lock_guard<std::mutex> lock {mMutex};
+        mSessions.erase(&session);
+    }
+}
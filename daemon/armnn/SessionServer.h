@@ -0,0 +1,74 @@
+/* Copyright (C) 2019-2022 by Arm Limited. All rights reserved. */
+#pragma once
+
+#include "armnn/ISession.h"
+#include "armnn/IStartStopHandler.h"
+#include "lib/AutoClosingFd.h"
+
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/io_context_strand.hpp>
+#include <boost/asio/local/stream_protocol.hpp>
+
+namespace armnn {
+    /// May return nullptr if a session could not be created from the socket
+    using SessionSupplier = std::function<std::shared_ptr<ISession>(boost::asio::io_context &,
+                                                                    boost::asio::local::stream_protocol::socket &&)>;
+
+    /**
+     * Accepts connections and runs their sessions on a small, fixed, pool of threads
+     **/
+    class SessionServer : public ICaptureStartStopHandler {
+    public:
+        static constexpr std::size_t NUMBER_OF_THREADS = 2;
+
+        /**
+         * @param acceptingSocket The listening socket
+         * @param supplier Creates the session for each accepted connection
+         */
+        SessionServer(lib::AutoClosingFd && acceptingSocket, SessionSupplier supplier);
+        ~SessionServer() override { stop(); };
+        void stop();
+
+        /**
+         * Enables the capture on all capture sessions
+         **/
+        void startCapture() override;
+
+        /**
+         * Disables the capture on all capture sessions
+         **/
+        void stopCapture() override;
+
+    private:
+        struct SessionData {
+            std::shared_ptr<ISession> session;
+            bool ready;
+        };
+
+        boost::asio::io_context mContext {};
+        boost::asio::io_context::strand mAcceptorStrand {mContext};
+        boost::asio::local::stream_protocol::acceptor mAcceptor;
+        SessionSupplier mSupplier;
+
+        std::mutex mMutex {};
+        std::map<ISession *, SessionData> mSessions {};
+        bool mEnabled {false};
+        bool mStopping {false};
+        bool mIsRunning {true};
+
+        std::vector<std::thread> mThreads {};
+
+        void doAccept();
+        void onAccepted(boost::asio::local::stream_protocol::socket && socket);
+        void onReady(ISession & session);
+        void onClosed(ISession & session);
+    };
+}
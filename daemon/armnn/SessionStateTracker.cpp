@@ -1,8 +1,9 @@
-/* Copyright (C) 2019-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2019-2022 by Arm Limited. All rights reserved. */
 
 #include "armnn/SessionStateTracker.h"
 
 #include "Logging.h"
+#include "armnn/CounterDirectoryCache.h"
 #include "armnn/CounterDirectoryStateUtils.h"
 
 #include <cassert>
@@ -33,27 +34,6 @@ namespace armnn {
         }
     }
 
-    static EventId makeEventId(
-        const std::map<std::uint16_t, ICounterDirectoryConsumer::DeviceRecord> & deviceMap,
-        const std::map<std::uint16_t, ICounterDirectoryConsumer::CounterSetRecord> & counterSetMap,
-        const ICounterDirectoryConsumer::CategoryRecord & category,
-        const ICounterDirectoryConsumer::EventRecord & record)
-    {
-
-        EventId id {};
-        id.category = category.name;
-        id.name = record.name;
-        if (record.device_uid > 0) {
-            const ICounterDirectoryConsumer::DeviceRecord & dr = deviceMap.at(record.device_uid);
-            id.device = std::optional<std::string>(dr.name);
-        }
-        if (record.counter_set_uid > 0) {
-            const ICounterDirectoryConsumer::CounterSetRecord & csr = counterSetMap.at(record.counter_set_uid);
-            id.counterSet = std::optional<std::string>(csr.name);
-        }
-        return id;
-    }
-
     SessionStateTracker::SessionStateTracker(IGlobalState & globalState,
                                              ICounterConsumer & counterConsumer,
                                              std::unique_ptr<ISessionPacketSender> sendQueue,
@@ -67,72 +47,17 @@ namespace armnn {
     {
     }
 
-    bool SessionStateTracker::onCounterDirectory(std::map<std::uint16_t, DeviceRecord> devices,
-                                                 std::map<std::uint16_t, CounterSetRecord> counterSets,
-                                                 std::vector<CategoryRecord> categories)
+    bool SessionStateTracker::onCounterDirectory(std::shared_ptr<const CounterDirectory> directory, bool known)
     {
-        std::set<std::uint16_t> seenUids;
-        std::map<armnn::EventId, CategoryIndexEventUID> newGlobalIdToCategoryAndEvent;
-
-        // first validate the data - make sure that devices / countersets references are correct
-        for (std::size_t i = 0; i < categories.size(); ++i) {
-            const auto & cat = categories.at(i);
-            for (const auto & epair : cat.events_by_uid) {
-                const auto & event = epair.second;
-                if ((event.device_uid != 0) && (devices.count(event.device_uid) == 0)) {
-                    LOG_ERROR("Invalid counter directory, event '%s'.'%s' (0x%04x) references invalid device 0x%04x",
-                              cat.name.c_str(),
-                              event.name.c_str(),
-                              event.uid,
-                              event.device_uid);
-                    return false;
-                }
-                if ((event.counter_set_uid != 0) && (counterSets.count(event.counter_set_uid) == 0)) {
-                    LOG_ERROR(
-                        "Invalid counter directory, event '%s'.'%s' (0x%04x) references invalid counter set 0x%04x",
-                        cat.name.c_str(),
-                        event.name.c_str(),
-                        event.uid,
-                        event.counter_set_uid);
-                    return false;
-                }
-
-                // track/validate UIDs (they should be unique)
-                for (std::uint32_t i = event.uid; i <= event.max_uid; ++i) {
-                    if (!seenUids.insert(i).second) {
-                        LOG_ERROR("Invalid counter directory, event '%s'.'%s' (0x%04x) overlaps another event with "
-                                  "the same UID",
-                                  cat.name.c_str(),
-                                  event.name.c_str(),
-                                  event.uid);
-                        return false;
-                    }
-                }
-
-                // map to globalId
-                armnn::EventId globalId = makeEventId(devices, counterSets, cat, event);
-
-                // update global id -> cat/event map
-                if (!newGlobalIdToCategoryAndEvent.emplace(std::move(globalId), CategoryIndexEventUID {i, event.uid})
-                         .second) {
-                    LOG_ERROR("Invalid counter directory, event '%s'.'%s' (0x%04x) overlaps another event with the "
-                              "same global id",
-                              cat.name.c_str(),
-                              event.name.c_str(),
-                              event.uid);
-                    return false;
-                }
-            }
+        // the decoder has validated the data, and the events of a known directory were added by whichever session
+        // first received it
+        if (!known) {
+            updateGlobalWithAvailableEvents(*directory);
         }
 
-        updateGlobalWithAvailableEvents(newGlobalIdToCategoryAndEvent, categories, devices, counterSets);
-
         std::lock_guard<std::mutex> lock {mutex};
 
-        availableCounterDirectoryDevices = devices;
-        availableCounterDirectoryCounterSets = counterSets;
-        availableCounterDirectoryCategories = categories;
-        globalIdToCategoryAndEvent = newGlobalIdToCategoryAndEvent;
+        counterDirectory = std::move(directory);
 
         if (captureIsActive) {
             // Send request to ArmNN to update active events
@@ -166,24 +91,27 @@ namespace armnn {
     }
 
     bool SessionStateTracker::onPeriodicCounterCapture(std::uint64_t timestamp,
-                                                       std::map<std::uint16_t, std::uint32_t> counterIndexValues)
+                                                       lib::Span<const CounterIndexAndValue> counterIndexValues)
     {
         std::lock_guard<std::mutex> lock {mutex};
-        for (const auto & uidAndValue : counterIndexValues) {
-            auto match = requestedEventUIDs.find(uidAndValue.first);
+        capturedCounterValues.clear();
+        for (const auto & indexAndValue : counterIndexValues) {
+            auto match = requestedEventUIDs.find(indexAndValue.index);
             if (match != requestedEventUIDs.end()) {
-                if (!counterConsumer.consumeCounterValue(timestamp, match->second, uidAndValue.second)) {
-                    return false;
-                }
+                capturedCounterValues.push_back({match->second, indexAndValue.value});
             }
         }
-        return true;
+        if (capturedCounterValues.empty()) {
+            return true;
+        }
+        // pass the whole packet on at once, rather than one value at a time
+        return counterConsumer.consumeCounterValues(timestamp, capturedCounterValues);
     }
 
     bool SessionStateTracker::onPerJobCounterCapture(bool /* isPre */,
                                                      std::uint64_t timestamp,
                                                      std::uint64_t /* objectRef */,
-                                                     std::map<std::uint16_t, std::uint32_t> counterIndexValues)
+                                                     lib::Span<const CounterIndexAndValue> counterIndexValues)
     {
         // ignore the job information for now
 
@@ -195,25 +123,26 @@ namespace armnn {
         return counterConsumer.consumePacket(sessionID, packet);
     }
 
-    EventUIDKeyAndCoreMap SessionStateTracker::formRequestedUIDs(
-        const EventKeyMap & eventIdsToKey,
-        const std::map<armnn::EventId, CategoryIndexEventUID> & eventIdToCategoryAndEvent,
-        const std::vector<CategoryRecord> & availableCategories)
+    EventUIDKeyAndCoreMap SessionStateTracker::formRequestedUIDs(const EventKeyMap & eventIdsToKey,
+                                                                 const CounterDirectory * directory)
     {
         std::map<std::uint16_t, ApcCounterKeyAndCoreNumber> newRequestedEventUIDs;
-        std::set<std::uint16_t> newActiveEventUIDs;
+
+        if (directory == nullptr) {
+            return newRequestedEventUIDs;
+        }
 
         for (const auto & pair : eventIdsToKey) {
             const armnn::EventId & globalId = pair.first;
             const int key = pair.second;
 
-            const auto it = eventIdToCategoryAndEvent.find(globalId);
-            if (it == eventIdToCategoryAndEvent.end()) {
+            const auto it = directory->eventsById.find(globalId);
+            if (it == directory->eventsById.end()) {
                 continue;
             }
 
             // find category and event
-            const auto & category = availableCategories.at(it->second.index);
+            const auto & category = directory->categories.at(it->second.index);
             const auto & event = category.events_by_uid.at(it->second.uid);
 
             // add to requested map
@@ -227,14 +156,16 @@ namespace armnn {
         std::lock_guard<std::mutex> lock {mutex};
 
         captureIsActive = true;
+        windowIndex = 0;
+        detailed = isDetailedWindow();
 
         if (!counterConsumer.consumePacket(sessionID, streamMetadata)) {
             LOG_ERROR("Failed to send Arm NN stream metadata");
             return false;
         }
 
-        // Activate the timeline reporting
-        bool requestedTimeline = sendQueue->requestActivateTimelineReporting();
+        // Activate the timeline reporting, unless only the exemplar windows have it
+        bool requestedTimeline = (!detailed || sendQueue->requestActivateTimelineReporting());
         // Send request to ArmNN to update active events
         bool counterSelectionSent = sendCounterSelection();
         return requestedTimeline && counterSelectionSent;
@@ -243,11 +174,11 @@ namespace armnn {
     bool SessionStateTracker::sendCounterSelection()
     {
         const CaptureMode captureMode = globalState.getCaptureMode();
-        const std::uint32_t samplePeriod = globalState.getSamplePeriod();
+        // the counters are sampled once per aggregated window, so that the delta counters are summed by Arm NN
+        const std::uint32_t samplePeriod =
+            (detailed ? globalState.getSamplePeriod() : globalState.getAggregatePeriod());
 
-        requestedEventUIDs = formRequestedUIDs(globalState.getRequestedCounters(),
-                                               globalIdToCategoryAndEvent,
-                                               availableCounterDirectoryCategories);
+        requestedEventUIDs = formRequestedUIDs(globalState.getRequestedCounters(), counterDirectory.get());
 
         std::set<std::uint16_t> newActiveEventUIDs {keysOf(requestedEventUIDs)};
 
@@ -269,38 +200,57 @@ namespace armnn {
         return requestedTimelineDeactivate && disablePacketSent;
     }
 
-    void SessionStateTracker::updateGlobalWithAvailableEvents(
-        const std::map<EventId, CategoryIndexEventUID> & newGlobalIdToCategoryAndEvent,
-        const std::vector<CategoryRecord> & categories,
-        const std::map<std::uint16_t, DeviceRecord> & devicesById,
-        const std::map<std::uint16_t, CounterSetRecord> & counterSetsById)
+    bool SessionStateTracker::isDetailedWindow() const
+    {
+        if (globalState.getAggregatePeriod() == 0) {
+            return true;
+        }
+        const std::uint32_t exemplarInterval = globalState.getExemplarInterval();
+        return (exemplarInterval != 0) && ((windowIndex % exemplarInterval) == 0);
+    }
+
+    bool SessionStateTracker::onAggregateWindowEnd()
+    {
+        std::lock_guard<std::mutex> lock {mutex};
+
+        if (!captureIsActive) {
+            return true;
+        }
+
+        windowIndex += 1;
+
+        const bool wasDetailed = std::exchange(detailed, isDetailedWindow());
+        if (detailed == wasDetailed) {
+            return true;
+        }
+
+        // when the timeline is activated, Arm NN sends the structure of its networks again, so every exemplar window
+        // can be decoded on its own
+        bool requestedTimeline = (detailed ? sendQueue->requestActivateTimelineReporting()
+                                           : sendQueue->requestDeactivateTimelineReporting());
+        bool counterSelectionSent = sendCounterSelection();
+        return requestedTimeline && counterSelectionSent;
+    }
+
+    void SessionStateTracker::updateGlobalWithAvailableEvents(const CounterDirectory & directory)
     {
         std::vector<std::tuple<armnn::EventId, armnn::EventProperties>> data {};
-        for (const auto & i : newGlobalIdToCategoryAndEvent) {
-            const auto & cr = categories.at(i.second.index);
+        data.reserve(directory.eventsById.size());
+        for (const auto & i : directory.eventsById) {
+            const auto & cr = directory.categories.at(i.second.index);
             const auto & event = cr.events_by_uid.at(i.second.uid);
-            std::optional<std::string> deviceOpt;
-            std::optional<std::string> counterSetOpt;
-            std::optional<std::uint16_t> counterSetCount;
-            if (event.device_uid > 0) {
-                deviceOpt = devicesById.at(event.device_uid).name;
-            }
+            std::uint16_t counterSetCount = 0;
             if (event.counter_set_uid > 0) {
-                const auto & csrecord = counterSetsById.at(event.counter_set_uid);
-                counterSetOpt = csrecord.name;
-                counterSetCount = csrecord.count;
+                counterSetCount = directory.counterSets.at(event.counter_set_uid).count;
             }
 
-            armnn::EventId eventId {cr.name, deviceOpt, counterSetOpt, event.name};
-            armnn::EventProperties eventProperties {(counterSetCount ? *counterSetCount : std::uint16_t {0}),
+            armnn::EventProperties eventProperties {counterSetCount,
                                                     event.clazz,
                                                     event.interpolation,
                                                     event.multiplier,
                                                     event.description,
                                                     event.units};
-            std::tuple<armnn::EventId, armnn::EventProperties> tuple {std::move(eventId), std::move(eventProperties)};
-
-            data.emplace_back(std::move(tuple));
+            data.emplace_back(i.first, std::move(eventProperties));
         }
 
         globalState.addEvents(std::move(data));
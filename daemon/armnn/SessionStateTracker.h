@@ -1,4 +1,4 @@
-/* Copyright (C) 2019-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2019-2022 by Arm Limited. All rights reserved. */
 
 #ifndef INCLUDE_ARMNN_SESSION_STATE_TRACKER_H
 #define INCLUDE_ARMNN_SESSION_STATE_TRACKER_H
@@ -11,6 +11,7 @@
 #include "armnn/ISessionPacketSender.h"
 
 #include <map>
+#include <memory>
 #include <mutex>
 #include <set>
 #include <tuple>
@@ -31,21 +32,19 @@ namespace armnn {
                             std::vector<std::uint8_t> streamMetadata);
 
         // see ICounterDirectoryConsumer
-        bool onCounterDirectory(std::map<std::uint16_t, DeviceRecord> devices,
-                                std::map<std::uint16_t, CounterSetRecord> counterSets,
-                                std::vector<CategoryRecord> categories) override;
+        bool onCounterDirectory(std::shared_ptr<const CounterDirectory> directory, bool known) override;
         // see IPeriodicCounterSelectionConsumer
         bool onPeriodicCounterSelection(std::uint32_t period, std::set<std::uint16_t> uids) override;
         // see IPerJobCounterSelectionConsumer
         bool onPerJobCounterSelection(std::uint64_t objectId, std::set<std::uint16_t> uids) override;
         // see IPeriodicCounterCaptureConsumer
         bool onPeriodicCounterCapture(std::uint64_t timestamp,
-                                      std::map<std::uint16_t, std::uint32_t> counterIndexValues) override;
+                                      lib::Span<const CounterIndexAndValue> counterIndexValues) override;
         // see IPerJobCounterCaptureConsumer
         bool onPerJobCounterCapture(bool isPre,
                                     std::uint64_t timestamp,
                                     std::uint64_t objectRef,
-                                    std::map<std::uint16_t, std::uint32_t> counterIndexValues) override;
+                                    lib::Span<const CounterIndexAndValue> counterIndexValues) override;
 
         /**
          * Consumes a raw packet sent from target
@@ -60,31 +59,25 @@ namespace armnn {
         /** Stop capturing data */
         bool doDisableCapture();
 
+        /**
+         * Move on to the next window of an aggregated capture, switching the timeline and the sample period between
+         * those of an aggregated window and those of an exemplar window as needed
+         */
+        bool onAggregateWindowEnd();
+
         /** @return The set of active counters */
         const std::set<std::uint16_t> & getActiveCounterUIDs() const { return activeEventUIDs; }
 
     private:
-        /**
-         * Tuple of (index, uid) where index is the position in availableCounterDirectoryCategories
-         * and uid is the uid of the event within that category
-         */
-        struct CategoryIndexEventUID {
-            std::size_t index;
-            std::uint16_t uid;
-        };
-
         bool sendCounterSelection();
 
-        void updateGlobalWithAvailableEvents(
-            const std::map<EventId, CategoryIndexEventUID> & newGlobalIdToCategoryAndEvent,
-            const std::vector<CategoryRecord> & categories,
-            const std::map<std::uint16_t, DeviceRecord> & devicesById,
-            const std::map<std::uint16_t, CounterSetRecord> & counterSetsById);
+        /** @return Whether the current window has the timeline and the usual sample period */
+        bool isDetailedWindow() const;
 
-        static EventUIDKeyAndCoreMap formRequestedUIDs(
-            const EventKeyMap & eventIdsToKey,
-            const std::map<armnn::EventId, CategoryIndexEventUID> & eventIdToCategoryAndEvent,
-            const std::vector<CategoryRecord> & availableCategories);
+        void updateGlobalWithAvailableEvents(const CounterDirectory & directory);
+
+        static EventUIDKeyAndCoreMap formRequestedUIDs(const EventKeyMap & eventIdsToKey,
+                                                       const CounterDirectory * directory);
 
         // global state object
         IGlobalState & globalState;
@@ -100,13 +93,8 @@ namespace armnn {
         // mutex to protect access/modification of maps
         std::mutex mutex {};
 
-        // stores the currently available items from the counter directory
-        std::map<std::uint16_t, DeviceRecord> availableCounterDirectoryDevices {};
-        std::map<std::uint16_t, CounterSetRecord> availableCounterDirectoryCounterSets {};
-        std::vector<CategoryRecord> availableCounterDirectoryCategories {};
-
-        // stores EventId structs -> (Category, Event UID) lookups
-        std::map<armnn::EventId, CategoryIndexEventUID> globalIdToCategoryAndEvent {};
+        // the current counter directory, which may be shared with other sessions
+        std::shared_ptr<const CounterDirectory> counterDirectory {};
 
         // requested event UIDs and the APC key + core they map to
         std::map<std::uint16_t, ApcCounterKeyAndCoreNumber> requestedEventUIDs {};
@@ -114,10 +102,19 @@ namespace armnn {
         // active event UIDs
         std::set<std::uint16_t> activeEventUIDs {};
 
+        // the requested values of the most recent capture packet, kept so its storage is reused
+        std::vector<ApcCounterValue> capturedCounterValues {};
+
         // the current session
         const std::uint32_t sessionID;
 
         bool captureIsActive {false};
+
+        // the number of windows since the capture started, when aggregated
+        std::uint64_t windowIndex {0};
+
+        // whether the timeline is being sent and the counters sampled at the usual period
+        bool detailed {true};
     };
 }
 
@@ -1,5 +1,5 @@
 /**
- * Copyright (C) 2020-2021 by Arm Limited. All rights reserved.
+ * Copyright (C) 2020-2022 by Arm Limited. All rights reserved.
  *
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU General Public License version 2 as
@@ -65,6 +65,11 @@ namespace armnn {
          */
         inline void close() { fd.close(); }
 
+        /**
+         * Release ownership of the socket, for example so that it may be used with asio
+         */
+        inline AutoClosingFd release() { return std::move(fd); }
+
         /**
          * @return True if the connection is open
          */
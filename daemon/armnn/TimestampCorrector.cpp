@@ -1,4 +1,4 @@
-/* Copyright (C) 2020-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2020-2022 by Arm Limited. All rights reserved. */
 
 #include "armnn/TimestampCorrector.h"
 
@@ -12,22 +12,26 @@ namespace armnn {
     {
     }
 
-    bool TimestampCorrector::consumeCounterValue(std::uint64_t timestamp,
-                                                 ApcCounterKeyAndCoreNumber keyAndCore,
-                                                 std::uint32_t counterValue)
+    bool TimestampCorrector::consumeCounterValues(std::uint64_t timestamp,
+                                                  lib::Span<const ApcCounterValue> counterValues)
     {
-        // Only pass on the counter value if it is from after monotonic start
+        // Only pass on the counter values if they are from after monotonic start
         if (timestamp >= monotonicStarted) {
             if (!counterConsumer) {
                 // begin a new block counter frame
                 counterConsumer = mFrameBuilderFactory.createBlockCounterFrame();
             }
-            return counterConsumer->counterMessage(timestamp - monotonicStarted,
-                                                   keyAndCore.core,
-                                                   keyAndCore.key,
-                                                   counterValue);
+            // all the values go in the same frame, after a single timestamp
+            for (const auto & value : counterValues) {
+                if (!counterConsumer->counterMessage(timestamp - monotonicStarted,
+                                                     value.keyAndCore.core,
+                                                     value.keyAndCore.key,
+                                                     value.counterValue)) {
+                    return false;
+                }
+            }
         }
-        // The value was successfully consumed but has been dropped because the timestamp was too early
+        // The values were successfully consumed, or have been dropped because the timestamp was too early
         return true;
     }
     bool TimestampCorrector::consumePacket(std::uint32_t sessionId, lib::Span<const std::uint8_t> data)
@@ -1,4 +1,4 @@
-/* Copyright (C) 2020 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2020-2022 by Arm Limited. All rights reserved. */
 
 #pragma once
 
@@ -19,9 +19,7 @@ namespace armnn {
     public:
         TimestampCorrector(IFrameBuilderFactory & frameBuilderFactory, std::uint64_t monotonicStarted);
 
-        bool consumeCounterValue(std::uint64_t timestamp,
-                                 ApcCounterKeyAndCoreNumber keyAndCore,
-                                 std::uint32_t counterValue) override;
+        bool consumeCounterValues(std::uint64_t timestamp, lib::Span<const ApcCounterValue> counterValues) override;
 
         bool consumePacket(std::uint32_t sessionId, lib::Span<const std::uint8_t> data) override;
 
@@ -8,6 +8,7 @@
 #include "async/continuations/operations.h"
 #include "async/continuations/use_continuation.h"
 
+#include <cstring>
 #include <memory>
 #include <string_view>
 #include <type_traits>
@@ -19,7 +20,25 @@
 
 namespace async {
     /**
-     * Helper class for reading lines, one by one from some stream descriptor
+     * Split some text into lines, passing each one to the handler (including its '\n', if it has one)
+     *
+     * @param lines The text to split
+     * @param handler The handler function of the form `void(std::string_view)`
+     */
+    template<typename Handler>
+    void for_each_line(std::string_view lines, Handler && handler)
+    {
+        while (!lines.empty()) {
+            auto const * eol = static_cast<char const *>(std::memchr(lines.data(), '\n', lines.size()));
+            auto const n = (eol != nullptr ? std::size_t(eol - lines.data()) + 1 : lines.size());
+            handler(lines.substr(0, n));
+            lines.remove_prefix(n);
+        }
+    }
+
+    /**
+     * Helper class for reading lines, one by one (or all of those that have been received so far at once) from some
+     * stream descriptor
      */
     class async_line_reader_t : public std::enable_shared_from_this<async_line_reader_t> {
     public:
@@ -96,6 +115,69 @@ namespace async {
                 std::forward<CompletionToken>(token));
         }
 
+        /**
+         * Read all the complete lines received so far from the stream, waiting for at least one. Completion handler
+         * takes (boost::system::error_code, std::string_view), where the text contains one or more lines, each
+         * delimited by '\n' (except for any trailing, unterminated text at the end of the stream). The text is only
+         * valid until the next read. Async completes once per batch of lines so should be called in a loop.
+         */
+        template<typename CompletionToken>
+        auto async_read_lines(CompletionToken && token)
+        {
+            using namespace async::continuations;
+
+            return async_initiate(
+                [st = shared_from_this()]() {
+                    // consume the bytes from the buffer, ready for the next loop
+                    st->buffer.consume(std::exchange(st->n_to_consume, 0));
+
+                    return boost::asio::async_read_until(st->stream_descriptor,
+                                                         st->buffer,
+                                                         '\n',
+                                                         use_continuation) //
+                         | then([st](boost::system::error_code const & ec, std::size_t /*n*/) {
+                               // assumes that data returns a single item
+                               static_assert(std::is_same_v<boost::asio::streambuf::const_buffers_type,
+                                                            boost::asio::const_buffers_1>);
+
+                               auto const is_eof = (ec == boost::asio::error::eof);
+
+                               // handle errors
+                               if ((!is_eof) && ec) {
+                                   LOG_DEBUG("Read failed with %s", ec.message().c_str());
+                                   return std::pair {ec, std::string_view()};
+                               }
+
+                               // the read may have received more than one line, so take everything up-to the last
+                               // '\n' marker
+                               auto const input_area = st->buffer.data();
+                               auto const chars = std::string_view(reinterpret_cast<char const *>(input_area.data()),
+                                                                   input_area.size());
+
+                               auto const lines = find_end_of_lines(chars);
+                               st->n_to_consume = lines.size();
+
+                               // only report EOF once buffer is drained of complete lines
+                               if (is_eof && lines.empty()) {
+                                   // if there is some trailing, unterminated (by EOL) text, send it
+                                   if (!chars.empty()) {
+                                       st->n_to_consume = chars.size();
+                                       return std::pair {boost::system::error_code {}, chars};
+                                   }
+
+                                   // otherwise report the EOF
+                                   return std::pair {boost::system::error_code {boost::asio::error::eof},
+                                                     std::string_view {}};
+                               }
+
+                               // report the lines
+                               return std::pair {boost::system::error_code {}, lines};
+                           }) //
+                         | unpack_tuple();
+                },
+                std::forward<CompletionToken>(token));
+        }
+
     private:
         static constexpr std::string_view find_end_of_line(std::string_view chars)
         {
@@ -105,21 +187,30 @@ namespace async {
                                                 : std::string_view {});
         }
 
+        static std::string_view find_end_of_lines(std::string_view chars)
+        {
+            auto const * eol = static_cast<char const *>(::memrchr(chars.data(), '\n', chars.size()));
+
+            return (eol != nullptr ? chars.substr(0, std::size_t(eol - chars.data()) + 1) //
+                                   : std::string_view {});
+        }
+
         boost::asio::posix::stream_descriptor stream_descriptor;
         boost::asio::streambuf buffer {};
         std::size_t n_to_consume {0};
     };
 
     /**
-     * Consume all lines, one by one, from the stream, for each one pass it to the handler
+     * Consume all lines, in batches of all those received so far, from the stream, for each batch pass it to the
+     * handler
      *
      * @param line_reader The line reader to read from
-     * @param handler The handler function of the form `<return>(std::string_view)`, where return may be void or boost::system::error_code, or a continuation thereof
+     * @param handler The handler function of the form `void(std::string_view)`, passed the lines as per async_read_lines
      */
     template<typename Handler, typename CompletionToken>
-    auto async_consume_all_lines(std::shared_ptr<async_line_reader_t> line_reader,
-                                 Handler && handler,
-                                 CompletionToken && token)
+    auto async_consume_all_line_batches(std::shared_ptr<async_line_reader_t> line_reader,
+                                        Handler && handler,
+                                        CompletionToken && token)
     {
         using namespace async::continuations;
 
@@ -129,35 +220,12 @@ namespace async {
                      | loop([](boost::system::error_code ec) { return start_with(!ec, ec); }, //
                             [line_reader = std::move(line_reader),
                              h = std::move(h)](boost::system::error_code const & /*ec*/) mutable {
-                                return line_reader->async_read_line(use_continuation) //
-                                     | then([&h](boost::system::error_code ec, std::string_view message)
-                                                -> polymorphic_continuation_t<boost::system::error_code> {
-                                           // exit loop early on error
-                                           if (ec) {
-                                               return start_with(ec);
+                                return line_reader->async_read_lines(use_continuation) //
+                                     | then([&h](boost::system::error_code ec, std::string_view lines) {
+                                           if (!ec) {
+                                               h(lines);
                                            }
-
-                                           // pass message to handler and consume result
-                                           return start_with(message) //
-                                                | then(h)             //
-                                                | then([](auto... args) {
-                                                      using args_type =
-                                                          continuation_of_t<std::decay_t<decltype(args)>...>;
-
-                                                      if constexpr (std::is_same_v<continuation_of_t<>, args_type>) {
-                                                          return boost::system::error_code {};
-                                                      }
-                                                      else {
-                                                          static_assert(
-                                                              std::is_same_v<
-                                                                  continuation_of_t<boost::system::error_code>,
-                                                                  args_type>,
-                                                              "line consume must return void, error-code or a "
-                                                              "continuation thereof");
-
-                                                          return boost::system::error_code {args...};
-                                                      }
-                                                  });
+                                           return ec;
                                        });
                             })
                      // filter EOF
@@ -172,6 +240,79 @@ namespace async {
             std::forward<CompletionToken>(token));
     }
 
+    /**
+     * Consume all lines, one by one, from the stream, for each one pass it to the handler
+     *
+     * @param line_reader The line reader to read from
+     * @param handler The handler function of the form `<return>(std::string_view)`, where return may be void or boost::system::error_code, or a continuation thereof
+     */
+    template<typename Handler, typename CompletionToken>
+    auto async_consume_all_lines(std::shared_ptr<async_line_reader_t> line_reader,
+                                 Handler && handler,
+                                 CompletionToken && token)
+    {
+        using namespace async::continuations;
+
+        // a handler that completes synchronously can be passed all the lines of each batch without waiting for
+        // another read in between
+        if constexpr (std::is_void_v<std::invoke_result_t<std::decay_t<Handler> &, std::string_view>>) {
+            return async_consume_all_line_batches(
+                std::move(line_reader),
+                [h = std::forward<Handler>(handler)](std::string_view lines) mutable { for_each_line(lines, h); },
+                std::forward<CompletionToken>(token));
+        }
+        else {
+            return async_initiate(
+                [line_reader = std::move(line_reader), h = std::forward<Handler>(handler)]() mutable {
+                    return start_with(boost::system::error_code {})                               //
+                         | loop([](boost::system::error_code ec) { return start_with(!ec, ec); }, //
+                                [line_reader = std::move(line_reader),
+                                 h = std::move(h)](boost::system::error_code const & /*ec*/) mutable {
+                                    return line_reader->async_read_line(use_continuation) //
+                                         | then([&h](boost::system::error_code ec, std::string_view message)
+                                                    -> polymorphic_continuation_t<boost::system::error_code> {
+                                               // exit loop early on error
+                                               if (ec) {
+                                                   return start_with(ec);
+                                               }
+
+                                               // pass message to handler and consume result
+                                               return start_with(message) //
+                                                    | then(h)             //
+                                                    | then([](auto... args) {
+                                                          using args_type =
+                                                              continuation_of_t<std::decay_t<decltype(args)>...>;
+
+                                                          if constexpr (std::is_same_v<continuation_of_t<>,
+                                                                                       args_type>) {
+                                                              return boost::system::error_code {};
+                                                          }
+                                                          else {
+                                                              static_assert(
+                                                                  std::is_same_v<
+                                                                      continuation_of_t<boost::system::error_code>,
+                                                                      args_type>,
+                                                                  "line consume must return void, error-code or a "
+                                                                  "continuation thereof");
+
+                                                              return boost::system::error_code {args...};
+                                                          }
+                                                      });
+                                           });
+                                })
+                         // filter EOF
+                         | then([](boost::system::error_code ec) {
+                               if (ec != boost::asio::error::eof) {
+                                   return ec;
+                               }
+                               return boost::system::error_code {};
+                           }) //
+                         | map_error();
+                },
+                std::forward<CompletionToken>(token));
+        }
+    }
+
     /**
      * Consume all lines, one by one, from the stream, for each one pass it to the handler
      *
@@ -3,6 +3,7 @@
 #pragma once
 
 #include "async/continuations/detail/initiation_chain.h"
+#include "async/continuations/detail/recycling_allocator.h"
 #include "async/continuations/detail/state_chain.h"
 #include "async/continuations/detail/trace.h"
 #include "lib/source_location.h"
@@ -73,7 +74,7 @@ namespace async::continuations::detail {
         {
             using value_type = polymorphic_exceptionally_value_t<Exceptionally>;
 
-            return {std::make_shared<value_type>(exceptionally)};
+            return {std::allocate_shared<value_type>(recycling_allocator_t<value_type> {}, exceptionally)};
         }
 
         static polymorphic_exceptionally_t wrap_exceptionally(polymorphic_exceptionally_t const & exceptionally)
@@ -85,7 +86,7 @@ namespace async::continuations::detail {
 
         // NOLINTNEXTLINE(hicpp-explicit-conversions)
         polymorphic_exceptionally_t(std::shared_ptr<polymorphic_exceptionally_base_t> && exceptionally)
-            : exceptionally(exceptionally)
+            : exceptionally(std::move(exceptionally))
         {
         }
 
@@ -103,7 +104,7 @@ namespace async::continuations::detail {
 
     /** Base type for wrapper around some NextInitiator that type erases it */
     template<typename... InputArgs>
-    class polymorphic_next_initiator_base_t {
+    class polymorphic_next_initiator_base_t : public recycling_allocated_t {
     public:
         virtual ~polymorphic_next_initiator_base_t() noexcept = default;
 
@@ -174,7 +175,7 @@ namespace async::continuations::detail {
 
     /** Base type for polymorphic state type */
     template<typename... OutputArgs>
-    class polymorphic_state_base_t {
+    class polymorphic_state_base_t : public recycling_allocated_t {
     public:
         virtual ~polymorphic_state_base_t() noexcept = default;
 
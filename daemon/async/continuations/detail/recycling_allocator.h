@@ -0,0 +1,192 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <new>
+
+namespace async::continuations::detail {
+    /**
+     * A per-thread cache of small freed memory blocks, used to recycle the memory of the type erased parts of
+     * polymorphic continuations. Those are created and destroyed for every step of a polymorphic chain (which is
+     * usually some loop that runs for as long as the capture does), so without some recycling each step costs several
+     * calls to the global allocator.
+     *
+     * Blocks are grouped into size classes. A block may be freed on a different thread to the one that allocated it, in
+     * which case it is cached by the freeing thread.
+     */
+    class recycling_block_cache_t {
+    public:
+        /** The size classes are multiples of this */
+        static constexpr std::size_t granularity = alignof(std::max_align_t);
+        /** Blocks larger than this are not cached */
+        static constexpr std::size_t max_block_size = 512;
+        /** The maximum number of free blocks to cache for each size class */
+        static constexpr std::size_t max_free_blocks_per_class = 64;
+
+        /** Allocate some block of at least `size` bytes */
+        [[nodiscard]] static void * allocate(std::size_t size)
+        {
+            auto * cache = get_cache();
+            if ((cache == nullptr) || (size > max_block_size)) {
+                return ::operator new(size);
+            }
+
+            auto & size_class = cache->size_classes[size_class_index(size)];
+            if (size_class.head == nullptr) {
+                return ::operator new(size_class_size(size));
+            }
+
+            auto * block = size_class.head;
+            size_class.head = block->next;
+            size_class.count -= 1;
+            return block;
+        }
+
+        /** Free some block previously returned by `allocate(size)` */
+        static void deallocate(void * pointer, std::size_t size) noexcept
+        {
+            if (pointer == nullptr) {
+                return;
+            }
+
+            auto * cache = get_cache();
+            if ((cache == nullptr) || (size > max_block_size)) {
+                ::operator delete(pointer);
+                return;
+            }
+
+            auto & size_class = cache->size_classes[size_class_index(size)];
+            if (size_class.count >= max_free_blocks_per_class) {
+                ::operator delete(pointer);
+                return;
+            }
+
+            auto * block = ::new (pointer) free_block_t {size_class.head};
+            size_class.head = block;
+            size_class.count += 1;
+        }
+
+    private:
+        static constexpr std::size_t number_of_size_classes = max_block_size / granularity;
+
+        static_assert((max_block_size % granularity) == 0);
+
+        struct free_block_t {
+            free_block_t * next;
+        };
+
+        struct size_class_t {
+            free_block_t * head = nullptr;
+            std::size_t count = 0;
+        };
+
+        struct cache_t {
+            std::array<size_class_t, number_of_size_classes> size_classes {};
+
+            cache_t() = default;
+            cache_t(cache_t const &) = delete;
+            cache_t & operator=(cache_t const &) = delete;
+            cache_t(cache_t &&) = delete;
+            cache_t & operator=(cache_t &&) = delete;
+
+            ~cache_t() noexcept
+            {
+                // anything freed by the remaining thread local destructors goes straight back to the global allocator
+                destroyed() = true;
+
+                for (auto & size_class : size_classes) {
+                    while (size_class.head != nullptr) {
+                        auto * block = size_class.head;
+                        size_class.head = block->next;
+                        ::operator delete(block);
+                    }
+                }
+            }
+        };
+
+        [[nodiscard]] static constexpr std::size_t size_class_index(std::size_t size)
+        {
+            return (size == 0 ? 0 : ((size - 1) / granularity));
+        }
+
+        [[nodiscard]] static constexpr std::size_t size_class_size(std::size_t size)
+        {
+            return (size_class_index(size) + 1) * granularity;
+        }
+
+        /** This is trivially destructible, so may still be read after the cache itself is destroyed */
+        [[nodiscard]] static bool & destroyed() noexcept
+        {
+            thread_local bool value = false;
+            return value;
+        }
+
+        [[nodiscard]] static cache_t * get_cache() noexcept
+        {
+            if (destroyed()) {
+                return nullptr;
+            }
+
+            thread_local cache_t cache {};
+            return &cache;
+        }
+    };
+
+    /**
+     * Mixin that makes some (polymorphic) type allocate its memory from the recycling_block_cache_t. The type must have
+     * a virtual destructor, so that the sized delete is given the size of the most derived type.
+     */
+    class recycling_allocated_t {
+    public:
+        [[nodiscard]] static void * operator new(std::size_t size)
+        {
+            return recycling_block_cache_t::allocate(size);
+        }
+
+        static void operator delete(void * pointer, std::size_t size) noexcept
+        {
+            recycling_block_cache_t::deallocate(pointer, size);
+        }
+    };
+
+    /** A std compatible allocator that uses the recycling_block_cache_t (for use with std::allocate_shared) */
+    template<typename T>
+    class recycling_allocator_t {
+    public:
+        using value_type = T;
+
+        constexpr recycling_allocator_t() noexcept = default;
+
+        template<typename U>
+        // NOLINTNEXTLINE(hicpp-explicit-conversions)
+        constexpr recycling_allocator_t(recycling_allocator_t<U> const & /*other*/) noexcept
+        {
+        }
+
+        [[nodiscard]] T * allocate(std::size_t n)
+        {
+            static_assert(alignof(T) <= recycling_block_cache_t::granularity);
+
+            return static_cast<T *>(recycling_block_cache_t::allocate(n * sizeof(T)));
+        }
+
+        void deallocate(T * pointer, std::size_t n) noexcept
+        {
+            recycling_block_cache_t::deallocate(pointer, n * sizeof(T));
+        }
+
+        template<typename U>
+        [[nodiscard]] constexpr bool operator==(recycling_allocator_t<U> const & /*other*/) const noexcept
+        {
+            return true;
+        }
+
+        template<typename U>
+        [[nodiscard]] constexpr bool operator!=(recycling_allocator_t<U> const & /*other*/) const noexcept
+        {
+            return false;
+        }
+    };
+}
@@ -0,0 +1,236 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#pragma once
+
+#include "async/netlink/nl_protocol.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string_view>
+
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/system/error_code.hpp>
+
+#include <linux/if_link.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+namespace async::netlink {
+
+    using nl_route_protocol_t = netlink_protocol_t<NETLINK_ROUTE>;
+
+    /**
+     * A synchronous rtnetlink client that reads the byte counts of every network interface with a single RTM_GETSTATS
+     * dump, which (unlike /proc/net/dev) is binary and only carries the 64 bit link stats.
+     *
+     * RTM_GETSTATS only identifies each interface by its index, so the names are read separately with an RTM_GETLINK
+     * dump, which need only be repeated when an interface appears. The client closes itself if the kernel is too old to
+     * support RTM_GETSTATS (before Linux 4.7).
+     */
+    class nl_link_stats_client_t {
+    public:
+        using protocol_type = nl_route_protocol_t;
+        using endpoint_type = typename protocol_type::endpoint;
+        using socket_type = typename protocol_type::socket;
+
+        /** How long to wait for each part of a reply before giving up on a request */
+        static constexpr long receive_timeout_us = 100000;
+
+        struct link_stats_t {
+            int ifindex;
+            std::uint64_t rx_bytes;
+            std::uint64_t tx_bytes;
+        };
+
+        explicit nl_link_stats_client_t(boost::asio::io_context & context) : socket(context)
+        {
+            // use the error checking rather than throwing methods so that the caller can fall back to /proc/net/dev
+            boost::system::error_code ec {};
+
+            socket.open(protocol_type(), ec);
+            if (!ec) {
+                socket.bind(endpoint_type {}, ec);
+            }
+            if (!!ec) {
+                socket.close(ec);
+                return;
+            }
+
+            // never block the caller indefinitely should a reply be lost
+            timeval timeout {0, receive_timeout_us};
+            setsockopt(socket.native_handle(), SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+            if (!dump_stats([](link_stats_t const & /*stats*/) {})) {
+                socket.close(ec);
+            }
+        }
+
+        /** @return True if the socket is open (and RTM_GETSTATS is usable), false otherwise */
+        [[nodiscard]] bool is_open() const { return socket.is_open(); }
+
+        /** Close the socket */
+        void close() { socket.close(); }
+
+        /**
+         * Read the stats of every interface
+         *
+         * @param consumer Called with the stats of each interface in turn
+         * @return False if the request failed
+         */
+        template<typename Consumer>
+        bool dump_stats(Consumer && consumer)
+        {
+            if_stats_msg request {};
+            request.family = AF_UNSPEC;
+            request.filter_mask = IFLA_STATS_FILTER_BIT(IFLA_STATS_LINK_64);
+
+            return dump(RTM_GETSTATS, &request, sizeof(request), RTM_NEWSTATS, [&consumer](std::string_view payload) {
+                if (payload.size() < NLMSG_ALIGN(sizeof(if_stats_msg))) {
+                    return;
+                }
+
+                if_stats_msg header {};
+                std::memcpy(&header, payload.data(), sizeof(header));
+
+                auto const stats = find_attribute(payload.substr(NLMSG_ALIGN(sizeof(if_stats_msg))),
+                                                  IFLA_STATS_LINK_64);
+                if (!stats) {
+                    return;
+                }
+
+                // the struct only ever grows, so older kernels send a prefix of it and newer ones send more
+                rtnl_link_stats64 link_stats {};
+                std::memcpy(&link_stats, stats->data(), std::min(stats->size(), sizeof(link_stats)));
+
+                consumer(link_stats_t {int(header.ifindex), link_stats.rx_bytes, link_stats.tx_bytes});
+            });
+        }
+
+        /**
+         * Read the name of every interface
+         *
+         * @param consumer Called with the index and name of each interface in turn
+         * @return False if the request failed
+         */
+        template<typename Consumer>
+        bool dump_names(Consumer && consumer)
+        {
+            ifinfomsg request {};
+            request.ifi_family = AF_UNSPEC;
+
+            return dump(RTM_GETLINK, &request, sizeof(request), RTM_NEWLINK, [&consumer](std::string_view payload) {
+                if (payload.size() < NLMSG_ALIGN(sizeof(ifinfomsg))) {
+                    return;
+                }
+
+                ifinfomsg header {};
+                std::memcpy(&header, payload.data(), sizeof(header));
+
+                auto const name = find_attribute(payload.substr(NLMSG_ALIGN(sizeof(ifinfomsg))), IFLA_IFNAME);
+                if (!name) {
+                    return;
+                }
+
+                // the name is nul terminated
+                consumer(header.ifi_index, name->substr(0, std::min(name->find('\0'), name->size())));
+            });
+        }
+
+    private:
+        /** Big enough for any one part of a dump, which the kernel limits to 32KiB */
+        static constexpr std::size_t buffer_size = 32768;
+
+        socket_type socket;
+        alignas(nlmsghdr) std::array<char, buffer_size> buffer {};
+        std::uint32_t sequence = 0;
+
+        /**
+         * Send a dump request, then receive each part of the reply
+         *
+         * @param consumer Called with the payload of each message of the reply
+         * @return False if the request failed or the kernel returned an error
+         */
+        template<typename Consumer>
+        bool dump(std::uint16_t type,
+                  void const * request,
+                  std::size_t request_length,
+                  std::uint16_t reply_type,
+                  Consumer && consumer)
+        {
+            const std::size_t length = NLMSG_LENGTH(request_length);
+
+            std::memset(buffer.data(), 0, length);
+
+            auto * const header = reinterpret_cast<nlmsghdr *>(buffer.data());
+            header->nlmsg_len = length;
+            header->nlmsg_type = type;
+            header->nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+            header->nlmsg_seq = ++sequence;
+            std::memcpy(NLMSG_DATA(header), request, request_length);
+
+            boost::system::error_code ec {};
+            socket.send(boost::asio::buffer(buffer.data(), length), 0, ec);
+            if (!!ec) {
+                return false;
+            }
+
+            for (;;) {
+                const std::size_t n = socket.receive(boost::asio::buffer(buffer), 0, ec);
+                if (!!ec) {
+                    return false;
+                }
+
+                std::string_view messages {buffer.data(), n};
+                while (messages.size() >= NLMSG_HDRLEN) {
+                    // the messages are aligned within the buffer
+                    auto const * const message = reinterpret_cast<nlmsghdr const *>(messages.data());
+                    if ((message->nlmsg_len < NLMSG_HDRLEN) || (message->nlmsg_len > messages.size())) {
+                        return false;
+                    }
+
+                    // anything else is a late reply to an earlier request that timed out
+                    if (message->nlmsg_seq == sequence) {
+                        if (message->nlmsg_type == NLMSG_DONE) {
+                            return true;
+                        }
+                        if (message->nlmsg_type == NLMSG_ERROR) {
+                            return false;
+                        }
+                        if (message->nlmsg_type == reply_type) {
+                            consumer(messages.substr(NLMSG_HDRLEN, message->nlmsg_len - NLMSG_HDRLEN));
+                        }
+                    }
+
+                    messages.remove_prefix(std::min<std::size_t>(NLMSG_ALIGN(message->nlmsg_len), messages.size()));
+                }
+            }
+        }
+
+        /** @return The payload of the first attribute of the specified type */
+        static std::optional<std::string_view> find_attribute(std::string_view attributes, std::uint16_t type)
+        {
+            while (attributes.size() >= NLA_HDRLEN) {
+                nlattr attribute {};
+                std::memcpy(&attribute, attributes.data(), sizeof(attribute));
+
+                if ((attribute.nla_len < NLA_HDRLEN) || (attribute.nla_len > attributes.size())) {
+                    return {};
+                }
+
+                if ((attribute.nla_type & NLA_TYPE_MASK) == type) {
+                    return attributes.substr(NLA_HDRLEN, attribute.nla_len - NLA_HDRLEN);
+                }
+
+                attributes.remove_prefix(std::min<std::size_t>(NLA_ALIGN(attribute.nla_len), attributes.size()));
+            }
+
+            return {};
+        }
+    };
+}
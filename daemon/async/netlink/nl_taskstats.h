@@ -0,0 +1,229 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#pragma once
+
+#include "async/netlink/nl_protocol.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string_view>
+
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/system/error_code.hpp>
+
+#include <linux/genetlink.h>
+#include <linux/netlink.h>
+#include <linux/taskstats.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace async::netlink {
+
+    using nl_generic_protocol_t = netlink_protocol_t<NETLINK_GENERIC>;
+
+    /**
+     * A synchronous client for the TASKSTATS generic netlink family, which returns the accumulated accounting data (cpu
+     * time, faults, context switches) of all the threads in a thread group with a single request.
+     *
+     * The kernel only accepts taskstats requests from processes with CAP_NET_ADMIN, so the client closes itself if the
+     * family is missing or a probe request is refused.
+     */
+    class nl_taskstats_client_t {
+    public:
+        using protocol_type = nl_generic_protocol_t;
+        using endpoint_type = typename protocol_type::endpoint;
+        using socket_type = typename protocol_type::socket;
+
+        /** How long to wait for a reply before giving up on a request */
+        static constexpr long receive_timeout_us = 100000;
+
+        explicit nl_taskstats_client_t(boost::asio::io_context & context) : socket(context)
+        {
+            // use the error checking rather than throwing methods as taskstats is optional and commonly not permitted
+            boost::system::error_code ec {};
+
+            socket.open(protocol_type(), ec);
+            if (!ec) {
+                socket.bind(endpoint_type {}, ec);
+            }
+            if (!!ec) {
+                socket.close(ec);
+                return;
+            }
+
+            // never block the caller indefinitely should a reply be lost
+            timeval timeout {0, receive_timeout_us};
+            setsockopt(socket.native_handle(), SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+            if (!resolve_family() || !query_tgid(getpid())) {
+                socket.close(ec);
+            }
+        }
+
+        /** @return True if the socket is open (and taskstats is usable), false otherwise */
+        [[nodiscard]] bool is_open() const { return socket.is_open(); }
+
+        /** Close the socket */
+        void close() { socket.close(); }
+
+        /**
+         * Query the accounting data for a thread group
+         *
+         * @return The data, or empty if the process no longer exists or the request failed
+         */
+        [[nodiscard]] std::optional<taskstats> query_tgid(pid_t tgid)
+        {
+            const auto tgid_value = std::uint32_t(tgid);
+
+            if (!send_request(family_id,
+                              TASKSTATS_CMD_GET,
+                              TASKSTATS_GENL_VERSION,
+                              TASKSTATS_CMD_ATTR_TGID,
+                              &tgid_value,
+                              sizeof(tgid_value))) {
+                return {};
+            }
+
+            // the stats are nested inside a tgid + stats aggregate
+            auto const reply = receive_reply(family_id);
+            auto const aggregate = (reply ? find_attribute(*reply, TASKSTATS_TYPE_AGGR_TGID) : std::nullopt);
+            auto const stats = (aggregate ? find_attribute(*aggregate, TASKSTATS_TYPE_STATS) : std::nullopt);
+            if (!stats) {
+                return {};
+            }
+
+            // the struct only ever grows, so older kernels send a prefix of it and newer ones send more
+            taskstats result {};
+            std::memcpy(&result, stats->data(), std::min(stats->size(), sizeof(result)));
+            return result;
+        }
+
+    private:
+        static constexpr std::size_t buffer_size = 4096;
+
+        socket_type socket;
+        alignas(nlmsghdr) std::array<char, buffer_size> buffer {};
+        std::uint32_t sequence = 0;
+        std::uint16_t family_id = 0;
+
+        /** Look up the id of the TASKSTATS family */
+        bool resolve_family()
+        {
+            static constexpr char family_name[] = TASKSTATS_GENL_NAME;
+
+            if (!send_request(GENL_ID_CTRL,
+                              CTRL_CMD_GETFAMILY,
+                              1,
+                              CTRL_ATTR_FAMILY_NAME,
+                              family_name,
+                              sizeof(family_name))) {
+                return false;
+            }
+
+            auto const reply = receive_reply(GENL_ID_CTRL);
+            auto const id = (reply ? find_attribute(*reply, CTRL_ATTR_FAMILY_ID) : std::nullopt);
+            if ((!id) || (id->size() < sizeof(family_id))) {
+                return false;
+            }
+
+            std::memcpy(&family_id, id->data(), sizeof(family_id));
+            return true;
+        }
+
+        /** Send a generic netlink request with a single attribute */
+        bool send_request(std::uint16_t type,
+                          std::uint8_t command,
+                          std::uint8_t version,
+                          std::uint16_t attribute_type,
+                          void const * attribute_data,
+                          std::size_t attribute_length)
+        {
+            const std::size_t length = NLMSG_LENGTH(GENL_HDRLEN) + NLA_ALIGN(NLA_HDRLEN + attribute_length);
+            if (length > buffer.size()) {
+                return false;
+            }
+
+            std::memset(buffer.data(), 0, length);
+
+            auto * const header = reinterpret_cast<nlmsghdr *>(buffer.data());
+            header->nlmsg_len = length;
+            header->nlmsg_type = type;
+            header->nlmsg_flags = NLM_F_REQUEST;
+            header->nlmsg_seq = ++sequence;
+
+            auto * const genl_header = static_cast<genlmsghdr *>(NLMSG_DATA(header));
+            genl_header->cmd = command;
+            genl_header->version = version;
+
+            auto * const attribute = reinterpret_cast<nlattr *>(reinterpret_cast<char *>(genl_header) + GENL_HDRLEN);
+            attribute->nla_len = NLA_HDRLEN + attribute_length;
+            attribute->nla_type = attribute_type;
+            std::memcpy(reinterpret_cast<char *>(attribute) + NLA_HDRLEN, attribute_data, attribute_length);
+
+            boost::system::error_code ec {};
+            socket.send(boost::asio::buffer(buffer.data(), length), 0, ec);
+            return !ec;
+        }
+
+        /**
+         * Receive the reply to the most recent request
+         *
+         * @return The attributes of the reply, or empty if the kernel returned an error
+         */
+        std::optional<std::string_view> receive_reply(std::uint16_t type)
+        {
+            for (;;) {
+                boost::system::error_code ec {};
+                const std::size_t n = socket.receive(boost::asio::buffer(buffer), 0, ec);
+                if (!!ec) {
+                    return {};
+                }
+
+                auto const * const header = reinterpret_cast<nlmsghdr const *>(buffer.data());
+                if (!NLMSG_OK(header, n)) {
+                    return {};
+                }
+
+                // a late reply to an earlier request that timed out
+                if (header->nlmsg_seq != sequence) {
+                    continue;
+                }
+
+                // anything else is an NLMSG_ERROR
+                if ((header->nlmsg_type != type) || (header->nlmsg_len < NLMSG_LENGTH(GENL_HDRLEN))) {
+                    return {};
+                }
+
+                return std::string_view(static_cast<char const *>(NLMSG_DATA(header)) + GENL_HDRLEN,
+                                        header->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN));
+            }
+        }
+
+        /** @return The payload of the first attribute of the specified type */
+        static std::optional<std::string_view> find_attribute(std::string_view attributes, std::uint16_t type)
+        {
+            while (attributes.size() >= NLA_HDRLEN) {
+                nlattr attribute {};
+                std::memcpy(&attribute, attributes.data(), sizeof(attribute));
+
+                if ((attribute.nla_len < NLA_HDRLEN) || (attribute.nla_len > attributes.size())) {
+                    return {};
+                }
+
+                if ((attribute.nla_type & NLA_TYPE_MASK) == type) {
+                    return attributes.substr(NLA_HDRLEN, attribute.nla_len - NLA_HDRLEN);
+                }
+
+                attributes.remove_prefix(std::min<std::size_t>(NLA_ALIGN(attribute.nla_len), attributes.size()));
+            }
+
+            return {};
+        }
+    };
+}
@@ -31,13 +31,7 @@ namespace async::detail {
          */
     bool is_pid_directory(const lib::FsEntry & entry)
     {
-        // type must be directory
-        const lib::FsEntry::Stats stats = entry.read_stats();
-        if (stats.type() != lib::FsEntry::Type::DIR) {
-            return false;
-        }
-
-        // name must be only digits
+        // name must be only digits (checked first, as it is much cheaper than the stat)
         const std::string name = entry.name();
         for (char chr : name) {
             if (std::isdigit(chr) == 0) {
@@ -45,7 +39,9 @@ namespace async::detail {
             }
         }
 
-        return true;
+        // type must be directory
+        const lib::FsEntry::Stats stats = entry.read_stats();
+        return (stats.type() == lib::FsEntry::Type::DIR);
     }
 
     /** @return The process exe path (or some estimation of it). Empty if the thread is a kernel thread, otherwise
@@ -225,12 +225,15 @@ namespace async {
             }
 
             auto name = entry.name();
-            auto exe_path = async::detail::get_process_exe_path(entry);
             // read the pid
             auto pid = std::strtol(name.c_str(), nullptr, 0);
 
             // process threads?
             if constexpr (WantThreads || WantStats) {
+                // only the threads need the exe path, and finding it costs a realpath (and maybe a read of cmdline)
+                auto exe_path = async::detail::get_process_exe_path(entry);
+
+
                 // call the receiver object
                 return callbacks->on_process_directory(pid, entry)
                      // then process the threads
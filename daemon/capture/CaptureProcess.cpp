@@ -24,8 +24,10 @@
 #include <sstream>
 #include <thread>
 
+#include <fcntl.h>
 #include <sys/prctl.h>
 #include <sys/resource.h>
+#include <sys/socket.h>
 #include <sys/syscall.h>
 #include <sys/time.h>
 #include <sys/wait.h>
@@ -58,6 +60,8 @@ namespace {
     Monitor monitor;
     capture::internal::UdpListener udpListener;
     std::unique_ptr<AnnotateListener> annotateListenerPtr;
+    // passes the connections that resume the capture to gator-child, whilst it is running
+    lib::AutoClosingFd resumeChannel;
 
     StateAndPid handleSigchld(StateAndPid currentStateAndChildPid, Drivers & drivers)
     {
@@ -74,6 +78,8 @@ namespace {
             driver->postChildExitInParent();
         }
 
+        resumeChannel.close();
+
         int exitStatus;
         // NOLINTNEXTLINE(hicpp-signed-bitwise)
         if (WIFEXITED(status)) {
@@ -111,6 +117,14 @@ namespace {
             return handleSigchld(currentStateAndChildPid, drivers);
         }
 
+        if (signum == SIGUSR2) {
+            // the capture continues, the child just sends the flight recorder data
+            if (currentStateAndChildPid.state == State::CAPTURING) {
+                kill(currentStateAndChildPid.pid, SIGUSR2);
+            }
+            return currentStateAndChildPid;
+        }
+
         LOG_DEBUG("Received signal %d, gator daemon exiting", signum);
 
         switch (currentStateAndChildPid.state) {
@@ -180,16 +194,30 @@ namespace {
      *
      * This is used to allow the ADB device scanner to continue to function even during a
      * capture without flooding the console with "Session already active" messages.
+     * Unless the host gives a session token in the magic sequence, in which case the connection is passed to
+     * gator-child to resume the capture (or to carry some of the capture data).
+     *
      * @param fd The newly accepted connection's file handle
+     * @param channel A copy of the resume channel, or invalid if there is none
      * @param last_log_error_supplier Supplies the last generated error log message for reporting back to Streamline
      */
-    void handleSecondaryConnection(int fd, logging::last_log_error_supplier_t last_log_error_supplier)
+    void handleSecondaryConnection(int fd,
+                                   lib::AutoClosingFd channel,
+                                   logging::last_log_error_supplier_t last_log_error_supplier)
     {
         prctl(PR_SET_NAME, reinterpret_cast<unsigned long>(&"gatord-2ndconn"), 0, 0, 0);
 
         OlySocket client {fd};
         Sender sender(&client);
 
+        if (channel && !sender.getSessionToken().empty()) {
+            if (!lib::sendFd(*channel, fd, sender.getSessionToken())) {
+                LOG_WARNING("Unable to pass the connection to gator-child to resume the capture");
+            }
+            // gator-child now has its own copy, which the Sender closes on return
+            return;
+        }
+
         // Wait to receive a single command
         StreamlineCommandHandler commandHandler;
         const auto result = streamlineSetupCommandIteration(client, commandHandler, [](bool) -> void {});
@@ -227,14 +255,26 @@ namespace {
                              logging::log_setup_supplier_t log_setup_supplier)
     {
         if (currentStateAndChildPid.state != State::IDLE) {
-            // A temporary socket connection to host, to transfer error message
-            std::thread handler {handleSecondaryConnection, sock.acceptConnection(), last_log_error_supplier};
+            // A temporary socket connection to host, to transfer error message (or to resume the capture)
+            lib::AutoClosingFd channel {resumeChannel ? fcntl(*resumeChannel, F_DUPFD_CLOEXEC, 0) : -1};
+            std::thread handler {handleSecondaryConnection,
+                                 sock.acceptConnection(),
+                                 std::move(channel),
+                                 last_log_error_supplier};
             handler.detach();
 
             return currentStateAndChildPid;
         }
 
         OlySocket client(sock.acceptConnection());
+
+        int resumeChannelFds[2];
+        if (socketpair(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0, resumeChannelFds) != 0) {
+            throw GatorException("Unable to set up the resume channel");
+        }
+        resumeChannel = resumeChannelFds[0];
+        lib::AutoClosingFd childResumeChannel {resumeChannelFds[1]};
+
         for (const auto & driver : drivers.getAll()) {
             driver->preChildFork();
         }
@@ -262,6 +302,7 @@ namespace {
             udpListener.close();
             monitor.close();
             annotateListenerPtr.reset();
+            resumeChannel.close();
 
             // create the agent process spawner
             std::unique_ptr<agents::i_agent_spawner_t> spawner {};
@@ -276,6 +317,7 @@ namespace {
             auto child = Child::createLive(*spawner,
                                            drivers,
                                            client,
+                                           std::move(childResumeChannel),
                                            event_listener,
                                            last_log_error_supplier,
                                            std::move(log_setup_supplier));
@@ -291,6 +333,7 @@ namespace {
                 driver->postChildForkInParent();
             }
             client.closeSocket();
+            childResumeChannel.close();
             return {.state = State::CAPTURING, .pid = pid};
         }
     }
@@ -0,0 +1,570 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "capture/CaptureReplay.h"
+
+#include "BufferUtils.h"
+#include "GatorCLIParser.h"
+#include "GatorException.h"
+#include "ISender.h"
+#include "Logging.h"
+#include "Monitor.h"
+#include "OlySocket.h"
+#include "OlyUtility.h"
+#include "Protocol.h"
+#include "ProtocolVersion.h"
+#include "StreamlineSetupLoop.h"
+#include "capture/internal/UdpListener.h"
+#include "lib/AutoClosingFd.h"
+#include "lib/String.h"
+#include "mxml/mxml.h"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <climits>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace capture {
+    namespace {
+        constexpr std::array<const char, sizeof("\0streamline-data")> NO_TCP_PIPE = {"\0streamline-data"};
+        constexpr std::string_view MAGIC = "STREAMLINE";
+        constexpr int SEND_TIMEOUT_MS = 8000;
+        /** How much of a data file is read at a time, for the frames that are gathered rather than sent by sendfile */
+        constexpr std::size_t READ_CHUNK_SIZE = 1024 * 1024;
+        /** Frames at least this long are sent straight from the file */
+        constexpr std::uint32_t SENDFILE_THRESHOLD = 64 * 1024;
+        /** The length and the type of a frame */
+        constexpr std::uint64_t FRAME_HEADER_SIZE = 5;
+        constexpr std::size_t DATA_FILE_NAME_LENGTH = 10;
+        constexpr std::string_view COMPRESSED_SUFFIX = ".lz4";
+
+        constexpr char TAG_REQUEST[] = "request";
+        constexpr char ATTR_TYPE[] = "type";
+
+        /** The same as Sender's, being the frames that each segment after the first starts with a copy of */
+        bool isSegmentHeaderFrame(char frameType)
+        {
+            switch (static_cast<FrameType>(frameType)) {
+                case FrameType::SUMMARY:
+                case FrameType::NAME:
+                case FrameType::PERF_ATTRS:
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        /** @return The number of the data file, or nothing if `name` is not one */
+        std::optional<unsigned> parseDataFileName(std::string_view name)
+        {
+            if ((name.size() != DATA_FILE_NAME_LENGTH)
+                || !std::all_of(name.begin(), name.end(), [](char c) { return (c >= '0') && (c <= '9'); })) {
+                return {};
+            }
+            return static_cast<unsigned>(std::strtoul(std::string(name).c_str(), nullptr, 10));
+        }
+
+        /** @return The numbers of the data segments of the capture in order, or nothing if it cannot be replayed */
+        std::optional<std::vector<unsigned>> findSegments(const char * apcDir)
+        {
+            std::unique_ptr<DIR, int (*)(DIR *)> dir {opendir(apcDir), &closedir};
+            if (!dir) {
+                // NOLINTNEXTLINE(concurrency-mt-unsafe)
+                LOG_ERROR("Unable to open the capture directory %s (%s)", apcDir, strerror(errno));
+                return {};
+            }
+
+            std::vector<unsigned> segments {};
+            bool compressed = false;
+            // NOLINTNEXTLINE(concurrency-mt-unsafe)
+            while (const struct dirent * const entry = readdir(dir.get())) {
+                const std::string_view name {entry->d_name};
+                if (const auto segment = parseDataFileName(name)) {
+                    segments.push_back(*segment);
+                }
+                else if ((name.size() == DATA_FILE_NAME_LENGTH + COMPRESSED_SUFFIX.size())
+                         && (name.substr(DATA_FILE_NAME_LENGTH) == COMPRESSED_SUFFIX)
+                         && parseDataFileName(name.substr(0, DATA_FILE_NAME_LENGTH))) {
+                    compressed = true;
+                }
+            }
+
+            if (compressed) {
+                LOG_ERROR("The capture in %s is compressed, and only uncompressed captures can be replayed", apcDir);
+                return {};
+            }
+            if (segments.empty()) {
+                LOG_ERROR("There is no capture data in %s", apcDir);
+                return {};
+            }
+
+            // any segments before the first were dropped as the capture went on, so it starts from the first kept
+            std::sort(segments.begin(), segments.end());
+            return segments;
+        }
+
+        struct ReplayStats {
+            std::uint64_t frames;
+            std::uint64_t bytes;
+            std::uint64_t sendfileBytes;
+            std::uint64_t skippedFrames;
+        };
+
+        /** Answers one host's commands from the APC, and streams the capture to it once it starts one */
+        class ReplaySession : private IStreamlineCommandHandler {
+        public:
+            ReplaySession(OlySocket & socket, const char * apcDir, const std::vector<unsigned> & segments, int signalFd)
+                : mSocket(socket), mApcDir(apcDir), mSegments(segments), mSignalFd(signalFd)
+            {
+            }
+
+            /** @return True if the host asked gatord to exit */
+            bool run()
+            {
+                // as in Sender, anything before the magic sequence is ignored
+                char streamline[64] = {0};
+                while (std::string_view(streamline).substr(0, MAGIC.size()) != MAGIC) {
+                    if (mSocket.receiveString(streamline, sizeof(streamline)) == -1) {
+                        LOG_DEBUG("Socket disconnected before the magic sequence");
+                        return false;
+                    }
+                }
+
+                lib::printf_str_t<32> magic {"GATOR %i\n", PROTOCOL_VERSION};
+                if (!sendAll(magic, strlen(magic))) {
+                    return false;
+                }
+                LOG_DEBUG("Completed magic sequence");
+
+                return streamlineSetupCommandLoop(mSocket, *this, [](bool /*recvd*/) {}) == State::EXIT_OK;
+            }
+
+        private:
+            OlySocket & mSocket;
+            const char * mApcDir;
+            const std::vector<unsigned> & mSegments;
+            int mSignalFd;
+            /** The data file being read, and the part of it that was last read into mChunk */
+            int mDataFd {-1};
+            std::vector<char> mChunk {};
+            std::uint64_t mChunkStart {0};
+            std::uint64_t mChunkLength {0};
+            /** Gathers the frames that are in mChunk, each after its type */
+            std::vector<struct iovec> mIov {};
+            ReplayStats mStats {0, 0, 0, 0};
+
+            State handleRequest(char * xml) override
+            {
+                const char * attr = nullptr;
+
+                auto * const tree = mxmlLoadString(nullptr, xml, MXML_NO_CALLBACK);
+                auto * const node = mxmlFindElement(tree, tree, TAG_REQUEST, ATTR_TYPE, nullptr, MXML_DESCEND_FIRST);
+                if (node != nullptr) {
+                    attr = mxmlElementGetAttr(node, ATTR_TYPE);
+                }
+
+                // the configuration cannot be changed, so only the xml that describes the capture is served
+                const std::string type {attr != nullptr ? attr : ""};
+                mxmlDelete(tree);
+
+                if ((type == "captured") || (type == "counters") || (type == "events")) {
+                    const lib::dyn_printf_str_t path {"%s/%s.xml", mApcDir, type.c_str()};
+                    unsigned int size = 0;
+                    const std::unique_ptr<char, void (*)(void *)> contents {readFromDisk(path, &size, false),
+                                                                            &std::free};
+                    if (contents) {
+                        LOG_DEBUG("Sent %s xml response", type.c_str());
+                        return sendResponse(contents.get(), size, ResponseType::XML);
+                    }
+                    LOG_DEBUG("The capture has no %s xml", type.c_str());
+                }
+                else {
+                    LOG_DEBUG("Received request that cannot be answered by a replay:\n%s", xml);
+                }
+
+                const char error[] = "Not available when replaying a capture";
+                return sendResponse(error, strlen(error), ResponseType::NAK);
+            }
+
+            State handleDeliver(char * /*xml*/) override
+            {
+                // the session and configuration are those of the capture, so whatever is delivered is ignored (and
+                // the capture data is only ever sent over this connection)
+                LOG_DEBUG("Ignoring delivered xml");
+                return sendResponse(nullptr, 0, ResponseType::ACK);
+            }
+
+            State handleApcStart() override
+            {
+                LOG_DEBUG("Received apc start request");
+                if (!sendCapture()) {
+                    return State::EXIT_DISCONNECT;
+                }
+                // the host may ask for the captured xml again, or ping, before it disconnects
+                return State::PROCESS_COMMANDS;
+            }
+
+            State handleApcStop() override
+            {
+                LOG_DEBUG("Received apc stop request");
+                return State::EXIT_APC_STOP;
+            }
+
+            State handleDisconnect() override
+            {
+                LOG_DEBUG("Received disconnect command");
+                return State::EXIT_DISCONNECT;
+            }
+
+            State handlePing() override
+            {
+                LOG_DEBUG("Received ping command");
+                return sendResponse(nullptr, 0, ResponseType::ACK);
+            }
+
+            State handleExit() override
+            {
+                LOG_DEBUG("Received exit command");
+                return State::EXIT_OK;
+            }
+
+            State handleRequestCurrentConfig() override
+            {
+                const char error[] = "Not available when replaying a capture";
+                return sendResponse(error, strlen(error), ResponseType::NAK);
+            }
+
+            bool sendAll(const char * data, std::size_t length)
+            {
+                // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast) - iovec is not const, but is only read from
+                struct iovec iov {const_cast<char *>(data), length};
+                return mSocket.trySendv(&iov, 1, SEND_TIMEOUT_MS);
+            }
+
+            State sendResponse(const char * data, std::uint32_t length, ResponseType type)
+            {
+                char header[5];
+                header[0] = static_cast<char>(type);
+                buffer_utils::writeLEInt(header + 1, length);
+                // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast) - iovec is not const, but is only read from
+                struct iovec iov[2] = {{header, sizeof(header)}, {const_cast<char *>(data), length}};
+                if (!mSocket.trySendv(iov, (length > 0 ? 2 : 1), SEND_TIMEOUT_MS)) {
+                    return State::EXIT_DISCONNECT;
+                }
+                return State::PROCESS_COMMANDS;
+            }
+
+            /** @return True if gatord was signalled, which is left in the pipe for the serving loop to handle */
+            [[nodiscard]] bool isSignalled() const
+            {
+                struct pollfd pfd {mSignalFd, POLLIN, 0};
+                return (poll(&pfd, 1, 0) > 0);
+            }
+
+            bool sendCapture()
+            {
+                mStats = {0, 0, 0, 0};
+                const auto start = std::chrono::steady_clock::now();
+
+                // corked, so that each type byte is sent with the frame that follows it
+                mSocket.setCork(true);
+                bool first = true;
+                for (const auto segment : mSegments) {
+                    if (!sendSegment(segment, !first)) {
+                        mSocket.setCork(false);
+                        return false;
+                    }
+                    first = false;
+                }
+
+                // write end-of-capture sequence
+                const bool sent = (sendResponse(nullptr, 0, ResponseType::APC_DATA) == State::PROCESS_COMMANDS);
+                mSocket.setCork(false);
+                if (!sent) {
+                    return false;
+                }
+
+                const auto elapsedMs =
+                    std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start)
+                        .count();
+                const double megabytes = static_cast<double>(mStats.bytes) / (1024.0 * 1024.0);
+                LOG_INFO("Replayed %.1f MB of capture data (%" PRIu64 " frames, %.1f MB of them with sendfile) "
+                         "from %zu segments in %lld ms (%.1f MB/s), skipping %" PRIu64 " repeated header frames",
+                         megabytes,
+                         mStats.frames,
+                         static_cast<double>(mStats.sendfileBytes) / (1024.0 * 1024.0),
+                         mSegments.size(),
+                         static_cast<long long>(elapsedMs),
+                         (elapsedMs > 0 ? (megabytes * 1000.0) / static_cast<double>(elapsedMs) : 0.0),
+                         mStats.skippedFrames);
+                return true;
+            }
+
+            /**
+             * Send the frames of one data file
+             *
+             * @param skipHeaderFrames True to skip the copy of the header frames that the segment starts with
+             */
+            bool sendSegment(unsigned segment, bool skipHeaderFrames)
+            {
+                const lib::dyn_printf_str_t path {"%s/%010u", mApcDir, segment};
+                lib::AutoClosingFd fd {lib::open(path, O_RDONLY | O_CLOEXEC)};
+                struct stat st {};
+                if ((!fd) || (fstat(*fd, &st) != 0)) {
+                    // NOLINTNEXTLINE(concurrency-mt-unsafe)
+                    LOG_ERROR("Unable to read the capture data file %s (%s)", path.c_str(), strerror(errno));
+                    return false;
+                }
+
+                mDataFd = *fd;
+                mChunkStart = 0;
+                mChunkLength = 0;
+                mIov.clear();
+
+                const auto size = static_cast<std::uint64_t>(st.st_size);
+                std::uint64_t offset = 0;
+                bool skipping = skipHeaderFrames;
+                while (offset < size) {
+                    if ((size - offset) < FRAME_HEADER_SIZE) {
+                        LOG_WARNING("The capture data file %s ends with part of a frame, which is not sent",
+                                    path.c_str());
+                        break;
+                    }
+                    if (!isInChunk(offset, FRAME_HEADER_SIZE) && !readChunk(offset, path.c_str())) {
+                        return false;
+                    }
+
+                    const char * const header = mChunk.data() + (offset - mChunkStart);
+                    const std::uint32_t length = buffer_utils::readLEInt(header);
+                    if ((length == 0) || (length > static_cast<std::uint32_t>(ISender::MAX_RESPONSE_LENGTH))) {
+                        LOG_ERROR("The capture data file %s is corrupt at offset %" PRIu64, path.c_str(), offset);
+                        return false;
+                    }
+                    const std::uint64_t frameSize = sizeof(std::uint32_t) + length;
+                    if (frameSize > (size - offset)) {
+                        LOG_WARNING("The capture data file %s ends with part of a frame, which is not sent",
+                                    path.c_str());
+                        break;
+                    }
+
+                    if (skipping && isSegmentHeaderFrame(header[sizeof(std::uint32_t)])) {
+                        mStats.skippedFrames += 1;
+                        offset += frameSize;
+                        continue;
+                    }
+                    skipping = false;
+
+                    if (length >= SENDFILE_THRESHOLD) {
+                        if (!flushFrames() || !sendFrameFromFile(offset, frameSize)) {
+                            return false;
+                        }
+                    }
+                    else {
+                        if (!isInChunk(offset, frameSize) && !readChunk(offset, path.c_str())) {
+                            return false;
+                        }
+                        static const char frameType = static_cast<char>(ResponseType::APC_DATA);
+                        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast) - iovec is not const, but is only read
+                        mIov.push_back({const_cast<char *>(&frameType), 1});
+                        mIov.push_back({mChunk.data() + (offset - mChunkStart), frameSize});
+                        if (((mIov.size() + 2) > IOV_MAX) && !flushFrames()) {
+                            return false;
+                        }
+                    }
+
+                    mStats.frames += 1;
+                    mStats.bytes += frameSize + 1;
+                    offset += frameSize;
+                }
+
+                const bool flushed = flushFrames();
+                mDataFd = -1;
+                return flushed;
+            }
+
+            [[nodiscard]] bool isInChunk(std::uint64_t offset, std::uint64_t length) const
+            {
+                return (offset >= mChunkStart) && ((offset + length) <= (mChunkStart + mChunkLength));
+            }
+
+            /** Read the file from `offset` into mChunk, having sent the frames gathered from it */
+            bool readChunk(std::uint64_t offset, const char * path)
+            {
+                if (!flushFrames()) {
+                    return false;
+                }
+                if (isSignalled()) {
+                    LOG_DEBUG("Replay interrupted by a signal");
+                    return false;
+                }
+
+                mChunk.resize(READ_CHUNK_SIZE);
+                mChunkStart = offset;
+                mChunkLength = 0;
+                while (mChunkLength < READ_CHUNK_SIZE) {
+                    const ssize_t n = pread(mDataFd,
+                                            mChunk.data() + mChunkLength,
+                                            READ_CHUNK_SIZE - mChunkLength,
+                                            static_cast<off_t>(offset + mChunkLength));
+                    if ((n < 0) && (errno == EINTR)) {
+                        continue;
+                    }
+                    if (n < 0) {
+                        // NOLINTNEXTLINE(concurrency-mt-unsafe)
+                        LOG_ERROR("Failed reading the capture data file %s (%s)", path, strerror(errno));
+                        return false;
+                    }
+                    if (n == 0) {
+                        break;
+                    }
+                    mChunkLength += n;
+                }
+                return true;
+            }
+
+            /** Send the frames that were gathered from mChunk */
+            bool flushFrames()
+            {
+                if (mIov.empty()) {
+                    return true;
+                }
+                const bool sent = mSocket.trySendv(mIov.data(), static_cast<int>(mIov.size()), SEND_TIMEOUT_MS);
+                mIov.clear();
+                return sent;
+            }
+
+            /** Send the frame's type, then the frame (with its length) straight from the file */
+            bool sendFrameFromFile(std::uint64_t offset, std::uint64_t frameSize)
+            {
+                if (isSignalled()) {
+                    LOG_DEBUG("Replay interrupted by a signal");
+                    return false;
+                }
+
+                const char frameType = static_cast<char>(ResponseType::APC_DATA);
+                if (!sendAll(&frameType, 1)) {
+                    return false;
+                }
+
+                auto fileOffset = static_cast<off_t>(offset);
+                std::uint64_t remaining = frameSize;
+                while (remaining > 0) {
+                    const ssize_t n = sendfile(mSocket.getFd(), mDataFd, &fileOffset, remaining);
+                    if ((n < 0) && (errno == EINTR)) {
+                        continue;
+                    }
+                    if ((n < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+                        struct pollfd pfd {mSocket.getFd(), POLLOUT, 0};
+                        if (poll(&pfd, 1, SEND_TIMEOUT_MS) <= 0) {
+                            LOG_ERROR("Timed out sending the capture data");
+                            return false;
+                        }
+                        continue;
+                    }
+                    if (n <= 0) {
+                        // NOLINTNEXTLINE(concurrency-mt-unsafe)
+                        LOG_ERROR("Socket sendfile error (%d): %s", errno, strerror(errno));
+                        return false;
+                    }
+                    remaining -= n;
+                }
+
+                mStats.sendfileBytes += frameSize;
+                return true;
+            }
+        };
+    }
+
+    int replayCapture(const char * apcDir, int port, int signalFd)
+    {
+        const auto segments = findSegments(apcDir);
+        if (!segments) {
+            return EXIT_FAILURE;
+        }
+
+        // as with a live capture, a send to a broken socket should fail rather than raise a signal
+        signal(SIGPIPE, SIG_IGN);
+
+        try {
+            Monitor monitor;
+            internal::UdpListener udpListener;
+            std::unique_ptr<OlyServerSocket> socketTcp;
+
+            if (!monitor.init() || !monitor.add(signalFd)) {
+                throw GatorException("Monitor setup failed");
+            }
+            if (port != DISABLE_TCP_USE_UDS_PORT) {
+                socketTcp = std::make_unique<OlyServerSocket>(port);
+                udpListener.setup(port);
+                if (!monitor.add(socketTcp->getFd()) || !monitor.add(udpListener.getReq())) {
+                    throw GatorException("Monitor setup failed: couldn't add host listeners");
+                }
+            }
+            OlyServerSocket socketUds {NO_TCP_PIPE.data(), NO_TCP_PIPE.size(), true};
+            if (!monitor.add(socketUds.getFd())) {
+                throw GatorException("Monitor setup failed: couldn't add host listeners");
+            }
+
+            LOG_INFO("Replaying the capture in %s (%zu data segments) to each host that connects",
+                     apcDir,
+                     segments->size());
+
+            while (true) {
+                struct epoll_event events[4];
+                const int ready = monitor.wait(events, ARRAY_LENGTH(events), -1);
+                if (ready < 0) {
+                    throw GatorException("Monitor::wait failed");
+                }
+
+                for (int i = 0; i < ready; ++i) {
+                    const int fd = events[i].data.fd;
+                    if (fd == signalFd) {
+                        int signum;
+                        if (::read(signalFd, &signum, sizeof(signum)) != sizeof(signum)) {
+                            throw GatorException("Reading the signal pipe failed");
+                        }
+                        LOG_DEBUG("Received signal %d, gator daemon exiting", signum);
+                        return EXIT_SUCCESS;
+                    }
+                    if ((socketTcp != nullptr) && (fd == udpListener.getReq())) {
+                        udpListener.handle();
+                        continue;
+                    }
+
+                    OlyServerSocket & server = ((socketTcp != nullptr) && (fd == socketTcp->getFd()) ? *socketTcp
+                                                                                                       : socketUds);
+                    OlySocket client {server.acceptConnection()};
+                    // hosts are served one at a time, so any others wait in the listen backlog
+                    ReplaySession session {client, apcDir, *segments, signalFd};
+                    const bool exit = session.run();
+                    client.shutdownConnection();
+                    client.closeSocket();
+                    if (exit) {
+                        return EXIT_SUCCESS;
+                    }
+                }
+            }
+        }
+        catch (const GatorException & ex) {
+            LOG_DEBUG("%s", ex.what());
+            return EXIT_FAILURE;
+        }
+    }
+}
@@ -0,0 +1,26 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#pragma once
+
+namespace capture {
+
+    /**
+     * Serve a local capture to Streamline as though it were being captured live, so that a capture that was
+     * made with --output can be loaded by connecting to the target rather than by copying the APC off it.
+     *
+     * Streamline connects as it does to start a live capture, over TCP on `port` (unless it is
+     * DISABLE_TCP_USE_UDS_PORT) or over the abstract "streamline-data" socket. Its requests for the captured,
+     * counters and events xml are answered from the files in the APC, and once it starts the capture, the data
+     * segments are sent in order. Each frame in a data file is only prefixed by its length, where the host expects
+     * the response type too, so each one is sent with its type byte written in front of it; large frames are sent
+     * straight from the file with sendfile, and runs of small ones are gathered into a single sendmsg.
+     *
+     * Hosts are served one at a time until gatord is stopped.
+     *
+     * @param apcDir The directory of the local capture, which must not be compressed
+     * @param port The TCP port to listen on
+     * @param signalFd The read end of the pipe that gatord's signal handler writes each signal to
+     * @return The exit code of gatord
+     */
+    int replayCapture(const char * apcDir, int port, int signalFd);
+}
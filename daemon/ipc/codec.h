@@ -33,6 +33,7 @@
 #include <cstdlib>
 #include <cstring>
 #include <type_traits>
+#include <utility>
 
 #include <boost/asio/buffer.hpp>
 #include <boost/system/errc.hpp>
@@ -222,6 +223,63 @@ namespace ipc {
         : byte_span_blob_codec_t<lib::Span<T const>, U> {
     };
 
+    /**
+     * Specialization for a pair of Spans of integrals, which are sent as one contiguous blob (for example, a chunk of some ringbuffer
+     * that wraps). This is a R/O send only type; the receiver should use the equivalent std::vector type.
+     */
+    template<typename T, typename U>
+    struct blob_codec_t<std::pair<lib::Span<T const>, lib::Span<T const>>, U, std::enable_if_t<std::is_integral_v<T>>> {
+        /** The blob type */
+        using value_type = std::pair<lib::Span<T const>, lib::Span<T const>>;
+
+        /** The scatter-gather helper object which stores the length and buffers so that the length field may be scatter-gathered */
+        struct sg_write_helper_type {
+            char const * first_data = nullptr;
+            std::size_t first_length = 0;
+            char const * second_data = nullptr;
+            std::size_t second_length = 0;
+            std::size_t length = 0;
+        };
+
+        /** The scatter-gather helper object used for reading the suffix (unused, as the type cannot be read into) */
+        struct sg_read_helper_type {
+        };
+
+        /** The number of buffers required to perform a scatter gather based write of the length + suffix fields */
+        static constexpr std::size_t sg_writer_buffers_count = 3;
+
+        /** The size of the length field */
+        static constexpr std::size_t length_size = sizeof(U);
+
+        /** Fill the sg_write_helper_type value */
+        static constexpr sg_write_helper_type fill_sg_write_helper_type(value_type const & buffers)
+        {
+            auto const first_length = buffers.first.size() * sizeof(T);
+            auto const second_length = buffers.second.size() * sizeof(T);
+
+            return {reinterpret_cast<char const *>(buffers.first.data()),
+                    first_length,
+                    reinterpret_cast<char const *>(buffers.second.data()),
+                    second_length,
+                    first_length + second_length};
+        }
+
+        /** The total size required to store the encoded suffix buffer + length field */
+        static constexpr std::size_t suffix_write_size(sg_write_helper_type const & helper)
+        {
+            return length_size + helper.length;
+        }
+
+        /** Fill a scatter-gather buffer list for writing out the header */
+        static constexpr void fill_sg_buffer(lib::Span<boost::asio::const_buffer> sg_list,
+                                             sg_write_helper_type const & helper)
+        {
+            sg_list[0] = {reinterpret_cast<char const *>(&helper.length), length_size};
+            sg_list[1] = {helper.first_data, helper.first_length};
+            sg_list[2] = {helper.second_data, helper.second_length};
+        }
+    };
+
     /** Specialization for protobuf messages */
     template<typename T, typename U>
     struct blob_codec_t<T, U, std::enable_if_t<is_protobuf_message_v<T>>> {
@@ -0,0 +1,133 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#pragma once
+
+#include "ISender.h"
+
+#include <array>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+namespace ipc {
+    /**
+     * A bounded pool of reusable byte buffers for the IPC messages that carry apc_frame data.
+     *
+     * Buffers are borrowed with `acquire`, moved into the message (e.g. msg_apc_frame_data_t), and then returned with
+     * `release` once the raw_ipc_channel_sink_t hands the message back to the send completion handler. The buffers are
+     * grouped into size classes so that small frames do not pin the (much larger) allocations used for aux frames, and
+     * each class holds a bounded number of buffers so that the pool cannot cause unbounded RSS growth.
+     *
+     * The pool is thread safe, as buffers may be released on a different thread from the one that acquired them.
+     */
+    class frame_buffer_pool_t {
+    public:
+        /** The number of size classes */
+        static constexpr std::size_t n_size_classes = 4;
+
+        /** The (minimum) capacity of buffers in each size class */
+        static constexpr std::array<std::size_t, n_size_classes> size_classes {
+            4UL * 1024UL,
+            64UL * 1024UL,
+            1024UL * 1024UL + 1024UL, // allows for the header on top of a max-sized perf data / aux payload
+            ISender::MAX_RESPONSE_LENGTH,
+        };
+
+        /** The maximum number of buffers retained in each size class */
+        static constexpr std::array<std::size_t, n_size_classes> default_max_buffers_per_class {64, 16, 8, 1};
+
+        frame_buffer_pool_t() = default;
+
+        explicit frame_buffer_pool_t(std::array<std::size_t, n_size_classes> max_buffers_per_class)
+            : max_buffers_per_class(max_buffers_per_class)
+        {
+        }
+
+        /**
+         * Borrow some empty buffer that has capacity for at least `min_capacity` bytes
+         *
+         * @param min_capacity The required capacity
+         * @return The buffer; size() will be zero
+         */
+        [[nodiscard]] std::vector<char> acquire(std::size_t min_capacity)
+        {
+            auto const size_class = size_class_for_acquire(min_capacity);
+
+            // too big to be pooled
+            if (size_class >= n_size_classes) {
+                std::vector<char> result {};
+                result.reserve(min_capacity);
+                return result;
+            }
+
+            {
+                auto lock = std::lock_guard(mutex);
+                auto & free_list = free_lists[size_class];
+                if (!free_list.empty()) {
+                    std::vector<char> result {std::move(free_list.back())};
+                    free_list.pop_back();
+                    return result;
+                }
+            }
+
+            std::vector<char> result {};
+            result.reserve(size_classes[size_class]);
+            return result;
+        }
+
+        /**
+         * Return some buffer to the pool. The buffer is discarded if it is too small, too large, or if the pool is
+         * full.
+         *
+         * @param buffer The buffer to return
+         */
+        void release(std::vector<char> && buffer)
+        {
+            auto const size_class = size_class_for_release(buffer.capacity());
+
+            if (size_class >= n_size_classes) {
+                return;
+            }
+
+            buffer.clear();
+
+            auto lock = std::lock_guard(mutex);
+            auto & free_list = free_lists[size_class];
+            if (free_list.size() < max_buffers_per_class[size_class]) {
+                free_list.emplace_back(std::move(buffer));
+            }
+        }
+
+    private:
+        std::array<std::size_t, n_size_classes> max_buffers_per_class {default_max_buffers_per_class};
+        std::array<std::vector<std::vector<char>>, n_size_classes> free_lists {};
+        std::mutex mutex {};
+
+        /** Find the smallest size class that can hold `size` bytes, or n_size_classes if none */
+        static constexpr std::size_t size_class_for_acquire(std::size_t size)
+        {
+            for (std::size_t n = 0; n < n_size_classes; ++n) {
+                if (size <= size_classes[n]) {
+                    return n;
+                }
+            }
+            return n_size_classes;
+        }
+
+        /** Find the largest size class that a buffer of `capacity` bytes can satisfy, or n_size_classes if none */
+        static constexpr std::size_t size_class_for_release(std::size_t capacity)
+        {
+            // ignore buffers that are too small to be useful or that are larger than any frame should be
+            if ((capacity < size_classes[0]) || (capacity > (2 * size_classes[n_size_classes - 1]))) {
+                return n_size_classes;
+            }
+
+            for (std::size_t n = n_size_classes; n > 0; --n) {
+                if (capacity >= size_classes[n - 1]) {
+                    return n - 1;
+                }
+            }
+            return n_size_classes;
+        }
+    };
+}
@@ -33,6 +33,13 @@ namespace ipc {
         cpu_state_change,
         capture_failed,
         capture_started,
+        perf_data_raw,
+        perf_agent_stats,
+        flight_recorder_trigger,
+        perf_capture_reconfiguration,
+
+        // external annotations
+        annotation_channel_limits,
     };
 
     /** The wire-size of the message key */
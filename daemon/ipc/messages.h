@@ -9,6 +9,7 @@
 #include "message_key.h"
 
 #include <string_view>
+#include <utility>
 #include <variant>
 
 namespace ipc {
@@ -30,6 +31,58 @@ namespace ipc {
         }
     };
 
+    struct [[gnu::packed]] perf_agent_stats_t {
+        /** The peak fill level of any perf ring buffer since the last report, in parts per thousand */
+        std::uint32_t peak_mmap_fill;
+        /** The number of messages waiting to be sent to the shell */
+        std::uint32_t ipc_queue_depth;
+        /** The total CPU time used by the agent process, in microseconds */
+        std::uint64_t cpu_time_us;
+        /** The peak resident set size of the agent process, in KiB */
+        std::uint64_t max_rss_kib;
+        /** The total number of times the agent's threads were woken */
+        std::uint64_t wakeups;
+        /** The total number of records that the kernel could not write as the ring buffers were full */
+        std::uint64_t lost_records;
+        /** The total number of samples that the kernel could not generate (PERF_RECORD_LOST_SAMPLES) */
+        std::uint64_t lost_samples;
+        /** The total number of aux records that the kernel truncated as the aux buffers were full */
+        std::uint64_t truncated_aux_records;
+        /** The total amount of ring buffer data discarded once the one-shot limit was reached (or the capture ended) */
+        std::uint64_t one_shot_dropped_bytes;
+
+        friend constexpr bool operator==(perf_agent_stats_t const & a, perf_agent_stats_t const & b)
+        {
+            return (a.peak_mmap_fill == b.peak_mmap_fill) && (a.ipc_queue_depth == b.ipc_queue_depth)
+                && (a.cpu_time_us == b.cpu_time_us) && (a.max_rss_kib == b.max_rss_kib) && (a.wakeups == b.wakeups)
+                && (a.lost_records == b.lost_records) && (a.lost_samples == b.lost_samples)
+                && (a.truncated_aux_records == b.truncated_aux_records)
+                && (a.one_shot_dropped_bytes == b.one_shot_dropped_bytes);
+        }
+
+        friend constexpr bool operator!=(perf_agent_stats_t const & a, perf_agent_stats_t const & b)
+        {
+            return !(a == b);
+        }
+    };
+
+    struct [[gnu::packed]] annotation_channel_limits_t {
+        /** The channel annotations beyond this many per second, on each channel of each thread, are suppressed */
+        std::uint32_t max_rate;
+        /** Only one in this many channel annotations is kept */
+        std::uint32_t sample;
+
+        friend constexpr bool operator==(annotation_channel_limits_t const & a, annotation_channel_limits_t const & b)
+        {
+            return (a.max_rate == b.max_rate) && (a.sample == b.sample);
+        }
+
+        friend constexpr bool operator!=(annotation_channel_limits_t const & a, annotation_channel_limits_t const & b)
+        {
+            return !(a == b);
+        }
+    };
+
     enum class capture_failed_reason_t : std::uint8_t {
         /** Capture failed due to command exec failure */
         command_exec_failed,
@@ -86,6 +139,14 @@ namespace ipc {
         message_t<message_key_t::annotation_send_bytes, annotation_uid_t, std::vector<char>>;
     DEFINE_NAMED_MESSAGE(msg_annotation_send_bytes_t);
 
+    /**
+     * Sent from the shell to the annotation agent with the limits to set in each annotated process, where zero leaves
+     * the limit set by the process's environment
+     */
+    using msg_annotation_channel_limits_t =
+        message_t<message_key_t::annotation_channel_limits, annotation_channel_limits_t, void>;
+    DEFINE_NAMED_MESSAGE(msg_annotation_channel_limits_t);
+
     /** Sent by the shell to configure the perf capture */
     using msg_capture_configuration_t =
         message_t<message_key_t::perf_capture_configuration, void, proto::shell::perf::capture_configuration_t>;
@@ -110,6 +171,18 @@ namespace ipc {
     using msg_apc_frame_data_from_span_t = message_t<message_key_t::apc_frame_data, void, lib::Span<char const>>;
     DEFINE_NAMED_MESSAGE(msg_apc_frame_data_from_span_t);
 
+    /** Raw (unencoded) perf data section records sent by the perf agent, for the shell to encode into a PERF_DATA APC frame.
+     *
+     * The header is the cpu number the records were read from. The suffix must contain only complete records.
+     */
+    using msg_perf_data_raw_t = message_t<message_key_t::perf_data_raw, int, std::vector<char>>;
+    DEFINE_NAMED_MESSAGE(msg_perf_data_raw_t);
+
+    // this version is R/O send only object allowing send directly from the (possibly wrapped) perf mmap
+    using msg_perf_data_raw_from_spans_t =
+        message_t<message_key_t::perf_data_raw, int, std::pair<lib::Span<char const>, lib::Span<char const>>>;
+    DEFINE_NAMED_MESSAGE(msg_perf_data_raw_from_spans_t);
+
     /** Sent by the perf agent to the shell once it is ready to capture the newly exec-d process */
     using msg_exec_target_app_t = message_t<message_key_t::exec_target_app, void, void>;
     DEFINE_NAMED_MESSAGE(msg_exec_target_app_t);
@@ -126,6 +199,20 @@ namespace ipc {
     using msg_capture_started_t = message_t<message_key_t::capture_started, void, void>;
     DEFINE_NAMED_MESSAGE(msg_capture_started_t);
 
+    /** Sent periodically from perf agent to shell to report the state of its part of the capture pipeline */
+    using msg_perf_agent_stats_t = message_t<message_key_t::perf_agent_stats, perf_agent_stats_t, void>;
+    DEFINE_NAMED_MESSAGE(msg_perf_agent_stats_t);
+
+    /** Sent from shell->perf agent to tell it to send the data held by the flight recorder */
+    using msg_flight_recorder_trigger_t = message_t<message_key_t::flight_recorder_trigger, void, void>;
+    DEFINE_NAMED_MESSAGE(msg_flight_recorder_trigger_t);
+
+    /** Sent from shell->perf agent to change the perf events of the running capture */
+    using msg_capture_reconfiguration_t = message_t<message_key_t::perf_capture_reconfiguration,
+                                                    void,
+                                                    proto::shell::perf::capture_reconfiguration_t>;
+    DEFINE_NAMED_MESSAGE(msg_capture_reconfiguration_t);
+
     /** All supported message types */
     using all_message_types_variant_t = std::variant<msg_ready_t,
                                                      msg_shutdown_t,
@@ -134,6 +221,7 @@ namespace ipc {
                                                      msg_annotation_close_conn_t,
                                                      msg_annotation_recv_bytes_t,
                                                      msg_annotation_send_bytes_t,
+                                                     msg_annotation_channel_limits_t,
                                                      msg_capture_configuration_t,
                                                      msg_capture_ready_t,
                                                      msg_apc_frame_data_t,
@@ -141,5 +229,9 @@ namespace ipc {
                                                      msg_cpu_state_change_t,
                                                      msg_capture_failed_t,
                                                      msg_capture_started_t,
+                                                     msg_perf_data_raw_t,
+                                                     msg_perf_agent_stats_t,
+                                                     msg_flight_recorder_trigger_t,
+                                                     msg_capture_reconfiguration_t,
                                                      std::monostate>;
 }
@@ -8,13 +8,26 @@
 #include "ipc/codec.h"
 #include "ipc/message_key.h"
 #include "ipc/message_traits.h"
+#include "ipc/messages.h"
 #include "ipc/responses.h"
+#include "ipc/shared_frame_ring.h"
 #include "lib/Assert.h"
 #include "lib/AutoClosingFd.h"
+#include "lib/Probe.h"
+#include "lib/Span.h"
 
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <deque>
+#include <memory>
+#include <new>
+#include <optional>
 #include <type_traits>
+#include <vector>
 
+#include <boost/asio/bind_executor.hpp>
 #include <boost/asio/buffer.hpp>
 #include <boost/asio/dispatch.hpp>
 #include <boost/asio/error.hpp>
@@ -22,12 +35,21 @@
 #include <boost/asio/io_context_strand.hpp>
 #include <boost/asio/posix/stream_descriptor.hpp>
 #include <boost/asio/post.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <boost/asio/write.hpp>
 #include <boost/system/error_code.hpp>
 
 namespace ipc {
     /**
      * The raw write end of an IPC channel
+     *
+     * When given a shared_frame_ring_t (in an agent), the apc_frame messages are written to the ring rather than the
+     * pipe, and every other message is preceded by a pipe_message record in the ring.
+     *
+     * The apc_frame data waiting in the send queue is limited: once it is full, each further apc_frame is dropped
+     * (and its handler is called as though it were sent), until the queue drains. Every other message is always
+     * queued, as the shell cannot do without them, but their senders wait for each to be sent before sending the
+     * next (as do the annotation workers before reading more from their socket), so they are held back instead.
      */
     class raw_ipc_channel_sink_t : public std::enable_shared_from_this<raw_ipc_channel_sink_t> {
     public:
@@ -35,11 +57,38 @@ namespace ipc {
         using stored_message_continuation_t =
             async::continuations::raw_stored_continuation_t<R, E, boost::system::error_code, M>;
 
+        /** How long to wait before trying again to write to the shared ring when it is full */
+        static constexpr std::chrono::microseconds shared_ring_retry_period {200};
+        /** The most apc_frame data that is queued, until set_max_queued_frame_bytes is called */
+        static constexpr std::size_t default_max_queued_frame_bytes = 4 * 1024 * 1024;
+
         /** Factory method */
         static std::shared_ptr<raw_ipc_channel_sink_t> create(boost::asio::io_context & io_context,
-                                                              lib::AutoClosingFd && out)
+                                                              lib::AutoClosingFd && out,
+                                                              std::shared_ptr<shared_frame_ring_t> ring = {})
         {
-            return std::make_shared<raw_ipc_channel_sink_t>(raw_ipc_channel_sink_t {io_context, std::move(out)});
+            // NOLINTNEXTLINE(cppcoreguidelines-owning-memory) - not movable (the queue depth is atomic) so make_shared cannot be used
+            return std::shared_ptr<raw_ipc_channel_sink_t> {
+                new raw_ipc_channel_sink_t {io_context, std::move(out), std::move(ring)}};
+        }
+
+        /** @return The number of messages waiting in the send queue; may be called from any thread */
+        [[nodiscard]] std::size_t queue_depth() const { return send_queue_depth.load(std::memory_order_relaxed); }
+
+        /** @return The number of apc_frame messages dropped as the queue was full; may be called from any thread */
+        [[nodiscard]] std::uint64_t dropped_frames() const
+        {
+            return dropped_frame_count.load(std::memory_order_relaxed);
+        }
+
+        /**
+         * Limit the apc_frame data waiting in the send queue; may be called from any thread
+         *
+         * @param bytes The limit, or 0 for none
+         */
+        void set_max_queued_frame_bytes(std::size_t bytes)
+        {
+            max_queued_frame_bytes.store(bytes, std::memory_order_relaxed);
         }
 
         /**
@@ -79,16 +128,123 @@ namespace ipc {
         }
 
     private:
+        /** The largest number of messages that are coalesced into a single write */
+        static constexpr std::size_t max_batch_size = 64;
+
         /** Type erasing base class for queue items allowing any type of message or handler to be supported */
         class message_queue_item_base_t {
         public:
             virtual ~message_queue_item_base_t() noexcept = default;
             [[nodiscard]] virtual std::size_t expected_size() const = 0;
-            virtual void do_send(raw_ipc_channel_sink_t & parent,
-                                 std::shared_ptr<message_queue_item_base_t> shared_this) = 0;
+            /** @return The frame data, if the message is an apc_frame that may be sent via the shared ring */
+            [[nodiscard]] virtual std::optional<lib::Span<char const>> apc_frame_data() const = 0;
+            /** Append the buffers that make up the encoded message */
+            virtual void fill_buffers(std::vector<boost::asio::const_buffer> & buffers) const = 0;
             virtual void call_handler(boost::asio::io_context & context, boost::system::error_code const & ec) = 0;
         };
 
+        /**
+         * Recycles the storage of the queue items, so that sending a small message does not normally allocate.
+         * Only used from the strand.
+         */
+        class message_queue_item_pool_t {
+        public:
+            /** Items that are larger than this are allocated individually */
+            static constexpr std::size_t block_size = 256;
+            /** The most blocks that are kept for reuse */
+            static constexpr std::size_t max_free_blocks = 256;
+
+            /** Returns the item's storage to the pool once it is destroyed */
+            class deleter_t {
+            public:
+                constexpr deleter_t() noexcept : pool(nullptr), storage(nullptr) {}
+                constexpr deleter_t(message_queue_item_pool_t * pool, void * storage) noexcept
+                    : pool(pool), storage(storage)
+                {
+                }
+
+                void operator()(message_queue_item_base_t * item) const
+                {
+                    std::destroy_at(item);
+                    if (pool != nullptr) {
+                        pool->release(storage);
+                    }
+                    else {
+                        ::operator delete(storage);
+                    }
+                }
+
+            private:
+                message_queue_item_pool_t * pool;
+                void * storage;
+            };
+
+            using item_ptr_t = std::unique_ptr<message_queue_item_base_t, deleter_t>;
+
+            message_queue_item_pool_t() = default;
+            message_queue_item_pool_t(message_queue_item_pool_t const &) = delete;
+            message_queue_item_pool_t & operator=(message_queue_item_pool_t const &) = delete;
+            message_queue_item_pool_t(message_queue_item_pool_t &&) = delete;
+            message_queue_item_pool_t & operator=(message_queue_item_pool_t &&) = delete;
+
+            ~message_queue_item_pool_t() noexcept
+            {
+                for (void * block : free_blocks) {
+                    ::operator delete(block);
+                }
+            }
+
+            /** Construct a new item of type T in some pooled (or, if too large, newly allocated) storage */
+            template<typename T, typename... Args>
+            [[nodiscard]] item_ptr_t make(Args &&... args)
+            {
+                static_assert(alignof(T) <= alignof(std::max_align_t));
+
+                constexpr bool pooled = (sizeof(T) <= block_size);
+
+                void * storage = (pooled ? acquire() : ::operator new(sizeof(T)));
+                try {
+                    auto * item = new (storage) T(std::forward<Args>(args)...);
+                    return {item, deleter_t {(pooled ? this : nullptr), storage}};
+                }
+                catch (...) {
+                    if (pooled) {
+                        release(storage);
+                    }
+                    else {
+                        ::operator delete(storage);
+                    }
+                    throw;
+                }
+            }
+
+        private:
+            std::vector<void *> free_blocks {};
+
+            [[nodiscard]] void * acquire()
+            {
+                if (free_blocks.empty()) {
+                    return ::operator new(block_size);
+                }
+
+                void * block = free_blocks.back();
+                free_blocks.pop_back();
+                return block;
+            }
+
+            void release(void * block)
+            {
+                if (free_blocks.size() >= max_free_blocks) {
+                    ::operator delete(block);
+                }
+                else {
+                    free_blocks.push_back(block);
+                }
+            }
+        };
+
+        using queue_item_ptr_t = message_queue_item_pool_t::item_ptr_t;
+
         /** Default message queue item type, copies the message into a buffer object held in the queue item */
         template<typename MessageType, typename R, typename E>
         class message_queue_item_t : public message_queue_item_base_t {
@@ -113,29 +269,32 @@ namespace ipc {
                      + suffix_codec_type::suffix_write_size(sg_helper);
             }
 
-            void do_send(raw_ipc_channel_sink_t & parent,
-                         std::shared_ptr<message_queue_item_base_t> shared_this) override
+            [[nodiscard]] std::optional<lib::Span<char const>> apc_frame_data() const override
             {
-                using sg_buffer_type =
-                    std::array<boost::asio::const_buffer,
-                               key_codec_type::sg_writer_buffers_count + header_codec_type::sg_writer_buffers_count
-                                   + suffix_codec_type::sg_writer_buffers_count>;
+                if constexpr (std::is_same_v<message_type, msg_apc_frame_data_t>
+                              || std::is_same_v<message_type, msg_apc_frame_data_from_span_t>) {
+                    return lib::Span<char const> {message.suffix};
+                }
+                else {
+                    return {};
+                }
+            }
+
+            void fill_buffers(std::vector<boost::asio::const_buffer> & buffers) const override
+            {
+                constexpr std::size_t n_key_buffers = key_codec_type::sg_writer_buffers_count;
+                constexpr std::size_t n_header_buffers = header_codec_type::sg_writer_buffers_count;
+                constexpr std::size_t n_suffix_buffers = suffix_codec_type::sg_writer_buffers_count;
 
                 // fill the scatter gather buffer list
-                sg_buffer_type buffers {};
-                lib::Span<boost::asio::const_buffer> buffers_span {buffers};
-
-                key_codec_type::fill_sg_buffer(buffers_span.subspan(0, key_codec_type::sg_writer_buffers_count),
-                                               message_type::key);
-                header_codec_type::fill_sg_buffer(buffers_span.subspan(key_codec_type::sg_writer_buffers_count,
-                                                                       header_codec_type::sg_writer_buffers_count),
-                                                  message);
-                suffix_codec_type::fill_sg_buffer(buffers_span.subspan(key_codec_type::sg_writer_buffers_count
-                                                                       + header_codec_type::sg_writer_buffers_count),
-                                                  sg_helper);
-
-                // pass it  to the parent for sending
-                parent.do_send_item(std::move(shared_this), std::move(buffers));
+                auto const offset = buffers.size();
+                buffers.resize(offset + n_key_buffers + n_header_buffers + n_suffix_buffers);
+                lib::Span<boost::asio::const_buffer> buffers_span {buffers.data() + offset,
+                                                                   buffers.size() - offset};
+
+                key_codec_type::fill_sg_buffer(buffers_span.subspan(0, n_key_buffers), message_type::key);
+                header_codec_type::fill_sg_buffer(buffers_span.subspan(n_key_buffers, n_header_buffers), message);
+                suffix_codec_type::fill_sg_buffer(buffers_span.subspan(n_key_buffers + n_header_buffers), sg_helper);
             }
 
             void call_handler(boost::asio::io_context & context, boost::system::error_code const & ec) override
@@ -149,18 +308,31 @@ namespace ipc {
             stored_continuation_t sc;
         };
 
-        // so it can call do_send_item
-        template<typename MessageType, typename R, typename E>
-        friend class message_queue_item_t;
-
         boost::asio::io_context::strand strand;
         boost::asio::posix::stream_descriptor out;
-        std::deque<std::shared_ptr<message_queue_item_base_t>> send_queue {};
+        std::shared_ptr<shared_frame_ring_t> ring;
+        boost::asio::steady_timer ring_retry_timer;
+        // must outlive every item, so is declared before anything that holds them
+        message_queue_item_pool_t queue_item_pool {};
+        std::deque<queue_item_ptr_t> send_queue {};
+        // the item waiting for space in the shared ring
+        queue_item_ptr_t ring_retry_item {};
+        // the items that are being written to the pipe, and their buffers
+        std::vector<queue_item_ptr_t> send_batch {};
+        std::vector<boost::asio::const_buffer> send_batch_buffers {};
         bool consume_in_progress = false;
+        // a copy of send_queue.size() that can be read from off the strand
+        std::atomic_size_t send_queue_depth {0};
+        // the size of the apc_frame data in send_queue
+        std::size_t queued_frame_bytes = 0;
+        std::atomic_size_t max_queued_frame_bytes {default_max_queued_frame_bytes};
+        std::atomic_uint64_t dropped_frame_count {0};
 
         /** Constructor is hidden to force the use of the factory method since the class is enable_shared_from_this */
-        raw_ipc_channel_sink_t(boost::asio::io_context & io_context, lib::AutoClosingFd && out)
-            : strand(io_context), out(io_context, out.release())
+        raw_ipc_channel_sink_t(boost::asio::io_context & io_context,
+                               lib::AutoClosingFd && out,
+                               std::shared_ptr<shared_frame_ring_t> ring)
+            : strand(io_context), out(io_context, out.release()), ring(std::move(ring)), ring_retry_timer(io_context)
         {
         }
 
@@ -173,19 +345,22 @@ namespace ipc {
             using queue_item_t = message_queue_item_t<message_type, R, E>;
 
             LOG_TRACE("(%p) New send request received with key %zu", this, std::size_t(message_type::key));
+            GATOR_PROBE1(ipc_enqueue, std::size_t(message_type::key));
 
-            // run on the strand to serialize access to the queue
+            // run on the strand to serialize access to the queue (and the pool)
             boost::asio::post(strand,
                               [st = shared_from_this(),
-                               queue_item = std::make_shared<queue_item_t>(std::forward<MessageType>(message),
-                                                                           std::move(sc))]() mutable {
-                                  st->strand_do_async_send_message(message_type::key, std::move(queue_item));
+                               message = std::forward<MessageType>(message),
+                               sc = std::move(sc)]() mutable {
+                                  st->strand_do_async_send_message(
+                                      message_type::key,
+                                      st->queue_item_pool.make<queue_item_t>(std::move(message), std::move(sc)));
                               });
         }
 
         /** Insert the message and handler into the send queue */
         template<typename MessageType>
-        void strand_do_async_send_message(MessageType key, std::shared_ptr<message_queue_item_base_t> queue_item)
+        void strand_do_async_send_message(MessageType key, queue_item_ptr_t queue_item)
         {
             // fast path for case that queue is already empty and consumer is waiting
             const auto cip = is_consume_in_progress();
@@ -200,12 +375,54 @@ namespace ipc {
                       send_queue.empty(),
                       cip);
 
+            // at least one frame is always let in, so that a frame larger than the limit is not always dropped
+            auto const frame_data = queue_item->apc_frame_data();
+            if (frame_data) {
+                auto const limit = max_queued_frame_bytes.load(std::memory_order_relaxed);
+                if ((limit > 0) && (queued_frame_bytes > 0) && (queued_frame_bytes + frame_data->size() > limit)) {
+                    return strand_do_drop_item(std::move(queue_item));
+                }
+                queued_frame_bytes += frame_data->size();
+            }
+
             // stick it in the queue, the consumer will pick it up when its ready
             send_queue.emplace_back(std::move(queue_item));
+            send_queue_depth.store(send_queue.size(), std::memory_order_relaxed);
+        }
+
+        /** Drop an apc_frame that does not fit in the queue */
+        void strand_do_drop_item(queue_item_ptr_t && queue_item)
+        {
+            // NB: must already be on the strand
+
+            if (dropped_frame_count.fetch_add(1, std::memory_order_relaxed) == 0) {
+                LOG_WARNING("The IPC send queue is full (%zu bytes of frames); capture data is being dropped",
+                            queued_frame_bytes);
+            }
+
+            // the sender carries on as though the frame was sent
+            queue_item->call_handler(strand.context(), {});
+        }
+
+        /** Remove the head of the send queue */
+        [[nodiscard]] queue_item_ptr_t strand_pop_front()
+        {
+            // NB: must already be on the strand
+
+            auto item = std::move(send_queue.front());
+            send_queue.pop_front();
+            send_queue_depth.store(send_queue.size(), std::memory_order_relaxed);
+
+            auto const frame_data = item->apc_frame_data();
+            if (frame_data) {
+                queued_frame_bytes -= frame_data->size();
+            }
+
+            return item;
         }
 
         /** Consume data from the buffer and write to stream */
-        void strand_do_consume_item(std::shared_ptr<message_queue_item_base_t> && queue_item)
+        void strand_do_consume_item(queue_item_ptr_t && queue_item)
         {
             // NB: must already be on the strand
             runtime_assert(queue_item != nullptr, "Invalid queue item");
@@ -220,56 +437,139 @@ namespace ipc {
 
             runtime_assert(!cip, "Invalid state");
 
-            // call the do_send method, which will then invoke the do_send_item with one or more buffers to actually send
-            queue_item->do_send(*this, queue_item);
+            if (ring) {
+                return strand_do_consume_item_via_ring(std::move(queue_item));
+            }
+
+            strand_do_send_batch(std::move(queue_item));
+        }
+
+        /** @return True if the item is written to the shared ring (rather than being sent via the pipe) */
+        [[nodiscard]] bool is_sent_via_ring(message_queue_item_base_t const & queue_item) const
+        {
+            auto const frame_data = queue_item.apc_frame_data();
+            return (frame_data && (frame_data->size() <= ring->max_payload_size()));
+        }
+
+        /** Write the frame to the shared ring, or write the record that says the message is sent via the pipe */
+        void strand_do_consume_item_via_ring(queue_item_ptr_t && queue_item)
+        {
+            // NB: must already be on the strand
+
+            auto const in_ring = is_sent_via_ring(*queue_item);
+
+            if (!ring->try_write(in_ring ? shared_frame_ring_t::record_kind_t::apc_frame
+                                         : shared_frame_ring_t::record_kind_t::pipe_message,
+                                 in_ring ? *queue_item->apc_frame_data() : lib::Span<char const> {})) {
+                LOG_TRACE("(%p) Shared ring is full, retrying queue item %p", this, queue_item.get());
+
+                // wait for the shell to make space
+                ring_retry_item = std::move(queue_item);
+                ring_retry_timer.expires_after(shared_ring_retry_period);
+                return ring_retry_timer.async_wait(
+                    boost::asio::bind_executor(strand, [st = shared_from_this()](auto const & /*ec*/) mutable {
+                        st->strand_do_consume_item_via_ring(std::move(st->ring_retry_item));
+                    }));
+            }
+
+            if (!in_ring) {
+                return strand_do_send_batch(std::move(queue_item));
+            }
+
+            LOG_TRACE("(%p) Wrote queue item %p to the shared ring", this, queue_item.get());
+
+            // notify the handler (which happens asynchronously)
+            queue_item->call_handler(strand.context(), {});
+            queue_item.reset();
+
+            // consume the next item (but from the stand as it will modify state)
+            return boost::asio::post(strand, [st = shared_from_this()]() { st->strand_do_consume_next(); });
         }
 
-        /** Called by the message queue item to send the actual data */
-        template<std::size_t N>
-        void do_send_item(std::shared_ptr<message_queue_item_base_t> && queue_item,
-                          std::array<boost::asio::const_buffer, N> buffers)
+        /**
+         * Send the item via the pipe, along with as many of the following queued items as can be sent the same way, so
+         * that a burst of small messages is written with a single gather write.
+         */
+        void strand_do_send_batch(queue_item_ptr_t && queue_item)
         {
             // NB: must already be on the strand
 
-            LOG_TRACE("(%p) Sending queue item %p (n_buffers=%zu)", this, queue_item.get(), N);
+            send_batch.emplace_back(std::move(queue_item));
+
+            while ((!send_queue.empty()) && (send_batch.size() < max_batch_size)) {
+                auto & next_item = send_queue.front();
+
+                // the ring records must be in the same order as the messages, so stop at anything for the ring, or
+                // when there is no space for the record
+                if (ring
+                    && (is_sent_via_ring(*next_item)
+                        || !ring->try_write(shared_frame_ring_t::record_kind_t::pipe_message, {}))) {
+                    break;
+                }
+
+                send_batch.emplace_back(strand_pop_front());
+            }
+
+            // fill the scatter gather buffer list
+            std::size_t expected_size = 0;
+            send_batch_buffers.clear();
+            for (auto const & item : send_batch) {
+                expected_size += item->expected_size();
+                item->fill_buffers(send_batch_buffers);
+            }
+
+            LOG_TRACE("(%p) Sending %zu queue items (n_buffers=%zu)",
+                      this,
+                      send_batch.size(),
+                      send_batch_buffers.size());
 
             // perform the actual write
+            GATOR_PROBE2(ipc_write_start, send_batch.size(), expected_size);
             boost::asio::async_write(out,
-                                     buffers,
-                                     [st = shared_from_this(), queue_item = std::move(queue_item)](
-                                         boost::system::error_code const & ec,
-                                         std::size_t n) mutable { st->on_sent_result(queue_item, ec, n); });
+                                     send_batch_buffers,
+                                     boost::asio::bind_executor(strand,
+                                                                [st = shared_from_this(), expected_size](
+                                                                    boost::system::error_code const & ec,
+                                                                    std::size_t n) mutable {
+                                                                    st->on_sent_result(expected_size, ec, n);
+                                                                }));
         }
 
         /** Handle the send result */
-        void on_sent_result(std::shared_ptr<message_queue_item_base_t> const & queue_item,
-                            boost::system::error_code const & ec,
-                            std::size_t n)
+        void on_sent_result(std::size_t expected_size, boost::system::error_code const & ec, std::size_t n)
         {
+            // NB: must already be on the strand
+            GATOR_PROBE2(ipc_write_complete, send_batch.size(), n);
+
+            auto result = ec;
+
             //  error
             if (ec) {
-                LOG_DEBUG("(%p) Sending queue item %p failed with error=%s",
+                LOG_DEBUG("(%p) Sending %zu queue items failed with error=%s",
                           this,
-                          queue_item.get(),
+                          send_batch.size(),
                           ec.message().c_str());
-                // notify the handler (which happens asynchronously)
-                return queue_item->call_handler(strand.context(), ec);
             }
-
             //  short write error
-            if (n != queue_item->expected_size()) {
-                LOG_DEBUG("(%p) Sending queue item %p failed with short write %zu", this, queue_item.get(), n);
-                // notify the handler (which happens asynchronously)
-                return queue_item->call_handler(
-                    strand.context(),
-                    boost::asio::error::make_error_code(boost::asio::error::misc_errors::eof));
+            else if (n != expected_size) {
+                LOG_DEBUG("(%p) Sending %zu queue items failed with short write %zu", this, send_batch.size(), n);
+                result = boost::asio::error::make_error_code(boost::asio::error::misc_errors::eof);
             }
 
-            // notify the handler (which happens asynchronously)
-            queue_item->call_handler(strand.context(), {});
+            // notify the handlers (which happens asynchronously)
+            for (auto & item : send_batch) {
+                item->call_handler(strand.context(), result);
+            }
+            send_batch.clear();
+            send_batch_buffers.clear();
 
-            // consume the next item (but from the stand as it will modify state)
-            return boost::asio::post(strand, [st = shared_from_this()]() { st->strand_do_consume_next(); });
+            // the sink is no longer usable after an error
+            if (result) {
+                return;
+            }
+
+            // consume the next item
+            strand_do_consume_next();
         }
 
         /** Consume the next item (running on the strand) */
@@ -287,12 +587,8 @@ namespace ipc {
                 return;
             }
 
-            // remove the head of the senq queue
-            auto next_item = std::move(send_queue.front());
-            send_queue.pop_front();
-
-            // and send it
-            return strand_do_consume_item(std::move(next_item));
+            // remove the head of the senq queue, and send it
+            return strand_do_consume_item(strand_pop_front());
         }
 
         /** Check if consume in progress */
@@ -7,9 +7,11 @@
 #include "async/continuations/stored_continuation.h"
 #include "async/continuations/use_continuation.h"
 #include "ipc/codec.h"
+#include "ipc/frame_buffer_pool.h"
 #include "ipc/message_key.h"
 #include "ipc/message_traits.h"
 #include "ipc/messages.h"
+#include "ipc/shared_frame_ring.h"
 #include "lib/Assert.h"
 #include "lib/AutoClosingFd.h"
 
@@ -19,7 +21,9 @@
 #include <tuple>
 #include <utility>
 #include <variant>
+#include <vector>
 
+#include <boost/asio/bind_executor.hpp>
 #include <boost/asio/buffer.hpp>
 #include <boost/asio/dispatch.hpp>
 #include <boost/asio/error.hpp>
@@ -32,6 +36,8 @@
 #include <boost/system/error_code.hpp>
 #include <boost/system/system_category.hpp>
 
+#include <fcntl.h>
+
 namespace ipc {
 
     namespace detail {
@@ -123,6 +129,30 @@ namespace ipc {
             return std::make_shared<raw_ipc_channel_source_t>(raw_ipc_channel_source_t {io_context, std::move(in)});
         }
 
+        /**
+         * Factory method for the channel from an agent that was offered the shared ring (see
+         * shared_frame_ring_t::send_offer). The agent's reply is read before the first message, and if it attached to
+         * the ring then the messages are read in the order given by the ring.
+         *
+         * As the agent sends most of its data as msg_apc_frame_data_t, their suffixes are taken from a pool of buffers,
+         * to which the consumer should return them with release_frame_buffer once it is done with them.
+         *
+         * @param ring The ring that was offered, or nullptr if there was none
+         */
+        static std::shared_ptr<raw_ipc_channel_source_t> create_for_agent(boost::asio::io_context & io_context,
+                                                                          lib::AutoClosingFd && in,
+                                                                          std::shared_ptr<shared_frame_ring_t> ring)
+        {
+            auto result = create(io_context, std::move(in));
+            result->expects_preamble = true;
+            result->frame_buffer_pool = std::make_shared<frame_buffer_pool_t>();
+            if (ring) {
+                result->doorbell.emplace(io_context, ::fcntl(ring->doorbell_fd(), F_DUPFD_CLOEXEC, 0));
+                result->ring = std::move(ring);
+            }
+            return result;
+        }
+
         /** Receive the next message */
         template<typename CompletionToken>
         auto async_recv_message(CompletionToken && token)
@@ -136,6 +166,17 @@ namespace ipc {
                 std::forward<CompletionToken>(token));
         }
 
+        /**
+         * Return the suffix of some msg_apc_frame_data_t that was received, so that it may be reused for a later one.
+         * May be called from any thread.
+         */
+        void release_frame_buffer(std::vector<char> && buffer)
+        {
+            if (frame_buffer_pool) {
+                frame_buffer_pool->release(std::move(buffer));
+            }
+        }
+
     private:
         using message_types_trait_finder_type =
             typename detail::message_types_trait_finder_for_t<all_message_types_variant_t>::type;
@@ -153,8 +194,14 @@ namespace ipc {
 
         boost::asio::io_context::strand strand;
         boost::asio::posix::stream_descriptor in;
+        std::shared_ptr<shared_frame_ring_t> ring {};
+        std::optional<boost::asio::posix::stream_descriptor> doorbell {};
+        std::shared_ptr<frame_buffer_pool_t> frame_buffer_pool {};
         message_key_t message_key_buffer = message_key_t::unknown;
+        char preamble_buffer = 0;
         bool recv_in_progress = false;
+        bool expects_preamble = false;
+        bool ring_in_use = false;
 
         /** Constructor is hidden to force the use of the factory method since the class is enable_shared_from_this */
         raw_ipc_channel_source_t(boost::asio::io_context & io_context, lib::AutoClosingFd && in)
@@ -182,8 +229,6 @@ namespace ipc {
             async::continuations::
                 raw_stored_continuation_t<R, E, boost::system::error_code, all_message_types_variant_t> && sc)
         {
-            using unknown_message = message_t<message_key_t::unknown, void, void>;
-            using key_codec_type = key_codec_t<unknown_message>;
             using sc_wrapper_type = sc_wrapper_t<R, E>;
 
             // should not already be pending...
@@ -196,13 +241,158 @@ namespace ipc {
                                            {});
             }
 
+            auto scw = sc_wrapper_type(std::move(sc));
+
+            if (expects_preamble) {
+                return do_recv_preamble(std::move(scw));
+            }
+
+            return do_recv_next(std::move(scw));
+        }
+
+        /** Read the agent's reply to the offer of the shared ring */
+        template<typename R, typename E>
+        void do_recv_preamble(sc_wrapper_t<R, E> && scw)
+        {
+            LOG_TRACE("(%p) Reading preamble from stream", this);
+
+            boost::asio::async_read(
+                in,
+                boost::asio::buffer(&preamble_buffer, sizeof(preamble_buffer)),
+                boost::asio::bind_executor(strand, [st = shared_from_this(), scw = std::move(scw)](auto ec,
+                                                                                                 auto n) mutable {
+                    if (ec) {
+                        LOG_TRACE("(%p) Reading preamble failed with error=%s", st.get(), ec.message().c_str());
+                        return st->invoke_handler(std::move(scw), ec, {});
+                    }
+
+                    if ((n != sizeof(st->preamble_buffer))
+                        || ((st->preamble_buffer != shared_frame_ring_t::preamble_attached)
+                            && (st->preamble_buffer != shared_frame_ring_t::preamble_declined))) {
+                        LOG_TRACE("(%p) Reading preamble failed due to invalid preamble", st.get());
+                        return st->invoke_handler(
+                            std::move(scw),
+                            boost::asio::error::make_error_code(boost::asio::error::misc_errors::eof),
+                            {});
+                    }
+
+                    st->expects_preamble = false;
+                    st->ring_in_use = (st->ring && (st->preamble_buffer == shared_frame_ring_t::preamble_attached));
+
+                    LOG_DEBUG("(%p) Agent %s the shared ring",
+                              st.get(),
+                              (st->ring_in_use ? "attached to" : "declined"));
+
+                    return st->do_recv_next(std::move(scw));
+                }));
+        }
+
+        /** Receive the next message, from the ring if the ring is in use, otherwise from the stream */
+        template<typename R, typename E>
+        void do_recv_next(sc_wrapper_t<R, E> && scw)
+        {
+            if (!ring_in_use) {
+                return do_recv_key(std::move(scw));
+            }
+
+            auto record = ring->peek();
+
+            if (!record) {
+                if (ring->is_corrupt()) {
+                    using namespace boost::system;
+                    return invoke_handler(std::move(scw), errc::make_error_code(errc::bad_message), {});
+                }
+
+                // nothing yet, so wait for the doorbell (unless something arrived in the meantime)
+                if (!ring->prepare_to_wait()) {
+                    return do_recv_next(std::move(scw));
+                }
+                return do_wait_for_ring(std::move(scw));
+            }
+
+            if (record->kind == shared_frame_ring_t::record_kind_t::pipe_message) {
+                ring->consume(*record);
+                return do_recv_key(std::move(scw));
+            }
+
+            LOG_TRACE("(%p) Read frame of length %zu from the shared ring", this, record->payload.size());
+
+            msg_apc_frame_data_t message {acquire_frame_buffer(record->payload.size())};
+            message.suffix.assign(record->payload.begin(), record->payload.end());
+            ring->consume(*record);
+
+            return invoke_handler(std::move(scw), {}, std::move(message));
+        }
+
+        /**
+         * Wait for the doorbell, or for the stream to become readable. The agent always writes to the ring before the
+         * stream, so if the stream becomes readable and there is still nothing in the ring then it was closed.
+         */
+        template<typename R, typename E>
+        void do_wait_for_ring(sc_wrapper_t<R, E> && scw)
+        {
+            LOG_TRACE("(%p) Waiting for the shared ring", this);
+
+            // whichever completes first takes the handler and cancels the other
+            auto shared_scw = std::make_shared<std::optional<sc_wrapper_t<R, E>>>(std::move(scw));
+
+            doorbell->async_wait(boost::asio::posix::stream_descriptor::wait_read,
+                                 boost::asio::bind_executor(strand,
+                                                            [st = shared_from_this(), shared_scw](auto const & ec) {
+                                                                st->on_ring_wake(*shared_scw, false, ec);
+                                                            }));
+            in.async_wait(boost::asio::posix::stream_descriptor::wait_read,
+                          boost::asio::bind_executor(strand, [st = shared_from_this(), shared_scw](auto const & ec) {
+                              st->on_ring_wake(*shared_scw, true, ec);
+                          }));
+        }
+
+        /** Woken by the doorbell or by the stream becoming readable */
+        template<typename R, typename E>
+        void on_ring_wake(std::optional<sc_wrapper_t<R, E>> & optional_scw,
+                          bool stream_is_readable,
+                          boost::system::error_code const & ec)
+        {
+            // the other already completed
+            if (!optional_scw.has_value()) {
+                return;
+            }
+
+            auto scw = std::move(*optional_scw);
+            optional_scw.reset();
+
+            boost::system::error_code ignored {};
+            doorbell->cancel(ignored);
+            in.cancel(ignored);
+            ring->finish_wait();
+
+            if (ec) {
+                LOG_TRACE("(%p) Waiting for the shared ring failed with error=%s", this, ec.message().c_str());
+                return invoke_handler(std::move(scw), ec, {});
+            }
+
+            // the stream was closed, so read it to get the error
+            if (stream_is_readable && !ring->peek() && !ring->is_corrupt()) {
+                return do_recv_key(std::move(scw));
+            }
+
+            return do_recv_next(std::move(scw));
+        }
+
+        /** Read the next key from the stream */
+        template<typename R, typename E>
+        void do_recv_key(sc_wrapper_t<R, E> && scw)
+        {
+            using unknown_message = message_t<message_key_t::unknown, void, void>;
+            using key_codec_type = key_codec_t<unknown_message>;
+
             LOG_TRACE("(%p) Reading next key from stream", this);
 
             // read the key
             boost::asio::async_read(
                 in,
                 key_codec_type::mutable_buffer(message_key_buffer),
-                [st = shared_from_this(), scw = sc_wrapper_type(std::move(sc))](auto ec, auto n) mutable {
+                [st = shared_from_this(), scw = std::move(scw)](auto ec, auto n) mutable {
                     // validate error
                     if (ec) {
                         LOG_TRACE("(%p) Reading next key failed with error=%s", st.get(), ec.message().c_str());
@@ -365,6 +555,11 @@ namespace ipc {
 
             static_assert(std::is_same_v<WrapperType, wrapper_type>);
 
+            // read the apc frame data straight into a pooled buffer
+            if constexpr (std::is_same_v<message_type, msg_apc_frame_data_t>) {
+                message_wrapper->message.suffix = acquire_frame_buffer(message_wrapper->buffer.length);
+            }
+
             auto buffer = suffix_codec_type::mutable_suffix_buffer(message_wrapper->message, message_wrapper->buffer);
 
             // skip reading the length if it is zero length
@@ -446,6 +641,18 @@ namespace ipc {
             return invoke_handler(std::move(scw), ec, std::move(message_wrapper->message));
         }
 
+        /** Get an empty buffer for the suffix of some msg_apc_frame_data_t, from the pool if there is one */
+        [[nodiscard]] std::vector<char> acquire_frame_buffer(std::size_t length)
+        {
+            if (frame_buffer_pool) {
+                return frame_buffer_pool->acquire(length);
+            }
+
+            std::vector<char> result {};
+            result.reserve(length);
+            return result;
+        }
+
         /** Invoke the handler */
         template<typename R, typename E>
         void invoke_handler(sc_wrapper_t<R, E> && scw,
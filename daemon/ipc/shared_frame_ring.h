@@ -0,0 +1,429 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#pragma once
+
+#include "Logging.h"
+#include "lib/AutoClosingFd.h"
+#include "lib/Span.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace ipc {
+    /**
+     * The header of the shared ring, the buffer itself follows the header and fills the rest of the mapping.
+     */
+    struct shared_frame_ring_header_t {
+        /** Written by the agent once the records before it are complete */
+        alignas(64) std::atomic<std::uint64_t> write_pos;
+        /** Written by the shell once the records before it have been consumed */
+        alignas(64) std::atomic<std::uint64_t> read_pos;
+        /** Set by the shell before it waits for the doorbell, cleared by whichever side sees it first */
+        alignas(64) std::atomic<std::uint32_t> reader_waiting;
+    };
+
+    static_assert(std::atomic<std::uint64_t>::is_always_lock_free);
+    static_assert(std::atomic<std::uint32_t>::is_always_lock_free);
+    static_assert(sizeof(shared_frame_ring_header_t) == 192);
+
+    /**
+     * A single producer, single consumer, ring of records shared between an agent (the producer) and the shell (the
+     * consumer), with an eventfd as the doorbell that wakes the shell when it is waiting for a record.
+     *
+     * It carries the msg_apc_frame_data_t messages from the agent, so that the frame data is copied once into the
+     * ring and once out of it, rather than being written into and read out of a pipe. All other messages still use the
+     * pipe, but each is preceded in the ring by a pipe_message record, so that the ring gives the order of all the
+     * messages and the shell never reads a message from the pipe before the frames that were sent before it.
+     *
+     * Each record is an 8 byte header followed by the payload, padded to a multiple of 8 bytes. A record never wraps
+     * around the end of the buffer; if there is not enough space at the end then a padding record fills it and the
+     * record is written at the start.
+     */
+    class shared_frame_ring_t {
+    public:
+        /** The kind of each record */
+        enum class record_kind_t : std::uint32_t {
+            /** Fills the end of the buffer, and should be skipped */
+            padding = 0,
+            /** The payload is the suffix of a msg_apc_frame_data_t */
+            apc_frame = 1,
+            /** The next message should be read from the pipe; there is no payload */
+            pipe_message = 2,
+        };
+
+        /** A record read from the ring, valid until it is consumed */
+        struct record_t {
+            record_kind_t kind;
+            lib::Span<char const> payload;
+            std::uint64_t next_pos;
+        };
+
+        /** The byte sent by the shell (with the fds, if it has a ring) before any message, and the agent's replies */
+        static constexpr char preamble_offer = 'O';
+        static constexpr char preamble_attached = 'A';
+        static constexpr char preamble_declined = 'D';
+
+        /** The size of the buffer */
+        static constexpr std::size_t default_buffer_size = 4UL * 1024UL * 1024UL;
+
+        /**
+         * Create a new ring, in a memfd, along with its doorbell
+         *
+         * @return The ring, or nullptr if one could not be created (in which case only the pipe is used)
+         */
+        static std::shared_ptr<shared_frame_ring_t> create(std::size_t buffer_size = default_buffer_size)
+        {
+#if defined(__NR_memfd_create)
+            // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg)
+            lib::AutoClosingFd memfd {int(::syscall(__NR_memfd_create, "gatord-ipc-ring", 1 /* MFD_CLOEXEC */))};
+            if (!memfd) {
+                LOG_DEBUG("Unable to create a shared IPC ring (%d)", errno);
+                return {};
+            }
+
+            if (::ftruncate(memfd.get(), off_t(sizeof(shared_frame_ring_header_t) + buffer_size)) != 0) {
+                LOG_DEBUG("Unable to size the shared IPC ring (%d)", errno);
+                return {};
+            }
+
+            lib::AutoClosingFd doorbell {::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)};
+            if (!doorbell) {
+                LOG_DEBUG("Unable to create the shared IPC ring doorbell (%d)", errno);
+                return {};
+            }
+
+            return map(std::move(memfd), std::move(doorbell));
+#else
+            (void) buffer_size;
+            return {};
+#endif
+        }
+
+        /**
+         * Map some ring that was created by `create` (possibly in another process)
+         *
+         * @return The ring, or nullptr if it could not be mapped
+         */
+        static std::shared_ptr<shared_frame_ring_t> map(lib::AutoClosingFd && memfd, lib::AutoClosingFd && doorbell)
+        {
+            struct stat st {};
+            if (::fstat(memfd.get(), &st) != 0) {
+                return {};
+            }
+
+            // the buffer must be a power of two so the positions can wrap
+            auto const mapping_size = std::size_t(st.st_size);
+            auto const buffer_size = mapping_size - std::min(mapping_size, sizeof(shared_frame_ring_header_t));
+            if ((buffer_size < (2 * record_header_size)) || ((buffer_size & (buffer_size - 1)) != 0)) {
+                LOG_DEBUG("Shared IPC ring has an invalid size %zu", mapping_size);
+                return {};
+            }
+
+            void * const mapping = ::mmap(nullptr, mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd.get(), 0);
+            if (mapping == MAP_FAILED) {
+                LOG_DEBUG("Unable to map the shared IPC ring (%d)", errno);
+                return {};
+            }
+
+            // NOLINTNEXTLINE(cppcoreguidelines-owning-memory) - the constructor is private
+            return std::shared_ptr<shared_frame_ring_t> {new shared_frame_ring_t {std::move(memfd),
+                                                                                   std::move(doorbell),
+                                                                                   mapping,
+                                                                                   mapping_size,
+                                                                                   buffer_size}};
+        }
+
+        shared_frame_ring_t(shared_frame_ring_t const &) = delete;
+        shared_frame_ring_t & operator=(shared_frame_ring_t const &) = delete;
+        shared_frame_ring_t(shared_frame_ring_t &&) = delete;
+        shared_frame_ring_t & operator=(shared_frame_ring_t &&) = delete;
+
+        ~shared_frame_ring_t() noexcept { ::munmap(mapping, mapping_size); }
+
+        /** @return The fd of the doorbell */
+        [[nodiscard]] int doorbell_fd() const { return doorbell.get(); }
+
+        /** @return The largest payload that can be written to the ring; anything larger must use the pipe */
+        [[nodiscard]] std::size_t max_payload_size() const { return (buffer_size / 2) - record_header_size; }
+
+        /**
+         * Write a record (from the agent)
+         *
+         * @return False if there is not yet enough space, in which case nothing was written
+         */
+        [[nodiscard]] bool try_write(record_kind_t kind, lib::Span<char const> payload)
+        {
+            auto & header = get_header();
+
+            auto const record_size = padded_size(payload.size());
+            auto write_pos = header.write_pos.load(std::memory_order_relaxed);
+            auto const read_pos = header.read_pos.load(std::memory_order_acquire);
+
+            // pad the end of the buffer if the record does not fit there
+            auto const contiguous = buffer_size - (write_pos & (buffer_size - 1));
+            auto const padding = (contiguous < record_size ? contiguous : 0);
+
+            if ((padding + record_size) > (buffer_size - (write_pos - read_pos))) {
+                return false;
+            }
+
+            if (padding > 0) {
+                write_record_header(write_pos, record_kind_t::padding, padding - record_header_size);
+                write_pos += padding;
+            }
+
+            write_record_header(write_pos, kind, payload.size());
+            if (!payload.empty()) {
+                std::memcpy(buffer_at(write_pos + record_header_size), payload.data(), payload.size());
+            }
+
+            // publish it, then wake the shell if it is waiting (which must be seen in this order by the shell)
+            header.write_pos.store(write_pos + record_size, std::memory_order_seq_cst);
+            if (header.reader_waiting.exchange(0, std::memory_order_seq_cst) != 0) {
+                std::uint64_t const one = 1;
+                if (::write(doorbell.get(), &one, sizeof(one)) < 0) {
+                    LOG_DEBUG("Unable to ring the shared IPC ring doorbell (%d)", errno);
+                }
+            }
+
+            return true;
+        }
+
+        /**
+         * Read the next record (from the shell), skipping any padding
+         *
+         * @return The record, or nothing if the ring is empty or is_corrupt()
+         */
+        [[nodiscard]] std::optional<record_t> peek()
+        {
+            auto & header = get_header();
+
+            auto read_pos = header.read_pos.load(std::memory_order_relaxed);
+            auto const write_pos = header.write_pos.load(std::memory_order_acquire);
+
+            // the agent may be less trusted than the shell, so check everything it wrote
+            if ((write_pos - read_pos) > buffer_size) {
+                return on_corrupt();
+            }
+
+            while (read_pos != write_pos) {
+                std::array<std::uint32_t, 2> record_header {};
+                std::memcpy(record_header.data(), buffer_at(read_pos), record_header_size);
+
+                auto const kind = record_kind_t(record_header[0]);
+                auto const length = std::size_t(record_header[1]);
+                auto const record_size = padded_size(length);
+                auto const contiguous = buffer_size - (read_pos & (buffer_size - 1));
+
+                if ((record_size > (write_pos - read_pos)) || (record_size > contiguous)) {
+                    return on_corrupt();
+                }
+
+                if (kind != record_kind_t::padding) {
+                    if ((kind != record_kind_t::apc_frame) && (kind != record_kind_t::pipe_message)) {
+                        return on_corrupt();
+                    }
+                    return record_t {kind, {buffer_at(read_pos + record_header_size), length}, read_pos + record_size};
+                }
+
+                read_pos += record_size;
+                header.read_pos.store(read_pos, std::memory_order_release);
+            }
+
+            return {};
+        }
+
+        /** @return True if the shell found the ring to be corrupt, in which case no more records are returned */
+        [[nodiscard]] bool is_corrupt() const { return corrupt; }
+
+        /** Release the space used by some record returned by peek (from the shell) */
+        void consume(record_t const & record)
+        {
+            get_header().read_pos.store(record.next_pos, std::memory_order_release);
+        }
+
+        /**
+         * Tell the agent that the shell is about to wait for the doorbell (from the shell)
+         *
+         * @return False if a record arrived in the meantime, so there is no need to wait
+         */
+        [[nodiscard]] bool prepare_to_wait()
+        {
+            auto & header = get_header();
+
+            header.reader_waiting.store(1, std::memory_order_seq_cst);
+            if (header.write_pos.load(std::memory_order_seq_cst) != header.read_pos.load(std::memory_order_relaxed)) {
+                header.reader_waiting.store(0, std::memory_order_relaxed);
+                return false;
+            }
+            return true;
+        }
+
+        /** Reset the doorbell, once the shell has woken (from the shell) */
+        void finish_wait()
+        {
+            get_header().reader_waiting.store(0, std::memory_order_relaxed);
+
+            std::uint64_t count = 0;
+            while ((::read(doorbell.get(), &count, sizeof(count)) < 0) && (errno == EINTR)) {
+            }
+        }
+
+        /**
+         * Offer the ring to the agent, by sending the preamble and the ring's fds over the agent's stdin, which must be
+         * a socket. The preamble is sent without any fds if there is no ring.
+         *
+         * @return False if the preamble could not be sent
+         */
+        static bool send_offer(int socket_fd, shared_frame_ring_t const * ring)
+        {
+            char preamble = preamble_offer;
+            iovec iov {&preamble, sizeof(preamble)};
+
+            msghdr msg {};
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+
+            std::array<char, CMSG_SPACE(2 * sizeof(int))> control {};
+            if (ring != nullptr) {
+                std::array<int, 2> const fds {ring->memfd.get(), ring->doorbell.get()};
+
+                msg.msg_control = control.data();
+                msg.msg_controllen = control.size();
+
+                auto * cmsg = CMSG_FIRSTHDR(&msg);
+                cmsg->cmsg_level = SOL_SOCKET;
+                cmsg->cmsg_type = SCM_RIGHTS;
+                cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+                std::memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(fds));
+            }
+
+            while (::sendmsg(socket_fd, &msg, MSG_NOSIGNAL) < 0) {
+                if (errno != EINTR) {
+                    LOG_DEBUG("Unable to send the shared IPC ring offer (%d)", errno);
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        /**
+         * Receive the shell's preamble from stdin (in the agent), and map the ring if one was sent
+         *
+         * @return The ring, or nullptr if the shell did not send one or it could not be mapped
+         */
+        static std::shared_ptr<shared_frame_ring_t> receive_offer(int socket_fd)
+        {
+            char preamble = 0;
+            iovec iov {&preamble, sizeof(preamble)};
+            std::array<char, CMSG_SPACE(2 * sizeof(int))> control {};
+
+            msghdr msg {};
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control.data();
+            msg.msg_controllen = control.size();
+
+            ssize_t n_read;
+            while ((n_read = ::recvmsg(socket_fd, &msg, MSG_CMSG_CLOEXEC)) < 0) {
+                if (errno == ENOTSOCK) {
+                    // not spawned with a socket for stdin, so just read the preamble
+                    while ((n_read = ::read(socket_fd, &preamble, sizeof(preamble))) < 0) {
+                        if (errno != EINTR) {
+                            break;
+                        }
+                    }
+                    break;
+                }
+                if (errno != EINTR) {
+                    break;
+                }
+            }
+
+            if ((n_read != 1) || (preamble != preamble_offer)) {
+                LOG_ERROR("Did not receive the IPC preamble from the shell");
+                return {};
+            }
+
+            std::shared_ptr<shared_frame_ring_t> result {};
+            for (auto * cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+                if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_RIGHTS)
+                    && (cmsg->cmsg_len == CMSG_LEN(2 * sizeof(int)))) {
+                    std::array<int, 2> fds {};
+                    std::memcpy(fds.data(), CMSG_DATA(cmsg), sizeof(fds));
+                    result = map(lib::AutoClosingFd {fds[0]}, lib::AutoClosingFd {fds[1]});
+                }
+            }
+            return result;
+        }
+
+    private:
+        static constexpr std::size_t record_header_size = 2 * sizeof(std::uint32_t);
+
+        lib::AutoClosingFd memfd;
+        lib::AutoClosingFd doorbell;
+        void * mapping;
+        std::size_t mapping_size;
+        std::size_t buffer_size;
+        bool corrupt = false;
+
+        shared_frame_ring_t(lib::AutoClosingFd && memfd,
+                            lib::AutoClosingFd && doorbell,
+                            void * mapping,
+                            std::size_t mapping_size,
+                            std::size_t buffer_size)
+            : memfd(std::move(memfd)),
+              doorbell(std::move(doorbell)),
+              mapping(mapping),
+              mapping_size(mapping_size),
+              buffer_size(buffer_size)
+        {
+        }
+
+        std::optional<record_t> on_corrupt()
+        {
+            if (!std::exchange(corrupt, true)) {
+                LOG_ERROR("The shared IPC ring is corrupt");
+            }
+            return {};
+        }
+
+        static constexpr std::size_t padded_size(std::size_t payload_size)
+        {
+            return (record_header_size + payload_size + 7) & ~std::size_t(7);
+        }
+
+        [[nodiscard]] shared_frame_ring_header_t & get_header() const
+        {
+            return *static_cast<shared_frame_ring_header_t *>(mapping);
+        }
+
+        [[nodiscard]] char * buffer_at(std::uint64_t pos) const
+        {
+            return static_cast<char *>(mapping) + sizeof(shared_frame_ring_header_t) + (pos & (buffer_size - 1));
+        }
+
+        void write_record_header(std::uint64_t pos, record_kind_t kind, std::size_t length)
+        {
+            std::array<std::uint32_t, 2> const record_header {std::uint32_t(kind), std::uint32_t(length)};
+            std::memcpy(buffer_at(pos), record_header.data(), record_header_size);
+        }
+    };
+}
@@ -0,0 +1,125 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "lib/ArchTimerDriftModel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace lib {
+    namespace {
+        constexpr double NS_PER_S = 1e9;
+        /** A sample is rejected if its window is more than this many times the narrowest recent one */
+        constexpr std::uint64_t REJECT_WINDOW_FACTOR = 3;
+    }
+
+    bool ArchTimerDriftModel::addSample(const ArchTimerSample & sample)
+    {
+        if (!haveBase) {
+            base = sample;
+            haveBase = true;
+        }
+
+        if (!points.empty()) {
+            const auto narrowest = std::min_element(points.begin(), points.end(), [](const auto & a, const auto & b) {
+                return a.windowNS < b.windowNS;
+            });
+            // (but accept it anyway if the recent samples are all rejected, as the narrowest may have been a fluke)
+            if ((sample.windowNS > narrowest->windowNS * REJECT_WINDOW_FACTOR) && (rejected < MAX_SAMPLES)) {
+                ++rejected;
+                return false;
+            }
+        }
+
+        rejected = 0;
+        points.push_back(toPoint(sample));
+        if (points.size() > MAX_SAMPLES) {
+            points.pop_front();
+        }
+        fit();
+        return true;
+    }
+
+    void ArchTimerDriftModel::setSyncPoint(const ArchTimerSample & sample)
+    {
+        if (!haveBase) {
+            base = sample;
+            haveBase = true;
+        }
+
+        syncResidualNS = toPoint(sample).residualNS;
+        haveSyncPoint = true;
+    }
+
+    bool ArchTimerDriftModel::needsSyncPoint(std::uint64_t monotonicRawNS) const
+    {
+        if (!haveSyncPoint) {
+            return true;
+        }
+
+        const double timeNS = static_cast<double>(monotonicRawNS) - static_cast<double>(base.monotonicRawNS);
+        return std::fabs(predictedErrorNS(timeNS)) > static_cast<double>(thresholdNS);
+    }
+
+    std::uint64_t ArchTimerDriftModel::timeUntilThresholdNS(std::uint64_t monotonicRawNS) const
+    {
+        if (!haveSyncPoint) {
+            return 0;
+        }
+
+        if (drift == 0) {
+            return std::numeric_limits<std::uint64_t>::max();
+        }
+
+        const double timeNS = static_cast<double>(monotonicRawNS) - static_cast<double>(base.monotonicRawNS);
+        const double errorNS = predictedErrorNS(timeNS);
+        const double threshold = static_cast<double>(thresholdNS);
+        // the error changes by drift per ns, towards +threshold if the drift is positive, otherwise -threshold
+        const double remainingNS = (drift > 0 ? (threshold - errorNS) / drift : (errorNS + threshold) / -drift);
+
+        if (remainingNS <= 0) {
+            return 0;
+        }
+        if (remainingNS >= static_cast<double>(std::numeric_limits<std::uint64_t>::max())) {
+            return std::numeric_limits<std::uint64_t>::max();
+        }
+        return static_cast<std::uint64_t>(remainingNS);
+    }
+
+    ArchTimerDriftModel::Point ArchTimerDriftModel::toPoint(const ArchTimerSample & sample) const
+    {
+        const double timeNS = static_cast<double>(sample.monotonicRawNS) - static_cast<double>(base.monotonicRawNS);
+        const double counts = static_cast<double>(sample.count) - static_cast<double>(base.count);
+        const double nominalNS = (frequency != 0 ? (counts * NS_PER_S) / static_cast<double>(frequency) : 0);
+        return {timeNS, timeNS - nominalNS, sample.windowNS};
+    }
+
+    double ArchTimerDriftModel::predictedErrorNS(double timeNS) const
+    {
+        return (offset + drift * timeNS) - syncResidualNS;
+    }
+
+    void ArchTimerDriftModel::fit()
+    {
+        const auto n = static_cast<double>(points.size());
+
+        double meanTime = 0;
+        double meanResidual = 0;
+        for (const auto & point : points) {
+            meanTime += point.timeNS;
+            meanResidual += point.residualNS;
+        }
+        meanTime /= n;
+        meanResidual /= n;
+
+        double covariance = 0;
+        double variance = 0;
+        for (const auto & point : points) {
+            covariance += (point.timeNS - meanTime) * (point.residualNS - meanResidual);
+            variance += (point.timeNS - meanTime) * (point.timeNS - meanTime);
+        }
+
+        drift = (isFitted() && (variance > 0) ? covariance / variance : 0);
+        offset = meanResidual - drift * meanTime;
+    }
+}
@@ -0,0 +1,90 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#pragma once
+
+#include "lib/ArchTimestamp.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+
+namespace lib {
+    /**
+     * Models the drift of CNTVCT_EL0 against CLOCK_MONOTONIC_RAW, so that sync points only need to be sent when the
+     * host's extrapolation from the last one would be off by more than some threshold.
+     *
+     * The host converts a counter value to CLOCK_MONOTONIC_RAW from the nearest sync point at the nominal frequency
+     * (CNTFREQ_EL0), so its error grows with any difference between the nominal and the actual rate. The model fits
+     * offset + drift * time by least squares to the difference between the clock and the nominal conversion of the
+     * counter over the recent samples, ignoring those whose reads were bracketed by a much wider window than the
+     * others (such as when the thread was preempted between the reads).
+     */
+    class ArchTimerDriftModel {
+    public:
+        /** The number of recent samples the model is fitted to */
+        static constexpr std::size_t MAX_SAMPLES = 16;
+        /** The number of samples needed before the drift is trusted */
+        static constexpr std::size_t MIN_FIT_SAMPLES = 4;
+
+        /**
+         * @param frequency The nominal frequency of the counter (CNTFREQ_EL0)
+         * @param thresholdNS The predicted error at which a new sync point is needed
+         */
+        ArchTimerDriftModel(std::uint64_t frequency, std::uint64_t thresholdNS)
+            : frequency(frequency), thresholdNS(thresholdNS)
+        {
+        }
+
+        /**
+         * Add a sample to the model
+         *
+         * @return False if the sample was rejected, as its window was much wider than the narrowest recent one
+         */
+        bool addSample(const ArchTimerSample & sample);
+
+        /** Record that the sample was sent as a sync point, which the host will extrapolate from */
+        void setSyncPoint(const ArchTimerSample & sample);
+
+        /** @return True once enough samples were added for the drift to be trusted */
+        [[nodiscard]] bool isFitted() const { return points.size() >= MIN_FIT_SAMPLES; }
+
+        /** @return The fitted drift, in ns per second */
+        [[nodiscard]] double getDriftNSPerS() const { return drift * 1e9; }
+
+        /** @return True if there is no sync point yet, or if the predicted error at the time exceeds the threshold */
+        [[nodiscard]] bool needsSyncPoint(std::uint64_t monotonicRawNS) const;
+
+        /**
+         * @return The time after `monotonicRawNS` at which the predicted error reaches the threshold, or UINT64_MAX
+         * if it never does
+         */
+        [[nodiscard]] std::uint64_t timeUntilThresholdNS(std::uint64_t monotonicRawNS) const;
+
+    private:
+        struct Point {
+            /** The time since the base sample */
+            double timeNS;
+            /** The clock minus the nominal conversion of the counter, relative to the base sample */
+            double residualNS;
+            std::uint64_t windowNS;
+        };
+
+        std::uint64_t frequency;
+        std::uint64_t thresholdNS;
+        std::deque<Point> points {};
+        ArchTimerSample base {};
+        bool haveBase {false};
+        /** The number of consecutive samples rejected */
+        std::size_t rejected {0};
+        /** The residual of the last sync point */
+        double syncResidualNS {0};
+        bool haveSyncPoint {false};
+        /** The fitted model, residual = offset + drift * time */
+        double offset {0};
+        double drift {0};
+
+        [[nodiscard]] Point toPoint(const ArchTimerSample & sample) const;
+        [[nodiscard]] double predictedErrorNS(double timeNS) const;
+        void fit();
+    };
+}
@@ -0,0 +1,175 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "lib/ArchTimestamp.h"
+
+#include "Logging.h"
+#include "lib/FsEntry.h"
+#include "lib/GenericTimer.h"
+#include "lib/Time.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <ctime>
+#include <limits>
+
+namespace lib {
+    namespace detail {
+        std::atomic_bool archTimestampsEnabled {false};
+    }
+
+    namespace {
+        constexpr std::uint64_t NS_PER_S = 1000000000ULL;
+        constexpr int INITIAL_CALIBRATION_ATTEMPTS = 5;
+
+        /**
+         * Maps a counter value to CLOCK_MONOTONIC_RAW, as baseNS plus rateNS for every `frequency` counts since
+         * baseCount. The fields are only written while the mapping is not current.
+         */
+        struct Mapping {
+            std::atomic<std::uint64_t> baseCount {0};
+            std::atomic<std::uint64_t> baseNS {0};
+            std::atomic<std::uint64_t> rateNS {0};
+        };
+
+        // set once, before archTimestampsEnabled
+        std::uint64_t frequency = 0;
+        // a mapping is only rewritten a second after it was replaced, by when no reader is still using it
+        std::array<Mapping, 2> mappings {};
+        std::atomic<unsigned> currentMapping {0};
+        // held by the thread that is recalibrating
+        std::atomic_flag calibrating = ATOMIC_FLAG_INIT;
+        // protected by calibrating
+        ArchTimerSample lastCalibration {};
+        // the last time read by this thread
+        thread_local std::uint64_t lastTimestampNS = 0;
+
+        std::uint64_t readCount()
+        {
+#if defined(__aarch64__)
+            // the counter may otherwise be read ahead of the preceding instructions
+            asm volatile("isb" : : : "memory");
+#endif
+            return get_cntvct_el0();
+        }
+
+        std::uint64_t toNS(std::uint64_t baseCount, std::uint64_t baseNS, std::uint64_t rateNS, std::uint64_t count)
+        {
+            const std::uint64_t delta = (count > baseCount ? count - baseCount : 0);
+            // split, so that the multiplication cannot overflow
+            return baseNS + (delta / frequency) * rateNS + ((delta % frequency) * rateNS) / frequency;
+        }
+
+        std::uint64_t toNS(const Mapping & mapping, std::uint64_t count)
+        {
+            return toNS(mapping.baseCount.load(std::memory_order_relaxed),
+                        mapping.baseNS.load(std::memory_order_relaxed),
+                        mapping.rateNS.load(std::memory_order_relaxed),
+                        count);
+        }
+
+        /**
+         * Replace the mapping with one that starts from the current mapped time (so there is no step) but runs at
+         * the rate that would remove the current error over the same period as that since the last calibration.
+         */
+        void recalibrate()
+        {
+            if (calibrating.test_and_set(std::memory_order_acquire)) {
+                // another thread is already doing it
+                return;
+            }
+
+            const ArchTimerSample sample = sampleArchTimer();
+            const unsigned index = currentMapping.load(std::memory_order_relaxed);
+            const std::uint64_t mappedNS = toNS(mappings[index], sample.count);
+
+            if ((sample.count > lastCalibration.count) && (sample.monotonicRawNS > lastCalibration.monotonicRawNS)) {
+                const double counts = sample.count - lastCalibration.count;
+                const double elapsedNS = sample.monotonicRawNS - lastCalibration.monotonicRawNS;
+                const double errorNS = static_cast<double>(sample.monotonicRawNS) - static_cast<double>(mappedNS);
+                const double rateNS = std::clamp((elapsedNS + errorNS) * static_cast<double>(frequency) / counts,
+                                                 NS_PER_S / 2.0,
+                                                 NS_PER_S * 2.0);
+
+                Mapping & next = mappings[index ^ 1U];
+                next.baseCount.store(sample.count, std::memory_order_relaxed);
+                next.baseNS.store(mappedNS, std::memory_order_relaxed);
+                next.rateNS.store(std::llround(rateNS), std::memory_order_relaxed);
+                currentMapping.store(index ^ 1U, std::memory_order_release);
+            }
+
+            lastCalibration = sample;
+            calibrating.clear(std::memory_order_release);
+        }
+    }
+
+    std::uint64_t getMonotonicRawNS()
+    {
+        struct timespec ts;
+        if (clock_gettime(CLOCK_MONOTONIC_RAW, &ts) != 0) {
+            LOG_ERROR("Failed to get uptime");
+            handleException();
+        }
+        return (NS_PER_S * ts.tv_sec + ts.tv_nsec);
+    }
+
+    ArchTimerSample sampleArchTimer(int attempts)
+    {
+        ArchTimerSample best {};
+        std::uint64_t bestWindowNS = std::numeric_limits<std::uint64_t>::max();
+        for (int attempt = 0; attempt < attempts; ++attempt) {
+            const std::uint64_t beforeNS = getMonotonicRawNS();
+            const std::uint64_t count = readCount();
+            const std::uint64_t afterNS = getMonotonicRawNS();
+            if ((afterNS - beforeNS) < bestWindowNS) {
+                bestWindowNS = afterNS - beforeNS;
+                best = {beforeNS + bestWindowNS / 2, count, bestWindowNS};
+            }
+        }
+        return best;
+    }
+
+    bool enableArchTimestamps()
+    {
+#if defined(__aarch64__)
+        frequency = get_cntfreq_el0();
+        if (frequency == 0) {
+            return false;
+        }
+
+        // otherwise CLOCK_MONOTONIC_RAW does not follow the counter
+        const auto clocksource =
+            FsEntry::create("/sys/devices/system/clocksource/clocksource0/current_clocksource")
+                .readFileContentsSingleLine();
+        if (clocksource != "arch_sys_counter") {
+            return false;
+        }
+
+        lastCalibration = sampleArchTimer(INITIAL_CALIBRATION_ATTEMPTS);
+        mappings[0].baseCount.store(lastCalibration.count, std::memory_order_relaxed);
+        mappings[0].baseNS.store(lastCalibration.monotonicRawNS, std::memory_order_relaxed);
+        mappings[0].rateNS.store(NS_PER_S, std::memory_order_relaxed);
+        currentMapping.store(0, std::memory_order_relaxed);
+        detail::archTimestampsEnabled.store(true, std::memory_order_release);
+        return true;
+#else
+        // the counter is not always readable from user space on 32 bit kernels
+        return false;
+#endif
+    }
+
+    std::uint64_t getArchTimestampNS()
+    {
+        const Mapping * mapping = &mappings[currentMapping.load(std::memory_order_acquire)];
+        const std::uint64_t count = readCount();
+        if (count > mapping->baseCount.load(std::memory_order_relaxed) + frequency) {
+            recalibrate();
+            mapping = &mappings[currentMapping.load(std::memory_order_acquire)];
+        }
+
+        // a reader of the previous mapping may be up to a few ns ahead just after a recalibration
+        const std::uint64_t timestampNS = std::max(toNS(*mapping, count), lastTimestampNS);
+        lastTimestampNS = timestampNS;
+        return timestampNS;
+    }
+}
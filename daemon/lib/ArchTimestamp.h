@@ -0,0 +1,52 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace lib {
+    /** A pair of CLOCK_MONOTONIC_RAW and CNTVCT_EL0 read at (as near as possible) the same moment */
+    struct ArchTimerSample {
+        std::uint64_t monotonicRawNS;
+        std::uint64_t count;
+        /** The time between the clock reads either side of the counter read, or 0 if unknown */
+        std::uint64_t windowNS = 0;
+    };
+
+    /** Read CLOCK_MONOTONIC_RAW from the kernel, in nanoseconds */
+    std::uint64_t getMonotonicRawNS();
+
+    /**
+     * Read CLOCK_MONOTONIC_RAW and CNTVCT_EL0 together, with the clock read either side of the counter so that the
+     * clock value is the midpoint of the two reads.
+     *
+     * @param attempts The number of reads to make, of which the one with the narrowest window is returned
+     */
+    ArchTimerSample sampleArchTimer(int attempts = 1);
+
+    /**
+     * Derive CLOCK_MONOTONIC_RAW from CNTVCT_EL0 from now on, if the arch timer is the kernel's clocksource (and so the
+     * source of CLOCK_MONOTONIC_RAW), as reading the counter does not need a syscall on kernels where the vDSO does
+     * not provide CLOCK_MONOTONIC_RAW. It must be called before any other thread reads the time.
+     *
+     * The mapping is recalibrated against the kernel's clock about once a second by whichever thread reads the time,
+     * slewing rather than stepping, so that the time read by any one thread never goes backwards.
+     *
+     * @return True if the counter is used
+     */
+    bool enableArchTimestamps();
+
+    namespace detail {
+        extern std::atomic_bool archTimestampsEnabled;
+    }
+
+    /** @return True if getArchTimestampNS may be called */
+    inline bool archTimestampsEnabled()
+    {
+        return detail::archTimestampsEnabled.load(std::memory_order_relaxed);
+    }
+
+    /** Read CLOCK_MONOTONIC_RAW, as derived from CNTVCT_EL0. Only valid once enableArchTimestamps returned true. */
+    std::uint64_t getArchTimestampNS();
+}
@@ -0,0 +1,85 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "lib/DirectoryFd.h"
+
+#include <cerrno>
+
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace lib {
+    namespace {
+        /** The initial size of the buffers that files are read into, which is enough for most files in /proc */
+        constexpr std::size_t initialBufferSize = 4096;
+    }
+
+    DirectoryFd DirectoryFd::open(const char * path)
+    {
+        return DirectoryFd {AutoClosingFd {lib::open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)}};
+    }
+
+    std::optional<std::string_view> DirectoryFd::readContents(int fd, std::vector<char> & buffer)
+    {
+        if (buffer.size() < initialBufferSize) {
+            buffer.resize(initialBufferSize);
+        }
+
+        std::size_t length = 0;
+        for (;;) {
+            // always leave room for the terminator
+            if ((length + 1) >= buffer.size()) {
+                buffer.resize(buffer.size() * 2);
+            }
+
+            const ssize_t bytes = ::pread(fd, buffer.data() + length, buffer.size() - length - 1, off_t(length));
+            if (bytes < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                // fails with ESRCH once a task has exited
+                return {};
+            }
+            if (bytes == 0) {
+                break;
+            }
+            length += bytes;
+        }
+
+        buffer[length] = '\0';
+        return std::string_view {buffer.data(), length};
+    }
+
+    DirectoryFd DirectoryFd::openDirectory(const char * name) const
+    {
+        if (!fd) {
+            return {};
+        }
+        return DirectoryFd {AutoClosingFd {::openat(*fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC)}};
+    }
+
+    AutoClosingFd DirectoryFd::openFile(const char * name) const
+    {
+        if (!fd) {
+            return {};
+        }
+        return AutoClosingFd {::openat(*fd, name, O_RDONLY | O_CLOEXEC)};
+    }
+
+    std::optional<std::string_view> DirectoryFd::readFile(const char * name, std::vector<char> & buffer) const
+    {
+        const AutoClosingFd file = openFile(name);
+        if (!file) {
+            return {};
+        }
+        return readContents(*file, buffer);
+    }
+
+    bool DirectoryFd::rewind() const { return fd && (::lseek(*fd, 0, SEEK_SET) == 0); }
+
+    ssize_t DirectoryFd::readEntries(char * buffer, std::size_t size) const
+    {
+        // use the syscall directly, as not every libc wraps getdents64, and readdir would allocate a DIR
+        return ::syscall(SYS_getdents64, *fd, buffer, size);
+    }
+}
@@ -0,0 +1,131 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#ifndef INCLUDE_LIB_DIRECTORY_FD_H
+#define INCLUDE_LIB_DIRECTORY_FD_H
+
+#include "lib/AutoClosingFd.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <sys/types.h>
+
+namespace lib {
+    /**
+     * Holds an open directory, and accesses its children relative to it (using openat and friends) so that, unlike
+     * FsEntry, accessing a child neither builds a path string nor allocates. Intended for files that are read
+     * repeatedly, such as those in /proc and sysfs that are polled.
+     */
+    class DirectoryFd {
+    public:
+        /** A child of the directory */
+        struct Entry {
+            /** The name of the child (never '.' or '..') */
+            const char * name;
+            /** The DT_* type of the child, which may be DT_UNKNOWN */
+            unsigned char type;
+        };
+
+        /**
+         * Open a directory
+         * @return The directory, which is invalid if it could not be opened
+         */
+        static DirectoryFd open(const char * path);
+
+        /**
+         * Read the whole of an open file, from the start, into the buffer (growing it if it is too small), and null
+         * terminate it
+         * @return The contents (without the terminator), or nothing if the file could not be read
+         */
+        static std::optional<std::string_view> readContents(int fd, std::vector<char> & buffer);
+
+        /** Constructor, invalid directory */
+        DirectoryFd() = default;
+
+        /** @return True if the directory is open */
+        explicit operator bool() const { return bool(fd); }
+
+        /**
+         * Open a child directory
+         * @param name The name of the child, or some relative path
+         * @return The directory, which is invalid if it could not be opened
+         */
+        [[nodiscard]] DirectoryFd openDirectory(const char * name) const;
+
+        /**
+         * Open a child file for reading
+         * @param name The name of the child, or some relative path
+         */
+        [[nodiscard]] AutoClosingFd openFile(const char * name) const;
+
+        /**
+         * Read the whole of a child file, as per readContents
+         * @param name The name of the child, or some relative path
+         * @return The contents (without the terminator), or nothing if the file could not be read
+         */
+        [[nodiscard]] std::optional<std::string_view> readFile(const char * name, std::vector<char> & buffer) const;
+
+        /**
+         * Enumerate the children of the directory, from the start. The entries are only valid during the call to the
+         * function.
+         * @param function Called as `void(const Entry &)` for each child
+         * @return False if the children could not be read
+         */
+        template<typename Function>
+        bool forEachChild(Function && function) const
+        {
+            // the kernel's struct linux_dirent64 (which libc does not consistently define)
+            constexpr std::size_t reclenOffset = 16;
+            constexpr std::size_t typeOffset = 18;
+            constexpr std::size_t nameOffset = 19;
+
+            std::array<char, entriesBufferSize> entries; // NOLINT(cppcoreguidelines-pro-type-member-init)
+
+            if (!rewind()) {
+                return false;
+            }
+
+            for (;;) {
+                const ssize_t length = readEntries(entries.data(), entries.size());
+                if (length < 0) {
+                    return false;
+                }
+                if (length == 0) {
+                    return true;
+                }
+
+                for (std::size_t offset = 0; offset < std::size_t(length);) {
+                    const char * const entry = entries.data() + offset;
+
+                    std::uint16_t reclen = 0;
+                    std::memcpy(&reclen, entry + reclenOffset, sizeof(reclen));
+
+                    const char * const name = entry + nameOffset;
+                    if ((std::strcmp(name, ".") != 0) && (std::strcmp(name, "..") != 0) && (name[0] != '\0')) {
+                        function(Entry {name, static_cast<unsigned char>(entry[typeOffset])});
+                    }
+
+                    offset += reclen;
+                }
+            }
+        }
+
+    private:
+        static constexpr std::size_t entriesBufferSize = 4096;
+
+        AutoClosingFd fd {};
+
+        explicit DirectoryFd(AutoClosingFd fd) : fd(std::move(fd)) {}
+
+        [[nodiscard]] bool rewind() const;
+        [[nodiscard]] ssize_t readEntries(char * buffer, std::size_t size) const;
+    };
+}
+
+#endif /* INCLUDE_LIB_DIRECTORY_FD_H */
@@ -1,12 +1,18 @@
-/* Copyright (C) 2018-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2018-2022 by Arm Limited. All rights reserved. */
+
+#include "lib/FileDescriptor.h"
 
 #include "Logging.h"
 
 #include <algorithm>
+#include <array>
 #include <cerrno>
 #include <cstdint>
+#include <cstring>
 
 #include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 namespace lib {
@@ -91,4 +97,72 @@ namespace lib {
 
         return true;
     }
+
+    bool sendFd(const int socket, const int fd, std::string_view message)
+    {
+        // a message must be sent for the descriptor to be, so always send at least the terminator
+        std::array<char, 256> buffer {};
+        const std::size_t length = std::min(message.size(), buffer.size() - 1);
+        std::memcpy(buffer.data(), message.data(), length);
+
+        iovec iov {buffer.data(), length + 1};
+
+        std::array<char, CMSG_SPACE(sizeof(int))> control {};
+
+        msghdr msg {};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.data();
+        msg.msg_controllen = control.size();
+
+        auto * cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(fd));
+        std::memcpy(CMSG_DATA(cmsg), &fd, sizeof(fd));
+
+        while (::sendmsg(socket, &msg, MSG_NOSIGNAL) < 0) {
+            if (errno != EINTR) {
+                LOG_DEBUG("sendmsg failed (%d)", errno);
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    int receiveFd(const int socket, std::string & message)
+    {
+        std::array<char, 256> buffer {};
+        iovec iov {buffer.data(), buffer.size()};
+
+        std::array<char, CMSG_SPACE(sizeof(int))> control {};
+
+        msghdr msg {};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.data();
+        msg.msg_controllen = control.size();
+
+        ssize_t bytes;
+        while ((bytes = ::recvmsg(socket, &msg, MSG_CMSG_CLOEXEC)) < 0) {
+            if (errno != EINTR) {
+                LOG_DEBUG("recvmsg failed (%d)", errno);
+                return -1;
+            }
+        }
+
+        int fd = -1;
+        for (auto * cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_RIGHTS)
+                && (cmsg->cmsg_len == CMSG_LEN(sizeof(int)))) {
+                std::memcpy(&fd, CMSG_DATA(cmsg), sizeof(fd));
+            }
+        }
+
+        buffer.back() = '\0';
+        message.assign(buffer.data(), strnlen(buffer.data(), std::min<std::size_t>(bytes, buffer.size())));
+
+        return fd;
+    }
 }
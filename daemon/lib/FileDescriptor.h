@@ -1,9 +1,11 @@
-/* Copyright (C) 2018-2020 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2018-2022 by Arm Limited. All rights reserved. */
 
 #ifndef INCLUDE_LIB_FILE_DESCRIPTOR_H
 #define INCLUDE_LIB_FILE_DESCRIPTOR_H
 
 #include <cstddef>
+#include <string>
+#include <string_view>
 
 namespace lib {
     int pipe_cloexec(int pipefd[2]);
@@ -11,6 +13,21 @@ namespace lib {
     bool writeAll(int fd, const void * buf, size_t pos);
     bool readAll(int fd, void * buf, size_t count);
     bool skipAll(int fd, size_t count);
+
+    /**
+     * Pass a file descriptor, along with a short message, over a unix socket to another process
+     *
+     * @return false if it could not be sent
+     */
+    bool sendFd(int socket, int fd, std::string_view message);
+
+    /**
+     * Receive a file descriptor sent by sendFd
+     *
+     * @param message Receives the message
+     * @return The file descriptor (which is close on exec), or -1 if none was received
+     */
+    int receiveFd(int socket, std::string & message);
 }
 
 #endif // INCLUDE_LIB_FILE_DESCRIPTOR_H
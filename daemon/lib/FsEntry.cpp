@@ -1,11 +1,13 @@
-/* Copyright (C) 2016-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2016-2022 by Arm Limited. All rights reserved. */
 
 #include "lib/FsEntry.h"
 
 #include "Logging.h"
 #include "lib/Assert.h"
+#include "lib/AutoClosingFd.h"
 
 #include <algorithm>
+#include <cerrno>
 #include <climits>
 #include <cstddef>
 #include <cstdlib>
@@ -18,6 +20,7 @@
 
 #include <boost/filesystem.hpp>
 
+#include <fcntl.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
@@ -214,25 +217,36 @@ namespace lib {
 
     std::string FsEntry::readFileContents() const
     {
-        std::ifstream stream(path(), std::ios::in);
-        std::ostringstream buffer;
+        // read in large chunks rather than line by line, as this is used for large files like /proc/kallsyms
+        static constexpr std::size_t chunk_size = 64 * 1024;
 
-        // read contents
-        bool first = true;
-        while (stream) {
-            if (!first) {
-                buffer << '\n';
+        std::string contents;
+
+        AutoClosingFd fd {::open(path().c_str(), O_RDONLY | O_CLOEXEC)};
+        if (!fd) {
+            return contents;
+        }
+
+        for (;;) {
+            auto const offset = contents.size();
+            contents.resize(offset + chunk_size);
+            auto const bytes = ::read(*fd, &contents[offset], chunk_size);
+            if ((bytes < 0) && (errno == EINTR)) {
+                contents.resize(offset);
+                continue;
             }
-            else {
-                first = false;
+            contents.resize(offset + std::max<ssize_t>(bytes, 0));
+            if (bytes <= 0) {
+                break;
             }
+        }
 
-            std::string line;
-            std::getline(stream, line);
-            buffer << line;
+        // the last line is always terminated
+        if ((!contents.empty()) && (contents.back() != '\n')) {
+            contents += '\n';
         }
 
-        return buffer.str();
+        return contents;
     }
 
     std::string FsEntry::readFileContentsSingleLine() const
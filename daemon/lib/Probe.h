@@ -0,0 +1,50 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#ifndef INCLUDE_LIB_PROBE_H
+#define INCLUDE_LIB_PROBE_H
+
+#include "Config.h"
+
+/*
+ * USDT (statically defined tracing) probes at the hand-offs between the stages of gatord's hot paths, such as the perf
+ * agent's ring buffer polls, the IPC sink's queue and the sender, so that when gatord itself is slow the latency
+ * between the stages can be measured with perf, bpftrace or systemtap (for example
+ * `perf probe -x gatord sdt_gatord:perf_poll_start`) rather than guessed at.
+ *
+ * Each probe is a single nop plus an ELF note describing where its arguments are, so costs next to nothing when no
+ * tracer is attached. They are only compiled in when built with CONFIG_USDT_PROBES, as they need sys/sdt.h from
+ * systemtap; otherwise the macros expand to nothing and the arguments are not evaluated.
+ *
+ * The probes are all in the "gatord" provider, and their arguments must be integers or pointers.
+ */
+
+#if CONFIG_USDT_PROBES
+#include <sys/sdt.h>
+
+#define GATOR_PROBE(name) DTRACE_PROBE(gatord, name)
+#define GATOR_PROBE1(name, a1) DTRACE_PROBE1(gatord, name, a1)
+#define GATOR_PROBE2(name, a1, a2) DTRACE_PROBE2(gatord, name, a1, a2)
+#define GATOR_PROBE3(name, a1, a2, a3) DTRACE_PROBE3(gatord, name, a1, a2, a3)
+#else
+#define GATOR_PROBE(name)                                                                                              \
+    do {                                                                                                               \
+    } while (false)
+// the arguments are only named in an unevaluated context, so that they still count as used
+#define GATOR_PROBE1(name, a1)                                                                                         \
+    do {                                                                                                               \
+        (void) sizeof(a1);                                                                                             \
+    } while (false)
+#define GATOR_PROBE2(name, a1, a2)                                                                                     \
+    do {                                                                                                               \
+        (void) sizeof(a1);                                                                                             \
+        (void) sizeof(a2);                                                                                             \
+    } while (false)
+#define GATOR_PROBE3(name, a1, a2, a3)                                                                                 \
+    do {                                                                                                               \
+        (void) sizeof(a1);                                                                                             \
+        (void) sizeof(a2);                                                                                             \
+        (void) sizeof(a3);                                                                                             \
+    } while (false)
+#endif
+
+#endif // INCLUDE_LIB_PROBE_H
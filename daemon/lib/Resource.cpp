@@ -1,4 +1,4 @@
-/* Copyright (C) 2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2021-2022 by Arm Limited. All rights reserved. */
 
 #include "Resource.h"
 
@@ -6,4 +6,19 @@ namespace lib {
     int getrlimit(int resource, rlimit * rlp) { return ::getrlimit(resource, rlp); }
 
     int setrlimit(int resource, const struct rlimit * rlp) { return ::setrlimit(resource, rlp); }
+
+    ResourceUsage getSelfResourceUsage()
+    {
+        constexpr std::uint64_t US_PER_S = 1000000;
+
+        struct rusage usage {};
+        if (::getrusage(RUSAGE_SELF, &usage) != 0) {
+            return {0, 0, 0};
+        }
+
+        const auto toUs = [](const timeval & tv) -> std::uint64_t { return (tv.tv_sec * US_PER_S) + tv.tv_usec; };
+        return {toUs(usage.ru_utime) + toUs(usage.ru_stime),
+                static_cast<std::uint64_t>(usage.ru_maxrss),
+                static_cast<std::uint64_t>(usage.ru_nvcsw)};
+    }
 }
@@ -1,7 +1,9 @@
-/* Copyright (C) 2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2021-2022 by Arm Limited. All rights reserved. */
 
 #pragma once
 
+#include <cstdint>
+
 #include <sys/resource.h>
 
 namespace lib {
@@ -14,4 +16,20 @@ namespace lib {
      * A wrapper around setrlimit that enables unit testing.
      */
     int setrlimit(int resource, const struct rlimit * rlp);
+
+    /** The resources used by the calling process so far */
+    struct ResourceUsage {
+        /** The total user and system CPU time, in microseconds */
+        std::uint64_t cpuTimeUs;
+        /** The peak resident set size, in KiB */
+        std::uint64_t maxRssKiB;
+        /** The number of times a thread slept (voluntarily gave up its cpu), and so was later woken */
+        std::uint64_t wakeups;
+    };
+
+    /**
+     * @return The resources used by the calling process (of all its threads, but not its children), or zeros if
+     * getrusage fails
+     */
+    ResourceUsage getSelfResourceUsage();
 }
@@ -0,0 +1,156 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "lib/RingMapping.h"
+
+#include "Logging.h"
+#include "lib/AutoClosingFd.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace lib {
+    namespace {
+        /** The usual size of a transparent huge page; where it is not, the alignment is merely wasted address space */
+        constexpr std::size_t HUGE_PAGE_SIZE = 2UL * 1024UL * 1024UL;
+
+        std::size_t getPageSize()
+        {
+            const auto pageSize = sysconf(_SC_PAGESIZE);
+            return (pageSize > 0 ? static_cast<std::size_t>(pageSize) : 4096);
+        }
+
+        /** Reserve some address space (that is not backed) aligned to `alignment`, which is a power of two */
+        char * reserve(std::size_t length, std::size_t alignment)
+        {
+            void * const reserved =
+                ::mmap(nullptr, length + alignment, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+            if (reserved == MAP_FAILED) {
+                return nullptr;
+            }
+
+            // trim the slack either side of the aligned part
+            const auto start = reinterpret_cast<std::uintptr_t>(reserved);
+            const auto aligned = (start + alignment - 1) & ~(alignment - 1);
+            if (aligned > start) {
+                ::munmap(reserved, aligned - start);
+            }
+            if ((start + alignment) > aligned) {
+                ::munmap(reinterpret_cast<void *>(aligned + length), (start + alignment) - aligned);
+            }
+
+            return reinterpret_cast<char *>(aligned);
+        }
+
+        char * mapMirrored(std::size_t size, std::size_t alignment)
+        {
+#if defined(__NR_memfd_create)
+            // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg)
+            AutoClosingFd memfd {int(::syscall(__NR_memfd_create, "gatord-buffer", 1 /* MFD_CLOEXEC */))};
+            if (!memfd || (::ftruncate(memfd.get(), off_t(size)) != 0)) {
+                LOG_DEBUG("Unable to create a mirrored ring (%d)", errno);
+                return nullptr;
+            }
+
+            // reserve the address space for both copies, then map the memfd over each half of it
+            char * const data = reserve(2 * size, alignment);
+            if (data == nullptr) {
+                LOG_DEBUG("Unable to reserve a mirrored ring (%d)", errno);
+                return nullptr;
+            }
+
+            for (char * copy : {data, data + size}) {
+                if (::mmap(copy, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, memfd.get(), 0) == MAP_FAILED) {
+                    LOG_DEBUG("Unable to map a mirrored ring (%d)", errno);
+                    ::munmap(data, 2 * size);
+                    return nullptr;
+                }
+            }
+
+            // the mappings keep the memory alive, so the memfd is no longer needed
+            return data;
+#else
+            (void) size;
+            (void) alignment;
+            return nullptr;
+#endif
+        }
+
+        char * mapPlain(std::size_t size, std::size_t alignment)
+        {
+            char * const data = reserve(size, alignment);
+            if ((data == nullptr)
+                || (::mmap(data, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0)
+                    == MAP_FAILED)) {
+                LOG_DEBUG("Unable to map a ring (%d)", errno);
+                if (data != nullptr) {
+                    ::munmap(data, size);
+                }
+                return nullptr;
+            }
+            return data;
+        }
+    }
+
+    RingMapping RingMapping::create(std::size_t size, bool prefault)
+    {
+        const auto pageSize = getPageSize();
+        if (size == 0) {
+            return {};
+        }
+
+        // huge pages can only back the parts of the mapping that are aligned to them
+        const auto alignment = ((prefault && ((size % HUGE_PAGE_SIZE) == 0)) ? HUGE_PAGE_SIZE : pageSize);
+        const bool canMirror = ((size % pageSize) == 0);
+
+        char * data = (canMirror ? mapMirrored(size, alignment) : nullptr);
+        const bool isMirrored = (data != nullptr);
+        if (data == nullptr) {
+            data = mapPlain(size, alignment);
+            if (data == nullptr) {
+                return {};
+            }
+        }
+
+        if (prefault) {
+#if defined(MADV_HUGEPAGE)
+            // only advice, which a shared mapping ignores unless shmem_enabled allows it
+            ::madvise(data, (isMirrored ? 2 * size : size), MADV_HUGEPAGE);
+#endif
+            // write each page so that it is allocated now rather than on the write path; the mirror's page table
+            // entries are filled in as well, as it is only read by the consumer
+            auto * const bytes = static_cast<volatile char *>(data);
+            for (std::size_t offset = 0; offset < (isMirrored ? 2 * size : size); offset += pageSize) {
+                bytes[offset] = 0;
+            }
+        }
+
+        return {data, size, isMirrored};
+    }
+
+    RingMapping::~RingMapping()
+    {
+        if (mData != nullptr) {
+            ::munmap(mData, (mIsMirrored ? 2 * mSize : mSize));
+        }
+    }
+
+    void RingMapping::release(std::size_t offset, std::size_t length) const
+    {
+        const auto pageSize = getPageSize();
+        const auto start = (offset + pageSize - 1) & ~(pageSize - 1);
+        const auto end = (std::min(offset + length, mSize)) & ~(pageSize - 1);
+        if ((mData == nullptr) || (start >= end)) {
+            return;
+        }
+
+        // the mirror shares the pages, which only MADV_REMOVE frees
+        if (::madvise(mData + start, end - start, (mIsMirrored ? MADV_REMOVE : MADV_DONTNEED)) != 0) {
+            LOG_DEBUG("Unable to release part of a ring (%d)", errno);
+        }
+    }
+}
@@ -0,0 +1,87 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#ifndef INCLUDE_LIB_RING_MAPPING_H
+#define INCLUDE_LIB_RING_MAPPING_H
+
+#include <cstddef>
+#include <utility>
+
+namespace lib {
+    /**
+     * The memory of a ring buffer, mapped directly rather than allocated from the heap so that how it is backed can be
+     * chosen for how the ring is used.
+     *
+     * Where possible the pages are mapped twice, one copy straight after the other, so that the ring can be written
+     * and read across its end as contiguous memory: data()[size() + n] is the same byte as data()[n] for any n less
+     * than size(). A write or read that wraps is then a single memcpy (or iovec), rather than one for each part. If
+     * that is not possible (no memfd, or a size that is not a multiple of the page size) it is a single anonymous
+     * mapping and the caller must split anything that wraps.
+     *
+     * A prefaulted ring has all its pages faulted in (with transparent huge pages where the kernel allows) when it is
+     * created, so that a busy source takes no page faults on its write path once the capture has started. Otherwise
+     * each page is only faulted in when it is first written, and the pages can be given back with release().
+     */
+    class RingMapping {
+    public:
+        /**
+         * Map a ring
+         * @param size The size of the ring
+         * @param prefault True to fault in the pages now
+         * @return The ring, which is invalid if it could not be mapped at all
+         */
+        static RingMapping create(std::size_t size, bool prefault);
+
+        /** Constructor, invalid ring */
+        RingMapping() = default;
+
+        RingMapping(const RingMapping &) = delete;
+        RingMapping & operator=(const RingMapping &) = delete;
+
+        RingMapping(RingMapping && that) noexcept
+            : mData(std::exchange(that.mData, nullptr)),
+              mSize(std::exchange(that.mSize, 0)),
+              mIsMirrored(std::exchange(that.mIsMirrored, false))
+        {
+        }
+
+        RingMapping & operator=(RingMapping && that) noexcept
+        {
+            RingMapping tmp {std::move(that)};
+            std::swap(mData, tmp.mData);
+            std::swap(mSize, tmp.mSize);
+            std::swap(mIsMirrored, tmp.mIsMirrored);
+            return *this;
+        }
+
+        ~RingMapping();
+
+        /** @return True if the ring is mapped */
+        explicit operator bool() const { return mData != nullptr; }
+
+        /** @return The start of the ring, which is followed by its mirror if isMirrored() */
+        [[nodiscard]] char * data() const { return mData; }
+
+        /** @return The size of the ring (not counting the mirror) */
+        [[nodiscard]] std::size_t size() const { return mSize; }
+
+        /** @return True if the ring is followed by a mirror of itself */
+        [[nodiscard]] bool isMirrored() const { return mIsMirrored; }
+
+        /**
+         * Give back the whole pages within part of the ring, which must not be in use. They read as zero afterwards
+         * and are faulted in again when next written.
+         */
+        void release(std::size_t offset, std::size_t length) const;
+
+    private:
+        char * mData = nullptr;
+        std::size_t mSize = 0;
+        bool mIsMirrored = false;
+
+        RingMapping(char * data, std::size_t size, bool isMirrored) : mData(data), mSize(size), mIsMirrored(isMirrored)
+        {
+        }
+    };
+}
+
+#endif // INCLUDE_LIB_RING_MAPPING_H
@@ -0,0 +1,54 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string_view>
+#include <utility>
+
+namespace lib {
+    /**
+     * Remembers the content last sent for each key, by a hash of it, so that a message that would only repeat what
+     * the host already has can be dropped. The host keeps the last content of each key, so dropping a repeat does not
+     * change what it sees.
+     *
+     * The content is not kept, so two different contents with the same size and (64 bit) hash would be taken as the
+     * same.
+     *
+     * @tparam Key The type of the key
+     */
+    template<typename Key>
+    class SentContentTracker {
+    public:
+        /**
+         * Record that some content is about to be sent
+         *
+         * @return False if the same content was the last to be sent for the key, and so need not be sent again
+         */
+        bool markSent(const Key & key, std::string_view content)
+        {
+            const Fingerprint fingerprint {std::hash<std::string_view> {}(content), content.size()};
+
+            std::lock_guard<std::mutex> lock {mutex};
+
+            auto [it, inserted] = lastSent.emplace(key, fingerprint);
+            if (inserted) {
+                return true;
+            }
+            if (it->second == fingerprint) {
+                return false;
+            }
+            it->second = fingerprint;
+            return true;
+        }
+
+    private:
+        using Fingerprint = std::pair<std::size_t, std::size_t>;
+
+        std::mutex mutex {};
+        std::map<Key, Fingerprint> lastSent {};
+    };
+}
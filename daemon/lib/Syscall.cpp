@@ -2,6 +2,7 @@
 
 #include "Syscall.h"
 
+#include <cerrno>
 #include <csignal>
 #include <cstdlib>
 
@@ -38,6 +39,20 @@ namespace lib {
         return syscall(__NR_perf_event_open, attr, pid, cpu, group_fd, flags);
     }
 
+    int bpf(int cmd, union bpf_attr * attr, unsigned int size)
+    {
+#ifdef __NR_bpf
+        // NOLINTNEXTLINE(bugprone-narrowing-conversions)
+        return syscall(__NR_bpf, cmd, attr, size);
+#else
+        (void) cmd;
+        (void) attr;
+        (void) size;
+        errno = ENOSYS;
+        return -1;
+#endif
+    }
+
     int accept4(int sockfd, struct sockaddr * addr, socklen_t * addrlen, int flags)
     {
         // NOLINTNEXTLINE(bugprone-narrowing-conversions)
@@ -1,7 +1,10 @@
-/* Copyright (C) 2017-2020 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2017-2022 by Arm Limited. All rights reserved. */
 
 #include "lib/TimestampSource.h"
 
+#include "lib/ArchTimestamp.h"
+#include "lib/Time.h"
+
 namespace lib {
     TimestampSource::TimestampSource(clockid_t id_) : base(0), id(id_) { base = getAbsTimestampNS(); }
 
@@ -11,6 +14,10 @@ namespace lib {
 
     unsigned long long TimestampSource::getAbsTimestampNS() const
     {
+        if ((id == CLOCK_MONOTONIC_RAW) && archTimestampsEnabled()) {
+            return getArchTimestampNS();
+        }
+
         ::timespec ts;
         clock_gettime(id, &ts);
 
@@ -13,6 +13,7 @@
 #include <cstdlib>
 #include <cstring>
 #include <limits>
+#include <string>
 
 #include <fcntl.h>
 #include <pwd.h>
@@ -165,65 +166,95 @@ namespace lib {
         return 0;
     }
 
-    std::set<int> readCpuMaskFromFile(const char * path)
+    std::set<int> parseCpuMask(std::string contents)
     {
         std::set<int> result;
 
-        const lib::FsEntry fsEntry = lib::FsEntry::create(path);
-
-        if (fsEntry.canAccess(true, false, false)) {
-            std::string contents = lib::readFileContents(fsEntry);
-
-            LOG_DEBUG("Reading cpumask from %s", fsEntry.path().c_str());
-
-            // split the input
-            const std::size_t length = contents.length();
-            std::size_t from = 0;
-            std::size_t split = 0;
-            std::size_t to = 0;
+        // split the input
+        const std::size_t length = contents.length();
+        std::size_t from = 0;
+        std::size_t split = 0;
+        std::size_t to = 0;
 
+        while (to < length) {
+            // move end pointer
             while (to < length) {
-                // move end pointer
-                while (to < length) {
-                    if ((contents[to] >= '0') && (contents[to] <= '9')) {
-                        to += 1;
-                    }
-                    else if (contents[to] == '-') {
-                        split = to;
-                        to += 1;
-                    }
-                    else {
-                        break;
-                    }
+                if ((contents[to] >= '0') && (contents[to] <= '9')) {
+                    to += 1;
                 }
+                else if (contents[to] == '-') {
+                    split = to;
+                    to += 1;
+                }
+                else {
+                    break;
+                }
+            }
 
-                // found a valid number (or range)
-                if (from < to) {
-                    if (split > from) {
-                        // found range
-                        contents[split] = 0;
-                        contents[to] = 0;
-                        int nf = (int) std::strtol(contents.c_str() + from, nullptr, 10);
-                        const int nt = (int) std::strtol(contents.c_str() + split + 1, nullptr, 10);
-                        while (nf <= nt) {
-                            LOG_DEBUG("    Adding cpu %d to mask", nf);
-                            result.insert(nf);
-                            nf += 1;
-                        }
-                    }
-                    else {
-                        // found single item
-                        contents[to] = 0;
-                        const int n = (int) std::strtol(contents.c_str() + from, nullptr, 10);
-                        LOG_DEBUG("    Adding cpu %d to mask", n);
-                        result.insert(n);
+            // found a valid number (or range)
+            if (from < to) {
+                if (split > from) {
+                    // found range
+                    contents[split] = 0;
+                    contents[to] = 0;
+                    int nf = (int) std::strtol(contents.c_str() + from, nullptr, 10);
+                    const int nt = (int) std::strtol(contents.c_str() + split + 1, nullptr, 10);
+                    while (nf <= nt) {
+                        LOG_DEBUG("    Adding cpu %d to mask", nf);
+                        result.insert(nf);
+                        nf += 1;
                     }
                 }
+                else {
+                    // found single item
+                    contents[to] = 0;
+                    const int n = (int) std::strtol(contents.c_str() + from, nullptr, 10);
+                    LOG_DEBUG("    Adding cpu %d to mask", n);
+                    result.insert(n);
+                }
+            }
+
+            // move to next item
+            to += 1;
+            from = to;
+            split = to;
+        }
 
-                // move to next item
-                to += 1;
-                from = to;
-                split = to;
+        return result;
+    }
+
+    std::set<int> readCpuMaskFromFile(const char * path)
+    {
+        const lib::FsEntry fsEntry = lib::FsEntry::create(path);
+
+        if (!fsEntry.canAccess(true, false, false)) {
+            return {};
+        }
+
+        LOG_DEBUG("Reading cpumask from %s", fsEntry.path().c_str());
+
+        return parseCpuMask(lib::readFileContents(fsEntry));
+    }
+
+    std::string formatCpuMask(const std::set<int> & cpus)
+    {
+        std::string result;
+
+        for (auto it = cpus.begin(); it != cpus.end();) {
+            // extend the range for as long as the cpus are consecutive
+            const int first = *it;
+            int last = first;
+            for (++it; (it != cpus.end()) && (*it == (last + 1)); ++it) {
+                last = *it;
+            }
+
+            if (!result.empty()) {
+                result += ',';
+            }
+            result += std::to_string(first);
+            if (last != first) {
+                result += '-';
+                result += std::to_string(last);
             }
         }
 
@@ -6,6 +6,7 @@
 #include <cstdint>
 #include <optional>
 #include <set>
+#include <string>
 
 #include <linux/version.h>
 #include <sys/types.h>
@@ -27,7 +28,11 @@ namespace lib {
     int writeReadIntInFile(const char * path, int & value);
     int writeReadInt64InFile(const char * path, int64_t & value);
 
+    /** @return The cpus in a cpu list, such as "0-3,6", which is the format of the cpumask files in sysfs */
+    std::set<int> parseCpuMask(std::string contents);
     std::set<int> readCpuMaskFromFile(const char * path);
+    /** @return The cpus as a cpu list, which is the inverse of parseCpuMask */
+    std::string formatCpuMask(const std::set<int> & cpus);
 
     uint64_t roundDownToPowerOfTwo(uint64_t in);
     int calculatePerfMmapSizeInPages(const std::uint64_t perfEventMlockKb, const std::uint64_t pageSizeBytes);
@@ -8,17 +8,21 @@
 #include "lib/Syscall.h"
 #include "lib/error_code_or.hpp"
 
+#include <array>
 #include <cerrno>
 #include <csignal>
 #include <cstddef>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <string>
 #include <utility>
 #include <vector>
 
 #include <fcntl.h>
 #include <grp.h>
 #include <pwd.h>
+#include <sched.h>
 #include <sys/prctl.h>
 #include <sys/resource.h>
 #include <sys/stat.h>
@@ -34,11 +38,126 @@
 namespace lib {
 
     namespace {
+        /** The cpu affinity of the process as it started, before any of its threads were pinned */
+        struct initial_affinity_t {
+            cpu_set_t cpus;
+            bool valid;
+        };
+
+        initial_affinity_t const initial_affinity = []() {
+            initial_affinity_t result {};
+            result.valid = (sched_getaffinity(0, sizeof(result.cpus), &result.cpus) == 0);
+            return result;
+        }();
+
         [[noreturn]] void kill_self()
         {
             kill(0, SIGKILL);
             _exit(COMMAND_FAILED_EXIT_CODE);
         }
+
+        /** The signals that gatord handles, which a new process must not inherit the handling of */
+        constexpr std::array<int, 8> handled_signals {{
+            SIGINT,
+            SIGTERM,
+            SIGABRT,
+            SIGALRM,
+            SIGCHLD,
+            SIGHUP,
+            SIGUSR1,
+            SIGUSR2,
+        }};
+
+        /** Enough for the few syscalls that the spawned child makes before it execs */
+        constexpr std::size_t spawn_stack_size = 64 * 1024;
+
+        /** Shared with the spawned child, which runs in the caller's memory until it execs */
+        struct spawn_child_args_t {
+            char const * path;
+            char * const * argv;
+            int stdin_fd;
+            int stdout_fd;
+            int stderr_fd;
+            /** The ends of the pipes that the child must not keep */
+            std::array<int, 3> parent_fds;
+            sigset_t signal_mask;
+            /** Set by the child if it fails to exec */
+            int error;
+        };
+
+        /** @return The path of the executable that execvp would run for `cmd` */
+        std::string find_executable(std::string const & cmd)
+        {
+            if (cmd.find('/') != std::string::npos) {
+                return cmd;
+            }
+
+            // NOLINTNEXTLINE(concurrency-mt-unsafe)
+            char const * const env_path = getenv("PATH");
+            std::string const search_path {env_path != nullptr ? env_path : "/bin:/usr/bin"};
+            std::size_t start = 0;
+            while (start <= search_path.size()) {
+                auto end = search_path.find(':', start);
+                if (end == std::string::npos) {
+                    end = search_path.size();
+                }
+                // an empty entry is the current directory
+                auto dir = search_path.substr(start, end - start);
+                auto candidate = (dir.empty() ? cmd : dir + "/" + cmd);
+                if (access(candidate.c_str(), X_OK) == 0) {
+                    return candidate;
+                }
+                start = end + 1;
+            }
+            return cmd;
+        }
+
+        /**
+         * The spawned child, which shares the caller's memory (and so must not allocate, or modify anything that the
+         * caller uses) until it execs. The caller is suspended until then.
+         */
+        int spawn_child(void * arg)
+        {
+            auto & args = *static_cast<spawn_child_args_t *>(arg);
+
+            // the child has its own copy of the signal handlers, which are reset before any signal is unblocked
+            for (auto signo : handled_signals) {
+                signal(signo, SIG_DFL);
+            }
+            sigprocmask(SIG_SETMASK, &args.signal_mask, nullptr);
+
+            // as with fork_process, so that the command and all its children can be killed together
+            setpgid(0, 0);
+
+            for (auto fd : args.parent_fds) {
+                if (fd >= 0) {
+                    ::close(fd);
+                }
+            }
+
+            if ((dup2(args.stdin_fd, STDIN_FILENO) < 0) || (dup2(args.stdout_fd, STDOUT_FILENO) < 0)
+                || (dup2(args.stderr_fd, STDERR_FILENO) < 0)) {
+                args.error = errno;
+                _exit(COMMAND_FAILED_EXIT_CODE);
+            }
+
+            if (prctl(PR_SET_PDEATHSIG, SIGKILL) != 0) {
+                args.error = errno;
+                _exit(COMMAND_FAILED_EXIT_CODE);
+            }
+
+            // the child is a new thread, so this only affects it
+            setpriority(PRIO_PROCESS, 0, 0);
+
+            if (initial_affinity.valid) {
+                sched_setaffinity(0, sizeof(initial_affinity.cpus), &initial_affinity.cpus);
+            }
+
+            execve(args.path, args.argv, environ);
+
+            args.error = errno;
+            _exit(errno == ENOENT ? forked_process_t::failure_exec_not_found : forked_process_t::failure_exec_invalid);
+        }
     }
 
     // NOLINTNEXTLINE(readability-function-cognitive-complexity)
@@ -158,6 +277,12 @@ namespace lib {
             kill_self();
         }
 
+        // likewise, the command may run on any of the cpus that it could have, rather than only on those that the
+        // forking thread was pinned to (failing that, it just keeps the forking thread's affinity)
+        if (initial_affinity.valid) {
+            sched_setaffinity(0, sizeof(initial_affinity.cpus), &initial_affinity.cpus);
+        }
+
         if (uid_gid) {
             // failure is only an error if c_uid == 0, i.e. we are root
             if ((setgroups(1, &r_gid) != 0) && (c_uid == 0)) {
@@ -205,6 +330,74 @@ namespace lib {
         _exit(errno == ENOENT ? failure_exec_not_found : failure_exec_invalid);
     }
 
+    error_code_or_t<forked_process_t> forked_process_t::spawn_process(std::string const & cmd,
+                                                                      lib::Span<std::string const> args,
+                                                                      stdio_fds_t stdio_fds)
+    {
+        LOG_DEBUG("Spawning exe '%s'", cmd.c_str());
+        for (auto const & a : args) {
+            LOG_DEBUG("   ARG: '%s'", a.c_str());
+        }
+
+        // everything the child needs is prepared here, as it must not allocate
+        auto const path = find_executable(cmd);
+
+        std::vector<char *> args_null_term_list {};
+        args_null_term_list.reserve(args.size() + 2);
+        args_null_term_list.push_back(const_cast<char *>(cmd.c_str()));
+        for (const auto & arg : args) {
+            args_null_term_list.push_back(const_cast<char *>(arg.c_str()));
+        }
+        args_null_term_list.push_back(nullptr);
+
+        spawn_child_args_t child_args {
+            path.c_str(),
+            args_null_term_list.data(),
+            stdio_fds.stdin_read.get(),
+            stdio_fds.stdout_write.get(),
+            stdio_fds.stderr_write.get(),
+            {{stdio_fds.stdin_write.get(), stdio_fds.stdout_read.get(), stdio_fds.stderr_read.get()}},
+            {},
+            0,
+        };
+
+        std::vector<char> stack(spawn_stack_size);
+        // the stack grows down on all the supported architectures
+        void * const stack_top = stack.data() + stack.size();
+
+        // block all signals, so that none is handled by gatord's handlers in the child before it resets them
+        sigset_t all_signals;
+        sigfillset(&all_signals);
+        pthread_sigmask(SIG_SETMASK, &all_signals, &child_args.signal_mask);
+
+        // NOLINTNEXTLINE(hicpp-signed-bitwise)
+        auto const pid = ::clone(&spawn_child, stack_top, CLONE_VM | CLONE_VFORK | SIGCHLD, &child_args);
+        auto const clone_errno = errno;
+
+        pthread_sigmask(SIG_SETMASK, &child_args.signal_mask, nullptr);
+
+        if (pid < 0) {
+            LOG_DEBUG("clone failed with %d", clone_errno);
+            return boost::system::errc::make_error_code(boost::system::errc::errc_t(clone_errno));
+        }
+
+        // the child has exec'd or exited by now
+        if (child_args.error != 0) {
+            LOG_DEBUG("spawning '%s' failed with %d", path.c_str(), child_args.error);
+            while ((waitpid(pid, nullptr, 0) < 0) && (errno == EINTR)) {
+            }
+            return boost::system::errc::make_error_code(boost::system::errc::errc_t(child_args.error));
+        }
+
+        forked_process_t result {std::move(stdio_fds.stdin_write),
+                                 std::move(stdio_fds.stdout_read),
+                                 std::move(stdio_fds.stderr_read),
+                                 {},
+                                 pid};
+        result.spawned = true;
+        return result;
+    }
+
     void forked_process_t::abort()
     {
         AutoClosingFd exec_abort_write {std::move(this->exec_abort_write)};
@@ -229,6 +422,10 @@ namespace lib {
 
     [[nodiscard]] bool forked_process_t::exec()
     {
+        if (spawned) {
+            return true;
+        }
+
         AutoClosingFd exec_abort_write {std::move(this->exec_abort_write)};
 
         if (!exec_abort_write) {
@@ -39,7 +39,8 @@ namespace lib {
               stdout_read(std::move(that.stdout_read)),
               stderr_read(std::move(that.stderr_read)),
               exec_abort_write(std::move(that.exec_abort_write)),
-              pid(std::exchange(that.pid, 0))
+              pid(std::exchange(that.pid, 0)),
+              spawned(std::exchange(that.spawned, false))
         {
         }
 
@@ -52,6 +53,7 @@ namespace lib {
                 std::swap(this->stderr_read, tmp.stderr_read);
                 std::swap(this->exec_abort_write, tmp.exec_abort_write);
                 std::swap(this->pid, tmp.pid);
+                std::swap(this->spawned, tmp.spawned);
             }
             return *this;
         }
@@ -64,7 +66,7 @@ namespace lib {
         /** Abort the command that was execvp, send SIGTERM to the command and any children */
         void abort();
 
-        /** Will make the forked child process stop waiting and exec the command */
+        /** Will make the forked child process stop waiting and exec the command (or does nothing if it was spawned) */
         [[nodiscard]] bool exec();
 
         /** @return the write end of the process's stdin (may be closed if not reading stdin, or moved out for use elsewhere) */
@@ -91,6 +93,19 @@ namespace lib {
                                                               std::optional<std::pair<uid_t, gid_t>> const & uid_gid,
                                                               stdio_fds_t stdio_fds);
 
+        /**
+         * Start a process running the command straight away, with clone(CLONE_VM | CLONE_VFORK) rather than fork, so
+         * that none of the (possibly large) address space of the caller has to be copied. The child does no more than
+         * redirect its stdio, join its own process group and undo the caller's signal handlers, priority and
+         * affinity, as fork_process's does, before it execs. Returns errno in case of an error, including when the
+         * exec fails.
+         *
+         * exec() does nothing for the returned process, which is already running the command.
+         */
+        static error_code_or_t<forked_process_t> spawn_process(std::string const & cmd,
+                                                               lib::Span<std::string const> args,
+                                                               stdio_fds_t stdio_fds);
+
         /** Constructor */
         forked_process_t(AutoClosingFd && stdin_write,
                          AutoClosingFd && stdout_read,
@@ -111,5 +126,6 @@ namespace lib {
         AutoClosingFd stderr_read;
         AutoClosingFd exec_abort_write;
         pid_t pid {0};
+        bool spawned {false};
     };
 }
@@ -9,6 +9,8 @@
 #include <cstdio>
 #include <cstdlib>
 
+#include <sys/socket.h>
+
 namespace lib {
 
     error_code_or_t<pipe_pair_t> pipe_pair_t::create(int flags)
@@ -24,6 +26,19 @@ namespace lib {
         return pipe_pair_t {AutoClosingFd {fds[0]}, AutoClosingFd {fds[1]}};
     }
 
+    error_code_or_t<pipe_pair_t> pipe_pair_t::create_socket_pair(int flags)
+    {
+        std::array<int, 2> fds {{-1, -1}};
+
+        if (::socketpair(AF_UNIX, SOCK_STREAM | flags, 0, fds.data()) != 0) {
+            auto const e = errno;
+            LOG_DEBUG("socketpair failed with %d", errno);
+            return boost::system::errc::make_error_code(boost::system::errc::errc_t(e));
+        }
+
+        return pipe_pair_t {AutoClosingFd {fds[0]}, AutoClosingFd {fds[1]}};
+    }
+
     error_code_or_t<pipe_pair_t> pipe_pair_t::from_file(char const * path)
     {
         // NOLINTNEXTLINE(android-cloexec-open) - cloexec is not appropriate for fork/exec redirection :-)
@@ -17,6 +17,8 @@ namespace lib {
         AutoClosingFd write;
 
         static error_code_or_t<pipe_pair_t> create(int flags);
+        /** Create from a unix stream socket pair rather than a pipe, so that fds may also be sent from the write end */
+        static error_code_or_t<pipe_pair_t> create_socket_pair(int flags);
         static error_code_or_t<pipe_pair_t> from_file(char const * path);
         static error_code_or_t<pipe_pair_t> to_file(char const * path, bool truncate = true, int mode = default_mode);
     };
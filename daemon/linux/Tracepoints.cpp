@@ -12,7 +12,10 @@
 #include "linux/perf/IPerfAttrsConsumer.h"
 
 #include <array>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
+#include <sstream>
 #include <string>
 
 #include <unistd.h>
@@ -38,6 +41,62 @@ bool readTracepointFormat(IPerfAttrsConsumer & attrsConsumer, const char * trace
     return true;
 }
 
+std::string makeTracepointFilter(const char * filter, const std::set<int> & pids)
+{
+    const bool hasFilter = ((filter != nullptr) && (filter[0] != '\0'));
+    if (pids.empty()) {
+        return (hasFilter ? filter : "");
+    }
+
+    lib::Format pidFilter {};
+    const char * separator = "";
+    for (const int pid : pids) {
+        pidFilter << separator << "common_pid == " << pid;
+        separator = " || ";
+    }
+
+    if (!hasFilter) {
+        return pidFilter;
+    }
+    return lib::Format() << "(" << filter << ") && (" << std::string(pidFilter) << ")";
+}
+
+std::optional<TracepointField> findTracepointField(const TraceFsConstants & constants,
+                                                   const char * name,
+                                                   const std::string & field)
+{
+    const auto format = lib::FsEntry::create(getTracepointPath(constants, name, "format")).readFileContents();
+
+    std::istringstream stream {format};
+    std::string line;
+    while (std::getline(stream, line)) {
+        const auto declarationStart = line.find("field:");
+        const auto declarationEnd = line.find(';', declarationStart);
+        const auto offsetStart = line.find("offset:", declarationEnd);
+        const auto sizeStart = line.find("size:", declarationEnd);
+        if ((declarationStart == std::string::npos) || (declarationEnd == std::string::npos)
+            || (offsetStart == std::string::npos) || (sizeStart == std::string::npos)) {
+            continue;
+        }
+
+        const auto declaration = line.substr(declarationStart, declarationEnd - declarationStart);
+        const auto nameStart = declaration.find_last_of(" \t*");
+        if ((nameStart == std::string::npos) || (declaration.compare(nameStart + 1, std::string::npos, field) != 0)) {
+            continue;
+        }
+
+        const long offset = std::strtol(line.c_str() + offsetStart + std::strlen("offset:"), nullptr, 10);
+        const long size = std::strtol(line.c_str() + sizeStart + std::strlen("size:"), nullptr, 10);
+        if ((offset < 0) || (offset > INT32_MAX) || (size < 0) || (size > INT32_MAX)) {
+            return {};
+        }
+
+        return TracepointField {static_cast<int>(offset), static_cast<int>(size)};
+    }
+
+    return {};
+}
+
 int64_t getTracepointId(const char * tracefsEventsPath, const char * const name)
 {
     int64_t result;
@@ -4,6 +4,8 @@
 #define TRACEPOINTS_H
 
 #include <cstdint>
+#include <optional>
+#include <set>
 #include <string>
 
 class IPerfAttrsConsumer;
@@ -56,6 +58,31 @@ inline bool readTracepointFormat(IPerfAttrsConsumer & attrsConsumer,
     return readTracepointFormat(attrsConsumer, constants.path__events, name);
 }
 
+/** Where a field is in the raw data of a tracepoint's samples */
+struct TracepointField {
+    int offset;
+    int size;
+};
+
+/**
+ * Find a field in the tracepoint's format, whose lines look like:
+ *  `field:unsigned int nr_sector;	offset:24;	size:4;	signed:0;`
+ *
+ * @return The field, or nothing if the format could not be read or has no such field
+ */
+std::optional<TracepointField> findTracepointField(const TraceFsConstants & constants,
+                                                   const char * name,
+                                                   const std::string & field);
+
+/**
+ * Make the filter expression of a tracepoint, which the kernel applies before it writes each record
+ *
+ * @param filter The tracepoint's own filter, from its events XML, or nullptr or empty for none
+ * @param pids The processes whose records are kept, or empty to keep those of every process
+ * @return The filter, combining both, or empty for none
+ */
+std::string makeTracepointFilter(const char * filter, const std::set<int> & pids);
+
 constexpr int64_t UNKNOWN_TRACEPOINT_ID = -1;
 
 int64_t getTracepointId(const char * tracefsEventsPath, const char * name);
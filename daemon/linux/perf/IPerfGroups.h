@@ -7,6 +7,7 @@
 #include "linux/perf/attr_to_key_mapping_tracker.h"
 
 #include <cstdint>
+#include <string>
 
 class IPerfAttrsConsumer;
 
@@ -25,6 +26,8 @@ public:
         bool freq = false;
         bool task = false;
         bool context_switch = false;
+        /// the tracepoint's filter expression, set once the event is opened, or empty for none
+        std::string filter {};
     };
 
     virtual bool add(attr_to_key_mapping_tracker_t & mapping_tracker,
@@ -1,4 +1,4 @@
-/* Copyright (C) 2013-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2013-2022 by Arm Limited. All rights reserved. */
 
 #define BUFFER_USE_SESSION_DATA
 
@@ -9,7 +9,10 @@
 #include "SessionData.h"
 #include "k/perf_event.h"
 
+#include <cstddef>
 #include <cstring>
+#include <string>
+#include <string_view>
 
 PerfAttrsBuffer::PerfAttrsBuffer(const int size, sem_t & readerSem) : buffer(size, readerSem)
 {
@@ -49,6 +52,11 @@ void PerfAttrsBuffer::waitForSpace(int bytes)
 
 void PerfAttrsBuffer::marshalPea(const struct perf_event_attr * const pea, int key)
 {
+    // the host keeps the last attributes of each key, so repeating them tells it nothing
+    if (!sentAttrs.markSent(key, {reinterpret_cast<const char *>(pea), pea->size})) {
+        return;
+    }
+
     waitForSpace(2 * buffer_utils::MAXSIZE_PACK32 + pea->size);
     buffer.packInt(static_cast<int32_t>(CodeType::PEA));
     buffer.writeBytes(pea, pea->size);
@@ -83,6 +91,12 @@ void PerfAttrsBuffer::marshalKeysOld(const int keyCount,
 
 void PerfAttrsBuffer::marshalFormat(const int length, const char * const format)
 {
+    // the same tracepoint may be sent both for the perf events and for the ftrace counters
+    const std::string_view content {format, std::size_t(length)};
+    if (!sentFormats.markSent(std::string(content), content)) {
+        return;
+    }
+
     waitForSpace(buffer_utils::MAXSIZE_PACK32 + length + 1);
     buffer.packInt(static_cast<int32_t>(CodeType::FORMAT));
     buffer.writeBytes(format, length + 1);
@@ -99,6 +113,10 @@ void PerfAttrsBuffer::marshalMaps(const int pid, const int tid, const char * con
         return;
     }
 
+    if (!sentMaps.markSent({pid, tid}, {maps, std::size_t(mapsLen - 1)})) {
+        return;
+    }
+
     waitForSpace(requiredLen);
     buffer.packInt(static_cast<int32_t>(CodeType::MAPS));
     buffer.packInt(pid);
@@ -1,11 +1,15 @@
-/* Copyright (C) 2013-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2013-2022 by Arm Limited. All rights reserved. */
 
 #ifndef PERF_ATTRS_BUFFER_H
 #define PERF_ATTRS_BUFFER_H
 
 #include "Buffer.h"
+#include "lib/SentContentTracker.h"
 #include "linux/perf/IPerfAttrsConsumer.h"
 
+#include <string>
+#include <utility>
+
 struct perf_event_attr;
 
 class PerfAttrsBuffer : public IPerfAttrsConsumer {
@@ -44,6 +48,12 @@ private:
     void waitForSpace(int bytes);
 
     Buffer buffer;
+    /** The attributes sent for each key */
+    lib::SentContentTracker<int> sentAttrs {};
+    /** The tracepoint formats sent, which are keyed by themselves as each names its tracepoint */
+    lib::SentContentTracker<std::string> sentFormats {};
+    /** The maps sent for each pid/tid */
+    lib::SentContentTracker<std::pair<int, int>> sentMaps {};
 };
 
 #endif // PERF_ATTRS_BUFFER_H
@@ -14,6 +14,7 @@ struct PerfConfig {
     bool has_ioctl_read_id = false;            // >= 3.12
     bool has_aux_support = false;              // >= 4.1
     bool has_exclude_callchain_kernel = false; // >= 3.7
+    bool has_attr_sample_max_stack = false;    // >= 4.8
 
     bool is_system_wide = false;
     bool exclude_kernel = false;
@@ -10,6 +10,7 @@
 #include "ISummaryConsumer.h"
 #include "Logging.h"
 #include "SessionData.h"
+#include "agents/perf/metric_expression.h"
 #include "agents/perf/perf_driver_summary.h"
 #include "k/perf_event.h"
 #include "lib/Assert.h"
@@ -20,12 +21,22 @@
 #include "linux/Tracepoints.h"
 #include "linux/perf/IPerfGroups.h"
 #include "linux/perf/PerfAttrsBuffer.h"
+#include "linux/perf/PerfEnergyModel.h"
 #include "linux/perf/PerfEventGroupIdentifier.h"
 #include "xml/PmuXML.h"
 
+#include <algorithm>
 #include <array>
 #include <cstddef>
-
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <optional>
+#include <set>
+#include <string>
+#include <utility>
+
+#include <strings.h>
 #include <sys/utsname.h>
 #include <sys/wait.h>
 #include <unistd.h>
@@ -64,12 +75,19 @@
 #define SPE_min_latency_LO 0
 #define SPE_min_latency_HI 11
 
+// from drivers/hwtracing/coresight/coresight-etm-perf.c
+// alternatively we could read them from /sys/bus/event_source/devices/cs_etm/format/*
+#define ETM_OPT_CTXTID 14
+#define ETM_OPT_TS 28
+
 // An improved version would mask out old value be we assume 0
 #define SET_SPE_CFG(cfg, value) SPE_##cfg##_CFG |= static_cast<uint64_t>(value) << SPE_##cfg##_LO
 
 static constexpr uint64_t armv7AndLaterClockCyclesEvent = 0x11;
 static constexpr uint64_t armv7PmuDriverCycleCounterPseudoEvent = 0xFF;
 
+class PerfMetricCounter;
+
 class PerfCounter : public DriverCounter {
 public:
     static constexpr uint64_t noConfigId2 = ~0ULL;
@@ -117,6 +135,8 @@ public:
 
     [[nodiscard]] virtual bool isCpuFreqCounterFor(GatorCpu const & /*cluster*/) const { return false; }
 
+    [[nodiscard]] virtual const PerfMetricCounter * asMetric() const { return nullptr; }
+
     virtual void read(IPerfAttrsConsumer & /*unused*/, const int /* cpu */, const GatorCpu * /* cluster */) {}
 
     [[nodiscard]] inline const PerfEventGroupIdentifier & getPerfEventGroupIdentifier() const
@@ -158,9 +178,15 @@ public:
 
     inline void setSampleType(uint64_t sampleType) { attr.sampleType = sampleType; }
 
+    /** @return The filter of an events XML tracepoint counter, which may be empty, or nothing if it is not one */
+    [[nodiscard]] const std::optional<std::string> & getTracepointFilter() const { return mTracepointFilter; }
+
+    inline void setTracepointFilter(std::string filter) { mTracepointFilter = std::move(filter); }
+
 private:
     const PerfEventGroupIdentifier eventGroupIdentifier;
     IPerfGroups::Attr attr;
+    std::optional<std::string> mTracepointFilter {};
     const uint64_t mConfigId2;
     bool mFixUpClockCyclesEvent;
     bool mUsesAux;
@@ -212,6 +238,50 @@ private:
     bool use_cpuinfo;
 };
 
+/** A derived metric of a cluster's cpu PMU events, which is evaluated by the perf agent from its own counting groups */
+class PerfMetricCounter : public PerfCounter {
+public:
+    PerfMetricCounter(DriverCounter * next,
+                      const char * name,
+                      const PerfCpu & cluster,
+                      std::string expressionText,
+                      agents::perf::metric_expression_t expression,
+                      double multiplier)
+        : PerfCounter(next, PerfEventGroupIdentifier(cluster.gator_cpu), name, TYPE_DERIVED, -1, 0, 0),
+          mPmuType(cluster.pmu_type),
+          mExpressionText(std::move(expressionText)),
+          mExpression(std::move(expression)),
+          mMultiplier(multiplier)
+    {
+    }
+
+    // Intentionally undefined
+    PerfMetricCounter(const PerfMetricCounter &) = delete;
+    PerfMetricCounter & operator=(const PerfMetricCounter &) = delete;
+    PerfMetricCounter(PerfMetricCounter &&) = delete;
+    PerfMetricCounter & operator=(PerfMetricCounter &&) = delete;
+
+    [[nodiscard]] const PerfMetricCounter * asMetric() const override { return this; }
+
+    [[nodiscard]] const GatorCpu & getCluster() const { return *getPerfEventGroupIdentifier().getCluster(); }
+    [[nodiscard]] int getPmuType() const { return mPmuType; }
+    [[nodiscard]] const std::string & getExpressionText() const { return mExpressionText; }
+    [[nodiscard]] double getMultiplier() const { return mMultiplier; }
+
+    /** @return True if the metric is computed from the event */
+    [[nodiscard]] bool usesEvent(uint64_t event) const
+    {
+        const auto events = mExpression.get_events();
+        return std::find(events.begin(), events.end(), event) != events.end();
+    }
+
+private:
+    int mPmuType;
+    std::string mExpressionText;
+    agents::perf::metric_expression_t mExpression;
+    double mMultiplier;
+};
+
 template<typename T>
 inline static T & neverNull(T * t)
 {
@@ -375,6 +445,8 @@ PerfDriver::PerfDriver(PerfDriverConfiguration && configuration,
         addMidgardHwTracepoints(maliFamilyName);
     }
 
+    addBlockIoCounters();
+
     //Adding for performance counters for perf software
     setCounters(new PerfCounter(getCounters(),
                                 PerfEventGroupIdentifier(),
@@ -494,9 +566,21 @@ void PerfDriver::addCpuCounters(const PerfCpu & perfCpu)
                                     getConfig().has_armv7_pmu_driver));
     }
 
-    for (int j = 0; j < cpu.getPmncCounters(); ++j) {
+    // when multiplexing, the counters are split into groups of pmncCounters that are rotated onto the PMU in turn,
+    // leaving only the cycle counter (which has its own dedicated counter) in the group that is always active
+    const bool multiplex = (gSessionData.mPmuMultiplexQuantumMs > 0) && (cpu.getPmncCounters() > 0);
+    const int numberOfSlots = cpu.getPmncCounters() * (multiplex ? PMU_MULTIPLEX_GROUPS : 1);
+
+    for (int j = 0; j < numberOfSlots; ++j) {
         lib::dyn_printf_str_t name {"%s_cnt%d", cpu.getId(), j};
-        setCounters(new PerfCounter(getCounters(), PerfEventGroupIdentifier(cpu), name, type, -1, PERF_SAMPLE_READ, 0));
+        setCounters(new PerfCounter(getCounters(),
+                                    (multiplex ? PerfEventGroupIdentifier(cpu, 1 + (j / cpu.getPmncCounters()))
+                                               : PerfEventGroupIdentifier(cpu)),
+                                    name,
+                                    type,
+                                    -1,
+                                    PERF_SAMPLE_READ,
+                                    0));
     }
 
     const char * speId = cpu.getSpeName();
@@ -524,10 +608,121 @@ void PerfDriver::addUncoreCounters(const PerfUncore & perfUncore)
     }
 }
 
+void PerfDriver::readMetrics(mxml_node_t * const xml)
+{
+    for (mxml_node_t * node = mxmlFindElement(xml, xml, "event", "expression", nullptr, MXML_DESCEND); node != nullptr;
+         node = mxmlFindElement(node, xml, "event", "expression", nullptr, MXML_DESCEND)) {
+        const char * counter = mxmlElementGetAttr(node, "counter");
+        if (counter == nullptr) {
+            continue;
+        }
+
+        // the metrics are named <cluster>_metric_<name>
+        const auto cluster = std::find_if(mConfig.cpus.begin(), mConfig.cpus.end(), [counter](const PerfCpu & cpu) {
+            const std::string prefix = std::string(cpu.gator_cpu.getId()) + "_metric_";
+            return strncmp(counter, prefix.c_str(), prefix.size()) == 0;
+        });
+        if (cluster == mConfig.cpus.end()) {
+            continue;
+        }
+
+        const char * expressionText = mxmlElementGetAttr(node, "expression");
+        std::string error;
+        auto expression = agents::perf::metric_expression_t::parse(expressionText, error);
+        if (!expression) {
+            LOG_ERROR("The metric counter %s has an invalid expression '%s' (%s)",
+                      counter,
+                      expressionText,
+                      error.c_str());
+            handleException();
+        }
+
+        // the group must fit on the PMU at once; the cycles may be counted by the dedicated cycle counter
+        const auto events = expression->get_events();
+        const auto usesCycles =
+            (std::find(events.begin(), events.end(), armv7AndLaterClockCyclesEvent) != events.end());
+        const auto countersNeeded = static_cast<int>(events.size()) - (usesCycles ? 1 : 0);
+        if (countersNeeded > cluster->gator_cpu.getPmncCounters()) {
+            LOG_SETUP("%s is disabled\nIt needs %d counters, but %s has %d",
+                      counter,
+                      countersNeeded,
+                      cluster->gator_cpu.getCoreName(),
+                      cluster->gator_cpu.getPmncCounters());
+            continue;
+        }
+
+        const char * multiplierText = mxmlElementGetAttr(node, "multiplier");
+        const double multiplier = (multiplierText != nullptr ? strtod(multiplierText, nullptr) : 1);
+        if (multiplier <= 0) {
+            LOG_ERROR("The metric counter %s has an invalid multiplier '%s'", counter, multiplierText);
+            handleException();
+        }
+
+        LOG_DEBUG("Using the perf agent for the metric %s = %s", counter, expressionText);
+        setCounters(new PerfMetricCounter(getCounters(),
+                                          counter,
+                                          *cluster,
+                                          expressionText,
+                                          std::move(*expression),
+                                          multiplier));
+    }
+}
+
+std::vector<agents::perf::perf_capture_configuration_t::cpu_metric_t> PerfDriver::getCpuMetrics() const
+{
+    std::vector<agents::perf::perf_capture_configuration_t::cpu_metric_t> result;
+
+    const auto clusters = mCpuInfo.getClusters();
+    for (auto * counter = static_cast<PerfCounter *>(getCounters()); counter != nullptr;
+         counter = static_cast<PerfCounter *>(counter->getNext())) {
+        const auto * metric = counter->asMetric();
+        if ((metric == nullptr) || !metric->isEnabled()) {
+            continue;
+        }
+
+        const auto cluster = std::find(clusters.begin(), clusters.end(), metric->getCluster());
+        if (cluster == clusters.end()) {
+            continue;
+        }
+
+        result.push_back({static_cast<std::uint32_t>(cluster - clusters.begin()),
+                          static_cast<std::uint32_t>(metric->getPmuType()),
+                          metric->getKey(),
+                          metric->getExpressionText(),
+                          metric->getMultiplier()});
+    }
+
+    return result;
+}
+
+bool PerfDriver::isSuppressedMetricInput(const PerfCounter & counter, const uint64_t event) const
+{
+    const auto * cluster = counter.getPerfEventGroupIdentifier().getCluster();
+    if ((cluster == nullptr) || (counter.asMetric() != nullptr)) {
+        return false;
+    }
+
+    for (auto & configured : gSessionData.mCounters) {
+        if (!configured.isEnabled() || (configured.getDriver() != this)) {
+            continue;
+        }
+
+        const auto * found = static_cast<const PerfCounter *>(findCounter(configured));
+        const auto * metric = (found != nullptr ? found->asMetric() : nullptr);
+        if ((metric != nullptr) && (metric->getCluster() == *cluster) && metric->usesEvent(event)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
 void PerfDriver::readEvents(mxml_node_t * const xml)
 {
     mxml_node_t * node = xml;
 
+    readMetrics(xml);
+
     // Only for use with perf
     if (!getConfig().can_access_tracepoints) {
         return;
@@ -569,17 +764,20 @@ void PerfDriver::readEvents(mxml_node_t * const xml)
         }
 
         const char * arg = mxmlElementGetAttr(node, "arg");
+        const char * filter = mxmlElementGetAttr(node, "filter");
 
         long long id = _getTracepointId(traceFsConstants, counter, tracepoint);
         if (id >= 0) {
             LOG_DEBUG("Using perf for %s", counter);
-            setCounters(new PerfCounter(getCounters(),
-                                        PerfEventGroupIdentifier(),
-                                        counter,
-                                        PERF_TYPE_TRACEPOINT,
-                                        id,
-                                        arg == nullptr ? 0 : PERF_SAMPLE_RAW,
-                                        1));
+            auto * const perfCounter = new PerfCounter(getCounters(),
+                                                       PerfEventGroupIdentifier(),
+                                                       counter,
+                                                       PERF_TYPE_TRACEPOINT,
+                                                       id,
+                                                       arg == nullptr ? 0 : PERF_SAMPLE_RAW,
+                                                       1);
+            perfCounter->setTracepointFilter(filter == nullptr ? "" : filter);
+            setCounters(perfCounter);
             mTracepoints = new PerfTracepoint(mTracepoints, getCounters(), tracepoint);
         }
     }
@@ -675,19 +873,239 @@ void PerfDriver::addMidgardHwTracepoints(const char * const maliFamilyName)
         mTracepoints = new PerfTracepoint(mTracepoints, getCounters(), MALI_TRC_PNT_PATH[MALI_MMU_TOTAL_ALLOC]);
     }
 
-    // for activity counters
+    // for activity counters, which are in job slot order
     id = _getTracepointId(traceFsConstants, MALI_JOB_SLOT, MALI_TRC_PNT_PATH[MALI_JOB_SLOT]);
     if (id >= 0) {
         lib::printf_str_t<buffer_size> buf {"ARM_Mali-%s_fragment", maliFamilyName};
         addCounter(buf, id);
         mTracepoints = new PerfTracepoint(mTracepoints, getCounters(), MALI_TRC_PNT_PATH[MALI_JOB_SLOT]);
+        mJobSlotCounters[0] = static_cast<PerfCounter *>(getCounters());
         buf.printf("ARM_Mali-%s_vertex", maliFamilyName);
         addCounter(buf, id);
         mTracepoints = new PerfTracepoint(mTracepoints, getCounters(), MALI_TRC_PNT_PATH[MALI_JOB_SLOT]);
+        mJobSlotCounters[1] = static_cast<PerfCounter *>(getCounters());
         buf.printf("ARM_Mali-%s_opencl", maliFamilyName);
         addCounter(buf, id);
         mTracepoints = new PerfTracepoint(mTracepoints, getCounters(), MALI_TRC_PNT_PATH[MALI_JOB_SLOT]);
+        mJobSlotCounters[2] = static_cast<PerfCounter *>(getCounters());
+    }
+
+    // for the GPU frequency, which records every DVFS change as it happens rather than sampling the clock
+    id = _getTracepointId(traceFsConstants, MALI_GPU_FREQUENCY, MALI_TRC_PNT_PATH[MALI_GPU_FREQUENCY]);
+    if (id >= 0) {
+        lib::printf_str_t<buffer_size> buf {"ARM_Mali-%s_GPU_FREQUENCY", maliFamilyName};
+        addCounter(buf, id);
+        mTracepoints = new PerfTracepoint(mTracepoints, getCounters(), MALI_TRC_PNT_PATH[MALI_GPU_FREQUENCY]);
+        mHasGpuFrequencyTracepoint = true;
+    }
+
+    // for the GPU time of each uid, which stock kernels report for the GPU work period of each uid
+    id = _getTracepointId(traceFsConstants, MALI_GPU_WORK_PERIOD, MALI_TRC_PNT_PATH[MALI_GPU_WORK_PERIOD]);
+    if (id >= 0) {
+        lib::printf_str_t<buffer_size> buf {"ARM_Mali-%s_GPU_WORK_PERIOD", maliFamilyName};
+        addCounter(buf, id);
+        mTracepoints = new PerfTracepoint(mTracepoints, getCounters(), MALI_TRC_PNT_PATH[MALI_GPU_WORK_PERIOD]);
+        mGpuWorkPeriodCounter = static_cast<PerfCounter *>(getCounters());
+    }
+}
+
+agents::perf::gpu_timeline_config_t PerfDriver::getGpuTimeline() const
+{
+    agents::perf::gpu_timeline_config_t result {};
+
+    if (!getConfig().can_access_tracepoints) {
+        return result;
+    }
+
+    const auto findField = [this](const char * tracepoint, const char * field) {
+        const auto found = findTracepointField(traceFsConstants, tracepoint, field);
+        if (!found) {
+            return agents::perf::tracepoint_field_t {0, 0};
+        }
+        return agents::perf::tracepoint_field_t {static_cast<std::uint32_t>(found->offset),
+                                                 static_cast<std::uint32_t>(found->size)};
+    };
+
+    bool anyJobSlot = false;
+    result.job_slot_keys.resize(mJobSlotCounters.size(), agents::perf::gator_key_t {0});
+    for (std::size_t slot = 0; slot < mJobSlotCounters.size(); ++slot) {
+        const auto * counter = mJobSlotCounters[slot];
+        if ((counter != nullptr) && counter->isEnabled()) {
+            result.job_slot_keys[slot] = agents::perf::gator_key_t(counter->getKey());
+            anyJobSlot = true;
+        }
+    }
+
+    if (anyJobSlot) {
+        const char * const tracepoint = MALI_TRC_PNT_PATH[MALI_JOB_SLOT];
+        result.job_slot_event_id = findField(tracepoint, "event_id");
+        result.job_slot_tgid = findField(tracepoint, "tgid");
+        result.job_slot_pid = findField(tracepoint, "pid");
+        if (result.job_slot_event_id.size == 0) {
+            LOG_DEBUG("The %s tracepoint has no event_id, so its samples are sent as they are", tracepoint);
+            result.job_slot_keys.clear();
+        }
+    }
+    else {
+        result.job_slot_keys.clear();
     }
+
+    if ((mGpuWorkPeriodCounter != nullptr) && mGpuWorkPeriodCounter->isEnabled()) {
+        const char * const tracepoint = MALI_TRC_PNT_PATH[MALI_GPU_WORK_PERIOD];
+        result.work_period_gpu_id = findField(tracepoint, "gpu_id");
+        result.work_period_uid = findField(tracepoint, "uid");
+        result.work_period_start_time = findField(tracepoint, "start_time_ns");
+        result.work_period_end_time = findField(tracepoint, "end_time_ns");
+        result.work_period_active_duration = findField(tracepoint, "total_active_duration_ns");
+        if ((result.work_period_uid.size != 0) && (result.work_period_active_duration.size != 0)) {
+            result.work_period_key = agents::perf::gator_key_t(mGpuWorkPeriodCounter->getKey());
+        }
+        else {
+            LOG_DEBUG("The %s tracepoint does not have the expected fields, so its samples are sent as they are",
+                      tracepoint);
+        }
+    }
+
+    return result;
+}
+
+void PerfDriver::addBlockIoCounters()
+{
+    static constexpr std::size_t buffer_size = 64;
+
+    // the requests of every process are paired, which needs their completions too
+    if (!getConfig().is_system_wide || !getConfig().can_access_tracepoints) {
+        return;
+    }
+
+    if ((_getTracepointId(traceFsConstants, "Block I/O: Latency", BLOCK_RQ_ISSUE) < 0)
+        || (_getTracepointId(traceFsConstants, "Block I/O: Latency", BLOCK_RQ_COMPLETE) < 0)) {
+        return;
+    }
+
+    const auto addCounter = [this](const char * name) {
+        setCounters(new PerfCounter(getCounters(), PerfEventGroupIdentifier(), name, TYPE_DERIVED, -1, 0, 0));
+        return static_cast<PerfCounter *>(getCounters());
+    };
+
+    for (std::size_t bucket = 0; bucket < mBlockIoLatencyCounters.size(); ++bucket) {
+        lib::printf_str_t<buffer_size> buf {"Linux_block_io_latency_%zu", bucket};
+        mBlockIoLatencyCounters[bucket] = addCounter(buf);
+    }
+    mBlockIoAverageLatencyCounter = addCounter("Linux_block_io_latency_avg");
+    mBlockIoQueueDepthCounter = addCounter("Linux_block_io_queue_depth");
+
+    mBlockIoIssueKey = getEventKey();
+    mBlockIoCompleteKey = getEventKey();
+}
+
+agents::perf::block_io_config_t PerfDriver::getBlockIo() const
+{
+    agents::perf::block_io_config_t result {};
+
+    const auto keyOf = [](const PerfCounter * counter) {
+        return agents::perf::gator_key_t((counter != nullptr) && counter->isEnabled() ? counter->getKey() : 0);
+    };
+
+    for (const auto * counter : mBlockIoLatencyCounters) {
+        result.latency_keys.push_back(keyOf(counter));
+    }
+    result.average_latency_key = keyOf(mBlockIoAverageLatencyCounter);
+    result.queue_depth_key = keyOf(mBlockIoQueueDepthCounter);
+    result.issue_key = agents::perf::gator_key_t(mBlockIoIssueKey);
+    result.complete_key = agents::perf::gator_key_t(mBlockIoCompleteKey);
+
+    if (!result.is_enabled()) {
+        return {};
+    }
+
+    const auto findField = [this](const char * tracepoint, const char * field) {
+        const auto found = findTracepointField(traceFsConstants, tracepoint, field);
+        if (!found) {
+            return agents::perf::tracepoint_field_t {0, 0};
+        }
+        return agents::perf::tracepoint_field_t {static_cast<std::uint32_t>(found->offset),
+                                                 static_cast<std::uint32_t>(found->size)};
+    };
+
+    result.issue_dev = findField(BLOCK_RQ_ISSUE, "dev");
+    result.issue_sector = findField(BLOCK_RQ_ISSUE, "sector");
+    result.complete_dev = findField(BLOCK_RQ_COMPLETE, "dev");
+    result.complete_sector = findField(BLOCK_RQ_COMPLETE, "sector");
+    if ((result.issue_dev.size == 0) || (result.issue_sector.size == 0) || (result.complete_dev.size == 0)
+        || (result.complete_sector.size == 0)) {
+        LOG_DEBUG("The block tracepoints do not have the expected fields, so the block I/O counters are not available");
+        return {};
+    }
+
+    return result;
+}
+
+agents::perf::lock_contention_config_t PerfDriver::getLockContention() const
+{
+    if (!mLockContention) {
+        return {};
+    }
+
+    const auto findField = [this](const char * tracepoint, const char * field) {
+        const auto found = findTracepointField(traceFsConstants, tracepoint, field);
+        if (!found) {
+            return agents::perf::tracepoint_field_t {0, 0};
+        }
+        return agents::perf::tracepoint_field_t {static_cast<std::uint32_t>(found->offset),
+                                                 static_cast<std::uint32_t>(found->size)};
+    };
+
+    agents::perf::lock_contention_config_t result {};
+    result.begin_key = agents::perf::gator_key_t(mLockContention->beginKey);
+    result.end_key = agents::perf::gator_key_t(mLockContention->endKey);
+
+    const bool isFutex = (strcmp(mLockContention->beginTracepoint, SYS_ENTER_FUTEX) == 0);
+    result.begin_address = findField(mLockContention->beginTracepoint, (isFutex ? "uaddr" : "lock_addr"));
+    if (isFutex) {
+        result.begin_op = findField(mLockContention->beginTracepoint, "op");
+    }
+    if ((result.begin_address.size == 0) || (isFutex && (result.begin_op.size == 0))) {
+        LOG_DEBUG("The %s tracepoint does not have the expected fields, so lock contention is not available",
+                  mLockContention->beginTracepoint);
+        return {};
+    }
+
+    return result;
+}
+
+agents::perf::thread_energy_config_t PerfDriver::getThreadEnergy() const
+{
+    if (mThreadEnergyFrequencyKey == 0) {
+        return {};
+    }
+
+    const auto findField = [this](const char * tracepoint, const char * field) {
+        const auto found = findTracepointField(traceFsConstants, tracepoint, field);
+        if (!found) {
+            return agents::perf::tracepoint_field_t {0, 0};
+        }
+        return agents::perf::tracepoint_field_t {static_cast<std::uint32_t>(found->offset),
+                                                 static_cast<std::uint32_t>(found->size)};
+    };
+
+    agents::perf::thread_energy_config_t result {};
+    result.sched_switch_key = agents::perf::gator_key_t(mThreadEnergySwitchKey);
+    result.switch_prev_tid = findField(SCHED_SWITCH, "prev_pid");
+    result.switch_next_tid = findField(SCHED_SWITCH, "next_pid");
+    result.cpu_frequency_key = agents::perf::gator_key_t(mThreadEnergyFrequencyKey);
+    result.frequency_state = findField(CPU_FREQUENCY, "state");
+    result.frequency_cpu_id = findField(CPU_FREQUENCY, "cpu_id");
+    result.domains = mEnergyDomains;
+
+    if (!result.is_enabled()) {
+        LOG_DEBUG("The %s or %s tracepoint does not have the expected fields, so thread energy is not available",
+                  SCHED_SWITCH,
+                  CPU_FREQUENCY);
+        return {};
+    }
+
+    return result;
 }
 
 std::optional<std::uint64_t> PerfDriver::summary(ISummaryConsumer & consumer,
@@ -750,6 +1168,13 @@ void PerfDriver::setupCounter(Counter & counter)
               perfCounter->getName(),
               (optionalEventCode.isValid() ? optionalEventCode.asU64() : 0));
 
+    if (gSessionData.mSuppressMetricInputs && optionalEventCode.isValid()
+        && isSuppressedMetricInput(*perfCounter, optionalEventCode.asU64())) {
+        LOG_DEBUG("Not capturing %s as it is an input to a selected metric", perfCounter->getName());
+        counter.setEnabled(false);
+        return;
+    }
+
     // Don't use the config from counters XML if it's not set, ex: software counters
     if (optionalEventCode.isValid()) {
         perfCounter->setConfig(optionalEventCode.asU64());
@@ -808,6 +1233,14 @@ std::optional<CapturedSpe> PerfDriver::setupSpe(int sampleRate, const SpeConfigu
             }
             counter->setEnabled(true);
 
+            if (spe.record_filter.isEnabled()) {
+                LOG_DEBUG("SPE: Filtering records in the agent");
+                mSpeRecordFilters[spe.id] = spe.record_filter;
+            }
+            else {
+                mSpeRecordFilters.erase(spe.id);
+            }
+
             return {{spe.id, counter->getKey()}};
         }
     }
@@ -849,6 +1282,82 @@ bool PerfDriver::enable(IPerfGroups & group, attr_to_key_mapping_tracker_t & map
         }
     }
 
+    for (const auto & probe : mFunctionProbes) {
+        if (!enableFunctionProbeTracepoint(group, mapping_tracker, probe.tracepoints.entryId, probe.entryKey)
+            || !enableFunctionProbeTracepoint(group, mapping_tracker, probe.tracepoints.returnId, probe.returnKey)) {
+            LOG_DEBUG("PerfGroups::add failed for the function probe %s", probe.tracepoints.entryName.c_str());
+            return false;
+        }
+    }
+
+    // the block I/O counters are derived by the agent from every block request's issue and completion
+    if (getBlockIo().is_enabled()) {
+        IPerfGroups::Attr attr;
+        attr.type = PERF_TYPE_TRACEPOINT;
+        attr.periodOrFreq = 1;
+        attr.sampleType = PERF_SAMPLE_RAW;
+        for (const auto & [tracepoint, key] : {std::make_pair(BLOCK_RQ_ISSUE, mBlockIoIssueKey),
+                                               std::make_pair(BLOCK_RQ_COMPLETE, mBlockIoCompleteKey)}) {
+            attr.config = getTracepointId(traceFsConstants, tracepoint);
+            if (!group.add(mapping_tracker, PerfEventGroupIdentifier(), key, attr, false)) {
+                LOG_DEBUG("PerfGroups::add failed for %s", tracepoint);
+                return false;
+            }
+        }
+    }
+
+    // the lock wait times are paired by the agent from the start and end of every wait, with the start's call chain
+    // for its call site
+    if (getLockContention().is_enabled()) {
+        const auto addEvent = [&](const char * tracepoint, int key, std::uint64_t sampleType) {
+            IPerfGroups::Attr attr;
+            attr.type = PERF_TYPE_TRACEPOINT;
+            attr.config = getTracepointId(traceFsConstants, tracepoint);
+            attr.periodOrFreq = 1;
+            attr.sampleType = sampleType;
+            if (!group.add(mapping_tracker, PerfEventGroupIdentifier(), key, attr, false)) {
+                LOG_DEBUG("PerfGroups::add failed for %s", tracepoint);
+                return false;
+            }
+            return true;
+        };
+
+        if (!addEvent(mLockContention->beginTracepoint,
+                      mLockContention->beginKey,
+                      PERF_SAMPLE_RAW | PERF_SAMPLE_CALLCHAIN)
+            || !addEvent(mLockContention->endTracepoint, mLockContention->endKey, PERF_SAMPLE_RAW)) {
+            return false;
+        }
+    }
+
+    // the thread energies are combined by the agent from the sched_switch events that lead each cpu's group and the
+    // changes of frequency, which are of its own event so that they are not confused with the frequency counter's
+    if (mThreadEnergyFrequencyKey != 0) {
+        IPerfGroups::Attr attr;
+        attr.type = PERF_TYPE_TRACEPOINT;
+        attr.config = getTracepointId(traceFsConstants, CPU_FREQUENCY);
+        attr.periodOrFreq = 1;
+        attr.sampleType = PERF_SAMPLE_RAW;
+        if (!group.add(mapping_tracker, PerfEventGroupIdentifier(), mThreadEnergyFrequencyKey, attr, false)) {
+            LOG_DEBUG("PerfGroups::add failed for %s", CPU_FREQUENCY);
+            return false;
+        }
+    }
+
+    if (mEtm) {
+        // trace the whole program flow with timestamps, and the context id so the trace can be attributed to each
+        // process; filters and strobing are applied by the agent
+        IPerfGroups::Attr attr;
+        attr.type = mEtm->first;
+        attr.config = (1ULL << ETM_OPT_TS) | (1ULL << ETM_OPT_CTXTID);
+        attr.periodOrFreq = 0;
+        attr.context_switch = getConfig().has_attr_context_switch;
+        if (!group.add(mapping_tracker, PerfEventGroupIdentifier(), mEtm->second, attr, true)) {
+            LOG_DEBUG("PerfGroups::add failed for the ETM");
+            return false;
+        }
+    }
+
     for (auto * counter = static_cast<PerfCounter *>(getCounters()); counter != nullptr;
          counter = static_cast<PerfCounter *>(counter->getNext())) {
         if (counter->isEnabled() && (counter->getAttr().type != TYPE_DERIVED)) {
@@ -861,27 +1370,8 @@ bool PerfDriver::enable(IPerfGroups & group, attr_to_key_mapping_tracker_t & map
 
             sentMaliJobSlotEvents |= isMaliJobSlotEvents;
 
-            if (!skip) {
-                if (group.add(mapping_tracker,
-                              counter->getPerfEventGroupIdentifier(),
-                              counter->getKey(),
-                              counter->getAttr(),
-                              counter->usesAux())) {
-                    if (counter->hasConfigId2()) {
-                        if (!group.add(mapping_tracker,
-                                       counter->getPerfEventGroupIdentifier(),
-                                       counter->getKey() | 0x40000000,
-                                       counter->getAttr2(),
-                                       counter->usesAux())) {
-                            LOG_DEBUG("PerfGroups::add (2nd) failed");
-                            return false;
-                        }
-                    }
-                }
-                else {
-                    LOG_DEBUG("PerfGroups::add failed");
-                    return false;
-                }
+            if (!skip && !addCounterEvents(group, mapping_tracker, *counter)) {
+                return false;
             }
         }
     }
@@ -889,6 +1379,164 @@ bool PerfDriver::enable(IPerfGroups & group, attr_to_key_mapping_tracker_t & map
     return true;
 }
 
+bool PerfDriver::addCounterEvents(IPerfGroups & group,
+                                  attr_to_key_mapping_tracker_t & mapping_tracker,
+                                  const PerfCounter & counter) const
+{
+    auto attr = counter.getAttr();
+
+    // the kernel drops the tracepoint's records that do not match its filter, or that are of another process when
+    // only the --pid processes' are wanted (application mode events are of the launched process already)
+    const auto & filter = counter.getTracepointFilter();
+    if (filter) {
+        const bool filterPids = (getConfig().is_system_wide && gSessionData.mFilterPidTracepoints);
+        attr.filter = makeTracepointFilter(filter->c_str(), (filterPids ? gSessionData.mPids : std::set<int> {}));
+    }
+
+    if (!group.add(mapping_tracker, counter.getPerfEventGroupIdentifier(), counter.getKey(), attr, counter.usesAux())) {
+        LOG_DEBUG("PerfGroups::add failed");
+        return false;
+    }
+
+    if (counter.hasConfigId2()
+        && !group.add(mapping_tracker,
+                      counter.getPerfEventGroupIdentifier(),
+                      counter.getKey() | 0x40000000,
+                      counter.getAttr2(),
+                      counter.usesAux())) {
+        LOG_DEBUG("PerfGroups::add (2nd) failed");
+        return false;
+    }
+
+    return true;
+}
+
+std::vector<PerfCounter *> PerfDriver::reconfigureCounters(const std::set<CounterConfiguration> & counterConfigurations,
+                                                           std::set<int> & removedKeys)
+{
+    // only the cpu and software events can be changed; the uncore, SPE and metric counters are left as they are
+    const auto isReconfigurable = [](const PerfCounter & perfCounter) {
+        const auto type = perfCounter.getPerfEventGroupIdentifier().getType();
+        return ((type == PerfEventGroupIdentifier::Type::GLOBAL)
+                || (type == PerfEventGroupIdentifier::Type::PER_CLUSTER_CPU))
+            && !perfCounter.usesAux() && (perfCounter.getAttr().type != TYPE_DERIVED);
+    };
+
+    const auto findConfiguration = [&counterConfigurations](const char * name) {
+        return std::find_if(counterConfigurations.begin(),
+                            counterConfigurations.end(),
+                            [name](const CounterConfiguration & config) {
+                                return strcasecmp(config.counterName.c_str(), name) == 0;
+                            });
+    };
+
+    const auto removeEvents = [&removedKeys](PerfCounter & perfCounter) {
+        removedKeys.insert(perfCounter.getKey());
+        if (perfCounter.hasConfigId2()) {
+            removedKeys.insert(perfCounter.getKey() | 0x40000000);
+        }
+        perfCounter.setEnabled(false);
+    };
+
+    std::vector<PerfCounter *> added {};
+
+    // remove the counters that are no longer wanted, and change those whose event or sample period changed
+    for (auto & counter : gSessionData.mCounters) {
+        if (!counter.isEnabled() || (counter.getDriver() != this)) {
+            continue;
+        }
+
+        auto * const perfCounter = static_cast<PerfCounter *>(findCounter(counter));
+        if ((perfCounter == nullptr) || !perfCounter->isEnabled() || !isReconfigurable(*perfCounter)) {
+            continue;
+        }
+
+        const auto it = findConfiguration(counter.getType());
+        if (it == counterConfigurations.end()) {
+            // the counter stays in the session's counters, so that what it counted so far is still described by
+            // captured.xml
+            LOG_DEBUG("Removing perf counter %s", counter.getType());
+            removeEvents(*perfCounter);
+            continue;
+        }
+
+        if ((!it->event.isValid() || (it->event == counter.getEventCode())) && (it->count == counter.getCount())) {
+            continue;
+        }
+
+        // a changed counter keeps its key, and has its events removed then added again
+        LOG_DEBUG("Changing perf counter %s", counter.getType());
+        removeEvents(*perfCounter);
+        if (it->event.isValid()) {
+            counter.setEventCode(it->event);
+        }
+        counter.setCount(it->count);
+        setupCounter(counter);
+        if (counter.isEnabled()) {
+            added.push_back(perfCounter);
+        }
+    }
+
+    // then add the new counters, in the free slots of the session's counters
+    for (const auto & config : counterConfigurations) {
+        const auto existing = std::find_if(std::begin(gSessionData.mCounters),
+                                           std::end(gSessionData.mCounters),
+                                           [&config](const Counter & counter) {
+                                               return counter.isEnabled()
+                                                   && (strcasecmp(config.counterName.c_str(), counter.getType()) == 0);
+                                           });
+        if (existing != std::end(gSessionData.mCounters)) {
+            continue;
+        }
+
+        const auto slot = std::find_if(std::begin(gSessionData.mCounters),
+                                       std::end(gSessionData.mCounters),
+                                       [](const Counter & counter) { return !counter.isEnabled(); });
+        if (slot == std::end(gSessionData.mCounters)) {
+            LOG_WARNING("Too many counters, %s is not added to the capture", config.counterName.c_str());
+            break;
+        }
+
+        Counter & counter = *slot;
+        counter.clear();
+        counter.setType(config.counterName.c_str());
+        if (config.event.isValid()) {
+            counter.setEventCode(config.event);
+        }
+        counter.setCount(config.count);
+        counter.setCores(config.cores);
+        counter.setEnabled(true);
+
+        if (!claimCounter(counter)) {
+            LOG_WARNING("Only the perf counters can be added while capturing, %s is not added",
+                        config.counterName.c_str());
+            counter.clear();
+            continue;
+        }
+
+        counter.setDriver(this);
+        setupCounter(counter);
+
+        auto * const perfCounter = static_cast<PerfCounter *>(findCounter(counter));
+        if (!counter.isEnabled() || (perfCounter == nullptr)) {
+            counter.clear();
+            continue;
+        }
+
+        if (!isReconfigurable(*perfCounter)) {
+            LOG_WARNING("The counter %s can not be added while capturing", config.counterName.c_str());
+            perfCounter->setEnabled(false);
+            counter.clear();
+            continue;
+        }
+
+        LOG_DEBUG("Adding perf counter %s", counter.getType());
+        added.push_back(perfCounter);
+    }
+
+    return added;
+}
+
 bool PerfDriver::enableGatorTracePoint(IPerfGroups & group,
                                        attr_to_key_mapping_tracker_t & mapping_tracker,
                                        long long id) const
@@ -902,6 +1550,154 @@ bool PerfDriver::enableGatorTracePoint(IPerfGroups & group,
     return group.add(mapping_tracker, PerfEventGroupIdentifier(), key, attr, false);
 }
 
+bool PerfDriver::enableFunctionProbeTracepoint(IPerfGroups & group,
+                                               attr_to_key_mapping_tracker_t & mapping_tracker,
+                                               std::int64_t id,
+                                               int key) const
+{
+    // the agent pairs the entry and return samples by thread and time, so no raw data is needed
+    IPerfGroups::Attr attr;
+    attr.type = PERF_TYPE_TRACEPOINT;
+    attr.config = id;
+    attr.periodOrFreq = 1;
+    attr.sampleType = PERF_SAMPLE_TID;
+    return group.add(mapping_tracker, PerfEventGroupIdentifier(), key, attr, false);
+}
+
+void PerfDriver::createFunctionProbes()
+{
+    mFunctionProbes.clear();
+
+    if (gSessionData.mFunctionProbes.empty()) {
+        return;
+    }
+
+    if (!getConfig().can_access_tracepoints) {
+        LOG_SETUP("Function probes are disabled\nThe tracepoints are not accessible");
+        return;
+    }
+
+    perf_function_probes::removeProbes(traceFsConstants);
+
+    for (std::size_t index = 0; index < gSessionData.mFunctionProbes.size(); ++index) {
+        auto tracepoints =
+            perf_function_probes::createProbe(traceFsConstants, index, gSessionData.mFunctionProbes[index]);
+        if (tracepoints) {
+            const int entryKey = getEventKey();
+            const int returnKey = getEventKey();
+            mFunctionProbes.push_back({std::move(*tracepoints), entryKey, returnKey});
+        }
+    }
+}
+
+void PerfDriver::createEtmEvent()
+{
+    mEtm.reset();
+
+    if (!gSessionData.mEtmTrace) {
+        return;
+    }
+
+    int type = 0;
+    if (lib::readIntFromFile("/sys/bus/event_source/devices/cs_etm/type", type) != 0) {
+        LOG_SETUP("ETM trace is disabled\nThe cs_etm PMU was not found");
+        return;
+    }
+
+    // the ETM and the SPE would both write to the one aux buffer of each cpu
+    for (auto * counter = static_cast<PerfCounter *>(getCounters()); counter != nullptr;
+         counter = static_cast<PerfCounter *>(counter->getNext())) {
+        if (counter->isEnabled() && counter->usesAux()) {
+            LOG_SETUP("ETM trace is disabled\nIt cannot be captured together with SPE");
+            return;
+        }
+    }
+
+    mEtm = {static_cast<std::uint32_t>(type), getEventKey()};
+}
+
+bool PerfDriver::usesAuxBuffers() const
+{
+    if (mEtm) {
+        return true;
+    }
+
+    for (const auto * counter = static_cast<const PerfCounter *>(getCounters()); counter != nullptr;
+         counter = static_cast<const PerfCounter *>(counter->getNext())) {
+        if (counter->isEnabled() && counter->usesAux()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void PerfDriver::createLockContentionEvents()
+{
+    mLockContention.reset();
+
+    if (!gSessionData.mLockContention) {
+        return;
+    }
+
+    if (!getConfig().can_access_tracepoints) {
+        LOG_SETUP("Lock contention is disabled\nThe tracepoints are not accessible");
+        return;
+    }
+
+    // prefer the futex syscalls, which are of the user space locks, over the kernel's own locks
+    for (const auto & [begin, end] : {std::make_pair(SYS_ENTER_FUTEX, SYS_EXIT_FUTEX),
+                                      std::make_pair(LOCK_CONTENTION_BEGIN, LOCK_CONTENTION_END)}) {
+        if ((getTracepointId(traceFsConstants, begin) > 0) && (getTracepointId(traceFsConstants, end) > 0)) {
+            const int beginKey = getEventKey();
+            const int endKey = getEventKey();
+            mLockContention = {begin, end, beginKey, endKey};
+            return;
+        }
+    }
+
+    LOG_SETUP("Lock contention is disabled\nNeither %s nor %s was found", SYS_ENTER_FUTEX, LOCK_CONTENTION_BEGIN);
+}
+
+void PerfDriver::createThreadEnergyEvents(int schedSwitchKey)
+{
+    mThreadEnergySwitchKey = 0;
+    mThreadEnergyFrequencyKey = 0;
+    mEnergyDomains.clear();
+
+    if (!gSessionData.mThreadEnergy) {
+        return;
+    }
+
+    // only the sched_switch events of a system-wide capture have every switch of every cpu
+    if (!getConfig().is_system_wide || !getConfig().can_access_tracepoints) {
+        LOG_SETUP("Thread energy is disabled\nIt requires a system-wide capture with access to the tracepoints");
+        return;
+    }
+
+    if (getTracepointId(traceFsConstants, CPU_FREQUENCY) <= 0) {
+        LOG_SETUP("Thread energy is disabled\n%s was not found", CPU_FREQUENCY);
+        return;
+    }
+
+    mEnergyDomains = perf_energy_model::readDomains();
+    if (mEnergyDomains.empty()) {
+        LOG_SETUP("Thread energy is disabled\nThe kernel's energy model was not found in %s",
+                  perf_energy_model::ENERGY_MODEL_PATH);
+        return;
+    }
+
+    mThreadEnergySwitchKey = schedSwitchKey;
+    mThreadEnergyFrequencyKey = getEventKey();
+}
+
+void PerfDriver::postChildExitInParent()
+{
+    // the probes were created by the capture's child process, so remove whatever it left in the probe group
+    if (getConfig().can_access_tracepoints) {
+        perf_function_probes::removeProbes(traceFsConstants);
+    }
+}
+
 void PerfDriver::read(IPerfAttrsConsumer & attrsConsumer, const int cpu)
 {
     const GatorCpu * const cluster = mCpuInfo.getCluster(cpu);
@@ -949,6 +1745,13 @@ bool PerfDriver::sendTracepointFormats(IPerfAttrsConsumer & attrsConsumer)
         }
     }
 
+    for (const auto & probe : mFunctionProbes) {
+        if (!readTracepointFormat(attrsConsumer, traceFsConstants, probe.tracepoints.entryName.c_str())
+            || !readTracepointFormat(attrsConsumer, traceFsConstants, probe.tracepoints.returnName.c_str())) {
+            return false;
+        }
+    }
+
     return true;
 }
 
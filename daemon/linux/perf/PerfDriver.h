@@ -3,24 +3,44 @@
 #ifndef PERFDRIVER_H
 #define PERFDRIVER_H
 
+#include "Configuration.h"
 #include "IPerfGroups.h"
 #include "SimpleDriver.h"
 #include "agents/agent_workers_process.h"
+#include "agents/perf/block_io_latency.h"
 #include "agents/perf/capture_configuration.h"
+#include "agents/perf/gpu_timeline.h"
+#include "agents/perf/lock_contention.h"
 #include "agents/perf/source_adapter.h"
+#include "agents/perf/thread_energy.h"
 #include "linux/Tracepoints.h"
 #include "linux/perf/PerfConfig.h"
 #include "linux/perf/PerfDriverConfiguration.h"
+#include "linux/perf/PerfEventGroup.h"
+#include "linux/perf/PerfFunctionProbes.h"
+#include "linux/perf/PerfGroups.h"
 
+#include <array>
 #include <cstdint>
 #include <functional>
 #include <list>
+#include <map>
 #include <memory>
+#include <optional>
 #include <set>
+#include <string>
+#include <utility>
+#include <vector>
 
 static constexpr const char * SCHED_SWITCH = "sched/sched_switch";
 static constexpr const char * CPU_IDLE = "power/cpu_idle";
 static constexpr const char * CPU_FREQUENCY = "power/cpu_frequency";
+static constexpr const char * BLOCK_RQ_ISSUE = "block/block_rq_issue";
+static constexpr const char * BLOCK_RQ_COMPLETE = "block/block_rq_complete";
+static constexpr const char * SYS_ENTER_FUTEX = "syscalls/sys_enter_futex";
+static constexpr const char * SYS_EXIT_FUTEX = "syscalls/sys_exit_futex";
+static constexpr const char * LOCK_CONTENTION_BEGIN = "lock/contention_begin";
+static constexpr const char * LOCK_CONTENTION_END = "lock/contention_end";
 
 static constexpr const char * GATOR_BOOKMARK = "gator/gator_bookmark";
 static constexpr const char * GATOR_COUNTER = "gator/gator_counter";
@@ -31,6 +51,7 @@ class ISummaryConsumer;
 class GatorCpu;
 class IPerfGroups;
 class IPerfAttrsConsumer;
+class PerfCounter;
 class PerfTracepoint;
 class UncorePmu;
 class ICpuInfo;
@@ -42,13 +63,17 @@ static const char * MALI_PM_STATUS = "Mali: PM Status";
 static const char * MALI_MMU_PAGE_FAULT = "Mali: MMU page fault insert pages";
 static const char * MALI_MMU_TOTAL_ALLOC = "Mali: MMU total alloc pages changed";
 static const char * MALI_JOB_SLOT = "Mali: Job slot events";
+static const char * MALI_GPU_FREQUENCY = "Mali: GPU frequency";
+static const char * MALI_GPU_WORK_PERIOD = "Mali: GPU work period";
 
 static std::map<const char *, const char *> MALI_TRC_PNT_PATH = { //
     {MALI_MMU_IN_USE, "mali/mali_mmu_as_in_use"},                 //
     {MALI_PM_STATUS, "mali/mali_mmu_as_released"},                //
     {MALI_MMU_PAGE_FAULT, "mali/mali_page_fault_insert_pages"},   //
     {MALI_MMU_TOTAL_ALLOC, "mali/mali_total_alloc_pages_change"}, //
-    {MALI_JOB_SLOT, "mali/mali_job_slots_event"}};
+    {MALI_JOB_SLOT, "mali/mali_job_slots_event"},                 //
+    {MALI_GPU_FREQUENCY, "power/gpu_frequency"},                  //
+    {MALI_GPU_WORK_PERIOD, "power/gpu_work_period"}};
 
 class PerfDriver : public SimpleDriver {
 public:
@@ -79,8 +104,13 @@ public:
     void read(IPerfAttrsConsumer & attrsConsumer, int cpu);
     bool sendTracepointFormats(IPerfAttrsConsumer & attrsConsumer);
 
+    void postChildExitInParent() override;
+
     const TraceFsConstants & getTraceFsConstants() const { return traceFsConstants; };
 
+    /** @return True if the GPU frequency is read from its tracepoint, so the polled GPU clock is not needed */
+    [[nodiscard]] bool hasGpuFrequencyTracepoint() const { return mHasGpuFrequencyTracepoint; }
+
     std::unique_ptr<PrimarySource> create_source(sem_t & senderSem,
                                                  ISender & sender,
                                                  std::function<bool()> session_ended_callback,
@@ -93,20 +123,117 @@ public:
                                                  lib::Span<UncorePmu> uncore_pmus,
                                                  agents::agent_workers_process_t<Child> & agent_workers_process);
 
+    /**
+     * Change the perf counters of the running capture to those of the configuration, removing the counters that are
+     * not in it or whose event or sample period changed, and adding the others
+     *
+     * @return True if the capture was reconfigured
+     */
+    bool reconfigure_source(const std::set<CounterConfiguration> & counterConfigurations,
+                            sem_t & senderSem,
+                            ISender & sender,
+                            agents::agent_workers_process_t<Child> & agent_workers_process);
+
 private:
+    /** The tracepoints of a probed function, and the keys of their events */
+    struct FunctionProbeEvents {
+        perf_function_probes::ProbeTracepoints tracepoints;
+        int entryKey;
+        int returnKey;
+    };
+
+    /** The tracepoints at the start and end of each lock wait, and the keys of their events */
+    struct LockContentionEvents {
+        const char * beginTracepoint;
+        const char * endTracepoint;
+        int beginKey;
+        int endKey;
+    };
+
     const TraceFsConstants & traceFsConstants;
     PerfTracepoint * mTracepoints;
     PerfDriverConfiguration mConfig;
     PmuXML mPmuXml;
     const ICpuInfo & mCpuInfo;
+    /** The record filters of the enabled SPEs that have them, by SPE id */
+    std::map<std::string, SpeRecordFilter> mSpeRecordFilters {};
+    /** The probed functions of the current capture */
+    std::vector<FunctionProbeEvents> mFunctionProbes {};
+    /** The CoreSight ETM's perf type and the key of its event, when ETM trace is enabled for the current capture */
+    std::optional<std::pair<std::uint32_t, int>> mEtm {};
+    /** The futex or lock tracepoints' events, when lock contention is measured for the current capture */
+    std::optional<LockContentionEvents> mLockContention {};
+    /** The keys of the sched_switch and cpu_frequency events, when thread energy is measured for the current capture */
+    int mThreadEnergySwitchKey {0};
+    int mThreadEnergyFrequencyKey {0};
+    /** The kernel's energy model, when thread energy is measured for the current capture */
+    std::vector<agents::perf::thread_energy_config_t::domain_t> mEnergyDomains {};
     bool mDisableKernelAnnotations;
+    bool mHasGpuFrequencyTracepoint {false};
+    /** The activity counters of each job slot, from the mali_job_slots_event tracepoint, if it exists */
+    std::array<PerfCounter *, agents::perf::gpu_timeline_config_t::number_of_job_slots> mJobSlotCounters {};
+    /** The counter of the gpu_work_period tracepoint, if it exists */
+    PerfCounter * mGpuWorkPeriodCounter {nullptr};
+    /** The keys of the block_rq_issue and block_rq_complete events, which the block I/O counters are derived from */
+    int mBlockIoIssueKey {0};
+    int mBlockIoCompleteKey {0};
+    /** The block I/O latency histogram counters, if the block tracepoints exist */
+    std::array<PerfCounter *, agents::perf::block_io_config_t::number_of_latency_buckets> mBlockIoLatencyCounters {};
+    PerfCounter * mBlockIoAverageLatencyCounter {nullptr};
+    PerfCounter * mBlockIoQueueDepthCounter {nullptr};
+    /** The configuration and state of the current capture's perf groups, kept so that its events can be changed */
+    std::optional<perf_event_group_configurer_config_t> mGroupsConfig {};
+    perf_groups_configurer_state_t mGroupsState {};
 
     void addCpuCounters(const PerfCpu & cpu);
+    /** Add the derived metric counters of the clusters, from the events with an expression */
+    void readMetrics(mxml_node_t * xml);
+    /** @return The enabled metric counters, for the perf agent to evaluate */
+    [[nodiscard]] std::vector<agents::perf::perf_capture_configuration_t::cpu_metric_t> getCpuMetrics() const;
+    /** @return The enabled GPU tracepoints, for the perf agent to convert into GPU activity */
+    [[nodiscard]] agents::perf::gpu_timeline_config_t getGpuTimeline() const;
+    /** Add the block I/O counters, which the perf agent derives from the block tracepoints */
+    void addBlockIoCounters();
+    /** @return The enabled block I/O counters, and the block tracepoints for the perf agent to derive them from */
+    [[nodiscard]] agents::perf::block_io_config_t getBlockIo() const;
+    /** @return The futex or lock tracepoints for the perf agent to pair into lock wait times, if they are enabled */
+    [[nodiscard]] agents::perf::lock_contention_config_t getLockContention() const;
+    /**
+     * @return The scheduler and cpu frequency tracepoints and the energy model for the perf agent to combine into the
+     * energy used by each thread, if it is enabled
+     */
+    [[nodiscard]] agents::perf::thread_energy_config_t getThreadEnergy() const;
+    /** @return True if the cpu PMU counter's event is an input to a enabled metric of its cluster */
+    [[nodiscard]] bool isSuppressedMetricInput(const PerfCounter & counter, uint64_t event) const;
     void addUncoreCounters(const PerfUncore & uncore);
     void addMidgardHwTracepoints(const char * maliFamilyName);
+    /** Add the events of a counter to its group */
+    bool addCounterEvents(IPerfGroups & group,
+                          attr_to_key_mapping_tracker_t & mapping_tracker,
+                          const PerfCounter & counter) const;
+    /**
+     * Apply the counter configuration to the session's counters, for reconfigure_source
+     *
+     * @param counterConfigurations The new configuration
+     * @param removedKeys Receives the keys of the removed events
+     * @return The counters whose events must be added
+     */
+    std::vector<PerfCounter *> reconfigureCounters(const std::set<CounterConfiguration> & counterConfigurations,
+                                                   std::set<int> & removedKeys);
     bool enableGatorTracePoint(IPerfGroups & group,
                                attr_to_key_mapping_tracker_t & mapping_tracker,
                                long long id) const;
+    bool enableFunctionProbeTracepoint(IPerfGroups & group,
+                                       attr_to_key_mapping_tracker_t & mapping_tracker,
+                                       std::int64_t id,
+                                       int key) const;
+    void createFunctionProbes();
+    void createEtmEvent();
+    /** @return True if the SPE or the ETM trace is captured, so the cpus' aux buffers are used */
+    [[nodiscard]] bool usesAuxBuffers() const;
+    void createLockContentionEvents();
+    /** @param schedSwitchKey The key of the sched_switch events that lead the cpus' groups */
+    void createThreadEnergyEvents(int schedSwitchKey);
 
     std::vector<agents::perf::perf_capture_configuration_t::cpu_freq_properties_t>
     get_cpu_cluster_keys_for_cpu_frequency_counter();
@@ -273,6 +273,7 @@ std::unique_ptr<PerfDriverConfiguration> PerfDriverConfiguration::detect(bool sy
     configuration->config.has_ioctl_read_id = (kernelVersion >= KERNEL_VERSION(3U, 12U, 0U));
     configuration->config.has_aux_support = (kernelVersion >= KERNEL_VERSION(4U, 1U, 0U));
     configuration->config.has_exclude_callchain_kernel = (kernelVersion >= KERNEL_VERSION(3U, 7U, 0U));
+    configuration->config.has_attr_sample_max_stack = (kernelVersion >= KERNEL_VERSION(4U, 8U, 0U));
 
     configuration->config.is_system_wide = systemWide;
     configuration->config.exclude_kernel = exclude_kernel;
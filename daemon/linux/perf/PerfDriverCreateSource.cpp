@@ -5,6 +5,7 @@
 #include "ICpuInfo.h"
 #include "ISender.h"
 #include "Logging.h"
+#include "MemoryBudget.h"
 #include "Proc.h"
 #include "SessionData.h"
 #include "Source.h"
@@ -18,10 +19,14 @@
 #include "linux/perf/PerfGroups.h"
 #include "xml/PmuXML.h"
 
+#include <algorithm>
 #include <chrono>
+#include <cstddef>
 #include <condition_variable>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <set>
 
 #include <boost/asio/use_future.hpp>
 
@@ -60,16 +65,36 @@ namespace {
         return type_to_name;
     }
 
-    agents::perf::buffer_config_t create_perf_buffer_config()
+    /**
+     * Carve the perf agent's buffers from the memory budget: the ring buffers of every core (and their aux buffers,
+     * if any event uses them), the IPC queue and the flight recorder
+     */
+    agents::perf::buffer_config_t allocate_perf_buffer_config(std::size_t num_cores, bool uses_aux)
     {
-        return {
-            static_cast<size_t>(gSessionData.mPageSize),
-            (gSessionData.mPerfMmapSizeInPages > 0
-                 ? static_cast<size_t>(gSessionData.mPageSize * gSessionData.mPerfMmapSizeInPages)
-                 : static_cast<size_t>(gSessionData.mTotalBufferSize) * MEGABYTES),
+        auto const page_size = static_cast<size_t>(gSessionData.mPageSize);
+        auto const data_size = (gSessionData.mPerfMmapSizeInPages > 0
+                                    ? static_cast<size_t>(gSessionData.mPageSize * gSessionData.mPerfMmapSizeInPages)
+                                    : static_cast<size_t>(gSessionData.mTotalBufferSize) * MEGABYTES);
+        auto const aux_size =
             (gSessionData.mPerfMmapSizeInPages > 0
                  ? static_cast<size_t>(gSessionData.mPageSize * gSessionData.mPerfMmapSizeInPages)
-                 : static_cast<size_t>(gSessionData.mTotalBufferSize) * MEGABYTES * AUX_MULTIPLIER),
+                 : static_cast<size_t>(gSessionData.mTotalBufferSize) * MEGABYTES * AUX_MULTIPLIER);
+
+        // the ring buffers are halved to fit, which keeps them a power of two multiple of the page size
+        auto const min_size = std::max(page_size, MemoryBudget::MIN_BUFFER_SIZE);
+
+        if (gSessionData.mFlightRecorderSeconds > 0) {
+            auto const recorder_size = static_cast<size_t>(gSessionData.mFlightRecorderSize) * MEGABYTES;
+            gMemoryBudget.allocate("perf flight recorder", 1, recorder_size, recorder_size);
+        }
+
+        return {
+            page_size,
+            gMemoryBudget.allocate("perf ring buffers", num_cores, data_size, min_size),
+            (uses_aux ? gMemoryBudget.allocate("perf aux buffers", num_cores, aux_size, min_size) : aux_size),
+            gMemoryBudget.allocate("perf agent IPC queue",
+                                   1,
+                                   static_cast<size_t>(gSessionData.mTotalBufferSize) * MEGABYTES),
         };
     }
 
@@ -89,27 +114,47 @@ std::unique_ptr<PrimarySource> PerfDriver::create_source(sem_t & senderSem,
                                                          lib::Span<UncorePmu> uncore_pmus,
                                                          agents::agent_workers_process_t<Child> & agent_workers_process)
 {
-    auto attrs_buffer = std::make_unique<PerfAttrsBuffer>(gSessionData.mTotalBufferSize * MEGABYTES, senderSem);
+    auto const attrs_buffer_size =
+        gMemoryBudget.allocate("perf attributes", 1, static_cast<size_t>(gSessionData.mTotalBufferSize) * MEGABYTES);
+    auto attrs_buffer = std::make_unique<PerfAttrsBuffer>(static_cast<int>(attrs_buffer_size), senderSem);
 
     perf_event_group_configurer_config_t event_configurer_config {
         mConfig.config,
         cpuInfo.getClusters(),
         cpuInfo.getClusterIds(),
         mConfig.config.exclude_kernel || gSessionData.mExcludeKernelEvents,
-        create_perf_buffer_config(),
+        // carved once the cores, and whether the aux buffers are used, are known
+        {},
         getTracepointId(traceFsConstants, SCHED_SWITCH),
         // We disable periodic sampling if we have at least one EBS counter
         // it should probably be independent of EBS though
         gSessionData.mBacktraceDepth,
         gSessionData.mSampleRate,
         !gSessionData.mIsEBS,
+        gSessionData.mClusterSampleRates,
     };
+    event_configurer_config.userStackSize = gSessionData.mUserStackSize;
+    event_configurer_config.maxCallStackDepth = gSessionData.mMaxCallStackDepth;
+    event_configurer_config.callChainSamplePeriod = gSessionData.mCallStackSamplePeriod;
+    event_configurer_config.inheritStatCounters = gSessionData.mInheritStatCounters;
+    event_configurer_config.excludeGuestEvents = gSessionData.mExcludeGuestEvents;
+    event_configurer_config.excludeHostEvents = gSessionData.mExcludeHostEvents;
+    event_configurer_config.lowWakeup = (gSessionData.mLowWakeupSeconds > 0);
 
     perf_groups_configurer_state_t event_configurer_state {};
 
     // Reread cpuinfo since cores may have changed since startup
     cpuInfo.updateIds(false);
 
+    // the function probes' tracepoints must exist before their formats are sent and their events are enabled
+    createFunctionProbes();
+    createEtmEvent();
+    createLockContentionEvents();
+    createThreadEnergyEvents(event_configurer_config.schedSwitchKey);
+
+    event_configurer_config.ringbuffer_config =
+        allocate_perf_buffer_config(cpuInfo.getNumberOfCores(), usesAuxBuffers());
+
     // write out any tracepoint format descriptors
     if (mConfig.config.can_access_tracepoints && !sendTracepointFormats(*attrs_buffer)) {
         LOG_DEBUG("could not send tracepoint formats");
@@ -129,6 +174,10 @@ std::unique_ptr<PrimarySource> PerfDriver::create_source(sem_t & senderSem,
     attrs_buffer->flush();
     attrs_buffer->write(sender);
 
+    // kept so that the counters can be changed while capturing
+    mGroupsConfig.emplace(event_configurer_config);
+    mGroupsState = event_configurer_state;
+
     // add the tracepoint formats
     send_tracepoint_formats(ftraceDriver, *attrs_buffer, mConfig.config.is_system_wide);
     // write directly to the sender
@@ -144,10 +193,59 @@ std::unique_ptr<PrimarySource> PerfDriver::create_source(sem_t & senderSem,
                                  appTids,
                                  uncore_pmus,
                                  event_configurer_state,
-                                 create_perf_buffer_config(),
+                                 event_configurer_config.ringbuffer_config,
                                  enableOnCommandExec);
 }
 
+bool PerfDriver::reconfigure_source(const std::set<CounterConfiguration> & counterConfigurations,
+                                    sem_t & senderSem,
+                                    ISender & sender,
+                                    agents::agent_workers_process_t<Child> & agent_workers_process)
+{
+    if (!mGroupsConfig) {
+        LOG_DEBUG("Cannot reconfigure the perf counters before the capture is created");
+        return false;
+    }
+
+    std::set<int> removed_keys {};
+    auto const added = reconfigureCounters(counterConfigurations, removed_keys);
+
+    if (added.empty() && removed_keys.empty()) {
+        LOG_DEBUG("The perf counters are unchanged");
+        return true;
+    }
+
+    std::map<PerfEventGroupIdentifier, std::size_t> previous_group_sizes {};
+    for (auto const & entry : mGroupsState.perfEventGroupMap) {
+        previous_group_sizes.emplace(entry.first, entry.second.events.size());
+    }
+
+    // the attributes of the added events must reach the host before their ids do
+    auto attrs_buffer = std::make_unique<PerfAttrsBuffer>(gSessionData.mTotalBufferSize * MEGABYTES, senderSem);
+    {
+        attr_to_key_mapping_tracker_t wrapper {*attrs_buffer};
+        perf_groups_configurer_t groups_builder {*mGroupsConfig, mGroupsState};
+        for (auto * counter : added) {
+            if (!addCounterEvents(groups_builder, wrapper, *counter)) {
+                LOG_ERROR("Could not add the new perf counters to the capture");
+                return false;
+            }
+        }
+    }
+
+    attrs_buffer->flush();
+    attrs_buffer->write(sender);
+
+    LOG_DEBUG("Reconfiguring the capture, removing %zu events and adding %zu counters",
+              removed_keys.size(),
+              added.size());
+
+    agent_workers_process.reconfigure_capture(
+        agents::perf::create_capture_reconfiguration_msg(mGroupsState, previous_group_sizes, removed_keys, mCpuInfo));
+
+    return true;
+}
+
 [[nodiscard]] static bool wait_for_ready(std::optional<bool> const & ready_worker,
                                          std::optional<bool> const & ready_agent,
                                          bool session_ended)
@@ -197,6 +295,10 @@ std::unique_ptr<agents::perf::perf_source_adapter_t> PerfDriver::create_source_a
     }
 
     auto type_to_name_map = collect_pmu_type_to_name_map(mConfig);
+    if (mEtm) {
+        // the agent finds the ETM's events by this name
+        type_to_name_map[mEtm->first] = "cs_etm";
+    }
 
     ipc::msg_capture_configuration_t config_msg = agents::perf::create_capture_configuration_msg(
         gSessionData,
@@ -209,6 +311,7 @@ std::unique_ptr<agents::perf::perf_source_adapter_t> PerfDriver::create_source_a
         perf_groups,
         ringbuffer_config,
         type_to_name_map,
+        mSpeRecordFilters,
         enable_on_exec,
         // only use SIGSTOP pause when waiting for newly launched Android package
         (gSessionData.mAndroidPackage != nullptr));
@@ -224,6 +327,20 @@ std::unique_ptr<agents::perf::perf_source_adapter_t> PerfDriver::create_source_a
         }
     }
     agents::perf::add_pids(config_msg, app_tids);
+    {
+        std::vector<agents::perf::function_latency_state_t::probe_t> function_probes;
+        for (const auto & probe : mFunctionProbes) {
+            function_probes.push_back(
+                {agents::perf::gator_key_t(probe.entryKey), agents::perf::gator_key_t(probe.returnKey)});
+        }
+        agents::perf::add_function_probes(config_msg, function_probes);
+    }
+    const auto cpuMetrics = getCpuMetrics();
+    agents::perf::add_cpu_metrics(config_msg, cpuMetrics);
+    agents::perf::add_gpu_timeline(config_msg, getGpuTimeline());
+    agents::perf::add_block_io(config_msg, getBlockIo());
+    agents::perf::add_lock_contention(config_msg, getLockContention());
+    agents::perf::add_thread_energy(config_msg, getThreadEnergy());
     agents::perf::add_wait_for_process(config_msg, gSessionData.mWaitForProcessCommand);
 
     // start the agent worker and tell it to communicate with the source adapter
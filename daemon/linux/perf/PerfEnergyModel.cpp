@@ -0,0 +1,81 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "linux/perf/PerfEnergyModel.h"
+
+#include "Logging.h"
+#include "lib/FsEntry.h"
+#include "lib/Utils.h"
+
+#include <cstdint>
+#include <optional>
+#include <set>
+#include <string>
+#include <utility>
+
+namespace perf_energy_model {
+    namespace {
+        /** The prefix of the directory of each performance state of a domain */
+        constexpr const char * PERF_STATE_PREFIX = "ps:";
+
+        std::optional<std::uint64_t> readValue(const lib::FsEntry & dir, const char * name)
+        {
+            const auto path = lib::FsEntry::create(dir, name).path();
+            std::int64_t value = 0;
+            if ((lib::readInt64FromFile(path.c_str(), value) != 0) || (value < 0)) {
+                return {};
+            }
+            return std::uint64_t(value);
+        }
+    }
+
+    std::vector<agents::perf::thread_energy_config_t::domain_t> readDomains()
+    {
+        std::vector<agents::perf::thread_energy_config_t::domain_t> result;
+
+        const auto root = lib::FsEntry::create(ENERGY_MODEL_PATH);
+        if (!root.exists()) {
+            return result;
+        }
+
+        // each domain is named for its first cpu (or was "pd<n>" on older kernels), so only rely on its contents
+        auto domains = root.children();
+        std::optional<lib::FsEntry> domainDir;
+        while ((domainDir = domains.next())) {
+            const auto cpusPath = lib::FsEntry::create(*domainDir, "cpus").path();
+            const std::set<int> cpus = lib::readCpuMaskFromFile(cpusPath.c_str());
+            if (cpus.empty()) {
+                continue;
+            }
+
+            agents::perf::thread_energy_config_t::domain_t domain {{cpus.begin(), cpus.end()}, {}};
+
+            auto states = domainDir->children();
+            std::optional<lib::FsEntry> stateDir;
+            while ((stateDir = states.next())) {
+                if (stateDir->name().rfind(PERF_STATE_PREFIX, 0) != 0) {
+                    continue;
+                }
+
+                const auto frequency = readValue(*stateDir, "frequency");
+                const auto power = readValue(*stateDir, "power");
+                if (frequency && power) {
+                    domain.states.push_back({*frequency, *power});
+                }
+            }
+
+            if (domain.states.empty()) {
+                LOG_DEBUG("No performance states in energy model domain %s", domainDir->path().c_str());
+                continue;
+            }
+
+            LOG_DEBUG("Energy model domain %s has %zu cpus and %zu performance states",
+                      domainDir->path().c_str(),
+                      domain.cpus.size(),
+                      domain.states.size());
+
+            result.push_back(std::move(domain));
+        }
+
+        return result;
+    }
+}
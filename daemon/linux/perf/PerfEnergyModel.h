@@ -0,0 +1,23 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#ifndef PERF_ENERGY_MODEL_H
+#define PERF_ENERGY_MODEL_H
+
+#include "agents/perf/thread_energy.h"
+
+#include <vector>
+
+namespace perf_energy_model {
+    /** Where debugfs exposes the kernel's energy model, as one directory per performance domain */
+    constexpr const char * ENERGY_MODEL_PATH = "/sys/kernel/debug/energy_model";
+
+    /**
+     * Read the performance domains of the cpus, and the power of each of their performance states, from the kernel's
+     * energy model
+     *
+     * @return The domains, which is empty if the kernel does not have an energy model (or debugfs is not mounted)
+     */
+    std::vector<agents::perf::thread_energy_config_t::domain_t> readDomains();
+}
+
+#endif // PERF_ENERGY_MODEL_H
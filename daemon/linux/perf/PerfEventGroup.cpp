@@ -11,10 +11,12 @@
 #include "linux/perf/PerfUtils.h"
 #include "xml/PmuXML.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cinttypes>
 #include <climits>
 #include <cstddef>
+#include <initializer_list>
 #include <iostream>
 #include <optional>
 #include <set>
@@ -25,6 +27,7 @@
 namespace {
     constexpr unsigned long NANO_SECONDS_IN_ONE_SECOND = 1000000000UL;
     constexpr unsigned long NANO_SECONDS_IN_100_MS = 100000000UL;
+    constexpr unsigned long NANO_SECONDS_IN_1_MS = 1000000UL;
     constexpr std::uint32_t MAX_SPE_WATERMARK = 2048U * 1024U;
     constexpr std::uint32_t MIN_SPE_WATERMARK = 4096U;
 
@@ -42,6 +45,12 @@ namespace {
     {
         constexpr std::uint64_t fraction_of_second = 10; // 1/10s
 
+        // an event that is not sampled (such as the ETM's) writes to the aux buffer continuously
+        if (count == 0) {
+            return std::max<std::uint32_t>(std::min<std::uint64_t>(mmap_size / 2, MAX_SPE_WATERMARK),
+                                           MIN_SPE_WATERMARK);
+        }
+
         auto const frequency = std::max<std::uint64_t>(NANO_SECONDS_IN_ONE_SECOND / count, 1);
         auto const bps = (24 * frequency); // assume an average of 24 bytes per sample
 
@@ -76,6 +85,24 @@ namespace {
 
         return true;
     }
+
+    /**
+     * Decode whether or not to apply exclude_guest / exclude_host
+     *
+     * @param groupType The type of the group the event is part of
+     * @param type The attribute type
+     * @return True for the cpu PMU events; the uncore PMUs generally reject the exclude bits, and the software and
+     * tracepoint events (such as the periodic sampling leader) must still fire in the host
+     */
+    constexpr bool should_filter_guest(PerfEventGroupIdentifier::Type groupType, std::uint32_t type)
+    {
+        if ((groupType != PerfEventGroupIdentifier::Type::PER_CLUSTER_CPU)
+            && (groupType != PerfEventGroupIdentifier::Type::SPECIFIC_CPU)) {
+            return false;
+        }
+
+        return (type != PERF_TYPE_SOFTWARE) && (type != PERF_TYPE_TRACEPOINT);
+    }
 }
 
 bool perf_event_group_configurer_t::initEvent(perf_event_group_configurer_config_t & config,
@@ -116,6 +143,12 @@ bool perf_event_group_configurer_t::initEvent(perf_event_group_configurer_config
             // https://elixir.bootlin.com/linux/latest/source/arch/arm64/include/uapi/asm/perf_regs.h
             // bits 0-32 are set (PC = 2^32)
             event.attr.sample_regs_user = 0x1ffffffffull;
+            // the perf agent unwinds the copied stack, replacing it with the addresses, so must find the sample's id
+            // and pid
+            if ((config.userStackSize > 0) && config.perfConfig.has_sample_identifier) {
+                event.attr.sample_type |= PERF_SAMPLE_STACK_USER | PERF_SAMPLE_TID;
+                event.attr.sample_stack_user = static_cast<std::uint32_t>(config.userStackSize) & ~7U;
+            }
         }
         else {
             // https://elixir.bootlin.com/linux/latest/source/arch/arm/include/uapi/asm/perf_regs.h
@@ -127,6 +160,12 @@ bool perf_event_group_configurer_t::initEvent(perf_event_group_configurer_config
     event.attr.sample_regs_user = 0;
 #endif
 
+    // bound the callchain's depth, which is otherwise limited only by perf_event_max_stack
+    if (((event.attr.sample_type & PERF_SAMPLE_CALLCHAIN) != 0) && (config.maxCallStackDepth > 0)
+        && config.perfConfig.has_attr_sample_max_stack) {
+        event.attr.sample_max_stack = static_cast<std::uint16_t>(config.maxCallStackDepth);
+    }
+
     // make sure all new children are counted too
     const bool use_inherit = !(config.perfConfig.is_system_wide || is_header);
     // group doesn't require a leader (so all events are stand alone)
@@ -136,6 +175,8 @@ bool perf_event_group_configurer_t::initEvent(perf_event_group_configurer_config
 
     // filter kernel events?
     const bool exclude_kernel = should_exclude_kernel(attr.type, attr.config, config.excludeKernelEvents);
+    // filter guest / host events?
+    const bool filter_guest = (!is_header) && should_filter_guest(type, attr.type);
 
     // when running in application mode, inherit must always be set, in system wide mode, inherit must always be clear
     event.attr.inherit = use_inherit;
@@ -152,8 +193,9 @@ bool perf_event_group_configurer_t::initEvent(perf_event_group_configurer_config
     event.attr.disabled = event.attr.pinned;
     /* have a sampling interrupt happen when we cross the wakeup_watermark boundary */
     event.attr.watermark = 1;
-    /* Be conservative in flush size as only one buffer set is monitored */
-    event.attr.wakeup_watermark = config.ringbuffer_config.data_buffer_size / 2;
+    /* Be conservative in flush size as only one buffer set is monitored, unless the wakeups themselves are the cost */
+    event.attr.wakeup_watermark = (config.lowWakeup ? (config.ringbuffer_config.data_buffer_size / 4) * 3
+                                                    : config.ringbuffer_config.data_buffer_size / 2);
     /* Use the monotonic raw clock if possible */
     event.attr.use_clockid = config.perfConfig.has_attr_clockid_support ? 1 : 0;
     event.attr.clockid = config.perfConfig.has_attr_clockid_support ? CLOCK_MONOTONIC_RAW : 0;
@@ -175,10 +217,13 @@ bool perf_event_group_configurer_t::initEvent(perf_event_group_configurer_config
     event.attr.exclude_idle = (exclude_kernel ? 1 : 0);
     event.attr.exclude_callchain_kernel =
         (config.excludeKernelEvents && config.perfConfig.has_exclude_callchain_kernel ? 1 : 0);
+    event.attr.exclude_guest = (filter_guest && config.excludeGuestEvents ? 1 : 0);
+    event.attr.exclude_host = (filter_guest && config.excludeHostEvents ? 1 : 0);
     event.attr.aux_watermark = (hasAuxData ? calculate_aux_watermark(config.ringbuffer_config.aux_buffer_size, //
                                                                      event.attr.sample_period)                 //
                                            : 0);
     event.key = key;
+    event.filter = attr.filter;
 
     // [SDDAP-10625] - trace context switch information for SPE attributes.
     // it is required (particularly in system-wide mode) to be able to see
@@ -227,11 +272,29 @@ bool perf_event_group_configurer_t::addEvent(const bool leader,
                      hasAuxData);
 }
 
+int perf_event_group_configurer_t::getSampleRate() const
+{
+    const GatorCpu * cluster = identifier.getCluster();
+    if ((cluster == nullptr) || config.clusterSampleRates.empty()) {
+        return config.sampleRate;
+    }
+
+    for (const char * name : {cluster->getId(), cluster->getCoreName()}) {
+        const auto it = config.clusterSampleRates.find(name);
+        if (it != config.clusterSampleRates.end()) {
+            return it->second;
+        }
+    }
+
+    return config.sampleRate;
+}
+
 bool perf_event_group_configurer_t::createGroupLeader(attr_to_key_mapping_tracker_t & mapping_tracker)
 {
     switch (identifier.getType()) {
         case PerfEventGroupIdentifier::Type::PER_CLUSTER_CPU:
-            return createCpuGroupLeader(mapping_tracker);
+            return (identifier.getMultiplexGroup() > 0 ? createCpuMultiplexGroupLeader(mapping_tracker)
+                                                       : createCpuGroupLeader(mapping_tracker));
 
         case PerfEventGroupIdentifier::Type::UNCORE_PMU:
             return createUncoreGroupLeader(mapping_tracker);
@@ -248,6 +311,10 @@ bool perf_event_group_configurer_t::createGroupLeader(attr_to_key_mapping_tracke
 bool perf_event_group_configurer_t::createCpuGroupLeader(attr_to_key_mapping_tracker_t & mapping_tracker)
 {
     const bool enableCallChain = (config.backtraceDepth > 0);
+    // collect the callchains from a second, slower, periodic sampling event so the other samples are just the pc
+    const bool splitCallChain = enableCallChain && (config.callChainSamplePeriod > 1);
+    const std::uint64_t pcCallChain = (enableCallChain && !splitCallChain ? PERF_SAMPLE_CALLCHAIN : 0);
+    const int sampleRate = getSampleRate();
 
     IPerfGroups::Attr attr {};
     attr.sampleType = PERF_SAMPLE_TID | PERF_SAMPLE_READ;
@@ -284,11 +351,11 @@ bool perf_event_group_configurer_t::createCpuGroupLeader(attr_to_key_mapping_tra
             // otherwise use sampling as leader
             else {
                 attr.config = PERF_COUNT_SW_CPU_CLOCK;
-                attr.periodOrFreq = (config.sampleRate > 0 && config.enablePeriodicSampling
-                                         ? NANO_SECONDS_IN_ONE_SECOND / config.sampleRate
+                attr.periodOrFreq = (sampleRate > 0 && config.enablePeriodicSampling
+                                         ? NANO_SECONDS_IN_ONE_SECOND / sampleRate
                                          : 0);
                 attr.sampleType |=
-                    PERF_SAMPLE_TID | PERF_SAMPLE_IP | PERF_SAMPLE_READ | (enableCallChain ? PERF_SAMPLE_CALLCHAIN : 0);
+                    PERF_SAMPLE_TID | PERF_SAMPLE_IP | PERF_SAMPLE_READ | pcCallChain;
             }
         }
         else if (!config.perfConfig.exclude_kernel) {
@@ -302,10 +369,10 @@ bool perf_event_group_configurer_t::createCpuGroupLeader(attr_to_key_mapping_tra
             // no context switches at all :-(
             attr.config = PERF_COUNT_SW_CPU_CLOCK;
             attr.periodOrFreq =
-                (config.sampleRate > 0 && config.enablePeriodicSampling ? NANO_SECONDS_IN_ONE_SECOND / config.sampleRate
+                (sampleRate > 0 && config.enablePeriodicSampling ? NANO_SECONDS_IN_ONE_SECOND / sampleRate
                                                                         : 0);
             attr.sampleType |=
-                PERF_SAMPLE_TID | PERF_SAMPLE_IP | PERF_SAMPLE_READ | (enableCallChain ? PERF_SAMPLE_CALLCHAIN : 0);
+                PERF_SAMPLE_TID | PERF_SAMPLE_IP | PERF_SAMPLE_READ | pcCallChain;
         }
     }
 
@@ -315,18 +382,31 @@ bool perf_event_group_configurer_t::createCpuGroupLeader(attr_to_key_mapping_tra
     }
 
     // Periodic PC sampling
-    if ((attr.config != PERF_COUNT_SW_CPU_CLOCK) && config.sampleRate > 0 && config.enablePeriodicSampling) {
+    if ((attr.config != PERF_COUNT_SW_CPU_CLOCK) && sampleRate > 0 && config.enablePeriodicSampling) {
         IPerfGroups::Attr pcAttr {};
         pcAttr.type = PERF_TYPE_SOFTWARE;
         pcAttr.config = PERF_COUNT_SW_CPU_CLOCK;
         pcAttr.sampleType =
-            PERF_SAMPLE_TID | PERF_SAMPLE_IP | PERF_SAMPLE_READ | (enableCallChain ? PERF_SAMPLE_CALLCHAIN : 0);
-        pcAttr.periodOrFreq = NANO_SECONDS_IN_ONE_SECOND / config.sampleRate;
+            PERF_SAMPLE_TID | PERF_SAMPLE_IP | PERF_SAMPLE_READ | pcCallChain;
+        pcAttr.periodOrFreq = NANO_SECONDS_IN_ONE_SECOND / sampleRate;
         if (!addEvent(false, mapping_tracker, nextDummyKey(), pcAttr, false)) {
             return false;
         }
     }
 
+    // the callchains, for one in callChainSamplePeriod of the periodic samples
+    if (splitCallChain && sampleRate > 0 && config.enablePeriodicSampling) {
+        IPerfGroups::Attr callChainAttr {};
+        callChainAttr.type = PERF_TYPE_SOFTWARE;
+        callChainAttr.config = PERF_COUNT_SW_CPU_CLOCK;
+        callChainAttr.sampleType = PERF_SAMPLE_TID | PERF_SAMPLE_IP | PERF_SAMPLE_READ | PERF_SAMPLE_CALLCHAIN;
+        callChainAttr.periodOrFreq =
+            (NANO_SECONDS_IN_ONE_SECOND / sampleRate) * static_cast<std::uint64_t>(config.callChainSamplePeriod);
+        if (!addEvent(false, mapping_tracker, nextDummyKey(), callChainAttr, false)) {
+            return false;
+        }
+    }
+
     // use high frequency task clock to attempt to catch the first switch back to a process after a switch out
     // this should give us approximate 'switch-in' events
     if (enableTaskClock) {
@@ -343,15 +423,34 @@ bool perf_event_group_configurer_t::createCpuGroupLeader(attr_to_key_mapping_tra
     return true;
 }
 
-bool perf_event_group_configurer_t::createUncoreGroupLeader(attr_to_key_mapping_tracker_t & mapping_tracker)
+bool perf_event_group_configurer_t::createCpuMultiplexGroupLeader(attr_to_key_mapping_tracker_t & mapping_tracker)
 {
+    // The group is enabled and disabled by the perf agent as it rotates the groups onto the PMU, and its counters
+    // are read by the leader's samples. The context switches and pc samples come from the main group's leader.
     IPerfGroups::Attr attr {};
     attr.type = PERF_TYPE_SOFTWARE;
     attr.config = PERF_COUNT_SW_CPU_CLOCK;
     attr.sampleType = PERF_SAMPLE_READ;
-    // Non-CPU PMUs are sampled every 100ms for Sample Rate: None otherwise they would never be sampled
+    const int sampleRate = getSampleRate();
+    // sampled every 100ms for Sample Rate: None otherwise the counters would never be read
     attr.periodOrFreq =
-        (config.sampleRate > 0 ? NANO_SECONDS_IN_ONE_SECOND / config.sampleRate : NANO_SECONDS_IN_100_MS);
+        (sampleRate > 0 ? NANO_SECONDS_IN_ONE_SECOND / sampleRate : NANO_SECONDS_IN_100_MS);
+
+    return addEvent(true, mapping_tracker, nextDummyKey(), attr, false);
+}
+
+bool perf_event_group_configurer_t::createUncoreGroupLeader(attr_to_key_mapping_tracker_t & mapping_tracker)
+{
+    IPerfGroups::Attr attr {};
+    attr.type = PERF_TYPE_SOFTWARE;
+    attr.config = PERF_COUNT_SW_CPU_CLOCK;
+    attr.sampleType = PERF_SAMPLE_READ;
+    // Non-CPU PMUs are sampled every 100ms for Sample Rate: None otherwise they would never be sampled. Otherwise they
+    // are read no more often than every 1ms; their counts are not attributed to threads so there is nothing to gain
+    // from the high sample rate, whereas each read is a record of every counter in the group, for every PMU instance.
+    attr.periodOrFreq = (config.sampleRate > 0
+                             ? std::max(NANO_SECONDS_IN_ONE_SECOND / config.sampleRate, NANO_SECONDS_IN_1_MS)
+                             : NANO_SECONDS_IN_100_MS);
 
     return addEvent(true, mapping_tracker, nextDummyKey(), attr, false);
 }
@@ -19,6 +19,8 @@
 #include <limits>
 #include <map>
 #include <set>
+#include <string>
+#include <utility>
 #include <vector>
 
 class GatorCpu;
@@ -34,9 +36,24 @@ struct perf_event_group_configurer_config_t {
     int schedSwitchKey = std::numeric_limits<int>::max();
     int dummyKeyCounter = std::numeric_limits<int>::max() - 1;
     int backtraceDepth;
+    /// the bytes of the user stack to copy with each sample that has a callchain, or 0 for none
+    int userStackSize = 0;
+    /// the most frames in each callchain, or 0 for the kernel's limit
+    int maxCallStackDepth = 0;
+    /// collect the callchain with only one in this many of the periodic samples
+    int callChainSamplePeriod = 1;
+    /// in app mode, count the events that have no sample period rather than sampling them at the sample rate
+    bool inheritStatCounters = false;
+    /// count the cpu PMU events only in the host, or only in the KVM guests
+    bool excludeGuestEvents = false;
+    bool excludeHostEvents = false;
+    /// in the low-wakeup mode, only wake the agent once a data buffer is nearly full
+    bool lowWakeup = false;
     int sampleRate;
     bool excludeKernelEvents;
     bool enablePeriodicSampling;
+    /// overrides sampleRate for specific clusters, by cluster id or core name
+    std::map<std::string, int> clusterSampleRates;
 
     inline perf_event_group_configurer_config_t(PerfConfig const & perfConfig,
                                                 lib::Span<const GatorCpu> clusters,
@@ -46,7 +63,8 @@ struct perf_event_group_configurer_config_t {
                                                 int64_t schedSwitchId,
                                                 int backtraceDepth,
                                                 int sampleRate,
-                                                bool enablePeriodicSampling)
+                                                bool enablePeriodicSampling,
+                                                std::map<std::string, int> clusterSampleRates = {})
         : perfConfig(perfConfig),
           clusters(clusters),
           clusterIds(clusterIds),
@@ -55,7 +73,8 @@ struct perf_event_group_configurer_config_t {
           backtraceDepth(backtraceDepth),
           sampleRate(sampleRate),
           excludeKernelEvents(excludeKernelEvents),
-          enablePeriodicSampling(enablePeriodicSampling)
+          enablePeriodicSampling(enablePeriodicSampling),
+          clusterSampleRates(std::move(clusterSampleRates))
     {
     }
 };
@@ -64,6 +83,8 @@ struct perf_event_group_configurer_config_t {
 struct perf_event_t {
     struct perf_event_attr attr;
     int key;
+    /// the tracepoint's filter expression, which is not part of the attr, or empty for none
+    std::string filter {};
 };
 
 /** The common state data for the activator and configurer; only this part gets serialized */
@@ -101,6 +122,9 @@ public:
 
     [[nodiscard]] bool hasLeader() const { return requiresLeader() && (!state.events.empty()); }
 
+    /** @return The sample rate of the group's cluster, which is the capture's sample rate unless overridden */
+    [[nodiscard]] int getSampleRate() const;
+
     [[nodiscard]] static bool initEvent(perf_event_group_configurer_config_t & config,
                                         perf_event_t & event,
                                         bool is_header,
@@ -127,6 +151,7 @@ private:
     perf_event_group_configurer_state_t & state;
 
     [[nodiscard]] bool createCpuGroupLeader(attr_to_key_mapping_tracker_t & mapping_tracker);
+    [[nodiscard]] bool createCpuMultiplexGroupLeader(attr_to_key_mapping_tracker_t & mapping_tracker);
     [[nodiscard]] bool createUncoreGroupLeader(attr_to_key_mapping_tracker_t & mapping_tracker);
     [[nodiscard]] int nextDummyKey() { return nextDummyKey(config); }
 };
@@ -1,4 +1,4 @@
-/* Copyright (C) 2018-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2018-2022 by Arm Limited. All rights reserved. */
 
 #include "linux/perf/PerfEventGroupIdentifier.h"
 
@@ -9,28 +9,34 @@
 #include <cassert>
 
 PerfEventGroupIdentifier::PerfEventGroupIdentifier()
-    : cluster(nullptr), pmu(nullptr), cpuNumber(-1), cpuNumberToType(nullptr)
+    : cluster(nullptr), pmu(nullptr), cpuNumber(-1), cpuNumberToType(nullptr), multiplexGroup(0)
 {
 }
 
 PerfEventGroupIdentifier::PerfEventGroupIdentifier(const GatorCpu & cluster)
-    : cluster(&cluster), pmu(nullptr), cpuNumber(-1), cpuNumberToType(nullptr)
+    : cluster(&cluster), pmu(nullptr), cpuNumber(-1), cpuNumberToType(nullptr), multiplexGroup(0)
 {
 }
 
+PerfEventGroupIdentifier::PerfEventGroupIdentifier(const GatorCpu & cluster, int multiplexGroup)
+    : cluster(&cluster), pmu(nullptr), cpuNumber(-1), cpuNumberToType(nullptr), multiplexGroup(multiplexGroup)
+{
+    assert(multiplexGroup >= 0);
+}
+
 PerfEventGroupIdentifier::PerfEventGroupIdentifier(const UncorePmu & pmu)
-    : cluster(nullptr), pmu(&pmu), cpuNumber(-1), cpuNumberToType(nullptr)
+    : cluster(nullptr), pmu(&pmu), cpuNumber(-1), cpuNumberToType(nullptr), multiplexGroup(0)
 {
 }
 
 PerfEventGroupIdentifier::PerfEventGroupIdentifier(int cpuNumber)
-    : cluster(nullptr), pmu(nullptr), cpuNumber(cpuNumber), cpuNumberToType(nullptr)
+    : cluster(nullptr), pmu(nullptr), cpuNumber(cpuNumber), cpuNumberToType(nullptr), multiplexGroup(0)
 {
     assert(cpuNumber >= 0);
 }
 
 PerfEventGroupIdentifier::PerfEventGroupIdentifier(const std::map<int, int> & cpuToTypeMap)
-    : cluster(nullptr), pmu(nullptr), cpuNumber(-1), cpuNumberToType(&cpuToTypeMap)
+    : cluster(nullptr), pmu(nullptr), cpuNumber(-1), cpuNumberToType(&cpuToTypeMap), multiplexGroup(0)
 {
 }
 
@@ -43,7 +49,8 @@ bool PerfEventGroupIdentifier::operator<(const PerfEventGroupIdentifier & that)
         }
         const int minThis = *std::min_element(cluster->getCpuIds().begin(), cluster->getCpuIds().end());
         const int minThat = *std::min_element(that.cluster->getCpuIds().begin(), that.cluster->getCpuIds().end());
-        return minThis < minThat;
+        // and then by multiplex group, so that the always active group is first
+        return (minThis < minThat) || ((minThis == minThat) && (multiplexGroup < that.multiplexGroup));
     }
     if (that.cluster != nullptr) {
         return false;
@@ -79,6 +86,9 @@ bool PerfEventGroupIdentifier::operator<(const PerfEventGroupIdentifier & that)
 PerfEventGroupIdentifier::operator std::string() const
 {
     if (cluster != nullptr) {
+        if (multiplexGroup > 0) {
+            return lib::Format() << cluster->getId() << " (multiplex group #" << multiplexGroup << ")";
+        }
         return cluster->getId();
     }
     if (pmu != nullptr) {
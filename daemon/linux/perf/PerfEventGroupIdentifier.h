@@ -1,4 +1,4 @@
-/* Copyright (C) 2018-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2018-2022 by Arm Limited. All rights reserved. */
 
 #ifndef INCLUDE_LINUX_PERF_PERF_EVENT_GROUP_IDENTIFIER_H
 #define INCLUDE_LINUX_PERF_PERF_EVENT_GROUP_IDENTIFIER_H
@@ -24,6 +24,15 @@ public:
     /** Constructor, for each CPU PMU in a specific cluster */
     PerfEventGroupIdentifier(const GatorCpu & cluster);
 
+    /**
+     * Constructor, for each CPU PMU in a specific cluster, where the events are split into several groups that are
+     * rotated onto the PMU in turn
+     *
+     * @param cluster The cluster
+     * @param multiplexGroup The (one based) index of the group, or 0 for the group that is always active
+     */
+    PerfEventGroupIdentifier(const GatorCpu & cluster, int multiplexGroup);
+
     /** Constructor, for a given UncorePmu */
     PerfEventGroupIdentifier(const UncorePmu & pmu);
 
@@ -37,7 +46,7 @@ public:
     inline bool operator==(const PerfEventGroupIdentifier & that) const
     {
         return (cluster == that.cluster) && (pmu == that.pmu) && (cpuNumber == that.cpuNumber)
-            && (cpuNumberToType == that.cpuNumberToType);
+            && (cpuNumberToType == that.cpuNumberToType) && (multiplexGroup == that.multiplexGroup);
     }
 
     /** Inequality operator, are they not the same group? */
@@ -59,6 +68,8 @@ public:
 
     inline int getCpuNumber() const { return cpuNumber; }
 
+    inline int getMultiplexGroup() const { return multiplexGroup; }
+
     inline Type getType() const
     {
         if (cluster != nullptr) {
@@ -81,6 +92,7 @@ private:
     const UncorePmu * const pmu;
     const int cpuNumber;
     const std::map<int, int> * const cpuNumberToType;
+    const int multiplexGroup;
 };
 
 #endif /* INCLUDE_LINUX_PERF_PERF_EVENT_GROUP_IDENTIFIER_H */
@@ -0,0 +1,297 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "linux/perf/PerfFunctionProbes.h"
+
+#include "Logging.h"
+#include "SessionData.h"
+#include "lib/AutoClosingFd.h"
+#include "lib/Format.h"
+#include "lib/FsEntry.h"
+#include "linux/Tracepoints.h"
+
+#include <cctype>
+#include <cerrno>
+#include <cinttypes>
+#include <cstring>
+#include <vector>
+
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace perf_function_probes {
+    namespace {
+        // the kernel limits event names to 64 characters, so leave some room for the prefix
+        constexpr std::size_t MAX_EVENT_NAME_SUFFIX = 48;
+
+        /** A read only mapping of a whole file */
+        class MappedFile {
+        public:
+            explicit MappedFile(const char * path)
+            {
+                lib::AutoClosingFd fd {open(path, O_RDONLY | O_CLOEXEC)};
+                if (!fd) {
+                    return;
+                }
+
+                struct stat st;
+                if ((fstat(*fd, &st) != 0) || !S_ISREG(st.st_mode) || (st.st_size <= 0)) {
+                    return;
+                }
+
+                void * const address = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, *fd, 0);
+                if (address == MAP_FAILED) {
+                    return;
+                }
+
+                mData = static_cast<const char *>(address);
+                mSize = st.st_size;
+            }
+
+            ~MappedFile()
+            {
+                if (mData != nullptr) {
+                    munmap(const_cast<char *>(mData), mSize);
+                }
+            }
+
+            // Intentionally undefined
+            MappedFile(const MappedFile &) = delete;
+            MappedFile & operator=(const MappedFile &) = delete;
+            MappedFile(MappedFile &&) = delete;
+            MappedFile & operator=(MappedFile &&) = delete;
+
+            /** @return A pointer to `count` objects of type T at `offset`, or nullptr if any is beyond the file */
+            template<typename T>
+            const T * at(std::uint64_t offset, std::uint64_t count = 1) const
+            {
+                if ((mData == nullptr) || (offset > mSize) || (count > ((mSize - offset) / sizeof(T)))) {
+                    return nullptr;
+                }
+                return reinterpret_cast<const T *>(mData + offset);
+            }
+
+            /** @return The nul terminated string at `offset` within the `size` bytes at `base`, or nullptr */
+            const char * stringAt(std::uint64_t base, std::uint64_t size, std::uint64_t offset) const
+            {
+                const char * const table = at<char>(base, size);
+                if ((table == nullptr) || (offset >= size)
+                    || (std::memchr(table + offset, 0, size - offset) == nullptr)) {
+                    return nullptr;
+                }
+                return table + offset;
+            }
+
+        private:
+            const char * mData = nullptr;
+            std::size_t mSize = 0;
+        };
+
+        template<typename Ehdr, typename Shdr, typename Phdr, typename Sym>
+        std::optional<std::uint64_t> findFunctionOffset(const MappedFile & file, const char * function)
+        {
+            const auto * const ehdr = file.at<Ehdr>(0);
+            if ((ehdr == nullptr) || (ehdr->e_shentsize != sizeof(Shdr))) {
+                return {};
+            }
+
+            const auto * const shdrs = file.at<Shdr>(ehdr->e_shoff, ehdr->e_shnum);
+            if (shdrs == nullptr) {
+                return {};
+            }
+
+            // find the symbol's virtual address; .symtab is searched first as it also has the local functions
+            std::optional<std::uint64_t> address {};
+            for (std::uint32_t type : {SHT_SYMTAB, SHT_DYNSYM}) {
+                for (std::size_t s = 0; (s < ehdr->e_shnum) && !address; ++s) {
+                    const auto & shdr = shdrs[s];
+                    if ((shdr.sh_type != type) || (shdr.sh_entsize != sizeof(Sym)) || (shdr.sh_link >= ehdr->e_shnum)) {
+                        continue;
+                    }
+
+                    const auto & strtab = shdrs[shdr.sh_link];
+                    const auto * const syms = file.at<Sym>(shdr.sh_offset, shdr.sh_size / sizeof(Sym));
+                    if (syms == nullptr) {
+                        continue;
+                    }
+
+                    for (std::size_t i = 0; i < (shdr.sh_size / sizeof(Sym)); ++i) {
+                        const auto & sym = syms[i];
+                        if ((ELF64_ST_TYPE(sym.st_info) != STT_FUNC) || (sym.st_shndx == SHN_UNDEF)
+                            || (sym.st_value == 0)) {
+                            continue;
+                        }
+
+                        const char * const name = file.stringAt(strtab.sh_offset, strtab.sh_size, sym.st_name);
+                        if ((name != nullptr) && (std::strcmp(name, function) == 0)) {
+                            address = sym.st_value;
+                            break;
+                        }
+                    }
+                }
+                if (address) {
+                    break;
+                }
+            }
+
+            if (!address) {
+                return {};
+            }
+
+            // the address of a Thumb function has its bottom bit set
+            if (ehdr->e_machine == EM_ARM) {
+                *address &= ~std::uint64_t(1);
+            }
+
+            // uprobes are placed by file offset, so find the segment that the function is loaded from
+            const auto * const phdrs = file.at<Phdr>(ehdr->e_phoff, ehdr->e_phnum);
+            if ((phdrs == nullptr) || (ehdr->e_phentsize != sizeof(Phdr))) {
+                return {};
+            }
+
+            for (std::size_t i = 0; i < ehdr->e_phnum; ++i) {
+                const auto & phdr = phdrs[i];
+                if ((phdr.p_type == PT_LOAD) && (*address >= phdr.p_vaddr)
+                    && ((*address - phdr.p_vaddr) < phdr.p_filesz)) {
+                    return *address - phdr.p_vaddr + phdr.p_offset;
+                }
+            }
+
+            return {};
+        }
+
+        /** @return The name, reduced to the characters that an event name may contain */
+        std::string sanitizeEventName(const std::string & name)
+        {
+            std::string result;
+            for (char c : name) {
+                if (result.size() >= MAX_EVENT_NAME_SUFFIX) {
+                    break;
+                }
+                result += ((std::isalnum(static_cast<unsigned char>(c)) != 0) ? c : '_');
+            }
+            return result;
+        }
+
+        /** Append a command to uprobe_events, which (unlike truncating it) leaves the other probes in place */
+        bool writeUprobeEvents(const TraceFsConstants & traceFsConstants, const std::string & command)
+        {
+            const std::string path = lib::Format() << traceFsConstants.path << "/uprobe_events";
+
+            lib::AutoClosingFd fd {open(path.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC)};
+            if (!fd) {
+                LOG_DEBUG("Unable to open %s", path.c_str());
+                return false;
+            }
+
+            if (write(*fd, command.c_str(), command.size()) != static_cast<ssize_t>(command.size())) {
+                LOG_DEBUG("Unable to write '%s' to %s (%d)", command.c_str(), path.c_str(), errno);
+                return false;
+            }
+
+            return true;
+        }
+    }
+
+    std::optional<std::uint64_t> findFunctionOffset(const char * path, const char * function)
+    {
+        const MappedFile file {path};
+
+        const auto * const ident = file.at<unsigned char>(0, EI_NIDENT);
+        if ((ident == nullptr) || (std::memcmp(ident, ELFMAG, SELFMAG) != 0)) {
+            return {};
+        }
+
+        // the probed file runs on this machine, so must have the same byte order
+        const unsigned char nativeData = ((__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) ? ELFDATA2LSB : ELFDATA2MSB);
+        if (ident[EI_DATA] != nativeData) {
+            return {};
+        }
+
+        switch (ident[EI_CLASS]) {
+            case ELFCLASS32:
+                return findFunctionOffset<Elf32_Ehdr, Elf32_Shdr, Elf32_Phdr, Elf32_Sym>(file, function);
+            case ELFCLASS64:
+                return findFunctionOffset<Elf64_Ehdr, Elf64_Shdr, Elf64_Phdr, Elf64_Sym>(file, function);
+            default:
+                return {};
+        }
+    }
+
+    std::optional<ProbeTracepoints> createProbe(const TraceFsConstants & traceFsConstants,
+                                                std::size_t index,
+                                                const FunctionProbe & probe)
+    {
+        // the path is separated from the rest of the definition by whitespace
+        for (char c : probe.path) {
+            if (std::isspace(static_cast<unsigned char>(c)) != 0) {
+                LOG_SETUP("Function probe is disabled\n%s contains whitespace", probe.path.c_str());
+                return {};
+            }
+        }
+
+        const auto offset = findFunctionOffset(probe.path.c_str(), probe.function.c_str());
+        if (!offset) {
+            LOG_SETUP("Function probe is disabled\nUnable to find %s in %s",
+                      probe.function.c_str(),
+                      probe.path.c_str());
+            return {};
+        }
+
+        const auto suffix = sanitizeEventName(probe.function);
+        const std::string entryEvent = lib::Format() << "p" << index << "_" << suffix;
+        const std::string returnEvent = lib::Format() << "r" << index << "_" << suffix;
+        const std::string location = lib::Format() << probe.path << ":0x" << std::hex << *offset;
+
+        if (!writeUprobeEvents(traceFsConstants,
+                               lib::Format() << "p:" << PROBE_GROUP << "/" << entryEvent << " " << location << "\n")
+            || !writeUprobeEvents(traceFsConstants,
+                                  lib::Format() << "r:" << PROBE_GROUP << "/" << returnEvent << " " << location
+                                                << "\n")) {
+            LOG_SETUP("Function probe is disabled\nUnable to probe %s in %s",
+                      probe.function.c_str(),
+                      probe.path.c_str());
+            return {};
+        }
+
+        ProbeTracepoints result {
+            lib::Format() << PROBE_GROUP << "/" << entryEvent,
+            lib::Format() << PROBE_GROUP << "/" << returnEvent,
+            UNKNOWN_TRACEPOINT_ID,
+            UNKNOWN_TRACEPOINT_ID,
+        };
+        result.entryId = getTracepointId(traceFsConstants, result.entryName.c_str());
+        result.returnId = getTracepointId(traceFsConstants, result.returnName.c_str());
+        if ((result.entryId <= 0) || (result.returnId <= 0)) {
+            LOG_SETUP("Function probe is disabled\nThe tracepoints of %s were not found", probe.function.c_str());
+            return {};
+        }
+
+        LOG_DEBUG("Probing %s in %s at offset 0x%" PRIx64, probe.function.c_str(), probe.path.c_str(), *offset);
+        return result;
+    }
+
+    void removeProbes(const TraceFsConstants & traceFsConstants)
+    {
+        const auto group = lib::FsEntry::create(lib::FsEntry::create(traceFsConstants.path__events), PROBE_GROUP);
+        if (!group.exists()) {
+            return;
+        }
+
+        std::vector<std::string> events;
+        auto children = group.children();
+        for (auto child = children.next(); child; child = children.next()) {
+            if (child->read_stats().type() == lib::FsEntry::Type::DIR) {
+                events.push_back(child->name());
+            }
+        }
+
+        for (const auto & event : events) {
+            if (!writeUprobeEvents(traceFsConstants, lib::Format() << "-:" << PROBE_GROUP << "/" << event << "\n")) {
+                LOG_WARNING("Unable to remove the function probe %s/%s", PROBE_GROUP, event.c_str());
+            }
+        }
+    }
+}
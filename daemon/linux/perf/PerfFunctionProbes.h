@@ -0,0 +1,49 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#ifndef PERF_FUNCTION_PROBES_H
+#define PERF_FUNCTION_PROBES_H
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+struct FunctionProbe;
+struct TraceFsConstants;
+
+namespace perf_function_probes {
+    /** The tracefs group that all of gator's function probe events are created in */
+    constexpr const char * PROBE_GROUP = "gator_probes";
+
+    /** The dynamic tracepoints that fire on the entry to, and return from, a probed function */
+    struct ProbeTracepoints {
+        // the tracepoint names, as "group/event"
+        std::string entryName;
+        std::string returnName;
+        std::int64_t entryId;
+        std::int64_t returnId;
+    };
+
+    /**
+     * Find the offset of a function in an ELF file, as a uprobe expects it
+     *
+     * @param path The executable or shared library
+     * @param function The name of the function's symbol, from either .symtab or .dynsym
+     * @return The file offset of the function's first instruction, or empty if it was not found
+     */
+    std::optional<std::uint64_t> findFunctionOffset(const char * path, const char * function);
+
+    /**
+     * Create a uprobe and a uretprobe on some function, by writing to tracefs' uprobe_events
+     *
+     * @param index Distinguishes the events of the probes of functions with the same name
+     * @return The tracepoints, or empty if the function was not found or the probes could not be created
+     */
+    std::optional<ProbeTracepoints> createProbe(const TraceFsConstants & traceFsConstants,
+                                                std::size_t index,
+                                                const FunctionProbe & probe);
+
+    /** Remove every probe in PROBE_GROUP, including any left behind by some earlier gatord that did not exit cleanly */
+    void removeProbes(const TraceFsConstants & traceFsConstants);
+}
+
+#endif // PERF_FUNCTION_PROBES_H
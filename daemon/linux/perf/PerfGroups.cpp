@@ -71,6 +71,10 @@ bool perf_groups_configurer_t::add(attr_to_key_mapping_tracker_t & mapping_track
                                    const IPerfGroups::Attr & attr,
                                    bool hasAuxData)
 {
+    // the multiplex groups are rotated by the group leader, so without one (in app mode) they stay in the main group
+    if ((groupIdentifier.getMultiplexGroup() > 0) && (!configuration.perfConfig.is_system_wide)) {
+        return add(mapping_tracker, PerfEventGroupIdentifier(*groupIdentifier.getCluster()), key, attr, hasAuxData);
+    }
 
     auto eventGroup = getGroup(mapping_tracker, groupIdentifier);
     LOG_DEBUG("Adding event: group='%s', key=%i, type=%" PRIu32 ", config=%" PRIu64 ", config1=%" PRIu64
@@ -100,11 +104,14 @@ bool perf_groups_configurer_t::add(attr_to_key_mapping_tracker_t & mapping_track
     }
 
     // If we are not system wide the group leader can't read counters for us
-    // so we need to add sample them individually periodically
-    if (((!configuration.perfConfig.is_system_wide) || (!eventGroup.requiresLeader())) && (attr.periodOrFreq == 0)) {
+    // so we need to add sample them individually periodically, unless the perf agent reads their inherited counts
+    const bool readInheritedCount = configuration.inheritStatCounters && !configuration.perfConfig.is_system_wide;
+    // (events that write to the aux buffer, such as the ETM's, have no count to sample)
+    if (((!configuration.perfConfig.is_system_wide) || (!eventGroup.requiresLeader())) && (attr.periodOrFreq == 0)
+        && !readInheritedCount && !hasAuxData) {
         LOG_DEBUG("    Forcing as freq counter");
-        newAttr.periodOrFreq =
-            configuration.sampleRate > 0 && configuration.enablePeriodicSampling ? configuration.sampleRate : 10UL;
+        const int sampleRate = eventGroup.getSampleRate();
+        newAttr.periodOrFreq = sampleRate > 0 && configuration.enablePeriodicSampling ? sampleRate : 10UL;
         newAttr.sampleType |= PERF_SAMPLE_PERIOD;
         newAttr.freq = true;
     }
@@ -35,6 +35,13 @@ public:
         initHeader(mapping_tracker);
     }
 
+    /** Resume configuring the state, whose header was already created, such as to add events to a running capture */
+    perf_groups_configurer_t(perf_event_group_configurer_config_t & configuration,
+                             perf_groups_configurer_state_t & state)
+        : configuration(configuration), state(state)
+    {
+    }
+
     bool add(attr_to_key_mapping_tracker_t & mapping_tracker,
              const PerfEventGroupIdentifier & groupIdentifier,
              int key,
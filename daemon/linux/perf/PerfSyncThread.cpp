@@ -3,11 +3,14 @@
 #include "linux/perf/PerfSyncThread.h"
 
 #include "Logging.h"
+#include "lib/ArchTimerDriftModel.h"
+#include "lib/ArchTimestamp.h"
 #include "lib/Assert.h"
 #include "lib/GenericTimer.h"
 #include "lib/String.h"
 #include "lib/Syscall.h"
 
+#include <algorithm>
 #include <cerrno>
 #include <csignal>
 #include <cstdio>
@@ -35,24 +38,20 @@ namespace {
 
         return 0;
     }
-
-    inline std::uint64_t get_cntvct_el0(bool readTimer)
-    {
-        if (readTimer) {
-            return lib::get_cntvct_el0();
-        }
-        return 0;
-    }
 }
 
-extern std::uint64_t getTime();
-
 #define NS_PER_S 1000000000ULL
 #define NS_TO_US 1000ULL
 #define NS_TO_SLEEP (NS_PER_S / 2)
 
-PerfSyncThread::PerfSyncThread(bool enableSyncThreadMode, bool readTimer, ConsumerFunction consumerFunction)
-    : consumerFunction(std::move(consumerFunction)), readTimer(readTimer), enableSyncThreadMode(enableSyncThreadMode)
+PerfSyncThread::PerfSyncThread(bool enableSyncThreadMode,
+                               bool readTimer,
+                               std::chrono::nanoseconds minPeriod,
+                               ConsumerFunction consumerFunction)
+    : consumerFunction(std::move(consumerFunction)),
+      sleepNs(std::max<std::uint64_t>(NS_TO_SLEEP, minPeriod.count())),
+      readTimer(readTimer),
+      enableSyncThreadMode(enableSyncThreadMode)
 {
     runtime_assert(enableSyncThreadMode || readTimer, "At least one of enableSyncThreadMode or readTimer are required");
 }
@@ -71,7 +70,11 @@ void PerfSyncThread::start(std::uint64_t monotonicRawBase)
 
 void PerfSyncThread::terminate()
 {
-    terminateFlag.store(true, std::memory_order_release);
+    {
+        std::lock_guard<std::mutex> lock {sleepMutex};
+        terminateFlag.store(true, std::memory_order_release);
+    }
+    sleepCondition.notify_all();
     if (thread.joinable()) {
         thread.join();
     }
@@ -140,27 +143,59 @@ void PerfSyncThread::run(std::uint64_t monotonicRawBase) noexcept
     // read CNTFREQ_EL0
     const std::uint64_t frequency = get_cntfreq_el0(readTimer);
 
+    // when only the arch timer is synced, the sync points are sent as the drift model requires rather than every time
+    const bool useDriftModel = readTimer && (!enableSyncThreadMode) && (frequency != 0);
+    const std::uint64_t maxIntervalNs = std::max(MAX_SYNC_INTERVAL_NS, sleepNs);
+    lib::ArchTimerDriftModel model {frequency, SYNC_ERROR_THRESHOLD_NS};
+    std::uint64_t lastSyncTime = 0;
+    unsigned samples = 0;
+    unsigned syncPoints = 0;
+
     // main loop (always executes at least once to ensure we always capture at least one sync point
     do {
-        // get current timestamp
-        const std::uint64_t syncTime = getTime();
-
-        // get architectural timer for SPE sync
-        const std::uint64_t vcount = get_cntvct_el0(readTimer);
-
-        // send the updated name with the monotonic delta
-        rename(syncTime - monotonicRawBase);
+        // get current timestamp, and architectural timer for SPE sync, from the kernel's clock as getTime() may be
+        // derived from the architectural timer
+        const lib::ArchTimerSample sample =
+            (readTimer ? lib::sampleArchTimer(useDriftModel ? SYNC_READ_ATTEMPTS : 1)
+                       : lib::ArchTimerSample {lib::getMonotonicRawNS(), 0, 0});
+        const std::uint64_t syncTime = sample.monotonicRawNS;
+        const std::uint64_t vcount = sample.count;
+        std::uint64_t nextSleepNs = sleepNs;
+        ++samples;
+
+        if (useDriftModel) {
+            model.addSample(sample);
+
+            if (model.needsSyncPoint(syncTime) || ((syncTime - lastSyncTime) >= maxIntervalNs)) {
+                consumerFunction(pid, tid, frequency, syncTime, vcount);
+                model.setSyncPoint(sample);
+                lastSyncTime = syncTime;
+                ++syncPoints;
+            }
 
-        // send the data to the consumer
-        consumerFunction(pid, tid, frequency, syncTime, vcount);
+            // resample well before the error is predicted to reach the threshold
+            if (model.isFitted()) {
+                nextSleepNs = std::clamp(model.timeUntilThresholdNS(syncTime) / 2, sleepNs, maxIntervalNs);
+            }
+        }
+        else {
+            // send the updated name with the monotonic delta
+            rename(syncTime - monotonicRawBase);
 
-        // sleep for short period
-        struct timespec ts;
-        ts.tv_sec = NS_TO_SLEEP / NS_PER_S;
-        ts.tv_nsec = NS_TO_SLEEP % NS_PER_S;
-        if (nanosleep(&ts, nullptr) != 0) {
-            LOG_ERROR("nanosleep failed: %d (%s)", errno, strerror(errno));
-            handleException();
+            // send the data to the consumer
+            consumerFunction(pid, tid, frequency, syncTime, vcount);
+            ++syncPoints;
         }
+
+        // sleep until the next sample, or until terminated
+        std::unique_lock<std::mutex> lock {sleepMutex};
+        sleepCondition.wait_for(lock, std::chrono::nanoseconds(nextSleepNs), [this]() {
+            return terminateFlag.load(std::memory_order_acquire);
+        });
     } while (!terminateFlag.load(std::memory_order_acquire));
+
+    LOG_DEBUG("Sync thread sent %u sync points from %u samples (arch timer drift %.3f ns/s)",
+              syncPoints,
+              samples,
+              model.getDriftNSPerS());
 }
@@ -1,15 +1,34 @@
-/* Copyright (C) 2018-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2018-2022 by Arm Limited. All rights reserved. */
 
 #ifndef INCLUDE_LINUX_PERF_PERFSYNCTHREAD_H
 #define INCLUDE_LINUX_PERF_PERFSYNCTHREAD_H
 
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
 #include <functional>
+#include <mutex>
 #include <thread>
 
+/**
+ * Sends the sync points that relate the perf clock (by renaming the thread, when perf cannot use CLOCK_MONOTONIC_RAW)
+ * and the arch timer (for SPE) to CLOCK_MONOTONIC_RAW.
+ *
+ * When only the arch timer needs syncing, the timer is read bracketed by the clock several times per sample, and a
+ * sync point is only sent when the drift model predicts that the host's extrapolation from the previous one would be
+ * off by more than SYNC_ERROR_THRESHOLD_NS (or at least every MAX_SYNC_INTERVAL_NS). The thread then sleeps for half
+ * the time until the error is predicted to reach the threshold.
+ */
 class PerfSyncThread {
 public:
+    /** The predicted error at which a new arch timer sync point is sent */
+    static constexpr std::uint64_t SYNC_ERROR_THRESHOLD_NS = 1000;
+    /** The longest time between arch timer sync points */
+    static constexpr std::uint64_t MAX_SYNC_INTERVAL_NS = 10000000000ULL;
+    /** The number of bracketed reads of the arch timer per sample, of which the narrowest is used */
+    static constexpr int SYNC_READ_ATTEMPTS = 5;
+
     /**
      * Consumer function that takes sync event data:
      *
@@ -25,9 +44,13 @@ public:
      * Constructor
      * @param enableSyncThreadMode True to enable 'gatord-sync' thread mode
      * @param readTimer True to read the arch timer, false otherwise
+     * @param minPeriod The least time between sync points, or 0 for the default
      * @param consumerFunction The data consumer function
      */
-    PerfSyncThread(bool enableSyncThreadMode, bool readTimer, ConsumerFunction consumerFunction);
+    PerfSyncThread(bool enableSyncThreadMode,
+                   bool readTimer,
+                   std::chrono::nanoseconds minPeriod,
+                   ConsumerFunction consumerFunction);
 
     ~PerfSyncThread();
 
@@ -48,7 +71,10 @@ private:
 
     std::thread thread {};
     ConsumerFunction consumerFunction;
+    std::mutex sleepMutex {};
+    std::condition_variable sleepCondition {};
     std::atomic_bool terminateFlag {false};
+    std::uint64_t sleepNs;
     bool readTimer;
     bool enableSyncThreadMode;
 };
@@ -1,9 +1,10 @@
-/* Copyright (C) 2010-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2010-2022 by Arm Limited. All rights reserved. */
 
 #ifndef PERF_UTILS_H
 #define PERF_UTILS_H
 
 #include "lib/Format.h"
+#include "lib/FsEntry.h"
 #include "lib/Utils.h"
 
 #include <optional>
@@ -26,6 +27,41 @@ namespace perf_utils {
         }
         return std::optional<std::int64_t>();
     }
+
+    /**
+     * Find the directory of some perf_event cgroup
+     *
+     * @param cgroup Either the absolute path to the cgroup directory, or its path relative to the cgroup mount point
+     *  (for cgroup v1, relative to the perf_event controller's hierarchy)
+     * @return The absolute path to the cgroup directory, or empty if not found
+     */
+    inline std::optional<std::string> findPerfEventCgroupPath(const std::string & cgroup)
+    {
+        const auto isDir = [](const std::string & path) {
+            auto entry = lib::FsEntry::create(path);
+            return (entry.read_stats().type() == lib::FsEntry::Type::DIR);
+        };
+
+        if (cgroup.empty()) {
+            return {};
+        }
+
+        if (cgroup.front() == '/') {
+            if (isDir(cgroup)) {
+                return cgroup;
+            }
+            return {};
+        }
+
+        for (const char * root : {"/sys/fs/cgroup/perf_event/", "/sys/fs/cgroup/"}) {
+            std::string path = lib::Format() << root << cgroup;
+            if (isDir(path)) {
+                return path;
+            }
+        }
+
+        return {};
+    }
 }
 
 #endif // PERF_UTILS_H
@@ -0,0 +1,359 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "linux/proc/IncrementalProcessPoller.h"
+
+#include "Logging.h"
+#include "lib/Resource.h"
+#include "lib/String.h"
+#include "lib/Syscall.h"
+#include "linux/proc/ProcLoadAvgFileRecord.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+namespace lnx {
+    namespace {
+        /** Large enough for any stat, statm or loadavg file */
+        constexpr std::size_t READ_BUFFER_SIZE = 4096;
+        /** The fraction of the RLIMIT_NOFILE soft limit that may be used to hold stat files open */
+        constexpr std::size_t FD_LIMIT_FRACTION = 2;
+        /** The number of fds used when RLIMIT_NOFILE cannot be read */
+        constexpr std::size_t DEFAULT_MAX_OPEN_FDS = 256;
+
+        using path_str_t = lib::printf_str_t<64>;
+
+        std::size_t getMaxOpenFds()
+        {
+            struct rlimit rlim {};
+            if ((lib::getrlimit(RLIMIT_NOFILE, &rlim) != 0) || (rlim.rlim_cur == RLIM_INFINITY)) {
+                return DEFAULT_MAX_OPEN_FDS;
+            }
+            return rlim.rlim_cur / FD_LIMIT_FRACTION;
+        }
+
+        /**
+         * @return The pid/tid value if the entry is a pid/tid directory, otherwise 0
+         */
+        int getPidFromDirent(const dirent & entry)
+        {
+            // type must be directory (or unknown, in which case the subsequent open will fail if it is not)
+            if ((entry.d_type != DT_DIR) && (entry.d_type != DT_UNKNOWN)) {
+                return 0;
+            }
+
+            // name must be only digits
+            char * end = nullptr;
+            const long pid = std::strtol(entry.d_name, &end, 10);
+            if ((end == entry.d_name) || (*end != '\0')) {
+                return 0;
+            }
+
+            return static_cast<int>(pid);
+        }
+
+        /**
+         * @return True if no thread in the process has run between the two samples
+         */
+        bool isSameActivity(const taskstats & previous, const taskstats & current)
+        {
+            return (previous.ac_utime == current.ac_utime) && (previous.ac_stime == current.ac_stime)
+                && (previous.nvcsw == current.nvcsw) && (previous.nivcsw == current.nivcsw);
+        }
+    }
+
+    IncrementalProcessPoller::IncrementalProcessPoller()
+        : taskstatsClient(context),
+          loadavgFd(lib::open("/proc/loadavg", O_RDONLY | O_CLOEXEC)),
+          readBuffer(READ_BUFFER_SIZE),
+          maxOpenFds(getMaxOpenFds())
+    {
+        LOG_DEBUG("Process polling %s taskstats", (taskstatsClient.is_open() ? "uses" : "does not use"));
+    }
+
+    void IncrementalProcessPoller::poll(ProcessPollerBase::IProcessPollerReceiver & receiver)
+    {
+        if (walkRequired || hasNewTasks()) {
+            walkRequired = false;
+            walkProc();
+        }
+
+        for (auto it = processes.begin(); it != processes.end();) {
+            if (pollProcess(it->first, it->second, receiver)) {
+                ++it;
+            }
+            else {
+                closeProcess(it->second);
+                it = processes.erase(it);
+            }
+        }
+    }
+
+    bool IncrementalProcessPoller::hasNewTasks()
+    {
+        ProcLoadAvgFileRecord record;
+        const char * const contents = readFile(loadavgFd, "/proc/loadavg");
+        if ((contents == nullptr) || !ProcLoadAvgFileRecord::parseLoadAvgFile(record, contents)) {
+            // cannot tell, so must assume there are
+            return true;
+        }
+
+        // every fork / clone changes the most recently allocated pid
+        const bool result = (record.getNewestPid() != lastNewestPid);
+        lastNewestPid = record.getNewestPid();
+        return result;
+    }
+
+    void IncrementalProcessPoller::walkProc()
+    {
+        // read this first so that anything created during the walk triggers another
+        hasNewTasks();
+
+        const std::unique_ptr<DIR, int (*)(DIR *)> procDir {opendir("/proc"), &closedir};
+        if (procDir == nullptr) {
+            LOG_DEBUG("Failed to open /proc (%d)", errno);
+            walkRequired = true;
+            return;
+        }
+
+        for (auto & entry : processes) {
+            entry.second.seen = false;
+        }
+
+        const dirent * procEntry;
+        while ((procEntry = readdir(procDir.get())) != nullptr) {
+            const int pid = getPidFromDirent(*procEntry);
+            if (pid <= 0) {
+                continue;
+            }
+
+            auto [it, inserted] = processes.try_emplace(pid);
+            ProcessState & process = it->second;
+            if (inserted) {
+                path_str_t path {"/proc/%d/statm", pid};
+                process.statmFd = openFile(path);
+            }
+            process.seen = true;
+
+            walkTasks(pid, process);
+        }
+
+        for (auto it = processes.begin(); it != processes.end();) {
+            if (it->second.seen && !it->second.threads.empty()) {
+                ++it;
+            }
+            else {
+                closeProcess(it->second);
+                it = processes.erase(it);
+            }
+        }
+    }
+
+    void IncrementalProcessPoller::walkTasks(int pid, ProcessState & process)
+    {
+        path_str_t path {"/proc/%d/task", pid};
+        const std::unique_ptr<DIR, int (*)(DIR *)> taskDir {opendir(path), &closedir};
+
+        for (auto & entry : process.threads) {
+            entry.second.seen = false;
+        }
+
+        auto addThread = [&](int tid, const char * statPath) {
+            auto [it, inserted] = process.threads.try_emplace(tid);
+            if (inserted) {
+                it->second.statFd = openFile(statPath);
+                process.threadsChanged = true;
+            }
+            it->second.seen = true;
+        };
+
+        if (taskDir == nullptr) {
+            // if for some reason the task directory does not exist, then use stat in the pid directory instead
+            path.printf("/proc/%d/stat", pid);
+            addThread(pid, path);
+        }
+        else {
+            const dirent * taskEntry;
+            while ((taskEntry = readdir(taskDir.get())) != nullptr) {
+                const int tid = getPidFromDirent(*taskEntry);
+                if (tid > 0) {
+                    path.printf("/proc/%d/task/%d/stat", pid, tid);
+                    addThread(tid, path);
+                }
+            }
+        }
+
+        for (auto it = process.threads.begin(); it != process.threads.end();) {
+            if (it->second.seen) {
+                ++it;
+            }
+            else {
+                closeFile(it->second.statFd);
+                it = process.threads.erase(it);
+                process.threadsChanged = true;
+            }
+        }
+    }
+
+    bool IncrementalProcessPoller::isIdle(int pid, ProcessState & process)
+    {
+        if (!taskstatsClient.is_open()) {
+            return false;
+        }
+
+        std::optional<taskstats> activity = taskstatsClient.query_tgid(pid);
+
+        const bool result = activity && process.activity && !process.threadsChanged
+                         && (process.idlePolls < MAX_IDLE_POLLS) && isSameActivity(*process.activity, *activity);
+
+        process.activity = activity;
+        process.idlePolls = (result ? process.idlePolls + 1 : 0);
+        return result;
+    }
+
+    bool IncrementalProcessPoller::pollProcess(int pid,
+                                               ProcessState & process,
+                                               ProcessPollerBase::IProcessPollerReceiver & receiver)
+    {
+        if (isIdle(pid, process)) {
+            // nothing has run so the files are unchanged since they were last read
+            for (const auto & [tid, thread] : process.threads) {
+                receiver.onThreadDetails(pid, tid, thread.stat, process.statm, process.exe);
+            }
+            return true;
+        }
+
+        process.threadsChanged = false;
+
+        // the statm values are shared by all threads, so read them once per process
+        process.statm = ProcPidStatmFileRecord();
+        {
+            path_str_t path {"/proc/%d/statm", pid};
+            const char * const contents = readFile(process.statmFd, path);
+            if ((contents == nullptr) || !ProcPidStatmFileRecord::parseStatmFile(*process.statm, contents)) {
+                process.statm.reset();
+            }
+        }
+
+        // the main thread determines the exe, so must be read first
+        const ProcPidStatFileRecord * mainThreadRecord = nullptr;
+        const auto mainThread = process.threads.find(pid);
+        if (mainThread != process.threads.end()) {
+            if (readThreadStat(pid, pid, mainThread->second)) {
+                mainThreadRecord = &mainThread->second.stat;
+            }
+            else {
+                closeFile(mainThread->second.statFd);
+                process.threads.erase(mainThread);
+                process.threadsChanged = true;
+            }
+        }
+
+        updateExe(pid, process, mainThreadRecord);
+
+        for (auto it = process.threads.begin(); it != process.threads.end();) {
+            const int tid = it->first;
+
+            if ((tid == pid) || readThreadStat(pid, tid, it->second)) {
+                receiver.onThreadDetails(pid, tid, it->second.stat, process.statm, process.exe);
+                ++it;
+            }
+            else {
+                // the thread has exited
+                closeFile(it->second.statFd);
+                it = process.threads.erase(it);
+                process.threadsChanged = true;
+            }
+        }
+
+        return !process.threads.empty();
+    }
+
+    bool IncrementalProcessPoller::readThreadStat(int pid, int tid, ThreadState & thread)
+    {
+        path_str_t path {"/proc/%d/task/%d/stat", pid, tid};
+        const char * const contents = readFile(thread.statFd, path);
+        return (contents != nullptr) && ProcPidStatFileRecord::parseStatFile(thread.stat, contents);
+    }
+
+    void IncrementalProcessPoller::updateExe(int pid,
+                                             ProcessState & process,
+                                             const ProcPidStatFileRecord * mainThreadRecord)
+    {
+        if (mainThreadRecord != nullptr) {
+            if (process.exeValid && (process.exeStarttime == mainThreadRecord->getStarttime())
+                && (process.exeComm == mainThreadRecord->getComm())) {
+                return;
+            }
+            process.exeStarttime = mainThreadRecord->getStarttime();
+            process.exeComm = mainThreadRecord->getComm();
+        }
+        else if (process.exeValid) {
+            return;
+        }
+
+        path_str_t path {"/proc/%d", pid};
+        process.exe = getProcessExePath(lib::FsEntry::create(path.c_str()));
+        process.exeValid = true;
+    }
+
+    lib::AutoClosingFd IncrementalProcessPoller::openFile(const char * path)
+    {
+        // beyond the limit the file is opened each time it is read instead
+        if (openFds >= maxOpenFds) {
+            return {};
+        }
+
+        lib::AutoClosingFd result {lib::open(path, O_RDONLY | O_CLOEXEC)};
+        if (result) {
+            openFds += 1;
+        }
+        return result;
+    }
+
+    void IncrementalProcessPoller::closeFile(lib::AutoClosingFd & fd)
+    {
+        if (fd) {
+            fd.close();
+            openFds -= 1;
+        }
+    }
+
+    void IncrementalProcessPoller::closeProcess(ProcessState & process)
+    {
+        closeFile(process.statmFd);
+        for (auto & entry : process.threads) {
+            closeFile(entry.second.statFd);
+        }
+    }
+
+    const char * IncrementalProcessPoller::readFile(const lib::AutoClosingFd & fd, const char * path)
+    {
+        ssize_t length;
+
+        if (fd) {
+            length = ::pread(*fd, readBuffer.data(), readBuffer.size() - 1, 0);
+        }
+        else {
+            const lib::AutoClosingFd tempFd {lib::open(path, O_RDONLY | O_CLOEXEC)};
+            if (!tempFd) {
+                return nullptr;
+            }
+            length = ::read(*tempFd, readBuffer.data(), readBuffer.size() - 1);
+        }
+
+        // fails with ESRCH (or returns nothing) once the task has exited
+        if (length <= 0) {
+            return nullptr;
+        }
+
+        readBuffer[length] = '\0';
+        return readBuffer.data();
+    }
+}
@@ -0,0 +1,100 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#ifndef INCLUDE_LINUX_PROC_INCREMENTALPROCESSPOLLER_H
+#define INCLUDE_LINUX_PROC_INCREMENTALPROCESSPOLLER_H
+
+#include "async/netlink/nl_taskstats.h"
+#include "lib/AutoClosingFd.h"
+#include "lib/FsEntry.h"
+#include "linux/proc/ProcessPollerBase.h"
+
+#include <cstddef>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <boost/asio/io_context.hpp>
+
+#include <linux/taskstats.h>
+
+namespace lnx {
+    /**
+     * Repeatedly scans the /proc/[PID]/task/[TID]/stat and /proc/[PID]/statm files of every thread, as for
+     * ProcessPollerBase::poll(true, true, ...), but with a per-poll cost that scales with the number of threads created
+     * and destroyed rather than the total number of threads.
+     *
+     * - The stat and statm files of known threads are kept open and re-read from offset 0.
+     * - The exe path of each process is cached until the pid is reused or the process calls exec (detected by a change
+     *   in the start time or comm of the main thread).
+     * - /proc is only walked when /proc/loadavg shows that some task was created since the previous walk; exited tasks
+     *   are detected by their stat file becoming unreadable.
+     * - Where taskstats is available (it requires CAP_NET_ADMIN), each process is first checked with a single taskstats
+     *   request, and if none of its threads have run since the previous poll then the previously read records are
+     *   reported again rather than reading the stat file of every thread. The files are still fully re-read every
+     *   MAX_IDLE_POLLS polls so that changes made without the process running (such as reclaim) are seen.
+     *
+     * Only IProcessPollerReceiver::onThreadDetails is called.
+     */
+    class IncrementalProcessPoller {
+    public:
+        /** The maximum number of consecutive polls for which an idle process may report its previous records */
+        static constexpr unsigned MAX_IDLE_POLLS = 10;
+
+        IncrementalProcessPoller();
+
+        void poll(ProcessPollerBase::IProcessPollerReceiver & receiver);
+
+    private:
+        struct ThreadState {
+            /** The open stat file, or invalid if it must be opened each time as the fd limit was reached */
+            lib::AutoClosingFd statFd {};
+            /** The most recently read contents of the stat file */
+            ProcPidStatFileRecord stat {};
+            bool seen {false};
+        };
+
+        struct ProcessState {
+            /** The open statm file, or invalid if it must be opened each time as the fd limit was reached */
+            lib::AutoClosingFd statmFd {};
+            std::map<int, ThreadState> threads {};
+            /** The most recently read contents of the statm file */
+            std::optional<ProcPidStatmFileRecord> statm {};
+            /** The taskstats at the most recent poll */
+            std::optional<taskstats> activity {};
+            std::optional<lib::FsEntry> exe {};
+            unsigned long long exeStarttime {0};
+            std::string exeComm {};
+            unsigned idlePolls {0};
+            bool exeValid {false};
+            /** True when threads were added or removed since the files were last read */
+            bool threadsChanged {true};
+            bool seen {false};
+        };
+
+        std::map<int, ProcessState> processes {};
+        boost::asio::io_context context {};
+        async::netlink::nl_taskstats_client_t taskstatsClient;
+        lib::AutoClosingFd loadavgFd;
+        std::vector<char> readBuffer;
+        unsigned long lastNewestPid {0};
+        std::size_t maxOpenFds;
+        std::size_t openFds {0};
+        bool walkRequired {true};
+
+        bool hasNewTasks();
+        void walkProc();
+        void walkTasks(int pid, ProcessState & process);
+        bool isIdle(int pid, ProcessState & process);
+        bool pollProcess(int pid, ProcessState & process, ProcessPollerBase::IProcessPollerReceiver & receiver);
+        bool readThreadStat(int pid, int tid, ThreadState & thread);
+        void updateExe(int pid, ProcessState & process, const ProcPidStatFileRecord * mainThreadRecord);
+
+        lib::AutoClosingFd openFile(const char * path);
+        void closeFile(lib::AutoClosingFd & fd);
+        void closeProcess(ProcessState & process);
+        const char * readFile(const lib::AutoClosingFd & fd, const char * path);
+    };
+}
+
+#endif /* INCLUDE_LINUX_PROC_INCREMENTALPROCESSPOLLER_H */
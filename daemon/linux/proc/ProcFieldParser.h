@@ -0,0 +1,129 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#ifndef INCLUDE_LINUX_PROC_PROCFIELDPARSER_H
+#define INCLUDE_LINUX_PROC_PROCFIELDPARSER_H
+
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+
+namespace lnx {
+    /**
+     * Splits the text of a /proc file into whitespace separated fields and parses them in place.
+     *
+     * Unlike sscanf the parser never copies, allocates or depends on the locale, so it is suitable for files that are
+     * re-read on every poll. The text must outlive the parser.
+     */
+    class ProcFieldParser {
+    public:
+        constexpr explicit ProcFieldParser(std::string_view text) : text(text) {}
+
+        /**
+         * Remove the first line from some text
+         *
+         * @param text The text, which is modified to start after the line's terminating newline (if any)
+         * @return The line, not including the newline
+         */
+        static constexpr std::string_view nextLine(std::string_view & text)
+        {
+            const auto end = text.find('\n');
+            if (end == std::string_view::npos) {
+                const auto line = text;
+                text = {};
+                return line;
+            }
+            const auto line = text.substr(0, end);
+            text.remove_prefix(end + 1);
+            return line;
+        }
+
+        /** @return The next field, or an empty view if there are no more fields */
+        constexpr std::string_view nextField()
+        {
+            skipWhitespace();
+            const auto end = std::min(text.find_first_of(WHITESPACE), text.size());
+            const auto field = text.substr(0, end);
+            text.remove_prefix(end);
+            return field;
+        }
+
+        /**
+         * Skip over some fields
+         *
+         * @return False if there were fewer fields than requested
+         */
+        constexpr bool skip(std::size_t count = 1)
+        {
+            for (std::size_t n = 0; n < count; ++n) {
+                if (nextField().empty()) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        /**
+         * Parse the next field as a single character (as for "%c" after whitespace)
+         *
+         * @return False if there are no more fields
+         */
+        constexpr bool next(char & value)
+        {
+            skipWhitespace();
+            if (text.empty()) {
+                return false;
+            }
+            value = text.front();
+            text.remove_prefix(1);
+            return true;
+        }
+
+        /**
+         * Parse the next field as a decimal integer
+         *
+         * @return False if there are no more fields, or the field is not wholly a value of type T
+         */
+        template<typename T>
+        bool next(T & value)
+        {
+            static_assert(std::is_integral_v<T>, "Only integer fields are supported");
+
+            const auto field = nextField();
+            if (field.empty()) {
+                return false;
+            }
+            const char * const end = field.data() + field.size();
+            const auto [ptr, ec] = std::from_chars(field.data(), end, value);
+            return (ec == std::errc {}) && (ptr == end);
+        }
+
+        /**
+         * Parse the next fields into each of the values in turn
+         *
+         * @return False if any field could not be parsed, in which case the values after it are unmodified
+         */
+        template<typename... T>
+        bool nextAll(T &... values)
+        {
+            return (next(values) && ...);
+        }
+
+        /** @return The text that has not yet been parsed */
+        [[nodiscard]] constexpr std::string_view remaining() const { return text; }
+
+    private:
+        static constexpr std::string_view WHITESPACE {" \t\n"};
+
+        std::string_view text;
+
+        constexpr void skipWhitespace()
+        {
+            text.remove_prefix(std::min(text.find_first_not_of(WHITESPACE), text.size()));
+        }
+    };
+}
+
+#endif /* INCLUDE_LINUX_PROC_PROCFIELDPARSER_H */
@@ -0,0 +1,68 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "linux/proc/ProcPidSmapsRollupFileRecord.h"
+
+#include "linux/proc/ProcFieldParser.h"
+
+#include <array>
+#include <cstddef>
+#include <utility>
+
+namespace lnx {
+    namespace {
+        constexpr unsigned long long BYTES_PER_KIB = 1024;
+    }
+
+    bool ProcPidSmapsRollupFileRecord::parseSmapsRollupFile(ProcPidSmapsRollupFileRecord & result,
+                                                            std::string_view contents)
+    {
+        ProcPidSmapsRollupFileRecord record {};
+
+        const std::array<std::pair<std::string_view, unsigned long long *>, 4> fields {{
+            {"Rss", &record.rss},
+            {"Pss", &record.pss},
+            {"Private_Clean", &record.privateClean},
+            {"Private_Dirty", &record.privateDirty},
+        }};
+
+        // the first line describes the combined mapping, the rest are "Name:   value kB"
+        ProcFieldParser::nextLine(contents);
+
+        std::size_t found = 0;
+        while ((found < fields.size()) && !contents.empty()) {
+            const std::string_view line = ProcFieldParser::nextLine(contents);
+            const auto colon = line.find(':');
+            if (colon == std::string_view::npos) {
+                continue;
+            }
+
+            const std::string_view name = line.substr(0, colon);
+            for (const auto & [fieldName, value] : fields) {
+                if (fieldName == name) {
+                    unsigned long long kib = 0;
+                    if (!ProcFieldParser {line.substr(colon + 1)}.next(kib)) {
+                        return false;
+                    }
+                    *value = kib * BYTES_PER_KIB;
+                    found += 1;
+                    break;
+                }
+            }
+        }
+
+        if (found < fields.size()) {
+            return false;
+        }
+
+        result = record;
+        return true;
+    }
+
+    ProcPidSmapsRollupFileRecord::ProcPidSmapsRollupFileRecord(unsigned long long rss_,
+                                                               unsigned long long pss_,
+                                                               unsigned long long privateClean_,
+                                                               unsigned long long privateDirty_)
+        : rss(rss_), pss(pss_), privateClean(privateClean_), privateDirty(privateDirty_)
+    {
+    }
+}
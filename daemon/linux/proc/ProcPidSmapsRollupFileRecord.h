@@ -0,0 +1,58 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#ifndef INCLUDE_LINUX_PROC_PROCPIDSMAPSROLLUPFILERECORD_H
+#define INCLUDE_LINUX_PROC_PROCPIDSMAPSROLLUPFILERECORD_H
+
+#include <string_view>
+
+namespace lnx {
+    /**
+     * The parsed contents of /proc/[pid]/smaps_rollup as per `man proc.5`; only the fields needed for the PSS and USS
+     * of the process are kept, and all sizes are in bytes.
+     *
+     * Reading the file walks every mapping of the process, so it is much more expensive than reading statm.
+     */
+    class ProcPidSmapsRollupFileRecord {
+    public:
+        /**
+         * Parse the contents of smaps_rollup file, modifying the fields in 'result' if successful.
+         *
+         * @param result The object to store the extracted fields in
+         * @param contents The text contents of the smaps_rollup file
+         * @return True if the contents were successfully parsed, false otherwise
+         */
+        static bool parseSmapsRollupFile(ProcPidSmapsRollupFileRecord & result, std::string_view contents);
+
+        /**
+         * Create an empty record with all fields zero
+         */
+        ProcPidSmapsRollupFileRecord() = default;
+
+        /**
+         * Construct a record populated with the specified values
+         */
+        ProcPidSmapsRollupFileRecord(unsigned long long rss,
+                                     unsigned long long pss,
+                                     unsigned long long privateClean,
+                                     unsigned long long privateDirty);
+
+        unsigned long long getRss() const { return rss; }
+
+        unsigned long long getPss() const { return pss; }
+
+        unsigned long long getPrivateClean() const { return privateClean; }
+
+        unsigned long long getPrivateDirty() const { return privateDirty; }
+
+        /** @return The unique set size; the memory that is private to the process */
+        unsigned long long getUss() const { return privateClean + privateDirty; }
+
+    private:
+        unsigned long long rss {0};
+        unsigned long long pss {0};
+        unsigned long long privateClean {0};
+        unsigned long long privateDirty {0};
+    };
+}
+
+#endif /* INCLUDE_LINUX_PROC_PROCPIDSMAPSROLLUPFILERECORD_H */
@@ -1,93 +1,84 @@
-/* Copyright (C) 2017-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2017-2022 by Arm Limited. All rights reserved. */
 
 #include "linux/proc/ProcPidStatFileRecord.h"
 
-#include <cstdio>
-#include <cstring>
+#include "linux/proc/ProcFieldParser.h"
 
-namespace lnx {
-    namespace {
-        const char PROC_STAT_SCANF_FORMAT_BEFORE_COMM[] = "%d (";
-        const char PROC_STAT_SCANF_FORMAT_AFTER_COMM[] =
-            ") %c %d %d %d %d %d %u %lu %lu %lu %lu %lu %lu %ld %ld %ld %ld %ld %ld %llu %lu %ld %lu %lu %lu %lu %lu "
-            "%lu %lu "
-            "%lu %lu %lu %lu %lu %lu %d %d %u %u %llu %lu %ld";
-        constexpr const int PROC_STAT_SCANF_BEFORE_COMM_FIELD_COUNT = 1;
-        constexpr const int PROC_STAT_SCANF_AFTER_COMM_FIELD_COUNT = 42;
-    }
+#include <string_view>
 
+namespace lnx {
     bool ProcPidStatFileRecord::parseStatFile(ProcPidStatFileRecord & result, const char * stat_contents)
     {
         if (stat_contents == nullptr) {
             return false;
         }
 
-        // separate out comm, which is surrounded by parenthesis. dont us sscanf
-        const char * const comm_start = std::strchr(stat_contents, '(');
-        const char * const comm_end = std::strrchr(stat_contents, ')');
+        // separate out comm, which is surrounded by parenthesis but may itself contain spaces or parenthesis
+        const std::string_view contents {stat_contents};
+        const auto comm_start = contents.find('(');
+        const auto comm_end = contents.rfind(')');
 
-        if ((comm_start == nullptr) || (comm_end == nullptr)) {
+        if ((comm_start == std::string_view::npos) || (comm_end == std::string_view::npos) || (comm_end < comm_start)) {
             return false;
         }
 
         // parse the items before comm (just pid)
-        const int nscanned_before_comm = sscanf(stat_contents, PROC_STAT_SCANF_FORMAT_BEFORE_COMM, &result.pid);
-        if (nscanned_before_comm != PROC_STAT_SCANF_BEFORE_COMM_FIELD_COUNT) {
+        ProcFieldParser before_comm {contents.substr(0, comm_start)};
+        if (!before_comm.next(result.pid)) {
             return false;
         }
 
         // parse the items after comm
-        const int nscanned_after_comm = sscanf(comm_end,
-                                               PROC_STAT_SCANF_FORMAT_AFTER_COMM,
-                                               &result.state,
-                                               &result.ppid,
-                                               &result.pgid,
-                                               &result.session,
-                                               &result.tty_nr,
-                                               &result.tpgid,
-                                               &result.flags,
-                                               &result.minflt,
-                                               &result.cminflt,
-                                               &result.majflt,
-                                               &result.cmajflt,
-                                               &result.utime,
-                                               &result.stime,
-                                               &result.cutime,
-                                               &result.cstime,
-                                               &result.priority,
-                                               &result.nice,
-                                               &result.num_threads,
-                                               &result.itrealvalue,
-                                               &result.starttime,
-                                               &result.vsize,
-                                               &result.rss,
-                                               &result.rsslim,
-                                               &result.startcode,
-                                               &result.endcode,
-                                               &result.startstack,
-                                               &result.kstkesp,
-                                               &result.kstkeip,
-                                               &result.signal,
-                                               &result.blocked,
-                                               &result.sigignore,
-                                               &result.sigcatch,
-                                               &result.wchan,
-                                               &result.nswap,
-                                               &result.cnswap,
-                                               &result.exit_signal,
-                                               &result.processor,
-                                               &result.rt_priority,
-                                               &result.policy,
-                                               &result.delayacct_blkio_ticks,
-                                               &result.guest_time,
-                                               &result.cguest_time);
+        ProcFieldParser after_comm {contents.substr(comm_end + 1)};
+        const bool parsed_after_comm = after_comm.nextAll(result.state,
+                                                          result.ppid,
+                                                          result.pgid,
+                                                          result.session,
+                                                          result.tty_nr,
+                                                          result.tpgid,
+                                                          result.flags,
+                                                          result.minflt,
+                                                          result.cminflt,
+                                                          result.majflt,
+                                                          result.cmajflt,
+                                                          result.utime,
+                                                          result.stime,
+                                                          result.cutime,
+                                                          result.cstime,
+                                                          result.priority,
+                                                          result.nice,
+                                                          result.num_threads,
+                                                          result.itrealvalue,
+                                                          result.starttime,
+                                                          result.vsize,
+                                                          result.rss,
+                                                          result.rsslim,
+                                                          result.startcode,
+                                                          result.endcode,
+                                                          result.startstack,
+                                                          result.kstkesp,
+                                                          result.kstkeip,
+                                                          result.signal,
+                                                          result.blocked,
+                                                          result.sigignore,
+                                                          result.sigcatch,
+                                                          result.wchan,
+                                                          result.nswap,
+                                                          result.cnswap,
+                                                          result.exit_signal,
+                                                          result.processor,
+                                                          result.rt_priority,
+                                                          result.policy,
+                                                          result.delayacct_blkio_ticks,
+                                                          result.guest_time,
+                                                          result.cguest_time);
 
-        if (nscanned_after_comm != PROC_STAT_SCANF_AFTER_COMM_FIELD_COUNT) {
+        if (!parsed_after_comm) {
             return false;
         }
 
-        // copy comm value
-        result.comm.assign(comm_start + 1, comm_end);
+        // copy comm value; comm is at most 16 characters so this does not allocate
+        result.comm.assign(contents.substr(comm_start + 1, comm_end - comm_start - 1));
 
         return true;
     }
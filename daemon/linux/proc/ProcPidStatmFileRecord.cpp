@@ -1,33 +1,24 @@
-/* Copyright (C) 2017-2020 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2017-2022 by Arm Limited. All rights reserved. */
 
 #include "linux/proc/ProcPidStatmFileRecord.h"
 
-#include <cstdio>
-#include <cstring>
+#include "linux/proc/ProcFieldParser.h"
 
 namespace lnx {
-    namespace {
-        const char PROC_STAT_SCANF_FORMAT[] = "%lu %lu %lu %lu %lu %lu %lu";
-        constexpr const int PROC_STAT_SCANF_FIELD_COUNT = 7;
-    }
-
     bool ProcPidStatmFileRecord::parseStatmFile(ProcPidStatmFileRecord & result, const char * statm_contents)
     {
         if (statm_contents == nullptr) {
             return false;
         }
 
-        const int nscanned = sscanf(statm_contents,
-                                    PROC_STAT_SCANF_FORMAT,
-                                    &result.size,
-                                    &result.resident,
-                                    &result.shared,
-                                    &result.text,
-                                    &result.lib,
-                                    &result.data,
-                                    &result.dt);
-
-        return (nscanned == PROC_STAT_SCANF_FIELD_COUNT);
+        ProcFieldParser parser {statm_contents};
+        return parser.nextAll(result.size,
+                              result.resident,
+                              result.shared,
+                              result.text,
+                              result.lib,
+                              result.data,
+                              result.dt);
     }
 
     ProcPidStatmFileRecord::ProcPidStatmFileRecord() : size(0), resident(0), shared(0), text(0), lib(0), data(0), dt(0)
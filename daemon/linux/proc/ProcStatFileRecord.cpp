@@ -1,4 +1,4 @@
-/* Copyright (C) 2017-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2017-2022 by Arm Limited. All rights reserved. */
 
 #include "linux/proc/ProcStatFileRecord.h"
 
@@ -226,8 +226,19 @@ namespace lnx {
         }
     }
 
-    ProcStatFileRecord::ProcStatFileRecord(const char * stat_contents) : ProcStatFileRecord()
+    void ProcStatFileRecord::parseStatFile(ProcStatFileRecord & result, const char * stat_contents)
     {
+        result.cpus.clear();
+        result.page.reset();
+        result.swap.reset();
+        result.intr.reset();
+        result.soft_irq.reset();
+        result.ctxt.reset();
+        result.btime.reset();
+        result.processes.reset();
+        result.procs_running.reset();
+        result.procs_blocked.reset();
+
         if (stat_contents != nullptr) {
             unsigned current_offset = 0;
             while (stat_contents[current_offset] != '\0') {
@@ -245,7 +256,7 @@ namespace lnx {
                         // btime
                         case 'b': {
                             if (matchToken(stat_contents, current_offset + 1, next_break, "time", true)) {
-                                current_offset = parseUnsignedLong(btime, stat_contents, next_break + 1);
+                                current_offset = parseUnsignedLong(result.btime, stat_contents, next_break + 1);
                             }
                             else {
                                 current_offset = skipLine(stat_contents, next_break);
@@ -255,10 +266,11 @@ namespace lnx {
                         // cpu, ctxt
                         case 'c': {
                             if (matchToken(stat_contents, current_offset + 1, next_break, "pu", false)) {
-                                current_offset = parseCpuTime(cpus, stat_contents, current_offset + 3, next_break + 1);
+                                current_offset =
+                                    parseCpuTime(result.cpus, stat_contents, current_offset + 3, next_break + 1);
                             }
                             else if (matchToken(stat_contents, current_offset + 1, next_break, "txt", true)) {
-                                current_offset = parseUnsignedLong(ctxt, stat_contents, next_break + 1);
+                                current_offset = parseUnsignedLong(result.ctxt, stat_contents, next_break + 1);
                             }
                             else {
                                 current_offset = skipLine(stat_contents, next_break);
@@ -268,7 +280,7 @@ namespace lnx {
                         // intr
                         case 'i': {
                             if (matchToken(stat_contents, current_offset + 1, next_break, "ntr", true)) {
-                                current_offset = parseUnsignedLong(intr, stat_contents, next_break + 1);
+                                current_offset = parseUnsignedLong(result.intr, stat_contents, next_break + 1);
                             }
                             else {
                                 current_offset = skipLine(stat_contents, next_break);
@@ -278,16 +290,16 @@ namespace lnx {
                         // page, processes, procs_running, procs_blocked
                         case 'p': {
                             if (matchToken(stat_contents, current_offset + 1, next_break, "age", false)) {
-                                current_offset = parsePagingCounts(page, stat_contents, next_break + 1);
+                                current_offset = parsePagingCounts(result.page, stat_contents, next_break + 1);
                             }
                             else if (matchToken(stat_contents, current_offset + 1, next_break, "rocesses", true)) {
-                                current_offset = parseUnsignedLong(processes, stat_contents, next_break + 1);
+                                current_offset = parseUnsignedLong(result.processes, stat_contents, next_break + 1);
                             }
                             else if (matchToken(stat_contents, current_offset + 1, next_break, "rocs_running", true)) {
-                                current_offset = parseUnsignedLong(procs_running, stat_contents, next_break + 1);
+                                current_offset = parseUnsignedLong(result.procs_running, stat_contents, next_break + 1);
                             }
                             else if (matchToken(stat_contents, current_offset + 1, next_break, "rocs_blocked", true)) {
-                                current_offset = parseUnsignedLong(procs_blocked, stat_contents, next_break + 1);
+                                current_offset = parseUnsignedLong(result.procs_blocked, stat_contents, next_break + 1);
                             }
                             else {
                                 current_offset = skipLine(stat_contents, next_break);
@@ -297,10 +309,10 @@ namespace lnx {
                         // soft_irq, swap
                         case 's': {
                             if (matchToken(stat_contents, current_offset + 1, next_break, "wap", false)) {
-                                current_offset = parsePagingCounts(swap, stat_contents, next_break + 1);
+                                current_offset = parsePagingCounts(result.swap, stat_contents, next_break + 1);
                             }
                             else if (matchToken(stat_contents, current_offset + 1, next_break, "oftirq", true)) {
-                                current_offset = parseUnsignedLong(soft_irq, stat_contents, next_break + 1);
+                                current_offset = parseUnsignedLong(result.soft_irq, stat_contents, next_break + 1);
                             }
                             else {
                                 current_offset = skipLine(stat_contents, next_break);
@@ -318,6 +330,11 @@ namespace lnx {
         }
     }
 
+    ProcStatFileRecord::ProcStatFileRecord(const char * stat_contents) : ProcStatFileRecord()
+    {
+        parseStatFile(*this, stat_contents);
+    }
+
     ProcStatFileRecord::ProcStatFileRecord(std::vector<CpuTime> && cpus_,
                                            std::optional<PagingCounts> && page_,
                                            std::optional<PagingCounts> && swap_,
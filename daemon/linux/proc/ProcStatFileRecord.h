@@ -1,4 +1,4 @@
-/* Copyright (C) 2017-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2017-2022 by Arm Limited. All rights reserved. */
 
 #ifndef INCLUDE_LINUX_PROC_PROCSTATFILERECORD_H
 #define INCLUDE_LINUX_PROC_PROCSTATFILERECORD_H
@@ -85,6 +85,16 @@ namespace lnx {
             PagingCounts(unsigned long in_, unsigned long out_) : in(in_), out(out_) {}
         };
 
+        /**
+         * Parse the contents of /proc/stat into an existing record, replacing all of its fields. The storage for the cpu
+         * records is reused, so repeatedly parsing into the same record does not allocate once it has grown to the
+         * number of cpus.
+         *
+         * @param result The object to store the extracted fields in
+         * @param stat_contents The text contents of the stat file
+         */
+        static void parseStatFile(ProcStatFileRecord & result, const char * stat_contents);
+
         /**
          * Create an empty record with all fields null/zero/empty
          */
@@ -4,35 +4,34 @@
 
 #include "lib/Format.h"
 
-#include <cctype>
 #include <cstdlib>
 #include <string>
 
+#include <dirent.h>
+
 namespace lnx {
     namespace {
         /**
-         * Checks the name of the FsEntry to see if it is a number, and checks the type
-         * to see if it is a directory.
+         * Checks the name of the entry to see if it is a number, and checks the type to see if it is a directory
+         * (or unknown, in which case opening it as a directory will fail if it is not).
          *
-         * @return True if criteria are met, false otherwise
+         * @return The pid/tid value if criteria are met, otherwise 0
          */
-        bool isPidDirectory(const lib::FsEntry & entry)
+        int getPidFromEntry(const lib::DirectoryFd::Entry & entry)
         {
             // type must be directory
-            const lib::FsEntry::Stats stats = entry.read_stats();
-            if (stats.type() != lib::FsEntry::Type::DIR) {
-                return false;
+            if ((entry.type != DT_DIR) && (entry.type != DT_UNKNOWN)) {
+                return 0;
             }
 
             // name must be only digits
-            const std::string name = entry.name();
-            for (char chr : name) {
-                if (std::isdigit(chr) == 0) {
-                    return false;
-                }
+            char * end = nullptr;
+            const long pid = std::strtol(entry.name, &end, 10);
+            if ((end == entry.name) || (*end != '\0')) {
+                return 0;
             }
 
-            return true;
+            return static_cast<int>(pid);
         }
 
         /**
@@ -139,67 +138,80 @@ namespace lnx {
     {
     }
 
-    ProcessPollerBase::ProcessPollerBase() : procDir(lib::FsEntry::create("/proc")) {}
+    ProcessPollerBase::ProcessPollerBase()
+        : procDir(lib::FsEntry::create("/proc")), procDirFd(lib::DirectoryFd::open("/proc"))
+    {
+    }
 
     void ProcessPollerBase::poll(bool wantThreads, bool wantStats, IProcessPollerReceiver & receiver)
     {
         // scan directory /proc for all pid files
-        lib::FsEntryDirectoryIterator iterator = procDir.children();
-
-        while (std::optional<lib::FsEntry> entry = iterator.next()) {
-            if (isPidDirectory(*entry)) {
-                processPidDirectory(wantThreads, wantStats, receiver, *entry);
+        procDirFd.forEachChild([&](const lib::DirectoryFd::Entry & entry) {
+            const int pid = getPidFromEntry(entry);
+            if (pid > 0) {
+                processPidDirectory(wantThreads, wantStats, receiver, pid, entry.name);
             }
-        }
+        });
     }
 
     void ProcessPollerBase::processPidDirectory(bool wantThreads,
                                                 bool wantStats,
                                                 IProcessPollerReceiver & receiver,
-                                                const lib::FsEntry & entry)
+                                                const int pid,
+                                                const char * name)
     {
-        const std::string name = entry.name();
-        std::optional<lib::FsEntry> exe_path = getProcessExePath(entry);
-
-        // read the pid
-        const long pid = std::strtol(name.c_str(), nullptr, 0);
+        const lib::FsEntry entry = lib::FsEntry::create(procDir, name);
 
         // call the receiver object
         receiver.onProcessDirectory(pid, entry);
 
         // process threads?
         if (wantThreads || wantStats) {
-            // the /proc/[PID]/task directory
-            const lib::FsEntry task_directory = lib::FsEntry::create(entry, "task");
-
-            // the /proc/[PID]/task/[PID]/ directory
-            const lib::FsEntry task_pid_directory = lib::FsEntry::create(task_directory, name);
-            const lib::FsEntry::Stats task_pid_directory_stats = task_pid_directory.read_stats();
-
-            // if for some reason taskPidDirectory does not exist, then use stat and statm in the procPid directory instead
-            if ((!task_pid_directory_stats.exists()) || (task_pid_directory_stats.type() != lib::FsEntry::Type::DIR)) {
-                processTidDirectory(wantStats, receiver, pid, entry, exe_path);
+            // the exe is only reported with the stats
+            const std::optional<lib::FsEntry> exe_path = (wantStats ? getProcessExePath(entry) //
+                                                                    : std::optional<lib::FsEntry> {});
+
+            // the /proc/[PID] and /proc/[PID]/task directories
+            const lib::DirectoryFd pid_directory = procDirFd.openDirectory(name);
+            const lib::DirectoryFd task_directory = pid_directory.openDirectory("task");
+
+            // if for some reason the /proc/[PID]/task/[PID]/ directory does not exist, then use stat and statm in the
+            // procPid directory instead
+            if (!task_directory.openDirectory(name)) {
+                processTidDirectory(wantStats, receiver, pid, pid, entry, pid_directory, exe_path);
             }
 
             // scan all the TIDs in the task directory
-            lib::FsEntryDirectoryIterator task_iterator = task_directory.children();
+            const lib::FsEntry task_entry = lib::FsEntry::create(entry, "task");
 
-            while (std::optional<lib::FsEntry> task_entry = task_iterator.next()) {
-                if (isPidDirectory(*task_entry)) {
-                    processTidDirectory(wantStats, receiver, pid, *task_entry, exe_path);
+            task_directory.forEachChild([&](const lib::DirectoryFd::Entry & child) {
+                const int tid = getPidFromEntry(child);
+                if (tid <= 0) {
+                    return;
                 }
-            }
+
+                const lib::DirectoryFd tid_directory = task_directory.openDirectory(child.name);
+                if (tid_directory) {
+                    processTidDirectory(wantStats,
+                                        receiver,
+                                        pid,
+                                        tid,
+                                        lib::FsEntry::create(task_entry, child.name),
+                                        tid_directory,
+                                        exe_path);
+                }
+            });
         }
     }
 
     void ProcessPollerBase::processTidDirectory(bool wantStats,
                                                 IProcessPollerReceiver & receiver,
                                                 const int pid,
+                                                const int tid,
                                                 const lib::FsEntry & entry,
+                                                const lib::DirectoryFd & directory,
                                                 const std::optional<lib::FsEntry> & exe)
     {
-        const long tid = std::strtol(entry.name().c_str(), nullptr, 0);
-
         // call the receiver object
         receiver.onThreadDirectory(pid, tid, entry);
 
@@ -207,29 +219,23 @@ namespace lnx {
         if (wantStats) {
             std::optional<ProcPidStatmFileRecord> statm_file_record {ProcPidStatmFileRecord()};
 
-            // open /proc/[PID]/statm
+            // read /proc/[PID]/statm
             {
-                const lib::FsEntry statm_file = lib::FsEntry::create(entry, "statm");
-                const lib::FsEntry::Stats statm_file_stats = statm_file.read_stats();
+                const auto statm_file_contents = directory.readFile("statm", readBuffer);
 
-                if (statm_file_stats.exists() && statm_file_stats.type() == lib::FsEntry::Type::FILE) {
-                    const std::string statm_file_contents = lib::readFileContents(statm_file);
-
-                    if (!ProcPidStatmFileRecord::parseStatmFile(*statm_file_record, statm_file_contents.c_str())) {
-                        statm_file_record.reset();
-                    }
+                if (statm_file_contents
+                    && !ProcPidStatmFileRecord::parseStatmFile(*statm_file_record, statm_file_contents->data())) {
+                    statm_file_record.reset();
                 }
             }
 
-            // open /proc/[PID]/stat
+            // read /proc/[PID]/stat
             {
-                const lib::FsEntry stat_file = lib::FsEntry::create(entry, "stat");
-                const lib::FsEntry::Stats stat_file_stats = stat_file.read_stats();
+                const auto stat_file_contents = directory.readFile("stat", readBuffer);
 
-                if (stat_file_stats.exists() && stat_file_stats.type() == lib::FsEntry::Type::FILE) {
-                    const std::string stat_file_contents = lib::readFileContents(stat_file);
+                if (stat_file_contents) {
                     ProcPidStatFileRecord stat_file_record;
-                    if (ProcPidStatFileRecord::parseStatFile(stat_file_record, stat_file_contents.c_str())) {
+                    if (ProcPidStatFileRecord::parseStatFile(stat_file_record, stat_file_contents->data())) {
                         receiver.onThreadDetails(pid, tid, stat_file_record, statm_file_record, exe);
                     }
                 }
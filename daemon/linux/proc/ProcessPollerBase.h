@@ -3,12 +3,14 @@
 #ifndef INCLUDE_LINUX_PROC_PROCESSPOLLERBASE_H
 #define INCLUDE_LINUX_PROC_PROCESSPOLLERBASE_H
 
+#include "lib/DirectoryFd.h"
 #include "lib/FsEntry.h"
 #include "lib/TimestampSource.h"
 #include "linux/proc/ProcPidStatFileRecord.h"
 #include "linux/proc/ProcPidStatmFileRecord.h"
 
 #include <optional>
+#include <vector>
 
 namespace lnx {
     /**
@@ -48,16 +50,23 @@ namespace lnx {
 
     private:
         lib::FsEntry procDir;
+        /** /proc, which the pid directories (and their files) are opened relative to */
+        lib::DirectoryFd procDirFd;
+        /** Reused for each stat and statm file to avoid allocating */
+        std::vector<char> readBuffer {};
 
-        static void processPidDirectory(bool wantThreads,
-                                        bool wantStats,
-                                        IProcessPollerReceiver & receiver,
-                                        const lib::FsEntry & entry);
-        static void processTidDirectory(bool wantStats,
-                                        IProcessPollerReceiver & receiver,
-                                        int pid,
-                                        const lib::FsEntry & entry,
-                                        const std::optional<lib::FsEntry> & exe);
+        void processPidDirectory(bool wantThreads,
+                                 bool wantStats,
+                                 IProcessPollerReceiver & receiver,
+                                 int pid,
+                                 const char * name);
+        void processTidDirectory(bool wantStats,
+                                 IProcessPollerReceiver & receiver,
+                                 int pid,
+                                 int tid,
+                                 const lib::FsEntry & entry,
+                                 const lib::DirectoryFd & directory,
+                                 const std::optional<lib::FsEntry> & exe);
     };
 
     /** @return The process exe path (or some estimation of it). Empty if the thread is a kernel thread, otherwise contains 'something' */
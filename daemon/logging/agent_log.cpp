@@ -10,10 +10,14 @@
 #include "lib/String.h"
 #include "lib/Time.h"
 
+#include <algorithm>
+#include <array>
 #include <cinttypes>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <optional>
+#include <string>
 #include <string_view>
 
 #include <boost/asio/buffer.hpp>
@@ -25,8 +29,17 @@
 namespace logging {
     namespace {
         constexpr std::string_view message_start_marker {"\x01"};
+        constexpr std::string_view binary_start_marker {"\x02"};
         constexpr std::string_view message_end_marker {"\x04"};
         constexpr std::string_view separator {"\x09"};
+        constexpr std::string_view binary_end_marker {"\x04\n"};
+
+        /** The binary log item header: seconds, nanos, level, tid, line, file name size and message size */
+        constexpr std::size_t binary_header_size = (2 * sizeof(std::int64_t)) + (5 * sizeof(std::uint32_t));
+        /** Larger items are sent as text, which also bounds how much of a split binary item is kept */
+        constexpr std::size_t max_binary_payload_size = 64 * 1024;
+        constexpr std::size_t binary_overhead_size =
+            binary_start_marker.size() + binary_header_size + binary_end_marker.size();
 
         void write_bytes(int file_descriptor, std::string_view str)
         {
@@ -39,11 +52,22 @@ namespace logging {
             }
         }
 
-        void write(int file_descriptor, std::uint32_t n) { dprintf(file_descriptor, "%" PRIu32, n); }
-        void write(int file_descriptor, std::int64_t n) { dprintf(file_descriptor, "%" PRId64, n); }
-        void write(int file_descriptor, thread_id_t t) { dprintf(file_descriptor, "%" PRIi32, pid_t(t)); }
-        void write(int file_descriptor, log_level_t l) { write(file_descriptor, std::uint32_t(l)); }
-        void write(int file_descriptor, std::string_view str)
+        template<typename... Args>
+        void append_printf(std::string & buffer, char const * format, Args... args)
+        {
+            constexpr std::size_t max_number_size = 24;
+            std::array<char, max_number_size> chars {};
+            auto const n = snprintf(chars.data(), chars.size(), format, args...);
+            if (n > 0) {
+                buffer.append(chars.data(), std::min<std::size_t>(n, chars.size() - 1));
+            }
+        }
+
+        void append(std::string & buffer, std::uint32_t n) { append_printf(buffer, "%" PRIu32, n); }
+        void append(std::string & buffer, std::int64_t n) { append_printf(buffer, "%" PRId64, n); }
+        void append(std::string & buffer, thread_id_t t) { append_printf(buffer, "%" PRIi32, pid_t(t)); }
+        void append(std::string & buffer, log_level_t l) { append(buffer, std::uint32_t(l)); }
+        void append_escaped(std::string & buffer, std::string_view str)
         {
             std::size_t from = 0;
 
@@ -52,27 +76,154 @@ namespace logging {
                 // escape control characters
                 if ((chr < ' ') || (chr == '\\')) {
                     // output the preceeding chars in the message since the last escape/start
-                    if (from < pos) {
-                        write_bytes(file_descriptor, str.substr(from, pos - from));
-                    }
+                    buffer.append(str.substr(from, pos - from));
                     // encode the char
                     if (chr == '\\') {
-                        dprintf(file_descriptor, "\\\\");
+                        buffer.append("\\\\");
                     }
                     else if (chr == '\n') {
-                        dprintf(file_descriptor, "\\n");
+                        buffer.append("\\n");
                     }
                     else {
-                        dprintf(file_descriptor, "\\%03" PRIo32, std::uint32_t(std::uint8_t(chr)));
+                        append_printf(buffer, "\\%03" PRIo32, std::uint32_t(std::uint8_t(chr)));
                     }
                     from = pos + 1;
                 }
             }
 
             // output the remaining chars in the message since the last escape/start
-            if (from < str.size()) {
-                write_bytes(file_descriptor, str.substr(from));
+            buffer.append(str.substr(from));
+        }
+
+        /** Encode the fields of one log item, separated by `field_separator` */
+        void append_fields(std::string & buffer,
+                           std::string_view field_separator,
+                           thread_id_t tid,
+                           log_level_t level,
+                           log_timestamp_t const & timestamp,
+                           source_loc_t const & location,
+                           std::string_view message)
+        {
+            append(buffer, level);
+            buffer.append(field_separator);
+            append(buffer, tid);
+            buffer.append(field_separator);
+            append_escaped(buffer, location.file_name());
+            buffer.append(field_separator);
+            append(buffer, location.line_no());
+            buffer.append(field_separator);
+            append(buffer, timestamp.seconds);
+            buffer.append(field_separator);
+            append(buffer, timestamp.nanos);
+            buffer.append(field_separator);
+            append_escaped(buffer, message);
+        }
+
+        template<typename T>
+        void append_raw(std::string & buffer, T value)
+        {
+            std::array<char, sizeof(T)> bytes {};
+            std::memcpy(bytes.data(), &value, sizeof(T));
+            buffer.append(bytes.data(), bytes.size());
+        }
+
+        template<typename T>
+        T read_raw(char const * data)
+        {
+            T value {};
+            std::memcpy(&value, data, sizeof(T));
+            return value;
+        }
+
+        /**
+         * Encode the fields of one log item as a binary record, which the reader can decode without any parsing.
+         * The file name and message are copied unchanged, so the record may contain '\n', but always ends with one.
+         */
+        void append_binary(std::string & buffer,
+                           thread_id_t tid,
+                           log_level_t level,
+                           log_timestamp_t const & timestamp,
+                           source_loc_t const & location,
+                           std::string_view message)
+        {
+            auto const file = location.file_name();
+
+            buffer.append(binary_start_marker);
+            append_raw<std::int64_t>(buffer, timestamp.seconds);
+            append_raw<std::int64_t>(buffer, timestamp.nanos);
+            append_raw<std::uint32_t>(buffer, std::uint32_t(level));
+            append_raw<std::int32_t>(buffer, pid_t(tid));
+            append_raw<std::uint32_t>(buffer, location.line_no());
+            append_raw<std::uint32_t>(buffer, file.size());
+            append_raw<std::uint32_t>(buffer, message.size());
+            buffer.append(file);
+            buffer.append(message);
+            buffer.append(binary_end_marker);
+        }
+
+        /** The decoded fields of a binary record */
+        struct binary_item_t {
+            thread_id_t tid;
+            log_level_t level;
+            log_timestamp_t timestamp;
+            source_loc_t location;
+            std::string_view message;
+        };
+
+        /** The result of decoding a binary record */
+        enum class binary_decode_t {
+            /** The record was decoded */
+            complete,
+            /** More bytes are needed to decode the record */
+            incomplete,
+            /** The bytes are not a binary record */
+            invalid,
+        };
+
+        /**
+         * Decode the binary record at the start of some bytes
+         *
+         * @param chars The bytes, which must start with binary_start_marker
+         * @param item Receives the decoded fields, which refer to the bytes
+         * @param size Receives the size of the record
+         */
+        binary_decode_t decode_binary(std::string_view chars, binary_item_t & item, std::size_t & size)
+        {
+            if (chars.size() < (binary_start_marker.size() + binary_header_size)) {
+                return binary_decode_t::incomplete;
+            }
+
+            auto const * header = chars.data() + binary_start_marker.size();
+            auto const seconds = read_raw<std::int64_t>(header);
+            auto const nanos = read_raw<std::int64_t>(header + sizeof(std::int64_t));
+            auto const * header_words = header + (2 * sizeof(std::int64_t));
+            auto const level = read_raw<std::uint32_t>(header_words);
+            auto const tid = read_raw<std::int32_t>(header_words + sizeof(std::uint32_t));
+            auto const line = read_raw<std::uint32_t>(header_words + (2 * sizeof(std::uint32_t)));
+            auto const file_size = read_raw<std::uint32_t>(header_words + (3 * sizeof(std::uint32_t)));
+            auto const message_size = read_raw<std::uint32_t>(header_words + (4 * sizeof(std::uint32_t)));
+
+            if ((std::size_t(file_size) + message_size) > max_binary_payload_size) {
+                return binary_decode_t::invalid;
             }
+
+            size = binary_overhead_size + file_size + message_size;
+            if (chars.size() < size) {
+                return binary_decode_t::incomplete;
+            }
+
+            if (chars.substr(size - binary_end_marker.size(), binary_end_marker.size()) != binary_end_marker) {
+                return binary_decode_t::invalid;
+            }
+
+            auto const payload = chars.substr(binary_start_marker.size() + binary_header_size);
+
+            item = binary_item_t {thread_id_t(tid),
+                                  log_level_t(level),
+                                  log_timestamp_t {seconds, nanos},
+                                  source_loc_t {payload.substr(0, file_size), line},
+                                  payload.substr(file_size, message_size)};
+            return binary_decode_t::complete;
         }
 
         constexpr bool is_octal(char c) { return (c >= '0') && (c < '8'); }
@@ -235,46 +386,42 @@ namespace logging {
                                     source_loc_t const & location,
                                     std::string_view message)
     {
-        // writing to the log must be serialized in a multithreaded environment
-        std::lock_guard lock {mutex};
-
-        // encode the message as a specially escaped and delimited line of text.
-        // The encoding leaves the message largely human readable, whilst ensuring it fits on a single line and is recognizable
+        // encode the message as a delimited binary record, so that the receiver does not need to parse it.
+        // Any larger message is encoded as a specially escaped and delimited line of text instead.
+        // The text encoding leaves the message largely human readable, whilst ensuring it fits on a single line and is recognizable
         // If any other (e.g. library, stl) code happens to printf to stderr, then it will not corrupt the output
         // and the receiver should be able to pick up the log entries + any random output (which will be considered error logging)
-        write_bytes(pipe_fd, message_start_marker);
-        write(pipe_fd, level);
-        write_bytes(pipe_fd, separator);
-        write(pipe_fd, tid);
-        write_bytes(pipe_fd, separator);
-        write(pipe_fd, location.file_name());
-        write_bytes(pipe_fd, separator);
-        write(pipe_fd, location.line_no());
-        write_bytes(pipe_fd, separator);
-        write(pipe_fd, timestamp.seconds);
-        write_bytes(pipe_fd, separator);
-        write(pipe_fd, timestamp.nanos);
-        write_bytes(pipe_fd, separator);
-        write(pipe_fd, message);
-        write_bytes(pipe_fd, message_end_marker);
-        write_bytes(pipe_fd, "\n");
+        // The item is encoded into a per-thread buffer outside of the lock, so that it can be written with one call
+        thread_local std::string buffer {};
+
+        buffer.clear();
+        if ((location.file_name().size() + message.size()) <= max_binary_payload_size) {
+            append_binary(buffer, tid, level, timestamp, location, message);
+        }
+        else {
+            buffer.append(message_start_marker);
+            append_fields(buffer, separator, tid, level, timestamp, location, message);
+            buffer.append(message_end_marker);
+            buffer.append("\n");
+        }
+
+        auto const pipe_line_size = buffer.size();
 
         // optional human readable TSV formatted log file
         if (log_file_descriptor) {
-            write(*log_file_descriptor, level);
-            write_bytes(*log_file_descriptor, "\t");
-            write(*log_file_descriptor, tid);
-            write_bytes(*log_file_descriptor, "\t");
-            write(*log_file_descriptor, location.file_name());
-            write_bytes(*log_file_descriptor, "\t");
-            write(*log_file_descriptor, location.line_no());
-            write_bytes(*log_file_descriptor, "\t");
-            write(*log_file_descriptor, timestamp.seconds);
-            write_bytes(*log_file_descriptor, "\t");
-            write(*log_file_descriptor, timestamp.nanos);
-            write_bytes(*log_file_descriptor, "\t");
-            write(*log_file_descriptor, message);
-            write_bytes(*log_file_descriptor, "\n");
+            append_fields(buffer, "\t", tid, level, timestamp, location, message);
+            buffer.append("\n");
+        }
+
+        std::string_view const encoded {buffer};
+
+        // writing to the log must be serialized in a multithreaded environment
+        std::lock_guard lock {mutex};
+
+        write_bytes(pipe_fd, encoded.substr(0, pipe_line_size));
+
+        if (log_file_descriptor) {
+            write_bytes(*log_file_descriptor, encoded.substr(pipe_line_size));
         }
     }
 
@@ -283,15 +430,62 @@ namespace logging {
         using namespace async::continuations;
 
         spawn("agent-log-reader",
-              async::async_consume_all_lines(
+              async::async_consume_all_line_batches(
                   line_reader,
-                  [st = shared_from_this()](std::string_view line) {
-                      // process line of text
-                      st->do_process_next_line(line);
+                  [st = shared_from_this()](std::string_view lines) {
+                      // process all the lines received so far
+                      st->do_process_lines(lines);
                   },
                   use_continuation));
     }
 
+    void agent_log_reader_t::do_process_lines(std::string_view lines)
+    {
+        if (pending.empty()) {
+            pending.assign(do_process_items(lines));
+            return;
+        }
+
+        // complete the split item
+        auto buffer = std::exchange(pending, {});
+        buffer.append(lines);
+        pending.assign(do_process_items(buffer));
+    }
+
+    std::string_view agent_log_reader_t::do_process_items(std::string_view lines)
+    {
+        while (!lines.empty()) {
+            if (lines.substr(0, binary_start_marker.size()) == binary_start_marker) {
+                binary_item_t item {};
+                std::size_t size = 0;
+
+                switch (decode_binary(lines, item, size)) {
+                    case binary_decode_t::complete: {
+                        do_expected_message(item.tid, item.level, item.timestamp, item.location, item.message);
+                        lines.remove_prefix(size);
+                        continue;
+                    }
+                    case binary_decode_t::incomplete: {
+                        // the record contains a '\n', so the rest of it is yet to be received
+                        return lines;
+                    }
+                    case binary_decode_t::invalid:
+                    default: {
+                        // just a normal line of text
+                        break;
+                    }
+                }
+            }
+
+            auto const * eol = static_cast<char const *>(std::memchr(lines.data(), '\n', lines.size()));
+            auto const n = (eol != nullptr ? std::size_t(eol - lines.data()) + 1 : lines.size());
+            do_process_next_line(lines.substr(0, n));
+            lines.remove_prefix(n);
+        }
+
+        return {};
+    }
+
     void agent_log_reader_t::do_process_next_line(std::string_view line)
     {
         constexpr std::size_t expected_minimum_size = message_start_marker.size() //
@@ -310,10 +504,10 @@ namespace logging {
                                                     + 0                           // message (str)
                                                     + message_end_marker.size();
 
-        // empty substr means no marker, get more bytes
+        // empty substr means no marker
         if (line.empty()) {
             LOG_TRACE("(%p) No end of line found", this);
-            return do_async_read();
+            return;
         }
 
         // remove trailing newline (turn it into a null terminator instead so that it can be used with printf)
@@ -325,7 +519,7 @@ namespace logging {
         // ignore empty lines
         if (line.empty()) {
             LOG_TRACE("(%p) Ignoring empty line", this);
-            return do_async_read();
+            return;
         }
 
         // must have a minimum size
@@ -76,11 +76,23 @@ namespace logging {
     private:
         consumer_fn_t consumer;
         std::shared_ptr<async::async_line_reader_t> line_reader;
+        /** The start of a binary log item that was split across more than one batch of lines */
+        std::string pending {};
 
-        /** Read the next line of data from the stream */
+        /** Read the lines of data from the stream */
         void do_async_read();
 
-        /** Process the received line */
+        /** Process a received batch of lines */
+        void do_process_lines(std::string_view lines);
+
+        /**
+         * Process the log items in a batch of lines
+         *
+         * @return The start of any binary log item at the end of the batch that is not yet complete
+         */
+        std::string_view do_process_items(std::string_view lines);
+
+        /** Process a received line of text */
         void do_process_next_line(std::string_view line);
 
         /** Handle the line having an unexpected format */
@@ -1,10 +1,11 @@
-/* Copyright (C) 2019-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2019-2022 by Arm Limited. All rights reserved. */
 
 #ifndef MALI_USERSPACE_IMALIHWCNTRREADER_H_
 #define MALI_USERSPACE_IMALIHWCNTRREADER_H_
 
 #include "MaliDevice.h"
 
+#include <cstddef>
 #include <cstdint>
 #include <functional>
 #include <memory>
@@ -114,6 +115,18 @@ namespace mali_userspace {
          * @return  Architecture version of the hardware counters, or 0 if not available
          */
         virtual HardwareVersion getHardwareVersion() const = 0;
+
+        /**
+         * Get the number of sample buffers shared with the kernel.
+         *
+         * @return The number of buffers that may be held (obtained by waitForBuffer and not yet released) at once
+         */
+        virtual std::size_t getBufferCount() const = 0;
+
+        /**
+         * Interrupt a call to {@link #waitForBuffer(int)} from another thread
+         */
+        virtual void interrupt() = 0;
     };
 } // namespace
 
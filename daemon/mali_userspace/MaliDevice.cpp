@@ -8,10 +8,14 @@
 #include "mali_userspace/MaliHwCntrNames.h"
 #include "mali_userspace/MaliHwCntrNamesBifrost.h"
 
+#include <array>
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <optional>
+#include <utility>
+#include <vector>
 
 namespace mali_userspace {
 
@@ -43,7 +47,10 @@ namespace mali_userspace {
         uint32_t mGpuIdValue;
         const char * mName;
         const char * mProductFamilyName;
-        const char * const * mCounterNames;
+        /** The counter names, each nul terminated */
+        const char * mCounterNames;
+        /** The offset of each counter's name within mCounterNames */
+        const uint16_t * mCounterNameOffsets;
         uint32_t mNumCounterNames;
         bool mLegacyLayout;
     };
@@ -55,8 +62,9 @@ namespace mali_userspace {
     }
 #define MALI_PRODUCT_VERSION(M, V, PN, FN, CN, V4)                                                                     \
     {                                                                                                                  \
-        (M), (V), (PN), (FN), (CN), COUNT_OF(CN), (V4)                                                                 \
+        (M), (V), (PN), (FN), (CN).chars.data(), (CN).offsets.data(), uint32_t((CN).offsets.size()), (V4)              \
     }
+#define MALI_COUNTER_NAME_TABLE(CN) makeCounterNameTable<getCounterNameTableLength(CN)>(CN)
 
     namespace {
         enum {
@@ -92,120 +100,189 @@ namespace mali_userspace {
             PRODUCT_ID_TVAX = 0xa004
         };
 
+        /**
+         * The counter names of a product, stored as one string rather than an array of pointers so that they need no
+         * relocations when gatord is loaded
+         */
+        template<std::size_t NumNames, std::size_t NumChars>
+        struct CounterNameTable {
+            std::array<char, NumChars> chars;
+            std::array<uint16_t, NumNames> offsets;
+        };
+
+        /** @return The length of the table of some names, where every empty name shares the leading nul */
+        template<std::size_t NumNames>
+        constexpr std::size_t getCounterNameTableLength(const char * const (&names)[NumNames])
+        {
+            std::size_t result = 1;
+            for (const char * name : names) {
+                if (*name != '\0') {
+                    while (*name++ != '\0') {
+                        ++result;
+                    }
+                    ++result;
+                }
+            }
+            return result;
+        }
+
+        template<std::size_t NumChars, std::size_t NumNames>
+        constexpr CounterNameTable<NumNames, NumChars> makeCounterNameTable(const char * const (&names)[NumNames])
+        {
+            static_assert(NumChars <= UINT16_MAX, "Counter names do not fit in a table");
+
+            CounterNameTable<NumNames, NumChars> result {};
+            std::size_t length = 1;
+            for (std::size_t index = 0; index < NumNames; ++index) {
+                const char * name = names[index];
+                if (*name != '\0') {
+                    result.offsets[index] = uint16_t(length);
+                    while (*name != '\0') {
+                        result.chars[length++] = *name++;
+                    }
+                    result.chars[length++] = '\0';
+                }
+            }
+            return result;
+        }
+
+        constexpr auto counter_names_mali_t60x = MALI_COUNTER_NAME_TABLE(hardware_counters_mali_t60x);
+        constexpr auto counter_names_mali_t62x = MALI_COUNTER_NAME_TABLE(hardware_counters_mali_t62x);
+        constexpr auto counter_names_mali_t72x = MALI_COUNTER_NAME_TABLE(hardware_counters_mali_t72x);
+        constexpr auto counter_names_mali_t76x = MALI_COUNTER_NAME_TABLE(hardware_counters_mali_t76x);
+        constexpr auto counter_names_mali_t82x = MALI_COUNTER_NAME_TABLE(hardware_counters_mali_t82x);
+        constexpr auto counter_names_mali_t83x = MALI_COUNTER_NAME_TABLE(hardware_counters_mali_t83x);
+        constexpr auto counter_names_mali_t86x = MALI_COUNTER_NAME_TABLE(hardware_counters_mali_t86x);
+        constexpr auto counter_names_mali_t88x = MALI_COUNTER_NAME_TABLE(hardware_counters_mali_t88x);
+        constexpr auto counter_names_mali_tDVx = MALI_COUNTER_NAME_TABLE(hardware_counters_mali_tDVx);
+        constexpr auto counter_names_mali_tSIx = MALI_COUNTER_NAME_TABLE(hardware_counters_mali_tSIx);
+        constexpr auto counter_names_mali_tGOx = MALI_COUNTER_NAME_TABLE(hardware_counters_mali_tGOx);
+        constexpr auto counter_names_mali_tMIx = MALI_COUNTER_NAME_TABLE(hardware_counters_mali_tMIx);
+        constexpr auto counter_names_mali_tHEx = MALI_COUNTER_NAME_TABLE(hardware_counters_mali_tHEx);
+        constexpr auto counter_names_mali_tNOx = MALI_COUNTER_NAME_TABLE(hardware_counters_mali_tNOx);
+        constexpr auto counter_names_mali_tNAx = MALI_COUNTER_NAME_TABLE(hardware_counters_mali_tNAx);
+        constexpr auto counter_names_mali_tOTx = MALI_COUNTER_NAME_TABLE(hardware_counters_mali_tOTx);
+        constexpr auto counter_names_mali_tTRx = MALI_COUNTER_NAME_TABLE(hardware_counters_mali_tTRx);
+        constexpr auto counter_names_mali_tBOx = MALI_COUNTER_NAME_TABLE(hardware_counters_mali_tBOx);
+        constexpr auto counter_names_mali_tVAx = MALI_COUNTER_NAME_TABLE(hardware_counters_mali_tVAx);
+        constexpr auto counter_names_mali_tGRx = MALI_COUNTER_NAME_TABLE(hardware_counters_mali_tGRx);
+        constexpr auto counter_names_mali_tVIx = MALI_COUNTER_NAME_TABLE(hardware_counters_mali_tVIx);
+        constexpr auto counter_names_mali_tODx = MALI_COUNTER_NAME_TABLE(hardware_counters_mali_tODx);
+
         /* supported product versions */
         const MaliProductVersion PRODUCT_VERSIONS[] = {MALI_PRODUCT_VERSION(PRODUCT_ID_MASK_OLD,
                                                                             PRODUCT_ID_T60X,
                                                                             "T60x",
                                                                             "Midgard",
-                                                                            hardware_counters_mali_t60x,
+                                                                            counter_names_mali_t60x,
                                                                             true),
                                                        MALI_PRODUCT_VERSION(PRODUCT_ID_MASK_OLD,
                                                                             PRODUCT_ID_T62X,
                                                                             "T62x",
                                                                             "Midgard",
-                                                                            hardware_counters_mali_t62x,
+                                                                            counter_names_mali_t62x,
                                                                             true),
                                                        MALI_PRODUCT_VERSION(PRODUCT_ID_MASK_OLD,
                                                                             PRODUCT_ID_T72X,
                                                                             "T72x",
                                                                             "Midgard",
-                                                                            hardware_counters_mali_t72x,
+                                                                            counter_names_mali_t72x,
                                                                             true),
                                                        MALI_PRODUCT_VERSION(PRODUCT_ID_MASK_OLD,
                                                                             PRODUCT_ID_T76X,
                                                                             "T76x",
                                                                             "Midgard",
-                                                                            hardware_counters_mali_t76x,
+                                                                            counter_names_mali_t76x,
                                                                             false),
                                                        MALI_PRODUCT_VERSION(PRODUCT_ID_MASK_OLD,
                                                                             PRODUCT_ID_T82X,
                                                                             "T82x",
                                                                             "Midgard",
-                                                                            hardware_counters_mali_t82x,
+                                                                            counter_names_mali_t82x,
                                                                             false),
                                                        MALI_PRODUCT_VERSION(PRODUCT_ID_MASK_OLD,
                                                                             PRODUCT_ID_T83X,
                                                                             "T83x",
                                                                             "Midgard",
-                                                                            hardware_counters_mali_t83x,
+                                                                            counter_names_mali_t83x,
                                                                             false),
                                                        MALI_PRODUCT_VERSION(PRODUCT_ID_MASK_OLD,
                                                                             PRODUCT_ID_T86X,
                                                                             "T86x",
                                                                             "Midgard",
-                                                                            hardware_counters_mali_t86x,
+                                                                            counter_names_mali_t86x,
                                                                             false),
                                                        MALI_PRODUCT_VERSION(PRODUCT_ID_MASK_OLD,
                                                                             PRODUCT_ID_TFRX,
                                                                             "T88x",
                                                                             "Midgard",
-                                                                            hardware_counters_mali_t88x,
+                                                                            counter_names_mali_t88x,
                                                                             false),
                                                        MALI_PRODUCT_VERSION(PRODUCT_ID_MASK_NEW,
                                                                             PRODUCT_ID_TMIX,
                                                                             "G71",
                                                                             "Bifrost",
-                                                                            hardware_counters_mali_tMIx,
+                                                                            counter_names_mali_tMIx,
                                                                             false),
                                                        MALI_PRODUCT_VERSION(PRODUCT_ID_MASK_NEW,
                                                                             PRODUCT_ID_THEX,
                                                                             "G72",
                                                                             "Bifrost",
-                                                                            hardware_counters_mali_tHEx,
+                                                                            counter_names_mali_tHEx,
                                                                             false),
                                                        MALI_PRODUCT_VERSION(PRODUCT_ID_MASK_NEW,
                                                                             PRODUCT_ID_TDVX,
                                                                             "G31",
                                                                             "Bifrost",
-                                                                            hardware_counters_mali_tDVx,
+                                                                            counter_names_mali_tDVx,
                                                                             false),
                                                        MALI_PRODUCT_VERSION(PRODUCT_ID_MASK_NEW,
                                                                             PRODUCT_ID_TSIX,
                                                                             "G51",
                                                                             "Bifrost",
-                                                                            hardware_counters_mali_tSIx,
+                                                                            counter_names_mali_tSIx,
                                                                             false),
                                                        MALI_PRODUCT_VERSION(PRODUCT_ID_MASK_NEW,
                                                                             PRODUCT_ID_TGOX,
                                                                             "G52",
                                                                             "Bifrost",
-                                                                            hardware_counters_mali_tGOx,
+                                                                            counter_names_mali_tGOx,
                                                                             false),
                                                        MALI_PRODUCT_VERSION(PRODUCT_ID_MASK_NEW,
                                                                             PRODUCT_ID_TNOX,
                                                                             "G76",
                                                                             "Bifrost",
-                                                                            hardware_counters_mali_tNOx,
+                                                                            counter_names_mali_tNOx,
                                                                             false),
                                                        MALI_PRODUCT_VERSION(PRODUCT_ID_MASK_NEW,
                                                                             PRODUCT_ID_TNAXa,
                                                                             "G57",
                                                                             "Valhall",
-                                                                            hardware_counters_mali_tNAx,
+                                                                            counter_names_mali_tNAx,
                                                                             false),
                                                        MALI_PRODUCT_VERSION(PRODUCT_ID_MASK_NEW,
                                                                             PRODUCT_ID_TNAXb,
                                                                             "G57",
                                                                             "Valhall",
-                                                                            hardware_counters_mali_tNAx,
+                                                                            counter_names_mali_tNAx,
                                                                             false),
                                                        MALI_PRODUCT_VERSION(PRODUCT_ID_MASK_NEW,
                                                                             PRODUCT_ID_TTRX,
                                                                             "G77",
                                                                             "Valhall",
-                                                                            hardware_counters_mali_tTRx,
+                                                                            counter_names_mali_tTRx,
                                                                             false),
                                                        MALI_PRODUCT_VERSION(PRODUCT_ID_MASK_NEW,
                                                                             PRODUCT_ID_TOTX,
                                                                             "G68",
                                                                             "Valhall",
-                                                                            hardware_counters_mali_tOTx,
+                                                                            counter_names_mali_tOTx,
                                                                             false),
                                                        MALI_PRODUCT_VERSION(PRODUCT_ID_MASK_NEW,
                                                                             PRODUCT_ID_TBOX,
                                                                             "G78",
                                                                             "Valhall",
-                                                                            hardware_counters_mali_tBOx,
+                                                                            counter_names_mali_tBOx,
                                                                             false),
                                                        // Detect Mali-G78E as a specific product, but alias
                                                        // to the same underlying counter definitions as
@@ -214,54 +291,35 @@ namespace mali_userspace {
                                                                             PRODUCT_ID_TBOXAE,
                                                                             "G78AE",
                                                                             "Valhall",
-                                                                            hardware_counters_mali_tBOx,
+                                                                            counter_names_mali_tBOx,
                                                                             false),
                                                        MALI_PRODUCT_VERSION(PRODUCT_ID_MASK_NEW,
                                                                             PRODUCT_ID_TODX,
                                                                             "G710",
                                                                             "Valhall",
-                                                                            hardware_counters_mali_tODx,
+                                                                            counter_names_mali_tODx,
                                                                             false),
                                                        MALI_PRODUCT_VERSION(PRODUCT_ID_MASK_NEW,
                                                                             PRODUCT_ID_TVIX,
                                                                             "G610",
                                                                             "Valhall",
-                                                                            hardware_counters_mali_tVIx,
+                                                                            counter_names_mali_tVIx,
                                                                             false),
                                                        MALI_PRODUCT_VERSION(PRODUCT_ID_MASK_NEW,
                                                                             PRODUCT_ID_TGRX,
                                                                             "G510",
                                                                             "Valhall",
-                                                                            hardware_counters_mali_tGRx,
+                                                                            counter_names_mali_tGRx,
                                                                             false),
                                                        MALI_PRODUCT_VERSION(PRODUCT_ID_MASK_NEW,
                                                                             PRODUCT_ID_TVAX,
                                                                             "G310",
                                                                             "Valhall",
-                                                                            hardware_counters_mali_tVAx,
+                                                                            counter_names_mali_tVAx,
                                                                             false)};
 
         enum { NUM_PRODUCT_VERSIONS = COUNT_OF(PRODUCT_VERSIONS) };
 
-        struct AccumulatedCounter {
-            uint64_t sum;
-            uint32_t count;
-
-            AccumulatedCounter() : sum(0), count(0) {}
-
-            AccumulatedCounter & operator+=(uint32_t delta)
-            {
-                sum += delta;
-                count += 1;
-
-                return *this;
-            }
-
-            [[nodiscard]] bool isValid() const { return count > 0; }
-
-            [[nodiscard]] uint32_t average() const { return sum / count; }
-        };
-
         /**
          * Map from the index'th block of a particular type to the actual block number within the list of data blocks.
          * For GPU's with legacy counter data layout
@@ -340,6 +398,9 @@ namespace mali_userspace {
 
         constexpr uint32_t mapNameBlockToIndex(MaliCounterBlockName nameBlock) { return uint32_t(nameBlock); }
 
+        /** The enable bits of a block with every group enabled */
+        constexpr uint32_t ALL_ENABLE_GROUPS_MASK = (1U << MaliDevice::NUM_ENABLE_GROUPS) - 1;
+
         const MaliProductVersion * findMaliProductRecordFromId(uint32_t productId)
         {
             for (const auto & index : PRODUCT_VERSIONS) {
@@ -351,38 +412,13 @@ namespace mali_userspace {
         }
     }
 
-    MaliDeviceCounterList::MaliDeviceCounterList(uint32_t numBlocks, uint32_t numGroups, uint32_t numWords)
-        : countersListLength(numBlocks * numGroups * numWords),
-          countersListValid(0),
-          countersList(new Address[countersListLength])
-    {
-    }
-
-    MaliDeviceCounterList::MaliDeviceCounterList(MaliDeviceCounterList && that) noexcept
-        : countersListLength(that.countersListLength),
-          countersListValid(that.countersListValid),
-          countersList(that.countersList)
-    {
-        that.countersListLength = 0;
-        that.countersListValid = 0;
-        that.countersList = nullptr;
-    }
-
-    MaliDeviceCounterList::~MaliDeviceCounterList() { delete[] countersList; }
-
-    void MaliDeviceCounterList::enable(MaliCounterBlockName nameBlock,
-                                       uint32_t repeatCount,
-                                       uint32_t groupIndex,
-                                       uint32_t wordIndex)
+    size_t MaliDeviceCounterList::size() const
     {
-        const size_t index = countersListValid++;
-
-        assert(index < countersListLength);
-
-        countersList[index].nameBlock = nameBlock;
-        countersList[index].repeatCount = repeatCount;
-        countersList[index].groupIndex = groupIndex;
-        countersList[index].wordIndex = wordIndex;
+        size_t result = directCounters.size();
+        for (const auto & block : aggregatedBlocks) {
+            result += block.counters.size();
+        }
+        return result;
     }
 
     const char * findMaliProductNameFromId(uint32_t productId)
@@ -441,240 +477,289 @@ namespace mali_userspace {
                                               failedDueToBufferCount);
     }
 
+    std::vector<kinstr_prfcnt::prfcnt_enum_item> MaliDevice::enumeratePrfcntInfo() const
+    {
+        return deviceApi->enumeratePrfcntInfo();
+    }
+
+    lib::AutoClosingFd MaliDevice::createPrfcntReaderFd(
+        const std::vector<kinstr_prfcnt::prfcnt_request_item> & requests,
+        std::uint32_t & metadataItemSize,
+        std::uint32_t & mmapSize) const
+    {
+        return deviceApi->createPrfcntReaderFd(requests, metadataItemSize, mmapSize);
+    }
+
     const char * MaliDevice::getCounterName(uint32_t nameBlockIndex, uint32_t counterIndex) const
     {
         if ((nameBlockIndex >= getNameBlockCount()) || (counterIndex >= NUM_COUNTERS_PER_BLOCK)) {
             return nullptr;
         }
 
-        const char * result = mProductVersion.mCounterNames[(nameBlockIndex * NUM_COUNTERS_PER_BLOCK) + counterIndex];
+        const uint32_t index = (nameBlockIndex * NUM_COUNTERS_PER_BLOCK) + counterIndex;
+        if (index >= mProductVersion.mNumCounterNames) {
+            return nullptr;
+        }
 
-        if ((result == nullptr) || (result[0] == 0)) {
+        const char * result = mProductVersion.mCounterNames + mProductVersion.mCounterNameOffsets[index];
+
+        if (result[0] == 0) {
             return nullptr;
         }
 
         return result;
     }
 
-    void MaliDevice::initCounterList(uint32_t gpuId,
-                                     IMaliDeviceCounterDumpCallback & callback,
-                                     MaliDeviceCounterList & list,
-                                     MaliCounterBlockName nameBlock,
-                                     uint32_t repeatCount)
+    void MaliDevice::addDirectCounters(const IMaliDeviceCounterDumpCallback & callback,
+                                       MaliDeviceCounterList & list,
+                                       MaliCounterBlockName nameBlock,
+                                       uint32_t blockNumber) const
     {
         const uint32_t nameBlockIndex = mapNameBlockToIndex(nameBlock);
+        const uint32_t blockBufferIndex = blockNumber * NUM_COUNTERS_PER_BLOCK;
 
-        for (uint32_t groupIndex = 0; groupIndex < MaliDevice::NUM_ENABLE_GROUPS; ++groupIndex) {
-            for (uint32_t wordIndex = 0; wordIndex < MaliDevice::NUM_COUNTERS_PER_ENABLE_GROUP; ++wordIndex) {
-                const uint32_t counterIndex = (groupIndex * MaliDevice::NUM_COUNTERS_PER_ENABLE_GROUP) + wordIndex;
-                if (counterIndex != MaliDevice::BLOCK_ENABLE_BITS_COUNTER_INDEX) {
-                    if (callback.isCounterActive(nameBlockIndex, counterIndex, gpuId)) {
-                        list.enable(nameBlock, repeatCount, groupIndex, wordIndex);
-                    }
-                }
+        for (uint32_t counterIndex = 0; counterIndex < NUM_COUNTERS_PER_BLOCK; ++counterIndex) {
+            if (counterIndex == BLOCK_ENABLE_BITS_COUNTER_INDEX) {
+                continue;
+            }
+
+            const int key = callback.getCounterKey(nameBlockIndex, counterIndex, mProductVersion.mGpuIdValue);
+            if (key != 0) {
+                list.directCounters.push_back({blockBufferIndex + counterIndex,
+                                               blockBufferIndex + BLOCK_ENABLE_BITS_COUNTER_INDEX,
+                                               1U << (counterIndex / NUM_COUNTERS_PER_ENABLE_GROUP),
+                                               key});
             }
         }
     }
 
-    MaliDeviceCounterList MaliDevice::createCounterList(IMaliDeviceCounterDumpCallback & callback) const
+    void MaliDevice::addAggregatedCounters(const IMaliDeviceCounterDumpCallback & callback,
+                                           MaliDeviceCounterList & list,
+                                           MaliCounterBlockName nameBlock,
+                                           bool average,
+                                           std::vector<uint32_t> blockNumbers) const
     {
-        const uint32_t numL2MmuBlocks = getL2MmuBlockCount();
-        const uint32_t numShaderBlocks = getShaderBlockCount();
+        const uint32_t nameBlockIndex = mapNameBlockToIndex(nameBlock);
 
-        MaliDeviceCounterList result(4, NUM_ENABLE_GROUPS, NUM_COUNTERS_PER_ENABLE_GROUP);
+        MaliDeviceCounterList::AggregatedBlock block {average, std::move(blockNumbers), {}};
+        for (auto & blockBufferIndex : block.blockBufferIndexes) {
+            blockBufferIndex *= NUM_COUNTERS_PER_BLOCK;
+        }
 
-        initCounterList(mProductVersion.mGpuIdValue, callback, result, MaliCounterBlockName::JM, 1);
-        initCounterList(mProductVersion.mGpuIdValue, callback, result, MaliCounterBlockName::TILER, 1);
-        initCounterList(mProductVersion.mGpuIdValue, callback, result, MaliCounterBlockName::MMU, numL2MmuBlocks);
-        initCounterList(mProductVersion.mGpuIdValue, callback, result, MaliCounterBlockName::SHADER, numShaderBlocks);
+        for (uint32_t counterIndex = 0; counterIndex < NUM_COUNTERS_PER_BLOCK; ++counterIndex) {
+            if (counterIndex == BLOCK_ENABLE_BITS_COUNTER_INDEX) {
+                continue;
+            }
 
-        return result;
+            const int key = callback.getCounterKey(nameBlockIndex, counterIndex, mProductVersion.mGpuIdValue);
+            if (key != 0) {
+                block.counters.push_back({counterIndex, key});
+            }
+        }
+
+        if (!block.counters.empty()) {
+            list.aggregatedBlocks.push_back(std::move(block));
+        }
     }
 
-    void MaliDevice::dumpAllCounters(uint32_t hardwareVersion,
-                                     const MaliDeviceCounterList & counterList,
-                                     const uint32_t * buffer,
-                                     size_t bufferLength,
-                                     IBlockCounterFrameBuilder & bufferData,
-                                     IMaliDeviceCounterDumpCallback & callback) const
+    MaliDeviceCounterList MaliDevice::createCounterList(uint32_t hardwareVersion,
+                                                        const IMaliDeviceCounterDumpCallback & callback) const
     {
+        const uint32_t numL2MmuBlocks = getL2MmuBlockCount();
+        const uint32_t numShaderBlocks = getShaderBlockCount();
+
+        // powered down shader cores are not counted in the average
+        std::vector<uint32_t> shaderBlockIndexes;
+        for (uint32_t blockIndex = 0; blockIndex < numShaderBlocks; ++blockIndex) {
+            if ((blockIndex < 64) && ((shaderCoreAvailabilityMask & (1ULL << blockIndex)) != 0)) {
+                shaderBlockIndexes.push_back(blockIndex);
+            }
+        }
+
+        MaliDeviceCounterList result;
+
         switch (hardwareVersion) {
             case 4: {
-                dumpAllCounters_V4(counterList, buffer, bufferLength, bufferData, callback);
+                // we must average the shader core counters across all shader cores
+                std::vector<uint32_t> shaderBlockNumbers;
+                for (uint32_t blockIndex : shaderBlockIndexes) {
+                    shaderBlockNumbers.push_back(
+                        mapV4BlockIndexToBlockNumber(MaliCounterBlockName::SHADER, blockIndex));
+                }
+
+                addDirectCounters(callback,
+                                  result,
+                                  MaliCounterBlockName::JM,
+                                  mapV4BlockIndexToBlockNumber(MaliCounterBlockName::JM, 0));
+                addDirectCounters(callback,
+                                  result,
+                                  MaliCounterBlockName::TILER,
+                                  mapV4BlockIndexToBlockNumber(MaliCounterBlockName::TILER, 0));
+                addDirectCounters(callback,
+                                  result,
+                                  MaliCounterBlockName::MMU,
+                                  mapV4BlockIndexToBlockNumber(MaliCounterBlockName::MMU, 0));
+                addAggregatedCounters(callback, result, MaliCounterBlockName::SHADER, true, shaderBlockNumbers);
                 break;
             }
             case 5:
             case 6: {
-                dumpAllCounters_V56(counterList, buffer, bufferLength, bufferData, callback);
+                // we must accumulate the mmu counters accross all mmu blocks
+                std::vector<uint32_t> mmuL2BlockNumbers;
+                for (uint32_t blockIndex = 0; blockIndex < numL2MmuBlocks; ++blockIndex) {
+                    mmuL2BlockNumbers.push_back(mapV56BlockIndexToBlockNumber(MaliCounterBlockName::MMU,
+                                                                              numL2MmuBlocks,
+                                                                              numShaderBlocks,
+                                                                              blockIndex));
+                }
+                // we must average the shader core counters across all shader cores
+                std::vector<uint32_t> shaderBlockNumbers;
+                for (uint32_t blockIndex : shaderBlockIndexes) {
+                    shaderBlockNumbers.push_back(mapV56BlockIndexToBlockNumber(MaliCounterBlockName::SHADER,
+                                                                               numL2MmuBlocks,
+                                                                               numShaderBlocks,
+                                                                               blockIndex));
+                }
+
+                addDirectCounters(
+                    callback,
+                    result,
+                    MaliCounterBlockName::JM,
+                    mapV56BlockIndexToBlockNumber(MaliCounterBlockName::JM, numL2MmuBlocks, numShaderBlocks, 0));
+                addDirectCounters(
+                    callback,
+                    result,
+                    MaliCounterBlockName::TILER,
+                    mapV56BlockIndexToBlockNumber(MaliCounterBlockName::TILER, numL2MmuBlocks, numShaderBlocks, 0));
+                addAggregatedCounters(callback, result, MaliCounterBlockName::MMU, false, mmuL2BlockNumbers);
+                addAggregatedCounters(callback, result, MaliCounterBlockName::SHADER, true, shaderBlockNumbers);
                 break;
             }
             default: {
-                static bool shownLog = false;
-                if (!shownLog) {
-                    shownLog = true;
-                    LOG_ERROR("MaliDevice::dumpAllCounters - Cannot process hardware V%u", hardwareVersion);
-                }
+                LOG_ERROR("MaliDevice::createCounterList - Cannot process hardware V%u", hardwareVersion);
                 break;
             }
         }
+
+        return result;
     }
 
-    void MaliDevice::dumpAllCounters_V4(const MaliDeviceCounterList & counterList,
-                                        const uint32_t * buffer,
-                                        size_t bufferLength,
-                                        IBlockCounterFrameBuilder & bufferData,
-                                        IMaliDeviceCounterDumpCallback & callback) const
+    MaliDevice::CounterEnableMasks MaliDevice::getEnabledCounterMasks(
+        const IMaliDeviceCounterDumpCallback & callback) const
     {
-        const size_t counterListSize = counterList.size();
-
-        // we must average the shader core counters across all shader cores
-        AccumulatedCounter shaderCoreCounters[NUM_COUNTERS_PER_BLOCK];
-
-        for (size_t counterListIndex = 0; counterListIndex < counterListSize; ++counterListIndex) {
-            const MaliDeviceCounterList::Address & counterAddress = counterList[counterListIndex];
-
-            const MaliCounterBlockName nameBlock = counterAddress.nameBlock;
-            const uint32_t nameBlockIndex = mapNameBlockToIndex(nameBlock);
-            const bool isShaderCore = (nameBlock == MaliCounterBlockName::SHADER);
-
-            for (uint32_t blockIndex = 0; blockIndex < counterAddress.repeatCount; ++blockIndex) {
-                const uint32_t blockNumber = mapV4BlockIndexToBlockNumber(nameBlock, blockIndex);
-                const size_t maskBufferIndex = (blockNumber * NUM_COUNTERS_PER_BLOCK) + BLOCK_ENABLE_BITS_COUNTER_INDEX;
-
-                if (maskBufferIndex >= bufferLength) {
-                    continue;
-                }
-
-                const uint32_t mask = buffer[maskBufferIndex];
-
-                if (((mask & (1 << counterAddress.groupIndex)) == 0U)
-                    || (isShaderCore && !(shaderCoreAvailabilityMask & (1ull << blockIndex)))) {
-                    continue;
-                }
-
-                const uint32_t counterIndex =
-                    (counterAddress.groupIndex * NUM_COUNTERS_PER_ENABLE_GROUP) + counterAddress.wordIndex;
-                const size_t bufferIndex = (blockNumber * NUM_COUNTERS_PER_BLOCK) + counterIndex;
-
-                if (bufferIndex >= bufferLength) {
-                    continue;
-                }
-
-                const uint32_t delta = buffer[bufferIndex];
+        CounterEnableMasks result {};
 
-                if (counterIndex != BLOCK_ENABLE_BITS_COUNTER_INDEX) {
-                    if (isShaderCore) {
-                        shaderCoreCounters[counterIndex] += delta;
-                    }
-                    else {
-                        callback.nextCounterValue(nameBlockIndex,
-                                                  counterIndex,
-                                                  delta,
-                                                  mProductVersion.mGpuIdValue,
-                                                  bufferData);
-                    }
+        for (uint32_t nameBlockIndex = 0; nameBlockIndex < result.size(); ++nameBlockIndex) {
+            for (uint32_t counterIndex = 0; counterIndex < NUM_COUNTERS_PER_BLOCK; ++counterIndex) {
+                if ((counterIndex != BLOCK_ENABLE_BITS_COUNTER_INDEX)
+                    && (callback.getCounterKey(nameBlockIndex, counterIndex, mProductVersion.mGpuIdValue) != 0)) {
+                    result[nameBlockIndex] |= (1ULL << counterIndex);
                 }
             }
         }
 
-        // now send shader core and mmu/l2 averages
-        for (uint32_t shaderCounterIndex = 0; shaderCounterIndex < NUM_COUNTERS_PER_BLOCK; ++shaderCounterIndex) {
-            if (shaderCoreCounters[shaderCounterIndex].isValid()) {
-                callback.nextCounterValue(mapNameBlockToIndex(MaliCounterBlockName::SHADER),
-                                          shaderCounterIndex,
-                                          shaderCoreCounters[shaderCounterIndex].average(),
-                                          mProductVersion.mGpuIdValue,
-                                          bufferData);
-            }
-        }
+        return result;
     }
 
-    void MaliDevice::dumpAllCounters_V56(const MaliDeviceCounterList & counterList,
-                                         const uint32_t * buffer,
-                                         size_t bufferLength,
-                                         IBlockCounterFrameBuilder & bufferData,
-                                         IMaliDeviceCounterDumpCallback & callback) const
+    std::optional<uint32_t> MaliDevice::getV56BlockNumber(uint32_t nameBlockIndex, uint32_t blockIndex) const
     {
         const uint32_t numL2MmuBlocks = getL2MmuBlockCount();
         const uint32_t numShaderBlocks = getShaderBlockCount();
-        const size_t counterListSize = counterList.size();
-
-        // we must accumulate the mmu counters accross all mmu blocks
-        AccumulatedCounter mmuL2Counters[NUM_COUNTERS_PER_BLOCK];
-        // we must average the shader core counters across all shader cores
-        AccumulatedCounter shaderCoreCounters[NUM_COUNTERS_PER_BLOCK];
-
-        for (size_t counterListIndex = 0; counterListIndex < counterListSize; ++counterListIndex) {
-            const MaliDeviceCounterList::Address & counterAddress = counterList[counterListIndex];
-
-            const MaliCounterBlockName nameBlock = counterAddress.nameBlock;
-            const uint32_t nameBlockIndex = mapNameBlockToIndex(nameBlock);
-            const bool isShaderCore = (nameBlock == MaliCounterBlockName::SHADER);
-            const bool isMMUL2 = (nameBlock == MaliCounterBlockName::MMU);
+        const auto nameBlock = MaliCounterBlockName(nameBlockIndex);
 
-            for (uint32_t blockIndex = 0; blockIndex < counterAddress.repeatCount; ++blockIndex) {
-                const uint32_t blockNumber =
-                    mapV56BlockIndexToBlockNumber(nameBlock, numL2MmuBlocks, numShaderBlocks, blockIndex);
-                const size_t maskBufferIndex = (blockNumber * NUM_COUNTERS_PER_BLOCK) + BLOCK_ENABLE_BITS_COUNTER_INDEX;
-
-                if (maskBufferIndex >= bufferLength) {
-                    continue;
+        switch (nameBlock) {
+            case MaliCounterBlockName::JM:
+            case MaliCounterBlockName::TILER:
+                if (blockIndex != 0) {
+                    return {};
+                }
+                break;
+            case MaliCounterBlockName::MMU:
+                if (blockIndex >= numL2MmuBlocks) {
+                    return {};
                 }
+                break;
+            case MaliCounterBlockName::SHADER:
+                if (blockIndex >= numShaderBlocks) {
+                    return {};
+                }
+                break;
+            default:
+                return {};
+        }
 
-                const uint32_t mask = buffer[maskBufferIndex];
+        return mapV56BlockIndexToBlockNumber(nameBlock, numL2MmuBlocks, numShaderBlocks, blockIndex);
+    }
 
-                if (((mask & (1 << counterAddress.groupIndex)) == 0U)
-                    || (isShaderCore && !(shaderCoreAvailabilityMask & (1ull << blockIndex)))) {
-                    continue;
-                }
+    void MaliDevice::dumpAllCounters(const MaliDeviceCounterList & counterList,
+                                     const uint32_t * buffer,
+                                     size_t bufferLength,
+                                     IBlockCounterFrameBuilder & bufferData)
+    {
+        for (const auto & counter : counterList.directCounters) {
+            if ((counter.bufferIndex < bufferLength) && (counter.maskBufferIndex < bufferLength)
+                && ((buffer[counter.maskBufferIndex] & counter.maskBit) != 0)) {
+                bufferData.event64(counter.key, buffer[counter.bufferIndex]);
+            }
+        }
 
-                const uint32_t counterIndex =
-                    (counterAddress.groupIndex * NUM_COUNTERS_PER_ENABLE_GROUP) + counterAddress.wordIndex;
-                const size_t bufferIndex = (blockNumber * NUM_COUNTERS_PER_BLOCK) + counterIndex;
+        for (const auto & block : counterList.aggregatedBlocks) {
+            // sum every counter of every block, as that is cheaper than picking out the enabled ones
+            std::array<uint64_t, NUM_COUNTERS_PER_BLOCK> sums {};
+            std::array<uint32_t, NUM_ENABLE_GROUPS> counts {};
 
-                if (bufferIndex >= bufferLength) {
+            for (const uint32_t blockBufferIndex : block.blockBufferIndexes) {
+                if (blockBufferIndex + NUM_COUNTERS_PER_BLOCK > bufferLength) {
                     continue;
                 }
 
-                const uint32_t delta = buffer[bufferIndex];
+                const uint32_t * const values = buffer + blockBufferIndex;
+                const uint32_t mask = values[BLOCK_ENABLE_BITS_COUNTER_INDEX];
 
-                if (counterIndex != BLOCK_ENABLE_BITS_COUNTER_INDEX) {
-                    if (isShaderCore) {
-                        shaderCoreCounters[counterIndex] += delta;
+                if ((mask & ALL_ENABLE_GROUPS_MASK) == ALL_ENABLE_GROUPS_MASK) {
+                    for (size_t counterIndex = 0; counterIndex < NUM_COUNTERS_PER_BLOCK; ++counterIndex) {
+                        sums[counterIndex] += values[counterIndex];
                     }
-                    else if (isMMUL2) {
-                        mmuL2Counters[counterIndex] += delta;
+                    for (auto & count : counts) {
+                        count += 1;
                     }
-                    else {
-                        callback.nextCounterValue(nameBlockIndex,
-                                                  counterIndex,
-                                                  delta,
-                                                  mProductVersion.mGpuIdValue,
-                                                  bufferData);
+                }
+                else {
+                    for (size_t groupIndex = 0; groupIndex < NUM_ENABLE_GROUPS; ++groupIndex) {
+                        if ((mask & (1U << groupIndex)) != 0) {
+                            counts[groupIndex] += 1;
+                            for (size_t wordIndex = 0; wordIndex < NUM_COUNTERS_PER_ENABLE_GROUP; ++wordIndex) {
+                                const size_t counterIndex = (groupIndex * NUM_COUNTERS_PER_ENABLE_GROUP) + wordIndex;
+                                sums[counterIndex] += values[counterIndex];
+                            }
+                        }
                     }
                 }
             }
-        }
 
-        // now send shader core and mmu/l2 averages
-        for (uint32_t mmuL2CounterIndex = 0; mmuL2CounterIndex < NUM_COUNTERS_PER_BLOCK; ++mmuL2CounterIndex) {
-            if (mmuL2Counters[mmuL2CounterIndex].isValid()) {
-                callback.nextCounterValue(mapNameBlockToIndex(MaliCounterBlockName::MMU),
-                                          mmuL2CounterIndex,
-                                          mmuL2Counters[mmuL2CounterIndex].sum,
-                                          mProductVersion.mGpuIdValue,
-                                          bufferData);
+            for (const auto & counter : block.counters) {
+                const uint32_t count = counts[counter.counterIndex / NUM_COUNTERS_PER_ENABLE_GROUP];
+                if (count > 0) {
+                    const uint64_t sum = sums[counter.counterIndex];
+                    bufferData.event64(counter.key, (block.average ? uint32_t(sum / count) : sum));
+                }
             }
         }
-        for (uint32_t shaderCounterIndex = 0; shaderCounterIndex < NUM_COUNTERS_PER_BLOCK; ++shaderCounterIndex) {
-            if (shaderCoreCounters[shaderCounterIndex].isValid()) {
-                callback.nextCounterValue(mapNameBlockToIndex(MaliCounterBlockName::SHADER),
-                                          shaderCounterIndex,
-                                          shaderCoreCounters[shaderCounterIndex].average(),
-                                          mProductVersion.mGpuIdValue,
-                                          bufferData);
+    }
+
+    bool MaliDevice::isIdleSample(const uint32_t * buffer, size_t bufferLength)
+    {
+        for (size_t blockIndex = 0; blockIndex + NUM_COUNTERS_PER_BLOCK <= bufferLength;
+             blockIndex += NUM_COUNTERS_PER_BLOCK) {
+            const uint32_t * const values = buffer + blockIndex;
+            for (size_t counterIndex = NUM_BLOCK_HEADER_COUNTERS; counterIndex < NUM_COUNTERS_PER_BLOCK;
+                 ++counterIndex) {
+                if (values[counterIndex] != 0) {
+                    return false;
+                }
             }
         }
+        return true;
     }
 
     void MaliDevice::insertConstants(std::set<Constant> & dest)
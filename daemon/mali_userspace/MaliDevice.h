@@ -1,4 +1,4 @@
-/* Copyright (C) 2016-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2016-2022 by Arm Limited. All rights reserved. */
 
 #ifndef NATIVE_GATOR_DAEMON_MALI_USERSPACE_MALIDEVICE_H_
 #define NATIVE_GATOR_DAEMON_MALI_USERSPACE_MALIDEVICE_H_
@@ -8,13 +8,16 @@
 #include "lib/AutoClosingFd.h"
 #include "mali_userspace/MaliDeviceApi.h"
 
+#include <array>
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
 #include <map>
 #include <memory>
+#include <optional>
 #include <set>
 #include <string>
+#include <vector>
 
 namespace mali_userspace {
     /* forward declarations */
@@ -23,74 +26,61 @@ namespace mali_userspace {
     enum class MaliCounterBlockName : uint32_t;
 
     /**
-     * Interface implemented by counter value receiver; the object that is passed data by MaliDevice::dumpAllCounters
+     * Interface implemented by the counter value receiver; the object that maps the counters read by
+     * MaliDevice::dumpAllCounters to keys
      */
     struct IMaliDeviceCounterDumpCallback {
         virtual ~IMaliDeviceCounterDumpCallback() = default;
 
         /**
-         * Receive the next counter value
-         */
-        virtual void nextCounterValue(uint32_t nameBlockIndex,
-                                      uint32_t counterIndex,
-                                      uint64_t delta,
-                                      uint32_t gpuId,
-                                      IBlockCounterFrameBuilder & buffer) = 0;
-
-        /**
-         * Used to check if the user selected the counter in the config dialog when building the fast lookup list
+         * Used to find the counters the user selected in the config dialog when building the counter list
          *
-         * @return True if the user selected the counter, false otherwise
+         * @return The key of the counter, or 0 if the user did not select it
          */
-        virtual bool isCounterActive(uint32_t nameBlockIndex, uint32_t counterIndex, uint32_t gpuId) const = 0;
+        virtual int getCounterKey(uint32_t nameBlockIndex, uint32_t counterIndex, uint32_t gpuId) const = 0;
     };
 
     /**
-     * Contains the list of counters to read. Used to improve performance during read instead of having to iterate
-     * over all possible counter entries
+     * Contains the list of counters to read, as a table of where each is in the sample buffer. Used to improve
+     * performance during read instead of having to iterate over all possible counter addresses for each sample
      */
     class MaliDeviceCounterList {
     public:
-        /** An address of an enabled counter */
-        struct Address {
-            MaliCounterBlockName nameBlock;
-            uint32_t repeatCount;
-            uint32_t groupIndex;
-            uint32_t wordIndex;
+        /** A counter that is read from a single block */
+        struct DirectCounter {
+            /** The index of the counter's value in the sample buffer */
+            uint32_t bufferIndex;
+            /** The index of the block's enable bits in the sample buffer */
+            uint32_t maskBufferIndex;
+            /** The enable bit that must be set for the value to be valid */
+            uint32_t maskBit;
+            int key;
         };
 
-        /**
-             * Constructor
-             */
-        MaliDeviceCounterList(uint32_t numBlocks, uint32_t numGroups, uint32_t numWords);
-        MaliDeviceCounterList(MaliDeviceCounterList &&) noexcept;
-        MaliDeviceCounterList(const MaliDeviceCounterList &) = delete;
-        MaliDeviceCounterList & operator=(const MaliDeviceCounterList &) = delete;
-        ~MaliDeviceCounterList();
-
-        /** @return The number of enabled counters in the list */
-        size_t size() const { return countersListValid; }
+        /** A counter that is combined across all the blocks of a type */
+        struct AggregatedCounter {
+            uint32_t counterIndex;
+            int key;
+        };
 
-        /** @return The `index`th item in the list */
-        const Address & operator[](size_t index) const
-        {
-            assert(index < countersListValid);
+        /** The counters of a type of block that has more than one instance */
+        struct AggregatedBlock {
+            /** True to send the average across the blocks, false to send the sum */
+            bool average;
+            /** The index of the start of each (available) block in the sample buffer */
+            std::vector<uint32_t> blockBufferIndexes;
+            std::vector<AggregatedCounter> counters;
+        };
 
-            return countersList[index];
-        }
+        /** @return The number of enabled counters in the list */
+        size_t size() const;
 
     private:
-        size_t countersListLength;
-        size_t countersListValid;
-        Address * countersList;
+        std::vector<DirectCounter> directCounters {};
+        std::vector<AggregatedBlock> aggregatedBlocks {};
 
-        /* It can call enable */
+        /* It builds and reads the list */
         friend class MaliDevice;
-
-        /**
-             * Mark counter at particular address as enabled
-             */
-        void enable(MaliCounterBlockName nameBlock, uint32_t repeatCount, uint32_t groupIndex, uint32_t wordIndex);
     };
 
     /**
@@ -98,6 +88,9 @@ namespace mali_userspace {
      */
     class MaliDevice {
     public:
+        /** A bit for each counter of a block, for each counter name block */
+        using CounterEnableMasks = std::array<std::uint64_t, 4>;
+
         enum {
             /** The number of counters with a block */
             NUM_COUNTERS_PER_BLOCK = 64,
@@ -106,7 +99,9 @@ namespace mali_userspace {
             /** The number of counter enable groups with a block */
             NUM_ENABLE_GROUPS = NUM_COUNTERS_PER_BLOCK / NUM_COUNTERS_PER_ENABLE_GROUP,
             /** The counter index of the enable bits with a block */
-            BLOCK_ENABLE_BITS_COUNTER_INDEX = 2
+            BLOCK_ENABLE_BITS_COUNTER_INDEX = 2,
+            /** The number of counters at the start of each block that are its header, rather than counter values */
+            NUM_BLOCK_HEADER_COUNTERS = 4
         };
 
         /**
@@ -170,19 +165,43 @@ namespace mali_userspace {
         /**
          * Create the active counter list
          *
-         * @return The list of active counters
+         * @param hardwareVersion The layout of the sample buffers
+         * @return The list of active counters (which is empty if the layout is not supported)
+         */
+        MaliDeviceCounterList createCounterList(uint32_t hardwareVersion,
+                                                const IMaliDeviceCounterDumpCallback & callback) const;
+
+        /**
+         * Find the counters the user selected, so that a reader can be limited to them
+         *
+         * @return The selected counters of each counter name block (excluding the block enable bits)
+         */
+        CounterEnableMasks getEnabledCounterMasks(const IMaliDeviceCounterDumpCallback & callback) const;
+
+        /**
+         * Find where a block is in the sample buffers of the V5/V6 layout
+         *
+         * @param nameBlockIndex The counter name block of the block
+         * @param blockIndex The instance of the block
+         * @return The block's number, or nothing if the layout has no such block
+         */
+        std::optional<uint32_t> getV56BlockNumber(uint32_t nameBlockIndex, uint32_t blockIndex) const;
+
+        /**
+         * Dump all the counter data encoded in the provided sample buffer
+         *
+         * @param counterList The list created for the layout of the buffer
          */
-        MaliDeviceCounterList createCounterList(IMaliDeviceCounterDumpCallback & callback) const;
+        static void dumpAllCounters(const MaliDeviceCounterList & counterList,
+                                    const uint32_t * buffer,
+                                    size_t bufferLength,
+                                    IBlockCounterFrameBuilder & bufferData);
 
         /**
-         * Dump all the counter data encoded in the provided sample buffer, passing it to the callback object
+         * @return True if every counter value in the sample buffer is zero, meaning the GPU was idle for the sample
+         * period (the block headers are ignored)
          */
-        void dumpAllCounters(uint32_t hardwareVersion,
-                             const MaliDeviceCounterList & counterList,
-                             const uint32_t * buffer,
-                             size_t bufferLength,
-                             IBlockCounterFrameBuilder & bufferData,
-                             IMaliDeviceCounterDumpCallback & callback) const;
+        static bool isIdleSample(const uint32_t * buffer, size_t bufferLength);
 
         /**
          * Create an HWCNT reader handle (which is a file-descriptor, for use by MaliHwCntrReader)
@@ -198,17 +217,44 @@ namespace mali_userspace {
                                                std::uint32_t mmuL2Bitmask,
                                                bool & failedDueToBufferCount) const;
 
+        /**
+         * Enumerate the counters of the kinstr_prfcnt interface
+         *
+         * @return The enumeration items, or an empty list if the driver does not have the interface
+         */
+        std::vector<kinstr_prfcnt::prfcnt_enum_item> enumeratePrfcntInfo() const;
+
+        /**
+         * Create a kinstr_prfcnt reader handle (which is a file-descriptor, for use by MaliPrfcntReader)
+         *
+         * @param metadataItemSize [OUT] The size of each item of a sample's metadata list
+         * @param mmapSize [OUT] The size of the reader's sample memory
+         * @return The handle, or invalid handle if failed
+         */
+        lib::AutoClosingFd createPrfcntReaderFd(const std::vector<kinstr_prfcnt::prfcnt_request_item> & requests,
+                                                std::uint32_t & metadataItemSize,
+                                                std::uint32_t & mmapSize) const;
+
+        /** @return True if the device is simulated, so must be read with a MaliSimulatedHwCntrReader */
+        bool isSimulated() const { return deviceApi->isSimulated(); }
+
         static void insertConstants(std::set<Constant> & dest);
 
         std::map<CounterKey, int64_t> getConstantValues() const;
 
     private:
-        /** Init a block in the enable list */
-        static void initCounterList(uint32_t gpuId,
-                                    IMaliDeviceCounterDumpCallback & callback,
-                                    MaliDeviceCounterList & list,
-                                    MaliCounterBlockName block,
-                                    uint32_t repeatCount);
+        /** Add the enabled counters of a block that is read directly to the list */
+        void addDirectCounters(const IMaliDeviceCounterDumpCallback & callback,
+                               MaliDeviceCounterList & list,
+                               MaliCounterBlockName nameBlock,
+                               uint32_t blockNumber) const;
+
+        /** Add the enabled counters of a type of block that is aggregated to the list */
+        void addAggregatedCounters(const IMaliDeviceCounterDumpCallback & callback,
+                                   MaliDeviceCounterList & list,
+                                   MaliCounterBlockName nameBlock,
+                                   bool average,
+                                   std::vector<uint32_t> blockNumbers) const;
 
         /** Internal product version counter information */
         const MaliProductVersion & mProductVersion;
@@ -228,24 +274,6 @@ namespace mali_userspace {
         MaliDevice(const MaliProductVersion & productVersion,
                    std::unique_ptr<IMaliDeviceApi> deviceApi,
                    std::string clockPath);
-
-        /**
-         * Dump all the counter data on V4 layout
-         */
-        void dumpAllCounters_V4(const MaliDeviceCounterList & counterList,
-                                const uint32_t * buffer,
-                                size_t bufferLength,
-                                IBlockCounterFrameBuilder & bufferData,
-                                IMaliDeviceCounterDumpCallback & callback) const;
-
-        /**
-         * Dump all the counter data encoded in the provided sample buffer, passing it to the callback object
-         */
-        void dumpAllCounters_V56(const MaliDeviceCounterList & counterList,
-                                 const uint32_t * buffer,
-                                 size_t bufferLength,
-                                 IBlockCounterFrameBuilder & bufferData,
-                                 IMaliDeviceCounterDumpCallback & callback) const;
     };
 
     /**
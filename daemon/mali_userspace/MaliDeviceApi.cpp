@@ -1,4 +1,4 @@
-/* Copyright (C) 2019-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2019-2022 by Arm Limited. All rights reserved. */
 
 #include "mali_userspace/MaliDeviceApi.h"
 
@@ -11,8 +11,10 @@
 
 #include <cerrno>
 #include <cmath>
+#include <cstdint>
 #include <cstring>
 #include <utility>
+#include <vector>
 
 #include <fcntl.h>
 #include <sys/ioctl.h>
@@ -184,6 +186,20 @@ namespace mali_userspace {
                 return lib::AutoClosingFd {setup_args.fd};
             }
 
+            std::vector<kinstr_prfcnt::prfcnt_enum_item> enumeratePrfcntInfo() override
+            {
+                // these versions predate the kinstr_prfcnt interface
+                return {};
+            }
+
+            lib::AutoClosingFd createPrfcntReaderFd(
+                const std::vector<kinstr_prfcnt::prfcnt_request_item> & /*requests*/,
+                uint32_t & /*metadataItemSize*/,
+                uint32_t & /*mmapSize*/) override
+            {
+                return {};
+            }
+
             [[nodiscard]] uint64_t getShaderCoreAvailabilityMask() const override { return shaderCoreAvailabilityMask; }
 
             [[nodiscard]] uint32_t getMaxShaderCoreBlockIndex() const override
@@ -282,6 +298,10 @@ namespace mali_userspace {
             KBASE_IOCTL_SET_FLAGS = MALI_IOW(KBASE_IOCTL_TYPE, 1, struct kbase_ioctl_set_flags),
             KBASE_IOCTL_GET_GPUPROPS = MALI_IOW(KBASE_IOCTL_TYPE, 3, struct kbase_ioctl_get_gpuprops),
             KBASE_IOCTL_HWCNT_READER_SETUP = MALI_IOW(KBASE_IOCTL_TYPE, 8, struct kbase_ioctl_hwcnt_reader_setup),
+            KBASE_IOCTL_KINSTR_PRFCNT_ENUM_INFO =
+                MALI_IOWR(KBASE_IOCTL_TYPE, 56, struct kinstr_prfcnt::kbase_ioctl_kinstr_prfcnt_enum_info),
+            KBASE_IOCTL_KINSTR_PRFCNT_SETUP =
+                MALI_IOWR(KBASE_IOCTL_TYPE, 57, union kinstr_prfcnt::kbase_ioctl_kinstr_prfcnt_setup),
         };
 
         /** Read a u8 from the gpu properties blob */
@@ -483,6 +503,60 @@ namespace mali_userspace {
                 return lib::AutoClosingFd {hwcntReaderFd};
             }
 
+            std::vector<kinstr_prfcnt::prfcnt_enum_item> enumeratePrfcntInfo() override
+            {
+                kinstr_prfcnt::kbase_ioctl_kinstr_prfcnt_enum_info enum_info {};
+
+                // probe first for the number of items (which fails if the driver predates the interface)
+                if (lib::ioctl(*devFd, KBASE_IOCTL_KINSTR_PRFCNT_ENUM_INFO, reinterpret_cast<unsigned long>(&enum_info))
+                    != 0) {
+                    LOG_DEBUG("MaliDeviceApi: kinstr_prfcnt is not supported (%s)", strerror(errno));
+                    return {};
+                }
+
+                if ((enum_info.info_item_size != sizeof(kinstr_prfcnt::prfcnt_enum_item))
+                    || (enum_info.info_item_count == 0)) {
+                    LOG_DEBUG("MaliDeviceApi: Unexpected kinstr_prfcnt enumeration (%u items of %u bytes)",
+                              enum_info.info_item_count,
+                              enum_info.info_item_size);
+                    return {};
+                }
+
+                // now probe again for the items
+                std::vector<kinstr_prfcnt::prfcnt_enum_item> items(enum_info.info_item_count);
+                enum_info.info_list_ptr = reinterpret_cast<uintptr_t>(items.data());
+
+                if (lib::ioctl(*devFd, KBASE_IOCTL_KINSTR_PRFCNT_ENUM_INFO, reinterpret_cast<unsigned long>(&enum_info))
+                    != 0) {
+                    LOG_DEBUG("MaliDeviceApi: Failed enumerating kinstr_prfcnt counters (%s)", strerror(errno));
+                    return {};
+                }
+
+                return items;
+            }
+
+            lib::AutoClosingFd createPrfcntReaderFd(const std::vector<kinstr_prfcnt::prfcnt_request_item> & requests,
+                                                    uint32_t & metadataItemSize,
+                                                    uint32_t & mmapSize) override
+            {
+                kinstr_prfcnt::kbase_ioctl_kinstr_prfcnt_setup setup_args {};
+
+                setup_args.in.request_item_count = requests.size();
+                setup_args.in.request_item_size = sizeof(kinstr_prfcnt::prfcnt_request_item);
+                setup_args.in.requests_ptr = reinterpret_cast<uintptr_t>(requests.data());
+
+                const int prfcntReaderFd =
+                    lib::ioctl(*devFd, KBASE_IOCTL_KINSTR_PRFCNT_SETUP, reinterpret_cast<unsigned long>(&setup_args));
+                if (prfcntReaderFd < 0) {
+                    LOG_DEBUG("MaliDeviceApi: Failed sending kinstr_prfcnt setup ioctl (%s)", strerror(errno));
+                    return {};
+                }
+
+                metadataItemSize = setup_args.out.prfcnt_metadata_item_size;
+                mmapSize = setup_args.out.prfcnt_mmap_size_bytes;
+                return lib::AutoClosingFd {prfcntReaderFd};
+            }
+
             [[nodiscard]] uint64_t getShaderCoreAvailabilityMask() const override { return shaderCoreAvailabilityMask; }
 
             [[nodiscard]] uint32_t getMaxShaderCoreBlockIndex() const override
@@ -1,14 +1,16 @@
-/* Copyright (C) 2019-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2019-2022 by Arm Limited. All rights reserved. */
 
 #ifndef NATIVE_GATOR_DAEMON_MALI_USERSPACE_MALIDEVICEAPI_H_
 #define NATIVE_GATOR_DAEMON_MALI_USERSPACE_MALIDEVICEAPI_H_
 
 #include "lib/AutoClosingFd.h"
+#include "mali_userspace/MaliDeviceApi_DdkDefines.h"
 
 #include <cstddef>
 #include <cstdint>
 #include <memory>
 #include <string>
+#include <vector>
 
 namespace mali_userspace {
     /**
@@ -41,6 +43,27 @@ namespace mali_userspace {
                                                        std::uint32_t mmuL2Bitmask,
                                                        bool & failedDueToBufferCount) = 0;
 
+        /**
+         * Enumerate what the kinstr_prfcnt interface provides
+         *
+         * @return The enumeration items (terminated by one of FLEX_LIST_TYPE_NONE), or an empty list if the driver does
+         *          not have the interface
+         */
+        virtual std::vector<kinstr_prfcnt::prfcnt_enum_item> enumeratePrfcntInfo() = 0;
+
+        /**
+         * Create a kinstr_prfcnt reader handle (which is a file-descriptor, for use by MaliPrfcntReader)
+         *
+         * @param requests The requests (terminated by one of FLEX_LIST_TYPE_NONE)
+         * @param metadataItemSize [OUT] The size of each item of a sample's metadata list
+         * @param mmapSize [OUT] The size of the reader's sample memory
+         * @return The handle, or invalid handle if failed
+         */
+        virtual lib::AutoClosingFd createPrfcntReaderFd(
+            const std::vector<kinstr_prfcnt::prfcnt_request_item> & requests,
+            std::uint32_t & metadataItemSize,
+            std::uint32_t & mmapSize) = 0;
+
         /** @return The shader core sparse allocation mask */
         virtual std::uint64_t getShaderCoreAvailabilityMask() const = 0;
         /** @return The shader core sparse allocation mask */
@@ -55,6 +78,8 @@ namespace mali_userspace {
         virtual std::uint32_t getHwVersion() const = 0;
         /** @return The cache's external data bus size */
         virtual std::uint32_t getExternalBusWidth() const = 0;
+        /** @return True if there is no driver behind the device, as it is simulated (see MaliSimulatedHwCntrReader) */
+        virtual bool isSimulated() const { return false; }
     };
 }
 
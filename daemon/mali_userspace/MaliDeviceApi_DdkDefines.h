@@ -1,8 +1,9 @@
-/* Copyright (C) 2019-2020 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2019-2022 by Arm Limited. All rights reserved. */
 
 #ifndef NATIVE_GATOR_DAEMON_MALI_USERSPACE_MALIDEVICEAPI_DDKDEFINES_H_
 #define NATIVE_GATOR_DAEMON_MALI_USERSPACE_MALIDEVICEAPI_DDKDEFINES_H_
 
+#include <cstddef>
 #include <cstdint>
 
 namespace mali_userspace {
@@ -233,6 +234,233 @@ namespace mali_userspace {
             L2_NUM_L2_SLICES = 15
         };
     }
+
+    /**
+     * The kinstr_prfcnt counter interface, supported by the CSF DDKs (and the later JM DDKs) alongside the hwcnt reader
+     */
+    namespace kinstr_prfcnt {
+        /** The version of the enumeration, request and metadata items */
+        static constexpr uint16_t PRFCNT_READER_API_VERSION = 0;
+
+        /** The kinds of item list */
+        enum prfcnt_list_type : uint16_t {
+            PRFCNT_LIST_TYPE_ENUM = 0,
+            PRFCNT_LIST_TYPE_REQUEST = 1,
+            PRFCNT_LIST_TYPE_SAMPLE_META = 2,
+        };
+
+        /** Make the type of an item from its list type and subtype */
+        constexpr uint16_t flexListType(uint16_t type, uint16_t subtype)
+        {
+            return uint16_t(((type & 0xf) << 12) | (subtype & 0xfff));
+        }
+
+        enum : uint16_t {
+            /** The type of the item that terminates every list */
+            FLEX_LIST_TYPE_NONE = flexListType(0, 0),
+
+            PRFCNT_ENUM_TYPE_BLOCK = flexListType(PRFCNT_LIST_TYPE_ENUM, 0),
+            PRFCNT_ENUM_TYPE_REQUEST = flexListType(PRFCNT_LIST_TYPE_ENUM, 1),
+            PRFCNT_ENUM_TYPE_SAMPLE_INFO = flexListType(PRFCNT_LIST_TYPE_ENUM, 2),
+
+            PRFCNT_REQUEST_TYPE_MODE = flexListType(PRFCNT_LIST_TYPE_REQUEST, 0),
+            PRFCNT_REQUEST_TYPE_ENABLE = flexListType(PRFCNT_LIST_TYPE_REQUEST, 1),
+            PRFCNT_REQUEST_TYPE_SCOPE = flexListType(PRFCNT_LIST_TYPE_REQUEST, 2),
+
+            PRFCNT_SAMPLE_META_TYPE_SAMPLE = flexListType(PRFCNT_LIST_TYPE_SAMPLE_META, 0),
+            PRFCNT_SAMPLE_META_TYPE_CLOCK = flexListType(PRFCNT_LIST_TYPE_SAMPLE_META, 1),
+            PRFCNT_SAMPLE_META_TYPE_BLOCK = flexListType(PRFCNT_LIST_TYPE_SAMPLE_META, 2),
+        };
+
+        /** The types of counter block */
+        enum prfcnt_block_type : uint8_t {
+            PRFCNT_BLOCK_TYPE_FE = 0,
+            PRFCNT_BLOCK_TYPE_TILER = 1,
+            PRFCNT_BLOCK_TYPE_MEMORY = 2,
+            PRFCNT_BLOCK_TYPE_SHADER_CORE = 3,
+            PRFCNT_BLOCK_TYPE_RESERVED = 255,
+        };
+
+        /** The counter sets */
+        enum prfcnt_set : uint8_t {
+            PRFCNT_SET_PRIMARY = 0,
+            PRFCNT_SET_SECONDARY = 1,
+            PRFCNT_SET_TERTIARY = 2,
+            PRFCNT_SET_RESERVED = 255,
+        };
+
+        /** The sampling modes */
+        enum prfcnt_mode : uint8_t {
+            PRFCNT_MODE_MANUAL = 0,
+            PRFCNT_MODE_PERIODIC = 1,
+            PRFCNT_MODE_RESERVED = 255,
+        };
+
+        /** The commands of the reader */
+        enum prfcnt_control_cmd_code : uint16_t {
+            PRFCNT_CONTROL_CMD_START = 1,
+            PRFCNT_CONTROL_CMD_STOP = 2,
+            PRFCNT_CONTROL_CMD_SAMPLE_SYNC = 3,
+            PRFCNT_CONTROL_CMD_DISCARD = 5,
+        };
+
+        /** The sample metadata flags */
+        enum : uint32_t {
+            SAMPLE_FLAG_OVERFLOW = (1U << 0),
+            SAMPLE_FLAG_ERROR = (1U << 30),
+        };
+
+        /** The header of every item */
+        struct prfcnt_item_header {
+            uint16_t item_type;
+            uint16_t item_version;
+        };
+
+        /** Describes a type of counter block */
+        struct prfcnt_enum_block_counter {
+            uint8_t block_type;
+            uint8_t set;
+            uint8_t pad[2];
+            uint16_t num_instances;
+            uint16_t num_values;
+            uint64_t counter_mask[2];
+        };
+
+        /** Describes a type of request */
+        struct prfcnt_enum_request {
+            uint16_t request_item_type;
+            uint16_t pad;
+            uint32_t versions_mask;
+        };
+
+        /** Describes the samples */
+        struct prfcnt_enum_sample_info {
+            uint32_t num_clock_domains;
+            uint32_t pad;
+        };
+
+        /** An item of the enumeration list */
+        struct prfcnt_enum_item {
+            prfcnt_item_header hdr;
+            uint8_t padding[4];
+            union {
+                prfcnt_enum_block_counter block_counter;
+                prfcnt_enum_request request;
+                prfcnt_enum_sample_info sample_info;
+            } u;
+        };
+
+        /** Requests the sampling mode */
+        struct prfcnt_request_mode {
+            uint8_t mode;
+            uint8_t pad[7];
+            union {
+                struct {
+                    uint64_t period_ns;
+                } periodic;
+            } mode_config;
+        };
+
+        /** Requests the counters of a type of block */
+        struct prfcnt_request_enable {
+            uint8_t block_type;
+            uint8_t set;
+            uint8_t pad[6];
+            uint64_t enable_mask[2];
+        };
+
+        /** Requests the scope of the counters */
+        struct prfcnt_request_scope {
+            uint8_t scope;
+            uint8_t pad[7];
+        };
+
+        /** An item of the request list */
+        struct prfcnt_request_item {
+            prfcnt_item_header hdr;
+            uint8_t padding[4];
+            union {
+                prfcnt_request_mode req_mode;
+                prfcnt_request_enable req_enable;
+                prfcnt_request_scope req_scope;
+            } u;
+        };
+
+        /** The metadata of a whole sample */
+        struct prfcnt_sample_metadata {
+            uint64_t timestamp_start;
+            uint64_t timestamp_end;
+            uint64_t seq;
+            uint64_t user_data;
+            uint32_t flags;
+            uint32_t pad;
+        };
+
+        static constexpr std::size_t MAX_REPORTED_DOMAINS = 4;
+
+        /** The gpu cycles of each clock domain over a sample */
+        struct prfcnt_clock_metadata {
+            uint32_t num_domains;
+            uint32_t pad;
+            uint64_t cycles[MAX_REPORTED_DOMAINS];
+        };
+
+        /** The metadata of one block of a sample */
+        struct prfcnt_block_metadata {
+            uint8_t block_type;
+            uint8_t block_idx;
+            uint8_t set;
+            uint8_t pad_u8;
+            uint32_t block_state;
+            /** The offset of the block's (u64) values from the start of the mmapped region */
+            uint32_t values_offset;
+            uint32_t pad_u32;
+        };
+
+        /** An item of a sample's metadata list */
+        struct prfcnt_metadata {
+            prfcnt_item_header hdr;
+            uint8_t padding[4];
+            union {
+                prfcnt_sample_metadata sample_md;
+                prfcnt_clock_metadata clock_md;
+                prfcnt_block_metadata block_md;
+            } u;
+        };
+
+        /** IOCTL parameters to control the reader */
+        struct prfcnt_control_cmd {
+            uint16_t cmd;
+            uint16_t pad[3];
+            uint64_t user_data;
+        };
+
+        /** IOCTL parameters to get and put a sample */
+        struct prfcnt_sample_access {
+            uint64_t sequence;
+            uint64_t sample_offset_bytes;
+        };
+
+        /** IOCTL parameters to enumerate the counters */
+        struct kbase_ioctl_kinstr_prfcnt_enum_info {
+            uint32_t info_item_size;
+            uint32_t info_item_count;
+            uint64_t info_list_ptr;
+        };
+
+        /** IOCTL parameters to create a reader */
+        union kbase_ioctl_kinstr_prfcnt_setup {
+            struct {
+                uint32_t request_item_count;
+                uint32_t request_item_size;
+                uint64_t requests_ptr;
+            } in;
+            struct {
+                uint32_t prfcnt_metadata_item_size;
+                uint32_t prfcnt_mmap_size_bytes;
+            } out;
+        };
+    }
 }
 
 #endif /* NATIVE_GATOR_DAEMON_MALI_USERSPACE_MALIDEVICEAPI_DDKDEFINES_H_ */
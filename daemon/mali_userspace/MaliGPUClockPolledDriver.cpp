@@ -39,13 +39,12 @@ namespace mali_userspace {
         return count;
     }
 
-    void MaliGPUClockPolledDriver::read(IBlockCounterFrameBuilder & buffer)
+    void MaliGPUClockPolledDriver::sample()
     {
         if (!doRead()) {
             LOG_ERROR("Unable to read GPU clock frequency for %s", mClockPath.c_str());
             handleException();
         }
-        PolledDriver::read(buffer);
     }
 
     bool MaliGPUClockPolledDriver::doRead()
@@ -54,7 +53,7 @@ namespace mali_userspace {
             return true;
         }
 
-        if (!mBuf.read(mClockPath.c_str())) {
+        if (!mBuf.reread(mClockPath.c_str())) {
             return false;
         }
 
@@ -34,9 +34,11 @@ namespace mali_userspace {
         int writeCounters(mxml_node_t * root) const override;
 
         void start() override {}
-        void read(IBlockCounterFrameBuilder & buffer) override;
+        void sample() override;
         void writeEvents(mxml_node_t * root) const override;
 
+        [[nodiscard]] std::chrono::nanoseconds getPollPeriod() const override { return getHighRatePollPeriod(); }
+
     private:
         static constexpr std::string_view ARM_MALI_CLOCK = "ARM_Mali-clock-";
 
@@ -1,4 +1,4 @@
-/* Copyright (C) 2013-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2013-2022 by Arm Limited. All rights reserved. */
 
 #ifndef NATIVE_GATOR_DAEMON_MIDGARDHWCOUNTERDRIVER_H_
 #define NATIVE_GATOR_DAEMON_MIDGARDHWCOUNTERDRIVER_H_
@@ -7,6 +7,7 @@
 #include "SessionData.h"
 #include "SimpleDriver.h"
 #include "mali_userspace/MaliHwCntrReader.h"
+#include "mali_userspace/MaliMemoryPolledDriver.h"
 
 #include <map>
 #include <memory>
@@ -41,6 +42,9 @@ namespace mali_userspace {
 
         inline const std::map<unsigned, std::unique_ptr<MaliDevice>> & getDevices() const { return mDevices; }
 
+        /** @return The polling driver for the GPU memory of every kbase device, which does not need hwcnt access */
+        inline MaliMemoryPolledDriver & getMemoryDriver() { return mMemoryDriver; }
+
         void insertConstants(std::set<Constant> & dest) override;
         int getCounterKey(uint32_t nameBlockIndex, uint32_t counterIndex, uint32_t gpuId) const;
 
@@ -56,6 +60,7 @@ namespace mali_userspace {
         std::map<unsigned, std::unique_ptr<int[]>> mEnabledCounterKeysByGpuId {};
         /** Map of the GPU device number and Polling driver for GPU clock etc. */
         std::map<unsigned, std::unique_ptr<PolledDriver>> mPolledDrivers {};
+        MaliMemoryPolledDriver mMemoryDriver {};
         //Map between the device number and the mali devices .
         std::map<unsigned, std::unique_ptr<MaliDevice>> mDevices;
     };
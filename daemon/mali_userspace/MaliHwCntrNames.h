@@ -15,7 +15,7 @@ namespace mali_userspace {
      * where no counter exists.
      */
 
-    static const char * const hardware_counters_mali_t60x[] = {
+    static constexpr const char * const hardware_counters_mali_t60x[] = {
         /* Job Manager */
         "",
         "",
@@ -280,7 +280,7 @@ namespace mali_userspace {
         "T60x_L2_SNOOP_FULL",
         "T60x_L2_REPLAY_FULL"};
 
-    static const char * const hardware_counters_mali_t62x[] = {
+    static constexpr const char * const hardware_counters_mali_t62x[] = {
         /* Job Manager */
         "",
         "",
@@ -545,7 +545,7 @@ namespace mali_userspace {
         "T62x_L2_SNOOP_FULL",
         "T62x_L2_REPLAY_FULL"};
 
-    static const char * const hardware_counters_mali_t72x[] = {
+    static constexpr const char * const hardware_counters_mali_t72x[] = {
         /* Job Manager */
         "",
         "",
@@ -810,7 +810,7 @@ namespace mali_userspace {
         "",
         ""};
 
-    static const char * const hardware_counters_mali_t76x[] = {
+    static constexpr const char * const hardware_counters_mali_t76x[] = {
         /* Job Manager */
         "",
         "",
@@ -1075,7 +1075,7 @@ namespace mali_userspace {
         "T76x_L2_SNOOP_FULL",
         "T76x_L2_REPLAY_FULL"};
 
-    static const char * const hardware_counters_mali_t82x[] = {
+    static constexpr const char * const hardware_counters_mali_t82x[] = {
         /* Job Manager */
         "",
         "",
@@ -1340,7 +1340,7 @@ namespace mali_userspace {
         "T82x_L2_SNOOP_FULL",
         "T82x_L2_REPLAY_FULL"};
 
-    static const char * const hardware_counters_mali_t83x[] = {
+    static constexpr const char * const hardware_counters_mali_t83x[] = {
         /* Job Manager */
         "",
         "",
@@ -1605,7 +1605,7 @@ namespace mali_userspace {
         "T83x_L2_SNOOP_FULL",
         "T83x_L2_REPLAY_FULL"};
 
-    static const char * const hardware_counters_mali_t86x[] = {
+    static constexpr const char * const hardware_counters_mali_t86x[] = {
         /* Job Manager */
         "",
         "",
@@ -1870,7 +1870,7 @@ namespace mali_userspace {
         "T86x_L2_SNOOP_FULL",
         "T86x_L2_REPLAY_FULL"};
 
-    static const char * const hardware_counters_mali_t88x[] = {
+    static constexpr const char * const hardware_counters_mali_t88x[] = {
         /* Job Manager */
         "",
         "",
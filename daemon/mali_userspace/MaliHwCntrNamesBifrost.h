@@ -8,7 +8,7 @@
 namespace mali_userspace {
 
     /* Mali-G31 */
-    static const char * const hardware_counters_mali_tDVx[] = {
+    static constexpr const char * const hardware_counters_mali_tDVx[] = {
         /* Job Manager */
         "",
         "",
@@ -275,7 +275,7 @@ namespace mali_userspace {
     };
 
     /* Mali-G51 */
-    static const char * const hardware_counters_mali_tSIx[] = {
+    static constexpr const char * const hardware_counters_mali_tSIx[] = {
         /* Job Manager */
         "",
         "",
@@ -542,7 +542,7 @@ namespace mali_userspace {
     };
 
     /* Mali-G52 */
-    static const char * const hardware_counters_mali_tGOx[] = {
+    static constexpr const char * const hardware_counters_mali_tGOx[] = {
         /* Job Manager */
         "",
         "",
@@ -809,7 +809,7 @@ namespace mali_userspace {
     };
 
     /* Mali-G71 */
-    static const char * const hardware_counters_mali_tMIx[] = {
+    static constexpr const char * const hardware_counters_mali_tMIx[] = {
         /* Job Manager */
         "",
         "",
@@ -1076,7 +1076,7 @@ namespace mali_userspace {
     };
 
     /* Mali-G72 */
-    static const char * const hardware_counters_mali_tHEx[] = {
+    static constexpr const char * const hardware_counters_mali_tHEx[] = {
         /* Job Manager */
         "",
         "",
@@ -1343,7 +1343,7 @@ namespace mali_userspace {
     };
 
     /* Mali-G76 */
-    static const char * const hardware_counters_mali_tNOx[] = {
+    static constexpr const char * const hardware_counters_mali_tNOx[] = {
         /* Job Manager */
         "",
         "",
@@ -1610,7 +1610,7 @@ namespace mali_userspace {
     };
 
     /* Mali-G57 */
-    static const char * const hardware_counters_mali_tNAx[] = {
+    static constexpr const char * const hardware_counters_mali_tNAx[] = {
         /* Job Manager */
         "",
         "",
@@ -1877,7 +1877,7 @@ namespace mali_userspace {
     };
 
     /* Mali-G68 */
-    static const char * const hardware_counters_mali_tOTx[] = {
+    static constexpr const char * const hardware_counters_mali_tOTx[] = {
         /* Job Manager */
         "",
         "",
@@ -2144,7 +2144,7 @@ namespace mali_userspace {
     };
 
     /* Mali-G77 */
-    static const char * const hardware_counters_mali_tTRx[] = {
+    static constexpr const char * const hardware_counters_mali_tTRx[] = {
         /* Job Manager */
         "",
         "",
@@ -2411,7 +2411,7 @@ namespace mali_userspace {
     };
 
     /* Mali-G78 */
-    static const char * const hardware_counters_mali_tBOx[] = {
+    static constexpr const char * const hardware_counters_mali_tBOx[] = {
         /* Job Manager */
         "",
         "",
@@ -2678,7 +2678,7 @@ namespace mali_userspace {
     };
 
     /* Mali-G310 */
-    static const char * const hardware_counters_mali_tVAx[] = {
+    static constexpr const char * const hardware_counters_mali_tVAx[] = {
         /* CSF */
         "",
         "",
@@ -2945,7 +2945,7 @@ namespace mali_userspace {
     };
 
     /* Mali-G510 */
-    static const char * const hardware_counters_mali_tGRx[] = {
+    static constexpr const char * const hardware_counters_mali_tGRx[] = {
         /* CSF */
         "",
         "",
@@ -3212,7 +3212,7 @@ namespace mali_userspace {
     };
 
     /* Mali-G610 */
-    static const char * const hardware_counters_mali_tVIx[] = {
+    static constexpr const char * const hardware_counters_mali_tVIx[] = {
         /* CSF */
         "",
         "",
@@ -3479,7 +3479,7 @@ namespace mali_userspace {
     };
 
     /* Mali-G710 */
-    static const char * const hardware_counters_mali_tODx[] = {
+    static constexpr const char * const hardware_counters_mali_tODx[] = {
         /* CSF */
         "",
         "",
@@ -1,4 +1,4 @@
-/* Copyright (C) 2016-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2016-2022 by Arm Limited. All rights reserved. */
 
 #include "mali_userspace/MaliHwCntrReader.h"
 
@@ -96,6 +96,8 @@ namespace mali_userspace {
 
     IMaliHwCntrReader::HardwareVersion MaliHwCntrReader::getHardwareVersion() const { return hardwareVersion; }
 
+    std::size_t MaliHwCntrReader::getBufferCount() const { return bufferCount; }
+
     bool MaliHwCntrReader::triggerCounterRead() { return lib::ioctl(*hwcntReaderFd, KBASE_HWCNT_READER_DUMP, 0) == 0; }
 
     bool MaliHwCntrReader::startPeriodicSampling(uint32_t interval)
@@ -1,4 +1,4 @@
-/* Copyright (C) 2016-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2016-2022 by Arm Limited. All rights reserved. */
 
 #ifndef NATIVE_GATOR_DAEMON_MALI_USERSPACE_MALIHWCNTRREADER_H_
 #define NATIVE_GATOR_DAEMON_MALI_USERSPACE_MALIHWCNTRREADER_H_
@@ -27,8 +27,10 @@ namespace mali_userspace {
 
         const MaliDevice & getDevice() const override;
         HardwareVersion getHardwareVersion() const override;
+        std::size_t getBufferCount() const override;
         SampleBuffer waitForBuffer(int timeout) override;
         bool startPeriodicSampling(uint32_t interval) override;
+        void interrupt() override;
 
         /**
          * Get the size of hardware counters sample buffer.
@@ -62,10 +64,6 @@ namespace mali_userspace {
          */
         bool configureJobBasedSampled(bool preJob, bool postJob);
 
-        /**
-         * Interrupt a call to {@link #waitForBuffer(SampleBuffer &, int)} from another thread
-         */
-        void interrupt();
         /**
          * Create a new instance of the MaliHwCntrReader object associated with the device object
          *
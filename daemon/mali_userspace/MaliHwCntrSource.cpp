@@ -1,4 +1,4 @@
-/* Copyright (C) 2010-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2010-2022 by Arm Limited. All rights reserved. */
 
 #define __STDC_FORMAT_MACROS
 #define BUFFER_USE_SESSION_DATA
@@ -10,6 +10,7 @@
 #include "Child.h"
 #include "Logging.h"
 #include "MaliHwCntrTask.h"
+#include "MemoryBudget.h"
 #include "PrimarySourceProvider.h"
 #include "Protocol.h"
 #include "SessionData.h"
@@ -19,6 +20,8 @@
 #include "mali_userspace/MaliDevice.h"
 #include "mali_userspace/MaliHwCntrDriver.h"
 #include "mali_userspace/MaliHwCntrReader.h"
+#include "mali_userspace/MaliPrfcntReader.h"
+#include "mali_userspace/MaliSimulatedHwCntrReader.h"
 
 #include <algorithm>
 #include <cinttypes>
@@ -44,7 +47,17 @@ namespace mali_userspace {
                 const int32_t deviceNumber = pair.first;
                 const MaliDevice & device = *pair.second;
 
-                std::unique_ptr<MaliHwCntrReader> reader = MaliHwCntrReader::createReader(device);
+                std::unique_ptr<IMaliHwCntrReader> reader;
+                if (device.isSimulated()) {
+                    reader = MaliSimulatedHwCntrReader::createReader(device);
+                }
+                else {
+                    // prefer kinstr_prfcnt, which is limited to the selected counters, over the hwcnt reader
+                    reader = MaliPrfcntReader::createReader(device, device.getEnabledCounterMasks(*this));
+                }
+                if ((!reader) && (!device.isSimulated())) {
+                    reader = MaliHwCntrReader::createReader(device);
+                }
                 if (!reader) {
                     LOG_ERROR(
                         "Failed to create reader for mali GPU # %d. Please try again, and if this happens repeatedly "
@@ -53,13 +66,23 @@ namespace mali_userspace {
                     handleException();
                 }
                 else {
-                    MaliHwCntrReader & readerRef = *reader;
+                    IMaliHwCntrReader & readerRef = *reader;
                     mReaders[deviceNumber] = std::move(reader);
-                    std::unique_ptr<Buffer> taskBuffer(
-                        new Buffer(gSessionData.mTotalBufferSize * 1024 * 1024, mSenderSem));
+                    const auto bufferSize = gMemoryBudget.allocate(
+                        "Mali GPU counters",
+                        1,
+                        std::size_t(gSessionData.mTotalBufferSize) * 1024 * 1024);
+                    std::unique_ptr<Buffer> taskBuffer(new Buffer(static_cast<int>(bufferSize), mSenderSem));
 
                     std::unique_ptr<BlockCounterFrameBuilder> frameBuilder(
-                        new BlockCounterFrameBuilder(*taskBuffer, gSessionData.mLiveRate));
+                        new BlockCounterFrameBuilder(*taskBuffer,
+                                                     gSessionData.mLiveRate,
+                                                     (gSessionData.mDeltaBlockCounters
+                                                          ? std::make_shared<BlockCounterDeltaState>()
+                                                          : nullptr),
+                                                     (gSessionData.mCounterRollups
+                                                          ? std::make_shared<BlockCounterRollupState>()
+                                                          : nullptr)));
                     std::unique_ptr<MaliHwCntrTask> task(new MaliHwCntrTask(std::move(taskBuffer),
                                                                             std::move(frameBuilder),
                                                                             deviceNumber,
@@ -73,17 +96,17 @@ namespace mali_userspace {
 
         bool prepare() { return mDriver.start(); }
 
-        void run(std::uint64_t monotonicStarted, std::function<void()> endSession) override
+        // one-shot captures are ended by gOneShotBudget, rather than when a task's buffer is full
+        void run(std::uint64_t monotonicStarted, std::function<void()> /*endSession*/) override
         {
             prctl(PR_SET_NAME, reinterpret_cast<unsigned long>(&"gatord-malihwc"), 0, 0, 0);
             std::vector<std::thread> threadsCreated;
             const int sampleRate = gSessionData.mSampleRate;
-            const bool isOneShot = gSessionData.mOneShot;
             for (auto const & task : tasks) {
                 MaliHwCntrTask * const taskPtr = task.get();
                 threadsCreated.emplace_back([=]() -> void {
                     prctl(PR_SET_NAME, reinterpret_cast<unsigned long>(&"gatord-malihtsk"), 0, 0, 0);
-                    taskPtr->execute(sampleRate, isOneShot, monotonicStarted, endSession);
+                    taskPtr->execute(sampleRate, monotonicStarted);
                 });
             }
             std::for_each(threadsCreated.begin(), threadsCreated.end(), std::mem_fn(&std::thread::join));
@@ -106,29 +129,14 @@ namespace mali_userspace {
             return done;
         }
 
-        void nextCounterValue(uint32_t nameBlockIndex,
-                              uint32_t counterIndex,
-                              uint64_t delta,
-                              uint32_t gpuId,
-                              IBlockCounterFrameBuilder & buffer) override
-        {
-            const int key = mDriver.getCounterKey(nameBlockIndex, counterIndex, gpuId);
-            if (key != 0) {
-                buffer.event64(key, delta);
-            }
-        }
-
-        [[nodiscard]] bool isCounterActive(uint32_t nameBlockIndex,
-                                           uint32_t counterIndex,
-                                           uint32_t gpuId) const override
+        [[nodiscard]] int getCounterKey(uint32_t nameBlockIndex, uint32_t counterIndex, uint32_t gpuId) const override
         {
-            const int key = mDriver.getCounterKey(nameBlockIndex, counterIndex, gpuId);
-            return (key != 0);
+            return mDriver.getCounterKey(nameBlockIndex, counterIndex, gpuId);
         }
 
     private:
         MaliHwCntrDriver & mDriver;
-        std::map<unsigned, std::unique_ptr<MaliHwCntrReader>> mReaders {};
+        std::map<unsigned, std::unique_ptr<IMaliHwCntrReader>> mReaders {};
         std::vector<std::unique_ptr<MaliHwCntrTask>> tasks {};
     };
 
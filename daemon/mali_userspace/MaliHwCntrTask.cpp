@@ -1,4 +1,4 @@
-/* Copyright (C) 2019-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2019-2022 by Arm Limited. All rights reserved. */
 
 #include "MaliHwCntrTask.h"
 
@@ -8,8 +8,11 @@
 #include "SessionData.h"
 #include "lib/Syscall.h"
 
+#include <optional>
+#include <thread>
 #include <utility>
 
+#include <sys/prctl.h>
 #include <unistd.h>
 
 namespace mali_userspace {
@@ -28,10 +31,7 @@ namespace mali_userspace {
     {
     }
 
-    void MaliHwCntrTask::execute(int sampleRate,
-                                 bool isOneShot,
-                                 std::uint64_t monotonicStarted,
-                                 const std::function<void()> & endSession)
+    void MaliHwCntrTask::execute(int sampleRate, std::uint64_t monotonicStarted)
     {
         bool terminated = false;
         // set sample interval, if sample rate == 0, then sample at 100Hz as currently the job dumping based sampling does not work... (driver issue?)
@@ -54,24 +54,23 @@ namespace mali_userspace {
         }
 
         // create the list of enabled counters
-        const MaliDeviceCounterList countersList(mReader.getDevice().createCounterList(mCallback));
+        const MaliDeviceCounterList countersList(
+            mReader.getDevice().createCounterList(mReader.getHardwareVersion(), mCallback));
+
+        // the kernel buffers must be returned in order, so either all of them are decoded in place or none are
+        const bool zeroCopy = (mReader.getBufferCount() >= ZERO_COPY_MIN_BUFFER_COUNT);
+        std::thread decoder {[this, &countersList, monotonicStarted]() {
+            prctl(PR_SET_NAME, reinterpret_cast<unsigned long>(&"gatord-malidec"), 0, 0, 0);
+            decodeSamples(countersList, monotonicStarted);
+        }};
+
         while (!terminated) {
             SampleBuffer waitStatus = mReader.waitForBuffer(10000);
 
             switch (waitStatus.status) {
                 case WAIT_STATUS_SUCCESS: {
                     if (waitStatus.data) {
-                        const uint64_t sampleTime = waitStatus.timestamp - monotonicStarted;
-                        if (mFrameBuilder->eventHeader(sampleTime) && mFrameBuilder->eventCore(deviceNumber)) {
-                            mReader.getDevice().dumpAllCounters(
-                                mReader.getHardwareVersion(),
-                                countersList,
-                                reinterpret_cast<const uint32_t *>(waitStatus.data.get()),
-                                waitStatus.size / sizeof(uint32_t),
-                                *mFrameBuilder,
-                                mCallback);
-                            mFrameBuilder->check(sampleTime);
-                        }
+                        queueSample(std::move(waitStatus), zeroCopy);
                     }
                     break;
                 }
@@ -86,20 +85,131 @@ namespace mali_userspace {
                     break;
                 }
             }
-            if (isOneShot && (mBuffer->isFull())) {
-                LOG_DEBUG("One shot (malihwc)");
-                endSession();
-            }
         }
 
         if (!mReader.startPeriodicSampling(0)) {
             LOG_ERROR("Could not disable periodic sampling");
         }
 
+        {
+            const std::lock_guard<std::mutex> lock {mQueueMutex};
+            mReadFinished = true;
+        }
+        mQueueCondition.notify_one();
+        decoder.join();
+
+        if (mDroppedSamples > 0) {
+            LOG_WARNING("Dropped %zu HW counter samples for device %d as they could not be decoded quickly enough",
+                        mDroppedSamples,
+                        deviceNumber);
+        }
+
         mFrameBuilder->flush();
         mBuffer->setDone();
     }
 
+    void MaliHwCntrTask::queueSample(SampleBuffer && sample, bool zeroCopy)
+    {
+        QueuedSample queued {};
+
+        if (zeroCopy) {
+            queued.kernelBuffer = std::move(sample);
+        }
+        else {
+            {
+                const std::lock_guard<std::mutex> lock {mQueueMutex};
+                if (mQueue.size() >= MAX_QUEUED_SAMPLES) {
+                    mDroppedSamples += 1;
+                    return;
+                }
+                if (!mFreeCopies.empty()) {
+                    queued.copy = std::move(mFreeCopies.back());
+                    mFreeCopies.pop_back();
+                }
+            }
+
+            const auto * const data = reinterpret_cast<const uint32_t *>(sample.data.get());
+            queued.copy.assign(data, data + (sample.size / sizeof(uint32_t)));
+            queued.kernelBuffer.timestamp = sample.timestamp;
+            // returns the kernel buffer
+            sample.data.reset();
+        }
+
+        {
+            const std::lock_guard<std::mutex> lock {mQueueMutex};
+            mQueue.push_back(std::move(queued));
+        }
+        mQueueCondition.notify_one();
+    }
+
+    void MaliHwCntrTask::decodeSamples(const MaliDeviceCounterList & countersList, std::uint64_t monotonicStarted)
+    {
+        // a copy of the first sample of the current idle run, which is written again as its last sample
+        std::vector<uint32_t> idleSample {};
+        std::optional<uint64_t> lastSkippedIdleTime {};
+        bool inIdleRun = false;
+        std::size_t skippedIdleSamples = 0;
+
+        std::unique_lock<std::mutex> lock {mQueueMutex};
+        for (;;) {
+            mQueueCondition.wait(lock, [this]() { return mReadFinished || !mQueue.empty(); });
+            if (mQueue.empty()) {
+                lock.unlock();
+                if (lastSkippedIdleTime) {
+                    writeSample(countersList, idleSample.data(), idleSample.size(), *lastSkippedIdleTime);
+                }
+                LOG_DEBUG("Skipped %zu idle HW counter samples for device %d", skippedIdleSamples, deviceNumber);
+                return;
+            }
+
+            QueuedSample sample = std::move(mQueue.front());
+            mQueue.pop_front();
+            lock.unlock();
+
+            const bool isCopy = !sample.kernelBuffer.data;
+            const uint32_t * const data =
+                (isCopy ? sample.copy.data() : reinterpret_cast<const uint32_t *>(sample.kernelBuffer.data.get()));
+            const size_t length = (isCopy ? sample.copy.size() : sample.kernelBuffer.size / sizeof(uint32_t));
+
+            const uint64_t sampleTime = sample.kernelBuffer.timestamp - monotonicStarted;
+            const bool idle = MaliDevice::isIdleSample(data, length);
+            if (idle && inIdleRun) {
+                lastSkippedIdleTime = sampleTime;
+                skippedIdleSamples += 1;
+            }
+            else {
+                if (lastSkippedIdleTime) {
+                    writeSample(countersList, idleSample.data(), idleSample.size(), *lastSkippedIdleTime);
+                    lastSkippedIdleTime.reset();
+                }
+                if (idle) {
+                    idleSample.assign(data, data + length);
+                }
+                writeSample(countersList, data, length, sampleTime);
+                inIdleRun = idle;
+            }
+
+            // returns the kernel buffer, if decoding in place
+            sample.kernelBuffer.data.reset();
+
+            lock.lock();
+            if (isCopy) {
+                mFreeCopies.push_back(std::move(sample.copy));
+            }
+        }
+    }
+
+    void MaliHwCntrTask::writeSample(const MaliDeviceCounterList & countersList,
+                                     const uint32_t * data,
+                                     size_t length,
+                                     uint64_t sampleTime)
+    {
+        if (mFrameBuilder->eventHeader(sampleTime) && mFrameBuilder->eventCore(deviceNumber)) {
+            MaliDevice::dumpAllCounters(countersList, data, length, *mFrameBuilder);
+            mFrameBuilder->check(sampleTime);
+        }
+    }
+
     bool MaliHwCntrTask::write(ISender & sender) { return mBuffer->write(sender); }
 
     bool MaliHwCntrTask::writeConstants()
@@ -1,4 +1,4 @@
-/* Copyright (C) 2019-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2019-2022 by Arm Limited. All rights reserved. */
 
 #ifndef MALI_USERSPACE_MALIHWCNTRTASK_H_
 #define MALI_USERSPACE_MALIHWCNTRTASK_H_
@@ -7,7 +7,13 @@
 #include "IMaliHwCntrReader.h"
 #include "MaliDevice.h"
 
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
 #include <functional>
+#include <mutex>
+#include <vector>
 
 class IBufferControl;
 class IBlockCounterFrameBuilder;
@@ -15,6 +21,13 @@ class ISender;
 
 namespace mali_userspace {
 
+    /**
+     * Reads the samples of one device.
+     *
+     * The samples are decoded into the frame builder by a separate thread so that the reading thread can return each
+     * kernel buffer as soon as it is available, rather than after it is decoded, making it less likely that the kernel
+     * runs out of buffers at high sample rates.
+     */
     class MaliHwCntrTask {
     public:
         /**
@@ -33,21 +46,59 @@ namespace mali_userspace {
         MaliHwCntrTask(MaliHwCntrTask &&) = delete;
         MaliHwCntrTask & operator=(MaliHwCntrTask &&) = delete;
 
-        void execute(int sampleRate,
-                     bool isOneShot,
-                     std::uint64_t monotonicStart,
-                     const std::function<void()> & endSession);
+        void execute(int sampleRate, std::uint64_t monotonicStart);
         bool write(ISender & sender);
 
     private:
+        /**
+         * The minimum number of kernel buffers for the samples to be decoded in place. With fewer, each sample is copied
+         * so that its kernel buffer can be returned immediately.
+         */
+        static constexpr std::size_t ZERO_COPY_MIN_BUFFER_COUNT = 4;
+        /** The maximum number of copied samples waiting to be decoded, after which samples are dropped */
+        static constexpr std::size_t MAX_QUEUED_SAMPLES = 256;
+
+        /** A sample that has been read but not yet decoded */
+        struct QueuedSample {
+            /** The kernel buffer, if decoding in place */
+            SampleBuffer kernelBuffer;
+            /** The copy of the sample, otherwise */
+            std::vector<uint32_t> copy;
+        };
+
         std::unique_ptr<IBufferControl> mBuffer;
         std::unique_ptr<IBlockCounterFrameBuilder> mFrameBuilder;
         IMaliDeviceCounterDumpCallback & mCallback;
         IMaliHwCntrReader & mReader;
         std::int32_t deviceNumber;
         const std::map<CounterKey, int64_t> mConstantValues;
+        std::mutex mQueueMutex {};
+        std::condition_variable mQueueCondition {};
+        std::deque<QueuedSample> mQueue {};
+        /** Decoded copies, kept to be reused */
+        std::vector<std::vector<uint32_t>> mFreeCopies {};
+        std::size_t mDroppedSamples {0};
+        bool mReadFinished {false};
 
         bool writeConstants();
+
+        /** Pass a sample to the decoding thread */
+        void queueSample(SampleBuffer && sample, bool zeroCopy);
+
+        /**
+         * Decode the queued samples until reading has finished and the queue is empty.
+         *
+         * Of each run of idle samples, only the first and the last are written. As the counters are deltas, the host
+         * shows those the same as the whole run: the first shows the counters dropping to zero, and the last ends the
+         * idle period so that the next active sample's values are not spread over it.
+         */
+        void decodeSamples(const MaliDeviceCounterList & countersList, std::uint64_t monotonicStarted);
+
+        /** Write one sample into the frame builder */
+        void writeSample(const MaliDeviceCounterList & countersList,
+                         const uint32_t * data,
+                         size_t length,
+                         uint64_t sampleTime);
     };
 }
 
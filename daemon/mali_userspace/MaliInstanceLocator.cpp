@@ -7,6 +7,7 @@
 #include "lib/FsEntry.h"
 #include "lib/String.h"
 #include "mali_userspace/MaliDeviceApi.h"
+#include "mali_userspace/MaliSimulatedHwCntrReader.h"
 
 #include <cstddef>
 #include <cstdio>
@@ -79,6 +80,19 @@ namespace mali_userspace {
         std::map<unsigned int, std::string> gpuClockPaths;
         std::map<unsigned int, std::unique_ptr<MaliDevice>> coreDriverMap;
 
+        // a simulated device replaces any real ones
+        const auto simulatedConfig = MaliSimulatedDeviceConfig::fromEnvironment();
+        if (simulatedConfig) {
+            std::unique_ptr<MaliDevice> device = MaliDevice::create(createSimulatedMaliDeviceApi(*simulatedConfig), {});
+            if (device) {
+                coreDriverMap[0] = std::move(device);
+            }
+            else {
+                LOG_ERROR("The simulated Mali GPU id 0x%x is not recognized", simulatedConfig->gpuId);
+            }
+            return coreDriverMap;
+        }
+
         // first scan for '/dev/mali#' files
         for (unsigned int i = 0; i < MAX_DEV_MALI_TOO_SCAN_FOR; ++i) {
             // construct the path
@@ -0,0 +1,290 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "mali_userspace/MaliMemoryPolledDriver.h"
+
+#include "DriverCounter.h"
+#include "Logging.h"
+#include "MaliGPUClockPolledDriverCounter.h"
+#include "linux/proc/ProcFieldParser.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <string_view>
+#include <utility>
+
+#include <dirent.h>
+#include <unistd.h>
+
+namespace mali_userspace {
+    namespace {
+        constexpr char DEBUGFS_PATH[] = "/sys/kernel/debug";
+        constexpr char GPU_MEMORY_FILE[] = "gpu_memory";
+        constexpr char CONTEXTS_DIR[] = "ctx";
+        constexpr char MEM_PROFILE_FILE[] = "mem_profile";
+        /** Follows the size of each heap in a mem_profile, as "Channel: <heap> (Total memory: <bytes>)" */
+        constexpr std::string_view TOTAL_MEMORY {"Total memory:"};
+
+        /** @return The device number of a kbase debugfs directory, such as "mali0", or -1 if it is not one */
+        int parseDeviceNumber(std::string_view name)
+        {
+            constexpr std::string_view PREFIX {"mali"};
+
+            if ((name.size() <= PREFIX.size()) || (name.substr(0, PREFIX.size()) != PREFIX)) {
+                return -1;
+            }
+            unsigned number = 0;
+            if (!lnx::ProcFieldParser {name.substr(PREFIX.size())}.next(number)) {
+                return -1;
+            }
+            return static_cast<int>(number);
+        }
+    }
+
+    void MaliMemoryPolledDriver::readEvents(mxml_node_t * const /*unused*/)
+    {
+        const lib::DirectoryFd debugfs = lib::DirectoryFd::open(DEBUGFS_PATH);
+
+        std::vector<std::pair<unsigned, std::string>> devices;
+        if (debugfs) {
+            debugfs.forEachChild([&](const lib::DirectoryFd::Entry & entry) {
+                const int number = parseDeviceNumber(entry.name);
+                if ((entry.type == DT_DIR) && (number >= 0)) {
+                    devices.emplace_back(number, entry.name);
+                }
+            });
+        }
+        std::sort(devices.begin(), devices.end());
+
+        for (const auto & [number, name] : devices) {
+            if (mDevices.size() >= MAX_DEVICES) {
+                LOG_DEBUG("Only the first %zu Mali devices' memory is counted", MAX_DEVICES);
+                break;
+            }
+            lib::DirectoryFd dir = debugfs.openDirectory(name.c_str());
+            if (dir && dir.openFile(GPU_MEMORY_FILE)) {
+                addDevice(number, std::move(dir));
+            }
+        }
+
+        if (mDevices.empty()) {
+            LOG_SETUP("Mali GPU counters\nCannot access %s/mali*/%s. GPU memory counters not available.",
+                      DEBUGFS_PATH,
+                      GPU_MEMORY_FILE);
+        }
+        else {
+            LOG_SETUP("Mali GPU counters\nGPU memory counters available for %zu devices.", mDevices.size());
+        }
+    }
+
+    void MaliMemoryPolledDriver::addDevice(unsigned number, lib::DirectoryFd dir)
+    {
+        auto device = std::make_unique<Device>();
+        device->number = number;
+        device->dir = std::move(dir);
+
+        const std::string prefix = "ARM_Mali-memory-" + std::to_string(number) + "_";
+        device->usedName = prefix + "used";
+        device->contextsName = prefix + "contexts";
+        device->largestName = prefix + "largest_process";
+        device->profiledName = prefix + "profiled";
+
+        setCounters(new MaliGPUClockPolledDriverCounter(getCounters(), device->usedName.c_str(), device->used));
+        setCounters(
+            new MaliGPUClockPolledDriverCounter(getCounters(), device->contextsName.c_str(), device->contexts));
+        setCounters(new MaliGPUClockPolledDriverCounter(getCounters(), device->largestName.c_str(), device->largest));
+        device->profiledCounter =
+            new MaliGPUClockPolledDriverCounter(getCounters(), device->profiledName.c_str(), device->profiled);
+        setCounters(device->profiledCounter);
+
+        mDevices.emplace_back(std::move(device));
+    }
+
+    void MaliMemoryPolledDriver::writeEvents(mxml_node_t * root) const
+    {
+        if (mDevices.empty()) {
+            return;
+        }
+
+        mxml_node_t * const category = mxmlNewElement(root, "category");
+        mxmlElementSetAttr(category, "name", "Mali Memory");
+        mxmlElementSetAttr(category, "per_cpu", "no");
+
+        for (const auto & device : mDevices) {
+            const std::string title = "Mali Memory (Device #" + std::to_string(device->number) + ")";
+
+            const auto addEvent = [&](const std::string & counter,
+                                      const char * name,
+                                      const char * units,
+                                      const char * description) {
+                mxml_node_t * const node = mxmlNewElement(category, "event");
+                mxmlElementSetAttr(node, "counter", counter.c_str());
+                mxmlElementSetAttr(node, "title", title.c_str());
+                mxmlElementSetAttr(node, "name", name);
+                mxmlElementSetAttr(node, "class", "absolute");
+                mxmlElementSetAttr(node, "display", "maximum");
+                mxmlElementSetAttr(node, "rendering_type", "line");
+                mxmlElementSetAttr(node, "series_composition", "overlay");
+                if (units != nullptr) {
+                    mxmlElementSetAttr(node, "units", units);
+                }
+                mxmlElementSetAttr(node, "description", description);
+            };
+
+            addEvent(device->usedName, "Used", "B", "The GPU memory allocated through the device (gpu_memory)");
+            addEvent(device->contextsName, "Contexts", nullptr, "The number of GPU contexts of the device");
+            addEvent(device->largestName,
+                     "Largest process",
+                     "B",
+                     "The GPU memory allocated by the process with the most, summed over its contexts");
+            addEvent(device->profiledName,
+                     "Profiled heaps",
+                     "B",
+                     "The size of the heaps that the driver reports in the mem_profile of every context");
+        }
+    }
+
+    void MaliMemoryPolledDriver::start()
+    {
+        mPageSize = static_cast<uint64_t>(std::max(sysconf(_SC_PAGESIZE), 1L));
+
+        // the file is opened once and reread from the start on each poll
+        for (auto & device : mDevices) {
+            device->processes.clear();
+            device->gpuMemory = device->dir.openFile(GPU_MEMORY_FILE);
+        }
+
+        sample();
+    }
+
+    void MaliMemoryPolledDriver::sample()
+    {
+        if (!countersEnabled()) {
+            return;
+        }
+
+        for (auto & device : mDevices) {
+            readDevice(*device);
+        }
+    }
+
+    void MaliMemoryPolledDriver::readDevice(Device & device)
+    {
+        if (!device.gpuMemory) {
+            return;
+        }
+
+        const auto contents = lib::DirectoryFd::readContents(*device.gpuMemory, mBuf);
+        if (!contents) {
+            return;
+        }
+
+        for (auto & entry : device.processes) {
+            entry.second.seen = false;
+        }
+
+        // the first line is the device's own, "<device> <pages>", then each context's is
+        // "kctx-<address> <pages> [<tgid>]", where older drivers do not have the tgid
+        std::string_view remaining = *contents;
+        bool isFirst = true;
+        uint64_t contexts = 0;
+        std::map<uint32_t, uint64_t> processPages;
+        while (!remaining.empty()) {
+            lnx::ProcFieldParser fields {lnx::ProcFieldParser::nextLine(remaining)};
+            const std::string_view name = fields.nextField();
+            uint64_t pages = 0;
+            if (name.empty() || !fields.next(pages)) {
+                continue;
+            }
+
+            if (isFirst) {
+                isFirst = false;
+                device.used = pages * mPageSize;
+            }
+            else if (name.substr(0, 4) == "kctx") {
+                uint32_t tgid = 0;
+                if (!fields.next(tgid)) {
+                    tgid = 0;
+                }
+                processPages[tgid] += pages;
+                contexts += 1;
+            }
+        }
+        device.contexts = contexts;
+
+        // only the processes whose memory changed have their profiles reread
+        std::map<uint32_t, std::vector<std::string>> changed;
+        for (const auto & [tgid, pages] : processPages) {
+            auto [it, inserted] = device.processes.try_emplace(tgid);
+            it->second.seen = true;
+            if (inserted || (it->second.pages != pages)) {
+                changed.try_emplace(tgid);
+            }
+            it->second.pages = pages;
+        }
+
+        for (auto it = device.processes.begin(); it != device.processes.end();) {
+            it = (it->second.seen ? std::next(it) : device.processes.erase(it));
+        }
+
+        // a context's directory is named "<tgid>_<id>"
+        if (!changed.empty() && device.profiledCounter->isEnabled()) {
+            const lib::DirectoryFd contextsDir = device.dir.openDirectory(CONTEXTS_DIR);
+            if (contextsDir) {
+                contextsDir.forEachChild([&](const lib::DirectoryFd::Entry & entry) {
+                    const std::string_view name {entry.name};
+                    const auto separator = name.find('_');
+                    uint32_t tgid = 0;
+                    if ((entry.type != DT_DIR) || (separator == std::string_view::npos)
+                        || !lnx::ProcFieldParser {name.substr(0, separator)}.next(tgid)) {
+                        return;
+                    }
+                    auto it = changed.find(tgid);
+                    if (it != changed.end()) {
+                        it->second.emplace_back(name);
+                    }
+                });
+            }
+
+            for (const auto & [tgid, contextDirs] : changed) {
+                device.processes[tgid].profiled = readProfiles(device, contextDirs);
+            }
+        }
+
+        uint64_t largest = 0;
+        uint64_t profiled = 0;
+        for (const auto & entry : device.processes) {
+            largest = std::max(largest, entry.second.pages);
+            profiled += entry.second.profiled;
+        }
+        device.largest = largest * mPageSize;
+        device.profiled = profiled;
+    }
+
+    uint64_t MaliMemoryPolledDriver::readProfiles(const Device & device, const std::vector<std::string> & contextDirs)
+    {
+        uint64_t total = 0;
+        for (const auto & contextDir : contextDirs) {
+            const std::string path = std::string {CONTEXTS_DIR} + '/' + contextDir + '/' + MEM_PROFILE_FILE;
+            const auto contents = device.dir.readFile(path.c_str(), mProfileBuf);
+            if (!contents) {
+                continue;
+            }
+
+            std::string_view remaining = *contents;
+            for (auto pos = remaining.find(TOTAL_MEMORY); pos != std::string_view::npos;
+                 pos = remaining.find(TOTAL_MEMORY)) {
+                remaining.remove_prefix(pos + TOTAL_MEMORY.size());
+                while (!remaining.empty() && (std::isspace(static_cast<unsigned char>(remaining.front())) != 0)) {
+                    remaining.remove_prefix(1);
+                }
+                uint64_t bytes = 0;
+                const auto result = std::from_chars(remaining.data(), remaining.data() + remaining.size(), bytes);
+                if (result.ec == std::errc {}) {
+                    total += bytes;
+                }
+            }
+        }
+        return total;
+    }
+}
@@ -0,0 +1,91 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#ifndef MALI_USERSPACE_MALIMEMORYPOLLEDDRIVER_H_
+#define MALI_USERSPACE_MALIMEMORYPOLLEDDRIVER_H_
+
+#include "PolledDriver.h"
+#include "lib/AutoClosingFd.h"
+#include "lib/DirectoryFd.h"
+#include "mxml/mxml.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace mali_userspace {
+
+    /**
+     * Reads the GPU memory allocated through each kbase device from its debugfs directory, so that the growth of the
+     * GPU memory of the processes can be seen beside the hardware counters.
+     *
+     * Each poll reads the device's gpu_memory file, which has the pages used by the device and by each of its
+     * contexts, along with the tgid of the process that created the context. The pages are summed per process, and
+     * only the processes whose total changed since the last poll have their contexts' mem_profile files reread (which
+     * the DDK writes with the size of each of its heaps), so that an idle process costs nothing beyond its line of
+     * gpu_memory.
+     *
+     * The devices are discovered by readEvents, up to MAX_DEVICES of them, and each has counters of the memory used
+     * by the device, the number of contexts, the memory of the process using the most, and the sum of the contexts'
+     * mem_profile heaps.
+     */
+    class MaliMemoryPolledDriver : public PolledDriver {
+    public:
+        /** The most devices counted */
+        static constexpr std::size_t MAX_DEVICES = 8;
+
+        MaliMemoryPolledDriver() : PolledDriver("MaliMemory") {}
+
+        // Intentionally unimplemented
+        MaliMemoryPolledDriver(const MaliMemoryPolledDriver &) = delete;
+        MaliMemoryPolledDriver & operator=(const MaliMemoryPolledDriver &) = delete;
+        MaliMemoryPolledDriver(MaliMemoryPolledDriver &&) = delete;
+        MaliMemoryPolledDriver & operator=(MaliMemoryPolledDriver &&) = delete;
+
+        void readEvents(mxml_node_t * root) override;
+        void writeEvents(mxml_node_t * root) const override;
+        void start() override;
+        void sample() override;
+
+    private:
+        /** The contexts of one process */
+        struct Process {
+            uint64_t pages {0};
+            /** The sum of the heaps in the mem_profile of each of its contexts, in bytes */
+            uint64_t profiled {0};
+            /** Set when the process is in the current poll's gpu_memory */
+            bool seen {false};
+        };
+
+        struct Device {
+            unsigned number;
+            std::string usedName;
+            std::string contextsName;
+            std::string largestName;
+            std::string profiledName;
+            lib::DirectoryFd dir {};
+            lib::AutoClosingFd gpuMemory {};
+            /** The processes with contexts, by tgid */
+            std::map<uint32_t, Process> processes {};
+            DriverCounter * profiledCounter {nullptr};
+            uint64_t used {0};
+            uint64_t contexts {0};
+            uint64_t largest {0};
+            uint64_t profiled {0};
+        };
+
+        std::vector<std::unique_ptr<Device>> mDevices {};
+        std::vector<char> mBuf {};
+        std::vector<char> mProfileBuf {};
+        uint64_t mPageSize {0};
+
+        void addDevice(unsigned number, lib::DirectoryFd dir);
+        void readDevice(Device & device);
+        /** @return The sum of the mem_profile heaps of each of the process's contexts */
+        uint64_t readProfiles(const Device & device, const std::vector<std::string> & contextDirs);
+    };
+}
+
+#endif /* MALI_USERSPACE_MALIMEMORYPOLLEDDRIVER_H_ */
@@ -0,0 +1,455 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "mali_userspace/MaliPrfcntReader.h"
+
+#include "Logging.h"
+#include "lib/Syscall.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <optional>
+#include <utility>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace mali_userspace {
+
+#if defined(ANDROID) || defined(__ANDROID__)
+/* We use _IOR_BAD/_IOW_BAD rather than _IOR/_IOW otherwise fails to compile with NDK-BUILD because of _IOC_TYPECHECK is defined, not because the paramter is invalid */
+#define MALI_IOR(a, b, c) _IOR_BAD(a, b, c)
+#define MALI_IOW(a, b, c) _IOW_BAD(a, b, c)
+#else
+#define MALI_IOR(a, b, c) _IOR(a, b, c)
+#define MALI_IOW(a, b, c) _IOW(a, b, c)
+#endif
+
+    /* --------------------------------------------------------------------- */
+
+    namespace {
+        using namespace kinstr_prfcnt;
+
+        enum {
+            /* The ids of ioctl commands for the reader interface */
+            KBASE_KINSTR_PRFCNT_READER = 0xBF,
+            KBASE_IOCTL_KINSTR_PRFCNT_CMD = MALI_IOW(KBASE_KINSTR_PRFCNT_READER, 0x00, struct prfcnt_control_cmd),
+            KBASE_IOCTL_KINSTR_PRFCNT_GET_SAMPLE =
+                MALI_IOR(KBASE_KINSTR_PRFCNT_READER, 0x01, struct prfcnt_sample_access),
+            KBASE_IOCTL_KINSTR_PRFCNT_PUT_SAMPLE =
+                MALI_IOW(KBASE_KINSTR_PRFCNT_READER, 0x10, struct prfcnt_sample_access),
+        };
+
+        enum {
+            PIPE_DESCRIPTOR_IN,  /**< The index of a pipe's input descriptor. */
+            PIPE_DESCRIPTOR_OUT, /**< The index of a pipe's output descriptor. */
+
+            PIPE_DESCRIPTOR_COUNT /**< The number of descriptors forming a pipe. */
+        };
+
+        enum {
+            POLL_DESCRIPTOR_SIGNAL,        /**< The index of the signal descriptor in poll fds array. */
+            POLL_DESCRIPTOR_PRFCNT_READER, /**< The index of the prfcnt reader descriptor in poll fds array. */
+
+            POLL_DESCRIPTOR_COUNT /**< The number of descriptors poll is waiting for. */
+        };
+
+        /** Write a single byte into the pipe to interrupt the reader thread */
+        using poll_data_t = char;
+
+        /** The layout the samples are presented in */
+        constexpr IMaliHwCntrReader::HardwareVersion SAMPLE_LAYOUT_VERSION = 5;
+
+        /** The number of samples the driver gives each client */
+        constexpr std::size_t DRIVER_SAMPLE_COUNT = 32;
+
+        /** The counter name block of each type of block */
+        constexpr std::optional<uint32_t> mapBlockTypeToNameBlockIndex(uint8_t blockType)
+        {
+            // the name blocks are JM (or the CSF front end), tiler, shader core, then MMU/L2
+            switch (blockType) {
+                case PRFCNT_BLOCK_TYPE_FE:
+                    return 0;
+                case PRFCNT_BLOCK_TYPE_TILER:
+                    return 1;
+                case PRFCNT_BLOCK_TYPE_SHADER_CORE:
+                    return 2;
+                case PRFCNT_BLOCK_TYPE_MEMORY:
+                    return 3;
+                default:
+                    return {};
+            }
+        }
+
+        /** @return True if the driver accepts version 0 of some request */
+        bool isRequestSupported(const std::vector<prfcnt_enum_item> & items, uint16_t requestItemType)
+        {
+            return std::any_of(items.begin(), items.end(), [requestItemType](const prfcnt_enum_item & item) {
+                return (item.hdr.item_type == PRFCNT_ENUM_TYPE_REQUEST)
+                    && (item.u.request.request_item_type == requestItemType)
+                    && ((item.u.request.versions_mask & (1U << PRFCNT_READER_API_VERSION)) != 0);
+            });
+        }
+
+        prfcnt_request_item makeRequestItem(uint16_t itemType)
+        {
+            prfcnt_request_item item {};
+            item.hdr.item_type = itemType;
+            item.hdr.item_version = PRFCNT_READER_API_VERSION;
+            return item;
+        }
+    }
+
+    MaliPrfcntReader::MaliPrfcntReader(const MaliDevice & device,
+                                       BlockCountersByType blockCounters,
+                                       lib::AutoClosingFd selfPipe0,
+                                       lib::AutoClosingFd selfPipe1)
+        : device(device),
+          blockCounters(std::move(blockCounters)),
+          sampleLength((2 + device.getL2MmuBlockCount() + device.getShaderBlockCount())
+                       * MaliDevice::NUM_COUNTERS_PER_BLOCK)
+    {
+        selfPipe[0] = std::move(selfPipe0);
+        selfPipe[1] = std::move(selfPipe1);
+    }
+
+    const MaliDevice & MaliPrfcntReader::getDevice() const { return device; }
+
+    IMaliHwCntrReader::HardwareVersion MaliPrfcntReader::getHardwareVersion() const { return SAMPLE_LAYOUT_VERSION; }
+
+    std::size_t MaliPrfcntReader::getBufferCount() const { return DRIVER_SAMPLE_COUNT; }
+
+    bool MaliPrfcntReader::startPeriodicSampling(uint32_t interval)
+    {
+        if (interval == 0) {
+            return (!prfcntReaderFd) || sendCommand(PRFCNT_CONTROL_CMD_STOP);
+        }
+
+        if (!prfcntReaderFd && !setup(interval)) {
+            return false;
+        }
+
+        return sendCommand(PRFCNT_CONTROL_CMD_START);
+    }
+
+    bool MaliPrfcntReader::setup(uint32_t interval)
+    {
+        std::vector<prfcnt_request_item> requests {};
+
+        {
+            auto mode = makeRequestItem(PRFCNT_REQUEST_TYPE_MODE);
+            mode.u.req_mode.mode = PRFCNT_MODE_PERIODIC;
+            mode.u.req_mode.mode_config.periodic.period_ns = interval;
+            requests.push_back(mode);
+        }
+
+        for (std::size_t blockType = 0; blockType < blockCounters.size(); ++blockType) {
+            const auto & block = blockCounters[blockType];
+            if (block.counterIndexes.empty()) {
+                continue;
+            }
+
+            auto enable = makeRequestItem(PRFCNT_REQUEST_TYPE_ENABLE);
+            enable.u.req_enable.block_type = blockType;
+            enable.u.req_enable.set = block.set;
+            for (const uint32_t counterIndex : block.counterIndexes) {
+                enable.u.req_enable.enable_mask[0] |= (1ULL << counterIndex);
+            }
+            requests.push_back(enable);
+        }
+
+        requests.push_back(makeRequestItem(FLEX_LIST_TYPE_NONE));
+
+        uint32_t newMetadataItemSize = 0;
+        uint32_t newMmapSize = 0;
+        lib::AutoClosingFd newReaderFd = device.createPrfcntReaderFd(requests, newMetadataItemSize, newMmapSize);
+        if (!newReaderFd) {
+            LOG_ERROR("MaliPrfcntReader: Could not set up the kinstr_prfcnt reader");
+            return false;
+        }
+
+        if ((newMetadataItemSize < sizeof(prfcnt_metadata)) || (newMmapSize == 0)) {
+            LOG_ERROR("MaliPrfcntReader: Unexpected sample layout (metadata of %u bytes in %u bytes)",
+                      newMetadataItemSize,
+                      newMmapSize);
+            return false;
+        }
+
+        // mmap the data
+        auto * const sampleMemoryPtr =
+            reinterpret_cast<uint8_t *>(lib::mmap(nullptr, newMmapSize, PROT_READ, MAP_SHARED, *newReaderFd, 0));
+        if ((sampleMemoryPtr == nullptr) || (sampleMemoryPtr == reinterpret_cast<uint8_t *>(-1UL))) {
+            LOG_ERROR("MaliPrfcntReader: Could not mmap sample buffer (%s)", strerror(errno));
+            return false;
+        }
+
+        sampleMemory = {sampleMemoryPtr, [newMmapSize](uint8_t * ptr) -> void {
+                            if (ptr != nullptr) {
+                                lib::munmap(ptr, newMmapSize);
+                            }
+                        }};
+        prfcntReaderFd = std::move(newReaderFd);
+        metadataItemSize = newMetadataItemSize;
+        mmapSize = newMmapSize;
+
+        LOG_DEBUG("MaliPrfcntReader: Successfully set up reader, with %zu requests and %u bytes of samples",
+                  requests.size(),
+                  mmapSize);
+        return true;
+    }
+
+    bool MaliPrfcntReader::sendCommand(prfcnt_control_cmd_code cmd)
+    {
+        prfcnt_control_cmd control {};
+        control.cmd = cmd;
+
+        if (lib::ioctl(*prfcntReaderFd, KBASE_IOCTL_KINSTR_PRFCNT_CMD, reinterpret_cast<unsigned long>(&control))
+            != 0) {
+            LOG_ERROR("MaliPrfcntReader: Command %u failed (%s)", unsigned(cmd), strerror(errno));
+            return false;
+        }
+        return true;
+    }
+
+    SampleBuffer MaliPrfcntReader::waitForBuffer(int timeout)
+    {
+        SampleBuffer temp;
+
+        if (!prfcntReaderFd) {
+            LOG_ERROR("MaliPrfcntReader::waitForBuffer - sampling has not started");
+            temp.status = WAIT_STATUS_ERROR;
+            return temp;
+        }
+
+        // poll for any updates
+        pollfd fds[POLL_DESCRIPTOR_COUNT];
+        fds[POLL_DESCRIPTOR_SIGNAL].fd = *selfPipe[PIPE_DESCRIPTOR_IN];
+        fds[POLL_DESCRIPTOR_SIGNAL].events = POLLIN;
+        fds[POLL_DESCRIPTOR_SIGNAL].revents = 0;
+        fds[POLL_DESCRIPTOR_PRFCNT_READER].fd = *prfcntReaderFd;
+        fds[POLL_DESCRIPTOR_PRFCNT_READER].events = POLLIN;
+        fds[POLL_DESCRIPTOR_PRFCNT_READER].revents = 0;
+
+        const int ready = lib::poll(fds, POLL_DESCRIPTOR_COUNT, timeout);
+
+        // process result
+        if (ready < 0) {
+            // error occurred
+            LOG_ERROR("MaliPrfcntReader::waitForBuffer - poll failed");
+            temp.status = WAIT_STATUS_ERROR;
+            return temp;
+        }
+        if (ready == 0) {
+            // clear buffer
+            temp.status = WAIT_STATUS_SUCCESS;
+            return temp;
+        }
+        if (fds[POLL_DESCRIPTOR_SIGNAL].revents != 0) {
+            // read the data from the pipe if necessary
+            if ((fds[POLL_DESCRIPTOR_SIGNAL].revents & POLLIN) == POLLIN) {
+                // read the data
+                poll_data_t value;
+                int result = lib::read(*selfPipe[PIPE_DESCRIPTOR_IN], &value, sizeof(value));
+                if (result < 0) {
+                    temp.status = WAIT_STATUS_SUCCESS;
+                    return temp;
+                }
+            }
+
+            // terminated
+            temp.status = WAIT_STATUS_TERMINATED;
+            return temp;
+        }
+        if ((fds[POLL_DESCRIPTOR_PRFCNT_READER].revents & POLLIN) == POLLIN) {
+            // get the sample
+            prfcnt_sample_access access {};
+            if (lib::ioctl(*prfcntReaderFd,
+                           KBASE_IOCTL_KINSTR_PRFCNT_GET_SAMPLE,
+                           reinterpret_cast<unsigned long>(&access))
+                != 0) {
+                LOG_ERROR("MaliPrfcntReader: Could not get sample due to ioctl failure (%s)", strerror(errno));
+                temp.status = WAIT_STATUS_ERROR;
+                return temp;
+            }
+
+            // the driver only reuses a sample's memory once it is returned, so it has its own converted copy
+            auto & converted = convertedSamples[access.sample_offset_bytes];
+            if (converted.empty()) {
+                converted.resize(sampleLength, 0);
+            }
+
+            uint64_t timestamp = 0;
+            if (!convertSample(access.sample_offset_bytes, converted, timestamp)) {
+                releaseSample(access);
+                temp.status = WAIT_STATUS_SUCCESS;
+                return temp;
+            }
+
+            temp.timestamp = timestamp;
+            temp.eventId = HWCNT_READER_EVENT_PERIODIC;
+            temp.bufferId = uint32_t(access.sequence);
+            temp.size = converted.size() * sizeof(uint32_t);
+            unique_ptr_with_deleter<uint8_t> data_temp(reinterpret_cast<uint8_t *>(converted.data()),
+                                                       [=](uint8_t * /*unused*/) { releaseSample(access); });
+            temp.data = std::move(data_temp);
+            temp.status = WAIT_STATUS_SUCCESS;
+            return temp;
+        }
+        if ((fds[POLL_DESCRIPTOR_PRFCNT_READER].revents & POLLHUP) == POLLHUP) {
+            // terminated
+            temp.status = WAIT_STATUS_TERMINATED;
+            return temp;
+        }
+        // error occurred
+        LOG_ERROR("MaliPrfcntReader::waitForBuffer - unexpected event 0x%x",
+                  fds[POLL_DESCRIPTOR_PRFCNT_READER].revents);
+        temp.status = WAIT_STATUS_ERROR;
+        return temp;
+    }
+
+    bool MaliPrfcntReader::convertSample(uint64_t sampleOffset,
+                                         std::vector<uint32_t> & converted,
+                                         uint64_t & timestamp) const
+    {
+        const uint8_t * const memory = sampleMemory.get();
+
+        for (uint64_t offset = sampleOffset; (offset + metadataItemSize) <= mmapSize; offset += metadataItemSize) {
+            prfcnt_metadata item;
+            std::memcpy(&item, memory + offset, sizeof(item));
+
+            if (item.hdr.item_type == FLEX_LIST_TYPE_NONE) {
+                return true;
+            }
+
+            if (item.hdr.item_type == PRFCNT_SAMPLE_META_TYPE_SAMPLE) {
+                if ((item.u.sample_md.flags & SAMPLE_FLAG_ERROR) != 0) {
+                    LOG_DEBUG("MaliPrfcntReader: Dropped sample %" PRIu64 " as the driver flagged an error",
+                              item.u.sample_md.seq);
+                    return false;
+                }
+                timestamp = item.u.sample_md.timestamp_end;
+            }
+            else if ((item.hdr.item_type == PRFCNT_SAMPLE_META_TYPE_BLOCK)
+                     && (item.u.block_md.block_type < blockCounters.size())) {
+                const auto & block = blockCounters[item.u.block_md.block_type];
+                const auto blockNumber = device.getV56BlockNumber(block.nameBlockIndex, item.u.block_md.block_idx);
+
+                if (block.counterIndexes.empty() || !blockNumber
+                    || ((uint64_t(item.u.block_md.values_offset) + (block.numValues * sizeof(uint64_t))) > mmapSize)) {
+                    continue;
+                }
+
+                const uint8_t * const values = memory + item.u.block_md.values_offset;
+                uint32_t * const output = converted.data() + (*blockNumber * MaliDevice::NUM_COUNTERS_PER_BLOCK);
+
+                // the driver's values are 64 bit, but each is the delta over one sample
+                for (const uint32_t counterIndex : block.counterIndexes) {
+                    uint64_t value;
+                    std::memcpy(&value, values + (counterIndex * sizeof(uint64_t)), sizeof(value));
+                    output[counterIndex] =
+                        uint32_t(std::min<uint64_t>(value, std::numeric_limits<uint32_t>::max()));
+                }
+                output[MaliDevice::BLOCK_ENABLE_BITS_COUNTER_INDEX] = block.enableBits;
+            }
+        }
+
+        LOG_DEBUG("MaliPrfcntReader: Sample metadata at %" PRIu64 " is not terminated", sampleOffset);
+        return false;
+    }
+
+    void MaliPrfcntReader::interrupt()
+    {
+        poll_data_t exit = 0;
+        if (lib::write(*selfPipe[PIPE_DESCRIPTOR_OUT], &exit, sizeof(exit)) < 0) {
+            LOG_ERROR("MaliPrfcntReader::interrupt failed (%s)", strerror(errno));
+        }
+    }
+
+    bool MaliPrfcntReader::releaseSample(const prfcnt_sample_access & access)
+    {
+        prfcnt_sample_access access_tmp = access;
+        return lib::ioctl(*prfcntReaderFd,
+                          KBASE_IOCTL_KINSTR_PRFCNT_PUT_SAMPLE,
+                          reinterpret_cast<unsigned long>(&access_tmp))
+            == 0;
+    }
+
+    std::unique_ptr<MaliPrfcntReader> MaliPrfcntReader::createReader(
+        const MaliDevice & device,
+        const MaliDevice::CounterEnableMasks & enabledCounters)
+    {
+        const std::vector<prfcnt_enum_item> items = device.enumeratePrfcntInfo();
+        if (items.empty()) {
+            return {};
+        }
+
+        if (!isRequestSupported(items, PRFCNT_REQUEST_TYPE_MODE)
+            || !isRequestSupported(items, PRFCNT_REQUEST_TYPE_ENABLE)) {
+            LOG_DEBUG("MaliPrfcntReader: The driver does not accept version %u of the requests",
+                      unsigned(PRFCNT_READER_API_VERSION));
+            return {};
+        }
+
+        BlockCountersByType blockCounters {};
+        std::size_t numCounters = 0;
+
+        for (const auto & item : items) {
+            if (item.hdr.item_type != PRFCNT_ENUM_TYPE_BLOCK) {
+                continue;
+            }
+
+            const auto & info = item.u.block_counter;
+            const auto nameBlockIndex = mapBlockTypeToNameBlockIndex(info.block_type);
+            if (!nameBlockIndex) {
+                continue;
+            }
+
+            auto & block = blockCounters[info.block_type];
+            block = {info.set, *nameBlockIndex, info.num_values, {}, 0};
+
+            // only the counters that are both selected and provided by the driver
+            const uint64_t mask = enabledCounters[*nameBlockIndex] & info.counter_mask[0];
+            const uint32_t limit = std::min<uint32_t>(info.num_values, MaliDevice::NUM_COUNTERS_PER_BLOCK);
+            for (uint32_t counterIndex = 0; counterIndex < limit; ++counterIndex) {
+                if ((mask & (1ULL << counterIndex)) != 0) {
+                    block.counterIndexes.push_back(counterIndex);
+                    block.enableBits |= (1U << (counterIndex / MaliDevice::NUM_COUNTERS_PER_ENABLE_GROUP));
+                }
+            }
+
+            LOG_DEBUG("MaliPrfcntReader: Block type %u has %u instances, reading %zu of %u values",
+                      unsigned(info.block_type),
+                      unsigned(info.num_instances),
+                      block.counterIndexes.size(),
+                      unsigned(info.num_values));
+            numCounters += block.counterIndexes.size();
+        }
+
+        if (numCounters == 0) {
+            LOG_DEBUG("MaliPrfcntReader: None of the selected counters are provided through kinstr_prfcnt");
+            return {};
+        }
+
+        // create the thread notification pipe
+        lib::AutoClosingFd selfPipe[2];
+        {
+            int selfPipeFd[2] = {-1, -1};
+            if (pipe2(selfPipeFd, O_CLOEXEC) != 0) {
+                LOG_ERROR("MaliPrfcntReader: Could not create pipe (%s)", strerror(errno));
+                return {};
+            }
+            selfPipe[0] = selfPipeFd[0];
+            selfPipe[1] = selfPipeFd[1];
+        }
+
+        return std::unique_ptr<MaliPrfcntReader> {
+            new MaliPrfcntReader(device, std::move(blockCounters), std::move(selfPipe[0]), std::move(selfPipe[1]))};
+    }
+}
@@ -0,0 +1,125 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#ifndef NATIVE_GATOR_DAEMON_MALI_USERSPACE_MALIPRFCNTREADER_H_
+#define NATIVE_GATOR_DAEMON_MALI_USERSPACE_MALIPRFCNTREADER_H_
+
+#include "lib/AutoClosingFd.h"
+#include "mali_userspace/IMaliHwCntrReader.h"
+#include "mali_userspace/MaliDevice.h"
+#include "mali_userspace/MaliDeviceApi_DdkDefines.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace mali_userspace {
+    /**
+     * Hardware counter reader for the kinstr_prfcnt interface.
+     *
+     * Unlike the hwcnt reader, which dumps every counter of every block, only the counters the user selected are
+     * requested from the driver, and only those are copied out of each sample. The samples are presented in the V5
+     * layout, with the enable bits of each block set for the copied counters, so that they are decoded by the same
+     * counter list as those of the hwcnt reader.
+     *
+     * The sampling period is fixed when the driver's reader is set up, so that is done by startPeriodicSampling.
+     */
+    class MaliPrfcntReader : public IMaliHwCntrReader {
+    public:
+        ~MaliPrfcntReader() override = default;
+
+        MaliPrfcntReader(const MaliPrfcntReader &) = delete;
+        MaliPrfcntReader & operator=(const MaliPrfcntReader &) = delete;
+        MaliPrfcntReader(MaliPrfcntReader &&) = delete;
+        MaliPrfcntReader & operator=(MaliPrfcntReader &&) = delete;
+
+        const MaliDevice & getDevice() const override;
+        HardwareVersion getHardwareVersion() const override;
+        std::size_t getBufferCount() const override;
+        SampleBuffer waitForBuffer(int timeout) override;
+        bool startPeriodicSampling(uint32_t interval) override;
+        void interrupt() override;
+
+        /**
+         * Create a new instance of the MaliPrfcntReader object associated with the device object
+         *
+         * @param enabledCounters The counters to read
+         * @return The new reader, or nullptr if the driver does not have the kinstr_prfcnt interface (or none of the
+         *          counters are available through it)
+         */
+        static std::unique_ptr<MaliPrfcntReader> createReader(const MaliDevice & device,
+                                                              const MaliDevice::CounterEnableMasks & enabledCounters);
+
+    private:
+        using MmappedBuffer = std::unique_ptr<uint8_t[], std::function<void(uint8_t *)>>;
+
+        /** The counters that are read from a type of block */
+        struct BlockCounters {
+            /** The counter set the driver reports */
+            uint8_t set;
+            /** The counter name block of the type */
+            uint32_t nameBlockIndex;
+            /** The number of values in each of the driver's blocks */
+            uint32_t numValues;
+            /** The counters to copy (which is empty if the type of block is not read) */
+            std::vector<uint32_t> counterIndexes;
+            /** The enable bits of the copied counters */
+            uint32_t enableBits;
+        };
+
+        /** Indexed by prfcnt_block_type */
+        using BlockCountersByType = std::array<BlockCounters, kinstr_prfcnt::PRFCNT_BLOCK_TYPE_SHADER_CORE + 1>;
+
+        /** Mali device object */
+        const MaliDevice & device;
+        /** The counters of each type of block */
+        const BlockCountersByType blockCounters;
+        /** The number of words in a sample in the V5 layout */
+        const std::size_t sampleLength;
+        /** File descriptor of the kinstr_prfcnt client in the kernel (once sampling has started) */
+        lib::AutoClosingFd prfcntReaderFd {};
+        /** Pipe to allow one thread to signal to poll to wake. Used to stop read. */
+        lib::AutoClosingFd selfPipe[2];
+        /** Sample memory */
+        MmappedBuffer sampleMemory {};
+        /** Size of the sample memory */
+        uint32_t mmapSize {0};
+        /** Size of each metadata item in a sample */
+        uint32_t metadataItemSize {0};
+        /**
+         * The samples in the V5 layout, by their offset in the sample memory. Each is only rewritten once its sample
+         * is returned to the driver, and (as the same counters are copied every time) the words that are not copied
+         * stay zero.
+         */
+        std::map<uint64_t, std::vector<uint32_t>> convertedSamples {};
+
+        MaliPrfcntReader(const MaliDevice & device,
+                         BlockCountersByType blockCounters,
+                         lib::AutoClosingFd selfPipe0,
+                         lib::AutoClosingFd selfPipe1);
+
+        /** Set up the driver's reader, sampling at some interval */
+        bool setup(uint32_t interval);
+
+        /** Send a command to the driver's reader */
+        bool sendCommand(kinstr_prfcnt::prfcnt_control_cmd_code cmd);
+
+        /**
+         * Copy the enabled counters of a sample into the V5 layout
+         *
+         * @param sampleOffset The offset of the sample's metadata in the sample memory
+         * @param converted Receives the counters
+         * @param timestamp [OUT] The time at the end of the sample
+         * @return False if the driver flagged the sample as invalid
+         */
+        bool convertSample(uint64_t sampleOffset, std::vector<uint32_t> & converted, uint64_t & timestamp) const;
+
+        /** Return a sample to the driver */
+        bool releaseSample(const kinstr_prfcnt::prfcnt_sample_access & access);
+    };
+}
+
+#endif /* NATIVE_GATOR_DAEMON_MALI_USERSPACE_MALIPRFCNTREADER_H_ */
@@ -0,0 +1,275 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#include "mali_userspace/MaliSimulatedHwCntrReader.h"
+
+#include "Logging.h"
+#include "Time.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <utility>
+
+namespace mali_userspace {
+    namespace {
+        constexpr std::uint32_t DEFAULT_SHADER_CORES = 16;
+        constexpr std::uint32_t MAX_SHADER_CORES = 64; // the size of the availability mask
+        constexpr std::uint32_t DEFAULT_L2_SLICES = 4;
+        constexpr std::uint32_t MAX_L2_SLICES = 16;
+        constexpr std::uint32_t SIMULATED_HARDWARE_VERSION = 5;
+        constexpr std::uint32_t SIMULATED_BUS_WIDTH = 128;
+        constexpr std::size_t SIMULATED_BUFFER_COUNT = 16;
+        /** The blocks of the V5 layout that there is only one of (JM and tiler) */
+        constexpr std::uint32_t NUM_SINGLE_BLOCKS = 2;
+        constexpr std::uint64_t NS_PER_MS = 1000000;
+
+        class SimulatedMaliDeviceApi : public IMaliDeviceApi {
+        public:
+            explicit SimulatedMaliDeviceApi(const MaliSimulatedDeviceConfig & config)
+                : shaderCoreAvailabilityMask(config.numShaderCores >= 64 ? ~0ULL
+                                                                         : ((1ULL << config.numShaderCores) - 1)),
+                  numberOfL2Slices(config.numL2Slices),
+                  gpuId(config.gpuId)
+            {
+            }
+
+            lib::AutoClosingFd createHwCntReaderFd(std::size_t /*bufferCount*/,
+                                                   std::uint32_t /*jmBitmask*/,
+                                                   std::uint32_t /*shaderBitmask*/,
+                                                   std::uint32_t /*tilerBitmask*/,
+                                                   std::uint32_t /*mmuL2Bitmask*/,
+                                                   bool & failedDueToBufferCount) override
+            {
+                failedDueToBufferCount = false;
+                return {};
+            }
+
+            std::vector<kinstr_prfcnt::prfcnt_enum_item> enumeratePrfcntInfo() override { return {}; }
+
+            lib::AutoClosingFd createPrfcntReaderFd(
+                const std::vector<kinstr_prfcnt::prfcnt_request_item> & /*requests*/,
+                std::uint32_t & /*metadataItemSize*/,
+                std::uint32_t & /*mmapSize*/) override
+            {
+                return {};
+            }
+
+            [[nodiscard]] uint64_t getShaderCoreAvailabilityMask() const override { return shaderCoreAvailabilityMask; }
+
+            [[nodiscard]] uint32_t getMaxShaderCoreBlockIndex() const override
+            {
+                return (64 - __builtin_clzll(shaderCoreAvailabilityMask));
+            }
+
+            [[nodiscard]] uint32_t getNumberOfUsableShaderCores() const override
+            {
+                return __builtin_popcountll(shaderCoreAvailabilityMask);
+            }
+
+            [[nodiscard]] uint32_t getNumberOfL2Slices() const override { return numberOfL2Slices; }
+
+            [[nodiscard]] uint32_t getGpuId() const override { return gpuId; }
+
+            [[nodiscard]] uint32_t getHwVersion() const override { return SIMULATED_HARDWARE_VERSION; }
+
+            [[nodiscard]] uint32_t getExternalBusWidth() const override { return SIMULATED_BUS_WIDTH; }
+
+            [[nodiscard]] bool isSimulated() const override { return true; }
+
+        private:
+            const uint64_t shaderCoreAvailabilityMask;
+            const uint32_t numberOfL2Slices;
+            const uint32_t gpuId;
+        };
+
+        std::size_t calcSampleBufferSize(const MaliDevice & device)
+        {
+            const std::size_t numBlocks =
+                NUM_SINGLE_BLOCKS + device.getL2MmuBlockCount() + device.getShaderBlockCount();
+            return numBlocks * MaliDevice::NUM_COUNTERS_PER_BLOCK * sizeof(std::uint32_t);
+        }
+    }
+
+    std::optional<MaliSimulatedDeviceConfig> MaliSimulatedDeviceConfig::fromEnvironment()
+    {
+        //NOLINTNEXTLINE(concurrency-mt-unsafe)
+        const char * const env = getenv("GATORD_SIMULATED_MALI");
+        if ((env == nullptr) || (*env == '\0')) {
+            return {};
+        }
+
+        char * end = nullptr;
+        const auto gpuId = std::strtoul(env, &end, 0);
+        auto numShaderCores = static_cast<unsigned long>(DEFAULT_SHADER_CORES);
+        auto numL2Slices = static_cast<unsigned long>(DEFAULT_L2_SLICES);
+        bool valid = (end != env);
+        if (valid && (*end == ',')) {
+            const char * const cores = end + 1;
+            numShaderCores = std::strtoul(cores, &end, 10);
+            valid = (end != cores);
+        }
+        if (valid && (*end == ',')) {
+            const char * const slices = end + 1;
+            numL2Slices = std::strtoul(slices, &end, 10);
+            valid = (end != slices);
+        }
+
+        if ((!valid) || (*end != '\0') || (gpuId == 0) || (gpuId > 0xffffffffUL) || (numShaderCores == 0)
+            || (numShaderCores > MAX_SHADER_CORES) || (numL2Slices == 0) || (numL2Slices > MAX_L2_SLICES)) {
+            LOG_ERROR("Ignoring invalid GATORD_SIMULATED_MALI value '%s'", env);
+            return {};
+        }
+
+        LOG_WARNING("Simulating a Mali GPU (id: 0x%lx) with %lu shader cores and %lu L2 slices",
+                    gpuId,
+                    numShaderCores,
+                    numL2Slices);
+
+        return MaliSimulatedDeviceConfig {std::uint32_t(gpuId),
+                                          std::uint32_t(numShaderCores),
+                                          std::uint32_t(numL2Slices)};
+    }
+
+    std::unique_ptr<IMaliDeviceApi> createSimulatedMaliDeviceApi(const MaliSimulatedDeviceConfig & config)
+    {
+        return std::unique_ptr<IMaliDeviceApi> {new SimulatedMaliDeviceApi(config)};
+    }
+
+    std::unique_ptr<MaliSimulatedHwCntrReader> MaliSimulatedHwCntrReader::createReader(const MaliDevice & device)
+    {
+        if (!device.isSimulated()) {
+            return {};
+        }
+        return std::make_unique<MaliSimulatedHwCntrReader>(device);
+    }
+
+    MaliSimulatedHwCntrReader::MaliSimulatedHwCntrReader(const MaliDevice & device)
+        : device(device),
+          sampleBufferSize(calcSampleBufferSize(device)),
+          sampleMemory((sampleBufferSize / sizeof(std::uint32_t)) * SIMULATED_BUFFER_COUNT),
+          bufferInUse(SIMULATED_BUFFER_COUNT, false)
+    {
+    }
+
+    IMaliHwCntrReader::HardwareVersion MaliSimulatedHwCntrReader::getHardwareVersion() const
+    {
+        return SIMULATED_HARDWARE_VERSION;
+    }
+
+    std::size_t MaliSimulatedHwCntrReader::getBufferCount() const { return SIMULATED_BUFFER_COUNT; }
+
+    bool MaliSimulatedHwCntrReader::startPeriodicSampling(uint32_t interval)
+    {
+        {
+            std::lock_guard<std::mutex> lock {mutex};
+            this->interval = interval;
+            nextSampleTime = getTime() + interval;
+        }
+        condition.notify_all();
+        return true;
+    }
+
+    void MaliSimulatedHwCntrReader::interrupt()
+    {
+        {
+            std::lock_guard<std::mutex> lock {mutex};
+            interrupted = true;
+        }
+        condition.notify_all();
+    }
+
+    SampleBuffer MaliSimulatedHwCntrReader::waitForBuffer(int timeout)
+    {
+        SampleBuffer temp;
+
+        std::unique_lock<std::mutex> lock {mutex};
+        const std::uint64_t deadline = getTime() + (timeout > 0 ? std::uint64_t(timeout) * NS_PER_MS : 0);
+
+        while (true) {
+            if (interrupted) {
+                // as with the self pipe, each interrupt ends one wait
+                interrupted = false;
+                temp.status = WAIT_STATUS_TERMINATED;
+                return temp;
+            }
+
+            const std::uint64_t now = getTime();
+            if ((interval != 0) && (now >= nextSampleTime)) {
+                // don't try to catch up on the samples that were missed while the reader was not waited on
+                nextSampleTime += interval;
+                if (nextSampleTime <= now) {
+                    nextSampleTime = now + interval;
+                }
+
+                const auto bufferIndex = produceSample();
+                if (bufferIndex) {
+                    const auto numValues = sampleBufferSize / sizeof(std::uint32_t);
+                    std::uint32_t * const values = &sampleMemory[numValues * *bufferIndex];
+                    temp.timestamp = now;
+                    temp.eventId = HWCNT_READER_EVENT_PERIODIC;
+                    temp.bufferId = *bufferIndex;
+                    temp.size = sampleBufferSize;
+                    temp.data = unique_ptr_with_deleter<uint8_t>(
+                        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+                        reinterpret_cast<uint8_t *>(values),
+                        [this, index = *bufferIndex](uint8_t * /*unused*/) { releaseBuffer(index); });
+                    temp.status = WAIT_STATUS_SUCCESS;
+                    return temp;
+                }
+                continue;
+            }
+
+            if ((timeout >= 0) && (now >= deadline)) {
+                // timed out, so return an empty buffer
+                temp.status = WAIT_STATUS_SUCCESS;
+                return temp;
+            }
+
+            if (interval != 0) {
+                const auto wakeTime = (timeout >= 0 ? std::min(deadline, nextSampleTime) : nextSampleTime);
+                condition.wait_for(lock, std::chrono::nanoseconds(wakeTime - now));
+            }
+            else if (timeout >= 0) {
+                condition.wait_for(lock, std::chrono::nanoseconds(deadline - now));
+            }
+            else {
+                condition.wait(lock);
+            }
+        }
+    }
+
+    std::optional<std::uint32_t> MaliSimulatedHwCntrReader::produceSample()
+    {
+        const auto free = std::find(bufferInUse.begin(), bufferInUse.end(), false);
+        if (free == bufferInUse.end()) {
+            return {};
+        }
+        *free = true;
+
+        const auto bufferIndex = std::uint32_t(free - bufferInUse.begin());
+        const auto numValues = sampleBufferSize / sizeof(std::uint32_t);
+        const auto sampleSequence = ++sequence;
+
+        std::uint32_t * const values = &sampleMemory[numValues * bufferIndex];
+        for (std::size_t block = 0; block < numValues; block += MaliDevice::NUM_COUNTERS_PER_BLOCK) {
+            values[block + MaliDevice::BLOCK_ENABLE_BITS_COUNTER_INDEX] = 0xffffffffU;
+            for (std::size_t counter = MaliDevice::NUM_BLOCK_HEADER_COUNTERS;
+                 counter < MaliDevice::NUM_COUNTERS_PER_BLOCK;
+                 ++counter) {
+                // vary the values a little, so that the delta encoding has something to do
+                values[block + counter] = std::uint32_t(1 + ((sampleSequence + block + counter) % 1024));
+            }
+        }
+
+        return bufferIndex;
+    }
+
+    void MaliSimulatedHwCntrReader::releaseBuffer(std::uint32_t bufferIndex)
+    {
+        {
+            std::lock_guard<std::mutex> lock {mutex};
+            bufferInUse[bufferIndex] = false;
+        }
+        condition.notify_all();
+    }
+}
@@ -0,0 +1,97 @@
+/* Copyright (C) 2022 by Arm Limited. All rights reserved. */
+
+#ifndef NATIVE_GATOR_DAEMON_MALI_USERSPACE_MALISIMULATEDHWCNTRREADER_H_
+#define NATIVE_GATOR_DAEMON_MALI_USERSPACE_MALISIMULATEDHWCNTRREADER_H_
+
+#include "mali_userspace/IMaliHwCntrReader.h"
+#include "mali_userspace/MaliDevice.h"
+#include "mali_userspace/MaliDeviceApi.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+namespace mali_userspace {
+    /** Configures the simulated Mali device, from the GATORD_SIMULATED_MALI environment variable */
+    struct MaliSimulatedDeviceConfig {
+        /** The GPUID to report, which must be one gatord knows the counters of */
+        std::uint32_t gpuId;
+        std::uint32_t numShaderCores;
+        std::uint32_t numL2Slices;
+
+        /**
+         * Read the configuration, which is given as `<gpuid>[,<shader cores>[,<l2 slices>]]`
+         *
+         * @return The configuration, or nothing if the device is not simulated
+         */
+        static std::optional<MaliSimulatedDeviceConfig> fromEnvironment();
+    };
+
+    /**
+     * Create the device api of a simulated device, which has no /dev/mali behind it and so can only be read with a
+     * MaliSimulatedHwCntrReader
+     */
+    std::unique_ptr<IMaliDeviceApi> createSimulatedMaliDeviceApi(const MaliSimulatedDeviceConfig & config);
+
+    /**
+     * Stands in for MaliHwCntrReader on a simulated device, so that the cost of the GPU counters can be measured for a
+     * GPU with any number of shader cores without having one.
+     *
+     * Samples are produced in the V5 hwcnt layout at the interval given to startPeriodicSampling, with every counter
+     * enabled and non-zero. As with the kernel, there are a fixed number of sample buffers, and a sample that is due
+     * while all of them are held is dropped.
+     */
+    class MaliSimulatedHwCntrReader : public IMaliHwCntrReader {
+    public:
+        /**
+         * Create a new instance of the MaliSimulatedHwCntrReader object associated with the device object
+         *
+         * @return The new reader, or nullptr if the device is not simulated
+         */
+        static std::unique_ptr<MaliSimulatedHwCntrReader> createReader(const MaliDevice & device);
+
+        explicit MaliSimulatedHwCntrReader(const MaliDevice & device);
+        ~MaliSimulatedHwCntrReader() override = default;
+
+        MaliSimulatedHwCntrReader(const MaliSimulatedHwCntrReader &) = delete;
+        MaliSimulatedHwCntrReader & operator=(const MaliSimulatedHwCntrReader &) = delete;
+        MaliSimulatedHwCntrReader(MaliSimulatedHwCntrReader &&) = delete;
+        MaliSimulatedHwCntrReader & operator=(MaliSimulatedHwCntrReader &&) = delete;
+
+        const MaliDevice & getDevice() const override { return device; }
+        HardwareVersion getHardwareVersion() const override;
+        std::size_t getBufferCount() const override;
+        SampleBuffer waitForBuffer(int timeout) override;
+        bool startPeriodicSampling(uint32_t interval) override;
+        void interrupt() override;
+
+    private:
+        /** Mali device object */
+        const MaliDevice & device;
+        /** Size of a single sample buffer */
+        const std::size_t sampleBufferSize;
+        std::mutex mutex {};
+        std::condition_variable condition {};
+        /** Sample capture memory, for every buffer */
+        std::vector<std::uint32_t> sampleMemory;
+        std::vector<bool> bufferInUse;
+        /** The sampling interval in nanoseconds, or zero when not sampling */
+        std::uint64_t interval {0};
+        /** The time the next sample is due */
+        std::uint64_t nextSampleTime {0};
+        std::uint32_t sequence {0};
+        bool interrupted {false};
+
+        /** Fill in a free buffer with the next sample, returning its index or nothing if all are held */
+        std::optional<std::uint32_t> produceSample();
+
+        /** Return a buffer obtained with waitForBuffer */
+        void releaseBuffer(std::uint32_t bufferIndex);
+    };
+}
+
+#endif /* NATIVE_GATOR_DAEMON_MALI_USERSPACE_MALISIMULATEDHWCNTRREADER_H_ */
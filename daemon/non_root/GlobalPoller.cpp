@@ -1,19 +1,18 @@
-/* Copyright (C) 2017-2020 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2017-2022 by Arm Limited. All rights reserved. */
 
 #include "non_root/GlobalPoller.h"
 
-#include "lib/FsEntry.h"
 #include "linux/proc/ProcLoadAvgFileRecord.h"
-#include "linux/proc/ProcStatFileRecord.h"
-
-#include <string>
 
 namespace non_root {
-    static const lib::FsEntry PROC_LOADAVG = lib::FsEntry::create("/proc/loadavg");
-    static const lib::FsEntry PROC_STAT = lib::FsEntry::create("/proc/stat");
+    static constexpr const char PROC[] = "/proc";
+    static constexpr const char LOADAVG[] = "loadavg";
+    static constexpr const char STAT[] = "stat";
 
     GlobalPoller::GlobalPoller(GlobalStatsTracker & globalStateTracker_, lib::TimestampSource & timestampSource_)
-        : globalStateTracker(globalStateTracker_), timestampSource(timestampSource_)
+        : globalStateTracker(globalStateTracker_),
+          timestampSource(timestampSource_),
+          procDir(lib::DirectoryFd::open(PROC))
     {
     }
 
@@ -22,16 +21,17 @@ namespace non_root {
         // do /proc/loadavg
         {
             lnx::ProcLoadAvgFileRecord loadAvgRecord;
-            if (lnx::ProcLoadAvgFileRecord::parseLoadAvgFile(loadAvgRecord,
-                                                             lib::readFileContents(PROC_LOADAVG).c_str())) {
+            const auto loadAvgContents = procDir.readFile(LOADAVG, loadAvgBuffer);
+            if (loadAvgContents
+                && lnx::ProcLoadAvgFileRecord::parseLoadAvgFile(loadAvgRecord, loadAvgContents->data())) {
                 globalStateTracker.updateFromProcLoadAvgFileRecord(loadAvgRecord);
             }
         }
 
         // do /proc/stat
         {
-
-            lnx::ProcStatFileRecord statRecord(lib::readFileContents(PROC_STAT).c_str());
+            const auto statContents = procDir.readFile(STAT, statBuffer);
+            lnx::ProcStatFileRecord::parseStatFile(statRecord, (statContents ? statContents->data() : ""));
             globalStateTracker.updateFromProcStatFileRecord(statRecord);
         }
 
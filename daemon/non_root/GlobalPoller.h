@@ -1,11 +1,15 @@
-/* Copyright (C) 2017-2020 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2017-2022 by Arm Limited. All rights reserved. */
 
 #ifndef INCLUDE_NON_ROOT_GLOBALPOLLER_H
 #define INCLUDE_NON_ROOT_GLOBALPOLLER_H
 
+#include "lib/DirectoryFd.h"
 #include "lib/TimestampSource.h"
+#include "linux/proc/ProcStatFileRecord.h"
 #include "non_root/GlobalStatsTracker.h"
 
+#include <vector>
+
 namespace non_root {
     /**
      * Scans the contents of /proc/stat and /proc/loadavg passing the extracted records into the GlobalStatsTracker object
@@ -19,6 +23,12 @@ namespace non_root {
     private:
         GlobalStatsTracker & globalStateTracker;
         lib::TimestampSource & timestampSource;
+        // /proc, which the files are read relative to
+        lib::DirectoryFd procDir;
+        // reused on each poll to avoid allocating
+        std::vector<char> loadAvgBuffer {};
+        std::vector<char> statBuffer {};
+        lnx::ProcStatFileRecord statRecord {};
     };
 }
 
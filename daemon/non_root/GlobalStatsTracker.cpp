@@ -1,4 +1,4 @@
-/* Copyright (C) 2017-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2017-2022 by Arm Limited. All rights reserved. */
 
 #include "non_root/GlobalStatsTracker.h"
 
@@ -8,18 +8,24 @@ namespace non_root {
 
     void GlobalStatsTracker::PerCoreStatsTracker::sendStats(unsigned long long timestampNS,
                                                             GlobalStateChangeHandler & handler,
-                                                            unsigned long cpuID)
+                                                            unsigned long cpuID,
+                                                            bool keyframe)
     {
-        writeCounter(timestampNS, handler, cpuID, DeltaGlobalCounter::TIME_CPU_USER, timeUserTicks);
-        writeCounter(timestampNS, handler, cpuID, DeltaGlobalCounter::TIME_CPU_NICE, timeNiceTicks);
-        writeCounter(timestampNS, handler, cpuID, DeltaGlobalCounter::TIME_CPU_SYSTEM, timeSystemTicks);
-        writeCounter(timestampNS, handler, cpuID, DeltaGlobalCounter::TIME_CPU_IDLE, timeIdleTicks);
-        writeCounter(timestampNS, handler, cpuID, DeltaGlobalCounter::TIME_CPU_IOWAIT, timeIowaitTicks);
-        writeCounter(timestampNS, handler, cpuID, DeltaGlobalCounter::TIME_CPU_IRQ, timeIrqTicks);
-        writeCounter(timestampNS, handler, cpuID, DeltaGlobalCounter::TIME_CPU_SOFTIRQ, timeSoftirqTicks);
-        writeCounter(timestampNS, handler, cpuID, DeltaGlobalCounter::TIME_CPU_STEAL, timeStealTicks);
-        writeCounter(timestampNS, handler, cpuID, DeltaGlobalCounter::TIME_CPU_GUEST, timeGuestTicks);
-        writeCounter(timestampNS, handler, cpuID, DeltaGlobalCounter::TIME_CPU_GUEST_NICE, timeGuestNiceTicks);
+        writeCounter(timestampNS, handler, cpuID, DeltaGlobalCounter::TIME_CPU_USER, timeUserTicks, keyframe);
+        writeCounter(timestampNS, handler, cpuID, DeltaGlobalCounter::TIME_CPU_NICE, timeNiceTicks, keyframe);
+        writeCounter(timestampNS, handler, cpuID, DeltaGlobalCounter::TIME_CPU_SYSTEM, timeSystemTicks, keyframe);
+        writeCounter(timestampNS, handler, cpuID, DeltaGlobalCounter::TIME_CPU_IDLE, timeIdleTicks, keyframe);
+        writeCounter(timestampNS, handler, cpuID, DeltaGlobalCounter::TIME_CPU_IOWAIT, timeIowaitTicks, keyframe);
+        writeCounter(timestampNS, handler, cpuID, DeltaGlobalCounter::TIME_CPU_IRQ, timeIrqTicks, keyframe);
+        writeCounter(timestampNS, handler, cpuID, DeltaGlobalCounter::TIME_CPU_SOFTIRQ, timeSoftirqTicks, keyframe);
+        writeCounter(timestampNS, handler, cpuID, DeltaGlobalCounter::TIME_CPU_STEAL, timeStealTicks, keyframe);
+        writeCounter(timestampNS, handler, cpuID, DeltaGlobalCounter::TIME_CPU_GUEST, timeGuestTicks, keyframe);
+        writeCounter(timestampNS,
+                     handler,
+                     cpuID,
+                     DeltaGlobalCounter::TIME_CPU_GUEST_NICE,
+                     timeGuestNiceTicks,
+                     keyframe);
 
         first = false;
     }
@@ -44,10 +50,13 @@ namespace non_root {
                                                                GlobalStateChangeHandler & handler,
                                                                unsigned long cpuID,
                                                                DeltaGlobalCounter id,
-                                                               DeltaCounter<T> & counter)
+                                                               DeltaCounter<T> & counter,
+                                                               bool keyframe)
     {
         // send zero for first event to avoid potential big spike
-        handler.deltaCounter(timestampNS, cpuID, id, first ? 0 : counter.delta());
+        if (first || keyframe || counter.changed()) {
+            handler.deltaCounter(timestampNS, cpuID, id, first ? 0 : counter.delta());
+        }
         counter.done();
     }
 
@@ -55,20 +64,23 @@ namespace non_root {
 
     void GlobalStatsTracker::sendStats(unsigned long long timestampNS)
     {
-        writeCounter(timestampNS, AbsoluteGlobalCounter::LOADAVG_1_MINUTE, loadavgOver1Minute);
-        writeCounter(timestampNS, AbsoluteGlobalCounter::LOADAVG_5_MINUTES, loadavgOver5Minutes);
-        writeCounter(timestampNS, AbsoluteGlobalCounter::LOADAVG_15_MINUTES, loadavgOver15Minutes);
-        writeCounter(timestampNS, AbsoluteGlobalCounter::NUM_PROCESSES_RUNNING, numProcessesRunning);
-        writeCounter(timestampNS, AbsoluteGlobalCounter::NUM_PROCESSES_EXISTING, numProcessesExist);
-        writeCounter(timestampNS, DeltaGlobalCounter::NUM_CONTEXT_SWITCHES, numContextSwitchs);
-        writeCounter(timestampNS, DeltaGlobalCounter::NUM_IRQ, numIrq);
-        writeCounter(timestampNS, DeltaGlobalCounter::NUM_SOFTIRQ, numSoftIrq);
-        writeCounter(timestampNS, DeltaGlobalCounter::NUM_FORKS, numForks);
+        // counters are only sent when changed, except for the periodic keyframe of every value
+        const bool keyframe = first || ((sendCount++ % KEYFRAME_INTERVAL) == 0);
+
+        writeCounter(timestampNS, AbsoluteGlobalCounter::LOADAVG_1_MINUTE, loadavgOver1Minute, keyframe);
+        writeCounter(timestampNS, AbsoluteGlobalCounter::LOADAVG_5_MINUTES, loadavgOver5Minutes, keyframe);
+        writeCounter(timestampNS, AbsoluteGlobalCounter::LOADAVG_15_MINUTES, loadavgOver15Minutes, keyframe);
+        writeCounter(timestampNS, AbsoluteGlobalCounter::NUM_PROCESSES_RUNNING, numProcessesRunning, keyframe);
+        writeCounter(timestampNS, AbsoluteGlobalCounter::NUM_PROCESSES_EXISTING, numProcessesExist, keyframe);
+        writeCounter(timestampNS, DeltaGlobalCounter::NUM_CONTEXT_SWITCHES, numContextSwitchs, keyframe);
+        writeCounter(timestampNS, DeltaGlobalCounter::NUM_IRQ, numIrq, keyframe);
+        writeCounter(timestampNS, DeltaGlobalCounter::NUM_SOFTIRQ, numSoftIrq, keyframe);
+        writeCounter(timestampNS, DeltaGlobalCounter::NUM_FORKS, numForks, keyframe);
 
         const bool oneOneCoreStatsEntry = (perCoreStats.size() == 1);
         for (auto & perCoreEntry : perCoreStats) {
             if (oneOneCoreStatsEntry || (perCoreEntry.first != lnx::ProcStatFileRecord::GLOBAL_CPU_TIME_ID)) {
-                perCoreEntry.second.sendStats(timestampNS, handler, perCoreEntry.first);
+                perCoreEntry.second.sendStats(timestampNS, handler, perCoreEntry.first, keyframe);
             }
         }
 
@@ -108,19 +120,25 @@ namespace non_root {
     template<typename T>
     void GlobalStatsTracker::writeCounter(unsigned long long timestampNS,
                                           AbsoluteGlobalCounter id,
-                                          AbsoluteCounter<T> & counter)
+                                          AbsoluteCounter<T> & counter,
+                                          bool keyframe)
     {
-        handler.absoluteCounter(timestampNS, id, counter.value());
+        if (keyframe || counter.changed()) {
+            handler.absoluteCounter(timestampNS, id, counter.value());
+        }
         counter.done();
     }
 
     template<typename T>
     void GlobalStatsTracker::writeCounter(unsigned long long timestampNS,
                                           DeltaGlobalCounter id,
-                                          DeltaCounter<T> & counter)
+                                          DeltaCounter<T> & counter,
+                                          bool keyframe)
     {
         // send zero for first event to avoid potential big spike
-        handler.deltaCounter(timestampNS, id, first ? 0 : counter.delta());
+        if (keyframe || counter.changed()) {
+            handler.deltaCounter(timestampNS, id, first ? 0 : counter.delta());
+        }
         counter.done();
     }
 }
@@ -1,4 +1,4 @@
-/* Copyright (C) 2017-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2017-2022 by Arm Limited. All rights reserved. */
 
 #ifndef INCLUDE_NON_ROOT_GLOBALSTATSTRACKER_H
 #define INCLUDE_NON_ROOT_GLOBALSTATSTRACKER_H
@@ -23,7 +23,10 @@ namespace non_root {
          */
         class PerCoreStatsTracker {
         public:
-            void sendStats(unsigned long long timestampNS, GlobalStateChangeHandler & handler, unsigned long cpuID);
+            void sendStats(unsigned long long timestampNS,
+                           GlobalStateChangeHandler & handler,
+                           unsigned long cpuID,
+                           bool keyframe);
             void updateFromProcStatFileRecordCpuTime(const lnx::ProcStatFileRecord::CpuTime & record);
 
         private:
@@ -44,12 +47,19 @@ namespace non_root {
                               GlobalStateChangeHandler & handler,
                               unsigned long cpuID,
                               DeltaGlobalCounter id,
-                              DeltaCounter<T> & counter);
+                              DeltaCounter<T> & counter,
+                              bool keyframe);
         };
 
         /* to convert loadavg values from double to unsigned long */
         static constexpr const unsigned long LOADAVG_MULTIPLIER = 100;
 
+        /**
+         * Counters are only sent when their value changes, except that every counter is sent once in every this many
+         * calls to sendStats
+         */
+        static constexpr unsigned KEYFRAME_INTERVAL = 100;
+
         GlobalStatsTracker(GlobalStateChangeHandler & handler);
 
         void sendStats(unsigned long long timestampNS);
@@ -68,13 +78,20 @@ namespace non_root {
         DeltaCounter<unsigned long> numSoftIrq {};
         DeltaCounter<unsigned long> numForks {};
         GlobalStateChangeHandler & handler;
+        unsigned sendCount {0};
         bool first {true};
 
         template<typename T>
-        void writeCounter(unsigned long long timestampNS, AbsoluteGlobalCounter id, AbsoluteCounter<T> & counter);
+        void writeCounter(unsigned long long timestampNS,
+                          AbsoluteGlobalCounter id,
+                          AbsoluteCounter<T> & counter,
+                          bool keyframe);
 
         template<typename T>
-        void writeCounter(unsigned long long timestampNS, DeltaGlobalCounter id, DeltaCounter<T> & counter);
+        void writeCounter(unsigned long long timestampNS,
+                          DeltaGlobalCounter id,
+                          DeltaCounter<T> & counter,
+                          bool keyframe);
     };
 }
 
@@ -12,6 +12,26 @@
 #include <string_view>
 
 namespace non_root {
+    namespace {
+        using buffer_utils::PackedInt32;
+        using buffer_utils::PackedInt64;
+
+        /** The message type, the time, the cookie, the pid and the tid */
+        using ActivityLinkLayout =
+            buffer_utils::FixedFrameLayout<PackedInt32, PackedInt64, PackedInt32, PackedInt32, PackedInt32>;
+        /** The time, the core, the key and the value */
+        using CounterLayout = buffer_utils::FixedFrameLayout<PackedInt64, PackedInt32, PackedInt32, PackedInt64>;
+        /** The core, the message type, the time, the tid and the state */
+        using SchedSwitchLayout =
+            buffer_utils::FixedFrameLayout<PackedInt32, PackedInt32, PackedInt64, PackedInt32, PackedInt32>;
+        /** The core, the message type, the time and the tid */
+        using SchedThreadExitLayout =
+            buffer_utils::FixedFrameLayout<PackedInt32, PackedInt32, PackedInt64, PackedInt32>;
+        /** The core, the timestamp key and the time, the tid key and the tid, then the key and the value */
+        using ThreadCounterLayout = buffer_utils::
+            FixedFrameLayout<PackedInt32, PackedInt32, PackedInt64, PackedInt32, PackedInt64, PackedInt32, PackedInt64>;
+    }
+
     MixedFrameBuffer::Frame::Frame(IRawFrameBuilder & parent_, FrameType frameType)
         : parent(parent_),
           bytesAvailable(parent.bytesAvailable() - IRawFrameBuilder::MAX_FRAME_HEADER_SIZE),
@@ -83,6 +103,13 @@ namespace non_root {
         }
     }
 
+    void MixedFrameBuffer::Frame::writePacked(const char * bytes, int length)
+    {
+        if (checkSize(length)) {
+            parent.writeBytes(bytes, length);
+        }
+    }
+
     bool MixedFrameBuffer::Frame::isValid() const { return valid; }
 
     MixedFrameBuffer::MixedFrameBuffer(IRawFrameBuilder & buffer_, CommitTimeChecker flushIsNeeded_)
@@ -97,11 +124,7 @@ namespace non_root {
     {
         Frame frame(buffer, FrameType::ACTIVITY_TRACE);
 
-        frame.packInt(static_cast<int32_t>(MessageType::LINK));
-        frame.packInt64(currentTime);
-        frame.packInt(cookie);
-        frame.packInt(pid);
-        frame.packInt(tid);
+        frame.packFixed<ActivityLinkLayout>(static_cast<int32_t>(MessageType::LINK), currentTime, cookie, pid, tid);
 
         flushIfNeeded(currentTime);
 
@@ -115,10 +138,7 @@ namespace non_root {
     {
         Frame frame(buffer, FrameType::COUNTER);
 
-        frame.packInt64(currentTime);
-        frame.packInt(core);
-        frame.packInt(key);
-        frame.packInt64(value);
+        frame.packFixed<CounterLayout>(currentTime, core, key, value);
 
         flushIfNeeded(currentTime);
 
@@ -166,12 +186,11 @@ namespace non_root {
                                                    std::int32_t state)
     {
         Frame frame(buffer, FrameType::SCHED_TRACE);
-        frame.packInt(core);
-
-        frame.packInt(static_cast<int32_t>(MessageType::SCHED_SWITCH));
-        frame.packInt64(currentTime);
-        frame.packInt(tid);
-        frame.packInt(state);
+        frame.packFixed<SchedSwitchLayout>(core,
+                                           static_cast<int32_t>(MessageType::SCHED_SWITCH),
+                                           currentTime,
+                                           tid,
+                                           state);
 
         flushIfNeeded(currentTime);
 
@@ -181,11 +200,10 @@ namespace non_root {
     bool MixedFrameBuffer::schedFrameThreadExitMessage(std::uint64_t currentTime, std::int32_t core, std::int32_t tid)
     {
         Frame frame(buffer, FrameType::SCHED_TRACE);
-        frame.packInt(core);
-
-        frame.packInt(static_cast<int32_t>(MessageType::THREAD_EXIT));
-        frame.packInt64(currentTime);
-        frame.packInt(tid);
+        frame.packFixed<SchedThreadExitLayout>(core,
+                                               static_cast<int32_t>(MessageType::THREAD_EXIT),
+                                               currentTime,
+                                               tid);
 
         flushIfNeeded(currentTime);
 
@@ -249,13 +267,7 @@ namespace non_root {
         // have to send as block counter in order to be able to send tid :-(
         Frame frame(buffer, FrameType::BLOCK_COUNTER);
 
-        frame.packInt(core);
-        frame.packInt(0);
-        frame.packInt64(currentTime);
-        frame.packInt(1);
-        frame.packInt64(tid);
-        frame.packInt(key);
-        frame.packInt64(value);
+        frame.packFixed<ThreadCounterLayout>(core, 0, currentTime, 1, tid, key, value);
 
         flushIfNeeded(currentTime);
 
@@ -264,7 +276,7 @@ namespace non_root {
 
     void MixedFrameBuffer::flushIfNeeded(std::uint64_t currentTime)
     {
-        if (flushIsNeeded(currentTime, buffer.needsFlush())) {
+        if (flushIsNeeded(currentTime, buffer.needsFlush(), buffer.bytesSinceFlush())) {
             buffer.flush();
         }
     }
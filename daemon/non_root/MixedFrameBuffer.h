@@ -4,11 +4,14 @@
 #define INCLUDE_NON_ROOT_MIXEDFRAMEBUFFER_H
 
 #include "CommitTimeChecker.h"
+#include "FixedFrameLayout.h"
 #include "Protocol.h"
 
+#include <array>
 #include <cstdint>
 #include <string>
 #include <string_view>
+#include <utility>
 
 class IRawFrameBuilder;
 class Sender;
@@ -27,12 +30,23 @@ namespace non_root {
             void writeString(std::string_view);
             bool isValid() const;
 
+            /** Packs a fixed sequence of fields, as described by some buffer_utils::FixedFrameLayout */
+            template<typename Layout, typename... Values>
+            void packFixed(Values &&... values)
+            {
+                std::array<char, Layout::MAX_SIZE> bytes;
+                int length = 0;
+                Layout::pack(bytes.data(), length, std::forward<Values>(values)...);
+                writePacked(bytes.data(), length);
+            }
+
         private:
             IRawFrameBuilder & parent;
             int bytesAvailable;
             bool valid;
 
             bool checkSize(int size);
+            void writePacked(const char * bytes, int length);
         };
 
         using size_type = unsigned long;
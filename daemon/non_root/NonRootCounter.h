@@ -1,4 +1,4 @@
-/* Copyright (C) 2017-2020 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2017-2022 by Arm Limited. All rights reserved. */
 
 #ifndef INCLUDE_NON_ROOT_NONROOTCOUNTER_H
 #define INCLUDE_NON_ROOT_NONROOTCOUNTER_H
@@ -33,10 +33,12 @@ namespace non_root {
 
         PROCESS_ABS_DATA_SIZE,
         PROCESS_ABS_NUM_THREADS,
+        PROCESS_ABS_PSS_SIZE,
         PROCESS_ABS_RES_LIMIT,
         PROCESS_ABS_RES_SIZE,
         PROCESS_ABS_SHARED_SIZE,
         PROCESS_ABS_TEXT_SIZE,
+        PROCESS_ABS_USS_SIZE,
         PROCESS_ABS_VM_SIZE,
 
         PROCESS_DELTA_MAJOR_FAULTS,
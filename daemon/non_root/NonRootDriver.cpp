@@ -117,6 +117,7 @@ namespace non_root {
         // assume if we can access these for 'self' we can access for other *accessible* PID directories
         const bool canAccessProcSelfStat = (access("/proc/self/stat", R_OK) == 0);
         const bool canAccessProcSelfStatm = (access("/proc/self/statm", R_OK) == 0);
+        const bool canAccessProcSelfSmapsRollup = (access("/proc/self/smaps_rollup", R_OK) == 0);
 
         // proc counters are fixed so are not listed in events.xml; instead enumerate them here
         if (canAccessProcLoadAvg) {
@@ -490,6 +491,47 @@ namespace non_root {
                 LOG_SETUP("/proc support\nCannot access /proc/self/statm");
             }
 
+            // smaps_rollup was added in Linux 4.14
+            if (canAccessProcSelfSmapsRollup) {
+                setCounters(new NonRootDriverCounter(
+                    getCounters(),
+                    NonRootCounter::PROCESS_ABS_PSS_SIZE,
+                    "nonroot_process_abs_pss_size", //
+                    "PSS Size",                     //
+                    "Process (Memory)",             //
+                    "Proportional Set Size: resident memory in bytes, with each shared page divided between the "
+                    "processes that map it. As it is costly to read, it is only sampled about once a second, and only "
+                    "for the processes with the largest resident set size. "
+                    "See the description of /proc/[PID]/smaps_rollup [Pss] in 'man proc.5' for more details.", //
+                    "maximum",
+                    "absolute",
+                    "B",
+                    "overlay",
+                    1.0,
+                    false,
+                    true));
+                setCounters(new NonRootDriverCounter(
+                    getCounters(),
+                    NonRootCounter::PROCESS_ABS_USS_SIZE,
+                    "nonroot_process_abs_uss_size", //
+                    "USS Size",                     //
+                    "Process (Memory)",             //
+                    "Unique Set Size: resident memory in bytes that is private to the process. As it is costly to "
+                    "read, it is only sampled about once a second, and only for the processes with the largest "
+                    "resident set size. See the description of /proc/[PID]/smaps_rollup [Private_Clean] and "
+                    "[Private_Dirty] in 'man proc.5' for more details.", //
+                    "maximum",
+                    "absolute",
+                    "B",
+                    "overlay",
+                    1.0,
+                    false,
+                    true));
+            }
+            else {
+                LOG_SETUP("/proc support\nCannot access /proc/self/smaps_rollup");
+            }
+
             if (canAccessProcSelfStat) {
                 setCounters(new NonRootDriverCounter(
                     getCounters(),
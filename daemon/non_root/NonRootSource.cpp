@@ -6,8 +6,12 @@
 #include "BlockCounterFrameBuilder.h"
 #include "BlockCounterMessageConsumer.h"
 #include "Child.h"
+#include "CpuBudgetGovernor.h"
 #include "ICpuInfo.h"
 #include "Logging.h"
+#include "MemoryBudget.h"
+#include "PeriodicPacer.h"
+#include "PipelineStats.h"
 #include "Protocol.h"
 #include "SessionData.h"
 #include "lib/String.h"
@@ -19,9 +23,9 @@
 #include "non_root/ProcessPoller.h"
 #include "non_root/ProcessStateChangeHandler.h"
 
+#include <chrono>
 #include <utility>
 
-#include <sys/prctl.h>
 #include <sys/utsname.h>
 #include <unistd.h>
 
@@ -34,9 +38,11 @@ namespace non_root {
                                  std::function<void()> profilingStartedCallback_,
                                  const ICpuInfo & cpuInfo)
         : mSwitchBuffers(default_buffer_size, senderSem_),
-          mGlobalCounterBuffer(default_buffer_size, senderSem_),
-          mProcessCounterBuffer(default_buffer_size, senderSem_),
-          mMiscBuffer(default_buffer_size, senderSem_),
+          mGlobalCounterBuffer(static_cast<int>(gMemoryBudget.allocate("non-root", 1, default_buffer_size)),
+                               senderSem_),
+          mProcessCounterBuffer(static_cast<int>(gMemoryBudget.allocate("non-root", 1, default_buffer_size)),
+                                senderSem_),
+          mMiscBuffer(static_cast<int>(gMemoryBudget.allocate("non-root", 1, default_buffer_size)), senderSem_),
           interrupted(false),
           timestampSource(CLOCK_MONOTONIC_RAW),
           driver(driver_),
@@ -47,9 +53,10 @@ namespace non_root {
     {
     }
 
-    void NonRootSource::run(std::uint64_t /* monotonicStarted */, std::function<void()> endSession)
+    // one-shot captures are ended by gOneShotBudget, rather than when one of these buffers is full
+    void NonRootSource::run(std::uint64_t /* monotonicStarted */, std::function<void()> /* endSession */)
     {
-        prctl(PR_SET_NAME, reinterpret_cast<unsigned long>(&"gatord-nrsrc"), 0, 0, 0);
+        PeriodicPacer::configureThread("gatord-nrsrc");
 
         std::map<NonRootCounter, int> enabledCounters = driver.getEnabledCounters();
 
@@ -72,21 +79,26 @@ namespace non_root {
                                                        mSwitchBuffers,
                                                        enabledCounters);
         ProcessStateTracker processStateTracker(processChangeHandler, getBootTimeTicksBase(), clktck, pageSize);
-        ProcessPoller processPoller(processStateTracker, timestampSource);
+        // smaps_rollup is comparatively expensive to read, so is only sampled if its counters are wanted
+        const bool sampleSmapsRollup = (enabledCounters.count(NonRootCounter::PROCESS_ABS_PSS_SIZE) != 0)
+                                    || (enabledCounters.count(NonRootCounter::PROCESS_ABS_USS_SIZE) != 0);
+        ProcessPoller processPoller(processStateTracker, timestampSource, sampleSmapsRollup);
 
         profilingStartedCallback();
         execTargetAppCallback();
 
-        const useconds_t sleepIntervalUs =
-            (gSessionData.mSampleRate < 1000 ? 10000 : 1000); // select 1ms or 10ms depending on normal or low rate
+        // select 1ms or 10ms depending on normal or low rate, aligned to the millisecond boundaries
+        const auto pollInterval = std::chrono::milliseconds(gSessionData.mSampleRate < 1000 ? 10 : 1);
+        PeriodicPacer pacer {pollInterval, true};
+        unsigned throttleShift = 0;
 
         while (!interrupted) {
-            // check buffer not full
-            if (gSessionData.mOneShot
-                && (mGlobalCounterBuffer.isFull() || mProcessCounterBuffer.isFull() || mMiscBuffer.isFull()
-                    || mSwitchBuffers.anyFull())) {
-                LOG_DEBUG("One shot (nrsrc)");
-                endSession();
+            pacer.wait();
+
+            const unsigned newThrottleShift = gCpuBudgetGovernor.update();
+            if (newThrottleShift != throttleShift) {
+                throttleShift = newThrottleShift;
+                pacer.setPeriod(pollInterval * (1U << throttleShift));
             }
 
             // update global stats
@@ -94,15 +106,10 @@ namespace non_root {
 
             // update process stats
             processPoller.poll();
-
-            // sleep an amount of time to align to the next 1 or 10 millisecond boundary depending on rate
-            const unsigned long long timestampNowUs =
-                (timestampSource.getTimestampNS() + 500) / 1000; // round to nearest uS
-            const useconds_t sleepUs = sleepIntervalUs - (timestampNowUs % sleepIntervalUs);
-
-            usleep(sleepUs);
         }
 
+        gPipelineStats.onPollingLoopEnd("Non-root polling (gatord-nrsrc)", pacer.getStats());
+
         processCounterBuilder.flush();
         globalCounterBuilder.flush();
 
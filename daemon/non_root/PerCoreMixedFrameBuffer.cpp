@@ -1,10 +1,11 @@
-/* Copyright (C) 2017-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2017-2022 by Arm Limited. All rights reserved. */
 #define BUFFER_USE_SESSION_DATA
 
 #include "non_root/PerCoreMixedFrameBuffer.h"
 
 #include "ISender.h"
 #include "Logging.h"
+#include "MemoryBudget.h"
 #include "SessionData.h"
 
 namespace non_root {
@@ -51,7 +52,10 @@ namespace non_root {
         if (wrapperPtrRef == nullptr) {
             auto & bufferPtrRef = buffers[core];
             if (bufferPtrRef == nullptr) {
-                bufferPtrRef = std::make_unique<Buffer>(bufferSize, readerSem);
+                // the context switches are the busiest of the non-root data
+                const auto size = gMemoryBudget.allocate("non-root context switches", 1, bufferSize);
+                bufferPtrRef =
+                    std::make_unique<Buffer>(static_cast<int>(size), readerSem, Buffer::Backing::PREFAULTED);
             }
 
             wrapperPtrRef =
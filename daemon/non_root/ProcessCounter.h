@@ -1,4 +1,4 @@
-/* Copyright (C) 2017-2020 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2017-2022 by Arm Limited. All rights reserved. */
 
 #ifndef INCLUDE_NON_ROOT_PROCESSCOUNTER_H
 #define INCLUDE_NON_ROOT_PROCESSCOUNTER_H
@@ -9,10 +9,12 @@ namespace non_root {
     enum class AbsoluteProcessCounter : typename std::underlying_type<NonRootCounter>::type {
         DATA_SIZE = NonRootCounterValue(NonRootCounter::PROCESS_ABS_DATA_SIZE),
         NUM_THREADS = NonRootCounterValue(NonRootCounter::PROCESS_ABS_NUM_THREADS),
+        PSS_SIZE = NonRootCounterValue(NonRootCounter::PROCESS_ABS_PSS_SIZE),
         RES_LIMIT = NonRootCounterValue(NonRootCounter::PROCESS_ABS_RES_LIMIT),
         RES_SIZE = NonRootCounterValue(NonRootCounter::PROCESS_ABS_RES_SIZE),
         SHARED_SIZE = NonRootCounterValue(NonRootCounter::PROCESS_ABS_SHARED_SIZE),
         TEXT_SIZE = NonRootCounterValue(NonRootCounter::PROCESS_ABS_TEXT_SIZE),
+        USS_SIZE = NonRootCounterValue(NonRootCounter::PROCESS_ABS_USS_SIZE),
         VM_SIZE = NonRootCounterValue(NonRootCounter::PROCESS_ABS_VM_SIZE),
     };
 
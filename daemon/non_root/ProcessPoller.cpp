@@ -1,14 +1,27 @@
-/* Copyright (C) 2017-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2017-2022 by Arm Limited. All rights reserved. */
 
 #include "non_root/ProcessPoller.h"
 
+#include "lib/AutoClosingFd.h"
+#include "lib/DirectoryFd.h"
+#include "lib/String.h"
+#include "lib/Syscall.h"
+#include "linux/proc/ProcPidSmapsRollupFileRecord.h"
+
+#include <algorithm>
+#include <functional>
+
+#include <fcntl.h>
+
 namespace non_root {
     namespace {
         class ProcessStateTrackerActiveScanIProcessPollerReceiver
             : public lnx::ProcessPollerBase::IProcessPollerReceiver {
         public:
-            ProcessStateTrackerActiveScanIProcessPollerReceiver(ProcessStateTracker::ActiveScan & activeScan_)
-                : activeScan(activeScan_)
+            ProcessStateTrackerActiveScanIProcessPollerReceiver(
+                ProcessStateTracker::ActiveScan & activeScan_,
+                std::vector<std::pair<long, int>> * processSizes_)
+                : activeScan(activeScan_), processSizes(processSizes_)
             {
             }
 
@@ -19,24 +32,84 @@ namespace non_root {
                                  const std::optional<lib::FsEntry> & exe) override
             {
                 activeScan.addProcess(pid, tid, statRecord, statmRecord, exe);
+
+                if ((processSizes != nullptr) && (pid == tid)) {
+                    processSizes->emplace_back(statRecord.getRss(), pid);
+                }
             }
 
         private:
             ProcessStateTracker::ActiveScan & activeScan;
+            std::vector<std::pair<long, int>> * processSizes;
         };
     }
 
-    ProcessPoller::ProcessPoller(ProcessStateTracker & processStateTracker_, lib::TimestampSource & timestampSource_)
-        : processStateTracker(processStateTracker_), timestampSource(timestampSource_)
+    ProcessPoller::ProcessPoller(ProcessStateTracker & processStateTracker_,
+                                 lib::TimestampSource & timestampSource_,
+                                 bool sampleSmapsRollup_)
+        : processStateTracker(processStateTracker_),
+          timestampSource(timestampSource_),
+          sampleSmapsRollup(sampleSmapsRollup_)
     {
     }
 
     void ProcessPoller::poll()
     {
+        const unsigned long long timestampNS = timestampSource.getTimestampNS();
+        const bool startSmapsRollupPeriod = sampleSmapsRollup && (timestampNS >= nextSmapsRollupPeriodNS);
+
         // get a new scan object from the process state tracker; this is how we check if a process was terminated
         // between one scan to the next
-        auto processScan = processStateTracker.beginScan(timestampSource.getTimestampNS());
-        ProcessStateTrackerActiveScanIProcessPollerReceiver receiver(*processScan);
-        ProcessPollerBase::poll(true, true, receiver);
+        auto processScan = processStateTracker.beginScan(timestampNS);
+        ProcessStateTrackerActiveScanIProcessPollerReceiver receiver(
+            *processScan,
+            (startSmapsRollupPeriod ? &processSizes : nullptr));
+        poller.poll(receiver);
+
+        // must be done before the scan ends, so that the values are sent with the rest of this scan's
+        if (sampleSmapsRollup) {
+            if (startSmapsRollupPeriod) {
+                nextSmapsRollupPeriodNS = timestampNS + SMAPS_ROLLUP_PERIOD_NS;
+            }
+            pollSmapsRollup(*processScan, startSmapsRollupPeriod);
+        }
+    }
+
+    void ProcessPoller::pollSmapsRollup(ProcessStateTracker::ActiveScan & activeScan, bool startPeriod)
+    {
+        if (startPeriod) {
+            // any processes that were not sampled in the previous period are dropped, rather than exceeding the budget
+            const std::size_t count = std::min(processSizes.size(), SMAPS_ROLLUP_TOP_PROCESSES);
+            std::partial_sort(processSizes.begin(),
+                              processSizes.begin() + count,
+                              processSizes.end(),
+                              std::greater<> {});
+
+            smapsRollupQueue.clear();
+            for (std::size_t n = count; n > 0; --n) {
+                smapsRollupQueue.push_back(processSizes[n - 1].second);
+            }
+            processSizes.clear();
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        while (!smapsRollupQueue.empty()) {
+            const int pid = smapsRollupQueue.back();
+            smapsRollupQueue.pop_back();
+
+            const lib::printf_str_t<64> path {"/proc/%d/smaps_rollup", pid};
+            const lib::AutoClosingFd fd {lib::open(path, O_RDONLY | O_CLOEXEC)};
+            if (fd) {
+                const auto contents = lib::DirectoryFd::readContents(*fd, smapsRollupBuffer);
+                lnx::ProcPidSmapsRollupFileRecord record;
+                if (contents && lnx::ProcPidSmapsRollupFileRecord::parseSmapsRollupFile(record, *contents)) {
+                    activeScan.addSmapsRollup(pid, record);
+                }
+            }
+
+            if ((std::chrono::steady_clock::now() - start) >= SMAPS_ROLLUP_BUDGET) {
+                break;
+            }
+        }
     }
 }
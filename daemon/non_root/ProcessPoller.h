@@ -1,28 +1,56 @@
-/* Copyright (C) 2017-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2017-2022 by Arm Limited. All rights reserved. */
 
 #ifndef INCLUDE_NON_ROOT_PROCESSPOLLER_H
 #define INCLUDE_NON_ROOT_PROCESSPOLLER_H
 
 #include "lib/FsEntry.h"
 #include "lib/TimestampSource.h"
-#include "linux/proc/ProcessPollerBase.h"
+#include "linux/proc/IncrementalProcessPoller.h"
 #include "non_root/ProcessStateTracker.h"
 
+#include <chrono>
+#include <cstddef>
 #include <optional>
+#include <utility>
+#include <vector>
 
 namespace non_root {
     /**
      * Scans the contents of /proc/[PID]/stat, /proc/[PID]/statm, /proc/[PID]/task/[TID]/stat and /proc/[PID]/task/[TID]/statm files
      * passing the extracted records into the ProcessStateTracker object
+     *
+     * Optionally also samples /proc/[PID]/smaps_rollup for the PSS and USS counters. As reading that file walks every
+     * mapping of the process, it is only read for the SMAPS_ROLLUP_TOP_PROCESSES processes with the largest RSS, each
+     * at most once per SMAPS_ROLLUP_PERIOD_NS, and the reads are spread over the polls so that no more than
+     * SMAPS_ROLLUP_BUDGET is spent on them in any one poll (other than for a single read).
      */
-    class ProcessPoller : private lnx::ProcessPollerBase {
+    class ProcessPoller {
     public:
-        ProcessPoller(ProcessStateTracker & processStateTracker, lib::TimestampSource & timestampSource);
+        /** The number of processes, with the largest RSS, whose smaps_rollup is sampled */
+        static constexpr std::size_t SMAPS_ROLLUP_TOP_PROCESSES = 16;
+        /** How often the processes to sample are chosen, and so how often each is sampled */
+        static constexpr unsigned long long SMAPS_ROLLUP_PERIOD_NS = 1000000000ULL;
+        /** The time after which no more smaps_rollup files are read in a poll */
+        static constexpr std::chrono::microseconds SMAPS_ROLLUP_BUDGET {200};
+
+        ProcessPoller(ProcessStateTracker & processStateTracker,
+                      lib::TimestampSource & timestampSource,
+                      bool sampleSmapsRollup);
         void poll();
 
     private:
         ProcessStateTracker & processStateTracker;
         lib::TimestampSource & timestampSource;
+        lnx::IncrementalProcessPoller poller {};
+        /** The RSS and pid of each process, collected in the scans that choose the processes to sample */
+        std::vector<std::pair<long, int>> processSizes {};
+        /** The processes still to be sampled in this period, largest last */
+        std::vector<int> smapsRollupQueue {};
+        std::vector<char> smapsRollupBuffer {};
+        unsigned long long nextSmapsRollupPeriodNS {0};
+        bool sampleSmapsRollup;
+
+        void pollSmapsRollup(ProcessStateTracker::ActiveScan & activeScan, bool startPeriod);
     };
 }
 
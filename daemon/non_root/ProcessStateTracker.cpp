@@ -1,4 +1,4 @@
-/* Copyright (C) 2017-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2017-2022 by Arm Limited. All rights reserved. */
 
 #include "non_root/ProcessStateTracker.h"
 
@@ -9,7 +9,9 @@
 #include "non_root/ProcessStateChangeHandler.h"
 
 #include <algorithm>
+#include <cstddef>
 #include <iostream>
+#include <vector>
 
 namespace non_root {
     namespace {
@@ -38,7 +40,16 @@ namespace non_root {
         const unsigned long long processTimeDelta = parent.add(timestampNS, pid, tid, statRecord, statmRecord, exe);
 
         // update time accumulation
-        accumulatedTimePerCore[statRecord.getProcessor()] += processTimeDelta;
+        const unsigned long processor = statRecord.getProcessor();
+        if (processor >= accumulatedTimePerCore.size()) {
+            accumulatedTimePerCore.resize(processor + 1, 0);
+        }
+        accumulatedTimePerCore[processor] += processTimeDelta;
+    }
+
+    void ProcessStateTracker::ActiveScan::addSmapsRollup(int pid, const lnx::ProcPidSmapsRollupFileRecord & record)
+    {
+        parent.addSmapsRollup(pid, record);
     }
 
     ProcessStateTracker::ProcessInfo::ProcessInfo()
@@ -207,6 +218,16 @@ namespace non_root {
         return processInfo.update(bootTimeBaseNS, clktck, statRecord, statmRecord, exe);
     }
 
+    void ProcessStateTracker::addSmapsRollup(int pid, const lnx::ProcPidSmapsRollupFileRecord & record)
+    {
+        // the record belongs to the process, so is tracked by its main thread; ignore it if the process has since
+        // exited
+        const auto it = trackedProcesses.find(pid);
+        if ((it != trackedProcesses.end()) && it->second.isSeenSinceLastScan() && (it->second.getPid() == pid)) {
+            it->second.update(record);
+        }
+    }
+
     /**
      * Generates events into the capture buffer based on the changes detected in the scan.
      * This process will:
@@ -222,42 +243,40 @@ namespace non_root {
      * to display an approximately correct heatmap and core map view.
      */
     void ProcessStateTracker::endScan(const ActiveScan & activeScan,
-                                      const std::map<unsigned long, unsigned long long> & accumulatedTimePerCore)
+                                      const std::vector<unsigned long long> & accumulatedTimePerCore)
     {
         runtime_assert(firstIteration || (activeScan.timestampNS > lastTimestampNS), "timestampNS <= lastTimestampNS");
 
         const unsigned long long scanDurationNS = (!firstIteration ? activeScan.timestampNS - lastTimestampNS : 0);
 
-        std::map<unsigned long, unsigned long long> relativeTimestampMap;
-        std::map<unsigned long, double> coreRunningTimeMultiplier;
-        std::map<unsigned long, double> coreTotalTimeMultiplier;
+        // these are looked up for every tracked thread, so are indexed by core rather than being maps
+        const std::size_t numberOfCores = accumulatedTimePerCore.size();
+        std::vector<unsigned long long> relativeTimestampMap(numberOfCores, 0);
+        std::vector<double> coreRunningTimeMultiplier(numberOfCores, 0);
+        std::vector<double> coreTotalTimeMultiplier(numberOfCores, 0);
 
         const double hzToNs = (1e9 / clktck);
-        for (const auto & entry : accumulatedTimePerCore) {
-            if (entry.second > 0) {
-                const unsigned long long coreDurationTicks = entry.second;
+        for (std::size_t core = 0; core < numberOfCores; ++core) {
+            const unsigned long long coreDurationTicks = accumulatedTimePerCore[core];
+            if (coreDurationTicks > 0) {
                 const unsigned long long coreDurationNs = coreDurationTicks * hzToNs;
-                const double multiplier = scanDurationNS / double(entry.second);
+                const double multiplier = scanDurationNS / double(coreDurationTicks);
 
-                coreTotalTimeMultiplier[entry.first] = multiplier;
+                coreTotalTimeMultiplier[core] = multiplier;
 
                 if (coreDurationNs < scanDurationNS) {
                     // lest time spent on core than in scan...
                     // convert direct from ticks to ns, so that any remaining time is allocated to an idle gap
                     // so the capture will end up "[PROCESS..][IDLE][PROCESS.....][IDLE...]..."
-                    coreRunningTimeMultiplier[entry.first] = hzToNs;
+                    coreRunningTimeMultiplier[core] = hzToNs;
                 }
                 else {
                     // somehow the value is bigger than expected
                     // scale ticks down accoringly
                     // there will be no idles inserted
-                    coreRunningTimeMultiplier[entry.first] = multiplier;
+                    coreRunningTimeMultiplier[core] = multiplier;
                 }
             }
-            else {
-                coreRunningTimeMultiplier[entry.first] = 0;
-                coreTotalTimeMultiplier[entry.first] = 0;
-            }
         }
 
         // iterate over all entries in the trackedProcesses map; if an entry is marked seen, then just emit any state changes
@@ -285,12 +304,16 @@ namespace non_root {
                 bool shouldSendSchedEvent = (!firstIteration) && (!processInfo.isNew()) && (processRunningTime > 0);
 
                 // calculate fake timestamp for process
-                unsigned long long & relativeTimestampEntryRef = relativeTimestampMap[processInfo.getProcessor()];
+                const auto processor = processInfo.getProcessor();
+                if (processor >= relativeTimestampMap.size()) {
+                    relativeTimestampMap.resize(processor + 1, 0);
+                    coreRunningTimeMultiplier.resize(processor + 1, 0);
+                    coreTotalTimeMultiplier.resize(processor + 1, 0);
+                }
+                unsigned long long & relativeTimestampEntryRef = relativeTimestampMap[processor];
                 const unsigned long long fakeTimestampNS = relativeTimestampEntryRef + lastTimestampNS;
-                const unsigned long long totalGapTimeNs =
-                    coreTotalTimeMultiplier[processInfo.getProcessor()] * processRunningTime;
-                const unsigned long long fakeRunningTimeNS =
-                    coreRunningTimeMultiplier[processInfo.getProcessor()] * processRunningTime;
+                const unsigned long long totalGapTimeNs = coreTotalTimeMultiplier[processor] * processRunningTime;
+                const unsigned long long fakeRunningTimeNS = coreRunningTimeMultiplier[processor] * processRunningTime;
                 // update fake timestamp tracker for core by some relative fraction of overall ticks
                 if (shouldSendSchedEvent) {
                     relativeTimestampEntryRef += std::max(fakeRunningTimeNS, totalGapTimeNs);
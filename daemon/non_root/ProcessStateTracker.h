@@ -1,4 +1,4 @@
-/* Copyright (C) 2017-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2017-2022 by Arm Limited. All rights reserved. */
 
 #ifndef INCLUDE_NON_ROOT_PROCESSSTATETRACKER_H
 #define INCLUDE_NON_ROOT_PROCESSSTATETRACKER_H
@@ -9,12 +9,14 @@
 #include <memory>
 #include <optional>
 #include <string>
+#include <vector>
 
 namespace lib {
     class FsEntry;
 }
 
 namespace lnx {
+    class ProcPidSmapsRollupFileRecord;
     class ProcPidStatFileRecord;
     class ProcPidStatmFileRecord;
 }
@@ -51,12 +53,17 @@ namespace non_root {
                             const std::optional<lnx::ProcPidStatmFileRecord> & statmRecord,
                             const std::optional<lib::FsEntry> & exe);
 
+            /**
+             * Accept one /proc/[PID]/smaps_rollup record, for a process that was already added in this scan
+             */
+            void addSmapsRollup(int pid, const lnx::ProcPidSmapsRollupFileRecord & record);
+
         private:
             /** Only ProcessStateTracker can construct */
             friend class ProcessStateTracker;
 
-            // sum up all time per core spent in system and user for all processes
-            std::map<unsigned long, unsigned long long> accumulatedTimePerCore {};
+            // sum up all time per core spent in system and user for all processes, indexed by core
+            std::vector<unsigned long long> accumulatedTimePerCore {};
             ProcessStateTracker & parent;
             unsigned long long timestampNS;
 
@@ -128,6 +135,10 @@ namespace non_root {
                                       const lnx::ProcPidStatFileRecord & statRecord,
                                       const std::optional<lnx::ProcPidStatmFileRecord> & statmRecord,
                                       const std::optional<lib::FsEntry> & exe);
+            void update(const lnx::ProcPidSmapsRollupFileRecord & record)
+            {
+                statsTracker.updateFromProcPidSmapsRollupFileRecord(record);
+            }
             void sendStats(unsigned long long timestampNS,
                            ProcessStateChangeHandler & handler,
                            bool sendFakeSchedulingEvents);
@@ -173,9 +184,11 @@ namespace non_root {
                                const std::optional<lnx::ProcPidStatmFileRecord> & statmRecord,
                                const std::optional<lib::FsEntry> & exe);
 
+        /** Accept one /proc/[PID]/smaps_rollup record */
+        void addSmapsRollup(int pid, const lnx::ProcPidSmapsRollupFileRecord & record);
+
         /** Called when active scan is destructed to mutate state */
-        void endScan(const ActiveScan & activeScan,
-                     const std::map<unsigned long, unsigned long long> & accumulatedTimePerCore);
+        void endScan(const ActiveScan & activeScan, const std::vector<unsigned long long> & accumulatedTimePerCore);
 
         /** Find the ProcessInformation object for some pid-tid pair */
         ProcessInfo & getProcessInfoFor(unsigned long long timestampNS, int pgid, int pid, int tid);
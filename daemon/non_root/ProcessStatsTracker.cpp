@@ -1,8 +1,9 @@
-/* Copyright (C) 2017-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2017-2022 by Arm Limited. All rights reserved. */
 
 #include "non_root/ProcessStatsTracker.h"
 
 #include "lib/FsEntry.h"
+#include "linux/proc/ProcPidSmapsRollupFileRecord.h"
 #include "linux/proc/ProcPidStatFileRecord.h"
 #include "linux/proc/ProcPidStatmFileRecord.h"
 #include "non_root/ProcessStateChangeHandler.h"
@@ -39,19 +40,25 @@ namespace non_root {
             exe_path.done();
         }
 
-        // send counters
-        writeCounter(timestampNS, handler, AbsoluteProcessCounter::DATA_SIZE, statm_data);
-        writeCounter(timestampNS, handler, AbsoluteProcessCounter::NUM_THREADS, stat_num_threads);
-        writeCounter(timestampNS, handler, AbsoluteProcessCounter::RES_LIMIT, stat_rsslim);
-        writeCounter(timestampNS, handler, AbsoluteProcessCounter::RES_SIZE, stat_rss);
-        writeCounter(timestampNS, handler, AbsoluteProcessCounter::SHARED_SIZE, statm_shared);
-        writeCounter(timestampNS, handler, AbsoluteProcessCounter::TEXT_SIZE, statm_text);
-        writeCounter(timestampNS, handler, AbsoluteProcessCounter::VM_SIZE, stat_vsize);
-        writeCounter(timestampNS, handler, DeltaProcessCounter::MINOR_FAULTS, stat_minflt);
-        writeCounter(timestampNS, handler, DeltaProcessCounter::MAJOR_FAULTS, stat_majflt);
-        writeCounter(timestampNS, handler, DeltaProcessCounter::UTIME, stat_utime);
-        writeCounter(timestampNS, handler, DeltaProcessCounter::STIME, stat_stime);
-        writeCounter(timestampNS, handler, DeltaProcessCounter::GUEST_TIME, stat_guest_time);
+        // send counters; these are only sent when changed (which, as most threads are asleep, is rarely), except
+        // for the periodic keyframe of every value
+        const bool keyframe = newProcess || ((sendCount++ % KEYFRAME_INTERVAL) == 0);
+        writeCounter(timestampNS, handler, AbsoluteProcessCounter::DATA_SIZE, statm_data, keyframe);
+        writeCounter(timestampNS, handler, AbsoluteProcessCounter::NUM_THREADS, stat_num_threads, keyframe);
+        writeCounter(timestampNS, handler, AbsoluteProcessCounter::RES_LIMIT, stat_rsslim, keyframe);
+        writeCounter(timestampNS, handler, AbsoluteProcessCounter::RES_SIZE, stat_rss, keyframe);
+        writeCounter(timestampNS, handler, AbsoluteProcessCounter::SHARED_SIZE, statm_shared, keyframe);
+        writeCounter(timestampNS, handler, AbsoluteProcessCounter::TEXT_SIZE, statm_text, keyframe);
+        writeCounter(timestampNS, handler, AbsoluteProcessCounter::VM_SIZE, stat_vsize, keyframe);
+        if (hasSmapsRollup) {
+            writeCounter(timestampNS, handler, AbsoluteProcessCounter::PSS_SIZE, smaps_pss, keyframe);
+            writeCounter(timestampNS, handler, AbsoluteProcessCounter::USS_SIZE, smaps_uss, keyframe);
+        }
+        writeCounter(timestampNS, handler, DeltaProcessCounter::MINOR_FAULTS, stat_minflt, keyframe);
+        writeCounter(timestampNS, handler, DeltaProcessCounter::MAJOR_FAULTS, stat_majflt, keyframe);
+        writeCounter(timestampNS, handler, DeltaProcessCounter::UTIME, stat_utime, keyframe);
+        writeCounter(timestampNS, handler, DeltaProcessCounter::STIME, stat_stime, keyframe);
+        writeCounter(timestampNS, handler, DeltaProcessCounter::GUEST_TIME, stat_guest_time, keyframe);
 
         newProcess = false;
     }
@@ -78,15 +85,25 @@ namespace non_root {
         statm_data.update(record.getData() * pageSize);
     }
 
+    void ProcessStatsTracker::updateFromProcPidSmapsRollupFileRecord(const lnx::ProcPidSmapsRollupFileRecord & record)
+    {
+        smaps_pss.update(record.getPss());
+        smaps_uss.update(record.getUss());
+        hasSmapsRollup = true;
+    }
+
     void ProcessStatsTracker::updateExe(const lib::FsEntry & exe) { exe_path.update(exe.path()); }
 
     template<typename T>
     void ProcessStatsTracker::writeCounter(unsigned long long timestampNS,
                                            ProcessStateChangeHandler & handler,
                                            AbsoluteProcessCounter id,
-                                           AbsoluteCounter<T> & counter)
+                                           AbsoluteCounter<T> & counter,
+                                           bool keyframe)
     {
-        handler.absoluteCounter(timestampNS, getProcessor(), tid, id, counter.value());
+        if (keyframe || counter.changed()) {
+            handler.absoluteCounter(timestampNS, getProcessor(), tid, id, counter.value());
+        }
         counter.done();
     }
 
@@ -94,10 +111,13 @@ namespace non_root {
     void ProcessStatsTracker::writeCounter(unsigned long long timestampNS,
                                            ProcessStateChangeHandler & handler,
                                            DeltaProcessCounter id,
-                                           DeltaCounter<T> & counter)
+                                           DeltaCounter<T> & counter,
+                                           bool keyframe)
     {
         // send zero for first event to avoid potential big spike
-        handler.deltaCounter(timestampNS, getProcessor(), tid, id, newProcess ? 0 : counter.delta());
+        if (keyframe || counter.changed()) {
+            handler.deltaCounter(timestampNS, getProcessor(), tid, id, newProcess ? 0 : counter.delta());
+        }
         counter.done();
     }
 }
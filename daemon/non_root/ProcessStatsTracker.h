@@ -1,4 +1,4 @@
-/* Copyright (C) 2017-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2017-2022 by Arm Limited. All rights reserved. */
 
 #ifndef INCLUDE_NON_ROOT_PROCESSSTATSTRACKER_H
 #define INCLUDE_NON_ROOT_PROCESSSTATSTRACKER_H
@@ -14,6 +14,7 @@ namespace lib {
 }
 
 namespace lnx {
+    class ProcPidSmapsRollupFileRecord;
     class ProcPidStatFileRecord;
     class ProcPidStatmFileRecord;
 }
@@ -26,6 +27,12 @@ namespace non_root {
      */
     class ProcessStatsTracker {
     public:
+        /**
+         * Counters are only sent when their value changes, except that every counter is sent once in every this many
+         * calls to sendStats
+         */
+        static constexpr unsigned KEYFRAME_INTERVAL = 100;
+
         ProcessStatsTracker(int pid, int tid, unsigned long pageSize);
 
         ProcessStatsTracker(const ProcessStatsTracker &) = default;
@@ -53,6 +60,7 @@ namespace non_root {
                        bool sendFakeSchedulingEvents);
         void updateFromProcPidStatFileRecord(const lnx::ProcPidStatFileRecord & record);
         void updateFromProcPidStatmFileRecord(const lnx::ProcPidStatmFileRecord & record);
+        void updateFromProcPidSmapsRollupFileRecord(const lnx::ProcPidSmapsRollupFileRecord & record);
         void updateExe(const lib::FsEntry & exe);
 
     private:
@@ -69,24 +77,31 @@ namespace non_root {
         AbsoluteCounter<unsigned long> statm_shared {};
         AbsoluteCounter<unsigned long> statm_text {};
         AbsoluteCounter<unsigned long> statm_data {};
+        AbsoluteCounter<unsigned long long> smaps_pss {};
+        AbsoluteCounter<unsigned long long> smaps_uss {};
         AbsoluteCounter<unsigned long> stat_processor {};
         AbsoluteCounter<long> stat_num_threads {};
         unsigned long pageSize;
         int pid;
         int tid;
+        unsigned sendCount {0};
         bool newProcess {true};
+        /** True once smaps_rollup was read; it is only sampled for some processes, so is not sent before then */
+        bool hasSmapsRollup {false};
 
         template<typename T>
         void writeCounter(unsigned long long timestampNS,
                           ProcessStateChangeHandler & handler,
                           AbsoluteProcessCounter id,
-                          AbsoluteCounter<T> & counter);
+                          AbsoluteCounter<T> & counter,
+                          bool keyframe);
 
         template<typename T>
         void writeCounter(unsigned long long timestampNS,
                           ProcessStateChangeHandler & handler,
                           DeltaProcessCounter id,
-                          DeltaCounter<T> & counter);
+                          DeltaCounter<T> & counter,
+                          bool keyframe);
     };
 }
 
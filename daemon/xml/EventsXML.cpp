@@ -3,6 +3,7 @@
 #include "xml/EventsXML.h"
 
 #include "CapturedXML.h"
+#include "Config.h"
 #include "Driver.h"
 #include "Logging.h"
 #include "OlyUtility.h"
@@ -12,114 +13,221 @@
 #include "xml/EventsXMLProcessor.h"
 #include "xml/PmuXML.h"
 
+#include <mutex>
 #include <string_view>
+#include <vector>
 
 namespace events_xml {
     namespace {
 #include "events_xml.h"
-    }
 
-    std::unique_ptr<mxml_node_t, void (*)(mxml_node_t *)> getStaticTree(lib::Span<const GatorCpu> clusters,
-                                                                        lib::Span<const UncorePmu> uncores)
-    {
-        mxml_unique_ptr mainXml = makeMxmlUniquePtr(nullptr);
-
-        // Load the provided or default events xml
-        if (gSessionData.mEventsXMLPath != nullptr) {
-            std::unique_ptr<FILE, int (*)(FILE *)> fl {lib::fopen_cloexec(gSessionData.mEventsXMLPath, "r"), fclose};
-            if (fl != nullptr) {
-                mainXml = makeMxmlUniquePtr(mxmlLoadFile(nullptr, fl.get(), MXML_NO_CALLBACK));
-                if (mainXml == nullptr) {
-                    LOG_ERROR("Unable to parse %s", gSessionData.mEventsXMLPath);
-                    handleException();
+        /** The processed static tree, which is the same for every session so is only parsed once per process */
+        struct StaticEvents {
+            /** The ids of the clusters and uncores the tree was processed for */
+            std::vector<std::string> key {};
+            mxml_unique_ptr xml = makeMxmlUniquePtr(nullptr);
+            mxml_node_t * events = nullptr;
+            std::map<std::string, EventCode> counterToEventMap {};
+        };
+
+        std::mutex staticEventsMutex;
+        StaticEvents staticEvents;
+
+        void addCounterToEvent(std::map<std::string, EventCode> & counterToEventMap, mxml_node_t * node)
+        {
+            const char * counter = mxmlElementGetAttr(node, "counter");
+            const char * event = mxmlElementGetAttr(node, "event");
+            if (counter == nullptr) {
+                return;
+            }
+
+            if (event != nullptr) {
+                const auto eventNo = strtoull(event, nullptr, 0);
+                counterToEventMap[counter] = EventCode(eventNo);
+            }
+            else {
+                counterToEventMap[counter] = EventCode();
+            }
+        }
+
+        /** Add the counter->event of every event element in the tree rooted at top, in document order */
+        void addCountersToEvents(std::map<std::string, EventCode> & counterToEventMap, mxml_node_t * top)
+        {
+            if ((mxmlGetType(top) == MXML_ELEMENT) && (std::string_view("event") == mxmlGetElement(top))) {
+                addCounterToEvent(counterToEventMap, top);
+            }
+
+            mxml_node_t * node = top;
+            while (true) {
+                node = mxmlFindElement(node, top, "event", nullptr, nullptr, MXML_DESCEND);
+                if (node == nullptr) {
+                    break;
                 }
+                addCounterToEvent(counterToEventMap, node);
             }
         }
-        if (mainXml == nullptr) {
-            LOG_DEBUG("Unable to locate events.xml, using default");
-            mainXml = makeMxmlUniquePtr(mxmlLoadString(nullptr, DEFAULT_EVENTS_XML.data(), MXML_NO_CALLBACK));
+
+        mxml_unique_ptr loadStaticTree(lib::Span<const GatorCpu> clusters, lib::Span<const UncorePmu> uncores)
+        {
+            mxml_unique_ptr mainXml = makeMxmlUniquePtr(nullptr);
+
+            // Load the provided or default events xml
+            if (gSessionData.mEventsXMLPath != nullptr) {
+                std::unique_ptr<FILE, int (*)(FILE *)> fl {lib::fopen_cloexec(gSessionData.mEventsXMLPath, "r"),
+                                                           fclose};
+                if (fl != nullptr) {
+                    mainXml = makeMxmlUniquePtr(mxmlLoadFile(nullptr, fl.get(), MXML_NO_CALLBACK));
+                    if (mainXml == nullptr) {
+                        LOG_ERROR("Unable to parse %s", gSessionData.mEventsXMLPath);
+                        handleException();
+                    }
+                }
+            }
+            if (mainXml == nullptr) {
+                LOG_DEBUG("Unable to locate events.xml, using default");
+                mainXml = makeMxmlUniquePtr(mxmlLoadString(nullptr, DEFAULT_EVENTS_XML.data(), MXML_NO_CALLBACK));
+            }
+
+            // Append additional events XML
+            if (gSessionData.mEventsXMLAppend != nullptr) {
+                std::unique_ptr<FILE, int (*)(FILE *)> fl {lib::fopen_cloexec(gSessionData.mEventsXMLAppend, "r"),
+                                                           fclose};
+                if (fl == nullptr) {
+                    LOG_ERROR("Unable to open additional events XML %s", gSessionData.mEventsXMLAppend);
+                    handleException();
+                }
+
+                mxml_unique_ptr appendXml = makeMxmlUniquePtr(mxmlLoadFile(nullptr, fl.get(), MXML_NO_CALLBACK));
+                if (appendXml == nullptr) {
+                    LOG_ERROR("Unable to parse %s", gSessionData.mEventsXMLAppend);
+                    handleException();
+                }
+
+                // do the merge
+                mergeTrees(mainXml.get(), std::move(appendXml));
+            }
+
+            // inject additional counter sets
+            processClusters(mainXml.get(), clusters, uncores);
+
+            // allow more events than the PMU has counters to be selected, as they are rotated onto it
+            if (gSessionData.mPmuMultiplexQuantumMs > 0) {
+                setClusterCounterSetGroups(mainXml.get(), clusters, PMU_MULTIPLEX_GROUPS);
+            }
+            return mainXml;
         }
 
-        // Append additional events XML
-        if (gSessionData.mEventsXMLAppend != nullptr) {
-            std::unique_ptr<FILE, int (*)(FILE *)> fl {lib::fopen_cloexec(gSessionData.mEventsXMLAppend, "r"), fclose};
-            if (fl == nullptr) {
-                LOG_ERROR("Unable to open additional events XML %s", gSessionData.mEventsXMLAppend);
-                handleException();
+        /** Must be called with staticEventsMutex held */
+        StaticEvents & getStaticEvents(lib::Span<const GatorCpu> clusters, lib::Span<const UncorePmu> uncores)
+        {
+            std::vector<std::string> key {};
+            for (const GatorCpu & cluster : clusters) {
+                key.emplace_back(cluster.getId());
+            }
+            for (const UncorePmu & uncore : uncores) {
+                key.emplace_back(uncore.getId());
             }
 
-            mxml_unique_ptr appendXml = makeMxmlUniquePtr(mxmlLoadFile(nullptr, fl.get(), MXML_NO_CALLBACK));
-            if (appendXml == nullptr) {
-                LOG_ERROR("Unable to parse %s", gSessionData.mEventsXMLAppend);
+            if ((staticEvents.xml != nullptr) && (staticEvents.key == key)) {
+                return staticEvents;
+            }
+
+            auto xml = loadStaticTree(clusters, uncores);
+            mxml_node_t * events = getEventsElement(xml.get());
+            if (events == nullptr) {
+                LOG_ERROR(
+                    "Unable to find <events> node in the events.xml, please ensure the first two lines of events XML "
+                    "are:\n"
+                    "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                    "<events>");
                 handleException();
             }
 
-            // do the merge
-            mergeTrees(mainXml.get(), std::move(appendXml));
+            staticEvents.key = std::move(key);
+            staticEvents.xml = std::move(xml);
+            staticEvents.events = events;
+            staticEvents.counterToEventMap.clear();
+            addCountersToEvents(staticEvents.counterToEventMap, staticEvents.xml.get());
+            return staticEvents;
         }
 
-        // inject additional counter sets
-        processClusters(mainXml.get(), clusters, uncores);
-        return mainXml;
+        /**
+         * Temporarily adds the dynamic events from the drivers to the end of the cached static tree, and removes them
+         * again when destroyed so that the static tree can be reused by the next caller.
+         * Must only exist with staticEventsMutex held.
+         */
+        class DynamicEvents {
+        public:
+            DynamicEvents(StaticEvents & staticEvents, lib::Span<const Driver * const> drivers)
+                : staticEvents(staticEvents), lastStaticChild(mxmlGetLastChild(staticEvents.events))
+            {
+                // Add dynamic events from the drivers; they only ever append children to <events>
+                for (const Driver * driver : drivers) {
+                    driver->writeEvents(staticEvents.events);
+                }
+            }
+
+            DynamicEvents(const DynamicEvents &) = delete;
+            DynamicEvents & operator=(const DynamicEvents &) = delete;
+            DynamicEvents(DynamicEvents &&) = delete;
+            DynamicEvents & operator=(DynamicEvents &&) = delete;
+
+            ~DynamicEvents()
+            {
+                mxml_node_t * node;
+                while ((node = mxmlGetLastChild(staticEvents.events)) != lastStaticChild) {
+                    mxmlDelete(node);
+                }
+            }
+
+            [[nodiscard]] mxml_node_t * getXml() const { return staticEvents.xml.get(); }
+
+            /** @return The first node added by the drivers, or nullptr if there are none */
+            [[nodiscard]] mxml_node_t * getFirstDynamicChild() const
+            {
+                return (lastStaticChild != nullptr ? mxmlGetNextSibling(lastStaticChild)
+                                                   : mxmlGetFirstChild(staticEvents.events));
+            }
+
+        private:
+            StaticEvents & staticEvents;
+            mxml_node_t * const lastStaticChild;
+        };
     }
 
-    static std::unique_ptr<mxml_node_t, void (*)(mxml_node_t *)> getDynamicTree(lib::Span<const Driver * const> drivers,
-                                                                                lib::Span<const GatorCpu> clusters,
-                                                                                lib::Span<const UncorePmu> uncores)
+    void readStaticTree(lib::Span<const GatorCpu> clusters,
+                        lib::Span<const UncorePmu> uncores,
+                        lib::Span<Driver * const> drivers)
     {
-        auto xml = getStaticTree(clusters, uncores);
-        // Add dynamic events from the drivers
-        mxml_node_t * events = getEventsElement(xml.get());
-        if (events == nullptr) {
-            LOG_ERROR(
-                "Unable to find <events> node in the events.xml, please ensure the first two lines of events XML are:\n"
-                "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
-                "<events>");
-            handleException();
-        }
-        for (const Driver * driver : drivers) {
-            driver->writeEvents(events);
+        const std::lock_guard<std::mutex> lock {staticEventsMutex};
+        mxml_node_t * xml = getStaticEvents(clusters, uncores).xml.get();
+        for (Driver * driver : drivers) {
+            driver->readEvents(xml);
         }
-
-        return xml;
     }
 
     std::unique_ptr<char, void (*)(void *)> getDynamicXML(lib::Span<const Driver * const> drivers,
                                                           lib::Span<const GatorCpu> clusters,
                                                           lib::Span<const UncorePmu> uncores)
     {
-        const auto xml = getDynamicTree(drivers, clusters, uncores);
-        return {mxmlSaveAllocString(xml.get(), mxmlWhitespaceCB), &free};
+        const std::lock_guard<std::mutex> lock {staticEventsMutex};
+        const DynamicEvents xml {getStaticEvents(clusters, uncores), drivers};
+        return {mxmlSaveAllocString(xml.getXml(), mxmlWhitespaceCB), &free};
     }
 
     std::map<std::string, EventCode> getCounterToEventMap(lib::Span<const Driver * const> drivers,
                                                           lib::Span<const GatorCpu> clusters,
                                                           lib::Span<const UncorePmu> uncores)
     {
-        std::map<std::string, EventCode> counterToEventMap {};
-
-        auto xml = events_xml::getDynamicTree(drivers, clusters, uncores);
+        const std::lock_guard<std::mutex> lock {staticEventsMutex};
+        StaticEvents & events = getStaticEvents(clusters, uncores);
 
-        // build map of counter->event
-        mxml_node_t * node = xml.get();
-        while (true) {
-            node = mxmlFindElement(node, xml.get(), "event", nullptr, nullptr, MXML_DESCEND);
-            if (node == nullptr) {
-                break;
-            }
-            const char * counter = mxmlElementGetAttr(node, "counter");
-            const char * event = mxmlElementGetAttr(node, "event");
-            if (counter == nullptr) {
-                continue;
-            }
+        // the static part of the map is precomputed; the drivers' events follow it in document order so override it
+        std::map<std::string, EventCode> counterToEventMap {events.counterToEventMap};
 
-            if (event != nullptr) {
-                const auto eventNo = strtoull(event, nullptr, 0);
-                counterToEventMap[counter] = EventCode(eventNo);
-            }
-            else {
-                counterToEventMap[counter] = EventCode();
-            }
+        const DynamicEvents xml {events, drivers};
+        for (mxml_node_t * node = xml.getFirstDynamicChild(); node != nullptr; node = mxmlGetNextSibling(node)) {
+            addCountersToEvents(counterToEventMap, node);
         }
         return counterToEventMap;
     }
@@ -1,4 +1,4 @@
-/* Copyright (C) 2013-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2013-2022 by Arm Limited. All rights reserved. */
 
 #ifndef EVENTS_XML_H
 #define EVENTS_XML_H
@@ -17,11 +17,15 @@ class GatorCpu;
 class UncorePmu;
 
 namespace events_xml {
-    /// Gets the events that come from commandline/builtin events.xml
-    std::unique_ptr<mxml_node_t, void (*)(mxml_node_t *)> getStaticTree(lib::Span<const GatorCpu> clusters,
-                                                                        lib::Span<const UncorePmu> uncores);
-
-    /// Gets the events that come from commandline/builtin events.xml plus ones added by drivers
+    /// Passes the events that come from commandline/builtin events.xml to each driver's readEvents.
+    /// The tree is parsed once and cached for the life of the process (and so is inherited by forked sessions), so
+    /// the first call should be made before forking.
+    void readStaticTree(lib::Span<const GatorCpu> clusters,
+                        lib::Span<const UncorePmu> uncores,
+                        lib::Span<Driver * const> drivers);
+
+    /// Gets the events that come from commandline/builtin events.xml plus ones added by drivers.
+    /// Only the drivers' events are regenerated; the rest comes from the cached tree
     std::unique_ptr<char, void (*)(void *)> getDynamicXML(lib::Span<const Driver * const> drivers,
                                                           lib::Span<const GatorCpu> clusters,
                                                           lib::Span<const UncorePmu> uncores);
@@ -467,6 +467,30 @@ namespace events_xml {
         }
     }
 
+    void setClusterCounterSetGroups(mxml_node_t * xml, lib::Span<const GatorCpu> clusters, int groups)
+    {
+        std::map<std::string, int> countsByCounterSetName;
+        for (const GatorCpu & cluster : clusters) {
+            countsByCounterSetName.emplace(std::string(cluster.getId()) + "_cnt", cluster.getPmncCounters() * groups);
+        }
+
+        // a single walk of the tree, rather than one per cluster, as the tree may have thousands of events
+        for (mxml_node_t * node = mxmlFindElement(xml, xml, TAG_COUNTER_SET, nullptr, nullptr, MXML_DESCEND);
+             node != nullptr;
+             node = mxmlFindElement(node, xml, TAG_COUNTER_SET, nullptr, nullptr, MXML_DESCEND)) {
+            const char * const name = mxmlElementGetAttr(node, ATTR_NAME);
+            if (name == nullptr) {
+                continue;
+            }
+            const auto it = countsByCounterSetName.find(name);
+            if (it != countsByCounterSetName.end()) {
+                mxmlElementSetAttrf(node, ATTR_COUNT, "%i", it->second);
+                // only update the first counter_set of each name
+                countsByCounterSetName.erase(it);
+            }
+        }
+    }
+
     mxml_node_t * getEventsElement(mxml_node_t * xml)
     {
         return mxmlFindElement(xml, xml, TAG_EVENTS, nullptr, nullptr, MXML_DESCEND_FIRST);
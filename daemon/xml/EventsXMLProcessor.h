@@ -1,4 +1,4 @@
-/* Copyright (C) 2019-2021 by Arm Limited. All rights reserved. */
+/* Copyright (C) 2019-2022 by Arm Limited. All rights reserved. */
 
 #ifndef EVENTS_XML_PROCESSOR_H
 #define EVENTS_XML_PROCESSOR_H
@@ -30,6 +30,11 @@ namespace events_xml {
      */
     void processClusters(mxml_node_t * xml, lib::Span<const GatorCpu> clusters, lib::Span<const UncorePmu> uncores);
 
+    /**
+     * Set the size of the clusters' counter sets to allow the given number of PMU sized groups of events to be selected
+     */
+    void setClusterCounterSetGroups(mxml_node_t * xml, lib::Span<const GatorCpu> clusters, int groups);
+
     /**
      * Get the events element
      * @return The element
@@ -1,4 +1,4 @@
-## Copyright (C) 2010-2020 by Arm Limited. All rights reserved.
+## Copyright (C) 2010-2022 by Arm Limited. All rights reserved.
 ##
 ## This program is free software; you can redistribute it and/or modify
 ## it under the terms of the GNU General Public License version 2 as
@@ -49,6 +49,74 @@ def gator_gettid():
     """ Calls the gettid syscall to read back the linux thread ID """
     return __GATOR_LIBC.syscall(__GATOR_NR_gettid)
 
+def gator_pack_int(data, n):
+    """leb128 encode some integer and append the encoded bytes to data"""
+    # most values (cookies, line numbers, stack depths) fit in a single byte
+    if (n >= 0) and (n < 0x40):
+        data.append(n)
+        return
+    more = True
+    while more:
+        b = n & 0x7f
+        n = n >> 7
+        if ((n == 0) and ((b & 0x40) == 0)) or ((n == -1) and ((b & 0x40) != 0)):
+            more = False
+        else:
+            b = b | 0x80
+        data.append(b)
+
+##
+##    GatorConnection
+##
+class GatorConnection:
+    """A per-thread connection to gatord.
+
+    Messages are appended to a buffer and sent in batches, rather than making a system call for every call stack.
+    The protocol is a plain stream of messages, so gatord sees exactly the same bytes either way. The buffer is sent once
+    it is large enough or old enough, when profiling stops, and when the thread exits (as the connection is destroyed
+    along with the rest of the thread's data).
+    """
+
+    # send once this many bytes are buffered
+    FLUSH_SIZE = 64 * 1024
+    # or once the oldest buffered message is this old (in nanoseconds), so that live captures are not delayed
+    FLUSH_INTERVAL = 100000000
+
+    def __init__(self, sock):
+        self.socket = sock
+        self.buffer = bytearray()
+        self.buffered_since = 0
+
+    def __del__(self):
+        try:
+            self.flush()
+        except Exception:
+            # the modules may already be torn down if this is destroyed as the interpreter exits
+            pass
+
+    def append(self, data, timestamp):
+        """Buffer some message, sending the buffer if required. Returns False if the connection was lost."""
+        if not self.buffer:
+            self.buffered_since = timestamp
+        self.buffer.extend(data)
+        if (len(self.buffer) >= GatorConnection.FLUSH_SIZE) or ((timestamp - self.buffered_since) >= GatorConnection.FLUSH_INTERVAL):
+            return self.flush()
+        return True
+
+    def flush(self):
+        """Send anything that is buffered. Returns False if the connection was lost."""
+        if self.socket is None:
+            return False
+        if self.buffer:
+            try:
+                self.socket.sendall(self.buffer)
+            except (socket.error) as e:
+                self.socket = None
+                return False
+            finally:
+                del self.buffer[:]
+        return True
+
 ##
 ##    GatorProfiler
 ##
@@ -88,6 +156,9 @@ class GatorProfiler:
         self.__ignored_paths.append(self.__make_abs(__file__))
         self.__ignored_paths.extend([self.__strip_pyc(x) for x in ignored_paths])
         self.__ignored_paths = set(self.__ignored_paths)
+        # maps each code object's filename to its absolute path, or to None if it is ignored. Resolving the path
+        # may need to search the file system, so is far too slow to do for every frame of every call stack.
+        self.__filename_map = {}
         self.__debug("f = %s, i = %s" % (__file__, self.__ignored_paths,))
 
         try:
@@ -119,21 +190,24 @@ class GatorProfiler:
         if initialized is None:
             self.__debug("Initializing per thread data for %s:%s" % (os.getpid(), gator_gettid(), ))
             # Create the socket
+            object.connection = None
             try:
-                object.socket = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
-                object.socket.connect("\0streamline-annotate")
+                sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+                sock.connect("\0streamline-annotate")
                 # send the protocol identifier
-                object.socket.sendall(bytearray("SCRIPT STACK 1\n", 'utf8'))
+                sock.sendall(bytearray("SCRIPT STACK 1\n", 'utf8'))
                 # send python language cookie string
                 version_string = bytearray("Python %s.%s.%s" % (sys.version_info.major, sys.version_info.minor, sys.version_info.micro), 'utf8')
-                data = [0x00]
-                data.extend(self.__pack_int(self.__python_language_cookie))
-                data.extend(self.__pack_int(len(version_string)))
+                data = bytearray([0x00])
+                gator_pack_int(data, self.__python_language_cookie)
+                gator_pack_int(data, len(version_string))
                 data.extend(version_string)
-                object.socket.sendall(bytearray(data))
+                sock.sendall(data)
+                object.connection = GatorConnection(sock)
             except (socket.error) as e:
                 self.__debug("gator: Cannot connect to gatord for thread %s:%s\n" % (os.getpid(), gator_gettid(), ))
-                object.socket = None
+            # the thread id never changes, so only make the system call once
+            object.tid = gator_gettid()
             # configure cookies
             object.cookie_counter = 1
             object.cookie_map = {}
@@ -164,58 +238,75 @@ class GatorProfiler:
     def __is_traced_event(self, event):
         return (self.__trace_mode and (event == 'line')) or ((not self.__trace_mode) and (event == 'call'))
 
+    def __filename_for(self, co_filename):
+        """Get the absolute path of some code object's filename, or None if it is ignored"""
+        try:
+            return self.__filename_map[co_filename]
+        except KeyError:
+            abs_filename = self.__make_abs(co_filename)
+            result = None if self.__is_ignored(abs_filename) else abs_filename
+            self.__filename_map[co_filename] = result
+            return result
+
     def __profile_handler(self, frame, event, arg):
         """Main profiling function, called by either sys.settrace or sys.setprofile action"""
-        self.__debug("__profile_handler('%s', %s, '%s')" % (frame.f_code.co_filename, frame.f_lineno, event))
-        if self.__is_ignored(self.__make_abs(frame.f_code.co_filename)):
+        if self.__debug_enabled:
+            self.__debug("__profile_handler('%s', %s, '%s')" % (frame.f_code.co_filename, frame.f_lineno, event))
+        if self.__filename_for(frame.f_code.co_filename) is None:
             return None
         tls_data = self.__get_tls_data()
         if (self.__is_traced_event(event)):
             stack = []
             while (frame is not None):
-                abs_filename = self.__make_abs(frame.f_code.co_filename)
-                if self.__is_ignored(abs_filename):
+                abs_filename = self.__filename_for(frame.f_code.co_filename)
+                if abs_filename is None:
                     break
                 stack.append((self.__cookie_for(tls_data, abs_filename), frame.f_lineno))
                 frame = frame.f_back
             if (len(stack) > 0):
-                self.__emit(tls_data, os.getpid(), gator_gettid(), gator_monotonic_time(), stack)
-        socket = getattr(tls_data, 'socket', None)
-        return self.__profile_handler if socket is not None else None
+                self.__emit(tls_data, os.getpid(), tls_data.tid, gator_monotonic_time(), stack)
+        return self.__profile_handler if tls_data.connection is not None else None
+
+    def __send(self, tls_data, data, timestamp):
+        """Buffer some message for gatord"""
+        if not tls_data.connection.append(data, timestamp):
+            self.__debug("gator: Lost connection to socket: %s:%s\n" % (os.getpid(), tls_data.tid, ))
+            tls_data.connection = None
+
+    def __flush(self):
+        """Send anything buffered by the current thread"""
+        tls_data = self.__get_tls_data()
+        if (tls_data.connection is not None) and not tls_data.connection.flush():
+            self.__debug("gator: Lost connection to socket: %s:%s\n" % (os.getpid(), tls_data.tid, ))
+            tls_data.connection = None
 
     def __emit(self, tls_data, pid, tid, timestamp, stack):
         """Transmit a call stack message to gatord"""
-        self.__debug("__emit(%s, %s, %s, %s)" % (pid, tid, timestamp, stack, ))
-        if tls_data.socket is not None:
-            data = [0x2]
-            data.extend(self.__pack_int(timestamp))
-            data.extend(self.__pack_int(pid))
-            data.extend(self.__pack_int(tid))
-            data.extend(self.__pack_int(len(stack)))
+        if self.__debug_enabled:
+            self.__debug("__emit(%s, %s, %s, %s)" % (pid, tid, timestamp, stack, ))
+        if tls_data.connection is not None:
+            data = bytearray([0x2])
+            gator_pack_int(data, timestamp)
+            gator_pack_int(data, pid)
+            gator_pack_int(data, tid)
+            gator_pack_int(data, len(stack))
             for cookie, line in stack:
-                data.extend(self.__pack_int(cookie))
-                data.extend(self.__pack_int(line))
-            try:
-                tls_data.socket.sendall(bytearray(data))
-            except (socket.error) as e:
-                self.__debug("gator: Lost connection to socket: %s:%s %s\n" % (os.getpid(), gator_gettid(), e, ))
-                tls_data.socket = None
+                gator_pack_int(data, cookie)
+                gator_pack_int(data, line)
+            self.__send(tls_data, data, timestamp)
 
     def __emit_cookie(self, tls_data, filename, cookie):
         """Transmit a new source file cookie message to gatord"""
         self.__debug("__emit_cookie('%s', %s)" % (filename, cookie, ))
-        if tls_data.socket is not None:
+        if tls_data.connection is not None:
             filename_bytes = bytearray(filename, 'utf8')
-            data = [0x1]
-            data.extend(self.__pack_int(self.__python_language_cookie))
-            data.extend(self.__pack_int(cookie))
-            data.extend(self.__pack_int(len(filename_bytes)))
+            data = bytearray([0x1])
+            gator_pack_int(data, self.__python_language_cookie)
+            gator_pack_int(data, cookie)
+            gator_pack_int(data, len(filename_bytes))
             data.extend(filename_bytes)
-            try:
-                tls_data.socket.sendall(bytearray(data))
-            except (socket.error) as e:
-                self.__debug("gator: Lost connection to socket: %s:%s %s\n" % (os.getpid(), gator_gettid(), e, ))
-                tls_data.socket = None
+            # the cookie must precede the call stacks that use it, so it is buffered along with them
+            self.__send(tls_data, data, gator_monotonic_time())
 
     def __make_abs(self, filename):
         """Convert the filename given to an absolute path"""
@@ -245,20 +336,6 @@ class GatorProfiler:
         self.__emit_cookie(tls_data, filename, result)
         return result
 
-    def __pack_int(self, n):
-        """leb128 encode some integer and return the encoded bytes"""
-        result = []
-        more = True
-        while more:
-            b = n & 0x7f
-            n = n >> 7
-            if ((n == 0) and ((b & 0x40) == 0)) or ((n == -1) and ((b & 0x40) != 0)):
-                more = False
-            else:
-                b = b | 0x80
-            result.append(b)
-        return result
-
     def run(self, script_or_code):
         """Equivalent to `runctx(script_or_code, __main__.__dict__, __main__.__dict__)`"""
         self.runctx(script_or_code, dict, dict)
@@ -276,6 +353,7 @@ class GatorProfiler:
             exec(script_or_code, globals, locals)
         finally:
             self.__unsetprofile()
+            self.__flush()
 
     def call(self, callable, args=(), kwargs={}):
         """
@@ -293,6 +371,7 @@ class GatorProfiler:
             return callable(*args, **kwargs)
         finally:
             self.__unsetprofile()
+            self.__flush()
 
 ##
 ##    Command line interface